@@ -18,6 +18,8 @@
 
 package org.collectd.api;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.ArrayList;
 import java.util.List;
 
@@ -31,6 +33,13 @@ public class ValueList extends PluginData {
 
     private long _interval = 0;
 
+    /* Values of batch writes are not converted to Number objects up front.
+     * Instead they are read from a direct buffer shared with the daemon, one
+     * 8 byte value in native byte order per data source, starting with the
+     * value at index _valueOffset. */
+    private ByteBuffer _valueBuffer = null;
+    private int _valueOffset = 0;
+
     public ValueList() {
         
     }
@@ -42,27 +51,106 @@ public class ValueList extends PluginData {
     public ValueList(ValueList vl) {
         this((PluginData)vl);
         _interval = vl._interval;
-        _values.addAll(vl.getValues());
+        if (vl._valueBuffer != null) {
+            for (int i = 0; i < vl._ds.getDataSources().size(); i++) {
+                if (vl.getValueType(i) == DataSource.TYPE_GAUGE)
+                    _values.add(Double.valueOf(vl.getDoubleValue(i)));
+                else
+                    _values.add(Long.valueOf(vl.getLongValue(i)));
+            }
+        }
+        else
+            _values.addAll(vl.getValues());
 	_ds = vl._ds;
     }
 
     public List<Number> getValues() {
+        if (_valueBuffer != null)
+            unpackValues();
         return _values;
     }
 
     public void setValues(List<Number> values) {
+        _valueBuffer = null;
         _values = values;
     }
 
     public void addValue(Number value) {
+        if (_valueBuffer != null)
+            unpackValues();
         _values.add(value);
     }
 
     /* Used by the network parsing code */
     public void clearValues () {
+        _valueBuffer = null;
         _values.clear ();
     }
 
+    /**
+     * Returns the value of the data source with the given index as a double,
+     * without creating a Number object.
+     */
+    public double getDoubleValue(int index) {
+        if (_valueBuffer == null)
+            return _values.get(index).doubleValue();
+        int pos = (_valueOffset + index) * 8;
+        if (getValueType(index) == DataSource.TYPE_GAUGE)
+            return _valueBuffer.getDouble(pos);
+        return (double)_valueBuffer.getLong(pos);
+    }
+
+    /**
+     * Returns the value of the data source with the given index as a long,
+     * without creating a Number object.
+     */
+    public long getLongValue(int index) {
+        if (_valueBuffer == null)
+            return _values.get(index).longValue();
+        int pos = (_valueOffset + index) * 8;
+        if (getValueType(index) == DataSource.TYPE_GAUGE)
+            return (long)_valueBuffer.getDouble(pos);
+        return _valueBuffer.getLong(pos);
+    }
+
+    private int getValueType(int index) {
+        return _ds.getDataSources().get(index).getType();
+    }
+
+    private void unpackValues() {
+        List<DataSource> dsrc = _ds.getDataSources();
+        List<Number> values = new ArrayList<Number>(dsrc.size());
+        for (int i = 0; i < dsrc.size(); i++) {
+            int pos = (_valueOffset + i) * 8;
+            if (dsrc.get(i).getType() == DataSource.TYPE_GAUGE)
+                values.add(Double.valueOf(_valueBuffer.getDouble(pos)));
+            else
+                values.add(Long.valueOf(_valueBuffer.getLong(pos)));
+        }
+        _values = values;
+        _valueBuffer = null;
+    }
+
+    /* Called by the daemon to set all members with a single JNI call. If
+     * "values" is null, the daemon adds the values to this (new) object with
+     * addValue() afterwards. */
+    void fill(String host, String plugin, String pluginInstance,
+              String type, String typeInstance, long time, long interval,
+              DataSet ds, ByteBuffer values, int offset) {
+        _host = host;
+        _plugin = plugin;
+        _pluginInstance = pluginInstance;
+        _type = type;
+        _typeInstance = typeInstance;
+        _time = time;
+        _interval = interval;
+        _ds = ds;
+        if (values != null && values.order() != ByteOrder.nativeOrder())
+            values.order(ByteOrder.nativeOrder());
+        _valueBuffer = values;
+        _valueOffset = offset;
+    }
+
     /**
      * @deprecated Use {@link #getDataSet()} instead.
      */
@@ -105,9 +193,10 @@ public class ValueList extends PluginData {
         StringBuffer sb = new StringBuffer(super.toString());
         sb.append("=[");
         List<DataSource> ds = getDataSource();
-        int size = _values.size();
+        List<Number> values = getValues();
+        int size = values.size();
         for (int i=0; i<size; i++) {
-            Number val = _values.get(i);
+            Number val = values.get(i);
             String name;
             if (ds == null) {
                 name = "unknown" + i;
@@ -30,12 +30,17 @@
 #include "utils/common/common.h"
 #include "utils/lookup/vl_lookup.h"
 #include "utils/metadata/meta_data.h"
-#include "utils_cache.h" /* for uc_get_rate() */
+#include "utils_cache.h" /* for uc_get_rate_into() */
 #include "utils_subst.h"
 
 #define AGG_MATCHES_ALL(str) (strcmp("/.*/", str) == 0)
 #define AGG_FUNC_PLACEHOLDER "%{aggregation}"
 
+/* Number of partial aggregates kept per instance. Each thread calling the
+ * write callback is assigned one of them, so that writers running in parallel
+ * don't contend for the same lock. */
+#define AGG_PARTIALS_NUM 16
+
 struct aggregation_s /* {{{ */
 {
   lookup_identifier_t ident;
@@ -57,14 +62,10 @@ struct aggregation_s /* {{{ */
 }; /* }}} */
 typedef struct aggregation_s aggregation_t;
 
-struct agg_instance_s;
-typedef struct agg_instance_s agg_instance_t;
-struct agg_instance_s /* {{{ */
+/* Values received since the last read of an aggregation instance. */
+struct agg_partial_s /* {{{ */
 {
   pthread_mutex_t lock;
-  lookup_identifier_t ident;
-
-  int ds_type;
 
   derive_t num;
   gauge_t sum;
@@ -72,6 +73,19 @@ struct agg_instance_s /* {{{ */
 
   gauge_t min;
   gauge_t max;
+}; /* }}} */
+typedef struct agg_partial_s agg_partial_t;
+
+struct agg_instance_s;
+typedef struct agg_instance_s agg_instance_t;
+struct agg_instance_s /* {{{ */
+{
+  pthread_mutex_t lock;
+  lookup_identifier_t ident;
+
+  int ds_type;
+
+  agg_partial_t partials[AGG_PARTIALS_NUM];
 
   rate_to_value_state_t *state_num;
   rate_to_value_state_t *state_sum;
@@ -88,6 +102,11 @@ static lookup_t *lookup;
 static pthread_mutex_t agg_instance_list_lock = PTHREAD_MUTEX_INITIALIZER;
 static agg_instance_t *agg_instance_list_head;
 
+/* Index of the partial aggregate used by the calling thread, plus one. */
+static pthread_key_t agg_partial_key;
+static pthread_mutex_t agg_partial_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t agg_partial_next;
+
 static bool agg_is_regex(char const *str) /* {{{ */
 {
   if (str == NULL)
@@ -134,12 +153,40 @@ static void agg_instance_destroy(agg_instance_t *inst) /* {{{ */
   sfree(inst->state_max);
   sfree(inst->state_stddev);
 
+  for (size_t i = 0; i < AGG_PARTIALS_NUM; i++)
+    pthread_mutex_destroy(&inst->partials[i].lock);
+
   memset(inst, 0, sizeof(*inst));
   inst->ds_type = -1;
-  inst->min = NAN;
-  inst->max = NAN;
 } /* }}} void agg_instance_destroy */
 
+static void agg_partial_reset(agg_partial_t *p) /* {{{ */
+{
+  p->num = 0;
+  p->sum = 0.0;
+  p->squares_sum = 0.0;
+  p->min = NAN;
+  p->max = NAN;
+} /* }}} void agg_partial_reset */
+
+/* Returns the index of the partial aggregate the calling thread updates. The
+ * threads are assigned the partials in a round-robin fashion on their first
+ * call. */
+static size_t agg_partial_index(void) /* {{{ */
+{
+  uintptr_t index = (uintptr_t)pthread_getspecific(agg_partial_key);
+  if (index != 0)
+    return (size_t)(index - 1);
+
+  pthread_mutex_lock(&agg_partial_lock);
+  index = (uintptr_t)(agg_partial_next % AGG_PARTIALS_NUM);
+  agg_partial_next++;
+  pthread_mutex_unlock(&agg_partial_lock);
+
+  pthread_setspecific(agg_partial_key, (void *)(index + 1));
+  return (size_t)index;
+} /* }}} size_t agg_partial_index */
+
 static int agg_instance_create_name(agg_instance_t *inst, /* {{{ */
                                     value_list_t const *vl,
                                     aggregation_t const *agg) {
@@ -244,8 +291,10 @@ static agg_instance_t *agg_instance_create(data_set_t const *ds, /* {{{ */
 
   agg_instance_create_name(inst, vl, agg);
 
-  inst->min = NAN;
-  inst->max = NAN;
+  for (size_t i = 0; i < AGG_PARTIALS_NUM; i++) {
+    pthread_mutex_init(&inst->partials[i].lock, /* attr = */ NULL);
+    agg_partial_reset(&inst->partials[i]);
+  }
 
 #define INIT_STATE(field)                                                      \
   do {                                                                         \
@@ -278,10 +327,10 @@ static agg_instance_t *agg_instance_create(data_set_t const *ds, /* {{{ */
   return inst;
 } /* }}} agg_instance_t *agg_instance_create */
 
-/* Update the num, sum, min, max, ... fields of the aggregation instance, if
- * the rate of the value list is available. Value lists with more than one data
- * source are not supported and will return an error. Returns zero on success
- * and non-zero otherwise. */
+/* Update the num, sum, min, max, ... fields of the calling thread's partial
+ * aggregate, if the rate of the value list is available. Value lists with more
+ * than one data source are not supported and will return an error. Returns
+ * zero on success and non-zero otherwise. */
 static int agg_instance_update(agg_instance_t *inst, /* {{{ */
                                data_set_t const *ds, value_list_t const *vl) {
   if (ds->ds_num != 1) {
@@ -292,34 +341,37 @@ static int agg_instance_update(agg_instance_t *inst, /* {{{ */
     return EINVAL;
   }
 
-  gauge_t *rate = uc_get_rate(ds, vl);
-  if (rate == NULL) {
-    char ident[6 * DATA_MAX_NAME_LEN];
-    FORMAT_VL(ident, sizeof(ident), vl);
-    ERROR("aggregation plugin: Unable to read the current rate of \"%s\".",
-          ident);
-    return ENOENT;
+  gauge_t rate;
+  if (ds->ds[0].type == DS_TYPE_GAUGE) {
+    /* The rate of a gauge is the value itself. */
+    rate = vl->values[0].gauge;
+  } else {
+    if (uc_get_rate_into(ds, vl, &rate, 1) != 0) {
+      char ident[6 * DATA_MAX_NAME_LEN];
+      FORMAT_VL(ident, sizeof(ident), vl);
+      ERROR("aggregation plugin: Unable to read the current rate of \"%s\".",
+            ident);
+      return ENOENT;
+    }
   }
 
-  if (isnan(rate[0])) {
-    sfree(rate);
+  if (isnan(rate))
     return 0;
-  }
 
-  pthread_mutex_lock(&inst->lock);
+  agg_partial_t *p = &inst->partials[agg_partial_index()];
+  pthread_mutex_lock(&p->lock);
 
-  inst->num++;
-  inst->sum += rate[0];
-  inst->squares_sum += (rate[0] * rate[0]);
+  p->num++;
+  p->sum += rate;
+  p->squares_sum += (rate * rate);
 
-  if (isnan(inst->min) || (inst->min > rate[0]))
-    inst->min = rate[0];
-  if (isnan(inst->max) || (inst->max < rate[0]))
-    inst->max = rate[0];
+  if (isnan(p->min) || (p->min > rate))
+    p->min = rate;
+  if (isnan(p->max) || (p->max < rate))
+    p->max = rate;
 
-  pthread_mutex_unlock(&inst->lock);
+  pthread_mutex_unlock(&p->lock);
 
-  sfree(rate);
   return 0;
 } /* }}} int agg_instance_update */
 
@@ -393,27 +445,41 @@ static int agg_instance_read(agg_instance_t *inst, cdtime_t t) /* {{{ */
 
   pthread_mutex_lock(&inst->lock);
 
-  READ_FUNC(num, (gauge_t)inst->num);
+  /* Merge the partial aggregates and reset them. Each partial is locked on its
+   * own, so writers are only blocked for the duration of the copy. */
+  agg_partial_t total;
+  agg_partial_reset(&total);
+  for (size_t i = 0; i < AGG_PARTIALS_NUM; i++) {
+    agg_partial_t *p = &inst->partials[i];
+
+    pthread_mutex_lock(&p->lock);
+    if (p->num > 0) {
+      total.num += p->num;
+      total.sum += p->sum;
+      total.squares_sum += p->squares_sum;
+      if (isnan(total.min) || (total.min > p->min))
+        total.min = p->min;
+      if (isnan(total.max) || (total.max < p->max))
+        total.max = p->max;
+      agg_partial_reset(p);
+    }
+    pthread_mutex_unlock(&p->lock);
+  }
+
+  READ_FUNC(num, (gauge_t)total.num);
 
   /* All other aggregations are only defined when there have been any values
    * at all. */
-  if (inst->num > 0) {
-    READ_FUNC(sum, inst->sum);
-    READ_FUNC(average, (inst->sum / ((gauge_t)inst->num)));
-    READ_FUNC(min, inst->min);
-    READ_FUNC(max, inst->max);
-    READ_FUNC(stddev, sqrt((((gauge_t)inst->num) * inst->squares_sum) -
-                           (inst->sum * inst->sum)) /
-                          ((gauge_t)inst->num));
+  if (total.num > 0) {
+    READ_FUNC(sum, total.sum);
+    READ_FUNC(average, (total.sum / ((gauge_t)total.num)));
+    READ_FUNC(min, total.min);
+    READ_FUNC(max, total.max);
+    READ_FUNC(stddev, sqrt((((gauge_t)total.num) * total.squares_sum) -
+                           (total.sum * total.sum)) /
+                          ((gauge_t)total.num));
   }
 
-  /* Reset internal state. */
-  inst->num = 0;
-  inst->sum = 0.0;
-  inst->squares_sum = 0.0;
-  inst->min = NAN;
-  inst->max = NAN;
-
   pthread_mutex_unlock(&inst->lock);
 
   meta_data_destroy(vl.meta);
@@ -738,8 +804,27 @@ static int agg_write(data_set_t const *ds, value_list_t const *vl, /* {{{ */
   return status;
 } /* }}} int agg_write */
 
+static int agg_init(void) /* {{{ */
+{
+  static bool have_init;
+
+  if (have_init)
+    return 0;
+
+  int status = pthread_key_create(&agg_partial_key, /* destructor = */ NULL);
+  if (status != 0) {
+    ERROR("aggregation plugin: pthread_key_create failed: %s",
+          STRERROR(status));
+    return -1;
+  }
+  have_init = true;
+
+  return 0;
+} /* }}} int agg_init */
+
 void module_register(void) {
   plugin_register_complex_config("aggregation", agg_config);
+  plugin_register_init("aggregation", agg_init);
   plugin_register_read("aggregation", agg_read);
   plugin_register_write("aggregation", agg_write, /* user_data = */ NULL);
 }
@@ -29,6 +29,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/cmds/putval.h"
 #include "utils/common/common.h"
 #include "utils/format_graphite/format_graphite.h"
@@ -64,9 +65,19 @@ int amqp_socket_close(amqp_socket_t *);
 
 #define CAMQP_CHANNEL 1
 
+#if defined(AMQP_VERSION) && AMQP_VERSION >= 0x00080000
+#define CAMQP_HAVE_CONFIRMS 1
+#endif
+
+/* With publisher confirms, writers block while more than this many messages
+ * are unconfirmed, but at most for CAMQP_CONFIRM_TIMEOUT. */
+#define CAMQP_MAX_UNCONFIRMED 1024
+#define CAMQP_CONFIRM_TIMEOUT TIME_T_TO_CDTIME_T(10)
+
 /*
  * Data types
  */
+typedef struct camqp_config_s camqp_config_t;
 struct camqp_config_s {
   bool publish;
   char *name;
@@ -90,11 +101,30 @@ struct camqp_config_s {
 
   /* Number of seconds to wait before connection is retried */
   int connection_retry_delay;
+  time_t last_connect_time;
 
   /* publish only */
   uint8_t delivery_mode;
   bool store_rates;
   int format;
+  /* Shared with pool members, which never format value lists. */
+  format_json_cache_t *json_cache;
+  /* Value lists are collected into one message per routing key, until the
+   * message would exceed "batch_max_size" bytes or is older than
+   * "batch_max_age". Disabled if "batch_max_size" is zero. */
+  size_t batch_max_size;
+  cdtime_t batch_max_age;
+  cdtime_t batch_last_sweep;
+  c_avl_tree_t *batches;
+  /* Additional connections used by parallel writers. Pool members share the
+   * configuration strings with the connection they were copied from. */
+  camqp_config_t **pool;
+  size_t pool_num;
+  bool pool_member;
+  /* Publisher confirms */
+  bool confirm;
+  uint64_t published;
+  uint64_t unconfirmed;
   /* publish & graphite format only */
   char *prefix;
   char *postfix;
@@ -110,7 +140,12 @@ struct camqp_config_s {
   amqp_connection_state_t connection;
   pthread_mutex_t lock;
 };
-typedef struct camqp_config_s camqp_config_t;
+
+typedef struct {
+  char *buffer;
+  size_t fill;
+  cdtime_t first;
+} camqp_batch_t;
 
 /*
  * Global variables
@@ -142,8 +177,19 @@ static void camqp_close_connection(camqp_config_t *conf) /* {{{ */
   amqp_destroy_connection(conf->connection);
   close(sockfd);
   conf->connection = NULL;
+
+  if (conf->unconfirmed > 0)
+    WARNING("amqp plugin: %" PRIu64 " messages have not been confirmed "
+            "by the broker.",
+            conf->unconfirmed);
+  /* Delivery tags start over on the next channel. */
+  conf->published = 0;
+  conf->unconfirmed = 0;
 } /* }}} void camqp_close_connection */
 
+static void camqp_batches_flush(camqp_config_t *conf, cdtime_t timeout);
+static int camqp_confirm_poll(camqp_config_t *conf, uint64_t max_unconfirmed);
+
 static void camqp_config_free(void *ptr) /* {{{ */
 {
   camqp_config_t *conf = ptr;
@@ -151,8 +197,34 @@ static void camqp_config_free(void *ptr) /* {{{ */
   if (conf == NULL)
     return;
 
+  for (size_t i = 0; i < conf->pool_num; i++)
+    camqp_config_free(conf->pool[i]);
+  sfree(conf->pool);
+
+  if (conf->batches != NULL) {
+    void *key;
+    void *value;
+
+    camqp_batches_flush(conf, /* timeout = */ 0);
+    while (c_avl_pick(conf->batches, &key, &value) == 0) {
+      camqp_batch_t *b = value;
+      sfree(key);
+      sfree(b->buffer);
+      sfree(b);
+    }
+    c_avl_destroy(conf->batches);
+  }
+
+  if (conf->confirm && (conf->connection != NULL))
+    camqp_confirm_poll(conf, /* max_unconfirmed = */ 0);
   camqp_close_connection(conf);
 
+  /* Pool members only borrow the configuration. */
+  if (conf->pool_member) {
+    sfree(conf);
+    return;
+  }
+
   sfree(conf->name);
   strarray_free(conf->hosts, conf->hosts_count);
   sfree(conf->vhost);
@@ -167,6 +239,7 @@ static void camqp_config_free(void *ptr) /* {{{ */
   sfree(conf->routing_key);
   sfree(conf->prefix);
   sfree(conf->postfix);
+  format_json_cache_destroy(conf->json_cache);
 
   sfree(conf);
 } /* }}} void camqp_config_free */
@@ -409,8 +482,6 @@ static int camqp_setup_queue(camqp_config_t *conf) /* {{{ */
 
 static int camqp_connect(camqp_config_t *conf) /* {{{ */
 {
-  static time_t last_connect_time;
-
   amqp_rpc_reply_t reply;
   int status;
 #ifdef HAVE_AMQP_TCP_SOCKET
@@ -423,14 +494,14 @@ static int camqp_connect(camqp_config_t *conf) /* {{{ */
     return 0;
 
   time_t now = time(NULL);
-  if (now < (last_connect_time + conf->connection_retry_delay)) {
+  if (now < (conf->last_connect_time + conf->connection_retry_delay)) {
     DEBUG("amqp plugin: skipping connection retry, "
           "ConnectionRetryDelay: %d",
           conf->connection_retry_delay);
     return 1;
   } else {
     DEBUG("amqp plugin: retrying connection");
-    last_connect_time = now;
+    conf->last_connect_time = now;
   }
 
   conf->connection = amqp_new_connection();
@@ -544,6 +615,19 @@ static int camqp_connect(camqp_config_t *conf) /* {{{ */
        "on %s:%i.",
        CONF(conf, vhost), host, conf->port);
 
+#if CAMQP_HAVE_CONFIRMS
+  if (conf->confirm) {
+    amqp_confirm_select(conf->connection, CAMQP_CHANNEL);
+    if (camqp_is_error(conf)) {
+      char errbuf[1024];
+      ERROR("amqp plugin: amqp_confirm_select failed: %s",
+            camqp_strerror(conf, errbuf, sizeof(errbuf)));
+      camqp_close_connection(conf);
+      return 1;
+    }
+  }
+#endif
+
   status = camqp_create_exchange(conf);
   if (status != 0)
     return status;
@@ -578,6 +662,72 @@ static int camqp_shutdown(void) /* {{{ */
 /*
  * Subscribing code
  */
+/* Parses one PUTVAL command per line and dispatches all value lists of the
+ * message at once. */
+static int camqp_dispatch_putval(char *body) /* {{{ */
+{
+  cmd_error_handler_t err = {cmd_error_fh, stderr};
+  cmd_t *cmds = NULL;
+  size_t cmds_num = 0;
+  size_t vl_num = 0;
+  int status = 0;
+
+  char *saveptr = NULL;
+  for (char *line = strtok_r(body, "\r\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\r\n", &saveptr)) {
+    cmd_t cmd;
+
+    if (cmd_parse(line, &cmd, NULL, &err) != CMD_OK) {
+      status = -1;
+      continue;
+    }
+    if (cmd.type != CMD_PUTVAL) {
+      cmd_error(CMD_UNKNOWN_COMMAND, &err, "Unexpected command: `%s'.",
+                CMD_TO_STRING(cmd.type));
+      cmd_destroy(&cmd);
+      status = -1;
+      continue;
+    }
+
+    cmd_t *tmp = realloc(cmds, (cmds_num + 1) * sizeof(*cmds));
+    if (tmp == NULL) {
+      cmd_destroy(&cmd);
+      status = ENOMEM;
+      break;
+    }
+    cmds = tmp;
+    cmds[cmds_num] = cmd;
+    cmds_num++;
+    vl_num += cmd.cmd.putval.vl_num;
+  }
+
+  if (cmds_num == 1) {
+    plugin_dispatch_values_batch(cmds[0].cmd.putval.vl, vl_num);
+  } else if (cmds_num > 1) {
+    /* The value lists are copied shallowly; "values" remain owned by the
+     * commands. */
+    value_list_t *vl = calloc(vl_num, sizeof(*vl));
+    if (vl == NULL) {
+      status = ENOMEM;
+    } else {
+      size_t n = 0;
+      for (size_t i = 0; i < cmds_num; i++) {
+        memcpy(vl + n, cmds[i].cmd.putval.vl,
+               cmds[i].cmd.putval.vl_num * sizeof(*vl));
+        n += cmds[i].cmd.putval.vl_num;
+      }
+      plugin_dispatch_values_batch(vl, vl_num);
+      sfree(vl);
+    }
+  }
+
+  for (size_t i = 0; i < cmds_num; i++)
+    cmd_destroy(cmds + i);
+  sfree(cmds);
+
+  return status;
+} /* }}} int camqp_dispatch_putval */
+
 static int camqp_read_body(camqp_config_t *conf, /* {{{ */
                            size_t body_size, const char *content_type) {
   char body[body_size + 1];
@@ -616,9 +766,11 @@ static int camqp_read_body(camqp_config_t *conf, /* {{{ */
   } /* while (received < body_size) */
 
   if (strcasecmp("text/collectd", content_type) == 0) {
-    status = cmd_handle_putval(stderr, body);
+    status = camqp_dispatch_putval(body);
     if (status != 0)
-      ERROR("amqp plugin: cmd_handle_putval failed with status %i.", status);
+      ERROR("amqp plugin: Dispatching \"PUTVAL\" commands failed with "
+            "status %i.",
+            status);
     return status;
   } else if (strcasecmp("application/json", content_type) == 0) {
     ERROR("amqp plugin: camqp_read_body: Parsing JSON data has not "
@@ -749,9 +901,79 @@ static int camqp_subscribe_init(camqp_config_t *conf) /* {{{ */
 /*
  * Publishing code
  */
+#if CAMQP_HAVE_CONFIRMS
+/* Marks messages up to "tag" as confirmed and returns their number. */
+static uint64_t camqp_confirm(camqp_config_t *conf, /* {{{ */
+                              uint64_t tag, bool multiple) {
+  uint64_t num;
+
+  if (!multiple)
+    num = 1;
+  else if (tag <= conf->published)
+    num = conf->unconfirmed - (conf->published - tag);
+  else
+    num = conf->unconfirmed;
+
+  if (num > conf->unconfirmed)
+    num = conf->unconfirmed;
+  conf->unconfirmed -= num;
+  return num;
+} /* }}} uint64_t camqp_confirm */
+#endif
+
+/* Processes the publisher confirms that have arrived. Blocks while more than
+ * "max_unconfirmed" messages are unconfirmed, but at most for
+ * CAMQP_CONFIRM_TIMEOUT. You must hold "conf->lock". */
+static int camqp_confirm_poll(camqp_config_t *conf, /* {{{ */
+                              uint64_t max_unconfirmed) {
+#if CAMQP_HAVE_CONFIRMS
+  cdtime_t deadline = cdtime() + CAMQP_CONFIRM_TIMEOUT;
+
+  while ((conf->connection != NULL) && (conf->unconfirmed > 0)) {
+    bool block = (conf->unconfirmed > max_unconfirmed);
+    cdtime_t now = cdtime();
+    struct timeval tv = CDTIME_T_TO_TIMEVAL(
+        (block && (now < deadline)) ? (deadline - now) : 0);
+    amqp_frame_t frame;
+
+    int status = amqp_simple_wait_frame_noblock(conf->connection, &frame, &tv);
+    if (status == AMQP_STATUS_TIMEOUT) {
+      if (!block)
+        return 0;
+      ERROR("amqp plugin: Timed out waiting for publisher confirms.");
+      camqp_close_connection(conf);
+      return -1;
+    } else if (status != AMQP_STATUS_OK) {
+      ERROR("amqp plugin: Waiting for publisher confirms failed: %s",
+            amqp_error_string2(status));
+      camqp_close_connection(conf);
+      return -1;
+    }
+
+    if (frame.frame_type != AMQP_FRAME_METHOD)
+      continue;
+
+    if (frame.payload.method.id == AMQP_BASIC_ACK_METHOD) {
+      amqp_basic_ack_t *ack = frame.payload.method.decoded;
+      camqp_confirm(conf, ack->delivery_tag, ack->multiple);
+    } else if (frame.payload.method.id == AMQP_BASIC_NACK_METHOD) {
+      amqp_basic_nack_t *nack = frame.payload.method.decoded;
+      uint64_t num = camqp_confirm(conf, nack->delivery_tag, nack->multiple);
+      ERROR("amqp plugin: The broker rejected %" PRIu64 " message(s).", num);
+    } else if (frame.payload.method.id == AMQP_CHANNEL_CLOSE_METHOD) {
+      ERROR("amqp plugin: The broker closed the channel.");
+      camqp_close_connection(conf);
+      return -1;
+    }
+  }
+#endif
+
+  return 0;
+} /* }}} int camqp_confirm_poll */
+
 /* XXX: You must hold "conf->lock" when calling this function! */
 static int camqp_write_locked(camqp_config_t *conf, /* {{{ */
-                              const char *buffer, const char *routing_key) {
+                              amqp_bytes_t body, const char *routing_key) {
   int status;
 
   status = camqp_connect(conf);
@@ -778,15 +1000,163 @@ static int camqp_write_locked(camqp_config_t *conf, /* {{{ */
       /* channel = */ 1, amqp_cstring_bytes(CONF(conf, exchange)),
       amqp_cstring_bytes(routing_key),
       /* mandatory = */ 0,
-      /* immediate = */ 0, &props, amqp_cstring_bytes(buffer));
+      /* immediate = */ 0, &props, body);
   if (status != 0) {
     ERROR("amqp plugin: amqp_basic_publish failed with status %i.", status);
     camqp_close_connection(conf);
+    return status;
+  }
+
+  if (conf->confirm) {
+    conf->published++;
+    conf->unconfirmed++;
+    status = camqp_confirm_poll(conf, CAMQP_MAX_UNCONFIRMED);
   }
 
   return status;
 } /* }}} int camqp_write_locked */
 
+/* You must hold "conf->lock" when calling this function. */
+static int camqp_batch_publish(camqp_config_t *conf, /* {{{ */
+                               const char *routing_key, camqp_batch_t *b) {
+  if (b->fill == 0)
+    return 0;
+
+  /* camqp_batch_add() reserves room for the closing bracket. */
+  if (conf->format == CAMQP_FORMAT_JSON)
+    b->buffer[b->fill++] = ']';
+
+  int status = camqp_write_locked(
+      conf, (amqp_bytes_t){.len = b->fill, .bytes = b->buffer}, routing_key);
+  b->fill = 0;
+  return status;
+} /* }}} int camqp_batch_publish */
+
+/* Appends the formatted value list "msg" to the message for "routing_key".
+ * You must hold "conf->lock" when calling this function. */
+static int camqp_batch_add(camqp_config_t *conf, /* {{{ */
+                           const char *routing_key, const char *msg) {
+  camqp_batch_t *b = NULL;
+  int status = 0;
+
+  if (c_avl_get(conf->batches, routing_key, (void *)&b) != 0) {
+    char *key = strdup(routing_key);
+    b = calloc(1, sizeof(*b));
+    if (b != NULL)
+      b->buffer = malloc(conf->batch_max_size);
+    if ((key == NULL) || (b == NULL) || (b->buffer == NULL) ||
+        (c_avl_insert(conf->batches, key, b) != 0)) {
+      sfree(key);
+      if (b != NULL)
+        sfree(b->buffer);
+      sfree(b);
+      return ENOMEM;
+    }
+  }
+
+  /* JSON messages are merged into one array: "[{...}]" is appended as
+   * ",{...}" and the first comma is replaced by an opening bracket. Lines of
+   * the other formats are separated by newlines. */
+  const char *elem = msg;
+  size_t elem_len = strlen(msg);
+  char sep = 0;
+  if (conf->format == CAMQP_FORMAT_JSON) {
+    if ((elem_len < 2) || (msg[0] != '[') || (msg[elem_len - 1] != ']'))
+      return EINVAL;
+    elem++;
+    elem_len -= 2;
+    sep = (b->fill == 0) ? '[' : ',';
+  } else if ((conf->format == CAMQP_FORMAT_COMMAND) && (b->fill != 0)) {
+    sep = '\n';
+  }
+
+  /* Separator plus a closing bracket */
+  size_t need = elem_len + 2;
+  if ((b->fill > 0) && (b->fill + need > conf->batch_max_size)) {
+    status = camqp_batch_publish(conf, routing_key, b);
+    if (status != 0)
+      return status;
+    if (conf->format == CAMQP_FORMAT_JSON)
+      sep = '[';
+    else
+      sep = 0;
+  }
+
+  /* Too large for any batch */
+  if (need > conf->batch_max_size)
+    return camqp_write_locked(conf, amqp_cstring_bytes(msg), routing_key);
+
+  if (b->fill == 0)
+    b->first = cdtime();
+  if (sep != 0)
+    b->buffer[b->fill++] = sep;
+  memcpy(b->buffer + b->fill, elem, elem_len);
+  b->fill += elem_len;
+
+  if (cdtime() - b->first >= conf->batch_max_age)
+    status = camqp_batch_publish(conf, routing_key, b);
+
+  return status;
+} /* }}} int camqp_batch_add */
+
+/* Publishes all batches with value lists older than "timeout", or all batches
+ * if "timeout" is zero. You must hold "conf->lock". */
+static void camqp_batches_flush(camqp_config_t *conf, /* {{{ */
+                                cdtime_t timeout) {
+  cdtime_t now = cdtime();
+
+  conf->batch_last_sweep = now;
+  if (conf->batches == NULL)
+    return;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(conf->batches);
+  if (iter == NULL)
+    return;
+
+  void *key;
+  void *value;
+  while (c_avl_iterator_next(iter, &key, &value) == 0) {
+    camqp_batch_t *b = value;
+    if ((b->fill == 0) || ((timeout != 0) && (now - b->first < timeout)))
+      continue;
+    camqp_batch_publish(conf, key, b);
+  }
+  c_avl_iterator_destroy(iter);
+} /* }}} void camqp_batches_flush */
+
+static camqp_config_t *camqp_pool_member(camqp_config_t *conf, /* {{{ */
+                                         size_t i) {
+  return (i == 0) ? conf : conf->pool[i - 1];
+} /* }}} camqp_config_t *camqp_pool_member */
+
+/* Locks and returns one of the connections of "conf". Writers prefer the
+ * connection chosen by the routing key, so that batches are filled evenly,
+ * but take any idle connection before waiting. */
+static camqp_config_t *camqp_pool_lock(camqp_config_t *conf, /* {{{ */
+                                       const char *routing_key) {
+  size_t num = conf->pool_num + 1;
+
+  if (num == 1) {
+    pthread_mutex_lock(&conf->lock);
+    return conf;
+  }
+
+  uint32_t hash = 2166136261U;
+  for (const char *c = routing_key; *c != 0; c++)
+    hash = (hash ^ (uint8_t)*c) * 16777619U;
+  size_t start = hash % num;
+
+  for (size_t i = 0; i < num; i++) {
+    camqp_config_t *c = camqp_pool_member(conf, (start + i) % num);
+    if (pthread_mutex_trylock(&c->lock) == 0)
+      return c;
+  }
+
+  camqp_config_t *c = camqp_pool_member(conf, start);
+  pthread_mutex_lock(&c->lock);
+  return c;
+} /* }}} camqp_config_t *camqp_pool_lock */
+
 static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
                        user_data_t *user_data) {
   camqp_config_t *conf = user_data->data;
@@ -825,7 +1195,8 @@ static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     size_t bfill = 0;
 
     format_json_initialize(buffer, &bfill, &bfree);
-    format_json_value_list(buffer, &bfill, &bfree, ds, vl, conf->store_rates);
+    format_json_value_list_cached(conf->json_cache, buffer, &bfill, &bfree, ds,
+                                  vl, conf->store_rates);
     format_json_finalize(buffer, &bfill, &bfree);
   } else if (conf->format == CAMQP_FORMAT_GRAPHITE) {
     status =
@@ -840,13 +1211,73 @@ static int camqp_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     return -1;
   }
 
-  pthread_mutex_lock(&conf->lock);
-  status = camqp_write_locked(conf, buffer, routing_key);
-  pthread_mutex_unlock(&conf->lock);
+  camqp_config_t *c = camqp_pool_lock(conf, routing_key);
+  if (c->batches != NULL) {
+    status = camqp_batch_add(c, routing_key, buffer);
+    /* Batches that are no longer written to are published here, too. */
+    if (cdtime() - c->batch_last_sweep >= c->batch_max_age)
+      camqp_batches_flush(c, c->batch_max_age);
+  } else {
+    status = camqp_write_locked(c, amqp_cstring_bytes(buffer), routing_key);
+  }
+  pthread_mutex_unlock(&c->lock);
 
   return status;
 } /* }}} int camqp_write */
 
+static int camqp_flush(cdtime_t timeout, /* {{{ */
+                       __attribute__((unused)) const char *identifier,
+                       user_data_t *user_data) {
+  camqp_config_t *conf = user_data->data;
+
+  for (size_t i = 0; i < conf->pool_num + 1; i++) {
+    camqp_config_t *c = camqp_pool_member(conf, i);
+
+    pthread_mutex_lock(&c->lock);
+    camqp_batches_flush(c, timeout);
+    if (c->confirm)
+      camqp_confirm_poll(c, /* max_unconfirmed = */ 0);
+    pthread_mutex_unlock(&c->lock);
+  }
+
+  return 0;
+} /* }}} int camqp_flush */
+
+/* Creates the additional connections of "conf". */
+static int camqp_pool_create(camqp_config_t *conf, size_t num) /* {{{ */
+{
+  if (num <= 1)
+    return 0;
+
+  conf->pool = calloc(num - 1, sizeof(*conf->pool));
+  if (conf->pool == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < num - 1; i++) {
+    camqp_config_t *c = malloc(sizeof(*c));
+    if (c == NULL)
+      return ENOMEM;
+
+    memcpy(c, conf, sizeof(*c));
+    c->pool = NULL;
+    c->pool_num = 0;
+    c->pool_member = true;
+    c->connection = NULL;
+    c->batches = NULL;
+    pthread_mutex_init(&c->lock, /* attr = */ NULL);
+    conf->pool[i] = c;
+    conf->pool_num++;
+
+    if (conf->batch_max_size > 0) {
+      c->batches = c_avl_create((int (*)(const void *, const void *))strcmp);
+      if (c->batches == NULL)
+        return ENOMEM;
+    }
+  }
+
+  return 0;
+} /* }}} int camqp_pool_create */
+
 /*
  * Config handling
  */
@@ -879,6 +1310,7 @@ static int camqp_config_set_format(oconfig_item_t *ci, /* {{{ */
 static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
                                    bool publish) {
   camqp_config_t *conf;
+  int connections = 1;
   int status;
 
   conf = calloc(1, sizeof(*conf));
@@ -911,6 +1343,9 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
   conf->delivery_mode = CAMQP_DM_VOLATILE;
   conf->store_rates = false;
   conf->graphite_flags = 0;
+  conf->batch_max_size = 0;
+  conf->batch_max_age = TIME_T_TO_CDTIME_T(1);
+  conf->confirm = false;
   /* publish & graphite only */
   conf->prefix = NULL;
   conf->postfix = NULL;
@@ -1021,7 +1456,27 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
                 "only one character. Others will be ignored.");
       conf->escape_char = tmp_buff[0];
       sfree(tmp_buff);
-    } else if (strcasecmp("ConnectionRetryDelay", child->key) == 0)
+    } else if ((strcasecmp("BatchMaxSize", child->key) == 0) && publish) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 0)) {
+        ERROR("amqp plugin: BatchMaxSize must not be negative.");
+        status = -1;
+      }
+      if (status == 0)
+        conf->batch_max_size = (size_t)tmp;
+    } else if ((strcasecmp("BatchMaxAge", child->key) == 0) && publish)
+      status = cf_util_get_cdtime(child, &conf->batch_max_age);
+    else if ((strcasecmp("Connections", child->key) == 0) && publish) {
+      status = cf_util_get_int(child, &connections);
+      if ((status == 0) && (connections < 1)) {
+        ERROR("amqp plugin: Connections must be positive.");
+        status = -1;
+      }
+    } else if ((strcasecmp("PublisherConfirms", child->key) == 0) &&
+               publish)
+      status = cf_util_get_boolean(child, &conf->confirm);
+    else if (strcasecmp("ConnectionRetryDelay", child->key) == 0)
       status = cf_util_get_int(child, &conf->connection_retry_delay);
     else
       WARNING("amqp plugin: Ignoring unknown "
@@ -1062,6 +1517,25 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
     status = 1;
   }
 #endif
+#if !CAMQP_HAVE_CONFIRMS
+  if (status == 0 && conf->confirm) {
+    ERROR("amqp plugin: PublisherConfirms is set but not supported. "
+          "rebuild collectd with rabbitmq-c >= 0.8");
+    status = 1;
+  }
+#endif
+  if (status == 0 && conf->batch_max_size > 0) {
+    conf->batches = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (conf->batches == NULL)
+      status = ENOMEM;
+  }
+  if (status == 0 && publish && (conf->format == CAMQP_FORMAT_JSON)) {
+    conf->json_cache = format_json_cache_create();
+    if (conf->json_cache == NULL)
+      status = ENOMEM;
+  }
+  if (status == 0)
+    status = camqp_pool_create(conf, (size_t)connections);
   if (status == 0 &&
       (conf->tls_client_cert != NULL || conf->tls_client_key != NULL)) {
     if (conf->tls_client_cert == NULL || conf->tls_client_key == NULL) {
@@ -1094,6 +1568,10 @@ static int camqp_config_connection(oconfig_item_t *ci, /* {{{ */
       camqp_config_free(conf);
       return status;
     }
+
+    if ((conf->batches != NULL) || conf->confirm)
+      plugin_register_flush(cbname, camqp_flush,
+                            &(user_data_t){.data = conf});
   } else {
     status = camqp_subscribe_init(conf);
     if (status != 0) {
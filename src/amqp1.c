@@ -50,6 +50,8 @@
 #include <stdlib.h>
 
 #define BUFSIZE 8192
+/* Number of sent messages whose buffers are kept for reuse. */
+#define AMQP1_FREE_MESSAGES 64
 #define AMQP1_FORMAT_JSON 0
 #define AMQP1_FORMAT_COMMAND 1
 #define AMQP1_FORMAT_GRAPHITE 2
@@ -64,8 +66,11 @@ typedef struct amqp1_config_transport_s {
   char *address;
   int retry_delay;
   int sendq_limit;
+  bool report_stats;
 } amqp1_config_transport_t;
 
+struct cd_message_s;
+
 typedef struct amqp1_config_instance_s {
   DEQ_LINKS(struct amqp1_config_instance_s);
   char *name;
@@ -78,6 +83,17 @@ typedef struct amqp1_config_instance_s {
   char escape_char;
   bool pre_settle;
   char send_to[1024];
+
+  /* Value lists are collected in "batch" until its body would exceed
+   * "batch_max_size" bytes or is older than "batch_max_age". Disabled if
+   * "batch_max_size" is zero. */
+  size_t batch_max_size;
+  cdtime_t batch_max_age;
+  pthread_mutex_t batch_lock;
+  struct cd_message_s *batch;
+  size_t batch_fill;
+  size_t batch_free;
+  cdtime_t batch_first;
 } amqp1_config_instance_t;
 
 DEQ_DECLARE(amqp1_config_instance_t, amqp1_config_instance_list_t);
@@ -85,6 +101,10 @@ DEQ_DECLARE(amqp1_config_instance_t, amqp1_config_instance_list_t);
 typedef struct cd_message_s {
   DEQ_LINKS(struct cd_message_s);
   pn_rwbytes_t mbuf;
+  /* Allocated size of "mbuf.start" */
+  size_t mbuf_alloc;
+  /* Number of value lists in the message body */
+  size_t values;
   amqp1_config_instance_t *instance;
 } cd_message_t;
 
@@ -98,6 +118,7 @@ static pn_link_t *sender;
 static pn_proactor_t *proactor;
 static pthread_mutex_t send_lock;
 static cd_message_list_t out_messages;
+static cd_message_list_t free_messages;
 static uint64_t cd_tag = 1;
 static uint64_t acknowledged;
 static amqp1_config_transport_t *transport;
@@ -105,6 +126,15 @@ static bool stopping;
 static bool event_thread_running;
 static pthread_t event_thread_id;
 
+/* Statistics, protected by "send_lock". "starved_since" is non-zero while
+ * messages are waiting for the peer to grant link credit. */
+static uint64_t stats_bytes_sent;
+static uint64_t stats_values_sent;
+static uint64_t stats_values_dropped;
+static uint64_t stats_credit_starved;
+static cdtime_t stats_starved_time;
+static cdtime_t starved_since;
+
 /*
  * Functions
  */
@@ -113,6 +143,58 @@ static void cd_message_free(cd_message_t *cdm) {
   free(cdm);
 } /* }}} void cd_message_free */
 
+/* Returns a message with a buffer of at least "size" bytes. The buffers of
+ * sent messages are reused, so that the write path doesn't have to allocate
+ * in the common case. */
+static cd_message_t *cd_message_get(size_t size) /* {{{ */
+{
+  pthread_mutex_lock(&send_lock);
+  cd_message_t *cdm = DEQ_HEAD(free_messages);
+  if (cdm != NULL)
+    DEQ_REMOVE_HEAD(free_messages);
+  pthread_mutex_unlock(&send_lock);
+
+  if (cdm == NULL) {
+    cdm = calloc(1, sizeof(*cdm));
+    if (cdm == NULL)
+      return NULL;
+  }
+
+  if (cdm->mbuf_alloc < size) {
+    char *start = realloc(cdm->mbuf.start, size);
+    if (start == NULL) {
+      cd_message_free(cdm);
+      return NULL;
+    }
+    cdm->mbuf.start = start;
+    cdm->mbuf_alloc = size;
+  }
+
+  DEQ_ITEM_INIT(cdm);
+  cdm->mbuf.size = size;
+  cdm->values = 0;
+  cdm->instance = NULL;
+  return cdm;
+} /* }}} cd_message_t *cd_message_get */
+
+/* Keeps the message for reuse by cd_message_get(). You must hold
+ * "send_lock" when calling this function. */
+static void cd_message_release_locked(cd_message_t *cdm) /* {{{ */
+{
+  if (DEQ_SIZE(free_messages) >= AMQP1_FREE_MESSAGES) {
+    cd_message_free(cdm);
+    return;
+  }
+  DEQ_INSERT_HEAD(free_messages, cdm);
+} /* }}} void cd_message_release_locked */
+
+static void cd_message_release(cd_message_t *cdm) /* {{{ */
+{
+  pthread_mutex_lock(&send_lock);
+  cd_message_release_locked(cdm);
+  pthread_mutex_unlock(&send_lock);
+} /* }}} void cd_message_release */
+
 static int amqp1_send_out_messages(pn_link_t *link) /* {{{ */
 {
   uint64_t dtag;
@@ -130,6 +212,11 @@ static int amqp1_send_out_messages(pn_link_t *link) /* {{{ */
 
   pthread_mutex_lock(&send_lock);
 
+  if ((link_credit > 0) && (starved_since != 0)) {
+    stats_starved_time += cdtime() - starved_since;
+    starved_since = 0;
+  }
+
   if (link_credit > 0) {
     dtag = cd_tag;
     cdm = DEQ_HEAD(out_messages);
@@ -143,12 +230,16 @@ static int amqp1_send_out_messages(pn_link_t *link) /* {{{ */
     cd_tag += DEQ_SIZE(to_send);
   }
 
+  /* Messages are left over because the peer didn't grant enough credit. */
+  if (!DEQ_IS_EMPTY(out_messages) && (starved_since == 0)) {
+    starved_since = cdtime();
+    stats_credit_starved++;
+  }
+
   pthread_mutex_unlock(&send_lock);
 
   /* message is already formatted and encoded */
-  cdm = DEQ_HEAD(to_send);
-  while (cdm) {
-    DEQ_REMOVE_HEAD(to_send);
+  for (cdm = DEQ_HEAD(to_send); cdm != NULL; cdm = DEQ_NEXT(cdm)) {
     dtag++;
     dlv = pn_delivery(link, pn_dtag((const char *)&dtag, sizeof(dtag)));
     pn_link_send(link, cdm->mbuf.start, cdm->mbuf.size);
@@ -157,9 +248,18 @@ static int amqp1_send_out_messages(pn_link_t *link) /* {{{ */
       pn_delivery_settle(dlv);
     }
     event_count++;
-    cd_message_free(cdm);
+  }
+
+  pthread_mutex_lock(&send_lock);
+  cdm = DEQ_HEAD(to_send);
+  while (cdm) {
+    DEQ_REMOVE_HEAD(to_send);
+    stats_bytes_sent += cdm->mbuf.size;
+    stats_values_sent += cdm->values;
+    cd_message_release_locked(cdm);
     cdm = DEQ_HEAD(to_send);
   }
+  pthread_mutex_unlock(&send_lock);
 
   return event_count;
 } /* }}} int amqp1_send_out_messages */
@@ -292,13 +392,17 @@ static void *event_thread(void __attribute__((unused)) * arg) /* {{{ */
 
   pn_proactor_disconnect(proactor, NULL);
 
-  /* Free the remaining out_messages */
+  /* Free the remaining out_messages and the message buffers kept for
+   * reuse */
+  pthread_mutex_lock(&send_lock);
+  DEQ_APPEND(out_messages, free_messages);
   cdm = DEQ_HEAD(out_messages);
   while (cdm) {
     DEQ_REMOVE_HEAD(out_messages);
     cd_message_free(cdm);
     cdm = DEQ_HEAD(out_messages);
   }
+  pthread_mutex_unlock(&send_lock);
 
   event_thread_running = false;
 
@@ -317,20 +421,22 @@ static int encqueue(cd_message_t *cdm,
   pn_data_exit(body);
 
   /* put_binary copies and stores so ok to use mbuf */
-  cdm->mbuf.size = BUFSIZE;
+  cdm->mbuf.size = cdm->mbuf_alloc;
 
   int status;
   char *start;
   while ((status = pn_message_encode(message, cdm->mbuf.start,
                                      &cdm->mbuf.size)) == PN_OVERFLOW) {
-    DEBUG("amqp1 plugin: increasing message buffer size %zu", cdm->mbuf.size);
-    cdm->mbuf.size *= 2;
-    start = realloc(cdm->mbuf.start, cdm->mbuf.size);
+    DEBUG("amqp1 plugin: increasing message buffer size %zu",
+          cdm->mbuf_alloc);
+    start = realloc(cdm->mbuf.start, 2 * cdm->mbuf_alloc);
     if (start == NULL) {
       status = -1;
       break;
     } else {
       cdm->mbuf.start = start;
+      cdm->mbuf_alloc *= 2;
+      cdm->mbuf.size = cdm->mbuf_alloc;
     }
   }
 
@@ -349,7 +455,8 @@ static int encqueue(cd_message_t *cdm,
     WARNING("amqp1 plugin: dropping oldest message because sendq is full");
     evict = DEQ_HEAD(out_messages);
     DEQ_REMOVE_HEAD(out_messages);
-    cd_message_free(evict);
+    stats_values_dropped += evict->values;
+    cd_message_release_locked(evict);
   }
   DEQ_INSERT_TAIL(out_messages, cdm);
   pthread_mutex_unlock(&send_lock);
@@ -364,6 +471,131 @@ static int encqueue(cd_message_t *cdm,
   return 0;
 } /* }}} int encqueue */
 
+/* Queues the value lists collected in "instance->batch" for sending. You
+ * must hold "instance->batch_lock" when calling this function. */
+static int amqp1_batch_publish(amqp1_config_instance_t *instance) /* {{{ */
+{
+  cd_message_t *cdm = instance->batch;
+
+  if ((cdm == NULL) || (instance->batch_fill == 0))
+    return 0;
+
+  if (instance->format == AMQP1_FORMAT_JSON)
+    format_json_finalize(cdm->mbuf.start, &instance->batch_fill,
+                         &instance->batch_free);
+  cdm->mbuf.size = instance->batch_fill;
+
+  instance->batch = NULL;
+  instance->batch_fill = 0;
+  instance->batch_free = 0;
+
+  int status = encqueue(cdm, instance);
+  if (status != 0) {
+    ERROR("amqp1 plugin: batch enqueue failed");
+    cd_message_release(cdm);
+  }
+  return status;
+} /* }}} int amqp1_batch_publish */
+
+/* Starts a new batch. The buffer has room for the message header, so that
+ * encqueue() can encode the message in place. */
+static int amqp1_batch_init(amqp1_config_instance_t *instance) /* {{{ */
+{
+  cd_message_t *cdm =
+      cd_message_get(instance->batch_max_size + sizeof(instance->send_to));
+  if (cdm == NULL)
+    return ENOMEM;
+
+  cdm->instance = instance;
+  cdm->mbuf.start[0] = 0;
+
+  instance->batch = cdm;
+  instance->batch_fill = 0;
+  instance->batch_free = instance->batch_max_size;
+  instance->batch_first = cdtime();
+
+  if (instance->format == AMQP1_FORMAT_JSON)
+    format_json_initialize(cdm->mbuf.start, &instance->batch_fill,
+                           &instance->batch_free);
+  return 0;
+} /* }}} int amqp1_batch_init */
+
+/* Appends "line" to the batch, publishing the batch first if the line doesn't
+ * fit. */
+static int amqp1_batch_append(amqp1_config_instance_t *instance, /* {{{ */
+                              char const *line, size_t len) {
+  if ((len >= instance->batch_free) && (instance->batch_fill > 0)) {
+    int status = amqp1_batch_publish(instance);
+    if (status == 0)
+      status = amqp1_batch_init(instance);
+    if (status != 0)
+      return status;
+  }
+
+  if (len >= instance->batch_free)
+    return ENOMEM;
+
+  memcpy(instance->batch->mbuf.start + instance->batch_fill, line, len + 1);
+  instance->batch_fill += len;
+  instance->batch_free -= len;
+  return 0;
+} /* }}} int amqp1_batch_append */
+
+/* Adds a value list to the batch: as an element of one JSON array, or as one
+ * line per value list with the other formats. You must hold
+ * "instance->batch_lock" when calling this function. */
+static int amqp1_batch_add(amqp1_config_instance_t *instance, /* {{{ */
+                           const data_set_t *ds, const value_list_t *vl) {
+  char line[BUFSIZE];
+  int status;
+
+  if (instance->batch == NULL) {
+    status = amqp1_batch_init(instance);
+    if (status != 0)
+      return status;
+  }
+
+  switch (instance->format) {
+  case AMQP1_FORMAT_JSON:
+    status = format_json_value_list(
+        instance->batch->mbuf.start, &instance->batch_fill,
+        &instance->batch_free, ds, vl, instance->store_rates);
+    if ((status == -ENOMEM) && (instance->batch_fill > 0)) {
+      status = amqp1_batch_publish(instance);
+      if (status == 0)
+        status = amqp1_batch_init(instance);
+      if (status == 0)
+        status = format_json_value_list(
+            instance->batch->mbuf.start, &instance->batch_fill,
+            &instance->batch_free, ds, vl, instance->store_rates);
+    }
+    break;
+  case AMQP1_FORMAT_COMMAND:
+    status = cmd_create_putval(line, sizeof(line) - 1, ds, vl);
+    if (status == 0) {
+      strcat(line, "\n");
+      status = amqp1_batch_append(instance, line, strlen(line));
+    }
+    break;
+  case AMQP1_FORMAT_GRAPHITE:
+    status = format_graphite(line, sizeof(line), ds, vl, instance->prefix,
+                             instance->postfix, instance->escape_char,
+                             instance->graphite_flags);
+    if (status == 0)
+      status = amqp1_batch_append(instance, line, strlen(line));
+    break;
+  default:
+    ERROR("amqp1 plugin: Invalid write format (%i).", instance->format);
+    return -1;
+  }
+
+  if (status != 0)
+    return status;
+
+  instance->batch->values++;
+  return 0;
+} /* }}} int amqp1_batch_add */
+
 static int amqp1_notify(notification_t const *n,
                         user_data_t *user_data) /* {{{ */
 {
@@ -381,21 +613,11 @@ static int amqp1_notify(notification_t const *n,
     ERROR("amqp1 plugin: write notification failed");
   }
 
-  cd_message_t *cdm = malloc(sizeof(*cdm));
+  cd_message_t *cdm = cd_message_get(bufsize);
   if (cdm == NULL) {
     ERROR("amqp1 plugin: notify failed");
     return -1;
   }
-
-  DEQ_ITEM_INIT(cdm);
-  char *start = malloc(bufsize);
-  if (start == NULL) {
-    ERROR("amqp1 plugin: malloc failed");
-    free(cdm);
-    return -1;
-  }
-  cdm->mbuf.size = bufsize;
-  cdm->mbuf.start = start;
   cdm->instance = instance;
 
   switch (instance->format) {
@@ -404,19 +626,19 @@ static int amqp1_notify(notification_t const *n,
     status = format_json_notification(cdm->mbuf.start, bufsize, n);
     if (status != 0) {
       ERROR("amqp1 plugin: formatting notification failed");
-      cd_message_free(cdm);
+      cd_message_release(cdm);
       return status;
     }
     cdm->mbuf.size = strlen(cdm->mbuf.start);
     if (cdm->mbuf.size >= BUFSIZE) {
       ERROR("amqp1 plugin: notify format json failed");
-      cd_message_free(cdm);
+      cd_message_release(cdm);
       return -1;
     }
     break;
   default:
     ERROR("amqp1 plugin: Invalid notify format (%i).", instance->format);
-    cd_message_free(cdm);
+    cd_message_release(cdm);
     return -1;
   }
 
@@ -424,7 +646,7 @@ static int amqp1_notify(notification_t const *n,
   status = encqueue(cdm, instance);
   if (status != 0) {
     ERROR("amqp1 plugin: notify enqueue failed");
-    cd_message_free(cdm);
+    cd_message_release(cdm);
   }
   return status;
 
@@ -446,34 +668,40 @@ static int amqp1_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     ERROR("amqp1 plugin: write failed");
   }
 
-  cd_message_t *cdm = malloc(sizeof(*cdm));
-  if (cdm == NULL) {
-    ERROR("amqp1 plugin: malloc failed.");
-    return -1;
+  if (instance->batch_max_size > 0) {
+    pthread_mutex_lock(&instance->batch_lock);
+    status = amqp1_batch_add(instance, ds, vl);
+    if ((status == 0) && (instance->batch != NULL) &&
+        (cdtime() - instance->batch_first >= instance->batch_max_age))
+      status = amqp1_batch_publish(instance);
+    pthread_mutex_unlock(&instance->batch_lock);
+    if (status != 0)
+      ERROR("amqp1 plugin: Adding a value list to the batch failed with "
+            "status %i.",
+            status);
+    return status;
   }
-  DEQ_ITEM_INIT(cdm);
-  char *start = malloc(bufsize);
-  if (start == NULL) {
+
+  cd_message_t *cdm = cd_message_get(bufsize);
+  if (cdm == NULL) {
     ERROR("amqp1 plugin: malloc failed.");
-    free(cdm);
     return -1;
   }
-  cdm->mbuf.size = bufsize;
-  cdm->mbuf.start = start;
   cdm->instance = instance;
+  cdm->values = 1;
 
   switch (instance->format) {
   case AMQP1_FORMAT_COMMAND:
     status = cmd_create_putval((char *)cdm->mbuf.start, bufsize, ds, vl);
     if (status != 0) {
       ERROR("amqp1 plugin: cmd_create_putval failed with status %i.", status);
-      cd_message_free(cdm);
+      cd_message_release(cdm);
       return status;
     }
     cdm->mbuf.size = strlen(cdm->mbuf.start);
     if (cdm->mbuf.size >= BUFSIZE) {
       ERROR("amqp1 plugin: format cmd failed");
-      cd_message_free(cdm);
+      cd_message_release(cdm);
       return -1;
     }
     break;
@@ -485,13 +713,13 @@ static int amqp1_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     if (status != 0) {
       ERROR("amqp1 plugin: format_json_finalize failed with status %i.",
             status);
-      cd_message_free(cdm);
+      cd_message_release(cdm);
       return status;
     }
     cdm->mbuf.size = strlen(cdm->mbuf.start);
     if (cdm->mbuf.size >= BUFSIZE) {
       ERROR("amqp1 plugin: format json failed");
-      cd_message_free(cdm);
+      cd_message_release(cdm);
       return -1;
     }
     break;
@@ -501,19 +729,19 @@ static int amqp1_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
                              instance->escape_char, instance->graphite_flags);
     if (status != 0) {
       ERROR("amqp1 plugin: format_graphite failed with status %i.", status);
-      cd_message_free(cdm);
+      cd_message_release(cdm);
       return status;
     }
     cdm->mbuf.size = strlen(cdm->mbuf.start);
     if (cdm->mbuf.size >= BUFSIZE) {
       ERROR("amqp1 plugin: format graphite failed");
-      cd_message_free(cdm);
+      cd_message_release(cdm);
       return -1;
     }
     break;
   default:
     ERROR("amqp1 plugin: Invalid write format (%i).", instance->format);
-    cd_message_free(cdm);
+    cd_message_release(cdm);
     return -1;
   }
 
@@ -521,12 +749,76 @@ static int amqp1_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   status = encqueue(cdm, instance);
   if (status != 0) {
     ERROR("amqp1 plugin: write enqueue failed");
-    cd_message_free(cdm);
+    cd_message_release(cdm);
   }
   return status;
 
 } /* }}} int amqp1_write */
 
+static int amqp1_flush(cdtime_t timeout, /* {{{ */
+                       __attribute__((unused)) const char *identifier,
+                       user_data_t *user_data) {
+  amqp1_config_instance_t *instance = user_data->data;
+  int status = 0;
+
+  pthread_mutex_lock(&instance->batch_lock);
+  if ((instance->batch != NULL) &&
+      ((timeout == 0) || (cdtime() - instance->batch_first >= timeout)))
+    status = amqp1_batch_publish(instance);
+  pthread_mutex_unlock(&instance->batch_lock);
+
+  return status;
+} /* }}} int amqp1_flush */
+
+static int amqp1_stats_read(void) /* {{{ */
+{
+  value_list_t vl = VALUE_LIST_INIT;
+
+  pthread_mutex_lock(&send_lock);
+  size_t queue_length = DEQ_SIZE(out_messages);
+  uint64_t bytes_sent = stats_bytes_sent;
+  uint64_t values_sent = stats_values_sent;
+  uint64_t values_dropped = stats_values_dropped;
+  uint64_t credit_starved = stats_credit_starved;
+  cdtime_t starved_time = stats_starved_time;
+  if (starved_since != 0)
+    starved_time += cdtime() - starved_since;
+  pthread_mutex_unlock(&send_lock);
+
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "amqp1", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, transport->name, sizeof(vl.plugin_instance));
+
+  vl.values = &(value_t){.derive = (derive_t)bytes_sent};
+  sstrncpy(vl.type, "total_bytes", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "sent", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = (derive_t)values_sent};
+  sstrncpy(vl.type, "total_values", sizeof(vl.type));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = (derive_t)values_dropped};
+  sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = (derive_t)credit_starved};
+  sstrncpy(vl.type, "total_events", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "credit_starved", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = (derive_t)CDTIME_T_TO_MS(starved_time)};
+  sstrncpy(vl.type, "total_time_in_ms", sizeof(vl.type));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = (gauge_t)queue_length};
+  sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+  vl.type_instance[0] = 0;
+  plugin_dispatch_values(&vl);
+
+  return 0;
+} /* }}} int amqp1_stats_read */
+
 static void amqp1_config_transport_free(void *ptr) /* {{{ */
 {
   amqp1_config_transport_t *transport = ptr;
@@ -555,6 +847,10 @@ static void amqp1_config_instance_free(void *ptr) /* {{{ */
   sfree(instance->prefix);
   sfree(instance->postfix);
 
+  if (instance->batch != NULL)
+    cd_message_free(instance->batch);
+  pthread_mutex_destroy(&instance->batch_lock);
+
   sfree(instance);
 } /* }}} void amqp1_config_instance_free */
 
@@ -565,10 +861,12 @@ static int amqp1_config_instance(oconfig_item_t *ci) /* {{{ */
     ERROR("amqp1 plugin: calloc failed.");
     return ENOMEM;
   }
+  pthread_mutex_init(&instance->batch_lock, /* attr = */ NULL);
+  instance->batch_max_age = TIME_T_TO_CDTIME_T(1);
 
   int status = cf_util_get_string(ci, &instance->name);
   if (status != 0) {
-    sfree(instance);
+    amqp1_config_instance_free(instance);
     return status;
   }
 
@@ -622,7 +920,18 @@ static int amqp1_config_instance(oconfig_item_t *ci) /* {{{ */
         instance->escape_char = tmp_buff[0];
       }
       sfree(tmp_buff);
-    } else
+    } else if (strcasecmp("BatchMaxSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 0)) {
+        ERROR("amqp1 plugin: BatchMaxSize must not be negative.");
+        status = -1;
+      }
+      if (status == 0)
+        instance->batch_max_size = (size_t)tmp;
+    } else if (strcasecmp("BatchMaxAge", child->key) == 0)
+      status = cf_util_get_cdtime(child, &instance->batch_max_age);
+    else
       WARNING("amqp1 plugin: Ignoring unknown "
               "instance configuration option "
               "\"%s\".",
@@ -667,6 +976,9 @@ static int amqp1_config_instance(oconfig_item_t *ci) /* {{{ */
 
     if (status != 0) {
       amqp1_config_instance_free(instance);
+    } else if ((instance->batch_max_size > 0) && !instance->notify) {
+      plugin_register_flush(tpname, amqp1_flush,
+                            &(user_data_t){.data = instance});
     }
   }
 
@@ -709,6 +1021,8 @@ static int amqp1_config_transport(oconfig_item_t *ci) /* {{{ */
       amqp1_config_instance(child);
     else if (strcasecmp("SendQueueLimit", child->key) == 0)
       status = cf_util_get_int(child, &transport->sendq_limit);
+    else if (strcasecmp("ReportStats", child->key) == 0)
+      status = cf_util_get_boolean(child, &transport->report_stats);
     else
       WARNING("amqp1 plugin: Ignoring unknown "
               "transport configuration option "
@@ -721,6 +1035,8 @@ static int amqp1_config_transport(oconfig_item_t *ci) /* {{{ */
 
   if (status != 0) {
     amqp1_config_transport_free(transport);
+  } else if (transport->report_stats) {
+    plugin_register_read("amqp1", amqp1_stats_read);
   }
   return status;
 } /* }}} int amqp1_config_transport */
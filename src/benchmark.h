@@ -0,0 +1,136 @@
+/**
+ * collectd - src/benchmark.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H 1
+
+/* Microbenchmarks, run with "make bench". A benchmark is defined with
+ * DEF_BENCH and must perform "b->iterations" operations on a data set of
+ * "b->size" elements. Setup and teardown can be excluded from the measurement
+ * with BENCH_RESET_TIMER, BENCH_STOP_TIMER and BENCH_START_TIMER. RUN_BENCH
+ * repeats the benchmark with increasing iterations until it runs for at least
+ * half a second (or $COLLECTD_BENCH_TIME seconds) and prints the result as one
+ * JSON object per line, so that results can be compared by scripts. */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_TIME 0.5
+
+typedef struct {
+  size_t size;
+  uint64_t iterations;
+  uint64_t start;
+  uint64_t elapsed;
+  bool running;
+} bench_t;
+
+static int bench_fail_count__;
+
+static uint64_t bench_now__(void) {
+  struct timespec ts = {0};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+#define BENCH_RESET_TIMER(b)                                                   \
+  do {                                                                         \
+    (b)->elapsed = 0;                                                          \
+    (b)->start = bench_now__();                                                \
+    (b)->running = true;                                                       \
+  } while (0)
+
+#define BENCH_START_TIMER(b)                                                   \
+  do {                                                                         \
+    if (!(b)->running)                                                         \
+      (b)->start = bench_now__();                                              \
+    (b)->running = true;                                                       \
+  } while (0)
+
+#define BENCH_STOP_TIMER(b)                                                    \
+  do {                                                                         \
+    if ((b)->running)                                                          \
+      (b)->elapsed += bench_now__() - (b)->start;                              \
+    (b)->running = false;                                                      \
+  } while (0)
+
+#define DEF_BENCH(func) static int bench_##func(bench_t *b)
+
+static void bench_run__(char const *name, int (*func)(bench_t *),
+                        size_t size) {
+  double min_time = BENCH_DEFAULT_TIME;
+  char const *env = getenv("COLLECTD_BENCH_TIME");
+  if ((env != NULL) && (atof(env) > 0.0))
+    min_time = atof(env);
+
+  uint64_t min_ns = (uint64_t)(min_time * 1e9);
+  bench_t b = {.size = size, .iterations = 1};
+
+  while (42) {
+    b.elapsed = 0;
+    b.start = bench_now__();
+    b.running = true;
+
+    if (func(&b) != 0) {
+      printf("{\"benchmark\":\"%s\",\"size\":%zu,\"error\":true}\n", name,
+             size);
+      fflush(stdout);
+      bench_fail_count__++;
+      return;
+    }
+    BENCH_STOP_TIMER(&b);
+
+    if ((b.elapsed >= min_ns) || (b.iterations >= UINT64_MAX / 100))
+      break;
+
+    /* Aim for 20% above the minimum time, but grow by at most 100x. */
+    uint64_t next = b.iterations * 100;
+    if (b.elapsed > 0) {
+      double want = 1.2 * ((double)b.iterations) * ((double)min_ns) /
+                    ((double)b.elapsed);
+      if (want < (double)next)
+        next = (uint64_t)want;
+    }
+    b.iterations = (next > b.iterations) ? next : b.iterations + 1;
+  }
+
+  double ns_per_op = ((double)b.elapsed) / ((double)b.iterations);
+  printf("{\"benchmark\":\"%s\",\"size\":%zu,\"iterations\":%" PRIu64
+         ",\"ns_per_op\":%.2f,\"ops_per_sec\":%.0f}\n",
+         name, size, b.iterations, ns_per_op,
+         (ns_per_op > 0.0) ? 1e9 / ns_per_op : 0.0);
+  fflush(stdout);
+}
+
+#define RUN_BENCH(func, size) bench_run__(#func, bench_##func, (size))
+
+#define END_BENCH exit((bench_fail_count__ == 0) ? 0 : 1);
+
+#endif /* BENCHMARK_H */
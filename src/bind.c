@@ -44,6 +44,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 
 #include <time.h>
@@ -125,6 +126,9 @@ static size_t bind_buffer_size;
 static size_t bind_buffer_fill;
 static char bind_curl_error[CURL_ERROR_SIZE];
 
+/* Compiled XPath expressions, keyed by the expression. */
+static c_avl_tree_t *xpath_cache;
+
 /* Translation table for the `nsstats' values. */
 static const translation_info_t nsstats_translation_table[] = /* {{{ */
     {
@@ -244,6 +248,35 @@ static int memsummary_translation_table_length =
     STATIC_ARRAY_SIZE(memsummary_translation_table);
 /* }}} */
 
+/* Evaluates "expr" like xmlXPathEvalExpression(). The expression is only
+ * compiled the first time it is used. */
+static xmlXPathObject *bind_xpath_eval(const char *expr, /* {{{ */
+                                       xmlXPathContext *ctx) {
+  xmlXPathCompExpr *comp = NULL;
+
+  if (xpath_cache == NULL) {
+    xpath_cache = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (xpath_cache == NULL)
+      return xmlXPathEvalExpression(BAD_CAST expr, ctx);
+  }
+
+  if (c_avl_get(xpath_cache, expr, (void *)&comp) != 0) {
+    comp = xmlXPathCompile(BAD_CAST expr);
+    if (comp == NULL)
+      return NULL;
+
+    char *key = strdup(expr);
+    if ((key == NULL) || (c_avl_insert(xpath_cache, key, comp) != 0)) {
+      xmlXPathObject *obj = xmlXPathCompiledEval(comp, ctx);
+      sfree(key);
+      xmlXPathFreeCompExpr(comp);
+      return obj;
+    }
+  }
+
+  return xmlXPathCompiledEval(comp, ctx);
+} /* }}} xmlXPathObject *bind_xpath_eval */
+
 static void submit(time_t ts, const char *plugin_instance, /* {{{ */
                    const char *type, const char *type_instance, value_t value) {
   value_list_t vl = VALUE_LIST_INIT;
@@ -381,8 +414,7 @@ static int bind_xml_read_gauge(xmlDoc *doc, xmlNode *node, /* {{{ */
 static int bind_xml_read_timestamp(const char *xpath_expression, /* {{{ */
                                    xmlDoc *doc, xmlXPathContext *xpathCtx,
                                    time_t *ret_value) {
-  xmlXPathObject *xpathObj =
-      xmlXPathEvalExpression(BAD_CAST xpath_expression, xpathCtx);
+  xmlXPathObject *xpathObj = bind_xpath_eval(xpath_expression, xpathCtx);
   if (xpathObj == NULL) {
     ERROR("bind plugin: Unable to evaluate XPath expression `%s'.",
           xpath_expression);
@@ -462,8 +494,7 @@ static int bind_parse_generic_name_value(const char *xpath_expression, /* {{{ */
                                          void *user_data, xmlDoc *doc,
                                          xmlXPathContext *xpathCtx,
                                          time_t current_time, int ds_type) {
-  xmlXPathObject *xpathObj =
-      xmlXPathEvalExpression(BAD_CAST xpath_expression, xpathCtx);
+  xmlXPathObject *xpathObj = bind_xpath_eval(xpath_expression, xpathCtx);
   if (xpathObj == NULL) {
     ERROR("bind plugin: Unable to evaluate XPath expression `%s'.",
           xpath_expression);
@@ -541,8 +572,7 @@ static int bind_parse_generic_value_list(const char *xpath_expression, /* {{{ */
                                          void *user_data, xmlDoc *doc,
                                          xmlXPathContext *xpathCtx,
                                          time_t current_time, int ds_type) {
-  xmlXPathObject *xpathObj =
-      xmlXPathEvalExpression(BAD_CAST xpath_expression, xpathCtx);
+  xmlXPathObject *xpathObj = bind_xpath_eval(xpath_expression, xpathCtx);
   if (xpathObj == NULL) {
     ERROR("bind plugin: Unable to evaluate XPath expression `%s'.",
           xpath_expression);
@@ -601,8 +631,7 @@ static int bind_parse_generic_name_attr_value_list(
     list_callback_t list_callback, void *user_data, xmlDoc *doc,
     xmlXPathContext *xpathCtx, time_t current_time, int ds_type) {
 
-  xmlXPathObject *xpathObj =
-      xmlXPathEvalExpression(BAD_CAST xpath_expression, xpathCtx);
+  xmlXPathObject *xpathObj = bind_xpath_eval(xpath_expression, xpathCtx);
   if (xpathObj == NULL) {
     ERROR("bind plugin: Unable to evaluate XPath expression `%s'.",
           xpath_expression);
@@ -671,8 +700,7 @@ static int bind_xml_stats_handle_zone(int version, xmlDoc *doc, /* {{{ */
     xmlFree(n);
     xmlFree(c);
   } else {
-    xmlXPathObject *path_obj =
-        xmlXPathEvalExpression(BAD_CAST "name", path_ctx);
+    xmlXPathObject *path_obj = bind_xpath_eval("name", path_ctx);
     if (path_obj == NULL) {
       ERROR("bind plugin: xmlXPathEvalExpression failed.");
       return -1;
@@ -750,8 +778,7 @@ static int bind_xml_stats_search_zones(int version, xmlDoc *doc, /* {{{ */
     return -1;
   }
 
-  xmlXPathObject *zone_nodes =
-      xmlXPathEvalExpression(BAD_CAST "zones/zone", path_ctx);
+  xmlXPathObject *zone_nodes = bind_xpath_eval("zones/zone", path_ctx);
   if (zone_nodes == NULL) {
     ERROR("bind plugin: Cannot find any <view> tags.");
     xmlXPathFreeContext(zone_path_context);
@@ -796,8 +823,7 @@ static int bind_xml_stats_handle_view(int version, xmlDoc *doc, /* {{{ */
     xmlFree(view_name);
     view_name = NULL;
   } else {
-    xmlXPathObject *path_obj =
-        xmlXPathEvalExpression(BAD_CAST "name", path_ctx);
+    xmlXPathObject *path_obj = bind_xpath_eval("name", path_ctx);
     if (path_obj == NULL) {
       ERROR("bind plugin: xmlXPathEvalExpression failed.");
       return -1;
@@ -913,8 +939,7 @@ static int bind_xml_stats_search_views(int version, xmlDoc *doc, /* {{{ */
     return -1;
   }
 
-  xmlXPathObject *view_nodes =
-      xmlXPathEvalExpression(BAD_CAST "views/view", xpathCtx);
+  xmlXPathObject *view_nodes = bind_xpath_eval("views/view", xpathCtx);
   if (view_nodes == NULL) {
     ERROR("bind plugin: Cannot find any <view> tags.");
     xmlXPathFreeContext(view_path_context);
@@ -1276,9 +1301,13 @@ static int bind_xml(const char *data) /* {{{ */
 {
   int ret = -1;
 
-  xmlDoc *doc = xmlParseMemory(data, strlen(data));
+  /* Statistics documents can be large. Storing short strings in the nodes
+   * themselves saves a considerable amount of memory. */
+  xmlDoc *doc = xmlReadMemory(data, strlen(data), /* URL = */ NULL,
+                              /* encoding = */ NULL,
+                              XML_PARSE_NONET | XML_PARSE_COMPACT);
   if (doc == NULL) {
-    ERROR("bind plugin: xmlParseMemory failed.");
+    ERROR("bind plugin: xmlReadMemory failed.");
     return -1;
   }
 
@@ -1293,8 +1322,7 @@ static int bind_xml(const char *data) /* {{{ */
   // version 3.* of statistics XML (since BIND9.9)
   //
 
-  xmlXPathObject *xpathObj =
-      xmlXPathEvalExpression(BAD_CAST "/statistics", xpathCtx);
+  xmlXPathObject *xpathObj = bind_xpath_eval("/statistics", xpathCtx);
   if (xpathObj == NULL || xpathObj->nodesetval == NULL ||
       xpathObj->nodesetval->nodeNr == 0) {
     DEBUG("bind plugin: Statistics appears not to be v3");
@@ -1346,7 +1374,7 @@ static int bind_xml(const char *data) /* {{{ */
   // versions 1.* or 2.* of statistics XML
   //
 
-  xpathObj = xmlXPathEvalExpression(BAD_CAST "/isc/bind/statistics", xpathCtx);
+  xpathObj = bind_xpath_eval("/isc/bind/statistics", xpathCtx);
   if (xpathObj == NULL) {
     ERROR("bind plugin: Cannot find the <statistics> tag.");
     xmlXPathFreeContext(xpathCtx);
@@ -1576,6 +1604,18 @@ static int bind_shutdown(void) /* {{{ */
     curl = NULL;
   }
 
+  if (xpath_cache != NULL) {
+    void *key;
+    void *comp;
+
+    while (c_avl_pick(xpath_cache, &key, &comp) == 0) {
+      sfree(key);
+      xmlXPathFreeCompExpr(comp);
+    }
+    c_avl_destroy(xpath_cache);
+    xpath_cache = NULL;
+  }
+
   return 0;
 } /* }}} int bind_shutdown */
 
@@ -114,10 +114,19 @@ struct ceph_daemon {
 
   /** Number of counters */
   int ds_num;
+  /** Number of counters memory has been allocated for */
+  int ds_alloc;
   /** Track ds types */
   uint32_t *ds_types;
   /** Track ds names to match with types */
   char **ds_names;
+  /**
+   * Counter keys as found in the perf dump, e.g. "osd.op_r", so values can be
+   * matched without compacting their keys. NULL if not known.
+   */
+  char **ds_keys;
+  /** Set if a counter was not found in the schema; fetches it again. */
+  bool schema_stale;
 
   /**
    * Keep track of last data for latency values so we can calculate rate
@@ -139,6 +148,11 @@ struct yajl_struct {
   char *key;
   char *stack[YAJL_MAX_DEPTH];
   size_t depth;
+
+  /** Keys of the enclosing maps joined by ".", maintained incrementally */
+  char path[2 * DATA_MAX_NAME_LEN];
+  size_t path_len;
+  size_t path_lens[YAJL_MAX_DEPTH];
 };
 typedef struct yajl_struct yajl_struct;
 
@@ -238,40 +252,44 @@ struct cconn {
 
   /** Keep data important to yajl processing */
   struct yajl_struct yajl;
+
+  /** Fetch data after the schema has been refreshed */
+  bool data_after_schema;
 };
 
 static int ceph_cb_null(void *ctx) { return CEPH_CB_CONTINUE; }
 
 static int ceph_cb_boolean(void *ctx, int bool_val) { return CEPH_CB_CONTINUE; }
 
-#define BUFFER_ADD(dest, src)                                                  \
-  do {                                                                         \
-    size_t dest_size = sizeof(dest);                                           \
-    size_t dest_len = strlen(dest);                                            \
-    if (dest_size > dest_len) {                                                \
-      sstrncpy((dest) + dest_len, (src), dest_size - dest_len);                \
-    }                                                                          \
-    (dest)[dest_size - 1] = '\0';                                              \
-  } while (0)
+/* Appends "src" to "dest" which currently holds "*dest_len" characters,
+ * truncating if necessary. */
+static void buffer_add(char *dest, size_t dest_size, size_t *dest_len,
+                       char const *src) {
+  size_t src_len = strlen(src);
+  if (*dest_len + src_len >= dest_size)
+    src_len = dest_size - *dest_len - 1;
+
+  memcpy(dest + *dest_len, src, src_len);
+  *dest_len += src_len;
+  dest[*dest_len] = '\0';
+}
 
 static int ceph_cb_number(void *ctx, const char *number_val,
                           yajl_len_t number_len) {
   yajl_struct *state = (yajl_struct *)ctx;
   char buffer[number_len + 1];
-  char key[2 * DATA_MAX_NAME_LEN] = {0};
+  char key[2 * DATA_MAX_NAME_LEN];
+  size_t key_len = 0;
   int status;
 
+  if (state->key == NULL)
+    return CEPH_CB_CONTINUE;
+
   memcpy(buffer, number_val, number_len);
   buffer[sizeof(buffer) - 1] = '\0';
 
-  for (size_t i = 0; i < state->depth; i++) {
-    if (state->stack[i] == NULL)
-      continue;
-
-    if (strlen(key) != 0)
-      BUFFER_ADD(key, ".");
-    BUFFER_ADD(key, state->stack[i]);
-  }
+  key[0] = '\0';
+  buffer_add(key, sizeof(key), &key_len, state->path);
 
   /* Super-special case for filestore.journal_wr_bytes.avgcount: For
    * some reason, Ceph schema encodes this as a count/sum pair while all
@@ -290,8 +308,8 @@ static int ceph_cb_number(void *ctx, const char *number_val,
     return CEPH_CB_CONTINUE;
   }
 
-  BUFFER_ADD(key, ".");
-  BUFFER_ADD(key, state->key);
+  buffer_add(key, sizeof(key), &key_len, ".");
+  buffer_add(key, sizeof(key), &key_len, state->key);
 
   status = state->handler(state->handler_arg, buffer, key);
 
@@ -315,6 +333,13 @@ static int ceph_cb_start_map(void *ctx) {
   if (state->depth == YAJL_MAX_DEPTH)
     return CEPH_CB_ABORT;
 
+  state->path_lens[state->depth] = state->path_len;
+  if (state->key != NULL) {
+    if (state->path_len != 0)
+      buffer_add(state->path, sizeof(state->path), &state->path_len, ".");
+    buffer_add(state->path, sizeof(state->path), &state->path_len, state->key);
+  }
+
   state->stack[state->depth] = state->key;
   state->depth++;
   state->key = NULL;
@@ -334,6 +359,9 @@ static int ceph_cb_end_map(void *ctx) {
   state->key = state->stack[state->depth];
   state->stack[state->depth] = NULL;
 
+  state->path_len = state->path_lens[state->depth];
+  state->path[state->path_len] = '\0';
+
   return CEPH_CB_CONTINUE;
 }
 
@@ -381,7 +409,8 @@ static void ceph_daemons_print(void) {
   }
 }
 
-static void ceph_daemon_free(struct ceph_daemon *d) {
+/* Frees the counters read from the schema and the last poll data. */
+static void ceph_daemon_free_schema(struct ceph_daemon *d) {
   for (int i = 0; i < d->last_idx; i++) {
     sfree(d->last_poll_data[i]);
   }
@@ -391,9 +420,17 @@ static void ceph_daemon_free(struct ceph_daemon *d) {
 
   for (int i = 0; i < d->ds_num; i++) {
     sfree(d->ds_names[i]);
+    sfree(d->ds_keys[i]);
   }
   sfree(d->ds_types);
   sfree(d->ds_names);
+  sfree(d->ds_keys);
+  d->ds_num = 0;
+  d->ds_alloc = 0;
+}
+
+static void ceph_daemon_free(struct ceph_daemon *d) {
+  ceph_daemon_free_schema(d);
   sfree(d);
 }
 
@@ -562,20 +599,35 @@ static int ceph_daemon_add_ds_entry(struct ceph_daemon *d, const char *name,
     }
   }
 
-  d->ds_names = realloc(d->ds_names, sizeof(char *) * (d->ds_num + 1));
-  if (!d->ds_names) {
-    return -ENOMEM;
-  }
+  if (d->ds_num == d->ds_alloc) {
+    int alloc = (d->ds_alloc == 0) ? 64 : 2 * d->ds_alloc;
 
-  d->ds_types = realloc(d->ds_types, sizeof(uint32_t) * (d->ds_num + 1));
-  if (!d->ds_types) {
-    return -ENOMEM;
+    char **names = realloc(d->ds_names, sizeof(*names) * alloc);
+    if (!names) {
+      return -ENOMEM;
+    }
+    d->ds_names = names;
+
+    char **keys = realloc(d->ds_keys, sizeof(*keys) * alloc);
+    if (!keys) {
+      return -ENOMEM;
+    }
+    d->ds_keys = keys;
+
+    uint32_t *types = realloc(d->ds_types, sizeof(*types) * alloc);
+    if (!types) {
+      return -ENOMEM;
+    }
+    d->ds_types = types;
+
+    d->ds_alloc = alloc;
   }
 
   d->ds_names[d->ds_num] = malloc(DATA_MAX_NAME_LEN);
   if (!d->ds_names[d->ds_num]) {
     return -ENOMEM;
   }
+  d->ds_keys[d->ds_num] = NULL;
 
   type = (pc_type & PERFCOUNTER_DERIVE)
              ? DSET_RATE
@@ -583,10 +635,19 @@ static int ceph_daemon_add_ds_entry(struct ceph_daemon *d, const char *name,
   d->ds_types[d->ds_num] = type;
 
   if (parse_keys(ds_name, sizeof(ds_name), name)) {
+    sfree(d->ds_names[d->ds_num]);
     return 1;
   }
 
   sstrncpy(d->ds_names[d->ds_num], ds_name, DATA_MAX_NAME_LEN - 1);
+
+  /* Remember the key without ".type" if parse_keys() stripped it, too. */
+  if ((count_parts(name) > 2) && has_suffix(name, ".type")) {
+    d->ds_keys[d->ds_num] = strdup(name);
+    if (d->ds_keys[d->ds_num] != NULL)
+      d->ds_keys[d->ds_num][strlen(name) - strlen(".type")] = '\0';
+  }
+
   d->ds_num = (d->ds_num + 1);
 
   return 0;
@@ -747,6 +808,16 @@ static int node_handler_define_schema(void *arg, const char *val,
                                       const char *key) {
   struct ceph_daemon *d = (struct ceph_daemon *)arg;
   int pc_type;
+
+  /* Newer Ceph versions describe counters with more numeric fields. Only
+   * "type" is of interest; adding the others as counters would break the
+   * in-order matching of values in node_handler_fetch_data(). */
+  const char *ignore_suffixes[] = {".metric_type", ".value_type", ".priority",
+                                   ".units"};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(ignore_suffixes); i++)
+    if (has_suffix(key, ignore_suffixes[i]))
+      return 0;
+
   pc_type = atoi(val);
   return ceph_daemon_add_ds_entry(d, key, pc_type);
 }
@@ -851,7 +922,8 @@ static double get_last_avg(struct ceph_daemon *d, const char *ds_n, int index,
 /**
  * If using index guess failed, resort to searching for counter name
  */
-static uint32_t backup_search_for_type(struct ceph_daemon *d, char *ds_name) {
+static uint32_t backup_search_for_type(struct ceph_daemon *d,
+                                       const char *ds_name) {
   for (int i = 0; i < d->ds_num; i++) {
     if (strcmp(d->ds_names[i], ds_name) == 0) {
       return d->ds_types[i];
@@ -860,6 +932,26 @@ static uint32_t backup_search_for_type(struct ceph_daemon *d, char *ds_name) {
   return DSET_TYPE_UNFOUND;
 }
 
+/**
+ * Check whether "key" from the perf dump belongs to counter "index" of the
+ * schema, i.e. is the counter's key or its key followed by one of the
+ * suffixes parse_keys() strips.
+ */
+static bool ceph_daemon_key_matches(struct ceph_daemon *d, int index,
+                                    const char *key) {
+  const char *ds_key = d->ds_keys[index];
+  if (ds_key == NULL)
+    return false;
+
+  size_t ds_key_len = strlen(ds_key);
+  if (strncmp(key, ds_key, ds_key_len) != 0)
+    return false;
+
+  const char *suffix = key + ds_key_len;
+  return (suffix[0] == '\0') || (strcmp(suffix, ".avgcount") == 0) ||
+         (strcmp(suffix, ".sum") == 0) || (strcmp(suffix, ".avgtime") == 0);
+}
+
 /**
  * Process counter data and dispatch values
  */
@@ -872,11 +964,8 @@ static int node_handler_fetch_data(void *arg, const char *val,
   uint32_t type = DSET_TYPE_UNFOUND;
   int index = vtmp->index;
 
-  char ds_name[DATA_MAX_NAME_LEN];
-
-  if (parse_keys(ds_name, sizeof(ds_name), key)) {
-    return 1;
-  }
+  char ds_name_buffer[DATA_MAX_NAME_LEN];
+  const char *ds_name = NULL;
 
   if (index >= vtmp->d->ds_num) {
     // don't overflow bounds of array
@@ -886,16 +975,30 @@ static int node_handler_fetch_data(void *arg, const char *val,
   /**
    * counters should remain in same order we parsed schema... we maintain the
    * index variable to keep track of current point in list of counters. first
-   * use index to guess point in array for retrieving type. if that doesn't
-   * work, use the old way to get the counter type
+   * use index to guess point in array for retrieving type. The raw keys
+   * remembered from the schema are compared first, which spares compacting
+   * the key. if that doesn't work, use the old way to get the counter type
    */
-  if (strcmp(ds_name, vtmp->d->ds_names[index]) == 0) {
-    // found match
+  if (ceph_daemon_key_matches(vtmp->d, index, key)) {
+    ds_name = vtmp->d->ds_names[index];
     type = vtmp->d->ds_types[index];
-  } else if ((index > 0) &&
-             (strcmp(ds_name, vtmp->d->ds_names[index - 1]) == 0)) {
-    // try previous key
+  } else if ((index > 0) && ceph_daemon_key_matches(vtmp->d, index - 1, key)) {
+    ds_name = vtmp->d->ds_names[index - 1];
     type = vtmp->d->ds_types[index - 1];
+  } else {
+    if (parse_keys(ds_name_buffer, sizeof(ds_name_buffer), key)) {
+      return 1;
+    }
+    ds_name = ds_name_buffer;
+
+    if (strcmp(ds_name, vtmp->d->ds_names[index]) == 0) {
+      // found match
+      type = vtmp->d->ds_types[index];
+    } else if ((index > 0) &&
+               (strcmp(ds_name, vtmp->d->ds_names[index - 1]) == 0)) {
+      // try previous key
+      type = vtmp->d->ds_types[index - 1];
+    }
   }
 
   if (type == DSET_TYPE_UNFOUND) {
@@ -959,6 +1062,8 @@ static int node_handler_fetch_data(void *arg, const char *val,
   case DSET_TYPE_UNFOUND:
   default:
     ERROR("ceph plugin: ds %s was not properly initialized.", ds_name);
+    /* The daemon may have been upgraded: fetch the schema again. */
+    vtmp->d->schema_stale = true;
     return -1;
   }
 
@@ -1078,6 +1183,8 @@ static int cconn_process_json(struct cconn *io) {
   }
 
   io->yajl.depth = 0;
+  io->yajl.path_len = 0;
+  io->yajl.path[0] = '\0';
 
   switch (io->request_type) {
   case ASOK_REQ_DATA:
@@ -1086,9 +1193,8 @@ static int cconn_process_json(struct cconn *io) {
     break;
   case ASOK_REQ_SCHEMA:
     // init daemon specific variables
-    io->d->ds_num = 0;
-    io->d->last_idx = 0;
-    io->d->last_poll_data = NULL;
+    ceph_daemon_free_schema(io->d);
+    io->d->schema_stale = false;
     io->yajl.handler = node_handler_define_schema;
     io->yajl.handler_arg = io->d;
     result = traverse_json(io->json, io->json_len, hand);
@@ -1239,7 +1345,12 @@ static ssize_t cconn_handle_event(struct cconn *io) {
         return ret;
       }
       cconn_close(io);
-      io->request_type = ASOK_REQ_NONE;
+      if ((io->request_type == ASOK_REQ_SCHEMA) && io->data_after_schema) {
+        io->request_type = ASOK_REQ_DATA;
+        io->data_after_schema = false;
+      } else {
+        io->request_type = ASOK_REQ_NONE;
+      }
     }
     return 0;
   }
@@ -1328,6 +1439,12 @@ static ssize_t cconn_main_loop(uint32_t request_type) {
         .state = CSTATE_UNCONNECTED,
         .asok = -1,
     };
+
+    /* The schema is only fetched again if it did not match the data. */
+    if ((request_type == ASOK_REQ_DATA) && g_daemons[i]->schema_stale) {
+      io_array[i].request_type = ASOK_REQ_SCHEMA;
+      io_array[i].data_after_schema = true;
+    }
   }
 
   /** Calculate the time at which we should give up */
@@ -181,9 +181,53 @@ DEF_TEST(parse_keys) {
   return 0;
 }
 
+DEF_TEST(define_schema) {
+  char const *json =
+      "{\n"
+      "    \"osd\": {\n"
+      "        \"op_r\": {\n"
+      "            \"type\": 10,\n"
+      "            \"metric_type\": 2,\n"
+      "            \"value_type\": 1,\n"
+      "            \"description\": \"Client read operations\",\n"
+      "            \"nick\": \"rd\",\n"
+      "            \"priority\": 8,\n"
+      "            \"units\": 0\n"
+      "        },\n"
+      "        \"op_r_latency\": {\n"
+      "            \"type\": 5,\n"
+      "            \"priority\": 5\n"
+      "        }\n"
+      "    }\n"
+      "}\n";
+  struct ceph_daemon d = {0};
+  struct cconn io = {
+      .d = &d,
+      .request_type = ASOK_REQ_SCHEMA,
+      .json = (unsigned char *)json,
+      .json_len = (uint32_t)strlen(json),
+  };
+
+  CHECK_ZERO(cconn_process_json(&io));
+  EXPECT_EQ_INT(2, d.ds_num);
+  EXPECT_EQ_STR("Osd.opR", d.ds_names[0]);
+  EXPECT_EQ_STR("osd.op_r", d.ds_keys[0]);
+  EXPECT_EQ_INT(DSET_RATE, d.ds_types[0]);
+  EXPECT_EQ_STR("Osd.opRLatency", d.ds_names[1]);
+  EXPECT_EQ_STR("osd.op_r_latency", d.ds_keys[1]);
+  EXPECT_EQ_INT(DSET_LATENCY, d.ds_types[1]);
+
+  OK(ceph_daemon_key_matches(&d, 1, "osd.op_r_latency.sum"));
+  OK(!ceph_daemon_key_matches(&d, 0, "osd.op_r_latency"));
+
+  ceph_daemon_free_schema(&d);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(traverse_json);
   RUN_TEST(parse_keys);
+  RUN_TEST(define_schema);
 
   END_TEST;
 }
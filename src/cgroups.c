@@ -24,15 +24,87 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils/ignorelist/ignorelist.h"
 #include "utils/mount/mount.h"
 
-static char const *config_keys[] = {"CGroup", "IgnoreSelected"};
+#include <dirent.h>
+#include <sys/inotify.h>
+
+static char const *config_keys[] = {"CGroup", "IgnoreSelected", "Version",
+                                    "MaxDepth"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static ignorelist_t *il_cgroup;
 
+/* 0 means "detect": cgroup v1 if the cpuacct controller is mounted, v2
+ * otherwise. */
+static int cgroup_version;
+static int cgroup_max_depth = 2;
+
+/*
+ * cgroup v2
+ *
+ * The tree below the cgroup2 mount point is scanned once and then kept up to
+ * date with inotify: a directory is only read again when an event for it
+ * arrives. The files of each cgroup are opened once and re-read with pread().
+ * Cgroups are identified by their inode, so a cgroup that is removed and
+ * re-created under the same name gets a fresh entry and removed cgroups are
+ * dropped when their parent is rescanned.
+ */
+enum {
+  CG2_CPU_STAT,
+  CG2_MEMORY_STAT,
+  CG2_IO_STAT,
+  CG2_CPU_PRESSURE,
+  CG2_MEMORY_PRESSURE,
+  CG2_IO_PRESSURE,
+  CG2_FILES_NUM,
+};
+
+static char const *cg2_file_names[CG2_FILES_NUM] = {
+    "cpu.stat",     "memory.stat",     "io.stat",
+    "cpu.pressure", "memory.pressure", "io.pressure",
+};
+
+/* Special values of cg2_entry_t.fds. */
+#define CG2_FD_CLOSED -1
+#define CG2_FD_MISSING -2 /* e.g. the controller is not enabled */
+
+/* Keys of memory.stat that are dispatched. */
+static char const *cg2_memory_keys[] = {
+    "anon",      "file",       "kernel_stack", "pagetables",    "sock",
+    "shmem",     "file_mapped", "file_dirty",  "file_writeback", "slab",
+};
+
+typedef struct cg2_entry_s cg2_entry_t;
+struct cg2_entry_s {
+  ino_t ino;
+  char *path;
+  char *name;
+  int depth;
+  int wd;
+  bool ignored;
+  bool dirty;
+  uint64_t seen;
+  int fds[CG2_FILES_NUM];
+
+  cg2_entry_t *parent;
+  cg2_entry_t *children;
+  cg2_entry_t *next_sibling;
+};
+
+static cg2_entry_t *cg2_root;
+static c_avl_tree_t *cg2_by_ino; /* ino_t -> cg2_entry_t */
+static c_avl_tree_t *cg2_by_wd;  /* int -> cg2_entry_t */
+static int cg2_inotify_fd = -1;
+/* Set if a directory could not be watched; the tree is rescanned on every
+ * read then. */
+static bool cg2_rescan_always;
+static uint64_t cg2_generation;
+static long cg2_clock_ticks;
+
 __attribute__((nonnull(1))) __attribute__((nonnull(2))) static void
 cgroups_submit_one(char const *plugin_instance, char const *type_instance,
                    value_t value) {
@@ -154,6 +226,444 @@ static int read_cpuacct_root(const char *dirname, const char *filename,
   return 0;
 }
 
+static int cg2_compare_ino(const void *a, const void *b) {
+  ino_t ia = *(const ino_t *)a;
+  ino_t ib = *(const ino_t *)b;
+  return (ia > ib) - (ia < ib);
+}
+
+static int cg2_compare_wd(const void *a, const void *b) {
+  int ia = *(const int *)a;
+  int ib = *(const int *)b;
+  return (ia > ib) - (ia < ib);
+}
+
+static void cg2_close_files(cg2_entry_t *e) {
+  for (size_t i = 0; i < CG2_FILES_NUM; i++) {
+    if (e->fds[i] >= 0)
+      close(e->fds[i]);
+    e->fds[i] = CG2_FD_CLOSED;
+  }
+}
+
+/* Removes an entry and all entries below it. */
+static void cg2_remove(cg2_entry_t *e) {
+  while (e->children != NULL)
+    cg2_remove(e->children);
+
+  if (e->parent != NULL) {
+    cg2_entry_t **pp = &e->parent->children;
+    while (*pp != e)
+      pp = &(*pp)->next_sibling;
+    *pp = e->next_sibling;
+  }
+
+  c_avl_remove(cg2_by_ino, &e->ino, NULL, NULL);
+  if (e->wd >= 0) {
+    c_avl_remove(cg2_by_wd, &e->wd, NULL, NULL);
+    /* Fails harmlessly if the directory is already gone. */
+    inotify_rm_watch(cg2_inotify_fd, e->wd);
+  }
+
+  DEBUG("cgroups plugin: Removing \"%s\".", e->path);
+  cg2_close_files(e);
+  sfree(e->path);
+  sfree(e->name);
+  sfree(e);
+}
+
+static void cg2_scan_dir(cg2_entry_t *parent);
+
+static cg2_entry_t *cg2_add(cg2_entry_t *parent, char const *path,
+                            char const *name, ino_t ino) {
+  cg2_entry_t *e = calloc(1, sizeof(*e));
+  if (e == NULL) {
+    ERROR("cgroups plugin: calloc failed.");
+    return NULL;
+  }
+  e->ino = ino;
+  e->path = strdup(path);
+  e->name = strdup(name);
+  e->depth = (parent != NULL) ? parent->depth + 1 : 0;
+  e->wd = -1;
+  for (size_t i = 0; i < CG2_FILES_NUM; i++)
+    e->fds[i] = CG2_FD_CLOSED;
+  if ((e->path == NULL) || (e->name == NULL)) {
+    ERROR("cgroups plugin: strdup failed.");
+    sfree(e->path);
+    sfree(e->name);
+    sfree(e);
+    return NULL;
+  }
+
+  /* The ignorelist is matched once per cgroup. */
+  e->ignored = (e->depth == 0) || ignorelist_match(il_cgroup, name);
+
+  if (c_avl_insert(cg2_by_ino, &e->ino, e) != 0) {
+    ERROR("cgroups plugin: Inserting \"%s\" failed.", path);
+    sfree(e->path);
+    sfree(e->name);
+    sfree(e);
+    return NULL;
+  }
+
+  e->parent = parent;
+  if (parent != NULL) {
+    e->next_sibling = parent->children;
+    parent->children = e;
+  }
+
+  if (e->depth < cgroup_max_depth) {
+    e->wd = inotify_add_watch(cg2_inotify_fd, path,
+                              IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                  IN_MOVED_TO | IN_ONLYDIR);
+    if (e->wd < 0) {
+      if (!cg2_rescan_always)
+        WARNING("cgroups plugin: inotify_add_watch (\"%s\") failed: %s. "
+                "Rescanning the cgroup tree on every read.",
+                path, STRERRNO);
+      cg2_rescan_always = true;
+    } else if (c_avl_insert(cg2_by_wd, &e->wd, e) != 0) {
+      inotify_rm_watch(cg2_inotify_fd, e->wd);
+      e->wd = -1;
+      cg2_rescan_always = true;
+    }
+
+    cg2_scan_dir(e);
+  }
+
+  return e;
+} /* cg2_entry_t *cg2_add */
+
+/* Reads the sub-directories of "parent", adds new cgroups and removes the
+ * ones that have disappeared. */
+static void cg2_scan_dir(cg2_entry_t *parent) {
+  uint64_t generation = ++cg2_generation;
+
+  DIR *dh = opendir(parent->path);
+  if (dh == NULL) {
+    /* The cgroup is being removed; the parent's watch will tell. */
+    DEBUG("cgroups plugin: opendir (\"%s\") failed: %s", parent->path,
+          STRERRNO);
+    return;
+  }
+
+  struct dirent *de;
+  while ((de = readdir(dh)) != NULL) {
+    if (de->d_name[0] == '.')
+      continue;
+    if ((de->d_type != DT_DIR) && (de->d_type != DT_UNKNOWN))
+      continue;
+
+    struct stat statbuf;
+    if (fstatat(dirfd(dh), de->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) != 0)
+      continue;
+    if (!S_ISDIR(statbuf.st_mode))
+      continue;
+
+    cg2_entry_t *e = NULL;
+    if (c_avl_get(cg2_by_ino, &statbuf.st_ino, (void *)&e) != 0) {
+      char path[PATH_MAX];
+      ssnprintf(path, sizeof(path), "%s/%s", parent->path, de->d_name);
+      e = cg2_add(parent, path, de->d_name, statbuf.st_ino);
+    }
+    if (e != NULL)
+      e->seen = generation;
+  }
+  closedir(dh);
+
+  cg2_entry_t *e = parent->children;
+  while (e != NULL) {
+    cg2_entry_t *next = e->next_sibling;
+    if (e->seen != generation)
+      cg2_remove(e);
+    e = next;
+  }
+} /* void cg2_scan_dir */
+
+/* Rescans the directories of entries flagged by inotify events, or all
+ * directories if "all" is true. */
+static void cg2_rescan(cg2_entry_t *e, bool all) {
+  if (all || e->dirty) {
+    e->dirty = false;
+    cg2_scan_dir(e);
+  }
+
+  for (cg2_entry_t *c = e->children; c != NULL; c = c->next_sibling)
+    if (c->depth < cgroup_max_depth)
+      cg2_rescan(c, all);
+}
+
+/* Drains the inotify queue and rescans the affected directories. */
+static void cg2_handle_events(void) {
+  char buf[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool have_events = false;
+  bool overflow = cg2_rescan_always;
+
+  while (true) {
+    ssize_t len = read(cg2_inotify_fd, buf, sizeof(buf));
+    if (len <= 0)
+      break;
+
+    for (char *ptr = buf; ptr < buf + len;) {
+      struct inotify_event const *ev = (void *)ptr;
+      ptr += sizeof(*ev) + ev->len;
+
+      if (ev->mask & IN_Q_OVERFLOW) {
+        overflow = true;
+        continue;
+      }
+      if (ev->wd < 0)
+        continue;
+
+      cg2_entry_t *e = NULL;
+      if (c_avl_get(cg2_by_wd, &ev->wd, (void *)&e) == 0) {
+        e->dirty = true;
+        have_events = true;
+      }
+    }
+  }
+
+  if (have_events || overflow)
+    cg2_rescan(cg2_root, overflow);
+}
+
+__attribute__((nonnull(1))) static void
+cg2_submit(char const *plugin_instance, char const *type,
+           char const *type_instance, value_t *values, size_t values_len) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = values;
+  vl.values_len = values_len;
+  sstrncpy(vl.plugin, "cgroups", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+  if (type_instance != NULL)
+    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+
+  plugin_dispatch_values(&vl);
+} /* void cg2_submit */
+
+/* Parses "key value" lines and dispatches cpu.stat or memory.stat. */
+static void cg2_parse_flat_keyed(cg2_entry_t *e, int file, char *buf) {
+  char *saveptr = NULL;
+  for (char *line = strtok_r(buf, "\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\n", &saveptr)) {
+    char *fields[2];
+    if (strsplit(line, fields, STATIC_ARRAY_SIZE(fields)) != 2)
+      continue;
+
+    if (file == CG2_CPU_STAT) {
+      char const *type_instance = NULL;
+      if (strcmp(fields[0], "user_usec") == 0)
+        type_instance = "user";
+      else if (strcmp(fields[0], "system_usec") == 0)
+        type_instance = "system";
+      else if (strcmp(fields[0], "throttled_usec") == 0)
+        type_instance = "throttled";
+      else
+        continue;
+
+      /* Report clock ticks, like cpuacct.stat in cgroup v1. */
+      uint64_t usec = strtoull(fields[1], NULL, 10);
+      value_t v = {.derive = (derive_t)(usec * (uint64_t)cg2_clock_ticks /
+                                        1000000)};
+      cg2_submit(e->name, "cpu", type_instance, &v, 1);
+      continue;
+    }
+
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(cg2_memory_keys); i++) {
+      if (strcmp(fields[0], cg2_memory_keys[i]) != 0)
+        continue;
+      value_t v = {.gauge = (gauge_t)strtoull(fields[1], NULL, 10)};
+      cg2_submit(e->name, "memory", fields[0], &v, 1);
+      break;
+    }
+  }
+} /* void cg2_parse_flat_keyed */
+
+/* Parses io.stat and dispatches the sum over all devices. */
+static void cg2_parse_io_stat(cg2_entry_t *e, char *buf) {
+  uint64_t rbytes = 0, wbytes = 0, rios = 0, wios = 0;
+
+  char *saveptr = NULL;
+  for (char *field = strtok_r(buf, " \n", &saveptr); field != NULL;
+       field = strtok_r(NULL, " \n", &saveptr)) {
+    char *value = strchr(field, '=');
+    if (value == NULL)
+      continue;
+    *value = 0;
+    value++;
+
+    if (strcmp(field, "rbytes") == 0)
+      rbytes += strtoull(value, NULL, 10);
+    else if (strcmp(field, "wbytes") == 0)
+      wbytes += strtoull(value, NULL, 10);
+    else if (strcmp(field, "rios") == 0)
+      rios += strtoull(value, NULL, 10);
+    else if (strcmp(field, "wios") == 0)
+      wios += strtoull(value, NULL, 10);
+  }
+
+  cg2_submit(e->name, "disk_octets", NULL,
+             (value_t[]){{.derive = (derive_t)rbytes},
+                         {.derive = (derive_t)wbytes}},
+             2);
+  cg2_submit(e->name, "disk_ops", NULL,
+             (value_t[]){{.derive = (derive_t)rios},
+                         {.derive = (derive_t)wios}},
+             2);
+} /* void cg2_parse_io_stat */
+
+/* Parses a pressure file, e.g.
+ *   some avg10=0.00 avg60=0.00 avg300=0.00 total=12345
+ *   full avg10=0.00 avg60=0.00 avg300=0.00 total=6789
+ * and dispatches the total stall times. */
+static void cg2_parse_pressure(cg2_entry_t *e, char const *resource,
+                               char *buf) {
+  char *saveptr = NULL;
+  for (char *line = strtok_r(buf, "\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\n", &saveptr)) {
+    char *fields[5];
+    int fields_num = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
+    if ((fields_num != 5) || (strncmp(fields[4], "total=", 6) != 0))
+      continue;
+
+    char type_instance[DATA_MAX_NAME_LEN];
+    ssnprintf(type_instance, sizeof(type_instance), "%s-%s", resource,
+              fields[0]);
+    value_t v = {.derive =
+                     (derive_t)(strtoull(fields[4] + 6, NULL, 10) / 1000)};
+    cg2_submit(e->name, "total_time_in_ms", type_instance, &v, 1);
+  }
+} /* void cg2_parse_pressure */
+
+static void cg2_read_entry(cg2_entry_t *e) {
+  char buf[8192];
+
+  for (int i = 0; i < CG2_FILES_NUM; i++) {
+    if (e->fds[i] == CG2_FD_MISSING)
+      continue;
+
+    if (e->fds[i] == CG2_FD_CLOSED) {
+      char path[PATH_MAX];
+      ssnprintf(path, sizeof(path), "%s/%s", e->path, cg2_file_names[i]);
+      e->fds[i] = open(path, O_RDONLY | O_CLOEXEC);
+      if (e->fds[i] < 0) {
+        e->fds[i] = CG2_FD_MISSING;
+        continue;
+      }
+    }
+
+    ssize_t len = pread(e->fds[i], buf, sizeof(buf) - 1, 0);
+    if (len < 0) {
+      /* ENODEV: The cgroup has been removed. */
+      if (errno != ENODEV)
+        ERROR("cgroups plugin: Reading \"%s/%s\" failed: %s", e->path,
+              cg2_file_names[i], STRERRNO);
+      close(e->fds[i]);
+      e->fds[i] = CG2_FD_MISSING;
+      continue;
+    }
+    buf[len] = 0;
+
+    switch (i) {
+    case CG2_CPU_STAT:
+    case CG2_MEMORY_STAT:
+      cg2_parse_flat_keyed(e, i, buf);
+      break;
+    case CG2_IO_STAT:
+      cg2_parse_io_stat(e, buf);
+      break;
+    case CG2_CPU_PRESSURE:
+      cg2_parse_pressure(e, "cpu", buf);
+      break;
+    case CG2_MEMORY_PRESSURE:
+      cg2_parse_pressure(e, "memory", buf);
+      break;
+    case CG2_IO_PRESSURE:
+      cg2_parse_pressure(e, "io", buf);
+      break;
+    }
+  }
+} /* void cg2_read_entry */
+
+static void cg2_read_tree(cg2_entry_t *e) {
+  if (!e->ignored)
+    cg2_read_entry(e);
+
+  for (cg2_entry_t *c = e->children; c != NULL; c = c->next_sibling)
+    cg2_read_tree(c);
+}
+
+static int cg2_setup(char const *mount_point) {
+  struct stat statbuf;
+
+  if (stat(mount_point, &statbuf) != 0) {
+    ERROR("cgroups plugin: stat (\"%s\") failed: %s", mount_point, STRERRNO);
+    return -1;
+  }
+
+  cg2_by_ino = c_avl_create(cg2_compare_ino);
+  cg2_by_wd = c_avl_create(cg2_compare_wd);
+  if ((cg2_by_ino == NULL) || (cg2_by_wd == NULL)) {
+    ERROR("cgroups plugin: c_avl_create failed.");
+    return -1;
+  }
+
+  cg2_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (cg2_inotify_fd < 0) {
+    WARNING("cgroups plugin: inotify_init1 failed: %s. Rescanning the cgroup "
+            "tree on every read.",
+            STRERRNO);
+    cg2_rescan_always = true;
+  }
+
+  cg2_clock_ticks = sysconf(_SC_CLK_TCK);
+  if (cg2_clock_ticks <= 0)
+    cg2_clock_ticks = 100;
+
+  cg2_root = cg2_add(/* parent = */ NULL, mount_point, mount_point,
+                     statbuf.st_ino);
+  if (cg2_root == NULL)
+    return -1;
+
+  return 0;
+} /* int cg2_setup */
+
+static int cg2_read(void) {
+  if (cg2_root == NULL) {
+    cu_mount_t *mnt_list = NULL;
+    if (cu_mount_getlist(&mnt_list) == NULL) {
+      ERROR("cgroups plugin: cu_mount_getlist failed.");
+      return -1;
+    }
+
+    int status = -1;
+    for (cu_mount_t *mnt_ptr = mnt_list; mnt_ptr != NULL;
+         mnt_ptr = mnt_ptr->next) {
+      if (strcmp(mnt_ptr->type, "cgroup2") == 0) {
+        status = cg2_setup(mnt_ptr->dir);
+        break;
+      }
+    }
+    cu_mount_freelist(mnt_list);
+
+    if (status != 0) {
+      WARNING("cgroups plugin: Unable to find the cgroup2 mount-point.");
+      return -1;
+    }
+  } else if (cg2_inotify_fd >= 0) {
+    cg2_handle_events();
+  } else {
+    cg2_rescan(cg2_root, /* all = */ true);
+  }
+
+  cg2_read_tree(cg2_root);
+  return 0;
+} /* int cg2_read */
+
 static int cgroups_init(void) {
   if (il_cgroup == NULL)
     il_cgroup = ignorelist_create(1);
@@ -174,6 +684,22 @@ static int cgroups_config(const char *key, const char *value) {
     else
       ignorelist_set_invert(il_cgroup, 1);
     return 0;
+  } else if (strcasecmp(key, "Version") == 0) {
+    int tmp = atoi(value);
+    if ((tmp != 1) && (tmp != 2)) {
+      ERROR("cgroups plugin: Version must be 1 or 2.");
+      return 1;
+    }
+    cgroup_version = tmp;
+    return 0;
+  } else if (strcasecmp(key, "MaxDepth") == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("cgroups plugin: MaxDepth must be at least 1.");
+      return 1;
+    }
+    cgroup_max_depth = tmp;
+    return 0;
   }
 
   return -1;
@@ -183,6 +709,9 @@ static int cgroups_read(void) {
   cu_mount_t *mnt_list = NULL;
   bool cgroup_found = false;
 
+  if (cgroup_version == 2)
+    return cg2_read();
+
   if (cu_mount_getlist(&mnt_list) == NULL) {
     ERROR("cgroups plugin: cu_mount_getlist failed.");
     return -1;
@@ -207,18 +736,46 @@ static int cgroups_read(void) {
 
   cu_mount_freelist(mnt_list);
 
+  if (!cgroup_found && (cgroup_version == 0)) {
+    INFO("cgroups plugin: No cgroup mount-point with the \"cpuacct\" "
+         "option found, using cgroup v2.");
+    cgroup_version = 2;
+    return cg2_read();
+  }
+
   if (!cgroup_found) {
     WARNING("cgroups plugin: Unable to find cgroup "
             "mount-point with the \"cpuacct\" option.");
     return -1;
   }
 
+  cgroup_version = 1;
   return 0;
 } /* int cgroup_read */
 
+static int cgroups_shutdown(void) {
+  if (cg2_root != NULL)
+    cg2_remove(cg2_root);
+  cg2_root = NULL;
+
+  if (cg2_by_ino != NULL)
+    c_avl_destroy(cg2_by_ino);
+  cg2_by_ino = NULL;
+  if (cg2_by_wd != NULL)
+    c_avl_destroy(cg2_by_wd);
+  cg2_by_wd = NULL;
+
+  if (cg2_inotify_fd >= 0)
+    close(cg2_inotify_fd);
+  cg2_inotify_fd = -1;
+
+  return 0;
+} /* int cgroups_shutdown */
+
 void module_register(void) {
   plugin_register_config("cgroups", cgroups_config, config_keys,
                          config_keys_num);
   plugin_register_init("cgroups", cgroups_init);
   plugin_register_read("cgroups", cgroups_read);
+  plugin_register_shutdown("cgroups", cgroups_shutdown);
 } /* void module_register */
@@ -96,6 +96,8 @@ extern int optind, opterr, optopt;
 
 static char *socket_file_g;
 static char *value_string_g;
+static char **value_strings_g;
+static size_t value_strings_num_g;
 static char *hostname_g;
 
 static char *range_warning_s;
@@ -241,12 +243,16 @@ __attribute__((noreturn)) static void usage(const char *name) {
           "  -s <socket>    Path to collectd's UNIX-socket.\n"
           "  -n <v_spec>    Value specification to get from collectd.\n"
           "                 Format: `plugin-instance/type-instance'\n"
+          "                 May be repeated and may contain the wildcards\n"
+          "                 `*', `?' and `[...]'; all matching values are\n"
+          "                 then fetched at once and checked together.\n"
           "  -d <ds>        Select the DS to examine. May be repeated to "
           "examine multiple\n"
           "                 DSes. By default all DSes are used.\n"
           "  -g <consol>    Method to use to consolidate several DSes.\n"
           "                 See below for a list of valid arguments.\n"
-          "  -H <host>      Hostname to query the values for.\n"
+          "  -H <host>      Hostname to query the values for. May contain "
+          "wildcards.\n"
           "  -c <range>     Critical range\n"
           "  -w <range>     Warning range\n"
           "  -m             Treat \"Not a Number\" (NaN) as critical (default: "
@@ -573,6 +579,144 @@ static int do_check(lcc_connection_t *connection) {
   return status;
 } /* int do_check */
 
+static bool has_wildcard(char const *str) {
+  return strpbrk(str, "*?[") != NULL;
+} /* bool has_wildcard */
+
+/* Fetches all value specifications given with `-n' using a single GETVALS
+ * request and runs the selected consolidation over the concatenation of all
+ * data sources. Each DS is labeled with its identifier so the performance
+ * data stays unambiguous. */
+static int do_check_batch(lcc_connection_t *connection) /* {{{ */
+{
+  lcc_getval_result_t *results = NULL;
+  size_t results_num = 0;
+  gauge_t *values = NULL;
+  char **values_names = NULL;
+  size_t values_num = 0;
+  char **patterns;
+  bool show_host = has_wildcard(hostname_g);
+  int status;
+
+  patterns = calloc(value_strings_num_g, sizeof(*patterns));
+  if (patterns == NULL) {
+    fprintf(stderr, "calloc failed: %s\n", strerror(errno));
+    LCC_DESTROY(connection);
+    return RET_UNKNOWN;
+  }
+
+  for (size_t i = 0; i < value_strings_num_g; i++) {
+    size_t len = strlen(hostname_g) + strlen(value_strings_g[i]) + 2;
+
+    patterns[i] = malloc(len);
+    if (patterns[i] == NULL) {
+      fprintf(stderr, "malloc failed: %s\n", strerror(errno));
+      for (size_t j = 0; j < i; j++)
+        free(patterns[j]);
+      free(patterns);
+      LCC_DESTROY(connection);
+      return RET_UNKNOWN;
+    }
+    snprintf(patterns[i], len, "%s/%s", hostname_g, value_strings_g[i]);
+  }
+
+  status = lcc_getvals(connection, (char const *const *)patterns,
+                       value_strings_num_g, &results, &results_num);
+  for (size_t i = 0; i < value_strings_num_g; i++)
+    free(patterns[i]);
+  free(patterns);
+
+  if (status != 0) {
+    printf("ERROR: Retrieving values from the daemon failed: %s.\n",
+           lcc_strerror(connection));
+    LCC_DESTROY(connection);
+    return RET_CRITICAL;
+  }
+
+  LCC_DESTROY(connection);
+
+  if (results_num == 0) {
+    printf("ERROR: No values matching the given specification.\n");
+    return RET_CRITICAL;
+  }
+
+  status = RET_OKAY;
+  for (size_t i = 0; (i < results_num) && (status == RET_OKAY); i++) {
+    lcc_getval_result_t *r = results + i;
+    char ident_str[1024];
+    char *ident_ptr = ident_str;
+    gauge_t *tmp_values;
+    char **tmp_names;
+
+    status = filter_ds(&r->values_num, &r->values, &r->values_names);
+    if (status != RET_OKAY)
+      break;
+
+    lcc_identifier_to_string(NULL, ident_str, sizeof(ident_str),
+                             &r->identifier);
+    /* Strip the host name unless several hosts may be involved. */
+    if (!show_host && (strchr(ident_str, '/') != NULL))
+      ident_ptr = strchr(ident_str, '/') + 1;
+
+    tmp_values =
+        realloc(values, (values_num + r->values_num) * sizeof(*values));
+    if (tmp_values == NULL) {
+      fprintf(stderr, "realloc failed: %s\n", strerror(errno));
+      status = RET_UNKNOWN;
+      break;
+    }
+    values = tmp_values;
+
+    tmp_names = realloc(values_names,
+                        (values_num + r->values_num) * sizeof(*values_names));
+    if (tmp_names == NULL) {
+      fprintf(stderr, "realloc failed: %s\n", strerror(errno));
+      status = RET_UNKNOWN;
+      break;
+    }
+    values_names = tmp_names;
+
+    for (size_t j = 0; j < r->values_num; j++) {
+      size_t len = strlen(ident_ptr) + strlen(r->values_names[j]) + 2;
+      char *name = malloc(len);
+
+      if (name == NULL) {
+        fprintf(stderr, "malloc failed: %s\n", strerror(errno));
+        status = RET_UNKNOWN;
+        break;
+      }
+      snprintf(name, len, "%s:%s", ident_ptr, r->values_names[j]);
+
+      values[values_num] = r->values[j];
+      values_names[values_num] = name;
+      values_num++;
+    }
+  }
+
+  /* filter_ds() may have replaced the arrays, which lcc_getvals_free()
+   * releases just the same. */
+  lcc_getvals_free(results, results_num);
+
+  if (status == RET_OKAY) {
+    status = RET_UNKNOWN;
+    if (consolitation_g == CON_NONE)
+      status = do_check_con_none(values_num, values, values_names);
+    else if (consolitation_g == CON_AVERAGE)
+      status = do_check_con_average(values_num, values, values_names);
+    else if (consolitation_g == CON_SUM)
+      status = do_check_con_sum(values_num, values, values_names);
+    else if (consolitation_g == CON_PERCENTAGE)
+      status = do_check_con_percentage(values_num, values, values_names);
+  }
+
+  free(values);
+  for (size_t i = 0; i < values_num; i++)
+    free(values_names[i]);
+  free(values_names);
+
+  return status;
+} /* }}} int do_check_batch */
+
 int main(int argc, char **argv) {
   char address[1024];
   lcc_connection_t *connection;
@@ -608,9 +752,20 @@ int main(int argc, char **argv) {
     case 's':
       socket_file_g = optarg;
       break;
-    case 'n':
+    case 'n': {
+      char **tmp;
+      tmp = realloc(value_strings_g,
+                    (value_strings_num_g + 1) * sizeof(*value_strings_g));
+      if (tmp == NULL) {
+        fprintf(stderr, "realloc failed: %s\n", strerror(errno));
+        return RET_UNKNOWN;
+      }
+      value_strings_g = tmp;
+      value_strings_g[value_strings_num_g] = optarg;
+      value_strings_num_g++;
       value_string_g = optarg;
       break;
+    }
     case 'H':
       hostname_g = optarg;
       break;
@@ -671,5 +826,9 @@ int main(int argc, char **argv) {
   if (0 == strcasecmp(value_string_g, "LIST"))
     return do_listval(connection);
 
+  if ((value_strings_num_g > 1) || has_wildcard(hostname_g) ||
+      has_wildcard(value_string_g))
+    return do_check_batch(connection);
+
   return do_check(connection);
 } /* int main */
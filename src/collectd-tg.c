@@ -33,9 +33,12 @@
 #endif
 
 #include <errno.h>
+#include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -52,6 +55,15 @@
 #define DEF_NUM_PLUGINS 20
 #define DEF_NUM_VALUES 100000
 #define DEF_INTERVAL 10.0
+#define DEF_NUM_THREADS 1
+#define DEF_BATCH_SIZE 1
+#define DEF_SPREAD 1.0
+#define DEF_REPORT_INTERVAL 1.0
+
+/* Latencies are counted in a log-linear histogram: 16 buckets per power of
+ * two, i.e. with a relative error of at most 1/16. */
+#define LATENCY_SUB_BUCKETS 16
+#define LATENCY_BUCKETS (LATENCY_SUB_BUCKETS * 40)
 
 static int conf_num_hosts = DEF_NUM_HOSTS;
 static int conf_num_plugins = DEF_NUM_PLUGINS;
@@ -59,10 +71,46 @@ static int conf_num_values = DEF_NUM_VALUES;
 static double conf_interval = DEF_INTERVAL;
 static const char *conf_destination = NET_DEFAULT_V6_ADDR;
 static const char *conf_service = NET_DEFAULT_PORT;
-
-static lcc_network_t *net;
-
-static c_heap_t *values_heap;
+static const char *conf_socket;
+static int conf_num_threads = DEF_NUM_THREADS;
+static int conf_batch_size = DEF_BATCH_SIZE;
+static double conf_skew;
+static double conf_churn;
+static double conf_spread = DEF_SPREAD;
+static double conf_duration;
+static double conf_report_interval = DEF_REPORT_INTERVAL;
+static bool conf_benchmark;
+
+typedef struct {
+  uint64_t values;
+  uint64_t errors;
+  uint64_t count;
+  uint64_t max;
+  uint64_t buckets[LATENCY_BUCKETS];
+} stats_t;
+
+typedef struct {
+  pthread_t thread;
+  int first_series;
+  int num_series;
+
+  c_heap_t *values_heap;
+  lcc_network_t *net;
+  lcc_connection_t *con;
+  lcc_value_list_t *batch;
+  int batch_num;
+  unsigned short rand_state[3];
+
+  /* Protects "stats", which is read by the reporting thread. */
+  pthread_mutex_t lock;
+  stats_t stats;
+} sender_t;
+
+static sender_t *senders;
+
+/* Normalizes the popularity weights, so that the average interval is
+ * "conf_interval". */
+static double skew_factor = 1.0;
 
 static struct sigaction sigint_action;
 static struct sigaction sigterm_action;
@@ -86,12 +134,26 @@ __attribute__((noreturn)) static void exit_usage(int exit_status) /* {{{ */
       "                   (Default: %s)\n"
       "    -D <port>      Destination port of the network packets.\n"
       "                   (Default: %s)\n"
+      "    -s <path>      Send values to the UNIX socket <path> instead.\n"
+      "    -B <number>    Values per PUTBIN command when using -s.\n"
+      "                   (Default: %i, i.e. use PUTVAL)\n"
+      "    -t <number>    Number of sending threads. (Default: %i)\n"
+      "    -z <exponent>  Zipf exponent of the series' popularity.\n"
+      "                   (Default: 0, i.e. the same interval for all)\n"
+      "    -c <ratio>     Probability that a series is replaced by a new one\n"
+      "                   after each value. (Default: 0)\n"
+      "    -S <ratio>     Part of the interval the series are spread over.\n"
+      "                   (Default: %.3f)\n"
+      "    -b             Benchmark mode: send values as fast as possible.\n"
+      "    -T <seconds>   Stop after <seconds>. (Default: run until SIGINT)\n"
+      "    -r <seconds>   Report interval, zero to disable. (Default: %.3f)\n"
       "    -h             Print usage information (this output).\n"
       "\n"
       "Copyright (C) 2010-2012  Florian Forster\n"
       "Licensed under the MIT license.\n",
       DEF_NUM_VALUES, DEF_NUM_HOSTS, DEF_NUM_PLUGINS, DEF_INTERVAL,
-      NET_DEFAULT_V6_ADDR, NET_DEFAULT_PORT);
+      NET_DEFAULT_V6_ADDR, NET_DEFAULT_PORT, DEF_BATCH_SIZE, DEF_NUM_THREADS,
+      DEF_SPREAD, DEF_REPORT_INTERVAL);
   exit(exit_status);
 } /* }}} void exit_usage */
 
@@ -110,6 +172,17 @@ static double dtime(void) /* {{{ */
 
   return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
 } /* }}} double dtime */
+
+/* Returns a monotonic time stamp in nanoseconds, used to measure latencies. */
+static uint64_t ntime(void) /* {{{ */
+{
+  struct timespec ts = {0};
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    perror("clock_gettime");
+
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+} /* }}} uint64_t ntime */
 #else
 /* Work around for Mac OS X which doesn't have clock_gettime(2). *sigh* */
 static double dtime(void) /* {{{ */
@@ -121,6 +194,11 @@ static double dtime(void) /* {{{ */
 
   return (double)tv.tv_sec + ((double)tv.tv_usec) / 1e6;
 } /* }}} double dtime */
+
+static uint64_t ntime(void) /* {{{ */
+{
+  return (uint64_t)(dtime() * 1e9);
+} /* }}} uint64_t ntime */
 #endif
 
 static int compare_time(const void *v0, const void *v1) /* {{{ */
@@ -136,7 +214,7 @@ static int compare_time(const void *v0, const void *v1) /* {{{ */
     return 0;
 } /* }}} int compare_time */
 
-static int get_boundet_random(int min, int max) /* {{{ */
+static int get_boundet_random(sender_t *s, int min, int max) /* {{{ */
 {
   int range;
 
@@ -147,11 +225,94 @@ static int get_boundet_random(int min, int max) /* {{{ */
 
   range = max - min;
 
-  return min + ((int)(((double)range) * ((double)random()) /
-                      (((double)RAND_MAX) + 1.0)));
+  return min + (int)(((double)range) * erand48(s->rand_state));
 } /* }}} int get_boundet_random */
 
-static lcc_value_list_t *create_value_list(void) /* {{{ */
+static void stats_add_latency(stats_t *st, uint64_t ns) /* {{{ */
+{
+  size_t idx = (size_t)ns;
+
+  if (ns >= LATENCY_SUB_BUCKETS) {
+    int exp = 0;
+    while ((ns >> exp) >= 2 * LATENCY_SUB_BUCKETS)
+      exp++;
+    idx = (size_t)(exp + 1) * LATENCY_SUB_BUCKETS +
+          (size_t)((ns >> exp) - LATENCY_SUB_BUCKETS);
+  }
+  if (idx >= LATENCY_BUCKETS)
+    idx = LATENCY_BUCKETS - 1;
+
+  st->buckets[idx]++;
+  st->count++;
+  if (st->max < ns)
+    st->max = ns;
+} /* }}} void stats_add_latency */
+
+/* Returns the upper bound of the bucket, in nanoseconds. */
+static uint64_t stats_bucket_bound(size_t idx) /* {{{ */
+{
+  if (idx < LATENCY_SUB_BUCKETS)
+    return (uint64_t)idx + 1;
+
+  int exp = (int)(idx / LATENCY_SUB_BUCKETS) - 1;
+  uint64_t sub = (uint64_t)(idx % LATENCY_SUB_BUCKETS) + LATENCY_SUB_BUCKETS;
+  return (sub + 1) << exp;
+} /* }}} uint64_t stats_bucket_bound */
+
+static double stats_percentile(const stats_t *st, double percent) /* {{{ */
+{
+  uint64_t sum = 0;
+
+  if (st->count == 0)
+    return NAN;
+
+  uint64_t want = (uint64_t)ceil(((double)st->count) * percent / 100.0);
+  if (want == 0)
+    want = 1;
+
+  for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+    sum += st->buckets[i];
+    if (sum >= want) {
+      uint64_t bound = stats_bucket_bound(i);
+      return (double)((bound < st->max) ? bound : st->max);
+    }
+  }
+
+  return (double)st->max;
+} /* }}} double stats_percentile */
+
+static void stats_merge(stats_t *dst, const stats_t *src) /* {{{ */
+{
+  dst->values += src->values;
+  dst->errors += src->errors;
+  dst->count += src->count;
+  if (dst->max < src->max)
+    dst->max = src->max;
+  for (size_t i = 0; i < LATENCY_BUCKETS; i++)
+    dst->buckets[i] += src->buckets[i];
+} /* }}} void stats_merge */
+
+static void stats_print(const char *prefix, const stats_t *st, /* {{{ */
+                        double duration) {
+  fprintf(stdout,
+          "%s: %" PRIu64 " values (%.0f/s), %" PRIu64 " errors, latency "
+          "[us] p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+          prefix, st->values,
+          (duration > 0.0) ? ((double)st->values) / duration : 0.0,
+          st->errors, stats_percentile(st, 50.0) / 1e3,
+          stats_percentile(st, 90.0) / 1e3, stats_percentile(st, 99.0) / 1e3,
+          stats_percentile(st, 99.9) / 1e3, ((double)st->max) / 1e3);
+  fflush(stdout);
+} /* }}} void stats_print */
+
+static void set_type_instance(sender_t *s, lcc_value_list_t *vl) /* {{{ */
+{
+  snprintf(vl->identifier.type_instance, sizeof(vl->identifier.type_instance),
+           "ti%li", nrand48(s->rand_state));
+} /* }}} void set_type_instance */
+
+/* Creates the series with the (zero based) popularity rank "rank". */
+static lcc_value_list_t *create_value_list(sender_t *s, int rank) /* {{{ */
 {
   lcc_value_list_t *vl;
   int host_num;
@@ -179,12 +340,15 @@ static lcc_value_list_t *create_value_list(void) /* {{{ */
 
   vl->values_len = 1;
 
-  host_num = get_boundet_random(0, conf_num_hosts);
+  host_num = get_boundet_random(s, 0, conf_num_hosts);
 
   vl->interval = conf_interval;
-  vl->time = 1.0 + dtime() + (host_num % (1 + (int)vl->interval));
+  if (conf_skew > 0.0)
+    vl->interval *= skew_factor * pow((double)(rank + 1), conf_skew);
+  vl->time =
+      1.0 + dtime() + conf_spread * vl->interval * erand48(s->rand_state);
 
-  if (get_boundet_random(0, 2) == 0)
+  if (get_boundet_random(s, 0, 2) == 0)
     vl->values_types[0] = LCC_TYPE_GAUGE;
   else
     vl->values_types[0] = LCC_TYPE_DERIVE;
@@ -192,13 +356,12 @@ static lcc_value_list_t *create_value_list(void) /* {{{ */
   snprintf(vl->identifier.host, sizeof(vl->identifier.host), "host%04i",
            host_num);
   snprintf(vl->identifier.plugin, sizeof(vl->identifier.plugin), "plugin%03i",
-           get_boundet_random(0, conf_num_plugins));
+           get_boundet_random(s, 0, conf_num_plugins));
   strncpy(vl->identifier.type,
           (vl->values_types[0] == LCC_TYPE_GAUGE) ? "gauge" : "derive",
           sizeof(vl->identifier.type));
   vl->identifier.type[sizeof(vl->identifier.type) - 1] = '\0';
-  snprintf(vl->identifier.type_instance, sizeof(vl->identifier.type_instance),
-           "ti%li", random());
+  set_type_instance(s, vl);
 
   return vl;
 } /* }}} int create_value_list */
@@ -213,25 +376,202 @@ static void destroy_value_list(lcc_value_list_t *vl) /* {{{ */
   free(vl);
 } /* }}} void destroy_value_list */
 
-static int send_value(lcc_value_list_t *vl) /* {{{ */
+/* Sends the batched value lists to the UNIX socket. */
+static int flush_batch(sender_t *s) /* {{{ */
 {
   int status;
 
-  if (vl->values_types[0] == LCC_TYPE_GAUGE)
-    vl->values[0].gauge =
-        100.0 * ((gauge_t)random()) / (((gauge_t)RAND_MAX) + 1.0);
+  if (s->batch_num == 0)
+    return 0;
+
+  uint64_t begin = ntime();
+  status = lcc_putval_batch(s->con, s->batch, (size_t)s->batch_num);
+  uint64_t latency = ntime() - begin;
+
+  pthread_mutex_lock(&s->lock);
+  stats_add_latency(&s->stats, latency);
+  if (status == 0)
+    s->stats.values += (uint64_t)s->batch_num;
   else
-    vl->values[0].derive += (derive_t)get_boundet_random(0, 100);
+    s->stats.errors += (uint64_t)s->batch_num;
+  pthread_mutex_unlock(&s->lock);
 
-  status = lcc_network_values_send(net, vl);
   if (status != 0)
-    fprintf(stderr, "lcc_network_values_send failed with status %i.\n", status);
+    fprintf(stderr, "lcc_putval_batch failed: %s\n", lcc_strerror(s->con));
+
+  s->batch_num = 0;
+  return status;
+} /* }}} int flush_batch */
+
+static int send_value(sender_t *s, lcc_value_list_t *vl) /* {{{ */
+{
+  int status = 0;
+
+  if (vl->values_types[0] == LCC_TYPE_GAUGE)
+    vl->values[0].gauge = 100.0 * erand48(s->rand_state);
+  else
+    vl->values[0].derive += (derive_t)get_boundet_random(s, 0, 100);
+
+  if ((s->con != NULL) && (conf_batch_size > 1)) {
+    /* The values are copied when they are sent, so sharing them is fine. */
+    s->batch[s->batch_num] = *vl;
+    s->batch_num++;
+    if (s->batch_num >= conf_batch_size)
+      flush_batch(s);
+  } else {
+    uint64_t begin = ntime();
+    if (s->con != NULL) {
+      status = lcc_putval(s->con, vl);
+      if (status != 0)
+        fprintf(stderr, "lcc_putval failed: %s\n", lcc_strerror(s->con));
+    } else {
+      status = lcc_network_values_send(s->net, vl);
+      if (status != 0)
+        fprintf(stderr, "lcc_network_values_send failed with status %i.\n",
+                status);
+    }
+    uint64_t latency = ntime() - begin;
+
+    pthread_mutex_lock(&s->lock);
+    stats_add_latency(&s->stats, latency);
+    if (status == 0)
+      s->stats.values++;
+    else
+      s->stats.errors++;
+    pthread_mutex_unlock(&s->lock);
+  }
 
   vl->time += vl->interval;
 
+  /* Cardinality churn: the series goes away and a new one takes its place. */
+  if ((conf_churn > 0.0) && (erand48(s->rand_state) < conf_churn)) {
+    set_type_instance(s, vl);
+    vl->values[0].derive = 0;
+  }
+
   return 0;
 } /* }}} int send_value */
 
+static int sender_init(sender_t *s) /* {{{ */
+{
+  pthread_mutex_init(&s->lock, /* attr = */ NULL);
+
+  s->values_heap = c_heap_create(compare_time);
+  if (s->values_heap == NULL) {
+    fprintf(stderr, "c_heap_create failed.\n");
+    return -1;
+  }
+
+  if (conf_socket != NULL) {
+    int status = lcc_connect(conf_socket, &s->con);
+    if (status != 0) {
+      fprintf(stderr, "lcc_connect (%s) failed with status %i.\n",
+              conf_socket, status);
+      return -1;
+    }
+
+    if (conf_batch_size > 1) {
+      s->batch = calloc((size_t)conf_batch_size, sizeof(*s->batch));
+      if (s->batch == NULL) {
+        fprintf(stderr, "calloc failed.\n");
+        return -1;
+      }
+    }
+  } else {
+    lcc_server_t *srv;
+
+    s->net = lcc_network_create();
+    if (s->net == NULL) {
+      fprintf(stderr, "lcc_network_create failed.\n");
+      return -1;
+    }
+
+    srv = lcc_server_create(s->net, conf_destination, conf_service);
+    if (srv == NULL) {
+      fprintf(stderr, "lcc_server_create failed.\n");
+      return -1;
+    }
+
+    lcc_server_set_ttl(srv, 42);
+#if 0
+    lcc_server_set_security_level (srv, ENCRYPT,
+        "admin", "password1");
+#endif
+  }
+
+  for (int i = 0; i < s->num_series; i++) {
+    lcc_value_list_t *vl;
+
+    vl = create_value_list(s, s->first_series + i);
+    if (vl == NULL) {
+      fprintf(stderr, "create_value_list failed.\n");
+      return -1;
+    }
+
+    c_heap_insert(s->values_heap, vl);
+  }
+
+  return 0;
+} /* }}} int sender_init */
+
+static void sender_destroy(sender_t *s) /* {{{ */
+{
+  if (s->values_heap != NULL) {
+    while (42) {
+      lcc_value_list_t *vl = c_heap_get_root(s->values_heap);
+      if (vl == NULL)
+        break;
+      destroy_value_list(vl);
+    }
+    c_heap_destroy(s->values_heap);
+  }
+
+  free(s->batch);
+  if (s->con != NULL)
+    lcc_disconnect(s->con);
+  if (s->net != NULL)
+    lcc_network_destroy(s->net);
+  pthread_mutex_destroy(&s->lock);
+} /* }}} void sender_destroy */
+
+static void *sender_thread(void *arg) /* {{{ */
+{
+  sender_t *s = arg;
+
+  while (loop) {
+    lcc_value_list_t *vl = c_heap_get_root(s->values_heap);
+
+    if (vl == NULL)
+      break;
+
+    /* Check if we need to sleep */
+    double now = conf_benchmark ? vl->time : dtime();
+    if (now < vl->time)
+      flush_batch(s);
+
+    while (loop && (now < vl->time)) {
+      /* Sleep in short steps, so that signals are handled quickly. */
+      double diff = vl->time - now;
+      if (diff > 0.1)
+        diff = 0.1;
+      struct timespec ts = {
+          .tv_sec = (time_t)diff,
+      };
+      ts.tv_nsec = (long)((diff - ((double)ts.tv_sec)) * 1e9);
+
+      nanosleep(&ts, /* remaining = */ NULL);
+      now = dtime();
+    }
+
+    send_value(s, vl);
+
+    c_heap_insert(s->values_heap, vl);
+  }
+
+  flush_batch(s);
+  return NULL;
+} /* }}} void *sender_thread */
+
 static int get_integer_opt(const char *str, int *ret_value) /* {{{ */
 {
   char *endptr;
@@ -284,7 +624,7 @@ static int read_options(int argc, char **argv) /* {{{ */
 {
   int opt;
 
-  while ((opt = getopt(argc, argv, "n:H:p:i:d:D:h")) != -1) {
+  while ((opt = getopt(argc, argv, "n:H:p:i:d:D:s:B:t:z:c:S:bT:r:h")) != -1) {
     switch (opt) {
     case 'n':
       get_integer_opt(optarg, &conf_num_values);
@@ -310,6 +650,42 @@ static int read_options(int argc, char **argv) /* {{{ */
       conf_service = optarg;
       break;
 
+    case 's':
+      conf_socket = optarg;
+      break;
+
+    case 'B':
+      get_integer_opt(optarg, &conf_batch_size);
+      break;
+
+    case 't':
+      get_integer_opt(optarg, &conf_num_threads);
+      break;
+
+    case 'z':
+      get_double_opt(optarg, &conf_skew);
+      break;
+
+    case 'c':
+      get_double_opt(optarg, &conf_churn);
+      break;
+
+    case 'S':
+      get_double_opt(optarg, &conf_spread);
+      break;
+
+    case 'b':
+      conf_benchmark = true;
+      break;
+
+    case 'T':
+      get_double_opt(optarg, &conf_duration);
+      break;
+
+    case 'r':
+      get_double_opt(optarg, &conf_report_interval);
+      break;
+
     case 'h':
       exit_usage(EXIT_SUCCESS);
 
@@ -318,13 +694,39 @@ static int read_options(int argc, char **argv) /* {{{ */
     } /* switch (opt) */
   }   /* while (getopt) */
 
+  if ((conf_num_values < 1) || (conf_num_threads < 1) ||
+      (conf_batch_size < 1) || (conf_interval <= 0.0) || (conf_skew < 0.0) ||
+      (conf_churn < 0.0) || (conf_churn > 1.0) || (conf_spread < 0.0) ||
+      (conf_spread > 1.0) || (conf_duration < 0.0) ||
+      (conf_report_interval < 0.0)) {
+    fprintf(stderr, "Invalid option value.\n");
+    exit_usage(EXIT_FAILURE);
+  }
+
+  if (conf_num_threads > conf_num_values)
+    conf_num_threads = conf_num_values;
+
   return 0;
 } /* }}} int read_options */
 
+/* Adds the senders' statistics since the last call to "interval". */
+static void collect_stats(stats_t *interval) /* {{{ */
+{
+  memset(interval, 0, sizeof(*interval));
+  for (int i = 0; i < conf_num_threads; i++) {
+    sender_t *s = senders + i;
+
+    pthread_mutex_lock(&s->lock);
+    stats_merge(interval, &s->stats);
+    memset(&s->stats, 0, sizeof(s->stats));
+    pthread_mutex_unlock(&s->lock);
+  }
+} /* }}} void collect_stats */
+
 int main(int argc, char **argv) /* {{{ */
 {
-  double last_time;
-  int values_sent = 0;
+  stats_t *total;
+  stats_t *interval;
 
   read_options(argc, argv);
 
@@ -334,93 +736,90 @@ int main(int argc, char **argv) /* {{{ */
   sigterm_action.sa_handler = signal_handler;
   sigaction(SIGTERM, &sigterm_action, /* old = */ NULL);
 
-  values_heap = c_heap_create(compare_time);
-  if (values_heap == NULL) {
-    fprintf(stderr, "c_heap_create failed.\n");
-    exit(EXIT_FAILURE);
+  if (conf_skew > 0.0) {
+    double sum = 0.0;
+    for (int i = 0; i < conf_num_values; i++)
+      sum += pow((double)(i + 1), -conf_skew);
+    skew_factor = sum / ((double)conf_num_values);
   }
 
-  net = lcc_network_create();
-  if (net == NULL) {
-    fprintf(stderr, "lcc_network_create failed.\n");
+  senders = calloc((size_t)conf_num_threads, sizeof(*senders));
+  total = calloc(1, sizeof(*total));
+  interval = calloc(1, sizeof(*interval));
+  if ((senders == NULL) || (total == NULL) || (interval == NULL)) {
+    fprintf(stderr, "calloc failed.\n");
     exit(EXIT_FAILURE);
-  } else {
-    lcc_server_t *srv;
-
-    srv = lcc_server_create(net, conf_destination, conf_service);
-    if (srv == NULL) {
-      fprintf(stderr, "lcc_server_create failed.\n");
-      exit(EXIT_FAILURE);
-    }
-
-    lcc_server_set_ttl(srv, 42);
-#if 0
-    lcc_server_set_security_level (srv, ENCRYPT,
-        "admin", "password1");
-#endif
   }
 
   fprintf(stdout, "Creating %i values ... ", conf_num_values);
   fflush(stdout);
-  for (int i = 0; i < conf_num_values; i++) {
-    lcc_value_list_t *vl;
+  for (int i = 0; i < conf_num_threads; i++) {
+    sender_t *s = senders + i;
 
-    vl = create_value_list();
-    if (vl == NULL) {
-      fprintf(stderr, "create_value_list failed.\n");
-      exit(EXIT_FAILURE);
-    }
+    s->first_series = (int)(((int64_t)conf_num_values) * i / conf_num_threads);
+    s->num_series =
+        (int)(((int64_t)conf_num_values) * (i + 1) / conf_num_threads) -
+        s->first_series;
+
+    /* Give every thread its own, reproducible random sequence. */
+    s->rand_state[0] = 0x330E;
+    s->rand_state[1] = (unsigned short)i;
+    s->rand_state[2] = (unsigned short)(i >> 16);
 
-    c_heap_insert(values_heap, vl);
+    if (sender_init(s) != 0)
+      exit(EXIT_FAILURE);
   }
   fprintf(stdout, "done\n");
+  fflush(stdout);
+
+  double start = dtime();
+  for (int i = 0; i < conf_num_threads; i++) {
+    int status = pthread_create(&senders[i].thread, /* attr = */ NULL,
+                                sender_thread, senders + i);
+    if (status != 0) {
+      fprintf(stderr, "pthread_create failed: %s\n", strerror(status));
+      exit(EXIT_FAILURE);
+    }
+  }
 
-  last_time = 0;
+  double last_report = start;
   while (loop) {
-    lcc_value_list_t *vl = c_heap_get_root(values_heap);
+    double now = dtime();
 
-    if (vl == NULL)
+    if ((conf_duration > 0.0) && (now >= start + conf_duration))
       break;
 
-    if (vl->time != last_time) {
-      printf("%i values have been sent.\n", values_sent);
-
-      /* Check if we need to sleep */
-      double now = dtime();
+    if ((conf_report_interval > 0.0) &&
+        (now >= last_report + conf_report_interval)) {
+      char prefix[64];
 
-      while (now < vl->time) {
-        double diff = vl->time - now;
-        struct timespec ts = {
-            .tv_sec = (time_t)diff,
-        };
-        ts.tv_nsec = (long)((diff - ((double)ts.tv_sec)) * 1e9);
-
-        nanosleep(&ts, /* remaining = */ NULL);
-        now = dtime();
-
-        if (!loop)
-          break;
-      }
-      last_time = vl->time;
+      collect_stats(interval);
+      snprintf(prefix, sizeof(prefix), "%.1f s", now - start);
+      stats_print(prefix, interval, now - last_report);
+      stats_merge(total, interval);
+      last_report = now;
     }
 
-    send_value(vl);
-    values_sent++;
-
-    c_heap_insert(values_heap, vl);
+    struct timespec ts = {.tv_nsec = 10000000};
+    nanosleep(&ts, /* remaining = */ NULL);
   }
 
   fprintf(stdout, "Shutting down.\n");
   fflush(stdout);
 
-  while (42) {
-    lcc_value_list_t *vl = c_heap_get_root(values_heap);
-    if (vl == NULL)
-      break;
-    destroy_value_list(vl);
-  }
-  c_heap_destroy(values_heap);
+  loop = false;
+  for (int i = 0; i < conf_num_threads; i++)
+    pthread_join(senders[i].thread, /* retval = */ NULL);
+
+  collect_stats(interval);
+  stats_merge(total, interval);
+  stats_print("Total", total, dtime() - start);
+
+  for (int i = 0; i < conf_num_threads; i++)
+    sender_destroy(senders + i);
+  free(senders);
+  free(interval);
+  free(total);
 
-  lcc_network_destroy(net);
   exit(EXIT_SUCCESS);
 } /* }}} int main */
@@ -106,10 +106,11 @@ __attribute__((noreturn)) static void exit_usage(const char *name, int status) {
 
       "\nAvailable commands:\n\n"
 
-      " * getval <identifier>\n"
+      " * getval <identifier> [<identifier> ...]\n"
       " * flush [timeout=<seconds>] [plugin=<name>] [identifier=<id>]\n"
       " * listval\n"
       " * putval <identifier> [interval=<seconds>] <value-list(s)>\n"
+      " * stats\n"
 
       "\nIdentifiers:\n\n"
 
@@ -120,6 +121,8 @@ __attribute__((noreturn)) static void exit_usage(const char *name, int status) {
       "Hostname defaults to the local hostname if omitted (e.g., "
       "uptime/uptime).\n"
       "No error is returned if the specified identifier does not exist.\n"
+      "The identifiers passed to getval may contain the shell wildcards\n"
+      "`*', `?' and `[...]'.\n"
 
       "\n" PACKAGE_NAME " " PACKAGE_VERSION ", http://collectd.org/\n"
       "by Florian octo Forster <octo@collectd.org>\n"
@@ -195,6 +198,58 @@ static int parse_identifier(lcc_connection_t *c, const char *value,
   return 0;
 } /* parse_identifier */
 
+/* Fetches all identifiers with one GETVALS command and prints one line per
+ * value list. */
+static int getvals(lcc_connection_t *c, int argc, char **argv) {
+  char **patterns = calloc((size_t)argc, sizeof(*patterns));
+  lcc_getval_result_t *results = NULL;
+  size_t results_num = 0;
+  int status = 0;
+
+  if (patterns == NULL) {
+    fprintf(stderr, "ERROR: calloc failed.\n");
+    return -1;
+  }
+
+  for (int i = 0; (i < argc) && (status == 0); i++) {
+    lcc_identifier_t ident;
+    char id[1024];
+
+    /* Fills in the local host name if it was omitted. */
+    status = parse_identifier(c, argv[i], &ident);
+    if (status == 0)
+      status = lcc_identifier_to_string(c, id, sizeof(id), &ident);
+    if (status == 0) {
+      patterns[i] = strdup(id);
+      if (patterns[i] == NULL)
+        status = -1;
+    }
+  }
+
+  if (status == 0) {
+    status = lcc_getvals(c, (char const *const *)patterns, (size_t)argc,
+                         &results, &results_num);
+    if (status != 0)
+      fprintf(stderr, "ERROR: %s\n", lcc_strerror(c));
+  }
+
+  for (size_t i = 0; (status == 0) && (i < results_num); i++) {
+    char id[1024];
+
+    lcc_identifier_to_string(c, id, sizeof(id), &results[i].identifier);
+    printf("%s", id);
+    for (size_t j = 0; j < results[i].values_num; j++)
+      printf(" %s=%e", results[i].values_names[j], results[i].values[j]);
+    printf("\n");
+  }
+
+  lcc_getvals_free(results, results_num);
+  for (int i = 0; i < argc; i++)
+    free(patterns[i]);
+  free(patterns);
+  return status;
+} /* getvals */
+
 static int getval(lcc_connection_t *c, int argc, char **argv) {
   lcc_identifier_t ident;
 
@@ -206,11 +261,14 @@ static int getval(lcc_connection_t *c, int argc, char **argv) {
 
   assert(strcasecmp(argv[0], "getval") == 0);
 
-  if (argc != 2) {
+  if (argc < 2) {
     fprintf(stderr, "ERROR: getval: Missing identifier.\n");
     return -1;
   }
 
+  if ((argc > 2) || (strpbrk(argv[1], "*?[") != NULL))
+    return getvals(c, argc - 1, argv + 1);
+
   status = parse_identifier(c, argv[1], &ident);
   if (status != 0)
     return status;
@@ -397,6 +455,32 @@ static int listval(lcc_connection_t *c, int argc, char **argv) {
 #undef BAIL_OUT
 } /* listval */
 
+static int stats(lcc_connection_t *c, int argc, char **argv) {
+  char **lines = NULL;
+  size_t lines_num = 0;
+
+  assert(strcasecmp(argv[0], "stats") == 0);
+
+  if (argc != 1) {
+    fprintf(stderr, "ERROR: stats: Does not accept any arguments.\n");
+    return -1;
+  }
+
+  int status = lcc_stats(c, &lines, &lines_num);
+  if (status != 0) {
+    fprintf(stderr, "ERROR: %s\n", lcc_strerror(c));
+    return status;
+  }
+
+  for (size_t i = 0; i < lines_num; i++) {
+    printf("%s\n", lines[i]);
+    free(lines[i]);
+  }
+  free(lines);
+
+  return 0;
+} /* stats */
+
 static int putval(lcc_connection_t *c, int argc, char **argv) {
   lcc_value_list_t vl = LCC_VALUE_LIST_INIT;
 
@@ -591,6 +675,8 @@ int main(int argc, char **argv) {
     status = listval(c, argc - optind, argv + optind);
   else if (strcasecmp(argv[optind], "putval") == 0)
     status = putval(c, argc - optind, argv + optind);
+  else if (strcasecmp(argv[optind], "stats") == 0)
+    status = stats(c, argc - optind, argv + optind);
   else {
     fprintf(stderr, "%s: invalid command: %s\n", argv[0], argv[optind]);
     return 1;
@@ -25,6 +25,9 @@
  *     Aneesh Puttur <aputtur at redhat.com>
  **/
 
+/* _GNU_SOURCE is needed in Linux to use recvmmsg */
+#define _GNU_SOURCE
+
 #include "collectd.h"
 
 #include "plugin.h"
@@ -57,6 +60,9 @@
 
 #define MYPROTO NETLINK_ROUTE
 
+// Number of netlink messages received with one recvmmsg() call
+#define CONNECTIVITY_RECV_BATCH 16
+
 #define LINK_STATE_DOWN 0
 #define LINK_STATE_UP 1
 #define LINK_STATE_UNKNOWN 2
@@ -411,9 +417,8 @@ static interface_list_t *add_interface(const char *interface, int status,
   return il;
 }
 
+// NOTE: Caller MUST hold connectivity_data_lock when calling this function
 static int connectivity_link_state(struct nlmsghdr *msg) {
-  pthread_mutex_lock(&connectivity_data_lock);
-
   struct nlattr *attr;
   struct ifinfomsg *ifi = mnl_nlmsg_get_payload(msg);
 
@@ -426,7 +431,6 @@ static int connectivity_link_state(struct nlmsghdr *msg) {
       ERROR("connectivity plugin: connectivity_link_state: IFLA_IFNAME "
             "mnl_attr_validate "
             "failed.");
-      pthread_mutex_unlock(&connectivity_data_lock);
       return MNL_CB_ERROR;
     }
 
@@ -483,8 +487,6 @@ static int connectivity_link_state(struct nlmsghdr *msg) {
     break;
   }
 
-  pthread_mutex_unlock(&connectivity_data_lock);
-
   return 0;
 }
 
@@ -496,9 +498,47 @@ static int msg_handler(struct nlmsghdr *msg) {
   return connectivity_link_state(msg);
 }
 
+// Handle the messages of one datagram
+// NOTE: Caller MUST hold connectivity_data_lock when calling this function
+static int read_messages(char *buf, int len,
+                         int (*msg_handler)(struct nlmsghdr *)) {
+  int ret = 0;
+
+  if (len == 0) {
+    DEBUG("connectivity plugin: read_event: EOF");
+  }
+
+  /* We need to handle more than one message per 'recvmsg' */
+  for (struct nlmsghdr *h = (struct nlmsghdr *)buf;
+       NLMSG_OK(h, (unsigned int)len); h = NLMSG_NEXT(h, len)) {
+    /* Finish reading */
+    if (h->nlmsg_type == NLMSG_DONE)
+      return ret;
+
+    /* Message is some kind of error */
+    if (h->nlmsg_type == NLMSG_ERROR) {
+      struct nlmsgerr *l_err = (struct nlmsgerr *)NLMSG_DATA(h);
+      ERROR("connectivity plugin: read_event: Message is an error: %d",
+            l_err->error);
+      return -1; // Error
+    }
+
+    /* Call message handler */
+    ret = (*msg_handler)(h);
+    if (ret < 0) {
+      ERROR("connectivity plugin: read_event: Message handler error %d", ret);
+      return ret;
+    }
+  }
+
+  return ret;
+}
+
 static int read_event(int (*msg_handler)(struct nlmsghdr *)) {
+  static char bufs[CONNECTIVITY_RECV_BATCH][4096];
+  struct iovec iovs[CONNECTIVITY_RECV_BATCH];
+  struct mmsghdr msgs[CONNECTIVITY_RECV_BATCH];
   int ret = 0;
-  int recv_flags = MSG_DONTWAIT;
 
   if (nl_sock == -1 || msg_handler == NULL)
     return EINVAL;
@@ -513,22 +553,20 @@ static int read_event(int (*msg_handler)(struct nlmsghdr *)) {
 
     pthread_mutex_unlock(&connectivity_threads_lock);
 
-    char buf[4096];
-    int status = recv(nl_sock, buf, sizeof(buf), recv_flags);
-
-    if (status < 0) {
-
-      // If there were no more messages to drain from the socket,
-      // then signal the dequeue thread and allow it to dispatch
-      // any saved interface status changes.  Then continue, but
-      // block and wait for new messages
-      if (errno == EWOULDBLOCK || errno == EAGAIN) {
-        pthread_cond_signal(&connectivity_cond);
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < CONNECTIVITY_RECV_BATCH; i++) {
+      iovs[i].iov_base = bufs[i];
+      iovs[i].iov_len = sizeof(bufs[i]);
+      msgs[i].msg_hdr.msg_iov = iovs + i;
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
 
-        recv_flags = 0;
-        continue;
-      }
+    // Block until there is at least one message, then take all messages
+    // that are already queued (up to the batch size)
+    int status = recvmmsg(nl_sock, msgs, CONNECTIVITY_RECV_BATCH,
+                          MSG_WAITFORONE, /* timeout = */ NULL);
 
+    if (status < 0) {
       if (errno == EINTR) {
         // Interrupt, so just continue and try again
         continue;
@@ -539,43 +577,25 @@ static int read_event(int (*msg_handler)(struct nlmsghdr *)) {
       return status;
     }
 
-    // Message received successfully, so we'll stop blocking on the
-    // receive call for now (until we get a "would block" error, which
-    // will be handled above)
-    recv_flags = MSG_DONTWAIT;
+    // The data lock is taken once per batch rather than once per message
+    pthread_mutex_lock(&connectivity_data_lock);
 
-    if (status == 0) {
-      DEBUG("connectivity plugin: read_event: EOF");
+    for (int i = 0; i < status; i++) {
+      ret = read_messages(bufs[i], (int)msgs[i].msg_len, msg_handler);
+      if (ret < 0)
+        break;
     }
 
-    /* We need to handle more than one message per 'recvmsg' */
-    for (struct nlmsghdr *h = (struct nlmsghdr *)buf;
-         NLMSG_OK(h, (unsigned int)status); h = NLMSG_NEXT(h, status)) {
-      /* Finish reading */
-      if (h->nlmsg_type == NLMSG_DONE)
-        return ret;
-
-      /* Message is some kind of error */
-      if (h->nlmsg_type == NLMSG_ERROR) {
-        struct nlmsgerr *l_err = (struct nlmsgerr *)NLMSG_DATA(h);
-        ERROR("connectivity plugin: read_event: Message is an error: %d",
-              l_err->error);
-        return -1; // Error
-      }
+    // There are no more messages to drain from the socket right now (or
+    // the batch is full), so signal the dequeue thread and allow it to
+    // dispatch any saved interface status changes
+    if (statuses_to_send)
+      pthread_cond_signal(&connectivity_cond);
 
-      /* Call message handler */
-      if (msg_handler) {
-        ret = (*msg_handler)(h);
-        if (ret < 0) {
-          ERROR("connectivity plugin: read_event: Message handler error %d",
-                ret);
-          return ret;
-        }
-      } else {
-        ERROR("connectivity plugin: read_event: Error NULL message handler");
-        return -1;
-      }
-    }
+    pthread_mutex_unlock(&connectivity_data_lock);
+
+    if (ret < 0)
+      return ret;
   }
 
   return ret;
@@ -593,6 +613,10 @@ static void connectivity_dispatch_notification(const char *interface,
       .type_instance = "interface_status",
   };
 
+  // Nobody would receive the notification, so don't bother building it
+  if (!plugin_notification_has_consumers())
+    return;
+
   sstrncpy(n.host, hostname_g, sizeof(n.host));
   sstrncpy(n.plugin_instance, interface, sizeof(n.plugin_instance));
 
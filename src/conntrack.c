@@ -30,22 +30,68 @@
 #error "No applicable input method."
 #endif
 
+#if HAVE_LIBMNL
+#include <arpa/inet.h>
+#include <libmnl/libmnl.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_conntrack.h>
+#endif
+
 #define CONNTRACK_FILE "/proc/sys/net/netfilter/nf_conntrack_count"
 #define CONNTRACK_MAX_FILE "/proc/sys/net/netfilter/nf_conntrack_max"
 #define CONNTRACK_FILE_OLD "/proc/sys/net/ipv4/netfilter/ip_conntrack_count"
 #define CONNTRACK_MAX_FILE_OLD "/proc/sys/net/ipv4/netfilter/ip_conntrack_max"
 
-static const char *config_keys[] = {"OldFiles"};
+static const char *config_keys[] = {"OldFiles", "Statistics", "ReportByCpu"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 /*
     Each table/chain combo that will be queried goes into this list
 */
 
 static int old_files;
+static bool report_stats;
+static bool report_by_cpu;
+
+#if HAVE_LIBMNL
+/* The ctnetlink socket is kept open between reads. It is closed, and the
+ * /proc files are used instead, if ctnetlink is not usable. */
+static struct mnl_socket *nl;
+static bool nl_failed;
+static unsigned int nl_seq;
+
+static const struct {
+  int attr;
+  char const *name;
+} ct_stats[] = {
+    {CTA_STATS_FOUND, "found"},
+    {CTA_STATS_INVALID, "invalid"},
+    {CTA_STATS_INSERT, "insert"},
+    {CTA_STATS_INSERT_FAILED, "insert_failed"},
+    {CTA_STATS_DROP, "drop"},
+    {CTA_STATS_EARLY_DROP, "early_drop"},
+    {CTA_STATS_ERROR, "error"},
+    {CTA_STATS_SEARCH_RESTART, "search_restart"},
+};
+#define CT_STATS_NUM STATIC_ARRAY_SIZE(ct_stats)
+
+typedef struct {
+  bool have_count;
+  value_t count;
+  bool have_max;
+  value_t max;
+
+  bool have_stats;
+  derive_t stats[CT_STATS_NUM];
+} ct_result_t;
+#endif /* HAVE_LIBMNL */
 
 static int conntrack_config(const char *key, const char *value) {
   if (strcmp(key, "OldFiles") == 0)
     old_files = 1;
+  else if (strcasecmp(key, "Statistics") == 0)
+    report_stats = IS_TRUE(value);
+  else if (strcasecmp(key, "ReportByCpu") == 0)
+    report_by_cpu = IS_TRUE(value);
 
   return 0;
 }
@@ -64,17 +110,198 @@ static void conntrack_submit(const char *type, const char *type_instance,
   plugin_dispatch_values(&vl);
 } /* static void conntrack_submit */
 
+#if HAVE_LIBMNL
+static void conntrack_submit_stats(int cpu, derive_t *stats) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "conntrack", sizeof(vl.plugin));
+  if (cpu >= 0)
+    ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%d", cpu);
+  sstrncpy(vl.type, "derive", sizeof(vl.type));
+
+  for (size_t i = 0; i < CT_STATS_NUM; i++) {
+    vl.values = &(value_t){.derive = stats[i]};
+    sstrncpy(vl.type_instance, ct_stats[i].name, sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+} /* void conntrack_submit_stats */
+
+static int ct_attr_cb(const struct nlattr *attr, void *data) {
+  const struct nlattr **tb = data;
+  int type = mnl_attr_get_type(attr);
+
+  /* Skip attributes unknown to this version of the headers. */
+  if (mnl_attr_type_valid(attr, CTA_STATS_MAX) < 0)
+    return MNL_CB_OK;
+  if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0)
+    return MNL_CB_OK;
+
+  tb[type] = attr;
+  return MNL_CB_OK;
+} /* int ct_attr_cb */
+
+/* Handles one reply to IPCTNL_MSG_CT_GET_STATS_CPU, i.e. the statistics of
+ * one CPU. */
+static int ct_stats_cpu_cb(const struct nlmsghdr *nlh, void *data) {
+  ct_result_t *res = data;
+  const struct nfgenmsg *nfg = mnl_nlmsg_get_payload(nlh);
+  const struct nlattr *tb[CTA_STATS_MAX + 1] = {NULL};
+  derive_t stats[CT_STATS_NUM] = {0};
+
+  mnl_attr_parse(nlh, sizeof(*nfg), ct_attr_cb, tb);
+
+  for (size_t i = 0; i < CT_STATS_NUM; i++) {
+    if (tb[ct_stats[i].attr] != NULL)
+      stats[i] = (derive_t)ntohl(mnl_attr_get_u32(tb[ct_stats[i].attr]));
+    res->stats[i] += stats[i];
+  }
+  res->have_stats = true;
+
+  if (report_by_cpu)
+    conntrack_submit_stats((int)ntohs(nfg->res_id), stats);
+
+  return MNL_CB_OK;
+} /* int ct_stats_cpu_cb */
+
+/* Handles the reply to IPCTNL_MSG_CT_GET_STATS, the global counters. */
+static int ct_stats_global_cb(const struct nlmsghdr *nlh, void *data) {
+  ct_result_t *res = data;
+  const struct nlattr *tb[CTA_STATS_MAX + 1] = {NULL};
+
+  mnl_attr_parse(nlh, sizeof(struct nfgenmsg), ct_attr_cb, tb);
+
+  /* CTA_STATS_GLOBAL_MAX is smaller than CTA_STATS_MAX, so tb is large
+   * enough. */
+  if (tb[CTA_STATS_GLOBAL_ENTRIES] != NULL) {
+    res->count.gauge =
+        (gauge_t)ntohl(mnl_attr_get_u32(tb[CTA_STATS_GLOBAL_ENTRIES]));
+    res->have_count = true;
+  }
+  if (tb[CTA_STATS_GLOBAL_MAX_ENTRIES] != NULL) {
+    res->max.gauge =
+        (gauge_t)ntohl(mnl_attr_get_u32(tb[CTA_STATS_GLOBAL_MAX_ENTRIES]));
+    res->have_max = true;
+  }
+
+  return MNL_CB_OK;
+} /* int ct_stats_global_cb */
+
+static void ct_nl_close(void) {
+  if (nl != NULL) {
+    mnl_socket_close(nl);
+    nl = NULL;
+  }
+}
+
+/* Sends a ctnetlink request and runs "cb" for each message of the reply. */
+static int ct_nl_request(uint16_t msg_type, uint16_t flags, mnl_cb_t cb,
+                         void *data) {
+  char buf[MNL_SOCKET_BUFFER_SIZE];
+
+  if (nl == NULL) {
+    nl = mnl_socket_open(NETLINK_NETFILTER);
+    if (nl == NULL) {
+      ERROR("conntrack plugin: mnl_socket_open failed: %s", STRERRNO);
+      return -1;
+    }
+    if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0) {
+      ERROR("conntrack plugin: mnl_socket_bind failed: %s", STRERRNO);
+      ct_nl_close();
+      return -1;
+    }
+  }
+
+  struct nlmsghdr *nlh = mnl_nlmsg_put_header(buf);
+  nlh->nlmsg_type = (NFNL_SUBSYS_CTNETLINK << 8) | msg_type;
+  /* With NLM_F_ACK, a non-dump request is terminated by an acknowledgement,
+   * just like a dump is terminated by NLMSG_DONE. */
+  nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+  nlh->nlmsg_seq = ++nl_seq;
+
+  struct nfgenmsg *nfg = mnl_nlmsg_put_extra_header(nlh, sizeof(*nfg));
+  nfg->nfgen_family = AF_UNSPEC;
+  nfg->version = NFNETLINK_V0;
+  nfg->res_id = 0;
+
+  if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
+    ERROR("conntrack plugin: mnl_socket_sendto failed: %s", STRERRNO);
+    ct_nl_close();
+    return -1;
+  }
+
+  unsigned int portid = mnl_socket_get_portid(nl);
+  int ret;
+  do {
+    ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
+    if (ret < 0)
+      break;
+    ret = mnl_cb_run(buf, (size_t)ret, nl_seq, portid, cb, data);
+  } while (ret > MNL_CB_STOP);
+
+  if (ret < 0) {
+    /* Discard any remaining messages of this request. */
+    ct_nl_close();
+    return -1;
+  }
+
+  return 0;
+} /* int ct_nl_request */
+
+/* Reads the global counters and, if enabled, the per-CPU statistics using
+ * ctnetlink. Returns non-zero if ctnetlink is not usable. */
+static int conntrack_read_netlink(ct_result_t *res) {
+  if (ct_nl_request(IPCTNL_MSG_CT_GET_STATS, 0, ct_stats_global_cb, res) !=
+      0) {
+    /* E.g. nf_conntrack_netlink is not loaded or CAP_NET_ADMIN is missing. */
+    NOTICE("conntrack plugin: Querying ctnetlink failed: %s. Falling back "
+           "to reading files in /proc.",
+           STRERRNO);
+    nl_failed = true;
+    return -1;
+  }
+
+  if (report_stats) {
+    int status = ct_nl_request(IPCTNL_MSG_CT_GET_STATS_CPU, NLM_F_DUMP,
+                               ct_stats_cpu_cb, res);
+    if (status != 0)
+      ERROR("conntrack plugin: Querying per-CPU statistics failed: %s",
+            STRERRNO);
+    else if (res->have_stats && !report_by_cpu)
+      conntrack_submit_stats(-1, res->stats);
+  }
+
+  return 0;
+} /* int conntrack_read_netlink */
+#endif /* HAVE_LIBMNL */
+
 static int conntrack_read(void) {
   value_t conntrack, conntrack_max, conntrack_pct;
+  bool have_count = false;
+  bool have_max = false;
+
+#if HAVE_LIBMNL
+  if (!old_files && !nl_failed) {
+    ct_result_t res = {0};
+    if (conntrack_read_netlink(&res) == 0) {
+      conntrack = res.count;
+      have_count = res.have_count;
+      conntrack_max = res.max;
+      have_max = res.have_max;
+    }
+  }
+#endif
 
   char const *path = old_files ? CONNTRACK_FILE_OLD : CONNTRACK_FILE;
-  if (parse_value_file(path, &conntrack, DS_TYPE_GAUGE) != 0) {
+  if (!have_count && parse_value_file(path, &conntrack, DS_TYPE_GAUGE) != 0) {
     ERROR("conntrack plugin: Reading \"%s\" failed.", path);
     return -1;
   }
 
+  /* Older kernels do not report the maximum via ctnetlink. */
   path = old_files ? CONNTRACK_MAX_FILE_OLD : CONNTRACK_MAX_FILE;
-  if (parse_value_file(path, &conntrack_max, DS_TYPE_GAUGE) != 0) {
+  if (!have_max &&
+      parse_value_file(path, &conntrack_max, DS_TYPE_GAUGE) != 0) {
     ERROR("conntrack plugin: Reading \"%s\" failed.", path);
     return -1;
   }
@@ -88,8 +315,28 @@ static int conntrack_read(void) {
   return 0;
 } /* static int conntrack_read */
 
+static int conntrack_init(void) {
+#if !HAVE_LIBMNL
+  if (report_stats) {
+    WARNING("conntrack plugin: The \"Statistics\" option requires ctnetlink "
+            "support, which has not been compiled in (libmnl is missing).");
+    report_stats = false;
+  }
+#endif
+  return 0;
+} /* int conntrack_init */
+
+static int conntrack_shutdown(void) {
+#if HAVE_LIBMNL
+  ct_nl_close();
+#endif
+  return 0;
+} /* int conntrack_shutdown */
+
 void module_register(void) {
   plugin_register_config("conntrack", conntrack_config, config_keys,
                          config_keys_num);
+  plugin_register_init("conntrack", conntrack_init);
   plugin_register_read("conntrack", conntrack_read);
+  plugin_register_shutdown("conntrack", conntrack_shutdown);
 } /* void module_register */
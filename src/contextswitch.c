@@ -32,7 +32,7 @@
 /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
-/* no global variables */
+static proc_file_t *proc_stat;
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_PERFSTAT
@@ -73,22 +73,31 @@ static int cs_read(void) {
   /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
-  FILE *fh;
-  char buffer[64];
+  char *buffer;
   int numfields;
   char *fields[3];
   derive_t result = 0;
   int status = -2;
 
-  fh = fopen("/proc/stat", "r");
-  if (fh == NULL) {
-    ERROR("contextswitch plugin: unable to open /proc/stat: %s", STRERRNO);
-    return -1;
+  if (proc_stat == NULL) {
+    proc_stat = proc_file_create("/proc/stat");
+    if (proc_stat == NULL) {
+      ERROR("contextswitch plugin: proc_file_create failed.");
+      return -1;
+    }
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  if (proc_file_read(proc_stat, NULL) == NULL)
+    return -1;
+
+  while ((buffer = proc_file_next_line(proc_stat)) != NULL) {
     char *endptr;
 
+    /* Skip other lines, such as the long "intr" line, without splitting
+     * them. */
+    if (strncmp("ctxt ", buffer, strlen("ctxt ")) != 0)
+      continue;
+
     numfields = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
     if (numfields != 2)
       continue;
@@ -109,7 +118,6 @@ static int cs_read(void) {
     status = 0;
     break;
   }
-  fclose(fh);
 
   if (status == -2)
     ERROR("contextswitch plugin: Unable to find context switch value.");
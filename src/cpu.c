@@ -130,7 +130,7 @@ static mach_msg_type_number_t cpu_list_len;
 /* #endif PROCESSOR_CPU_LOAD_INFO */
 
 #elif defined(KERNEL_LINUX)
-/* no variables needed */
+static proc_file_t *proc_stat;
 /* #endif KERNEL_LINUX */
 
 #elif defined(HAVE_LIBKSTAT)
@@ -196,16 +196,25 @@ static size_t cpu_states_num; /* #cpu_states allocated */
  * determine how many CPUs there were. Reset to 0 by cpu_reset(). */
 static size_t global_cpu_num;
 
+/* Resolved in init(), so that dispatching doesn't have to look the types up. */
+static const data_set_t *ds_cpu;
+static const data_set_t *ds_percent;
+static const data_set_t *ds_cpu_states;
+static const data_set_t *ds_cpu_states_percent;
+
 static bool report_by_cpu = true;
 static bool report_by_state = true;
 static bool report_percent;
 static bool report_num_cpu;
 static bool report_guest;
 static bool subtract_guest = true;
+static bool combine_states;
+static int utilization_buckets;
 
-static const char *config_keys[] = {"ReportByCpu",      "ReportByState",
-                                    "ReportNumCpu",     "ValuesPercentage",
-                                    "ReportGuestState", "SubtractGuestState"};
+static const char *config_keys[] = {
+    "ReportByCpu",      "ReportByState",      "ReportNumCpu",
+    "ValuesPercentage", "ReportGuestState",   "SubtractGuestState",
+    "CombineStates",    "UtilizationHistogram"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int cpu_config(char const *key, char const *value) /* {{{ */
@@ -222,13 +231,34 @@ static int cpu_config(char const *key, char const *value) /* {{{ */
     report_guest = IS_TRUE(value);
   else if (strcasecmp(key, "SubtractGuestState") == 0)
     subtract_guest = IS_TRUE(value);
-  else
+  else if (strcasecmp(key, "CombineStates") == 0)
+    combine_states = IS_TRUE(value);
+  else if (strcasecmp(key, "UtilizationHistogram") == 0) {
+    int tmp = atoi(value);
+    if ((tmp < 0) || (tmp > 100)) {
+      ERROR("cpu plugin: UtilizationHistogram must be between 0 and 100.");
+      return -1;
+    }
+    utilization_buckets = tmp;
+  } else
     return -1;
 
   return 0;
 } /* }}} int cpu_config */
 
 static int init(void) {
+  ds_cpu = plugin_get_ds("cpu");
+  ds_percent = plugin_get_ds("percent");
+  if (combine_states) {
+    ds_cpu_states = plugin_get_ds("cpu_states");
+    ds_cpu_states_percent = plugin_get_ds("cpu_states_percent");
+    if ((ds_cpu_states == NULL) || (ds_cpu_states_percent == NULL)) {
+      ERROR("cpu plugin: CombineStates requires the \"cpu_states\" and "
+            "\"cpu_states_percent\" types.");
+      return -1;
+    }
+  }
+
 #if PROCESSOR_CPU_LOAD_INFO
   kern_return_t status;
 
@@ -325,11 +355,14 @@ static int init(void) {
 } /* int init */
 
 static void submit_value(int cpu_num, int cpu_state, const char *type,
-                         value_t value) {
+                         const data_set_t *ds, value_t value) {
   value_list_t vl = VALUE_LIST_INIT;
 
   vl.values = &value;
   vl.values_len = 1;
+  vl.ds = ds;
+  /* Plugin name, CPU number, type and state names never contain slashes. */
+  vl.escaped = true;
 
   sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
   sstrncpy(vl.type, type, sizeof(vl.type));
@@ -349,11 +382,49 @@ static void submit_percent(int cpu_num, int cpu_state, gauge_t value) {
   if (isnan(value))
     return;
 
-  submit_value(cpu_num, cpu_state, "percent", (value_t){.gauge = value});
+  submit_value(cpu_num, cpu_state, "percent", ds_percent,
+               (value_t){.gauge = value});
 }
 
-static void submit_derive(int cpu_num, int cpu_state, derive_t value) {
-  submit_value(cpu_num, cpu_state, "cpu", (value_t){.derive = value});
+/* Dispatches all states of one CPU, or of the global aggregation if cpu_num
+ * is negative, as one value list. "values" holds one value per state, up to
+ * but not including COLLECTD_CPU_STATE_ACTIVE. */
+static void submit_states(int cpu_num, const char *type, const data_set_t *ds,
+                          value_t values[static COLLECTD_CPU_STATE_ACTIVE]) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = values;
+  vl.values_len = COLLECTD_CPU_STATE_ACTIVE;
+  vl.ds = ds;
+  vl.escaped = true;
+
+  sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+
+  if (cpu_num >= 0) {
+    snprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%i", cpu_num);
+  }
+  plugin_dispatch_values(&vl);
+}
+
+/* Dispatches "num" states of one CPU, or of the global aggregation if cpu_num
+ * is negative, with one value each. "states" holds the state names. */
+static void submit_instances(int cpu_num, const char *type,
+                             const data_set_t *ds, char const **states,
+                             value_t *values, size_t num) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values_len = 1;
+  vl.ds = ds;
+  vl.escaped = true;
+
+  sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+
+  if (cpu_num >= 0) {
+    snprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%i", cpu_num);
+  }
+  plugin_dispatch_instances(&vl, states, values, num);
 }
 
 /* Takes the zero-index number of a CPU and makes sure that the module-global
@@ -484,10 +555,32 @@ static void cpu_commit_one(int cpu_num, /* {{{ */
     return;
   }
 
+  if (combine_states) {
+    value_t values[COLLECTD_CPU_STATE_ACTIVE];
+    for (size_t state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++)
+      values[state].gauge = 100.0 * rates[state] / sum;
+    submit_states(cpu_num, "cpu_states_percent", ds_cpu_states_percent,
+                  values);
+    return;
+  }
+
+  char const *states[COLLECTD_CPU_STATE_ACTIVE];
+  value_t values[COLLECTD_CPU_STATE_ACTIVE];
+  size_t num = 0;
+
   for (size_t state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++) {
     gauge_t percent = 100.0 * rates[state] / sum;
-    submit_percent(cpu_num, state, percent);
+
+    /* States not reported by the read method are NAN; see submit_percent. */
+    if (isnan(percent))
+      continue;
+
+    states[num] = cpu_state_names[state];
+    values[num].gauge = percent;
+    num++;
   }
+
+  submit_instances(cpu_num, "percent", ds_percent, states, values, num);
 } /* }}} void cpu_commit_one */
 
 /* Commits the number of cores */
@@ -514,18 +607,100 @@ static void cpu_reset(void) /* {{{ */
   global_cpu_num = 0;
 } /* }}} void cpu_reset */
 
+/* Dispatches the number of CPUs whose utilization, i.e. the active
+ * percentage, falls into each of utilization_buckets equally sized buckets.
+ * Requires aggregate() to have been called. */
+static void cpu_commit_histogram(void) /* {{{ */
+{
+  gauge_t counts[utilization_buckets];
+  bool have_value = false;
+
+  for (int i = 0; i < utilization_buckets; i++)
+    counts[i] = 0.0;
+
+  for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++) {
+    cpu_state_t *this_cpu_states = get_cpu_state(cpu_num, 0);
+    gauge_t active = this_cpu_states[COLLECTD_CPU_STATE_ACTIVE].rate;
+    gauge_t sum = active;
+
+    if (!this_cpu_states[COLLECTD_CPU_STATE_ACTIVE].has_value)
+      continue;
+    if (this_cpu_states[COLLECTD_CPU_STATE_IDLE].has_value)
+      RATE_ADD(sum, this_cpu_states[COLLECTD_CPU_STATE_IDLE].rate);
+
+    gauge_t percent = 100.0 * active / sum;
+    if (isnan(percent))
+      continue;
+
+    int bucket = (int)(percent * utilization_buckets / 100.0);
+    if (bucket < 0)
+      bucket = 0;
+    else if (bucket >= utilization_buckets)
+      bucket = utilization_buckets - 1;
+
+    counts[bucket] += 1.0;
+    have_value = true;
+  }
+
+  /* No rates yet, e.g. in the first iteration. */
+  if (!have_value)
+    return;
+
+  for (int i = 0; i < utilization_buckets; i++) {
+    value_list_t vl = VALUE_LIST_INIT;
+
+    vl.values = &(value_t){.gauge = counts[i]};
+    vl.values_len = 1;
+
+    sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
+    sstrncpy(vl.type, "count", sizeof(vl.type));
+    snprintf(vl.type_instance, sizeof(vl.type_instance), "active-%d-%d",
+             100 * i / utilization_buckets,
+             100 * (i + 1) / utilization_buckets);
+
+    plugin_dispatch_values(&vl);
+  }
+} /* }}} void cpu_commit_histogram */
+
 /* Legacy behavior: Dispatches the raw derive values without any aggregation. */
 static void cpu_commit_without_aggregation(void) /* {{{ */
 {
-  for (int state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++) {
+  if (combine_states) {
     for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++) {
+      value_t values[COLLECTD_CPU_STATE_ACTIVE];
+      bool have_value = false;
+
+      /* States that are not reported by the system are dispatched as zero. */
+      for (int state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++) {
+        cpu_state_t *s = get_cpu_state(cpu_num, state);
+
+        values[state].derive = s->has_value ? s->conv.last_value.derive : 0;
+        have_value = have_value || s->has_value;
+      }
+
+      if (have_value)
+        submit_states((int)cpu_num, "cpu_states", ds_cpu_states, values);
+    }
+    return;
+  }
+
+  for (size_t cpu_num = 0; cpu_num < global_cpu_num; cpu_num++) {
+    char const *states[COLLECTD_CPU_STATE_ACTIVE];
+    value_t values[COLLECTD_CPU_STATE_ACTIVE];
+    size_t num = 0;
+
+    for (int state = 0; state < COLLECTD_CPU_STATE_ACTIVE; state++) {
       cpu_state_t *s = get_cpu_state(cpu_num, state);
 
       if (!s->has_value)
         continue;
 
-      submit_derive((int)cpu_num, (int)state, s->conv.last_value.derive);
+      states[num] = cpu_state_names[state];
+      values[num].derive = s->conv.last_value.derive;
+      num++;
     }
+
+    submit_instances((int)cpu_num, "cpu", ds_cpu, states, values, num);
   }
 } /* }}} void cpu_commit_without_aggregation */
 
@@ -539,12 +714,18 @@ static void cpu_commit(void) /* {{{ */
   if (report_num_cpu)
     cpu_commit_num_cpu((gauge_t)global_cpu_num);
 
+  if (utilization_buckets > 0) {
+    aggregate(global_rates);
+    cpu_commit_histogram();
+  }
+
   if (report_by_state && report_by_cpu && !report_percent) {
     cpu_commit_without_aggregation();
     return;
   }
 
-  aggregate(global_rates);
+  if (utilization_buckets == 0)
+    aggregate(global_rates);
 
   if (!report_by_cpu) {
     cpu_commit_one(-1, global_rates);
@@ -596,6 +777,34 @@ static int cpu_stage(size_t cpu_num, size_t state, derive_t d,
   return 0;
 } /* }}} int cpu_stage */
 
+#if defined(KERNEL_LINUX) /* {{{ */
+/* Parses the numbers of a "cpuN" line of /proc/stat in a single pass, without
+ * splitting the line first. fields[0] is set to the CPU number, the following
+ * fields to the counters. Returns the number of fields parsed. */
+static size_t cpu_parse_stat_line(char const *buf, uint64_t *fields,
+                                  size_t fields_num) {
+  char const *ptr = buf + strlen("cpu");
+  size_t num = 0;
+
+  while (num < fields_num) {
+    while (*ptr == ' ')
+      ptr++;
+    if ((*ptr < '0') || (*ptr > '9'))
+      break;
+
+    uint64_t value = 0;
+    while ((*ptr >= '0') && (*ptr <= '9')) {
+      value = 10 * value + (uint64_t)(*ptr - '0');
+      ptr++;
+    }
+    fields[num] = value;
+    num++;
+  }
+
+  return num;
+}
+#endif /* }}} KERNEL_LINUX */
+
 static int cpu_read(void) {
   cdtime_t now = cdtime();
 
@@ -638,51 +847,54 @@ static int cpu_read(void) {
 
 #elif defined(KERNEL_LINUX) /* {{{ */
   int cpu;
-  FILE *fh;
-  char buf[1024];
+  char *buf;
 
-  char *fields[11];
-  int numfields;
+  uint64_t fields[11];
+  size_t numfields;
 
-  if ((fh = fopen("/proc/stat", "r")) == NULL) {
-    ERROR("cpu plugin: fopen (/proc/stat) failed: %s", STRERRNO);
-    return -1;
+  if (proc_stat == NULL) {
+    proc_stat = proc_file_create("/proc/stat");
+    if (proc_stat == NULL) {
+      ERROR("cpu plugin: proc_file_create failed.");
+      return -1;
+    }
   }
 
-  while (fgets(buf, 1024, fh) != NULL) {
+  if (proc_file_read(proc_stat, NULL) == NULL)
+    return -1;
+
+  while ((buf = proc_file_next_line(proc_stat)) != NULL) {
     if (strncmp(buf, "cpu", 3))
       continue;
     if ((buf[3] < '0') || (buf[3] > '9'))
       continue;
 
-    numfields = strsplit(buf, fields, STATIC_ARRAY_SIZE(fields));
+    numfields = cpu_parse_stat_line(buf, fields, STATIC_ARRAY_SIZE(fields));
     if (numfields < 5)
       continue;
 
-    cpu = atoi(fields[0] + 3);
+    cpu = (int)fields[0];
 
     /* Do not stage User and Nice immediately: we may need to alter them later:
      */
-    long long user_value = atoll(fields[1]);
-    long long nice_value = atoll(fields[2]);
-    cpu_stage(cpu, COLLECTD_CPU_STATE_SYSTEM, (derive_t)atoll(fields[3]), now);
-    cpu_stage(cpu, COLLECTD_CPU_STATE_IDLE, (derive_t)atoll(fields[4]), now);
+    long long user_value = (long long)fields[1];
+    long long nice_value = (long long)fields[2];
+    cpu_stage(cpu, COLLECTD_CPU_STATE_SYSTEM, (derive_t)fields[3], now);
+    cpu_stage(cpu, COLLECTD_CPU_STATE_IDLE, (derive_t)fields[4], now);
 
     if (numfields >= 8) {
-      cpu_stage(cpu, COLLECTD_CPU_STATE_WAIT, (derive_t)atoll(fields[5]), now);
-      cpu_stage(cpu, COLLECTD_CPU_STATE_INTERRUPT, (derive_t)atoll(fields[6]),
-                now);
-      cpu_stage(cpu, COLLECTD_CPU_STATE_SOFTIRQ, (derive_t)atoll(fields[7]),
-                now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_WAIT, (derive_t)fields[5], now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_INTERRUPT, (derive_t)fields[6], now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_SOFTIRQ, (derive_t)fields[7], now);
     }
 
     if (numfields >= 9) { /* Steal (since Linux 2.6.11) */
-      cpu_stage(cpu, COLLECTD_CPU_STATE_STEAL, (derive_t)atoll(fields[8]), now);
+      cpu_stage(cpu, COLLECTD_CPU_STATE_STEAL, (derive_t)fields[8], now);
     }
 
     if (numfields >= 10) { /* Guest (since Linux 2.6.24) */
       if (report_guest) {
-        long long value = atoll(fields[9]);
+        long long value = (long long)fields[9];
         cpu_stage(cpu, COLLECTD_CPU_STATE_GUEST, (derive_t)value, now);
         /* Guest is included in User; optionally subtract Guest from User: */
         if (subtract_guest) {
@@ -695,7 +907,7 @@ static int cpu_read(void) {
 
     if (numfields >= 11) { /* Guest_nice (since Linux 2.6.33) */
       if (report_guest) {
-        long long value = atoll(fields[10]);
+        long long value = (long long)fields[10];
         cpu_stage(cpu, COLLECTD_CPU_STATE_GUEST_NICE, (derive_t)value, now);
         /* Guest_nice is included in Nice; optionally subtract Guest_nice from
            Nice: */
@@ -711,7 +923,6 @@ static int cpu_read(void) {
     cpu_stage(cpu, COLLECTD_CPU_STATE_USER, (derive_t)user_value, now);
     cpu_stage(cpu, COLLECTD_CPU_STATE_NICE, (derive_t)nice_value, now);
   }
-  fclose(fh);
   /* }}} #endif defined(KERNEL_LINUX) */
 
 #elif defined(HAVE_LIBKSTAT) /* {{{ */
@@ -24,6 +24,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/file_batch/file_batch.h"
 
 #if KERNEL_FREEBSD
 #include <sys/sysctl.h>
@@ -37,8 +38,14 @@ static int num_cpu;
 
 struct cpu_data_t {
   value_to_rate_state_t *time_state;
+  int total_trans_file;
+  int time_in_state_file;
 } * cpu_data;
 
+/* All files read by the plugin. The index of the "scaling_cur_freq" file of a
+ * CPU is the CPU's number. */
+static file_batch_t *files;
+
 /* Flags denoting capability of reporting CPU frequency statistics. */
 static bool report_p_stats = false;
 
@@ -106,6 +113,29 @@ static void cpufreq_stats_init(void) {
     }
   }
 
+  if (!report_p_stats)
+    return;
+
+  for (int i = 0; i < num_cpu; i++) {
+    char filename[PATH_MAX];
+
+    snprintf(filename, sizeof(filename),
+             "/sys/devices/system/cpu/cpu%d/cpufreq/stats/total_trans", i);
+    cpu_data[i].total_trans_file = file_batch_add(files, filename);
+
+    snprintf(filename, sizeof(filename),
+             "/sys/devices/system/cpu/cpu%d/cpufreq/stats/time_in_state", i);
+    cpu_data[i].time_in_state_file = file_batch_add(files, filename);
+
+    if ((cpu_data[i].total_trans_file < 0) ||
+        (cpu_data[i].time_in_state_file < 0)) {
+      ERROR("cpufreq plugin: file_batch_add failed. P-State statistics will "
+            "not be reported.");
+      report_p_stats = false;
+      return;
+    }
+  }
+
   return;
 }
 #endif /* KERNEL_LINUX */
@@ -116,6 +146,12 @@ static int cpufreq_init(void) {
 
   num_cpu = 0;
 
+  files = file_batch_create();
+  if (files == NULL) {
+    ERROR("cpufreq plugin: file_batch_create failed.");
+    return -1;
+  }
+
   while (1) {
     int status = snprintf(filename, sizeof(filename),
                           "/sys/devices/system/cpu/cpu%d/cpufreq/"
@@ -127,6 +163,11 @@ static int cpufreq_init(void) {
     if (access(filename, R_OK))
       break;
 
+    if (file_batch_add(files, filename) != num_cpu) {
+      ERROR("cpufreq plugin: file_batch_add failed.");
+      break;
+    }
+
     num_cpu++;
   }
 
@@ -167,34 +208,30 @@ static void cpufreq_submit(int cpu_num, const char *type,
 
 #if KERNEL_LINUX
 static void cpufreq_read_stats(int cpu) {
-  char filename[PATH_MAX];
   /* Read total transitions for cpu frequency */
-  snprintf(filename, sizeof(filename),
-           "/sys/devices/system/cpu/cpu%d/cpufreq/stats/total_trans", cpu);
-
   value_t v;
-  if (parse_value_file(filename, &v, DS_TYPE_DERIVE) != 0) {
-    ERROR("cpufreq plugin: Reading \"%s\" failed.", filename);
+  if (file_batch_value(files, cpu_data[cpu].total_trans_file, &v,
+                       DS_TYPE_DERIVE) != 0) {
+    ERROR("cpufreq plugin: Reading \"%s\" failed.",
+          file_batch_path(files, cpu_data[cpu].total_trans_file));
     return;
   }
   cpufreq_submit(cpu, "transitions", NULL, &v);
 
   /* Determine percentage time in each state for cpu during previous
    * interval. */
-  snprintf(filename, sizeof(filename),
-           "/sys/devices/system/cpu/cpu%d/cpufreq/stats/time_in_state", cpu);
-
-  FILE *fh = fopen(filename, "r");
-  if (fh == NULL) {
+  int file = cpu_data[cpu].time_in_state_file;
+  char const *filename = file_batch_path(files, file);
+  char const *buffer = file_batch_data(files, file, NULL);
+  if (buffer == NULL) {
     ERROR("cpufreq plugin: Reading \"%s\" failed.", filename);
     return;
   }
 
   int state_index = 0;
   cdtime_t now = cdtime();
-  char buffer[DATA_MAX_NAME_LEN];
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  while (*buffer != 0) {
     unsigned int frequency;
     unsigned long long time;
 
@@ -231,22 +268,25 @@ static void cpufreq_read_stats(int cpu) {
       cpufreq_submit(cpu, "percent", state, &(value_t){.gauge = g});
     }
     state_index++;
+
+    /* Advance to the next line. */
+    buffer += strcspn(buffer, "\n");
+    if (*buffer == '\n')
+      buffer++;
   }
-  fclose(fh);
 }
 #endif /* KERNEL_LINUX */
 
 static int cpufreq_read(void) {
 #if KERNEL_LINUX
+  file_batch_read(files);
+
   for (int cpu = 0; cpu < num_cpu; cpu++) {
-    char filename[PATH_MAX];
     /* Read cpu frequency */
-    snprintf(filename, sizeof(filename),
-             "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
-
     value_t v;
-    if (parse_value_file(filename, &v, DS_TYPE_GAUGE) != 0) {
-      WARNING("cpufreq plugin: Reading \"%s\" failed.", filename);
+    if (file_batch_value(files, cpu, &v, DS_TYPE_GAUGE) != 0) {
+      WARNING("cpufreq plugin: Reading \"%s\" failed.",
+              file_batch_path(files, cpu));
       continue;
     }
 
@@ -278,7 +318,18 @@ static int cpufreq_read(void) {
   return 0;
 } /* int cpufreq_read */
 
+#if KERNEL_LINUX
+static int cpufreq_shutdown(void) {
+  file_batch_destroy(files);
+  files = NULL;
+  return 0;
+} /* int cpufreq_shutdown */
+#endif
+
 void module_register(void) {
   plugin_register_init("cpufreq", cpufreq_init);
   plugin_register_read("cpufreq", cpufreq_read);
+#if KERNEL_LINUX
+  plugin_register_shutdown("cpufreq", cpufreq_shutdown);
+#endif
 }
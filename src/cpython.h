@@ -146,6 +146,7 @@ static inline PyObject *cpy_string_to_unicode_or_bytes(const char *buf) {
 }
 
 void cpy_log_exception(const char *context);
+PyObject *cpy_dispatch_many(PyObject *self, PyObject *args, PyObject *kwds);
 
 /* Python object declarations. */
 
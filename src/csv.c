@@ -24,13 +24,32 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils_cache.h"
 
+/*
+ * Private types
+ */
+/* An open, locked file. Lines are buffered by stdio and written when the
+ * buffer fills up, when the oldest unwritten line is older than
+ * "FlushTimeout", when the file is evicted, or when flushed explicitly. */
+typedef struct csv_file_s csv_file_t;
+struct csv_file_s {
+  char *filename; /* key in "files" */
+  FILE *fh;
+  cdtime_t first_unflushed; /* zero when nothing is buffered */
+
+  /* Least recently used list, most recently used entry first. */
+  csv_file_t *prev;
+  csv_file_t *next;
+};
+
 /*
  * Private variables
  */
-static const char *config_keys[] = {"DataDir", "StoreRates", "FileDate"};
+static const char *config_keys[] = {"DataDir", "StoreRates", "FileDate",
+                                    "FileCacheSize", "FlushTimeout"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static char *datadir;
@@ -38,6 +57,18 @@ static int store_rates;
 static int use_stdio;
 static int file_date = 1;
 
+static size_t file_cache_size;
+static cdtime_t flush_timeout = TIME_T_TO_CDTIME_T_STATIC(10);
+
+static c_avl_tree_t *files;
+static csv_file_t *files_head;
+static csv_file_t *files_tail;
+static size_t files_num;
+static int files_year = -1;
+static int files_yday = -1;
+static cdtime_t files_last_sweep;
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static int value_list_to_string(char *buffer, int buffer_len,
                                 const data_set_t *ds, const value_list_t *vl) {
   int offset;
@@ -98,13 +129,12 @@ static int value_list_to_string(char *buffer, int buffer_len,
 } /* int value_list_to_string */
 
 static int value_list_to_filename(char *buffer, size_t buffer_size,
-                                  value_list_t const *vl) {
+                                  value_list_t const *vl,
+                                  struct tm const *struct_tm) {
   int status;
 
   char *ptr = buffer;
   size_t ptr_size = buffer_size;
-  time_t now;
-  struct tm struct_tm;
 
   if (datadir != NULL) {
     size_t len = strlen(datadir) + 1;
@@ -139,15 +169,7 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
     return ENOMEM;
   }
 
-  /* TODO: Find a way to minimize the calls to `localtime_r',
-   * since they are pretty expensive.. */
-  now = time(NULL);
-  if (localtime_r(&now, &struct_tm) == NULL) {
-    ERROR("csv plugin: localtime_r failed");
-    return -1;
-  }
-
-  status = strftime(ptr, ptr_size, "-%Y-%m-%d", &struct_tm);
+  status = strftime(ptr, ptr_size, "-%Y-%m-%d", struct_tm);
   if (status == 0) /* yep, it returns zero on error. */
   {
     ERROR("csv plugin: strftime failed");
@@ -179,6 +201,236 @@ static int csv_create_file(const char *filename, const data_set_t *ds) {
   return 0;
 } /* int csv_create_file */
 
+/* csv_open_file opens "filename" for appending, creating it if necessary, and
+ * locks it. */
+static FILE *csv_open_file(const char *filename, const data_set_t *ds) {
+  struct stat statbuf;
+  FILE *csv;
+  struct flock fl = {0};
+  int status;
+
+  if (stat(filename, &statbuf) == -1) {
+    if (errno == ENOENT) {
+      if (csv_create_file(filename, ds))
+        return NULL;
+    } else {
+      ERROR("stat(%s) failed: %s", filename, STRERRNO);
+      return NULL;
+    }
+  } else if (!S_ISREG(statbuf.st_mode)) {
+    ERROR("stat(%s): Not a regular file!", filename);
+    return NULL;
+  }
+
+  csv = fopen(filename, "a");
+  if (csv == NULL) {
+    ERROR("csv plugin: fopen (%s) failed: %s", filename, STRERRNO);
+    return NULL;
+  }
+
+  fl.l_pid = getpid();
+  fl.l_type = F_WRLCK;
+  fl.l_whence = SEEK_SET;
+
+  status = fcntl(fileno(csv), F_SETLK, &fl);
+  if (status != 0) {
+    ERROR("csv plugin: flock (%s) failed: %s", filename, STRERRNO);
+    fclose(csv);
+    return NULL;
+  }
+
+  return csv;
+} /* FILE *csv_open_file */
+
+/* XXX: You must hold "files_lock" when calling this function! */
+static void csv_file_unlink(csv_file_t *f) {
+  if (f->prev != NULL)
+    f->prev->next = f->next;
+  else
+    files_head = f->next;
+
+  if (f->next != NULL)
+    f->next->prev = f->prev;
+  else
+    files_tail = f->prev;
+
+  f->prev = NULL;
+  f->next = NULL;
+} /* void csv_file_unlink */
+
+/* XXX: You must hold "files_lock" when calling this function! */
+static void csv_file_push_front(csv_file_t *f) {
+  f->prev = NULL;
+  f->next = files_head;
+  if (files_head != NULL)
+    files_head->prev = f;
+  files_head = f;
+  if (files_tail == NULL)
+    files_tail = f;
+} /* void csv_file_push_front */
+
+/* XXX: You must hold "files_lock" when calling this function! */
+static int csv_file_flush(csv_file_t *f) {
+  if (f->first_unflushed == 0)
+    return 0;
+
+  f->first_unflushed = 0;
+  if (fflush(f->fh) != 0) {
+    ERROR("csv plugin: fflush (%s) failed: %s", f->filename, STRERRNO);
+    return -1;
+  }
+  return 0;
+} /* int csv_file_flush */
+
+/* csv_file_close writes buffered lines, closes the file, which releases the
+ * lock, and removes it from the cache.
+ * XXX: You must hold "files_lock" when calling this function! */
+static void csv_file_close(csv_file_t *f) {
+  c_avl_remove(files, f->filename, NULL, NULL);
+  csv_file_unlink(f);
+  files_num--;
+
+  if (fclose(f->fh) != 0)
+    ERROR("csv plugin: fclose (%s) failed: %s", f->filename, STRERRNO);
+
+  sfree(f->filename);
+  sfree(f);
+} /* void csv_file_close */
+
+/* XXX: You must hold "files_lock" when calling this function! */
+static void csv_files_close_all(void) {
+  while (files_head != NULL)
+    csv_file_close(files_head);
+} /* void csv_files_close_all */
+
+/* csv_files_flush writes the buffers of all files which have lines older than
+ * "timeout". If "identifier" is not NULL, only matching files are flushed.
+ * XXX: You must hold "files_lock" when calling this function! */
+static void csv_files_flush(cdtime_t now, cdtime_t timeout,
+                            const char *identifier) {
+  char prefix[512] = "";
+  size_t prefix_len = 0;
+
+  if (identifier != NULL) {
+    if (datadir != NULL)
+      ssnprintf(prefix, sizeof(prefix), "%s/%s", datadir, identifier);
+    else
+      sstrncpy(prefix, identifier, sizeof(prefix));
+    prefix_len = strlen(prefix);
+  }
+
+  for (csv_file_t *f = files_head; f != NULL; f = f->next) {
+    if (f->first_unflushed == 0)
+      continue;
+    if ((timeout != 0) && ((now - f->first_unflushed) < timeout))
+      continue;
+    if ((prefix_len > 0) && (strncmp(f->filename, prefix, prefix_len) != 0))
+      continue;
+
+    csv_file_flush(f);
+  }
+} /* void csv_files_flush */
+
+/* csv_file_get returns the cached file for "filename", opening it and evicting
+ * the least recently used file if necessary.
+ * XXX: You must hold "files_lock" when calling this function! */
+static csv_file_t *csv_file_get(const char *filename, const data_set_t *ds) {
+  csv_file_t *f = NULL;
+
+  if (c_avl_get(files, filename, (void *)&f) == 0) {
+    if (f != files_head) {
+      csv_file_unlink(f);
+      csv_file_push_front(f);
+    }
+    return f;
+  }
+
+  f = calloc(1, sizeof(*f));
+  if (f == NULL) {
+    ERROR("csv plugin: calloc failed.");
+    return NULL;
+  }
+
+  f->filename = strdup(filename);
+  if (f->filename == NULL) {
+    ERROR("csv plugin: strdup failed.");
+    sfree(f);
+    return NULL;
+  }
+
+  f->fh = csv_open_file(filename, ds);
+  if (f->fh == NULL) {
+    sfree(f->filename);
+    sfree(f);
+    return NULL;
+  }
+
+  if (c_avl_insert(files, f->filename, f) != 0) {
+    ERROR("csv plugin: c_avl_insert (%s) failed.", filename);
+    fclose(f->fh);
+    sfree(f->filename);
+    sfree(f);
+    return NULL;
+  }
+  csv_file_push_front(f);
+  files_num++;
+
+  while (files_num > file_cache_size)
+    csv_file_close(files_tail);
+
+  return f;
+} /* csv_file_t *csv_file_get */
+
+static int csv_write_cached(const char *filename, const data_set_t *ds,
+                            const char *values, struct tm const *struct_tm) {
+  cdtime_t now = cdtime();
+  int status = 0;
+
+  pthread_mutex_lock(&files_lock);
+
+  if (files == NULL) {
+    pthread_mutex_unlock(&files_lock);
+    ERROR("csv plugin: The file cache has not been initialized.");
+    return -1;
+  }
+
+  /* Close all files when the date changes, so that yesterday's files are
+   * released right away. */
+  if (file_date && ((struct_tm->tm_yday != files_yday) ||
+                    (struct_tm->tm_year != files_year))) {
+    csv_files_close_all();
+    files_yday = struct_tm->tm_yday;
+    files_year = struct_tm->tm_year;
+  }
+
+  csv_file_t *f = csv_file_get(filename, ds);
+  if (f == NULL) {
+    pthread_mutex_unlock(&files_lock);
+    return -1;
+  }
+
+  if (fprintf(f->fh, "%s\n", values) < 0) {
+    ERROR("csv plugin: fprintf (%s) failed: %s", filename, STRERRNO);
+    csv_file_close(f);
+    pthread_mutex_unlock(&files_lock);
+    return -1;
+  }
+
+  if (f->first_unflushed == 0)
+    f->first_unflushed = now;
+  if ((now - f->first_unflushed) >= flush_timeout)
+    status = csv_file_flush(f);
+
+  /* Files which are not written to anymore are flushed here. */
+  if ((now - files_last_sweep) >= flush_timeout) {
+    csv_files_flush(now, flush_timeout, /* identifier = */ NULL);
+    files_last_sweep = now;
+  }
+
+  pthread_mutex_unlock(&files_lock);
+  return status;
+} /* int csv_write_cached */
+
 static int csv_config(const char *key, const char *value) {
   if (strcasecmp("DataDir", key) == 0) {
     if (datadir != NULL) {
@@ -214,6 +466,22 @@ static int csv_config(const char *key, const char *value) {
       file_date = 1;
     else
       file_date = 0;
+  } else if (strcasecmp("FileCacheSize", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 0) {
+      ERROR("csv plugin: `FileCacheSize' must be greater than or equal to "
+            "zero.");
+      return 1;
+    }
+    file_cache_size = (size_t)tmp;
+  } else if (strcasecmp("FlushTimeout", key) == 0) {
+    double tmp = atof(value);
+    if (tmp < 0.0) {
+      ERROR("csv plugin: `FlushTimeout' must be greater than or equal to "
+            "zero.");
+      return 1;
+    }
+    flush_timeout = DOUBLE_TO_CDTIME_T(tmp);
   } else {
     return -1;
   }
@@ -222,12 +490,10 @@ static int csv_config(const char *key, const char *value) {
 
 static int csv_write(const data_set_t *ds, const value_list_t *vl,
                      user_data_t __attribute__((unused)) * user_data) {
-  struct stat statbuf;
   char filename[512];
   char values[4096];
   FILE *csv;
-  int csv_fd;
-  struct flock fl = {0};
+  struct tm struct_tm = {0};
   int status;
 
   if (0 != strcmp(ds->type, vl->type)) {
@@ -235,7 +501,15 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
     return -1;
   }
 
-  status = value_list_to_filename(filename, sizeof(filename), vl);
+  if (!use_stdio && file_date) {
+    time_t now = time(NULL);
+    if (localtime_r(&now, &struct_tm) == NULL) {
+      ERROR("csv plugin: localtime_r failed");
+      return -1;
+    }
+  }
+
+  status = value_list_to_filename(filename, sizeof(filename), vl, &struct_tm);
   if (status != 0)
     return -1;
 
@@ -260,36 +534,12 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
     return 0;
   }
 
-  if (stat(filename, &statbuf) == -1) {
-    if (errno == ENOENT) {
-      if (csv_create_file(filename, ds))
-        return -1;
-    } else {
-      ERROR("stat(%s) failed: %s", filename, STRERRNO);
-      return -1;
-    }
-  } else if (!S_ISREG(statbuf.st_mode)) {
-    ERROR("stat(%s): Not a regular file!", filename);
-    return -1;
-  }
-
-  csv = fopen(filename, "a");
-  if (csv == NULL) {
-    ERROR("csv plugin: fopen (%s) failed: %s", filename, STRERRNO);
-    return -1;
-  }
-  csv_fd = fileno(csv);
-
-  fl.l_pid = getpid();
-  fl.l_type = F_WRLCK;
-  fl.l_whence = SEEK_SET;
+  if (file_cache_size > 0)
+    return csv_write_cached(filename, ds, values, &struct_tm);
 
-  status = fcntl(csv_fd, F_SETLK, &fl);
-  if (status != 0) {
-    ERROR("csv plugin: flock (%s) failed: %s", filename, STRERRNO);
-    fclose(csv);
+  csv = csv_open_file(filename, ds);
+  if (csv == NULL)
     return -1;
-  }
 
   fprintf(csv, "%s\n", values);
 
@@ -300,7 +550,46 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
   return 0;
 } /* int csv_write */
 
+static int csv_flush(cdtime_t timeout, const char *identifier,
+                     user_data_t __attribute__((unused)) * user_data) {
+  pthread_mutex_lock(&files_lock);
+  csv_files_flush(cdtime(), timeout, identifier);
+  pthread_mutex_unlock(&files_lock);
+  return 0;
+} /* int csv_flush */
+
+static int csv_init(void) {
+  if (use_stdio || (file_cache_size == 0))
+    return 0;
+
+  pthread_mutex_lock(&files_lock);
+  if (files == NULL)
+    files = c_avl_create((int (*)(const void *, const void *))strcmp);
+  pthread_mutex_unlock(&files_lock);
+
+  if (files == NULL) {
+    ERROR("csv plugin: c_avl_create failed.");
+    return -1;
+  }
+
+  plugin_register_flush("csv", csv_flush, /* user_data = */ NULL);
+  return 0;
+} /* int csv_init */
+
+static int csv_shutdown(void) {
+  pthread_mutex_lock(&files_lock);
+  if (files != NULL) {
+    csv_files_close_all();
+    c_avl_destroy(files);
+    files = NULL;
+  }
+  pthread_mutex_unlock(&files_lock);
+  return 0;
+} /* int csv_shutdown */
+
 void module_register(void) {
   plugin_register_config("csv", csv_config, config_keys, config_keys_num);
+  plugin_register_init("csv", csv_init);
   plugin_register_write("csv", csv_write, /* user_data = */ NULL);
+  plugin_register_shutdown("csv", csv_shutdown);
 } /* void module_register */
@@ -54,6 +54,10 @@ struct cj_key_s /* {{{ */
   char *path;
   char *type;
   char *instance;
+
+  /* Cached result of the data set lookup for "type". */
+  bool have_ds_type;
+  int ds_type;
 };
 /* }}} */
 
@@ -111,6 +115,19 @@ struct cj_s /* {{{ */
 };
 typedef struct cj_s cj_t; /* }}} */
 
+/* cj_group_t bundles all URL blocks of one <Plugin> block that share the same
+ * interval. They are read by a single callback, which runs all transfers
+ * concurrently using the libcurl "multi" interface. */
+struct cj_group_s /* {{{ */
+{
+  cdtime_t interval;
+  CURLM *multi;
+
+  cj_t **dbs;
+  size_t dbs_num;
+};
+typedef struct cj_group_s cj_group_t; /* }}} */
+
 #if HAVE_YAJL_V2
 typedef size_t yajl_len_t;
 #else
@@ -118,6 +135,7 @@ typedef unsigned int yajl_len_t;
 #endif
 
 static int cj_read(user_data_t *ud);
+static int cj_read_group(user_data_t *ud);
 static void cj_submit_impl(cj_t *db, cj_key_t *key, value_t *value);
 
 /* cj_submit is a function pointer to cj_submit_impl, allowing the unit-test to
@@ -159,6 +177,9 @@ static int cj_get_type(cj_key_t *key) {
   if (key == NULL)
     return -EINVAL;
 
+  if (key->have_ds_type)
+    return key->ds_type;
+
   const data_set_t *ds = plugin_get_ds(key->type);
   if (ds == NULL) {
     static char type[DATA_MAX_NAME_LEN] = "!!!invalid!!!";
@@ -181,7 +202,20 @@ static int cj_get_type(cj_key_t *key) {
         key->type);
   }
 
-  return ds->ds[0].type;
+  key->ds_type = ds->ds[0].type;
+  key->have_ds_type = true;
+  return key->ds_type;
+}
+
+/* cj_parent_is_tree returns true if the context enclosing the current one has
+ * configuration for its children. If not, the parser does not need to look at
+ * keys and array indexes at the current depth at all. */
+static bool cj_parent_is_tree(cj_t const *db) {
+  if (db->depth <= 0)
+    return false;
+
+  cj_tree_entry_t const *parent = db->state[db->depth - 1].entry;
+  return (parent != NULL) && (parent->type == TREE);
 }
 
 /* cj_load_key loads the configuration for "key" from the parent context and
@@ -190,24 +224,22 @@ static int cj_load_key(cj_t *db, char const *key) {
   if (db == NULL || key == NULL || db->depth <= 0)
     return EINVAL;
 
-  sstrncpy(db->state[db->depth].name, key, sizeof(db->state[db->depth].name));
-
-  if (db->state[db->depth - 1].entry == NULL ||
-      db->state[db->depth - 1].entry->type != TREE) {
+  if (!cj_parent_is_tree(db))
     return 0;
-  }
 
   c_avl_tree_t *tree = db->state[db->depth - 1].entry->tree;
   cj_tree_entry_t *e = NULL;
 
-  if (c_avl_get(tree, key, (void *)&e) == 0) {
-    db->state[db->depth].entry = e;
-  } else if (c_avl_get(tree, CJ_ANY, (void *)&e) == 0) {
-    db->state[db->depth].entry = e;
-  } else {
+  if ((c_avl_get(tree, key, (void *)&e) != 0) &&
+      (c_avl_get(tree, CJ_ANY, (void *)&e) != 0)) {
     db->state[db->depth].entry = NULL;
+    return 0;
   }
 
+  /* The name is only needed to build the type instance, i.e. if the path
+   * leading here is configured. */
+  db->state[db->depth].entry = e;
+  sstrncpy(db->state[db->depth].name, key, sizeof(db->state[db->depth].name));
   return 0;
 }
 
@@ -216,6 +248,8 @@ static void cj_advance_array(cj_t *db) {
     return;
 
   db->state[db->depth].index++;
+  if (!cj_parent_is_tree(db))
+    return;
 
   char name[DATA_MAX_NAME_LEN];
   snprintf(name, sizeof(name), "%d", db->state[db->depth].index);
@@ -234,18 +268,20 @@ static int cj_cb_null(void *ctx) {
 static int cj_cb_number(void *ctx, const char *number, yajl_len_t number_len) {
   cj_t *db = (cj_t *)ctx;
 
+  if (db->state[db->depth].entry == NULL) {
+    cj_advance_array(ctx);
+    return CJ_CB_CONTINUE;
+  }
+
   /* Create a null-terminated version of the string. */
   char buffer[number_len + 1];
   memcpy(buffer, number, number_len);
   buffer[sizeof(buffer) - 1] = '\0';
 
-  if (db->state[db->depth].entry == NULL ||
-      db->state[db->depth].entry->type != KEY) {
-    if (db->state[db->depth].entry != NULL) {
-      NOTICE("curl_json plugin: Found \"%s\", but the configuration expects a "
-             "map.",
-             buffer);
-    }
+  if (db->state[db->depth].entry->type != KEY) {
+    NOTICE("curl_json plugin: Found \"%s\", but the configuration expects a "
+           "map.",
+           buffer);
     cj_advance_array(ctx);
     return CJ_CB_CONTINUE;
   }
@@ -270,6 +306,9 @@ static int cj_cb_number(void *ctx, const char *number, yajl_len_t number_len) {
  * NULL. */
 static int cj_cb_map_key(void *ctx, unsigned char const *in_name,
                          yajl_len_t in_name_len) {
+  if (!cj_parent_is_tree(ctx))
+    return CJ_CB_CONTINUE;
+
   char name[in_name_len + 1];
 
   memmove(name, in_name, in_name_len);
@@ -632,8 +671,122 @@ static int cj_init_curl(cj_t *db) /* {{{ */
   return 0;
 } /* }}} int cj_init_curl */
 
-static int cj_config_add_url(oconfig_item_t *ci) /* {{{ */
+static void cj_group_free(void *arg) /* {{{ */
 {
+  cj_group_t *g = arg;
+
+  if (g == NULL)
+    return;
+
+  for (size_t i = 0; i < g->dbs_num; i++)
+    cj_free(g->dbs[i]);
+  sfree(g->dbs);
+
+  if (g->multi != NULL)
+    curl_multi_cleanup(g->multi);
+
+  sfree(g);
+} /* }}} void cj_group_free */
+
+/* cj_group_append adds db to the group in "groups" with the given interval,
+ * creating a new group if necessary. */
+static int cj_group_append(cj_group_t ***groups, size_t *groups_num, /* {{{ */
+                           cj_t *db, cdtime_t interval) {
+  cj_group_t *g = NULL;
+
+  for (size_t i = 0; i < *groups_num; i++) {
+    if ((*groups)[i]->interval == interval) {
+      g = (*groups)[i];
+      break;
+    }
+  }
+
+  if (g == NULL) {
+    cj_group_t **tmp = realloc(*groups, (*groups_num + 1) * sizeof(*tmp));
+    if (tmp == NULL)
+      return ENOMEM;
+    *groups = tmp;
+
+    g = calloc(1, sizeof(*g));
+    if (g == NULL)
+      return ENOMEM;
+    g->interval = interval;
+
+    (*groups)[*groups_num] = g;
+    (*groups_num)++;
+  }
+
+  cj_t **tmp = realloc(g->dbs, (g->dbs_num + 1) * sizeof(*tmp));
+  if (tmp == NULL)
+    return ENOMEM;
+  g->dbs = tmp;
+  g->dbs[g->dbs_num] = db;
+  g->dbs_num++;
+
+  return 0;
+} /* }}} int cj_group_append */
+
+static void cj_register_read(cj_t *db, cdtime_t interval) /* {{{ */
+{
+  DEBUG("curl_json plugin: Registering new read callback: %s", db->instance);
+
+  char *cb_name = ssnprintf_alloc("curl_json-%s-%s", db->instance,
+                                  db->url ? db->url : db->sock);
+
+  plugin_register_complex_read(/* group = */ NULL, cb_name, cj_read, interval,
+                               &(user_data_t){
+                                   .data = db,
+                                   .free_func = cj_free,
+                               });
+  sfree(cb_name);
+} /* }}} void cj_register_read */
+
+/* cj_register_group registers one read callback for the group. Groups with a
+ * single member are registered like ungrouped blocks. The group is freed on
+ * failure. */
+static int cj_register_group(cj_group_t *g) /* {{{ */
+{
+  if (g->dbs_num == 0) {
+    cj_group_free(g);
+    return 0;
+  } else if (g->dbs_num == 1) {
+    cj_register_read(g->dbs[0], g->interval);
+    g->dbs_num = 0;
+    cj_group_free(g);
+    return 0;
+  }
+
+  g->multi = curl_multi_init();
+  if (g->multi == NULL) {
+    ERROR("curl_json plugin: curl_multi_init failed.");
+    cj_group_free(g);
+    return -1;
+  }
+
+  /* The name of the first member is unique, because it is not registered on
+   * its own. */
+  char *cb_name = ssnprintf_alloc("curl_json-%s-%s", g->dbs[0]->instance,
+                                  g->dbs[0]->url);
+
+  DEBUG("curl_json plugin: Registering new read callback for %" PRIsz
+        " URLs: %s",
+        g->dbs_num, cb_name);
+
+  plugin_register_complex_read(/* group = */ NULL, cb_name, cj_read_group,
+                               g->interval,
+                               &(user_data_t){
+                                   .data = g,
+                                   .free_func = cj_group_free,
+                               });
+  sfree(cb_name);
+  return 0;
+} /* }}} int cj_register_group */
+
+/* cj_config_add_url parses a <URL> or <Sock> block. URL blocks are appended
+ * to "groups" and registered by the caller; Sock blocks are registered right
+ * away. */
+static int cj_config_add_url(oconfig_item_t *ci, /* {{{ */
+                             cj_group_t ***groups, size_t *groups_num) {
   cj_t *db;
   int status = 0;
   cdtime_t interval = 0;
@@ -749,29 +902,27 @@ static int cj_config_add_url(oconfig_item_t *ci) /* {{{ */
       status = cj_init_curl(db);
   }
 
-  /* If all went well, register this database for reading */
-  if (status == 0) {
-    char *cb_name;
-
+  if (status == 0 && db->instance == NULL) {
+    db->instance = strdup("default");
     if (db->instance == NULL)
-      db->instance = strdup("default");
-
-    DEBUG("curl_json plugin: Registering new read callback: %s", db->instance);
+      status = -1;
+  }
 
-    cb_name = ssnprintf_alloc("curl_json-%s-%s", db->instance,
-                              db->url ? db->url : db->sock);
+  if (status == 0 && db->url != NULL) {
+    status = cj_group_append(groups, groups_num, db, interval);
+    if (status != 0)
+      ERROR("curl_json plugin: Adding URL `%s' to its group failed.", db->url);
+  }
 
-    plugin_register_complex_read(/* group = */ NULL, cb_name, cj_read, interval,
-                                 &(user_data_t){
-                                     .data = db,
-                                     .free_func = cj_free,
-                                 });
-    sfree(cb_name);
-  } else {
+  if (status != 0) {
     cj_free(db);
     return -1;
   }
 
+  /* If all went well, register this database for reading */
+  if (db->url == NULL)
+    cj_register_read(db, interval);
+
   return 0;
 }
 /* }}} int cj_config_add_database */
@@ -782,6 +933,9 @@ static int cj_config(oconfig_item_t *ci) /* {{{ */
   int errors;
   int status;
 
+  cj_group_t **groups = NULL;
+  size_t groups_num = 0;
+
   success = 0;
   errors = 0;
 
@@ -790,7 +944,7 @@ static int cj_config(oconfig_item_t *ci) /* {{{ */
 
     if (strcasecmp("Sock", child->key) == 0 ||
         strcasecmp("URL", child->key) == 0) {
-      status = cj_config_add_url(child);
+      status = cj_config_add_url(child, &groups, &groups_num);
       if (status == 0)
         success++;
       else
@@ -801,6 +955,17 @@ static int cj_config(oconfig_item_t *ci) /* {{{ */
     }
   }
 
+  /* URL blocks sharing an interval are read by one callback. */
+  for (size_t i = 0; i < groups_num; i++) {
+    size_t dbs_num = groups[i]->dbs_num;
+
+    if (cj_register_group(groups[i]) != 0) {
+      success -= (int)dbs_num;
+      errors += (int)dbs_num;
+    }
+  }
+  sfree(groups);
+
   if ((success == 0) && (errors > 0)) {
     ERROR("curl_json plugin: All statements failed.");
     return -1;
@@ -877,15 +1042,13 @@ static int cj_sock_perform(cj_t *db) /* {{{ */
   return 0;
 } /* }}} int cj_sock_perform */
 
-static int cj_curl_perform(cj_t *db) /* {{{ */
+/* cj_curl_result checks the outcome of a transfer and dispatches the transfer
+ * statistics. */
+static int cj_curl_result(cj_t *db, CURLcode status) /* {{{ */
 {
-  int status;
   long rc;
   char *url;
 
-  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
-
-  status = curl_easy_perform(db->curl);
   if (status != CURLE_OK) {
     ERROR("curl_json plugin: curl_easy_perform failed with status %i: %s (%s)",
           status, db->curl_errbuf, db->url);
@@ -906,35 +1069,33 @@ static int cj_curl_perform(cj_t *db) /* {{{ */
     return -1;
   }
   return 0;
-} /* }}} int cj_curl_perform */
+} /* }}} int cj_curl_result */
 
-static int cj_perform(cj_t *db) /* {{{ */
+static int cj_curl_perform(cj_t *db) /* {{{ */
 {
-  int status;
-  yajl_handle yprev = db->yajl;
+  curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
+
+  return cj_curl_result(db, curl_easy_perform(db->curl));
+} /* }}} int cj_curl_perform */
 
-  db->yajl = yajl_alloc(&ycallbacks,
+static yajl_handle cj_yajl_alloc(cj_t *db) /* {{{ */
+{
+  yajl_handle yajl = yajl_alloc(&ycallbacks,
 #if HAVE_YAJL_V2
-                        /* alloc funcs = */ NULL,
+                                /* alloc funcs = */ NULL,
 #else
-                        /* alloc funcs = */ NULL, NULL,
+                                /* alloc funcs = */ NULL, NULL,
 #endif
-                        /* context = */ (void *)db);
-  if (db->yajl == NULL) {
+                                /* context = */ (void *)db);
+  if (yajl == NULL)
     ERROR("curl_json plugin: yajl_alloc failed.");
-    db->yajl = yprev;
-    return -1;
-  }
 
-  if (db->url)
-    status = cj_curl_perform(db);
-  else
-    status = cj_sock_perform(db);
-  if (status < 0) {
-    yajl_free(db->yajl);
-    db->yajl = yprev;
-    return -1;
-  }
+  return yajl;
+} /* }}} yajl_handle cj_yajl_alloc */
+
+static int cj_yajl_complete(cj_t *db) /* {{{ */
+{
+  int status;
 
 #if HAVE_YAJL_V2
   status = yajl_complete_parse(db->yajl);
@@ -948,16 +1109,49 @@ static int cj_perform(cj_t *db) /* {{{ */
                             /* jsonText = */ NULL, /* jsonTextLen = */ 0);
     ERROR("curl_json plugin: yajl_parse_complete failed: %s", (char *)errmsg);
     yajl_free_error(db->yajl, errmsg);
-    yajl_free(db->yajl);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int cj_yajl_complete */
+
+static int cj_perform(cj_t *db) /* {{{ */
+{
+  int status;
+  yajl_handle yprev = db->yajl;
+
+  db->yajl = cj_yajl_alloc(db);
+  if (db->yajl == NULL) {
     db->yajl = yprev;
     return -1;
   }
 
+  if (db->url)
+    status = cj_curl_perform(db);
+  else
+    status = cj_sock_perform(db);
+  if (status == 0)
+    status = cj_yajl_complete(db);
+
   yajl_free(db->yajl);
   db->yajl = yprev;
-  return 0;
+  return (status == 0) ? 0 : -1;
 } /* }}} int cj_perform */
 
+/* cj_reset prepares the parser state of db for a new document. */
+static void cj_reset(cj_t *db, cj_tree_entry_t *root) /* {{{ */
+{
+  db->depth = 0;
+  memset(&db->state, 0, sizeof(db->state));
+
+  /* This is not a compound literal because EPEL6's GCC is not cool enough to
+   * handle anonymous unions within compound literals. */
+  memset(root, 0, sizeof(*root));
+  root->type = TREE;
+  root->tree = db->tree;
+  db->state[0].entry = root;
+} /* }}} void cj_reset */
+
 static int cj_read(user_data_t *ud) /* {{{ */
 {
   cj_t *db;
@@ -969,15 +1163,8 @@ static int cj_read(user_data_t *ud) /* {{{ */
 
   db = (cj_t *)ud->data;
 
-  db->depth = 0;
-  memset(&db->state, 0, sizeof(db->state));
-
-  /* This is not a compound literal because EPEL6's GCC is not cool enough to
-   * handle anonymous unions within compound literals. */
-  cj_tree_entry_t root = {0};
-  root.type = TREE;
-  root.tree = db->tree;
-  db->state[0].entry = &root;
+  cj_tree_entry_t root;
+  cj_reset(db, &root);
 
   int status = cj_perform(db);
 
@@ -986,6 +1173,97 @@ static int cj_read(user_data_t *ud) /* {{{ */
   return status;
 } /* }}} int cj_read */
 
+/* cj_read_group fetches all URLs of a group concurrently. Each transfer feeds
+ * its own parser as data arrives, so the callback returns once the slowest
+ * transfer has finished or timed out. */
+static int cj_read_group(user_data_t *ud) /* {{{ */
+{
+  cj_group_t *g;
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("curl_json plugin: cj_read_group: Invalid user data.");
+    return -1;
+  }
+
+  g = (cj_group_t *)ud->data;
+
+  cj_tree_entry_t roots[g->dbs_num];
+  int results[g->dbs_num];
+  int running = 0;
+
+  for (size_t i = 0; i < g->dbs_num; i++) {
+    cj_t *db = g->dbs[i];
+
+    results[i] = -1;
+    cj_reset(db, &roots[i]);
+
+    db->yajl = cj_yajl_alloc(db);
+    if (db->yajl == NULL)
+      continue;
+
+    curl_easy_setopt(db->curl, CURLOPT_URL, db->url);
+    curl_easy_setopt(db->curl, CURLOPT_PRIVATE, (void *)&results[i]);
+
+    CURLMcode mc = curl_multi_add_handle(g->multi, db->curl);
+    if (mc != CURLM_OK) {
+      ERROR("curl_json plugin: curl_multi_add_handle failed: %s (%s)",
+            curl_multi_strerror(mc), db->url);
+      yajl_free(db->yajl);
+      db->yajl = NULL;
+      continue;
+    }
+    running++;
+  }
+
+  while (running > 0) {
+    CURLMcode mc = curl_multi_perform(g->multi, &running);
+    if (mc != CURLM_OK) {
+      ERROR("curl_json plugin: curl_multi_perform failed: %s",
+            curl_multi_strerror(mc));
+      break;
+    }
+
+    if (running > 0)
+      curl_multi_wait(g->multi, NULL, 0, /* timeout_ms = */ 1000, NULL);
+  }
+
+  CURLMsg *msg;
+  int msgs_left;
+  while ((msg = curl_multi_info_read(g->multi, &msgs_left)) != NULL) {
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+
+    int *result = NULL;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&result);
+    if (result == NULL)
+      continue;
+
+    cj_t *db = g->dbs[result - results];
+    *result = cj_curl_result(db, msg->data.result);
+    if (*result == 0)
+      *result = cj_yajl_complete(db);
+  }
+
+  int success = 0;
+  for (size_t i = 0; i < g->dbs_num; i++) {
+    cj_t *db = g->dbs[i];
+
+    if (db->yajl != NULL) {
+      curl_multi_remove_handle(g->multi, db->curl);
+      yajl_free(db->yajl);
+      db->yajl = NULL;
+    }
+    db->state[0].entry = NULL;
+
+    if (results[i] == 0)
+      success++;
+  }
+
+  /* Only report an error if all URLs failed, so that a single broken server
+   * does not delay the reads of all other URLs in the group. */
+  return (success > 0) ? 0 : -1;
+} /* }}} int cj_read_group */
+
 static int cj_init(void) /* {{{ */
 {
   /* Call this while collectd is still single-threaded to avoid
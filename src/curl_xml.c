@@ -42,6 +42,7 @@ struct cx_values_s /* {{{ */
 {
   char path[DATA_MAX_NAME_LEN];
   size_t path_len;
+  xmlXPathCompExprPtr comp;
 };
 typedef struct cx_values_s cx_values_t;
 /* }}} */
@@ -57,6 +58,11 @@ struct cx_xpath_s /* {{{ */
   char *plugin_instance_from;
   int is_table;
   unsigned long magic;
+
+  /* Compiled versions of "path", "instance" and "plugin_instance_from". */
+  xmlXPathCompExprPtr path_comp;
+  xmlXPathCompExprPtr instance_comp;
+  xmlXPathCompExprPtr plugin_instance_from_comp;
 };
 typedef struct cx_xpath_s cx_xpath_t;
 /* }}} */
@@ -141,6 +147,12 @@ static void cx_xpath_free(cx_xpath_t *xpath) /* {{{ */
   if (xpath == NULL)
     return;
 
+  xmlXPathFreeCompExpr(xpath->path_comp);
+  xmlXPathFreeCompExpr(xpath->instance_comp);
+  xmlXPathFreeCompExpr(xpath->plugin_instance_from_comp);
+  for (size_t i = 0; i < xpath->values_len; i++)
+    xmlXPathFreeCompExpr(xpath->values[i].comp);
+
   sfree(xpath->path);
   sfree(xpath->type);
   sfree(xpath->instance_prefix);
@@ -251,10 +263,10 @@ static int cx_check_type(const data_set_t *ds, cx_xpath_t *xpath) /* {{{ */
 } /* }}} cx_check_type */
 
 static xmlXPathObjectPtr cx_evaluate_xpath(xmlXPathContextPtr xpath_ctx,
+                                           xmlXPathCompExprPtr comp,
                                            char *expr) /* {{{ */
 {
-  xmlXPathObjectPtr xpath_obj =
-      xmlXPathEvalExpression(BAD_CAST expr, xpath_ctx);
+  xmlXPathObjectPtr xpath_obj = xmlXPathCompiledEval(comp, xpath_ctx);
   if (xpath_obj == NULL) {
     WARNING("curl_xml plugin: "
             "Error unable to evaluate xpath expression \"%s\". Skipping...",
@@ -281,8 +293,9 @@ static int cx_if_not_text_node(xmlNodePtr node) /* {{{ */
  * Returned value should be freed with xmlFree().
  */
 static char *cx_get_text_node_value(xmlXPathContextPtr xpath_ctx, /* {{{ */
-                                    char *expr, const char *from_option) {
-  xmlXPathObjectPtr values_node_obj = cx_evaluate_xpath(xpath_ctx, expr);
+                                    xmlXPathCompExprPtr comp, char *expr,
+                                    const char *from_option) {
+  xmlXPathObjectPtr values_node_obj = cx_evaluate_xpath(xpath_ctx, comp, expr);
   if (values_node_obj == NULL)
     return NULL; /* Error already logged. */
 
@@ -330,8 +343,9 @@ static int cx_handle_single_value_xpath(xmlXPathContextPtr xpath_ctx, /* {{{ */
                                         cx_xpath_t *xpath, const data_set_t *ds,
                                         value_list_t *vl, int index) {
 
-  char *node_value = cx_get_text_node_value(
-      xpath_ctx, xpath->values[index].path, "ValuesFrom");
+  char *node_value =
+      cx_get_text_node_value(xpath_ctx, xpath->values[index].comp,
+                             xpath->values[index].path, "ValuesFrom");
 
   if (node_value == NULL)
     return -1;
@@ -390,8 +404,8 @@ static int cx_handle_instance_xpath(xmlXPathContextPtr xpath_ctx, /* {{{ */
 
   /* Handle type instance */
   if (xpath->instance != NULL) {
-    char *node_value =
-        cx_get_text_node_value(xpath_ctx, xpath->instance, "InstanceFrom");
+    char *node_value = cx_get_text_node_value(
+        xpath_ctx, xpath->instance_comp, xpath->instance, "InstanceFrom");
     if (node_value == NULL)
       return -1;
 
@@ -409,7 +423,8 @@ static int cx_handle_instance_xpath(xmlXPathContextPtr xpath_ctx, /* {{{ */
   /* Handle plugin instance */
   if (xpath->plugin_instance_from != NULL) {
     char *node_value = cx_get_text_node_value(
-        xpath_ctx, xpath->plugin_instance_from, "PluginInstanceFrom");
+        xpath_ctx, xpath->plugin_instance_from_comp,
+        xpath->plugin_instance_from, "PluginInstanceFrom");
 
     if (node_value == NULL)
       return -1;
@@ -428,7 +443,8 @@ static int cx_handle_xpath(const cx_t *db, /* {{{ */
   if (cx_check_type(ds, xpath) != 0)
     return -1;
 
-  xmlXPathObjectPtr base_node_obj = cx_evaluate_xpath(xpath_ctx, xpath->path);
+  xmlXPathObjectPtr base_node_obj =
+      cx_evaluate_xpath(xpath_ctx, xpath->path_comp, xpath->path);
   if (base_node_obj == NULL)
     return -1; /* error is logged already */
 
@@ -504,8 +520,11 @@ static int cx_handle_parsed_xml(cx_t *db, xmlDocPtr doc, /* {{{ */
 
 static int cx_parse_xml(cx_t *db, char *xml) /* {{{ */
 {
-  /* Load the XML */
-  xmlDocPtr doc = xmlParseDoc(BAD_CAST xml);
+  /* Load the XML. Storing short strings in the nodes themselves saves a
+   * considerable amount of memory for large documents. */
+  xmlDocPtr doc = xmlReadMemory(xml, strlen(xml), /* URL = */ NULL,
+                                /* encoding = */ NULL,
+                                XML_PARSE_NONET | XML_PARSE_COMPACT);
   if (doc == NULL) {
     ERROR("curl_xml plugin: Failed to parse the xml document  - %s", xml);
     return -1;
@@ -609,11 +628,23 @@ static int cx_config_add_values(const char *name, cx_xpath_t *xpath, /* {{{ */
     xpath->values[i].path_len = sizeof(ci->values[i].value.string);
     sstrncpy(xpath->values[i].path, ci->values[i].value.string,
              sizeof(xpath->values[i].path));
+    xpath->values[i].comp = NULL;
   }
 
   return 0;
 } /* }}} cx_config_add_values */
 
+static int cx_compile_xpath(const char *expr, /* {{{ */
+                            xmlXPathCompExprPtr *ret_comp) {
+  *ret_comp = xmlXPathCompile(BAD_CAST expr);
+  if (*ret_comp == NULL) {
+    ERROR("curl_xml plugin: Invalid xpath expression \"%s\".", expr);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int cx_compile_xpath */
+
 static int cx_config_add_xpath(cx_t *db, oconfig_item_t *ci) /* {{{ */
 {
   cx_xpath_t *xpath = calloc(1, sizeof(*xpath));
@@ -676,6 +707,20 @@ static int cx_config_add_xpath(cx_t *db, oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  /* Compile the expressions once instead of on every read. */
+  status = cx_compile_xpath(xpath->path, &xpath->path_comp);
+  if ((status == 0) && (xpath->instance != NULL))
+    status = cx_compile_xpath(xpath->instance, &xpath->instance_comp);
+  if ((status == 0) && (xpath->plugin_instance_from != NULL))
+    status = cx_compile_xpath(xpath->plugin_instance_from,
+                              &xpath->plugin_instance_from_comp);
+  for (size_t i = 0; (status == 0) && (i < xpath->values_len); i++)
+    status = cx_compile_xpath(xpath->values[i].path, &xpath->values[i].comp);
+  if (status != 0) {
+    cx_xpath_free(xpath);
+    return status;
+  }
+
   llentry_t *le = llentry_create(xpath->path, xpath);
   if (le == NULL) {
     ERROR("curl_xml plugin: llentry_create failed.");
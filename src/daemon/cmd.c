@@ -45,6 +45,10 @@ static void sig_term_handler(int __attribute__((unused)) signal) {
   stop_collectd();
 }
 
+static void sig_hup_handler(int __attribute__((unused)) signal) {
+  plugin_reload_request();
+}
+
 static void sig_usr1_handler(int __attribute__((unused)) signal) {
   pthread_t thread;
   pthread_attr_t attr;
@@ -252,6 +256,14 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  struct sigaction sig_hup_action = {.sa_handler = sig_hup_handler};
+
+  if (sigaction(SIGHUP, &sig_hup_action, NULL) != 0) {
+    ERROR("Error: Failed to install a signal handler for signal HUP: %s",
+          STRERRNO);
+    return 1;
+  }
+
   struct sigaction sig_usr1_action = {.sa_handler = sig_usr1_handler};
 
   if (sigaction(SIGUSR1, &sig_usr1_action, NULL) != 0) {
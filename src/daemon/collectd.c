@@ -270,6 +270,9 @@ static int do_loop(void) {
   cdtime_t wait_until = cdtime() + interval;
 
   while (loop == 0) {
+    if (plugin_reload_requested())
+      cf_reload();
+
 #if HAVE_LIBKSTAT
     update_kstat();
 #endif
@@ -289,7 +292,12 @@ static int do_loop(void) {
     struct timespec ts_wait = CDTIME_T_TO_TIMESPEC(wait_until - now);
     wait_until = wait_until + interval;
 
+    /* A reload is handled right away if the signal interrupted the sleep. */
     while ((loop == 0) && (nanosleep(&ts_wait, &ts_wait) != 0)) {
+      if ((errno == EINTR) && plugin_reload_requested()) {
+        cf_reload();
+        continue;
+      }
       if (errno != EINTR) {
         ERROR("nanosleep failed: %s", STRERRNO);
         return -1;
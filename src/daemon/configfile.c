@@ -106,20 +106,43 @@ static cf_global_option_t cf_global_options[] = {
     {"Hostname", NULL, 0, NULL},
     {"FQDNLookup", NULL, 0, "true"},
     {"Interval", NULL, 0, NULL},
+    {"InitThreads", NULL, 0, "1"},
     {"ReadThreads", NULL, 0, "5"},
+    {"ReadThreadsMax", NULL, 0, NULL},
+    {"ReadTimeout", NULL, 0, "0"},
+    {"AlignRead", NULL, 0, "false"},
+    {"SpreadRead", NULL, 0, "false"},
+    {"SharedReadTimestamp", NULL, 0, "false"},
     {"WriteThreads", NULL, 0, "5"},
+    {"ReadThreadsCPUs", NULL, 0, ""},
+    {"WriteThreadsCPUs", NULL, 0, ""},
     {"WriteQueueLimitHigh", NULL, 0, NULL},
     {"WriteQueueLimitLow", NULL, 0, NULL},
+    {"WriteQueueSharding", NULL, 0, "false"},
     {"Timeout", NULL, 0, "2"},
     {"AutoLoadPlugin", NULL, 0, "false"},
     {"CollectInternalStats", NULL, 0, "false"},
     {"PreCacheChain", NULL, 0, "PreCache"},
     {"PostCacheChain", NULL, 0, "PostCache"},
-    {"MaxReadInterval", NULL, 0, "86400"}};
+    {"MaxReadInterval", NULL, 0, "86400"},
+    {"CacheFile", NULL, 0, NULL},
+    {"CacheCheckpointInterval", NULL, 0, "0"},
+    {"SeriesLimitPerHost", NULL, 0, "0"},
+    {"SeriesLimitPerPlugin", NULL, 0, "0"},
+    {"SeriesLimitAction", NULL, 0, "Drop"},
+    {"LogQueueLength", NULL, 0, "0"},
+    {"NotificationThreads", NULL, 0, "0"},
+    {"NotificationQueueLimit", NULL, 0, "1000"},
+    {"NotificationCoalesceInterval", NULL, 0, "0"}};
 static int cf_global_options_num = STATIC_ARRAY_SIZE(cf_global_options);
 
 static int cf_default_typesdb = 1;
 
+/* The configuration that is in effect and the file it has been read from,
+ * see cf_reload(). */
+static oconfig_item_t *cf_running;
+static char *cf_running_file;
+
 /*
  * Functions to handle register/unregister, search, and other plugin related
  * stuff
@@ -268,6 +291,32 @@ static int dispatch_value_plugindir(oconfig_item_t *ci) {
   return 0;
 }
 
+/* Parses the "WritePriority" option of <LoadPlugin>. */
+static int cf_get_write_priority(oconfig_item_t const *ci,
+                                 int *ret_priority) {
+  if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING)) {
+    ERROR("configfile: The `WritePriority' option requires exactly one "
+          "string argument.");
+    return EINVAL;
+  }
+
+  char const *priority = ci->values[0].value.string;
+  if (strcasecmp("Low", priority) == 0)
+    *ret_priority = WRITE_PRIORITY_LOW;
+  else if (strcasecmp("Normal", priority) == 0)
+    *ret_priority = WRITE_PRIORITY_NORMAL;
+  else if (strcasecmp("High", priority) == 0)
+    *ret_priority = WRITE_PRIORITY_HIGH;
+  else {
+    ERROR("configfile: WritePriority must be \"Low\", \"Normal\" or "
+          "\"High\", not \"%s\".",
+          priority);
+    return EINVAL;
+  }
+
+  return 0;
+}
+
 static int dispatch_loadplugin(oconfig_item_t *ci) {
   bool global = false;
 
@@ -287,6 +336,7 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
   plugin_ctx_t ctx = {
       .interval = cf_get_default_interval(),
       .name = strdup(name),
+      .suppress_heartbeat = 10,
   };
   if (ctx.name == NULL)
     return ENOMEM;
@@ -302,6 +352,32 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
       cf_util_get_cdtime(child, &ctx.flush_interval);
     else if (strcasecmp("FlushTimeout", child->key) == 0)
       cf_util_get_cdtime(child, &ctx.flush_timeout);
+    else if (strcasecmp("WriteQueue", child->key) == 0)
+      cf_util_get_boolean(child, &ctx.write_queue);
+    else if (strcasecmp("WriteQueueLimitHigh", child->key) == 0)
+      cf_util_get_int(child, &ctx.write_queue_limit_high);
+    else if (strcasecmp("WriteQueueLimitLow", child->key) == 0)
+      cf_util_get_int(child, &ctx.write_queue_limit_low);
+    else if (strcasecmp("WriteQueueSpill", child->key) == 0)
+      cf_util_get_boolean(child, &ctx.write_queue_spill);
+    else if (strcasecmp("WriteQueueSpillLimit", child->key) == 0)
+      cf_util_get_int(child, &ctx.write_queue_spill_limit);
+    else if (strcasecmp("WritePriority", child->key) == 0)
+      cf_get_write_priority(child, &ctx.write_priority);
+    else if (strcasecmp("SuppressUnchanged", child->key) == 0)
+      cf_util_get_boolean(child, &ctx.suppress_unchanged);
+    else if (strcasecmp("SuppressUnchangedHeartbeat", child->key) == 0)
+      cf_util_get_int(child, &ctx.suppress_heartbeat);
+    else if (strcasecmp("ReadTimeout", child->key) == 0)
+      cf_util_get_cdtime(child, &ctx.read_timeout);
+    else if (strcasecmp("AdaptiveInterval", child->key) == 0)
+      cf_util_get_boolean(child, &ctx.adaptive_interval);
+    else if (strcasecmp("AdaptiveIntervalMin", child->key) == 0)
+      cf_util_get_cdtime(child, &ctx.adaptive_interval_min);
+    else if (strcasecmp("AdaptiveIntervalMax", child->key) == 0)
+      cf_util_get_cdtime(child, &ctx.adaptive_interval_max);
+    else if (strcasecmp("AdaptiveThreshold", child->key) == 0)
+      cf_util_get_double(child, &ctx.adaptive_threshold);
     else {
       WARNING("Ignoring unknown LoadPlugin option \"%s\" "
               "for plugin \"%s\"",
@@ -309,6 +385,21 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
     }
   }
 
+  if (ctx.suppress_heartbeat < 1) {
+    WARNING("configfile: SuppressUnchangedHeartbeat of plugin \"%s\" must be "
+            "at least 1. Using 1.",
+            name);
+    ctx.suppress_heartbeat = 1;
+  }
+
+  if ((ctx.adaptive_interval_min != 0) && (ctx.adaptive_interval_max != 0) &&
+      (ctx.adaptive_interval_min > ctx.adaptive_interval_max)) {
+    WARNING("configfile: AdaptiveIntervalMin of plugin \"%s\" is larger than "
+            "AdaptiveIntervalMax. Disabling AdaptiveInterval.",
+            name);
+    ctx.adaptive_interval = false;
+  }
+
   plugin_ctx_t old_ctx = plugin_set_ctx(ctx);
   int ret_val = plugin_load(name, global);
   /* reset to the "global" context */
@@ -445,95 +536,38 @@ static int dispatch_block(oconfig_item_t *ci) {
     return dispatch_block_plugin(ci);
   else if (strcasecmp(ci->key, "Chain") == 0)
     return fc_configure(ci);
+  else if (strcasecmp(ci->key, "ReadThreadPool") == 0)
+    return plugin_config_read_pool(ci);
 
   return 0;
 }
 
-static int cf_ci_replace_child(oconfig_item_t *dst, oconfig_item_t *src,
-                               int offset) {
-  oconfig_item_t *temp;
-
-  assert(offset >= 0);
-  assert(dst->children_num > offset);
-
-  /* Free the memory used by the replaced child. Usually that's the
-   * `Include "blah"' statement. */
-  temp = dst->children + offset;
-  for (int i = 0; i < temp->values_num; i++) {
-    if (temp->values[i].type == OCONFIG_TYPE_STRING) {
-      sfree(temp->values[i].value.string);
-    }
-  }
-  sfree(temp->values);
-  temp = NULL;
-
-  /* If (src->children_num == 0) the array size is decreased. If offset
-   * is _not_ the last element, (offset < (dst->children_num - 1)), then
-   * we need to move the trailing elements before resizing the array. */
-  if ((src->children_num == 0) && (offset < (dst->children_num - 1))) {
-    int nmemb = dst->children_num - (offset + 1);
-    memmove(dst->children + offset, dst->children + offset + 1,
-            sizeof(oconfig_item_t) * nmemb);
-  }
-
-  /* Resize the memory containing the children to be big enough to hold
-   * all children. */
-  if (dst->children_num + src->children_num - 1 == 0) {
-    dst->children_num = 0;
-    return 0;
-  }
-
-  temp =
-      realloc(dst->children, sizeof(oconfig_item_t) *
-                                 (dst->children_num + src->children_num - 1));
-  if (temp == NULL) {
-    ERROR("configfile: realloc failed.");
-    return -1;
-  }
-  dst->children = temp;
-
-  /* If there are children behind the include statement, and they have
-   * not yet been moved because (src->children_num == 0), then move them
-   * to the end of the list, so that the new children have room before
-   * them. */
-  if ((src->children_num > 0) && ((dst->children_num - (offset + 1)) > 0)) {
-    int nmemb = dst->children_num - (offset + 1);
-    int old_offset = offset + 1;
-    int new_offset = offset + src->children_num;
-
-    memmove(dst->children + new_offset, dst->children + old_offset,
-            sizeof(oconfig_item_t) * nmemb);
-  }
-
-  /* Last but not least: If there are new children, copy them to the
-   * memory reserved for them. */
-  if (src->children_num > 0) {
-    memcpy(dst->children + offset, src->children,
-           sizeof(oconfig_item_t) * src->children_num);
-  }
-
-  /* Update the number of children. */
-  dst->children_num += (src->children_num - 1);
-
-  return 0;
-} /* int cf_ci_replace_child */
-
-static int cf_ci_append_children(oconfig_item_t *dst, oconfig_item_t *src) {
-  oconfig_item_t *temp;
-
+/* Appends the children of "src" to "dst". "dst_alloc" is the number of
+ * children "dst->children" has room for; the array grows geometrically, so
+ * that merging many included files takes linear time. */
+static int cf_ci_append_children(oconfig_item_t *dst, int *dst_alloc,
+                                 oconfig_item_t const *src) {
   if ((src == NULL) || (src->children_num == 0))
     return 0;
 
-  temp = realloc(dst->children, sizeof(oconfig_item_t) *
-                                    (dst->children_num + src->children_num));
-  if (temp == NULL) {
-    ERROR("configfile: realloc failed.");
-    return -1;
+  int need = dst->children_num + src->children_num;
+  if (need > *dst_alloc) {
+    int alloc = (*dst_alloc > 0) ? 2 * (*dst_alloc) : 16;
+    while (alloc < need)
+      alloc *= 2;
+
+    oconfig_item_t *temp =
+        realloc(dst->children, sizeof(*dst->children) * alloc);
+    if (temp == NULL) {
+      ERROR("configfile: realloc failed.");
+      return -1;
+    }
+    dst->children = temp;
+    *dst_alloc = alloc;
   }
-  dst->children = temp;
 
   memcpy(dst->children + dst->children_num, src->children,
-         sizeof(oconfig_item_t) * src->children_num);
+         sizeof(*src->children) * src->children_num);
   dst->children_num += src->children_num;
 
   return 0;
@@ -543,21 +577,46 @@ static int cf_ci_append_children(oconfig_item_t *dst, oconfig_item_t *src) {
 static oconfig_item_t *cf_read_generic(const char *path, const char *pattern,
                                        int depth);
 
+/* Replaces the `Include' statements among the children of "root" with the
+ * children of the included files. The children are moved to a new array in a
+ * single pass, so that the cost does not depend on the number of `Include'
+ * statements. */
 static int cf_include_all(oconfig_item_t *root, int depth) {
-  for (int i = 0; i < root->children_num; i++) {
+  int i;
+
+  for (i = 0; i < root->children_num; i++)
+    if (strcasecmp(root->children[i].key, "Include") == 0)
+      break;
+  if (i >= root->children_num)
+    return 0;
+
+  oconfig_item_t merged = {0};
+  int merged_alloc = 0;
+  int status = 0;
+
+  for (i = 0; i < root->children_num; i++) {
+    oconfig_item_t *old = root->children + i;
     oconfig_item_t *new;
-    oconfig_item_t *old;
 
     char *pattern = NULL;
 
-    if (strcasecmp(root->children[i].key, "Include") != 0)
+    if (strcasecmp(old->key, "Include") != 0) {
+      status = cf_ci_append_children(
+          &merged, &merged_alloc,
+          &(oconfig_item_t){.children = old, .children_num = 1});
+      if (status != 0)
+        break;
       continue;
-
-    old = root->children + i;
+    }
 
     if ((old->values_num != 1) ||
         (old->values[0].type != OCONFIG_TYPE_STRING)) {
       ERROR("configfile: `Include' needs exactly one string argument.");
+      status = cf_ci_append_children(
+          &merged, &merged_alloc,
+          &(oconfig_item_t){.children = old, .children_num = 1});
+      if (status != 0)
+        break;
       continue;
     }
 
@@ -574,24 +633,49 @@ static int cf_include_all(oconfig_item_t *root, int depth) {
     new = cf_read_generic(old->values[0].value.string, pattern, depth + 1);
     sfree(pattern);
 
-    if (new == NULL)
-      return -1;
-
-    /* Now replace the i'th child in `root' with `new'. */
-    if (cf_ci_replace_child(root, new, i) < 0) {
-      sfree(new->values);
-      sfree(new);
-      return -1;
+    if (new == NULL) {
+      status = -1;
+      break;
     }
 
-    /* ... and go back to the new i'th child. */
-    --i;
-
+    status = cf_ci_append_children(&merged, &merged_alloc, new);
+    if (status != 0) {
+      oconfig_free(new);
+      break;
+    }
     sfree(new->values);
+    sfree(new->children);
     sfree(new);
+
+    /* Free the memory used by the `Include "blah"' statement. */
+    sfree(old->key);
+    for (int j = 0; j < old->values_num; j++) {
+      if (old->values[j].type == OCONFIG_TYPE_STRING) {
+        sfree(old->values[j].value.string);
+      }
+    }
+    sfree(old->values);
+    old->values_num = 0;
   } /* for (i = 0; i < root->children_num; i++) */
 
-  return 0;
+  /* On error, the remaining children are kept, so that every item is still
+   * referenced exactly once and "root" can be freed by the caller. */
+  if ((status != 0) && (i < root->children_num)) {
+    if (cf_ci_append_children(
+            &merged, &merged_alloc,
+            &(oconfig_item_t){.children = root->children + i,
+                              .children_num = root->children_num - i}) !=
+        0) {
+      /* Leak the merged children rather than freeing items twice. */
+      return -1;
+    }
+  }
+
+  sfree(root->children);
+  root->children = merged.children;
+  root->children_num = merged.children_num;
+
+  return status;
 } /* int cf_include_all */
 
 static oconfig_item_t *cf_read_file(const char *file, const char *pattern,
@@ -645,6 +729,7 @@ static int cf_compare_string(const void *p1, const void *p2) {
 static oconfig_item_t *cf_read_dir(const char *dir, const char *pattern,
                                    int depth) {
   oconfig_item_t *root = NULL;
+  int root_alloc = 0;
   DIR *dh;
   struct dirent *de;
   char **filenames = NULL;
@@ -721,7 +806,7 @@ static oconfig_item_t *cf_read_dir(const char *dir, const char *pattern,
       continue;
     }
 
-    cf_ci_append_children(root, temp);
+    cf_ci_append_children(root, &root_alloc, temp);
     sfree(temp->children);
     sfree(temp);
 
@@ -748,6 +833,7 @@ static oconfig_item_t *cf_read_dir(const char *dir, const char *pattern,
 static oconfig_item_t *cf_read_generic(const char *path, const char *pattern,
                                        int depth) {
   oconfig_item_t *root = NULL;
+  int root_alloc = 0;
   int status;
   const char *path_ptr;
   wordexp_t we;
@@ -804,7 +890,7 @@ static oconfig_item_t *cf_read_generic(const char *path, const char *pattern,
       return NULL;
     }
 
-    cf_ci_append_children(root, temp);
+    cf_ci_append_children(root, &root_alloc, temp);
     sfree(temp->children);
     sfree(temp);
   }
@@ -1039,7 +1125,15 @@ int cf_read(const char *filename) {
     }
   }
 
-  oconfig_free(conf);
+  /* Kept to find the changes when the configuration is reloaded. The file
+   * name is made absolute, because the working directory changes to
+   * "BaseDir". */
+  oconfig_free(cf_running);
+  cf_running = conf;
+  sfree(cf_running_file);
+  cf_running_file = realpath(filename, /* resolved_path = */ NULL);
+  if (cf_running_file == NULL)
+    cf_running_file = strdup(filename);
 
   /* Read the default types.db if no `TypesDB' option was given. */
   if (cf_default_typesdb) {
@@ -1051,6 +1145,349 @@ int cf_read(const char *filename) {
 
 } /* int cf_read */
 
+/*
+ * Reloading the configuration
+ */
+typedef bool (*cf_item_match_t)(oconfig_item_t const *ci, char const *plugin);
+
+/* Returns the name of the plugin a top-level `LoadPlugin' or `Plugin' item
+ * belongs to, or NULL for other items. */
+static char const *cf_item_plugin(oconfig_item_t const *ci) /* {{{ */
+{
+  if ((strcasecmp("LoadPlugin", ci->key) != 0) &&
+      (strcasecmp("Plugin", ci->key) != 0))
+    return NULL;
+  if ((ci->values_num < 1) || (ci->values[0].type != OCONFIG_TYPE_STRING))
+    return NULL;
+
+  char const *name = ci->values[0].value.string;
+  return (strcmp("libvirt", name) == 0) ? "virt" : name;
+} /* }}} char const *cf_item_plugin */
+
+static bool cf_match_plugin(oconfig_item_t const *ci, /* {{{ */
+                            char const *plugin) {
+  char const *name = cf_item_plugin(ci);
+  return (name != NULL) && (strcasecmp(name, plugin) == 0);
+} /* }}} bool cf_match_plugin */
+
+static bool cf_match_chain(oconfig_item_t const *ci, /* {{{ */
+                           char const __attribute__((unused)) * plugin) {
+  return strcasecmp("Chain", ci->key) == 0;
+} /* }}} bool cf_match_chain */
+
+static bool cf_match_global(oconfig_item_t const *ci, /* {{{ */
+                            char const __attribute__((unused)) * plugin) {
+  return (cf_item_plugin(ci) == NULL) && !cf_match_chain(ci, NULL);
+} /* }}} bool cf_match_global */
+
+static bool cf_item_equal(oconfig_item_t const *a, /* {{{ */
+                          oconfig_item_t const *b) {
+  if ((strcasecmp(a->key, b->key) != 0) || (a->values_num != b->values_num) ||
+      (a->children_num != b->children_num))
+    return false;
+
+  for (int i = 0; i < a->values_num; i++) {
+    oconfig_value_t const *va = a->values + i;
+    oconfig_value_t const *vb = b->values + i;
+
+    if (va->type != vb->type)
+      return false;
+    if ((va->type == OCONFIG_TYPE_STRING) &&
+        (strcmp(va->value.string, vb->value.string) != 0))
+      return false;
+    if ((va->type == OCONFIG_TYPE_NUMBER) &&
+        (va->value.number != vb->value.number))
+      return false;
+    if ((va->type == OCONFIG_TYPE_BOOLEAN) &&
+        (va->value.boolean != vb->value.boolean))
+      return false;
+  }
+
+  for (int i = 0; i < a->children_num; i++)
+    if (!cf_item_equal(a->children + i, b->children + i))
+      return false;
+
+  return true;
+} /* }}} bool cf_item_equal */
+
+/* Returns true if the top-level items of "a" and "b" selected by "match" are
+ * the same and in the same order. */
+static bool cf_items_equal(oconfig_item_t const *a, /* {{{ */
+                           oconfig_item_t const *b, cf_item_match_t match,
+                           char const *plugin) {
+  int i = 0;
+  int j = 0;
+
+  while (42) {
+    while ((i < a->children_num) && !match(a->children + i, plugin))
+      i++;
+    while ((j < b->children_num) && !match(b->children + j, plugin))
+      j++;
+
+    if ((i >= a->children_num) || (j >= b->children_num))
+      return (i >= a->children_num) && (j >= b->children_num);
+
+    if (!cf_item_equal(a->children + i, b->children + j))
+      return false;
+    i++;
+    j++;
+  }
+} /* }}} bool cf_items_equal */
+
+/* Plugins embedding an interpreter can't be initialized twice, and the
+ * matches and targets of the filter chains are registered only once. */
+static bool cf_plugin_reloadable(char const *name) /* {{{ */
+{
+  if ((strcasecmp("java", name) == 0) || (strcasecmp("perl", name) == 0) ||
+      (strcasecmp("python", name) == 0))
+    return false;
+
+  return (strncasecmp("match_", name, strlen("match_")) != 0) &&
+         (strncasecmp("target_", name, strlen("target_")) != 0);
+} /* }}} bool cf_plugin_reloadable */
+
+/* Removes the config callbacks registered by the plugin "name". */
+static void cf_unregister_plugin(char const *name) /* {{{ */
+{
+  for (cf_callback_t **prev = &first_callback; *prev != NULL;) {
+    cf_callback_t *this = *prev;
+    if ((this->ctx.name == NULL) || (strcasecmp(this->ctx.name, name) != 0)) {
+      prev = &this->next;
+      continue;
+    }
+
+    *prev = this->next;
+    free(this);
+  }
+
+  for (cf_complex_callback_t **prev = &complex_callback_head; *prev != NULL;) {
+    cf_complex_callback_t *this = *prev;
+    if ((this->ctx.name == NULL) || (strcasecmp(this->ctx.name, name) != 0)) {
+      prev = &this->next;
+      continue;
+    }
+
+    *prev = this->next;
+    sfree(this->type);
+    sfree(this);
+  }
+} /* }}} void cf_unregister_plugin */
+
+typedef struct {
+  char const *name;
+  /* The configuration has changed and the plugin is loaded again. */
+  bool reload;
+  /* The configuration has changed, but the plugin can't be reloaded. */
+  bool keep;
+} cf_reload_plugin_t;
+
+typedef struct {
+  cf_reload_plugin_t *plugins;
+  size_t plugins_num;
+  /* The chains couldn't be configured, the old ones are still in use. */
+  bool keep_chains;
+} cf_reload_t;
+
+static cf_reload_plugin_t *cf_reload_plugin_get(cf_reload_t *r, /* {{{ */
+                                                char const *name) {
+  for (size_t i = 0; i < r->plugins_num; i++)
+    if (strcasecmp(r->plugins[i].name, name) == 0)
+      return r->plugins + i;
+  return NULL;
+} /* }}} cf_reload_plugin_t *cf_reload_plugin_get */
+
+/* Adds the plugins configured in "root" to "r". */
+static int cf_reload_add_plugins(cf_reload_t *r, /* {{{ */
+                                 oconfig_item_t const *root) {
+  for (int i = 0; i < root->children_num; i++) {
+    char const *name = cf_item_plugin(root->children + i);
+    if ((name == NULL) || (cf_reload_plugin_get(r, name) != NULL))
+      continue;
+
+    cf_reload_plugin_t *tmp =
+        realloc(r->plugins, (r->plugins_num + 1) * sizeof(*r->plugins));
+    if (tmp == NULL) {
+      ERROR("configfile: realloc failed.");
+      return ENOMEM;
+    }
+    r->plugins = tmp;
+    r->plugins[r->plugins_num] = (cf_reload_plugin_t){.name = name};
+    r->plugins_num++;
+  }
+
+  return 0;
+} /* }}} int cf_reload_add_plugins */
+
+/* Returns true if "ci" of the old configuration is still in effect after the
+ * reload. Global options are only applied by a restart. */
+static bool cf_reload_keep_item(cf_reload_t *r, /* {{{ */
+                                oconfig_item_t const *ci) {
+  char const *name = cf_item_plugin(ci);
+  if (name != NULL) {
+    cf_reload_plugin_t *p = cf_reload_plugin_get(r, name);
+    return (p != NULL) && p->keep;
+  }
+
+  if (cf_match_chain(ci, NULL))
+    return r->keep_chains;
+
+  return true;
+} /* }}} bool cf_reload_keep_item */
+
+/* Returns the configuration that is in effect after the reload: the items of
+ * "new" that have been applied and the items of "old" that are kept. */
+static oconfig_item_t *cf_reload_merge(cf_reload_t *r, /* {{{ */
+                                       oconfig_item_t const *old,
+                                       oconfig_item_t const *new) {
+  oconfig_item_t *root = calloc(1, sizeof(*root));
+  if (root == NULL)
+    return NULL;
+  int root_alloc = 0;
+
+  for (int i = 0; i < new->children_num + old->children_num; i++) {
+    bool from_old = (i >= new->children_num);
+    oconfig_item_t const *ci =
+        from_old ? old->children + (i - new->children_num) : new->children + i;
+    if (cf_reload_keep_item(r, ci) != from_old)
+      continue;
+
+    oconfig_item_t *copy = oconfig_clone(ci);
+    oconfig_item_t parent = {.children = copy, .children_num = 1};
+    if ((copy == NULL) ||
+        (cf_ci_append_children(root, &root_alloc, &parent) != 0)) {
+      oconfig_free(copy);
+      oconfig_free(root);
+      return NULL;
+    }
+    /* The children array has been copied, only the item itself is freed. */
+    sfree(copy);
+  }
+
+  return root;
+} /* }}} oconfig_item_t *cf_reload_merge */
+
+int cf_reload(void) {
+  if (cf_running == NULL) {
+    ERROR("configfile: There is no configuration to reload.");
+    return -1;
+  }
+
+  INFO("configfile: Reloading the configuration from %s.", cf_running_file);
+
+  oconfig_item_t *conf =
+      cf_read_generic(cf_running_file, /* pattern = */ NULL, /* depth = */ 0);
+  if ((conf == NULL) || (conf->children_num == 0)) {
+    ERROR("configfile: Unable to read config file %s. Keeping the current "
+          "configuration.",
+          cf_running_file);
+    oconfig_free(conf);
+    return -1;
+  }
+
+  cf_reload_t r = {0};
+  if ((cf_reload_add_plugins(&r, conf) != 0) ||
+      (cf_reload_add_plugins(&r, cf_running) != 0)) {
+    sfree(r.plugins);
+    oconfig_free(conf);
+    return -1;
+  }
+
+  if (!cf_items_equal(cf_running, conf, cf_match_global, NULL))
+    WARNING("configfile: Global options have changed. They take effect when "
+            "the daemon is restarted.");
+
+  size_t reload_num = 0;
+  for (size_t i = 0; i < r.plugins_num; i++) {
+    cf_reload_plugin_t *p = r.plugins + i;
+
+    if (cf_items_equal(cf_running, conf, cf_match_plugin, p->name))
+      continue;
+
+    /* Plugins that aren't loaded yet can always be loaded. */
+    if (plugin_is_loaded(p->name) && !cf_plugin_reloadable(p->name)) {
+      WARNING("configfile: The configuration of the `%s' plugin has changed, "
+              "but the plugin can't be reloaded. The change takes effect when "
+              "the daemon is restarted.",
+              p->name);
+      p->keep = true;
+      continue;
+    }
+
+    p->reload = true;
+    reload_num++;
+  }
+
+  bool chains_changed = !cf_items_equal(cf_running, conf, cf_match_chain, NULL);
+  int ret = 0;
+
+  if ((reload_num > 0) || chains_changed) {
+    plugin_reload_begin();
+
+    for (size_t i = 0; i < r.plugins_num; i++) {
+      if (!r.plugins[i].reload)
+        continue;
+
+      if (!plugin_is_loaded(r.plugins[i].name))
+        continue;
+
+      INFO("configfile: Reloading the `%s' plugin.", r.plugins[i].name);
+      /* The plugin keeps running with its old configuration. */
+      if (plugin_unload(r.plugins[i].name) != 0) {
+        r.plugins[i].reload = false;
+        r.plugins[i].keep = true;
+        reload_num--;
+        ret = -1;
+        continue;
+      }
+      /* The config callbacks point into the shared object. */
+      cf_unregister_plugin(r.plugins[i].name);
+    }
+
+    for (int i = 0; i < conf->children_num; i++) {
+      oconfig_item_t *ci = conf->children + i;
+      char const *name = cf_item_plugin(ci);
+      if ((name == NULL) || !cf_reload_plugin_get(&r, name)->reload)
+        continue;
+
+      int status = (strcasecmp("LoadPlugin", ci->key) == 0)
+                       ? dispatch_loadplugin(ci)
+                       : dispatch_block_plugin(ci);
+      if (status != 0)
+        ret = -1;
+    }
+
+    if (chains_changed && (fc_reconfigure(conf) != 0)) {
+      r.keep_chains = true;
+      ret = -1;
+    }
+
+    /* "r.plugins" is in the order of the new configuration. */
+    for (size_t i = 0; i < r.plugins_num; i++) {
+      if (r.plugins[i].reload && plugin_is_loaded(r.plugins[i].name) &&
+          (plugin_init_plugin(r.plugins[i].name) != 0))
+        ret = -1;
+    }
+
+    plugin_reload_end();
+  }
+
+  oconfig_item_t *running = cf_reload_merge(&r, cf_running, conf);
+  if (running == NULL) {
+    ERROR("configfile: Merging the configurations failed.");
+    running = conf;
+    conf = NULL;
+  }
+  sfree(r.plugins);
+  oconfig_free(conf);
+  oconfig_free(cf_running);
+  cf_running = running;
+
+  INFO("configfile: Reloaded %" PRIsz " plugin%s%s.", reload_num,
+       (reload_num == 1) ? "" : "s",
+       (chains_changed && !r.keep_chains) ? " and the chains" : "");
+  return ret;
+} /* int cf_reload */
+
 /* Assures the config option is a string, duplicates it and returns the copy in
  * "ret_string". If necessary "*ret_string" is freed first. Returns zero upon
  * success. */
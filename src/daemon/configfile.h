@@ -89,6 +89,20 @@ int cf_register_complex(const char *type, int (*callback)(oconfig_item_t *));
  */
 int cf_read(const char *filename);
 
+/*
+ * DESCRIPTION
+ *  Reads the config file passed to `cf_read' again and applies the changes:
+ *  Plugins whose `LoadPlugin' or `Plugin' blocks have changed are unloaded and
+ *  loaded again, and the filter chains are rebuilt if they have changed.
+ *  Unchanged plugins and the value cache are not touched. Changes to global
+ *  options are reported, but only take effect after a restart.
+ *  Must be called by the main thread.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success and non-zero otherwise.
+ */
+int cf_reload(void);
+
 int global_option_set(const char *option, const char *value, bool from_cli);
 const char *global_option_get(const char *option);
 long global_option_get_long(const char *option, long default_value);
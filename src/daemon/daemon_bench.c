@@ -0,0 +1,330 @@
+/**
+ * collectd - src/daemon/daemon_bench.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "benchmark.h"
+#include "configfile.h"
+#include "filter_chain.h"
+#include "plugin.h"
+#include "utils/common/common.h"
+#include "utils_cache.h"
+
+#include <regex.h>
+
+static data_source_t bench_dsrc[] = {{"value", DS_TYPE_DERIVE, 0.0, NAN}};
+static data_set_t bench_ds = {"bench", 1, bench_dsrc};
+
+/* Strictly increasing time, so that the cache never rejects a value as too
+ * old, no matter which series is updated. */
+static cdtime_t bench_time = TIME_T_TO_CDTIME_T_STATIC(1577836800);
+
+/* The names of "num" series, stored as type instances. Using a compact
+ * array instead of formatting names in the timed loop keeps the 1M series
+ * case cheap and focused on the function being measured. */
+typedef char series_name_t[24];
+
+static series_name_t *create_names(size_t num) {
+  series_name_t *names = calloc(num, sizeof(*names));
+  if (names == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < num; i++)
+    snprintf(names[i], sizeof(names[i]), "%zu", i);
+  return names;
+}
+
+static void init_value_list(value_list_t *vl, value_t *v, char const *host) {
+  *vl = (value_list_t){
+      .values = v,
+      .values_len = 1,
+      .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+      .plugin = "bench",
+      .type = "bench",
+  };
+  sstrncpy(vl->host, host, sizeof(vl->host));
+}
+
+/*
+ * uc_update
+ */
+DEF_BENCH(uc_update) {
+  series_name_t *names = create_names(b->size);
+  if (names == NULL)
+    return -1;
+
+  /* Each size uses its own set of series. Later runs with the same size
+   * update the entries created by the first run. */
+  char host[DATA_MAX_NAME_LEN];
+  snprintf(host, sizeof(host), "uc_update-%zu", b->size);
+
+  value_t v = {.derive = 0};
+  value_list_t vl;
+  init_value_list(&vl, &v, host);
+
+  int status = 0;
+
+  BENCH_STOP_TIMER(b);
+  for (size_t i = 0; i < b->size; i++) {
+    sstrncpy(vl.type_instance, names[i], sizeof(vl.type_instance));
+    vl.time = bench_time++;
+    status |= uc_update(&bench_ds, &vl);
+  }
+  BENCH_RESET_TIMER(b);
+
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    sstrncpy(vl.type_instance, names[i % b->size], sizeof(vl.type_instance));
+    vl.time = bench_time++;
+    v.derive++;
+    status |= uc_update(&bench_ds, &vl);
+  }
+  BENCH_STOP_TIMER(b);
+
+  free(names);
+  return status;
+}
+
+/*
+ * plugin_dispatch_values
+ */
+static pthread_mutex_t written_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t written_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t written;
+
+static int bench_init(void) { return 0; }
+
+static int bench_write(__attribute__((unused)) data_set_t const *ds,
+                       __attribute__((unused)) value_list_t const *vl,
+                       __attribute__((unused)) user_data_t *ud) {
+  pthread_mutex_lock(&written_lock);
+  written++;
+  pthread_cond_broadcast(&written_cond);
+  pthread_mutex_unlock(&written_lock);
+  return 0;
+}
+
+/* Dispatches values and waits until the write callback has seen all of them,
+ * i.e. measures the throughput of the whole pipeline: cache update, filter
+ * chain, write queue and write threads. */
+DEF_BENCH(plugin_dispatch_values) {
+  series_name_t *names = create_names(b->size);
+  if (names == NULL)
+    return -1;
+
+  char host[DATA_MAX_NAME_LEN];
+  snprintf(host, sizeof(host), "plugin_dispatch_values-%zu", b->size);
+
+  value_t v = {.derive = 0};
+  value_list_t vl;
+  init_value_list(&vl, &v, host);
+
+  pthread_mutex_lock(&written_lock);
+  uint64_t want = written + b->iterations;
+  pthread_mutex_unlock(&written_lock);
+
+  int status = 0;
+
+  BENCH_RESET_TIMER(b);
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    sstrncpy(vl.type_instance, names[i % b->size], sizeof(vl.type_instance));
+    vl.time = bench_time++;
+    v.derive++;
+    status |= plugin_dispatch_values(&vl);
+  }
+
+  pthread_mutex_lock(&written_lock);
+  while ((status == 0) && (written < want))
+    pthread_cond_wait(&written_cond, &written_lock);
+  pthread_mutex_unlock(&written_lock);
+  BENCH_STOP_TIMER(b);
+
+  free(names);
+  return status;
+}
+
+/*
+ * fc_process_chain
+ */
+static int bench_match_create(oconfig_item_t const *ci, void **user_data) {
+  regex_t *re = calloc(1, sizeof(*re));
+  if (re == NULL)
+    return ENOMEM;
+
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+    if ((strcasecmp("Plugin", child->key) != 0) || (child->values_num != 1))
+      continue;
+
+    if (regcomp(re, child->values[0].value.string, REG_EXTENDED | REG_NOSUB) !=
+        0) {
+      free(re);
+      return EINVAL;
+    }
+    *user_data = re;
+    return 0;
+  }
+
+  free(re);
+  return EINVAL;
+}
+
+static int bench_match_destroy(void **user_data) {
+  if (*user_data != NULL) {
+    regfree(*user_data);
+    sfree(*user_data);
+  }
+  return 0;
+}
+
+static int bench_match(__attribute__((unused)) data_set_t const *ds,
+                       value_list_t const *vl,
+                       __attribute__((unused)) notification_meta_t **meta,
+                       void **user_data) {
+  if (regexec(*user_data, vl->plugin, 0, NULL, 0) == 0)
+    return FC_MATCH_MATCHES;
+  return FC_MATCH_NO_MATCH;
+}
+
+/* Appends a child with an optional string argument to "parent". */
+static oconfig_item_t *ci_append(oconfig_item_t *parent, char const *key,
+                                 char const *value) {
+  oconfig_item_t *tmp =
+      realloc(parent->children,
+              (parent->children_num + 1) * sizeof(*parent->children));
+  if (tmp == NULL)
+    return NULL;
+  parent->children = tmp;
+
+  oconfig_item_t *ci = parent->children + parent->children_num;
+  parent->children_num++;
+  *ci = (oconfig_item_t){.key = strdup(key), .parent = parent};
+
+  if (value != NULL) {
+    ci->values = calloc(1, sizeof(*ci->values));
+    if (ci->values == NULL)
+      return NULL;
+    ci->values[0].type = OCONFIG_TYPE_STRING;
+    ci->values[0].value.string = strdup(value);
+    ci->values_num = 1;
+  }
+
+  return ci;
+}
+
+/* Creates a chain of "rules_num" rules, each matching one plugin name with a
+ * regular expression, like the typical "match_regex" setups. */
+static fc_chain_t *create_chain(size_t rules_num) {
+  char name[DATA_MAX_NAME_LEN];
+  snprintf(name, sizeof(name), "bench_%zu", rules_num);
+
+  fc_chain_t *chain = fc_chain_get_by_name(name);
+  if (chain != NULL)
+    return chain;
+
+  oconfig_item_t *ci = calloc(1, sizeof(*ci));
+  if (ci == NULL)
+    return NULL;
+  ci->key = strdup("Chain");
+  ci->values = calloc(1, sizeof(*ci->values));
+  ci->values[0].type = OCONFIG_TYPE_STRING;
+  ci->values[0].value.string = strdup(name);
+  ci->values_num = 1;
+
+  for (size_t i = 0; i < rules_num; i++) {
+    char regex[DATA_MAX_NAME_LEN];
+    snprintf(regex, sizeof(regex), "^plugin%zu$", i);
+
+    /* Children are stored in a contiguous array and may move while appending
+     * siblings, so the rule is looked up again after each append. */
+    ci_append(ci, "Rule", NULL);
+    ci_append(ci->children + i, "Match", "bench_regex");
+    ci_append(ci->children + i, "Target", "return");
+    ci_append(ci->children[i].children + 0, "Plugin", regex);
+  }
+
+  int status = fc_configure(ci);
+  oconfig_free(ci);
+  if (status != 0)
+    return NULL;
+
+  return fc_chain_get_by_name(name);
+}
+
+/* Processes a value that matches no rule, so that every rule is evaluated. */
+DEF_BENCH(fc_process_chain) {
+  fc_chain_t *chain = create_chain(b->size);
+  if (chain == NULL)
+    return -1;
+
+  value_t v = {.derive = 42};
+  value_list_t vl;
+  init_value_list(&vl, &v, "fc_process_chain");
+  sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
+
+  int status = 0;
+
+  BENCH_RESET_TIMER(b);
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    if (fc_process_chain(&bench_ds, &vl, chain) != FC_TARGET_CONTINUE)
+      status = -1;
+  }
+  BENCH_STOP_TIMER(b);
+
+  return status;
+}
+
+int main(void) {
+  plugin_init_ctx();
+  plugin_register_data_set(&bench_ds);
+  fc_register_match("bench_regex", (match_proc_t){
+                                       .create = bench_match_create,
+                                       .destroy = bench_match_destroy,
+                                       .match = bench_match,
+                                   });
+  plugin_register_write("bench", bench_write, /* user_data = */ NULL);
+  /* Keep the values of one series in order, so that the cache doesn't reject
+   * them when write threads race each other. */
+  global_option_set("WriteQueueSharding", "true", /* from_cli = */ false);
+  /* plugin_init_all() only starts the write threads if there are callbacks. */
+  plugin_register_init("bench", bench_init);
+  if (plugin_init_all() != 0)
+    return 1;
+
+  size_t series[] = {1000, 100000, 1000000};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(series); i++)
+    RUN_BENCH(uc_update, series[i]);
+
+  size_t dispatch_series[] = {1000, 100000};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(dispatch_series); i++)
+    RUN_BENCH(plugin_dispatch_values, dispatch_series[i]);
+
+  size_t rules[] = {1, 10, 50};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(rules); i++)
+    RUN_BENCH(fc_process_chain, rules[i]);
+
+  plugin_shutdown_all();
+  END_BENCH;
+}
@@ -31,6 +31,7 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils_complain.h"
+#include "utils_probe.h"
 
 /*
  * Data types
@@ -497,7 +498,9 @@ static int fc_config_add_chain(const oconfig_item_t *ci) /* {{{ */
   } /* for (ci->children) */
 
   if (status != 0) {
-    fc_free_chains(chain);
+    /* A chain that is already in the list is kept. */
+    if (new_chain)
+      fc_free_chains(chain);
     return -1;
   }
 
@@ -855,14 +858,11 @@ fc_chain_t *fc_chain_get_by_name(const char *chain_name) /* {{{ */
   return NULL;
 } /* }}} int fc_chain_get_by_name */
 
-int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
-                     fc_chain_t *chain) {
+static int fc_process_chain_internal(const data_set_t *ds, /* {{{ */
+                                     value_list_t *vl, fc_chain_t *chain) {
   fc_target_t *target;
   int status = FC_TARGET_CONTINUE;
 
-  if (chain == NULL)
-    return -1;
-
   DEBUG("fc_process_chain (chain = %s);", chain->name);
 
   for (fc_rule_t *rule = chain->rules; rule != NULL; rule = rule->next) {
@@ -973,6 +973,18 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
         chain->name);
 
   return FC_TARGET_CONTINUE;
+} /* }}} int fc_process_chain_internal */
+
+int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
+                     fc_chain_t *chain) {
+  if (chain == NULL)
+    return -1;
+
+  PROBE1(chain__start, chain->name);
+  int status = fc_process_chain_internal(ds, vl, chain);
+  PROBE2(chain__done, chain->name, status);
+
+  return status;
 } /* }}} int fc_process_chain */
 
 /* Iterate over all rules in the chain and execute all targets for which all
@@ -997,3 +1009,35 @@ int fc_configure(const oconfig_item_t *ci) /* {{{ */
 
   return -1;
 } /* }}} int fc_configure */
+
+int fc_reconfigure(const oconfig_item_t *root) /* {{{ */
+{
+  fc_chain_t *old_chains = chain_list_head;
+  chain_list_head = NULL;
+
+  for (int i = 0; i < root->children_num; i++) {
+    oconfig_item_t const *ci = root->children + i;
+
+    if (strcasecmp("Chain", ci->key) != 0)
+      continue;
+
+    if (fc_configure(ci) != 0) {
+      ERROR("Filter subsystem: Configuring the chains failed. "
+            "Keeping the current chains.");
+      fc_free_chains(chain_list_head);
+      chain_list_head = old_chains;
+      return -1;
+    }
+  }
+
+  fc_free_chains(old_chains);
+  return 0;
+} /* }}} int fc_reconfigure */
+
+void fc_shutdown(void) /* {{{ */
+{
+  fc_chain_t *chains = chain_list_head;
+
+  chain_list_head = NULL;
+  fc_free_chains(chains);
+} /* }}} void fc_shutdown */
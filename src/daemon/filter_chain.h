@@ -100,4 +100,13 @@ int fc_default_action(const data_set_t *ds, value_list_t *vl);
  */
 int fc_configure(const oconfig_item_t *ci);
 
+/* Replaces all chains with the <Chain> blocks among the children of "root".
+ * If one of them is invalid, the current chains are kept. No chain may be
+ * processed while this is running. */
+int fc_reconfigure(const oconfig_item_t *root);
+
+/* Frees all chains, so that targets can write out the state they kept. No
+ * chain may be processed while this is running or afterwards. */
+void fc_shutdown(void);
+
 #endif /* FILTER_CHAIN_H */
@@ -36,10 +36,15 @@
 #include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils/heap/heap.h"
+#include "utils_affinity.h"
 #include "utils_cache.h"
+#include "utils/latency/latency.h"
 #include "utils_complain.h"
 #include "utils_llist.h"
+#include "utils_pool.h"
+#include "utils_probe.h"
 #include "utils_random.h"
+#include "utils_spill.h"
 #include "utils_time.h"
 
 #ifdef WIN32
@@ -63,6 +68,14 @@ struct callback_func_s {
   void *cf_callback;
   user_data_t cf_udata;
   plugin_ctx_t cf_ctx;
+  /* Set for write callbacks of type `plugin_write_batch_cb'. */
+  bool cf_batch;
+  /* Set for write callbacks with a queue of their own, see write_sink_t. */
+  struct write_sink_s *cf_sink;
+  /* Time spent in the callback since the last time the internal statistics
+   * were collected. Only allocated if "CollectInternalStats" is enabled. */
+  latency_counter_t *cf_latency;
+  pthread_mutex_t cf_latency_lock;
 };
 typedef struct callback_func_s callback_func_t;
 
@@ -82,9 +95,94 @@ struct read_func_s {
   cdtime_t rf_interval;
   cdtime_t rf_effective_interval;
   cdtime_t rf_next_read;
+  /* Largest delay between rf_next_read and the actual start of the callback
+   * since the last time the internal statistics were collected. */
+  cdtime_t rf_lateness_max;
+  /* CPUs to run the callback on, see plugin_set_read_cpus(). */
+  core_group_t *rf_cpus;
+  /* Number of times the callback ran longer than its "ReadTimeout". */
+  uint64_t rf_overruns;
+  /* Current interval if "AdaptiveInterval" is enabled, zero otherwise, and
+   * the largest volatility of the values dispatched during the current call,
+   * NAN if none had enough history yet. */
+  cdtime_t rf_adaptive_interval;
+  double rf_volatility;
 };
 typedef struct read_func_s read_func_t;
 
+/* Each read thread has a queue of its own, so the read threads don't all wait
+ * on one condition variable. A thread without due read functions takes due
+ * read functions from the other queues, which keeps slow callbacks from
+ * delaying the rest of their queue. */
+typedef struct {
+  c_heap_t *heap;
+  size_t num; /* number of read functions in "heap" */
+  /* When the root of "heap" is due, zero if it is empty. Written with "lock"
+   * held; the other threads of the pool read it without taking the lock to
+   * decide when to look for due read functions, see read_queue_take(). */
+  cdtime_t next_read;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  /* CPUs the thread is pinned to, or NULL. See "ReadThreadsCPUs". */
+  core_group_t const *cpus;
+  struct read_pool_s *pool;
+} read_queue_t;
+
+/* A set of read threads for the read functions of some plugins and read
+ * groups, see <ReadThreadPool>. The threads of a pool only steal from the
+ * pool's own queues, so that slow callbacks can't hold up the read functions
+ * of other pools. All other read functions go to "read_pool_default", which
+ * has "ReadThreads" threads. */
+typedef struct read_pool_s {
+  char *name;
+  size_t threads_num;
+  char **plugins;
+  size_t plugins_num;
+  char **groups;
+  size_t groups_num;
+
+  /* The pool's entries of "read_queues". Only set while the read threads are
+   * running. */
+  read_queue_t *queues;
+  size_t queues_num;
+  size_t queues_next;
+} read_pool_t;
+
+struct read_orphans_s;
+
+/* A read thread. The watchdog thread replaces read threads whose callback
+ * exceeds its "ReadTimeout": a new thread takes over the queue and the old
+ * thread exits once the callback returns. Callbacks are never cancelled. All
+ * members are protected by "read_threads_lock". */
+typedef struct {
+  pthread_t thread;
+  read_queue_t *queue;
+  bool used;
+  /* The callback being called, when it was called, when it times out (zero
+   * if it doesn't) and whether it has exceeded its timeout. */
+  read_func_t *rf;
+  cdtime_t started;
+  cdtime_t deadline;
+  bool overrun;
+  /* Set when a replacement thread has taken over "queue". */
+  bool abandoned;
+  /* Set by stop_read_threads() for threads stuck in a callback; they are not
+   * joined. See read_thread_orphan_end(). */
+  bool detached;
+  bool exited;
+  struct read_orphans_s *orphans;
+} read_thread_t;
+
+/* A "read_threads" array left behind by stop_read_threads() because some of
+ * its threads were detached. It is freed once the last of them has returned
+ * from its callback. Protected by "read_threads_lock". */
+typedef struct read_orphans_s {
+  read_thread_t *threads;
+  size_t threads_num;
+  size_t running;
+  struct read_orphans_s *next;
+} read_orphans_t;
+
 struct cache_event_func_s {
   plugin_cache_event_cb callback;
   char *name;
@@ -93,13 +191,132 @@ struct cache_event_func_s {
 };
 typedef struct cache_event_func_s cache_event_func_t;
 
+/* Size, in units of value_t, of the buffer inside a write queue node for the
+ * values and the identifier. Value lists that don't fit need a separate
+ * allocation. */
+#define WRITE_QUEUE_DATA_INLINE 16
+
 struct write_queue_s;
 typedef struct write_queue_s write_queue_t;
+/* Value lists are stored packed in the write queues: the fields of the
+ * identifier follow each other, each terminated by a null byte, instead of
+ * taking DATA_MAX_NAME_LEN bytes each. A node is converted to a value_list_t
+ * by write_queue_unpack() right before it is dispatched or written. */
 struct write_queue_s {
-  value_list_t *vl;
   plugin_ctx_t ctx;
   write_queue_t *next;
+  /* Only set in the queues of write sinks. */
+  cdtime_t enqueued;
+
+  cdtime_t time;
+  cdtime_t interval;
+  meta_data_t *meta;
+  size_t values_len;
+  bool escaped;
+  /* Hash of the identifier, see uc_hash_vl(). */
+  uint32_t hash;
+
+  /* The values, followed by host, plugin, plugin instance, type and type
+   * instance. Points to "data" if they fit. */
+  value_t *values;
+  value_t data[WRITE_QUEUE_DATA_INLINE];
+};
+
+/* Number of write priority classes, see plugin.h. */
+#define WRITE_PRIORITY_NUM 3
+
+/* A write queue shard is a FIFO protected by its own lock. Without
+ * "WriteQueueSharding" there is exactly one shard that is shared by all write
+ * threads. With sharding enabled, each write thread owns one shard and value
+ * lists are assigned to a shard by hashing their identifier, so that the
+ * ordering of values within one series is retained.
+ *
+ * The list is sorted by priority class, highest first, and is a FIFO within
+ * each class. "tails" points to the last node of each class, so that a node
+ * is inserted without walking the list. */
+struct write_queue_shard_s {
+  write_queue_t *head;
+  write_queue_t *tail;
+  write_queue_t *tails[WRITE_PRIORITY_NUM];
+  /* Only changed with "lock" held, using write_queue_set_length(). Read
+   * without the lock using write_queue_get_length(). */
+  long length;
+  /* Set to make the threads waiting on the queue return. */
+  bool closed;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+typedef struct write_queue_shard_s write_queue_shard_t;
+
+/* Maximum number of value lists a write thread takes from its queue at once.
+ * This is also the maximum number of value lists passed to a batch write
+ * callback in one call. */
+#define WRITE_BATCH_MAX 64
+
+/* Bounds of the time a write sink waits before retrying to replay its spill
+ * after the write callback failed. */
+#define WRITE_SINK_BACKOFF_MIN TIME_T_TO_CDTIME_T(1)
+#define WRITE_SINK_BACKOFF_MAX TIME_T_TO_CDTIME_T(60)
+/* Default of "WriteQueueSpillLimit", in MiB. */
+#define WRITE_SINK_SPILL_LIMIT_DEFAULT 1024
+
+/* Value lists collected by a write thread for one batch write callback. */
+struct write_batch_s {
+  callback_func_t *cf;
+  char const *name;
+  data_set_t const *ds[WRITE_BATCH_MAX];
+  value_list_t const *vl[WRITE_BATCH_MAX];
+  size_t num;
+};
+typedef struct write_batch_s write_batch_t;
+
+struct write_thread_s {
+  write_queue_shard_t *queue;
+  write_batch_t *batches;
+  size_t batches_num;
+  /* When the thread took the value lists it is working on (zero while it
+   * waits for the queue) and the name of the write callback it is calling
+   * (NULL if none). Only used by plugin_get_stats() and accessed atomically,
+   * so that the write path doesn't need a lock. */
+  cdtime_t busy_since;
+  char const *busy_callback;
+};
+typedef struct write_thread_s write_thread_t;
+
+/* A write callback registered with the "WriteQueue" option has a queue and a
+ * thread of its own. The write threads only copy value lists to that queue,
+ * so that a slow write plugin only backs up its own queue instead of delaying
+ * all other write plugins. */
+struct write_sink_s {
+  write_queue_shard_t queue;
+  callback_func_t *cf;
+  char *name;
+  long limit_high;
+  long limit_low;
+  pthread_t thread;
+  bool thread_running;
+
+  /* Set with the "WriteQueueSpill" option. Value lists are written to the
+   * spill instead of being dropped, see write_sink_enqueue(). */
+  spill_t *spill;
+  /* Time to wait before retrying a failed replay. Only used by the thread. */
+  cdtime_t replay_backoff;
+
+  /* The following members are protected by "queue.lock". */
+  derive_t dropped;
+  c_complain_t drop_complaint;
+  /* Largest delay between enqueueing a value list and the callback returning
+   * since the last time the internal statistics were collected. */
+  cdtime_t latency_max;
+  /* Set while the spill holds value lists. New value lists are appended to
+   * the spill, too, so that they are written after the older ones. */
+  bool spill_pending;
+  derive_t spilled;
+  derive_t replayed;
+
+  struct write_sink_s *next;
 };
+typedef struct write_sink_s write_sink_t;
 
 struct flush_callback_s {
   char *name;
@@ -110,6 +327,7 @@ typedef struct flush_callback_s flush_callback_t;
 /*
  * Private variables
  */
+/* Names of the loaded plugins, mapped to the handles returned by dlopen(). */
 static c_avl_tree_t *plugins_loaded;
 
 static llist_t *list_init;
@@ -128,28 +346,204 @@ static fc_chain_t *post_cache_chain;
 
 static c_avl_tree_t *data_sets;
 
+/* Hash index over "data_sets". plugin_get_ds() is called for every value list
+ * that is dispatched, so it should not have to walk the tree. */
+typedef struct data_set_entry_s {
+  data_set_t *ds;
+  uint32_t hash;
+  struct data_set_entry_s *next;
+} data_set_entry_t;
+static data_set_entry_t **data_sets_index;
+static size_t data_sets_index_size; /* power of two */
+static size_t data_sets_num;
+
+/* Data sets that have been replaced or unregistered. Plugins and value lists
+ * may still point to them, see "vl->ds", so they are only freed on shutdown.
+ * Their type is cleared, so that these pointers are not used anymore. */
+static data_set_t **data_sets_retired;
+static size_t data_sets_retired_num;
+
 static char *plugindir;
+static c_avl_tree_t *plugindir_index;
 
 #ifndef DEFAULT_MAX_READ_INTERVAL
 #define DEFAULT_MAX_READ_INTERVAL TIME_T_TO_CDTIME_T_STATIC(86400)
 #endif
 static c_heap_t *read_heap;
+/* Indexed by name, so that registering many read functions, e.g. one per host
+ * of the SNMP plugin, does not take quadratic time. */
 static llist_t *read_list;
 static int read_loop = 1;
 static pthread_mutex_t read_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t read_cond = PTHREAD_COND_INITIALIZER;
-static pthread_t *read_threads;
+/* "read_threads" has room for "read_threads_max" threads, including the
+ * replacements started by the watchdog; see "ReadThreadsMax". The first
+ * "read_threads_num" entries have been used. */
+static read_thread_t *read_threads;
 static size_t read_threads_num;
+static size_t read_threads_max;
+/* Number of read threads to start, zero if read callbacks are called by the
+ * main thread ("-T"). */
+static size_t read_threads_config_num;
+static size_t read_threads_config_max;
+static pthread_mutex_t read_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static read_orphans_t *read_orphans;
+/* Set by plugin_shutdown_all(). Detached threads no longer touch their read
+ * function once it is set. */
+static bool read_threads_shutdown;
+static pthread_cond_t read_watchdog_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t read_watchdog;
+static bool read_watchdog_running;
+/* Default for the "ReadTimeout" option of <LoadPlugin>. Zero disables it. */
+static cdtime_t read_timeout;
+/* Only set while the read threads are running. Before, read functions are
+ * kept in "read_heap". */
+static read_queue_t *read_queues;
+static size_t read_queues_num;
+static read_pool_t read_pool_default = {.name = "default"};
+static read_pool_t *read_pools;
+static size_t read_pools_num;
 static cdtime_t max_read_interval = DEFAULT_MAX_READ_INTERVAL;
-
-static write_queue_t *write_queue_head;
-static write_queue_t *write_queue_tail;
-static long write_queue_length;
+/* If set, read functions are called at multiples of their interval, so that
+ * all read functions with the same interval run together. See "AlignRead". */
+static bool align_read;
+/* If set, read functions are called at a fixed offset within their interval,
+ * derived from their name. See "SpreadRead". */
+static bool spread_read;
+/* If set, value lists dispatched by a read function without a time get the
+ * time the read function was called. See "SharedReadTimestamp". */
+static bool shared_read_timestamp;
+/* CPUs the read and write threads are pinned to, see "ReadThreadsCPUs" and
+ * "WriteThreadsCPUs". Thread i uses group i modulo the number of groups. */
+static core_groups_list_t read_threads_cpus;
+static core_groups_list_t write_threads_cpus;
+
+/* Checkpointing of the value cache, see "CacheFile". */
+static cdtime_t cache_checkpoint_interval;
+static cdtime_t cache_checkpoint_next;
+
+static write_queue_shard_t write_queue_default = {
+    .head = NULL,
+    .tail = NULL,
+    .length = 0,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+static write_queue_shard_t *write_queues = &write_queue_default;
+static size_t write_queues_num = 1;
 static bool write_loop = true;
-static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t write_cond = PTHREAD_COND_INITIALIZER;
 static pthread_t *write_threads;
+static write_thread_t *write_threads_state;
+/* Held while the write threads are started and stopped, so that
+ * plugin_get_stats() can look at "write_threads" and "write_threads_state". */
+static pthread_mutex_t write_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t write_thread_key;
+static pool_t *write_queue_pool;
+
+/* Serialized forms of the value list that plugin_write() is currently passing
+ * to the write callbacks of this thread, see plugin_write_format_get(). */
+#define WRITE_FORMATS_MAX 4
+typedef struct {
+  char *key;
+  char *data;
+  size_t len;
+  size_t size;
+} write_format_t;
+typedef struct {
+  /* NULL outside of plugin_write(). */
+  value_list_t const *vl;
+  write_format_t formats[WRITE_FORMATS_MAX];
+  size_t formats_num;
+} write_formats_t;
+static pthread_key_t write_formats_key;
 static size_t write_threads_num;
+static size_t write_threads_config_num;
+static size_t write_sinks_started;
+static write_sink_t *write_sinks;
+static pthread_mutex_t write_sinks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Log messages are handed to the log callbacks by a separate thread if
+ * "LogQueueLength" is set. "log_queue" is a ring buffer of "log_queue_size"
+ * entries; "log_queue_head" and "log_queue_tail" only ever increase. */
+typedef struct {
+  int level;
+  char msg[1024];
+} log_entry_t;
+
+static log_entry_t *log_queue;
+static size_t log_queue_size;
+static uint64_t log_queue_head;
+static uint64_t log_queue_tail;
+static uint64_t log_queue_suppressed;
+static derive_t log_queue_dropped;
+static bool log_loop;
+static pthread_t log_thread;
+static pthread_mutex_t log_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_queue_cond = PTHREAD_COND_INITIALIZER;
+
+/* Notifications are handed to the notification callbacks by separate threads
+ * if "NotificationThreads" is set. */
+typedef struct notification_queue_s notification_queue_t;
+struct notification_queue_s {
+  notification_t n;
+  cdtime_t enqueued;
+  notification_queue_t *next;
+};
+
+static notification_queue_t *notif_queue_head;
+static notification_queue_t *notif_queue_tail;
+static size_t notif_queue_length;
+static size_t notif_queue_limit;
+static cdtime_t notif_coalesce_interval;
+static derive_t notif_queue_dropped;
+static derive_t notif_queue_coalesced;
+static bool notif_loop;
+static pthread_t *notif_threads;
+static size_t notif_threads_num;
+static pthread_mutex_t notif_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notif_queue_cond = PTHREAD_COND_INITIALIZER;
+
+/* Cache events are handed to the cache event callbacks by a separate thread,
+ * so that updating the cache only costs the writers a copy of the value list.
+ * Events are handled in the order they were queued. */
+typedef struct cache_event_queue_s cache_event_queue_t;
+struct cache_event_queue_s {
+  enum cache_event_type_e type;
+  unsigned long callbacks_mask;
+  value_list_t vl;
+  char name[6 * DATA_MAX_NAME_LEN];
+  cache_event_queue_t *next;
+};
+
+static cache_event_queue_t *cache_event_queue_head;
+static cache_event_queue_t *cache_event_queue_tail;
+static size_t cache_event_queue_length;
+/* Number of events queued and handled so far, used by
+ * plugin_wait_cache_events(). */
+static uint64_t cache_event_queued;
+static uint64_t cache_event_handled;
+static bool cache_event_loop;
+static bool cache_event_thread_running;
+static pthread_t cache_event_thread;
+static pthread_mutex_t cache_event_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_event_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t cache_event_handled_cond = PTHREAD_COND_INITIALIZER;
+
+/* A running call of a flush callback. Callers requesting the same flush while
+ * it is running wait for it instead of calling the callback again. "refs"
+ * counts the waiting callers plus one for the running callback. */
+typedef struct flush_job_s flush_job_t;
+struct flush_job_s {
+  callback_func_t *cf;
+  cdtime_t timeout;
+  char *identifier;
+  bool done;
+  size_t refs;
+  flush_job_t *next;
+};
+
+static flush_job_t *flush_jobs;
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
 
 static pthread_key_t plugin_ctx_key;
 static bool plugin_ctx_key_initialized;
@@ -157,14 +551,70 @@ static bool plugin_ctx_key_initialized;
 static long write_limit_high;
 static long write_limit_low;
 
+/* If set, the values of series over the series limits are folded into the
+ * overflow series instead of being dropped. See uc_set_series_limits(). */
+static bool series_limit_overflow;
+
 static pthread_mutex_t statistics_lock = PTHREAD_MUTEX_INITIALIZER;
 static derive_t stats_values_dropped;
+/* Number of value lists not written because they didn't change, see the
+ * "SuppressUnchanged" option. Updated atomically. */
+static uint64_t stats_values_suppressed;
 static bool record_statistics;
 
+/* Per-plugin counters of the dispatch and write paths, keyed by the name of
+ * the plugin context. Each thread counts into a table of its own, so that
+ * the counters can be updated without locks. Tables are never freed: when a
+ * thread exits, its table is handed to the next thread that needs one, so
+ * the counters keep growing monotonically. */
+typedef struct plugin_stats_s plugin_stats_t;
+struct plugin_stats_s {
+  char *name;
+  uint64_t dispatched;
+  uint64_t dropped;
+  uint64_t series_created;
+  uint64_t write_calls;
+  uint64_t write_errors;
+  uint64_t write_values;
+  plugin_stats_t *next;
+};
+
+typedef struct plugin_stats_table_s plugin_stats_table_t;
+struct plugin_stats_table_s {
+  /* Only the owning thread adds entries, see plugin_stats_get(). */
+  plugin_stats_t *head;
+  plugin_stats_t *last;
+  bool in_use;
+  plugin_stats_table_t *next;
+};
+
+static pthread_key_t plugin_stats_key;
+
+/* The read function with "AdaptiveInterval" that is being called by the
+ * current thread, if any. Value lists dispatched by it update its
+ * "rf_volatility". */
+static pthread_key_t read_adaptive_key;
+
+/* Number of cached rates, and largest number of data sources, of a value list
+ * that are used to determine its volatility. */
+#define READ_ADAPTIVE_HISTORY 5
+#define READ_ADAPTIVE_DS_MAX 16
+static pthread_mutex_t plugin_stats_tables_lock = PTHREAD_MUTEX_INITIALIZER;
+static plugin_stats_table_t *plugin_stats_tables;
+
 /*
  * Static functions
  */
 static int plugin_dispatch_values_internal(value_list_t *vl);
+static void plugin_log_callbacks(int level, char const *msg);
+static void plugin_notification_callbacks(notification_t const *n);
+static void plugin_cache_event_callbacks(enum cache_event_type_e event_type,
+                                         unsigned long callbacks_mask,
+                                         const char *name,
+                                         const value_list_t *vl);
+static void plugin_flush_wait_all(void);
+static int plugin_compare_read_func(const void *arg0, const void *arg1);
+static void write_sink_destroy(write_sink_t *ws);
 
 static const char *plugin_get_dir(void) {
   if (plugindir == NULL)
@@ -173,8 +623,427 @@ static const char *plugin_get_dir(void) {
     return plugindir;
 }
 
+/* Returns the start time to pass to callback_latency_add(), or zero if the
+ * internal statistics are disabled. */
+static cdtime_t callback_latency_start(void) /* {{{ */
+{
+  return record_statistics ? cdtime() : 0;
+} /* }}} cdtime_t callback_latency_start */
+
+static void callback_latency_record(callback_func_t *cf, /* {{{ */
+                                    cdtime_t latency) {
+  pthread_mutex_lock(&cf->cf_latency_lock);
+  if (cf->cf_latency == NULL)
+    cf->cf_latency = latency_counter_create();
+  if (cf->cf_latency != NULL)
+    latency_counter_add(cf->cf_latency, latency);
+  pthread_mutex_unlock(&cf->cf_latency_lock);
+} /* }}} void callback_latency_record */
+
+/* Records the time since "start" as time spent in the callback. */
+static void callback_latency_add(callback_func_t *cf, /* {{{ */
+                                 cdtime_t start) {
+  if (start == 0)
+    return;
+
+  callback_latency_record(cf, cdtime() - start);
+} /* }}} void callback_latency_add */
+
+static void plugin_stats_table_release(void *arg) /* {{{ */
+{
+  plugin_stats_table_t *t = arg;
+
+  pthread_mutex_lock(&plugin_stats_tables_lock);
+  t->in_use = false;
+  pthread_mutex_unlock(&plugin_stats_tables_lock);
+} /* }}} void plugin_stats_table_release */
+
+/* Returns the calling thread's table, taking over the table of a thread
+ * that has exited if possible. */
+static plugin_stats_table_t *plugin_stats_table(void) /* {{{ */
+{
+  plugin_stats_table_t *t = pthread_getspecific(plugin_stats_key);
+  if (t != NULL)
+    return t;
+
+  pthread_mutex_lock(&plugin_stats_tables_lock);
+  for (t = plugin_stats_tables; t != NULL; t = t->next)
+    if (!t->in_use)
+      break;
+
+  if (t == NULL) {
+    t = calloc(1, sizeof(*t));
+    if (t == NULL) {
+      pthread_mutex_unlock(&plugin_stats_tables_lock);
+      return NULL;
+    }
+    t->next = plugin_stats_tables;
+    plugin_stats_tables = t;
+  }
+  t->in_use = true;
+  pthread_mutex_unlock(&plugin_stats_tables_lock);
+
+  pthread_setspecific(plugin_stats_key, t);
+  return t;
+} /* }}} plugin_stats_table_t *plugin_stats_table */
+
+/* Returns the calling thread's counters of the plugin "name", or NULL if
+ * internal statistics are disabled. */
+static plugin_stats_t *plugin_stats_get(char const *name) /* {{{ */
+{
+  if (!record_statistics || (name == NULL))
+    return NULL;
+
+  plugin_stats_table_t *t = plugin_stats_table();
+  if (t == NULL)
+    return NULL;
+
+  if ((t->last != NULL) && (strcmp(t->last->name, name) == 0))
+    return t->last;
+
+  plugin_stats_t *ps;
+  for (ps = t->head; ps != NULL; ps = ps->next)
+    if (strcmp(ps->name, name) == 0)
+      break;
+
+  if (ps == NULL) {
+    ps = calloc(1, sizeof(*ps));
+    if (ps == NULL)
+      return NULL;
+    ps->name = strdup(name);
+    if (ps->name == NULL) {
+      sfree(ps);
+      return NULL;
+    }
+    /* plugin_update_internal_statistics() walks the list concurrently, so
+     * the entry is published only once it has been initialized. */
+    ps->next = t->head;
+    __atomic_store_n(&t->head, ps, __ATOMIC_RELEASE);
+  }
+
+  t->last = ps;
+  return ps;
+} /* }}} plugin_stats_t *plugin_stats_get */
+
+/* Adds "n" to a counter of the calling thread. Only the owning thread writes
+ * the counter, so a plain load and store suffice. */
+static void plugin_stats_add(uint64_t *counter, uint64_t n) /* {{{ */
+{
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n,
+                   __ATOMIC_RELAXED);
+} /* }}} void plugin_stats_add */
+
+/* Counts value lists dispatched or dropped by the current plugin. */
+static void plugin_stats_dispatch(size_t dispatched, size_t dropped) /* {{{ */
+{
+  if (!record_statistics)
+    return;
+
+  plugin_stats_t *ps = plugin_stats_get(plugin_get_ctx().name);
+  if (ps == NULL)
+    return;
+
+  if (dispatched > 0)
+    plugin_stats_add(&ps->dispatched, (uint64_t)dispatched);
+  if (dropped > 0)
+    plugin_stats_add(&ps->dropped, (uint64_t)dropped);
+} /* }}} void plugin_stats_dispatch */
+
+/* Counts one call of the write callback "cf" with "num" value lists. */
+static void plugin_stats_write(callback_func_t const *cf, /* {{{ */
+                               size_t num, int status) {
+  plugin_stats_t *ps = plugin_stats_get(cf->cf_ctx.name);
+  if (ps == NULL)
+    return;
+
+  plugin_stats_add(&ps->write_calls, 1);
+  plugin_stats_add(&ps->write_values, (uint64_t)num);
+  if (status != 0)
+    plugin_stats_add(&ps->write_errors, 1);
+} /* }}} void plugin_stats_write */
+
+/* The length of a queue shard is updated atomically while holding the shard
+ * lock, so that the drop decision and the statistics can read it without
+ * taking the lock. */
+static void write_queue_set_length(write_queue_shard_t *wq, /* {{{ */
+                                   long length) {
+  __atomic_store_n(&wq->length, length, __ATOMIC_RELAXED);
+} /* }}} void write_queue_set_length */
+
+static long write_queue_get_length(write_queue_shard_t *wq) /* {{{ */
+{
+  return __atomic_load_n(&wq->length, __ATOMIC_RELAXED);
+} /* }}} long write_queue_get_length */
+
+/* Returns the number of value lists in all write queue shards. The shard
+ * locks are not held, so the result may be slightly off while other threads
+ * are enqueueing or dequeueing. */
+static long write_queue_length(void) { /* {{{ */
+  long length = 0;
+
+  for (size_t i = 0; i < write_queues_num; i++)
+    length += write_queue_get_length(write_queues + i);
+
+  return length;
+} /* }}} long write_queue_length */
+
+/* Returns the probability with which a value list should be dropped if a
+ * queue that has "length" entries is limited by "low" and "high". */
+static double write_drop_probability(long length, long low, /* {{{ */
+                                     long high) {
+  if (length < low)
+    return 0.0;
+  if (length >= high)
+    return 1.0;
+
+  long pos = 1 + length - low;
+  long size = 1 + high - low;
+
+  return (double)pos / (double)size;
+} /* }}} double write_drop_probability */
+
+/* Converts the drop probability "p" of the normal priority class to the class
+ * "priority". Low priority value lists are dropped twice as often, i.e. all of
+ * them once the queue is half way between its limits, and high priority value
+ * lists only from there on. */
+static double write_drop_probability_class(double p, /* {{{ */
+                                           int priority) {
+  if (priority < WRITE_PRIORITY_NORMAL)
+    return (p >= 0.5) ? 1.0 : 2.0 * p;
+  if (priority > WRITE_PRIORITY_NORMAL)
+    return (p <= 0.5) ? 0.0 : 2.0 * p - 1.0;
+  return p;
+} /* }}} double write_drop_probability_class */
+
+/* Copies "name" to "buffer", replacing characters that are not allowed in
+ * identifiers. */
+static void plugin_stats_instance(char *buffer, size_t buffer_size, /* {{{ */
+                                  char const *prefix, char const *name) {
+  ssnprintf(buffer, buffer_size, "%s%s", prefix, name);
+  for (char *c = buffer; *c != 0; c++)
+    if (*c == '/')
+      *c = '_';
+} /* }}} void plugin_stats_instance */
+
+/* Dispatches the latency of one callback with "vl"'s plugin instance and
+ * resets it. Nothing is dispatched if the callback wasn't called since the
+ * last time. */
+static const double callback_latency_percentiles[] = {50.0, 95.0, 99.0};
+
+/* The latency of a callback since the previous report. */
+typedef struct {
+  size_t num;
+  cdtime_t average;
+  cdtime_t upper;
+  cdtime_t percentile[STATIC_ARRAY_SIZE(callback_latency_percentiles)];
+} callback_latency_t;
+
+/* Copies the latency counter of "cf" to "ret" and resets it. */
+static void callback_latency_get(callback_func_t *cf, /* {{{ */
+                                 callback_latency_t *ret) {
+  *ret = (callback_latency_t){0};
+
+  pthread_mutex_lock(&cf->cf_latency_lock);
+  ret->num = latency_counter_get_num(cf->cf_latency);
+  if (ret->num == 0) {
+    pthread_mutex_unlock(&cf->cf_latency_lock);
+    return;
+  }
+  ret->average = latency_counter_get_average(cf->cf_latency);
+  ret->upper = latency_counter_get_max(cf->cf_latency);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(callback_latency_percentiles); i++)
+    ret->percentile[i] = latency_counter_get_percentile(
+        cf->cf_latency, callback_latency_percentiles[i]);
+  latency_counter_reset(cf->cf_latency);
+  pthread_mutex_unlock(&cf->cf_latency_lock);
+} /* }}} void callback_latency_get */
+
+static void plugin_dispatch_callback_latency(value_list_t *vl, /* {{{ */
+                                             char const *name,
+                                             callback_latency_t const *l) {
+  if (l->num == 0)
+    return;
+
+  char instance[DATA_MAX_NAME_LEN];
+  plugin_stats_instance(instance, sizeof(instance), "", name);
+
+  vl->values_len = 1;
+  sstrncpy(vl->type, "latency", sizeof(vl->type));
+
+  vl->values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(l->average)};
+  ssnprintf(vl->type_instance, sizeof(vl->type_instance), "%s-average",
+            instance);
+  plugin_dispatch_values(vl);
+
+  vl->values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(l->upper)};
+  ssnprintf(vl->type_instance, sizeof(vl->type_instance), "%s-upper",
+            instance);
+  plugin_dispatch_values(vl);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(callback_latency_percentiles);
+       i++) {
+    vl->values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(l->percentile[i])};
+    ssnprintf(vl->type_instance, sizeof(vl->type_instance),
+              "%s-percentile-%.0f", instance, callback_latency_percentiles[i]);
+    plugin_dispatch_values(vl);
+  }
+
+  sstrncpy(vl->type, "gauge", sizeof(vl->type));
+  vl->values = &(value_t){.gauge = (gauge_t)l->num};
+  ssnprintf(vl->type_instance, sizeof(vl->type_instance), "%s-count",
+            instance);
+  plugin_dispatch_values(vl);
+} /* }}} void plugin_dispatch_callback_latency */
+
+static void plugin_dispatch_list_latency(value_list_t *vl, /* {{{ */
+                                         char const *plugin_instance,
+                                         llist_t *list) {
+  sstrncpy(vl->plugin_instance, plugin_instance, sizeof(vl->plugin_instance));
+
+  for (llentry_t *le = llist_head(list); le != NULL; le = le->next) {
+    callback_latency_t l;
+    callback_latency_get(le->value, &l);
+    plugin_dispatch_callback_latency(vl, le->key, &l);
+  }
+} /* }}} void plugin_dispatch_list_latency */
+
+/* Sums up the per-plugin counters of all threads and dispatches them with
+ * the plugin's name as plugin instance. */
+static void plugin_dispatch_plugin_stats(value_list_t *vl) /* {{{ */
+{
+  static char const *names[] = {"dispatched",  "dropped",      "series_created",
+                                "write_calls", "write_errors", "write_values"};
+
+  llist_t *totals = llist_create();
+  if (totals == NULL)
+    return;
+
+  pthread_mutex_lock(&plugin_stats_tables_lock);
+  for (plugin_stats_table_t *t = plugin_stats_tables; t != NULL; t = t->next) {
+    for (plugin_stats_t *ps = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+         ps != NULL; ps = ps->next) {
+      llentry_t *le = llist_search(totals, ps->name);
+      if (le == NULL) {
+        uint64_t *sum = calloc(STATIC_ARRAY_SIZE(names), sizeof(*sum));
+        if (sum == NULL)
+          continue;
+        le = llentry_create(ps->name, sum);
+        if (le == NULL) {
+          sfree(sum);
+          continue;
+        }
+        llist_append(totals, le);
+      }
+
+      uint64_t *sum = le->value;
+      sum[0] += __atomic_load_n(&ps->dispatched, __ATOMIC_RELAXED);
+      sum[1] += __atomic_load_n(&ps->dropped, __ATOMIC_RELAXED);
+      sum[2] += __atomic_load_n(&ps->series_created, __ATOMIC_RELAXED);
+      sum[3] += __atomic_load_n(&ps->write_calls, __ATOMIC_RELAXED);
+      sum[4] += __atomic_load_n(&ps->write_errors, __ATOMIC_RELAXED);
+      sum[5] += __atomic_load_n(&ps->write_values, __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&plugin_stats_tables_lock);
+
+  sstrncpy(vl->type, "derive", sizeof(vl->type));
+  vl->values_len = 1;
+
+  for (llentry_t *le = llist_head(totals); le != NULL; le = le->next) {
+    uint64_t *sum = le->value;
+
+    plugin_stats_instance(vl->plugin_instance, sizeof(vl->plugin_instance), "",
+                          le->key);
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(names); i++) {
+      /* Skip the write counters of plugins that only dispatch values and
+       * vice versa. */
+      bool is_write = (i >= 3);
+      if ((is_write && (sum[3] == 0)) ||
+          (!is_write && (sum[0] == 0) && (sum[1] == 0)))
+        continue;
+
+      vl->values = &(value_t){.derive = (derive_t)sum[i]};
+      sstrncpy(vl->type_instance, names[i], sizeof(vl->type_instance));
+      plugin_dispatch_values(vl);
+    }
+
+    sfree(le->value);
+  }
+
+  llist_destroy(totals);
+} /* }}} void plugin_dispatch_plugin_stats */
+
+/* Returns the pool whose threads call "rf". */
+static read_pool_t *read_pool_find(read_func_t const *rf) /* {{{ */
+{
+  for (size_t i = 0; i < read_pools_num; i++) {
+    read_pool_t *pool = read_pools + i;
+
+    for (size_t j = 0; j < pool->groups_num; j++)
+      if (strcasecmp(pool->groups[j], rf->rf_group) == 0)
+        return pool;
+
+    if (rf->rf_ctx.name == NULL)
+      continue;
+    for (size_t j = 0; j < pool->plugins_num; j++)
+      if (strcasecmp(pool->plugins[j], rf->rf_ctx.name) == 0)
+        return pool;
+  }
+
+  return &read_pool_default;
+} /* }}} read_pool_t *read_pool_find */
+
+/* The statistics of a read function, copied while holding "read_lock". They
+ * are dispatched after releasing it, since write and filter callbacks may
+ * (un)register read functions. */
+typedef struct {
+  char name[DATA_MAX_NAME_LEN];
+  cdtime_t lateness;
+  derive_t overruns;
+  /* Index in "pool_lateness" of plugin_update_internal_statistics(). */
+  size_t pool;
+  callback_latency_t latency;
+} read_func_stats_t;
+
+/* Copies the statistics of all read functions and resets the largest
+ * lateness. Returns the number of read functions copied to "*ret". */
+static size_t read_func_stats_get(read_func_stats_t **ret) /* {{{ */
+{
+  *ret = NULL;
+
+  pthread_mutex_lock(&read_lock);
+  int num = (read_list != NULL) ? llist_size(read_list) : 0;
+  read_func_stats_t *stats = (num > 0) ? calloc(num, sizeof(*stats)) : NULL;
+  if (stats == NULL) {
+    pthread_mutex_unlock(&read_lock);
+    return 0;
+  }
+
+  size_t i = 0;
+  for (llentry_t *le = llist_head(read_list); le != NULL; le = le->next) {
+    read_func_t *rf = le->value;
+    read_func_stats_t *s = stats + i++;
+
+    sstrncpy(s->name, rf->rf_name, sizeof(s->name));
+    s->lateness = rf->rf_lateness_max;
+    rf->rf_lateness_max = 0;
+    s->overruns =
+        (derive_t)__atomic_load_n(&rf->rf_overruns, __ATOMIC_RELAXED);
+
+    /* Index zero is the default pool. */
+    read_pool_t *pool = read_pool_find(rf);
+    s->pool = (pool == &read_pool_default) ? 0 : 1 + (pool - read_pools);
+
+    callback_latency_get(&rf->rf_super, &s->latency);
+  }
+  pthread_mutex_unlock(&read_lock);
+
+  *ret = stats;
+  return i;
+} /* }}} size_t read_func_stats_get */
+
 static int plugin_update_internal_statistics(void) { /* {{{ */
-  gauge_t copy_write_queue_length = (gauge_t)write_queue_length;
+  gauge_t copy_write_queue_length = (gauge_t)write_queue_length();
 
   /* Initialize `vl' */
   value_list_t vl = VALUE_LIST_INIT;
@@ -191,6 +1060,69 @@ static int plugin_update_internal_statistics(void) { /* {{{ */
   vl.type_instance[0] = 0;
   plugin_dispatch_values(&vl);
 
+  /* Write queue : per-shard queue length */
+  if (write_queues_num > 1) {
+    for (size_t i = 0; i < write_queues_num; i++) {
+      long length = write_queue_get_length(write_queues + i);
+      vl.values = &(value_t){.gauge = (gauge_t)length};
+      vl.values_len = 1;
+      ssnprintf(vl.type_instance, sizeof(vl.type_instance), "shard%" PRIsz,
+                i);
+      plugin_dispatch_values(&vl);
+    }
+  }
+
+  /* Write queue : queues of the write sinks */
+  pthread_mutex_lock(&write_sinks_lock);
+  for (write_sink_t *ws = write_sinks; ws != NULL; ws = ws->next) {
+    pthread_mutex_lock(&ws->queue.lock);
+    gauge_t length = (gauge_t)ws->queue.length;
+    derive_t dropped = ws->dropped;
+    derive_t spilled = ws->spilled;
+    derive_t replayed = ws->replayed;
+    cdtime_t latency = ws->latency_max;
+    ws->latency_max = 0;
+    pthread_mutex_unlock(&ws->queue.lock);
+
+    vl.values_len = 1;
+
+    vl.values = &(value_t){.gauge = length};
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    plugin_stats_instance(vl.type_instance, sizeof(vl.type_instance), "",
+                          ws->name);
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(latency)};
+    sstrncpy(vl.type, "duration", sizeof(vl.type));
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = dropped};
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    plugin_stats_instance(vl.type_instance, sizeof(vl.type_instance),
+                          "dropped-", ws->name);
+    plugin_dispatch_values(&vl);
+
+    if (ws->spill == NULL)
+      continue;
+
+    vl.values = &(value_t){.derive = spilled};
+    plugin_stats_instance(vl.type_instance, sizeof(vl.type_instance),
+                          "spilled-", ws->name);
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = replayed};
+    plugin_stats_instance(vl.type_instance, sizeof(vl.type_instance),
+                          "replayed-", ws->name);
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.gauge = (gauge_t)spill_size(ws->spill)};
+    sstrncpy(vl.type, "bytes", sizeof(vl.type));
+    plugin_stats_instance(vl.type_instance, sizeof(vl.type_instance),
+                          "spill-", ws->name);
+    plugin_dispatch_values(&vl);
+  }
+  pthread_mutex_unlock(&write_sinks_lock);
+
   /* Write queue : Values dropped (queue length > low limit) */
   vl.values = &(value_t){.gauge = (gauge_t)stats_values_dropped};
   vl.values_len = 1;
@@ -198,6 +1130,70 @@ static int plugin_update_internal_statistics(void) { /* {{{ */
   sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 
+  /* Write queue : Node allocations served by the pool / by malloc */
+  uint64_t pool_hits = 0;
+  uint64_t pool_misses = 0;
+  pool_stats(write_queue_pool, &pool_hits, &pool_misses);
+
+  vl.values = &(value_t){.derive = (derive_t)pool_hits};
+  sstrncpy(vl.type_instance, "pool_hits", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = (derive_t)pool_misses};
+  sstrncpy(vl.type_instance, "pool_misses", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Log queue : queue length and messages dropped */
+  pthread_mutex_lock(&log_queue_lock);
+  bool log_queue_enabled = log_loop;
+  gauge_t log_queue_length = (gauge_t)(log_queue_head - log_queue_tail);
+  derive_t log_dropped = log_queue_dropped;
+  pthread_mutex_unlock(&log_queue_lock);
+
+  if (log_queue_enabled) {
+    sstrncpy(vl.plugin_instance, "log_queue", sizeof(vl.plugin_instance));
+
+    vl.values = &(value_t){.gauge = log_queue_length};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    vl.type_instance[0] = 0;
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = log_dropped};
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Notification queue : queue length, notifications dropped and coalesced */
+  pthread_mutex_lock(&notif_queue_lock);
+  bool notif_queue_enabled = notif_loop;
+  gauge_t notif_length = (gauge_t)notif_queue_length;
+  derive_t notif_dropped = notif_queue_dropped;
+  derive_t notif_coalesced = notif_queue_coalesced;
+  pthread_mutex_unlock(&notif_queue_lock);
+
+  if (notif_queue_enabled) {
+    sstrncpy(vl.plugin_instance, "notification_queue",
+             sizeof(vl.plugin_instance));
+
+    vl.values = &(value_t){.gauge = notif_length};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    vl.type_instance[0] = 0;
+    plugin_dispatch_values(&vl);
+
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+
+    vl.values = &(value_t){.derive = notif_dropped};
+    sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = notif_coalesced};
+    sstrncpy(vl.type_instance, "coalesced", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
   /* Cache */
   sstrncpy(vl.plugin_instance, "cache", sizeof(vl.plugin_instance));
 
@@ -208,6 +1204,134 @@ static int plugin_update_internal_statistics(void) { /* {{{ */
   vl.type_instance[0] = 0;
   plugin_dispatch_values(&vl);
 
+  /* Cache : Series created and rejected by the series limits */
+  uint64_t series_created = 0;
+  uint64_t series_rejected = 0;
+  uc_get_series_stats(&series_created, &series_rejected);
+
+  sstrncpy(vl.type, "derive", sizeof(vl.type));
+  vl.values = &(value_t){.derive = (derive_t)series_created};
+  sstrncpy(vl.type_instance, "series_created", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = (derive_t)series_rejected};
+  sstrncpy(vl.type_instance, "series_rejected", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = (derive_t)uc_get_values_too_old()};
+  sstrncpy(vl.type_instance, "too_old", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){
+      .derive = (derive_t)__atomic_load_n(&stats_values_suppressed,
+                                          __ATOMIC_RELAXED)};
+  sstrncpy(vl.type_instance, "suppressed", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Cache : Cache events waiting for the cache event thread */
+  pthread_mutex_lock(&cache_event_lock);
+  bool cache_event_enabled = cache_event_loop;
+  gauge_t cache_event_length = (gauge_t)cache_event_queue_length;
+  pthread_mutex_unlock(&cache_event_lock);
+
+  if (cache_event_enabled) {
+    vl.values = &(value_t){.gauge = cache_event_length};
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "events", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Read functions : lateness of each read function and the largest
+   * lateness in each read thread pool */
+  sstrncpy(vl.plugin_instance, "read_lateness", sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, "duration", sizeof(vl.type));
+
+  cdtime_t pool_lateness[read_pools_num + 1];
+  memset(pool_lateness, 0, sizeof(pool_lateness));
+
+  read_func_stats_t *rf_stats;
+  size_t rf_stats_num = read_func_stats_get(&rf_stats);
+
+  for (size_t i = 0; i < rf_stats_num; i++) {
+    read_func_stats_t *s = rf_stats + i;
+
+    vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(s->lateness)};
+    vl.values_len = 1;
+    sstrncpy(vl.type_instance, s->name, sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+
+    if (s->lateness > pool_lateness[s->pool])
+      pool_lateness[s->pool] = s->lateness;
+  }
+
+  if (read_pools_num > 0) {
+    sstrncpy(vl.plugin_instance, "read_pool_lateness",
+             sizeof(vl.plugin_instance));
+    for (size_t i = 0; i <= read_pools_num; i++) {
+      read_pool_t *pool = (i == 0) ? &read_pool_default : read_pools + i - 1;
+
+      vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(pool_lateness[i])};
+      vl.values_len = 1;
+      sstrncpy(vl.type_instance, pool->name, sizeof(vl.type_instance));
+      plugin_dispatch_values(&vl);
+    }
+  }
+
+  /* Read functions : number of times each one exceeded its timeout */
+  sstrncpy(vl.plugin_instance, "read_overruns", sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, "derive", sizeof(vl.type));
+
+  for (size_t i = 0; i < rf_stats_num; i++) {
+    vl.values = &(value_t){.derive = rf_stats[i].overruns};
+    vl.values_len = 1;
+    sstrncpy(vl.type_instance, rf_stats[i].name, sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  /* Read threads : running threads and threads stuck in a callback that
+   * exceeded its timeout */
+  gauge_t threads_running = 0;
+  gauge_t threads_stuck = 0;
+  pthread_mutex_lock(&read_threads_lock);
+  for (size_t i = 0; i < read_threads_num; i++) {
+    read_thread_t *t = read_threads + i;
+    if (!t->used || t->exited)
+      continue;
+    if (t->overrun)
+      threads_stuck++;
+    else
+      threads_running++;
+  }
+  pthread_mutex_unlock(&read_threads_lock);
+
+  sstrncpy(vl.plugin_instance, "read_threads", sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, "threads", sizeof(vl.type));
+
+  vl.values = &(value_t){.gauge = threads_running};
+  vl.values_len = 1;
+  sstrncpy(vl.type_instance, "running", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = threads_stuck};
+  sstrncpy(vl.type_instance, "stuck", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  sstrncpy(vl.type, "duration", sizeof(vl.type));
+
+  /* Callbacks : time spent in each callback */
+  sstrncpy(vl.plugin_instance, "read_latency", sizeof(vl.plugin_instance));
+  for (size_t i = 0; i < rf_stats_num; i++)
+    plugin_dispatch_callback_latency(&vl, rf_stats[i].name,
+                                     &rf_stats[i].latency);
+  sfree(rf_stats);
+
+  plugin_dispatch_list_latency(&vl, "write_latency", list_write);
+  plugin_dispatch_list_latency(&vl, "flush_latency", list_flush);
+  plugin_dispatch_list_latency(&vl, "missing_latency", list_missing);
+
+  /* Plugins : values dispatched, dropped and written per plugin */
+  plugin_dispatch_plugin_stats(&vl);
+
   return 0;
 } /* }}} int plugin_update_internal_statistics */
 
@@ -225,10 +1349,25 @@ static void destroy_callback(callback_func_t *cf) /* {{{ */
 {
   if (cf == NULL)
     return;
+  write_sink_destroy(cf->cf_sink);
+  latency_counter_destroy(cf->cf_latency);
+  pthread_mutex_destroy(&cf->cf_latency_lock);
   free_userdata(&cf->cf_udata);
   sfree(cf);
 } /* }}} void destroy_callback */
 
+static void destroy_read_func(read_func_t *rf) /* {{{ */
+{
+  if (rf == NULL)
+    return;
+  sfree(rf->rf_name);
+  if (rf->rf_cpus != NULL) {
+    sfree(rf->rf_cpus->cores);
+    sfree(rf->rf_cpus);
+  }
+  destroy_callback((callback_func_t *)rf);
+} /* }}} void destroy_read_func */
+
 static void destroy_all_callbacks(llist_t **list) /* {{{ */
 {
   llentry_t *le;
@@ -264,17 +1403,23 @@ static void destroy_read_heap(void) /* {{{ */
     rf = c_heap_get_root(read_heap);
     if (rf == NULL)
       break;
-    sfree(rf->rf_name);
-    destroy_callback((callback_func_t *)rf);
+    destroy_read_func(rf);
   }
 
   c_heap_destroy(read_heap);
   read_heap = NULL;
 } /* }}} void destroy_read_heap */
 
-static int register_callback(llist_t **list, /* {{{ */
-                             const char *name, callback_func_t *cf) {
+/* Protects the callback lists while init callbacks run in parallel, see
+ * "InitThreads". */
+static pthread_mutex_t register_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* The log and notification callbacks are called by any thread. This lock
+ * keeps plugin_unload() from removing them while they are being called. */
+static pthread_rwlock_t callbacks_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static int register_callback_locked(llist_t **list, /* {{{ */
+                                    const char *name, callback_func_t *cf) {
   if (*list == NULL) {
     *list = llist_create();
     if (*list == NULL) {
@@ -318,6 +1463,14 @@ static int register_callback(llist_t **list, /* {{{ */
   }
 
   return 0;
+} /* }}} int register_callback_locked */
+
+static int register_callback(llist_t **list, /* {{{ */
+                             const char *name, callback_func_t *cf) {
+  pthread_mutex_lock(&register_lock);
+  int status = register_callback_locked(list, name, cf);
+  pthread_mutex_unlock(&register_lock);
+  return status;
 } /* }}} int register_callback */
 
 static void log_list_callbacks(llist_t **list, /* {{{ */
@@ -356,18 +1509,13 @@ static void log_list_callbacks(llist_t **list, /* {{{ */
   sfree(keys);
 } /* }}} void log_list_callbacks */
 
-static int create_register_callback(llist_t **list, /* {{{ */
-                                    const char *name, void *callback,
-                                    user_data_t const *ud) {
-
-  if (name == NULL || callback == NULL)
-    return EINVAL;
-
+static callback_func_t *create_callback(void *callback, /* {{{ */
+                                        user_data_t const *ud) {
   callback_func_t *cf = calloc(1, sizeof(*cf));
   if (cf == NULL) {
     free_userdata(ud);
-    ERROR("plugin: create_register_callback: calloc failed.");
-    return ENOMEM;
+    ERROR("plugin: create_callback: calloc failed.");
+    return NULL;
   }
 
   cf->cf_callback = callback;
@@ -381,6 +1529,22 @@ static int create_register_callback(llist_t **list, /* {{{ */
   }
 
   cf->cf_ctx = plugin_get_ctx();
+  cf->cf_ctx.read_time = 0;
+  pthread_mutex_init(&cf->cf_latency_lock, /* attr = */ NULL);
+
+  return cf;
+} /* }}} callback_func_t *create_callback */
+
+static int create_register_callback(llist_t **list, /* {{{ */
+                                    const char *name, void *callback,
+                                    user_data_t const *ud) {
+
+  if (name == NULL || callback == NULL)
+    return EINVAL;
+
+  callback_func_t *cf = create_callback(callback, ud);
+  if (cf == NULL)
+    return ENOMEM;
 
   return register_callback(list, name, cf);
 } /* }}} int create_register_callback */
@@ -407,8 +1571,9 @@ static int plugin_unregister(llist_t *list, const char *name) /* {{{ */
 } /* }}} int plugin_unregister */
 
 /* plugin_load_file loads the shared object "file" and calls its
- * "module_register" function. Returns zero on success, non-zero otherwise. */
-static int plugin_load_file(char const *file, bool global) {
+ * "module_register" function. Returns zero on success, non-zero otherwise.
+ * The handle of the shared object is returned in "ret_dlh". */
+static int plugin_load_file(char const *file, bool global, void **ret_dlh) {
   int flags = RTLD_NOW;
   if (global)
     flags |= RTLD_GLOBAL;
@@ -444,67 +1609,432 @@ static int plugin_load_file(char const *file, bool global) {
   }
 
   (*reg_handle)();
+  *ret_dlh = dlh;
   return 0;
 }
 
-static void *plugin_read_thread(void __attribute__((unused)) * args) {
-  while (read_loop != 0) {
-    read_func_t *rf;
-    plugin_ctx_t old_ctx;
-    cdtime_t start;
-    cdtime_t now;
-    cdtime_t elapsed;
-    int status;
-    int rf_type;
-    int rc;
+/* Returns the first multiple of "interval" that is not before "t". */
+static cdtime_t read_align(cdtime_t t, cdtime_t interval) /* {{{ */
+{
+  if (interval == 0)
+    return t;
 
-    /* Get the read function that needs to be read next.
-     * We don't need to hold "read_lock" for the heap, but we need
-     * to call c_heap_get_root() and pthread_cond_wait() in the
-     * same protected block. */
-    pthread_mutex_lock(&read_lock);
-    rf = c_heap_get_root(read_heap);
-    if (rf == NULL) {
-      pthread_cond_wait(&read_cond, &read_lock);
-      pthread_mutex_unlock(&read_lock);
-      continue;
-    }
-    pthread_mutex_unlock(&read_lock);
+  cdtime_t rem = t % interval;
+  return (rem == 0) ? t : t + (interval - rem);
+} /* }}} cdtime_t read_align */
 
-    if (rf->rf_interval == 0) {
-      /* this should not happen, because the interval is set
-       * for each plugin when loading it
-       * XXX: issue a warning? */
-      rf->rf_interval = plugin_get_interval();
-      rf->rf_effective_interval = rf->rf_interval;
+/* Returns the first time that is not before "t" and lies at the offset of
+ * "rf" within its interval. See "SpreadRead". */
+static cdtime_t read_spread(cdtime_t t, read_func_t const *rf) /* {{{ */
+{
+  if (rf->rf_interval == 0)
+    return t;
+
+  /* The hashes of similar names are close to each other. Mix the bits with
+   * the finalizer of SplitMix64 first. */
+  uint64_t hash = uc_hash_name(rf->rf_name);
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  hash ^= hash >> 31;
+  cdtime_t offset = (cdtime_t)(hash % rf->rf_interval);
+  if (t < offset)
+    return offset;
+  return read_align(t - offset, rf->rf_interval) + offset;
+} /* }}} cdtime_t read_spread */
+
+/* Returns the interval the reads of "rf" are aligned to. */
+static cdtime_t read_align_interval(read_func_t const *rf) /* {{{ */
+{
+  return (rf->rf_adaptive_interval != 0) ? rf->rf_adaptive_interval
+                                         : rf->rf_interval;
+} /* }}} cdtime_t read_align_interval */
+
+/* Raises the volatility of "rf" to that of a value list it dispatches: the
+ * largest coefficient of variation, i.e. the standard deviation divided by
+ * the absolute mean, of the recent rates of its data sources. The rates are
+ * those in the cache, so the value list being dispatched is not included. */
+static void read_adaptive_observe(read_func_t *rf, char const *host, /* {{{ */
+                                  value_list_t const *vl,
+                                  char const *type_instance) {
+  size_t num_ds = vl->values_len;
+  if ((num_ds == 0) || (num_ds > READ_ADAPTIVE_DS_MAX))
+    return;
+
+  char name[6 * DATA_MAX_NAME_LEN];
+  if (format_name(name, sizeof(name), host, vl->plugin, vl->plugin_instance,
+                  vl->type, type_instance) != 0)
+    return;
 
-      rf->rf_next_read = cdtime();
+  gauge_t history[READ_ADAPTIVE_HISTORY * READ_ADAPTIVE_DS_MAX];
+  if (uc_get_history_by_name(name, history, READ_ADAPTIVE_HISTORY, num_ds) !=
+      0)
+    return;
+
+  for (size_t i = 0; i < num_ds; i++) {
+    size_t n = 0;
+    double sum = 0.0;
+    double sum_sq = 0.0;
+    for (size_t j = 0; j < READ_ADAPTIVE_HISTORY; j++) {
+      gauge_t v = history[j * num_ds + i];
+      if (!isfinite(v))
+        continue;
+      n++;
+      sum += v;
+      sum_sq += v * v;
     }
+    /* A fresh history is filled with NANs. */
+    if (n < 3)
+      continue;
+
+    double mean = sum / (double)n;
+    double variance = (sum_sq / (double)n) - (mean * mean);
+    double stddev = (variance > 0.0) ? sqrt(variance) : 0.0;
+
+    double volatility;
+    if (mean != 0.0)
+      volatility = stddev / fabs(mean);
+    else
+      volatility = (stddev > 0.0) ? INFINITY : 0.0;
+
+    if (isnan(rf->rf_volatility) || (volatility > rf->rf_volatility))
+      rf->rf_volatility = volatility;
+  }
+} /* }}} void read_adaptive_observe */
+
+/* Adjusts the interval of "rf" after a successful call: it is halved while
+ * the dispatched values are volatile and grows by a quarter while they are
+ * stable, within "AdaptiveIntervalMin" and "AdaptiveIntervalMax". */
+static void read_adaptive_update(read_func_t *rf) /* {{{ */
+{
+  plugin_ctx_t const *ctx = &rf->rf_ctx;
+  double volatility = rf->rf_volatility;
+  if (isnan(volatility))
+    return;
+
+  cdtime_t interval = rf->rf_adaptive_interval;
+  if (volatility > ctx->adaptive_threshold)
+    interval /= 2;
+  else if (volatility < (ctx->adaptive_threshold / 2.0))
+    interval += interval / 4;
+
+  if (interval < ctx->adaptive_interval_min)
+    interval = ctx->adaptive_interval_min;
+  if (interval > ctx->adaptive_interval_max)
+    interval = ctx->adaptive_interval_max;
+
+  if (interval != rf->rf_adaptive_interval)
+    DEBUG("plugin_read_thread: Volatility of the `%s' plugin is %g; "
+          "changing its interval from %.3f to %.3f seconds.",
+          rf->rf_name, volatility,
+          CDTIME_T_TO_DOUBLE(rf->rf_adaptive_interval),
+          CDTIME_T_TO_DOUBLE(interval));
+  rf->rf_adaptive_interval = interval;
+} /* }}} void read_adaptive_update */
+
+/* Picks the queue for "rf" among the queues of its pool. With "AlignRead",
+ * read functions with the same interval are assigned to the same queue, so
+ * that one thread wakes up and handles them back to back. Otherwise they are
+ * distributed round-robin. */
+static read_queue_t *read_queue_select(read_func_t *rf) /* {{{ */
+{
+  read_pool_t *pool = read_pool_find(rf);
+  size_t index;
+
+  if (align_read)
+    index = (size_t)((rf->rf_interval * 11400714819323198485ULL) >> 32);
+  else
+    index = pool->queues_next++;
+
+  return pool->queues + (index % pool->queues_num);
+} /* }}} read_queue_t *read_queue_select */
+
+/* Publishes when the root of "q" is due. "q" must be locked. */
+static void read_queue_update_next(read_queue_t *q) /* {{{ */
+{
+  read_func_t *rf = c_heap_peek_root(q->heap);
+  __atomic_store_n(&q->next_read, (rf != NULL) ? rf->rf_next_read : 0,
+                   __ATOMIC_RELAXED);
+} /* }}} void read_queue_update_next */
+
+/* Returns the earliest time a read function is due in the queues of the pool
+ * of "q", other than "q" itself. Returns zero if they are all empty. */
+static cdtime_t read_queue_peers_next(read_queue_t const *q) /* {{{ */
+{
+  read_pool_t const *pool = q->pool;
+  cdtime_t next = 0;
+
+  for (size_t i = 0; i < pool->queues_num; i++) {
+    read_queue_t *other = pool->queues + i;
+    if (other == q)
+      continue;
+
+    cdtime_t t = __atomic_load_n(&other->next_read, __ATOMIC_RELAXED);
+    if ((t != 0) && ((next == 0) || (t < next)))
+      next = t;
+  }
+
+  return next;
+} /* }}} cdtime_t read_queue_peers_next */
+
+/* Adds "rf" to "q" and wakes up the queue's thread if "rf" is due before all
+ * other read functions of the queue. */
+static void read_queue_insert(read_queue_t *q, read_func_t *rf) /* {{{ */
+{
+  pthread_mutex_lock(&q->lock);
+  int status = c_heap_insert(q->heap, rf);
+  if (status == 0) {
+    q->num++;
+    if (c_heap_peek_root(q->heap) == rf) {
+      read_queue_update_next(q);
+      pthread_cond_signal(&q->cond);
+    }
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  if (status != 0)
+    ERROR("plugin: read_queue_insert: c_heap_insert failed.");
+} /* }}} void read_queue_insert */
+
+/* Removes and returns the root of "q" if it is due at "now". "q" must be
+ * locked. */
+static read_func_t *read_queue_get_due(read_queue_t *q, /* {{{ */
+                                       cdtime_t now) {
+  read_func_t *rf = c_heap_peek_root(q->heap);
+  if ((rf == NULL) || (rf->rf_next_read > now))
+    return NULL;
+
+  c_heap_get_root(q->heap);
+  q->num--;
+  read_queue_update_next(q);
+  return rf;
+} /* }}} read_func_t *read_queue_get_due */
+
+/* Takes a due read function from another queue of the same pool. Queues that
+ * are locked at the moment are skipped. */
+static read_func_t *read_queue_steal(read_queue_t *q, cdtime_t now) /* {{{ */
+{
+  read_pool_t *pool = q->pool;
+  size_t index = (size_t)(q - pool->queues);
+
+  for (size_t i = 1; i < pool->queues_num; i++) {
+    read_queue_t *other = pool->queues + ((index + i) % pool->queues_num);
+
+    if (pthread_mutex_trylock(&other->lock) != 0)
+      continue;
+    read_func_t *rf = read_queue_get_due(other, now);
+    pthread_mutex_unlock(&other->lock);
+
+    if (rf != NULL)
+      return rf;
+  }
+
+  return NULL;
+} /* }}} read_func_t *read_queue_steal */
+
+/* Blocks until a read function is due and returns it. Returns NULL when the
+ * read threads are being stopped. */
+static read_func_t *read_queue_take(read_queue_t *q) /* {{{ */
+{
+  pthread_mutex_lock(&q->lock);
+  while (read_loop != 0) {
+    read_func_t *rf = read_queue_get_due(q, cdtime());
+    if (rf != NULL) {
+      pthread_mutex_unlock(&q->lock);
+      return rf;
+    }
+
+    /* Nothing is due in this queue, so help out the other threads. */
+    read_func_t *next = c_heap_peek_root(q->heap);
+    pthread_mutex_unlock(&q->lock);
+
+    rf = read_queue_steal(q, cdtime());
+    if (rf != NULL)
+      return rf;
+
+    pthread_mutex_lock(&q->lock);
+    /* Another read function may have been added while the lock was released.
+     * In that case, the signal has been missed. */
+    if ((read_loop == 0) || (c_heap_peek_root(q->heap) != next))
+      continue;
+
+    /* Wake up when a read function of another queue is due, too, in case
+     * that queue's thread is busy with a slow callback. */
+    cdtime_t wakeup = (next != NULL) ? next->rf_next_read : 0;
+    cdtime_t peers = read_queue_peers_next(q);
+    if ((peers != 0) && ((wakeup == 0) || (peers < wakeup)))
+      wakeup = peers;
 
-    /* sleep until this entry is due,
-     * using pthread_cond_timedwait */
-    pthread_mutex_lock(&read_lock);
     /* In pthread_cond_timedwait, spurious wakeups are possible
      * (and really happen, at least on NetBSD with > 1 CPU), thus
      * we need to re-evaluate the condition every time
      * pthread_cond_timedwait returns. */
-    rc = 0;
-    while ((read_loop != 0) && (cdtime() < rf->rf_next_read) && rc == 0) {
-      rc = pthread_cond_timedwait(&read_cond, &read_lock,
-                                  &CDTIME_T_TO_TIMESPEC(rf->rf_next_read));
+    if (wakeup == 0)
+      pthread_cond_wait(&q->cond, &q->lock);
+    else
+      pthread_cond_timedwait(&q->cond, &q->lock,
+                             &CDTIME_T_TO_TIMESPEC(wakeup));
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  return NULL;
+} /* }}} read_func_t *read_queue_take */
+
+/* Records that "t" is about to call "rf" and wakes up the watchdog if the
+ * callback has a timeout. */
+static void read_thread_begin(read_thread_t *t, read_func_t *rf, /* {{{ */
+                              cdtime_t start) {
+  cdtime_t timeout = rf->rf_ctx.read_timeout;
+  if (timeout == 0)
+    timeout = read_timeout;
+
+  pthread_mutex_lock(&read_threads_lock);
+  t->rf = rf;
+  t->started = start;
+  t->deadline = (timeout != 0) ? start + timeout : 0;
+  t->overrun = false;
+  if (t->deadline != 0)
+    pthread_cond_signal(&read_watchdog_cond);
+  pthread_mutex_unlock(&read_threads_lock);
+} /* }}} void read_thread_begin */
+
+/* Return values of read_thread_end(). */
+#define READ_THREAD_CONTINUE 0
+/* The thread has been replaced. It re-queues the read function and exits. */
+#define READ_THREAD_EXIT 1
+/* The read threads have been stopped without waiting for the thread. It hands
+ * the read function back and exits, see read_thread_orphan_end(). */
+#define READ_THREAD_DETACHED 2
+
+/* Records that the callback of "t" has returned. "*ret_overrun" is set if
+ * the callback exceeded its timeout. */
+static int read_thread_end(read_thread_t *t, bool *ret_overrun) /* {{{ */
+{
+  int ret = READ_THREAD_CONTINUE;
+
+  pthread_mutex_lock(&read_threads_lock);
+  t->deadline = 0;
+  *ret_overrun = t->overrun;
+  /* A detached thread keeps "rf" until it has been re-queued, so that
+   * plugin_unload() knows the callback's code is still in use. */
+  if (t->detached)
+    ret = READ_THREAD_DETACHED;
+  else if (t->abandoned)
+    ret = READ_THREAD_EXIT;
+  if (ret != READ_THREAD_DETACHED)
+    t->rf = NULL;
+  pthread_mutex_unlock(&read_threads_lock);
+
+  return ret;
+} /* }}} int read_thread_end */
+
+/* Drops a reference to "o" and removes it from "read_orphans" if it was the
+ * last one. The caller frees "o" then. Must be called with
+ * "read_threads_lock" held. */
+static bool read_orphans_unref(read_orphans_t *o) /* {{{ */
+{
+  if ((o == NULL) || (--o->running > 0))
+    return false;
+
+  for (read_orphans_t **p = &read_orphans; *p != NULL; p = &(*p)->next) {
+    if (*p == o) {
+      *p = o->next;
+      break;
     }
+  }
+  return true;
+} /* }}} bool read_orphans_unref */
 
-    /* Must hold `read_lock' when accessing `rf->rf_type'. */
-    rf_type = rf->rf_type;
+/* Frees "o" and the array of its threads. */
+static void read_orphans_free(read_orphans_t *o) /* {{{ */
+{
+  if (o == NULL)
+    return;
+
+  sfree(o->threads);
+  sfree(o);
+} /* }}} void read_orphans_free */
+
+/* Hands the read function of the detached thread "t" back once its callback
+ * has returned: it is added to the read queues started by
+ * plugin_reload_end(), or to "read_heap" if they aren't running yet. */
+static void read_thread_orphan_end(read_thread_t *t, /* {{{ */
+                                   read_func_t *rf) {
+  read_orphans_t *free_orphans = NULL;
+  bool remove = false;
+
+  /* Once re-queued, "rf" may be taken by another thread. */
+  NOTICE("plugin: read-function of the `%s' plugin has returned after the "
+         "read threads were stopped.",
+         rf->rf_name);
+
+  pthread_mutex_lock(&read_lock);
+  pthread_mutex_lock(&read_threads_lock);
+
+  /* The read functions are being destroyed. */
+  if (read_threads_shutdown) {
+    pthread_mutex_unlock(&read_threads_lock);
     pthread_mutex_unlock(&read_lock);
+    return;
+  }
 
-    /* Check if we're supposed to stop.. This may have interrupted
-     * the sleep, too. */
-    if (read_loop == 0) {
-      /* Insert `rf' again, so it can be free'd correctly */
-      c_heap_insert(read_heap, rf);
+  /* The read function may have been unregistered in the meantime. */
+  remove = (rf->rf_type == RF_REMOVE);
+  if (!remove) {
+    rf->rf_next_read = cdtime();
+    if (read_queues != NULL)
+      read_queue_insert(read_queue_select(rf), rf);
+    else if (c_heap_insert(read_heap, rf) != 0)
+      ERROR("plugin: read_thread_orphan_end: c_heap_insert failed.");
+  }
+
+  t->rf = NULL;
+  if (read_orphans_unref(t->orphans))
+    free_orphans = t->orphans;
+
+  pthread_mutex_unlock(&read_threads_lock);
+  pthread_mutex_unlock(&read_lock);
+
+  if (remove)
+    destroy_read_func(rf);
+
+  /* "t" points into the array. */
+  read_orphans_free(free_orphans);
+} /* }}} void read_thread_orphan_end */
+
+/* Marks "t" as finished, so the watchdog can join it and reuse its slot. */
+static void read_thread_exit(read_thread_t *t) /* {{{ */
+{
+  pthread_mutex_lock(&read_threads_lock);
+  t->exited = true;
+  pthread_cond_signal(&read_watchdog_cond);
+  pthread_mutex_unlock(&read_threads_lock);
+} /* }}} void read_thread_exit */
+
+static void *plugin_read_thread(void *args) {
+  read_thread_t *t = args;
+  read_queue_t *q = t->queue;
+
+  while (read_loop != 0) {
+    read_func_t *rf;
+    plugin_ctx_t old_ctx;
+    cdtime_t start;
+    cdtime_t now;
+    cdtime_t elapsed;
+    int status;
+    int rf_type;
+    bool overrun;
+
+    /* Get the read function that needs to be read next. This sleeps until
+     * the read function is due. */
+    rf = read_queue_take(q);
+    if (rf == NULL)
       break;
-    }
+
+    /* Must hold `read_lock' when accessing `rf->rf_type'. */
+    pthread_mutex_lock(&read_lock);
+    rf_type = rf->rf_type;
+    core_group_t const *rf_cpus = rf->rf_cpus;
+    pthread_mutex_unlock(&read_lock);
 
     /* The entry has been marked for deletion. The linked list
      * entry has already been removed by `plugin_unregister_read'.
@@ -514,8 +2044,7 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
       DEBUG("plugin_read_thread: Destroying the `%s' "
             "callback.",
             rf->rf_name);
-      sfree(rf->rf_name);
-      destroy_callback((callback_func_t *)rf);
+      destroy_read_func(rf);
       rf = NULL;
       continue;
     }
@@ -524,8 +2053,37 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
 
     start = cdtime();
 
-    old_ctx = plugin_set_ctx(rf->rf_ctx);
+    if ((start > rf->rf_next_read) &&
+        ((start - rf->rf_next_read) > rf->rf_lateness_max))
+      rf->rf_lateness_max = start - rf->rf_next_read;
+
+    if (rf->rf_interval == 0) {
+      /* this should not happen, because the interval is set
+       * for each plugin when loading it
+       * XXX: issue a warning? */
+      rf->rf_interval = plugin_get_interval();
+      rf->rf_effective_interval = rf->rf_interval;
+
+      rf->rf_next_read = start;
+    }
+
+    plugin_ctx_t ctx = rf->rf_ctx;
+    if (shared_read_timestamp)
+      ctx.read_time = start;
+    /* Value lists record the interval they were actually read with. */
+    if (rf->rf_adaptive_interval != 0) {
+      ctx.interval = rf->rf_adaptive_interval;
+      rf->rf_volatility = NAN;
+      pthread_setspecific(read_adaptive_key, rf);
+    }
+    old_ctx = plugin_set_ctx(ctx);
+
+    if (rf_cpus != NULL)
+      thread_cpus_set(rf_cpus);
+
+    read_thread_begin(t, rf, start);
 
+    PROBE1(read__start, rf->rf_name);
     if (rf_type == RF_SIMPLE) {
       int (*callback)(void);
 
@@ -539,22 +2097,41 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
       callback = rf->rf_callback;
       status = (*callback)(&rf->rf_udata);
     }
+    PROBE2(read__done, rf->rf_name, status);
+
+    if (rf->rf_adaptive_interval != 0)
+      pthread_setspecific(read_adaptive_key, NULL);
+
+    int state = read_thread_end(t, &overrun);
+    if (state == READ_THREAD_DETACHED) {
+      read_thread_orphan_end(t, rf);
+      return NULL;
+    }
+
+    if (rf_cpus != NULL)
+      thread_cpus_set(q->cpus);
 
     plugin_set_ctx(old_ctx);
 
-    /* If the function signals failure, we will increase the
+    /* If the function signals failure or timed out, we will increase the
      * intervals in which it will be called. */
-    if (status != 0) {
+    if ((status != 0) || overrun) {
       rf->rf_effective_interval *= 2;
       if (rf->rf_effective_interval > max_read_interval)
         rf->rf_effective_interval = max_read_interval;
 
-      NOTICE("read-function of plugin `%s' failed. "
+      NOTICE("read-function of plugin `%s' %s. "
              "Will suspend it for %.3f seconds.",
-             rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
+             rf->rf_name, overrun ? "timed out" : "failed",
+             CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
     } else {
       /* Success: Restore the interval, if it was changed. */
-      rf->rf_effective_interval = rf->rf_interval;
+      if (rf->rf_adaptive_interval != 0) {
+        read_adaptive_update(rf);
+        rf->rf_effective_interval = rf->rf_adaptive_interval;
+      } else {
+        rf->rf_effective_interval = rf->rf_interval;
+      }
     }
 
     /* update the ``next read due'' field */
@@ -562,6 +2139,8 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
 
     /* calculate the time spent in the read function */
     elapsed = (now - start);
+    if (record_statistics)
+      callback_latency_record(&rf->rf_super, elapsed);
 
     if (elapsed > rf->rf_effective_interval)
       WARNING(
@@ -582,20 +2161,32 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
     /* Calculate the next (absolute) time at which this function
      * should be called. */
     rf->rf_next_read += rf->rf_effective_interval;
+    if (align_read)
+      rf->rf_next_read =
+          read_align(rf->rf_next_read, read_align_interval(rf));
 
     /* Check, if `rf_next_read' is in the past. */
     if (rf->rf_next_read < now) {
       /* `rf_next_read' is in the past. Insert `now'
        * so this value doesn't trail off into the
-       * past too much. */
-      rf->rf_next_read = now;
+       * past too much. When aligning, skip to the next
+       * slot instead. */
+      rf->rf_next_read =
+          align_read ? read_align(now, read_align_interval(rf)) : now;
     }
 
     DEBUG("plugin_read_thread: Next read of the `%s' plugin at %.3f.",
           rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_next_read));
 
-    /* Re-insert this read function into the heap again. */
-    c_heap_insert(read_heap, rf);
+    /* Re-insert this read function into the queue again. A stolen read
+     * function stays with the thread that took it. */
+    read_queue_insert(q, rf);
+
+    /* Another thread has taken over the queue. */
+    if (state == READ_THREAD_EXIT) {
+      read_thread_exit(t);
+      return NULL;
+    }
   } /* while (read_loop) */
 
   pthread_exit(NULL);
@@ -630,36 +2221,286 @@ static void set_thread_name(pthread_t tid, char const *name) {
 #endif
 }
 
-static void start_read_threads(size_t num) /* {{{ */
+/* Creates a thread like pthread_create(3), pinned to the "index"th group of
+ * "cpus", round-robin. If "cpus" is empty, the thread is not pinned. */
+static int thread_create_cpus(pthread_t *thread, /* {{{ */
+                              core_groups_list_t const *cpus, size_t index,
+                              void *(*start_routine)(void *), void *arg) {
+  if (cpus->num_cgroups == 0)
+    return pthread_create(thread, /* attr = */ NULL, start_routine, arg);
+
+  core_group_t const *cg = cpus->cgroups + (index % cpus->num_cgroups);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  int status = thread_cpus_attr(&attr, cg);
+  if (status == 0)
+    status = pthread_create(thread, &attr, start_routine, arg);
+  pthread_attr_destroy(&attr);
+  if (status == 0)
+    return 0;
+
+  /* E.g. none of the CPUs is available to the daemon. */
+  WARNING("plugin: Pinning a thread to CPUs \"%s\" failed: %s", cg->desc,
+          STRERROR(status));
+  return pthread_create(thread, /* attr = */ NULL, start_routine, arg);
+} /* }}} int thread_create_cpus */
+
+static void destroy_read_queues(void) /* {{{ */
+{
+  if (read_queues == NULL)
+    return;
+
+  /* Move the read functions back so destroy_read_heap() can free them. */
+  for (size_t i = 0; i < read_queues_num; i++) {
+    read_func_t *rf;
+    while ((rf = c_heap_get_root(read_queues[i].heap)) != NULL)
+      c_heap_insert(read_heap, rf);
+
+    c_heap_destroy(read_queues[i].heap);
+    pthread_mutex_destroy(&read_queues[i].lock);
+    pthread_cond_destroy(&read_queues[i].cond);
+  }
+
+  sfree(read_queues);
+  read_queues_num = 0;
+
+  read_pool_default.queues = NULL;
+  read_pool_default.queues_num = 0;
+  for (size_t i = 0; i < read_pools_num; i++) {
+    read_pools[i].queues = NULL;
+    read_pools[i].queues_num = 0;
+  }
+} /* }}} void destroy_read_queues */
+
+/* Assigns "pool" its share of the "read_queues", starting at "*next". */
+static void read_pool_assign_queues(read_pool_t *pool, size_t *next) /* {{{ */
+{
+  pool->queues = read_queues + *next;
+  pool->queues_num = pool->threads_num;
+  pool->queues_next = 0;
+
+  for (size_t i = 0; i < pool->queues_num; i++)
+    pool->queues[i].pool = pool;
+
+  *next += pool->queues_num;
+} /* }}} void read_pool_assign_queues */
+
+/* Creates one read queue per read thread of all pools and distributes the
+ * registered read functions among them. Must be called with "read_lock"
+ * held. */
+static int create_read_queues(size_t num) /* {{{ */
+{
+  read_queue_t *queues = calloc(num, sizeof(*queues));
+  if (queues == NULL) {
+    ERROR("plugin: create_read_queues: calloc failed.");
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    queues[i].heap = c_heap_create(plugin_compare_read_func);
+    if (queues[i].heap == NULL) {
+      ERROR("plugin: create_read_queues: c_heap_create failed.");
+      for (size_t j = 0; j < i; j++)
+        c_heap_destroy(queues[j].heap);
+      sfree(queues);
+      return ENOMEM;
+    }
+    pthread_mutex_init(&queues[i].lock, /* attr = */ NULL);
+    pthread_cond_init(&queues[i].cond, /* attr = */ NULL);
+  }
+
+  read_queues = queues;
+  read_queues_num = num;
+
+  size_t next = 0;
+  read_pool_assign_queues(&read_pool_default, &next);
+  for (size_t i = 0; i < read_pools_num; i++)
+    read_pool_assign_queues(read_pools + i, &next);
+  assert(next == num);
+
+  cdtime_t now = cdtime();
+  read_func_t *rf;
+  while ((rf = c_heap_get_root(read_heap)) != NULL) {
+    /* The options are only known once the read functions registered by the
+     * configuration have been inserted. */
+    if (align_read)
+      rf->rf_next_read = read_align(now, rf->rf_interval);
+    else if (spread_read)
+      rf->rf_next_read = read_spread(now, rf);
+
+    read_queue_t *q = read_queue_select(rf);
+    c_heap_insert(q->heap, rf);
+    q->num++;
+  }
+
+  for (size_t i = 0; i < num; i++)
+    read_queue_update_next(read_queues + i);
+
+  return 0;
+} /* }}} int create_read_queues */
+
+/* Starts a read thread for "q" in the slot "t". Must be called with
+ * "read_threads_lock" held. */
+static int read_thread_start(read_thread_t *t, read_queue_t *q) /* {{{ */
+{
+  *t = (read_thread_t){.queue = q};
+
+  int status =
+      thread_create_cpus(&t->thread, &read_threads_cpus,
+                         (size_t)(q - read_queues), plugin_read_thread, t);
+  if (status != 0) {
+    ERROR("plugin: read_thread_start: pthread_create failed with status %i "
+          "(%s).",
+          status, STRERROR(status));
+    return status;
+  }
+  t->used = true;
+
+  size_t index = (size_t)(t - read_threads);
+  if (index >= read_threads_num)
+    read_threads_num = index + 1;
+
+  char name[THREAD_NAME_MAX];
+  ssnprintf(name, sizeof(name), "reader#%" PRIu64, (uint64_t)index);
+  set_thread_name(t->thread, name);
+  return 0;
+} /* }}} int read_thread_start */
+
+/* Handles a read thread whose callback exceeded its timeout. The callback
+ * can't be interrupted safely, so the read function stays with the thread
+ * until it returns. If possible, a new thread takes over the thread's queue
+ * in the meantime. Must be called with "read_threads_lock" held. */
+static void read_watchdog_overrun(read_thread_t *t) /* {{{ */
+{
+  t->overrun = true;
+  t->deadline = 0;
+  __atomic_fetch_add(&t->rf->rf_overruns, 1, __ATOMIC_RELAXED);
+
+  read_thread_t *slot = NULL;
+  for (size_t i = 0; i < read_threads_max; i++) {
+    if (!read_threads[i].used) {
+      slot = read_threads + i;
+      break;
+    }
+  }
+
+  if (slot == NULL) {
+    WARNING("plugin: read-function of the `%s' plugin exceeded its read "
+            "timeout. No replacement thread is started because "
+            "`ReadThreadsMax' (%" PRIsz ") has been reached.",
+            t->rf->rf_name, read_threads_max);
+    return;
+  }
+
+  if (read_thread_start(slot, t->queue) != 0)
+    return;
+  t->abandoned = true;
+
+  WARNING("plugin: read-function of the `%s' plugin exceeded its read "
+          "timeout. Started reader#%" PRIsz " to take over its read queue.",
+          t->rf->rf_name, (size_t)(slot - read_threads));
+} /* }}} void read_watchdog_overrun */
+
+/* Sleeps until the next read callback times out and joins the read threads
+ * that have been replaced. */
+static void *read_watchdog_thread(void __attribute__((unused)) * arg) /* {{{ */
+{
+  pthread_mutex_lock(&read_threads_lock);
+  while (read_watchdog_running) {
+    cdtime_t now = cdtime();
+    cdtime_t next = 0;
+
+    for (size_t i = 0; i < read_threads_num; i++) {
+      read_thread_t *t = read_threads + i;
+
+      if (!t->used)
+        continue;
+
+      if (t->exited) {
+        pthread_join(t->thread, NULL);
+        t->used = false;
+        continue;
+      }
+
+      if (t->deadline == 0)
+        continue;
+
+      if (t->deadline <= now)
+        read_watchdog_overrun(t);
+      else if ((next == 0) || (t->deadline < next))
+        next = t->deadline;
+    }
+
+    if (next == 0)
+      pthread_cond_wait(&read_watchdog_cond, &read_threads_lock);
+    else
+      pthread_cond_timedwait(&read_watchdog_cond, &read_threads_lock,
+                             &CDTIME_T_TO_TIMESPEC(next));
+  }
+  pthread_mutex_unlock(&read_threads_lock);
+
+  return NULL;
+} /* }}} void *read_watchdog_thread */
+
+/* Starts "num" threads for the default pool plus the threads of the
+ * <ReadThreadPool>s. Each pool's threads add to "max" twice, see
+ * "ReadThreadsMax". */
+static void start_read_threads(size_t num, size_t max) /* {{{ */
 {
   if (read_threads != NULL)
     return;
 
-  read_threads = calloc(num, sizeof(*read_threads));
+  read_pool_default.threads_num = num;
+  for (size_t i = 0; i < read_pools_num; i++) {
+    num += read_pools[i].threads_num;
+    max += 2 * read_pools[i].threads_num;
+  }
+
+  if (max < num)
+    max = num;
+
+  read_threads = calloc(max, sizeof(*read_threads));
   if (read_threads == NULL) {
     ERROR("plugin: start_read_threads: calloc failed.");
     return;
   }
+  read_threads_max = max;
+
+  pthread_mutex_lock(&read_lock);
+  /* The threads may have been stopped by plugin_reload_begin(). */
+  read_loop = 1;
+  int status = create_read_queues(num);
+  pthread_mutex_unlock(&read_lock);
+  if (status != 0) {
+    sfree(read_threads);
+    return;
+  }
 
+  pthread_mutex_lock(&read_threads_lock);
   read_threads_num = 0;
   for (size_t i = 0; i < num; i++) {
-    int status = pthread_create(read_threads + read_threads_num,
-                                /* attr = */ NULL, plugin_read_thread,
-                                /* arg = */ NULL);
-    if (status != 0) {
-      ERROR("plugin: start_read_threads: pthread_create failed with status %i "
-            "(%s).",
-            status, STRERROR(status));
-      return;
-    }
-
-    char name[THREAD_NAME_MAX];
-    ssnprintf(name, sizeof(name), "reader#%" PRIu64,
-              (uint64_t)read_threads_num);
-    set_thread_name(read_threads[read_threads_num], name);
+    if (read_threads_cpus.num_cgroups > 0)
+      read_queues[i].cpus =
+          read_threads_cpus.cgroups + (i % read_threads_cpus.num_cgroups);
 
-    read_threads_num++;
+    if (read_thread_start(read_threads + i, read_queues + i) != 0)
+      break;
   } /* for (i) */
+
+  read_watchdog_running = true;
+  status = pthread_create(&read_watchdog, /* attr = */ NULL,
+                          read_watchdog_thread, /* arg = */ NULL);
+  if (status != 0) {
+    ERROR("plugin: start_read_threads: Starting the watchdog thread failed "
+          "with status %i (%s).",
+          status, STRERROR(status));
+    read_watchdog_running = false;
+  }
+  pthread_mutex_unlock(&read_threads_lock);
+
+  if (status == 0)
+    set_thread_name(read_watchdog, "reader watchdog");
 } /* }}} void start_read_threads */
 
 static void stop_read_threads(void) {
@@ -670,18 +2511,82 @@ static void stop_read_threads(void) {
 
   pthread_mutex_lock(&read_lock);
   read_loop = 0;
-  DEBUG("plugin: stop_read_threads: Signalling `read_cond'");
-  pthread_cond_broadcast(&read_cond);
   pthread_mutex_unlock(&read_lock);
 
+  pthread_mutex_lock(&read_threads_lock);
+  bool watchdog_running = read_watchdog_running;
+  read_watchdog_running = false;
+  pthread_cond_signal(&read_watchdog_cond);
+  pthread_mutex_unlock(&read_threads_lock);
+  if (watchdog_running)
+    pthread_join(read_watchdog, NULL);
+
+  DEBUG("plugin: stop_read_threads: Signalling the read queues");
+  for (size_t i = 0; i < read_queues_num; i++) {
+    pthread_mutex_lock(&read_queues[i].lock);
+    pthread_cond_broadcast(&read_queues[i].cond);
+    pthread_mutex_unlock(&read_queues[i].lock);
+  }
+
+  /* Don't wait for callbacks that have exceeded their timeout already. The
+   * array is kept until these threads have returned. Until the end of this
+   * function, "orphans" holds a reference of its own. */
+  read_orphans_t *orphans = calloc(1, sizeof(*orphans));
+  size_t detached_num = 0;
+  pthread_mutex_lock(&read_threads_lock);
+  for (size_t i = 0; i < read_threads_num; i++) {
+    read_thread_t *t = read_threads + i;
+
+    if (!t->used || !t->overrun || (t->rf == NULL))
+      continue;
+
+    WARNING("plugin: read-function of the `%s' plugin is still running. "
+            "Not waiting for it.",
+            t->rf->rf_name);
+    t->detached = true;
+    t->orphans = orphans;
+    pthread_detach(t->thread);
+    detached_num++;
+  }
+  if ((detached_num > 0) && (orphans != NULL)) {
+    *orphans = (read_orphans_t){.threads = read_threads,
+                                .threads_num = read_threads_num,
+                                .running = detached_num + 1,
+                                .next = read_orphans};
+    read_orphans = orphans;
+  } else {
+    sfree(orphans);
+  }
+  pthread_mutex_unlock(&read_threads_lock);
+
   for (size_t i = 0; i < read_threads_num; i++) {
-    if (pthread_join(read_threads[i], NULL) != 0) {
+    if (!read_threads[i].used || read_threads[i].detached)
+      continue;
+
+    if (pthread_join(read_threads[i].thread, NULL) != 0) {
       ERROR("plugin: stop_read_threads: pthread_join failed.");
     }
-    read_threads[i] = (pthread_t)0;
+    read_threads[i].used = false;
+  }
+
+  /* Detached threads still access their slot when the callback returns. If
+   * "orphans" couldn't be allocated, the array is leaked. */
+  if (detached_num == 0) {
+    sfree(read_threads);
+  } else if (orphans != NULL) {
+    pthread_mutex_lock(&read_threads_lock);
+    if (!read_orphans_unref(orphans))
+      orphans = NULL;
+    pthread_mutex_unlock(&read_threads_lock);
+    read_orphans_free(orphans);
   }
-  sfree(read_threads);
+  read_threads = NULL;
   read_threads_num = 0;
+  read_threads_max = 0;
+
+  pthread_mutex_lock(&read_lock);
+  destroy_read_queues();
+  pthread_mutex_unlock(&read_lock);
 } /* void stop_read_threads */
 
 static void plugin_value_list_free(value_list_t *vl) /* {{{ */
@@ -694,36 +2599,29 @@ static void plugin_value_list_free(value_list_t *vl) /* {{{ */
   sfree(vl);
 } /* }}} void plugin_value_list_free */
 
-static value_list_t *
-plugin_value_list_clone(value_list_t const *vl_orig) /* {{{ */
-{
-  value_list_t *vl;
-
-  if (vl_orig == NULL)
-    return NULL;
-
-  vl = malloc(sizeof(*vl));
-  if (vl == NULL)
-    return NULL;
+/* Copies "vl_orig" to "vl" and fills in the host, time and interval fields if
+ * they are unset. */
+static int plugin_value_list_copy(value_list_t *vl, /* {{{ */
+                                  value_list_t const *vl_orig) {
   memcpy(vl, vl_orig, sizeof(*vl));
 
   if (vl->host[0] == 0)
     sstrncpy(vl->host, hostname_g, sizeof(vl->host));
 
   vl->values = calloc(vl_orig->values_len, sizeof(*vl->values));
-  if (vl->values == NULL) {
-    plugin_value_list_free(vl);
-    return NULL;
-  }
+  if (vl->values == NULL)
+    return ENOMEM;
   memcpy(vl->values, vl_orig->values,
          vl_orig->values_len * sizeof(*vl->values));
 
   vl->meta = meta_data_clone(vl->meta);
   if ((vl_orig->meta != NULL) && (vl->meta == NULL)) {
-    plugin_value_list_free(vl);
-    return NULL;
+    sfree(vl->values);
+    return ENOMEM;
   }
 
+  if ((vl->time == 0) && shared_read_timestamp)
+    vl->time = plugin_get_ctx().read_time;
   if (vl->time == 0)
     vl->time = cdtime();
 
@@ -731,115 +2629,936 @@ plugin_value_list_clone(value_list_t const *vl_orig) /* {{{ */
   if (vl->interval == 0)
     vl->interval = plugin_get_interval();
 
-  return vl;
-} /* }}} value_list_t *plugin_value_list_clone */
+  return 0;
+} /* }}} int plugin_value_list_copy */
 
-static int plugin_write_enqueue(value_list_t const *vl) /* {{{ */
+static value_list_t *
+plugin_value_list_clone(value_list_t const *vl_orig) /* {{{ */
 {
+  value_list_t *vl;
+
+  if (vl_orig == NULL)
+    return NULL;
+
+  vl = malloc(sizeof(*vl));
+  if (vl == NULL)
+    return NULL;
+
+  if (plugin_value_list_copy(vl, vl_orig) != 0) {
+    sfree(vl);
+    return NULL;
+  }
+
+  return vl;
+} /* }}} value_list_t *plugin_value_list_clone */
+
+static write_queue_shard_t *
+plugin_write_queue_select(write_queue_t const *q) /* {{{ */
+{
+  if (write_queues_num == 1)
+    return write_queues;
+
+  /* Uses the same hash as the value cache, so that the series of one shard
+   * only ever touch a subset of the cache's stripes. */
+  return write_queues + (q->hash % write_queues_num);
+} /* }}} write_queue_shard_t *plugin_write_queue_select */
+
+static size_t write_queue_class(write_queue_t const *q) /* {{{ */
+{
+  return (size_t)(q->ctx.write_priority - WRITE_PRIORITY_LOW);
+} /* }}} size_t write_queue_class */
+
+/* Appends the chain "head" to "tail" to the nodes of its priority class. All
+ * nodes of the chain must be of the same class. */
+static void write_queue_splice(write_queue_shard_t *wq, /* {{{ */
+                               write_queue_t *head, write_queue_t *tail,
+                               long length) {
+  size_t class = write_queue_class(head);
+
+  /* Insert after the last node of the same or the next higher class. */
+  write_queue_t *prev = NULL;
+  for (size_t i = class; (i < WRITE_PRIORITY_NUM) && (prev == NULL); i++)
+    prev = wq->tails[i];
+
+  if (prev == NULL) {
+    tail->next = wq->head;
+    wq->head = head;
+  } else {
+    tail->next = prev->next;
+    prev->next = head;
+  }
+
+  if (tail->next == NULL)
+    wq->tail = tail;
+  wq->tails[class] = tail;
+  write_queue_set_length(wq, wq->length + length);
+} /* }}} void write_queue_splice */
+
+static void write_queue_push(write_queue_shard_t *wq, /* {{{ */
+                             write_queue_t *q) {
+  write_queue_splice(wq, q, q, 1);
+} /* }}} void write_queue_push */
+
+/* Empties the queue without freeing the nodes. */
+static void write_queue_reset(write_queue_shard_t *wq) /* {{{ */
+{
+  wq->head = NULL;
+  wq->tail = NULL;
+  memset(wq->tails, 0, sizeof(wq->tails));
+  write_queue_set_length(wq, 0);
+} /* }}} void write_queue_reset */
+
+static void write_queue_destroy(write_queue_t *q) /* {{{ */
+{
+  if (q == NULL)
+    return;
+
+  meta_data_destroy(q->meta);
+  if (q->values != q->data)
+    sfree(q->values);
+
+  /* pool_free() falls back to free(3) if there is no pool. */
+  pool_free(write_queue_pool, q);
+} /* }}} void write_queue_destroy */
+
+static void write_queue_free(write_queue_t *q) /* {{{ */
+{
+  while (q != NULL) {
+    write_queue_t *next = q->next;
+
+    write_queue_destroy(q);
+    q = next;
+  }
+} /* }}} void write_queue_free */
+
+/* Appends "str" including its null byte at "*ptr" and advances "*ptr". */
+static void write_queue_pack(char **ptr, char const *str, /* {{{ */
+                             size_t len) {
+  memcpy(*ptr, str, len);
+  (*ptr)[len] = 0;
+  *ptr += len + 1;
+} /* }}} void write_queue_pack */
+
+/* Creates a node for "vl" with the type instance and values replaced by
+ * "type_instance" and "values". */
+static write_queue_t *
+write_queue_create_instance(value_list_t const *vl, /* {{{ */
+                            char const *type_instance, value_t const *values) {
   write_queue_t *q;
 
-  q = malloc(sizeof(*q));
+  if (write_queue_pool != NULL)
+    q = pool_alloc(write_queue_pool);
+  else
+    q = malloc(sizeof(*q));
   if (q == NULL)
-    return ENOMEM;
+    return NULL;
   q->next = NULL;
 
-  q->vl = plugin_value_list_clone(vl);
-  if (q->vl == NULL) {
-    sfree(q);
-    return ENOMEM;
+  char const *host = (vl->host[0] != 0) ? vl->host : hostname_g;
+  size_t host_len = strnlen(host, DATA_MAX_NAME_LEN - 1);
+  size_t plugin_len = strnlen(vl->plugin, sizeof(vl->plugin) - 1);
+  size_t plugin_instance_len =
+      strnlen(vl->plugin_instance, sizeof(vl->plugin_instance) - 1);
+  size_t type_len = strnlen(vl->type, sizeof(vl->type) - 1);
+  size_t type_instance_len =
+      strnlen(type_instance, sizeof(vl->type_instance) - 1);
+
+  size_t size = vl->values_len * sizeof(*q->values) + host_len + plugin_len +
+                plugin_instance_len + type_len + type_instance_len + 5;
+  if (size <= sizeof(q->data))
+    q->values = q->data;
+  else
+    q->values = malloc(size);
+  if (q->values == NULL) {
+    pool_free(write_queue_pool, q);
+    return NULL;
+  }
+
+  q->meta = meta_data_clone(vl->meta);
+  if ((vl->meta != NULL) && (q->meta == NULL)) {
+    if (q->values != q->data)
+      sfree(q->values);
+    pool_free(write_queue_pool, q);
+    return NULL;
   }
 
+  memcpy(q->values, values, vl->values_len * sizeof(*q->values));
+  char *ptr = (char *)(q->values + vl->values_len);
+  write_queue_pack(&ptr, host, host_len);
+  write_queue_pack(&ptr, vl->plugin, plugin_len);
+  write_queue_pack(&ptr, vl->plugin_instance, plugin_instance_len);
+  write_queue_pack(&ptr, vl->type, type_len);
+  write_queue_pack(&ptr, type_instance, type_instance_len);
+
+  q->values_len = vl->values_len;
+  q->escaped = vl->escaped;
+  q->hash = uc_hash_identifier(host, vl->plugin, vl->plugin_instance, vl->type,
+                               type_instance);
+
+  q->time = vl->time;
+  if ((q->time == 0) && shared_read_timestamp)
+    q->time = plugin_get_ctx().read_time;
+  if (q->time == 0)
+    q->time = cdtime();
+
+  /* Fill in the interval from the thread context, if it is zero. */
+  q->interval = vl->interval;
+  if (q->interval == 0)
+    q->interval = plugin_get_interval();
+
   /* Store context of caller (read plugin); otherwise, it would not be
    * available to the write plugins when actually dispatching the
    * value-list later on. */
   q->ctx = plugin_get_ctx();
 
-  pthread_mutex_lock(&write_lock);
+  read_func_t *rf = pthread_getspecific(read_adaptive_key);
+  if (rf != NULL)
+    read_adaptive_observe(rf, host, vl, type_instance);
 
-  if (write_queue_tail == NULL) {
-    write_queue_head = q;
-    write_queue_tail = q;
-    write_queue_length = 1;
-  } else {
-    write_queue_tail->next = q;
-    write_queue_tail = q;
-    write_queue_length += 1;
+  return q;
+} /* }}} write_queue_t *write_queue_create_instance */
+
+static write_queue_t *write_queue_create(value_list_t const *vl) /* {{{ */
+{
+  return write_queue_create_instance(vl, vl->type_instance, vl->values);
+} /* }}} write_queue_t *write_queue_create */
+
+/* Fills "vl" from the node. The values and the meta data are not copied and
+ * remain owned by the node. The data set is looked up again when the node is
+ * dispatched or written, since it may have been replaced in the meantime. */
+static void write_queue_unpack(write_queue_t const *q, /* {{{ */
+                               value_list_t *vl) {
+  char const *ptr = (char const *)(q->values + q->values_len);
+  char *fields[] = {vl->host, vl->plugin, vl->plugin_instance, vl->type,
+                    vl->type_instance};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+    size_t len = strlen(ptr);
+    memcpy(fields[i], ptr, len + 1);
+    ptr += len + 1;
   }
 
-  pthread_cond_signal(&write_cond);
-  pthread_mutex_unlock(&write_lock);
+  vl->values = q->values;
+  vl->values_len = q->values_len;
+  vl->time = q->time;
+  vl->interval = q->interval;
+  vl->meta = q->meta;
+  vl->ds = NULL;
+  vl->escaped = q->escaped;
+} /* }}} void write_queue_unpack */
+
+static int plugin_write_enqueue(value_list_t const *vl) /* {{{ */
+{
+  write_queue_t *q = write_queue_create(vl);
+  if (q == NULL)
+    return ENOMEM;
+
+  /* The shard is selected using the hash of the node, which has the host
+   * name filled in. */
+  write_queue_shard_t *wq = plugin_write_queue_select(q);
+
+  PROBE3(dispatch__enqueue, vl->host, vl->plugin, vl->type);
+
+  pthread_mutex_lock(&wq->lock);
+  write_queue_push(wq, q);
+  pthread_cond_signal(&wq->cond);
+  pthread_mutex_unlock(&wq->lock);
 
   return 0;
 } /* }}} int plugin_write_enqueue */
 
-static value_list_t *plugin_write_dequeue(void) /* {{{ */
-{
-  write_queue_t *q;
-  value_list_t *vl;
+/* Removes up to WRITE_BATCH_MAX value lists from the queue and returns them
+ * as a linked list. When several threads share one queue, each takes only its
+ * share of the queued value lists, so that the others are not left idle. If
+ * "wake" is not NULL, NULL is also returned as soon as "*wake" is true. */
+static write_queue_t *plugin_write_dequeue(write_queue_shard_t *wq, /* {{{ */
+                                           long consumers, bool const *wake) {
+  write_queue_t *head;
+  write_queue_t *tail;
 
-  pthread_mutex_lock(&write_lock);
+  pthread_mutex_lock(&wq->lock);
 
-  while (write_loop && (write_queue_head == NULL))
-    pthread_cond_wait(&write_cond, &write_lock);
+  while (write_loop && !wq->closed && (wq->head == NULL) &&
+         ((wake == NULL) || !*wake))
+    pthread_cond_wait(&wq->cond, &wq->lock);
 
-  if (write_queue_head == NULL) {
-    pthread_mutex_unlock(&write_lock);
+  if (wq->head == NULL) {
+    pthread_mutex_unlock(&wq->lock);
     return NULL;
   }
 
-  q = write_queue_head;
-  write_queue_head = q->next;
-  write_queue_length -= 1;
-  if (write_queue_head == NULL) {
-    write_queue_tail = NULL;
-    assert(0 == write_queue_length);
+  long num = (wq->length + consumers - 1) / consumers;
+  if (num > WRITE_BATCH_MAX)
+    num = WRITE_BATCH_MAX;
+
+  head = wq->head;
+  tail = head;
+  for (long i = 1; (i < num) && (tail->next != NULL); i++)
+    tail = tail->next;
+
+  wq->head = tail->next;
+  tail->next = NULL;
+  write_queue_set_length(wq, wq->length - num);
+  if (wq->head == NULL) {
+    wq->tail = NULL;
+    assert(0 == wq->length);
   }
 
-  pthread_mutex_unlock(&write_lock);
+  /* The nodes are sorted by class, so the classes above the class of the new
+   * head have been taken entirely. */
+  size_t class = (wq->head == NULL) ? 0 : write_queue_class(wq->head) + 1;
+  for (; class < WRITE_PRIORITY_NUM; class++)
+    wq->tails[class] = NULL;
 
-  (void)plugin_set_ctx(q->ctx);
+  PROBE2(write__dequeue, num, wq->length);
+  pthread_mutex_unlock(&wq->lock);
 
-  vl = q->vl;
-  sfree(q);
-  return vl;
-} /* }}} value_list_t *plugin_write_dequeue */
+  return head;
+} /* }}} write_queue_t *plugin_write_dequeue */
 
-static void *plugin_write_thread(void __attribute__((unused)) * args) /* {{{ */
+/* Passes the value lists collected for batch write callbacks to the
+ * callbacks and frees them. */
+static void plugin_write_batch_flush(write_thread_t *wt) /* {{{ */
 {
-  while (write_loop) {
-    value_list_t *vl = plugin_write_dequeue();
-    if (vl == NULL)
+  for (size_t i = 0; i < wt->batches_num; i++) {
+    write_batch_t *wb = wt->batches + i;
+
+    if (wb->num == 0)
       continue;
 
-    plugin_dispatch_values_internal(vl);
+    /* Keep the read plugin's interval and flush information but update the
+     * plugin name. */
+    plugin_ctx_t old_ctx = plugin_get_ctx();
+    plugin_ctx_t ctx = old_ctx;
+    ctx.name = wb->cf->cf_ctx.name;
+    plugin_set_ctx(ctx);
+
+    DEBUG("plugin: plugin_write_batch_flush: Writing %" PRIsz
+          " values via %s.",
+          wb->num, wb->name);
+    plugin_write_batch_cb callback = wb->cf->cf_callback;
+    PROBE2(write__start, wb->name, wb->num);
+    __atomic_store_n(&wt->busy_callback, wb->name, __ATOMIC_RELAXED);
+    cdtime_t latency_start = callback_latency_start();
+    int status = (*callback)(wb->ds, wb->vl, wb->num, &wb->cf->cf_udata);
+    callback_latency_add(wb->cf, latency_start);
+    __atomic_store_n(&wt->busy_callback, NULL, __ATOMIC_RELAXED);
+    plugin_stats_write(wb->cf, wb->num, status);
+    PROBE2(write__done, wb->name, status);
+    if (status != 0)
+      DEBUG("plugin: plugin_write_batch_flush: Writing via %s failed with "
+            "status %i.",
+            wb->name, status);
+
+    plugin_set_ctx(old_ctx);
+
+    for (size_t j = 0; j < wb->num; j++) {
+      plugin_value_list_free((value_list_t *)wb->vl[j]);
+      wb->vl[j] = NULL;
+    }
+    wb->num = 0;
+  }
+} /* }}} void plugin_write_batch_flush */
+
+/* Calls a batch write callback. When called from a write thread, the value
+ * list is copied and collected, and the callback is called with the entire
+ * batch once the write thread has processed all value lists it dequeued.
+ * Otherwise the callback is called with a batch of one. */
+static int plugin_write_batch_add(callback_func_t *cf, /* {{{ */
+                                  char const *name, data_set_t const *ds,
+                                  value_list_t const *vl) {
+  write_thread_t *wt = NULL;
+  if (write_threads_state != NULL)
+    wt = pthread_getspecific(write_thread_key);
+
+  if (wt == NULL) {
+    plugin_write_batch_cb callback = cf->cf_callback;
+    PROBE2(write__start, name, 1);
+    cdtime_t latency_start = callback_latency_start();
+    int status = (*callback)(&ds, &vl, 1, &cf->cf_udata);
+    callback_latency_add(cf, latency_start);
+    plugin_stats_write(cf, 1, status);
+    PROBE2(write__done, name, status);
+    return status;
+  }
+
+  write_batch_t *wb = NULL;
+  for (size_t i = 0; i < wt->batches_num; i++) {
+    if (wt->batches[i].cf == cf) {
+      wb = wt->batches + i;
+      break;
+    }
+  }
+
+  if (wb == NULL) {
+    write_batch_t *tmp =
+        realloc(wt->batches, (wt->batches_num + 1) * sizeof(*wt->batches));
+    if (tmp == NULL) {
+      ERROR("plugin: plugin_write_batch_add: realloc failed.");
+      return ENOMEM;
+    }
+    wt->batches = tmp;
+    wb = wt->batches + wt->batches_num;
+    wt->batches_num++;
+
+    memset(wb, 0, sizeof(*wb));
+    wb->cf = cf;
+    wb->name = name;
+  }
+
+  value_list_t *copy = plugin_value_list_clone(vl);
+  if (copy == NULL) {
+    ERROR("plugin: plugin_write_batch_add: plugin_value_list_clone failed.");
+    return ENOMEM;
+  }
+
+  wb->ds[wb->num] = ds;
+  wb->vl[wb->num] = copy;
+  wb->num++;
+
+  if (wb->num >= WRITE_BATCH_MAX)
+    plugin_write_batch_flush(wt);
+
+  return 0;
+} /* }}} int plugin_write_batch_add */
+
+static void *plugin_write_thread(void *args) /* {{{ */
+{
+  write_thread_t *wt = args;
+
+  pthread_setspecific(write_thread_key, wt);
+
+  long consumers = 1;
+  if (write_threads_num > write_queues_num)
+    consumers = (long)(write_threads_num / write_queues_num);
+
+  while (write_loop) {
+    write_queue_t *q = plugin_write_dequeue(wt->queue, consumers,
+                                            /* wake = */ NULL);
+    if (q != NULL)
+      __atomic_store_n(&wt->busy_since, cdtime(), __ATOMIC_RELAXED);
+
+    while (q != NULL) {
+      write_queue_t *next = q->next;
+
+      value_list_t vl;
+      write_queue_unpack(q, &vl);
+
+      (void)plugin_set_ctx(q->ctx);
+      plugin_dispatch_values_internal(&vl);
 
-    plugin_value_list_free(vl);
+      write_queue_destroy(q);
+      q = next;
+    }
+
+    plugin_write_batch_flush(wt);
+    __atomic_store_n(&wt->busy_since, 0, __ATOMIC_RELAXED);
   }
 
+  pthread_setspecific(write_thread_key, NULL);
   pthread_exit(NULL);
   return (void *)0;
 } /* }}} void *plugin_write_thread */
 
+/* Appends the value list to the spill of the write sink. Must be called with
+ * "queue.lock" held. */
+static void write_sink_spill(write_sink_t *ws, /* {{{ */
+                             value_list_t const *vl) {
+  int status = spill_append(ws->spill, vl);
+  if (status != 0) {
+    ws->dropped++;
+    c_complain(LOG_WARNING, &ws->drop_complaint,
+               "plugin: Spilling the write queue of \"%s\" failed: %s. "
+               "Dropping metrics.",
+               ws->name,
+               (status == ENOSPC) ? "WriteQueueSpillLimit reached"
+                                  : STRERROR(status));
+    return;
+  }
+
+  ws->spilled++;
+  if (!ws->spill_pending) {
+    ws->spill_pending = true;
+    pthread_cond_signal(&ws->queue.cond);
+  }
+} /* }}} void write_sink_spill */
+
+/* Copies the value list to the queue of the write sink. If the queue is above
+ * its limits, the value list is written to the spill or dropped. */
+static int write_sink_enqueue(write_sink_t *ws, /* {{{ */
+                              value_list_t const *vl) {
+  write_queue_shard_t *wq = &ws->queue;
+
+  if (ws->spill != NULL) {
+    pthread_mutex_lock(&wq->lock);
+    if (ws->spill_pending ||
+        ((ws->limit_high > 0) && (wq->length >= ws->limit_high))) {
+      write_sink_spill(ws, vl);
+      pthread_mutex_unlock(&wq->lock);
+      return 0;
+    }
+    pthread_mutex_unlock(&wq->lock);
+  } else if (ws->limit_high > 0) {
+    /* The length is read without holding the lock, like in
+     * check_drop_value(). */
+    double p = write_drop_probability_class(
+        write_drop_probability(write_queue_get_length(wq), ws->limit_low,
+                               ws->limit_high),
+        plugin_get_ctx().write_priority);
+    if ((p > 0.0) && ((p == 1.0) || (p > cdrand_d()))) {
+      pthread_mutex_lock(&wq->lock);
+      ws->dropped++;
+      c_complain(LOG_WARNING, &ws->drop_complaint,
+                 "plugin: The write queue of \"%s\" is full. Dropping "
+                 "%.0f%% of metrics.",
+                 ws->name, 100.0 * p);
+      pthread_mutex_unlock(&wq->lock);
+      return 0;
+    }
+  }
+
+  write_queue_t *q = write_queue_create(vl);
+  if (q == NULL)
+    return ENOMEM;
+  q->enqueued = cdtime();
+
+  pthread_mutex_lock(&wq->lock);
+  write_queue_push(wq, q);
+  if ((ws->limit_high > 0) && (wq->length < ws->limit_low))
+    c_release(LOG_INFO, &ws->drop_complaint,
+              "plugin: The write queue of \"%s\" is below its low limit "
+              "again.",
+              ws->name);
+  pthread_cond_signal(&wq->cond);
+  pthread_mutex_unlock(&wq->lock);
+
+  return 0;
+} /* }}} int write_sink_enqueue */
+
+/* Passes "num" value lists to the callback of the write sink. Returns
+ * non-zero if any of them could not be written. */
+static int write_sink_write(write_sink_t *ws, data_set_t const **ds, /* {{{ */
+                            value_list_t const **vl, size_t num,
+                            bool spill_failed) {
+  callback_func_t *cf = ws->cf;
+  int ret = 0;
+
+  if (cf->cf_batch) {
+    plugin_write_batch_cb callback = cf->cf_callback;
+    PROBE2(write__start, ws->name, num);
+    cdtime_t latency_start = callback_latency_start();
+    ret = (*callback)(ds, vl, num, &cf->cf_udata);
+    callback_latency_add(cf, latency_start);
+    plugin_stats_write(cf, num, ret);
+    PROBE2(write__done, ws->name, ret);
+    if (ret != 0)
+      DEBUG("plugin: write_sink_thread: Writing via %s failed with "
+            "status %i.",
+            ws->name, ret);
+    if ((ret != 0) && spill_failed) {
+      pthread_mutex_lock(&ws->queue.lock);
+      for (size_t i = 0; i < num; i++)
+        write_sink_spill(ws, vl[i]);
+      pthread_mutex_unlock(&ws->queue.lock);
+    }
+    return ret;
+  }
+
+  plugin_write_cb callback = cf->cf_callback;
+  for (size_t i = 0; i < num; i++) {
+    PROBE2(write__start, ws->name, 1);
+    cdtime_t latency_start = callback_latency_start();
+    int status = (*callback)(ds[i], vl[i], &cf->cf_udata);
+    callback_latency_add(cf, latency_start);
+    plugin_stats_write(cf, 1, status);
+    PROBE2(write__done, ws->name, status);
+    if (status == 0)
+      continue;
+
+    DEBUG("plugin: write_sink_thread: Writing via %s failed with "
+          "status %i.",
+          ws->name, status);
+    ret = status;
+    if (spill_failed) {
+      pthread_mutex_lock(&ws->queue.lock);
+      write_sink_spill(ws, vl[i]);
+      pthread_mutex_unlock(&ws->queue.lock);
+    }
+  }
+
+  return ret;
+} /* }}} int write_sink_write */
+
+/* Writes the oldest value lists of the spill. If the write plugin fails, the
+ * value lists are kept and retried after an exponential backoff. */
+static void write_sink_replay(write_sink_t *ws) /* {{{ */
+{
+  write_queue_shard_t *wq = &ws->queue;
+  data_set_t const *ds[WRITE_BATCH_MAX];
+  value_list_t *vl[WRITE_BATCH_MAX];
+  size_t num = 0;
+
+  int status = spill_read(ws->spill, vl, STATIC_ARRAY_SIZE(vl), &num);
+  if ((status == 0) && (num == 0)) {
+    spill_commit(ws->spill);
+    pthread_mutex_lock(&wq->lock);
+    if (spill_empty(ws->spill))
+      ws->spill_pending = false;
+    pthread_mutex_unlock(&wq->lock);
+    return;
+  }
+
+  if (status != 0) {
+    ERROR("plugin: Reading the spill of \"%s\" failed: %s", ws->name,
+          STRERROR(status));
+  } else {
+    /* Value lists whose type is unknown by now are skipped. */
+    size_t valid = 0;
+    for (size_t i = 0; i < num; i++) {
+      ds[valid] = plugin_get_ds(vl[i]->type);
+      if (ds[valid] == NULL) {
+        plugin_value_list_free(vl[i]);
+        continue;
+      }
+      vl[valid] = vl[i];
+      valid++;
+    }
+    num = valid;
+
+    /* Like plugin_write(), but with the interval stored in the spill. */
+    plugin_ctx_t ctx = ws->cf->cf_ctx;
+    if (num > 0)
+      ctx.interval = vl[0]->interval;
+    plugin_set_ctx(ctx);
+
+    status = write_sink_write(ws, ds, (value_list_t const **)vl, num,
+                              /* spill_failed = */ false);
+    for (size_t i = 0; i < num; i++)
+      plugin_value_list_free(vl[i]);
+  }
+
+  if (status == 0) {
+    spill_commit(ws->spill);
+    ws->replay_backoff = 0;
+
+    pthread_mutex_lock(&wq->lock);
+    ws->replayed += (derive_t)num;
+    pthread_mutex_unlock(&wq->lock);
+    return;
+  }
+
+  spill_rewind(ws->spill);
+  if (ws->replay_backoff == 0)
+    ws->replay_backoff = WRITE_SINK_BACKOFF_MIN;
+  else if (ws->replay_backoff < WRITE_SINK_BACKOFF_MAX)
+    ws->replay_backoff *= 2;
+  if (ws->replay_backoff > WRITE_SINK_BACKOFF_MAX)
+    ws->replay_backoff = WRITE_SINK_BACKOFF_MAX;
+
+  cdtime_t deadline = cdtime() + ws->replay_backoff;
+  struct timespec ts = CDTIME_T_TO_TIMESPEC(deadline);
+
+  pthread_mutex_lock(&wq->lock);
+  while (write_loop && !wq->closed && (cdtime() < deadline))
+    pthread_cond_timedwait(&wq->cond, &wq->lock, &ts);
+  pthread_mutex_unlock(&wq->lock);
+} /* }}} void write_sink_replay */
+
+static void *write_sink_thread(void *args) /* {{{ */
+{
+  write_sink_t *ws = args;
+
+  while (write_loop && !ws->queue.closed) {
+    write_queue_t *head = plugin_write_dequeue(
+        &ws->queue, /* consumers = */ 1,
+        (ws->spill != NULL) ? &ws->spill_pending : NULL);
+    if (head == NULL) {
+      /* The in-memory queue is always written first. The spill is replayed
+       * once it is empty. */
+      if (ws->spill != NULL)
+        write_sink_replay(ws);
+      continue;
+    }
+
+    write_queue_t const *nodes[WRITE_BATCH_MAX];
+    data_set_t const *ds[WRITE_BATCH_MAX];
+    value_list_t const *vl[WRITE_BATCH_MAX];
+    value_list_t vl_data[WRITE_BATCH_MAX];
+    size_t num = 0;
+
+    for (write_queue_t *q = head; q != NULL; q = q->next) {
+      write_queue_unpack(q, vl_data + num);
+      /* Value lists whose type has been unregistered by now are skipped. */
+      ds[num] = plugin_get_ds(vl_data[num].type);
+      if (ds[num] == NULL)
+        continue;
+      nodes[num] = q;
+      vl[num] = vl_data + num;
+      num++;
+    }
+
+    /* The context has the read plugin's interval and the write plugin's
+     * name, see plugin_write(). */
+    plugin_set_ctx(head->ctx);
+    if (ws->cf->cf_batch && (num > 0)) {
+      write_sink_write(ws, ds, vl, num,
+                       /* spill_failed = */ ws->spill != NULL);
+    } else {
+      for (size_t i = 0; i < num; i++) {
+        plugin_set_ctx(nodes[i]->ctx);
+        write_sink_write(ws, ds + i, vl + i, 1,
+                         /* spill_failed = */ ws->spill != NULL);
+      }
+    }
+
+    /* "head" is the oldest value list of the batch. */
+    cdtime_t latency = cdtime() - head->enqueued;
+    pthread_mutex_lock(&ws->queue.lock);
+    if (latency > ws->latency_max)
+      ws->latency_max = latency;
+    pthread_mutex_unlock(&ws->queue.lock);
+
+    write_queue_free(head);
+  }
+
+  pthread_exit(NULL);
+  return (void *)0;
+} /* }}} void *write_sink_thread */
+
+static void write_sink_start(write_sink_t *ws) /* {{{ */
+{
+  if (ws->thread_running)
+    return;
+
+  pthread_mutex_lock(&ws->queue.lock);
+  ws->queue.closed = false;
+  pthread_mutex_unlock(&ws->queue.lock);
+
+  /* Write sinks are pinned like write threads, continuing after them. */
+  int status = thread_create_cpus(&ws->thread, &write_threads_cpus,
+                                  write_threads_num + write_sinks_started,
+                                  write_sink_thread, /* arg = */ ws);
+  if (status != 0) {
+    ERROR("plugin: write_sink_start: pthread_create failed with status %i "
+          "(%s).",
+          status, STRERROR(status));
+    return;
+  }
+  ws->thread_running = true;
+  write_sinks_started++;
+
+  char name[THREAD_NAME_MAX];
+  sstrncpy(name, ws->name, sizeof(name));
+  set_thread_name(ws->thread, name);
+} /* }}} void write_sink_start */
+
+static void write_sink_stop(write_sink_t *ws) /* {{{ */
+{
+  if (!ws->thread_running)
+    return;
+
+  pthread_mutex_lock(&ws->queue.lock);
+  ws->queue.closed = true;
+  pthread_cond_broadcast(&ws->queue.cond);
+  pthread_mutex_unlock(&ws->queue.lock);
+
+  if (pthread_join(ws->thread, NULL) != 0)
+    ERROR("plugin: write_sink_stop: pthread_join failed.");
+  ws->thread_running = false;
+} /* }}} void write_sink_stop */
+
+static write_sink_t *write_sink_create(char const *name, /* {{{ */
+                                       callback_func_t *cf) {
+  write_sink_t *ws = calloc(1, sizeof(*ws));
+  if (ws == NULL) {
+    ERROR("plugin: write_sink_create: calloc failed.");
+    return NULL;
+  }
+
+  ws->name = strdup(name);
+  if (ws->name == NULL) {
+    ERROR("plugin: write_sink_create: strdup failed.");
+    sfree(ws);
+    return NULL;
+  }
+  ws->cf = cf;
+  pthread_mutex_init(&ws->queue.lock, /* attr = */ NULL);
+  pthread_cond_init(&ws->queue.cond, /* attr = */ NULL);
+  C_COMPLAIN_INIT(&ws->drop_complaint);
+
+  ws->limit_high = (long)cf->cf_ctx.write_queue_limit_high;
+  if (ws->limit_high < 0) {
+    ERROR("plugin: WriteQueueLimitHigh of \"%s\" must be positive or zero.",
+          name);
+    ws->limit_high = 0;
+  }
+  ws->limit_low = (long)cf->cf_ctx.write_queue_limit_low;
+  if (ws->limit_low <= 0) {
+    ws->limit_low = ws->limit_high / 2;
+  } else if (ws->limit_low > ws->limit_high) {
+    ERROR("plugin: WriteQueueLimitLow of \"%s\" must not be larger than "
+          "WriteQueueLimitHigh.",
+          name);
+    ws->limit_low = ws->limit_high;
+  }
+
+  if (cf->cf_ctx.write_queue_spill) {
+    char dir[PATH_MAX];
+    char sink_name[DATA_MAX_NAME_LEN];
+    int limit = cf->cf_ctx.write_queue_spill_limit;
+    if (limit <= 0)
+      limit = WRITE_SINK_SPILL_LIMIT_DEFAULT;
+
+    sstrncpy(sink_name, name, sizeof(sink_name));
+    escape_slashes(sink_name, sizeof(sink_name));
+    snprintf(dir, sizeof(dir), "%s/spill/%s", global_option_get("BaseDir"),
+             sink_name);
+
+    ws->spill = spill_create(dir, (uint64_t)limit * 1024 * 1024);
+    if (ws->spill == NULL)
+      ERROR("plugin: Creating the spill of \"%s\" in \"%s\" failed. Values "
+            "will be dropped instead.",
+            name, dir);
+    else
+      ws->spill_pending = !spill_empty(ws->spill);
+  }
+
+  pthread_mutex_lock(&write_sinks_lock);
+  ws->next = write_sinks;
+  write_sinks = ws;
+  /* Sinks created before start_write_threads() are started by it. */
+  if (write_threads != NULL)
+    write_sink_start(ws);
+  pthread_mutex_unlock(&write_sinks_lock);
+
+  return ws;
+} /* }}} write_sink_t *write_sink_create */
+
+static void write_sink_destroy(write_sink_t *ws) /* {{{ */
+{
+  if (ws == NULL)
+    return;
+
+  pthread_mutex_lock(&write_sinks_lock);
+  for (write_sink_t **prev = &write_sinks; *prev != NULL;
+       prev = &(*prev)->next) {
+    if (*prev == ws) {
+      *prev = ws->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&write_sinks_lock);
+
+  write_sink_stop(ws);
+
+  /* Value lists still in memory are kept in the spill for the next start. */
+  if ((ws->spill != NULL) && (ws->queue.length > 0)) {
+    for (write_queue_t *q = ws->queue.head; q != NULL; q = q->next) {
+      value_list_t vl;
+      write_queue_unpack(q, &vl);
+      write_sink_spill(ws, &vl);
+    }
+    write_queue_set_length(&ws->queue, 0);
+  }
+  spill_destroy(ws->spill);
+
+  if (ws->queue.length > 0)
+    WARNING("plugin: %ld value list%s left in the write queue of \"%s\".",
+            ws->queue.length, (ws->queue.length == 1) ? " was" : "s were",
+            ws->name);
+  write_queue_free(ws->queue.head);
+
+  pthread_cond_destroy(&ws->queue.cond);
+  pthread_mutex_destroy(&ws->queue.lock);
+  sfree(ws->name);
+  sfree(ws);
+} /* }}} void write_sink_destroy */
+
+/* Registers a write callback. Callbacks registered with the "WriteQueue"
+ * option get a write sink. */
+static int register_write_callback(char const *name, /* {{{ */
+                                   callback_func_t *cf) {
+  if (cf->cf_ctx.write_queue) {
+    cf->cf_sink = write_sink_create(name, cf);
+    if (cf->cf_sink == NULL) {
+      destroy_callback(cf);
+      return ENOMEM;
+    }
+  }
+
+  return register_callback(&list_write, name, cf);
+} /* }}} int register_write_callback */
+
+/* Replaces the single default write queue with one shard per write thread.
+ * Must be called before any other thread is started, i.e. before the init
+ * callbacks are run. Value lists that have been enqueued earlier are moved to
+ * their new shard. */
+static int plugin_write_queue_shard(size_t num) /* {{{ */
+{
+  if ((num < 2) || (write_queues != &write_queue_default))
+    return 0;
+
+  write_queue_shard_t *shards = calloc(num, sizeof(*shards));
+  if (shards == NULL) {
+    ERROR("plugin: plugin_write_queue_shard: calloc failed.");
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    pthread_mutex_init(&shards[i].lock, /* attr = */ NULL);
+    pthread_cond_init(&shards[i].cond, /* attr = */ NULL);
+  }
+
+  pthread_mutex_lock(&write_queue_default.lock);
+
+  write_queue_t *q = write_queue_default.head;
+  while (q != NULL) {
+    write_queue_t *next = q->next;
+
+    q->next = NULL;
+    write_queue_push(shards + (q->hash % num), q);
+    q = next;
+  }
+  write_queue_reset(&write_queue_default);
+
+  write_queues = shards;
+  write_queues_num = num;
+
+  pthread_mutex_unlock(&write_queue_default.lock);
+
+  return 0;
+} /* }}} int plugin_write_queue_shard */
+
 static void start_write_threads(size_t num) /* {{{ */
 {
   if (write_threads != NULL)
     return;
 
+  pthread_mutex_lock(&write_threads_lock);
   write_threads = calloc(num, sizeof(*write_threads));
-  if (write_threads == NULL) {
+  write_threads_state = calloc(num, sizeof(*write_threads_state));
+  if ((write_threads == NULL) || (write_threads_state == NULL)) {
     ERROR("plugin: start_write_threads: calloc failed.");
+    sfree(write_threads);
+    sfree(write_threads_state);
+    pthread_mutex_unlock(&write_threads_lock);
     return;
   }
 
+  write_loop = true;
   write_threads_num = 0;
   for (size_t i = 0; i < num; i++) {
-    int status = pthread_create(write_threads + write_threads_num,
-                                /* attr = */ NULL, plugin_write_thread,
-                                /* arg = */ NULL);
+    write_thread_t *wt = write_threads_state + write_threads_num;
+    wt->queue = write_queues + (write_threads_num % write_queues_num);
+
+    int status = thread_create_cpus(write_threads + write_threads_num,
+                                    &write_threads_cpus, write_threads_num,
+                                    plugin_write_thread, /* arg = */ wt);
     if (status != 0) {
       ERROR("plugin: start_write_threads: pthread_create failed with status %i "
             "(%s).",
             status, STRERROR(status));
+      pthread_mutex_unlock(&write_threads_lock);
       return;
     }
 
@@ -850,11 +3569,18 @@ static void start_write_threads(size_t num) /* {{{ */
 
     write_threads_num++;
   } /* for (i) */
+  pthread_mutex_unlock(&write_threads_lock);
+
+  pthread_mutex_lock(&write_sinks_lock);
+  for (write_sink_t *ws = write_sinks; ws != NULL; ws = ws->next)
+    write_sink_start(ws);
+  pthread_mutex_unlock(&write_sinks_lock);
 } /* }}} void start_write_threads */
 
-static void stop_write_threads(void) /* {{{ */
+/* Stops the write threads and the write sinks. Value lists that are still
+ * queued are kept and handled once the threads have been started again. */
+static void pause_write_threads(void) /* {{{ */
 {
-  write_queue_t *q;
   size_t i;
 
   if (write_threads == NULL)
@@ -862,12 +3588,16 @@ static void stop_write_threads(void) /* {{{ */
 
   INFO("collectd: Stopping %" PRIsz " write threads.", write_threads_num);
 
-  pthread_mutex_lock(&write_lock);
+  for (i = 0; i < write_queues_num; i++)
+    pthread_mutex_lock(&write_queues[i].lock);
   write_loop = false;
-  DEBUG("plugin: stop_write_threads: Signalling `write_cond'");
-  pthread_cond_broadcast(&write_cond);
-  pthread_mutex_unlock(&write_lock);
+  DEBUG("plugin: stop_write_threads: Signalling write queues");
+  for (i = 0; i < write_queues_num; i++) {
+    pthread_cond_broadcast(&write_queues[i].cond);
+    pthread_mutex_unlock(&write_queues[i].lock);
+  }
 
+  pthread_mutex_lock(&write_threads_lock);
   for (i = 0; i < write_threads_num; i++) {
     if (pthread_join(write_threads[i], NULL) != 0) {
       ERROR("plugin: stop_write_threads: pthread_join failed.");
@@ -875,34 +3605,421 @@ static void stop_write_threads(void) /* {{{ */
     write_threads[i] = (pthread_t)0;
   }
   sfree(write_threads);
+  pthread_mutex_unlock(&write_threads_lock);
+
+  /* The write sinks are stopped after the write threads, which fill their
+   * queues. Value lists left in their queues are freed when the callbacks are
+   * unregistered. */
+  pthread_mutex_lock(&write_sinks_lock);
+  for (write_sink_t *ws = write_sinks; ws != NULL; ws = ws->next)
+    write_sink_stop(ws);
+  pthread_mutex_unlock(&write_sinks_lock);
+
+  pthread_mutex_lock(&write_threads_lock);
+  for (i = 0; i < write_threads_num; i++)
+    sfree(write_threads_state[i].batches);
+  sfree(write_threads_state);
   write_threads_num = 0;
+  pthread_mutex_unlock(&write_threads_lock);
+} /* }}} void pause_write_threads */
 
-  pthread_mutex_lock(&write_lock);
-  i = 0;
-  for (q = write_queue_head; q != NULL;) {
-    write_queue_t *q1 = q;
-    plugin_value_list_free(q->vl);
-    q = q->next;
-    sfree(q1);
-    i++;
-  }
-  write_queue_head = NULL;
-  write_queue_tail = NULL;
-  write_queue_length = 0;
-  pthread_mutex_unlock(&write_lock);
-
-  if (i > 0) {
+static void stop_write_threads(void) /* {{{ */
+{
+  write_queue_t *q;
+  size_t i;
+
+  if (write_threads == NULL)
+    return;
+
+  pause_write_threads();
+
+  size_t num_left = 0;
+  for (i = 0; i < write_queues_num; i++) {
+    write_queue_shard_t *wq = write_queues + i;
+
+    pthread_mutex_lock(&wq->lock);
+    for (q = wq->head; q != NULL; q = q->next)
+      num_left++;
+    write_queue_free(wq->head);
+    write_queue_reset(wq);
+    pthread_mutex_unlock(&wq->lock);
+  }
+
+  if (write_queues != &write_queue_default) {
+    for (i = 0; i < write_queues_num; i++) {
+      pthread_cond_destroy(&write_queues[i].cond);
+      pthread_mutex_destroy(&write_queues[i].lock);
+    }
+    sfree(write_queues);
+    write_queues = &write_queue_default;
+    write_queues_num = 1;
+  }
+
+  if (num_left > 0) {
     WARNING("plugin: %" PRIsz " value list%s left after shutting down "
             "the write threads.",
-            i, (i == 1) ? " was" : "s were");
+            num_left, (num_left == 1) ? " was" : "s were");
   }
 } /* }}} void stop_write_threads */
 
+static void *plugin_log_thread(void __attribute__((unused)) * args) /* {{{ */
+{
+  pthread_mutex_lock(&log_queue_lock);
+  while (true) {
+    while (log_loop && (log_queue_head == log_queue_tail) &&
+           (log_queue_suppressed == 0))
+      pthread_cond_wait(&log_queue_cond, &log_queue_lock);
+
+    if ((log_queue_head == log_queue_tail) && (log_queue_suppressed == 0))
+      break;
+
+    /* Entries between "start" and "end" are not touched by plugin_log() until
+     * "log_queue_tail" has been advanced, so the lock can be released while
+     * the callbacks run. */
+    uint64_t start = log_queue_tail;
+    uint64_t end = log_queue_head;
+    uint64_t suppressed = log_queue_suppressed;
+    log_queue_suppressed = 0;
+    pthread_mutex_unlock(&log_queue_lock);
+
+    for (uint64_t i = start; i < end; i++) {
+      log_entry_t *e = log_queue + (i % log_queue_size);
+      plugin_log_callbacks(e->level, e->msg);
+    }
+
+    if (suppressed > 0) {
+      char msg[128];
+      ssnprintf(msg, sizeof(msg),
+                "plugin: Log queue full, suppressed %" PRIu64 " messages.",
+                suppressed);
+      plugin_log_callbacks(LOG_WARNING, msg);
+    }
+
+    pthread_mutex_lock(&log_queue_lock);
+    log_queue_tail = end;
+  }
+  pthread_mutex_unlock(&log_queue_lock);
+
+  return NULL;
+} /* }}} void *plugin_log_thread */
+
+static void start_log_thread(size_t size) /* {{{ */
+{
+  if ((size == 0) || (log_queue != NULL))
+    return;
+
+  log_entry_t *queue = calloc(size, sizeof(*queue));
+  if (queue == NULL) {
+    ERROR("plugin: start_log_thread: calloc failed.");
+    return;
+  }
+
+  pthread_mutex_lock(&log_queue_lock);
+  log_queue = queue;
+  log_queue_size = size;
+  log_queue_head = 0;
+  log_queue_tail = 0;
+  log_loop = true;
+  pthread_mutex_unlock(&log_queue_lock);
+
+  int status = pthread_create(&log_thread, /* attr = */ NULL,
+                              plugin_log_thread, /* arg = */ NULL);
+  if (status != 0) {
+    pthread_mutex_lock(&log_queue_lock);
+    log_loop = false;
+    pthread_mutex_unlock(&log_queue_lock);
+
+    /* Hand over messages queued in the meantime. */
+    plugin_log_thread(NULL);
+
+    pthread_mutex_lock(&log_queue_lock);
+    sfree(log_queue);
+    log_queue_size = 0;
+    pthread_mutex_unlock(&log_queue_lock);
+
+    ERROR("plugin: start_log_thread: pthread_create failed with status %i "
+          "(%s).",
+          status, STRERROR(status));
+    return;
+  }
+
+  set_thread_name(log_thread, "log");
+} /* }}} void start_log_thread */
+
+/* Blocks until all queued messages have been handed to the log callbacks. */
+static void stop_log_thread(void) /* {{{ */
+{
+  if (log_queue == NULL)
+    return;
+
+  pthread_mutex_lock(&log_queue_lock);
+  log_loop = false;
+  pthread_cond_broadcast(&log_queue_cond);
+  pthread_mutex_unlock(&log_queue_lock);
+
+  if (pthread_join(log_thread, NULL) != 0)
+    ERROR("plugin: stop_log_thread: pthread_join failed.");
+
+  pthread_mutex_lock(&log_queue_lock);
+  sfree(log_queue);
+  log_queue_size = 0;
+  pthread_mutex_unlock(&log_queue_lock);
+} /* }}} void stop_log_thread */
+
+static void notification_queue_free(notification_queue_t *q) /* {{{ */
+{
+  if (q == NULL)
+    return;
+
+  if (q->n.meta != NULL)
+    plugin_notification_meta_free(q->n.meta);
+  sfree(q);
+} /* }}} void notification_queue_free */
+
+static void *plugin_notification_thread(void __attribute__((unused)) *
+                                        args) /* {{{ */
+{
+  while (true) {
+    pthread_mutex_lock(&notif_queue_lock);
+    while (notif_loop && (notif_queue_head == NULL))
+      pthread_cond_wait(&notif_queue_cond, &notif_queue_lock);
+
+    /* The queue is drained before the threads exit. */
+    notification_queue_t *q = notif_queue_head;
+    if (q == NULL) {
+      pthread_mutex_unlock(&notif_queue_lock);
+      break;
+    }
+
+    notif_queue_head = q->next;
+    if (notif_queue_head == NULL)
+      notif_queue_tail = NULL;
+    notif_queue_length--;
+    pthread_mutex_unlock(&notif_queue_lock);
+
+    plugin_notification_callbacks(&q->n);
+    notification_queue_free(q);
+  }
+
+  return NULL;
+} /* }}} void *plugin_notification_thread */
+
+static void start_notification_threads(size_t num) /* {{{ */
+{
+  if ((num == 0) || (notif_threads != NULL))
+    return;
+
+  notif_threads = calloc(num, sizeof(*notif_threads));
+  if (notif_threads == NULL) {
+    ERROR("plugin: start_notification_threads: calloc failed.");
+    return;
+  }
+
+  pthread_mutex_lock(&notif_queue_lock);
+  notif_loop = true;
+  pthread_mutex_unlock(&notif_queue_lock);
+
+  notif_threads_num = 0;
+  for (size_t i = 0; i < num; i++) {
+    int status = pthread_create(notif_threads + notif_threads_num,
+                                /* attr = */ NULL, plugin_notification_thread,
+                                /* arg = */ NULL);
+    if (status != 0) {
+      ERROR("plugin: start_notification_threads: pthread_create failed with "
+            "status %i (%s).",
+            status, STRERROR(status));
+      break;
+    }
+
+    char name[THREAD_NAME_MAX];
+    ssnprintf(name, sizeof(name), "notify#%" PRIu64,
+              (uint64_t)notif_threads_num);
+    set_thread_name(notif_threads[notif_threads_num], name);
+
+    notif_threads_num++;
+  }
+
+  if (notif_threads_num == 0) {
+    pthread_mutex_lock(&notif_queue_lock);
+    notif_loop = false;
+    pthread_mutex_unlock(&notif_queue_lock);
+
+    /* Handle notifications queued in the meantime. */
+    plugin_notification_thread(NULL);
+    sfree(notif_threads);
+  }
+} /* }}} void start_notification_threads */
+
+/* Blocks until all queued notifications have been handled. */
+static void stop_notification_threads(void) /* {{{ */
+{
+  if (notif_threads == NULL)
+    return;
+
+  pthread_mutex_lock(&notif_queue_lock);
+  notif_loop = false;
+  pthread_cond_broadcast(&notif_queue_cond);
+  pthread_mutex_unlock(&notif_queue_lock);
+
+  for (size_t i = 0; i < notif_threads_num; i++) {
+    if (pthread_join(notif_threads[i], NULL) != 0)
+      ERROR("plugin: stop_notification_threads: pthread_join failed.");
+  }
+  sfree(notif_threads);
+  notif_threads_num = 0;
+} /* }}} void stop_notification_threads */
+
+static void cache_event_queue_free(cache_event_queue_t *q) /* {{{ */
+{
+  if (q == NULL)
+    return;
+
+  meta_data_destroy(q->vl.meta);
+  sfree(q->vl.values);
+  sfree(q);
+} /* }}} void cache_event_queue_free */
+
+static void *plugin_cache_event_thread(void __attribute__((unused)) *
+                                       args) /* {{{ */
+{
+  while (true) {
+    pthread_mutex_lock(&cache_event_lock);
+    while (cache_event_loop && (cache_event_queue_head == NULL))
+      pthread_cond_wait(&cache_event_cond, &cache_event_lock);
+
+    /* The queue is drained before the thread exits. */
+    cache_event_queue_t *q = cache_event_queue_head;
+    if (q == NULL) {
+      pthread_mutex_unlock(&cache_event_lock);
+      break;
+    }
+
+    cache_event_queue_head = q->next;
+    if (cache_event_queue_head == NULL)
+      cache_event_queue_tail = NULL;
+    cache_event_queue_length--;
+    pthread_mutex_unlock(&cache_event_lock);
+
+    plugin_cache_event_callbacks(q->type, q->callbacks_mask, q->name, &q->vl);
+    cache_event_queue_free(q);
+
+    pthread_mutex_lock(&cache_event_lock);
+    cache_event_handled++;
+    pthread_cond_broadcast(&cache_event_handled_cond);
+    pthread_mutex_unlock(&cache_event_lock);
+  }
+
+  return NULL;
+} /* }}} void *plugin_cache_event_thread */
+
+static void start_cache_event_thread(void) /* {{{ */
+{
+  if (cache_event_thread_running)
+    return;
+
+  pthread_mutex_lock(&cache_event_lock);
+  cache_event_loop = true;
+  pthread_mutex_unlock(&cache_event_lock);
+
+  int status = pthread_create(&cache_event_thread, /* attr = */ NULL,
+                              plugin_cache_event_thread, /* arg = */ NULL);
+  if (status != 0) {
+    pthread_mutex_lock(&cache_event_lock);
+    cache_event_loop = false;
+    pthread_mutex_unlock(&cache_event_lock);
+
+    /* Handle events queued in the meantime. */
+    plugin_cache_event_thread(NULL);
+
+    ERROR("plugin: start_cache_event_thread: pthread_create failed with "
+          "status %i (%s).",
+          status, STRERROR(status));
+    return;
+  }
+
+  set_thread_name(cache_event_thread, "cache events");
+  cache_event_thread_running = true;
+} /* }}} void start_cache_event_thread */
+
+/* Blocks until all queued cache events have been handled. */
+static void stop_cache_event_thread(void) /* {{{ */
+{
+  if (!cache_event_thread_running)
+    return;
+
+  pthread_mutex_lock(&cache_event_lock);
+  cache_event_loop = false;
+  pthread_cond_broadcast(&cache_event_cond);
+  pthread_mutex_unlock(&cache_event_lock);
+
+  if (pthread_join(cache_event_thread, NULL) != 0)
+    ERROR("plugin: stop_cache_event_thread: pthread_join failed.");
+  cache_event_thread_running = false;
+} /* }}} void stop_cache_event_thread */
+
+/* Frees the index built by plugin_dir_index(). */
+static void plugin_dir_index_free(void) /* {{{ */
+{
+  void *key;
+  void *value;
+
+  if (plugindir_index == NULL)
+    return;
+
+  while (c_avl_pick(plugindir_index, &key, &value) == 0)
+    sfree(key);
+
+  c_avl_destroy(plugindir_index);
+  plugindir_index = NULL;
+} /* }}} void plugin_dir_index_free */
+
+/* Reads the plugin directory once and indexes its entries by their
+ * (case-insensitive) file name, so that plugin_load() doesn't have to scan the
+ * directory for each LoadPlugin statement. Keys and values are the same
+ * string. */
+static int plugin_dir_index(char const *dir) /* {{{ */
+{
+  DIR *dh;
+  struct dirent *de;
+
+  if (plugindir_index != NULL)
+    return 0;
+
+  if ((dh = opendir(dir)) == NULL) {
+    ERROR("plugin_load: opendir (%s) failed: %s", dir, STRERRNO);
+    return -1;
+  }
+
+  plugindir_index =
+      c_avl_create((int (*)(const void *, const void *))strcasecmp);
+  if (plugindir_index == NULL) {
+    closedir(dh);
+    return ENOMEM;
+  }
+
+  while ((de = readdir(dh)) != NULL) {
+    char *name = strdup(de->d_name);
+    if (name == NULL) {
+      closedir(dh);
+      plugin_dir_index_free();
+      return ENOMEM;
+    }
+
+    /* Keep the first of several names that differ only in case. */
+    if (c_avl_insert(plugindir_index, name, name) != 0)
+      sfree(name);
+  }
+
+  closedir(dh);
+  return 0;
+} /* }}} int plugin_dir_index */
+
 /*
  * Public functions
  */
 void plugin_set_dir(const char *dir) {
   sfree(plugindir);
+  plugin_dir_index_free();
 
   if (dir == NULL) {
     plugindir = NULL;
@@ -924,7 +4041,7 @@ bool plugin_is_loaded(char const *name) {
   return status == 0;
 }
 
-static int plugin_mark_loaded(char const *name) {
+static int plugin_mark_loaded(char const *name, void *dlh) {
   char *name_copy;
   int status;
 
@@ -933,7 +4050,7 @@ static int plugin_mark_loaded(char const *name) {
     return ENOMEM;
 
   status = c_avl_insert(plugins_loaded,
-                        /* key = */ name_copy, /* value = */ NULL);
+                        /* key = */ name_copy, /* value = */ dlh);
   return status;
 }
 
@@ -944,10 +4061,9 @@ static void plugin_free_loaded(void) {
   if (plugins_loaded == NULL)
     return;
 
-  while (c_avl_pick(plugins_loaded, &key, &value) == 0) {
+  /* The shared objects stay loaded until the process exits. */
+  while (c_avl_pick(plugins_loaded, &key, &value) == 0)
     sfree(key);
-    assert(value == NULL);
-  }
 
   c_avl_destroy(plugins_loaded);
   plugins_loaded = NULL;
@@ -960,13 +4076,11 @@ static void plugin_free_loaded(void) {
 #define SHLIB_SUFFIX ".so"
 #endif
 int plugin_load(char const *plugin_name, bool global) {
-  DIR *dh;
   const char *dir;
-  char filename[BUFSIZE] = "";
+  char filename[BUFSIZE];
   char typename[BUFSIZE];
-  int ret;
+  char *entry = NULL;
   struct stat statbuf;
-  struct dirent *de;
   int status;
 
   if (plugin_name == NULL)
@@ -978,7 +4092,6 @@ int plugin_load(char const *plugin_name, bool global) {
     return 0;
 
   dir = plugin_get_dir();
-  ret = 1;
 
   /*
    * XXX: Magic at work:
@@ -1004,50 +4117,41 @@ int plugin_load(char const *plugin_name, bool global) {
     return -1;
   }
 
-  if ((dh = opendir(dir)) == NULL) {
-    ERROR("plugin_load: opendir (%s) failed: %s", dir, STRERRNO);
+  if (plugin_dir_index(dir) != 0)
     return -1;
-  }
 
-  while ((de = readdir(dh)) != NULL) {
-    if (strcasecmp(de->d_name, typename))
-      continue;
-
-    status = snprintf(filename, sizeof(filename), "%s/%s", dir, de->d_name);
-    if ((status < 0) || ((size_t)status >= sizeof(filename))) {
-      WARNING("plugin_load: Filename too long: \"%s/%s\"", dir, de->d_name);
-      continue;
-    }
-
-    if (lstat(filename, &statbuf) == -1) {
-      WARNING("plugin_load: stat (\"%s\") failed: %s", filename, STRERRNO);
-      continue;
-    } else if (!S_ISREG(statbuf.st_mode)) {
-      /* don't follow symlinks */
-      WARNING("plugin_load: %s is not a regular file.", filename);
-      continue;
-    }
+  if (c_avl_get(plugindir_index, typename, (void *)&entry) != 0) {
+    ERROR("plugin_load: Could not find plugin \"%s\" in %s", plugin_name, dir);
+    return 1;
+  }
 
-    status = plugin_load_file(filename, global);
-    if (status == 0) {
-      /* success */
-      plugin_mark_loaded(plugin_name);
-      ret = 0;
-      INFO("plugin_load: plugin \"%s\" successfully loaded.", plugin_name);
-      break;
-    } else {
-      ERROR("plugin_load: Load plugin \"%s\" failed with "
-            "status %i.",
-            plugin_name, status);
-    }
+  status = snprintf(filename, sizeof(filename), "%s/%s", dir, entry);
+  if ((status < 0) || ((size_t)status >= sizeof(filename))) {
+    WARNING("plugin_load: Filename too long: \"%s/%s\"", dir, entry);
+    return 1;
   }
 
-  closedir(dh);
+  if (lstat(filename, &statbuf) == -1) {
+    WARNING("plugin_load: stat (\"%s\") failed: %s", filename, STRERRNO);
+    return 1;
+  } else if (!S_ISREG(statbuf.st_mode)) {
+    /* don't follow symlinks */
+    WARNING("plugin_load: %s is not a regular file.", filename);
+    return 1;
+  }
 
-  if (filename[0] == 0)
-    ERROR("plugin_load: Could not find plugin \"%s\" in %s", plugin_name, dir);
+  void *dlh = NULL;
+  status = plugin_load_file(filename, global, &dlh);
+  if (status != 0) {
+    ERROR("plugin_load: Load plugin \"%s\" failed with "
+          "status %i.",
+          plugin_name, status);
+    return 1;
+  }
 
-  return ret;
+  plugin_mark_loaded(plugin_name, dlh);
+  INFO("plugin_load: plugin \"%s\" successfully loaded.", plugin_name);
+  return 0;
 }
 
 /*
@@ -1093,8 +4197,33 @@ static int plugin_insert_read(read_func_t *rf) {
   llentry_t *le;
 
   rf->rf_next_read = cdtime();
+  if (align_read)
+    rf->rf_next_read = read_align(rf->rf_next_read, rf->rf_interval);
+  else if (spread_read)
+    rf->rf_next_read = read_spread(rf->rf_next_read, rf);
   rf->rf_effective_interval = rf->rf_interval;
 
+  /* Adaptive intervals start at the configured one. The bounds default to a
+   * quarter and four times of it. */
+  plugin_ctx_t *ctx = &rf->rf_ctx;
+  if (ctx->adaptive_interval && (rf->rf_interval > 0)) {
+    if (ctx->adaptive_interval_min == 0)
+      ctx->adaptive_interval_min = rf->rf_interval / 4;
+    if (ctx->adaptive_interval_max == 0)
+      ctx->adaptive_interval_max = 4 * rf->rf_interval;
+    if (ctx->adaptive_interval_max < ctx->adaptive_interval_min)
+      ctx->adaptive_interval_max = ctx->adaptive_interval_min;
+    if (!(ctx->adaptive_threshold > 0.0))
+      ctx->adaptive_threshold = 0.1;
+
+    rf->rf_adaptive_interval = rf->rf_interval;
+    if (rf->rf_adaptive_interval < ctx->adaptive_interval_min)
+      rf->rf_adaptive_interval = ctx->adaptive_interval_min;
+    if (rf->rf_adaptive_interval > ctx->adaptive_interval_max)
+      rf->rf_adaptive_interval = ctx->adaptive_interval_max;
+    rf->rf_effective_interval = rf->rf_adaptive_interval;
+  }
+
   pthread_mutex_lock(&read_lock);
 
   if (read_list == NULL) {
@@ -1115,8 +4244,7 @@ static int plugin_insert_read(read_func_t *rf) {
     }
   }
 
-  le = llist_search(read_list, rf->rf_name);
-  if (le != NULL) {
+  if (llist_search(read_list, rf->rf_name) != NULL) {
     pthread_mutex_unlock(&read_lock);
     P_WARNING("The read function \"%s\" is already registered. "
               "Check for duplicates in your configuration!",
@@ -1131,19 +4259,23 @@ static int plugin_insert_read(read_func_t *rf) {
     return -1;
   }
 
-  status = c_heap_insert(read_heap, rf);
-  if (status != 0) {
-    pthread_mutex_unlock(&read_lock);
-    ERROR("plugin_insert_read: c_heap_insert failed.");
-    llentry_destroy(le);
-    return -1;
+  if (read_queues != NULL) {
+    /* The read threads are running: assign the read function to one of them.
+     * read_queue_insert() wakes up the thread if needed. */
+    read_queue_insert(read_queue_select(rf), rf);
+  } else {
+    status = c_heap_insert(read_heap, rf);
+    if (status != 0) {
+      pthread_mutex_unlock(&read_lock);
+      ERROR("plugin_insert_read: c_heap_insert failed.");
+      llentry_destroy(le);
+      return -1;
+    }
   }
 
   /* This does not fail. */
   llist_append(read_list, le);
 
-  /* Wake up all the read threads. */
-  pthread_cond_broadcast(&read_cond);
   pthread_mutex_unlock(&read_lock);
   return 0;
 } /* int plugin_insert_read */
@@ -1157,11 +4289,13 @@ EXPORT int plugin_register_read(const char *name, int (*callback)(void)) {
     ERROR("plugin_register_read: calloc failed.");
     return ENOMEM;
   }
+  pthread_mutex_init(&rf->rf_super.cf_latency_lock, /* attr = */ NULL);
 
   rf->rf_callback = (void *)callback;
   rf->rf_udata.data = NULL;
   rf->rf_udata.free_func = NULL;
   rf->rf_ctx = plugin_get_ctx();
+  rf->rf_ctx.read_time = 0;
   rf->rf_group[0] = '\0';
   rf->rf_name = strdup(name);
   rf->rf_type = RF_SIMPLE;
@@ -1170,6 +4304,7 @@ EXPORT int plugin_register_read(const char *name, int (*callback)(void)) {
 
   status = plugin_insert_read(rf);
   if (status != 0) {
+    pthread_mutex_destroy(&rf->rf_super.cf_latency_lock);
     sfree(rf->rf_name);
     sfree(rf);
   }
@@ -1190,6 +4325,7 @@ EXPORT int plugin_register_complex_read(const char *group, const char *name,
     ERROR("plugin_register_complex_read: calloc failed.");
     return ENOMEM;
   }
+  pthread_mutex_init(&rf->rf_super.cf_latency_lock, /* attr = */ NULL);
 
   rf->rf_callback = (void *)callback;
   if (group != NULL)
@@ -1209,11 +4345,13 @@ EXPORT int plugin_register_complex_read(const char *group, const char *name,
   }
 
   rf->rf_ctx = plugin_get_ctx();
+  rf->rf_ctx.read_time = 0;
   rf->rf_ctx.interval = rf->rf_interval;
 
   status = plugin_insert_read(rf);
   if (status != 0) {
     free_userdata(&rf->rf_udata);
+    pthread_mutex_destroy(&rf->rf_super.cf_latency_lock);
     sfree(rf->rf_name);
     sfree(rf);
   }
@@ -1223,9 +4361,30 @@ EXPORT int plugin_register_complex_read(const char *group, const char *name,
 
 EXPORT int plugin_register_write(const char *name, plugin_write_cb callback,
                                  user_data_t const *ud) {
-  return create_register_callback(&list_write, name, (void *)callback, ud);
+  if (name == NULL || callback == NULL)
+    return EINVAL;
+
+  callback_func_t *cf = create_callback((void *)callback, ud);
+  if (cf == NULL)
+    return ENOMEM;
+
+  return register_write_callback(name, cf);
 } /* int plugin_register_write */
 
+EXPORT int plugin_register_write_batch(const char *name,
+                                       plugin_write_batch_cb callback,
+                                       user_data_t const *ud) {
+  if (name == NULL || callback == NULL)
+    return EINVAL;
+
+  callback_func_t *cf = create_callback((void *)callback, ud);
+  if (cf == NULL)
+    return ENOMEM;
+  cf->cf_batch = true;
+
+  return register_write_callback(name, cf);
+} /* int plugin_register_write_batch */
+
 static int plugin_flush_timeout_callback(user_data_t *ud) {
   flush_callback_t *cb = ud->data;
 
@@ -1378,6 +4537,96 @@ EXPORT int plugin_register_shutdown(const char *name, int (*callback)(void)) {
   return create_register_callback(&list_shutdown, name, (void *)callback, NULL);
 } /* int plugin_register_shutdown */
 
+static data_set_entry_t **data_sets_index_bucket(uint32_t hash) /* {{{ */
+{
+  return &data_sets_index[hash & (data_sets_index_size - 1)];
+} /* }}} data_set_entry_t **data_sets_index_bucket */
+
+static data_set_t *data_sets_index_get(const char *type) /* {{{ */
+{
+  if (data_sets_index == NULL)
+    return NULL;
+
+  uint32_t hash = uc_hash_name(type);
+  for (data_set_entry_t *e = *data_sets_index_bucket(hash); e != NULL;
+       e = e->next) {
+    if ((e->hash == hash) && (strcmp(e->ds->type, type) == 0))
+      return e->ds;
+  }
+
+  return NULL;
+} /* }}} data_set_t *data_sets_index_get */
+
+static int data_sets_index_insert(data_set_t *ds) /* {{{ */
+{
+  /* Keep the load factor at or below one. */
+  if (data_sets_num >= data_sets_index_size) {
+    size_t size = (data_sets_index_size == 0) ? 256 : 2 * data_sets_index_size;
+    data_set_entry_t **index = calloc(size, sizeof(*index));
+    if (index == NULL)
+      return ENOMEM;
+
+    for (size_t i = 0; i < data_sets_index_size; i++) {
+      data_set_entry_t *next;
+      for (data_set_entry_t *e = data_sets_index[i]; e != NULL; e = next) {
+        next = e->next;
+        e->next = index[e->hash & (size - 1)];
+        index[e->hash & (size - 1)] = e;
+      }
+    }
+
+    sfree(data_sets_index);
+    data_sets_index = index;
+    data_sets_index_size = size;
+  }
+
+  data_set_entry_t *e = calloc(1, sizeof(*e));
+  if (e == NULL)
+    return ENOMEM;
+  e->ds = ds;
+  e->hash = uc_hash_name(ds->type);
+
+  data_set_entry_t **bucket = data_sets_index_bucket(e->hash);
+  e->next = *bucket;
+  *bucket = e;
+  data_sets_num++;
+  return 0;
+} /* }}} int data_sets_index_insert */
+
+static void data_sets_index_remove(const char *type) /* {{{ */
+{
+  if (data_sets_index == NULL)
+    return;
+
+  uint32_t hash = uc_hash_name(type);
+  for (data_set_entry_t **prev = data_sets_index_bucket(hash); *prev != NULL;
+       prev = &(*prev)->next) {
+    data_set_entry_t *e = *prev;
+    if ((e->hash != hash) || (strcmp(e->ds->type, type) != 0))
+      continue;
+
+    *prev = e->next;
+    sfree(e);
+    data_sets_num--;
+    return;
+  }
+} /* }}} void data_sets_index_remove */
+
+static void data_set_retire(data_set_t *ds) /* {{{ */
+{
+  ds->type[0] = 0;
+
+  data_set_t **tmp = realloc(data_sets_retired, (data_sets_retired_num + 1) *
+                                                    sizeof(*data_sets_retired));
+  if (tmp == NULL) {
+    ERROR("data_set_retire: realloc failed. Leaking the data set.");
+    return;
+  }
+  data_sets_retired = tmp;
+  data_sets_retired[data_sets_retired_num] = ds;
+  data_sets_retired_num++;
+} /* }}} void data_set_retire */
+
 static void plugin_free_data_sets(void) {
   void *key;
   void *value;
@@ -1395,12 +4644,30 @@ static void plugin_free_data_sets(void) {
 
   c_avl_destroy(data_sets);
   data_sets = NULL;
+
+  for (size_t i = 0; i < data_sets_index_size; i++) {
+    data_set_entry_t *next;
+    for (data_set_entry_t *e = data_sets_index[i]; e != NULL; e = next) {
+      next = e->next;
+      sfree(e);
+    }
+  }
+  sfree(data_sets_index);
+  data_sets_index_size = 0;
+  data_sets_num = 0;
+
+  for (size_t i = 0; i < data_sets_retired_num; i++) {
+    sfree(data_sets_retired[i]->ds);
+    sfree(data_sets_retired[i]);
+  }
+  sfree(data_sets_retired);
+  data_sets_retired_num = 0;
 } /* void plugin_free_data_sets */
 
 EXPORT int plugin_register_data_set(const data_set_t *ds) {
   data_set_t *ds_copy;
 
-  if ((data_sets != NULL) && (c_avl_get(data_sets, ds->type, NULL) == 0)) {
+  if (data_sets_index_get(ds->type) != NULL) {
     NOTICE("Replacing DS `%s' with another version.", ds->type);
     plugin_unregister_data_set(ds->type);
   } else if (data_sets == NULL) {
@@ -1423,7 +4690,22 @@ EXPORT int plugin_register_data_set(const data_set_t *ds) {
   for (size_t i = 0; i < ds->ds_num; i++)
     memcpy(ds_copy->ds + i, ds->ds + i, sizeof(data_source_t));
 
-  return c_avl_insert(data_sets, (void *)ds_copy->type, (void *)ds_copy);
+  int status = c_avl_insert(data_sets, (void *)ds_copy->type, (void *)ds_copy);
+  if (status != 0) {
+    sfree(ds_copy->ds);
+    sfree(ds_copy);
+    return status;
+  }
+
+  status = data_sets_index_insert(ds_copy);
+  if (status != 0) {
+    c_avl_remove(data_sets, ds_copy->type, NULL, NULL);
+    sfree(ds_copy->ds);
+    sfree(ds_copy);
+    return status;
+  }
+
+  return 0;
 } /* int plugin_register_data_set */
 
 EXPORT int plugin_register_log(const char *name, plugin_log_cb callback,
@@ -1489,18 +4771,54 @@ EXPORT int plugin_unregister_read(const char *name) /* {{{ */
   return 0;
 } /* }}} int plugin_unregister_read */
 
+EXPORT int plugin_set_read_cpus(const char *name, /* {{{ */
+                                unsigned int const *cpus, size_t cpus_num) {
+  if ((name == NULL) || (cpus == NULL) || (cpus_num == 0))
+    return EINVAL;
+
+#if !HAVE_PTHREAD_SETAFFINITY_NP
+  return ENOTSUP;
+#else
+  core_group_t *cg = calloc(1, sizeof(*cg));
+  if (cg == NULL)
+    return ENOMEM;
+  cg->cores = calloc(cpus_num, sizeof(*cg->cores));
+  if (cg->cores == NULL) {
+    sfree(cg);
+    return ENOMEM;
+  }
+  memcpy(cg->cores, cpus, cpus_num * sizeof(*cg->cores));
+  cg->num_cores = cpus_num;
+
+  pthread_mutex_lock(&read_lock);
+  llentry_t *le = llist_search(read_list, name);
+  if (le == NULL) {
+    pthread_mutex_unlock(&read_lock);
+    sfree(cg->cores);
+    sfree(cg);
+    return ENOENT;
+  }
+
+  /* The read threads use the CPUs without holding the lock, so they can only
+   * be set once. */
+  read_func_t *rf = le->value;
+  if (rf->rf_cpus != NULL) {
+    pthread_mutex_unlock(&read_lock);
+    sfree(cg->cores);
+    sfree(cg);
+    return EEXIST;
+  }
+  rf->rf_cpus = cg;
+  pthread_mutex_unlock(&read_lock);
+
+  return 0;
+#endif
+} /* }}} int plugin_set_read_cpus */
+
 EXPORT void plugin_log_available_writers(void) {
   log_list_callbacks(&list_write, "Available write targets:");
 }
 
-static int compare_read_func_group(llentry_t *e, void *ud) /* {{{ */
-{
-  read_func_t *rf = e->value;
-  char *group = ud;
-
-  return strcmp(rf->rf_group, (const char *)group);
-} /* }}} int compare_read_func_group */
-
 EXPORT int plugin_unregister_read_group(const char *group) /* {{{ */
 {
   llentry_t *le;
@@ -1518,18 +4836,19 @@ EXPORT int plugin_unregister_read_group(const char *group) /* {{{ */
     return -ENOENT;
   }
 
-  while (42) {
-    le = llist_search_custom(read_list, compare_read_func_group, (void *)group);
+  /* Remove all members of the group in a single pass. */
+  llentry_t *next;
+  for (le = llist_head(read_list); le != NULL; le = next) {
+    next = le->next;
 
-    if (le == NULL)
-      break;
+    rf = le->value;
+    assert(rf != NULL);
+    if (strcmp(rf->rf_group, group) != 0)
+      continue;
 
     ++found;
 
     llist_remove(read_list, le);
-
-    rf = le->value;
-    assert(rf != NULL);
     rf->rf_type = RF_REMOVE;
 
     llentry_destroy(le);
@@ -1568,6 +4887,8 @@ EXPORT int plugin_unregister_flush(const char *name) {
     }
   }
 
+  /* The callback may still be running for a caller that gave up waiting. */
+  plugin_flush_wait_all();
   return plugin_unregister(list_flush, name);
 }
 
@@ -1614,8 +4935,8 @@ EXPORT int plugin_unregister_data_set(const char *name) {
   if (c_avl_remove(data_sets, name, NULL, (void *)&ds) != 0)
     return -1;
 
-  sfree(ds->ds);
-  sfree(ds);
+  data_sets_index_remove(ds->type);
+  data_set_retire(ds);
 
   return 0;
 } /* int plugin_unregister_data_set */
@@ -1628,18 +4949,294 @@ EXPORT int plugin_unregister_notification(const char *name) {
   return plugin_unregister(list_notification, name);
 }
 
+static int plugin_init_one(llentry_t *le) /* {{{ */
+{
+  callback_func_t *cf = le->value;
+  plugin_init_cb callback = cf->cf_callback;
+
+  plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
+  int status = (*callback)();
+  plugin_set_ctx(old_ctx);
+
+  return status;
+} /* }}} int plugin_init_one */
+
+static void plugin_init_failed(char const *name, int status) /* {{{ */
+{
+  ERROR("Initialization of plugin `%s' "
+        "failed with status %i. "
+        "Plugin will be unloaded.",
+        name, status);
+  /* Plugins that register read callbacks from the init
+   * callback should take care of appropriate error
+   * handling themselves. */
+  /* FIXME: Unload _all_ functions */
+  plugin_unregister_read(name);
+} /* }}} void plugin_init_failed */
+
+typedef struct {
+  llentry_t **entries;
+  int *status;
+  size_t num;
+  size_t next;
+  pthread_mutex_t lock;
+} init_queue_t;
+
+static void *plugin_init_thread(void *arg) /* {{{ */
+{
+  init_queue_t *q = arg;
+
+  while (42) {
+    pthread_mutex_lock(&q->lock);
+    size_t i = q->next++;
+    pthread_mutex_unlock(&q->lock);
+
+    if (i >= q->num)
+      break;
+
+    q->status[i] = plugin_init_one(q->entries[i]);
+  }
+
+  return NULL;
+} /* }}} void *plugin_init_thread */
+
+/* Calls the init callbacks on up to "threads_num" threads at once, so that
+ * one slow plugin does not hold up all others. Failed plugins are handled
+ * afterwards, in the order in which they were loaded. */
+static int plugin_init_parallel(size_t threads_num) /* {{{ */
+{
+  init_queue_t q = {.num = (size_t)llist_size(list_init)};
+  q.entries = calloc(q.num, sizeof(*q.entries));
+  q.status = calloc(q.num, sizeof(*q.status));
+  pthread_t *threads = calloc(threads_num, sizeof(*threads));
+  if ((q.entries == NULL) || (q.status == NULL) || (threads == NULL)) {
+    ERROR("plugin_init_parallel: calloc failed.");
+    sfree(q.entries);
+    sfree(q.status);
+    sfree(threads);
+    return -1;
+  }
+  pthread_mutex_init(&q.lock, /* attr = */ NULL);
+
+  /* Take a snapshot: init callbacks may modify the list. */
+  size_t i = 0;
+  for (llentry_t *le = llist_head(list_init); (le != NULL) && (i < q.num);
+       le = le->next)
+    q.entries[i++] = le;
+  q.num = i;
+
+  if (threads_num > q.num)
+    threads_num = q.num;
+
+  size_t started = 0;
+  for (i = 0; i < threads_num; i++) {
+    int status = pthread_create(threads + started, /* attr = */ NULL,
+                                plugin_init_thread, &q);
+    if (status != 0) {
+      ERROR("plugin_init_parallel: pthread_create failed with status %i "
+            "(%s).",
+            status, STRERROR(status));
+      continue;
+    }
+
+    char name[THREAD_NAME_MAX];
+    ssnprintf(name, sizeof(name), "init#%" PRIsz, started);
+    set_thread_name(threads[started], name);
+    started++;
+  }
+
+  /* If no thread could be started, do the work on this one. */
+  if (started == 0)
+    plugin_init_thread(&q);
+
+  for (i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+
+  int ret = 0;
+  for (i = 0; i < q.num; i++) {
+    if (q.status[i] != 0) {
+      plugin_init_failed(q.entries[i]->key, q.status[i]);
+      ret = -1;
+    }
+  }
+
+  pthread_mutex_destroy(&q.lock);
+  sfree(q.entries);
+  sfree(q.status);
+  sfree(threads);
+  return ret;
+} /* }}} int plugin_init_parallel */
+
+/* Appends the string arguments of "ci" to "*list". */
+static int read_pool_add_strings(oconfig_item_t const *ci, /* {{{ */
+                                 char ***list, size_t *list_num) {
+  if (ci->values_num < 1) {
+    ERROR("The `%s' option of <ReadThreadPool> needs at least one argument.",
+          ci->key);
+    return EINVAL;
+  }
+
+  for (int i = 0; i < ci->values_num; i++) {
+    if (ci->values[i].type != OCONFIG_TYPE_STRING) {
+      ERROR("The arguments of the `%s' option of <ReadThreadPool> must be "
+            "strings.",
+            ci->key);
+      return EINVAL;
+    }
+
+    char **tmp = realloc(*list, (*list_num + 1) * sizeof(**list));
+    if (tmp == NULL)
+      return ENOMEM;
+    *list = tmp;
+
+    (*list)[*list_num] = strdup(ci->values[i].value.string);
+    if ((*list)[*list_num] == NULL)
+      return ENOMEM;
+    (*list_num)++;
+  }
+
+  return 0;
+} /* }}} int read_pool_add_strings */
+
+static void read_pool_free(read_pool_t *pool) /* {{{ */
+{
+  sfree(pool->name);
+  for (size_t i = 0; i < pool->plugins_num; i++)
+    sfree(pool->plugins[i]);
+  sfree(pool->plugins);
+  for (size_t i = 0; i < pool->groups_num; i++)
+    sfree(pool->groups[i]);
+  sfree(pool->groups);
+} /* }}} void read_pool_free */
+
+EXPORT int plugin_config_read_pool(oconfig_item_t const *ci) /* {{{ */
+{
+  read_pool_t pool = {.threads_num = 1};
+
+  if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING)) {
+    ERROR("<ReadThreadPool> needs exactly one string argument.");
+    return EINVAL;
+  }
+
+  char const *name = ci->values[0].value.string;
+  bool duplicate = (strcasecmp(read_pool_default.name, name) == 0);
+  for (size_t i = 0; i < read_pools_num; i++)
+    if (strcasecmp(read_pools[i].name, name) == 0)
+      duplicate = true;
+  if (duplicate) {
+    ERROR("The read thread pool \"%s\" exists already.", name);
+    return EEXIST;
+  }
+
+  int status = 0;
+  pool.name = strdup(name);
+  if (pool.name == NULL)
+    status = ENOMEM;
+
+  for (int i = 0; (i < ci->children_num) && (status == 0); i++) {
+    oconfig_item_t const *child = ci->children + i;
+
+    if (strcasecmp("Threads", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        ERROR("The `Threads' option of <ReadThreadPool> must be positive.");
+        status = EINVAL;
+      }
+      pool.threads_num = (size_t)tmp;
+    } else if (strcasecmp("Plugin", child->key) == 0) {
+      status = read_pool_add_strings(child, &pool.plugins, &pool.plugins_num);
+    } else if (strcasecmp("Group", child->key) == 0) {
+      status = read_pool_add_strings(child, &pool.groups, &pool.groups_num);
+    } else {
+      ERROR("Unknown option `%s' in <ReadThreadPool>.", child->key);
+      status = EINVAL;
+    }
+  }
+
+  if ((status == 0) && (pool.plugins_num == 0) && (pool.groups_num == 0)) {
+    WARNING("The read thread pool \"%s\" has neither `Plugin' nor `Group' "
+            "options. Its threads will be idle.",
+            pool.name);
+  }
+
+  if (status == 0) {
+    read_pool_t *tmp =
+        realloc(read_pools, (read_pools_num + 1) * sizeof(*read_pools));
+    if (tmp == NULL) {
+      status = ENOMEM;
+    } else {
+      read_pools = tmp;
+      read_pools[read_pools_num] = pool;
+      read_pools_num++;
+    }
+  }
+
+  if (status != 0) {
+    if (status == ENOMEM)
+      ERROR("plugin_config_read_pool: Out of memory.");
+    read_pool_free(&pool);
+    return status;
+  }
+
+  return 0;
+} /* }}} int plugin_config_read_pool */
+
 EXPORT int plugin_init_all(void) {
   char const *chain_name;
   llentry_t *le;
+  long init_threads_num;
   int status;
   int ret = 0;
 
+  long log_queue_length = global_option_get_long("LogQueueLength",
+                                                 /* default = */ 0);
+  if (log_queue_length < 0) {
+    ERROR("LogQueueLength must be positive or zero.");
+    log_queue_length = 0;
+  }
+  start_log_thread((size_t)log_queue_length);
+
   /* Init the value cache */
   uc_init();
 
+  long series_limit_host =
+      global_option_get_long("SeriesLimitPerHost", /* default = */ 0);
+  long series_limit_plugin =
+      global_option_get_long("SeriesLimitPerPlugin", /* default = */ 0);
+  if ((series_limit_host < 0) || (series_limit_plugin < 0)) {
+    ERROR("SeriesLimitPerHost and SeriesLimitPerPlugin must be positive or "
+          "zero.");
+  } else {
+    uc_set_series_limits((size_t)series_limit_host,
+                         (size_t)series_limit_plugin);
+  }
+
+  char const *series_limit_action = global_option_get("SeriesLimitAction");
+  if (strcasecmp("Overflow", series_limit_action) == 0)
+    series_limit_overflow = true;
+  else if (strcasecmp("Drop", series_limit_action) != 0)
+    ERROR("SeriesLimitAction must be \"Drop\" or \"Overflow\", not \"%s\".",
+          series_limit_action);
+
+  char const *cache_file = global_option_get("CacheFile");
+  if (cache_file != NULL) {
+    uc_load(cache_file);
+    cache_checkpoint_interval =
+        global_option_get_time("CacheCheckpointInterval", /* default = */ 0);
+    if (cache_checkpoint_interval > 0)
+      cache_checkpoint_next = cdtime() + cache_checkpoint_interval;
+  }
+
   if (IS_TRUE(global_option_get("CollectInternalStats"))) {
     record_statistics = true;
+    /* The internal statistics show why the write queue is backing up, so
+     * they are the last to be dropped. */
+    plugin_ctx_t ctx = plugin_get_ctx();
+    ctx.write_priority = WRITE_PRIORITY_HIGH;
+    plugin_ctx_t old_ctx = plugin_set_ctx(ctx);
     plugin_register_read("collectd", plugin_update_internal_statistics);
+    plugin_set_ctx(old_ctx);
   }
 
   chain_name = global_option_get("PreCacheChain");
@@ -1673,6 +5270,34 @@ EXPORT int plugin_init_all(void) {
     ERROR("WriteThreads must be positive.");
     write_threads_num = 5;
   }
+  write_threads_config_num = write_threads_num;
+
+  int read_threads_option = atoi(global_option_get("ReadThreads"));
+  if (read_threads_option > 0) {
+    long max = global_option_get_long("ReadThreadsMax",
+                                      /* default = */ 2 * read_threads_option);
+    if (max < read_threads_option) {
+      ERROR("ReadThreadsMax must not be smaller than ReadThreads.");
+      max = read_threads_option;
+    }
+    read_threads_config_num = (size_t)read_threads_option;
+    read_threads_config_max = (size_t)max;
+  } else if (read_threads_option != -1) {
+    read_threads_config_num = 5;
+    read_threads_config_max = 10;
+  }
+
+  if (IS_TRUE(global_option_get("WriteQueueSharding")))
+    plugin_write_queue_shard(write_threads_num);
+
+  thread_cpus_init();
+  if (thread_cpus_parse("ReadThreadsCPUs", global_option_get("ReadThreadsCPUs"),
+                        &read_threads_cpus) != 0)
+    ERROR("Parsing ReadThreadsCPUs failed. Read threads are not pinned.");
+  if (thread_cpus_parse("WriteThreadsCPUs",
+                        global_option_get("WriteThreadsCPUs"),
+                        &write_threads_cpus) != 0)
+    ERROR("Parsing WriteThreadsCPUs failed. Write threads are not pinned.");
 
   if ((list_init == NULL) && (read_heap == NULL))
     return ret;
@@ -1680,49 +5305,60 @@ EXPORT int plugin_init_all(void) {
   /* Calling all init callbacks before checking if read callbacks
    * are available allows the init callbacks to register the read
    * callback. */
-  le = llist_head(list_init);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_init_cb callback;
-    plugin_ctx_t old_ctx;
+  init_threads_num = global_option_get_long("InitThreads", /* default = */ 1);
+  if (init_threads_num < 1) {
+    ERROR("InitThreads must be positive.");
+    init_threads_num = 1;
+  }
 
-    cf = le->value;
-    old_ctx = plugin_set_ctx(cf->cf_ctx);
-    callback = cf->cf_callback;
-    status = (*callback)();
-    plugin_set_ctx(old_ctx);
+  if ((init_threads_num > 1) && (list_init != NULL)) {
+    ret = plugin_init_parallel((size_t)init_threads_num);
+  } else {
+    le = llist_head(list_init);
+    while (le != NULL) {
+      status = plugin_init_one(le);
+      if (status != 0) {
+        plugin_init_failed(le->key, status);
+        ret = -1;
+      }
 
-    if (status != 0) {
-      ERROR("Initialization of plugin `%s' "
-            "failed with status %i. "
-            "Plugin will be unloaded.",
-            le->key, status);
-      /* Plugins that register read callbacks from the init
-       * callback should take care of appropriate error
-       * handling themselves. */
-      /* FIXME: Unload _all_ functions */
-      plugin_unregister_read(le->key);
-      ret = -1;
+      le = le->next;
     }
+  }
 
-    le = le->next;
+  start_write_threads(write_threads_config_num);
+
+  long notif_threads_option =
+      global_option_get_long("NotificationThreads", /* default = */ 0);
+  long notif_limit_option =
+      global_option_get_long("NotificationQueueLimit", /* default = */ 1000);
+  if (notif_threads_option < 0) {
+    ERROR("NotificationThreads must be positive or zero.");
+    notif_threads_option = 0;
+  }
+  if (notif_limit_option < 1) {
+    ERROR("NotificationQueueLimit must be positive.");
+    notif_limit_option = 1000;
   }
+  notif_queue_limit = (size_t)notif_limit_option;
+  notif_coalesce_interval = global_option_get_time(
+      "NotificationCoalesceInterval", /* default = */ 0);
+  start_notification_threads((size_t)notif_threads_option);
 
-  start_write_threads((size_t)write_threads_num);
+  /* Cache event callbacks are registered by the config and init callbacks. */
+  if (list_cache_event_num > 0)
+    start_cache_event_thread();
 
   max_read_interval =
       global_option_get_time("MaxReadInterval", DEFAULT_MAX_READ_INTERVAL);
+  read_timeout = global_option_get_time("ReadTimeout", /* default = */ 0);
+  align_read = IS_TRUE(global_option_get("AlignRead"));
+  spread_read = IS_TRUE(global_option_get("SpreadRead"));
+  shared_read_timestamp = IS_TRUE(global_option_get("SharedReadTimestamp"));
 
   /* Start read-threads */
-  if (read_heap != NULL) {
-    const char *rt;
-    int num;
-
-    rt = global_option_get("ReadThreads");
-    num = atoi(rt);
-    if (num != -1)
-      start_read_threads((num > 0) ? ((size_t)num) : 5);
-  }
+  if ((read_heap != NULL) && (read_threads_config_num > 0))
+    start_read_threads(read_threads_config_num, read_threads_config_max);
   return ret;
 } /* void plugin_init_all */
 
@@ -1730,6 +5366,11 @@ EXPORT int plugin_init_all(void) {
 EXPORT void plugin_read_all(void) {
   uc_check_timeout();
 
+  if ((cache_checkpoint_interval > 0) && (cdtime() >= cache_checkpoint_next)) {
+    uc_save(global_option_get("CacheFile"));
+    cache_checkpoint_next = cdtime() + cache_checkpoint_interval;
+  }
+
   return;
 } /* void plugin_read_all */
 
@@ -1753,6 +5394,7 @@ EXPORT int plugin_read_all_once(void) {
 
     old_ctx = plugin_set_ctx(rf->rf_ctx);
 
+    PROBE1(read__start, rf->rf_name);
     if (rf->rf_type == RF_SIMPLE) {
       int (*callback)(void);
 
@@ -1764,20 +5406,115 @@ EXPORT int plugin_read_all_once(void) {
       callback = rf->rf_callback;
       status = (*callback)(&rf->rf_udata);
     }
+    PROBE2(read__done, rf->rf_name, status);
+
+    plugin_set_ctx(old_ctx);
+
+    if (status != 0) {
+      NOTICE("read-function of plugin `%s' failed.", rf->rf_name);
+      return_status = -1;
+    }
+
+    destroy_read_func(rf);
+  }
+
+  return return_status;
+} /* int plugin_read_all_once */
+
+static void write_formats_destroy(void *arg) /* {{{ */
+{
+  write_formats_t *wf = arg;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(wf->formats); i++) {
+    sfree(wf->formats[i].key);
+    sfree(wf->formats[i].data);
+  }
+  sfree(wf);
+} /* }}} void write_formats_destroy */
+
+/* Returns the formats of this thread if "vl" is the value list currently
+ * written by plugin_write(). */
+static write_formats_t *write_formats_get(value_list_t const *vl) /* {{{ */
+{
+  write_formats_t *wf = pthread_getspecific(write_formats_key);
+  if ((wf == NULL) || (vl == NULL) || (wf->vl != vl))
+    return NULL;
+  return wf;
+} /* }}} write_formats_t *write_formats_get */
+
+EXPORT char const *plugin_write_format_get(value_list_t const *vl, /* {{{ */
+                                           char const *key, size_t *ret_len) {
+  write_formats_t *wf = write_formats_get(vl);
+  if (wf == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < wf->formats_num; i++) {
+    if (strcmp(wf->formats[i].key, key) == 0) {
+      *ret_len = wf->formats[i].len;
+      return wf->formats[i].data;
+    }
+  }
+
+  return NULL;
+} /* }}} char const *plugin_write_format_get */
+
+EXPORT void plugin_write_format_put(value_list_t const *vl, /* {{{ */
+                                    char const *key, char const *data,
+                                    size_t len) {
+  write_formats_t *wf = write_formats_get(vl);
+  if ((wf == NULL) || (wf->formats_num >= WRITE_FORMATS_MAX))
+    return;
 
-    plugin_set_ctx(old_ctx);
+  /* The keys and buffers of earlier value lists are reused. */
+  write_format_t *f = wf->formats + wf->formats_num;
+  if ((f->key == NULL) || (strcmp(f->key, key) != 0)) {
+    sfree(f->key);
+    f->key = strdup(key);
+    if (f->key == NULL)
+      return;
+  }
 
-    if (status != 0) {
-      NOTICE("read-function of plugin `%s' failed.", rf->rf_name);
-      return_status = -1;
-    }
+  if (f->size < len + 1) {
+    char *tmp = realloc(f->data, len + 1);
+    if (tmp == NULL)
+      return;
+    f->data = tmp;
+    f->size = len + 1;
+  }
+  memcpy(f->data, data, len);
+  f->data[len] = 0;
+  f->len = len;
 
-    sfree(rf->rf_name);
-    destroy_callback((void *)rf);
+  wf->formats_num++;
+} /* }}} void plugin_write_format_put */
+
+/* Makes "vl" the value list whose formats are shared. Returns false if
+ * another value list is already being written by this thread, i.e. if
+ * plugin_write() has been called from a write callback. */
+static bool write_formats_begin(value_list_t const *vl) /* {{{ */
+{
+  write_formats_t *wf = pthread_getspecific(write_formats_key);
+  if (wf == NULL) {
+    wf = calloc(1, sizeof(*wf));
+    if (wf == NULL)
+      return false;
+    pthread_setspecific(write_formats_key, wf);
   }
 
-  return return_status;
-} /* int plugin_read_all_once */
+  if (wf->vl != NULL)
+    return false;
+
+  wf->vl = vl;
+  wf->formats_num = 0;
+  return true;
+} /* }}} bool write_formats_begin */
+
+static void write_formats_end(void) /* {{{ */
+{
+  write_formats_t *wf = pthread_getspecific(write_formats_key);
+  if (wf != NULL)
+    wf->vl = NULL;
+} /* }}} void write_formats_end */
 
 EXPORT int plugin_write(const char *plugin, /* {{{ */
                         const data_set_t *ds, const value_list_t *vl) {
@@ -1790,6 +5527,8 @@ EXPORT int plugin_write(const char *plugin, /* {{{ */
   if (list_write == NULL)
     return ENOENT;
 
+  if ((ds == NULL) && (vl->ds != NULL) && (strcmp(vl->ds->type, vl->type) == 0))
+    ds = vl->ds;
   if (ds == NULL) {
     ds = plugin_get_ds(vl->type);
     if (ds == NULL) {
@@ -1802,6 +5541,14 @@ EXPORT int plugin_write(const char *plugin, /* {{{ */
     int success = 0;
     int failure = 0;
 
+    /* Write callbacks using the same format share the formatted value list.
+     * Callbacks with a write queue or batches format their own copy later. */
+    bool share_formats = (llist_size(list_write) > 1) && write_formats_begin(vl);
+
+    write_thread_t *wt = NULL;
+    if (write_threads_state != NULL)
+      wt = pthread_getspecific(write_thread_key);
+
     le = llist_head(list_write);
     while (le != NULL) {
       callback_func_t *cf = le->value;
@@ -1815,8 +5562,23 @@ EXPORT int plugin_write(const char *plugin, /* {{{ */
       plugin_set_ctx(ctx);
 
       DEBUG("plugin: plugin_write: Writing values via %s.", le->key);
-      callback = cf->cf_callback;
-      status = (*callback)(ds, vl, &cf->cf_udata);
+      if (cf->cf_sink != NULL) {
+        status = write_sink_enqueue(cf->cf_sink, vl);
+      } else if (cf->cf_batch) {
+        status = plugin_write_batch_add(cf, le->key, ds, vl);
+      } else {
+        callback = cf->cf_callback;
+        PROBE2(write__start, le->key, 1);
+        if (wt != NULL)
+          __atomic_store_n(&wt->busy_callback, le->key, __ATOMIC_RELAXED);
+        cdtime_t latency_start = callback_latency_start();
+        status = (*callback)(ds, vl, &cf->cf_udata);
+        callback_latency_add(cf, latency_start);
+        if (wt != NULL)
+          __atomic_store_n(&wt->busy_callback, NULL, __ATOMIC_RELAXED);
+        plugin_stats_write(cf, 1, status);
+        PROBE2(write__done, le->key, status);
+      }
       if (status != 0)
         failure++;
       else
@@ -1826,6 +5588,9 @@ EXPORT int plugin_write(const char *plugin, /* {{{ */
       le = le->next;
     }
 
+    if (share_formats)
+      write_formats_end();
+
     if ((success == 0) && (failure != 0))
       status = -1;
     else
@@ -1852,42 +5617,230 @@ EXPORT int plugin_write(const char *plugin, /* {{{ */
      * information of the calling read plugin */
 
     DEBUG("plugin: plugin_write: Writing values via %s.", le->key);
+    if (cf->cf_sink != NULL)
+      return write_sink_enqueue(cf->cf_sink, vl);
+    if (cf->cf_batch)
+      return plugin_write_batch_add(cf, le->key, ds, vl);
+
     callback = cf->cf_callback;
+    PROBE2(write__start, le->key, 1);
+    cdtime_t latency_start = callback_latency_start();
     status = (*callback)(ds, vl, &cf->cf_udata);
+    callback_latency_add(cf, latency_start);
+    plugin_stats_write(cf, 1, status);
+    PROBE2(write__done, le->key, status);
   }
 
   return status;
 } /* }}} int plugin_write */
 
-EXPORT int plugin_flush(const char *plugin, cdtime_t timeout,
-                        const char *identifier) {
-  llentry_t *le;
+/* Must be called with "flush_lock" held. */
+static void flush_job_unref(flush_job_t *job) /* {{{ */
+{
+  assert(job->refs > 0);
+  job->refs--;
+  if (job->refs > 0)
+    return;
 
-  if (list_flush == NULL)
-    return 0;
+  sfree(job->identifier);
+  sfree(job);
+} /* }}} void flush_job_unref */
 
-  le = llist_head(list_flush);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_flush_cb callback;
-    plugin_ctx_t old_ctx;
+/* Marks "job" as done and wakes up the callers waiting for it. Must be called
+ * with "flush_lock" held. */
+static void flush_job_finish(flush_job_t *job) /* {{{ */
+{
+  for (flush_job_t **j = &flush_jobs; *j != NULL; j = &(*j)->next) {
+    if (*j == job) {
+      *j = job->next;
+      break;
+    }
+  }
 
-    if ((plugin != NULL) && (strcmp(plugin, le->key) != 0)) {
-      le = le->next;
+  job->done = true;
+  pthread_cond_broadcast(&flush_cond);
+  flush_job_unref(job);
+} /* }}} void flush_job_finish */
+
+/* Returns the running job flushing "identifier" with "cf", if any. Must be
+ * called with "flush_lock" held. */
+static flush_job_t *flush_job_find(callback_func_t *cf, cdtime_t timeout,
+                                   char const *identifier) /* {{{ */
+{
+  for (flush_job_t *job = flush_jobs; job != NULL; job = job->next) {
+    if ((job->cf != cf) || (job->timeout != timeout))
       continue;
+    if ((job->identifier == NULL) && (identifier == NULL))
+      return job;
+    if ((job->identifier != NULL) && (identifier != NULL) &&
+        (strcmp(job->identifier, identifier) == 0))
+      return job;
+  }
+
+  return NULL;
+} /* }}} flush_job_t *flush_job_find */
+
+/* Must be called with "flush_lock" held. */
+static flush_job_t *flush_job_create(callback_func_t *cf, cdtime_t timeout,
+                                     char const *identifier) /* {{{ */
+{
+  flush_job_t *job = calloc(1, sizeof(*job));
+  if (job == NULL)
+    return NULL;
+
+  job->cf = cf;
+  job->timeout = timeout;
+  if (identifier != NULL) {
+    job->identifier = strdup(identifier);
+    if (job->identifier == NULL) {
+      sfree(job);
+      return NULL;
     }
+  }
+  job->refs = 1;
 
-    cf = le->value;
-    old_ctx = plugin_set_ctx(cf->cf_ctx);
-    callback = cf->cf_callback;
+  job->next = flush_jobs;
+  flush_jobs = job;
+  return job;
+} /* }}} flush_job_t *flush_job_create */
+
+static void flush_job_run(flush_job_t *job) /* {{{ */
+{
+  callback_func_t *cf = job->cf;
+  plugin_flush_cb callback = cf->cf_callback;
+  plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
 
-    (*callback)(timeout, identifier, &cf->cf_udata);
+  cdtime_t latency_start = callback_latency_start();
+  (*callback)(job->timeout, job->identifier, &cf->cf_udata);
+  callback_latency_add(cf, latency_start);
 
-    plugin_set_ctx(old_ctx);
+  plugin_set_ctx(old_ctx);
 
-    le = le->next;
+  pthread_mutex_lock(&flush_lock);
+  flush_job_finish(job);
+  pthread_mutex_unlock(&flush_lock);
+} /* }}} void flush_job_run */
+
+static void *flush_job_thread(void *arg) /* {{{ */
+{
+  flush_job_run(arg);
+  return NULL;
+} /* }}} void *flush_job_thread */
+
+/* Runs "job" in a detached thread. Must be called with "flush_lock" held. */
+static int flush_job_start(flush_job_t *job) /* {{{ */
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int status = pthread_create(&thread, &attr, flush_job_thread, job);
+  pthread_attr_destroy(&attr);
+  if (status != 0) {
+    ERROR("plugin: flush_job_start: pthread_create failed with status %i "
+          "(%s).",
+          status, STRERROR(status));
+    flush_job_finish(job);
+    return status;
   }
+
+  set_thread_name(thread, "flush");
   return 0;
+} /* }}} int flush_job_start */
+
+/* Blocks until no flush callback is running, e.g. because a caller gave up
+ * waiting for it. */
+static void plugin_flush_wait_all(void) /* {{{ */
+{
+  pthread_mutex_lock(&flush_lock);
+  while (flush_jobs != NULL)
+    pthread_cond_wait(&flush_cond, &flush_lock);
+  pthread_mutex_unlock(&flush_lock);
+} /* }}} void plugin_flush_wait_all */
+
+EXPORT int plugin_flush_deadline(const char *plugin, cdtime_t timeout,
+                                 const char *identifier,
+                                 cdtime_t deadline) /* {{{ */
+{
+  if ((list_flush == NULL) || (llist_size(list_flush) == 0))
+    return 0;
+
+  flush_job_t **jobs = calloc((size_t)llist_size(list_flush), sizeof(*jobs));
+  if (jobs == NULL)
+    return ENOMEM;
+  size_t jobs_num = 0;
+  int ret = 0;
+
+  /* Without a deadline, the last new job is run by the calling thread. */
+  flush_job_t *inline_job = NULL;
+
+  pthread_mutex_lock(&flush_lock);
+  for (llentry_t *le = llist_head(list_flush); le != NULL; le = le->next) {
+    if ((plugin != NULL) && (strcmp(plugin, le->key) != 0))
+      continue;
+
+    flush_job_t *job = flush_job_find(le->value, timeout, identifier);
+    if (job == NULL) {
+      job = flush_job_create(le->value, timeout, identifier);
+      if (job == NULL) {
+        ERROR("plugin_flush: flush_job_create failed.");
+        ret = -1;
+        continue;
+      }
+
+      if (deadline == 0) {
+        flush_job_t *prev = inline_job;
+        inline_job = job;
+        job = prev;
+      }
+
+      /* flush_job_start() frees the job if it fails. */
+      if ((job != NULL) && (flush_job_start(job) != 0)) {
+        ret = -1;
+        job = NULL;
+      }
+    }
+
+    if (job != NULL) {
+      job->refs++;
+      jobs[jobs_num] = job;
+      jobs_num++;
+    }
+  }
+
+  if (inline_job != NULL) {
+    pthread_mutex_unlock(&flush_lock);
+    flush_job_run(inline_job);
+    pthread_mutex_lock(&flush_lock);
+  }
+
+  for (size_t i = 0; i < jobs_num; i++) {
+    flush_job_t *job = jobs[i];
+
+    while (!job->done) {
+      if (deadline == 0)
+        pthread_cond_wait(&flush_cond, &flush_lock);
+      else if (pthread_cond_timedwait(&flush_cond, &flush_lock,
+                                      &CDTIME_T_TO_TIMESPEC(deadline)) ==
+               ETIMEDOUT)
+        break;
+    }
+
+    if (!job->done)
+      ret = ETIMEDOUT;
+    flush_job_unref(job);
+  }
+  pthread_mutex_unlock(&flush_lock);
+
+  sfree(jobs);
+  return ret;
+} /* }}} int plugin_flush_deadline */
+
+EXPORT int plugin_flush(const char *plugin, cdtime_t timeout,
+                        const char *identifier) {
+  return plugin_flush_deadline(plugin, timeout, identifier,
+                               /* deadline = */ 0);
 } /* int plugin_flush */
 
 EXPORT int plugin_shutdown_all(void) {
@@ -1896,7 +5849,16 @@ EXPORT int plugin_shutdown_all(void) {
 
   destroy_all_callbacks(&list_init);
 
+  pthread_mutex_lock(&read_threads_lock);
+  read_threads_shutdown = true;
+  pthread_mutex_unlock(&read_threads_lock);
+
   stop_read_threads();
+  config_cores_cleanup(&read_threads_cpus);
+  for (size_t i = 0; i < read_pools_num; i++)
+    read_pool_free(read_pools + i);
+  sfree(read_pools);
+  read_pools_num = 0;
 
   pthread_mutex_lock(&read_lock);
   llist_destroy(read_list);
@@ -1907,12 +5869,36 @@ EXPORT int plugin_shutdown_all(void) {
 
   /* blocks until all write threads have shut down. */
   stop_write_threads();
+  config_cores_cleanup(&write_threads_cpus);
+
+  /* No values pass the chains from here on. Targets such as "rollup" write
+   * the values they kept before the write plugins are flushed. */
+  pre_cache_chain = NULL;
+  post_cache_chain = NULL;
+  fc_shutdown();
+
+  /* Notifications still queued are handled before any plugin is shut down.
+   * From here on, they are dispatched synchronously. */
+  stop_notification_threads();
+
+  /* The cache event callbacks are called synchronously from here on. */
+  stop_cache_event_thread();
+
+  /* No more updates of the value cache from here on. */
+  char const *cache_file = global_option_get("CacheFile");
+  if (cache_file != NULL)
+    uc_save(cache_file);
 
   /* ask all plugins to write out the state they kept. */
   plugin_flush(/* plugin = */ NULL,
                /* timeout = */ 0,
                /* identifier = */ NULL);
 
+  /* Log plugins may close their files in the shutdown callbacks, so queued
+   * messages are written first. Messages logged from here on are passed to
+   * the log callbacks directly. */
+  stop_log_thread();
+
   le = NULL;
   if (list_shutdown != NULL)
     le = llist_head(list_shutdown);
@@ -1926,36 +5912,530 @@ EXPORT int plugin_shutdown_all(void) {
     old_ctx = plugin_set_ctx(cf->cf_ctx);
     callback = cf->cf_callback;
 
-    /* Advance the pointer before calling the callback allows
-     * shutdown functions to unregister themselves. If done the
-     * other way around the memory `le' points to will be freed
-     * after callback returns. */
+    /* Advance the pointer before calling the callback allows
+     * shutdown functions to unregister themselves. If done the
+     * other way around the memory `le' points to will be freed
+     * after callback returns. */
+    le = le->next;
+
+    if ((*callback)() != 0)
+      ret = -1;
+
+    plugin_set_ctx(old_ctx);
+  }
+
+  /* Write plugins which use the `user_data' pointer usually need the
+   * same data available to the flush callback. If this is the case, set
+   * the free_function to NULL when registering the flush callback and to
+   * the real free function when registering the write callback. This way
+   * the data isn't freed twice. */
+  plugin_flush_wait_all();
+  destroy_all_callbacks(&list_flush);
+  destroy_all_callbacks(&list_missing);
+  destroy_cache_event_callbacks();
+  destroy_all_callbacks(&list_write);
+
+  destroy_all_callbacks(&list_notification);
+  destroy_all_callbacks(&list_shutdown);
+  destroy_all_callbacks(&list_log);
+
+  plugin_free_loaded();
+  plugin_dir_index_free();
+  plugin_free_data_sets();
+  return ret;
+} /* void plugin_shutdown_all */
+
+/*
+ * Runtime statistics, see plugin_get_stats().
+ */
+typedef struct {
+  char **lines;
+  size_t lines_num;
+  int status;
+} stats_report_t;
+
+__attribute__((format(printf, 2, 3))) static void
+stats_report_add(stats_report_t *r, char const *format, ...) /* {{{ */
+{
+  char buffer[1024];
+  va_list ap;
+
+  if (r->status != 0)
+    return;
+
+  va_start(ap, format);
+  vsnprintf(buffer, sizeof(buffer), format, ap);
+  va_end(ap);
+
+  char **tmp = realloc(r->lines, (r->lines_num + 1) * sizeof(*r->lines));
+  if (tmp == NULL) {
+    r->status = ENOMEM;
+    return;
+  }
+  r->lines = tmp;
+
+  r->lines[r->lines_num] = strdup(buffer);
+  if (r->lines[r->lines_num] == NULL) {
+    r->status = ENOMEM;
+    return;
+  }
+  r->lines_num++;
+} /* }}} void stats_report_add */
+
+/* Formats the CPU time used by "thread" as " cpu=<seconds>" into "buffer".
+ * The buffer is left empty if the CPU time can't be determined. */
+static char const *stats_thread_cpu(char *buffer, size_t buffer_size, /* {{{ */
+                                    pthread_t thread) {
+  buffer[0] = 0;
+#if defined(_POSIX_THREAD_CPUTIME) && (_POSIX_THREAD_CPUTIME >= 0)
+  clockid_t clock;
+  struct timespec ts;
+  if ((pthread_getcpuclockid(thread, &clock) == 0) &&
+      (clock_gettime(clock, &ts) == 0))
+    ssnprintf(buffer, buffer_size, " cpu=%.3f",
+              CDTIME_T_TO_DOUBLE(TIMESPEC_TO_CDTIME_T(&ts)));
+#endif
+  return buffer;
+} /* }}} char const *stats_thread_cpu */
+
+static int stats_read_func_compare(void const *a, void const *b) /* {{{ */
+{
+  read_func_t const *rf0 = *(read_func_t *const *)a;
+  read_func_t const *rf1 = *(read_func_t *const *)b;
+
+  if (rf0->rf_next_read != rf1->rf_next_read)
+    return (rf0->rf_next_read < rf1->rf_next_read) ? -1 : 1;
+  return strcmp(rf0->rf_name, rf1->rf_name);
+} /* }}} int stats_read_func_compare */
+
+static void stats_report_read(stats_report_t *r, cdtime_t now) /* {{{ */
+{
+  char cpu[64];
+
+  pthread_mutex_lock(&read_lock);
+
+  /* Once "read_loop" has been cleared, the read threads are being stopped
+   * and joined. Holding "read_lock" keeps them from being started again. */
+  if (read_loop != 0) {
+    pthread_mutex_lock(&read_threads_lock);
+    for (size_t i = 0; i < read_threads_num; i++) {
+      read_thread_t *t = read_threads + i;
+      if (!t->used || t->exited)
+        continue;
+
+      char const *pool = t->queue->pool->name;
+      stats_thread_cpu(cpu, sizeof(cpu), t->thread);
+      if (t->rf == NULL) {
+        stats_report_add(r, "read_thread %" PRIsz " pool=%s state=idle%s", i,
+                         pool, cpu);
+        continue;
+      }
+
+      char const *state = "busy";
+      if (t->abandoned)
+        state = "abandoned";
+      else if (t->overrun)
+        state = "overrun";
+      stats_report_add(r,
+                       "read_thread %" PRIsz
+                       " pool=%s state=%s callback=%s running=%.3f%s",
+                       i, pool, state, t->rf->rf_name,
+                       CDTIME_T_TO_DOUBLE(now - t->started), cpu);
+    }
+    pthread_mutex_unlock(&read_threads_lock);
+  }
+
+  for (size_t i = 0; i < read_queues_num; i++) {
+    read_queue_t *q = read_queues + i;
+
+    pthread_mutex_lock(&q->lock);
+    size_t num = q->num;
+    pthread_mutex_unlock(&q->lock);
+
+    stats_report_add(r, "read_queue %" PRIsz " pool=%s functions=%" PRIsz, i,
+                     q->pool->name, num);
+  }
+
+  /* The read functions, whether they are in "read_heap", one of the
+   * "read_queues" or being called, ordered by the time they are due. */
+  size_t rf_num = 0;
+  read_func_t **rfs = NULL;
+  if (llist_size(read_list) > 0)
+    rfs = calloc(llist_size(read_list), sizeof(*rfs));
+  for (llentry_t *le = llist_head(read_list); (le != NULL) && (rfs != NULL);
+       le = le->next)
+    rfs[rf_num++] = le->value;
+  if (rf_num > 1)
+    qsort(rfs, rf_num, sizeof(*rfs), stats_read_func_compare);
+
+  for (size_t i = 0; i < rf_num; i++) {
+    read_func_t *rf = rfs[i];
+    cdtime_t interval = (rf->rf_adaptive_interval != 0)
+                            ? rf->rf_adaptive_interval
+                            : rf->rf_effective_interval;
+    double due = (rf->rf_next_read >= now)
+                     ? CDTIME_T_TO_DOUBLE(rf->rf_next_read - now)
+                     : -CDTIME_T_TO_DOUBLE(now - rf->rf_next_read);
+
+    stats_report_add(r,
+                     "read_function %s group=%s interval=%.3f due=%.3f "
+                     "overruns=%" PRIu64,
+                     rf->rf_name, (rf->rf_group[0] != 0) ? rf->rf_group : "-",
+                     CDTIME_T_TO_DOUBLE(interval), due,
+                     __atomic_load_n(&rf->rf_overruns, __ATOMIC_RELAXED));
+  }
+  sfree(rfs);
+
+  pthread_mutex_unlock(&read_lock);
+} /* }}} void stats_report_read */
+
+static void stats_report_write(stats_report_t *r, cdtime_t now) /* {{{ */
+{
+  char cpu[64];
+
+  pthread_mutex_lock(&write_threads_lock);
+  for (size_t i = 0; (write_threads != NULL) && (i < write_threads_num); i++) {
+    write_thread_t *wt = write_threads_state + i;
+    size_t shard = (size_t)(wt->queue - write_queues);
+
+    stats_thread_cpu(cpu, sizeof(cpu), write_threads[i]);
+    cdtime_t since = __atomic_load_n(&wt->busy_since, __ATOMIC_RELAXED);
+    char const *callback =
+        __atomic_load_n(&wt->busy_callback, __ATOMIC_RELAXED);
+    if (since == 0) {
+      stats_report_add(r, "write_thread %" PRIsz " shard=%" PRIsz
+                       " state=idle%s", i, shard, cpu);
+      continue;
+    }
+
+    stats_report_add(r,
+                     "write_thread %" PRIsz " shard=%" PRIsz
+                     " state=busy callback=%s running=%.3f%s",
+                     i, shard, (callback != NULL) ? callback : "-",
+                     CDTIME_T_TO_DOUBLE((now > since) ? now - since : 0), cpu);
+  }
+  pthread_mutex_unlock(&write_threads_lock);
+
+  /* The lengths are read without holding the shard locks, like
+   * write_queue_length() does. */
+  for (size_t i = 0; i < write_queues_num; i++) {
+    long length = write_queue_get_length(write_queues + i);
+    stats_report_add(r, "write_shard %" PRIsz " length=%ld bytes=%" PRIsz, i,
+                     length, (size_t)length * sizeof(write_queue_t));
+  }
+
+  pthread_mutex_lock(&write_sinks_lock);
+  for (write_sink_t *ws = write_sinks; ws != NULL; ws = ws->next) {
+    pthread_mutex_lock(&ws->queue.lock);
+    long length = ws->queue.length;
+    derive_t dropped = ws->dropped;
+    pthread_mutex_unlock(&ws->queue.lock);
+
+    cpu[0] = 0;
+    if (ws->thread_running)
+      stats_thread_cpu(cpu, sizeof(cpu), ws->thread);
+    stats_report_add(r, "write_sink %s length=%ld dropped=%" PRIi64 "%s",
+                     ws->name, length, (int64_t)dropped, cpu);
+  }
+  pthread_mutex_unlock(&write_sinks_lock);
+} /* }}} void stats_report_write */
+
+static void stats_report_cache(stats_report_t *r) /* {{{ */
+{
+  uc_memory_t *mem = NULL;
+  size_t mem_num = 0;
+  size_t bytes = 0;
+
+  int status = uc_get_memory(&mem, &mem_num, &bytes);
+  if (status != 0) {
+    r->status = status;
+    return;
+  }
+
+  size_t entries = 0;
+  for (size_t i = 0; i < mem_num; i++)
+    entries += mem[i].entries;
+  stats_report_add(r, "cache entries=%" PRIsz " bytes=%" PRIsz, entries,
+                   bytes);
+
+  for (size_t i = 0; i < mem_num; i++)
+    stats_report_add(r,
+                     "plugin %s cache_entries=%" PRIsz
+                     " cache_bytes=%" PRIsz,
+                     mem[i].plugin, mem[i].entries, mem[i].bytes);
+
+  sfree(mem);
+} /* }}} void stats_report_cache */
+
+EXPORT int plugin_get_stats(char ***ret_lines, /* {{{ */
+                            size_t *ret_lines_num) {
+  stats_report_t r = {0};
+  cdtime_t now = cdtime();
+
+  if ((ret_lines == NULL) || (ret_lines_num == NULL))
+    return EINVAL;
+
+  stats_report_read(&r, now);
+  stats_report_write(&r, now);
+  stats_report_cache(&r);
+
+  if (r.status != 0) {
+    for (size_t i = 0; i < r.lines_num; i++)
+      sfree(r.lines[i]);
+    sfree(r.lines);
+    return r.status;
+  }
+
+  *ret_lines = r.lines;
+  *ret_lines_num = r.lines_num;
+  return 0;
+} /* }}} int plugin_get_stats */
+
+/*
+ * Reloading the configuration, see cf_reload().
+ */
+static bool reload_requested;
+
+EXPORT void plugin_reload_request(void) {
+  __atomic_store_n(&reload_requested, true, __ATOMIC_RELAXED);
+} /* void plugin_reload_request */
+
+bool plugin_reload_requested(void) {
+  return __atomic_exchange_n(&reload_requested, false, __ATOMIC_RELAXED);
+} /* bool plugin_reload_requested */
+
+void plugin_reload_begin(void) {
+  stop_read_threads();
+  pause_write_threads();
+  /* From here on, cache events are handled by the calling thread. */
+  stop_cache_event_thread();
+} /* void plugin_reload_begin */
+
+void plugin_reload_end(void) {
+  /* The chains may have been configured again. */
+  pre_cache_chain = fc_chain_get_by_name(global_option_get("PreCacheChain"));
+  post_cache_chain = fc_chain_get_by_name(global_option_get("PostCacheChain"));
+
+  start_write_threads(write_threads_config_num);
+
+  if (list_cache_event_num > 0)
+    start_cache_event_thread();
+
+  if ((read_heap != NULL) && (read_threads_config_num > 0))
+    start_read_threads(read_threads_config_num, read_threads_config_max);
+} /* void plugin_reload_end */
+
+/* Returns true if "cf" has been registered by the plugin "name". */
+static bool callback_owned_by(callback_func_t const *cf, /* {{{ */
+                              char const *name) {
+  return (cf->cf_ctx.name != NULL) && (strcasecmp(cf->cf_ctx.name, name) == 0);
+} /* }}} bool callback_owned_by */
+
+/* Moves the callbacks registered by the plugin "name" from "*list" to
+ * "*removed". */
+static void unregister_plugin_callbacks(llist_t *list, /* {{{ */
+                                        char const *name, llist_t **removed) {
+  if (list == NULL)
+    return;
+
+  llentry_t *le = llist_head(list);
+  while (le != NULL) {
+    llentry_t *next = le->next;
+
+    if (callback_owned_by(le->value, name)) {
+      llist_remove(list, le);
+      if ((*removed == NULL) && ((*removed = llist_create()) == NULL)) {
+        /* Leaked rather than freed while another thread may use it. */
+        ERROR("plugin: unregister_plugin_callbacks: llist_create failed.");
+      } else {
+        llist_append(*removed, le);
+      }
+    }
+
+    le = next;
+  }
+} /* }}} void unregister_plugin_callbacks */
+
+/* Returns true if a detached read thread is still running a read callback of
+ * the plugin "name". */
+static bool read_orphans_running(char const *name) /* {{{ */
+{
+  bool running = false;
+
+  pthread_mutex_lock(&read_threads_lock);
+  for (read_orphans_t *o = read_orphans; o != NULL; o = o->next) {
+    for (size_t i = 0; i < o->threads_num; i++) {
+      read_thread_t *t = o->threads + i;
+      if (t->detached && (t->rf != NULL) &&
+          callback_owned_by(&t->rf->rf_super, name))
+        running = true;
+    }
+  }
+  pthread_mutex_unlock(&read_threads_lock);
+
+  return running;
+} /* }}} bool read_orphans_running */
+
+static void unregister_plugin_read(char const *name) /* {{{ */
+{
+  pthread_mutex_lock(&read_lock);
+
+  llentry_t *le = (read_list != NULL) ? llist_head(read_list) : NULL;
+  while (le != NULL) {
+    llentry_t *next = le->next;
+    read_func_t *rf = le->value;
+
+    /* The read function itself is freed below. */
+    if (callback_owned_by(&rf->rf_super, name)) {
+      llist_remove(read_list, le);
+      llentry_destroy(le);
+    }
+
+    le = next;
+  }
+
+  /* The read threads are stopped, so all read functions are in "read_heap". */
+  c_heap_t *keep = c_heap_create(plugin_compare_read_func);
+  if ((read_heap != NULL) && (keep != NULL)) {
+    read_func_t *rf;
+    while ((rf = c_heap_get_root(read_heap)) != NULL) {
+      if (callback_owned_by(&rf->rf_super, name))
+        destroy_read_func(rf);
+      else
+        c_heap_insert(keep, rf);
+    }
+    c_heap_destroy(read_heap);
+    read_heap = keep;
+  } else if (keep != NULL) {
+    c_heap_destroy(keep);
+  }
+
+  pthread_mutex_unlock(&read_lock);
+} /* }}} void unregister_plugin_read */
+
+/* Removes the flush callbacks of the plugin "name" and waits for the flush
+ * jobs still running them. */
+static void unregister_plugin_flush(char const *name) /* {{{ */
+{
+  llist_t *removed = NULL;
+
+  pthread_mutex_lock(&flush_lock);
+  unregister_plugin_callbacks(list_flush, name, &removed);
+
+  bool running = true;
+  while (running) {
+    running = false;
+    for (flush_job_t *job = flush_jobs; job != NULL; job = job->next)
+      if (callback_owned_by(job->cf, name))
+        running = true;
+
+    if (running)
+      pthread_cond_wait(&flush_cond, &flush_lock);
+  }
+  pthread_mutex_unlock(&flush_lock);
+
+  destroy_all_callbacks(&removed);
+} /* }}} void unregister_plugin_flush */
+
+int plugin_unload(char const *name) {
+  int ret = 0;
+
+  if (name == NULL)
+    return EINVAL;
+
+  /* Unloading the plugin would unmap the code of the running callback. */
+  if (read_orphans_running(name)) {
+    ERROR("plugin_unload: A read callback of the `%s' plugin is still "
+          "running. Not unloading the plugin.",
+          name);
+    return EBUSY;
+  }
+
+  /* The shutdown callbacks stop the threads the plugin has started. */
+  for (llentry_t *le = llist_head(list_shutdown); le != NULL;) {
+    callback_func_t *cf = le->value;
+    plugin_shutdown_cb callback = cf->cf_callback;
+
     le = le->next;
+    if (!callback_owned_by(cf, name))
+      continue;
 
+    plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
     if ((*callback)() != 0)
       ret = -1;
-
     plugin_set_ctx(old_ctx);
   }
 
-  /* Write plugins which use the `user_data' pointer usually need the
-   * same data available to the flush callback. If this is the case, set
-   * the free_function to NULL when registering the flush callback and to
-   * the real free function when registering the write callback. This way
-   * the data isn't freed twice. */
-  destroy_all_callbacks(&list_flush);
-  destroy_all_callbacks(&list_missing);
-  destroy_cache_event_callbacks();
-  destroy_all_callbacks(&list_write);
+  /* As in plugin_shutdown_all(), the flush callbacks are freed before the
+   * write callbacks, which usually own the user data. */
+  unregister_plugin_flush(name);
 
-  destroy_all_callbacks(&list_notification);
-  destroy_all_callbacks(&list_shutdown);
-  destroy_all_callbacks(&list_log);
+  llist_t *removed = NULL;
+  unregister_plugin_callbacks(list_missing, name, &removed);
+  destroy_all_callbacks(&removed);
 
-  plugin_free_loaded();
-  plugin_free_data_sets();
+  for (size_t i = 0; i < list_cache_event_num; i++) {
+    cache_event_func_t *cef = &list_cache_event[i];
+    if ((cef->callback == NULL) || (cef->plugin_ctx.name == NULL) ||
+        (strcasecmp(cef->plugin_ctx.name, name) != 0))
+      continue;
+
+    cef->callback = NULL;
+    sfree(cef->name);
+    free_userdata(&cef->user_data);
+  }
+
+  unregister_plugin_callbacks(list_write, name, &removed);
+  destroy_all_callbacks(&removed);
+
+  /* Other threads may be calling these right now. */
+  llist_t *removed_notification = NULL;
+  llist_t *removed_log = NULL;
+  pthread_rwlock_wrlock(&callbacks_lock);
+  unregister_plugin_callbacks(list_notification, name, &removed_notification);
+  unregister_plugin_callbacks(list_log, name, &removed_log);
+  pthread_rwlock_unlock(&callbacks_lock);
+  destroy_all_callbacks(&removed_notification);
+  destroy_all_callbacks(&removed_log);
+
+  unregister_plugin_callbacks(list_shutdown, name, &removed);
+  destroy_all_callbacks(&removed);
+  unregister_plugin_callbacks(list_init, name, &removed);
+  destroy_all_callbacks(&removed);
+
+  unregister_plugin_read(name);
+
+  char *key = NULL;
+  void *dlh = NULL;
+  if ((plugins_loaded == NULL) ||
+      (c_avl_remove(plugins_loaded, name, (void *)&key, &dlh) != 0))
+    return ret;
+
+  sfree(key);
+  if ((dlh != NULL) && (dlclose(dlh) != 0))
+    WARNING("plugin_unload: dlclose(\"%s\") failed: %s", name, dlerror());
+
+  INFO("plugin_unload: plugin \"%s\" unloaded.", name);
   return ret;
-} /* void plugin_shutdown_all */
+} /* int plugin_unload */
+
+int plugin_init_plugin(char const *name) {
+  int ret = 0;
+
+  /* Init callbacks may register more init callbacks, which are appended. */
+  for (llentry_t *le = llist_head(list_init); le != NULL; le = le->next) {
+    if (!callback_owned_by(le->value, name))
+      continue;
+
+    int status = plugin_init_one(le);
+    if (status != 0) {
+      plugin_init_failed(le->key, status);
+      ret = -1;
+    }
+  }
+
+  return ret;
+} /* int plugin_init_plugin */
 
 EXPORT int plugin_dispatch_missing(const value_list_t *vl) /* {{{ */
 {
@@ -1968,7 +6448,9 @@ EXPORT int plugin_dispatch_missing(const value_list_t *vl) /* {{{ */
     plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
     plugin_missing_cb callback = cf->cf_callback;
 
+    cdtime_t latency_start = callback_latency_start();
     int status = (*callback)(vl, &cf->cf_udata);
+    callback_latency_add(cf, latency_start);
     plugin_set_ctx(old_ctx);
     if (status != 0) {
       if (status < 0) {
@@ -1986,9 +6468,11 @@ EXPORT int plugin_dispatch_missing(const value_list_t *vl) /* {{{ */
   return 0;
 } /* int }}} plugin_dispatch_missing */
 
-void plugin_dispatch_cache_event(enum cache_event_type_e event_type,
-                                 unsigned long callbacks_mask, const char *name,
-                                 const value_list_t *vl) {
+static void plugin_cache_event_callbacks(enum cache_event_type_e event_type,
+                                         unsigned long callbacks_mask,
+                                         const char *name,
+                                         const value_list_t *vl) /* {{{ */
+{
   switch (event_type) {
   case CE_VALUE_NEW:
     callbacks_mask = 0;
@@ -2017,7 +6501,7 @@ void plugin_dispatch_cache_event(enum cache_event_type_e event_type,
           DEBUG(
               "plugin_dispatch_cache_event: Callback \"%s\" subscribed to %s.",
               cef->name, name);
-          callbacks_mask |= (1 << (i));
+          callbacks_mask |= (1UL << i);
         } else {
           DEBUG("plugin_dispatch_cache_event: Callback \"%s\" ignores %s.",
                 cef->name, name);
@@ -2038,7 +6522,7 @@ void plugin_dispatch_cache_event(enum cache_event_type_e event_type,
       if (!callback)
         continue;
 
-      if (callbacks_mask && (1 << (i)) == 0)
+      if ((callbacks_mask & (1UL << i)) == 0)
         continue;
 
       cache_event_t event = (cache_event_t){.type = event_type,
@@ -2059,9 +6543,94 @@ void plugin_dispatch_cache_event(enum cache_event_type_e event_type,
     }
     break;
   }
-  return;
+} /* }}} void plugin_cache_event_callbacks */
+
+/* Adds a copy of "vl" to the cache event queue. Returns non-zero if the cache
+ * event thread is not running. */
+static int plugin_cache_event_enqueue(enum cache_event_type_e event_type,
+                                      unsigned long callbacks_mask,
+                                      const char *name,
+                                      const value_list_t *vl) /* {{{ */
+{
+  cache_event_queue_t *q = malloc(sizeof(*q));
+  if (q == NULL)
+    return ENOMEM;
+
+  q->type = event_type;
+  q->callbacks_mask = callbacks_mask;
+  sstrncpy(q->name, name, sizeof(q->name));
+  q->next = NULL;
+  if (plugin_value_list_copy(&q->vl, vl) != 0) {
+    sfree(q);
+    return ENOMEM;
+  }
+
+  pthread_mutex_lock(&cache_event_lock);
+  if (!cache_event_loop) {
+    pthread_mutex_unlock(&cache_event_lock);
+    cache_event_queue_free(q);
+    return -1;
+  }
+
+  if (cache_event_queue_tail == NULL)
+    cache_event_queue_head = q;
+  else
+    cache_event_queue_tail->next = q;
+  cache_event_queue_tail = q;
+  cache_event_queue_length++;
+  cache_event_queued++;
+  pthread_cond_signal(&cache_event_cond);
+  pthread_mutex_unlock(&cache_event_lock);
+
+  return 0;
+} /* }}} int plugin_cache_event_enqueue */
+
+void plugin_dispatch_cache_event(enum cache_event_type_e event_type,
+                                 unsigned long callbacks_mask, const char *name,
+                                 const value_list_t *vl) {
+  if (event_type == CE_VALUE_NEW) {
+    /* Called from the write thread, with the context of the plugin that
+     * dispatched "vl". */
+    if (record_statistics) {
+      plugin_stats_t *ps = plugin_stats_get(plugin_get_ctx().name);
+      if (ps != NULL)
+        plugin_stats_add(&ps->series_created, 1);
+    }
+
+    /* New values are offered to all active callbacks. */
+    callbacks_mask = 0;
+    for (size_t i = 0; i < list_cache_event_num; i++)
+      if (list_cache_event[i].callback != NULL)
+        callbacks_mask |= (1UL << i);
+  }
+
+  if (callbacks_mask == 0)
+    return;
+
+  if (plugin_cache_event_enqueue(event_type, callbacks_mask, name, vl) != 0)
+    plugin_cache_event_callbacks(event_type, callbacks_mask, name, vl);
 }
 
+void plugin_wait_cache_events(void) {
+  pthread_mutex_lock(&cache_event_lock);
+  uint64_t target = cache_event_queued;
+  while (cache_event_handled < target)
+    pthread_cond_wait(&cache_event_handled_cond, &cache_event_lock);
+  pthread_mutex_unlock(&cache_event_lock);
+}
+
+/* Returns the data set of "vl", using the pointer cached in the value list if
+ * it is still valid. Retired data sets have an empty type, see
+ * data_set_retire(). */
+static data_set_t const *
+plugin_value_list_ds(value_list_t const *vl) /* {{{ */
+{
+  if ((vl->ds != NULL) && (strcmp(vl->ds->type, vl->type) == 0))
+    return vl->ds;
+
+  return data_sets_index_get(vl->type);
+} /* }}} data_set_t const *plugin_value_list_ds */
+
 static int plugin_dispatch_values_internal(value_list_t *vl) {
   int status;
   static c_complain_t no_write_complaint = C_COMPLAIN_INIT_STATIC;
@@ -2101,8 +6670,8 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
     return -1;
   }
 
-  data_set_t *ds = NULL;
-  if (c_avl_get(data_sets, vl->type, (void *)&ds) != 0) {
+  data_set_t const *ds = plugin_value_list_ds(vl);
+  if (ds == NULL) {
     char ident[6 * DATA_MAX_NAME_LEN];
 
     FORMAT_VL(ident, sizeof(ident), vl);
@@ -2141,11 +6710,15 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   }
 #endif
 
+  /* The host name may have been filled in from the global hostname, so it is
+   * always escaped. */
   escape_slashes(vl->host, sizeof(vl->host));
-  escape_slashes(vl->plugin, sizeof(vl->plugin));
-  escape_slashes(vl->plugin_instance, sizeof(vl->plugin_instance));
-  escape_slashes(vl->type, sizeof(vl->type));
-  escape_slashes(vl->type_instance, sizeof(vl->type_instance));
+  if (!vl->escaped) {
+    escape_slashes(vl->plugin, sizeof(vl->plugin));
+    escape_slashes(vl->plugin_instance, sizeof(vl->plugin_instance));
+    escape_slashes(vl->type, sizeof(vl->type));
+    escape_slashes(vl->type_instance, sizeof(vl->type_instance));
+  }
 
   if (pre_cache_chain != NULL) {
     status = fc_process_chain(ds, vl, pre_cache_chain);
@@ -2158,8 +6731,42 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
       return 0;
   }
 
-  /* Update the value cache */
-  uc_update(ds, vl);
+  /* Update the value cache. New series over the series limits are dropped or
+   * folded into the overflow series of their host, plugin and type. Value
+   * lists that didn't change are not written if the dispatching plugin was
+   * loaded with "SuppressUnchanged". */
+  plugin_ctx_t ctx = plugin_get_ctx();
+  bool unchanged = false;
+  if (ctx.suppress_unchanged)
+    status = uc_update_suppress(
+        ds, vl, (cdtime_t)ctx.suppress_heartbeat * vl->interval, &unchanged);
+  else
+    status = uc_update(ds, vl);
+
+  if (unchanged) {
+    __atomic_fetch_add(&stats_values_suppressed, 1, __ATOMIC_RELAXED);
+    if ((free_meta_data == true) && (vl->meta != NULL)) {
+      meta_data_destroy(vl->meta);
+      vl->meta = NULL;
+    }
+    return 0;
+  }
+
+  if (status == ENOSPC) {
+    if (!series_limit_overflow) {
+      if ((free_meta_data == true) && (vl->meta != NULL)) {
+        meta_data_destroy(vl->meta);
+        vl->meta = NULL;
+      }
+      return 0;
+    }
+
+    sstrncpy(vl->plugin_instance, UC_OVERFLOW_INSTANCE,
+             sizeof(vl->plugin_instance));
+    sstrncpy(vl->type_instance, UC_OVERFLOW_INSTANCE,
+             sizeof(vl->type_instance));
+    uc_update(ds, vl);
+  }
 
   if (post_cache_chain != NULL) {
     status = fc_process_chain(ds, vl, post_cache_chain);
@@ -2182,23 +6789,8 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
 
 static double get_drop_probability(void) /* {{{ */
 {
-  long pos;
-  long size;
-  long wql;
-
-  pthread_mutex_lock(&write_lock);
-  wql = write_queue_length;
-  pthread_mutex_unlock(&write_lock);
-
-  if (wql < write_limit_low)
-    return 0.0;
-  if (wql >= write_limit_high)
-    return 1.0;
-
-  pos = 1 + wql - write_limit_low;
-  size = 1 + write_limit_high - write_limit_low;
-
-  return (double)pos / (double)size;
+  return write_drop_probability(write_queue_length(), write_limit_low,
+                                write_limit_high);
 } /* }}} double get_drop_probability */
 
 static bool check_drop_value(void) /* {{{ */
@@ -2221,7 +6813,7 @@ static bool check_drop_value(void) /* {{{ */
   if (status == 0) {
     cdtime_t now;
 
-    now = cdtime();
+    now = cdtime_coarse();
     if ((now - last_message_time) > TIME_T_TO_CDTIME_T(1)) {
       last_message_time = now;
       ERROR("plugin_dispatch_values: Low water mark "
@@ -2231,6 +6823,9 @@ static bool check_drop_value(void) /* {{{ */
     pthread_mutex_unlock(&last_message_lock);
   }
 
+  p = write_drop_probability_class(p, plugin_get_ctx().write_priority);
+  if (p == 0.0)
+    return false;
   if (p == 1.0)
     return true;
 
@@ -2245,10 +6840,12 @@ EXPORT int plugin_dispatch_values(value_list_t const *vl) {
   int status;
 
   if (check_drop_value()) {
+    PROBE2(value__drop, vl->plugin, vl->type);
     if (record_statistics) {
       pthread_mutex_lock(&statistics_lock);
       stats_values_dropped++;
       pthread_mutex_unlock(&statistics_lock);
+      plugin_stats_dispatch(0, 1);
     }
     return 0;
   }
@@ -2261,22 +6858,208 @@ EXPORT int plugin_dispatch_values(value_list_t const *vl) {
     return status;
   }
 
+  plugin_stats_dispatch(1, 0);
   return 0;
 }
 
+/* Nodes sorted by write queue, so that each queue is locked only once when a
+ * batch of value lists is enqueued. */
+typedef struct {
+  write_queue_t *head;
+  write_queue_t *tail;
+  long length;
+} write_queue_chain_t;
+
+typedef struct {
+  write_queue_chain_t single;
+  write_queue_chain_t *chains;
+  size_t chains_num;
+} write_queue_batch_t;
+
+static int write_queue_batch_init(write_queue_batch_t *b) /* {{{ */
+{
+  *b = (write_queue_batch_t){
+      .chains = &b->single,
+      .chains_num = write_queues_num,
+  };
+
+  if (b->chains_num > 1) {
+    b->chains = calloc(b->chains_num, sizeof(*b->chains));
+    if (b->chains == NULL)
+      return ENOMEM;
+  }
+
+  return 0;
+} /* }}} int write_queue_batch_init */
+
+static void write_queue_batch_add(write_queue_batch_t *b, /* {{{ */
+                                  write_queue_t *q) {
+  size_t idx = 0;
+  if (b->chains_num > 1)
+    idx = q->hash % b->chains_num;
+
+  write_queue_chain_t *c = b->chains + idx;
+  if (c->tail == NULL)
+    c->head = q;
+  else
+    c->tail->next = q;
+  c->tail = q;
+  c->length++;
+} /* }}} void write_queue_batch_add */
+
+/* Appends all chains to their write queues and frees the batch. */
+static void write_queue_batch_commit(write_queue_batch_t *b) /* {{{ */
+{
+  for (size_t i = 0; i < b->chains_num; i++) {
+    write_queue_chain_t *c = b->chains + i;
+    write_queue_shard_t *wq = write_queues + i;
+
+    if (c->head == NULL)
+      continue;
+
+    pthread_mutex_lock(&wq->lock);
+    /* All value lists of a batch are dispatched with the same context and
+     * are of the same priority class. */
+    write_queue_splice(wq, c->head, c->tail, c->length);
+
+    if (c->length == 1)
+      pthread_cond_signal(&wq->cond);
+    else
+      pthread_cond_broadcast(&wq->cond);
+    pthread_mutex_unlock(&wq->lock);
+  }
+
+  if (b->chains != &b->single)
+    sfree(b->chains);
+} /* }}} void write_queue_batch_commit */
+
+EXPORT int plugin_dispatch_values_batch(value_list_t const *vl, /* {{{ */
+                                        size_t vl_num) {
+  write_queue_batch_t batch;
+  int ret = 0;
+
+  if ((vl == NULL) || (vl_num == 0))
+    return (vl_num == 0) ? 0 : EINVAL;
+
+  if (write_queue_batch_init(&batch) != 0)
+    return ENOMEM;
+
+  size_t dispatched = 0;
+  size_t dropped = 0;
+
+  /* Copy the value lists and sort them by queue before taking any lock. */
+  for (size_t i = 0; i < vl_num; i++) {
+    if (check_drop_value()) {
+      PROBE2(value__drop, vl[i].plugin, vl[i].type);
+      if (record_statistics) {
+        pthread_mutex_lock(&statistics_lock);
+        stats_values_dropped++;
+        pthread_mutex_unlock(&statistics_lock);
+      }
+      dropped++;
+      continue;
+    }
+
+    write_queue_t *q = write_queue_create(vl + i);
+    if (q == NULL) {
+      ret = ENOMEM;
+      continue;
+    }
+
+    PROBE3(dispatch__enqueue, vl[i].host, vl[i].plugin, vl[i].type);
+    write_queue_batch_add(&batch, q);
+    dispatched++;
+  }
+
+  write_queue_batch_commit(&batch);
+  plugin_stats_dispatch(dispatched, dropped);
+
+  if (ret != 0)
+    ERROR("plugin_dispatch_values_batch: Enqueueing values failed with "
+          "status %i (%s).",
+          ret, STRERROR(ret));
+
+  return ret;
+} /* }}} int plugin_dispatch_values_batch */
+
+EXPORT int plugin_dispatch_instances(value_list_t const *template, /* {{{ */
+                                     char const *const *instances,
+                                     value_t const *values, size_t num) {
+  int ret = 0;
+
+  if ((template == NULL) || (template->values_len == 0) ||
+      ((num > 0) && ((instances == NULL) || (values == NULL))))
+    return EINVAL;
+  if (num == 0)
+    return 0;
+
+  /* Resolve the time once, so that all instances share the same timestamp. */
+  value_list_t shared = *template;
+  if (shared.time == 0) {
+    if (shared_read_timestamp)
+      shared.time = plugin_get_ctx().read_time;
+    if (shared.time == 0)
+      shared.time = cdtime();
+  }
+
+  write_queue_batch_t batch;
+  if (write_queue_batch_init(&batch) != 0)
+    return ENOMEM;
+
+  size_t dispatched = 0;
+  size_t dropped = 0;
+
+  for (size_t i = 0; i < num; i++) {
+    if (check_drop_value()) {
+      PROBE2(value__drop, shared.plugin, shared.type);
+      if (record_statistics) {
+        pthread_mutex_lock(&statistics_lock);
+        stats_values_dropped++;
+        pthread_mutex_unlock(&statistics_lock);
+      }
+      dropped++;
+      continue;
+    }
+
+    write_queue_t *q = write_queue_create_instance(
+        &shared, instances[i], values + i * shared.values_len);
+    if (q == NULL) {
+      ret = ENOMEM;
+      continue;
+    }
+
+    PROBE3(dispatch__enqueue, shared.host, shared.plugin, shared.type);
+    write_queue_batch_add(&batch, q);
+    dispatched++;
+  }
+
+  write_queue_batch_commit(&batch);
+  plugin_stats_dispatch(dispatched, dropped);
+
+  if (ret != 0)
+    ERROR("plugin_dispatch_instances: Enqueueing values failed with "
+          "status %i (%s).",
+          ret, STRERROR(ret));
+
+  return ret;
+} /* }}} int plugin_dispatch_instances */
+
 __attribute__((sentinel)) int
 plugin_dispatch_multivalue(value_list_t const *template, /* {{{ */
                            bool store_percentage, int store_type, ...) {
   value_list_t *vl;
   int failed = 0;
+  size_t dispatched = 0;
   gauge_t sum = 0.0;
   va_list ap;
 
   if (check_drop_value()) {
+    PROBE2(value__drop, template->plugin, template->type);
     if (record_statistics) {
       pthread_mutex_lock(&statistics_lock);
       stats_values_dropped++;
       pthread_mutex_unlock(&statistics_lock);
+      plugin_stats_dispatch(0, 1);
     }
     return 0;
   }
@@ -2341,15 +7124,113 @@ plugin_dispatch_multivalue(value_list_t const *template, /* {{{ */
     status = plugin_write_enqueue(vl);
     if (status != 0)
       failed++;
+    else
+      dispatched++;
   }
   va_end(ap);
+  plugin_stats_dispatch(dispatched, 0);
 
   plugin_value_list_free(vl);
   return failed;
 } /* }}} int plugin_dispatch_multivalue */
 
+static void plugin_notification_callbacks(notification_t const *n) /* {{{ */
+{
+  pthread_rwlock_rdlock(&callbacks_lock);
+  for (llentry_t *le = llist_head(list_notification); le != NULL;
+       le = le->next) {
+    callback_func_t *cf = le->value;
+    plugin_notification_cb callback = cf->cf_callback;
+
+    /* do not switch plugin context; rather keep the context
+     * (interval) information of the calling plugin */
+
+    int status = (*callback)(n, &cf->cf_udata);
+    if (status != 0) {
+      WARNING("plugin_dispatch_notification: Notification "
+              "callback %s returned %i.",
+              le->key, status);
+    }
+  }
+  pthread_rwlock_unlock(&callbacks_lock);
+} /* }}} void plugin_notification_callbacks */
+
+/* Notifications are coalesced if they have the same severity and identifier,
+ * regardless of their message. */
+static bool notification_same_source(notification_t const *a,
+                                     notification_t const *b) /* {{{ */
+{
+  return (a->severity == b->severity) && (strcmp(a->type, b->type) == 0) &&
+         (strcmp(a->type_instance, b->type_instance) == 0) &&
+         (strcmp(a->plugin, b->plugin) == 0) &&
+         (strcmp(a->plugin_instance, b->plugin_instance) == 0) &&
+         (strcmp(a->host, b->host) == 0);
+} /* }}} bool notification_same_source */
+
+/* Adds a copy of "n" to the notification queue. Returns non-zero if the
+ * notification threads are not running. */
+static int plugin_notification_enqueue(notification_t const *n) /* {{{ */
+{
+  notification_queue_t *q = calloc(1, sizeof(*q));
+  if (q == NULL)
+    return ENOMEM;
+
+  q->n = *n;
+  q->n.meta = NULL;
+  plugin_notification_meta_copy(&q->n, n);
+  q->enqueued = cdtime();
+
+  pthread_mutex_lock(&notif_queue_lock);
+  if (!notif_loop) {
+    pthread_mutex_unlock(&notif_queue_lock);
+    notification_queue_free(q);
+    return -1;
+  }
+
+  /* A queued notification from the same source is replaced by the newer one,
+   * which keeps its place in the queue. */
+  if (notif_coalesce_interval > 0) {
+    for (notification_queue_t *e = notif_queue_head; e != NULL; e = e->next) {
+      if (((q->enqueued - e->enqueued) >= notif_coalesce_interval) ||
+          !notification_same_source(&e->n, &q->n))
+        continue;
+
+      notification_meta_t *meta = e->n.meta;
+      e->n = q->n;
+      q->n.meta = meta;
+      notif_queue_coalesced++;
+      pthread_mutex_unlock(&notif_queue_lock);
+
+      notification_queue_free(q);
+      return 0;
+    }
+  }
+
+  if (notif_queue_length >= notif_queue_limit) {
+    notif_queue_dropped++;
+    pthread_mutex_unlock(&notif_queue_lock);
+
+    notification_queue_free(q);
+    return 0;
+  }
+
+  if (notif_queue_tail == NULL)
+    notif_queue_head = q;
+  else
+    notif_queue_tail->next = q;
+  notif_queue_tail = q;
+  notif_queue_length++;
+
+  pthread_cond_signal(&notif_queue_cond);
+  pthread_mutex_unlock(&notif_queue_lock);
+  return 0;
+} /* }}} int plugin_notification_enqueue */
+
+EXPORT bool plugin_notification_has_consumers(void) {
+  return list_notification != NULL;
+} /* bool plugin_notification_has_consumers */
+
 EXPORT int plugin_dispatch_notification(const notification_t *notif) {
-  llentry_t *le;
   /* Possible TODO: Add flap detection here */
 
   DEBUG("plugin_dispatch_notification: severity = %i; message = %s; "
@@ -2361,34 +7242,58 @@ EXPORT int plugin_dispatch_notification(const notification_t *notif) {
   if (list_notification == NULL)
     return -1;
 
-  le = llist_head(list_notification);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_notification_cb callback;
-    int status;
+  if (plugin_notification_enqueue(notif) == 0)
+    return 0;
+
+  plugin_notification_callbacks(notif);
+  return 0;
+} /* int plugin_dispatch_notification */
+
+static void plugin_log_callbacks(int level, char const *msg) /* {{{ */
+{
+  pthread_rwlock_rdlock(&callbacks_lock);
+  for (llentry_t *le = llist_head(list_log); le != NULL; le = le->next) {
+    callback_func_t *cf = le->value;
+    plugin_log_cb callback = cf->cf_callback;
 
     /* do not switch plugin context; rather keep the context
      * (interval) information of the calling plugin */
 
-    cf = le->value;
-    callback = cf->cf_callback;
-    status = (*callback)(notif, &cf->cf_udata);
-    if (status != 0) {
-      WARNING("plugin_dispatch_notification: Notification "
-              "callback %s returned %i.",
-              le->key, status);
-    }
+    (*callback)(level, msg, &cf->cf_udata);
+  }
+  pthread_rwlock_unlock(&callbacks_lock);
+} /* }}} void plugin_log_callbacks */
 
-    le = le->next;
+/* Adds a message to the log queue. Returns non-zero if the log thread is not
+ * running. If the queue is full, the message is dropped and counted. */
+static int plugin_log_enqueue(int level, char const *msg) /* {{{ */
+{
+  pthread_mutex_lock(&log_queue_lock);
+  if (!log_loop) {
+    pthread_mutex_unlock(&log_queue_lock);
+    return -1;
+  }
+
+  if ((log_queue_head - log_queue_tail) >= log_queue_size) {
+    log_queue_suppressed++;
+    log_queue_dropped++;
+    pthread_mutex_unlock(&log_queue_lock);
+    return 0;
   }
 
+  log_entry_t *e = log_queue + (log_queue_head % log_queue_size);
+  e->level = level;
+  sstrncpy(e->msg, msg, sizeof(e->msg));
+  log_queue_head++;
+
+  pthread_cond_signal(&log_queue_cond);
+  pthread_mutex_unlock(&log_queue_lock);
   return 0;
-} /* int plugin_dispatch_notification */
+} /* }}} int plugin_log_enqueue */
 
 EXPORT void plugin_log(int level, const char *format, ...) {
   char msg[1024];
   va_list ap;
-  llentry_t *le;
 
 #if !COLLECT_DEBUG
   if (level >= LOG_DEBUG)
@@ -2405,21 +7310,10 @@ EXPORT void plugin_log(int level, const char *format, ...) {
     return;
   }
 
-  le = llist_head(list_log);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_log_cb callback;
-
-    cf = le->value;
-    callback = cf->cf_callback;
-
-    /* do not switch plugin context; rather keep the context
-     * (interval) information of the calling plugin */
-
-    (*callback)(level, msg, &cf->cf_udata);
+  if (plugin_log_enqueue(level, msg) == 0)
+    return;
 
-    le = le->next;
-  }
+  plugin_log_callbacks(level, msg);
 } /* void plugin_log */
 
 void daemon_log(int level, const char *format, ...) {
@@ -2480,7 +7374,8 @@ EXPORT const data_set_t *plugin_get_ds(const char *name) {
     return NULL;
   }
 
-  if (c_avl_get(data_sets, name, (void *)&ds) != 0) {
+  ds = data_sets_index_get(name);
+  if (ds == NULL) {
     DEBUG("No such dataset registered: %s", name);
     return NULL;
   }
@@ -2662,6 +7557,15 @@ static plugin_ctx_t *plugin_ctx_create(void) {
 EXPORT void plugin_init_ctx(void) {
   pthread_key_create(&plugin_ctx_key, plugin_ctx_destructor);
   plugin_ctx_key_initialized = true;
+
+  pthread_key_create(&write_thread_key, /* destructor = */ NULL);
+  pthread_key_create(&plugin_stats_key, plugin_stats_table_release);
+  pthread_key_create(&read_adaptive_key, /* destructor = */ NULL);
+  pthread_key_create(&write_formats_key, write_formats_destroy);
+
+  /* Keep enough free nodes around to absorb the queue length varying by a
+   * few thousand value lists without calling malloc(3). */
+  write_queue_pool = pool_create(sizeof(write_queue_t), /* max_free = */ 16384);
 } /* void plugin_init_ctx */
 
 EXPORT plugin_ctx_t plugin_get_ctx(void) {
@@ -2740,6 +7644,8 @@ int plugin_thread_create(pthread_t *thread, void *(*start_routine)(void *),
     return ENOMEM;
 
   plugin_thread->ctx = plugin_get_ctx();
+  /* Threads outlive the read that may have started them. */
+  plugin_thread->ctx.read_time = 0;
   plugin_thread->start_routine = start_routine;
   plugin_thread->arg = arg;
 
@@ -111,6 +111,17 @@ struct value_list_s {
   char type[DATA_MAX_NAME_LEN];
   char type_instance[DATA_MAX_NAME_LEN];
   meta_data_t *meta;
+
+  /* Optional: the data set of "type", as returned by plugin_get_ds(). If set,
+   * plugin_dispatch_values() doesn't need to look up the type. It is ignored
+   * if its type doesn't match "type". Data sets that are replaced or
+   * unregistered are not freed before shutdown, so the pointer may be kept
+   * for the lifetime of the plugin. */
+  struct data_set_s const *ds;
+  /* Optional: set to true if "plugin", "plugin_instance", "type" and
+   * "type_instance" are known not to contain slashes, so that
+   * plugin_dispatch_values() doesn't need to escape them. */
+  bool escaped;
 };
 typedef struct value_list_s value_list_t;
 
@@ -180,11 +191,50 @@ typedef struct cache_event_s {
   int ret;
 } cache_event_t;
 
+/* Priority classes of the write queue, see the "WritePriority" option of
+ * <LoadPlugin>. Value lists of a higher class are written first and dropped
+ * last when the queue is over "WriteQueueLimitLow". */
+#define WRITE_PRIORITY_LOW (-1)
+#define WRITE_PRIORITY_NORMAL 0
+#define WRITE_PRIORITY_HIGH 1
+
 struct plugin_ctx_s {
   char *name;
   cdtime_t interval;
   cdtime_t flush_interval;
   cdtime_t flush_timeout;
+  /* Write callbacks registered with this context get a queue and thread of
+   * their own, see the "WriteQueue" option of <LoadPlugin>. */
+  bool write_queue;
+  int write_queue_limit_high;
+  int write_queue_limit_low;
+  /* Write sinks spill to disk instead of dropping value lists, see the
+   * "WriteQueueSpill" option. The limit is in MiB. */
+  bool write_queue_spill;
+  int write_queue_spill_limit;
+  /* Value lists that are equal to the cached ones are not written, except
+   * every "suppress_heartbeat" intervals. See the "SuppressUnchanged" option
+   * of <LoadPlugin>. */
+  bool suppress_unchanged;
+  int suppress_heartbeat;
+  /* Read callbacks registered with this context that run longer than this
+   * are handed off by the read watchdog. Zero means the global default. See
+   * the "ReadTimeout" option. */
+  cdtime_t read_timeout;
+  /* Read callbacks registered with this context shorten their interval down
+   * to "adaptive_interval_min" while the values they dispatch are volatile
+   * and lengthen it up to "adaptive_interval_max" while they are stable. See
+   * the "AdaptiveInterval" option. */
+  bool adaptive_interval;
+  cdtime_t adaptive_interval_min;
+  cdtime_t adaptive_interval_max;
+  double adaptive_threshold;
+  /* Priority class of the value lists dispatched with this context, one of
+   * the WRITE_PRIORITY_* constants. */
+  int write_priority;
+  /* Start of the current read callback if "SharedReadTimestamp" is enabled.
+   * Used as the time of value lists dispatched without one. */
+  cdtime_t read_time;
 };
 typedef struct plugin_ctx_s plugin_ctx_t;
 
@@ -195,6 +245,11 @@ typedef int (*plugin_init_cb)(void);
 typedef int (*plugin_read_cb)(user_data_t *);
 typedef int (*plugin_write_cb)(const data_set_t *, const value_list_t *,
                                user_data_t *);
+/* "write batch" callback. Receives "num" value lists and their data sets at
+ * once. The arrays and the value lists are only valid during the call. */
+typedef int (*plugin_write_batch_cb)(const data_set_t *const *ds,
+                                     const value_list_t *const *vl, size_t num,
+                                     user_data_t *);
 typedef int (*plugin_flush_cb)(cdtime_t timeout, const char *identifier,
                                user_data_t *);
 /* "missing" callback. Returns less than zero on failure, zero if other
@@ -250,10 +305,53 @@ int plugin_load(const char *name, bool global);
 bool plugin_is_loaded(char const *name);
 
 int plugin_init_all(void);
+/* Handles a global <ReadThreadPool> block. Must be called before
+ * plugin_init_all(). */
+int plugin_config_read_pool(oconfig_item_t const *ci);
 void plugin_read_all(void);
 int plugin_read_all_once(void);
 int plugin_shutdown_all(void);
 
+/*
+ * Reloading the configuration
+ *
+ * plugin_reload_request() asks the main loop to re-read the configuration
+ * file and may be called from a signal handler. plugin_reload_requested()
+ * returns true once per request.
+ *
+ * While reloading, plugin_reload_begin() stops the read, write and cache
+ * event threads, keeping queued value lists. plugin_unload() runs the
+ * shutdown callbacks of a plugin, unregisters all its callbacks and unloads
+ * the shared object. It fails with EBUSY, leaving the plugin untouched, while
+ * a read callback of the plugin that exceeded its timeout is still running.
+ * plugin_init_plugin() runs the init callbacks of a plugin that has been
+ * loaded again. plugin_reload_end() starts the threads again.
+ */
+void plugin_reload_request(void);
+bool plugin_reload_requested(void);
+void plugin_reload_begin(void);
+int plugin_unload(char const *name);
+int plugin_init_plugin(char const *name);
+void plugin_reload_end(void);
+
+/*
+ * NAME
+ *  plugin_get_stats
+ *
+ * DESCRIPTION
+ *  Describes what the daemon is doing right now, one item per line: the
+ *  callback each read and write thread is calling and for how long, the CPU
+ *  time of the threads, the read functions ordered by the time they are due
+ *  next, the length of the write queues and the number of cache entries and
+ *  the memory they use, in total and per plugin. Used by the STATS command of
+ *  the unixsock plugin.
+ *
+ * RETURN VALUE
+ *  Zero on success, an errno value otherwise. The lines and the array have to
+ *  be freed by the caller.
+ */
+int plugin_get_stats(char ***ret_lines, size_t *ret_lines_num);
+
 /*
  * NAME
  *  plugin_write
@@ -284,7 +382,55 @@ int plugin_shutdown_all(void);
 int plugin_write(const char *plugin, const data_set_t *ds,
                  const value_list_t *vl);
 
+/*
+ * NAME
+ *  plugin_write_format_get, plugin_write_format_put
+ *
+ * DESCRIPTION
+ *  Lets the write callbacks that `plugin_write' calls for the same value list
+ *  share serialized forms of it, so that a format is only rendered once. The
+ *  first callback that needs a format stores it with `plugin_write_format_put'
+ *  and the following ones copy it from the result of `plugin_write_format_get'.
+ *  Outside of `plugin_write' and for other value lists, e.g. copies of `vl',
+ *  nothing is shared.
+ *
+ * ARGUMENTS
+ *  vl         The value list passed to the write callback.
+ *  key        Identifies the format and all options that change its output.
+ *  data, len  The serialized value list, not necessarily null terminated.
+ *
+ * RETURN VALUE
+ *  `plugin_write_format_get' returns the stored data, which is null
+ *  terminated and valid until the write callback returns, and sets `ret_len'.
+ *  It returns NULL if the format has not been stored.
+ */
+char const *plugin_write_format_get(value_list_t const *vl, char const *key,
+                                    size_t *ret_len);
+void plugin_write_format_put(value_list_t const *vl, char const *key,
+                             char const *data, size_t len);
+
 int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier);
+/*
+ * NAME
+ *  plugin_flush_deadline
+ *
+ * DESCRIPTION
+ *  Like `plugin_flush', but calls the flush callbacks of different plugins
+ *  concurrently. If the same flush is already running for a plugin, e.g.
+ *  because of another FLUSH command, it is waited for instead of being
+ *  started again.
+ *
+ * ARGUMENTS
+ *  deadline   Point in time after which the function returns even if flush
+ *             callbacks are still running. Those callbacks continue in the
+ *             background. Zero means no deadline.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success, ETIMEDOUT if the deadline passed before all
+ *  callbacks returned and another non-zero value if an error occurred.
+ */
+int plugin_flush_deadline(const char *plugin, cdtime_t timeout,
+                          const char *identifier, cdtime_t deadline);
 
 /*
  * The `plugin_register_*' functions are used to make `config', `init',
@@ -305,6 +451,12 @@ int plugin_register_complex_read(const char *group, const char *name,
                                  user_data_t const *user_data);
 int plugin_register_write(const char *name, plugin_write_cb callback,
                           user_data_t const *user_data);
+/* Registers a write callback that receives value lists in batches. Batch
+ * write callbacks share the namespace of, and are unregistered like, other
+ * write callbacks. */
+int plugin_register_write_batch(const char *name,
+                                plugin_write_batch_cb callback,
+                                user_data_t const *user_data);
 int plugin_register_flush(const char *name, plugin_flush_cb callback,
                           user_data_t const *user_data);
 int plugin_register_missing(const char *name, plugin_missing_cb callback,
@@ -323,6 +475,14 @@ int plugin_register_notification(const char *name,
 int plugin_unregister_config(const char *name);
 int plugin_unregister_complex_config(const char *name);
 int plugin_unregister_init(const char *name);
+/* Runs the read callback "name" on one of the CPUs "cpus", e.g. because it
+ * reads per-CPU hardware counters and would otherwise migrate between CPUs
+ * while doing so. Can only be called once per callback. Returns ENOENT if
+ * there is no such callback and ENOTSUP if threads can't be pinned on this
+ * platform. */
+int plugin_set_read_cpus(const char *name, unsigned int const *cpus,
+                         size_t cpus_num);
+
 int plugin_unregister_read(const char *name);
 int plugin_unregister_read_group(const char *group);
 int plugin_unregister_write(const char *name);
@@ -362,6 +522,58 @@ void plugin_log_available_writers(void);
  */
 int plugin_dispatch_values(value_list_t const *vl);
 
+/*
+ * NAME
+ *  plugin_dispatch_values_batch
+ *
+ * DESCRIPTION
+ *  Like `plugin_dispatch_values', but dispatches `vl_num' value lists at once.
+ *  The value lists are copied first and then added to the write queue while
+ *  holding the queue lock only once, waking up the write threads only once.
+ *  Plugins that dispatch many value lists per read cycle should prefer this
+ *  function.
+ *
+ * ARGUMENTS
+ *  `vl'        Array of value lists to dispatch.
+ *  `vl_num'    Number of elements in `vl'.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success or an error code if at least one of the value
+ *  lists could not be enqueued. The remaining value lists are dispatched
+ *  nonetheless.
+ */
+int plugin_dispatch_values_batch(value_list_t const *vl, size_t vl_num);
+
+/*
+ * NAME
+ *  plugin_dispatch_instances
+ *
+ * DESCRIPTION
+ *  Dispatches `num' value lists that share the identifier of `template' and
+ *  differ only in the type instance and the values, e.g. the states of one
+ *  CPU or the statistics of one network interface. The value lists are
+ *  enqueued like with `plugin_dispatch_values_batch', but are built directly
+ *  from the template without a `value_list_t' per instance. If the time of
+ *  `template' is zero, all instances share the same timestamp.
+ *
+ * ARGUMENTS
+ *  `template'  Value list with the shared identifier, time, interval and
+ *              meta data. Its `values' and `type_instance' are ignored;
+ *              `values_len' is the number of values per instance.
+ *  `instances' Array of `num' type instances.
+ *  `values'    Array of `num' * `template->values_len' values, one row per
+ *              instance.
+ *  `num'       Number of instances.
+ *
+ * RETURN VALUE
+ *  Returns zero upon success or an error code if at least one of the value
+ *  lists could not be enqueued. The remaining value lists are dispatched
+ *  nonetheless.
+ */
+int plugin_dispatch_instances(value_list_t const *template,
+                              char const *const *instances,
+                              value_t const *values, size_t num);
+
 /*
  * NAME
  *  plugin_dispatch_multivalue
@@ -402,8 +614,13 @@ int plugin_dispatch_missing(const value_list_t *vl);
 void plugin_dispatch_cache_event(enum cache_event_type_e event_type,
                                  unsigned long callbacks_mask, const char *name,
                                  const value_list_t *vl);
+/* Blocks until the cache events dispatched so far have been handled. */
+void plugin_wait_cache_events(void);
 
 int plugin_dispatch_notification(const notification_t *notif);
+/* Returns true if a notification callback is registered. Plugins can use this
+ * to avoid building notifications nobody receives. */
+bool plugin_notification_has_consumers(void);
 
 void plugin_log(int level, const char *format, ...)
     __attribute__((format(printf, 2, 3)));
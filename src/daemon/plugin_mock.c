@@ -69,6 +69,13 @@ int plugin_register_write(__attribute__((unused)) const char *name,
   return ENOTSUP;
 }
 
+int plugin_register_write_batch(__attribute__((unused)) const char *name,
+                                __attribute__((unused))
+                                plugin_write_batch_cb callback,
+                                __attribute__((unused)) user_data_t const *ud) {
+  return ENOTSUP;
+}
+
 int plugin_register_flush(__attribute__((unused)) const char *name,
                           __attribute__((unused)) plugin_flush_cb callback,
                           __attribute__((unused))
@@ -121,11 +128,58 @@ DECLARE_UNREGISTER(notification)
 
 int plugin_dispatch_values(value_list_t const *vl) { return ENOTSUP; }
 
+char const *plugin_write_format_get(__attribute__((unused))
+                                    value_list_t const *vl,
+                                    __attribute__((unused)) char const *key,
+                                    __attribute__((unused)) size_t *ret_len) {
+  return NULL;
+}
+
+void plugin_write_format_put(__attribute__((unused)) value_list_t const *vl,
+                             __attribute__((unused)) char const *key,
+                             __attribute__((unused)) char const *data,
+                             __attribute__((unused)) size_t len) { /* nop */
+}
+
+int plugin_dispatch_values_batch(__attribute__((unused)) value_list_t const *vl,
+                                 __attribute__((unused)) size_t vl_num) {
+  return ENOTSUP;
+}
+
+int plugin_dispatch_instances(
+    __attribute__((unused)) value_list_t const *template,
+    __attribute__((unused)) char const *const *instances,
+    __attribute__((unused)) value_t const *values,
+    __attribute__((unused)) size_t num) {
+  return ENOTSUP;
+}
+
 int plugin_dispatch_notification(__attribute__((unused))
                                  const notification_t *notif) {
   return ENOTSUP;
 }
 
+bool plugin_notification_has_consumers(void) { return false; }
+
+void plugin_reload_request(void) { /* nop */
+}
+
+int plugin_config_read_pool(__attribute__((unused)) oconfig_item_t const *ci) {
+  return ENOTSUP;
+}
+
+void plugin_reload_begin(void) { /* nop */
+}
+
+int plugin_unload(__attribute__((unused)) char const *name) { return ENOTSUP; }
+
+int plugin_init_plugin(__attribute__((unused)) char const *name) {
+  return ENOTSUP;
+}
+
+void plugin_reload_end(void) { /* nop */
+}
+
 int plugin_notification_meta_add_string(__attribute__((unused))
                                         notification_t *n,
                                         __attribute__((unused))
@@ -184,6 +238,11 @@ int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier) {
   return ENOTSUP;
 }
 
+int plugin_flush_deadline(const char *plugin, cdtime_t timeout,
+                          const char *identifier, cdtime_t deadline) {
+  return ENOTSUP;
+}
+
 static data_source_t magic_ds[] = {{"value", DS_TYPE_DERIVE, 0.0, NAN}};
 static data_set_t magic = {"MAGIC", 1, magic_ds};
 const data_set_t *plugin_get_ds(const char *name) {
@@ -244,3 +303,5 @@ int plugin_thread_create(__attribute__((unused)) pthread_t *thread,
  * would be to hard-code the top-level config keys in daemon/collectd.c to avoid
  * having these references in daemon/configfile.c. */
 int fc_configure(const oconfig_item_t *ci) { return ENOTSUP; }
+
+int fc_reconfigure(const oconfig_item_t *root) { return ENOTSUP; }
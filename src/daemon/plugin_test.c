@@ -0,0 +1,139 @@
+/**
+ * collectd - src/daemon/plugin_test.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "testing.h"
+#include "utils/common/common.h"
+
+static data_source_t test_dsrc[] = {{"value", DS_TYPE_GAUGE, 0.0, NAN}};
+static data_set_t test_ds = {"test", 1, test_dsrc};
+
+static pthread_mutex_t written_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t written_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t written;
+/* The data set passed to the last call of test_write(). */
+static data_set_t const *written_ds;
+
+static int test_init(void) { return 0; }
+
+static int test_write(data_set_t const *ds, value_list_t const *vl,
+                      __attribute__((unused)) user_data_t *ud) {
+  pthread_mutex_lock(&written_lock);
+  if (strcmp(ds->type, vl->type) == 0)
+    written_ds = ds;
+  written++;
+  pthread_cond_broadcast(&written_cond);
+  pthread_mutex_unlock(&written_lock);
+  return 0;
+}
+
+/* Dispatches "vl" and returns the data set the write callback received. */
+static data_set_t const *dispatch(value_list_t *vl) {
+  static cdtime_t t = TIME_T_TO_CDTIME_T_STATIC(1577836800);
+
+  pthread_mutex_lock(&written_lock);
+  uint64_t want = written + 1;
+  written_ds = NULL;
+  pthread_mutex_unlock(&written_lock);
+
+  vl->time = t++;
+  if (plugin_dispatch_values(vl) != 0)
+    return NULL;
+
+  pthread_mutex_lock(&written_lock);
+  while (written < want)
+    pthread_cond_wait(&written_cond, &written_lock);
+  data_set_t const *ds = written_ds;
+  pthread_mutex_unlock(&written_lock);
+
+  return ds;
+}
+
+DEF_TEST(dispatch_lookup) {
+  value_t v = {.gauge = 42.0};
+  value_list_t vl = {
+      .values = &v,
+      .values_len = 1,
+      .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+      .host = "example.com",
+      .plugin = "dispatch_lookup",
+      .type = "test",
+  };
+
+  /* Without "vl.ds", the type is looked up on the dispatch path. */
+  data_set_t const *ds = plugin_get_ds("test");
+  OK(ds != NULL);
+  EXPECT_EQ_PTR((void *)ds, (void *)dispatch(&vl));
+
+  return 0;
+}
+
+DEF_TEST(replaced_data_set) {
+  value_t v = {.gauge = 42.0};
+  value_list_t vl = {
+      .values = &v,
+      .values_len = 1,
+      .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+      .host = "example.com",
+      .plugin = "replaced_data_set",
+      .type = "test",
+  };
+
+  /* A plugin resolved the type at init time. */
+  data_set_t const *cached = plugin_get_ds("test");
+  OK(cached != NULL);
+  vl.ds = cached;
+  EXPECT_EQ_PTR((void *)cached, (void *)dispatch(&vl));
+
+  /* Replacing the data set keeps the old one allocated, but it is not used
+   * anymore. */
+  CHECK_ZERO(plugin_register_data_set(&test_ds));
+  data_set_t const *ds = plugin_get_ds("test");
+  OK(ds != NULL);
+  OK(ds != cached);
+  EXPECT_EQ_STR("", cached->type);
+  EXPECT_EQ_PTR((void *)ds, (void *)dispatch(&vl));
+
+  return 0;
+}
+
+int main(void) {
+  plugin_init_ctx();
+  plugin_register_data_set(&test_ds);
+  plugin_register_write("test", test_write, /* user_data = */ NULL);
+  /* plugin_init_all() only starts the write threads if there are callbacks. */
+  plugin_register_init("test", test_init);
+  if (plugin_init_all() != 0)
+    return 1;
+
+  RUN_TEST(dispatch_lookup);
+  RUN_TEST(replaced_data_set);
+
+  plugin_shutdown_all();
+  END_TEST;
+}
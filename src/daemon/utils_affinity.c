@@ -0,0 +1,126 @@
+/**
+ * collectd - src/daemon/utils_affinity.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+
+/* For cpu_set_t and pthread_setaffinity_np(3). */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils_affinity.h"
+
+#if HAVE_PTHREAD_SETAFFINITY_NP
+#include <sched.h>
+
+static cpu_set_t default_cpus;
+static bool default_cpus_valid;
+
+static int cpu_set_from_group(cpu_set_t *set, /* {{{ */
+                              core_group_t const *cg) {
+  CPU_ZERO(set);
+  for (size_t i = 0; i < cg->num_cores; i++) {
+    if (cg->cores[i] >= CPU_SETSIZE)
+      return EINVAL;
+    CPU_SET(cg->cores[i], set);
+  }
+  return 0;
+} /* }}} int cpu_set_from_group */
+#endif
+
+void thread_cpus_init(void) /* {{{ */
+{
+#if HAVE_PTHREAD_SETAFFINITY_NP
+  default_cpus_valid = (pthread_getaffinity_np(pthread_self(),
+                                               sizeof(default_cpus),
+                                               &default_cpus) == 0);
+#endif
+} /* }}} void thread_cpus_init */
+
+int thread_cpus_parse(char const *option, char const *str, /* {{{ */
+                      core_groups_list_t *cgl) {
+  if ((option == NULL) || (str == NULL) || (cgl == NULL))
+    return EINVAL;
+
+  char *copy = strdup(str);
+  if (copy == NULL)
+    return ENOMEM;
+
+  /* Each group needs at least two characters, e.g. "0 ". */
+  size_t values_max = strlen(copy) / 2 + 1;
+  oconfig_value_t values[values_max];
+  oconfig_item_t ci = {.key = (char *)option, .values = values};
+
+  char *saveptr = NULL;
+  for (char *tok = strtok_r(copy, " \t", &saveptr);
+       (tok != NULL) && ((size_t)ci.values_num < values_max);
+       tok = strtok_r(NULL, " \t", &saveptr)) {
+    values[ci.values_num].type = OCONFIG_TYPE_STRING;
+    values[ci.values_num].value.string = tok;
+    ci.values_num++;
+  }
+
+  int status = 0;
+  if (ci.values_num > 0)
+    status = -config_cores_parse(&ci, cgl);
+
+  sfree(copy);
+  return status;
+} /* }}} int thread_cpus_parse */
+
+int thread_cpus_attr(pthread_attr_t *attr, core_group_t const *cg) /* {{{ */
+{
+#if HAVE_PTHREAD_SETAFFINITY_NP
+  cpu_set_t set;
+  int status = cpu_set_from_group(&set, cg);
+  if (status != 0)
+    return status;
+  return pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+#else
+  return ENOTSUP;
+#endif
+} /* }}} int thread_cpus_attr */
+
+int thread_cpus_set(core_group_t const *cg) /* {{{ */
+{
+#if HAVE_PTHREAD_SETAFFINITY_NP
+  cpu_set_t set;
+  if (cg != NULL) {
+    int status = cpu_set_from_group(&set, cg);
+    if (status != 0)
+      return status;
+  } else if (default_cpus_valid) {
+    set = default_cpus;
+  } else {
+    return EINVAL;
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  return ENOTSUP;
+#endif
+} /* }}} int thread_cpus_set */
@@ -0,0 +1,67 @@
+/**
+ * collectd - src/daemon/utils_affinity.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+
+#ifndef UTILS_AFFINITY_H
+#define UTILS_AFFINITY_H 1
+
+#include "utils/config_cores/config_cores.h"
+
+#include <pthread.h>
+
+/*
+ * Pinning of daemon threads to CPUs. The CPUs are given as core groups, see
+ * config_cores_parse(). Where the platform doesn't support setting a
+ * thread's affinity, the functions return ENOTSUP.
+ */
+
+/*
+ * thread_cpus_init remembers the affinity of the calling thread as the one
+ * thread_cpus_set() restores. Must be called before any thread is pinned.
+ */
+void thread_cpus_init(void);
+
+/*
+ * thread_cpus_parse parses a whitespace separated list of core groups, e.g.
+ * "0-3 8-11" or "[0-7]", as found in the global option "option".
+ */
+int thread_cpus_parse(char const *option, char const *str,
+                      core_groups_list_t *cgl);
+
+/*
+ * thread_cpus_attr sets the affinity of threads created with "attr" to the
+ * cores of "cg".
+ */
+int thread_cpus_attr(pthread_attr_t *attr, core_group_t const *cg);
+
+/*
+ * thread_cpus_set sets the affinity of the calling thread to the cores of
+ * "cg". If "cg" is NULL, the affinity is restored to the one saved by
+ * thread_cpus_init().
+ */
+int thread_cpus_set(core_group_t const *cg);
+
+#endif /* UTILS_AFFINITY_H */
@@ -33,11 +33,59 @@
 #include "utils/common/common.h"
 #include "utils/metadata/meta_data.h"
 #include "utils_cache.h"
+#include "utils_probe.h"
 
 #include <assert.h>
+#include <fnmatch.h>
+
+/* The cache is a hash table that is split into UC_STRIPES independent
+ * stripes, each protected by its own lock. Entries are assigned to a stripe by
+ * the lower bits of the identifier's hash, and to a bucket within the stripe
+ * by the remaining bits. Looking up, updating and inserting an entry only
+ * takes the lock of one stripe. Operations covering the entire cache, such as
+ * the iterator, take the stripe locks one after another, always in ascending
+ * order. */
+#define UC_STRIPES_BITS 6
+#define UC_STRIPES (1 << UC_STRIPES_BITS)
+#define UC_BUCKETS_INITIAL 16
+
+/* Each stripe also keeps its entries in a timer wheel, in the slot of the time
+ * they expire at, i.e. "last_update + interval * timeout_g". uc_check_timeout()
+ * only looks at the slots that became due since its previous run instead of at
+ * all entries. Expiry times further in the future than the wheel covers wrap
+ * around and are skipped until their turn comes. One slot covers 2^30 cdtime_t
+ * units, about one second, so the wheel covers a little over four minutes. */
+#define UC_WHEEL_BITS 8
+#define UC_WHEEL_SIZE (1 << UC_WHEEL_BITS)
+#define UC_WHEEL_TICK_BITS 30
+
+/* Maximum number of expired entries handled at a time by uc_check_timeout().
+ */
+#define UC_EXPIRE_BATCH 256
 
-typedef struct cache_entry_s {
-  char name[6 * DATA_MAX_NAME_LEN];
+/* Number of cache entries of one host or plugin, see uc_set_series_limits().
+ */
+typedef struct {
+  char *name;
+  size_t num;
+  bool over_limit; /* the limit has been reported */
+} series_count_t;
+
+struct cache_entry_s;
+/* Entries are allocated as one block by cache_alloc(): the struct is followed
+ * by "values_raw", "values_gauge" and the null-terminated name, which the
+ * respective pointers point to. Only the history and the meta data, which
+ * most entries never use, are allocated separately and on demand. */
+typedef struct cache_entry_s cache_entry_t;
+struct cache_entry_s {
+  char *name;
+  uint32_t name_len;
+  uint32_t hash;
+  cache_entry_t *next;
+  /* Position in the stripe's timer wheel. */
+  cdtime_t expire;
+  cache_entry_t *expire_next;
+  cache_entry_t **expire_pprev;
   size_t values_num;
   gauge_t *values_gauge;
   value_t *values_raw;
@@ -47,6 +95,9 @@ typedef struct cache_entry_s {
   /* Time according to the local clock
    * (for purging old entries) */
   cdtime_t last_update;
+  /* Time contained in the last package that wasn't suppressed by
+   * uc_update_suppress() */
+  cdtime_t last_written;
   /* Interval in which the data is collected
    * (for purging old entries) */
   cdtime_t interval;
@@ -63,49 +114,338 @@ typedef struct cache_entry_s {
    * +-----------------+-----------------+-----------------+----
    */
   gauge_t *history;
-  size_t history_index; /* points to the next position to write to. */
-  size_t history_length;
+  uint32_t history_index; /* points to the next position to write to. */
+  uint32_t history_length;
 
   meta_data_t *meta;
   unsigned long callbacks_mask;
-} cache_entry_t;
+
+  /* Result of threshold_search() for this entry, which may be NULL, and the
+   * threshold generation it was looked up in. See uc_get_threshold(). */
+  struct threshold_s *threshold;
+  uint64_t threshold_generation;
+
+  /* Value of "cache_epoch" at the last update, see uc_snapshot(). */
+  uint64_t epoch;
+
+  /* Counts this entry belongs to. NULL if the series limits are disabled. */
+  series_count_t *host_count;
+  series_count_t *plugin_count;
+};
+
+typedef struct {
+  pthread_mutex_t lock;
+  cache_entry_t **buckets;
+  size_t buckets_num; /* always a power of two */
+  size_t entries_num;
+
+  cache_entry_t *wheel[UC_WHEEL_SIZE];
+  uint64_t wheel_tick; /* first tick not yet checked completely */
+} cache_stripe_t;
 
 struct uc_iter_s {
-  c_avl_iterator_t *iter;
+  uc_snapshot_t *snapshot;
+  size_t index; /* position of the entry after the current one */
+  uc_snapshot_entry_t const *entry;
+};
 
-  char *name;
-  cache_entry_t *entry;
+struct uc_snapshot_s {
+  uc_snapshot_entry_t *entries;
+  size_t entries_num;
+  uint64_t epoch;
 };
 
-static c_avl_tree_t *cache_tree;
-static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static cache_stripe_t cache_stripes[UC_STRIPES];
+static bool cache_initialized;
+
+/* Incremented by each snapshot. Entries remember its value when they are
+ * updated, so that a snapshot can be limited to the entries updated since an
+ * earlier one. It is read without holding "cache_epoch_lock": the stripe
+ * locks, which both uc_update() and uc_snapshot() hold while reading or
+ * copying an entry, make sure that an update either sees the new epoch or is
+ * included in the snapshot. */
+static uint64_t cache_epoch = 1;
+static pthread_mutex_t cache_epoch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Series limits. The counts are only touched when an entry is created or
+ * removed, so updates of existing entries don't pay for them. "series_lock"
+ * may be taken while holding a stripe lock, but not the other way round. */
+static size_t series_limit_host;
+static size_t series_limit_plugin;
+static c_avl_tree_t *series_hosts;
+static c_avl_tree_t *series_plugins;
+static uint64_t series_created;
+static uint64_t series_rejected;
+static pthread_mutex_t series_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Number of updates rejected because they were not newer than the cached
+ * value, e.g. duplicates sent by redundant senders. Updated atomically. */
+static uint64_t values_too_old;
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+static uint32_t hash_append(uint32_t hash, char const *str) /* {{{ */
+{
+  for (; *str != 0; str++) {
+    hash ^= (uint32_t)(unsigned char)*str;
+    hash *= FNV_PRIME;
+  }
+  return hash;
+} /* }}} uint32_t hash_append */
 
-static int cache_compare(const cache_entry_t *a, const cache_entry_t *b) {
-#if COLLECT_DEBUG
-  assert((a != NULL) && (b != NULL));
-#endif
-  return strcmp(a->name, b->name);
-} /* int cache_compare */
+uint32_t uc_hash_name(char const *name) /* {{{ */
+{
+  return hash_append(FNV_OFFSET, name);
+} /* }}} uint32_t uc_hash_name */
+
+/* Returns the same value as uc_hash_name() does for the name FORMAT_VL()
+ * creates, without formatting the name first. */
+uint32_t uc_hash_identifier(char const *host, char const *plugin, /* {{{ */
+                            char const *plugin_instance, char const *type,
+                            char const *type_instance) {
+  uint32_t hash = hash_append(FNV_OFFSET, host);
+  hash = hash_append(hash, "/");
+  hash = hash_append(hash, plugin);
+  if (plugin_instance[0] != 0) {
+    hash = hash_append(hash, "-");
+    hash = hash_append(hash, plugin_instance);
+  }
+  hash = hash_append(hash, "/");
+  hash = hash_append(hash, type);
+  if (type_instance[0] != 0) {
+    hash = hash_append(hash, "-");
+    hash = hash_append(hash, type_instance);
+  }
+  return hash;
+} /* }}} uint32_t uc_hash_identifier */
 
-static cache_entry_t *cache_alloc(size_t values_num) {
-  cache_entry_t *ce;
+uint32_t uc_hash_vl(value_list_t const *vl) /* {{{ */
+{
+  return uc_hash_identifier(vl->host, vl->plugin, vl->plugin_instance,
+                            vl->type, vl->type_instance);
+} /* }}} uint32_t uc_hash_vl */
+
+/* If "str" is a prefix of "*name", advances "*name" past it and returns true.
+ */
+static bool name_skip(char const **name, char const *str) /* {{{ */
+{
+  size_t len = strlen(str);
+
+  if (strncmp(*name, str, len) != 0)
+    return false;
+
+  *name += len;
+  return true;
+} /* }}} bool name_skip */
+
+/* Checks whether "name" is the name FORMAT_VL() would create for "vl". */
+static bool name_matches_vl(char const *name, value_list_t const *vl) /* {{{ */
+{
+  if (!name_skip(&name, vl->host) || !name_skip(&name, "/") ||
+      !name_skip(&name, vl->plugin))
+    return false;
+  if ((vl->plugin_instance[0] != 0) &&
+      (!name_skip(&name, "-") || !name_skip(&name, vl->plugin_instance)))
+    return false;
+  if (!name_skip(&name, "/") || !name_skip(&name, vl->type))
+    return false;
+  if ((vl->type_instance[0] != 0) &&
+      (!name_skip(&name, "-") || !name_skip(&name, vl->type_instance)))
+    return false;
+
+  return name[0] == 0;
+} /* }}} bool name_matches_vl */
+
+static cache_stripe_t *cache_stripe(uint32_t hash) /* {{{ */
+{
+  return cache_stripes + (hash & (UC_STRIPES - 1));
+} /* }}} cache_stripe_t *cache_stripe */
+
+static cache_entry_t **cache_bucket(cache_stripe_t *cs, /* {{{ */
+                                    uint32_t hash) {
+  return cs->buckets + ((hash >> UC_STRIPES_BITS) & (cs->buckets_num - 1));
+} /* }}} cache_entry_t **cache_bucket */
+
+/* Returns the entry called "name" or NULL. The stripe must be locked. */
+static cache_entry_t *cache_lookup(cache_stripe_t *cs, /* {{{ */
+                                   uint32_t hash, char const *name) {
+  if (cs->buckets == NULL)
+    return NULL;
 
-  ce = calloc(1, sizeof(*ce));
+  for (cache_entry_t *ce = *cache_bucket(cs, hash); ce != NULL; ce = ce->next)
+    if ((ce->hash == hash) && (strcmp(ce->name, name) == 0))
+      return ce;
+
+  return NULL;
+} /* }}} cache_entry_t *cache_lookup */
+
+/* Returns the entry for "vl" or NULL. The stripe must be locked. */
+static cache_entry_t *cache_lookup_vl(cache_stripe_t *cs, /* {{{ */
+                                      uint32_t hash, value_list_t const *vl) {
+  if (cs->buckets == NULL)
+    return NULL;
+
+  for (cache_entry_t *ce = *cache_bucket(cs, hash); ce != NULL; ce = ce->next)
+    if ((ce->hash == hash) && name_matches_vl(ce->name, vl))
+      return ce;
+
+  return NULL;
+} /* }}} cache_entry_t *cache_lookup_vl */
+
+/* Looks up "name" and returns the entry with its stripe locked. If no such
+ * entry exists, NULL is returned and no lock is held. */
+static cache_entry_t *cache_get(char const *name, /* {{{ */
+                                cache_stripe_t **ret_stripe) {
+  uint32_t hash = uc_hash_name(name);
+  cache_stripe_t *cs = cache_stripe(hash);
+
+  pthread_mutex_lock(&cs->lock);
+  cache_entry_t *ce = cache_lookup(cs, hash, name);
   if (ce == NULL) {
-    ERROR("utils_cache: cache_alloc: calloc failed.");
+    pthread_mutex_unlock(&cs->lock);
     return NULL;
   }
-  ce->values_num = values_num;
 
-  ce->values_gauge = calloc(values_num, sizeof(*ce->values_gauge));
-  ce->values_raw = calloc(values_num, sizeof(*ce->values_raw));
-  if ((ce->values_gauge == NULL) || (ce->values_raw == NULL)) {
-    sfree(ce->values_gauge);
-    sfree(ce->values_raw);
-    sfree(ce);
+  *ret_stripe = cs;
+  return ce;
+} /* }}} cache_entry_t *cache_get */
+
+/* Like cache_get(), but looks up the entry using the value list. */
+static cache_entry_t *cache_get_vl(value_list_t const *vl, /* {{{ */
+                                   cache_stripe_t **ret_stripe) {
+  uint32_t hash = uc_hash_vl(vl);
+  cache_stripe_t *cs = cache_stripe(hash);
+
+  pthread_mutex_lock(&cs->lock);
+  cache_entry_t *ce = cache_lookup_vl(cs, hash, vl);
+  if (ce == NULL) {
+    pthread_mutex_unlock(&cs->lock);
+    return NULL;
+  }
+
+  *ret_stripe = cs;
+  return ce;
+} /* }}} cache_entry_t *cache_get_vl */
+
+/* Doubles the number of buckets. The stripe must be locked. */
+static int cache_stripe_grow(cache_stripe_t *cs) /* {{{ */
+{
+  size_t num = (cs->buckets_num == 0) ? UC_BUCKETS_INITIAL
+                                      : 2 * cs->buckets_num;
+
+  cache_entry_t **buckets = calloc(num, sizeof(*buckets));
+  if (buckets == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < cs->buckets_num; i++) {
+    cache_entry_t *ce = cs->buckets[i];
+    while (ce != NULL) {
+      cache_entry_t *next = ce->next;
+      size_t idx = (ce->hash >> UC_STRIPES_BITS) & (num - 1);
+
+      ce->next = buckets[idx];
+      buckets[idx] = ce;
+      ce = next;
+    }
+  }
+
+  sfree(cs->buckets);
+  cs->buckets = buckets;
+  cs->buckets_num = num;
+  return 0;
+} /* }}} int cache_stripe_grow */
+
+/* Removes "ce" from the timer wheel. The stripe must be locked. */
+static void cache_expire_unlink(cache_entry_t *ce) /* {{{ */
+{
+  if (ce->expire_pprev == NULL)
+    return;
+
+  *ce->expire_pprev = ce->expire_next;
+  if (ce->expire_next != NULL)
+    ce->expire_next->expire_pprev = ce->expire_pprev;
+
+  ce->expire_next = NULL;
+  ce->expire_pprev = NULL;
+} /* }}} void cache_expire_unlink */
+
+/* (Re-)Adds "ce" to the timer wheel, based on its last update and interval.
+ * The stripe must be locked. */
+static void cache_expire_link(cache_stripe_t *cs, /* {{{ */
+                              cache_entry_t *ce) {
+  cache_expire_unlink(ce);
+
+  ce->expire = ce->last_update + ce->interval * timeout_g;
+
+  cache_entry_t **slot =
+      cs->wheel + ((ce->expire >> UC_WHEEL_TICK_BITS) & (UC_WHEEL_SIZE - 1));
+  ce->expire_next = *slot;
+  if (*slot != NULL)
+    (*slot)->expire_pprev = &ce->expire_next;
+  ce->expire_pprev = slot;
+  *slot = ce;
+} /* }}} void cache_expire_link */
+
+/* Adds "ce" to the stripe. The stripe must be locked. */
+static int cache_stripe_insert(cache_stripe_t *cs, /* {{{ */
+                               cache_entry_t *ce) {
+  if ((cs->buckets == NULL) || (cs->entries_num >= 2 * cs->buckets_num)) {
+    int status = cache_stripe_grow(cs);
+    /* Keep going with the current table, unless there is none. */
+    if ((status != 0) && (cs->buckets == NULL))
+      return status;
+  }
+
+  cache_entry_t **bucket = cache_bucket(cs, ce->hash);
+  ce->next = *bucket;
+  *bucket = ce;
+  cs->entries_num++;
+  return 0;
+} /* }}} int cache_stripe_insert */
+
+/* Removes and returns the entry called "name". The stripe must be locked. */
+static cache_entry_t *cache_stripe_remove(cache_stripe_t *cs, /* {{{ */
+                                          uint32_t hash, char const *name) {
+  if (cs->buckets == NULL)
+    return NULL;
+
+  for (cache_entry_t **ce = cache_bucket(cs, hash); *ce != NULL;
+       ce = &(*ce)->next) {
+    if (((*ce)->hash != hash) || (strcmp((*ce)->name, name) != 0))
+      continue;
+
+    cache_entry_t *ret = *ce;
+    *ce = ret->next;
+    ret->next = NULL;
+    cs->entries_num--;
+    cache_expire_unlink(ret);
+    return ret;
+  }
+
+  return NULL;
+} /* }}} cache_entry_t *cache_stripe_remove */
+
+static cache_entry_t *cache_alloc(size_t values_num, char const *name,
+                                  size_t name_len) {
+  cache_entry_t *ce;
+
+  /* value_t and gauge_t don't need a stricter alignment than the struct, so
+   * they can directly follow it. */
+  ce = calloc(1, sizeof(*ce) + values_num * sizeof(*ce->values_raw) +
+                     values_num * sizeof(*ce->values_gauge) + name_len + 1);
+  if (ce == NULL) {
     ERROR("utils_cache: cache_alloc: calloc failed.");
     return NULL;
   }
+  ce->values_num = values_num;
+
+  ce->values_raw = (value_t *)(ce + 1);
+  ce->values_gauge = (gauge_t *)(ce->values_raw + values_num);
+  ce->name = (char *)(ce->values_gauge + values_num);
+  memcpy(ce->name, name, name_len);
+  ce->name[name_len] = 0;
+  ce->name_len = (uint32_t)name_len;
 
   ce->history = NULL;
   ce->history_length = 0;
@@ -114,12 +454,115 @@ static cache_entry_t *cache_alloc(size_t values_num) {
   return ce;
 } /* cache_entry_t *cache_alloc */
 
+static series_count_t *series_count_get(c_avl_tree_t *tree, /* {{{ */
+                                         char const *name) {
+  series_count_t *sc = NULL;
+  if (c_avl_get(tree, name, (void *)&sc) == 0)
+    return sc;
+  return NULL;
+} /* }}} series_count_t *series_count_get */
+
+/* Increments the count of "name", creating it if needed. Must be called with
+ * "series_lock" held. */
+static series_count_t *series_count_acquire(c_avl_tree_t *tree, /* {{{ */
+                                            char const *name) {
+  series_count_t *sc = series_count_get(tree, name);
+  if (sc == NULL) {
+    sc = calloc(1, sizeof(*sc));
+    if (sc == NULL)
+      return NULL;
+    sc->name = strdup(name);
+    if ((sc->name == NULL) || (c_avl_insert(tree, sc->name, sc) != 0)) {
+      sfree(sc->name);
+      sfree(sc);
+      return NULL;
+    }
+  }
+
+  sc->num++;
+  return sc;
+} /* }}} series_count_t *series_count_acquire */
+
+/* Must be called with "series_lock" held. */
+static void series_count_release(c_avl_tree_t *tree, /* {{{ */
+                                 series_count_t *sc) {
+  if (sc == NULL)
+    return;
+
+  assert(sc->num > 0);
+  sc->num--;
+  if (sc->num > 0)
+    return;
+
+  c_avl_remove(tree, sc->name, NULL, NULL);
+  sfree(sc->name);
+  sfree(sc);
+} /* }}} void series_count_release */
+
+/* Returns true if "sc" is at "limit", reporting it once. */
+static bool series_over_limit(series_count_t *sc, size_t limit, /* {{{ */
+                              char const *what) {
+  if ((sc == NULL) || (limit == 0))
+    return false;
+
+  if (sc->num < limit) {
+    sc->over_limit = false;
+    return false;
+  }
+
+  if (!sc->over_limit) {
+    WARNING("uc_update: %s \"%s\" has reached the limit of %" PRIsz
+            " series. New series are not added to the cache.",
+            what, sc->name, limit);
+    sc->over_limit = true;
+  }
+  return true;
+} /* }}} bool series_over_limit */
+
+/* Accounts for a new entry of "host" and "plugin". Returns ENOSPC without
+ * accounting for it if a limit has been reached, unless "force" is set. */
+static int series_admit(cache_entry_t *ce, char const *host, /* {{{ */
+                        char const *plugin, bool force) {
+  if ((series_limit_host == 0) && (series_limit_plugin == 0))
+    return 0;
+
+  pthread_mutex_lock(&series_lock);
+  if (!force &&
+      (series_over_limit(series_count_get(series_hosts, host),
+                         series_limit_host, "Host") ||
+       series_over_limit(series_count_get(series_plugins, plugin),
+                         series_limit_plugin, "Plugin"))) {
+    series_rejected++;
+    pthread_mutex_unlock(&series_lock);
+    return ENOSPC;
+  }
+
+  ce->host_count = series_count_acquire(series_hosts, host);
+  ce->plugin_count = series_count_acquire(series_plugins, plugin);
+  pthread_mutex_unlock(&series_lock);
+  return 0;
+} /* }}} int series_admit */
+
+static void series_release(cache_entry_t *ce) /* {{{ */
+{
+  if ((ce->host_count == NULL) && (ce->plugin_count == NULL))
+    return;
+
+  pthread_mutex_lock(&series_lock);
+  series_count_release(series_hosts, ce->host_count);
+  series_count_release(series_plugins, ce->plugin_count);
+  pthread_mutex_unlock(&series_lock);
+
+  ce->host_count = NULL;
+  ce->plugin_count = NULL;
+} /* }}} void series_release */
+
 static void cache_free(cache_entry_t *ce) {
   if (ce == NULL)
     return;
 
-  sfree(ce->values_gauge);
-  sfree(ce->values_raw);
+  series_release(ce);
+
   sfree(ce->history);
   if (ce->meta != NULL) {
     meta_data_destroy(ce->meta);
@@ -139,24 +582,26 @@ static void uc_check_range(const data_set_t *ds, cache_entry_t *ce) {
   }
 } /* void uc_check_range */
 
-static int uc_insert(const data_set_t *ds, const value_list_t *vl,
-                     const char *key) {
-  /* `cache_lock' has been locked by `uc_update' */
-
-  char *key_copy = strdup(key);
-  if (key_copy == NULL) {
-    ERROR("uc_insert: strdup failed.");
-    return -1;
-  }
+static int uc_insert(cache_stripe_t *cs, const data_set_t *ds,
+                     const value_list_t *vl, const char *key, uint32_t hash) {
+  /* The stripe has been locked by `uc_update' */
 
-  cache_entry_t *ce = cache_alloc(ds->ds_num);
+  cache_entry_t *ce = cache_alloc(ds->ds_num, key, strlen(key));
   if (ce == NULL) {
-    sfree(key_copy);
     ERROR("uc_insert: cache_alloc (%" PRIsz ") failed.", ds->ds_num);
     return -1;
   }
 
-  sstrncpy(ce->name, key, sizeof(ce->name));
+  /* The overflow series themselves are always admitted. */
+  bool overflow =
+      (strcmp(vl->plugin_instance, UC_OVERFLOW_INSTANCE) == 0) &&
+      (strcmp(vl->type_instance, UC_OVERFLOW_INSTANCE) == 0);
+  if (series_admit(ce, vl->host, vl->plugin, overflow) != 0) {
+    cache_free(ce);
+    return ENOSPC;
+  }
+
+  ce->hash = hash;
 
   for (size_t i = 0; i < ds->ds_num; i++) {
     switch (ds->ds[i].type) {
@@ -187,7 +632,6 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
       /* This shouldn't happen. */
       ERROR("uc_insert: Don't know how to handle data source type %i.",
             ds->ds[i].type);
-      sfree(key_copy);
       cache_free(ce);
       return -1;
     } /* switch (ds->ds[i].type) */
@@ -197,7 +641,8 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
   uc_check_range(ds, ce);
 
   ce->last_time = vl->time;
-  ce->last_update = cdtime();
+  ce->last_update = cdtime_coarse();
+  ce->last_written = vl->time;
   ce->interval = vl->interval;
   ce->state = STATE_UNKNOWN;
 
@@ -205,78 +650,135 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
     ce->meta = meta_data_clone(vl->meta);
   }
 
-  if (c_avl_insert(cache_tree, key_copy, ce) != 0) {
-    sfree(key_copy);
-    ERROR("uc_insert: c_avl_insert failed.");
+  if (cache_stripe_insert(cs, ce) != 0) {
+    cache_free(ce);
+    ERROR("uc_insert: cache_stripe_insert failed.");
     return -1;
   }
+  cache_expire_link(cs, ce);
+  ce->epoch = cache_epoch;
+
+  pthread_mutex_lock(&series_lock);
+  series_created++;
+  pthread_mutex_unlock(&series_lock);
 
   DEBUG("uc_insert: Added %s to the cache.", key);
   return 0;
 } /* int uc_insert */
 
 int uc_init(void) {
-  if (cache_tree == NULL)
-    cache_tree =
-        c_avl_create((int (*)(const void *, const void *))cache_compare);
+  if (cache_initialized)
+    return 0;
+
+  for (size_t i = 0; i < UC_STRIPES; i++) {
+    pthread_mutex_init(&cache_stripes[i].lock, /* attr = */ NULL);
+    cache_stripes[i].buckets = NULL;
+    cache_stripes[i].buckets_num = 0;
+    cache_stripes[i].entries_num = 0;
+    cache_stripes[i].wheel_tick = cdtime() >> UC_WHEEL_TICK_BITS;
+  }
+  cache_initialized = true;
 
   return 0;
 } /* int uc_init */
 
-int uc_check_timeout(void) {
-  struct {
-    char *key;
-    cdtime_t time;
-    cdtime_t interval;
-    unsigned long callbacks_mask;
-  } *expired = NULL;
-  size_t expired_num = 0;
+int uc_set_series_limits(size_t per_host, size_t per_plugin) /* {{{ */
+{
+  pthread_mutex_lock(&series_lock);
+  if ((per_host != 0) || (per_plugin != 0)) {
+    if (series_hosts == NULL)
+      series_hosts = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (series_plugins == NULL)
+      series_plugins =
+          c_avl_create((int (*)(const void *, const void *))strcmp);
+    if ((series_hosts == NULL) || (series_plugins == NULL)) {
+      pthread_mutex_unlock(&series_lock);
+      ERROR("uc_set_series_limits: c_avl_create failed.");
+      return ENOMEM;
+    }
+  }
 
-  pthread_mutex_lock(&cache_lock);
-  cdtime_t now = cdtime();
+  series_limit_host = per_host;
+  series_limit_plugin = per_plugin;
+  pthread_mutex_unlock(&series_lock);
+  return 0;
+} /* }}} int uc_set_series_limits */
 
-  /* Build a list of entries to be flushed */
-  c_avl_iterator_t *iter = c_avl_get_iterator(cache_tree);
-  char *key = NULL;
-  cache_entry_t *ce = NULL;
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&ce) == 0) {
-    /* If the entry is fresh enough, continue. */
-    if ((now - ce->last_update) < (ce->interval * timeout_g))
-      continue;
+void uc_get_series_stats(uint64_t *ret_created, /* {{{ */
+                         uint64_t *ret_rejected) {
+  pthread_mutex_lock(&series_lock);
+  *ret_created = series_created;
+  *ret_rejected = series_rejected;
+  pthread_mutex_unlock(&series_lock);
+} /* }}} void uc_get_series_stats */
 
-    void *tmp = realloc(expired, (expired_num + 1) * sizeof(*expired));
-    if (tmp == NULL) {
-      ERROR("uc_check_timeout: realloc failed.");
-      continue;
-    }
-    expired = tmp;
+uint64_t uc_get_values_too_old(void) /* {{{ */
+{
+  return __atomic_load_n(&values_too_old, __ATOMIC_RELAXED);
+} /* }}} uint64_t uc_get_values_too_old */
 
-    expired[expired_num].key = strdup(key);
-    expired[expired_num].time = ce->last_time;
-    expired[expired_num].interval = ce->interval;
-    expired[expired_num].callbacks_mask = ce->callbacks_mask;
+typedef struct {
+  char key[6 * DATA_MAX_NAME_LEN];
+  cdtime_t time;
+  cdtime_t interval;
+  unsigned long callbacks_mask;
+} expired_entry_t;
+
+/* Copies up to "expired_size" entries that expired at "now" to "expired",
+ * looking only at the timer wheel slots that became due. Returns true if all
+ * due slots have been checked, false if "expired" filled up first. The stripe
+ * must be locked. */
+static bool cache_stripe_expired(cache_stripe_t *cs, cdtime_t now, /* {{{ */
+                                 expired_entry_t *expired, size_t expired_size,
+                                 size_t *ret_expired_num) {
+  uint64_t now_tick = now >> UC_WHEEL_TICK_BITS;
+  uint64_t tick = cs->wheel_tick;
+  size_t expired_num = 0;
 
-    if (expired[expired_num].key == NULL) {
-      ERROR("uc_check_timeout: strdup failed.");
-      continue;
-    }
+  /* Each slot needs to be checked at most once. */
+  if ((tick > now_tick) || ((now_tick - tick) >= UC_WHEEL_SIZE))
+    tick = now_tick - (UC_WHEEL_SIZE - 1);
 
-    expired_num++;
-  } /* while (c_avl_iterator_next) */
+  for (; tick <= now_tick; tick++) {
+    cache_entry_t *ce = cs->wheel[tick & (UC_WHEEL_SIZE - 1)];
 
-  c_avl_iterator_destroy(iter);
-  pthread_mutex_unlock(&cache_lock);
+    for (; ce != NULL; ce = ce->expire_next) {
+      /* Not yet expired or expiring in a later turn of the wheel. */
+      if (ce->expire > now)
+        continue;
 
-  if (expired_num == 0) {
-    sfree(expired);
-    return 0;
+      if (expired_num >= expired_size) {
+        /* Continue with this slot next time. */
+        cs->wheel_tick = tick;
+        *ret_expired_num = expired_num;
+        return false;
+      }
+
+      sstrncpy(expired[expired_num].key, ce->name,
+               sizeof(expired[expired_num].key));
+      expired[expired_num].time = ce->last_time;
+      expired[expired_num].interval = ce->interval;
+      expired[expired_num].callbacks_mask = ce->callbacks_mask;
+      expired_num++;
+    }
   }
 
+  /* The current slot may get more entries that expire later in this tick. */
+  cs->wheel_tick = now_tick;
+  *ret_expired_num = expired_num;
+  return true;
+} /* }}} bool cache_stripe_expired */
+
+/* Dispatches the "missing" callbacks for "expired" and removes the entries
+ * from the cache. Must be called without holding any stripe lock. */
+static void uc_expire(expired_entry_t *expired, size_t expired_num) /* {{{ */
+{
   /* Call the "missing" callback for each value. Do this before removing the
    * value from the cache, so that callbacks can still access the data stored,
    * including plugin specific meta data, rates, history, …. This must be done
    * without holding the lock, otherwise we will run into a deadlock if a
    * plugin calls the cache interface. */
+  bool expired_events = false;
   for (size_t i = 0; i < expired_num; i++) {
     value_list_t vl = {
         .time = expired[i].time,
@@ -291,52 +793,136 @@ int uc_check_timeout(void) {
 
     plugin_dispatch_missing(&vl);
 
-    if (expired[i].callbacks_mask)
+    if (expired[i].callbacks_mask) {
       plugin_dispatch_cache_event(CE_VALUE_EXPIRED, expired[i].callbacks_mask,
                                   expired[i].key, &vl);
+      expired_events = true;
+    }
   } /* for (i = 0; i < expired_num; i++) */
 
+  /* The callbacks run on the cache event thread and may still look up the
+   * expired values. */
+  if (expired_events)
+    plugin_wait_cache_events();
+
   /* Now actually remove all the values from the cache. We don't re-evaluate
    * the timestamp again, so in theory it is possible we remove a value after
    * it is updated here. */
-  pthread_mutex_lock(&cache_lock);
   for (size_t i = 0; i < expired_num; i++) {
-    char *key = NULL;
-    cache_entry_t *value = NULL;
+    uint32_t hash = uc_hash_name(expired[i].key);
+    cache_stripe_t *cs = cache_stripe(hash);
+
+    pthread_mutex_lock(&cs->lock);
+    cache_entry_t *value = cache_stripe_remove(cs, hash, expired[i].key);
+    pthread_mutex_unlock(&cs->lock);
 
-    if (c_avl_remove(cache_tree, expired[i].key, (void *)&key,
-                     (void *)&value) != 0) {
-      ERROR("uc_check_timeout: c_avl_remove (\"%s\") failed.", expired[i].key);
-      sfree(expired[i].key);
+    if (value == NULL) {
+      ERROR("uc_check_timeout: cache_stripe_remove (\"%s\") failed.",
+            expired[i].key);
       continue;
     }
-    sfree(key);
     cache_free(value);
-
-    sfree(expired[i].key);
   } /* for (i = 0; i < expired_num; i++) */
-  pthread_mutex_unlock(&cache_lock);
+} /* }}} void uc_expire */
+
+int uc_check_timeout(void) {
+  expired_entry_t *expired = NULL;
+  cdtime_t now = cdtime();
+
+  /* Only one stripe is locked at a time, and only while looking for expired
+   * entries, so that updates to the other stripes can continue. */
+  for (size_t s = 0; s < UC_STRIPES; s++) {
+    cache_stripe_t *cs = cache_stripes + s;
+    bool done = false;
+
+    while (!done) {
+      size_t expired_num = 0;
+
+      if (expired == NULL) {
+        expired = calloc(UC_EXPIRE_BATCH, sizeof(*expired));
+        if (expired == NULL) {
+          ERROR("uc_check_timeout: calloc failed.");
+          return ENOMEM;
+        }
+      }
+
+      pthread_mutex_lock(&cs->lock);
+      done = cache_stripe_expired(cs, now, expired, UC_EXPIRE_BATCH,
+                                  &expired_num);
+      pthread_mutex_unlock(&cs->lock);
+
+      uc_expire(expired, expired_num);
+    }
+  } /* for (s) */
 
   sfree(expired);
   return 0;
 } /* int uc_check_timeout */
 
-int uc_update(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+/* Returns true if the raw values of "vl" equal the cached ones. */
+static bool uc_raw_unchanged(const data_set_t *ds, /* {{{ */
+                             const cache_entry_t *ce, const value_list_t *vl) {
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    switch (ds->ds[i].type) {
+    case DS_TYPE_COUNTER:
+      if (ce->values_raw[i].counter != vl->values[i].counter)
+        return false;
+      break;
+    case DS_TYPE_GAUGE:
+      if ((ce->values_raw[i].gauge != vl->values[i].gauge) &&
+          !(isnan(ce->values_raw[i].gauge) && isnan(vl->values[i].gauge)))
+        return false;
+      break;
+    case DS_TYPE_DERIVE:
+      if (ce->values_raw[i].derive != vl->values[i].derive)
+        return false;
+      break;
+    case DS_TYPE_ABSOLUTE:
+      if (ce->values_raw[i].absolute != vl->values[i].absolute)
+        return false;
+      break;
+    default:
+      return false;
+    }
+  }
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_update: FORMAT_VL failed.");
-    return -1;
+  return true;
+} /* }}} bool uc_raw_unchanged */
+
+/* Returns true if the rates in "ce" equal "rates", treating NaNs as equal. */
+static bool uc_rates_unchanged(const cache_entry_t *ce, /* {{{ */
+                               const gauge_t *rates) {
+  for (size_t i = 0; i < ce->values_num; i++) {
+    if ((ce->values_gauge[i] != rates[i]) &&
+        !(isnan(ce->values_gauge[i]) && isnan(rates[i])))
+      return false;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  return true;
+} /* }}} bool uc_rates_unchanged */
+
+/* If "ret_unchanged" is not NULL, it is set to true if neither the raw values
+ * nor the rates changed and the entry was last written less than "heartbeat"
+ * ago. */
+static int uc_update_internal(const data_set_t *ds, const value_list_t *vl,
+                              cdtime_t heartbeat, bool *ret_unchanged) {
+  char name[6 * DATA_MAX_NAME_LEN];
+  uint32_t hash = uc_hash_vl(vl);
+  cache_stripe_t *cs = cache_stripe(hash);
+
+  pthread_mutex_lock(&cs->lock);
 
-  cache_entry_t *ce = NULL;
-  int status = c_avl_get(cache_tree, name, (void *)&ce);
-  if (status != 0) /* entry does not yet exist */
+  cache_entry_t *ce = cache_lookup_vl(cs, hash, vl);
+  if (ce == NULL) /* entry does not yet exist */
   {
-    status = uc_insert(ds, vl, name);
-    pthread_mutex_unlock(&cache_lock);
+    if (FORMAT_VL(name, sizeof(name), vl) != 0) {
+      pthread_mutex_unlock(&cs->lock);
+      ERROR("uc_update: FORMAT_VL failed.");
+      return -1;
+    }
+
+    int status = uc_insert(cs, ds, vl, name, hash);
+    pthread_mutex_unlock(&cs->lock);
 
     if (status == 0)
       plugin_dispatch_cache_event(CE_VALUE_NEW, 0 /* mask */, name, vl);
@@ -344,25 +930,43 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
     return status;
   }
 
-  assert(ce != NULL);
   assert(ce->values_num == ds->ds_num);
 
   if (ce->last_time >= vl->time) {
-    pthread_mutex_unlock(&cache_lock);
-    NOTICE("uc_update: Value too old: name = %s; value time = %.3f; "
-           "last cache update = %.3f;",
-           name, CDTIME_T_TO_DOUBLE(vl->time),
-           CDTIME_T_TO_DOUBLE(ce->last_time));
+#if COLLECT_DEBUG
+    cdtime_t last_time = ce->last_time;
+    sstrncpy(name, ce->name, sizeof(name));
+#endif
+    pthread_mutex_unlock(&cs->lock);
+    /* Counted instead of logged: with redundant senders this happens for
+     * every second copy of a value. */
+    __atomic_fetch_add(&values_too_old, 1, __ATOMIC_RELAXED);
+    DEBUG("uc_update: Value too old: name = %s; value time = %.3f; "
+          "last cache update = %.3f;",
+          name, CDTIME_T_TO_DOUBLE(vl->time), CDTIME_T_TO_DOUBLE(last_time));
     return -1;
   }
 
+  /* Remember the previous rates so that they can be compared after the
+   * update. */
+  bool raw_unchanged = false;
+  gauge_t rates_old[ds->ds_num];
+  if (ret_unchanged != NULL) {
+    raw_unchanged = uc_raw_unchanged(ds, ce, vl);
+    if (raw_unchanged)
+      memcpy(rates_old, ce->values_gauge, sizeof(rates_old));
+  }
+
+  /* The time difference is the same for all data sources, so only compute it
+   * once. */
+  double interval = CDTIME_T_TO_DOUBLE(vl->time - ce->last_time);
+
   for (size_t i = 0; i < ds->ds_num; i++) {
     switch (ds->ds[i].type) {
     case DS_TYPE_COUNTER: {
       counter_t diff =
           counter_diff(ce->values_raw[i].counter, vl->values[i].counter);
-      ce->values_gauge[i] =
-          ((double)diff) / (CDTIME_T_TO_DOUBLE(vl->time - ce->last_time));
+      ce->values_gauge[i] = ((double)diff) / interval;
       ce->values_raw[i].counter = vl->values[i].counter;
     } break;
 
@@ -374,35 +978,33 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
     case DS_TYPE_DERIVE: {
       derive_t diff = vl->values[i].derive - ce->values_raw[i].derive;
 
-      ce->values_gauge[i] =
-          ((double)diff) / (CDTIME_T_TO_DOUBLE(vl->time - ce->last_time));
+      ce->values_gauge[i] = ((double)diff) / interval;
       ce->values_raw[i].derive = vl->values[i].derive;
     } break;
 
     case DS_TYPE_ABSOLUTE:
-      ce->values_gauge[i] = ((double)vl->values[i].absolute) /
-                            (CDTIME_T_TO_DOUBLE(vl->time - ce->last_time));
+      ce->values_gauge[i] = ((double)vl->values[i].absolute) / interval;
       ce->values_raw[i].absolute = vl->values[i].absolute;
       break;
 
     default:
       /* This shouldn't happen. */
-      pthread_mutex_unlock(&cache_lock);
+      pthread_mutex_unlock(&cs->lock);
       ERROR("uc_update: Don't know how to handle data source type %i.",
             ds->ds[i].type);
       return -1;
     } /* switch (ds->ds[i].type) */
 
-    DEBUG("uc_update: %s: ds[%" PRIsz "] = %lf", name, i, ce->values_gauge[i]);
+    DEBUG("uc_update: %s: ds[%" PRIsz "] = %lf", ce->name, i,
+          ce->values_gauge[i]);
   } /* for (i) */
 
   /* Update the history if it exists. */
   if (ce->history != NULL) {
     assert(ce->history_index < ce->history_length);
-    for (size_t i = 0; i < ce->values_num; i++) {
-      size_t hist_idx = (ce->values_num * ce->history_index) + i;
-      ce->history[hist_idx] = ce->values_gauge[i];
-    }
+    /* Each step of the history is one contiguous row of "values_num" rates. */
+    memcpy(ce->history + (ce->values_num * ce->history_index),
+           ce->values_gauge, ce->values_num * sizeof(*ce->history));
 
     assert(ce->history_length > 0);
     ce->history_index = (ce->history_index + 1) % ce->history_length;
@@ -411,33 +1013,63 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
   /* Prune invalid gauge data */
   uc_check_range(ds, ce);
 
+  if (ret_unchanged != NULL) {
+    *ret_unchanged = raw_unchanged && uc_rates_unchanged(ce, rates_old) &&
+                     ((vl->time - ce->last_written) < heartbeat);
+    if (!*ret_unchanged)
+      ce->last_written = vl->time;
+  } else {
+    ce->last_written = vl->time;
+  }
+
   ce->last_time = vl->time;
-  ce->last_update = cdtime();
+  ce->last_update = cdtime_coarse();
   ce->interval = vl->interval;
+  cache_expire_link(cs, ce);
+  ce->epoch = cache_epoch;
 
   /* Check if cache entry has registered callbacks */
   unsigned long callbacks_mask = ce->callbacks_mask;
+  if (callbacks_mask)
+    sstrncpy(name, ce->name, sizeof(name));
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&cs->lock);
 
   if (callbacks_mask)
     plugin_dispatch_cache_event(CE_VALUE_UPDATE, callbacks_mask, name, vl);
 
   return 0;
+} /* int uc_update_internal */
+
+int uc_update(const data_set_t *ds, const value_list_t *vl) {
+  PROBE3(cache__update__start, vl->host, vl->plugin, vl->type);
+  int status = uc_update_internal(ds, vl, 0, NULL);
+  PROBE1(cache__update__done, status);
+
+  return status;
 } /* int uc_update */
 
+int uc_update_suppress(const data_set_t *ds, const value_list_t *vl,
+                       cdtime_t heartbeat, bool *ret_unchanged) {
+  *ret_unchanged = false;
+
+  PROBE3(cache__update__start, vl->host, vl->plugin, vl->type);
+  int status = uc_update_internal(ds, vl, heartbeat, ret_unchanged);
+  PROBE1(cache__update__done, status);
+
+  return status;
+} /* int uc_update_suppress */
+
 int uc_set_callbacks_mask(const char *name, unsigned long mask) {
-  pthread_mutex_lock(&cache_lock);
-  cache_entry_t *ce = NULL;
-  int status = c_avl_get(cache_tree, name, (void *)&ce);
-  if (status != 0) { /* Ouch, just created entry disappeared ?! */
+  cache_stripe_t *cs = NULL;
+  cache_entry_t *ce = cache_get(name, &cs);
+  if (ce == NULL) { /* Ouch, just created entry disappeared ?! */
     ERROR("uc_set_callbacks_mask: Couldn't find %s entry!", name);
-    pthread_mutex_unlock(&cache_lock);
     return -1;
   }
   DEBUG("uc_set_callbacks_mask: set mask for \"%s\" to %lu.", name, mask);
   ce->callbacks_mask = mask;
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&cs->lock);
   return 0;
 }
 
@@ -445,13 +1077,11 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
                         size_t *ret_values_num) {
   gauge_t *ret = NULL;
   size_t ret_num = 0;
-  cache_entry_t *ce = NULL;
+  cache_stripe_t *cs = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  cache_entry_t *ce = cache_get(name, &cs);
+  if (ce != NULL) {
 
     /* remove missing values from getval */
     if (ce->state == STATE_MISSING) {
@@ -469,13 +1099,12 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
         memcpy(ret, ce->values_gauge, ret_num * sizeof(gauge_t));
       }
     }
+    pthread_mutex_unlock(&cs->lock);
   } else {
     DEBUG("utils_cache: uc_get_rate_by_name: No such value: %s", name);
     status = -1;
   }
 
-  pthread_mutex_unlock(&cache_lock);
-
   if (status == 0) {
     *ret_values = ret;
     *ret_values_num = ret_num;
@@ -484,27 +1113,45 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
   return status;
 } /* gauge_t *uc_get_rate_by_name */
 
-gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
-  gauge_t *ret = NULL;
-  size_t ret_num = 0;
-  int status;
+int uc_get_rate_into(const data_set_t *ds, const value_list_t *vl,
+                     gauge_t *ret, size_t ret_num) {
+  if (ret_num < ds->ds_num)
+    return EINVAL;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("utils_cache: uc_get_rate: FORMAT_VL failed.");
-    return NULL;
-  }
+  /* Same as uc_get_rate_by_name(), but avoids formatting the name. */
+  cache_stripe_t *cs = NULL;
+  cache_entry_t *ce = cache_get_vl(vl, &cs);
+  if (ce == NULL)
+    return ENOENT;
 
-  status = uc_get_rate_by_name(name, &ret, &ret_num);
-  if (status != 0)
-    return NULL;
+  if (ce->state == STATE_MISSING) {
+    pthread_mutex_unlock(&cs->lock);
+    return ENOENT;
+  }
 
   /* This is important - the caller has no other way of knowing how many
    * values are returned. */
-  if (ret_num != ds->ds_num) {
+  size_t values_num = ce->values_num;
+  if (values_num != ds->ds_num) {
+    pthread_mutex_unlock(&cs->lock);
     ERROR("utils_cache: uc_get_rate: ds[%s] has %" PRIsz " values, "
-          "but uc_get_rate_by_name returned %" PRIsz ".",
-          ds->type, ds->ds_num, ret_num);
+          "but the cache entry has %" PRIsz ".",
+          ds->type, ds->ds_num, values_num);
+    return EINVAL;
+  }
+
+  memcpy(ret, ce->values_gauge, values_num * sizeof(*ret));
+  pthread_mutex_unlock(&cs->lock);
+
+  return 0;
+} /* int uc_get_rate_into */
+
+gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl) {
+  gauge_t *ret = calloc(ds->ds_num, sizeof(*ret));
+  if (ret == NULL)
+    return NULL;
+
+  if (uc_get_rate_into(ds, vl, ret, ds->ds_num) != 0) {
     sfree(ret);
     return NULL;
   }
@@ -516,13 +1163,11 @@ int uc_get_value_by_name(const char *name, value_t **ret_values,
                          size_t *ret_values_num) {
   value_t *ret = NULL;
   size_t ret_num = 0;
-  cache_entry_t *ce = NULL;
+  cache_stripe_t *cs = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  cache_entry_t *ce = cache_get(name, &cs);
+  if (ce != NULL) {
 
     /* remove missing values from getval */
     if (ce->state == STATE_MISSING) {
@@ -537,13 +1182,12 @@ int uc_get_value_by_name(const char *name, value_t **ret_values,
         memcpy(ret, ce->values_raw, ret_num * sizeof(value_t));
       }
     }
+    pthread_mutex_unlock(&cs->lock);
   } else {
     DEBUG("utils_cache: uc_get_value_by_name: No such value: %s", name);
     status = -1;
   }
 
-  pthread_mutex_unlock(&cache_lock);
-
   if (status == 0) {
     *ret_values = ret;
     *ret_values_num = ret_num;
@@ -583,18 +1227,118 @@ value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl) {
 size_t uc_get_size(void) {
   size_t size_arrays = 0;
 
-  pthread_mutex_lock(&cache_lock);
-  size_arrays = (size_t)c_avl_size(cache_tree);
-  pthread_mutex_unlock(&cache_lock);
+  for (size_t i = 0; i < UC_STRIPES; i++) {
+    pthread_mutex_lock(&cache_stripes[i].lock);
+    size_arrays += cache_stripes[i].entries_num;
+    pthread_mutex_unlock(&cache_stripes[i].lock);
+  }
 
   return size_arrays;
 }
 
-int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
-  c_avl_iterator_t *iter;
-  char *key;
-  cache_entry_t *value;
+static int uc_memory_compare(void const *a, void const *b) /* {{{ */
+{
+  return strcmp(((uc_memory_t const *)a)->plugin,
+                ((uc_memory_t const *)b)->plugin);
+} /* }}} int uc_memory_compare */
+
+/* Returns the entry of "plugin" in "mem", adding it if necessary. The number
+ * of plugins is small, so a linear search is good enough. */
+static uc_memory_t *uc_memory_get(uc_memory_t **mem, size_t *mem_num, /* {{{ */
+                                  char const *plugin, size_t plugin_len) {
+  if (plugin_len >= DATA_MAX_NAME_LEN)
+    plugin_len = DATA_MAX_NAME_LEN - 1;
+
+  for (size_t i = 0; i < *mem_num; i++) {
+    uc_memory_t *m = *mem + i;
+    if ((strncmp(m->plugin, plugin, plugin_len) == 0) &&
+        (m->plugin[plugin_len] == 0))
+      return m;
+  }
+
+  uc_memory_t *tmp = realloc(*mem, (*mem_num + 1) * sizeof(**mem));
+  if (tmp == NULL)
+    return NULL;
+  *mem = tmp;
+
+  uc_memory_t *m = *mem + *mem_num;
+  (*mem_num)++;
+  memset(m, 0, sizeof(*m));
+  memcpy(m->plugin, plugin, plugin_len);
+  return m;
+} /* }}} uc_memory_t *uc_memory_get */
+
+int uc_get_memory(uc_memory_t **ret_plugins, /* {{{ */
+                  size_t *ret_plugins_num, size_t *ret_bytes) {
+  uc_memory_t *mem = NULL;
+  size_t mem_num = 0;
+  size_t bytes = sizeof(cache_stripes);
+  int status = 0;
+
+  if ((ret_plugins == NULL) || (ret_plugins_num == NULL) ||
+      (ret_bytes == NULL))
+    return EINVAL;
+
+  for (size_t i = 0; (i < UC_STRIPES) && (status == 0); i++) {
+    cache_stripe_t *cs = cache_stripes + i;
+
+    pthread_mutex_lock(&cs->lock);
+    bytes += cs->buckets_num * sizeof(*cs->buckets);
+
+    for (size_t j = 0; (j < cs->buckets_num) && (status == 0); j++) {
+      for (cache_entry_t *ce = cs->buckets[j]; ce != NULL; ce = ce->next) {
+        /* The name is "host/plugin[-instance]/type[-instance]". */
+        char const *plugin = strchr(ce->name, '/');
+        plugin = (plugin != NULL) ? plugin + 1 : ce->name;
+        size_t plugin_len = strcspn(plugin, "-/");
+
+        uc_memory_t *m = uc_memory_get(&mem, &mem_num, plugin, plugin_len);
+        if (m == NULL) {
+          status = ENOMEM;
+          break;
+        }
+
+        size_t size = sizeof(*ce) +
+                      ce->values_num * (sizeof(*ce->values_raw) +
+                                        sizeof(*ce->values_gauge)) +
+                      ce->name_len + 1;
+        if (ce->history != NULL)
+          size += ce->history_length * ce->values_num * sizeof(*ce->history);
+
+        m->entries++;
+        m->bytes += size;
+        bytes += size;
+      }
+    }
+    pthread_mutex_unlock(&cs->lock);
+  }
+
+  if (status != 0) {
+    sfree(mem);
+    return status;
+  }
+
+  if (mem_num > 1)
+    qsort(mem, mem_num, sizeof(*mem), uc_memory_compare);
+
+  *ret_plugins = mem;
+  *ret_plugins_num = mem_num;
+  *ret_bytes = bytes;
+  return 0;
+} /* }}} int uc_get_memory */
 
+typedef struct {
+  char *name;
+  cdtime_t time;
+} name_time_t;
+
+static int name_time_compare(const void *a, const void *b) /* {{{ */
+{
+  return strcmp(((const name_time_t *)a)->name, ((const name_time_t *)b)->name);
+} /* }}} int name_time_compare */
+
+int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
+  name_time_t *entries = NULL;
   char **names = NULL;
   cdtime_t *times = NULL;
   size_t number = 0;
@@ -605,60 +1349,85 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
   if ((ret_names == NULL) || (ret_number == NULL))
     return -1;
 
-  pthread_mutex_lock(&cache_lock);
-
-  size_arrays = (size_t)c_avl_size(cache_tree);
-  if (size_arrays < 1) {
-    /* Handle the "no values" case here, to avoid the error message when
-     * calloc() returns NULL. */
-    pthread_mutex_unlock(&cache_lock);
-    return 0;
-  }
-
-  names = calloc(size_arrays, sizeof(*names));
-  times = calloc(size_arrays, sizeof(*times));
-  if ((names == NULL) || (times == NULL)) {
-    ERROR("uc_get_names: calloc failed.");
-    sfree(names);
-    sfree(times);
-    pthread_mutex_unlock(&cache_lock);
-    return ENOMEM;
-  }
+  /* Only one stripe is locked at a time, so that updates to the other
+   * stripes can continue. */
+  for (size_t s = 0; (s < UC_STRIPES) && (status == 0); s++) {
+    cache_stripe_t *cs = cache_stripes + s;
+
+    pthread_mutex_lock(&cs->lock);
+
+    if ((number + cs->entries_num) > size_arrays) {
+      size_t new_size = number + cs->entries_num;
+      name_time_t *tmp = realloc(entries, new_size * sizeof(*entries));
+      if (tmp == NULL) {
+        pthread_mutex_unlock(&cs->lock);
+        ERROR("uc_get_names: realloc failed.");
+        status = ENOMEM;
+        break;
+      }
+      entries = tmp;
+      size_arrays = new_size;
+    }
 
-  iter = c_avl_get_iterator(cache_tree);
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&value) == 0) {
-    /* remove missing values when list values */
-    if (value->state == STATE_MISSING)
-      continue;
+    for (size_t b = 0; (b < cs->buckets_num) && (status == 0); b++) {
+      for (cache_entry_t *ce = cs->buckets[b]; ce != NULL; ce = ce->next) {
+        /* remove missing values when list values */
+        if (ce->state == STATE_MISSING)
+          continue;
 
-    /* c_avl_size does not return a number smaller than the number of elements
-     * returned by c_avl_iterator_next. */
-    assert(number < size_arrays);
+        /* The stripe's entries_num adds up to the number of entries in its
+         * buckets. */
+        assert(number < size_arrays);
 
-    if (ret_times != NULL)
-      times[number] = value->last_time;
+        entries[number].time = ce->last_time;
+        entries[number].name = strdup(ce->name);
+        if (entries[number].name == NULL) {
+          status = -1;
+          break;
+        }
 
-    names[number] = strdup(key);
-    if (names[number] == NULL) {
-      status = -1;
-      break;
+        number++;
+      }
     }
 
-    number++;
-  } /* while (c_avl_iterator_next) */
+    pthread_mutex_unlock(&cs->lock);
+  }
+
+  if ((status == 0) && (number == 0)) {
+    /* Handle the "no values" case here, to avoid the error message when
+     * calloc() returns NULL. */
+    sfree(entries);
+    return 0;
+  }
 
-  c_avl_iterator_destroy(iter);
-  pthread_mutex_unlock(&cache_lock);
+  if (status == 0) {
+    names = calloc(size_arrays, sizeof(*names));
+    times = calloc(size_arrays, sizeof(*times));
+    if ((names == NULL) || (times == NULL)) {
+      ERROR("uc_get_names: calloc failed.");
+      status = ENOMEM;
+    }
+  }
 
   if (status != 0) {
     for (size_t i = 0; i < number; i++) {
-      sfree(names[i]);
+      sfree(entries[i].name);
     }
+    sfree(entries);
     sfree(names);
     sfree(times);
 
-    return -1;
+    return status;
+  }
+
+  /* The hash table is unordered; callers, e.g. LISTVAL, expect the names in
+   * lexicographic order. */
+  qsort(entries, number, sizeof(*entries), name_time_compare);
+  for (size_t i = 0; i < number; i++) {
+    names[i] = entries[i].name;
+    times[i] = entries[i].time;
   }
+  sfree(entries);
 
   *ret_names = names;
   if (ret_times != NULL)
@@ -670,66 +1439,143 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
   return 0;
 } /* int uc_get_names */
 
-int uc_get_state(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
-  cache_entry_t *ce = NULL;
-  int ret = STATE_ERROR;
+int uc_get_last_time(const value_list_t *vl, cdtime_t *ret_time) /* {{{ */
+{
+  cache_stripe_t *cs = NULL;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_get_state: FORMAT_VL failed.");
-    return STATE_ERROR;
-  }
+  cache_entry_t *ce = cache_get_vl(vl, &cs);
+  if (ce == NULL)
+    return ENOENT;
 
-  pthread_mutex_lock(&cache_lock);
+  *ret_time = ce->last_time;
+  pthread_mutex_unlock(&cs->lock);
+
+  return 0;
+} /* }}} int uc_get_last_time */
+
+int uc_get_state(const data_set_t *ds, const value_list_t *vl) {
+  cache_stripe_t *cs = NULL;
+  int ret = STATE_ERROR;
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  cache_entry_t *ce = cache_get_vl(vl, &cs);
+  if (ce != NULL) {
     ret = ce->state;
+    pthread_mutex_unlock(&cs->lock);
   }
 
-  pthread_mutex_unlock(&cache_lock);
-
   return ret;
 } /* int uc_get_state */
 
 int uc_set_state(const data_set_t *ds, const value_list_t *vl, int state) {
-  char name[6 * DATA_MAX_NAME_LEN];
-  cache_entry_t *ce = NULL;
+  cache_stripe_t *cs = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_set_state: FORMAT_VL failed.");
-    return STATE_ERROR;
-  }
-
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  cache_entry_t *ce = cache_get_vl(vl, &cs);
+  if (ce != NULL) {
     ret = ce->state;
     ce->state = state;
+    pthread_mutex_unlock(&cs->lock);
   }
 
-  pthread_mutex_unlock(&cache_lock);
-
   return ret;
 } /* int uc_set_state */
 
+int uc_get_threshold(const value_list_t *vl, uint64_t generation,
+                     struct threshold_s **ret_threshold) {
+  cache_stripe_t *cs = NULL;
+  int status = ENOENT;
+
+  cache_entry_t *ce = cache_get_vl(vl, &cs);
+  if (ce == NULL)
+    return ENOENT;
+
+  if (ce->threshold_generation == generation) {
+    *ret_threshold = ce->threshold;
+    status = 0;
+  }
+  pthread_mutex_unlock(&cs->lock);
+
+  return status;
+} /* int uc_get_threshold */
+
+int uc_set_threshold(const value_list_t *vl, uint64_t generation,
+                     struct threshold_s *threshold) {
+  cache_stripe_t *cs = NULL;
+
+  cache_entry_t *ce = cache_get_vl(vl, &cs);
+  if (ce == NULL)
+    return ENOENT;
+
+  ce->threshold = threshold;
+  ce->threshold_generation = generation;
+  pthread_mutex_unlock(&cs->lock);
+
+  return 0;
+} /* int uc_set_threshold */
+
+int uc_set_threshold_states(uc_threshold_state_t const *states, /* {{{ */
+                            size_t states_num) {
+  if (states_num == 0)
+    return 0;
+  if (states == NULL)
+    return EINVAL;
+
+  /* Sort the states by stripe, so that each stripe is locked once. */
+  uint32_t *hashes = malloc(states_num * sizeof(*hashes));
+  size_t *order = malloc(states_num * sizeof(*order));
+  if ((hashes == NULL) || (order == NULL)) {
+    sfree(hashes);
+    sfree(order);
+    return ENOMEM;
+  }
+
+  size_t offsets[UC_STRIPES + 1] = {0};
+  for (size_t i = 0; i < states_num; i++) {
+    hashes[i] = uc_hash_name(states[i].name);
+    offsets[(cache_stripe(hashes[i]) - cache_stripes) + 1]++;
+  }
+  for (size_t i = 0; i < UC_STRIPES; i++)
+    offsets[i + 1] += offsets[i];
+  for (size_t i = 0; i < states_num; i++)
+    order[offsets[cache_stripe(hashes[i]) - cache_stripes]++] = i;
+
+  size_t next = 0;
+  for (size_t s = 0; s < UC_STRIPES; s++) {
+    /* "offsets[s]" is now the end of the states of stripe "s". */
+    if (next == offsets[s])
+      continue;
+
+    cache_stripe_t *cs = cache_stripes + s;
+    pthread_mutex_lock(&cs->lock);
+    for (; next < offsets[s]; next++) {
+      uc_threshold_state_t const *st = states + order[next];
+      cache_entry_t *ce = cache_lookup(cs, hashes[order[next]], st->name);
+      if ((ce == NULL) || (ce->state == STATE_MISSING))
+        continue;
+
+      ce->state = st->state;
+      ce->hits = st->hits;
+      ce->threshold = st->threshold;
+      ce->threshold_generation = st->threshold_generation;
+    }
+    pthread_mutex_unlock(&cs->lock);
+  }
+
+  sfree(hashes);
+  sfree(order);
+  return 0;
+} /* }}} int uc_set_threshold_states */
+
 int uc_get_history_by_name(const char *name, gauge_t *ret_history,
                            size_t num_steps, size_t num_ds) {
-  cache_entry_t *ce = NULL;
-  int status = 0;
+  cache_stripe_t *cs = NULL;
 
-  pthread_mutex_lock(&cache_lock);
-
-  status = c_avl_get(cache_tree, name, (void *)&ce);
-  if (status != 0) {
-    pthread_mutex_unlock(&cache_lock);
+  cache_entry_t *ce = cache_get(name, &cs);
+  if (ce == NULL)
     return -ENOENT;
-  }
 
-  if (((size_t)ce->values_num) != num_ds) {
-    pthread_mutex_unlock(&cache_lock);
+  if ((((size_t)ce->values_num) != num_ds) || (num_steps > UINT32_MAX)) {
+    pthread_mutex_unlock(&cs->lock);
     return -EINVAL;
   }
 
@@ -741,7 +1587,7 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
     tmp =
         realloc(ce->history, sizeof(*ce->history) * num_steps * ce->values_num);
     if (tmp == NULL) {
-      pthread_mutex_unlock(&cache_lock);
+      pthread_mutex_unlock(&cs->lock);
       return -ENOMEM;
     }
 
@@ -750,7 +1596,7 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
       tmp[i] = NAN;
 
     ce->history = tmp;
-    ce->history_length = num_steps;
+    ce->history_length = (uint32_t)num_steps;
   } /* if (ce->history_length < num_steps) */
 
   /* Copy the values to the output buffer. */
@@ -770,7 +1616,7 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
            sizeof(*ret_history) * num_ds);
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&cs->lock);
 
   return 0;
 } /* int uc_get_history_by_name */
@@ -788,73 +1634,565 @@ int uc_get_history(const data_set_t *ds, const value_list_t *vl,
 } /* int uc_get_history */
 
 int uc_get_hits(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
-  cache_entry_t *ce = NULL;
+  cache_stripe_t *cs = NULL;
   int ret = STATE_ERROR;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_get_hits: FORMAT_VL failed.");
-    return STATE_ERROR;
-  }
-
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  cache_entry_t *ce = cache_get_vl(vl, &cs);
+  if (ce != NULL) {
     ret = ce->hits;
+    pthread_mutex_unlock(&cs->lock);
   }
 
-  pthread_mutex_unlock(&cache_lock);
-
   return ret;
 } /* int uc_get_hits */
 
 int uc_set_hits(const data_set_t *ds, const value_list_t *vl, int hits) {
-  char name[6 * DATA_MAX_NAME_LEN];
-  cache_entry_t *ce = NULL;
+  cache_stripe_t *cs = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_set_hits: FORMAT_VL failed.");
-    return STATE_ERROR;
-  }
-
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  cache_entry_t *ce = cache_get_vl(vl, &cs);
+  if (ce != NULL) {
     ret = ce->hits;
     ce->hits = hits;
+    pthread_mutex_unlock(&cs->lock);
   }
 
-  pthread_mutex_unlock(&cache_lock);
-
   return ret;
 } /* int uc_set_hits */
 
 int uc_inc_hits(const data_set_t *ds, const value_list_t *vl, int step) {
-  char name[6 * DATA_MAX_NAME_LEN];
-  cache_entry_t *ce = NULL;
+  cache_stripe_t *cs = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_inc_hits: FORMAT_VL failed.");
-    return STATE_ERROR;
-  }
-
-  pthread_mutex_lock(&cache_lock);
-
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
-    assert(ce != NULL);
+  cache_entry_t *ce = cache_get_vl(vl, &cs);
+  if (ce != NULL) {
     ret = ce->hits;
     ce->hits = ret + step;
+    pthread_mutex_unlock(&cs->lock);
   }
 
-  pthread_mutex_unlock(&cache_lock);
-
   return ret;
 } /* int uc_inc_hits */
 
+/*
+ * Checkpoint file
+ *
+ * The file starts with a header of UC_FILE_MAGIC, the format version and the
+ * number of entries, followed by the entries. Each entry consists of the
+ * uc_file_entry_t, the name (without terminating null byte), the raw values,
+ * the gauge values and the history. All numbers are in host byte order, so the
+ * file can only be read on the machine that wrote it.
+ */
+#define UC_FILE_MAGIC 0x43445543 /* "CDUC" */
+#define UC_FILE_VERSION 1
+#define UC_FILE_VALUES_MAX 1024
+#define UC_FILE_HISTORY_MAX 65536
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t entries_num;
+} uc_file_header_t;
+
+typedef struct {
+  uint32_t name_len;
+  uint32_t values_num;
+  uint32_t history_length;
+  uint32_t history_index;
+  uint64_t last_time;
+  uint64_t interval;
+  int32_t state;
+  int32_t hits;
+} uc_file_entry_t;
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t len;
+} uc_buffer_t;
+
+static int uc_buffer_append(uc_buffer_t *buf, void const *data, /* {{{ */
+                            size_t len) {
+  if (len == 0)
+    return 0;
+
+  if (buf->len + len > buf->size) {
+    size_t size = (buf->size == 0) ? 65536 : buf->size;
+    while (buf->len + len > size)
+      size *= 2;
+
+    char *tmp = realloc(buf->data, size);
+    if (tmp == NULL)
+      return ENOMEM;
+    buf->data = tmp;
+    buf->size = size;
+  }
+
+  memcpy(buf->data + buf->len, data, len);
+  buf->len += len;
+  return 0;
+} /* }}} int uc_buffer_append */
+
+/* Serializes all entries of the stripe. The stripe must be locked. */
+static int uc_save_stripe(cache_stripe_t *cs, uc_buffer_t *buf) /* {{{ */
+{
+  for (size_t i = 0; i < cs->buckets_num; i++) {
+    for (cache_entry_t *ce = cs->buckets[i]; ce != NULL; ce = ce->next) {
+      uc_file_entry_t fe = {
+          .name_len = ce->name_len,
+          .values_num = (uint32_t)ce->values_num,
+          .history_length = (uint32_t)ce->history_length,
+          .history_index = (uint32_t)ce->history_index,
+          .last_time = (uint64_t)ce->last_time,
+          .interval = (uint64_t)ce->interval,
+          .state = (int32_t)ce->state,
+          .hits = (int32_t)ce->hits,
+      };
+      size_t history_num = ce->history_length * ce->values_num;
+
+      if ((uc_buffer_append(buf, &fe, sizeof(fe)) != 0) ||
+          (uc_buffer_append(buf, ce->name, fe.name_len) != 0) ||
+          (uc_buffer_append(buf, ce->values_raw,
+                            ce->values_num * sizeof(*ce->values_raw)) != 0) ||
+          (uc_buffer_append(buf, ce->values_gauge,
+                            ce->values_num * sizeof(*ce->values_gauge)) !=
+           0) ||
+          (uc_buffer_append(buf, ce->history,
+                            history_num * sizeof(*ce->history)) != 0))
+        return ENOMEM;
+    }
+  }
+
+  return 0;
+} /* }}} int uc_save_stripe */
+
+int uc_save(char const *file) /* {{{ */
+{
+  char tmp_file[PATH_MAX];
+  uc_buffer_t buf = {0};
+  uc_file_header_t header = {
+      .magic = UC_FILE_MAGIC,
+      .version = UC_FILE_VERSION,
+  };
+
+  if ((file == NULL) || !cache_initialized)
+    return EINVAL;
+
+  ssnprintf(tmp_file, sizeof(tmp_file), "%s.tmp", file);
+
+  FILE *fh = fopen(tmp_file, "w");
+  if (fh == NULL) {
+    ERROR("uc_save: Opening \"%s\" failed: %s", tmp_file, STRERRNO);
+    return -1;
+  }
+
+  int status = 0;
+  if (fwrite(&header, sizeof(header), 1, fh) != 1)
+    status = EIO;
+
+  /* Copy each stripe into memory first, so that updates are not blocked
+   * while writing to the file. */
+  for (size_t i = 0; (i < UC_STRIPES) && (status == 0); i++) {
+    cache_stripe_t *cs = cache_stripes + i;
+
+    buf.len = 0;
+    pthread_mutex_lock(&cs->lock);
+    status = uc_save_stripe(cs, &buf);
+    header.entries_num += cs->entries_num;
+    pthread_mutex_unlock(&cs->lock);
+
+    if ((status == 0) && (buf.len > 0) &&
+        (fwrite(buf.data, buf.len, 1, fh) != 1))
+      status = EIO;
+  }
+  sfree(buf.data);
+
+  /* Now that the number of entries is known, update the header. */
+  if ((status == 0) && ((fseek(fh, 0, SEEK_SET) != 0) ||
+                        (fwrite(&header, sizeof(header), 1, fh) != 1)))
+    status = EIO;
+
+  if (fclose(fh) != 0)
+    status = EIO;
+
+  if (status == 0 && rename(tmp_file, file) != 0)
+    status = errno;
+
+  if (status != 0) {
+    ERROR("uc_save: Writing \"%s\" failed: %s", file, STRERROR(status));
+    unlink(tmp_file);
+    return status;
+  }
+
+  DEBUG("uc_save: Wrote %" PRIu64 " entries to \"%s\".", header.entries_num,
+        file);
+  return 0;
+} /* }}} int uc_save */
+
+/* Reads one entry from "fh". Returns NULL on error. */
+static cache_entry_t *uc_load_entry(FILE *fh) /* {{{ */
+{
+  uc_file_entry_t fe;
+
+  if (fread(&fe, sizeof(fe), 1, fh) != 1)
+    return NULL;
+
+  if ((fe.name_len == 0) || (fe.name_len >= 6 * DATA_MAX_NAME_LEN) ||
+      (fe.values_num == 0) || (fe.values_num > UC_FILE_VALUES_MAX) ||
+      (fe.history_length > UC_FILE_HISTORY_MAX) ||
+      ((fe.history_length > 0) && (fe.history_index >= fe.history_length)))
+    return NULL;
+
+  char name[6 * DATA_MAX_NAME_LEN];
+  if (fread(name, fe.name_len, 1, fh) != 1)
+    return NULL;
+
+  cache_entry_t *ce = cache_alloc(fe.values_num, name, fe.name_len);
+  if (ce == NULL)
+    return NULL;
+
+  size_t history_num = (size_t)fe.history_length * fe.values_num;
+  if (history_num > 0) {
+    ce->history = calloc(history_num, sizeof(*ce->history));
+    if (ce->history == NULL) {
+      cache_free(ce);
+      return NULL;
+    }
+  }
+
+  if ((fread(ce->values_raw, sizeof(*ce->values_raw), fe.values_num, fh) !=
+       fe.values_num) ||
+      (fread(ce->values_gauge, sizeof(*ce->values_gauge), fe.values_num, fh) !=
+       fe.values_num) ||
+      (fread(ce->history, sizeof(*ce->history), history_num, fh) !=
+       history_num)) {
+    cache_free(ce);
+    return NULL;
+  }
+
+  ce->hash = uc_hash_name(ce->name);
+  ce->history_length = fe.history_length;
+  ce->history_index = fe.history_index;
+  ce->last_time = (cdtime_t)fe.last_time;
+  ce->interval = (cdtime_t)fe.interval;
+  ce->state = (int)fe.state;
+  ce->hits = (int)fe.hits;
+  return ce;
+} /* }}} cache_entry_t *uc_load_entry */
+
+int uc_load(char const *file) /* {{{ */
+{
+  uc_file_header_t header;
+
+  if ((file == NULL) || !cache_initialized)
+    return EINVAL;
+
+  FILE *fh = fopen(file, "r");
+  if (fh == NULL) {
+    int status = errno;
+    if (status == ENOENT)
+      INFO("uc_load: \"%s\" does not exist, starting with an empty cache.",
+           file);
+    else
+      ERROR("uc_load: Opening \"%s\" failed: %s", file, STRERROR(status));
+    return status;
+  }
+
+  if ((fread(&header, sizeof(header), 1, fh) != 1) ||
+      (header.magic != UC_FILE_MAGIC) || (header.version != UC_FILE_VERSION)) {
+    ERROR("uc_load: \"%s\" is not a cache file of this version.", file);
+    fclose(fh);
+    return EINVAL;
+  }
+
+  /* Size the hash tables for the final number of entries up front, instead of
+   * growing them repeatedly while inserting. */
+  for (size_t i = 0; i < UC_STRIPES; i++) {
+    cache_stripe_t *cs = cache_stripes + i;
+    size_t expected = (size_t)(header.entries_num / UC_STRIPES);
+
+    pthread_mutex_lock(&cs->lock);
+    while ((cs->buckets == NULL) || (2 * cs->buckets_num < expected))
+      if (cache_stripe_grow(cs) != 0)
+        break;
+    pthread_mutex_unlock(&cs->lock);
+  }
+
+  /* Entries have not been updated while the daemon was down, so they
+   * start the timeout from now. */
+  cdtime_t now = cdtime();
+  uint64_t loaded = 0;
+  int status = 0;
+  for (uint64_t i = 0; i < header.entries_num; i++) {
+    cache_entry_t *ce = uc_load_entry(fh);
+    if (ce == NULL) {
+      ERROR("uc_load: \"%s\" is truncated or corrupt after %" PRIu64
+            " entries.",
+            file, i);
+      status = EINVAL;
+      break;
+    }
+    ce->last_update = now;
+
+    /* Restored entries count towards the series limits, but are never
+     * rejected. */
+    value_list_t vl = VALUE_LIST_INIT;
+    if (parse_identifier_vl(ce->name, &vl) == 0)
+      series_admit(ce, vl.host, vl.plugin, /* force = */ true);
+
+    cache_stripe_t *cs = cache_stripe(ce->hash);
+    pthread_mutex_lock(&cs->lock);
+    if ((cache_lookup(cs, ce->hash, ce->name) != NULL) ||
+        (cache_stripe_insert(cs, ce) != 0)) {
+      pthread_mutex_unlock(&cs->lock);
+      cache_free(ce);
+      continue;
+    }
+    cache_expire_link(cs, ce);
+    ce->epoch = cache_epoch;
+    pthread_mutex_unlock(&cs->lock);
+    loaded++;
+  }
+
+  fclose(fh);
+
+  INFO("uc_load: Restored %" PRIu64 " entries from \"%s\".", loaded, file);
+  return status;
+} /* }}} int uc_load */
+
+static int snapshot_entry_compare(const void *a, const void *b) /* {{{ */
+{
+  uc_snapshot_entry_t const *e0 = a;
+  uc_snapshot_entry_t const *e1 = b;
+
+  return strcmp(e0->name, e1->name);
+} /* }}} int snapshot_entry_compare */
+
+static void snapshot_entry_free(uc_snapshot_entry_t *e) /* {{{ */
+{
+  sfree(e->name);
+  /* "rates" points into the same allocation. */
+  sfree(e->values);
+  e->rates = NULL;
+  meta_data_destroy(e->meta);
+  e->meta = NULL;
+} /* }}} void snapshot_entry_free */
+
+/* Copies "ce" to "e". The stripe of "ce" must be locked. */
+static int snapshot_entry_copy(uc_snapshot_entry_t *e, /* {{{ */
+                               cache_entry_t const *ce) {
+  memset(e, 0, sizeof(*e));
+
+  e->name = strdup(ce->name);
+  e->values = malloc(ce->values_num * (sizeof(*e->values) + sizeof(*e->rates)));
+  if ((e->name == NULL) || (e->values == NULL)) {
+    snapshot_entry_free(e);
+    return ENOMEM;
+  }
+  e->rates = (gauge_t *)(e->values + ce->values_num);
+
+  memcpy(e->values, ce->values_raw, ce->values_num * sizeof(*e->values));
+  memcpy(e->rates, ce->values_gauge, ce->values_num * sizeof(*e->rates));
+  e->values_num = ce->values_num;
+  e->time = ce->last_time;
+  e->interval = ce->interval;
+  e->epoch = ce->epoch;
+  e->state = ce->state;
+  e->hits = ce->hits;
+  e->threshold = ce->threshold;
+  e->threshold_generation = ce->threshold_generation;
+
+  /* Cheap: clones share the meta data until one of them is modified. */
+  e->meta = meta_data_clone(ce->meta);
+
+  return 0;
+} /* }}} int snapshot_entry_copy */
+
+/* Returns true if the name of "ce" is one of "patterns", or matches one of
+ * them as a shell wildcard pattern. A NULL "patterns" matches all entries. */
+static bool snapshot_entry_match(cache_entry_t const *ce, /* {{{ */
+                                 char const *const *patterns,
+                                 size_t patterns_num) {
+  if (patterns == NULL)
+    return true;
+
+  for (size_t i = 0; i < patterns_num; i++)
+    if ((strcmp(patterns[i], ce->name) == 0) ||
+        (fnmatch(patterns[i], ce->name, /* flags = */ 0) == 0))
+      return true;
+  return false;
+} /* }}} bool snapshot_entry_match */
+
+/* Copies the entries matching "patterns" from all stripes to "snap". */
+static int snapshot_copy_stripes(uc_snapshot_t *snap, /* {{{ */
+                                 uint64_t since_epoch,
+                                 char const *const *patterns,
+                                 size_t patterns_num) {
+  size_t entries_size = 0;
+  int status = 0;
+
+  /* Only one stripe is locked at a time, so that updates to the other
+   * stripes can continue. */
+  for (size_t s = 0; (s < UC_STRIPES) && (status == 0); s++) {
+    cache_stripe_t *cs = cache_stripes + s;
+
+    pthread_mutex_lock(&cs->lock);
+
+    if ((snap->entries_num + cs->entries_num) > entries_size) {
+      size_t new_size = snap->entries_num + cs->entries_num;
+      uc_snapshot_entry_t *tmp =
+          realloc(snap->entries, new_size * sizeof(*snap->entries));
+      if (tmp == NULL) {
+        pthread_mutex_unlock(&cs->lock);
+        status = ENOMEM;
+        break;
+      }
+      snap->entries = tmp;
+      entries_size = new_size;
+    }
+
+    for (size_t b = 0; (b < cs->buckets_num) && (status == 0); b++) {
+      for (cache_entry_t *ce = cs->buckets[b]; ce != NULL; ce = ce->next) {
+        if ((ce->state == STATE_MISSING) || (ce->epoch < since_epoch) ||
+            !snapshot_entry_match(ce, patterns, patterns_num))
+          continue;
+
+        status = snapshot_entry_copy(snap->entries + snap->entries_num, ce);
+        if (status != 0)
+          break;
+        snap->entries_num++;
+      }
+    }
+
+    pthread_mutex_unlock(&cs->lock);
+  }
+
+  return status;
+} /* }}} int snapshot_copy_stripes */
+
+uc_snapshot_t *uc_snapshot(uint64_t since_epoch) /* {{{ */
+{
+  uc_snapshot_t *snap = calloc(1, sizeof(*snap));
+  if (snap == NULL) {
+    ERROR("uc_snapshot: calloc failed.");
+    return NULL;
+  }
+
+  /* Entries updated from now on will have an epoch of at least
+   * "snap->epoch". */
+  pthread_mutex_lock(&cache_epoch_lock);
+  cache_epoch++;
+  snap->epoch = cache_epoch;
+  pthread_mutex_unlock(&cache_epoch_lock);
+
+  int status = snapshot_copy_stripes(snap, since_epoch, /* patterns = */ NULL,
+                                     /* patterns_num = */ 0);
+  if (status != 0) {
+    ERROR("uc_snapshot: Copying the cache failed: %s", STRERROR(status));
+    uc_snapshot_destroy(snap);
+    return NULL;
+  }
+
+  qsort(snap->entries, snap->entries_num, sizeof(*snap->entries),
+        snapshot_entry_compare);
+
+  return snap;
+} /* }}} uc_snapshot_t *uc_snapshot */
+
+uc_snapshot_t *uc_snapshot_match(char const *const *patterns, /* {{{ */
+                                 size_t patterns_num) {
+  uc_snapshot_t *snap = calloc(1, sizeof(*snap));
+  if (snap == NULL) {
+    ERROR("uc_snapshot_match: calloc failed.");
+    return NULL;
+  }
+
+  bool wildcards = false;
+  for (size_t i = 0; i < patterns_num; i++)
+    if (strpbrk(patterns[i], "*?[") != NULL)
+      wildcards = true;
+
+  int status = 0;
+  if (wildcards) {
+    /* One pass over the cache, whatever the number of patterns. */
+    status = snapshot_copy_stripes(snap, /* since_epoch = */ 0, patterns,
+                                   patterns_num);
+  } else if (patterns_num > 0) {
+    /* Plain names are looked up, so that the rest of the cache isn't
+     * touched. */
+    snap->entries = calloc(patterns_num, sizeof(*snap->entries));
+    if (snap->entries == NULL)
+      status = ENOMEM;
+
+    for (size_t i = 0; (i < patterns_num) && (status == 0); i++) {
+      cache_stripe_t *cs = NULL;
+      cache_entry_t *ce = cache_get(patterns[i], &cs);
+      if (ce == NULL)
+        continue;
+
+      if (ce->state != STATE_MISSING) {
+        status = snapshot_entry_copy(snap->entries + snap->entries_num, ce);
+        if (status == 0)
+          snap->entries_num++;
+      }
+      pthread_mutex_unlock(&cs->lock);
+    }
+  }
+
+  if (status != 0) {
+    ERROR("uc_snapshot_match: Copying the cache failed: %s", STRERROR(status));
+    uc_snapshot_destroy(snap);
+    return NULL;
+  }
+
+  qsort(snap->entries, snap->entries_num, sizeof(*snap->entries),
+        snapshot_entry_compare);
+
+  /* A name given more than once is only returned once. */
+  size_t n = 0;
+  for (size_t i = 0; i < snap->entries_num; i++) {
+    if ((n > 0) && (strcmp(snap->entries[n - 1].name,
+                           snap->entries[i].name) == 0)) {
+      snapshot_entry_free(snap->entries + i);
+      continue;
+    }
+    snap->entries[n] = snap->entries[i];
+    n++;
+  }
+  snap->entries_num = n;
+
+  return snap;
+} /* }}} uc_snapshot_t *uc_snapshot_match */
+
+uint64_t uc_snapshot_epoch(uc_snapshot_t const *snap) /* {{{ */
+{
+  return (snap != NULL) ? snap->epoch : 0;
+} /* }}} uint64_t uc_snapshot_epoch */
+
+size_t uc_snapshot_size(uc_snapshot_t const *snap) /* {{{ */
+{
+  return (snap != NULL) ? snap->entries_num : 0;
+} /* }}} size_t uc_snapshot_size */
+
+uc_snapshot_entry_t const *uc_snapshot_get(uc_snapshot_t const *snap, /* {{{ */
+                                          size_t index) {
+  if ((snap == NULL) || (index >= snap->entries_num))
+    return NULL;
+
+  return snap->entries + index;
+} /* }}} uc_snapshot_entry_t const *uc_snapshot_get */
+
+void uc_snapshot_destroy(uc_snapshot_t *snap) /* {{{ */
+{
+  if (snap == NULL)
+    return;
+
+  for (size_t i = 0; i < snap->entries_num; i++)
+    snapshot_entry_free(snap->entries + i);
+  sfree(snap->entries);
+  sfree(snap);
+} /* }}} void uc_snapshot_destroy */
+
 /*
  * Iterator interface
  */
@@ -863,10 +2201,9 @@ uc_iter_t *uc_get_iterator(void) {
   if (iter == NULL)
     return NULL;
 
-  pthread_mutex_lock(&cache_lock);
-
-  iter->iter = c_avl_get_iterator(cache_tree);
-  if (iter->iter == NULL) {
+  /* The iterator works on a copy, so no lock is held while iterating. */
+  iter->snapshot = uc_snapshot(/* since_epoch = */ 0);
+  if (iter->snapshot == NULL) {
     free(iter);
     return NULL;
   }
@@ -875,26 +2212,16 @@ uc_iter_t *uc_get_iterator(void) {
 } /* uc_iter_t *uc_get_iterator */
 
 int uc_iterator_next(uc_iter_t *iter, char **ret_name) {
-  int status;
-
   if (iter == NULL)
     return -1;
 
-  while ((status = c_avl_iterator_next(iter->iter, (void *)&iter->name,
-                                       (void *)&iter->entry)) == 0) {
-    if (iter->entry->state == STATE_MISSING)
-      continue;
-
-    break;
-  }
-  if (status != 0) {
-    iter->name = NULL;
-    iter->entry = NULL;
+  iter->entry = uc_snapshot_get(iter->snapshot, iter->index);
+  if (iter->entry == NULL)
     return -1;
-  }
+  iter->index++;
 
   if (ret_name != NULL)
-    *ret_name = iter->name;
+    *ret_name = iter->entry->name;
 
   return 0;
 } /* int uc_iterator_next */
@@ -903,9 +2230,7 @@ void uc_iterator_destroy(uc_iter_t *iter) {
   if (iter == NULL)
     return;
 
-  c_avl_iterator_destroy(iter->iter);
-  pthread_mutex_unlock(&cache_lock);
-
+  uc_snapshot_destroy(iter->snapshot);
   free(iter);
 } /* void uc_iterator_destroy */
 
@@ -913,7 +2238,7 @@ int uc_iterator_get_time(uc_iter_t *iter, cdtime_t *ret_time) {
   if ((iter == NULL) || (iter->entry == NULL) || (ret_time == NULL))
     return -1;
 
-  *ret_time = iter->entry->last_time;
+  *ret_time = iter->entry->time;
   return 0;
 } /* int uc_iterator_get_name */
 
@@ -922,12 +2247,11 @@ int uc_iterator_get_values(uc_iter_t *iter, value_t **ret_values,
   if ((iter == NULL) || (iter->entry == NULL) || (ret_values == NULL) ||
       (ret_num == NULL))
     return -1;
-  *ret_values =
-      calloc(iter->entry->values_num, sizeof(*iter->entry->values_raw));
+  *ret_values = calloc(iter->entry->values_num, sizeof(*iter->entry->values));
   if (*ret_values == NULL)
     return -1;
   for (size_t i = 0; i < iter->entry->values_num; ++i)
-    (*ret_values)[i] = iter->entry->values_raw[i];
+    (*ret_values)[i] = iter->entry->values[i];
 
   *ret_num = iter->entry->values_num;
 
@@ -954,33 +2278,23 @@ int uc_iterator_get_meta(uc_iter_t *iter, meta_data_t **ret_meta) {
 /*
  * Meta data interface
  */
-/* XXX: This function will acquire `cache_lock' but will not free it! */
-static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
-{
-  char name[6 * DATA_MAX_NAME_LEN];
-  cache_entry_t *ce = NULL;
-  int status;
+/* XXX: This function will acquire the lock of the entry's stripe, returned in
+ * "ret_stripe", but will not free it! */
+static meta_data_t *uc_get_meta(const value_list_t *vl, /* {{{ */
+                                cache_stripe_t **ret_stripe) {
+  cache_stripe_t *cs = NULL;
 
-  status = FORMAT_VL(name, sizeof(name), vl);
-  if (status != 0) {
-    ERROR("utils_cache: uc_get_meta: FORMAT_VL failed.");
-    return NULL;
-  }
-
-  pthread_mutex_lock(&cache_lock);
-
-  status = c_avl_get(cache_tree, name, (void *)&ce);
-  if (status != 0) {
-    pthread_mutex_unlock(&cache_lock);
+  cache_entry_t *ce = cache_get_vl(vl, &cs);
+  if (ce == NULL)
     return NULL;
-  }
-  assert(ce != NULL);
 
   if (ce->meta == NULL)
     ce->meta = meta_data_create();
 
   if (ce->meta == NULL)
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&cs->lock);
+
+  *ret_stripe = cs;
 
   return ce->meta;
 } /* }}} meta_data_t *uc_get_meta */
@@ -990,12 +2304,13 @@ static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
 #define UC_WRAP(wrap_function)                                                 \
   {                                                                            \
     meta_data_t *meta;                                                         \
+    cache_stripe_t *cs;                                                        \
     int status;                                                                \
-    meta = uc_get_meta(vl);                                                    \
+    meta = uc_get_meta(vl, &cs);                                               \
     if (meta == NULL)                                                          \
       return -1;                                                               \
     status = wrap_function(meta, key);                                         \
-    pthread_mutex_unlock(&cache_lock);                                         \
+    pthread_mutex_unlock(&cs->lock);                                           \
     return status;                                                             \
   }
 int uc_meta_data_exists(const value_list_t *vl, const char *key)
@@ -1016,12 +2331,13 @@ int uc_meta_data_exists(const value_list_t *vl, const char *key)
 #define UC_WRAP(wrap_function)                                                 \
   {                                                                            \
     meta_data_t *meta;                                                         \
+    cache_stripe_t *cs;                                                        \
     int status;                                                                \
-    meta = uc_get_meta(vl);                                                    \
+    meta = uc_get_meta(vl, &cs);                                               \
     if (meta == NULL)                                                          \
       return -1;                                                               \
     status = wrap_function(meta, key, value);                                  \
-    pthread_mutex_unlock(&cache_lock);                                         \
+    pthread_mutex_unlock(&cs->lock);                                           \
     return status;                                                             \
   }
         int uc_meta_data_add_string(const value_list_t *vl, const char *key,
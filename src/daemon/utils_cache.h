@@ -38,24 +38,111 @@
 #define STATE_MISSING 15
 
 int uc_init(void);
+
+/* Writes the cache to "file" and restores it from there, so that rates,
+ * states and histories survive a restart. Meta data is not saved. */
+int uc_save(const char *file);
+int uc_load(const char *file);
+
+/* Hashes the identifier of a value list. The result is the same as the one
+ * uc_hash_name() returns for the name created by FORMAT_VL(), but the name is
+ * never formatted. */
+uint32_t uc_hash_vl(const value_list_t *vl);
+uint32_t uc_hash_name(const char *name);
+/* Same as uc_hash_vl(), but takes the fields of the identifier. */
+uint32_t uc_hash_identifier(const char *host, const char *plugin,
+                            const char *plugin_instance, const char *type,
+                            const char *type_instance);
+
+/* Instance used for the series that take the values of series over their
+ * limit, see uc_set_series_limits(). */
+#define UC_OVERFLOW_INSTANCE "overflow"
+
+/* Limits the number of cache entries per host and per plugin. Zero disables
+ * a limit. Once a limit has been reached, uc_update() doesn't create new
+ * entries for that host or plugin and returns ENOSPC instead, except for
+ * entries whose plugin instance and type instance are UC_OVERFLOW_INSTANCE.
+ * Should be called before the first update. */
+int uc_set_series_limits(size_t per_host, size_t per_plugin);
+/* Returns the number of entries created and rejected since the start. */
+void uc_get_series_stats(uint64_t *ret_created, uint64_t *ret_rejected);
+/* Returns the number of updates rejected by uc_update() since the start
+ * because they were not newer than the cached value. */
+uint64_t uc_get_values_too_old(void);
+
 int uc_check_timeout(void);
 int uc_update(const data_set_t *ds, const value_list_t *vl);
+/* Same as uc_update(), but sets "ret_unchanged" to true if neither the values
+ * nor the rates of "vl" differ from the cached ones and an update has been
+ * reported as changed less than "heartbeat" ago. */
+int uc_update_suppress(const data_set_t *ds, const value_list_t *vl,
+                       cdtime_t heartbeat, bool *ret_unchanged);
 int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
                         size_t *ret_values_num);
 gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl);
+/* Copies the current rates of "vl" to "ret", which must have room for at
+ * least "ds->ds_num" values. Unlike uc_get_rate() this doesn't allocate.
+ * Returns ENOENT if there is no (current) entry for "vl". */
+int uc_get_rate_into(const data_set_t *ds, const value_list_t *vl,
+                     gauge_t *ret, size_t ret_num);
 int uc_get_value_by_name(const char *name, value_t **ret_values,
                          size_t *ret_values_num);
 value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl);
 
 size_t uc_get_size(void);
+
+/* Memory used by the cache entries of one plugin, see uc_get_memory(). */
+typedef struct {
+  char plugin[DATA_MAX_NAME_LEN];
+  size_t entries;
+  size_t bytes;
+} uc_memory_t;
+
+/* Returns the number of cache entries of each plugin together with an
+ * estimate of the memory they use, sorted by plugin name, and the memory used
+ * by the cache as a whole, which includes the hash tables. The estimate
+ * covers the entries, their values and their history, but not their meta
+ * data. "*ret_plugins" must be freed by the caller. */
+int uc_get_memory(uc_memory_t **ret_plugins, size_t *ret_plugins_num,
+                  size_t *ret_bytes);
 int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number);
 
+/* Stores the time of the cached value of "vl" in "ret_time". Returns ENOENT
+ * if "vl" is not in the cache. */
+int uc_get_last_time(const value_list_t *vl, cdtime_t *ret_time);
 int uc_get_state(const data_set_t *ds, const value_list_t *vl);
 int uc_set_state(const data_set_t *ds, const value_list_t *vl, int state);
 int uc_get_hits(const data_set_t *ds, const value_list_t *vl);
 int uc_set_hits(const data_set_t *ds, const value_list_t *vl, int hits);
 int uc_inc_hits(const data_set_t *ds, const value_list_t *vl, int step);
 
+/* Memoized result of threshold_search(), see utils_threshold.h. The stored
+ * pointer, which may be NULL for "no threshold", is only returned if it was
+ * stored with the same "generation". Returns ENOENT if the value list is not
+ * in the cache or nothing valid has been stored for it. */
+struct threshold_s;
+int uc_get_threshold(const value_list_t *vl, uint64_t generation,
+                     struct threshold_s **ret_threshold);
+int uc_set_threshold(const value_list_t *vl, uint64_t generation,
+                     struct threshold_s *threshold);
+
+/* Threshold state, hit counter and memoized threshold of the cache entry
+ * "name", see uc_set_threshold_states(). */
+typedef struct {
+  char const *name;
+  int state;
+  int hits;
+  struct threshold_s *threshold;
+  uint64_t threshold_generation;
+} uc_threshold_state_t;
+
+/* Stores the threshold states of many entries at once, for example after
+ * checking a snapshot against the thresholds. Each stripe of the cache is
+ * locked only once. Entries which have been removed or have gone missing in
+ * the meantime are skipped, so that a missing value is reported as such. */
+int uc_set_threshold_states(uc_threshold_state_t const *states,
+                            size_t states_num);
+
 int uc_set_callbacks_mask(const char *name, unsigned long callbacks_mask);
 
 int uc_get_history(const data_set_t *ds, const value_list_t *vl,
@@ -74,8 +161,9 @@ typedef struct uc_iter_s uc_iter_t;
  *   uc_get_iterator
  *
  * DESCRIPTION
- *   Create an iterator for the cache. It will hold the cache lock until it's
- *   destroyed.
+ *   Create an iterator for the cache. The iterator works on a snapshot of the
+ *   cache, see uc_snapshot(), so no lock is held while iterating. Entries are
+ *   returned in lexicographic order of their names.
  *
  * RETURN VALUE
  *   An iterator object on success or NULL else.
@@ -113,6 +201,80 @@ int uc_iterator_get_interval(uc_iter_t *iter, cdtime_t *ret_interval);
 /* Return the metadata for the value at the current position. */
 int uc_iterator_get_meta(uc_iter_t *iter, meta_data_t **ret_meta);
 
+/*
+ * Snapshot interface
+ */
+struct uc_snapshot_s;
+typedef struct uc_snapshot_s uc_snapshot_t;
+
+typedef struct {
+  char *name;
+  cdtime_t time;
+  cdtime_t interval;
+  size_t values_num;
+  value_t *values; /* raw values */
+  gauge_t *rates;  /* as returned by uc_get_rate() */
+  meta_data_t *meta;
+  uint64_t epoch; /* see uc_snapshot_epoch() */
+  /* Threshold state and hit counter, and the memoized threshold, see
+   * uc_get_threshold(). */
+  int state;
+  int hits;
+  struct threshold_s *threshold;
+  uint64_t threshold_generation;
+} uc_snapshot_entry_t;
+
+/*
+ * NAME
+ *   uc_snapshot
+ *
+ * DESCRIPTION
+ *   Copies the entries of the cache, which can then be read without holding
+ *   any lock. The cache is locked one part at a time while copying, so
+ *   updates can continue. The copied meta data is shared with the cache until
+ *   either is modified. Entries are sorted by name. The snapshot is not
+ *   atomic: entries may be updated while the snapshot is being taken.
+ *
+ * PARAMETERS
+ *   `since_epoch'  Only copy entries updated since the snapshot that returned
+ *                  this value from uc_snapshot_epoch() was taken. Zero copies
+ *                  all entries.
+ *
+ * RETURN VALUE
+ *   A snapshot, which must be freed with uc_snapshot_destroy(), or NULL on
+ *   error.
+ */
+uc_snapshot_t *uc_snapshot(uint64_t since_epoch);
+
+/*
+ * NAME
+ *   uc_snapshot_match
+ *
+ * DESCRIPTION
+ *   Like uc_snapshot(), but only copies the entries whose name is one of
+ *   "patterns" or matches one of them as a shell wildcard pattern (see
+ *   fnmatch(3)). Without wildcards, the names are looked up individually,
+ *   otherwise the cache is walked once for all patterns. Each entry is
+ *   returned at most once. The epoch of the returned snapshot is zero.
+ *
+ * RETURN VALUE
+ *   A snapshot, which must be freed with uc_snapshot_destroy(), or NULL on
+ *   error.
+ */
+uc_snapshot_t *uc_snapshot_match(char const *const *patterns,
+                                 size_t patterns_num);
+
+/* Returns the epoch to pass to the next uc_snapshot() call, to get only the
+ * entries updated since "snap" was taken. Entries updated while "snap" was
+ * being taken may be included in both snapshots. */
+uint64_t uc_snapshot_epoch(uc_snapshot_t const *snap);
+/* Returns the number of entries in the snapshot. */
+size_t uc_snapshot_size(uc_snapshot_t const *snap);
+/* Returns the entry at position "index" or NULL if "index" is out of range. */
+uc_snapshot_entry_t const *uc_snapshot_get(uc_snapshot_t const *snap,
+                                          size_t index);
+void uc_snapshot_destroy(uc_snapshot_t *snap);
+
 /*
  * Meta data interface
  */
@@ -35,6 +35,13 @@ gauge_t *uc_get_rate(__attribute__((unused)) data_set_t const *ds,
   return NULL;
 }
 
+int uc_get_rate_into(__attribute__((unused)) data_set_t const *ds,
+                     __attribute__((unused)) value_list_t const *vl,
+                     __attribute__((unused)) gauge_t *ret,
+                     __attribute__((unused)) size_t ret_num) {
+  return ENOTSUP;
+}
+
 int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
                         size_t *ret_values_num) {
   return ENOTSUP;
@@ -49,6 +56,25 @@ int uc_get_value_by_name(const char *name, value_t **ret_values,
   return ENOTSUP;
 }
 
+int uc_get_last_time(const value_list_t *vl, cdtime_t *ret_time) {
+  return ENOENT;
+}
+
+uc_snapshot_t *uc_snapshot_match(char const *const *patterns,
+                                 size_t patterns_num) {
+  errno = ENOTSUP;
+  return NULL;
+}
+
+size_t uc_snapshot_size(uc_snapshot_t const *snap) { return 0; }
+
+uc_snapshot_entry_t const *uc_snapshot_get(uc_snapshot_t const *snap,
+                                          size_t index) {
+  return NULL;
+}
+
+void uc_snapshot_destroy(uc_snapshot_t *snap) {}
+
 int uc_meta_data_get_signed_int(const value_list_t *vl, const char *key,
                                 int64_t *value) {
   return -ENOENT;
@@ -24,11 +24,14 @@
  *   Florian Forster <octo at collectd.org>
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "utils_llist.h"
 
+#define LLIST_BUCKETS_MIN 16
+
 /*
  * Private data types
  */
@@ -36,8 +39,106 @@ struct llist_s {
   llentry_t *head;
   llentry_t *tail;
   int size;
+
+  /* Index of the entries with a non-NULL key. "buckets" is NULL if the index
+   * could not be allocated; llist_search() falls back to a linear search
+   * then. */
+  llentry_t **buckets;
+  size_t buckets_num;
+  int keys_num;
 };
 
+/*
+ * Private functions
+ */
+static uint32_t llist_hash(const char *key) {
+  /* FNV-1a */
+  uint32_t hash = 2166136261u;
+
+  for (const unsigned char *c = (const unsigned char *)key; *c != 0; c++) {
+    hash ^= *c;
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+static llentry_t **llist_bucket(llist_t *l, const char *key) {
+  return &l->buckets[llist_hash(key) & (l->buckets_num - 1)];
+}
+
+/* llist_rehash (re)builds the index with "num" buckets. The entries of each
+ * bucket are kept in list order, so that llist_search() returns the first
+ * matching entry. On failure the old index is kept. */
+static int llist_rehash(llist_t *l, size_t num) {
+  llentry_t **buckets = calloc(num, sizeof(*buckets));
+  if (buckets == NULL)
+    return -1;
+
+  free(l->buckets);
+  l->buckets = buckets;
+  l->buckets_num = num;
+
+  for (llentry_t *e = l->tail; e != NULL; e = e->prev) {
+    if (e->key == NULL)
+      continue;
+
+    llentry_t **b = llist_bucket(l, e->key);
+    e->hash_next = *b;
+    *b = e;
+  }
+
+  return 0;
+}
+
+/* llist_index adds "e" to the index. "e" must already be linked into the
+ * list. */
+static void llist_index(llist_t *l, llentry_t *e) {
+  e->hash_next = NULL;
+  if (e->key == NULL)
+    return;
+
+  l->keys_num++;
+  if ((l->buckets == NULL) || ((size_t)l->keys_num > l->buckets_num)) {
+    size_t num = (l->buckets_num > 0) ? 2 * l->buckets_num : LLIST_BUCKETS_MIN;
+    if (llist_rehash(l, num) == 0)
+      return; /* "e" has been indexed by llist_rehash(). */
+    if (l->buckets == NULL)
+      return;
+  }
+
+  llentry_t **b = llist_bucket(l, e->key);
+  if (e->prev == NULL) {
+    /* Prepended: the new entry precedes all others with the same key. */
+    e->hash_next = *b;
+    *b = e;
+    return;
+  }
+
+  /* Appended: the new entry follows all others with the same key. */
+  while (*b != NULL)
+    b = &(*b)->hash_next;
+  *b = e;
+}
+
+static void llist_unindex(llist_t *l, llentry_t *e) {
+  if (e->key == NULL)
+    return;
+
+  l->keys_num--;
+  if (l->buckets == NULL)
+    return;
+
+  for (llentry_t **b = llist_bucket(l, e->key); *b != NULL;
+       b = &(*b)->hash_next) {
+    if (*b == e) {
+      *b = e->hash_next;
+      break;
+    }
+  }
+  e->hash_next = NULL;
+}
+
 /*
  * Public functions
  */
@@ -63,6 +164,7 @@ void llist_destroy(llist_t *l) {
     llentry_destroy(e_this);
   }
 
+  free(l->buckets);
   free(l);
 }
 
@@ -74,6 +176,8 @@ llentry_t *llentry_create(char *key, void *value) {
     e->key = key;
     e->value = value;
     e->next = NULL;
+    e->prev = NULL;
+    e->hash_next = NULL;
   }
 
   return e;
@@ -83,6 +187,7 @@ void llentry_destroy(llentry_t *e) { free(e); }
 
 void llist_append(llist_t *l, llentry_t *e) {
   e->next = NULL;
+  e->prev = l->tail;
 
   if (l->tail == NULL)
     l->head = e;
@@ -92,34 +197,42 @@ void llist_append(llist_t *l, llentry_t *e) {
   l->tail = e;
 
   ++(l->size);
+  llist_index(l, e);
 }
 
 void llist_prepend(llist_t *l, llentry_t *e) {
   e->next = l->head;
-  l->head = e;
+  e->prev = NULL;
 
-  if (l->tail == NULL)
+  if (l->head == NULL)
     l->tail = e;
+  else
+    l->head->prev = e;
+
+  l->head = e;
 
   ++(l->size);
+  llist_index(l, e);
 }
 
 void llist_remove(llist_t *l, llentry_t *e) {
-  llentry_t *prev;
-
   if ((l == NULL) || (e == NULL))
     return;
 
-  prev = l->head;
-  while ((prev != NULL) && (prev->next != e))
-    prev = prev->next;
+  llist_unindex(l, e);
 
-  if (prev != NULL)
-    prev->next = e->next;
-  if (l->head == e)
+  if (e->prev != NULL)
+    e->prev->next = e->next;
+  else
     l->head = e->next;
-  if (l->tail == e)
-    l->tail = prev;
+
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  else
+    l->tail = e->prev;
+
+  e->next = NULL;
+  e->prev = NULL;
 
   --(l->size);
 }
@@ -127,13 +240,24 @@ void llist_remove(llist_t *l, llentry_t *e) {
 int llist_size(llist_t *l) { return l ? l->size : 0; }
 
 static int llist_strcmp(llentry_t *e, void *ud) {
-  if ((e == NULL) || (ud == NULL))
+  if ((e == NULL) || (e->key == NULL) || (ud == NULL))
     return -1;
   return strcmp(e->key, (const char *)ud);
 }
 
 llentry_t *llist_search(llist_t *l, const char *key) {
-  return llist_search_custom(l, llist_strcmp, (void *)key);
+  if ((l == NULL) || (key == NULL))
+    return NULL;
+
+  if (l->buckets == NULL)
+    return llist_search_custom(l, llist_strcmp, (void *)key);
+
+  for (llentry_t *e = *llist_bucket(l, key); e != NULL; e = e->hash_next) {
+    if (strcmp(e->key, key) == 0)
+      return e;
+  }
+
+  return NULL;
 }
 
 llentry_t *llist_search_custom(llist_t *l, int (*compare)(llentry_t *, void *),
@@ -34,6 +34,10 @@ struct llentry_s {
   char *key;
   void *value;
   struct llentry_s *next;
+  struct llentry_s *prev;
+
+  /* Private: next entry in the same bucket of the key index. */
+  struct llentry_s *hash_next;
 };
 typedef struct llentry_s llentry_t;
 
@@ -42,6 +46,12 @@ typedef struct llist_s llist_t;
 
 /*
  * Functions
+ *
+ * Entries with a non-NULL key are indexed by a hash table, so that
+ * llist_search(), llist_append(), llist_prepend() and llist_remove() take
+ * constant time on average. The key of an entry must not be changed while
+ * the entry is part of a list. If several entries have the same key,
+ * llist_search() returns the one closest to the head of the list.
  */
 llist_t *llist_create(void);
 void llist_destroy(llist_t *l);
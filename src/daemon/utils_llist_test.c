@@ -0,0 +1,121 @@
+/**
+ * collectd - src/daemon/utils_llist_test.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils_llist.h"
+
+#define KEYS_NUM 1000
+
+static int compare_value(llentry_t *e, void *ud) {
+  return (e->value == ud) ? 0 : 1;
+}
+
+DEF_TEST(search) {
+  llist_t *l = llist_create();
+  CHECK_NOT_NULL(l);
+
+  char keys[KEYS_NUM][16];
+  for (int i = 0; i < KEYS_NUM; i++) {
+    snprintf(keys[i], sizeof(keys[i]), "key%d", i);
+    llist_append(l, llentry_create(keys[i], keys[i]));
+  }
+  EXPECT_EQ_INT(KEYS_NUM, llist_size(l));
+
+  for (int i = 0; i < KEYS_NUM; i++) {
+    llentry_t *e = llist_search(l, keys[i]);
+    CHECK_NOT_NULL(e);
+    EXPECT_EQ_PTR(keys[i], e->value);
+  }
+  EXPECT_EQ_PTR(NULL, llist_search(l, "nonexistent"));
+  EXPECT_EQ_PTR(NULL, llist_search(l, NULL));
+
+  /* Remove every other entry. */
+  for (int i = 0; i < KEYS_NUM; i += 2) {
+    llentry_t *e = llist_search(l, keys[i]);
+    CHECK_NOT_NULL(e);
+    llist_remove(l, e);
+    llentry_destroy(e);
+  }
+  EXPECT_EQ_INT(KEYS_NUM / 2, llist_size(l));
+
+  int i = 1;
+  for (llentry_t *e = llist_head(l); e != NULL; e = e->next, i += 2) {
+    EXPECT_EQ_STR(keys[i], e->key);
+    EXPECT_EQ_PTR(e, llist_search(l, keys[i]));
+    EXPECT_EQ_PTR(NULL, llist_search(l, keys[i - 1]));
+  }
+  EXPECT_EQ_INT(KEYS_NUM + 1, i);
+  EXPECT_EQ_STR(keys[KEYS_NUM - 1], llist_tail(l)->key);
+
+  llist_destroy(l);
+  return 0;
+}
+
+DEF_TEST(duplicates) {
+  llist_t *l = llist_create();
+  CHECK_NOT_NULL(l);
+
+  int values[4];
+  llist_append(l, llentry_create("dup", &values[1]));
+  llist_append(l, llentry_create("dup", &values[2]));
+  llist_prepend(l, llentry_create("dup", &values[0]));
+  llist_append(l, llentry_create(NULL, &values[3]));
+
+  /* The search returns the entry closest to the head. */
+  for (int i = 0; i < 3; i++) {
+    llentry_t *e = llist_search(l, "dup");
+    CHECK_NOT_NULL(e);
+    EXPECT_EQ_PTR(&values[i], e->value);
+    EXPECT_EQ_PTR(e, llist_head(l));
+    llist_remove(l, e);
+    llentry_destroy(e);
+  }
+  EXPECT_EQ_PTR(NULL, llist_search(l, "dup"));
+
+  llentry_t *e = llist_search_custom(l, compare_value, &values[3]);
+  CHECK_NOT_NULL(e);
+  EXPECT_EQ_PTR(e, llist_head(l));
+  EXPECT_EQ_PTR(e, llist_tail(l));
+  llist_remove(l, e);
+  llentry_destroy(e);
+
+  EXPECT_EQ_INT(0, llist_size(l));
+  EXPECT_EQ_PTR(NULL, llist_head(l));
+  EXPECT_EQ_PTR(NULL, llist_tail(l));
+
+  llist_destroy(l);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(search);
+  RUN_TEST(duplicates);
+
+  END_TEST;
+}
@@ -0,0 +1,300 @@
+/**
+ * collectd - src/daemon/utils_pool.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "utils_pool.h"
+
+#include <pthread.h>
+
+/* Number of objects moved between a thread cache and the depot at once. */
+#define POOL_CHUNK_SIZE 64
+
+/* Free objects are linked using their first bytes. The first object of a
+ * chunk in the depot additionally points to the next chunk. */
+struct pool_object_s;
+typedef struct pool_object_s pool_object_t;
+struct pool_object_s {
+  pool_object_t *next;
+  pool_object_t *next_chunk;
+};
+
+struct pool_cache_s;
+typedef struct pool_cache_s pool_cache_t;
+struct pool_cache_s {
+  pool_t *pool;
+  pool_object_t *head;
+  size_t num;
+
+  uint64_t hits;
+  uint64_t misses;
+
+  pool_cache_t *prev;
+  pool_cache_t *next;
+};
+
+struct pool_s {
+  size_t object_size;
+  size_t max_chunks;
+
+  pthread_key_t key;
+  pthread_mutex_t lock;
+
+  /* shared depot */
+  pool_object_t *chunks;
+  size_t chunks_num;
+
+  /* all thread caches */
+  pool_cache_t *caches;
+
+  /* counters of threads that have exited */
+  uint64_t hits;
+  uint64_t misses;
+};
+
+static void pool_free_list(pool_object_t *o) /* {{{ */
+{
+  while (o != NULL) {
+    pool_object_t *next = o->next;
+    free(o);
+    o = next;
+  }
+} /* }}} void pool_free_list */
+
+/* Moves the first POOL_CHUNK_SIZE objects of the cache to the depot. Called
+ * with the pool lock held. */
+static void pool_cache_release_chunk(pool_cache_t *c) /* {{{ */
+{
+  pool_t *p = c->pool;
+
+  pool_object_t *chunk = c->head;
+  pool_object_t *last = chunk;
+  size_t num = 1;
+  while ((num < POOL_CHUNK_SIZE) && (last->next != NULL)) {
+    last = last->next;
+    num++;
+  }
+
+  c->head = last->next;
+  c->num -= num;
+  last->next = NULL;
+
+  if (p->chunks_num >= p->max_chunks) {
+    pool_free_list(chunk);
+    return;
+  }
+
+  chunk->next_chunk = p->chunks;
+  p->chunks = chunk;
+  p->chunks_num++;
+} /* }}} void pool_cache_release_chunk */
+
+static void pool_cache_destroy(void *arg) /* {{{ */
+{
+  pool_cache_t *c = arg;
+  if (c == NULL)
+    return;
+
+  pool_t *p = c->pool;
+
+  pthread_mutex_lock(&p->lock);
+  while (c->num >= POOL_CHUNK_SIZE)
+    pool_cache_release_chunk(c);
+  pool_free_list(c->head);
+
+  p->hits += c->hits;
+  p->misses += c->misses;
+
+  if (c->prev != NULL)
+    c->prev->next = c->next;
+  else
+    p->caches = c->next;
+  if (c->next != NULL)
+    c->next->prev = c->prev;
+  pthread_mutex_unlock(&p->lock);
+
+  free(c);
+} /* }}} void pool_cache_destroy */
+
+static pool_cache_t *pool_get_cache(pool_t *p) /* {{{ */
+{
+  pool_cache_t *c = pthread_getspecific(p->key);
+  if (c != NULL)
+    return c;
+
+  c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return NULL;
+  c->pool = p;
+
+  if (pthread_setspecific(p->key, c) != 0) {
+    free(c);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&p->lock);
+  c->next = p->caches;
+  if (p->caches != NULL)
+    p->caches->prev = c;
+  p->caches = c;
+  pthread_mutex_unlock(&p->lock);
+
+  return c;
+} /* }}} pool_cache_t *pool_get_cache */
+
+pool_t *pool_create(size_t object_size, size_t max_free) /* {{{ */
+{
+  pool_t *p = calloc(1, sizeof(*p));
+  if (p == NULL)
+    return NULL;
+
+  if (object_size < sizeof(pool_object_t))
+    object_size = sizeof(pool_object_t);
+  p->object_size = object_size;
+  p->max_chunks = max_free / POOL_CHUNK_SIZE;
+
+  if (pthread_key_create(&p->key, pool_cache_destroy) != 0) {
+    free(p);
+    return NULL;
+  }
+  pthread_mutex_init(&p->lock, /* attr = */ NULL);
+
+  return p;
+} /* }}} pool_t *pool_create */
+
+void pool_destroy(pool_t *p) /* {{{ */
+{
+  if (p == NULL)
+    return;
+
+  /* Deleting the key first makes sure the destructor is not called for
+   * threads that exit later on. */
+  pthread_key_delete(p->key);
+
+  while (p->caches != NULL) {
+    pool_cache_t *c = p->caches;
+    p->caches = c->next;
+
+    pool_free_list(c->head);
+    free(c);
+  }
+
+  while (p->chunks != NULL) {
+    pool_object_t *chunk = p->chunks;
+    p->chunks = chunk->next_chunk;
+    pool_free_list(chunk);
+  }
+
+  pthread_mutex_destroy(&p->lock);
+  free(p);
+} /* }}} void pool_destroy */
+
+void *pool_alloc(pool_t *p) /* {{{ */
+{
+  if (p == NULL)
+    return NULL;
+
+  pool_cache_t *c = pool_get_cache(p);
+  if (c == NULL)
+    return malloc(p->object_size);
+
+  if ((c->head == NULL) && (p->chunks != NULL)) {
+    pthread_mutex_lock(&p->lock);
+    pool_object_t *chunk = p->chunks;
+    if (chunk != NULL) {
+      p->chunks = chunk->next_chunk;
+      p->chunks_num--;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    c->head = chunk;
+    for (pool_object_t *o = chunk; o != NULL; o = o->next)
+      c->num++;
+  }
+
+  pool_object_t *o = c->head;
+  if (o == NULL) {
+    c->misses++;
+    return malloc(p->object_size);
+  }
+
+  c->head = o->next;
+  c->num--;
+  c->hits++;
+  return o;
+} /* }}} void *pool_alloc */
+
+void pool_free(pool_t *p, void *obj) /* {{{ */
+{
+  if (obj == NULL)
+    return;
+
+  if (p == NULL) {
+    free(obj);
+    return;
+  }
+
+  pool_cache_t *c = pool_get_cache(p);
+  if (c == NULL) {
+    free(obj);
+    return;
+  }
+
+  pool_object_t *o = obj;
+  o->next = c->head;
+  c->head = o;
+  c->num++;
+
+  /* Keep up to two chunks locally, so that a thread alternating between
+   * allocating and freeing does not move the same chunk back and forth. */
+  if (c->num >= 2 * POOL_CHUNK_SIZE) {
+    pthread_mutex_lock(&p->lock);
+    pool_cache_release_chunk(c);
+    pthread_mutex_unlock(&p->lock);
+  }
+} /* }}} void pool_free */
+
+void pool_stats(pool_t *p, uint64_t *hits, uint64_t *misses) /* {{{ */
+{
+  uint64_t h = 0;
+  uint64_t m = 0;
+
+  if (p != NULL) {
+    pthread_mutex_lock(&p->lock);
+    h = p->hits;
+    m = p->misses;
+    for (pool_cache_t *c = p->caches; c != NULL; c = c->next) {
+      h += c->hits;
+      m += c->misses;
+    }
+    pthread_mutex_unlock(&p->lock);
+  }
+
+  if (hits != NULL)
+    *hits = h;
+  if (misses != NULL)
+    *misses = m;
+} /* }}} void pool_stats */
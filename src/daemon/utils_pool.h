@@ -0,0 +1,79 @@
+/**
+ * collectd - src/daemon/utils_pool.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#ifndef UTILS_POOL_H
+#define UTILS_POOL_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Object pool for fixed size objects, e.g. the nodes of the write queue.
+ *
+ * Each thread keeps a small cache of free objects, so that allocating and
+ * freeing objects usually does not take any lock. Objects are moved between
+ * the thread caches and a shared depot in chunks, which makes it possible to
+ * allocate objects in one thread and free them in another without returning
+ * them to malloc(3).
+ */
+struct pool_s;
+typedef struct pool_s pool_t;
+
+/*
+ * pool_create allocates a new pool for objects of "object_size" bytes. Up to
+ * "max_free" free objects are kept in the shared depot; beyond that, objects
+ * are returned to the system. Returns NULL on failure.
+ */
+pool_t *pool_create(size_t object_size, size_t max_free);
+
+/*
+ * pool_destroy frees all free objects held by the pool and the pool itself.
+ * Objects that are in use are not freed. No other thread must access the pool
+ * while it is being destroyed.
+ */
+void pool_destroy(pool_t *p);
+
+/*
+ * pool_alloc returns an uninitialized object of the pool's object size.
+ * Returns NULL if "p" is NULL or on failure.
+ */
+void *pool_alloc(pool_t *p);
+
+/*
+ * pool_free returns an object allocated with pool_alloc to the pool. If "p"
+ * is NULL, "obj" is freed using free(3).
+ */
+void pool_free(pool_t *p, void *obj);
+
+/*
+ * pool_stats returns the number of allocations served from the pool
+ * ("hits") and the number of allocations that had to fall back to malloc(3)
+ * ("misses"). The counters of running threads are read without locking, so
+ * the values may lag behind slightly.
+ */
+void pool_stats(pool_t *p, uint64_t *hits, uint64_t *misses);
+
+#endif /* UTILS_POOL_H */
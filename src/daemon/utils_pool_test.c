@@ -0,0 +1,128 @@
+/**
+ * collectd - src/daemon/utils_pool_test.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils_pool.h"
+
+#include <pthread.h>
+
+#define OBJECT_NUM 1000
+
+DEF_TEST(alloc_free) {
+  pool_t *p = pool_create(32, 1024);
+  OK(p != NULL);
+
+  uint64_t hits = 1;
+  uint64_t misses = 1;
+  pool_stats(p, &hits, &misses);
+  EXPECT_EQ_UINT64(0, hits);
+  EXPECT_EQ_UINT64(0, misses);
+
+  void *obj = pool_alloc(p);
+  OK(obj != NULL);
+  memset(obj, 0xff, 32);
+  pool_free(p, obj);
+
+  /* The object just freed is handed out again. */
+  EXPECT_EQ_PTR(obj, pool_alloc(p));
+  pool_free(p, obj);
+
+  pool_stats(p, &hits, &misses);
+  EXPECT_EQ_UINT64(1, hits);
+  EXPECT_EQ_UINT64(1, misses);
+
+  pool_destroy(p);
+  return 0;
+}
+
+DEF_TEST(null_pool) {
+  EXPECT_EQ_PTR(NULL, pool_alloc(NULL));
+
+  /* pool_free falls back to free(3). */
+  pool_free(NULL, malloc(16));
+  pool_free(NULL, NULL);
+
+  uint64_t hits = 1;
+  pool_stats(NULL, &hits, NULL);
+  EXPECT_EQ_UINT64(0, hits);
+
+  return 0;
+}
+
+static void *free_objects(void *arg) {
+  void **objects = ((void **)arg) + 1;
+  pool_t *p = ((void **)arg)[0];
+
+  for (size_t i = 0; i < OBJECT_NUM; i++)
+    pool_free(p, objects[i]);
+
+  return NULL;
+}
+
+DEF_TEST(cross_thread) {
+  pool_t *p = pool_create(sizeof(double), 2 * OBJECT_NUM);
+  OK(p != NULL);
+
+  void *args[OBJECT_NUM + 1] = {p};
+  for (size_t i = 0; i < OBJECT_NUM; i++) {
+    args[i + 1] = pool_alloc(p);
+    OK(args[i + 1] != NULL);
+  }
+
+  /* Objects freed in another thread end up in the depot in chunks of 64 and
+   * are available to this thread afterwards. Objects that don't fill a whole
+   * chunk are released when the other thread exits. */
+  pthread_t t;
+  OK(pthread_create(&t, NULL, free_objects, args) == 0);
+  OK(pthread_join(t, NULL) == 0);
+
+  for (size_t i = 0; i < OBJECT_NUM; i++) {
+    args[i + 1] = pool_alloc(p);
+    OK(args[i + 1] != NULL);
+  }
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  pool_stats(p, &hits, &misses);
+  EXPECT_EQ_UINT64(2 * OBJECT_NUM, hits + misses);
+  EXPECT_EQ_UINT64(OBJECT_NUM - (OBJECT_NUM % 64), hits);
+
+  for (size_t i = 0; i < OBJECT_NUM; i++)
+    pool_free(p, args[i + 1]);
+
+  pool_destroy(p);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(alloc_free);
+  RUN_TEST(null_pool);
+  RUN_TEST(cross_thread);
+
+  END_TEST;
+}
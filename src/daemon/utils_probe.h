@@ -0,0 +1,79 @@
+/**
+ * collectd - src/daemon/utils_probe.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#ifndef UTILS_PROBE_H
+#define UTILS_PROBE_H 1
+
+/*
+ * Statically defined tracing probes (USDT) of the "collectd" provider.
+ *
+ * When compiled in, each probe is a single no-op instruction plus a note in
+ * the ELF file. Tools such as bpftrace, perf, SystemTap and DTrace attach to
+ * them at run time, e.g.:
+ *
+ *   bpftrace -e 'usdt:/usr/sbin/collectd:collectd:read__done
+ *                { @[str(arg0)] = count(); }'
+ *
+ * Without <sys/sdt.h>, or when configured with "--disable-usdt", the macros
+ * compile to nothing and their arguments are never evaluated, so arguments
+ * must not have side effects. The probes are documented in collectd(1).
+ */
+
+#if COLLECT_USDT
+#include <sys/sdt.h>
+
+#define PROBE0(name) DTRACE_PROBE(collectd, name)
+#define PROBE1(name, a1) DTRACE_PROBE1(collectd, name, a1)
+#define PROBE2(name, a1, a2) DTRACE_PROBE2(collectd, name, a1, a2)
+#define PROBE3(name, a1, a2, a3) DTRACE_PROBE3(collectd, name, a1, a2, a3)
+#else
+#define PROBE0(name)                                                           \
+  do {                                                                         \
+  } while (0)
+#define PROBE1(name, a1)                                                       \
+  do {                                                                         \
+    if (0) {                                                                   \
+      (void)(a1);                                                              \
+    }                                                                          \
+  } while (0)
+#define PROBE2(name, a1, a2)                                                   \
+  do {                                                                         \
+    if (0) {                                                                   \
+      (void)(a1);                                                              \
+      (void)(a2);                                                              \
+    }                                                                          \
+  } while (0)
+#define PROBE3(name, a1, a2, a3)                                               \
+  do {                                                                         \
+    if (0) {                                                                   \
+      (void)(a1);                                                              \
+      (void)(a2);                                                              \
+      (void)(a3);                                                              \
+    }                                                                          \
+  } while (0)
+#endif
+
+#endif /* UTILS_PROBE_H */
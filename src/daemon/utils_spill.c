@@ -0,0 +1,539 @@
+/**
+ * collectd - src/daemon/utils_spill.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils_spill.h"
+
+#define SPILL_MAGIC 0x43445350 /* "CDSP" */
+#define SPILL_SUFFIX ".spill"
+#define SPILL_FILE_BUFFER 65536
+#define SPILL_SEGMENT_MIN 65536
+#define SPILL_SEGMENT_MAX (16 * 1024 * 1024)
+#define SPILL_SYNC_INTERVAL TIME_T_TO_CDTIME_T(1)
+
+/* Record layout, in host byte order:
+ *   uint32_t magic, uint32_t size (of the whole record),
+ *   uint64_t time, uint64_t interval, uint16_t values_len,
+ *   five strings (host, plugin, plugin_instance, type, type_instance), each
+ *   as uint8_t length followed by the characters without terminating null,
+ *   values_len values of 8 bytes each. */
+#define SPILL_HEADER_SIZE (4 + 4 + 8 + 8 + 2)
+#define SPILL_STRINGS_MAX (5 * DATA_MAX_NAME_LEN)
+#define SPILL_RECORD_MAX                                                       \
+  (SPILL_HEADER_SIZE + SPILL_STRINGS_MAX + 65535 * sizeof(value_t))
+
+struct spill_s {
+  pthread_mutex_t lock;
+  char *dir;
+
+  uint64_t size_limit;
+  uint64_t segment_size;
+  uint64_t size; /* of all segment files */
+
+  /* Segment being written. The file is created with the first record. */
+  uint64_t write_seq;
+  FILE *write_fh;
+  uint64_t write_size;
+  cdtime_t last_sync;
+
+  /* Position following the last record returned by spill_read(). */
+  uint64_t read_seq;
+  uint64_t read_pos;
+  FILE *read_fh;
+  uint64_t read_size; /* of a completed segment, UINT64_MAX otherwise */
+
+  /* Position following the last committed record. */
+  uint64_t commit_seq;
+  uint64_t commit_pos;
+
+  uint8_t *buffer;
+};
+
+static void spill_path(spill_t *s, uint64_t seq, char *buffer, /* {{{ */
+                       size_t buffer_size) {
+  snprintf(buffer, buffer_size, "%s/%016" PRIx64 SPILL_SUFFIX, s->dir, seq);
+} /* }}} void spill_path */
+
+static int spill_scan_cb(const char *dirname, const char *filename, /* {{{ */
+                         void *user_data) {
+  spill_t *s = user_data;
+  char path[PATH_MAX];
+  struct stat statbuf;
+  char *endptr = NULL;
+
+  size_t len = strlen(filename);
+  if ((len != 16 + strlen(SPILL_SUFFIX)) ||
+      (strcmp(filename + 16, SPILL_SUFFIX) != 0))
+    return 0;
+
+  errno = 0;
+  uint64_t seq = (uint64_t)strtoull(filename, &endptr, 16);
+  if ((errno != 0) || (endptr != filename + 16))
+    return 0;
+
+  snprintf(path, sizeof(path), "%s/%s", dirname, filename);
+  if (stat(path, &statbuf) != 0)
+    return 0;
+
+  if (seq < s->read_seq)
+    s->read_seq = seq;
+  if (seq >= s->write_seq)
+    s->write_seq = seq + 1;
+  s->size += (uint64_t)statbuf.st_size;
+
+  return 0;
+} /* }}} int spill_scan_cb */
+
+spill_t *spill_create(char const *dir, uint64_t size_limit) /* {{{ */
+{
+  char path[PATH_MAX];
+
+  if ((dir == NULL) || (size_limit == 0))
+    return NULL;
+
+  snprintf(path, sizeof(path), "%s/", dir);
+  if (check_create_dir(path) != 0) {
+    ERROR("spill_create: Creating directory \"%s\" failed.", dir);
+    return NULL;
+  }
+
+  spill_t *s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+
+  s->dir = strdup(dir);
+  s->buffer = malloc(SPILL_RECORD_MAX);
+  if ((s->dir == NULL) || (s->buffer == NULL)) {
+    spill_destroy(s);
+    return NULL;
+  }
+  pthread_mutex_init(&s->lock, NULL);
+
+  s->size_limit = size_limit;
+  s->segment_size = size_limit / 8;
+  if (s->segment_size > SPILL_SEGMENT_MAX)
+    s->segment_size = SPILL_SEGMENT_MAX;
+  if (s->segment_size < SPILL_SEGMENT_MIN)
+    s->segment_size = SPILL_SEGMENT_MIN;
+
+  /* Segments left over from a previous run are read before anything new. */
+  s->read_seq = UINT64_MAX;
+  walk_directory(dir, spill_scan_cb, s, /* hidden = */ 0);
+  if (s->read_seq == UINT64_MAX)
+    s->read_seq = s->write_seq;
+  s->commit_seq = s->read_seq;
+
+  if (s->size > 0)
+    INFO("spill_create: Found %" PRIu64 " bytes of value lists in \"%s\".",
+         s->size, dir);
+
+  return s;
+} /* }}} spill_t *spill_create */
+
+static int spill_sync(spill_t *s) /* {{{ */
+{
+  if (s->write_fh == NULL)
+    return 0;
+
+  if ((fflush(s->write_fh) != 0) || (fdatasync(fileno(s->write_fh)) != 0)) {
+    ERROR("spill: Syncing segment %016" PRIx64 " in \"%s\" failed: %s",
+          s->write_seq, s->dir, STRERRNO);
+    return -1;
+  }
+
+  s->last_sync = cdtime();
+  return 0;
+} /* }}} int spill_sync */
+
+static void spill_close_write(spill_t *s) /* {{{ */
+{
+  if (s->write_fh == NULL)
+    return;
+
+  spill_sync(s);
+  fclose(s->write_fh);
+  s->write_fh = NULL;
+} /* }}} void spill_close_write */
+
+void spill_destroy(spill_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  spill_close_write(s);
+  if (s->read_fh != NULL)
+    fclose(s->read_fh);
+
+  pthread_mutex_destroy(&s->lock);
+  sfree(s->buffer);
+  sfree(s->dir);
+  sfree(s);
+} /* }}} void spill_destroy */
+
+static size_t spill_encode(uint8_t *buffer, /* {{{ */
+                           value_list_t const *vl) {
+  char const *strings[] = {vl->host, vl->plugin, vl->plugin_instance, vl->type,
+                           vl->type_instance};
+  uint32_t magic = SPILL_MAGIC;
+  uint64_t time = (uint64_t)vl->time;
+  uint64_t interval = (uint64_t)vl->interval;
+  uint16_t values_len = (uint16_t)vl->values_len;
+  size_t pos = 4 + 4;
+
+  memcpy(buffer, &magic, sizeof(magic));
+  memcpy(buffer + pos, &time, sizeof(time));
+  pos += sizeof(time);
+  memcpy(buffer + pos, &interval, sizeof(interval));
+  pos += sizeof(interval);
+  memcpy(buffer + pos, &values_len, sizeof(values_len));
+  pos += sizeof(values_len);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(strings); i++) {
+    size_t len = strnlen(strings[i], DATA_MAX_NAME_LEN - 1);
+    buffer[pos] = (uint8_t)len;
+    memcpy(buffer + pos + 1, strings[i], len);
+    pos += 1 + len;
+  }
+
+  memcpy(buffer + pos, vl->values, vl->values_len * sizeof(*vl->values));
+  pos += vl->values_len * sizeof(*vl->values);
+
+  uint32_t size = (uint32_t)pos;
+  memcpy(buffer + 4, &size, sizeof(size));
+  return pos;
+} /* }}} size_t spill_encode */
+
+int spill_append(spill_t *s, value_list_t const *vl) /* {{{ */
+{
+  if ((s == NULL) || (vl == NULL) || (vl->values_len == 0) ||
+      (vl->values_len > UINT16_MAX))
+    return EINVAL;
+
+  pthread_mutex_lock(&s->lock);
+
+  size_t size = spill_encode(s->buffer, vl);
+  if ((s->size + size) > s->size_limit) {
+    pthread_mutex_unlock(&s->lock);
+    return ENOSPC;
+  }
+
+  if (s->write_fh == NULL) {
+    char path[PATH_MAX];
+
+    spill_path(s, s->write_seq, path, sizeof(path));
+    s->write_fh = fopen(path, "a");
+    if (s->write_fh == NULL) {
+      int status = errno;
+      ERROR("spill: Opening \"%s\" failed: %s", path, STRERRNO);
+      pthread_mutex_unlock(&s->lock);
+      return status;
+    }
+    setvbuf(s->write_fh, NULL, _IOFBF, SPILL_FILE_BUFFER);
+    s->write_size = 0;
+    s->last_sync = cdtime();
+  }
+
+  if (fwrite(s->buffer, size, 1, s->write_fh) != 1) {
+    int status = errno;
+    ERROR("spill: Writing to segment %016" PRIx64 " in \"%s\" failed: %s",
+          s->write_seq, s->dir, STRERRNO);
+    pthread_mutex_unlock(&s->lock);
+    return status;
+  }
+  s->write_size += size;
+  s->size += size;
+
+  if (s->write_size >= s->segment_size) {
+    spill_close_write(s);
+    s->write_seq++;
+    s->write_size = 0;
+  } else if ((cdtime() - s->last_sync) >= SPILL_SYNC_INTERVAL) {
+    spill_sync(s);
+  }
+
+  pthread_mutex_unlock(&s->lock);
+  return 0;
+} /* }}} int spill_append */
+
+/* spill_decode parses the record in s->buffer. Returns EINVAL if the record
+ * is corrupt. */
+static int spill_decode(uint8_t const *buffer, size_t size, /* {{{ */
+                        value_list_t *vl) {
+  char *strings[] = {vl->host, vl->plugin, vl->plugin_instance, vl->type,
+                     vl->type_instance};
+  uint64_t time;
+  uint64_t interval;
+  uint16_t values_len;
+  size_t pos = 4 + 4;
+
+  memcpy(&time, buffer + pos, sizeof(time));
+  pos += sizeof(time);
+  memcpy(&interval, buffer + pos, sizeof(interval));
+  pos += sizeof(interval);
+  memcpy(&values_len, buffer + pos, sizeof(values_len));
+  pos += sizeof(values_len);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(strings); i++) {
+    if (pos >= size)
+      return EINVAL;
+    size_t len = buffer[pos];
+    if ((len >= DATA_MAX_NAME_LEN) || ((pos + 1 + len) > size))
+      return EINVAL;
+    memcpy(strings[i], buffer + pos + 1, len);
+    strings[i][len] = 0;
+    pos += 1 + len;
+  }
+
+  if ((values_len == 0) || ((size - pos) != values_len * sizeof(value_t)))
+    return EINVAL;
+
+  vl->values = malloc(values_len * sizeof(*vl->values));
+  if (vl->values == NULL)
+    return ENOMEM;
+  memcpy(vl->values, buffer + pos, values_len * sizeof(*vl->values));
+  vl->values_len = values_len;
+  vl->time = (cdtime_t)time;
+  vl->interval = (cdtime_t)interval;
+  vl->meta = NULL;
+
+  return 0;
+} /* }}} int spill_decode */
+
+/* spill_read_record reads the record at the current read position. Returns
+ * ENOENT at the end of the segment and EINVAL if the record is truncated or
+ * corrupt. */
+static int spill_read_record(spill_t *s, value_list_t *vl) /* {{{ */
+{
+  uint32_t magic;
+  uint32_t size;
+
+  if (fread(s->buffer, 8, 1, s->read_fh) != 1)
+    return feof(s->read_fh) ? ENOENT : EIO;
+
+  memcpy(&magic, s->buffer, sizeof(magic));
+  memcpy(&size, s->buffer + 4, sizeof(size));
+  if ((magic != SPILL_MAGIC) || (size < SPILL_HEADER_SIZE) ||
+      (size > SPILL_RECORD_MAX))
+    return EINVAL;
+
+  if (fread(s->buffer + 8, size - 8, 1, s->read_fh) != 1)
+    return EINVAL;
+
+  int status = spill_decode(s->buffer, size, vl);
+  if (status != 0)
+    return status;
+
+  s->read_pos += size;
+  return 0;
+} /* }}} int spill_read_record */
+
+static void spill_close_read(spill_t *s) /* {{{ */
+{
+  if (s->read_fh == NULL)
+    return;
+
+  fclose(s->read_fh);
+  s->read_fh = NULL;
+} /* }}} void spill_close_read */
+
+int spill_read(spill_t *s, value_list_t **ret, size_t max, /* {{{ */
+               size_t *ret_num) {
+  if ((s == NULL) || (ret == NULL) || (ret_num == NULL))
+    return EINVAL;
+
+  pthread_mutex_lock(&s->lock);
+
+  /* Make all appended value lists visible to the reader. */
+  if (s->write_fh != NULL)
+    fflush(s->write_fh);
+
+  size_t num = 0;
+  int status = 0;
+  while (num < max) {
+    if (s->read_fh == NULL) {
+      char path[PATH_MAX];
+
+      spill_path(s, s->read_seq, path, sizeof(path));
+      s->read_fh = fopen(path, "r");
+      if (s->read_fh == NULL) {
+        if ((errno == ENOENT) && (s->read_seq < s->write_seq)) {
+          s->read_seq++;
+          s->read_pos = 0;
+          continue;
+        }
+        if (errno != ENOENT) {
+          status = errno;
+          ERROR("spill: Opening \"%s\" failed: %s", path, STRERRNO);
+        }
+        break;
+      }
+      if (fseeko(s->read_fh, (off_t)s->read_pos, SEEK_SET) != 0) {
+        status = errno;
+        spill_close_read(s);
+        break;
+      }
+
+      struct stat statbuf;
+      s->read_size = UINT64_MAX;
+      if ((s->read_seq < s->write_seq) &&
+          (fstat(fileno(s->read_fh), &statbuf) == 0))
+        s->read_size = (uint64_t)statbuf.st_size;
+    }
+
+    value_list_t *vl = calloc(1, sizeof(*vl));
+    if (vl == NULL) {
+      status = ENOMEM;
+      break;
+    }
+
+    off_t pos = ftello(s->read_fh);
+    status = spill_read_record(s, vl);
+    if (status == 0) {
+      ret[num] = vl;
+      num++;
+
+      /* Move on at the end of a completed segment right away, so that
+       * spill_commit() can remove it. */
+      if (s->read_pos >= s->read_size) {
+        spill_close_read(s);
+        s->read_seq++;
+        s->read_pos = 0;
+      }
+      continue;
+    }
+    sfree(vl);
+
+    /* The segment being written is only ever read up to its end. */
+    if (s->read_seq == s->write_seq) {
+      clearerr(s->read_fh);
+      fseeko(s->read_fh, pos, SEEK_SET);
+      status = (status == ENOENT) ? 0 : status;
+      break;
+    }
+
+    if (status != ENOENT)
+      WARNING("spill: Segment %016" PRIx64 " in \"%s\" is corrupt after %" PRIu64
+              " bytes. Skipping the rest of it.",
+              s->read_seq, s->dir, s->read_pos);
+    status = 0;
+    spill_close_read(s);
+    s->read_seq++;
+    s->read_pos = 0;
+  }
+
+  pthread_mutex_unlock(&s->lock);
+
+  *ret_num = num;
+  return (num > 0) ? 0 : status;
+} /* }}} int spill_read */
+
+static void spill_unlink(spill_t *s, uint64_t seq) /* {{{ */
+{
+  char path[PATH_MAX];
+  struct stat statbuf;
+
+  spill_path(s, seq, path, sizeof(path));
+  if (stat(path, &statbuf) != 0)
+    return;
+
+  if (unlink(path) != 0) {
+    ERROR("spill: Removing \"%s\" failed: %s", path, STRERRNO);
+    return;
+  }
+
+  uint64_t size = (uint64_t)statbuf.st_size;
+  s->size = (size < s->size) ? (s->size - size) : 0;
+} /* }}} void spill_unlink */
+
+void spill_commit(spill_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  pthread_mutex_lock(&s->lock);
+
+  for (uint64_t seq = s->commit_seq; seq < s->read_seq; seq++)
+    spill_unlink(s, seq);
+  s->commit_seq = s->read_seq;
+  s->commit_pos = s->read_pos;
+
+  /* Start over with a new segment once everything has been consumed, so that
+   * the current segment doesn't stay around until it is full. */
+  if ((s->commit_seq == s->write_seq) && (s->write_size > 0) &&
+      (s->commit_pos == s->write_size)) {
+    spill_close_read(s);
+    if (s->write_fh != NULL) {
+      fclose(s->write_fh);
+      s->write_fh = NULL;
+    }
+    spill_unlink(s, s->write_seq);
+    s->write_seq++;
+    s->write_size = 0;
+    s->read_seq = s->commit_seq = s->write_seq;
+    s->read_pos = s->commit_pos = 0;
+  }
+
+  pthread_mutex_unlock(&s->lock);
+} /* }}} void spill_commit */
+
+void spill_rewind(spill_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  pthread_mutex_lock(&s->lock);
+  spill_close_read(s);
+  s->read_seq = s->commit_seq;
+  s->read_pos = s->commit_pos;
+  pthread_mutex_unlock(&s->lock);
+} /* }}} void spill_rewind */
+
+bool spill_empty(spill_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return true;
+
+  pthread_mutex_lock(&s->lock);
+  bool empty = (s->commit_seq == s->write_seq) &&
+               (s->commit_pos >= s->write_size);
+  pthread_mutex_unlock(&s->lock);
+
+  return empty;
+} /* }}} bool spill_empty */
+
+uint64_t spill_size(spill_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return 0;
+
+  pthread_mutex_lock(&s->lock);
+  uint64_t size = s->size;
+  pthread_mutex_unlock(&s->lock);
+
+  return size;
+} /* }}} uint64_t spill_size */
@@ -0,0 +1,97 @@
+/**
+ * collectd - src/daemon/utils_spill.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#ifndef UTILS_SPILL_H
+#define UTILS_SPILL_H 1
+
+#include "plugin.h"
+
+/*
+ * Disk-backed FIFO of value lists, e.g. for the write queue of a write
+ * plugin that can't keep up.
+ *
+ * Value lists are appended to segment files in a directory. Writes are
+ * buffered and synced with fdatasync(2) at most once per second and whenever
+ * a segment is completed. Value lists are read back in order; a segment file
+ * is removed once all of its value lists have been read and committed.
+ * Segments found in the directory on creation are read first, so value lists
+ * survive a restart. Records are stored in host byte order and meta data is
+ * not stored.
+ *
+ * All functions are thread-safe.
+ */
+struct spill_s;
+typedef struct spill_s spill_t;
+
+/*
+ * spill_create opens the spill in "dir", creating the directory if needed.
+ * The total size of the segment files is limited to "size_limit" bytes.
+ * Returns NULL on failure.
+ */
+spill_t *spill_create(char const *dir, uint64_t size_limit);
+
+/*
+ * spill_destroy syncs and closes all files. Segments with value lists that
+ * have not been committed are kept for the next spill_create().
+ */
+void spill_destroy(spill_t *s);
+
+/*
+ * spill_append appends a copy of "vl". Returns ENOSPC if the size limit has
+ * been reached.
+ */
+int spill_append(spill_t *s, value_list_t const *vl);
+
+/*
+ * spill_read reads up to "max" value lists following the ones returned by
+ * the previous call. The value lists and their values are allocated with
+ * malloc(3); "meta" is always NULL. Returns zero with "*ret_num" set to zero
+ * if there is nothing left to read.
+ */
+int spill_read(spill_t *s, value_list_t **ret, size_t max, size_t *ret_num);
+
+/*
+ * spill_commit marks all value lists returned by spill_read() as done.
+ */
+void spill_commit(spill_t *s);
+
+/*
+ * spill_rewind makes spill_read() return the value lists read since the last
+ * commit again.
+ */
+void spill_rewind(spill_t *s);
+
+/*
+ * spill_empty returns true if all value lists have been committed.
+ */
+bool spill_empty(spill_t *s);
+
+/*
+ * spill_size returns the total size of the segment files in bytes.
+ */
+uint64_t spill_size(spill_t *s);
+
+#endif /* UTILS_SPILL_H */
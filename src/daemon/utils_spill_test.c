@@ -0,0 +1,213 @@
+/**
+ * collectd - src/daemon/utils_spill_test.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils_spill.h"
+
+#define VALUES_NUM 10000
+
+static char test_dir[] = "/tmp/collectd-spill-test-XXXXXX";
+
+static int remove_cb(const char *dirname, const char *filename, /* {{{ */
+                     void *user_data) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", dirname, filename);
+  unlink(path);
+  return 0;
+} /* }}} int remove_cb */
+
+static void test_vl(value_list_t *vl, value_t *v, int i) /* {{{ */
+{
+  *vl = (value_list_t){
+      .values = v,
+      .values_len = 1,
+      .time = TIME_T_TO_CDTIME_T(i),
+      .interval = TIME_T_TO_CDTIME_T(10),
+  };
+  v->gauge = (gauge_t)i;
+  sstrncpy(vl->host, "example.com", sizeof(vl->host));
+  sstrncpy(vl->plugin, "test", sizeof(vl->plugin));
+  snprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "%d", i % 7);
+  sstrncpy(vl->type, "gauge", sizeof(vl->type));
+} /* }}} void test_vl */
+
+static int append_all(spill_t *s, int num) /* {{{ */
+{
+  for (int i = 0; i < num; i++) {
+    value_list_t vl;
+    value_t v;
+    test_vl(&vl, &v, i);
+
+    int status = spill_append(s, &vl);
+    if (status != 0)
+      return status;
+  }
+
+  return 0;
+} /* }}} int append_all */
+
+/* read_all reads and frees up to "max" value lists, checking that they are
+ * numbered from "first". Returns the number of value lists read. */
+static int read_all(spill_t *s, int first, int max) /* {{{ */
+{
+  value_list_t *vls[64];
+  int count = 0;
+
+  while (count < max) {
+    size_t num = 0;
+    size_t want = STATIC_ARRAY_SIZE(vls);
+    if ((size_t)(max - count) < want)
+      want = (size_t)(max - count);
+
+    if (spill_read(s, vls, want, &num) != 0)
+      return -1;
+    if (num == 0)
+      break;
+
+    for (size_t i = 0; i < num; i++) {
+      int want_i = first + count;
+      if ((vls[i]->values_len != 1) ||
+          (vls[i]->values[0].gauge != (gauge_t)want_i) ||
+          (vls[i]->time != TIME_T_TO_CDTIME_T(want_i)) ||
+          (strcmp(vls[i]->host, "example.com") != 0) ||
+          (strcmp(vls[i]->type_instance, "") != 0))
+        count = -1;
+      sfree(vls[i]->values);
+      sfree(vls[i]);
+      if (count < 0)
+        return -1;
+      count++;
+    }
+  }
+
+  return count;
+} /* }}} int read_all */
+
+DEF_TEST(fifo) {
+  spill_t *s = spill_create(test_dir, 1024 * 1024);
+  CHECK_NOT_NULL(s);
+  OK(spill_empty(s));
+
+  EXPECT_EQ_INT(0, append_all(s, VALUES_NUM));
+  OK(!spill_empty(s));
+  OK(spill_size(s) > 0);
+
+  /* Rewinding returns the same value lists again. */
+  EXPECT_EQ_INT(100, read_all(s, 0, 100));
+  spill_rewind(s);
+  EXPECT_EQ_INT(100, read_all(s, 0, 100));
+  spill_commit(s);
+
+  EXPECT_EQ_INT(VALUES_NUM - 100, read_all(s, 100, VALUES_NUM));
+  OK(!spill_empty(s));
+  spill_commit(s);
+  OK(spill_empty(s));
+  EXPECT_EQ_UINT64(0, spill_size(s));
+
+  spill_destroy(s);
+  return 0;
+}
+
+DEF_TEST(limit) {
+  spill_t *s = spill_create(test_dir, 65536);
+  CHECK_NOT_NULL(s);
+
+  int status = 0;
+  int num = 0;
+  while (status == 0) {
+    value_list_t vl;
+    value_t v;
+    test_vl(&vl, &v, num);
+    status = spill_append(s, &vl);
+    if (status == 0)
+      num++;
+  }
+  EXPECT_EQ_INT(ENOSPC, status);
+  OK(num > 0);
+  OK(spill_size(s) <= 65536);
+
+  EXPECT_EQ_INT(num, read_all(s, 0, num + 1));
+  spill_commit(s);
+  OK(spill_empty(s));
+
+  spill_destroy(s);
+  return 0;
+}
+
+DEF_TEST(restart) {
+  spill_t *s = spill_create(test_dir, 1024 * 1024);
+  CHECK_NOT_NULL(s);
+
+  EXPECT_EQ_INT(0, append_all(s, VALUES_NUM));
+  EXPECT_EQ_INT(500, read_all(s, 0, 500));
+  spill_commit(s);
+  EXPECT_EQ_INT(500, read_all(s, 500, 500));
+  spill_destroy(s);
+
+  /* Value lists that haven't been committed are read again after a restart.
+   * Value lists in the segment the commit pointed into are read again, too,
+   * so everything from the start of that segment comes back. */
+  s = spill_create(test_dir, 1024 * 1024);
+  CHECK_NOT_NULL(s);
+  OK(!spill_empty(s));
+
+  value_list_t *vl = NULL;
+  size_t num = 0;
+  EXPECT_EQ_INT(0, spill_read(s, &vl, 1, &num));
+  EXPECT_EQ_INT(1, (int)num);
+  int first = (int)CDTIME_T_TO_TIME_T(vl->time);
+  OK(first <= 500);
+  sfree(vl->values);
+  sfree(vl);
+  spill_rewind(s);
+
+  EXPECT_EQ_INT(VALUES_NUM - first, read_all(s, first, VALUES_NUM));
+  spill_commit(s);
+  OK(spill_empty(s));
+  EXPECT_EQ_UINT64(0, spill_size(s));
+
+  spill_destroy(s);
+  return 0;
+}
+
+int main(void) {
+  if (mkdtemp(test_dir) == NULL) {
+    fprintf(stderr, "mkdtemp failed: %s\n", STRERRNO);
+    return 1;
+  }
+
+  RUN_TEST(fifo);
+  RUN_TEST(limit);
+  RUN_TEST(restart);
+
+  walk_directory(test_dir, remove_cb, NULL, /* hidden = */ 1);
+  rmdir(test_dir);
+
+  END_TEST;
+}
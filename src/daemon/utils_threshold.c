@@ -28,6 +28,7 @@
 
 #include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils_cache.h"
 #include "utils_threshold.h"
 
 #include <pthread.h>
@@ -37,6 +38,7 @@
  * {{{ */
 c_avl_tree_t *threshold_tree = NULL;
 pthread_mutex_t threshold_lock = PTHREAD_MUTEX_INITIALIZER;
+uint64_t threshold_generation = 1;
 /* }}} */
 
 /*
@@ -64,14 +66,14 @@ threshold_t *threshold_get(const char *hostname, const char *plugin,
 } /* }}} threshold_t *threshold_get */
 
 /*
- * threshold_t *threshold_search
+ * threshold_t *threshold_search_uncached
  *
  * Searches for a threshold configuration using all the possible variations of
  * "Host", "Plugin" and "Type" blocks. Returns NULL if no threshold could be
  * found.
  * XXX: This is likely the least efficient function in collectd.
  */
-threshold_t *threshold_search(const value_list_t *vl) { /* {{{ */
+threshold_t *threshold_search_uncached(const value_list_t *vl) { /* {{{ */
   threshold_t *th;
 
   if ((th = threshold_get(vl->host, vl->plugin, vl->plugin_instance, vl->type,
@@ -109,6 +111,26 @@ threshold_t *threshold_search(const value_list_t *vl) { /* {{{ */
     return th;
 
   return NULL;
+} /* }}} threshold_t *threshold_search_uncached */
+
+/*
+ * threshold_t *threshold_search
+ *
+ * Like "threshold_search_uncached", but remembers the result, including "no
+ * threshold", in the value cache entry of "vl". The remembered result is used
+ * until "threshold_generation" changes. Values that are not in the cache, e.g.
+ * because they have not been dispatched yet, are always searched for.
+ */
+threshold_t *threshold_search(const value_list_t *vl) { /* {{{ */
+  uint64_t generation = threshold_generation;
+  threshold_t *th = NULL;
+
+  if (uc_get_threshold(vl, generation, &th) == 0)
+    return th;
+
+  th = threshold_search_uncached(vl);
+  uc_set_threshold(vl, generation, th);
+  return th;
 } /* }}} threshold_t *threshold_search */
 
 int ut_search_threshold(const value_list_t *vl, /* {{{ */
@@ -51,11 +51,18 @@ typedef struct threshold_s {
 
 extern c_avl_tree_t *threshold_tree;
 extern pthread_mutex_t threshold_lock;
+/* Incremented, while holding "threshold_lock", whenever thresholds are added
+ * to "threshold_tree". Invalidates the results remembered by
+ * "threshold_search". */
+extern uint64_t threshold_generation;
 
 threshold_t *threshold_get(const char *hostname, const char *plugin,
                            const char *plugin_instance, const char *type,
                            const char *type_instance);
 
+/* Searches the thresholds matching "vl" without looking at the value cache,
+ * for callers that already have the memoized result, see uc_snapshot(). */
+threshold_t *threshold_search_uncached(const value_list_t *vl);
 threshold_t *threshold_search(const value_list_t *vl);
 
 int ut_search_threshold(const value_list_t *vl, threshold_t *ret_threshold);
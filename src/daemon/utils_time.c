@@ -38,6 +38,8 @@
 cdtime_t cdtime_mock = (cdtime_t)MOCK_TIME;
 
 cdtime_t cdtime(void) { return cdtime_mock; }
+
+cdtime_t cdtime_coarse(void) { return cdtime_mock; }
 #else /* !MOCK_TIME */
 #if HAVE_CLOCK_GETTIME
 cdtime_t cdtime(void) /* {{{ */
@@ -69,6 +71,20 @@ cdtime_t cdtime(void) /* {{{ */
   return TIMEVAL_TO_CDTIME_T(&tv);
 } /* }}} cdtime_t cdtime */
 #endif
+
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_REALTIME_COARSE)
+cdtime_t cdtime_coarse(void) /* {{{ */
+{
+  struct timespec ts = {0, 0};
+
+  if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) != 0)
+    return cdtime();
+
+  return TIMESPEC_TO_CDTIME_T(&ts);
+} /* }}} cdtime_t cdtime_coarse */
+#else
+cdtime_t cdtime_coarse(void) { return cdtime(); }
+#endif
 #endif
 
 /**********************************************************************
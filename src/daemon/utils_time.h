@@ -110,6 +110,12 @@ extern cdtime_t cdtime_mock;
 
 cdtime_t cdtime(void);
 
+/* cdtime_coarse returns the current time like cdtime(), but with the
+ * resolution of the kernel's timer tick, i.e. a few milliseconds. Where
+ * available, it uses CLOCK_REALTIME_COARSE, which is considerably cheaper to
+ * read. Use it for bookkeeping such as timeouts, not for the time of values. */
+cdtime_t cdtime_coarse(void);
+
 #define RFC3339_SIZE 26     /* 2006-01-02T15:04:05+00:00 */
 #define RFC3339NANO_SIZE 36 /* 2006-01-02T15:04:05.999999999+00:00 */
 
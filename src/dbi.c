@@ -114,42 +114,23 @@ static const char *cdbi_strerror(dbi_conn conn, /* {{{ */
   return buffer;
 } /* }}} const char *cdbi_conn_error */
 
-static int cdbi_result_get_field(dbi_result res, /* {{{ */
-                                 unsigned int index, char *buffer,
-                                 size_t buffer_size) {
+/* cdbi_result_check_field checks whether the field type is supported. */
+static int cdbi_result_check_field(dbi_result res, /* {{{ */
+                                   unsigned int index,
+                                   unsigned short *ret_type) {
   unsigned short src_type;
 
   src_type = dbi_result_get_field_type_idx(res, index);
   if (src_type == DBI_TYPE_ERROR) {
-    ERROR("dbi plugin: cdbi_result_get: "
+    ERROR("dbi plugin: cdbi_result_check_field: "
           "dbi_result_get_field_type_idx failed.");
     return -1;
   }
 
-  if (src_type == DBI_TYPE_INTEGER) {
-    long long value;
-
-    value = dbi_result_get_longlong_idx(res, index);
-    snprintf(buffer, buffer_size, "%lli", value);
-  } else if (src_type == DBI_TYPE_DECIMAL) {
-    double value;
-
-    value = dbi_result_get_double_idx(res, index);
-    snprintf(buffer, buffer_size, "%63.15g", value);
-  } else if (src_type == DBI_TYPE_STRING) {
-    const char *value;
-
-    value = dbi_result_get_string_idx(res, index);
-    if (value == NULL)
-      sstrncpy(buffer, "", buffer_size);
-    else if (strcmp("ERROR", value) == 0)
-      return -1;
-    else
-      sstrncpy(buffer, value, buffer_size);
-  }
   /* DBI_TYPE_BINARY */
   /* DBI_TYPE_DATETIME */
-  else {
+  if ((src_type != DBI_TYPE_INTEGER) && (src_type != DBI_TYPE_DECIMAL) &&
+      (src_type != DBI_TYPE_STRING)) {
     const char *field_name;
 
     field_name = dbi_result_get_field_name(res, index);
@@ -162,6 +143,35 @@ static int cdbi_result_get_field(dbi_result res, /* {{{ */
     return -1;
   }
 
+  *ret_type = src_type;
+  return 0;
+} /* }}} int cdbi_result_check_field */
+
+/* cdbi_result_get_field returns the field of the current row. Numbers are
+ * passed on as such; strings point into the result and are valid until the
+ * next row is fetched. */
+static int cdbi_result_get_field(dbi_result res, /* {{{ */
+                                 unsigned int index, unsigned short src_type,
+                                 udb_column_t *ret) {
+  if (src_type == DBI_TYPE_INTEGER) {
+    ret->type = UDB_COLUMN_INT64;
+    ret->value.integer = (int64_t)dbi_result_get_longlong_idx(res, index);
+  } else if (src_type == DBI_TYPE_DECIMAL) {
+    ret->type = UDB_COLUMN_DOUBLE;
+    ret->value.number = dbi_result_get_double_idx(res, index);
+  } else /* if (src_type == DBI_TYPE_STRING) */ {
+    const char *value;
+
+    value = dbi_result_get_string_idx(res, index);
+    if (value == NULL)
+      value = "";
+    else if (strcmp("ERROR", value) == 0)
+      return -1;
+
+    ret->type = UDB_COLUMN_STRING;
+    ret->value.string = value;
+  }
+
   return 0;
 } /* }}} int cdbi_result_get_field */
 
@@ -447,7 +457,8 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
   dbi_result res;
   size_t column_num;
   char **column_names;
-  char **column_values;
+  unsigned short *column_types;
+  udb_column_t *columns;
   int status;
 
 /* Macro that cleans up dynamically allocated memory and returns the
@@ -457,10 +468,8 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
     sfree(column_names[0]);                                                    \
     sfree(column_names);                                                       \
   }                                                                            \
-  if (column_values != NULL) {                                                 \
-    sfree(column_values[0]);                                                   \
-    sfree(column_values);                                                      \
-  }                                                                            \
+  sfree(column_types);                                                         \
+  sfree(columns);                                                              \
   if (res != NULL) {                                                           \
     dbi_result_free(res);                                                      \
     res = NULL;                                                                \
@@ -468,7 +477,8 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
   return (status)
 
   column_names = NULL;
-  column_values = NULL;
+  column_types = NULL;
+  columns = NULL;
 
   statement = udb_query_get_statement(q);
   assert(statement != NULL);
@@ -500,7 +510,7 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
           db->name, udb_query_get_name(q), column_num);
   }
 
-  /* Allocate `column_names' and `column_values'. {{{ */
+  /* Allocate `column_names', `column_types' and `columns'. {{{ */
   column_names = calloc(column_num, sizeof(*column_names));
   if (column_names == NULL) {
     ERROR("dbi plugin: calloc failed.");
@@ -515,22 +525,16 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
   for (size_t i = 1; i < column_num; i++)
     column_names[i] = column_names[i - 1] + DATA_MAX_NAME_LEN;
 
-  column_values = calloc(column_num, sizeof(*column_values));
-  if (column_values == NULL) {
-    ERROR("dbi plugin: calloc failed.");
-    BAIL_OUT(-1);
-  }
-
-  column_values[0] = calloc(column_num, DATA_MAX_NAME_LEN);
-  if (column_values[0] == NULL) {
+  column_types = calloc(column_num, sizeof(*column_types));
+  columns = calloc(column_num, sizeof(*columns));
+  if ((column_types == NULL) || (columns == NULL)) {
     ERROR("dbi plugin: calloc failed.");
     BAIL_OUT(-1);
   }
-  for (size_t i = 1; i < column_num; i++)
-    column_values[i] = column_values[i - 1] + DATA_MAX_NAME_LEN;
   /* }}} */
 
-  /* Copy the field names to `column_names' */
+  /* Copy the field names to `column_names' and look up the field types,
+   * which are the same for all rows. */
   for (size_t i = 0; i < column_num; i++) /* {{{ */
   {
     const char *column_name;
@@ -544,6 +548,14 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
     }
 
     sstrncpy(column_names[i], column_name, DATA_MAX_NAME_LEN);
+
+    if (cdbi_result_check_field(res, (unsigned int)(i + 1),
+                                &column_types[i]) != 0) {
+      ERROR("dbi plugin: cdbi_read_database_query (%s, %s): "
+            "cdbi_result_check_field (%" PRIsz ") failed.",
+            db->name, udb_query_get_name(q), i + 1);
+      BAIL_OUT(-1);
+    }
   } /* }}} for (i = 0; i < column_num; i++) */
 
   status = udb_query_prepare_result(
@@ -570,16 +582,16 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
     BAIL_OUT(-1);
   } /* }}} */
 
-  /* Iterate over all rows and call `udb_query_handle_result' with each list of
-   * values. */
+  /* Iterate over all rows and call `udb_query_handle_result_columns' with
+   * each list of values. */
   while (42) /* {{{ */
   {
     status = 0;
-    /* Copy the value of the columns to `column_values' */
+    /* Get the value of the columns */
     for (size_t i = 0; i < column_num; i++) /* {{{ */
     {
       status = cdbi_result_get_field(res, (unsigned int)(i + 1),
-                                     column_values[i], DATA_MAX_NAME_LEN);
+                                     column_types[i], columns + i);
 
       if (status != 0) {
         ERROR("dbi plugin: cdbi_read_database_query (%s, %s): "
@@ -590,11 +602,12 @@ static int cdbi_read_database_query(cdbi_database_t *db, /* {{{ */
       }
     } /* }}} for (i = 0; i < column_num; i++) */
 
-    /* If all values were copied successfully, call `udb_query_handle_result'
+    /* If all values were read successfully, call
+     * `udb_query_handle_result_columns'
      * to dispatch the row to the daemon. */
     if (status == 0) /* {{{ */
     {
-      status = udb_query_handle_result(q, prep_area, column_values);
+      status = udb_query_handle_result_columns(q, prep_area, columns);
       if (status != 0) {
         ERROR("dbi plugin: cdbi_read_database_query (%s, %s): "
               "udb_query_handle_result failed.",
@@ -28,6 +28,11 @@
 #include "utils/ignorelist/ignorelist.h"
 #include "utils/mount/mount.h"
 
+#include <pthread.h>
+#if KERNEL_LINUX
+#include <poll.h>
+#endif
+
 #if HAVE_STATVFS
 #if HAVE_SYS_STATVFS_H
 #include <sys/statvfs.h>
@@ -46,10 +51,17 @@
 #error "No applicable input method."
 #endif
 
+#if HAVE_STATVFS
+typedef struct statvfs df_statbuf_t;
+#elif HAVE_STATFS
+typedef struct statfs df_statbuf_t;
+#endif
+
 static const char *config_keys[] = {
     "Device",         "MountPoint",       "FSType",
     "IgnoreSelected", "ReportByDevice",   "ReportInodes",
-    "ValuesAbsolute", "ValuesPercentage", "LogOnce"};
+    "ValuesAbsolute", "ValuesPercentage", "LogOnce",
+    "Threads",        "Timeout"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static ignorelist_t *il_device;
@@ -62,6 +74,51 @@ static bool report_inodes;
 static bool values_absolute = true;
 static bool values_percentage;
 static bool log_once;
+static int threads_num = 4;
+static cdtime_t stat_timeout;
+
+/* A mount point selected for collection. The list of selected mount points
+ * is cached and only rebuilt when the mount table changes, so that the
+ * ignorelists are matched once per mount point. The STATANYFS() calls are
+ * made by worker threads, so that a hanging file system (e.g. NFS) does not
+ * block the read callback. All members are protected by df_lock. */
+typedef struct df_mount_s {
+  char *dir;
+  char disk_name[256];
+
+  /* A worker is calling STATANYFS() for this mount point. */
+  bool busy;
+  /* The entry has been removed from the list while it was busy. The worker
+   * frees it. */
+  bool removed;
+  /* Result of the last STATANYFS() call of the current round. */
+  bool done;
+  uint64_t round;
+  int status;
+  int error;
+  df_statbuf_t statbuf;
+
+  struct df_mount_s *next;
+  struct df_mount_s *queue_next;
+} df_mount_t;
+
+static pthread_mutex_t df_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t df_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t df_done_cond = PTHREAD_COND_INITIALIZER;
+static df_mount_t *df_mounts;
+static bool df_mounts_valid;
+static df_mount_t *df_queue_head;
+static df_mount_t *df_queue_tail;
+static uint64_t df_round;
+static size_t df_pending;
+static bool df_threads_running;
+static bool df_shutdown_requested;
+
+#if KERNEL_LINUX
+/* The kernel signals POLLPRI | POLLERR on this file when the mount table of
+ * the namespace changes. */
+static int mountinfo_fd = -1;
+#endif
 
 static int df_init(void) {
   if (il_device == NULL)
@@ -73,6 +130,11 @@ static int df_init(void) {
   if (il_errors == NULL)
     il_errors = ignorelist_create(1);
 
+#if KERNEL_LINUX
+  if (mountinfo_fd < 0)
+    mountinfo_fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+#endif
+
   return 0;
 }
 
@@ -135,6 +197,22 @@ static int df_config(const char *key, const char *value) {
       log_once = false;
 
     return 0;
+  } else if (strcasecmp(key, "Threads") == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("df plugin: Threads must be at least 1.");
+      return 1;
+    }
+    threads_num = tmp;
+    return 0;
+  } else if (strcasecmp(key, "Timeout") == 0) {
+    double tmp = atof(value);
+    if (tmp <= 0.0) {
+      ERROR("df plugin: Timeout must be greater than zero.");
+      return 1;
+    }
+    stat_timeout = DOUBLE_TO_CDTIME_T(tmp);
+    return 0;
   }
 
   return -1;
@@ -158,30 +236,162 @@ __attribute__((nonnull(2))) static void df_submit_one(char *plugin_instance,
   plugin_dispatch_values(&vl);
 } /* void df_submit_one */
 
-static int df_read(void) {
+/* Dispatches the metrics of one file system. */
+static int df_submit_statbuf(char *disk_name, df_statbuf_t *statbuf) {
+  unsigned long long blocksize;
+  uint64_t blk_free;
+  uint64_t blk_reserved;
+  uint64_t blk_used;
+
+  blocksize = BLOCKSIZE(*statbuf);
+
+/*
+ * Sanity-check for the values in the struct
+ */
+/* Check for negative "available" byes. For example UFS can
+ * report negative free space for user. Notice. blk_reserved
+ * will start to diminish after this. */
 #if HAVE_STATVFS
-  struct statvfs statbuf;
+  /* Cast and temporary variable are needed to avoid
+   * compiler warnings.
+   * ((struct statvfs).f_bavail is unsigned (POSIX)) */
+  int64_t signed_bavail = (int64_t)statbuf->f_bavail;
+  if (signed_bavail < 0)
+    statbuf->f_bavail = 0;
 #elif HAVE_STATFS
-  struct statfs statbuf;
+  if (statbuf->f_bavail < 0)
+    statbuf->f_bavail = 0;
 #endif
-  int retval = 0;
-  /* struct STATANYFS statbuf; */
-  cu_mount_t *mnt_list;
+  /* Make sure that f_blocks >= f_bfree >= f_bavail */
+  if (statbuf->f_bfree < statbuf->f_bavail)
+    statbuf->f_bfree = statbuf->f_bavail;
+  if (statbuf->f_blocks < statbuf->f_bfree)
+    statbuf->f_blocks = statbuf->f_bfree;
+
+  blk_free = (uint64_t)statbuf->f_bavail;
+  blk_reserved = (uint64_t)(statbuf->f_bfree - statbuf->f_bavail);
+  blk_used = (uint64_t)(statbuf->f_blocks - statbuf->f_bfree);
+
+  if (values_absolute) {
+    df_submit_one(disk_name, "df_complex", "free",
+                  (gauge_t)(blk_free * blocksize));
+    df_submit_one(disk_name, "df_complex", "reserved",
+                  (gauge_t)(blk_reserved * blocksize));
+    df_submit_one(disk_name, "df_complex", "used",
+                  (gauge_t)(blk_used * blocksize));
+  }
+
+  if (values_percentage) {
+    if (statbuf->f_blocks > 0) {
+      df_submit_one(disk_name, "percent_bytes", "free",
+                    (gauge_t)((float_t)(blk_free) / statbuf->f_blocks * 100));
+      df_submit_one(
+          disk_name, "percent_bytes", "reserved",
+          (gauge_t)((float_t)(blk_reserved) / statbuf->f_blocks * 100));
+      df_submit_one(disk_name, "percent_bytes", "used",
+                    (gauge_t)((float_t)(blk_used) / statbuf->f_blocks * 100));
+    } else {
+      return -1;
+    }
+  }
+
+  /* inode handling */
+  if (report_inodes && statbuf->f_files != 0 && statbuf->f_ffree != 0) {
+    uint64_t inode_free;
+    uint64_t inode_reserved;
+    uint64_t inode_used;
+
+    /* Sanity-check for the values in the struct */
+    if (statbuf->f_ffree < statbuf->f_favail)
+      statbuf->f_ffree = statbuf->f_favail;
+    if (statbuf->f_files < statbuf->f_ffree)
+      statbuf->f_files = statbuf->f_ffree;
+
+    inode_free = (uint64_t)statbuf->f_favail;
+    inode_reserved = (uint64_t)(statbuf->f_ffree - statbuf->f_favail);
+    inode_used = (uint64_t)(statbuf->f_files - statbuf->f_ffree);
+
+    if (values_percentage) {
+      if (statbuf->f_files > 0) {
+        df_submit_one(
+            disk_name, "percent_inodes", "free",
+            (gauge_t)((float_t)(inode_free) / statbuf->f_files * 100));
+        df_submit_one(
+            disk_name, "percent_inodes", "reserved",
+            (gauge_t)((float_t)(inode_reserved) / statbuf->f_files * 100));
+        df_submit_one(
+            disk_name, "percent_inodes", "used",
+            (gauge_t)((float_t)(inode_used) / statbuf->f_files * 100));
+      } else {
+        return -1;
+      }
+    }
+    if (values_absolute) {
+      df_submit_one(disk_name, "df_inodes", "free", (gauge_t)inode_free);
+      df_submit_one(disk_name, "df_inodes", "reserved",
+                    (gauge_t)inode_reserved);
+      df_submit_one(disk_name, "df_inodes", "used", (gauge_t)inode_used);
+    }
+  }
+
+  return 0;
+} /* int df_submit_statbuf */
+
+/* Frees an entry, or leaves it to the worker if it is busy. Called with
+ * df_lock held. */
+static void df_mount_release(df_mount_t *m) {
+  if (m->busy) {
+    m->removed = true;
+    return;
+  }
+  sfree(m->dir);
+  sfree(m);
+}
+
+static void df_mounts_release(void) {
+  df_mount_t *m = df_mounts;
+  while (m != NULL) {
+    df_mount_t *next = m->next;
+    df_mount_release(m);
+    m = next;
+  }
+  df_mounts = NULL;
+  df_mounts_valid = false;
+}
+
+/* Returns true if the mount table may have changed since the last call. */
+static bool df_mounts_changed(void) {
+#if KERNEL_LINUX
+  if (mountinfo_fd < 0)
+    return true;
+
+  struct pollfd pfd = {.fd = mountinfo_fd, .events = POLLPRI};
+  int status = poll(&pfd, 1, /* timeout = */ 0);
+  if (status < 0)
+    return true;
+  return (status > 0) && ((pfd.revents & (POLLPRI | POLLERR)) != 0);
+#else
+  return true;
+#endif
+}
+
+/* Reads the mount table and rebuilds the list of selected mount points.
+ * Called with df_lock held. */
+static int df_mounts_update(void) {
+  cu_mount_t *mnt_list = NULL;
 
-  mnt_list = NULL;
   if (cu_mount_getlist(&mnt_list) == NULL) {
     ERROR("df plugin: cu_mount_getlist failed.");
     return -1;
   }
 
+  df_mounts_release();
+  df_mount_t **tail = &df_mounts;
+
   for (cu_mount_t *mnt_ptr = mnt_list; mnt_ptr != NULL;
        mnt_ptr = mnt_ptr->next) {
-    unsigned long long blocksize;
     char disk_name[256];
     cu_mount_t *dup_ptr;
-    uint64_t blk_free;
-    uint64_t blk_reserved;
-    uint64_t blk_used;
 
     char const *dev =
         (mnt_ptr->spec_device != NULL) ? mnt_ptr->spec_device : mnt_ptr->device;
@@ -214,23 +424,6 @@ static int df_read(void) {
     if (dup_ptr != NULL)
       continue;
 
-    if (STATANYFS(mnt_ptr->dir, &statbuf) < 0) {
-      if (log_once == false || ignorelist_match(il_errors, mnt_ptr->dir) == 0) {
-        if (log_once == true) {
-          ignorelist_add(il_errors, mnt_ptr->dir);
-        }
-        ERROR(STATANYFS_STR "(%s) failed: %s", mnt_ptr->dir, STRERRNO);
-      }
-      continue;
-    } else {
-      if (log_once == true) {
-        ignorelist_remove(il_errors, mnt_ptr->dir);
-      }
-    }
-
-    if (!statbuf.f_blocks)
-      continue;
-
     if (by_device) {
       /* eg, /dev/hda1  -- strip off the "/dev/" */
       if (strncmp(dev, "/dev/", strlen("/dev/")) == 0)
@@ -255,107 +448,206 @@ static int df_read(void) {
       }
     }
 
-    blocksize = BLOCKSIZE(statbuf);
+    df_mount_t *m = calloc(1, sizeof(*m));
+    if (m == NULL) {
+      ERROR("df plugin: calloc failed.");
+      continue;
+    }
+    m->dir = strdup(mnt_ptr->dir);
+    if (m->dir == NULL) {
+      ERROR("df plugin: strdup failed.");
+      sfree(m);
+      continue;
+    }
+    sstrncpy(m->disk_name, disk_name, sizeof(m->disk_name));
+
+    *tail = m;
+    tail = &m->next;
+  }
 
-/*
- * Sanity-check for the values in the struct
- */
-/* Check for negative "available" byes. For example UFS can
- * report negative free space for user. Notice. blk_reserved
- * will start to diminish after this. */
-#if HAVE_STATVFS
-    /* Cast and temporary variable are needed to avoid
-     * compiler warnings.
-     * ((struct statvfs).f_bavail is unsigned (POSIX)) */
-    int64_t signed_bavail = (int64_t)statbuf.f_bavail;
-    if (signed_bavail < 0)
-      statbuf.f_bavail = 0;
-#elif HAVE_STATFS
-    if (statbuf.f_bavail < 0)
-      statbuf.f_bavail = 0;
-#endif
-    /* Make sure that f_blocks >= f_bfree >= f_bavail */
-    if (statbuf.f_bfree < statbuf.f_bavail)
-      statbuf.f_bfree = statbuf.f_bavail;
-    if (statbuf.f_blocks < statbuf.f_bfree)
-      statbuf.f_blocks = statbuf.f_bfree;
+  cu_mount_freelist(mnt_list);
+  df_mounts_valid = true;
+  return 0;
+} /* int df_mounts_update */
 
-    blk_free = (uint64_t)statbuf.f_bavail;
-    blk_reserved = (uint64_t)(statbuf.f_bfree - statbuf.f_bavail);
-    blk_used = (uint64_t)(statbuf.f_blocks - statbuf.f_bfree);
+static void *df_worker(__attribute__((unused)) void *arg) {
+  pthread_mutex_lock(&df_lock);
+  while (!df_shutdown_requested) {
+    if (df_queue_head == NULL) {
+      pthread_cond_wait(&df_work_cond, &df_lock);
+      continue;
+    }
 
-    if (values_absolute) {
-      df_submit_one(disk_name, "df_complex", "free",
-                    (gauge_t)(blk_free * blocksize));
-      df_submit_one(disk_name, "df_complex", "reserved",
-                    (gauge_t)(blk_reserved * blocksize));
-      df_submit_one(disk_name, "df_complex", "used",
-                    (gauge_t)(blk_used * blocksize));
+    df_mount_t *m = df_queue_head;
+    df_queue_head = m->queue_next;
+    if (df_queue_head == NULL)
+      df_queue_tail = NULL;
+    m->queue_next = NULL;
+    uint64_t round = m->round;
+    pthread_mutex_unlock(&df_lock);
+
+    df_statbuf_t statbuf;
+    int status = STATANYFS(m->dir, &statbuf);
+    int error = errno;
+
+    pthread_mutex_lock(&df_lock);
+    m->busy = false;
+    if (m->removed) {
+      df_mount_release(m);
+      continue;
     }
 
-    if (values_percentage) {
-      if (statbuf.f_blocks > 0) {
-        df_submit_one(disk_name, "percent_bytes", "free",
-                      (gauge_t)((float_t)(blk_free) / statbuf.f_blocks * 100));
-        df_submit_one(
-            disk_name, "percent_bytes", "reserved",
-            (gauge_t)((float_t)(blk_reserved) / statbuf.f_blocks * 100));
-        df_submit_one(disk_name, "percent_bytes", "used",
-                      (gauge_t)((float_t)(blk_used) / statbuf.f_blocks * 100));
-      } else {
-        retval = -1;
-        break;
+    /* Results arriving after the read callback gave up are dropped. */
+    if (round != df_round)
+      continue;
+
+    m->statbuf = statbuf;
+    m->status = status;
+    m->error = error;
+    m->done = true;
+    df_pending--;
+    if (df_pending == 0)
+      pthread_cond_signal(&df_done_cond);
+  }
+  pthread_mutex_unlock(&df_lock);
+
+  return NULL;
+} /* void *df_worker */
+
+static int df_start_threads(void) {
+  for (int i = 0; i < threads_num; i++) {
+    pthread_t tid;
+    int status = plugin_thread_create(&tid, df_worker, /* arg = */ NULL, "df");
+    if (status != 0) {
+      ERROR("df plugin: Starting thread failed: %s", STRERROR(status));
+      if (i == 0)
+        return -1;
+      break;
+    }
+    /* Workers may hang in STATANYFS() forever, so they are never joined. */
+    pthread_detach(tid);
+  }
+
+  df_threads_running = true;
+  return 0;
+}
+
+static int df_read(void) {
+  int retval = 0;
+
+  pthread_mutex_lock(&df_lock);
+
+  if (!df_threads_running && (df_start_threads() != 0)) {
+    pthread_mutex_unlock(&df_lock);
+    return -1;
+  }
+
+  if (!df_mounts_valid || df_mounts_changed()) {
+    if (df_mounts_update() != 0) {
+      pthread_mutex_unlock(&df_lock);
+      return -1;
+    }
+  }
+
+  df_round++;
+  df_pending = 0;
+  for (df_mount_t *m = df_mounts; m != NULL; m = m->next) {
+    m->done = false;
+
+    /* A previous call is still hanging. */
+    if (m->busy) {
+      DEBUG("df plugin: " STATANYFS_STR "(%s) is still pending.", m->dir);
+      continue;
+    }
+
+    m->busy = true;
+    m->round = df_round;
+    if (df_queue_tail == NULL)
+      df_queue_head = m;
+    else
+      df_queue_tail->queue_next = m;
+    df_queue_tail = m;
+    df_pending++;
+  }
+  pthread_cond_broadcast(&df_work_cond);
+
+  cdtime_t timeout = (stat_timeout != 0) ? stat_timeout : plugin_get_interval();
+  struct timespec deadline = CDTIME_T_TO_TIMESPEC(cdtime() + timeout);
+  while (df_pending > 0) {
+    if (pthread_cond_timedwait(&df_done_cond, &df_lock, &deadline) ==
+        ETIMEDOUT)
+      break;
+  }
+
+  /* Mount points that did not answer in time are skipped; their workers
+   * keep waiting in the background and they are not queried again until
+   * the call returns. */
+  for (df_mount_t *m = df_mounts; m != NULL; m = m->next) {
+    if (m->busy && (m->round == df_round)) {
+      if (log_once == false || ignorelist_match(il_errors, m->dir) == 0) {
+        if (log_once == true) {
+          ignorelist_add(il_errors, m->dir);
+        }
+        ERROR(STATANYFS_STR "(%s) timed out.", m->dir);
       }
+      continue;
     }
+    if (!m->done)
+      continue;
 
-    /* inode handling */
-    if (report_inodes && statbuf.f_files != 0 && statbuf.f_ffree != 0) {
-      uint64_t inode_free;
-      uint64_t inode_reserved;
-      uint64_t inode_used;
-
-      /* Sanity-check for the values in the struct */
-      if (statbuf.f_ffree < statbuf.f_favail)
-        statbuf.f_ffree = statbuf.f_favail;
-      if (statbuf.f_files < statbuf.f_ffree)
-        statbuf.f_files = statbuf.f_ffree;
-
-      inode_free = (uint64_t)statbuf.f_favail;
-      inode_reserved = (uint64_t)(statbuf.f_ffree - statbuf.f_favail);
-      inode_used = (uint64_t)(statbuf.f_files - statbuf.f_ffree);
-
-      if (values_percentage) {
-        if (statbuf.f_files > 0) {
-          df_submit_one(
-              disk_name, "percent_inodes", "free",
-              (gauge_t)((float_t)(inode_free) / statbuf.f_files * 100));
-          df_submit_one(
-              disk_name, "percent_inodes", "reserved",
-              (gauge_t)((float_t)(inode_reserved) / statbuf.f_files * 100));
-          df_submit_one(
-              disk_name, "percent_inodes", "used",
-              (gauge_t)((float_t)(inode_used) / statbuf.f_files * 100));
-        } else {
-          retval = -1;
-          break;
+    if (m->status < 0) {
+      if (log_once == false || ignorelist_match(il_errors, m->dir) == 0) {
+        if (log_once == true) {
+          ignorelist_add(il_errors, m->dir);
         }
+        ERROR(STATANYFS_STR "(%s) failed: %s", m->dir, STRERROR(m->error));
       }
-      if (values_absolute) {
-        df_submit_one(disk_name, "df_inodes", "free", (gauge_t)inode_free);
-        df_submit_one(disk_name, "df_inodes", "reserved",
-                      (gauge_t)inode_reserved);
-        df_submit_one(disk_name, "df_inodes", "used", (gauge_t)inode_used);
+      continue;
+    } else {
+      if (log_once == true) {
+        ignorelist_remove(il_errors, m->dir);
       }
     }
+
+    if (!m->statbuf.f_blocks)
+      continue;
+
+    if (df_submit_statbuf(m->disk_name, &m->statbuf) != 0) {
+      retval = -1;
+      break;
+    }
   }
 
-  cu_mount_freelist(mnt_list);
+  pthread_mutex_unlock(&df_lock);
 
   return retval;
 } /* int df_read */
 
+static int df_shutdown(void) {
+  pthread_mutex_lock(&df_lock);
+  df_shutdown_requested = true;
+  pthread_cond_broadcast(&df_work_cond);
+
+  /* Queued entries will not be picked up by a worker anymore. */
+  for (df_mount_t *m = df_queue_head; m != NULL; m = m->queue_next)
+    m->busy = false;
+  df_queue_head = df_queue_tail = NULL;
+  df_mounts_release();
+  pthread_mutex_unlock(&df_lock);
+
+#if KERNEL_LINUX
+  if (mountinfo_fd >= 0) {
+    close(mountinfo_fd);
+    mountinfo_fd = -1;
+  }
+#endif
+
+  return 0;
+} /* int df_shutdown */
+
 void module_register(void) {
   plugin_register_config("df", df_config, config_keys, config_keys_num);
   plugin_register_init("df", df_init);
   plugin_register_read("df", df_read);
+  plugin_register_shutdown("df", df_shutdown);
 } /* void module_register */
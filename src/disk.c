@@ -54,6 +54,9 @@
 #if HAVE_IOKIT_IOBSD_H
 #include <IOKit/IOBSD.h>
 #endif
+#if KERNEL_LINUX
+#include <sys/sysmacros.h>
+#endif
 #if KERNEL_FREEBSD
 #include <devstat.h>
 #include <libgeom.h>
@@ -89,6 +92,14 @@ static bool use_bsd_name;
 #elif KERNEL_LINUX
 typedef struct diskstats {
   char *name;
+  unsigned int major;
+  unsigned int minor;
+
+  /* Name used as plugin instance and whether the disk is ignored. Both are
+   * determined once and only updated when udev reports a change. */
+  char *alt_name;
+  bool ignored;
+  bool name_valid;
 
   /* This overflows in roughly 1361 years */
   unsigned int poll_count;
@@ -117,6 +128,11 @@ typedef struct diskstats {
 } diskstats_t;
 
 static diskstats_t *disklist;
+static proc_file_t *proc_diskstats;
+
+/* Number of values following the device name in /proc/diskstats that are
+ * used by this plugin. */
+#define DISKSTATS_VALUES_NUM 11
 /* #endif KERNEL_LINUX */
 #elif KERNEL_FREEBSD
 static struct gmesh geom_tree;
@@ -160,6 +176,9 @@ static size_t ndrive = 0;
 
 static char *conf_udev_name_attr;
 static struct udev *handle_udev;
+#if KERNEL_LINUX
+static struct udev_monitor *udev_monitor;
+#endif
 #endif
 
 static const char *config_keys[] = {"Disk", "UseBSDName", "IgnoreSelected",
@@ -232,6 +251,20 @@ static int disk_init(void) {
       ERROR("disk plugin: udev_new() failed!");
       return -1;
     }
+
+    /* Names are looked up once per disk and refreshed when udev reports a
+     * change, rather than queried for every disk in every read. */
+    udev_monitor = udev_monitor_new_from_netlink(handle_udev, "udev");
+    if ((udev_monitor == NULL) ||
+        (udev_monitor_filter_add_match_subsystem_devtype(udev_monitor, "block",
+                                                         NULL) < 0) ||
+        (udev_monitor_enable_receiving(udev_monitor) < 0)) {
+      WARNING("disk plugin: Receiving udev events failed. Names set with "
+              "\"UdevNameAttr\" will not be updated when they change.");
+      if (udev_monitor != NULL)
+        udev_monitor_unref(udev_monitor);
+      udev_monitor = NULL;
+    }
   }
 #endif /* HAVE_LIBUDEV_H */
   /* #endif KERNEL_LINUX */
@@ -301,9 +334,15 @@ static int disk_init(void) {
 static int disk_shutdown(void) {
 #if KERNEL_LINUX
 #if HAVE_LIBUDEV_H
+  if (udev_monitor != NULL)
+    udev_monitor_unref(udev_monitor);
+  udev_monitor = NULL;
   if (handle_udev != NULL)
     udev_unref(handle_udev);
+  handle_udev = NULL;
 #endif /* HAVE_LIBUDEV_H */
+  proc_file_destroy(proc_diskstats);
+  proc_diskstats = NULL;
 #endif /* KERNEL_LINUX */
   return 0;
 } /* int disk_shutdown */
@@ -399,12 +438,12 @@ static counter_t disk_calc_time_incr(counter_t delta_time,
  */
 
 static char *disk_udev_attr_name(struct udev *udev, char *disk_name,
-                                 const char *attr) {
+                                 dev_t devnum, const char *attr) {
   struct udev_device *dev;
   const char *prop;
   char *output = NULL;
 
-  dev = udev_device_new_from_subsystem_sysname(udev, "block", disk_name);
+  dev = udev_device_new_from_devnum(udev, 'b', devnum);
   if (dev != NULL) {
     prop = udev_device_get_property_value(dev, attr);
     if (prop) {
@@ -417,6 +456,115 @@ static char *disk_udev_attr_name(struct udev *udev, char *disk_name,
 }
 #endif
 
+#if KERNEL_LINUX
+/* disk_scan_uint parses an unsigned decimal number followed by white space or
+ * the end of the line, and advances "*ptr" past it. */
+static int disk_scan_uint(char **ptr, uint64_t *ret) {
+  char *p = *ptr;
+  uint64_t v = 0;
+
+  while ((*p == ' ') || (*p == '\t'))
+    p++;
+  if ((*p < '0') || (*p > '9'))
+    return -1;
+  while ((*p >= '0') && (*p <= '9')) {
+    v = 10 * v + (uint64_t)(*p - '0');
+    p++;
+  }
+  if ((*p != ' ') && (*p != '\t') && (*p != 0))
+    return -1;
+
+  *ptr = p;
+  *ret = v;
+  return 0;
+} /* int disk_scan_uint */
+
+/* disk_parse_line splits a line of /proc/diskstats, i.e. "major minor name"
+ * followed by the statistics, without the generic strsplit(). The name is
+ * terminated in place and the first DISKSTATS_VALUES_NUM statistics are
+ * stored in "values". Returns the number of fields on the line, including the
+ * three leading ones, or -1 if the line is malformed. */
+static int disk_parse_line(char *line, unsigned int *ret_major,
+                           unsigned int *ret_minor, char **ret_name,
+                           uint64_t values[DISKSTATS_VALUES_NUM]) {
+  uint64_t major, minor;
+  char *p = line;
+
+  if ((disk_scan_uint(&p, &major) != 0) || (disk_scan_uint(&p, &minor) != 0))
+    return -1;
+
+  while ((*p == ' ') || (*p == '\t'))
+    p++;
+  if (*p == 0)
+    return -1;
+  *ret_name = p;
+  while ((*p != ' ') && (*p != '\t') && (*p != 0))
+    p++;
+  if (*p != 0) {
+    *p = 0;
+    p++;
+  }
+
+  int fields_num = 3;
+  uint64_t v;
+  while (disk_scan_uint(&p, &v) == 0) {
+    if (fields_num - 3 < DISKSTATS_VALUES_NUM)
+      values[fields_num - 3] = v;
+    fields_num++;
+  }
+
+  *ret_major = (unsigned int)major;
+  *ret_minor = (unsigned int)minor;
+  return fields_num;
+} /* int disk_parse_line */
+
+#if HAVE_LIBUDEV_H
+/* disk_udev_process_events invalidates the cached names of all disks udev
+ * reported a change for since the last read. */
+static void disk_udev_process_events(void) {
+  struct udev_device *dev;
+
+  if (udev_monitor == NULL)
+    return;
+
+  /* The monitor's socket is non-blocking, so this returns NULL once all
+   * pending events have been received. */
+  while ((dev = udev_monitor_receive_device(udev_monitor)) != NULL) {
+    dev_t devnum = udev_device_get_devnum(dev);
+
+    for (diskstats_t *ds = disklist; ds != NULL; ds = ds->next) {
+      if ((ds->major == major(devnum)) && (ds->minor == minor(devnum))) {
+        DEBUG("disk plugin: udev reported \"%s\" for %s.",
+              udev_device_get_action(dev), ds->name);
+        ds->name_valid = false;
+      }
+    }
+
+    udev_device_unref(dev);
+  }
+} /* void disk_udev_process_events */
+#endif /* HAVE_LIBUDEV_H */
+
+/* disk_resolve_name determines the name a disk is reported as and whether it
+ * is ignored, unless both are already known. */
+static void disk_resolve_name(diskstats_t *ds) {
+  if (ds->name_valid)
+    return;
+
+  sfree(ds->alt_name);
+#if HAVE_LIBUDEV_H
+  if (conf_udev_name_attr != NULL)
+    ds->alt_name =
+        disk_udev_attr_name(handle_udev, ds->name,
+                            makedev(ds->major, ds->minor), conf_udev_name_attr);
+#endif
+
+  char *output_name = (ds->alt_name != NULL) ? ds->alt_name : ds->name;
+  ds->ignored = (ignorelist_match(ignorelist, output_name) != 0);
+  ds->name_valid = true;
+} /* void disk_resolve_name */
+#endif /* KERNEL_LINUX */
+
 #if HAVE_IOKIT_IOKITLIB_H
 static signed long long dict_get_value(CFDictionaryRef dict, const char *key) {
   signed long long val_int;
@@ -721,10 +869,9 @@ static int disk_read(void) {
   geom_stats_snapshot_free(snap);
 
 #elif KERNEL_LINUX
-  FILE *fh;
-  char buffer[1024];
+  char *buffer;
 
-  char *fields[32];
+  uint64_t values[DISKSTATS_VALUES_NUM];
   static unsigned int poll_count = 0;
 
   derive_t read_sectors = 0;
@@ -743,26 +890,43 @@ static int disk_read(void) {
   int is_disk = 0;
 
   diskstats_t *ds, *pre_ds;
+  diskstats_t *prev_line_ds = NULL;
 
-  if ((fh = fopen("/proc/diskstats", "r")) == NULL) {
-    ERROR("disk plugin: fopen(\"/proc/diskstats\"): %s", STRERRNO);
-    return -1;
+  if (proc_diskstats == NULL) {
+    proc_diskstats = proc_file_create("/proc/diskstats");
+    if (proc_diskstats == NULL) {
+      ERROR("disk plugin: proc_file_create failed.");
+      return -1;
+    }
   }
 
+  if (proc_file_read(proc_diskstats, NULL) == NULL)
+    return -1;
+
+#if HAVE_LIBUDEV_H
+  disk_udev_process_events();
+#endif
+
   poll_count++;
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    int numfields = strsplit(buffer, fields, 32);
+  while ((buffer = proc_file_next_line(proc_diskstats)) != NULL) {
+    unsigned int major_num, minor_num;
+    char *disk_name;
+
+    int numfields =
+        disk_parse_line(buffer, &major_num, &minor_num, &disk_name, values);
 
     /* need either 7 fields (partition) or at least 14 fields */
     if ((numfields != 7) && (numfields < 14))
       continue;
 
-    char *disk_name = fields[2];
-
-    for (ds = disklist, pre_ds = disklist; ds != NULL;
-         pre_ds = ds, ds = ds->next)
-      if (strcmp(disk_name, ds->name) == 0)
-        break;
+    /* The lines are in the same order on every read, so the disk following
+     * the previous line's one is almost always the one we're looking for. */
+    ds = (prev_line_ds == NULL) ? disklist : prev_line_ds->next;
+    if ((ds == NULL) || (strcmp(disk_name, ds->name) != 0)) {
+      for (ds = disklist; ds != NULL; ds = ds->next)
+        if (strcmp(disk_name, ds->name) == 0)
+          break;
+    }
 
     if (ds == NULL) {
       if ((ds = calloc(1, sizeof(*ds))) == NULL)
@@ -773,37 +937,49 @@ static int disk_read(void) {
         continue;
       }
 
-      if (pre_ds == NULL)
+      /* Insert after the previous line's disk to keep the list in the same
+       * order as the file. */
+      if (prev_line_ds == NULL) {
+        ds->next = disklist;
         disklist = ds;
-      else
-        pre_ds->next = ds;
+      } else {
+        ds->next = prev_line_ds->next;
+        prev_line_ds->next = ds;
+      }
+    }
+    prev_line_ds = ds;
+
+    if ((ds->major != major_num) || (ds->minor != minor_num)) {
+      ds->major = major_num;
+      ds->minor = minor_num;
+      ds->name_valid = false;
     }
 
     is_disk = 0;
     if (numfields == 7) {
       /* Kernel 2.6, Partition */
-      read_ops = atoll(fields[3]);
-      read_sectors = atoll(fields[4]);
-      write_ops = atoll(fields[5]);
-      write_sectors = atoll(fields[6]);
+      read_ops = (derive_t)values[0];
+      read_sectors = (derive_t)values[1];
+      write_ops = (derive_t)values[2];
+      write_sectors = (derive_t)values[3];
     } else {
       assert(numfields >= 14);
-      read_ops = atoll(fields[3]);
-      write_ops = atoll(fields[7]);
+      read_ops = (derive_t)values[0];
+      write_ops = (derive_t)values[4];
 
-      read_sectors = atoll(fields[5]);
-      write_sectors = atoll(fields[9]);
+      read_sectors = (derive_t)values[2];
+      write_sectors = (derive_t)values[6];
 
       is_disk = 1;
-      read_merged = atoll(fields[4]);
-      read_time = atoll(fields[6]);
-      write_merged = atoll(fields[8]);
-      write_time = atoll(fields[10]);
+      read_merged = (derive_t)values[1];
+      read_time = (derive_t)values[3];
+      write_merged = (derive_t)values[5];
+      write_time = (derive_t)values[7];
 
-      in_progress = atof(fields[11]);
+      in_progress = (gauge_t)values[8];
 
-      io_time = atof(fields[12]);
-      weighted_time = atof(fields[13]);
+      io_time = (derive_t)values[9];
+      weighted_time = (derive_t)values[10];
     }
 
     {
@@ -898,25 +1074,11 @@ static int disk_read(void) {
       continue;
     }
 
-    char *output_name = disk_name;
-
-#if HAVE_LIBUDEV_H
-    char *alt_name = NULL;
-    if (conf_udev_name_attr != NULL) {
-      alt_name =
-          disk_udev_attr_name(handle_udev, disk_name, conf_udev_name_attr);
-      if (alt_name != NULL)
-        output_name = alt_name;
-    }
-#endif
-
-    if (ignorelist_match(ignorelist, output_name) != 0) {
-#if HAVE_LIBUDEV_H
-      /* release udev-based alternate name, if allocated */
-      sfree(alt_name);
-#endif
+    disk_resolve_name(ds);
+    if (ds->ignored)
       continue;
-    }
+
+    char *output_name = (ds->alt_name != NULL) ? ds->alt_name : ds->name;
 
     if ((ds->read_bytes != 0) || (ds->write_bytes != 0))
       disk_submit(output_name, "disk_octets", ds->read_bytes, ds->write_bytes);
@@ -938,12 +1100,7 @@ static int disk_read(void) {
 
       submit_utilization(output_name, diff_io_time);
     } /* if (is_disk) */
-
-#if HAVE_LIBUDEV_H
-    /* release udev-based alternate name, if allocated */
-    sfree(alt_name);
-#endif
-  } /* while (fgets (buffer, sizeof (buffer), fh) != NULL) */
+  } /* while (proc_file_next_line (proc_diskstats) != NULL) */
 
   /* Remove disks that have disappeared from diskstats */
   for (ds = disklist, pre_ds = disklist; ds != NULL;) {
@@ -965,9 +1122,9 @@ static int disk_read(void) {
 
     DEBUG("disk plugin: Disk %s disappeared.", missing_ds->name);
     free(missing_ds->name);
+    free(missing_ds->alt_name);
     free(missing_ds);
   }
-  fclose(fh);
   /* #endif defined(KERNEL_LINUX) */
 
 #elif HAVE_LIBKSTAT
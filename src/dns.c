@@ -38,93 +38,61 @@
 #include <sys/capability.h>
 #endif
 
+#if KERNEL_LINUX
+#include <linux/if_packet.h>
+#endif
+
 /*
  * Private data types
  */
-struct counter_list_s {
-  unsigned int key;
-  unsigned int value;
-  struct counter_list_s *next;
-};
-typedef struct counter_list_s counter_list_t;
+#define DNS_OPCODE_NUM 16 /* 4 bit field */
+#define DNS_RCODE_NUM 16  /* 4 bit field */
+
+/* Counters of one capture thread. Only the owning thread writes them, so
+ * packets are counted without any locking. dns_read() sums the counters of
+ * all threads using relaxed atomic loads. */
+typedef struct {
+  derive_t tr_queries;
+  derive_t tr_responses;
+  derive_t qtype[T_MAX];
+  derive_t opcode[DNS_OPCODE_NUM];
+  derive_t rcode[DNS_RCODE_NUM];
+} dns_counters_t;
+
+typedef struct {
+  pthread_t thread;
+  dns_counters_t *counters;
+} dns_capture_thread_t;
 
 /*
  * Private variables
  */
 static const char *config_keys[] = {"Interface", "IgnoreSource",
-                                    "SelectNumericQueryTypes"};
+                                    "SelectNumericQueryTypes",
+                                    "CaptureThreads"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 static int select_numeric_qtype = 1;
 
 #define PCAP_SNAPLEN 1460
 static char *pcap_device;
 
-static derive_t tr_queries;
-static derive_t tr_responses;
-static counter_list_t *qtype_list;
-static counter_list_t *opcode_list;
-static counter_list_t *rcode_list;
+static size_t capture_threads_num = 1;
+static dns_capture_thread_t *capture_threads;
 
-static pthread_t listen_thread;
-static int listen_thread_init;
-/* The `traffic' mutex if for `tr_queries' and `tr_responses' */
-static pthread_mutex_t traffic_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t qtype_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t opcode_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t rcode_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Points to the dns_counters_t of the calling capture thread. */
+static pthread_key_t counters_key;
 
 /*
  * Private functions
  */
-static counter_list_t *counter_list_search(counter_list_t **list,
-                                           unsigned int key) {
-  counter_list_t *entry;
-
-  for (entry = *list; entry != NULL; entry = entry->next)
-    if (entry->key == key)
-      break;
-
-  return entry;
+static inline void dns_counter_add(derive_t *counter, derive_t value) {
+  /* Single writer: a relaxed load/store pair is sufficient. */
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value,
+                   __ATOMIC_RELAXED);
 }
 
-static counter_list_t *counter_list_create(counter_list_t **list,
-                                           unsigned int key,
-                                           unsigned int value) {
-  counter_list_t *entry;
-
-  entry = calloc(1, sizeof(*entry));
-  if (entry == NULL)
-    return NULL;
-
-  entry->key = key;
-  entry->value = value;
-
-  if (*list == NULL) {
-    *list = entry;
-  } else {
-    counter_list_t *last;
-
-    last = *list;
-    while (last->next != NULL)
-      last = last->next;
-
-    last->next = entry;
-  }
-
-  return entry;
-}
-
-static void counter_list_add(counter_list_t **list, unsigned int key,
-                             unsigned int increment) {
-  counter_list_t *entry;
-
-  entry = counter_list_search(list, key);
-
-  if (entry != NULL) {
-    entry->value += increment;
-  } else {
-    counter_list_create(list, key, increment);
-  }
+static inline derive_t dns_counter_get(derive_t *counter) {
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
 }
 
 static int dns_config(const char *key, const char *value) {
@@ -141,6 +109,13 @@ static int dns_config(const char *key, const char *value) {
       select_numeric_qtype = 0;
     else
       select_numeric_qtype = 1;
+  } else if (strcasecmp(key, "CaptureThreads") == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("dns plugin: CaptureThreads must be at least 1.");
+      return 1;
+    }
+    capture_threads_num = (size_t)tmp;
   } else {
     return -1;
   }
@@ -149,44 +124,80 @@ static int dns_config(const char *key, const char *value) {
 }
 
 static void dns_child_callback(const rfc1035_header_t *dns) {
-  if (dns->qr == 0) {
-    /* This is a query */
-    int skip = 0;
-    if (!select_numeric_qtype) {
-      const char *str = qtype_str(dns->qtype);
-      if ((str == NULL) || (str[0] == '#'))
-        skip = 1;
-    }
+  dns_counters_t *c = pthread_getspecific(counters_key);
+  if (c == NULL)
+    return;
 
-    pthread_mutex_lock(&traffic_mutex);
-    tr_queries += dns->length;
-    pthread_mutex_unlock(&traffic_mutex);
-
-    if (skip == 0) {
-      pthread_mutex_lock(&qtype_mutex);
-      counter_list_add(&qtype_list, dns->qtype, 1);
-      pthread_mutex_unlock(&qtype_mutex);
-    }
+  if (dns->qr == 0) {
+    /* This is a query. Non-numeric query types are filtered in dns_read(). */
+    dns_counter_add(&c->tr_queries, dns->length);
+    dns_counter_add(&c->qtype[dns->qtype], 1);
   } else {
     /* This is a reply */
-    pthread_mutex_lock(&traffic_mutex);
-    tr_responses += dns->length;
-    pthread_mutex_unlock(&traffic_mutex);
-
-    pthread_mutex_lock(&rcode_mutex);
-    counter_list_add(&rcode_list, dns->rcode, 1);
-    pthread_mutex_unlock(&rcode_mutex);
+    dns_counter_add(&c->tr_responses, dns->length);
+    dns_counter_add(&c->rcode[dns->rcode], 1);
   }
 
   /* FIXME: Are queries, replies or both interesting? */
-  pthread_mutex_lock(&opcode_mutex);
-  counter_list_add(&opcode_list, dns->opcode, 1);
-  pthread_mutex_unlock(&opcode_mutex);
+  dns_counter_add(&c->opcode[dns->opcode], 1);
 }
 
+/* Opens a capture handle. libpcap uses TPACKET_V3 ring buffers where the
+ * kernel supports them. */
+static pcap_t *dns_open_pcap(void) {
+  const char *device = (pcap_device != NULL) ? pcap_device : "any";
+  char pcap_error[PCAP_ERRBUF_SIZE];
+
+  pcap_t *p = pcap_create(device, pcap_error);
+  if (p == NULL) {
+    ERROR("dns plugin: Opening interface `%s' failed: %s", device, pcap_error);
+    return NULL;
+  }
+
+  pcap_set_snaplen(p, PCAP_SNAPLEN);
+  pcap_set_promisc(p, 0 /* Not promiscuous */);
+  pcap_set_timeout(p, (int)CDTIME_T_TO_MS(plugin_get_interval() / 2));
+
+  int status = pcap_activate(p);
+  if (status < 0) {
+    ERROR("dns plugin: Opening interface `%s' failed: %s", device,
+          pcap_geterr(p));
+    pcap_close(p);
+    return NULL;
+  } else if (status > 0) {
+    WARNING("dns plugin: Opening interface `%s': %s", device,
+            pcap_statustostr(status));
+  }
+
+  return p;
+} /* pcap_t *dns_open_pcap */
+
+/* Adds the handle to a PACKET_FANOUT group shared by all capture threads, so
+ * that the kernel distributes packets between them by flow hash. */
+static int dns_join_fanout(pcap_t *p) {
+#if defined(PACKET_FANOUT) && defined(PACKET_FANOUT_HASH)
+  if (capture_threads_num < 2)
+    return 0;
+
+  int fanout = (int)(getpid() & 0xffff) | (PACKET_FANOUT_HASH << 16);
+  if (setsockopt(pcap_fileno(p), SOL_PACKET, PACKET_FANOUT, &fanout,
+                 sizeof(fanout)) != 0) {
+    ERROR("dns plugin: Joining the PACKET_FANOUT group failed: %s", STRERRNO);
+    return -1;
+  }
+  return 0;
+#else
+  if (capture_threads_num > 1) {
+    ERROR("dns plugin: CaptureThreads > 1 requires PACKET_FANOUT, which is not "
+          "available on this system.");
+    return -1;
+  }
+  return 0;
+#endif
+} /* int dns_join_fanout */
+
 static int dns_run_pcap_loop(void) {
   pcap_t *pcap_obj;
-  char pcap_error[PCAP_ERRBUF_SIZE];
   struct bpf_program fp = {0};
 
   int status;
@@ -200,36 +211,36 @@ static int dns_run_pcap_loop(void) {
 
   /* Passing `pcap_device == NULL' is okay and the same as passign "any" */
   DEBUG("dns plugin: Creating PCAP object..");
-  pcap_obj = pcap_open_live((pcap_device != NULL) ? pcap_device : "any",
-                            PCAP_SNAPLEN, 0 /* Not promiscuous */,
-                            (int)CDTIME_T_TO_MS(plugin_get_interval() / 2),
-                            pcap_error);
-  if (pcap_obj == NULL) {
-    ERROR("dns plugin: Opening interface `%s' "
-          "failed: %s",
-          (pcap_device != NULL) ? pcap_device : "any", pcap_error);
+  pcap_obj = dns_open_pcap();
+  if (pcap_obj == NULL)
     return PCAP_ERROR;
-  }
 
   status = pcap_compile(pcap_obj, &fp, "udp port 53", 1, 0);
   if (status < 0) {
     ERROR("dns plugin: pcap_compile failed: %s", pcap_statustostr(status));
+    pcap_close(pcap_obj);
     return status;
   }
 
   status = pcap_setfilter(pcap_obj, &fp);
+  pcap_freecode(&fp);
   if (status < 0) {
     ERROR("dns plugin: pcap_setfilter failed: %s", pcap_statustostr(status));
+    pcap_close(pcap_obj);
     return status;
   }
 
-  DEBUG("dns plugin: PCAP object created.");
+  if (dns_join_fanout(pcap_obj) != 0) {
+    pcap_close(pcap_obj);
+    return PCAP_ERROR;
+  }
 
-  dnstop_set_pcap_obj(pcap_obj);
-  dnstop_set_callback(dns_child_callback);
+  DEBUG("dns plugin: PCAP object created.");
 
+  /* The handle is passed as user data, so that each capture thread uses its
+   * own. */
   status = pcap_loop(pcap_obj, -1 /* loop forever */,
-                     handle_pcap /* callback */, NULL /* user data */);
+                     handle_pcap /* callback */, (u_char *)pcap_obj);
   INFO("dns plugin: pcap_loop exited with status %i.", status);
   /* We need to handle "PCAP_ERROR" specially because libpcap currently
    * doesn't return PCAP_ERROR_IFACE_NOT_UP for compatibility reasons. */
@@ -253,10 +264,13 @@ static int dns_sleep_one_interval(void) /* {{{ */
   return 0;
 } /* }}} int dns_sleep_one_interval */
 
-static void *dns_child_loop(__attribute__((unused)) void *dummy) /* {{{ */
+static void *dns_child_loop(void *arg) /* {{{ */
 {
+  dns_capture_thread_t *t = arg;
   int status;
 
+  pthread_setspecific(counters_key, t->counters);
+
   while (42) {
     status = dns_run_pcap_loop();
     if (status != PCAP_ERROR_IFACE_NOT_UP)
@@ -268,30 +282,43 @@ static void *dns_child_loop(__attribute__((unused)) void *dummy) /* {{{ */
   if (status != PCAP_ERROR_BREAK)
     ERROR("dns plugin: PCAP returned error %s.", pcap_statustostr(status));
 
-  listen_thread_init = 0;
   return NULL;
 } /* }}} void *dns_child_loop */
 
 static int dns_init(void) {
-  /* clean up an old thread */
-  int status;
-
-  pthread_mutex_lock(&traffic_mutex);
-  tr_queries = 0;
-  tr_responses = 0;
-  pthread_mutex_unlock(&traffic_mutex);
-
-  if (listen_thread_init != 0)
+  /* Counters are kept when the plugin is re-initialized. */
+  if (capture_threads != NULL)
     return -1;
 
-  status = plugin_thread_create(&listen_thread, dns_child_loop, (void *)0,
-                                "dns listen");
+  int status = pthread_key_create(&counters_key, /* destructor = */ NULL);
   if (status != 0) {
-    ERROR("dns plugin: pthread_create failed: %s", STRERRNO);
+    ERROR("dns plugin: pthread_key_create failed: %s", STRERROR(status));
+    return -1;
+  }
+
+  capture_threads = calloc(capture_threads_num, sizeof(*capture_threads));
+  if (capture_threads == NULL) {
+    ERROR("dns plugin: calloc failed.");
     return -1;
   }
 
-  listen_thread_init = 1;
+  dnstop_set_callback(dns_child_callback);
+
+  for (size_t i = 0; i < capture_threads_num; i++) {
+    dns_capture_thread_t *t = capture_threads + i;
+
+    t->counters = calloc(1, sizeof(*t->counters));
+    if (t->counters == NULL) {
+      ERROR("dns plugin: calloc failed.");
+      return -1;
+    }
+
+    status = plugin_thread_create(&t->thread, dns_child_loop, t, "dns listen");
+    if (status != 0) {
+      ERROR("dns plugin: pthread_create failed: %s", STRERRNO);
+      return -1;
+    }
+  }
 
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_NET_RAW)
   if (check_capability(CAP_NET_RAW) != 0) {
@@ -338,59 +365,62 @@ static void submit_octets(derive_t queries, derive_t responses) {
 } /* void submit_octets */
 
 static int dns_read(void) {
-  unsigned int keys[T_MAX];
-  unsigned int values[T_MAX];
-  int len;
+  dns_counters_t *sum = calloc(1, sizeof(*sum));
+  if (sum == NULL) {
+    ERROR("dns plugin: calloc failed.");
+    return -1;
+  }
 
-  counter_list_t *ptr;
+  for (size_t i = 0; i < capture_threads_num; i++) {
+    dns_counters_t *c = capture_threads[i].counters;
+    if (c == NULL)
+      continue;
 
-  pthread_mutex_lock(&traffic_mutex);
-  values[0] = tr_queries;
-  values[1] = tr_responses;
-  pthread_mutex_unlock(&traffic_mutex);
+    sum->tr_queries += dns_counter_get(&c->tr_queries);
+    sum->tr_responses += dns_counter_get(&c->tr_responses);
+    for (size_t j = 0; j < T_MAX; j++)
+      sum->qtype[j] += dns_counter_get(&c->qtype[j]);
+    for (size_t j = 0; j < DNS_OPCODE_NUM; j++)
+      sum->opcode[j] += dns_counter_get(&c->opcode[j]);
+    for (size_t j = 0; j < DNS_RCODE_NUM; j++)
+      sum->rcode[j] += dns_counter_get(&c->rcode[j]);
+  }
 
-  if ((values[0] != 0) || (values[1] != 0))
-    submit_octets(values[0], values[1]);
+  if ((sum->tr_queries != 0) || (sum->tr_responses != 0))
+    submit_octets(sum->tr_queries, sum->tr_responses);
 
-  pthread_mutex_lock(&qtype_mutex);
-  for (ptr = qtype_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
-  }
-  pthread_mutex_unlock(&qtype_mutex);
+  /* Like before, only types that have been seen at least once are
+   * dispatched. */
+  for (int i = 0; i < T_MAX; i++) {
+    if (sum->qtype[i] == 0)
+      continue;
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: qtype = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_qtype", qtype_str(keys[i]), values[i]);
-  }
+    const char *str = qtype_str(i);
+    if (!select_numeric_qtype && ((str == NULL) || (str[0] == '#')))
+      continue;
 
-  pthread_mutex_lock(&opcode_mutex);
-  for (ptr = opcode_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
+    DEBUG("dns plugin: qtype = %d; counter = %" PRIi64 ";", i, sum->qtype[i]);
+    submit_derive("dns_qtype", str, sum->qtype[i]);
   }
-  pthread_mutex_unlock(&opcode_mutex);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: opcode = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_opcode", opcode_str(keys[i]), values[i]);
-  }
+  for (int i = 0; i < DNS_OPCODE_NUM; i++) {
+    if (sum->opcode[i] == 0)
+      continue;
 
-  pthread_mutex_lock(&rcode_mutex);
-  for (ptr = rcode_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
+    DEBUG("dns plugin: opcode = %d; counter = %" PRIi64 ";", i,
+          sum->opcode[i]);
+    submit_derive("dns_opcode", opcode_str(i), sum->opcode[i]);
   }
-  pthread_mutex_unlock(&rcode_mutex);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: rcode = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_rcode", rcode_str(keys[i]), values[i]);
+  for (int i = 0; i < DNS_RCODE_NUM; i++) {
+    if (sum->rcode[i] == 0)
+      continue;
+
+    DEBUG("dns plugin: rcode = %d; counter = %" PRIi64 ";", i, sum->rcode[i]);
+    submit_derive("dns_rcode", rcode_str(i), sum->rcode[i]);
   }
 
+  sfree(sum);
   return 0;
 } /* int dns_read */
 
@@ -52,6 +52,7 @@ struct dpdk_stats_config_s {
 typedef struct dpdk_stats_config_s dpdk_stats_config_t;
 
 #define RTE_VERSION_16_07 RTE_VERSION_NUM(16, 7, 0, 16)
+#define RTE_VERSION_17_08 RTE_VERSION_NUM(17, 8, 0, 16)
 
 #if RTE_VERSION < RTE_VERSION_16_07
 #define DPDK_STATS_XSTAT_GET_VALUE(ctx, index) ctx->xstats[index].value
@@ -61,7 +62,7 @@ typedef struct dpdk_stats_config_s dpdk_stats_config_t;
   do {                                                                         \
     ctx->xstats = (struct rte_eth_xstats *)&ctx->raw_data[0];                  \
   } while (0)
-#else
+#elif RTE_VERSION < RTE_VERSION_17_08
 #define DPDK_STATS_XSTAT_GET_VALUE(ctx, index) ctx->xstats[index].value
 #define DPDK_STATS_XSTAT_GET_NAME(ctx, index) ctx->xnames[index].name
 #define DPDK_STATS_CTX_GET_XSTAT_SIZE                                          \
@@ -73,6 +74,19 @@ typedef struct dpdk_stats_config_s dpdk_stats_config_t;
         (struct rte_eth_xstat_name *)&ctx                                      \
             ->raw_data[ctx->stats_count * sizeof(struct rte_eth_xstat)];       \
   } while (0)
+#else
+/* Only the values are fetched on each read, using rte_eth_xstats_get_by_id();
+ * the names are fetched when the set of counters changes. */
+#define DPDK_STATS_XSTAT_GET_VALUE(ctx, index) ctx->values[index]
+#define DPDK_STATS_XSTAT_GET_NAME(ctx, index) ctx->xnames[index].name
+#define DPDK_STATS_CTX_GET_XSTAT_SIZE                                          \
+  (sizeof(uint64_t) + sizeof(struct rte_eth_xstat_name))
+#define DPDK_STATS_CTX_INIT(ctx)                                               \
+  do {                                                                         \
+    ctx->values = (uint64_t *)&ctx->raw_data[0];                               \
+    ctx->xnames = (struct rte_eth_xstat_name *)&ctx                            \
+                      ->raw_data[ctx->stats_count * sizeof(uint64_t)];         \
+  } while (0)
 #endif
 
 struct dpdk_stats_ctx_s {
@@ -81,11 +95,18 @@ struct dpdk_stats_ctx_s {
   uint32_t ports_count;
   cdtime_t port_read_time[RTE_MAX_ETHPORTS];
   uint32_t port_stats_count[RTE_MAX_ETHPORTS];
+  /* Cleared when the number of counters changes. Set again, and
+   * names_generation incremented, once the helper has fetched the names. */
+  bool names_valid;
+  uint32_t names_generation;
 #if RTE_VERSION < RTE_VERSION_16_07
   struct rte_eth_xstats *xstats;
-#else
+#elif RTE_VERSION < RTE_VERSION_17_08
   struct rte_eth_xstat *xstats;
   struct rte_eth_xstat_name *xnames;
+#else
+  uint64_t *values;
+  struct rte_eth_xstat_name *xnames;
 #endif
   char raw_data[];
 };
@@ -102,6 +123,12 @@ dpdk_helper_ctx_t *g_hc = NULL;
 static char g_shm_name[DATA_MAX_NAME_LEN] = DPDK_STATS_NAME;
 static dpdk_stat_cfg_status g_state = DPDK_STAT_STATE_OKAY;
 
+/* Types of the counters, resolved from their names. Only rebuilt when the
+ * helper reports new names. */
+static char (*g_cnt_types)[DATA_MAX_NAME_LEN];
+static uint32_t g_cnt_types_num;
+static uint32_t g_cnt_types_generation;
+
 static int dpdk_stats_reinit_helper();
 static void dpdk_stats_default_config(void) {
   dpdk_stats_ctx_t *ec = DPDK_STATS_CTX_GET(g_hc);
@@ -214,28 +241,41 @@ static int dpdk_helper_stats_get(dpdk_helper_ctx_t *phc) {
     /* Store available stats array length for port */
     len = ctx->port_stats_count[i];
 
+#if RTE_VERSION >= RTE_VERSION_17_08
+    ret = rte_eth_xstats_get_by_id(i, /* ids = */ NULL, &ctx->values[stats],
+                                   len);
+#else
     ret = rte_eth_xstats_get(i, &ctx->xstats[stats], len);
+#endif
     if (ret < 0 || ret > len) {
       DPDK_CHILD_LOG(DPDK_STATS_PLUGIN
                      ": Error reading stats (port=%d; len=%d, ret=%d)\n",
                      i, len, ret);
       ctx->port_stats_count[i] = 0;
+      ctx->names_valid = false;
       return -1;
     }
 #if RTE_VERSION >= RTE_VERSION_16_07
-    ret = rte_eth_xstats_get_names(i, &ctx->xnames[stats], len);
-    if (ret < 0 || ret > len) {
-      DPDK_CHILD_LOG(DPDK_STATS_PLUGIN
-                     ": Error reading stat names (port=%d; len=%d ret=%d)\n",
-                     i, len, ret);
-      ctx->port_stats_count[i] = 0;
-      return -1;
+    if (!ctx->names_valid) {
+      ret = rte_eth_xstats_get_names(i, &ctx->xnames[stats], len);
+      if (ret < 0 || ret > len) {
+        DPDK_CHILD_LOG(DPDK_STATS_PLUGIN
+                       ": Error reading stat names (port=%d; len=%d ret=%d)\n",
+                       i, len, ret);
+        ctx->port_stats_count[i] = 0;
+        return -1;
+      }
     }
 #endif
     ctx->port_stats_count[i] = ret;
     stats += ctx->port_stats_count[i];
   }
 
+  if (!ctx->names_valid) {
+    ctx->names_valid = true;
+    ctx->names_generation++;
+  }
+
   assert(stats <= ctx->stats_count);
   return 0;
 }
@@ -246,6 +286,8 @@ static int dpdk_helper_stats_count_get(dpdk_helper_ctx_t *phc) {
     return -ENODEV;
 
   dpdk_stats_ctx_t *ctx = DPDK_STATS_CTX_GET(phc);
+  if (ctx->ports_count != ports)
+    ctx->names_valid = false;
   ctx->ports_count = ports;
 
   int len = 0;
@@ -262,6 +304,9 @@ static int dpdk_helper_stats_count_get(dpdk_helper_ctx_t *phc) {
       DPDK_CHILD_LOG("%s: Cannot get stats count\n", DPDK_STATS_PLUGIN);
       return -1;
     }
+    /* Cached names are only valid while the counters stay the same. */
+    if (ctx->port_stats_count[i] != (uint32_t)len)
+      ctx->names_valid = false;
     ctx->port_stats_count[i] = len;
     stats_count += len;
   }
@@ -366,6 +411,7 @@ static void dpdk_stats_resolve_cnt_type(char *cnt_type, size_t cnt_type_len,
 }
 
 static void dpdk_stats_counter_submit(const char *plugin_instance,
+                                      const char *cnt_type,
                                       const char *cnt_name, derive_t value,
                                       cdtime_t port_read_time) {
   value_list_t vl = VALUE_LIST_INIT;
@@ -374,11 +420,47 @@ static void dpdk_stats_counter_submit(const char *plugin_instance,
   vl.time = port_read_time;
   sstrncpy(vl.plugin, DPDK_STATS_PLUGIN, sizeof(vl.plugin));
   sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
-  dpdk_stats_resolve_cnt_type(vl.type, sizeof(vl.type), cnt_name);
+  sstrncpy(vl.type, cnt_type, sizeof(vl.type));
   sstrncpy(vl.type_instance, cnt_name, sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 }
 
+/* Resolves the types of all counters. Called when the helper has fetched new
+ * counter names. */
+static int dpdk_stats_cnt_types_update(dpdk_stats_ctx_t *ctx) {
+  if (g_cnt_types_num != ctx->stats_count) {
+    sfree(g_cnt_types);
+    g_cnt_types_num = 0;
+    g_cnt_types = calloc(ctx->stats_count, sizeof(*g_cnt_types));
+    if (g_cnt_types == NULL) {
+      ERROR(DPDK_STATS_PLUGIN ": calloc failed.");
+      return -1;
+    }
+    g_cnt_types_num = ctx->stats_count;
+  }
+
+  int stats_count = 0;
+  for (int i = 0; i < ctx->ports_count; i++) {
+    if (!(ctx->config.enabled_port_mask & (1 << i)))
+      continue;
+
+    for (int j = 0; j < ctx->port_stats_count[i]; j++) {
+      const char *cnt_name = DPDK_STATS_XSTAT_GET_NAME(ctx, stats_count);
+      g_cnt_types[stats_count][0] = 0;
+      if (cnt_name != NULL)
+        dpdk_stats_resolve_cnt_type(g_cnt_types[stats_count],
+                                    sizeof(g_cnt_types[stats_count]),
+                                    cnt_name);
+      stats_count++;
+
+      assert(stats_count <= g_cnt_types_num);
+    }
+  }
+
+  g_cnt_types_generation = ctx->names_generation;
+  return 0;
+}
+
 static int dpdk_stats_counters_dispatch(dpdk_helper_ctx_t *phc) {
   dpdk_stats_ctx_t *ctx = DPDK_STATS_CTX_GET(phc);
 
@@ -387,6 +469,12 @@ static int dpdk_stats_counters_dispatch(dpdk_helper_ctx_t *phc) {
   DEBUG("%s:%s:%d ports=%u", DPDK_STATS_PLUGIN, __FUNCTION__, __LINE__,
         ctx->ports_count);
 
+  if ((g_cnt_types == NULL) || (g_cnt_types_num != ctx->stats_count) ||
+      (g_cnt_types_generation != ctx->names_generation)) {
+    if (dpdk_stats_cnt_types_update(ctx) != 0)
+      return -1;
+  }
+
   int stats_count = 0;
 
   for (int i = 0; i < ctx->ports_count; i++) {
@@ -409,7 +497,7 @@ static int dpdk_stats_counters_dispatch(dpdk_helper_ctx_t *phc) {
         WARNING("dpdkstat: Invalid counter name");
       else
         dpdk_stats_counter_submit(
-            dev_name, cnt_name,
+            dev_name, g_cnt_types[stats_count], cnt_name,
             (derive_t)DPDK_STATS_XSTAT_GET_VALUE(ctx, stats_count),
             ctx->port_read_time[i]);
       stats_count++;
@@ -452,6 +540,8 @@ static int dpdk_stats_reinit_helper() {
 
   ctx = DPDK_STATS_CTX_GET(g_hc);
   memcpy(ctx, &tmp_ctx, sizeof(dpdk_stats_ctx_t));
+  /* The new shared memory does not hold any names yet. */
+  ctx->names_valid = false;
   DPDK_STATS_CTX_INIT(ctx);
   dpdk_helper_eal_config_set(g_hc, &tmp_eal);
 
@@ -494,6 +584,9 @@ static int dpdk_stats_shutdown(void) {
   dpdk_helper_shutdown(g_hc);
   g_hc = NULL;
 
+  sfree(g_cnt_types);
+  g_cnt_types_num = 0;
+
   return 0;
 }
 
@@ -0,0 +1,291 @@
+/**
+ * collectd - src/ebpf.bpf.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, this file may be distributed under the terms of the GNU
+ * General Public License version 2, which is required to load it into the
+ * kernel with the helpers it uses.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+/*
+ * eBPF programs of the "ebpf" plugin. This file is compiled with
+ * "clang -target bpf" against a vmlinux.h generated from the kernel's BTF and
+ * relocated by libbpf when it is loaded (CO-RE), so the same object works on
+ * all kernels with BTF.
+ *
+ * Latencies are aggregated into log2 histograms in the "hists" map, which the
+ * plugin reads and clears once per interval.
+ */
+
+#include "vmlinux.h"
+
+#include <bpf/bpf_core_read.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+
+#include "ebpf.h"
+
+#define TASK_RUNNING 0
+
+char LICENSE[] SEC("license") = "Dual MIT/GPL";
+
+extern int LINUX_KERNEL_VERSION __kconfig;
+
+struct {
+  __uint(type, BPF_MAP_TYPE_ARRAY);
+  __uint(max_entries, 1);
+  __type(key, __u32);
+  __type(value, struct ebpf_config);
+} config SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __uint(max_entries, EBPF_HISTS_MAX);
+  __type(key, struct ebpf_hist_key);
+  __type(value, struct ebpf_hist);
+} hists SEC(".maps");
+
+struct rq_start {
+  __u64 ts;
+  __u64 cgroup;
+};
+
+/* Block requests in flight, keyed by the address of struct request. */
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __uint(max_entries, 10240);
+  __type(key, __u64);
+  __type(value, struct rq_start);
+} rq_starts SEC(".maps");
+
+/* Runnable tasks waiting for a CPU, keyed by pid. */
+struct {
+  __uint(type, BPF_MAP_TYPE_HASH);
+  __uint(max_entries, 10240);
+  __type(key, __u32);
+  __type(value, __u64);
+} runq_starts SEC(".maps");
+
+struct {
+  __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+  __uint(max_entries, 1);
+  __type(key, __u32);
+  __type(value, __u64);
+} tcp_retransmits SEC(".maps");
+
+static const struct ebpf_hist empty_hist;
+
+/* Kernel structures whose layout changed, for CO-RE field existence checks. */
+struct request___x {
+  struct request_queue *q;
+  struct gendisk *rq_disk;
+} __attribute__((preserve_access_index));
+
+struct task_struct___o {
+  volatile long int state;
+} __attribute__((preserve_access_index));
+
+struct task_struct___x {
+  unsigned int __state;
+} __attribute__((preserve_access_index));
+
+static __always_inline bool per_cgroup(void) {
+  __u32 zero = 0;
+  struct ebpf_config *cfg = bpf_map_lookup_elem(&config, &zero);
+  return (cfg != NULL) && cfg->per_cgroup;
+}
+
+static __always_inline __u64 log2_u32(__u32 v) {
+  __u32 shift, r;
+
+  r = (v > 0xFFFF) << 4;
+  v >>= r;
+  shift = (v > 0xFF) << 3;
+  v >>= shift;
+  r |= shift;
+  shift = (v > 0xF) << 2;
+  v >>= shift;
+  r |= shift;
+  shift = (v > 0x3) << 1;
+  v >>= shift;
+  r |= shift;
+  r |= (v >> 1);
+  return r;
+}
+
+static __always_inline __u64 log2_u64(__u64 v) {
+  __u32 hi = v >> 32;
+  if (hi != 0)
+    return log2_u32(hi) + 32;
+  return log2_u32((__u32)v);
+}
+
+static __always_inline void hist_record(__u32 kind, __u64 dev, __u64 cgroup,
+                                        __u64 delta_ns) {
+  struct ebpf_hist_key key = {
+      .kind = kind,
+      .dev = dev,
+      .cgroup = cgroup,
+  };
+
+  struct ebpf_hist *h = bpf_map_lookup_elem(&hists, &key);
+  if (h == NULL) {
+    bpf_map_update_elem(&hists, &key, &empty_hist, BPF_NOEXIST);
+    h = bpf_map_lookup_elem(&hists, &key);
+    if (h == NULL)
+      return;
+  }
+
+  __u64 slot = log2_u64(delta_ns / 1000);
+  if (slot >= EBPF_HIST_SLOTS)
+    slot = EBPF_HIST_SLOTS - 1;
+  __sync_fetch_and_add(&h->slots[slot], 1);
+  __sync_fetch_and_add(&h->sum_ns, delta_ns);
+}
+
+static __always_inline __u64 task_cgroup_id(struct task_struct *task) {
+  return BPF_CORE_READ(task, cgroups, dfl_cgrp, kn, id);
+}
+
+static __always_inline struct gendisk *request_disk(void *request) {
+  struct request___x *r = request;
+
+  /* Since Linux 5.17 the disk is only reachable through the queue. */
+  if (bpf_core_field_exists(r->rq_disk))
+    return BPF_CORE_READ(r, rq_disk);
+  return BPF_CORE_READ(r, q, disk);
+}
+
+static __always_inline long task_state(void *task) {
+  struct task_struct___x *t = task;
+
+  /* "state" was renamed to "__state" in Linux 5.14. */
+  if (bpf_core_field_exists(t->__state))
+    return BPF_CORE_READ(t, __state);
+  return BPF_CORE_READ((struct task_struct___o *)task, state);
+}
+
+/*
+ * Block I/O
+ */
+static __always_inline int block_start(void *rq) {
+  struct rq_start start = {
+      .ts = bpf_ktime_get_ns(),
+      .cgroup = per_cgroup() ? bpf_get_current_cgroup_id() : 0,
+  };
+  __u64 key = (__u64)rq;
+
+  bpf_map_update_elem(&rq_starts, &key, &start, BPF_ANY);
+  return 0;
+}
+
+SEC("tp_btf/block_rq_issue")
+int BPF_PROG(block_rq_issue) {
+  /* The request queue argument was removed in Linux 5.11. */
+  if (LINUX_KERNEL_VERSION < KERNEL_VERSION(5, 11, 0))
+    return block_start((void *)ctx[1]);
+  return block_start((void *)ctx[0]);
+}
+
+SEC("tp_btf/block_rq_complete")
+int BPF_PROG(block_rq_complete, struct request *rq) {
+  __u64 key = (__u64)rq;
+  struct rq_start *start = bpf_map_lookup_elem(&rq_starts, &key);
+  if (start == NULL)
+    return 0;
+
+  __u64 now = bpf_ktime_get_ns();
+  __u64 ts = start->ts;
+  __u64 cgroup = start->cgroup;
+  bpf_map_delete_elem(&rq_starts, &key);
+  if (now < ts)
+    return 0;
+
+  __u64 dev = 0;
+  struct gendisk *disk = request_disk(rq);
+  if (disk != NULL)
+    dev = (((__u64)BPF_CORE_READ(disk, major)) << 32) |
+          ((__u64)BPF_CORE_READ(disk, first_minor));
+
+  hist_record(EBPF_HIST_BLOCK, dev, cgroup, now - ts);
+  return 0;
+}
+
+/*
+ * Run queue latency
+ */
+static __always_inline int runq_start(struct task_struct *task) {
+  __u32 pid = BPF_CORE_READ(task, pid);
+  if (pid == 0)
+    return 0;
+
+  __u64 ts = bpf_ktime_get_ns();
+  bpf_map_update_elem(&runq_starts, &pid, &ts, BPF_ANY);
+  return 0;
+}
+
+SEC("tp_btf/sched_wakeup")
+int BPF_PROG(sched_wakeup, struct task_struct *task) {
+  return runq_start(task);
+}
+
+SEC("tp_btf/sched_wakeup_new")
+int BPF_PROG(sched_wakeup_new, struct task_struct *task) {
+  return runq_start(task);
+}
+
+SEC("tp_btf/sched_switch")
+int BPF_PROG(sched_switch, bool preempt, struct task_struct *prev,
+             struct task_struct *next) {
+  /* A preempted task goes back to the run queue right away. */
+  if (task_state(prev) == TASK_RUNNING)
+    runq_start(prev);
+
+  __u32 pid = BPF_CORE_READ(next, pid);
+  __u64 *ts = bpf_map_lookup_elem(&runq_starts, &pid);
+  if (ts == NULL)
+    return 0;
+
+  __u64 now = bpf_ktime_get_ns();
+  __u64 start = *ts;
+  bpf_map_delete_elem(&runq_starts, &pid);
+  if (now < start)
+    return 0;
+
+  hist_record(EBPF_HIST_RUNQ, 0, per_cgroup() ? task_cgroup_id(next) : 0,
+              now - start);
+  return 0;
+}
+
+/*
+ * TCP retransmits
+ */
+SEC("tp_btf/tcp_retransmit_skb")
+int BPF_PROG(tcp_retransmit_skb) {
+  __u32 zero = 0;
+  __u64 *count = bpf_map_lookup_elem(&tcp_retransmits, &zero);
+  if (count != NULL)
+    (*count)++;
+  return 0;
+}
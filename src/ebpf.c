@@ -0,0 +1,615 @@
+/**
+ * collectd - src/ebpf.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/avltree/avltree.h"
+#include "utils/common/common.h"
+#include "utils/latency/histogram.h"
+#include "utils/latency/latency_config.h"
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <linux/types.h>
+
+#include "ebpf.h"
+
+#ifndef EBPF_OBJECT_FILE
+#define EBPF_OBJECT_FILE PKGDATADIR "/ebpf.bpf.o"
+#endif
+
+/* Number of histograms read from the kernel with one system call. */
+#define EBPF_BATCH_SIZE 256
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+static char *conf_object_file;
+static bool conf_block_io = true;
+static bool conf_run_queue = true;
+static bool conf_tcp_retransmits = true;
+static bool conf_per_cgroup;
+static latency_config_t conf_latency;
+
+static struct bpf_object *obj;
+static struct bpf_link **links;
+static size_t links_num;
+static int hists_fd = -1;
+static int tcp_retransmits_fd = -1;
+
+/* Buffers for bpf_map_lookup_and_delete_batch(). */
+static struct ebpf_hist_key *batch_keys;
+static struct ebpf_hist *batch_values;
+
+static latency_histogram_t *histogram;
+static cdtime_t last_read;
+
+/* Names of block devices and cgroups, keyed by device number and cgroup id
+ * respectively. */
+static c_avl_tree_t *disk_names;
+static c_avl_tree_t *cgroup_names;
+static bool cgroups_scanned;
+
+static int ebpf_compare_u64(void const *a, void const *b) /* {{{ */
+{
+  uint64_t const *x = a;
+  uint64_t const *y = b;
+
+  if (*x == *y)
+    return 0;
+  return (*x < *y) ? -1 : 1;
+} /* }}} int ebpf_compare_u64 */
+
+static void ebpf_names_clear(c_avl_tree_t *tree) /* {{{ */
+{
+  void *key;
+  void *value;
+
+  while (c_avl_pick(tree, &key, &value) == 0) {
+    sfree(key);
+    sfree(value);
+  }
+} /* }}} void ebpf_names_clear */
+
+static int ebpf_names_add(c_avl_tree_t *tree, uint64_t id, /* {{{ */
+                          char const *name) {
+  uint64_t *key = malloc(sizeof(*key));
+  char *value = strdup(name);
+  if ((key == NULL) || (value == NULL)) {
+    sfree(key);
+    sfree(value);
+    return ENOMEM;
+  }
+  *key = id;
+
+  if (c_avl_insert(tree, key, value) != 0) {
+    sfree(key);
+    sfree(value);
+    return -1;
+  }
+  return 0;
+} /* }}} int ebpf_names_add */
+
+/* ebpf_disk_name returns the kernel name of a block device, e.g. "sda". */
+static char const *ebpf_disk_name(uint64_t dev) /* {{{ */
+{
+  char *name = NULL;
+  if (c_avl_get(disk_names, &dev, (void *)&name) == 0)
+    return name;
+
+  unsigned int major_num = (unsigned int)(dev >> 32);
+  unsigned int minor_num = (unsigned int)(dev & 0xffffffff);
+
+  char path[PATH_MAX];
+  char target[PATH_MAX];
+  ssnprintf(path, sizeof(path), "/sys/dev/block/%u:%u", major_num, minor_num);
+  ssize_t len = readlink(path, target, sizeof(target) - 1);
+
+  char buffer[DATA_MAX_NAME_LEN];
+  if (len > 0) {
+    target[len] = 0;
+    char *base = strrchr(target, '/');
+    sstrncpy(buffer, (base != NULL) ? base + 1 : target, sizeof(buffer));
+  } else {
+    ssnprintf(buffer, sizeof(buffer), "%u_%u", major_num, minor_num);
+  }
+
+  if (ebpf_names_add(disk_names, dev, buffer) != 0)
+    return NULL;
+  c_avl_get(disk_names, &dev, (void *)&name);
+  return name;
+} /* }}} char const *ebpf_disk_name */
+
+static int ebpf_scan_cgroup(char const *dir, char const *name, /* {{{ */
+                            void *user_data) {
+  char const *rel = user_data;
+  char path[PATH_MAX];
+  char rel_path[PATH_MAX];
+  struct stat st;
+
+  ssnprintf(path, sizeof(path), "%s/%s", dir, name);
+  if ((lstat(path, &st) != 0) || !S_ISDIR(st.st_mode))
+    return 0;
+
+  if (rel[0] == 0)
+    sstrncpy(rel_path, name, sizeof(rel_path));
+  else
+    ssnprintf(rel_path, sizeof(rel_path), "%s/%s", rel, name);
+
+  /* On cgroup v2, the cgroup id is the inode number of its directory. */
+  ebpf_names_add(cgroup_names, (uint64_t)st.st_ino, rel_path);
+  walk_directory(path, ebpf_scan_cgroup, rel_path, /* hidden = */ 0);
+  return 0;
+} /* }}} int ebpf_scan_cgroup */
+
+/* ebpf_cgroup_name returns the path of a cgroup relative to the cgroup v2
+ * mount point, or "root" for the root cgroup. The cgroup hierarchy is scanned
+ * again at most once per read when an unknown id is encountered. */
+static char const *ebpf_cgroup_name(uint64_t id) /* {{{ */
+{
+  char *name = NULL;
+  if (c_avl_get(cgroup_names, &id, (void *)&name) == 0)
+    return name;
+
+  if (!cgroups_scanned) {
+    cgroups_scanned = true;
+    ebpf_names_clear(cgroup_names);
+
+    struct stat st;
+    if (stat(CGROUP_ROOT, &st) == 0)
+      ebpf_names_add(cgroup_names, (uint64_t)st.st_ino, "root");
+    walk_directory(CGROUP_ROOT, ebpf_scan_cgroup, "", /* hidden = */ 0);
+
+    if (c_avl_get(cgroup_names, &id, (void *)&name) == 0)
+      return name;
+  }
+
+  /* The cgroup has been removed already. */
+  char buffer[DATA_MAX_NAME_LEN];
+  ssnprintf(buffer, sizeof(buffer), "%" PRIu64, id);
+  if (ebpf_names_add(cgroup_names, id, buffer) != 0)
+    return NULL;
+  c_avl_get(cgroup_names, &id, (void *)&name);
+  return name;
+} /* }}} char const *ebpf_cgroup_name */
+
+static void ebpf_submit(char const *plugin_instance, /* {{{ */
+                        char const *type, char const *type_instance,
+                        value_t value) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = &value;
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "ebpf", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, type, sizeof(vl.type));
+  if (type_instance != NULL)
+    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+
+  plugin_dispatch_values(&vl);
+} /* }}} void ebpf_submit */
+
+static void ebpf_submit_hist(struct ebpf_hist_key const *key, /* {{{ */
+                             struct ebpf_hist const *hist, double interval) {
+  char plugin_instance[DATA_MAX_NAME_LEN];
+
+  if (key->kind == EBPF_HIST_BLOCK) {
+    char const *disk = ebpf_disk_name(key->dev);
+    sstrncpy(plugin_instance, "block-", sizeof(plugin_instance));
+    if (disk != NULL)
+      sstrncpy(plugin_instance + strlen("block-"), disk,
+               sizeof(plugin_instance) - strlen("block-"));
+  } else if (key->kind == EBPF_HIST_RUNQ) {
+    sstrncpy(plugin_instance, "runqueue", sizeof(plugin_instance));
+  } else {
+    return;
+  }
+
+  if (conf_per_cgroup) {
+    char const *cgroup = ebpf_cgroup_name(key->cgroup);
+    if (cgroup != NULL) {
+      size_t len = strlen(plugin_instance);
+      ssnprintf(plugin_instance + len, sizeof(plugin_instance) - len, "-%s",
+                cgroup);
+    }
+  }
+  /* The identifier must not contain slashes. */
+  for (char *c = plugin_instance; *c != 0; c++)
+    if (*c == '/')
+      *c = '_';
+
+  /* Each log2 slot is recorded at its middle: 1us for slot 0 and 1.5 * 2^i
+   * us for slot i. */
+  latency_histogram_reset(histogram);
+  for (size_t i = 0; i < EBPF_HIST_SLOTS; i++) {
+    cdtime_t latency = (i == 0) ? US_TO_CDTIME_T(1)
+                                : US_TO_CDTIME_T(3 * (UINT64_C(1) << (i - 1)));
+    latency_histogram_add_n(histogram, latency, hist->slots[i]);
+  }
+
+  uint64_t num = latency_histogram_get_num(histogram);
+  if (num == 0)
+    return;
+
+  ebpf_submit(plugin_instance, "operations_per_second", NULL,
+              (value_t){.gauge = ((double)num) / interval});
+  ebpf_submit(plugin_instance, "latency", "average",
+              (value_t){.gauge = ((double)hist->sum_ns) / ((double)num) / 1e9});
+
+  if (conf_latency.percentile_num > 0) {
+    cdtime_t percentile[conf_latency.percentile_num];
+    latency_histogram_get_percentiles(histogram, conf_latency.percentile,
+                                      percentile, conf_latency.percentile_num);
+
+    for (size_t i = 0; i < conf_latency.percentile_num; i++) {
+      char type_instance[DATA_MAX_NAME_LEN];
+      ssnprintf(type_instance, sizeof(type_instance), "percentile-%g",
+                conf_latency.percentile[i]);
+      ebpf_submit(plugin_instance, "latency", type_instance,
+                  (value_t){.gauge = CDTIME_T_TO_DOUBLE(percentile[i])});
+    }
+  }
+
+  char const *bucket_type =
+      (conf_latency.bucket_type != NULL) ? conf_latency.bucket_type : "bucket";
+  for (size_t i = 0; i < conf_latency.buckets_num; i++) {
+    latency_bucket_t bucket = conf_latency.buckets[i];
+    double lower_bound = CDTIME_T_TO_DOUBLE(bucket.lower_bound);
+    double upper_bound =
+        bucket.upper_bound ? CDTIME_T_TO_DOUBLE(bucket.upper_bound) : INFINITY;
+
+    char type_instance[DATA_MAX_NAME_LEN];
+    ssnprintf(type_instance, sizeof(type_instance), "latency-%g_%g",
+              lower_bound, upper_bound);
+
+    double count = latency_histogram_get_count(histogram, bucket.lower_bound,
+                                               bucket.upper_bound);
+    ebpf_submit(plugin_instance, bucket_type, type_instance,
+                (value_t){.gauge = count / interval});
+  }
+} /* }}} void ebpf_submit_hist */
+
+/* ebpf_read_hists_slow reads and deletes the histograms one by one, for
+ * kernels without batch operations on hash maps (before Linux 5.6). */
+static int ebpf_read_hists_slow(double interval) /* {{{ */
+{
+  /* Deleting keys while iterating restarts the iteration, so collect a batch
+   * of keys first. Bound the number of rounds in case histograms are added
+   * faster than they are read. */
+  for (size_t round = 0; round <= EBPF_HISTS_MAX / EBPF_BATCH_SIZE; round++) {
+    size_t keys_num = 0;
+    while (keys_num < EBPF_BATCH_SIZE) {
+      struct ebpf_hist_key *prev =
+          (keys_num > 0) ? batch_keys + (keys_num - 1) : NULL;
+      if (bpf_map_get_next_key(hists_fd, prev, batch_keys + keys_num) != 0)
+        break;
+      keys_num++;
+    }
+    if (keys_num == 0)
+      break;
+
+    for (size_t i = 0; i < keys_num; i++) {
+      if (bpf_map_lookup_elem(hists_fd, batch_keys + i, batch_values + i) != 0)
+        continue;
+      bpf_map_delete_elem(hists_fd, batch_keys + i);
+      ebpf_submit_hist(batch_keys + i, batch_values + i, interval);
+    }
+  }
+
+  return 0;
+} /* }}} int ebpf_read_hists_slow */
+
+static int ebpf_read_hists(double interval) /* {{{ */
+{
+  static bool batch_unsupported;
+  __u32 in_batch = 0;
+  __u32 out_batch = 0;
+  bool first = true;
+
+  if (batch_unsupported)
+    return ebpf_read_hists_slow(interval);
+
+  LIBBPF_OPTS(bpf_map_batch_opts, opts);
+  while (true) {
+    __u32 count = EBPF_BATCH_SIZE;
+    int status = bpf_map_lookup_and_delete_batch(
+        hists_fd, first ? NULL : &in_batch, &out_batch, batch_keys,
+        batch_values, &count, &opts);
+    if ((status < 0) && (status != -ENOENT)) {
+      if (first && ((status == -EINVAL) || (status == -ENOTSUP) ||
+                    (status == -EOPNOTSUPP))) {
+        INFO("ebpf plugin: Batch map operations are not supported by this "
+             "kernel. Reading histograms one by one.");
+        batch_unsupported = true;
+        return ebpf_read_hists_slow(interval);
+      }
+      ERROR("ebpf plugin: bpf_map_lookup_and_delete_batch failed: %s",
+            STRERROR(-status));
+      return -1;
+    }
+
+    for (__u32 i = 0; i < count; i++)
+      ebpf_submit_hist(batch_keys + i, batch_values + i, interval);
+
+    /* -ENOENT signals that the end of the map has been reached. */
+    if (status != 0)
+      break;
+
+    in_batch = out_batch;
+    first = false;
+  }
+
+  return 0;
+} /* }}} int ebpf_read_hists */
+
+static int ebpf_read_tcp_retransmits(void) /* {{{ */
+{
+  int cpus_num = libbpf_num_possible_cpus();
+  if (cpus_num <= 0)
+    return -1;
+
+  __u64 values[cpus_num];
+  __u32 zero = 0;
+  if (bpf_map_lookup_elem(tcp_retransmits_fd, &zero, values) != 0) {
+    ERROR("ebpf plugin: Reading the TCP retransmit counters failed: %s",
+          STRERRNO);
+    return -1;
+  }
+
+  derive_t sum = 0;
+  for (int i = 0; i < cpus_num; i++)
+    sum += (derive_t)values[i];
+
+  ebpf_submit("tcp", "derive", "retransmits", (value_t){.derive = sum});
+  return 0;
+} /* }}} int ebpf_read_tcp_retransmits */
+
+static int ebpf_read(void) /* {{{ */
+{
+  if (obj == NULL)
+    return -1;
+
+  cdtime_t now = cdtime();
+  double interval = CDTIME_T_TO_DOUBLE(
+      (last_read != 0) ? (now - last_read) : plugin_get_interval());
+  last_read = now;
+  cgroups_scanned = false;
+
+  int status = 0;
+  if ((conf_block_io || conf_run_queue) && (ebpf_read_hists(interval) != 0))
+    status = -1;
+  if (conf_tcp_retransmits && (ebpf_read_tcp_retransmits() != 0))
+    status = -1;
+
+  return status;
+} /* }}} int ebpf_read */
+
+static int ebpf_libbpf_print(enum libbpf_print_level level, /* {{{ */
+                             char const *format, va_list ap) {
+  char buffer[1024];
+  vsnprintf(buffer, sizeof(buffer), format, ap);
+
+  /* libbpf terminates its messages with a newline. */
+  size_t len = strlen(buffer);
+  while ((len > 0) && (buffer[len - 1] == '\n'))
+    buffer[--len] = 0;
+
+  if (level == LIBBPF_WARN)
+    WARNING("ebpf plugin: libbpf: %s", buffer);
+  else if (level == LIBBPF_INFO)
+    INFO("ebpf plugin: libbpf: %s", buffer);
+  else
+    DEBUG("ebpf plugin: libbpf: %s", buffer);
+  return 0;
+} /* }}} int ebpf_libbpf_print */
+
+static bool ebpf_program_enabled(char const *name) /* {{{ */
+{
+  if (strncmp("block_", name, strlen("block_")) == 0)
+    return conf_block_io;
+  if (strncmp("sched_", name, strlen("sched_")) == 0)
+    return conf_run_queue;
+  if (strncmp("tcp_", name, strlen("tcp_")) == 0)
+    return conf_tcp_retransmits;
+  return false;
+} /* }}} bool ebpf_program_enabled */
+
+/* ebpf_close detaches and unloads the eBPF programs and frees all state. */
+static void ebpf_close(void) /* {{{ */
+{
+  for (size_t i = 0; i < links_num; i++)
+    bpf_link__destroy(links[i]);
+  sfree(links);
+  links_num = 0;
+
+  if (obj != NULL)
+    bpf_object__close(obj);
+  obj = NULL;
+  hists_fd = -1;
+  tcp_retransmits_fd = -1;
+
+  sfree(batch_keys);
+  sfree(batch_values);
+  latency_histogram_destroy(histogram);
+  histogram = NULL;
+
+  if (disk_names != NULL) {
+    ebpf_names_clear(disk_names);
+    c_avl_destroy(disk_names);
+    disk_names = NULL;
+  }
+  if (cgroup_names != NULL) {
+    ebpf_names_clear(cgroup_names);
+    c_avl_destroy(cgroup_names);
+    cgroup_names = NULL;
+  }
+} /* }}} void ebpf_close */
+
+static int ebpf_shutdown(void) /* {{{ */
+{
+  ebpf_close();
+
+  sfree(conf_object_file);
+  latency_config_free(conf_latency);
+  memset(&conf_latency, 0, sizeof(conf_latency));
+
+  return 0;
+} /* }}} int ebpf_shutdown */
+
+static int ebpf_init(void) /* {{{ */
+{
+  char const *object_file =
+      (conf_object_file != NULL) ? conf_object_file : EBPF_OBJECT_FILE;
+
+  /* Report the commonly used percentiles by default. */
+  if ((conf_latency.percentile_num == 0) && (conf_latency.buckets_num == 0)) {
+    static double const defaults[] = {50.0, 95.0, 99.0};
+    conf_latency.percentile = calloc(STATIC_ARRAY_SIZE(defaults),
+                                     sizeof(*conf_latency.percentile));
+    if (conf_latency.percentile == NULL)
+      return ENOMEM;
+    memcpy(conf_latency.percentile, defaults, sizeof(defaults));
+    conf_latency.percentile_num = STATIC_ARRAY_SIZE(defaults);
+  }
+
+  libbpf_set_print(ebpf_libbpf_print);
+
+  obj = bpf_object__open_file(object_file, NULL);
+  if (obj == NULL) {
+    ERROR("ebpf plugin: Opening \"%s\" failed: %s", object_file, STRERRNO);
+    return -1;
+  }
+
+  size_t programs_num = 0;
+  struct bpf_program *prog;
+  bpf_object__for_each_program(prog, obj) {
+    bool enabled = ebpf_program_enabled(bpf_program__name(prog));
+    bpf_program__set_autoload(prog, enabled);
+    if (enabled)
+      programs_num++;
+  }
+
+  int status = bpf_object__load(obj);
+  if (status != 0) {
+    ERROR("ebpf plugin: Loading the eBPF programs from \"%s\" failed: %s. "
+          "Loading eBPF programs requires CAP_BPF and CAP_PERFMON (or "
+          "CAP_SYS_ADMIN) and a kernel with BTF.",
+          object_file, STRERROR(-status));
+    ebpf_close();
+    return -1;
+  }
+
+  struct ebpf_config cfg = {.per_cgroup = conf_per_cgroup};
+  __u32 zero = 0;
+  struct bpf_map *map = bpf_object__find_map_by_name(obj, "config");
+  if ((map == NULL) ||
+      (bpf_map_update_elem(bpf_map__fd(map), &zero, &cfg, BPF_ANY) != 0)) {
+    ERROR("ebpf plugin: Setting the configuration map failed.");
+    ebpf_close();
+    return -1;
+  }
+
+  hists_fd = bpf_object__find_map_fd_by_name(obj, "hists");
+  tcp_retransmits_fd = bpf_object__find_map_fd_by_name(obj, "tcp_retransmits");
+  if ((hists_fd < 0) || (tcp_retransmits_fd < 0)) {
+    ERROR("ebpf plugin: \"%s\" lacks the expected maps.", object_file);
+    ebpf_close();
+    return -1;
+  }
+
+  links = calloc(programs_num, sizeof(*links));
+  if ((programs_num > 0) && (links == NULL)) {
+    ebpf_close();
+    return ENOMEM;
+  }
+  bpf_object__for_each_program(prog, obj) {
+    if (!bpf_program__autoload(prog))
+      continue;
+
+    struct bpf_link *link = bpf_program__attach(prog);
+    if (link == NULL) {
+      ERROR("ebpf plugin: Attaching \"%s\" failed: %s",
+            bpf_program__name(prog), STRERRNO);
+      ebpf_close();
+      return -1;
+    }
+    links[links_num] = link;
+    links_num++;
+  }
+
+  batch_keys = calloc(EBPF_BATCH_SIZE, sizeof(*batch_keys));
+  batch_values = calloc(EBPF_BATCH_SIZE, sizeof(*batch_values));
+  histogram = latency_histogram_create();
+  disk_names = c_avl_create(ebpf_compare_u64);
+  cgroup_names = c_avl_create(ebpf_compare_u64);
+  if ((batch_keys == NULL) || (batch_values == NULL) || (histogram == NULL) ||
+      (disk_names == NULL) || (cgroup_names == NULL)) {
+    ebpf_close();
+    return ENOMEM;
+  }
+
+  return 0;
+} /* }}} int ebpf_init */
+
+static int ebpf_config(oconfig_item_t *ci) /* {{{ */
+{
+  int status = 0;
+
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("ObjectFile", child->key) == 0)
+      status = cf_util_get_string(child, &conf_object_file);
+    else if (strcasecmp("BlockIO", child->key) == 0)
+      status = cf_util_get_boolean(child, &conf_block_io);
+    else if (strcasecmp("RunQueue", child->key) == 0)
+      status = cf_util_get_boolean(child, &conf_run_queue);
+    else if (strcasecmp("TCPRetransmits", child->key) == 0)
+      status = cf_util_get_boolean(child, &conf_tcp_retransmits);
+    else if (strcasecmp("PerCgroup", child->key) == 0)
+      status = cf_util_get_boolean(child, &conf_per_cgroup);
+    else if (strcasecmp("Latency", child->key) == 0) {
+      latency_config_free(conf_latency);
+      memset(&conf_latency, 0, sizeof(conf_latency));
+      status = latency_config(&conf_latency, child);
+    } else {
+      ERROR("ebpf plugin: Unknown config option: %s", child->key);
+      status = -1;
+    }
+
+    if (status != 0)
+      return status;
+  }
+
+  return 0;
+} /* }}} int ebpf_config */
+
+void module_register(void) {
+  plugin_register_complex_config("ebpf", ebpf_config);
+  plugin_register_init("ebpf", ebpf_init);
+  plugin_register_read("ebpf", ebpf_read);
+  plugin_register_shutdown("ebpf", ebpf_shutdown);
+} /* void module_register */
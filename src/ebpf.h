@@ -0,0 +1,66 @@
+/**
+ * collectd - src/ebpf.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#ifndef EBPF_H
+#define EBPF_H 1
+
+/*
+ * Definitions shared by the eBPF programs in src/ebpf.bpf.c and the plugin in
+ * src/ebpf.c. The programs are compiled against vmlinux.h, the plugin against
+ * <linux/types.h>; both provide the __u32 and __u64 types used here.
+ */
+
+/* Number of log2 slots of a histogram. Slot 0 counts latencies below 2us,
+ * slot i counts latencies within [2^i, 2^(i+1)) us. The last slot counts
+ * everything above 2^(EBPF_HIST_SLOTS - 1) us, about 67 seconds. */
+#define EBPF_HIST_SLOTS 27
+
+/* Maximum number of histograms, i.e. of device and cgroup combinations. */
+#define EBPF_HISTS_MAX 10240
+
+enum ebpf_hist_kind {
+  EBPF_HIST_BLOCK = 1, /* block request issue to completion */
+  EBPF_HIST_RUNQ = 2,  /* task wakeup to running on a CPU */
+};
+
+struct ebpf_hist_key {
+  __u32 kind;
+  __u32 pad;
+  __u64 dev;    /* major << 32 | minor, for EBPF_HIST_BLOCK */
+  __u64 cgroup; /* cgroup v2 id, or zero if PerCgroup is disabled */
+};
+
+struct ebpf_hist {
+  __u64 slots[EBPF_HIST_SLOTS];
+  __u64 sum_ns;
+};
+
+/* Runtime settings, stored in the single element of the "config" map. */
+struct ebpf_config {
+  __u32 per_cgroup;
+};
+
+#endif /* EBPF_H */
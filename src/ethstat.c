@@ -48,31 +48,60 @@ struct value_map_s {
 };
 typedef struct value_map_s value_map_t;
 
-static char **interfaces;
+/* Number of value lists passed to plugin_dispatch_values_batch() at once. */
+#define ETHSTAT_BATCH_SIZE 64
+
+/* A statistic reported by the driver that is dispatched, and the type and
+ * type instance it is dispatched as. */
+struct ethstat_stat_s {
+  size_t index;
+  char const *type;
+  char const *type_instance;
+};
+typedef struct ethstat_stat_s ethstat_stat_t;
+
+/* The string set of an interface rarely changes, so it is fetched, and the
+ * statistics are mapped to types, only when the driver information changes. */
+struct ethstat_interface_s {
+  char *name;
+
+  struct ethtool_drvinfo drvinfo;
+  struct ethtool_gstrings *strings;
+  struct ethtool_stats *stats;
+
+  ethstat_stat_t *stat_list;
+  size_t stat_list_num;
+};
+typedef struct ethstat_interface_s ethstat_interface_t;
+
+static ethstat_interface_t *interfaces;
 static size_t interfaces_num;
 
+/* Control socket used for all ioctl(2) calls. */
+static int ctl_fd = -1;
+
 static c_avl_tree_t *value_map;
 
 static bool collect_mapped_only;
 
 static int ethstat_add_interface(const oconfig_item_t *ci) /* {{{ */
 {
-  char **tmp;
+  ethstat_interface_t *tmp;
   int status;
 
   tmp = realloc(interfaces, sizeof(*interfaces) * (interfaces_num + 1));
   if (tmp == NULL)
     return -1;
   interfaces = tmp;
-  interfaces[interfaces_num] = NULL;
+  interfaces[interfaces_num] = (ethstat_interface_t){0};
 
-  status = cf_util_get_string(ci, interfaces + interfaces_num);
+  status = cf_util_get_string(ci, &interfaces[interfaces_num].name);
   if (status != 0)
     return status;
 
   interfaces_num++;
   INFO("ethstat plugin: Registered interface %s",
-       interfaces[interfaces_num - 1]);
+       interfaces[interfaces_num - 1].name);
 
   return 0;
 } /* }}} int ethstat_add_interface */
@@ -157,141 +186,183 @@ static int ethstat_config(oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} */
 
-static void ethstat_submit_value(const char *device, const char *type_instance,
-                                 derive_t value) {
+static void ethstat_cache_free(ethstat_interface_t *iface) /* {{{ */
+{
+  sfree(iface->strings);
+  sfree(iface->stats);
+  sfree(iface->stat_list);
+  iface->stat_list_num = 0;
+  memset(&iface->drvinfo, 0, sizeof(iface->drvinfo));
+} /* }}} void ethstat_cache_free */
+
+static int ethstat_ioctl(char const *device, void *data) /* {{{ */
+{
+  if (ctl_fd < 0) {
+    ctl_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, /* protocol = */ 0);
+    if (ctl_fd < 0) {
+      ERROR("ethstat plugin: Failed to open control socket: %s", STRERRNO);
+      return -1;
+    }
+  }
+
+  struct ifreq req = {.ifr_data = data};
+  sstrncpy(req.ifr_name, device, sizeof(req.ifr_name));
+
+  return ioctl(ctl_fd, SIOCETHTOOL, &req);
+} /* }}} int ethstat_ioctl */
+
+/* Returns true if the driver information differs from the one the cache was
+ * built for, e.g. because the driver was reloaded or the firmware updated. */
+static bool ethstat_drvinfo_changed(struct ethtool_drvinfo const *a, /* {{{ */
+                                    struct ethtool_drvinfo const *b) {
+  return (a->n_stats != b->n_stats) || (strcmp(a->driver, b->driver) != 0) ||
+         (strcmp(a->version, b->version) != 0) ||
+         (strcmp(a->fw_version, b->fw_version) != 0) ||
+         (strcmp(a->bus_info, b->bus_info) != 0);
+} /* }}} bool ethstat_drvinfo_changed */
+
+/* Fetches the names of the interface's statistics and decides which of them
+ * are dispatched and as which type. */
+static int ethstat_cache_update(ethstat_interface_t *iface, /* {{{ */
+                                struct ethtool_drvinfo const *drvinfo) {
   static c_complain_t complain_no_map = C_COMPLAIN_INIT_STATIC;
 
-  value_list_t vl = VALUE_LIST_INIT;
-  value_map_t *map = NULL;
+  size_t n_stats = (size_t)drvinfo->n_stats;
 
-  if (value_map != NULL)
-    c_avl_get(value_map, type_instance, (void *)&map);
+  ethstat_cache_free(iface);
 
-  /* If the "MappedOnly" option is specified, ignore unmapped values. */
-  if (collect_mapped_only && (map == NULL)) {
-    if (value_map == NULL)
-      c_complain(
-          LOG_WARNING, &complain_no_map,
-          "ethstat plugin: The \"MappedOnly\" option has been set to true, "
-          "but no mapping has been configured. All values will be ignored!");
-    return;
+  iface->strings =
+      malloc(sizeof(*iface->strings) + (n_stats * ETH_GSTRING_LEN));
+  iface->stats = malloc(sizeof(*iface->stats) + (n_stats * sizeof(uint64_t)));
+  iface->stat_list = calloc(n_stats, sizeof(*iface->stat_list));
+  if ((iface->strings == NULL) || (iface->stats == NULL) ||
+      (iface->stat_list == NULL)) {
+    ethstat_cache_free(iface);
+    ERROR("ethstat plugin: malloc failed.");
+    return -1;
   }
 
-  vl.values = &(value_t){.derive = value};
-  vl.values_len = 1;
-
-  sstrncpy(vl.plugin, "ethstat", sizeof(vl.plugin));
-  sstrncpy(vl.plugin_instance, device, sizeof(vl.plugin_instance));
-  if (map != NULL) {
-    sstrncpy(vl.type, map->type, sizeof(vl.type));
-    sstrncpy(vl.type_instance, map->type_instance, sizeof(vl.type_instance));
-  } else {
-    sstrncpy(vl.type, "derive", sizeof(vl.type));
-    sstrncpy(vl.type_instance, type_instance, sizeof(vl.type_instance));
+  iface->strings->cmd = ETHTOOL_GSTRINGS;
+  iface->strings->string_set = ETH_SS_STATS;
+  iface->strings->len = n_stats;
+  if (ethstat_ioctl(iface->name, iface->strings) < 0) {
+    ERROR("ethstat plugin: Cannot get strings from %s: %s", iface->name,
+          STRERRNO);
+    ethstat_cache_free(iface);
+    return -1;
   }
 
-  plugin_dispatch_values(&vl);
-}
+  if (collect_mapped_only && (value_map == NULL))
+    c_complain(
+        LOG_WARNING, &complain_no_map,
+        "ethstat plugin: The \"MappedOnly\" option has been set to true, "
+        "but no mapping has been configured. All values will be ignored!");
 
-static int ethstat_read_interface(char *device) {
-  int fd;
-  struct ethtool_gstrings *strings;
-  struct ethtool_stats *stats;
-  size_t n_stats;
-  size_t strings_size;
-  size_t stats_size;
-  int status;
+  for (size_t i = 0; i < n_stats; i++) {
+    char *stat_name = (char *)&iface->strings->data[i * ETH_GSTRING_LEN];
+    /* The names are not necessarily null terminated. */
+    stat_name[ETH_GSTRING_LEN - 1] = 0;
+    /* Remove leading spaces in key name */
+    while (isspace((int)*stat_name))
+      stat_name++;
 
-  fd = socket(AF_INET, SOCK_DGRAM, /* protocol = */ 0);
-  if (fd < 0) {
-    ERROR("ethstat plugin: Failed to open control socket: %s", STRERRNO);
-    return 1;
+    value_map_t *map = NULL;
+    if (value_map != NULL)
+      c_avl_get(value_map, stat_name, (void *)&map);
+
+    /* If the "MappedOnly" option is specified, ignore unmapped values. */
+    if (collect_mapped_only && (map == NULL))
+      continue;
+
+    ethstat_stat_t *stat = iface->stat_list + iface->stat_list_num;
+    stat->index = i;
+    if (map != NULL) {
+      stat->type = map->type;
+      stat->type_instance = map->type_instance;
+    } else {
+      stat->type = "derive";
+      stat->type_instance = stat_name;
+    }
+    iface->stat_list_num++;
   }
 
-  struct ethtool_drvinfo drvinfo = {.cmd = ETHTOOL_GDRVINFO};
-
-  struct ifreq req = {.ifr_data = (void *)&drvinfo};
-
-  sstrncpy(req.ifr_name, device, sizeof(req.ifr_name));
+  iface->drvinfo = *drvinfo;
+  return 0;
+} /* }}} int ethstat_cache_update */
 
-  status = ioctl(fd, SIOCETHTOOL, &req);
-  if (status < 0) {
-    close(fd);
+static int ethstat_read_interface(ethstat_interface_t *iface) /* {{{ */
+{
+  struct ethtool_drvinfo drvinfo = {.cmd = ETHTOOL_GDRVINFO};
+  if (ethstat_ioctl(iface->name, &drvinfo) < 0) {
     ERROR("ethstat plugin: Failed to get driver information "
           "from %s: %s",
-          device, STRERRNO);
+          iface->name, STRERRNO);
     return -1;
   }
 
-  n_stats = (size_t)drvinfo.n_stats;
-  if (n_stats < 1) {
-    close(fd);
-    ERROR("ethstat plugin: No stats available for %s", device);
+  if (drvinfo.n_stats < 1) {
+    ERROR("ethstat plugin: No stats available for %s", iface->name);
     return -1;
   }
 
-  strings_size = sizeof(struct ethtool_gstrings) + (n_stats * ETH_GSTRING_LEN);
-  stats_size = sizeof(struct ethtool_stats) + (n_stats * sizeof(uint64_t));
-
-  strings = malloc(strings_size);
-  stats = malloc(stats_size);
-  if ((strings == NULL) || (stats == NULL)) {
-    close(fd);
-    sfree(strings);
-    sfree(stats);
-    ERROR("ethstat plugin: malloc failed.");
-    return -1;
+  if ((iface->stats == NULL) ||
+      ethstat_drvinfo_changed(&drvinfo, &iface->drvinfo)) {
+    int status = ethstat_cache_update(iface, &drvinfo);
+    if (status != 0)
+      return status;
   }
 
-  strings->cmd = ETHTOOL_GSTRINGS;
-  strings->string_set = ETH_SS_STATS;
-  strings->len = n_stats;
-  req.ifr_data = (void *)strings;
-  status = ioctl(fd, SIOCETHTOOL, &req);
-  if (status < 0) {
-    close(fd);
-    free(strings);
-    free(stats);
-    ERROR("ethstat plugin: Cannot get strings from %s: %s", device, STRERRNO);
+  iface->stats->cmd = ETHTOOL_GSTATS;
+  iface->stats->n_stats = iface->drvinfo.n_stats;
+  if (ethstat_ioctl(iface->name, iface->stats) < 0) {
+    ERROR("ethstat plugin: Reading statistics from %s failed: %s",
+          iface->name, STRERRNO);
     return -1;
   }
 
-  stats->cmd = ETHTOOL_GSTATS;
-  stats->n_stats = n_stats;
-  req.ifr_data = (void *)stats;
-  status = ioctl(fd, SIOCETHTOOL, &req);
-  if (status < 0) {
-    close(fd);
-    free(strings);
-    free(stats);
-    ERROR("ethstat plugin: Reading statistics from %s failed: %s", device,
-          STRERRNO);
-    return -1;
+  value_t values[ETHSTAT_BATCH_SIZE];
+  value_list_t vl[ETHSTAT_BATCH_SIZE];
+  size_t vl_num = 0;
+
+  /* Only the type, type instance and value differ between value lists. */
+  value_list_t template = VALUE_LIST_INIT;
+  template.values_len = 1;
+  sstrncpy(template.plugin, "ethstat", sizeof(template.plugin));
+  sstrncpy(template.plugin_instance, iface->name,
+           sizeof(template.plugin_instance));
+  for (size_t i = 0; i < ETHSTAT_BATCH_SIZE; i++) {
+    vl[i] = template;
+    vl[i].values = values + i;
   }
 
-  for (size_t i = 0; i < n_stats; i++) {
-    char *stat_name;
+  for (size_t i = 0; i < iface->stat_list_num; i++) {
+    ethstat_stat_t const *stat = iface->stat_list + i;
+    uint64_t value = iface->stats->data[stat->index];
 
-    stat_name = (void *)&strings->data[i * ETH_GSTRING_LEN];
-    /* Remove leading spaces in key name */
-    while (isspace((int)*stat_name))
-      stat_name++;
+    DEBUG("ethstat plugin: device = \"%s\": %s = %" PRIu64, iface->name,
+          stat->type_instance, value);
 
-    DEBUG("ethstat plugin: device = \"%s\": %s = %" PRIu64, device, stat_name,
-          (uint64_t)stats->data[i]);
-    ethstat_submit_value(device, stat_name, (derive_t)stats->data[i]);
+    values[vl_num].derive = (derive_t)value;
+    sstrncpy(vl[vl_num].type, stat->type, sizeof(vl[vl_num].type));
+    sstrncpy(vl[vl_num].type_instance, stat->type_instance,
+             sizeof(vl[vl_num].type_instance));
+    vl_num++;
+
+    if (vl_num == ETHSTAT_BATCH_SIZE) {
+      plugin_dispatch_values_batch(vl, vl_num);
+      vl_num = 0;
+    }
   }
 
-  close(fd);
-  sfree(strings);
-  sfree(stats);
+  if (vl_num > 0)
+    plugin_dispatch_values_batch(vl, vl_num);
 
   return 0;
 } /* }}} ethstat_read_interface */
 
 static int ethstat_read(void) {
   for (size_t i = 0; i < interfaces_num; i++)
-    ethstat_read_interface(interfaces[i]);
+    ethstat_read_interface(interfaces + i);
 
   return 0;
 }
@@ -300,6 +371,18 @@ static int ethstat_shutdown(void) {
   void *key = NULL;
   void *value = NULL;
 
+  for (size_t i = 0; i < interfaces_num; i++) {
+    ethstat_cache_free(interfaces + i);
+    sfree(interfaces[i].name);
+  }
+  sfree(interfaces);
+  interfaces_num = 0;
+
+  if (ctl_fd >= 0) {
+    close(ctl_fd);
+    ctl_fd = -1;
+  }
+
   if (value_map == NULL)
     return 0;
 
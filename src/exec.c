@@ -34,10 +34,17 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 
+#include "utils/cmds/putbin.h"
 #include "utils/cmds/putnotif.h"
 #include "utils/cmds/putval.h"
 
 #include <grp.h>
+#if HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#if HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
 #include <poll.h>
 #include <pwd.h>
 #include <signal.h>
@@ -51,6 +58,8 @@ extern char **environ;
 
 #define PL_NORMAL 0x01
 #define PL_NOTIF_ACTION 0x02
+#define PL_BINARY 0x04
+#define PL_PERSISTENT 0x08
 
 #define PL_RUNNING 0x10
 
@@ -64,6 +73,8 @@ extern char **environ;
  * The `pid' and `status' fields are thus unused if the `PL_NOTIF_ACTION' flag
  * is set.
  * The `PL_RUNNING' flag is set in `exec_read' and unset in `exec_read_one'.
+ * Persistent notification programs (`PL_PERSISTENT') are the exception: their
+ * `pid' and `fh_in' fields are protected by `lock'.
  */
 struct program_list_s;
 typedef struct program_list_s program_list_t;
@@ -75,6 +86,8 @@ struct program_list_s {
   int pid;
   int status;
   int flags;
+  FILE *fh_in;
+  pthread_mutex_t lock;
   program_list_t *next;
 };
 
@@ -83,6 +96,21 @@ typedef struct program_list_and_notification_s {
   notification_t n;
 } program_list_and_notification_t;
 
+/* Receive buffer and dispatch batch of `ExecBinary' programs. */
+typedef struct exec_frames_s {
+  char *data;
+  size_t size;
+  size_t fill;
+
+  value_list_t *vl;
+  size_t vl_num;
+  size_t vl_size;
+  value_t *values;
+  size_t values_num;
+  size_t values_size;
+  size_t failed;
+} exec_frames_t;
+
 /*
  * constants
  */
@@ -143,6 +171,10 @@ static int exec_config_exec(oconfig_item_t *ci) /* {{{ */
 
   if (strcasecmp("NotificationExec", ci->key) == 0)
     pl->flags |= PL_NOTIF_ACTION;
+  else if (strcasecmp("PersistentNotificationExec", ci->key) == 0)
+    pl->flags |= PL_NOTIF_ACTION | PL_PERSISTENT;
+  else if (strcasecmp("ExecBinary", ci->key) == 0)
+    pl->flags |= PL_NORMAL | PL_BINARY;
   else
     pl->flags |= PL_NORMAL;
 
@@ -230,6 +262,9 @@ static int exec_config_exec(oconfig_item_t *ci) /* {{{ */
     DEBUG("exec plugin: argv[%i] = %s", i, pl->argv[i]);
   }
 
+  if (pl->flags & PL_PERSISTENT)
+    pthread_mutex_init(&pl->lock, /* attr = */ NULL);
+
   pl->next = pl_head;
   pl_head = pl;
 
@@ -241,7 +276,9 @@ static int exec_config(oconfig_item_t *ci) /* {{{ */
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
     if ((strcasecmp("Exec", child->key) == 0) ||
-        (strcasecmp("NotificationExec", child->key) == 0))
+        (strcasecmp("ExecBinary", child->key) == 0) ||
+        (strcasecmp("NotificationExec", child->key) == 0) ||
+        (strcasecmp("PersistentNotificationExec", child->key) == 0))
       exec_config_exec(child);
     else {
       WARNING("exec plugin: Unknown config option `%s'.", child->key);
@@ -567,6 +604,157 @@ static int parse_line(char *buffer) /* {{{ */
   }
 } /* int parse_line }}} */
 
+static void exec_frame_error(void *ud, cmd_status_t status, /* {{{ */
+                             const char *format, va_list ap) {
+  program_list_t *pl = ud;
+  char buffer[1024];
+
+  if (status == CMD_OK)
+    return;
+
+  vsnprintf(buffer, sizeof(buffer), format, ap);
+  ERROR("exec plugin: Program `%s' sent an invalid frame: %s", pl->exec,
+        buffer);
+} /* void exec_frame_error }}} */
+
+/* Adds a copy of "vl" to the batch. The values are appended to a separate
+ * array, which may be moved by realloc; "exec_frames_dispatch" sets the
+ * pointers once the frame has been parsed completely. */
+static int exec_frames_add(value_list_t const *vl, void *user_data) /* {{{ */
+{
+  exec_frames_t *fr = user_data;
+
+  data_set_t const *ds = plugin_get_ds(vl->type);
+  if ((ds == NULL) || (ds->ds_num != vl->values_len)) {
+    fr->failed++;
+    return EINVAL;
+  }
+
+  if (fr->vl_num >= fr->vl_size) {
+    size_t new_size = (fr->vl_size == 0) ? 64 : 2 * fr->vl_size;
+    value_list_t *tmp = realloc(fr->vl, new_size * sizeof(*fr->vl));
+    if (tmp == NULL) {
+      fr->failed++;
+      return ENOMEM;
+    }
+    fr->vl = tmp;
+    fr->vl_size = new_size;
+  }
+
+  if (fr->values_num + vl->values_len > fr->values_size) {
+    size_t new_size = (fr->values_size == 0) ? 256 : 2 * fr->values_size;
+    while (new_size < fr->values_num + vl->values_len)
+      new_size *= 2;
+    value_t *tmp = realloc(fr->values, new_size * sizeof(*fr->values));
+    if (tmp == NULL) {
+      fr->failed++;
+      return ENOMEM;
+    }
+    fr->values = tmp;
+    fr->values_size = new_size;
+  }
+
+  memcpy(fr->values + fr->values_num, vl->values,
+         vl->values_len * sizeof(*vl->values));
+  fr->values_num += vl->values_len;
+
+  fr->vl[fr->vl_num] = *vl;
+  fr->vl[fr->vl_num].values = NULL;
+  fr->vl_num++;
+
+  return 0;
+} /* int exec_frames_add }}} */
+
+/* Parses one frame and hands all of its value lists to the write queue at
+ * once. */
+static void exec_frames_dispatch(program_list_t *pl, /* {{{ */
+                                 exec_frames_t *fr, char const *frame,
+                                 size_t frame_size) {
+  cmd_error_handler_t err = {exec_frame_error, pl};
+
+  fr->vl_num = 0;
+  fr->values_num = 0;
+  fr->failed = 0;
+
+  /* Value lists before a malformed part are dispatched nonetheless. */
+  cmd_parse_putbin(frame, frame_size, exec_frames_add, fr, &err);
+
+  size_t offset = 0;
+  for (size_t i = 0; i < fr->vl_num; i++) {
+    fr->vl[i].values = fr->values + offset;
+    offset += fr->vl[i].values_len;
+  }
+
+  if (fr->failed > 0)
+    WARNING("exec plugin: Program `%s': %" PRIsz " of %" PRIsz
+            " value lists could not be dispatched.",
+            pl->exec, fr->failed, fr->failed + fr->vl_num);
+
+  if (fr->vl_num > 0)
+    plugin_dispatch_values_batch(fr->vl, fr->vl_num);
+} /* void exec_frames_dispatch }}} */
+
+/* Reads from the STDOUT of an `ExecBinary' program and dispatches all
+ * complete frames. Each frame is a 32 bit length in network byte order,
+ * followed by that many bytes in the binary network protocol. Returns the
+ * number of bytes read, zero on EOF and -1 on error. */
+static ssize_t exec_frames_read(program_list_t *pl, /* {{{ */
+                                exec_frames_t *fr, int fd) {
+  size_t want = fr->fill + 4096;
+  if (fr->fill >= sizeof(uint32_t)) {
+    uint32_t tmp;
+    memcpy(&tmp, fr->data, sizeof(tmp));
+    size_t frame_size = sizeof(tmp) + (size_t)ntohl(tmp);
+    if (want < frame_size)
+      want = frame_size;
+  }
+
+  if (fr->size < want) {
+    char *tmp = realloc(fr->data, want);
+    if (tmp == NULL) {
+      ERROR("exec plugin: realloc failed.");
+      errno = ENOMEM;
+      return -1;
+    }
+    fr->data = tmp;
+    fr->size = want;
+  }
+
+  ssize_t len = read(fd, fr->data + fr->fill, fr->size - fr->fill);
+  if (len <= 0)
+    return len;
+  fr->fill += (size_t)len;
+
+  size_t offset = 0;
+  while (fr->fill - offset >= sizeof(uint32_t)) {
+    uint32_t tmp;
+    memcpy(&tmp, fr->data + offset, sizeof(tmp));
+    size_t frame_size = (size_t)ntohl(tmp);
+
+    /* The stream can't be resynchronized after a bogus length. */
+    if (frame_size > CMD_PUTBIN_MAX_SIZE) {
+      ERROR("exec plugin: Program `%s' sent a frame of %" PRIsz
+            " bytes, the maximum is %d bytes.",
+            pl->exec, frame_size, CMD_PUTBIN_MAX_SIZE);
+      errno = EPROTO;
+      return -1;
+    }
+
+    if (fr->fill - offset - sizeof(tmp) < frame_size)
+      break;
+
+    exec_frames_dispatch(pl, fr, fr->data + offset + sizeof(tmp), frame_size);
+    offset += sizeof(tmp) + frame_size;
+  }
+
+  if (offset > 0) {
+    fr->fill -= offset;
+    memmove(fr->data, fr->data + offset, fr->fill);
+  }
+
+  return len;
+} /* ssize_t exec_frames_read }}} */
+
 static void *exec_read_one(void *arg) /* {{{ */
 {
   program_list_t *pl = (program_list_t *)arg;
@@ -577,6 +765,7 @@ static void *exec_read_one(void *arg) /* {{{ */
   char buffer_err[1024];
   char *pbuffer = buffer;
   char *pbuffer_err = buffer_err;
+  exec_frames_t frames = {0};
 
   status = fork_child(pl, NULL, &fd, &fd_err);
   if (status < 0) {
@@ -605,7 +794,17 @@ static void *exec_read_one(void *arg) /* {{{ */
       break;
     }
 
-    if (fds[0].revents & (POLLIN | POLLHUP)) {
+    if ((fds[0].revents & (POLLIN | POLLHUP)) && (pl->flags & PL_BINARY)) {
+      ssize_t n = exec_frames_read(pl, &frames, fd);
+      if (n < 0) {
+        if (errno == EAGAIN || errno == EINTR)
+          continue;
+        /* Don't wait for a program that may block writing to the pipe. */
+        kill(pl->pid, SIGTERM);
+        break;
+      } else if (n == 0)
+        break; /* We've reached EOF */
+    } else if (fds[0].revents & (POLLIN | POLLHUP)) {
       char *pnl;
 
       len = read(fd, pbuffer, sizeof(buffer) - 1 - (pbuffer - buffer));
@@ -713,35 +912,22 @@ static void *exec_read_one(void *arg) /* {{{ */
   if (fd_err >= 0)
     close(fd_err);
 
+  sfree(frames.data);
+  sfree(frames.vl);
+  sfree(frames.values);
+
   pthread_exit((void *)0);
   return NULL;
 } /* void *exec_read_one }}} */
 
-static void *exec_notification_one(void *arg) /* {{{ */
-{
-  program_list_t *pl = ((program_list_and_notification_t *)arg)->pl;
-  notification_t *n = &((program_list_and_notification_t *)arg)->n;
-  int fd;
-  FILE *fh;
-  int pid;
-  int status;
+/* Writes the notification in the format documented in collectd-exec(5). If
+ * "single_line" is true, line breaks in the message are replaced by spaces,
+ * so that readers of a stream can tell where the notification ends. */
+static void exec_print_notification(FILE *fh, /* {{{ */
+                                    const notification_t *n,
+                                    bool single_line) {
   const char *severity;
 
-  pid = fork_child(pl, &fd, NULL, NULL);
-  if (pid < 0) {
-    sfree(arg);
-    pthread_exit((void *)1);
-  }
-
-  fh = fdopen(fd, "w");
-  if (fh == NULL) {
-    ERROR("exec plugin: fdopen (%i) failed: %s", fd, STRERRNO);
-    kill(pid, SIGTERM);
-    close(fd);
-    sfree(arg);
-    pthread_exit((void *)1);
-  }
-
   severity = "FAILURE";
   if (n->severity == NOTIF_WARNING)
     severity = "WARNING";
@@ -781,7 +967,42 @@ static void *exec_notification_one(void *arg) /* {{{ */
               meta->nm_value.nm_boolean ? "true" : "false");
   }
 
-  fprintf(fh, "\n%s\n", n->message);
+  if (!single_line) {
+    fprintf(fh, "\n%s\n", n->message);
+    return;
+  }
+
+  fputc('\n', fh);
+  for (const char *c = n->message; *c != 0; c++)
+    fputc(((*c == '\n') || (*c == '\r')) ? ' ' : *c, fh);
+  fputc('\n', fh);
+} /* void exec_print_notification }}} */
+
+static void *exec_notification_one(void *arg) /* {{{ */
+{
+  program_list_t *pl = ((program_list_and_notification_t *)arg)->pl;
+  notification_t *n = &((program_list_and_notification_t *)arg)->n;
+  int fd;
+  FILE *fh;
+  int pid;
+  int status;
+
+  pid = fork_child(pl, &fd, NULL, NULL);
+  if (pid < 0) {
+    sfree(arg);
+    pthread_exit((void *)1);
+  }
+
+  fh = fdopen(fd, "w");
+  if (fh == NULL) {
+    ERROR("exec plugin: fdopen (%i) failed: %s", fd, STRERRNO);
+    kill(pid, SIGTERM);
+    close(fd);
+    sfree(arg);
+    pthread_exit((void *)1);
+  }
+
+  exec_print_notification(fh, n, /* single_line = */ false);
 
   fflush(fh);
   fclose(fh);
@@ -798,6 +1019,91 @@ static void *exec_notification_one(void *arg) /* {{{ */
   return NULL;
 } /* void *exec_notification_one }}} */
 
+/* Closes the STDIN of a persistent notification program and waits for it to
+ * exit. Programs that don't exit within a second after reading EOF are sent a
+ * SIGTERM. The caller must hold "pl->lock". */
+static void exec_persistent_stop(program_list_t *pl) /* {{{ */
+{
+  int status;
+  pid_t pid = 0;
+
+  if (pl->fh_in == NULL)
+    return;
+
+  fclose(pl->fh_in);
+  pl->fh_in = NULL;
+
+  for (int i = 0; i < 10; i++) {
+    pid = waitpid(pl->pid, &status, WNOHANG);
+    if (pid != 0)
+      break;
+    usleep(100000);
+  }
+
+  if (pid == 0) {
+    kill(pl->pid, SIGTERM);
+    pid = waitpid(pl->pid, &status, 0);
+  }
+  if (pid > 0)
+    pl->status = status;
+  DEBUG("exec plugin: Child %i exited with status %i.", pl->pid, pl->status);
+  pl->pid = 0;
+} /* void exec_persistent_stop }}} */
+
+/* Starts the long-lived child of a `PersistentNotificationExec' block. The
+ * caller must hold "pl->lock". */
+static int exec_persistent_start(program_list_t *pl) /* {{{ */
+{
+  int fd;
+  int status;
+
+  int pid = fork_child(pl, &fd, NULL, NULL);
+  if (pid < 0)
+    return -1;
+
+  pl->fh_in = fdopen(fd, "w");
+  if (pl->fh_in == NULL) {
+    ERROR("exec plugin: fdopen (%i) failed: %s", fd, STRERRNO);
+    kill(pid, SIGTERM);
+    close(fd);
+    waitpid(pid, &status, 0);
+    return -1;
+  }
+
+  pl->pid = pid;
+  return 0;
+} /* int exec_persistent_start }}} */
+
+/* Streams the notification to the long-lived child of a
+ * `PersistentNotificationExec' block. If the child has exited, it is restarted
+ * and the notification is passed to the new child. */
+static int exec_notification_persistent(program_list_t *pl, /* {{{ */
+                                        const notification_t *n) {
+  int status = -1;
+
+  pthread_mutex_lock(&pl->lock);
+
+  for (int i = 0; i < 2; i++) {
+    if ((pl->fh_in == NULL) && (exec_persistent_start(pl) != 0))
+      break;
+
+    exec_print_notification(pl->fh_in, n, /* single_line = */ true);
+
+    if ((fflush(pl->fh_in) == 0) && !ferror(pl->fh_in)) {
+      status = 0;
+      break;
+    }
+
+    WARNING("exec plugin: Passing a notification to `%s' failed: %s. "
+            "Restarting the program.",
+            pl->exec, STRERRNO);
+    exec_persistent_stop(pl);
+  }
+
+  pthread_mutex_unlock(&pl->lock);
+  return status;
+} /* int exec_notification_persistent }}} */
+
 static int exec_init(void) /* {{{ */
 {
   struct sigaction sa = {.sa_handler = sigchld_handler};
@@ -865,6 +1171,11 @@ static int exec_notification(const notification_t *n, /* {{{ */
     if ((pl->flags & PL_NOTIF_ACTION) == 0)
       continue;
 
+    if (pl->flags & PL_PERSISTENT) {
+      exec_notification_persistent(pl, n);
+      continue;
+    }
+
     /* Skip if a child is already running. */
     if (pl->pid != 0)
       continue;
@@ -904,6 +1215,13 @@ static int exec_shutdown(void) /* {{{ */
   while (pl != NULL) {
     next = pl->next;
 
+    if (pl->flags & PL_PERSISTENT) {
+      pthread_mutex_lock(&pl->lock);
+      exec_persistent_stop(pl);
+      pthread_mutex_unlock(&pl->lock);
+      pthread_mutex_destroy(&pl->lock);
+    }
+
     if (pl->pid > 0) {
       kill(pl->pid, SIGTERM);
       INFO("exec plugin: Sent SIGTERM to %hu", (unsigned short int)pl->pid);
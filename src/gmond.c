@@ -24,6 +24,9 @@
  *   Florian octo Forster <octo at collectd.org>
  **/
 
+/* _GNU_SOURCE is needed in Linux to use recvmmsg */
+#define _GNU_SOURCE
+
 #include "collectd.h"
 
 #include "plugin.h"
@@ -59,10 +62,19 @@
 #define BUFF_SIZE 1400
 #endif
 
+/* Maximum number of packets read with one recvmmsg(2) call. */
+#define MC_RECEIVE_BATCH 16
+
+/* Number of shards of the staging table, see staging_shard_get(). */
+#define STAGING_SHARDS_NUM 64
+
 struct socket_entry_s {
   int fd;
   struct sockaddr_storage addr;
   socklen_t addrlen;
+  /* Receiving sockets: index of the receiver reading from this socket, or -1
+   * if all receivers share it. */
+  int receiver;
 };
 typedef struct socket_entry_s socket_entry_t;
 
@@ -73,6 +85,42 @@ struct staging_entry_s {
 };
 typedef struct staging_entry_s staging_entry_t;
 
+/* The staging table is split into shards with a lock each, so that receivers
+ * updating different metrics don't contend on a single lock. */
+struct staging_shard_s {
+  c_avl_tree_t *tree;
+  pthread_mutex_t lock;
+};
+typedef struct staging_shard_s staging_shard_t;
+
+/* Copy of a completed staging entry, waiting to be dispatched. */
+struct dispatch_entry_s {
+  value_list_t vl;
+  size_t values_size;
+};
+typedef struct dispatch_entry_s dispatch_entry_t;
+
+/* Each receiver has a thread reading from its own set of sockets. With more
+ * than one receiver, unicast addresses are bound once per receiver using
+ * SO_REUSEPORT, so that the kernel distributes the packets. Multicast packets
+ * are delivered to every socket bound to the group, so multicast sockets are
+ * opened only once and shared by all receivers. Value lists completed while
+ * handling a batch of packets are dispatched after the batch, without holding
+ * any staging locks. */
+struct mc_receiver_s {
+  pthread_t thread;
+  bool thread_running;
+
+  struct pollfd *pollfd;
+  size_t pollfd_num;
+
+  char buffers[MC_RECEIVE_BATCH][BUFF_SIZE];
+
+  dispatch_entry_t dispatch[MC_RECEIVE_BATCH];
+  size_t dispatch_num;
+};
+typedef struct mc_receiver_s mc_receiver_t;
+
 struct metric_map_s {
   char *ganglia_name;
   char *type;
@@ -88,16 +136,18 @@ static char *mc_receive_group;
 #define MC_RECEIVE_PORT_DEFAULT "8649"
 static char *mc_receive_port;
 
-static struct pollfd *mc_receive_sockets;
+static size_t mc_receive_threads = 1;
+
+static socket_entry_t *mc_receive_sockets;
 static size_t mc_receive_sockets_num;
 
 static socket_entry_t *mc_send_sockets;
 static size_t mc_send_sockets_num;
 static pthread_mutex_t mc_send_sockets_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static int mc_receive_thread_loop;
-static int mc_receive_thread_running;
-static pthread_t mc_receive_thread_id;
+static mc_receiver_t *mc_receivers;
+static size_t mc_receivers_num;
+static bool mc_receive_thread_loop;
 
 static metric_map_t metric_map_default[] =
     {/*---------------+-------------+-----------+-------------+------+-----*
@@ -125,8 +175,7 @@ static size_t metric_map_len_default = STATIC_ARRAY_SIZE(metric_map_default);
 static metric_map_t *metric_map;
 static size_t metric_map_len;
 
-static c_avl_tree_t *staging_tree;
-static pthread_mutex_t staging_lock = PTHREAD_MUTEX_INITIALIZER;
+static staging_shard_t *staging_shards;
 
 static metric_map_t *metric_lookup(const char *key) /* {{{ */
 {
@@ -196,6 +245,117 @@ static metric_map_t *metric_lookup(const char *key) /* {{{ */
   return map + i;
 } /* }}} metric_map_t *metric_lookup */
 
+static bool addr_is_multicast(struct addrinfo const *ai) /* {{{ */
+{
+  if (ai->ai_family == AF_INET) {
+    struct sockaddr_in *addr = (struct sockaddr_in *)ai->ai_addr;
+    return IN_MULTICAST(ntohl(addr->sin_addr.s_addr));
+  } else if (ai->ai_family == AF_INET6) {
+    struct sockaddr_in6 *addr = (struct sockaddr_in6 *)ai->ai_addr;
+    return IN6_IS_ADDR_MULTICAST(&addr->sin6_addr);
+  }
+
+  return false;
+} /* }}} bool addr_is_multicast */
+
+static int create_socket(socket_entry_t *se, /* {{{ */
+                         struct addrinfo const *ai_ptr, int listen,
+                         bool reuse_port) {
+  int status;
+
+  se->fd = socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+  if (se->fd < 0) {
+    ERROR("gmond plugin: socket failed: %s", STRERRNO);
+    return -1;
+  }
+
+  assert(sizeof(se->addr) >= ai_ptr->ai_addrlen);
+  memcpy(&se->addr, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
+  se->addrlen = ai_ptr->ai_addrlen;
+  se->receiver = -1;
+
+  /* Sending socket: Don't bind it. */
+  if (listen == 0)
+    return 0;
+
+  status = setsockopt(se->fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+  if (status != 0) {
+    WARNING("gmond plugin: setsockopt(2) failed: %s", STRERRNO);
+  }
+
+#ifdef SO_REUSEPORT
+  if (reuse_port &&
+      (setsockopt(se->fd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int)) !=
+       0)) {
+    ERROR("gmond plugin: setsockopt (reuseport) failed: %s", STRERRNO);
+    close(se->fd);
+    return -1;
+  }
+#endif
+
+  status = bind(se->fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
+  if (status != 0) {
+    ERROR("gmond plugin: bind failed: %s", STRERRNO);
+    close(se->fd);
+    return -1;
+  }
+
+  if (!addr_is_multicast(ai_ptr))
+    return 0;
+
+  if (ai_ptr->ai_family == AF_INET) {
+    struct sockaddr_in *addr;
+    int loop;
+
+    addr = (struct sockaddr_in *)ai_ptr->ai_addr;
+
+    loop = 1;
+    status = setsockopt(se->fd, IPPROTO_IP, IP_MULTICAST_LOOP, (void *)&loop,
+                        sizeof(loop));
+    if (status != 0) {
+      WARNING("gmond plugin: setsockopt(2) failed: %s", STRERRNO);
+    }
+
+    struct ip_mreq mreq = {.imr_multiaddr.s_addr = addr->sin_addr.s_addr,
+                           .imr_interface.s_addr = htonl(INADDR_ANY)};
+
+    status = setsockopt(se->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, (void *)&mreq,
+                        sizeof(mreq));
+    if (status != 0) {
+      WARNING("gmond plugin: setsockopt(2) failed: %s", STRERRNO);
+    }
+  } /* if (ai_ptr->ai_family == AF_INET) */
+  else if (ai_ptr->ai_family == AF_INET6) {
+    struct sockaddr_in6 *addr;
+    int loop;
+
+    addr = (struct sockaddr_in6 *)ai_ptr->ai_addr;
+
+    loop = 1;
+    status = setsockopt(se->fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP,
+                        (void *)&loop, sizeof(loop));
+    if (status != 0) {
+      WARNING("gmond plugin: setsockopt(2) failed: %s", STRERRNO);
+    }
+
+    struct ipv6_mreq mreq = {
+        .ipv6mr_interface = 0 /* any */
+    };
+
+    memcpy(&mreq.ipv6mr_multiaddr, &addr->sin6_addr, sizeof(addr->sin6_addr));
+    status = setsockopt(se->fd, IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP,
+                        (void *)&mreq, sizeof(mreq));
+    if (status != 0) {
+      WARNING("gmond plugin: setsockopt(2) failed: %s", STRERRNO);
+    }
+  } /* if (ai_ptr->ai_family == AF_INET6) */
+
+  return 0;
+} /* }}} int create_socket */
+
+/* Opens one sending socket if "listen" is zero. Otherwise opens receiving
+ * sockets: one per receiver for each unicast address, and one shared by all
+ * receivers for each multicast address. */
 static int create_sockets(socket_entry_t **ret_sockets, /* {{{ */
                           size_t *ret_sockets_num, const char *node,
                           const char *service, int listen) {
@@ -205,8 +365,6 @@ static int create_sockets(socket_entry_t **ret_sockets, /* {{{ */
   socket_entry_t *sockets = NULL;
   size_t sockets_num = 0;
 
-  int status;
-
   if (*ret_sockets != NULL)
     return EINVAL;
 
@@ -227,103 +385,32 @@ static int create_sockets(socket_entry_t **ret_sockets, /* {{{ */
   for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
        ai_ptr = ai_ptr->ai_next) /* {{{ */
   {
-    socket_entry_t *tmp;
-
-    tmp = realloc(sockets, (sockets_num + 1) * sizeof(*sockets));
-    if (tmp == NULL) {
-      ERROR("gmond plugin: realloc failed.");
-      continue;
-    }
-    sockets = tmp;
-
-    sockets[sockets_num].fd =
-        socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
-    if (sockets[sockets_num].fd < 0) {
-      ERROR("gmond plugin: socket failed: %s", STRERRNO);
-      continue;
-    }
+    size_t copies = 1;
+    if ((listen != 0) && !addr_is_multicast(ai_ptr))
+      copies = mc_receive_threads;
 
-    assert(sizeof(sockets[sockets_num].addr) >= ai_ptr->ai_addrlen);
-    memcpy(&sockets[sockets_num].addr, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
-    sockets[sockets_num].addrlen = ai_ptr->ai_addrlen;
+    for (size_t i = 0; i < copies; i++) {
+      socket_entry_t *tmp;
 
-    /* Sending socket: Open only one socket and don't bind it. */
-    if (listen == 0) {
-      sockets_num++;
-      break;
-    } else {
-      status = setsockopt(sockets[sockets_num].fd, SOL_SOCKET, SO_REUSEADDR,
-                          &(int){1}, sizeof(int));
-      if (status != 0) {
-        WARNING("gmond plugin: setsockopt(2) failed: %s", STRERRNO);
-      }
-    }
-
-    status = bind(sockets[sockets_num].fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
-    if (status != 0) {
-      ERROR("gmond plugin: bind failed: %s", STRERRNO);
-      close(sockets[sockets_num].fd);
-      continue;
-    }
-
-    if (ai_ptr->ai_family == AF_INET) {
-      struct sockaddr_in *addr;
-      int loop;
-
-      addr = (struct sockaddr_in *)ai_ptr->ai_addr;
-
-      if (!IN_MULTICAST(ntohl(addr->sin_addr.s_addr))) {
-        sockets_num++;
+      tmp = realloc(sockets, (sockets_num + 1) * sizeof(*sockets));
+      if (tmp == NULL) {
+        ERROR("gmond plugin: realloc failed.");
         continue;
       }
+      sockets = tmp;
 
-      loop = 1;
-      status = setsockopt(sockets[sockets_num].fd, IPPROTO_IP,
-                          IP_MULTICAST_LOOP, (void *)&loop, sizeof(loop));
-      if (status != 0) {
-        WARNING("gmond plugin: setsockopt(2) failed: %s", STRERRNO);
-      }
-
-      struct ip_mreq mreq = {.imr_multiaddr.s_addr = addr->sin_addr.s_addr,
-                             .imr_interface.s_addr = htonl(INADDR_ANY)};
-
-      status = setsockopt(sockets[sockets_num].fd, IPPROTO_IP,
-                          IP_ADD_MEMBERSHIP, (void *)&mreq, sizeof(mreq));
-      if (status != 0) {
-        WARNING("gmond plugin: setsockopt(2) failed: %s", STRERRNO);
-      }
-    } /* if (ai_ptr->ai_family == AF_INET) */
-    else if (ai_ptr->ai_family == AF_INET6) {
-      struct sockaddr_in6 *addr;
-      int loop;
-
-      addr = (struct sockaddr_in6 *)ai_ptr->ai_addr;
-
-      if (!IN6_IS_ADDR_MULTICAST(&addr->sin6_addr)) {
-        sockets_num++;
+      if (create_socket(sockets + sockets_num, ai_ptr, listen,
+                        /* reuse_port = */ copies > 1) != 0)
         continue;
-      }
-
-      loop = 1;
-      status = setsockopt(sockets[sockets_num].fd, IPPROTO_IPV6,
-                          IPV6_MULTICAST_LOOP, (void *)&loop, sizeof(loop));
-      if (status != 0) {
-        WARNING("gmond plugin: setsockopt(2) failed: %s", STRERRNO);
-      }
-
-      struct ipv6_mreq mreq = {
-          .ipv6mr_interface = 0 /* any */
-      };
 
-      memcpy(&mreq.ipv6mr_multiaddr, &addr->sin6_addr, sizeof(addr->sin6_addr));
-      status = setsockopt(sockets[sockets_num].fd, IPPROTO_IPV6,
-                          IPV6_ADD_MEMBERSHIP, (void *)&mreq, sizeof(mreq));
-      if (status != 0) {
-        WARNING("gmond plugin: setsockopt(2) failed: %s", STRERRNO);
-      }
-    } /* if (ai_ptr->ai_family == AF_INET6) */
+      if ((listen != 0) && !addr_is_multicast(ai_ptr))
+        sockets[sockets_num].receiver = (int)i;
+      sockets_num++;
+    }
 
-    sockets_num++;
+    /* Sending socket: Open only one socket. */
+    if ((listen == 0) && (sockets_num > 0))
+      break;
   } /* }}} for (ai_ptr = ai_list; ai_ptr != NULL; ai_ptr = ai_ptr->ai_next) */
 
   freeaddrinfo(ai_list);
@@ -386,22 +473,42 @@ static int request_meta_data(const char *host, const char *name) /* {{{ */
   return 0;
 } /* }}} int request_meta_data */
 
-static staging_entry_t *staging_entry_get(const char *host, /* {{{ */
-                                          const char *name, const char *type,
+static void staging_key(char *buffer, size_t buffer_size, /* {{{ */
+                        const char *host, const char *type,
+                        const char *type_instance) {
+  ssnprintf(buffer, buffer_size, "%s/%s/%s", host, type,
+            (type_instance != NULL) ? type_instance : "");
+} /* }}} void staging_key */
+
+/* Returns the shard responsible for "key", using the FNV-1a hash of the key.
+ * Returns NULL if the staging table has not been created. */
+static staging_shard_t *staging_shard_get(const char *key) /* {{{ */
+{
+  uint32_t hash = 2166136261u;
+
+  if (staging_shards == NULL)
+    return NULL;
+
+  for (const unsigned char *ptr = (const unsigned char *)key; *ptr != 0;
+       ptr++) {
+    hash ^= (uint32_t)*ptr;
+    hash *= 16777619u;
+  }
+
+  return staging_shards + (hash % STAGING_SHARDS_NUM);
+} /* }}} staging_shard_t *staging_shard_get */
+
+/* Must be called with the shard's lock held. */
+static staging_entry_t *staging_entry_get(staging_shard_t *shard, /* {{{ */
+                                          const char *key, const char *host,
+                                          const char *type,
                                           const char *type_instance,
                                           int values_len) {
-  char key[2 * DATA_MAX_NAME_LEN];
   staging_entry_t *se;
   int status;
 
-  if (staging_tree == NULL)
-    return NULL;
-
-  ssnprintf(key, sizeof(key), "%s/%s/%s", host, type,
-            (type_instance != NULL) ? type_instance : "");
-
   se = NULL;
-  status = c_avl_get(staging_tree, key, (void *)&se);
+  status = c_avl_get(shard->tree, key, (void *)&se);
   if (status == 0)
     return se;
 
@@ -428,7 +535,7 @@ static staging_entry_t *staging_entry_get(const char *host, /* {{{ */
   if (type_instance != NULL)
     sstrncpy(se->vl.type_instance, type_instance, sizeof(se->vl.type_instance));
 
-  status = c_avl_insert(staging_tree, se->key, se);
+  status = c_avl_insert(shard->tree, se->key, se);
   if (status != 0) {
     ERROR("gmond plugin: c_avl_insert failed.");
     sfree(se->vl.values);
@@ -439,11 +546,61 @@ static staging_entry_t *staging_entry_get(const char *host, /* {{{ */
   return se;
 } /* }}} staging_entry_t *staging_entry_get */
 
-static int staging_entry_update(const char *host, const char *name, /* {{{ */
+static void staging_entry_free(staging_entry_t *se) /* {{{ */
+{
+  if (se == NULL)
+    return;
+
+  sfree(se->vl.values);
+  sfree(se);
+} /* }}} void staging_entry_free */
+
+/* Copies "vl" to the receiver's dispatch queue. Must be called with the lock
+ * of the staging shard holding "vl" held. */
+static int mc_dispatch_enqueue(mc_receiver_t *r, /* {{{ */
+                               const value_list_t *vl) {
+  dispatch_entry_t *de;
+
+  /* Each packet completes at most one value list, so this only happens if
+   * the batch is dispatched late. */
+  if (r->dispatch_num >= STATIC_ARRAY_SIZE(r->dispatch))
+    return plugin_dispatch_values(vl);
+
+  de = r->dispatch + r->dispatch_num;
+  if (de->values_size < vl->values_len) {
+    value_t *tmp = realloc(de->vl.values, vl->values_len * sizeof(*tmp));
+    if (tmp == NULL) {
+      ERROR("gmond plugin: realloc failed.");
+      return -1;
+    }
+    de->vl.values = tmp;
+    de->values_size = vl->values_len;
+  }
+
+  value_t *values = de->vl.values;
+  de->vl = *vl;
+  de->vl.values = values;
+  memcpy(de->vl.values, vl->values, vl->values_len * sizeof(*vl->values));
+
+  r->dispatch_num++;
+  return 0;
+} /* }}} int mc_dispatch_enqueue */
+
+static void mc_dispatch_flush(mc_receiver_t *r) /* {{{ */
+{
+  for (size_t i = 0; i < r->dispatch_num; i++)
+    plugin_dispatch_values(&r->dispatch[i].vl);
+  r->dispatch_num = 0;
+} /* }}} void mc_dispatch_flush */
+
+static int staging_entry_update(mc_receiver_t *r, /* {{{ */
+                                const char *host, const char *name,
                                 const char *type, const char *type_instance,
                                 size_t ds_index, int ds_type, value_t value) {
   const data_set_t *ds;
+  staging_shard_t *shard;
   staging_entry_t *se;
+  char key[2 * DATA_MAX_NAME_LEN];
 
   ds = plugin_get_ds(type);
   if (ds == NULL) {
@@ -458,16 +615,21 @@ static int staging_entry_update(const char *host, const char *name, /* {{{ */
     return -1;
   }
 
-  pthread_mutex_lock(&staging_lock);
+  staging_key(key, sizeof(key), host, type, type_instance);
+  shard = staging_shard_get(key);
+  if (shard == NULL)
+    return -1;
 
-  se = staging_entry_get(host, name, type, type_instance, ds->ds_num);
+  pthread_mutex_lock(&shard->lock);
+
+  se = staging_entry_get(shard, key, host, type, type_instance, ds->ds_num);
   if (se == NULL) {
-    pthread_mutex_unlock(&staging_lock);
+    pthread_mutex_unlock(&shard->lock);
     ERROR("gmond plugin: staging_entry_get failed.");
     return -1;
   }
   if (se->vl.values_len != ds->ds_num) {
-    pthread_mutex_unlock(&staging_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -1;
   }
 
@@ -486,7 +648,7 @@ static int staging_entry_update(const char *host, const char *name, /* {{{ */
 
   /* Check if all data sources have been set. If not, return here. */
   if (se->flags != ((0x01 << se->vl.values_len) - 1)) {
-    pthread_mutex_unlock(&staging_lock);
+    pthread_mutex_unlock(&shard->lock);
     return 0;
   }
 
@@ -495,22 +657,22 @@ static int staging_entry_update(const char *host, const char *name, /* {{{ */
   if (se->vl.interval == 0) {
     /* No meta data has been received for this metric yet. */
     se->flags = 0;
-    pthread_mutex_unlock(&staging_lock);
+    pthread_mutex_unlock(&shard->lock);
 
     request_meta_data(host, name);
     return 0;
   }
 
-  plugin_dispatch_values(&se->vl);
+  mc_dispatch_enqueue(r, &se->vl);
 
   se->flags = 0;
-  pthread_mutex_unlock(&staging_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return 0;
 } /* }}} int staging_entry_update */
 
-static int mc_handle_value_msg(Ganglia_value_msg *msg) /* {{{ */
-{
+static int mc_handle_value_msg(mc_receiver_t *r, /* {{{ */
+                               Ganglia_value_msg *msg) {
   const char *host;
   const char *name;
   metric_map_t *map;
@@ -606,7 +768,7 @@ static int mc_handle_value_msg(Ganglia_value_msg *msg) /* {{{ */
     else
       assert(23 == 42);
 
-    return staging_entry_update(host, name, map->type, map->type_instance,
+    return staging_entry_update(r, host, name, map->type, map->type_instance,
                                 map->ds_index, map->ds_type, val_copy);
   }
 
@@ -619,9 +781,11 @@ static int mc_handle_metadata_msg(Ganglia_metadata_msg *msg) /* {{{ */
   switch (msg->id) {
   case gmetadata_full: {
     Ganglia_metadatadef msg_meta;
+    staging_shard_t *shard;
     staging_entry_t *se;
     const data_set_t *ds;
     metric_map_t *map;
+    char key[2 * DATA_MAX_NAME_LEN];
 
     msg_meta = msg->Ganglia_metadata_msg_u.gfull;
 
@@ -644,12 +808,18 @@ static int mc_handle_metadata_msg(Ganglia_metadata_msg *msg) /* {{{ */
     DEBUG("gmond plugin: Received meta data for %s/%s.",
           msg_meta.metric_id.host, msg_meta.metric_id.name);
 
-    pthread_mutex_lock(&staging_lock);
-    se = staging_entry_get(msg_meta.metric_id.host, msg_meta.metric_id.name,
-                           map->type, map->type_instance, ds->ds_num);
+    staging_key(key, sizeof(key), msg_meta.metric_id.host, map->type,
+                map->type_instance);
+    shard = staging_shard_get(key);
+    if (shard == NULL)
+      return -1;
+
+    pthread_mutex_lock(&shard->lock);
+    se = staging_entry_get(shard, key, msg_meta.metric_id.host, map->type,
+                           map->type_instance, ds->ds_num);
     if (se != NULL)
       se->vl.interval = TIME_T_TO_CDTIME_T(msg_meta.metric.tmax);
-    pthread_mutex_unlock(&staging_lock);
+    pthread_mutex_unlock(&shard->lock);
 
     if (se == NULL) {
       ERROR("gmond plugin: staging_entry_get failed.");
@@ -665,8 +835,8 @@ static int mc_handle_metadata_msg(Ganglia_metadata_msg *msg) /* {{{ */
   return 0;
 } /* }}} int mc_handle_metadata_msg */
 
-static int mc_handle_metric(void *buffer, size_t buffer_size) /* {{{ */
-{
+static int mc_handle_metric(mc_receiver_t *r, void *buffer, /* {{{ */
+                            size_t buffer_size) {
   XDR xdr;
   Ganglia_msg_formats format;
 
@@ -686,7 +856,7 @@ static int mc_handle_metric(void *buffer, size_t buffer_size) /* {{{ */
     Ganglia_value_msg msg = {0};
 
     if (xdr_Ganglia_value_msg(&xdr, &msg))
-      mc_handle_value_msg(&msg);
+      mc_handle_value_msg(r, &msg);
     break;
   }
 
@@ -706,63 +876,79 @@ static int mc_handle_metric(void *buffer, size_t buffer_size) /* {{{ */
   return 0;
 } /* }}} int mc_handle_metric */
 
-static int mc_handle_socket(struct pollfd *p) /* {{{ */
+/* Reads up to MC_RECEIVE_BATCH packets into the receiver's buffers and returns
+ * the number of packets read, or -1 on error. */
+static int mc_receive(mc_receiver_t *r, int fd, size_t *sizes) /* {{{ */
 {
-  char buffer[BUFF_SIZE];
-  ssize_t buffer_size;
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[MC_RECEIVE_BATCH];
+  struct iovec iovs[MC_RECEIVE_BATCH];
+
+  memset(msgs, 0, sizeof(msgs));
+  for (size_t i = 0; i < MC_RECEIVE_BATCH; i++) {
+    iovs[i].iov_base = r->buffers[i];
+    iovs[i].iov_len = sizeof(r->buffers[i]);
+    msgs[i].msg_hdr.msg_iov = iovs + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int status = recvmmsg(fd, msgs, MC_RECEIVE_BATCH, MSG_DONTWAIT,
+                        /* timeout = */ NULL);
+  if (status < 0)
+    return -1;
+
+  for (int i = 0; i < status; i++)
+    sizes[i] = (size_t)msgs[i].msg_len;
+
+  return status;
+#else
+  ssize_t status = recv(fd, r->buffers[0], sizeof(r->buffers[0]),
+                        /* flags = */ MSG_DONTWAIT);
+  if (status < 0)
+    return -1;
+
+  sizes[0] = (size_t)status;
+  return 1;
+#endif
+} /* }}} int mc_receive */
+
+static int mc_handle_socket(mc_receiver_t *r, struct pollfd *p) /* {{{ */
+{
+  size_t sizes[MC_RECEIVE_BATCH];
+  int num;
 
   if ((p->revents & (POLLIN | POLLPRI)) == 0) {
     p->revents = 0;
     return -1;
   }
+  p->revents = 0;
+
+  num = mc_receive(r, p->fd, sizes);
+  if (num < 0) {
+    /* Shared sockets are polled by all receivers, so another receiver may
+     * have read the packet first. */
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+      return 0;
 
-  buffer_size = recv(p->fd, buffer, sizeof(buffer), /* flags = */ 0);
-  if (buffer_size <= 0) {
     ERROR("gmond plugin: recv failed: %s", STRERRNO);
-    p->revents = 0;
     return -1;
   }
 
-  mc_handle_metric(buffer, (size_t)buffer_size);
+  for (int i = 0; i < num; i++)
+    if (sizes[i] > 0)
+      mc_handle_metric(r, r->buffers[i], sizes[i]);
+
+  mc_dispatch_flush(r);
   return 0;
 } /* }}} int mc_handle_socket */
 
 static void *mc_receive_thread(void *arg) /* {{{ */
 {
-  socket_entry_t *mc_receive_socket_entries;
+  mc_receiver_t *r = arg;
   int status;
 
-  mc_receive_socket_entries = NULL;
-  status = create_sockets(
-      &mc_receive_socket_entries, &mc_receive_sockets_num,
-      (mc_receive_group != NULL) ? mc_receive_group : MC_RECEIVE_GROUP_DEFAULT,
-      (mc_receive_port != NULL) ? mc_receive_port : MC_RECEIVE_PORT_DEFAULT,
-      /* listen = */ 1);
-  if (status != 0) {
-    ERROR("gmond plugin: create_sockets failed.");
-    return (void *)-1;
-  }
-
-  mc_receive_sockets =
-      calloc(mc_receive_sockets_num, sizeof(*mc_receive_sockets));
-  if (mc_receive_sockets == NULL) {
-    ERROR("gmond plugin: calloc failed.");
-    for (size_t i = 0; i < mc_receive_sockets_num; i++)
-      close(mc_receive_socket_entries[i].fd);
-    free(mc_receive_socket_entries);
-    mc_receive_socket_entries = NULL;
-    mc_receive_sockets_num = 0;
-    return (void *)-1;
-  }
-
-  for (size_t i = 0; i < mc_receive_sockets_num; i++) {
-    mc_receive_sockets[i].fd = mc_receive_socket_entries[i].fd;
-    mc_receive_sockets[i].events = POLLIN | POLLPRI;
-    mc_receive_sockets[i].revents = 0;
-  }
-
-  while (mc_receive_thread_loop != 0) {
-    status = poll(mc_receive_sockets, mc_receive_sockets_num, -1);
+  while (mc_receive_thread_loop) {
+    status = poll(r->pollfd, r->pollfd_num, -1);
     if (status <= 0) {
       if (errno == EINTR)
         continue;
@@ -770,50 +956,119 @@ static void *mc_receive_thread(void *arg) /* {{{ */
       break;
     }
 
-    for (size_t i = 0; i < mc_receive_sockets_num; i++) {
-      if (mc_receive_sockets[i].revents != 0)
-        mc_handle_socket(mc_receive_sockets + i);
+    for (size_t i = 0; i < r->pollfd_num; i++) {
+      if (r->pollfd[i].revents != 0)
+        mc_handle_socket(r, r->pollfd + i);
     }
-  } /* while (mc_receive_thread_loop != 0) */
+  } /* while (mc_receive_thread_loop) */
 
-  free(mc_receive_socket_entries);
   return (void *)0;
 } /* }}} void *mc_receive_thread */
 
+static void mc_receivers_free(void) /* {{{ */
+{
+  for (size_t i = 0; i < mc_receivers_num; i++) {
+    mc_receiver_t *r = mc_receivers + i;
+
+    sfree(r->pollfd);
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(r->dispatch); j++)
+      sfree(r->dispatch[j].vl.values);
+  }
+  sfree(mc_receivers);
+  mc_receivers_num = 0;
+
+  for (size_t i = 0; i < mc_receive_sockets_num; i++)
+    close(mc_receive_sockets[i].fd);
+  sfree(mc_receive_sockets);
+  mc_receive_sockets_num = 0;
+} /* }}} void mc_receivers_free */
+
 static int mc_receive_thread_start(void) /* {{{ */
 {
   int status;
 
-  if (mc_receive_thread_running != 0)
+  if (mc_receivers != NULL)
     return -1;
 
-  mc_receive_thread_loop = 1;
-
-  status = plugin_thread_create(&mc_receive_thread_id, mc_receive_thread,
-                                /* args = */ NULL, "gmond recv");
+  status = create_sockets(
+      &mc_receive_sockets, &mc_receive_sockets_num,
+      (mc_receive_group != NULL) ? mc_receive_group : MC_RECEIVE_GROUP_DEFAULT,
+      (mc_receive_port != NULL) ? mc_receive_port : MC_RECEIVE_PORT_DEFAULT,
+      /* listen = */ 1);
   if (status != 0) {
-    ERROR("gmond plugin: Starting receive thread failed.");
-    mc_receive_thread_loop = 0;
+    ERROR("gmond plugin: create_sockets failed.");
+    return -1;
+  }
+
+  mc_receivers = calloc(mc_receive_threads, sizeof(*mc_receivers));
+  if (mc_receivers == NULL) {
+    ERROR("gmond plugin: calloc failed.");
+    mc_receivers_free();
     return -1;
   }
+  mc_receivers_num = mc_receive_threads;
+
+  /* Hand each receiver its own sockets plus the shared ones. */
+  for (size_t i = 0; i < mc_receivers_num; i++) {
+    mc_receiver_t *r = mc_receivers + i;
+
+    r->pollfd = calloc(mc_receive_sockets_num, sizeof(*r->pollfd));
+    if (r->pollfd == NULL) {
+      ERROR("gmond plugin: calloc failed.");
+      mc_receivers_free();
+      return -1;
+    }
+
+    for (size_t j = 0; j < mc_receive_sockets_num; j++) {
+      socket_entry_t *se = mc_receive_sockets + j;
+      if ((se->receiver >= 0) && ((size_t)se->receiver != i))
+        continue;
+
+      r->pollfd[r->pollfd_num] = (struct pollfd){
+          .fd = se->fd,
+          .events = POLLIN | POLLPRI,
+      };
+      r->pollfd_num++;
+    }
+  }
+
+  mc_receive_thread_loop = true;
+
+  for (size_t i = 0; i < mc_receivers_num; i++) {
+    mc_receiver_t *r = mc_receivers + i;
+
+    status = plugin_thread_create(&r->thread, mc_receive_thread, r,
+                                  "gmond recv");
+    if (status != 0) {
+      ERROR("gmond plugin: Starting receive thread failed.");
+      continue;
+    }
+    r->thread_running = true;
+  }
 
-  mc_receive_thread_running = 1;
   return 0;
-} /* }}} int start_receive_thread */
+} /* }}} int mc_receive_thread_start */
 
 static int mc_receive_thread_stop(void) /* {{{ */
 {
-  if (mc_receive_thread_running == 0)
+  if (mc_receivers == NULL)
     return -1;
 
-  mc_receive_thread_loop = 0;
+  mc_receive_thread_loop = false;
 
-  INFO("gmond plugin: Stopping receive thread.");
-  pthread_kill(mc_receive_thread_id, SIGTERM);
-  pthread_join(mc_receive_thread_id, /* return value = */ NULL);
-  memset(&mc_receive_thread_id, 0, sizeof(mc_receive_thread_id));
+  INFO("gmond plugin: Stopping receive threads.");
+  for (size_t i = 0; i < mc_receivers_num; i++) {
+    mc_receiver_t *r = mc_receivers + i;
 
-  mc_receive_thread_running = 0;
+    if (!r->thread_running)
+      continue;
+
+    pthread_kill(r->thread, SIGTERM);
+    pthread_join(r->thread, /* return value = */ NULL);
+    r->thread_running = false;
+  }
+
+  mc_receivers_free();
 
   return 0;
 } /* }}} int mc_receive_thread_stop */
@@ -823,6 +1078,7 @@ static int mc_receive_thread_stop(void) /* {{{ */
  *
  * <Plugin gmond>
  *   MCReceiveFrom "239.2.11.71" "8649"
+ *   ReceiveThreads 1
  *   <Metric "load_one">
  *     Type "load"
  *     [TypeInstance "foo"]
@@ -927,12 +1183,38 @@ static int gmond_config_set_address(oconfig_item_t *ci, /* {{{ */
   return 0;
 } /* }}} int gmond_config_set_address */
 
+static int gmond_config_set_receive_threads(oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+
+  if (tmp < 1) {
+    WARNING("gmond plugin: The `ReceiveThreads' option must be at least 1.");
+    return -1;
+  }
+
+#ifndef SO_REUSEPORT
+  if (tmp > 1) {
+    WARNING("gmond plugin: `ReceiveThreads' requires SO_REUSEPORT, which "
+            "is not available on this system. Using one receive thread.");
+    tmp = 1;
+  }
+#endif
+
+  mc_receive_threads = (size_t)tmp;
+  return 0;
+} /* }}} int gmond_config_set_receive_threads */
+
 static int gmond_config(oconfig_item_t *ci) /* {{{ */
 {
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
     if (strcasecmp("MCReceiveFrom", child->key) == 0)
       gmond_config_set_address(child, &mc_receive_group, &mc_receive_port);
+    else if (strcasecmp("ReceiveThreads", child->key) == 0)
+      gmond_config_set_receive_threads(child);
     else if (strcasecmp("Metric", child->key) == 0)
       gmond_config_add_metric(child);
     else {
@@ -952,12 +1234,22 @@ static int gmond_init(void) /* {{{ */
       (mc_receive_port != NULL) ? mc_receive_port : MC_RECEIVE_PORT_DEFAULT,
       /* listen = */ 0);
 
-  staging_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
-  if (staging_tree == NULL) {
-    ERROR("gmond plugin: c_avl_create failed.");
+  staging_shards = calloc(STAGING_SHARDS_NUM, sizeof(*staging_shards));
+  if (staging_shards == NULL) {
+    ERROR("gmond plugin: calloc failed.");
     return -1;
   }
 
+  for (size_t i = 0; i < STAGING_SHARDS_NUM; i++) {
+    staging_shards[i].tree =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (staging_shards[i].tree == NULL) {
+      ERROR("gmond plugin: c_avl_create failed.");
+      return -1;
+    }
+    pthread_mutex_init(&staging_shards[i].lock, /* attr = */ NULL);
+  }
+
   mc_receive_thread_start();
 
   return 0;
@@ -976,6 +1268,23 @@ static int gmond_shutdown(void) /* {{{ */
   mc_send_sockets_num = 0;
   pthread_mutex_unlock(&mc_send_sockets_lock);
 
+  if (staging_shards != NULL) {
+    for (size_t i = 0; i < STAGING_SHARDS_NUM; i++) {
+      staging_shard_t *shard = staging_shards + i;
+      staging_entry_t *se;
+      char *key;
+
+      if (shard->tree == NULL)
+        continue;
+
+      while (c_avl_pick(shard->tree, (void *)&key, (void *)&se) == 0)
+        staging_entry_free(se);
+      c_avl_destroy(shard->tree);
+      pthread_mutex_destroy(&shard->lock);
+    }
+    sfree(staging_shards);
+  }
+
   return 0;
 } /* }}} int gmond_shutdown */
 
@@ -30,9 +30,6 @@ SOFTWARE.
 
 #define PLUGIN_NAME "gpu_nvidia"
 
-static nvmlReturn_t nv_status = NVML_SUCCESS;
-static char *nv_errline = "";
-
 #define TRY_CATCH(f, catch)                                                    \
   if ((nv_status = f) != NVML_SUCCESS) {                                       \
     nv_errline = #f;                                                           \
@@ -53,10 +50,11 @@ static char *nv_errline = "";
 #define KEY_IGNORESELECTED "IgnoreSelected"
 #define KEY_INSTANCE_BY_GPUINDEX "InstanceByGPUIndex"
 #define KEY_INSTANCE_BY_GPUNAME "InstanceByGPUName"
+#define KEY_METRIC "Metric"
 
 static const char *config_keys[] = {KEY_GPUINDEX, KEY_IGNORESELECTED,
                                     KEY_INSTANCE_BY_GPUINDEX,
-                                    KEY_INSTANCE_BY_GPUNAME};
+                                    KEY_INSTANCE_BY_GPUNAME, KEY_METRIC};
 static const unsigned int n_config_keys = STATIC_ARRAY_SIZE(config_keys);
 
 // This is a bitflag, necessitating the (extremely conservative) assumption
@@ -69,6 +67,52 @@ static bool conf_mask_is_exclude = 0;
 #define INSTANCE_BY_GPUNAME (1 << 1)
 static uint8_t instance_by = INSTANCE_BY_GPUINDEX | INSTANCE_BY_GPUNAME;
 
+// Metrics to collect, selected with the "Metric" option.
+#define METRIC_MEMORY (1 << 0)
+#define METRIC_UTILIZATION (1 << 1)
+#define METRIC_FANSPEED (1 << 2)
+#define METRIC_TEMPERATURE (1 << 3)
+#define METRIC_SM_CLOCK (1 << 4)
+#define METRIC_MEMORY_CLOCK (1 << 5)
+#define METRIC_POWER (1 << 6)
+// These are read with a single nvmlDeviceGetFieldValues() call.
+#define METRIC_MEMORY_TEMPERATURE (1 << 7)
+#define METRIC_ENERGY (1 << 8)
+#define METRIC_DEFAULT                                                         \
+  (METRIC_MEMORY | METRIC_UTILIZATION | METRIC_FANSPEED | METRIC_TEMPERATURE | \
+   METRIC_SM_CLOCK | METRIC_MEMORY_CLOCK | METRIC_POWER)
+
+static struct {
+  const char *name;
+  unsigned int flag;
+} metric_names[] = {
+    {"memory", METRIC_MEMORY},
+    {"gpu_used", METRIC_UTILIZATION},
+    {"fanspeed", METRIC_FANSPEED},
+    {"temperature", METRIC_TEMPERATURE},
+    {"sm_clock", METRIC_SM_CLOCK},
+    {"memory_clock", METRIC_MEMORY_CLOCK},
+    {"power", METRIC_POWER},
+    {"memory_temperature", METRIC_MEMORY_TEMPERATURE},
+    {"energy", METRIC_ENERGY},
+};
+
+static unsigned int conf_metrics = METRIC_DEFAULT;
+static bool conf_metrics_set = false;
+
+// Devices are looked up once, at init. Each device is read by its own read
+// callback, so that the (slow) NVML queries of several GPUs run in parallel
+// on collectd's read threads.
+typedef struct {
+  unsigned int index;
+  nvmlDevice_t dev;
+  char name[NVML_DEVICE_NAME_BUFFER_SIZE];
+  char cb_name[DATA_MAX_NAME_LEN];
+} nvml_device_t;
+
+static nvml_device_t *nv_devices;
+static size_t nv_devices_num;
+
 static int nvml_config(const char *key, const char *value) {
   if (strcasecmp(key, KEY_GPUINDEX) == 0) {
     char *eptr;
@@ -95,6 +139,24 @@ static int nvml_config(const char *key, const char *value) {
     if (IS_FALSE(value)) {
       instance_by &= ~INSTANCE_BY_GPUNAME;
     }
+  } else if (strcasecmp(key, KEY_METRIC) == 0) {
+    // the first "Metric" option replaces the default set
+    if (!conf_metrics_set) {
+      conf_metrics = 0;
+      conf_metrics_set = true;
+    }
+
+    size_t i;
+    for (i = 0; i < STATIC_ARRAY_SIZE(metric_names); i++) {
+      if (strcasecmp(value, metric_names[i].name) == 0) {
+        conf_metrics |= metric_names[i].flag;
+        break;
+      }
+    }
+    if (i == STATIC_ARRAY_SIZE(metric_names)) {
+      ERROR(PLUGIN_NAME ": Unknown metric \"%s\"", value);
+      return -1;
+    }
   } else {
     ERROR(PLUGIN_NAME ": Unrecognized config option %s", key);
     return -10;
@@ -103,22 +165,6 @@ static int nvml_config(const char *key, const char *value) {
   return 0;
 }
 
-static int nvml_init(void) {
-  TRY(nvmlInit());
-  return 0;
-
-  catch : ERROR(PLUGIN_NAME ": NVML init failed with %d", nv_status);
-  return -1;
-}
-
-static int nvml_shutdown(void) {
-  TRY(nvmlShutdown())
-  return 0;
-
-  catch : ERROR(PLUGIN_NAME ": NVML shutdown failed with %d", nv_status);
-  return -1;
-}
-
 static void nvml_submit_gauge(int device_idx, const char *device_name,
                               const char *type, const char *type_instance,
                               gauge_t nvml) {
@@ -149,94 +195,224 @@ static void nvml_submit_gauge(int device_idx, const char *device_name,
   plugin_dispatch_values(&vl);
 }
 
-static int nvml_read(void) {
+#if defined(NVML_FI_DEV_MEMORY_TEMP) &&                                        \
+    defined(NVML_FI_DEV_TOTAL_ENERGY_CONSUMPTION)
+#define HAVE_NVML_FIELD_VALUES 1
+
+static gauge_t nvml_field_to_gauge(nvmlFieldValue_t const *fv) {
+  if (fv->nvmlReturn != NVML_SUCCESS)
+    return NAN;
+
+  switch (fv->valueType) {
+  case NVML_VALUE_TYPE_DOUBLE:
+    return (gauge_t)fv->value.dVal;
+  case NVML_VALUE_TYPE_UNSIGNED_INT:
+    return (gauge_t)fv->value.uiVal;
+  case NVML_VALUE_TYPE_UNSIGNED_LONG:
+    return (gauge_t)fv->value.ulVal;
+  case NVML_VALUE_TYPE_UNSIGNED_LONG_LONG:
+    return (gauge_t)fv->value.ullVal;
+  default:
+    return NAN;
+  }
+}
 
-  unsigned int device_count;
-  TRY_CATCH(nvmlDeviceGetCount(&device_count), catch_nocount);
+// Reads all metrics that are available as NVML fields in a single call.
+static nvmlReturn_t nvml_read_fields(nvml_device_t const *d) {
+  nvmlFieldValue_t fv[2] = {{0}};
+  int fv_num = 0;
+
+  if (conf_metrics & METRIC_MEMORY_TEMPERATURE)
+    fv[fv_num++].fieldId = NVML_FI_DEV_MEMORY_TEMP;
+  if (conf_metrics & METRIC_ENERGY)
+    fv[fv_num++].fieldId = NVML_FI_DEV_TOTAL_ENERGY_CONSUMPTION;
+  if (fv_num == 0)
+    return NVML_SUCCESS;
+
+  nvmlReturn_t status = nvmlDeviceGetFieldValues(d->dev, fv_num, fv);
+  if (status != NVML_SUCCESS)
+    return status;
+
+  for (int i = 0; i < fv_num; i++) {
+    gauge_t value = nvml_field_to_gauge(fv + i);
+    if (isnan(value))
+      continue;
 
-  if (device_count > 64) {
-    device_count = 64;
+    if (fv[i].fieldId == NVML_FI_DEV_MEMORY_TEMP)
+      nvml_submit_gauge(d->index, d->name, "temperature", "memory", value);
+    else if (fv[i].fieldId == NVML_FI_DEV_TOTAL_ENERGY_CONSUMPTION)
+      // millijoules since the driver was loaded
+      nvml_submit_gauge(d->index, d->name, "energy", NULL, 1e-3 * value);
   }
 
-  for (unsigned int ix = 0; ix < device_count; ix++) {
-
-    unsigned int is_match =
-        ((1 << ix) & conf_match_mask) || (conf_match_mask == 0);
-    if (conf_mask_is_exclude == !!is_match) {
-      continue;
-    }
+  return NVML_SUCCESS;
+}
+#endif /* NVML_FI_DEV_MEMORY_TEMP && NVML_FI_DEV_TOTAL_ENERGY_CONSUMPTION */
 
-    nvmlDevice_t dev;
-    TRY(nvmlDeviceGetHandleByIndex(ix, &dev));
+static int nvml_read_device(user_data_t *ud) {
+  nvml_device_t const *d = ud->data;
+  nvmlDevice_t dev = d->dev;
+  unsigned int ix = d->index;
+  const char *dev_name = d->name;
 
-    char dev_name[NVML_DEVICE_NAME_BUFFER_SIZE] = {0};
-    if (instance_by & INSTANCE_BY_GPUNAME) {
-      TRY(nvmlDeviceGetName(dev, dev_name, NVML_DEVICE_NAME_BUFFER_SIZE));
-    }
+  nvmlReturn_t nv_status = NVML_SUCCESS;
+  char *nv_errline = "";
 
-    // Try to be as lenient as possible with the variety of devices that are
-    // out there, ignoring any NOT_SUPPORTED errors gently.
+  // Try to be as lenient as possible with the variety of devices that are
+  // out there, ignoring any NOT_SUPPORTED errors gently.
+  if (conf_metrics & METRIC_MEMORY) {
     nvmlMemory_t meminfo;
     TRYOPT(nvmlDeviceGetMemoryInfo(dev, &meminfo))
     if (nv_status == NVML_SUCCESS) {
       nvml_submit_gauge(ix, dev_name, "memory", "used", meminfo.used);
       nvml_submit_gauge(ix, dev_name, "memory", "free", meminfo.free);
     }
+  }
 
+  if (conf_metrics & METRIC_UTILIZATION) {
     nvmlUtilization_t utilization;
     TRYOPT(nvmlDeviceGetUtilizationRates(dev, &utilization))
     if (nv_status == NVML_SUCCESS)
       nvml_submit_gauge(ix, dev_name, "percent", "gpu_used", utilization.gpu);
+  }
 
+  if (conf_metrics & METRIC_FANSPEED) {
     unsigned int fan_speed;
     TRYOPT(nvmlDeviceGetFanSpeed(dev, &fan_speed))
     if (nv_status == NVML_SUCCESS)
       nvml_submit_gauge(ix, dev_name, "fanspeed", NULL, fan_speed);
+  }
 
+  if (conf_metrics & METRIC_TEMPERATURE) {
     unsigned int core_temp;
     TRYOPT(nvmlDeviceGetTemperature(dev, NVML_TEMPERATURE_GPU, &core_temp))
     if (nv_status == NVML_SUCCESS)
       nvml_submit_gauge(ix, dev_name, "temperature", "core", core_temp);
+  }
 
+  if (conf_metrics & METRIC_SM_CLOCK) {
     unsigned int sm_clk_mhz;
     TRYOPT(nvmlDeviceGetClockInfo(dev, NVML_CLOCK_SM, &sm_clk_mhz))
     if (nv_status == NVML_SUCCESS)
       nvml_submit_gauge(ix, dev_name, "frequency", "multiprocessor",
                         1e6 * sm_clk_mhz);
+  }
 
+  if (conf_metrics & METRIC_MEMORY_CLOCK) {
     unsigned int mem_clk_mhz;
     TRYOPT(nvmlDeviceGetClockInfo(dev, NVML_CLOCK_MEM, &mem_clk_mhz))
     if (nv_status == NVML_SUCCESS)
-      nvml_submit_gauge(ix, dev_name, "frequency", "memory", 1e6 * mem_clk_mhz);
+      nvml_submit_gauge(ix, dev_name, "frequency", "memory",
+                        1e6 * mem_clk_mhz);
+  }
 
+  if (conf_metrics & METRIC_POWER) {
     unsigned int power_mW;
     TRYOPT(nvmlDeviceGetPowerUsage(dev, &power_mW))
     if (nv_status == NVML_SUCCESS)
       nvml_submit_gauge(ix, dev_name, "power", NULL, 1e-3 * power_mW);
+  }
 
-    continue;
+#if HAVE_NVML_FIELD_VALUES
+  TRYOPT(nvml_read_fields(d))
+#endif
 
-    // Failures here indicate transient errors or removal of GPU. In either
-    // case it will either be resolved or the GPU will no longer be enumerated
-    // the next time round.
-    catch : WARNING(PLUGIN_NAME
-                    ": NVML call \"%s\" failed (%d) on dev at index %d!",
-                    nv_errline, nv_status, ix);
-    continue;
+  return 0;
+
+  // Failures here indicate transient errors or removal of GPU. Returning an
+  // error makes the daemon back off from reading this device.
+  catch : WARNING(PLUGIN_NAME
+                  ": NVML call \"%s\" failed (%d) on dev at index %d!",
+                  nv_errline, nv_status, ix);
+  return -1;
+}
+
+static int nvml_init(void) {
+  nvmlReturn_t nv_status = NVML_SUCCESS;
+  char *nv_errline = "";
+
+  TRY(nvmlInit());
+
+#if !HAVE_NVML_FIELD_VALUES
+  if (conf_metrics & (METRIC_MEMORY_TEMPERATURE | METRIC_ENERGY))
+    WARNING(PLUGIN_NAME ": The \"memory_temperature\" and \"energy\" metrics "
+                        "are not supported by this version of NVML.");
+#endif
+
+  unsigned int device_count;
+  TRY(nvmlDeviceGetCount(&device_count));
+
+  if (device_count > 64) {
+    device_count = 64;
+  }
+
+  nv_devices = calloc(device_count, sizeof(*nv_devices));
+  if ((device_count > 0) && (nv_devices == NULL)) {
+    ERROR(PLUGIN_NAME ": calloc failed.");
+    return -1;
+  }
+
+  for (unsigned int ix = 0; ix < device_count; ix++) {
+
+    unsigned int is_match =
+        ((1 << ix) & conf_match_mask) || (conf_match_mask == 0);
+    if (conf_mask_is_exclude == !!is_match) {
+      continue;
+    }
+
+    nvml_device_t *d = nv_devices + nv_devices_num;
+    d->index = ix;
+
+    nv_status = nvmlDeviceGetHandleByIndex(ix, &d->dev);
+    if ((nv_status == NVML_SUCCESS) && (instance_by & INSTANCE_BY_GPUNAME))
+      nv_status = nvmlDeviceGetName(d->dev, d->name, sizeof(d->name));
+    if (nv_status != NVML_SUCCESS) {
+      WARNING(PLUGIN_NAME ": Looking up dev at index %u failed (%d).", ix,
+              nv_status);
+      continue;
+    }
+
+    snprintf(d->cb_name, sizeof(d->cb_name), PLUGIN_NAME "/%u", ix);
+    int status = plugin_register_complex_read(
+        /* group = */ PLUGIN_NAME, d->cb_name, nvml_read_device,
+        /* interval = */ 0, &(user_data_t){.data = d});
+    if (status != 0) {
+      ERROR(PLUGIN_NAME ": Registering read callback for dev at index %u "
+                        "failed.",
+            ix);
+      continue;
+    }
+    nv_devices_num++;
   }
 
+  if (nv_devices_num == 0)
+    NOTICE(PLUGIN_NAME ": No GPUs are selected.");
+
+  return 0;
+
+  catch : ERROR(PLUGIN_NAME ": NVML init failed: \"%s\" returned %d",
+                nv_errline, nv_status);
+  return -1;
+}
+
+static int nvml_shutdown(void) {
+  nvmlReturn_t nv_status = NVML_SUCCESS;
+  char *nv_errline = "";
+
+  plugin_unregister_read_group(PLUGIN_NAME);
+  sfree(nv_devices);
+  nv_devices_num = 0;
+
+  TRY(nvmlShutdown())
   return 0;
 
-// Failures here indicate serious misconfiguration; we bail out totally.
-catch_nocount:
-  ERROR(PLUGIN_NAME ": Failed to enumerate NVIDIA GPUs (\"%s\" returned %d)",
-        nv_errline, nv_status);
+  catch : ERROR(PLUGIN_NAME ": NVML shutdown failed: \"%s\" returned %d",
+                nv_errline, nv_status);
   return -1;
 }
 
 void module_register(void) {
   plugin_register_init(PLUGIN_NAME, nvml_init);
   plugin_register_config(PLUGIN_NAME, nvml_config, config_keys, n_config_keys);
-  plugin_register_read(PLUGIN_NAME, nvml_read);
   plugin_register_shutdown(PLUGIN_NAME, nvml_shutdown);
 }
@@ -29,8 +29,10 @@
 #include <google/protobuf/util/time_util.h>
 #include <grpc++/grpc++.h>
 
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <queue>
 #include <vector>
 
@@ -71,6 +73,7 @@ struct Listener {
 };
 static std::vector<Listener> listeners;
 static grpc::string default_addr("0.0.0.0:50051");
+static int worker_threads = 2;
 
 /*
  * helper functions
@@ -159,78 +162,57 @@ static grpc::Status unmarshal_ident(const collectd::types::Identifier &msg,
 
 static grpc::Status marshal_meta_data(meta_data_t *meta,
                                       grpcMetadata *mutable_meta_data) {
-  char **meta_data_keys = nullptr;
-  int meta_data_keys_len = meta_data_toc(meta, &meta_data_keys);
-  if (meta_data_keys_len < 0) {
-    return grpc::Status(grpc::StatusCode::INTERNAL,
-                        grpc::string("error getting metadata keys"));
-  }
-
-  for (int i = 0; i < meta_data_keys_len; i++) {
-    char *key = meta_data_keys[i];
-    int md_type = meta_data_type(meta, key);
+  for (meta_entry_t *e = meta_data_iter(meta); e != nullptr;
+       e = meta_data_iter_next(e)) {
+    int md_type = meta_data_iter_type(e);
+    int status = 0;
 
-    collectd::types::MetadataValue md_value;
+    collectd::types::MetadataValue &md_value =
+        (*mutable_meta_data)[grpc::string(meta_data_iter_key(e))];
     md_value.Clear();
 
     switch (md_type) {
-    case MD_TYPE_STRING:
-      char *md_string;
-      if (meta_data_get_string(meta, key, &md_string) != 0 ||
-          md_string == nullptr) {
-        strarray_free(meta_data_keys, meta_data_keys_len);
-        return grpc::Status(grpc::StatusCode::INTERNAL,
-                            grpc::string("missing metadata"));
-      }
-      md_value.set_string_value(md_string);
+    case MD_TYPE_STRING: {
+      char *md_string = nullptr;
+      status = meta_data_iter_get_string(meta, e, &md_string);
+      if (status == 0)
+        md_value.set_string_value(md_string);
       free(md_string);
       break;
-    case MD_TYPE_SIGNED_INT:
+    }
+    case MD_TYPE_SIGNED_INT: {
       int64_t int64_value;
-      if (meta_data_get_signed_int(meta, key, &int64_value) != 0) {
-        strarray_free(meta_data_keys, meta_data_keys_len);
-        return grpc::Status(grpc::StatusCode::INTERNAL,
-                            grpc::string("missing metadata"));
-      }
+      status = meta_data_iter_get_signed_int(meta, e, &int64_value);
       md_value.set_int64_value(int64_value);
       break;
-    case MD_TYPE_UNSIGNED_INT:
+    }
+    case MD_TYPE_UNSIGNED_INT: {
       uint64_t uint64_value;
-      if (meta_data_get_unsigned_int(meta, key, &uint64_value) != 0) {
-        strarray_free(meta_data_keys, meta_data_keys_len);
-        return grpc::Status(grpc::StatusCode::INTERNAL,
-                            grpc::string("missing metadata"));
-      }
+      status = meta_data_iter_get_unsigned_int(meta, e, &uint64_value);
       md_value.set_uint64_value(uint64_value);
       break;
-    case MD_TYPE_DOUBLE:
+    }
+    case MD_TYPE_DOUBLE: {
       double double_value;
-      if (meta_data_get_double(meta, key, &double_value) != 0) {
-        strarray_free(meta_data_keys, meta_data_keys_len);
-        return grpc::Status(grpc::StatusCode::INTERNAL,
-                            grpc::string("missing metadata"));
-      }
+      status = meta_data_iter_get_double(meta, e, &double_value);
       md_value.set_double_value(double_value);
       break;
-    case MD_TYPE_BOOLEAN:
+    }
+    case MD_TYPE_BOOLEAN: {
       bool bool_value;
-      if (meta_data_get_boolean(meta, key, &bool_value) != 0) {
-        strarray_free(meta_data_keys, meta_data_keys_len);
-        return grpc::Status(grpc::StatusCode::INTERNAL,
-                            grpc::string("missing metadata"));
-      }
+      status = meta_data_iter_get_boolean(meta, e, &bool_value);
       md_value.set_bool_value(bool_value);
       break;
+    }
     default:
-      strarray_free(meta_data_keys, meta_data_keys_len);
       ERROR("grpc: invalid metadata type (%d)", md_type);
       return grpc::Status(grpc::StatusCode::INTERNAL,
                           grpc::string("unknown metadata type"));
     }
 
-    (*mutable_meta_data)[grpc::string(key)] = md_value;
-
-    strarray_free(meta_data_keys, meta_data_keys_len);
+    if (status != 0)
+      return grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("missing metadata"));
   }
 
   return grpc::Status::OK;
@@ -238,14 +220,18 @@ static grpc::Status marshal_meta_data(meta_data_t *meta,
 
 static grpc::Status unmarshal_meta_data(const grpcMetadata &rpc_metadata,
                                         meta_data_t **md_out) {
+  *md_out = nullptr;
+  if (rpc_metadata.empty())
+    return grpc::Status::OK;
+
   *md_out = meta_data_create();
   if (*md_out == nullptr) {
     return grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
                         grpc::string("failed to create metadata list"));
   }
-  for (auto kv : rpc_metadata) {
+  for (const auto &kv : rpc_metadata) {
     auto k = kv.first.c_str();
-    auto v = kv.second;
+    const auto &v = kv.second;
 
     // The meta_data collection individually allocates copies of the keys and
     // string values for each entry, so it's safe for us to pass a reference
@@ -269,6 +255,7 @@ static grpc::Status unmarshal_meta_data(const grpcMetadata &rpc_metadata,
       break;
     default:
       meta_data_destroy(*md_out);
+      *md_out = nullptr;
       return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
                           grpc::string("Metadata of unknown type"));
     }
@@ -343,22 +330,18 @@ static grpc::Status unmarshal_value_list(const collectd::types::ValueList &msg,
   if (!status.ok())
     return status;
 
-  value_t *values = NULL;
-  size_t values_len = 0;
-
-  status = grpc::Status::OK;
-  for (auto v : msg.values()) {
-    value_t *val =
-        (value_t *)realloc(values, (values_len + 1) * sizeof(*values));
-    if (!val) {
-      status = grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
-                            grpc::string("failed to allocate values array"));
-      break;
-    }
+  size_t values_len = (size_t)msg.values_size();
+  value_t *values = (value_t *)calloc(values_len ? values_len : 1,
+                                      sizeof(*values));
+  if (values == NULL) {
+    meta_data_destroy(vl->meta);
+    vl->meta = NULL;
+    return grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                        grpc::string("failed to allocate values array"));
+  }
 
-    values = val;
-    val = values + values_len;
-    values_len++;
+  value_t *val = values;
+  for (const auto &v : msg.values()) {
 
     switch (v.value_case()) {
     case collectd::types::Value::ValueCase::kCounter:
@@ -381,12 +364,14 @@ static grpc::Status unmarshal_value_list(const collectd::types::ValueList &msg,
 
     if (!status.ok())
       break;
+    val++;
   }
   if (status.ok()) {
     vl->values = values;
     vl->values_len = values_len;
   } else {
     meta_data_destroy(vl->meta);
+    vl->meta = NULL;
     free(values);
   }
 
@@ -396,134 +381,114 @@ static grpc::Status unmarshal_value_list(const collectd::types::ValueList &msg,
 /*
  * Collectd service
  */
-class CollectdImpl : public collectd::Collectd::Service {
-public:
-  grpc::Status
-  QueryValues(grpc::ServerContext *ctx, QueryValuesRequest const *req,
-              grpc::ServerWriter<QueryValuesResponse> *writer) override {
-    value_list_t match;
-    auto status = unmarshal_ident(req->identifier(), &match, false);
-    if (!status.ok()) {
-      return status;
-    }
+static grpc::Status query_values_read(value_list_t const *match,
+                                      std::queue<value_list_t> *value_lists) {
+  uc_iter_t *iter;
+  if ((iter = uc_get_iterator()) == NULL) {
+    return grpc::Status(
+        grpc::StatusCode::INTERNAL,
+        grpc::string("failed to query values: cannot create iterator"));
+  }
 
-    std::queue<value_list_t> value_lists;
-    status = this->queryValuesRead(&match, &value_lists);
-    if (status.ok()) {
-      status = this->queryValuesWrite(ctx, writer, &value_lists);
+  grpc::Status status = grpc::Status::OK;
+  char *name = NULL;
+  while (uc_iterator_next(iter, &name) == 0) {
+    value_list_t vl;
+    if (parse_identifier_vl(name, &vl) != 0) {
+      status = grpc::Status(grpc::StatusCode::INTERNAL,
+                            grpc::string("failed to parse identifier"));
+      break;
     }
 
-    while (!value_lists.empty()) {
-      auto vl = value_lists.front();
-      value_lists.pop();
-      sfree(vl.values);
-      meta_data_destroy(vl.meta);
+    if (!ident_matches(&vl, match))
+      continue;
+    if (uc_iterator_get_time(iter, &vl.time) < 0) {
+      status = grpc::Status(grpc::StatusCode::INTERNAL,
+                            grpc::string("failed to retrieve value timestamp"));
+      break;
     }
-
-    return status;
-  }
-
-  grpc::Status PutValues(grpc::ServerContext *ctx,
-                         grpc::ServerReader<PutValuesRequest> *reader,
-                         PutValuesResponse *res) override {
-    PutValuesRequest req;
-
-    while (reader->Read(&req)) {
-      value_list_t vl = {0};
-      auto status = unmarshal_value_list(req.value_list(), &vl);
-      if (!status.ok())
-        return status;
-
-      if (plugin_dispatch_values(&vl))
-        return grpc::Status(
-            grpc::StatusCode::INTERNAL,
-            grpc::string("failed to enqueue values for writing"));
+    if (uc_iterator_get_interval(iter, &vl.interval) < 0) {
+      status = grpc::Status(grpc::StatusCode::INTERNAL,
+                            grpc::string("failed to retrieve value interval"));
+      break;
+    }
+    if (uc_iterator_get_values(iter, &vl.values, &vl.values_len) < 0) {
+      status = grpc::Status(grpc::StatusCode::INTERNAL,
+                            grpc::string("failed to retrieve values"));
+      break;
+    }
+    if (uc_iterator_get_meta(iter, &vl.meta) < 0) {
+      status = grpc::Status(grpc::StatusCode::INTERNAL,
+                            grpc::string("failed to retrieve value metadata"));
     }
 
-    res->Clear();
-    return grpc::Status::OK;
-  }
-
-private:
-  grpc::Status queryValuesRead(value_list_t const *match,
-                               std::queue<value_list_t> *value_lists) {
-    uc_iter_t *iter;
-    if ((iter = uc_get_iterator()) == NULL) {
-      return grpc::Status(
-          grpc::StatusCode::INTERNAL,
-          grpc::string("failed to query values: cannot create iterator"));
-    }
-
-    grpc::Status status = grpc::Status::OK;
-    char *name = NULL;
-    while (uc_iterator_next(iter, &name) == 0) {
-      value_list_t vl;
-      if (parse_identifier_vl(name, &vl) != 0) {
-        status = grpc::Status(grpc::StatusCode::INTERNAL,
-                              grpc::string("failed to parse identifier"));
-        break;
-      }
-
-      if (!ident_matches(&vl, match))
-        continue;
-      if (uc_iterator_get_time(iter, &vl.time) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value timestamp"));
-        break;
-      }
-      if (uc_iterator_get_interval(iter, &vl.interval) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value interval"));
-        break;
-      }
-      if (uc_iterator_get_values(iter, &vl.values, &vl.values_len) < 0) {
-        status = grpc::Status(grpc::StatusCode::INTERNAL,
-                              grpc::string("failed to retrieve values"));
-        break;
-      }
-      if (uc_iterator_get_meta(iter, &vl.meta) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value metadata"));
-      }
+    value_lists->push(vl);
+  } // while (uc_iterator_next(iter, &name) == 0)
 
-      value_lists->push(vl);
-    } // while (uc_iterator_next(iter, &name) == 0)
+  uc_iterator_destroy(iter);
+  return status;
+} /* query_values_read */
+
+/* Dispatches all value lists of "req" with one call to
+ * plugin_dispatch_values_batch(). */
+static grpc::Status put_values_dispatch(PutValuesRequest const &req) {
+  std::vector<value_list_t> value_lists;
+  value_lists.reserve(req.value_lists_size() + 1);
+
+  grpc::Status status = grpc::Status::OK;
+  if (req.has_value_list()) {
+    value_list_t vl = {0};
+    status = unmarshal_value_list(req.value_list(), &vl);
+    if (status.ok())
+      value_lists.push_back(vl);
+  }
+  for (auto const &msg : req.value_lists()) {
+    if (!status.ok())
+      break;
 
-    uc_iterator_destroy(iter);
-    return status;
+    value_list_t vl = {0};
+    status = unmarshal_value_list(msg, &vl);
+    if (status.ok())
+      value_lists.push_back(vl);
   }
 
-  grpc::Status queryValuesWrite(grpc::ServerContext *ctx,
-                                grpc::ServerWriter<QueryValuesResponse> *writer,
-                                std::queue<value_list_t> *value_lists) {
-    while (!value_lists->empty()) {
-      auto vl = value_lists->front();
-      QueryValuesResponse res;
-      res.Clear();
+  if (status.ok() && !value_lists.empty() &&
+      (plugin_dispatch_values_batch(value_lists.data(), value_lists.size()) !=
+       0))
+    status = grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("failed to enqueue values for writing"));
 
-      auto status = marshal_value_list(&vl, res.mutable_value_list());
-      if (!status.ok()) {
-        return status;
-      }
+  /* The value lists have been copied by plugin_dispatch_values_batch(). */
+  for (auto &vl : value_lists) {
+    sfree(vl.values);
+    meta_data_destroy(vl.meta);
+  }
 
-      if (!writer->Write(res)) {
-        return grpc::Status::CANCELLED;
-      }
+  return status;
+} /* put_values_dispatch */
 
-      value_lists->pop();
-      sfree(vl.values);
-    }
+class CollectdServer;
 
-    return grpc::Status::OK;
-  }
+/* CallData is the state of one call handled by the asynchronous server. Its
+ * address is used as the tag of the call's operations, and Proceed() is
+ * called by a worker thread when one of them has completed. */
+class CallData {
+public:
+  CallData(CollectdServer *server, grpc::ServerCompletionQueue *cq)
+      : server_(server), cq_(cq) {}
+  virtual ~CallData() {}
+
+  /* "ok" is false if the operation failed, e.g. because the client went away
+   * or the server is shutting down. Proceed() deletes the object once the
+   * call is complete. */
+  virtual void Proceed(bool ok) = 0;
+
+protected:
+  CollectdServer *server_;
+  grpc::ServerCompletionQueue *cq_;
+  grpc::ServerContext ctx_;
 };
 
-/*
- * gRPC server implementation
- */
 class CollectdServer final {
 public:
   void Start() {
@@ -550,53 +515,292 @@ public:
       }
     }
 
-    builder.RegisterService(&collectd_service_);
+    builder.RegisterService(&service_);
+
+    for (int i = 0; i < worker_threads; i++)
+      cqs_.push_back(builder.AddCompletionQueue());
 
     server_ = builder.BuildAndStart();
+    if (server_ == nullptr) {
+      ERROR("grpc: Failed to start server");
+      return;
+    }
+
+    for (auto &cq : cqs_) {
+      SpawnCalls(cq.get());
+
+      pthread_t tid;
+      int status =
+          plugin_thread_create(&tid, CollectdServer::Worker, cq.get(), "grpc");
+      if (status != 0) {
+        char errbuf[256];
+        ERROR("grpc: Starting a worker thread failed: %s",
+              sstrerror(status, errbuf, sizeof(errbuf)));
+        continue;
+      }
+      threads_.push_back(tid);
+    }
   } /* Start() */
 
-  void Shutdown() { server_->Shutdown(); } /* Shutdown() */
+  void Shutdown() {
+    /* Streams kept open by clients are cancelled after the deadline. */
+    if (server_ != nullptr)
+      server_->Shutdown(std::chrono::system_clock::now() +
+                        std::chrono::seconds(1));
+
+    /* No new calls may be requested once the queues are shut down. */
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      shutdown_ = true;
+      for (auto &cq : cqs_)
+        cq->Shutdown();
+    }
+
+    /* The workers return once all remaining events have been drained. */
+    for (auto tid : threads_)
+      pthread_join(tid, NULL);
+    threads_.clear();
+  } /* Shutdown() */
+
+  Collectd::AsyncService *Service() { return &service_; }
+
+  /* SpawnCalls prepares a new call of each method to be received on "cq". */
+  void SpawnCalls(grpc::ServerCompletionQueue *cq);
+
+  template <class T> void Spawn(grpc::ServerCompletionQueue *cq) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!shutdown_)
+      new T(this, cq);
+  }
 
 private:
-  CollectdImpl collectd_service_;
+  static void *Worker(void *arg) {
+    auto cq = static_cast<grpc::ServerCompletionQueue *>(arg);
+    void *tag;
+    bool ok;
+
+    while (cq->Next(&tag, &ok))
+      static_cast<CallData *>(tag)->Proceed(ok);
+
+    return NULL;
+  } /* Worker() */
+
+  Collectd::AsyncService service_;
+  std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> cqs_;
+  std::vector<pthread_t> threads_;
+
+  std::mutex lock_;
+  bool shutdown_ = false;
 
   std::unique_ptr<grpc::Server> server_;
 }; /* class CollectdServer */
 
+/* PutValuesCall reads PutValuesRequest messages from the client's stream and
+ * dispatches the value lists of each message as one batch. */
+class PutValuesCall final : public CallData {
+public:
+  PutValuesCall(CollectdServer *server, grpc::ServerCompletionQueue *cq)
+      : CallData(server, cq), reader_(&ctx_) {
+    server_->Service()->RequestPutValues(&ctx_, &reader_, cq_, cq_, this);
+  }
+
+  void Proceed(bool ok) override {
+    switch (state_) {
+    case REQUEST:
+      if (!ok) {
+        delete this;
+        return;
+      }
+      server_->Spawn<PutValuesCall>(cq_);
+      state_ = READ;
+      reader_.Read(&req_, this);
+      return;
+
+    case READ: {
+      if (!ok) { /* The client has finished sending. */
+        state_ = FINISH;
+        res_.Clear();
+        reader_.Finish(res_, grpc::Status::OK, this);
+        return;
+      }
+
+      auto status = put_values_dispatch(req_);
+      if (!status.ok()) {
+        state_ = FINISH;
+        reader_.FinishWithError(status, this);
+        return;
+      }
+
+      reader_.Read(&req_, this);
+      return;
+    }
+
+    case FINISH:
+      delete this;
+      return;
+    }
+  } /* Proceed() */
+
+private:
+  enum { REQUEST, READ, FINISH } state_ = REQUEST;
+
+  PutValuesRequest req_;
+  PutValuesResponse res_;
+  grpc::ServerAsyncReader<PutValuesResponse, PutValuesRequest> reader_;
+};
+
+/* QueryValuesCall writes the matching value lists from the cache to the
+ * client's stream. */
+class QueryValuesCall final : public CallData {
+public:
+  QueryValuesCall(CollectdServer *server, grpc::ServerCompletionQueue *cq)
+      : CallData(server, cq), writer_(&ctx_) {
+    server_->Service()->RequestQueryValues(&ctx_, &req_, &writer_, cq_, cq_,
+                                           this);
+  }
+
+  ~QueryValuesCall() {
+    while (!value_lists_.empty()) {
+      auto vl = value_lists_.front();
+      value_lists_.pop();
+      sfree(vl.values);
+      meta_data_destroy(vl.meta);
+    }
+  }
+
+  void Proceed(bool ok) override {
+    switch (state_) {
+    case REQUEST: {
+      if (!ok) {
+        delete this;
+        return;
+      }
+      server_->Spawn<QueryValuesCall>(cq_);
+
+      value_list_t match;
+      auto status = unmarshal_ident(req_.identifier(), &match, false);
+      if (status.ok())
+        status = query_values_read(&match, &value_lists_);
+      if (!status.ok()) {
+        state_ = FINISH;
+        writer_.Finish(status, this);
+        return;
+      }
+
+      WriteNext();
+      return;
+    }
+
+    case WRITE:
+      if (!ok) {
+        state_ = FINISH;
+        writer_.Finish(grpc::Status::CANCELLED, this);
+        return;
+      }
+      WriteNext();
+      return;
+
+    case FINISH:
+      delete this;
+      return;
+    }
+  } /* Proceed() */
+
+private:
+  void WriteNext() {
+    if (value_lists_.empty()) {
+      state_ = FINISH;
+      writer_.Finish(grpc::Status::OK, this);
+      return;
+    }
+
+    auto vl = value_lists_.front();
+    value_lists_.pop();
+
+    res_.Clear();
+    auto status = marshal_value_list(&vl, res_.mutable_value_list());
+    sfree(vl.values);
+    meta_data_destroy(vl.meta);
+    if (!status.ok()) {
+      state_ = FINISH;
+      writer_.Finish(status, this);
+      return;
+    }
+
+    state_ = WRITE;
+    writer_.Write(res_, this);
+  } /* WriteNext() */
+
+  enum { REQUEST, WRITE, FINISH } state_ = REQUEST;
+
+  QueryValuesRequest req_;
+  QueryValuesResponse res_;
+  grpc::ServerAsyncWriter<QueryValuesResponse> writer_;
+  std::queue<value_list_t> value_lists_;
+};
+
+void CollectdServer::SpawnCalls(grpc::ServerCompletionQueue *cq) {
+  Spawn<PutValuesCall>(cq);
+  Spawn<QueryValuesCall>(cq);
+} /* SpawnCalls() */
+
+/* CollectdClient sends value lists to a server. All writes share one
+ * PutValues stream, which is re-opened after an error. */
 class CollectdClient final {
 public:
   CollectdClient(std::shared_ptr<grpc::ChannelInterface> channel)
       : stub_(Collectd::NewStub(channel)) {}
 
-  int PutValues(value_list_t const *vl) {
-    grpc::ClientContext ctx;
+  ~CollectdClient() {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (stream_ != nullptr)
+      CloseStream();
+  }
 
+  int PutValues(value_list_t const *const *vl, size_t num) {
     PutValuesRequest req;
-    auto status = marshal_value_list(vl, req.mutable_value_list());
-    if (!status.ok()) {
-      ERROR("grpc: Marshalling value_list_t failed.");
-      return -1;
+    for (size_t i = 0; i < num; i++) {
+      auto status = marshal_value_list(vl[i], req.add_value_lists());
+      if (!status.ok()) {
+        ERROR("grpc: Marshalling value_list_t failed.");
+        req.mutable_value_lists()->RemoveLast();
+      }
     }
+    if (req.value_lists_size() == 0)
+      return -1;
 
-    PutValuesResponse res;
-    auto stream = stub_->PutValues(&ctx, &res);
-    if (!stream->Write(req)) {
-      NOTICE("grpc: Broken stream.");
-      /* intentionally not returning. */
+    std::lock_guard<std::mutex> lock(lock_);
+    if (stream_ == nullptr) {
+      ctx_.reset(new grpc::ClientContext());
+      stream_ = stub_->PutValues(ctx_.get(), &res_);
     }
 
-    stream->WritesDone();
-    status = stream->Finish();
-    if (!status.ok()) {
-      ERROR("grpc: Error while closing stream.");
+    if (!stream_->Write(req)) {
+      auto status = CloseStream();
+      ERROR("grpc: Broken stream: %s", status.error_message().c_str());
       return -1;
     }
 
-    return 0;
+    return (req.value_lists_size() == (int)num) ? 0 : -1;
   } /* int PutValues */
 
 private:
+  /* CloseStream finishes the stream and returns its status. lock_ must be
+   * held. */
+  grpc::Status CloseStream() {
+    stream_->WritesDone();
+    auto status = stream_->Finish();
+    stream_.reset();
+    ctx_.reset();
+    return status;
+  } /* CloseStream */
+
   std::unique_ptr<Collectd::Stub> stub_;
+
+  std::mutex lock_;
+  std::unique_ptr<grpc::ClientContext> ctx_;
+  std::unique_ptr<grpc::ClientWriter<PutValuesRequest>> stream_;
+  PutValuesResponse res_;
 };
 
 static CollectdServer *server = nullptr;
@@ -609,10 +813,12 @@ static void c_grpc_destroy_write_callback(void *ptr) {
   delete (CollectdClient *)ptr;
 }
 
-static int c_grpc_write(__attribute__((unused)) data_set_t const *ds,
-                        value_list_t const *vl, user_data_t *ud) {
+static int c_grpc_write_batch(__attribute__((unused))
+                              data_set_t const *const *ds,
+                              value_list_t const *const *vl, size_t num,
+                              user_data_t *ud) {
   CollectdClient *c = (CollectdClient *)ud->data;
-  return c->PutValues(vl);
+  return c->PutValues(vl, num);
 }
 
 static int c_grpc_config_listen(oconfig_item_t *ci) {
@@ -751,7 +957,7 @@ static int c_grpc_config_server(oconfig_item_t *ci) {
       .free_func = c_grpc_destroy_write_callback,
   };
 
-  plugin_register_write(callback_name.c_str(), c_grpc_write, &ud);
+  plugin_register_write_batch(callback_name.c_str(), c_grpc_write_batch, &ud);
   return 0;
 } /* c_grpc_config_server() */
 
@@ -767,6 +973,13 @@ static int c_grpc_config(oconfig_item_t *ci) {
     } else if (!strcasecmp("Server", child->key)) {
       if (c_grpc_config_server(child))
         return -1;
+    } else if (!strcasecmp("WorkerThreads", child->key)) {
+      if (cf_util_get_int(child, &worker_threads))
+        return -1;
+      if (worker_threads < 1) {
+        ERROR("grpc: `%s` must be at least 1.", child->key);
+        return -1;
+      }
     }
 
     else {
@@ -54,6 +54,8 @@ typedef struct intel_pmu_entity_s intel_pmu_entity_t;
 struct intel_pmu_ctx_s {
   char event_list_fn[PATH_MAX];
   bool dispatch_cloned_pmus;
+  /* Maximum number of ungrouped events combined into one perf group. */
+  int event_group_size;
 
   intel_pmu_entity_t *entl;
 };
@@ -91,6 +93,7 @@ static void pmu_dump_config(void) {
   DEBUG(PMU_PLUGIN ": Config:");
   DEBUG(PMU_PLUGIN ":   AggregateUncorePMUs : %d", !g_ctx.dispatch_cloned_pmus);
   DEBUG(PMU_PLUGIN ":   event list file     : %s", g_ctx.event_list_fn);
+  DEBUG(PMU_PLUGIN ":   EventGroupSize      : %d", g_ctx.event_group_size);
 
   unsigned int i = 0;
   for (intel_pmu_entity_t *ent = g_ctx.entl; ent != NULL; ent = ent->next)
@@ -251,6 +254,12 @@ static int pmu_config(oconfig_item_t *ci) {
       ret = cf_util_get_boolean(child, &aggregate);
       if (ret == 0)
         g_ctx.dispatch_cloned_pmus = !aggregate;
+    } else if (strcasecmp("EventGroupSize", child->key) == 0) {
+      ret = cf_util_get_int(child, &g_ctx.event_group_size);
+      if ((ret == 0) && (g_ctx.event_group_size < 0)) {
+        ERROR(PMU_PLUGIN ": `EventGroupSize` must not be negative.");
+        ret = -EINVAL;
+      }
     } else {
       ERROR(PMU_PLUGIN ": Unknown configuration parameter \"%s\".", child->key);
       ret = -1;
@@ -424,6 +433,42 @@ static void pmu_dispatch_data(intel_pmu_entity_t *ent) {
   }
 }
 
+/* Reads all counters of the group led by "leader" on "core" with a single
+ * read(2). The kernel returns the number of counters, the group's enabled and
+ * running times, and one value for each event that was opened in the group,
+ * in the order they were added. */
+static int pmu_read_group(struct event *leader, int core) {
+  size_t num = 0;
+  for (struct event *e = leader; e != NULL; e = e->next) {
+    if (e->efd[core].fd >= 0)
+      num++;
+    if (e->end_group)
+      break;
+  }
+
+  uint64_t buf[3 + num];
+  ssize_t len = read(leader->efd[core].fd, buf, sizeof(buf));
+  if (len < (ssize_t)(3 * sizeof(*buf)) || buf[0] > num ||
+      (size_t)len < (3 + buf[0]) * sizeof(*buf)) {
+    ERROR(PMU_PLUGIN ": Reading group of %s/%d failed.", leader->event, core);
+    return -1;
+  }
+
+  size_t idx = 0;
+  for (struct event *e = leader; e != NULL && idx < buf[0]; e = e->next) {
+    if (e->efd[core].fd >= 0) {
+      e->efd[core].val[0] = buf[3 + idx];
+      e->efd[core].val[1] = buf[1];
+      e->efd[core].val[2] = buf[2];
+      idx++;
+    }
+    if (e->end_group)
+      break;
+  }
+
+  return 0;
+}
+
 static int pmu_read(user_data_t *ud) {
   if (ud == NULL) {
     ERROR(PMU_PLUGIN ": ud is NULL! %s:%d", __FUNCTION__, __LINE__);
@@ -440,7 +485,11 @@ static int pmu_read(user_data_t *ud) {
   DEBUG(PMU_PLUGIN ": %s:%d", __FUNCTION__, __LINE__);
 
   /* read all events only for configured cores */
+  struct event *leader = NULL;
   for (e = ent->event_list->eventlist; e; e = e->next) {
+    if (e->group_leader)
+      leader = e;
+
     for (size_t i = 0; i < ent->cgroups_count; i++) {
       core_group_t *cgroup = ent->cores.cgroups + i + ent->first_cgroup;
       for (size_t j = 0; j < cgroup->num_cores; j++) {
@@ -450,7 +499,16 @@ static int pmu_read(user_data_t *ud) {
           continue;
         }
 
-        ret = read_event(e, core);
+        /* Group members have been read together with their leader. If the
+         * leader could not be opened on this core, members were opened as
+         * standalone events. */
+        if (leader != NULL && leader != e && leader->efd[core].fd >= 0)
+          continue;
+
+        if (e == leader)
+          ret = pmu_read_group(e, core);
+        else
+          ret = read_event(e, core);
         if (ret != 0) {
           ERROR(PMU_PLUGIN ": Failed to read value of %s/%d event.", e->event,
                 core);
@@ -458,6 +516,9 @@ static int pmu_read(user_data_t *ud) {
         }
       }
     }
+
+    if (e->end_group)
+      leader = NULL;
   }
 
   pmu_dispatch_data(ent);
@@ -582,6 +643,52 @@ static int pmu_add_hw_events(struct eventlist *el, char **e, size_t count) {
   return 0;
 }
 
+/* Marks the events from "first" to "last" as one group. */
+static void pmu_make_group(struct event *first, struct event *last) {
+  first->group_leader = 1;
+  for (struct event *e = first; e != NULL; e = e->next) {
+    e->ingroup = 1;
+    if (e == last) {
+      e->end_group = 1;
+      break;
+    }
+  }
+}
+
+/* Combines consecutive ungrouped core events of the same PMU into groups of
+ * up to "group_size" events, so that each group is read with one system call
+ * and its counters are sampled at the same time. Uncore and multi-PMU events
+ * are left alone. */
+static void pmu_group_events(struct eventlist *el, size_t group_size) {
+  struct event *first = NULL;
+  struct event *last = NULL;
+  size_t num = 0;
+
+  for (struct event *e = el->eventlist; e; e = e->next) {
+    bool groupable = !e->ingroup && !e->uncore && !e->extra.multi_pmu &&
+                     e->orig == NULL;
+
+    if (first != NULL &&
+        (!groupable || num >= group_size || e->attr.type != first->attr.type)) {
+      if (num > 1)
+        pmu_make_group(first, last);
+      first = NULL;
+      num = 0;
+    }
+
+    if (!groupable)
+      continue;
+
+    if (first == NULL)
+      first = e;
+    last = e;
+    num++;
+  }
+
+  if (num > 1)
+    pmu_make_group(first, last);
+}
+
 static void pmu_free_events(struct eventlist *el) {
 
   if (el == NULL)
@@ -595,6 +702,9 @@ static int pmu_setup_events(core_groups_list_t *cores, struct eventlist *el,
   struct event *e, *leader = NULL;
   int ret = -1;
   for (e = el->eventlist; e; e = e->next) {
+    /* Read groups with one read(2) per core, see pmu_read_group(). */
+    if (e->group_leader)
+      e->attr.read_format |= PERF_FORMAT_GROUP;
 
     for (size_t i = 0; i < cores->num_cgroups; i++) {
       core_group_t *cgroup = cores->cgroups + i;
@@ -782,6 +892,9 @@ static int pmu_init(void) {
       ERROR(PMU_PLUGIN ": Failed to add hardware events.");
       goto init_error;
     }
+
+    if (g_ctx.event_group_size > 1)
+      pmu_group_events(ent->event_list, (size_t)g_ctx.event_group_size);
   }
 
 #if COLLECT_DEBUG
@@ -222,6 +222,93 @@ DEF_TEST(config_cores_parse__not_aggregated_groups) {
   return 0;
 }
 
+/* Creates an event list with "num" core events of PMU type "type" on one
+ * core. */
+static struct eventlist *stub_eventlist(size_t num, uint32_t type) {
+  struct eventlist *el = calloc(1, sizeof(*el));
+  el->num_cpus = 1;
+
+  for (size_t i = 0; i < num; i++) {
+    struct event *e = calloc(1, sizeof(*e) + sizeof(struct efd));
+    e->attr.type = type;
+    e->efd[0].fd = -1;
+    if (el->eventlist_last == NULL)
+      el->eventlist = e;
+    else
+      el->eventlist_last->next = e;
+    el->eventlist_last = e;
+  }
+
+  return el;
+}
+
+static void stub_eventlist_free(struct eventlist *el) {
+  while (el->eventlist != NULL) {
+    struct event *next = el->eventlist->next;
+    sfree(el->eventlist);
+    el->eventlist = next;
+  }
+  sfree(el);
+}
+
+DEF_TEST(pmu_group_events) {
+  // setup
+  struct eventlist *el = stub_eventlist(7, PERF_TYPE_RAW);
+  struct event *e[7];
+  e[0] = el->eventlist;
+  for (size_t i = 1; i < STATIC_ARRAY_SIZE(e); i++)
+    e[i] = e[i - 1]->next;
+  /* an uncore event splits the list */
+  e[3]->uncore = true;
+
+  // check
+  pmu_group_events(el, 2);
+  EXPECT_EQ_INT(1, e[0]->group_leader);
+  EXPECT_EQ_INT(1, e[1]->ingroup);
+  EXPECT_EQ_INT(1, e[1]->end_group);
+  EXPECT_EQ_INT(0, e[2]->ingroup);
+  EXPECT_EQ_INT(0, e[3]->ingroup);
+  EXPECT_EQ_INT(1, e[4]->group_leader);
+  EXPECT_EQ_INT(1, e[5]->end_group);
+  /* a single remaining event is not made a group */
+  EXPECT_EQ_INT(0, e[6]->ingroup);
+
+  // cleanup
+  stub_eventlist_free(el);
+  return 0;
+}
+
+DEF_TEST(pmu_read_group) {
+  // setup
+  struct eventlist *el = stub_eventlist(3, PERF_TYPE_RAW);
+  pmu_group_events(el, 3);
+  struct event *leader = el->eventlist;
+
+  int fds[2];
+  CHECK_ZERO(pipe(fds));
+  /* nr, time_enabled, time_running, value[nr] */
+  uint64_t data[] = {3, 1000, 500, 11, 22, 33};
+  EXPECT_EQ_INT(sizeof(data), write(fds[1], data, sizeof(data)));
+  for (struct event *e = leader; e != NULL; e = e->next)
+    e->efd[0].fd = fds[0];
+
+  // check
+  EXPECT_EQ_INT(0, pmu_read_group(leader, 0));
+  uint64_t want = 11;
+  for (struct event *e = leader; e != NULL; e = e->next) {
+    EXPECT_EQ_UINT64(want, e->efd[0].val[0]);
+    EXPECT_EQ_UINT64(1000, e->efd[0].val[1]);
+    EXPECT_EQ_UINT64(500, e->efd[0].val[2]);
+    want += 11;
+  }
+
+  // cleanup
+  close(fds[0]);
+  close(fds[1]);
+  stub_eventlist_free(el);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(pmu_config_hw_events__all_events);
   RUN_TEST(pmu_config_hw_events__few_events);
@@ -229,6 +316,8 @@ int main(void) {
   RUN_TEST(config_cores_parse__empty_group);
   RUN_TEST(config_cores_parse__aggregated_groups);
   RUN_TEST(config_cores_parse__not_aggregated_groups);
+  RUN_TEST(pmu_group_events);
+  RUN_TEST(pmu_read_group);
 
   END_TEST;
 }
@@ -46,6 +46,13 @@
 #include <ifaddrs.h>
 #endif
 
+#if KERNEL_LINUX
+#include "utils/avltree/avltree.h"
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
 #if HAVE_STATGRAB_H
 #include <statgrab.h>
 #endif
@@ -85,6 +92,8 @@ static const char *config_keys[] = {
     "Interface",
     "IgnoreSelected",
     "ReportInactive",
+    "ReportUnchanged",
+    "UseNetlink",
 };
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
@@ -92,6 +101,41 @@ static ignorelist_t *ignorelist;
 
 static bool report_inactive = true;
 
+#if KERNEL_LINUX
+/* Counters of one interface, as reported by /proc/net/dev. */
+typedef struct {
+  derive_t rx_octets;
+  derive_t rx_packets;
+  derive_t rx_errors;
+  derive_t rx_dropped;
+  derive_t tx_octets;
+  derive_t tx_packets;
+  derive_t tx_errors;
+  derive_t tx_dropped;
+} if_counters_t;
+
+/* if_state_t caches the ignorelist decision and the last submitted counters
+ * of an interface, so that neither has to be determined again on each read. */
+typedef struct {
+  char *name;
+  bool ignored;
+  bool has_counters;
+  if_counters_t counters;
+  unsigned int generation;
+} if_state_t;
+
+static c_avl_tree_t *if_states;
+static unsigned int if_states_generation;
+static int if_states_seen;
+
+static bool report_unchanged = true;
+static bool use_netlink;
+
+static proc_file_t *proc_net_dev;
+static int netlink_fd = -1;
+static uint32_t netlink_seq;
+#endif
+
 #ifdef HAVE_LIBKSTAT
 #if HAVE_KSTAT_H
 #include <kstat.h>
@@ -116,7 +160,18 @@ static int interface_config(const char *key, const char *value) {
     ignorelist_set_invert(ignorelist, invert);
   } else if (strcasecmp(key, "ReportInactive") == 0)
     report_inactive = IS_TRUE(value);
-  else if (strcasecmp(key, "UniqueName") == 0) {
+  else if ((strcasecmp(key, "ReportUnchanged") == 0) ||
+           (strcasecmp(key, "UseNetlink") == 0)) {
+#if KERNEL_LINUX
+    if (strcasecmp(key, "ReportUnchanged") == 0)
+      report_unchanged = IS_TRUE(value);
+    else
+      use_netlink = IS_TRUE(value);
+#else
+    WARNING("interface plugin: the \"%s\" option is only valid on Linux.",
+            key);
+#endif /* KERNEL_LINUX */
+  } else if (strcasecmp(key, "UniqueName") == 0) {
 #ifdef HAVE_LIBKSTAT
     if (IS_TRUE(value))
       unique_name = true;
@@ -158,17 +213,14 @@ static int interface_init(void) {
 } /* int interface_init */
 #endif /* HAVE_LIBKSTAT */
 
-static void if_submit(const char *dev, const char *type, derive_t rx,
-                      derive_t tx) {
+static void if_dispatch(const char *dev, const char *type, derive_t rx,
+                        derive_t tx) {
   value_list_t vl = VALUE_LIST_INIT;
   value_t values[] = {
       {.derive = rx},
       {.derive = tx},
   };
 
-  if (ignorelist_match(ignorelist, dev) != 0)
-    return;
-
   vl.values = values;
   vl.values_len = STATIC_ARRAY_SIZE(values);
   sstrncpy(vl.plugin, "interface", sizeof(vl.plugin));
@@ -176,25 +228,140 @@ static void if_submit(const char *dev, const char *type, derive_t rx,
   sstrncpy(vl.type, type, sizeof(vl.type));
 
   plugin_dispatch_values(&vl);
+} /* void if_dispatch */
+
+#if !KERNEL_LINUX
+static void if_submit(const char *dev, const char *type, derive_t rx,
+                      derive_t tx) {
+  if (ignorelist_match(ignorelist, dev) != 0)
+    return;
+
+  if_dispatch(dev, type, rx, tx);
 } /* void if_submit */
+#endif
 
-static int interface_read(void) {
 #if KERNEL_LINUX
-  FILE *fh;
-  char buffer[1024];
-  derive_t incoming, outgoing;
+static void if_state_free(if_state_t *st) {
+  if (st == NULL)
+    return;
+
+  sfree(st->name);
+  sfree(st);
+} /* void if_state_free */
+
+static if_state_t *if_state_get(const char *dev) {
+  if_state_t *st = NULL;
+
+  if (if_states == NULL) {
+    if_states = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (if_states == NULL)
+      return NULL;
+  }
+
+  if (c_avl_get(if_states, dev, (void *)&st) == 0)
+    return st;
+
+  st = calloc(1, sizeof(*st));
+  if (st == NULL)
+    return NULL;
+
+  st->name = strdup(dev);
+  if (st->name == NULL) {
+    sfree(st);
+    return NULL;
+  }
+  st->ignored = (ignorelist_match(ignorelist, dev) != 0);
+
+  if (c_avl_insert(if_states, st->name, st) != 0) {
+    if_state_free(st);
+    return NULL;
+  }
+
+  return st;
+} /* if_state_t *if_state_get */
+
+/* Removes interfaces which were not seen during the last read. */
+static void if_states_prune(void) {
+  if_state_t **stale = NULL;
+  int stale_num = 0;
+  char *name;
+  if_state_t *st;
+
+  if ((if_states == NULL) || (c_avl_size(if_states) <= if_states_seen))
+    return;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(if_states);
+  while (c_avl_iterator_next(iter, (void *)&name, (void *)&st) == 0) {
+    if (st->generation == if_states_generation)
+      continue;
+
+    if_state_t **tmp = realloc(stale, (stale_num + 1) * sizeof(*stale));
+    if (tmp == NULL)
+      break;
+    stale = tmp;
+    stale[stale_num++] = st;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (int i = 0; i < stale_num; i++) {
+    DEBUG("interface plugin: Interface %s disappeared.", stale[i]->name);
+    c_avl_remove(if_states, stale[i]->name, NULL, NULL);
+    if_state_free(stale[i]);
+  }
+  sfree(stale);
+} /* void if_states_prune */
+
+static void if_handle(const char *dev, if_counters_t const *c) {
+  if_state_t *st = if_state_get(dev);
+  if (st == NULL) {
+    ERROR("interface plugin: Allocating the state of %s failed.", dev);
+    return;
+  }
+
+  if (st->generation != if_states_generation) {
+    st->generation = if_states_generation;
+    if_states_seen++;
+  }
+
+  if (st->ignored)
+    return;
+
+  if (!report_inactive && c->rx_packets == 0 && c->tx_packets == 0)
+    return;
+
+  if (!report_unchanged && st->has_counters &&
+      (memcmp(&st->counters, c, sizeof(*c)) == 0))
+    return;
+
+  st->counters = *c;
+  st->has_counters = true;
+
+  if_dispatch(dev, "if_packets", c->rx_packets, c->tx_packets);
+  if_dispatch(dev, "if_octets", c->rx_octets, c->tx_octets);
+  if_dispatch(dev, "if_errors", c->rx_errors, c->tx_errors);
+  if_dispatch(dev, "if_dropped", c->rx_dropped, c->tx_dropped);
+} /* void if_handle */
+
+static int if_read_proc(void) {
+  char *buffer;
   char *device;
 
   char *dummy;
   char *fields[16];
   int numfields;
 
-  if ((fh = fopen("/proc/net/dev", "r")) == NULL) {
-    WARNING("interface plugin: fopen: %s", STRERRNO);
-    return -1;
+  if (proc_net_dev == NULL) {
+    proc_net_dev = proc_file_create("/proc/net/dev");
+    if (proc_net_dev == NULL) {
+      WARNING("interface plugin: proc_file_create failed.");
+      return -1;
+    }
   }
 
-  while (fgets(buffer, 1024, fh) != NULL) {
+  if (proc_file_read(proc_net_dev, NULL) == NULL)
+    return -1;
+
+  while ((buffer = proc_file_next_line(proc_net_dev)) != NULL) {
     if (!(dummy = strchr(buffer, ':')))
       continue;
     dummy[0] = '\0';
@@ -209,30 +376,172 @@ static int interface_read(void) {
 
     numfields = strsplit(dummy, fields, 16);
 
-    if (numfields < 11)
+    if (numfields < 12)
       continue;
 
-    incoming = atoll(fields[1]);
-    outgoing = atoll(fields[9]);
-    if (!report_inactive && incoming == 0 && outgoing == 0)
-      continue;
+    if_handle(device, &(if_counters_t){
+                          .rx_octets = atoll(fields[0]),
+                          .rx_packets = atoll(fields[1]),
+                          .rx_errors = atoll(fields[2]),
+                          .rx_dropped = atoll(fields[3]),
+                          .tx_octets = atoll(fields[8]),
+                          .tx_packets = atoll(fields[9]),
+                          .tx_errors = atoll(fields[10]),
+                          .tx_dropped = atoll(fields[11]),
+                      });
+  }
 
-    if_submit(device, "if_packets", incoming, outgoing);
+  return 0;
+} /* int if_read_proc */
+
+/* Copies the counters from a rtnl_link_stats or rtnl_link_stats64 structure.
+ * The kernel reports missed packets as dropped in /proc/net/dev, so do the
+ * same here. */
+#define IF_COPY_LINK_STATS(c, stats)                                             do {                                                                             (c)->rx_octets = (derive_t)(stats)->rx_bytes;                                  (c)->rx_packets = (derive_t)(stats)->rx_packets;                               (c)->rx_errors = (derive_t)(stats)->rx_errors;                                 (c)->rx_dropped =                                                                  (derive_t)((stats)->rx_dropped + (stats)->rx_missed_errors);               (c)->tx_octets = (derive_t)(stats)->tx_bytes;                                  (c)->tx_packets = (derive_t)(stats)->tx_packets;                               (c)->tx_errors = (derive_t)(stats)->tx_errors;                                 (c)->tx_dropped = (derive_t)(stats)->tx_dropped;                             } while (0)
+
+/* Handles one RTM_NEWLINK message of the link dump. */
+static void if_handle_link(struct nlmsghdr *h) {
+  struct ifinfomsg *ifi = NLMSG_DATA(h);
+  int len = (int)h->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+  char const *dev = NULL;
+  if_counters_t c = {0};
+  bool have_stats = false;
+
+  if (len < 0)
+    return;
 
-    incoming = atoll(fields[0]);
-    outgoing = atoll(fields[8]);
-    if_submit(device, "if_octets", incoming, outgoing);
+  for (struct rtattr *rta = IFLA_RTA(ifi); RTA_OK(rta, len);
+       rta = RTA_NEXT(rta, len)) {
+    if (rta->rta_type == IFLA_IFNAME) {
+      dev = RTA_DATA(rta);
+      if (strnlen(dev, RTA_PAYLOAD(rta)) == RTA_PAYLOAD(rta))
+        dev = NULL;
+#ifdef HAVE_RTNL_LINK_STATS64
+    } else if ((rta->rta_type == IFLA_STATS64) &&
+               (RTA_PAYLOAD(rta) >= sizeof(struct rtnl_link_stats64))) {
+      struct rtnl_link_stats64 stats;
+      memcpy(&stats, RTA_DATA(rta), sizeof(stats));
+      IF_COPY_LINK_STATS(&c, &stats);
+      have_stats = true;
+#endif
+    } else if ((rta->rta_type == IFLA_STATS) && !have_stats &&
+               (RTA_PAYLOAD(rta) >= sizeof(struct rtnl_link_stats))) {
+      struct rtnl_link_stats *stats = RTA_DATA(rta);
+      IF_COPY_LINK_STATS(&c, stats);
+      have_stats = true;
+    }
+  }
 
-    incoming = atoll(fields[2]);
-    outgoing = atoll(fields[10]);
-    if_submit(device, "if_errors", incoming, outgoing);
+  if ((dev == NULL) || !have_stats)
+    return;
 
-    incoming = atoll(fields[3]);
-    outgoing = atoll(fields[11]);
-    if_submit(device, "if_dropped", incoming, outgoing);
+  if_handle(dev, &c);
+} /* void if_handle_link */
+
+/* Reads the counters of all interfaces with a RTM_GETLINK dump. The socket is
+ * kept open between reads. Returns zero on success. */
+static int if_read_netlink(void) {
+  if (netlink_fd < 0) {
+    netlink_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (netlink_fd < 0) {
+      ERROR("interface plugin: socket(AF_NETLINK) failed: %s", STRERRNO);
+      return -1;
+    }
+  }
+
+  struct {
+    struct nlmsghdr nlh;
+    struct rtgenmsg g;
+  } req = {
+      .nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg)),
+      .nlh.nlmsg_type = RTM_GETLINK,
+      .nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+      .nlh.nlmsg_seq = ++netlink_seq,
+      .g.rtgen_family = AF_PACKET,
+  };
+  struct sockaddr_nl nladdr = {.nl_family = AF_NETLINK};
+
+  if (sendto(netlink_fd, &req, req.nlh.nlmsg_len, 0, (void *)&nladdr,
+             sizeof(nladdr)) < 0) {
+    ERROR("interface plugin: sendto(AF_NETLINK) failed: %s", STRERRNO);
+    close(netlink_fd);
+    netlink_fd = -1;
+    return -1;
   }
 
-  fclose(fh);
+  /* The kernel sizes dump messages to the receive buffer of up to 32 kByte. */
+  char buf[32768] __attribute__((aligned(NLMSG_ALIGNTO)));
+  while (true) {
+    ssize_t status = recv(netlink_fd, buf, sizeof(buf), 0);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+
+      ERROR("interface plugin: recv(AF_NETLINK) failed: %s", STRERRNO);
+      close(netlink_fd);
+      netlink_fd = -1;
+      return -1;
+    } else if (status == 0) {
+      return 0;
+    }
+
+    for (struct nlmsghdr *h = (void *)buf; NLMSG_OK(h, status);
+         h = NLMSG_NEXT(h, status)) {
+      /* Skip the remains of an aborted earlier dump. */
+      if (h->nlmsg_seq != netlink_seq)
+        continue;
+
+      if (h->nlmsg_type == NLMSG_DONE) {
+        return 0;
+      } else if (h->nlmsg_type == NLMSG_ERROR) {
+        struct nlmsgerr *err = NLMSG_DATA(h);
+        ERROR("interface plugin: RTM_GETLINK failed: %s", STRERROR(-err->error));
+        return -1;
+      } else if (h->nlmsg_type == RTM_NEWLINK) {
+        if_handle_link(h);
+      }
+    }
+  }
+} /* int if_read_netlink */
+
+static int interface_shutdown(void) {
+  char *name;
+  if_state_t *st;
+
+  if (netlink_fd >= 0) {
+    close(netlink_fd);
+    netlink_fd = -1;
+  }
+
+  proc_file_destroy(proc_net_dev);
+  proc_net_dev = NULL;
+
+  if (if_states != NULL) {
+    while (c_avl_pick(if_states, (void *)&name, (void *)&st) == 0)
+      if_state_free(st);
+    c_avl_destroy(if_states);
+    if_states = NULL;
+  }
+
+  return 0;
+} /* int interface_shutdown */
+#endif /* KERNEL_LINUX */
+
+static int interface_read(void) {
+#if KERNEL_LINUX
+  int status;
+
+  if_states_generation++;
+  if_states_seen = 0;
+
+  if (use_netlink)
+    status = if_read_netlink();
+  else
+    status = if_read_proc();
+  if (status != 0)
+    return status;
+
+  if_states_prune();
   /* #endif KERNEL_LINUX */
 
 #elif HAVE_GETIFADDRS
@@ -396,4 +705,7 @@ void module_register(void) {
   plugin_register_init("interface", interface_init);
 #endif
   plugin_register_read("interface", interface_read);
+#if KERNEL_LINUX
+  plugin_register_shutdown("interface", interface_shutdown);
+#endif
 } /* void module_register */
@@ -40,6 +40,10 @@
 
 #define ERR_BUF_SIZE 1024
 
+/* OpenIPMI keys the cached SDRs by BMC, so all instances share one file. The
+ * path is relative to the BaseDir. */
+#define SDR_CACHE_FILE "ipmi_sdr.db"
+
 /*
  * Private data types
  */
@@ -62,6 +66,8 @@ struct c_ipmi_instance_s {
   char *username;
   char *password;
   unsigned int authtype;
+  bool sdr_cache;
+  int max_outstanding;
 
   bool connected;
   ipmi_con_t *connection;
@@ -72,6 +78,12 @@ struct c_ipmi_instance_s {
   pthread_t thread_id;
   int init_in_progress;
 
+  /* Time needed to read all sensors, from the first request of a read until
+   * the last reply. */
+  pthread_mutex_t poll_lock;
+  cdtime_t poll_start;
+  unsigned int poll_pending;
+
   struct c_ipmi_instance_s *next;
 };
 typedef struct c_ipmi_instance_s c_ipmi_instance_t;
@@ -167,6 +179,39 @@ static notification_t c_ipmi_notification_init(c_ipmi_instance_t const *st,
   return n;
 } /* notification_t c_ipmi_notification_init */
 
+static void c_ipmi_submit_poll_duration(c_ipmi_instance_t const *st,
+                                        cdtime_t duration) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(duration)};
+  vl.values_len = 1;
+
+  if (st->host != NULL)
+    sstrncpy(vl.host, st->host, sizeof(vl.host));
+  sstrncpy(vl.plugin, "ipmi", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, st->name, sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, "duration", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "poll", sizeof(vl.type_instance));
+
+  plugin_dispatch_values(&vl);
+} /* void c_ipmi_submit_poll_duration */
+
+/* Called once for every sensor reading that has been requested. */
+static void c_ipmi_poll_done(c_ipmi_instance_t *st) {
+  cdtime_t duration = 0;
+
+  pthread_mutex_lock(&st->poll_lock);
+  if (st->poll_pending > 0) {
+    st->poll_pending--;
+    if (st->poll_pending == 0)
+      duration = cdtime() - st->poll_start;
+  }
+  pthread_mutex_unlock(&st->poll_lock);
+
+  if (duration != 0)
+    c_ipmi_submit_poll_duration(st, duration);
+} /* void c_ipmi_poll_done */
+
 /*
  * Sensor handlers
  */
@@ -184,6 +229,7 @@ static void sensor_read_handler(ipmi_sensor_t *sensor, int err,
   c_ipmi_instance_t *st = list_item->instance;
 
   list_item->use--;
+  c_ipmi_poll_done(st);
 
   if (err != 0) {
     if (IPMI_IS_IPMI_ERR(err) &&
@@ -575,6 +621,13 @@ static int sensor_list_remove(c_ipmi_instance_t *st, ipmi_sensor_t *sensor) {
 static int sensor_list_read_all(c_ipmi_instance_t *st) {
   pthread_mutex_lock(&st->sensor_list_lock);
 
+  /* If readings of the previous round are still outstanding, the round
+   * continues. */
+  pthread_mutex_lock(&st->poll_lock);
+  if (st->poll_pending == 0)
+    st->poll_start = cdtime();
+  pthread_mutex_unlock(&st->poll_lock);
+
   for (c_ipmi_sensor_list_t *list_item = st->sensor_list; list_item != NULL;
        list_item = list_item->next) {
     DEBUG("ipmi plugin: try read sensor `%s` of `%s`, use: %d",
@@ -585,8 +638,22 @@ static int sensor_list_read_all(c_ipmi_instance_t *st) {
       continue;
 
     list_item->use++;
-    ipmi_sensor_id_get_reading(list_item->sensor_id, sensor_read_handler,
-                               /* user data = */ (void *)list_item);
+    /* Count the request before it is sent, the reply may arrive on another
+     * thread right away. */
+    pthread_mutex_lock(&st->poll_lock);
+    st->poll_pending++;
+    pthread_mutex_unlock(&st->poll_lock);
+
+    int status =
+        ipmi_sensor_id_get_reading(list_item->sensor_id, sensor_read_handler,
+                                   /* user data = */ (void *)list_item);
+    if (status != 0) {
+      /* The handler will not be called. */
+      list_item->use--;
+      pthread_mutex_lock(&st->poll_lock);
+      st->poll_pending--;
+      pthread_mutex_unlock(&st->poll_lock);
+    }
   } /* for (list_item) */
 
   pthread_mutex_unlock(&st->sensor_list_lock);
@@ -926,7 +993,43 @@ static int c_ipmi_thread_init(c_ipmi_instance_t *st) {
   ipmi_domain_id_t domain_id;
   int status;
 
-  if (st->connaddr != NULL) {
+  if ((st->connaddr != NULL) && (st->max_outstanding > 0)) {
+#ifdef IPMI_LANP_MAX_OUTSTANDING_MSG_COUNT
+    /* The number of requests in flight to a LAN BMC is limited by OpenIPMI,
+     * to two by default. Requests beyond that are queued. */
+    char *port = IPMI_LAN_STD_PORT_STR;
+    ipmi_lanp_parm_t parms[] = {
+        {.parm_id = IPMI_LANP_PARMID_ADDRS,
+         .parm_data = &st->connaddr,
+         .parm_data_len = 1},
+        {.parm_id = IPMI_LANP_PARMID_PORTS,
+         .parm_data = &port,
+         .parm_data_len = 1},
+        {.parm_id = IPMI_LANP_PARMID_AUTHTYPE, .parm_val = st->authtype},
+        {.parm_id = IPMI_LANP_PARMID_PRIVILEGE,
+         .parm_val = IPMI_PRIVILEGE_USER},
+        {.parm_id = IPMI_LANP_PARMID_NAME,
+         .parm_data = st->username,
+         .parm_data_len = strlen(st->username)},
+        {.parm_id = IPMI_LANP_PARMID_PASSWORD,
+         .parm_data = st->password,
+         .parm_data_len = strlen(st->password)},
+        {.parm_id = IPMI_LANP_MAX_OUTSTANDING_MSG_COUNT,
+         .parm_val = st->max_outstanding},
+    };
+
+    status = ipmi_lanp_setup_con(parms, STATIC_ARRAY_SIZE(parms), os_handler,
+                                 /* user data = */ NULL, &st->connection);
+    if (status != 0) {
+      c_ipmi_error(st, "ipmi_lanp_setup_con", status);
+      return -1;
+    }
+#else
+    ERROR("ipmi plugin: MaxOutstanding is not supported by this version of "
+          "OpenIPMI.");
+    return -1;
+#endif
+  } else if (st->connaddr != NULL) {
     status = ipmi_ip_setup_con(
         &st->connaddr, &(char *){IPMI_LAN_STD_PORT_STR}, 1, st->authtype,
         (unsigned int)IPMI_PRIVILEGE_USER, st->username, strlen(st->username),
@@ -948,8 +1051,9 @@ static int c_ipmi_thread_init(c_ipmi_instance_t *st) {
   ipmi_open_option_t opts[] = {
       {.option = IPMI_OPEN_OPTION_ALL, {.ival = 1}},
 #ifdef IPMI_OPEN_OPTION_USE_CACHE
-      /* OpenIPMI-2.0.17 and later: Disable SDR cache in local file */
-      {.option = IPMI_OPEN_OPTION_USE_CACHE, {.ival = 0}},
+      /* OpenIPMI-2.0.17 and later: Cache the SDRs in a local file, so that
+       * they are not read from the BMC again on every (re)connect. */
+      {.option = IPMI_OPEN_OPTION_USE_CACHE, {.ival = st->sdr_cache ? 1 : 0}},
 #endif
   };
 
@@ -1022,6 +1126,7 @@ static c_ipmi_instance_t *c_ipmi_init_instance() {
 
   st->sensor_list = NULL;
   pthread_mutex_init(&st->sensor_list_lock, /* attr = */ NULL);
+  pthread_mutex_init(&st->poll_lock, /* attr = */ NULL);
 
   st->host = NULL;
   st->connaddr = NULL;
@@ -1049,6 +1154,7 @@ static void c_ipmi_free_instance(c_ipmi_instance_t *st) {
   ignorelist_free(st->sel_ignorelist);
   ignorelist_free(st->ignorelist);
   pthread_mutex_destroy(&st->sensor_list_lock);
+  pthread_mutex_destroy(&st->poll_lock);
   sfree(st);
 } /* void c_ipmi_free_instance */
 
@@ -1121,6 +1227,15 @@ static int c_ipmi_config_add_instance(oconfig_item_t *ci) {
       status = cf_util_get_boolean(child, &st->sel_enabled);
     } else if (strcasecmp("SELClearEvent", child->key) == 0) {
       status = cf_util_get_boolean(child, &st->sel_clear_event);
+    } else if (strcasecmp("SDRCache", child->key) == 0) {
+      status = cf_util_get_boolean(child, &st->sdr_cache);
+    } else if (strcasecmp("MaxOutstanding", child->key) == 0) {
+      status = cf_util_get_int(child, &st->max_outstanding);
+      if ((status == 0) &&
+          ((st->max_outstanding < 1) || (st->max_outstanding > 63))) {
+        WARNING("ipmi plugin: MaxOutstanding must be in the range 1-63.");
+        status = -1;
+      }
     } else if (strcasecmp("Host", child->key) == 0)
       status = cf_util_get_string(child, &st->host);
     else if (strcasecmp("Address", child->key) == 0)
@@ -1246,6 +1361,22 @@ static int c_ipmi_init(void) {
     c_ipmi_add_instance(st);
   }
 
+  for (st = instances; st != NULL; st = st->next) {
+    if (!st->sdr_cache)
+      continue;
+
+#ifdef IPMI_OPEN_OPTION_USE_CACHE
+    if ((os_handler->database_set_filename == NULL) ||
+        (os_handler->database_set_filename(os_handler, SDR_CACHE_FILE) != 0))
+      WARNING("ipmi plugin: Setting the SDR cache file failed. OpenIPMI may "
+              "have been built without database support.");
+#else
+    WARNING("ipmi plugin: SDRCache is not supported by this version of "
+            "OpenIPMI.");
+#endif
+    break;
+  }
+
   /* Don't send `ADD' notifications during startup (~ 1 minute) */
   int cycles = 1 + (int)(TIME_T_TO_CDTIME_T(60) / plugin_get_interval());
 
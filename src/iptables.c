@@ -346,11 +346,21 @@ static void submit_chain(iptc_handle_t *handle, ip_chain_t *chain) {
   } /* while (entry) */
 }
 
+static bool same_table(ip_chain_t const *a, ip_chain_t const *b) {
+  return (a != NULL) && (b != NULL) && (a->ip_version == b->ip_version) &&
+         (strcmp(a->table, b->table) == 0);
+}
+
 static int iptables_read(void) {
   int num_failures = 0;
   ip_chain_t *chain;
+  bool done[chain_num > 0 ? chain_num : 1];
+
+  memset(done, 0, sizeof(done));
 
-  /* Init the iptc handle structure and query the correct table */
+  /* Fetching a table copies all of its rules from the kernel, which is
+   * expensive for large rule sets. Each table is therefore fetched once per
+   * read and used for all configured chains of that table. */
   for (int i = 0; i < chain_num; i++) {
     chain = chain_list[i];
 
@@ -358,6 +368,8 @@ static int iptables_read(void) {
       DEBUG("iptables plugin: chain == NULL");
       continue;
     }
+    if (done[i])
+      continue;
 
     if (chain->ip_version == IPV4) {
 #ifdef HAVE_IPTC_HANDLE_T
@@ -373,11 +385,21 @@ static int iptables_read(void) {
       if (!handle) {
         ERROR("iptables plugin: iptc_init (%s) failed: %s", chain->table,
               iptc_strerror(errno));
-        num_failures++;
+        for (int j = i; j < chain_num; j++) {
+          if (same_table(chain_list[j], chain)) {
+            done[j] = true;
+            num_failures++;
+          }
+        }
         continue;
       }
 
-      submit_chain(handle, chain);
+      for (int j = i; j < chain_num; j++) {
+        if (!same_table(chain_list[j], chain))
+          continue;
+        submit_chain(handle, chain_list[j]);
+        done[j] = true;
+      }
       iptc_free(handle);
     } else if (chain->ip_version == IPV6) {
 #ifdef HAVE_IP6TC_HANDLE_T
@@ -392,11 +414,21 @@ static int iptables_read(void) {
       if (!handle) {
         ERROR("iptables plugin: ip6tc_init (%s) failed: %s", chain->table,
               ip6tc_strerror(errno));
-        num_failures++;
+        for (int j = i; j < chain_num; j++) {
+          if (same_table(chain_list[j], chain)) {
+            done[j] = true;
+            num_failures++;
+          }
+        }
         continue;
       }
 
-      submit6_chain(handle, chain);
+      for (int j = i; j < chain_num; j++) {
+        if (!same_table(chain_list[j], chain))
+          continue;
+        submit6_chain(handle, chain_list[j]);
+        done[j] = true;
+      }
       ip6tc_free(handle);
     } else
       num_failures++;
@@ -84,9 +84,10 @@ static void irq_submit(const char *irq_name, derive_t value) {
 } /* void irq_submit */
 
 #if KERNEL_LINUX
+static proc_file_t *proc_interrupts;
+
 static int irq_read(void) {
-  FILE *fh;
-  char buffer[1024];
+  char *buffer;
   int cpu_count;
   char *fields[256];
 
@@ -97,23 +98,27 @@ static int irq_read(void) {
    * 1:     102553     158669     218062      70587   IO-APIC-edge      i8042
    * 8:          0          0          0          1   IO-APIC-edge      rtc0
    */
-  fh = fopen("/proc/interrupts", "r");
-  if (fh == NULL) {
-    ERROR("irq plugin: fopen (/proc/interrupts): %s", STRERRNO);
-    return -1;
+  if (proc_interrupts == NULL) {
+    proc_interrupts = proc_file_create("/proc/interrupts");
+    if (proc_interrupts == NULL) {
+      ERROR("irq plugin: proc_file_create failed.");
+      return -1;
+    }
   }
 
+  if (proc_file_read(proc_interrupts, NULL) == NULL)
+    return -1;
+
   /* Get CPU count from the first line */
-  if (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  if ((buffer = proc_file_next_line(proc_interrupts)) != NULL) {
     cpu_count = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
   } else {
     ERROR("irq plugin: unable to get CPU count from first line "
           "of /proc/interrupts");
-    fclose(fh);
     return -1;
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  while ((buffer = proc_file_next_line(proc_interrupts)) != NULL) {
     char *irq_name;
     size_t irq_name_len;
     derive_t irq_value;
@@ -170,8 +175,6 @@ static int irq_read(void) {
     irq_submit(irq_name, irq_value);
   }
 
-  fclose(fh);
-
   return 0;
 } /* int irq_read */
 #endif /* KERNEL_LINUX */
@@ -25,6 +25,7 @@
 
 #include "filter_chain.h"
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 
 #include <jni.h>
@@ -40,6 +41,18 @@ struct cjni_jvm_env_s /* {{{ */
 {
   JNIEnv *jvm_env;
   int reference_counter;
+
+  /* Objects kept across calls from this thread. All of them are global
+   * references, so they stay valid while the thread is detached. */
+  jstring host;
+  char host_value[DATA_MAX_NAME_LEN];
+
+  jobjectArray batch;
+  size_t batch_size;
+
+  jobject values;
+  value_t *values_buffer;
+  size_t values_size;
 };
 typedef struct cjni_jvm_env_s cjni_jvm_env_t;
 /* }}} */
@@ -63,6 +76,7 @@ typedef struct java_plugin_class_s java_plugin_class_t;
 #define CB_TYPE_NOTIFICATION 8
 #define CB_TYPE_MATCH 9
 #define CB_TYPE_TARGET 10
+#define CB_TYPE_WRITE_BATCH 11
 struct cjni_callback_info_s /* {{{ */
 {
   char *name;
@@ -74,6 +88,26 @@ struct cjni_callback_info_s /* {{{ */
 typedef struct cjni_callback_info_s cjni_callback_info_t;
 /* }}} */
 
+/* Classes and methods needed for every value list. They are looked up once
+ * in `cjni_cache_init' instead of for every value. */
+struct cjni_cache_s /* {{{ */
+{
+  jclass c_long;
+  jmethodID m_long_constructor;
+  jclass c_double;
+  jmethodID m_double_constructor;
+  jclass c_valuelist;
+  jmethodID m_valuelist_constructor;
+  jmethodID m_valuelist_addvalue;
+  jmethodID m_valuelist_fill;
+
+  /* DataSet objects by type name. */
+  c_avl_tree_t *data_sets;
+  pthread_mutex_t data_sets_lock;
+};
+typedef struct cjni_cache_s cjni_cache_t;
+/* }}} */
+
 /*
  * Global variables
  */
@@ -95,6 +129,10 @@ static pthread_mutex_t java_callbacks_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static oconfig_item_t *config_block;
 
+static cjni_cache_t cjni_cache = {
+    .data_sets_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
 /*
  * Prototypes
  *
@@ -111,6 +149,9 @@ static int cjni_callback_register(JNIEnv *jvm_env, jobject o_name,
 static int cjni_read(user_data_t *user_data);
 static int cjni_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *ud);
+static int cjni_write_batch(const data_set_t *const *ds,
+                            const value_list_t *const *vl, size_t num,
+                            user_data_t *ud);
 static int cjni_flush(cdtime_t timeout, const char *identifier,
                       user_data_t *ud);
 static void cjni_log(int severity, const char *message, user_data_t *ud);
@@ -230,51 +271,15 @@ static int ctoj_double(JNIEnv *jvm_env, /* {{{ */
 /* Convert a jlong to a java.lang.Number */
 static jobject ctoj_jlong_to_number(JNIEnv *jvm_env, jlong value) /* {{{ */
 {
-  jclass c_long;
-  jmethodID m_long_constructor;
-
-  /* Look up the java.lang.Long class */
-  c_long = (*jvm_env)->FindClass(jvm_env, "java/lang/Long");
-  if (c_long == NULL) {
-    ERROR("java plugin: ctoj_jlong_to_number: Looking up the "
-          "java.lang.Long class failed.");
-    return NULL;
-  }
-
-  m_long_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_long, "<init>", "(J)V");
-  if (m_long_constructor == NULL) {
-    ERROR("java plugin: ctoj_jlong_to_number: Looking up the "
-          "`Long (long)' constructor failed.");
-    return NULL;
-  }
-
-  return (*jvm_env)->NewObject(jvm_env, c_long, m_long_constructor, value);
+  return (*jvm_env)->NewObject(jvm_env, cjni_cache.c_long,
+                               cjni_cache.m_long_constructor, value);
 } /* }}} jobject ctoj_jlong_to_number */
 
 /* Convert a jdouble to a java.lang.Number */
 static jobject ctoj_jdouble_to_number(JNIEnv *jvm_env, jdouble value) /* {{{ */
 {
-  jclass c_double;
-  jmethodID m_double_constructor;
-
-  /* Look up the java.lang.Long class */
-  c_double = (*jvm_env)->FindClass(jvm_env, "java/lang/Double");
-  if (c_double == NULL) {
-    ERROR("java plugin: ctoj_jdouble_to_number: Looking up the "
-          "java.lang.Double class failed.");
-    return NULL;
-  }
-
-  m_double_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_double, "<init>", "(D)V");
-  if (m_double_constructor == NULL) {
-    ERROR("java plugin: ctoj_jdouble_to_number: Looking up the "
-          "`Double (double)' constructor failed.");
-    return NULL;
-  }
-
-  return (*jvm_env)->NewObject(jvm_env, c_double, m_double_constructor, value);
+  return (*jvm_env)->NewObject(jvm_env, cjni_cache.c_double,
+                               cjni_cache.m_double_constructor, value);
 } /* }}} jobject ctoj_jdouble_to_number */
 
 /* Convert a value_t to a java.lang.Number */
@@ -625,157 +630,175 @@ static jobject ctoj_data_set(JNIEnv *jvm_env, const data_set_t *ds) /* {{{ */
   return o_dataset;
 } /* }}} jobject ctoj_data_set */
 
-static int ctoj_value_list_add_value(JNIEnv *jvm_env, /* {{{ */
-                                     value_t value, int ds_type,
-                                     jclass class_ptr, jobject object_ptr) {
-  jmethodID m_addvalue;
-  jobject o_number;
+/* Returns a DataSet object for `ds'. The objects are created once per type
+ * and shared by all value lists. The returned global reference must not be
+ * deleted by the caller. */
+static jobject ctoj_data_set_cached(JNIEnv *jvm_env, /* {{{ */
+                                    const data_set_t *ds) {
+  jobject o_dataset = NULL;
 
-  m_addvalue = (*jvm_env)->GetMethodID(jvm_env, class_ptr, "addValue",
-                                       "(Ljava/lang/Number;)V");
-  if (m_addvalue == NULL) {
-    ERROR("java plugin: ctoj_value_list_add_value: "
-          "Cannot find method `void addValue (Number)'.");
-    return -1;
+  pthread_mutex_lock(&cjni_cache.data_sets_lock);
+
+  if (c_avl_get(cjni_cache.data_sets, ds->type, (void *)&o_dataset) == 0) {
+    pthread_mutex_unlock(&cjni_cache.data_sets_lock);
+    return o_dataset;
   }
 
-  o_number = ctoj_value_to_number(jvm_env, value, ds_type);
-  if (o_number == NULL) {
-    ERROR("java plugin: ctoj_value_list_add_value: "
-          "ctoj_value_to_number failed.");
-    return -1;
+  jobject o_local = ctoj_data_set(jvm_env, ds);
+  if (o_local == NULL) {
+    pthread_mutex_unlock(&cjni_cache.data_sets_lock);
+    ERROR("java plugin: ctoj_data_set_cached: ctoj_data_set (%s) failed.",
+          ds->type);
+    return NULL;
+  }
+
+  o_dataset = (*jvm_env)->NewGlobalRef(jvm_env, o_local);
+  (*jvm_env)->DeleteLocalRef(jvm_env, o_local);
+  if (o_dataset == NULL) {
+    pthread_mutex_unlock(&cjni_cache.data_sets_lock);
+    ERROR("java plugin: ctoj_data_set_cached: NewGlobalRef failed.");
+    return NULL;
   }
 
-  (*jvm_env)->CallVoidMethod(jvm_env, object_ptr, m_addvalue, o_number);
+  char *type = strdup(ds->type);
+  if ((type == NULL) ||
+      (c_avl_insert(cjni_cache.data_sets, type, o_dataset) != 0)) {
+    pthread_mutex_unlock(&cjni_cache.data_sets_lock);
+    ERROR("java plugin: ctoj_data_set_cached: Caching the data set failed.");
+    sfree(type);
+    (*jvm_env)->DeleteGlobalRef(jvm_env, o_dataset);
+    return NULL;
+  }
 
-  (*jvm_env)->DeleteLocalRef(jvm_env, o_number);
+  pthread_mutex_unlock(&cjni_cache.data_sets_lock);
+  return o_dataset;
+} /* }}} jobject ctoj_data_set_cached */
 
-  return 0;
-} /* }}} int ctoj_value_list_add_value */
+/* Returns a java.lang.String holding `host'. The string of the last host is
+ * kept per thread, because it rarely changes between value lists. The
+ * returned global reference must not be deleted by the caller. Returns NULL if
+ * the thread has not been attached using `cjni_thread_attach'. */
+static jstring ctoj_host_string(JNIEnv *jvm_env, const char *host) /* {{{ */
+{
+  cjni_jvm_env_t *cjni_env;
+  jstring o_local;
+  jstring o_host;
+
+  cjni_env = pthread_getspecific(jvm_env_key);
+  if (cjni_env == NULL)
+    return NULL;
+
+  if ((cjni_env->host != NULL) && (strcmp(cjni_env->host_value, host) == 0))
+    return cjni_env->host;
+
+  o_local = (*jvm_env)->NewStringUTF(jvm_env, host);
+  if (o_local == NULL)
+    return NULL;
+
+  o_host = (*jvm_env)->NewGlobalRef(jvm_env, o_local);
+  (*jvm_env)->DeleteLocalRef(jvm_env, o_local);
+  if (o_host == NULL)
+    return NULL;
 
-static int ctoj_value_list_add_data_set(JNIEnv *jvm_env, /* {{{ */
-                                        jclass c_valuelist, jobject o_valuelist,
-                                        const data_set_t *ds) {
-  jmethodID m_setdataset;
+  if (cjni_env->host != NULL)
+    (*jvm_env)->DeleteGlobalRef(jvm_env, cjni_env->host);
+  cjni_env->host = o_host;
+  sstrncpy(cjni_env->host_value, host, sizeof(cjni_env->host_value));
+
+  return o_host;
+} /* }}} jstring ctoj_host_string */
+
+/* Set all members of a org/collectd/api/ValueList with a single call to its
+ * `fill' method. If `o_values' is not NULL, it is a direct ByteBuffer holding
+ * the values of `vl' starting at the value with index `offset'. Otherwise the
+ * values have to be added by the caller. */
+static int ctoj_value_list_fill(JNIEnv *jvm_env, /* {{{ */
+                                jobject o_valuelist, const data_set_t *ds,
+                                const value_list_t *vl, jobject o_values,
+                                jint offset) {
+  const char *strings[] = {vl->plugin, vl->plugin_instance, vl->type,
+                           vl->type_instance};
+  jstring o_strings[STATIC_ARRAY_SIZE(strings)] = {NULL};
+  jstring o_host_local = NULL;
+  jstring o_host;
   jobject o_dataset;
+  int status = 0;
 
-  /* Look for the `void setDataSource (List<DataSource> ds)' method. */
-  m_setdataset = (*jvm_env)->GetMethodID(jvm_env, c_valuelist, "setDataSet",
-                                         "(Lorg/collectd/api/DataSet;)V");
-  if (m_setdataset == NULL) {
-    ERROR("java plugin: ctoj_value_list_add_data_set: "
-          "Cannot find the `void setDataSet (DataSet)' method.");
+  o_dataset = ctoj_data_set_cached(jvm_env, ds);
+  if (o_dataset == NULL)
     return -1;
+
+  o_host = ctoj_host_string(jvm_env, vl->host);
+  if (o_host == NULL) {
+    o_host_local = (*jvm_env)->NewStringUTF(jvm_env, vl->host);
+    if (o_host_local == NULL) {
+      ERROR("java plugin: ctoj_value_list_fill: NewStringUTF failed.");
+      return -1;
+    }
+    o_host = o_host_local;
   }
 
-  /* Create a DataSet object. */
-  o_dataset = ctoj_data_set(jvm_env, ds);
-  if (o_dataset == NULL) {
-    ERROR("java plugin: ctoj_value_list_add_data_set: "
-          "ctoj_data_set (%s) failed.",
-          ds->type);
-    return -1;
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(strings); i++) {
+    o_strings[i] = (*jvm_env)->NewStringUTF(jvm_env, strings[i]);
+    if (o_strings[i] == NULL) {
+      ERROR("java plugin: ctoj_value_list_fill: NewStringUTF failed.");
+      status = -1;
+      break;
+    }
   }
 
-  /* Actually call the method. */
-  (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist, m_setdataset, o_dataset);
+  /* Java stores time in milliseconds. */
+  if (status == 0)
+    (*jvm_env)->CallVoidMethod(
+        jvm_env, o_valuelist, cjni_cache.m_valuelist_fill, o_host,
+        o_strings[0], o_strings[1], o_strings[2], o_strings[3],
+        (jlong)CDTIME_T_TO_MS(vl->time), (jlong)CDTIME_T_TO_MS(vl->interval),
+        o_dataset, o_values, offset);
 
-  /* Decrease reference counter on the List<DataSource> object. */
-  (*jvm_env)->DeleteLocalRef(jvm_env, o_dataset);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(strings); i++)
+    if (o_strings[i] != NULL)
+      (*jvm_env)->DeleteLocalRef(jvm_env, o_strings[i]);
+  if (o_host_local != NULL)
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_host_local);
 
-  return 0;
-} /* }}} int ctoj_value_list_add_data_set */
+  return status;
+} /* }}} int ctoj_value_list_fill */
 
 /* Convert a value_list_t (and data_set_t) to a org/collectd/api/ValueList */
 static jobject ctoj_value_list(JNIEnv *jvm_env, /* {{{ */
                                const data_set_t *ds, const value_list_t *vl) {
-  jclass c_valuelist;
-  jmethodID m_valuelist_constructor;
   jobject o_valuelist;
   int status;
 
-  /* First, create a new ValueList instance..
-   * Look up the class.. */
-  c_valuelist = (*jvm_env)->FindClass(jvm_env, "org/collectd/api/ValueList");
-  if (c_valuelist == NULL) {
-    ERROR("java plugin: ctoj_value_list: "
-          "FindClass (org/collectd/api/ValueList) failed.");
-    return NULL;
-  }
-
-  /* Lookup the `ValueList ()' constructor. */
-  m_valuelist_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_valuelist, "<init>", "()V");
-  if (m_valuelist_constructor == NULL) {
-    ERROR("java plugin: ctoj_value_list: Cannot find the "
-          "`ValueList ()' constructor.");
-    return NULL;
-  }
-
-  /* Create a new instance. */
-  o_valuelist =
-      (*jvm_env)->NewObject(jvm_env, c_valuelist, m_valuelist_constructor);
+  o_valuelist = (*jvm_env)->NewObject(jvm_env, cjni_cache.c_valuelist,
+                                      cjni_cache.m_valuelist_constructor);
   if (o_valuelist == NULL) {
     ERROR("java plugin: ctoj_value_list: Creating a new ValueList instance "
           "failed.");
     return NULL;
   }
 
-  status = ctoj_value_list_add_data_set(jvm_env, c_valuelist, o_valuelist, ds);
-  if (status != 0) {
-    ERROR("java plugin: ctoj_value_list: "
-          "ctoj_value_list_add_data_set failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
-    return NULL;
-  }
-
-/* Set the strings.. */
-#define SET_STRING(str, method_name)                                           \
-  do {                                                                         \
-    status = ctoj_string(jvm_env, str, c_valuelist, o_valuelist, method_name); \
-    if (status != 0) {                                                         \
-      ERROR("java plugin: ctoj_value_list: ctoj_string (%s) failed.",          \
-            method_name);                                                      \
-      (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);                        \
-      return NULL;                                                             \
-    }                                                                          \
-  } while (0)
-
-  SET_STRING(vl->host, "setHost");
-  SET_STRING(vl->plugin, "setPlugin");
-  SET_STRING(vl->plugin_instance, "setPluginInstance");
-  SET_STRING(vl->type, "setType");
-  SET_STRING(vl->type_instance, "setTypeInstance");
-
-#undef SET_STRING
-
-  /* Set the `time' member. Java stores time in milliseconds. */
-  status = ctoj_long(jvm_env, (jlong)CDTIME_T_TO_MS(vl->time), c_valuelist,
-                     o_valuelist, "setTime");
-  if (status != 0) {
-    ERROR("java plugin: ctoj_value_list: ctoj_long (setTime) failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
-    return NULL;
-  }
-
-  /* Set the `interval' member.. */
-  status = ctoj_long(jvm_env, (jlong)CDTIME_T_TO_MS(vl->interval), c_valuelist,
-                     o_valuelist, "setInterval");
+  status = ctoj_value_list_fill(jvm_env, o_valuelist, ds, vl, NULL, 0);
   if (status != 0) {
-    ERROR("java plugin: ctoj_value_list: ctoj_long (setInterval) failed.");
+    ERROR("java plugin: ctoj_value_list: ctoj_value_list_fill failed.");
     (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
     return NULL;
   }
 
   for (size_t i = 0; i < vl->values_len; i++) {
-    status = ctoj_value_list_add_value(jvm_env, vl->values[i], ds->ds[i].type,
-                                       c_valuelist, o_valuelist);
-    if (status != 0) {
-      ERROR("java plugin: ctoj_value_list: "
-            "ctoj_value_list_add_value failed.");
+    jobject o_number;
+
+    o_number = ctoj_value_to_number(jvm_env, vl->values[i], ds->ds[i].type);
+    if (o_number == NULL) {
+      ERROR("java plugin: ctoj_value_list: ctoj_value_to_number failed.");
       (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
       return NULL;
     }
+
+    (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist,
+                               cjni_cache.m_valuelist_addvalue, o_number);
+
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_number);
   }
 
   return o_valuelist;
@@ -1337,6 +1360,29 @@ static jint JNICALL cjni_api_register_write(JNIEnv *jvm_env, /* {{{ */
   return 0;
 } /* }}} jint cjni_api_register_write */
 
+static jint JNICALL cjni_api_register_write_batch(JNIEnv *jvm_env, /* {{{ */
+                                                  jobject this, jobject o_name,
+                                                  jobject o_write) {
+  cjni_callback_info_t *cbi;
+
+  cbi = cjni_callback_info_create(jvm_env, o_name, o_write,
+                                  CB_TYPE_WRITE_BATCH);
+  if (cbi == NULL)
+    return -1;
+
+  DEBUG("java plugin: Registering new batch write callback: %s", cbi->name);
+
+  plugin_register_write_batch(cbi->name, cjni_write_batch,
+                              &(user_data_t){
+                                  .data = cbi,
+                                  .free_func = cjni_callback_info_destroy,
+                              });
+
+  (*jvm_env)->DeleteLocalRef(jvm_env, o_write);
+
+  return 0;
+} /* }}} jint cjni_api_register_write_batch */
+
 static jint JNICALL cjni_api_register_flush(JNIEnv *jvm_env, /* {{{ */
                                             jobject this, jobject o_name,
                                             jobject o_flush) {
@@ -1533,6 +1579,10 @@ static JNINativeMethod jni_api_functions[] = /* {{{ */
          "(Ljava/lang/String;Lorg/collectd/api/CollectdWriteInterface;)I",
          cjni_api_register_write},
 
+        {"registerWriteBatch",
+         "(Ljava/lang/String;Lorg/collectd/api/CollectdWriteBatchInterface;)I",
+         cjni_api_register_write_batch},
+
         {"registerFlush",
          "(Ljava/lang/String;Lorg/collectd/api/CollectdFlushInterface;)I",
          cjni_api_register_flush},
@@ -1603,6 +1653,11 @@ cjni_callback_info_create(JNIEnv *jvm_env, /* {{{ */
     method_signature = "(Lorg/collectd/api/ValueList;)I";
     break;
 
+  case CB_TYPE_WRITE_BATCH:
+    method_name = "writeBatch";
+    method_signature = "([Lorg/collectd/api/ValueList;I)I";
+    break;
+
   case CB_TYPE_FLUSH:
     method_name = "flush";
     method_signature = "(Ljava/lang/Number;Ljava/lang/String;)I";
@@ -1787,10 +1842,126 @@ static void cjni_jvm_env_destroy(void *args) /* {{{ */
           (void *)cjni_env->jvm_env);
   }
 
+  /* Release the objects kept by this thread. If the JVM is gone already, so
+   * are the objects. */
+  if ((jvm != NULL) && ((cjni_env->host != NULL) ||
+                        (cjni_env->batch != NULL) || (cjni_env->values != NULL))) {
+    JNIEnv *jvm_env = NULL;
+    JavaVMAttachArgs attach_args = {.version = JNI_VERSION_1_2};
+
+    if ((*jvm)->AttachCurrentThread(jvm, (void *)&jvm_env,
+                                    (void *)&attach_args) == 0) {
+      if (cjni_env->host != NULL)
+        (*jvm_env)->DeleteGlobalRef(jvm_env, cjni_env->host);
+      if (cjni_env->batch != NULL)
+        (*jvm_env)->DeleteGlobalRef(jvm_env, cjni_env->batch);
+      if (cjni_env->values != NULL)
+        (*jvm_env)->DeleteGlobalRef(jvm_env, cjni_env->values);
+      (*jvm)->DetachCurrentThread(jvm);
+    }
+  }
+  sfree(cjni_env->values_buffer);
+
   /* The pointer is allocated in `cjni_thread_attach' */
   free(cjni_env);
 } /* }}} void cjni_jvm_env_destroy */
 
+/* Look up `name' and return a global reference to the class. */
+static jclass cjni_cache_class(JNIEnv *jvm_env, const char *name) /* {{{ */
+{
+  jclass c_local;
+  jclass c_global;
+
+  c_local = (*jvm_env)->FindClass(jvm_env, name);
+  if (c_local == NULL) {
+    ERROR("java plugin: cjni_cache_class: FindClass (%s) failed.", name);
+    return NULL;
+  }
+
+  c_global = (*jvm_env)->NewGlobalRef(jvm_env, c_local);
+  (*jvm_env)->DeleteLocalRef(jvm_env, c_local);
+  if (c_global == NULL)
+    ERROR("java plugin: cjni_cache_class: NewGlobalRef (%s) failed.", name);
+
+  return c_global;
+} /* }}} jclass cjni_cache_class */
+
+/* Look up the classes and methods used for every value list. */
+static int cjni_cache_init(JNIEnv *jvm_env) /* {{{ */
+{
+  cjni_cache.c_long = cjni_cache_class(jvm_env, "java/lang/Long");
+  cjni_cache.c_double = cjni_cache_class(jvm_env, "java/lang/Double");
+  cjni_cache.c_valuelist =
+      cjni_cache_class(jvm_env, "org/collectd/api/ValueList");
+  if ((cjni_cache.c_long == NULL) || (cjni_cache.c_double == NULL) ||
+      (cjni_cache.c_valuelist == NULL))
+    return -1;
+
+  struct {
+    jmethodID *method;
+    jclass class;
+    const char *name;
+    const char *signature;
+  } methods[] = {
+      {&cjni_cache.m_long_constructor, cjni_cache.c_long, "<init>", "(J)V"},
+      {&cjni_cache.m_double_constructor, cjni_cache.c_double, "<init>",
+       "(D)V"},
+      {&cjni_cache.m_valuelist_constructor, cjni_cache.c_valuelist, "<init>",
+       "()V"},
+      {&cjni_cache.m_valuelist_addvalue, cjni_cache.c_valuelist, "addValue",
+       "(Ljava/lang/Number;)V"},
+      {&cjni_cache.m_valuelist_fill, cjni_cache.c_valuelist, "fill",
+       "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;"
+       "Ljava/lang/String;Ljava/lang/String;JJLorg/collectd/api/DataSet;"
+       "Ljava/nio/ByteBuffer;I)V"},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(methods); i++) {
+    *methods[i].method = (*jvm_env)->GetMethodID(
+        jvm_env, methods[i].class, methods[i].name, methods[i].signature);
+    if (*methods[i].method == NULL) {
+      ERROR("java plugin: cjni_cache_init: Cannot find the method `%s' with "
+            "signature `%s'.",
+            methods[i].name, methods[i].signature);
+      return -1;
+    }
+  }
+
+  cjni_cache.data_sets =
+      c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (cjni_cache.data_sets == NULL) {
+    ERROR("java plugin: cjni_cache_init: c_avl_create failed.");
+    return -1;
+  }
+
+  return 0;
+} /* }}} int cjni_cache_init */
+
+static void cjni_cache_destroy(JNIEnv *jvm_env) /* {{{ */
+{
+  jclass *classes[] = {&cjni_cache.c_long, &cjni_cache.c_double,
+                       &cjni_cache.c_valuelist};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(classes); i++) {
+    if (*classes[i] != NULL)
+      (*jvm_env)->DeleteGlobalRef(jvm_env, *classes[i]);
+    *classes[i] = NULL;
+  }
+
+  if (cjni_cache.data_sets != NULL) {
+    char *type;
+    jobject o_dataset;
+
+    while (c_avl_pick(cjni_cache.data_sets, (void *)&type,
+                      (void *)&o_dataset) == 0) {
+      sfree(type);
+      (*jvm_env)->DeleteGlobalRef(jvm_env, o_dataset);
+    }
+    c_avl_destroy(cjni_cache.data_sets);
+    cjni_cache.data_sets = NULL;
+  }
+} /* }}} void cjni_cache_destroy */
+
 /* Register ``native'' functions with the JVM. Native functions are C-functions
  * that can be called by Java code. */
 static int cjni_init_native(JNIEnv *jvm_env) /* {{{ */
@@ -1813,6 +1984,12 @@ static int cjni_init_native(JNIEnv *jvm_env) /* {{{ */
     return -1;
   }
 
+  status = cjni_cache_init(jvm_env);
+  if (status != 0) {
+    ERROR("cjni_init_native: cjni_cache_init failed.");
+    return -1;
+  }
+
   return 0;
 } /* }}} int cjni_init_native */
 
@@ -2353,6 +2530,167 @@ static int cjni_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   return ret_status;
 } /* }}} int cjni_write */
 
+/* Make sure the per-thread ValueList array has room for `vl_num' elements and
+ * the value buffer for `values_num' values. */
+static int cjni_write_batch_reserve(JNIEnv *jvm_env, /* {{{ */
+                                    cjni_jvm_env_t *cjni_env, size_t vl_num,
+                                    size_t values_num) {
+  if (vl_num > cjni_env->batch_size) {
+    size_t size = (cjni_env->batch_size > 0) ? cjni_env->batch_size : 64;
+    jobjectArray o_local;
+    jobjectArray o_batch;
+
+    while (size < vl_num)
+      size *= 2;
+
+    o_local = (*jvm_env)->NewObjectArray(jvm_env, (jsize)size,
+                                         cjni_cache.c_valuelist, NULL);
+    if (o_local == NULL) {
+      ERROR("java plugin: cjni_write_batch_reserve: NewObjectArray failed.");
+      return -1;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+      jobject o_valuelist = (*jvm_env)->NewObject(
+          jvm_env, cjni_cache.c_valuelist, cjni_cache.m_valuelist_constructor);
+      if (o_valuelist == NULL) {
+        ERROR("java plugin: cjni_write_batch_reserve: Creating a new "
+              "ValueList instance failed.");
+        (*jvm_env)->DeleteLocalRef(jvm_env, o_local);
+        return -1;
+      }
+      (*jvm_env)->SetObjectArrayElement(jvm_env, o_local, (jsize)i,
+                                        o_valuelist);
+      (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
+    }
+
+    o_batch = (*jvm_env)->NewGlobalRef(jvm_env, o_local);
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_local);
+    if (o_batch == NULL) {
+      ERROR("java plugin: cjni_write_batch_reserve: NewGlobalRef failed.");
+      return -1;
+    }
+
+    if (cjni_env->batch != NULL)
+      (*jvm_env)->DeleteGlobalRef(jvm_env, cjni_env->batch);
+    cjni_env->batch = o_batch;
+    cjni_env->batch_size = size;
+  }
+
+  if (values_num > cjni_env->values_size) {
+    size_t size = (cjni_env->values_size > 0) ? cjni_env->values_size : 256;
+    jobject o_local;
+
+    while (size < values_num)
+      size *= 2;
+
+    /* The old ByteBuffer points to the old memory, so release it first. */
+    if (cjni_env->values != NULL)
+      (*jvm_env)->DeleteGlobalRef(jvm_env, cjni_env->values);
+    cjni_env->values = NULL;
+    sfree(cjni_env->values_buffer);
+    cjni_env->values_size = 0;
+
+    cjni_env->values_buffer = calloc(size, sizeof(*cjni_env->values_buffer));
+    if (cjni_env->values_buffer == NULL) {
+      ERROR("java plugin: cjni_write_batch_reserve: calloc failed.");
+      return -1;
+    }
+
+    o_local = (*jvm_env)->NewDirectByteBuffer(
+        jvm_env, cjni_env->values_buffer,
+        (jlong)(size * sizeof(*cjni_env->values_buffer)));
+    if (o_local == NULL) {
+      ERROR("java plugin: cjni_write_batch_reserve: "
+            "NewDirectByteBuffer failed.");
+      sfree(cjni_env->values_buffer);
+      return -1;
+    }
+
+    cjni_env->values = (*jvm_env)->NewGlobalRef(jvm_env, o_local);
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_local);
+    if (cjni_env->values == NULL) {
+      ERROR("java plugin: cjni_write_batch_reserve: NewGlobalRef failed.");
+      sfree(cjni_env->values_buffer);
+      return -1;
+    }
+    cjni_env->values_size = size;
+  }
+
+  return 0;
+} /* }}} int cjni_write_batch_reserve */
+
+/* Call the CB_TYPE_WRITE_BATCH callback pointed to by the `user_data_t'
+ * pointer. The ValueList array, its elements and the buffer holding the values
+ * are kept per thread and reused for every batch. Each value takes eight bytes
+ * in the buffer: `value_t' already is a double or a 64 bit integer in host
+ * byte order, which is what ByteBuffer's getDouble and getLong expect. */
+static int cjni_write_batch(const data_set_t *const *ds, /* {{{ */
+                            const value_list_t *const *vl, size_t num,
+                            user_data_t *ud) {
+  JNIEnv *jvm_env;
+  cjni_jvm_env_t *cjni_env;
+  cjni_callback_info_t *cbi;
+  size_t values_num = 0;
+  size_t offset = 0;
+  int ret_status;
+
+  if (jvm == NULL) {
+    ERROR("java plugin: cjni_write_batch: jvm == NULL");
+    return -1;
+  }
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("java plugin: cjni_write_batch: Invalid user data.");
+    return -1;
+  }
+
+  if (num == 0)
+    return 0;
+
+  jvm_env = cjni_thread_attach();
+  if (jvm_env == NULL)
+    return -1;
+
+  cbi = (cjni_callback_info_t *)ud->data;
+  cjni_env = pthread_getspecific(jvm_env_key);
+
+  for (size_t i = 0; i < num; i++)
+    values_num += vl[i]->values_len;
+
+  if (cjni_write_batch_reserve(jvm_env, cjni_env, num, values_num) != 0) {
+    cjni_thread_detach();
+    return -1;
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    jobject o_valuelist;
+    int status;
+
+    memcpy(cjni_env->values_buffer + offset, vl[i]->values,
+           vl[i]->values_len * sizeof(*vl[i]->values));
+
+    o_valuelist =
+        (*jvm_env)->GetObjectArrayElement(jvm_env, cjni_env->batch, (jsize)i);
+    status = ctoj_value_list_fill(jvm_env, o_valuelist, ds[i], vl[i],
+                                  cjni_env->values, (jint)offset);
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
+    if (status != 0) {
+      ERROR("java plugin: cjni_write_batch: ctoj_value_list_fill failed.");
+      cjni_thread_detach();
+      return -1;
+    }
+
+    offset += vl[i]->values_len;
+  }
+
+  ret_status = (*jvm_env)->CallIntMethod(jvm_env, cbi->object, cbi->method,
+                                         cjni_env->batch, (jint)num);
+
+  cjni_thread_detach();
+  return ret_status;
+} /* }}} int cjni_write_batch */
+
 /* Call the CB_TYPE_FLUSH callback pointed to by the `user_data_t' pointer. */
 static int cjni_flush(cdtime_t timeout, const char *identifier, /* {{{ */
                       user_data_t *ud) {
@@ -2791,6 +3129,8 @@ static int cjni_shutdown(void) /* {{{ */
   java_classes_list_len = 0;
   sfree(java_classes_list);
 
+  cjni_cache_destroy(jvm_env);
+
   /* Destroy the JVM */
   DEBUG("java plugin: Destroying the JVM.");
   (*jvm)->DestroyJavaVM(jvm);
@@ -54,6 +54,7 @@
 #endif
 
 #include "collectd/client.h"
+#include "collectd/network_buffer.h"
 
 /* NI_MAXHOST has been obsoleted by RFC 3493 which is a reason for SunOS 5.11
  * to no longer define it. We'll use the old, RFC 2553 value here. */
@@ -74,6 +75,9 @@
 #define AI_ADDRCONFIG 0
 #endif
 
+/* Size of the frames sent by lcc_putval_batch(). */
+#define LCC_PUTBIN_FRAME_SIZE 65536
+
 /* Secure/static macros. They work like `strcpy' and `strcat', but assure null
  * termination. They work for static buffers only, because they use `sizeof'.
  * The `SSTRCATF' combines the functionality of `snprintf' and `strcat' which
@@ -717,6 +721,166 @@ int lcc_getval(lcc_connection_t *c, lcc_identifier_t *ident, /* {{{ */
   return 0;
 } /* }}} int lcc_getval */
 
+/* Parses one line of a GETVALS response: the identifier, in double quotes
+ * if it contains spaces, followed by "<name>=<value>" fields. */
+static int lcc_getvals_parse_line(lcc_connection_t *c, /* {{{ */
+                                  lcc_getval_result_t *r, char *line) {
+  char *ident_str = line;
+  char *ptr;
+
+  if (*ident_str == '"') {
+    ident_str++;
+    for (ptr = ident_str; (*ptr != '"') && (*ptr != 0); ptr++) {
+      if ((ptr[0] == '\\') && (ptr[1] != 0))
+        memmove(ptr, ptr + 1, strlen(ptr + 1) + 1);
+    }
+    if (*ptr != '"') {
+      lcc_set_errno(c, EILSEQ);
+      return -1;
+    }
+  } else {
+    ptr = ident_str;
+    while ((*ptr != ' ') && (*ptr != 0))
+      ptr++;
+  }
+  if (*ptr != 0) {
+    *ptr = 0;
+    ptr++;
+  }
+
+  if (lcc_string_to_identifier(c, &r->identifier, ident_str) != 0)
+    return -1;
+
+  /* Every field is preceded by one space. */
+  size_t num = 0;
+  for (char *tmp = ptr; *tmp != 0; tmp++)
+    if (*tmp == '=')
+      num++;
+
+  r->values = calloc(num, sizeof(*r->values));
+  r->values_names = calloc(num, sizeof(*r->values_names));
+  if ((num > 0) && ((r->values == NULL) || (r->values_names == NULL))) {
+    lcc_set_errno(c, ENOMEM);
+    return -1;
+  }
+
+  while ((*ptr != 0) && (r->values_num < num)) {
+    while (*ptr == ' ')
+      ptr++;
+
+    char *key = ptr;
+    char *value = strchr(key, '=');
+    if (value == NULL)
+      break;
+    *value = 0;
+    value++;
+
+    char *endptr = NULL;
+    errno = 0;
+    r->values[r->values_num] = strtod(value, &endptr);
+    if ((endptr == value) || (errno != 0) ||
+        ((*endptr != ' ') && (*endptr != 0))) {
+      lcc_set_errno(c, EILSEQ);
+      return -1;
+    }
+
+    r->values_names[r->values_num] = strdup(key);
+    if (r->values_names[r->values_num] == NULL) {
+      lcc_set_errno(c, ENOMEM);
+      return -1;
+    }
+    r->values_num++;
+    ptr = endptr;
+  }
+
+  return 0;
+} /* }}} int lcc_getvals_parse_line */
+
+int lcc_getvals(lcc_connection_t *c, /* {{{ */
+                char const *const *patterns, size_t patterns_num,
+                lcc_getval_result_t **ret_results, size_t *ret_results_num) {
+  lcc_response_t res;
+  int status;
+
+  if (c == NULL)
+    return -1;
+
+  if ((patterns == NULL) || (patterns_num == 0) || (ret_results == NULL) ||
+      (ret_results_num == NULL)) {
+    lcc_set_errno(c, EINVAL);
+    return -1;
+  }
+
+  /* Quoting at most doubles the length of a pattern. */
+  size_t command_size = sizeof("GETVALS");
+  for (size_t i = 0; i < patterns_num; i++)
+    command_size += 2 * strlen(patterns[i]) + 3;
+
+  char *command = malloc(command_size);
+  if (command == NULL) {
+    lcc_set_errno(c, ENOMEM);
+    return -1;
+  }
+
+  size_t fill = (size_t)snprintf(command, command_size, "GETVALS");
+  for (size_t i = 0; i < patterns_num; i++) {
+    command[fill++] = ' ';
+    lcc_strescape(command + fill, patterns[i], command_size - fill);
+    fill += strlen(command + fill);
+  }
+
+  status = lcc_sendreceive(c, command, &res);
+  free(command);
+  if (status != 0)
+    return status;
+
+  if (res.status != 0) {
+    LCC_SET_ERRSTR(c, "Server error: %s", res.message);
+    lcc_response_free(&res);
+    return -1;
+  }
+
+  lcc_getval_result_t *results = calloc(res.lines_num + 1, sizeof(*results));
+  if (results == NULL) {
+    lcc_response_free(&res);
+    lcc_set_errno(c, ENOMEM);
+    return -1;
+  }
+
+  size_t results_num = 0;
+  for (size_t i = 0; i < res.lines_num; i++) {
+    status = lcc_getvals_parse_line(c, results + i, res.lines[i]);
+    results_num++;
+    if (status != 0)
+      break;
+  }
+
+  lcc_response_free(&res);
+
+  if (status != 0) {
+    lcc_getvals_free(results, results_num);
+    return -1;
+  }
+
+  *ret_results = results;
+  *ret_results_num = results_num;
+  return 0;
+} /* }}} int lcc_getvals */
+
+void lcc_getvals_free(lcc_getval_result_t *results, /* {{{ */
+                      size_t results_num) {
+  if (results == NULL)
+    return;
+
+  for (size_t i = 0; i < results_num; i++) {
+    for (size_t j = 0; j < results[i].values_num; j++)
+      free(results[i].values_names[j]);
+    free(results[i].values_names);
+    free(results[i].values);
+  }
+  free(results);
+} /* }}} void lcc_getvals_free */
+
 int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
 {
   char ident_str[6 * LCC_NAME_LEN];
@@ -776,6 +940,101 @@ int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
   return 0;
 } /* }}} int lcc_putval */
 
+static int lcc_putbin_send(lcc_connection_t *c, /* {{{ */
+                           lcc_network_buffer_t *nb) {
+  size_t buffer_size = LCC_PUTBIN_FRAME_SIZE;
+  lcc_response_t res = {0};
+  int status;
+
+  char *buffer = malloc(buffer_size);
+  if (buffer == NULL) {
+    lcc_set_errno(c, ENOMEM);
+    return -1;
+  }
+
+  lcc_network_buffer_finalize(nb);
+  lcc_network_buffer_get(nb, buffer, &buffer_size);
+
+  lcc_tracef("send:    --> PUTBIN %zu\n", buffer_size);
+
+  if ((fprintf(c->fh, "PUTBIN %zu\r\n", buffer_size) < 0) ||
+      (fwrite(buffer, 1, buffer_size, c->fh) != buffer_size) ||
+      (fflush(c->fh) != 0)) {
+    lcc_set_errno(c, errno);
+    free(buffer);
+    return -1;
+  }
+  free(buffer);
+
+  status = lcc_receive(c, &res);
+  if (status != 0)
+    return status;
+
+  if (res.status != 0) {
+    LCC_SET_ERRSTR(c, "Server error: %s", res.message);
+    lcc_response_free(&res);
+    return -1;
+  }
+
+  lcc_response_free(&res);
+  return lcc_network_buffer_initialize(nb);
+} /* }}} int lcc_putbin_send */
+
+int lcc_putval_batch(lcc_connection_t *c, /* {{{ */
+                     const lcc_value_list_t *vl, size_t vl_num) {
+  lcc_network_buffer_t *nb;
+  size_t frame_num = 0;
+  int status = 0;
+
+  if ((c == NULL) || ((vl == NULL) && (vl_num > 0))) {
+    lcc_set_errno(c, EINVAL);
+    return -1;
+  }
+
+  if (c->fh == NULL) {
+    lcc_set_errno(c, EBADF);
+    return -1;
+  }
+
+  nb = lcc_network_buffer_create(LCC_PUTBIN_FRAME_SIZE);
+  if (nb == NULL) {
+    lcc_set_errno(c, ENOMEM);
+    return -1;
+  }
+
+  size_t done = 0;
+  while ((status == 0) && (done < vl_num)) {
+    size_t added = 0;
+    status = lcc_network_buffer_add_values(nb, vl + done, vl_num - done, &added);
+    done += added;
+    frame_num += added;
+    if (status != 0) {
+      lcc_set_errno(c, status);
+      status = -1;
+      break;
+    }
+
+    if (done >= vl_num)
+      break;
+
+    /* The frame is full: send it and continue with an empty one. */
+    if (frame_num == 0) {
+      LCC_SET_ERRSTR(c, "Value list %zu does not fit into a frame.", done);
+      status = -1;
+      break;
+    }
+
+    status = lcc_putbin_send(c, nb);
+    frame_num = 0;
+  }
+
+  if ((status == 0) && (frame_num > 0))
+    status = lcc_putbin_send(c, nb);
+
+  lcc_network_buffer_destroy(nb);
+  return status;
+} /* }}} int lcc_putval_batch */
+
 int lcc_flush(lcc_connection_t *c, const char *plugin, /* {{{ */
               lcc_identifier_t *ident, int timeout) {
   char command[1024] = "";
@@ -900,6 +1159,36 @@ int lcc_listval(lcc_connection_t *c, /* {{{ */
   return 0;
 } /* }}} int lcc_listval */
 
+int lcc_stats(lcc_connection_t *c, char ***ret_lines, /* {{{ */
+              size_t *ret_lines_num) {
+  lcc_response_t res;
+  int status;
+
+  if (c == NULL)
+    return -1;
+
+  if ((ret_lines == NULL) || (ret_lines_num == NULL)) {
+    lcc_set_errno(c, EINVAL);
+    return -1;
+  }
+
+  status = lcc_sendreceive(c, "STATS", &res);
+  if (status != 0)
+    return status;
+
+  if (res.status != 0) {
+    LCC_SET_ERRSTR(c, "Server error: %s", res.message);
+    lcc_response_free(&res);
+    return -1;
+  }
+
+  /* The lines are handed over to the caller. */
+  *ret_lines = res.lines;
+  *ret_lines_num = res.lines_num;
+
+  return 0;
+} /* }}} int lcc_stats */
+
 const char *lcc_strerror(lcc_connection_t *c) /* {{{ */
 {
   if (c == NULL)
@@ -49,6 +49,15 @@ LCC_BEGIN_DECLS
 struct lcc_connection_s;
 typedef struct lcc_connection_s lcc_connection_t;
 
+/* One value list returned by lcc_getvals(). */
+struct lcc_getval_result_s {
+  lcc_identifier_t identifier;
+  size_t values_num;
+  gauge_t *values;
+  char **values_names;
+};
+typedef struct lcc_getval_result_s lcc_getval_result_t;
+
 /*
  * Functions
  */
@@ -64,14 +73,43 @@ int lcc_getval(lcc_connection_t *c, lcc_identifier_t *ident,
                size_t *ret_values_num, gauge_t **ret_values,
                char ***ret_values_names);
 
+/*
+ * Fetches the values of all value lists whose identifiers match one of
+ * "patterns" with a single GETVALS command. A pattern is an identifier string
+ * which may contain the shell wildcards "*", "?" and "[...]". The results are
+ * sorted by identifier and must be freed with lcc_getvals_free(). Patterns
+ * without a match are not an error.
+ */
+int lcc_getvals(lcc_connection_t *c, char const *const *patterns,
+                size_t patterns_num, lcc_getval_result_t **ret_results,
+                size_t *ret_results_num);
+void lcc_getvals_free(lcc_getval_result_t *results, size_t results_num);
+
 int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl);
 
+/*
+ * Sends "vl_num" value lists using the binary PUTBIN command. The value lists
+ * are encoded like the network plugin does and sent in frames of up to 64 kiB,
+ * each of which is acknowledged by the server with a single status line.
+ * Returns zero on success. If an error occurs, value lists in frames that have
+ * already been acknowledged have been dispatched.
+ */
+int lcc_putval_batch(lcc_connection_t *c, const lcc_value_list_t *vl,
+                     size_t vl_num);
+
 int lcc_flush(lcc_connection_t *c, const char *plugin, lcc_identifier_t *ident,
               int timeout);
 
 int lcc_listval(lcc_connection_t *c, lcc_identifier_t **ret_ident,
                 size_t *ret_ident_num);
 
+/*
+ * Fetches the runtime statistics of the daemon with the STATS command. Each
+ * line describes one thread, queue, read function or plugin, see
+ * collectd-unixsock(5). The lines and the array must be freed with free().
+ */
+int lcc_stats(lcc_connection_t *c, char ***ret_lines, size_t *ret_lines_num);
+
 /* TODO: putnotif */
 
 const char *lcc_strerror(lcc_connection_t *c);
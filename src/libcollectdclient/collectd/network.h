@@ -72,6 +72,16 @@ int lcc_server_set_security_level(lcc_server_t *srv, lcc_security_level_t level,
  * Send data
  */
 int lcc_network_values_send(lcc_network_t *net, const lcc_value_list_t *vl);
+
+/* Sends "vl_num" value lists to all servers. Full packets are sent in batches,
+ * using sendmmsg(2) where available. As with "lcc_network_values_send", the
+ * last packet is only sent once it is full or "lcc_network_flush" is called.
+ * Invalid value lists are skipped and reported by a non-zero return value. */
+int lcc_network_values_send_batch(lcc_network_t *net,
+                                  const lcc_value_list_t *vl, size_t vl_num);
+
+/* Sends all partially filled packets. */
+int lcc_network_flush(lcc_network_t *net);
 #if 0
 int lcc_network_notification_send (lcc_network_t *net,
     const lcc_notification_t *notif);
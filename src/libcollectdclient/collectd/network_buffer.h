@@ -52,6 +52,13 @@ int lcc_network_buffer_finalize(lcc_network_buffer_t *nb);
 int lcc_network_buffer_add_value(lcc_network_buffer_t *nb,
                                  const lcc_value_list_t *vl);
 
+/* Adds value lists from "vl" until all "vl_num" have been added or the buffer
+ * is full, and stores the number of added value lists in "ret_added". Returns
+ * EINVAL if the next value list is invalid. */
+int lcc_network_buffer_add_values(lcc_network_buffer_t *nb,
+                                  const lcc_value_list_t *vl, size_t vl_num,
+                                  size_t *ret_added);
+
 int lcc_network_buffer_get(lcc_network_buffer_t *nb, void *buffer,
                            size_t *buffer_size);
 
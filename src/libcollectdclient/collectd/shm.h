@@ -0,0 +1,53 @@
+/**
+ * libcollectdclient - src/libcollectdclient/collectd/shm.h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef LIBCOLLECTD_SHM_H
+#define LIBCOLLECTD_SHM_H 1
+
+#include "collectd/lcc_features.h"
+#include "collectd/shm_format.h"
+#include "collectd/types.h"
+
+LCC_BEGIN_DECLS
+
+struct lcc_shm_s;
+typedef struct lcc_shm_s lcc_shm_t;
+
+/* lcc_shm_open maps the segment "name" read-only. If "name" is NULL,
+ * LCC_SHM_DEFAULT_NAME is used. Returns zero on success or an errno value. */
+int lcc_shm_open(const char *name, lcc_shm_t **ret_shm);
+
+/* lcc_shm_getval looks up the latest values of "ident". On success,
+ * "*ret_values" points to a newly allocated array of "*ret_values_num"
+ * elements, which the caller must free. "ret_time" may be NULL. Returns zero
+ * on success, ENOENT if the identifier is unknown or EAGAIN if the record
+ * could not be read consistently. */
+int lcc_shm_getval(lcc_shm_t *shm, const lcc_identifier_t *ident,
+                   size_t *ret_values_num, gauge_t **ret_values,
+                   double *ret_time);
+
+/* lcc_shm_close unmaps the segment and frees "shm". */
+void lcc_shm_close(lcc_shm_t *shm);
+
+LCC_END_DECLS
+
+#endif /* LIBCOLLECTD_SHM_H */
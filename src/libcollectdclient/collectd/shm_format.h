@@ -0,0 +1,71 @@
+/**
+ * libcollectdclient - src/libcollectdclient/collectd/shm_format.h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef LIBCOLLECTD_SHM_FORMAT_H
+#define LIBCOLLECTD_SHM_FORMAT_H 1
+
+/* Layout of the shared memory segment written by the write_shm plugin. This
+ * header is used by the daemon, too, and must not depend on the other
+ * libcollectdclient headers. */
+
+#include <stdint.h>
+
+/* LCC_SHM_DEFAULT_NAME is the name of the shared memory segment that the
+ * write_shm plugin creates by default. */
+#define LCC_SHM_DEFAULT_NAME "/collectd"
+
+#define LCC_SHM_MAGIC 0x63647368 /* "cdsh" */
+#define LCC_SHM_VERSION 1
+
+/* Maximum number of data sources per record and maximum length of the
+ * identifier, including the terminating null byte. */
+#define LCC_SHM_VALUES_MAX 8
+#define LCC_SHM_IDENTIFIER_SIZE 320
+
+/* lcc_shm_header_t is found at the beginning of the segment and is followed by
+ * "records_max" records of "record_size" bytes each. */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t records_max;
+  /* records_num is the number of records in use. It only ever grows and is
+   * updated after the record's identifier has been written. */
+  uint32_t records_num;
+  uint32_t reserved;
+} lcc_shm_header_t;
+
+/* lcc_shm_record_t holds the latest values of one metric. "seq" is odd while
+ * the writer updates the record; readers must retry if it is odd or changed
+ * while they were copying the record. */
+typedef struct {
+  uint32_t seq;
+  uint32_t values_num;
+  /* time and interval in collectd's internal resolution, 2^-30 seconds. */
+  uint64_t time;
+  uint64_t interval;
+  /* values holds rates for counter, derive and absolute data sources. */
+  double values[LCC_SHM_VALUES_MAX];
+  char identifier[LCC_SHM_IDENTIFIER_SIZE];
+} lcc_shm_record_t;
+
+#endif /* LIBCOLLECTD_SHM_FORMAT_H */
@@ -26,6 +26,9 @@
  *   Max Henkel <henkel at gmx.at>
  **/
 
+/* _GNU_SOURCE is needed in Linux to use sendmmsg */
+#define _GNU_SOURCE
+
 #include "collectd.h"
 
 #include <assert.h>
@@ -51,6 +54,9 @@
 #define AI_ADDRCONFIG 0
 #endif
 
+/* Maximum number of finished packets sent with one sendmmsg(2) call. */
+#define SEND_BATCH_SIZE 16
+
 #include "collectd/network.h"
 #include "collectd/network_buffer.h"
 
@@ -75,6 +81,12 @@ struct lcc_server_s {
   socklen_t sa_len;
 
   lcc_network_buffer_t *buffer;
+  bool values_pending; /* "buffer" holds at least one value list */
+
+  /* Finished packets that have not been sent yet. Allocated on first use. */
+  char *packets;
+  size_t packets_len[SEND_BATCH_SIZE];
+  size_t packets_num;
 
   lcc_server_t *next;
 };
@@ -114,6 +126,8 @@ static void int_server_destroy(lcc_server_t *srv) /* {{{ */
   free(srv->service);
   free(srv->username);
   free(srv->password);
+  free(srv->packets);
+  lcc_network_buffer_destroy(srv->buffer);
   free(srv);
 
   int_server_destroy(next);
@@ -197,19 +211,80 @@ static int server_open_socket(lcc_server_t *srv) /* {{{ */
   return 0;
 } /* }}} int server_open_socket */
 
-static int server_send_buffer(lcc_server_t *srv) /* {{{ */
+/* Sends all finished packets, using as few system calls as possible. */
+static int server_send_packets(lcc_server_t *srv) /* {{{ */
 {
-  char buffer[LCC_NETWORK_BUFFER_SIZE_DEFAULT] = {0};
-  size_t buffer_size;
-  int status;
+  size_t sent = 0;
+  int status = 0;
+
+  if (srv->packets_num == 0)
+    return 0;
 
   if (srv->fd < 0) {
     status = server_open_socket(srv);
-    if (status != 0)
+    if (status != 0) {
+      srv->packets_num = 0;
       return status;
+    }
+  }
+
+  while (sent < srv->packets_num) {
+    assert(srv->fd >= 0);
+    assert(srv->sa != NULL);
+
+#if HAVE_SENDMMSG
+    struct mmsghdr msgs[SEND_BATCH_SIZE] = {0};
+    struct iovec iovs[SEND_BATCH_SIZE];
+    size_t num = srv->packets_num - sent;
+
+    for (size_t i = 0; i < num; i++) {
+      iovs[i].iov_base =
+          srv->packets + (sent + i) * LCC_NETWORK_BUFFER_SIZE_DEFAULT;
+      iovs[i].iov_len = srv->packets_len[sent + i];
+      msgs[i].msg_hdr.msg_iov = iovs + i;
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = srv->sa;
+      msgs[i].msg_hdr.msg_namelen = srv->sa_len;
+    }
+
+    status = sendmmsg(srv->fd, msgs, (unsigned int)num, /* flags = */ 0);
+#else
+    status = (int)sendto(srv->fd,
+                         srv->packets + sent * LCC_NETWORK_BUFFER_SIZE_DEFAULT,
+                         srv->packets_len[sent], /* flags = */ 0, srv->sa,
+                         srv->sa_len);
+    if (status >= 0)
+      status = 1;
+#endif
+    if ((status < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+      continue;
+    if (status < 0)
+      break;
+
+    sent += (size_t)status;
   }
 
-  buffer_size = sizeof(buffer);
+  srv->packets_num = 0;
+  if (status < 0)
+    return status;
+  return 0;
+} /* }}} int server_send_packets */
+
+/* Moves the current buffer to the list of finished packets. The packets are
+ * sent once SEND_BATCH_SIZE of them have been collected. */
+static int server_queue_buffer(lcc_server_t *srv) /* {{{ */
+{
+  int status;
+
+  srv->values_pending = false;
+
+  if (srv->packets == NULL) {
+    srv->packets = malloc(SEND_BATCH_SIZE * LCC_NETWORK_BUFFER_SIZE_DEFAULT);
+    if (srv->packets == NULL) {
+      lcc_network_buffer_initialize(srv->buffer);
+      return ENOMEM;
+    }
+  }
 
   status = lcc_network_buffer_finalize(srv->buffer);
   if (status != 0) {
@@ -217,29 +292,34 @@ static int server_send_buffer(lcc_server_t *srv) /* {{{ */
     return status;
   }
 
-  status = lcc_network_buffer_get(srv->buffer, buffer, &buffer_size);
+  char *packet =
+      srv->packets + srv->packets_num * LCC_NETWORK_BUFFER_SIZE_DEFAULT;
+  size_t packet_len = LCC_NETWORK_BUFFER_SIZE_DEFAULT;
+
+  status = lcc_network_buffer_get(srv->buffer, packet, &packet_len);
   lcc_network_buffer_initialize(srv->buffer);
 
   if (status != 0)
     return status;
 
-  if (buffer_size > sizeof(buffer))
-    buffer_size = sizeof(buffer);
+  if (packet_len > LCC_NETWORK_BUFFER_SIZE_DEFAULT)
+    packet_len = LCC_NETWORK_BUFFER_SIZE_DEFAULT;
 
-  while (42) {
-    assert(srv->fd >= 0);
-    assert(srv->sa != NULL);
-    status = (int)sendto(srv->fd, buffer, buffer_size, /* flags = */ 0, srv->sa,
-                         srv->sa_len);
-    if ((status < 0) && ((errno == EINTR) || (errno == EAGAIN)))
-      continue;
+  srv->packets_len[srv->packets_num] = packet_len;
+  srv->packets_num++;
 
-    break;
-  }
+  if (srv->packets_num >= SEND_BATCH_SIZE)
+    return server_send_packets(srv);
+  return 0;
+} /* }}} int server_queue_buffer */
 
-  if (status < 0)
+static int server_send_buffer(lcc_server_t *srv) /* {{{ */
+{
+  int status = server_queue_buffer(srv);
+  if (status != 0)
     return status;
-  return 0;
+
+  return server_send_packets(srv);
 } /* }}} int server_send_buffer */
 
 static int server_value_add(lcc_server_t *srv, /* {{{ */
@@ -247,13 +327,63 @@ static int server_value_add(lcc_server_t *srv, /* {{{ */
   int status;
 
   status = lcc_network_buffer_add_value(srv->buffer, vl);
-  if (status == 0)
-    return 0;
+  if (status == EINVAL)
+    return status;
 
-  server_send_buffer(srv);
-  return lcc_network_buffer_add_value(srv->buffer, vl);
+  if (status != 0) {
+    server_send_buffer(srv);
+    status = lcc_network_buffer_add_value(srv->buffer, vl);
+  }
+
+  if (status == 0)
+    srv->values_pending = true;
+  return status;
 } /* }}} int server_value_add */
 
+/* Adds all value lists to the server's buffer. Full packets are collected and
+ * sent in batches; the last, partially filled packet is kept. */
+static int server_values_add(lcc_server_t *srv, /* {{{ */
+                             const lcc_value_list_t *vl, size_t vl_num) {
+  size_t done = 0;
+  int ret = 0;
+
+  while (done < vl_num) {
+    size_t added = 0;
+    int status = lcc_network_buffer_add_values(srv->buffer, vl + done,
+                                               vl_num - done, &added);
+    done += added;
+    if (added > 0)
+      srv->values_pending = true;
+
+    if (status != 0) {
+      /* Skip the invalid value list. */
+      ret = status;
+      done++;
+      continue;
+    }
+
+    if (done >= vl_num)
+      break;
+
+    if (!srv->values_pending) {
+      /* The value list doesn't fit into an empty packet. */
+      ret = EMSGSIZE;
+      done++;
+      continue;
+    }
+
+    status = server_queue_buffer(srv);
+    if (status != 0)
+      ret = status;
+  }
+
+  int status = server_send_packets(srv);
+  if (status != 0)
+    ret = status;
+
+  return ret;
+} /* }}} int server_values_add */
+
 /*
  * Public functions
  */
@@ -450,3 +580,38 @@ int lcc_network_values_send(lcc_network_t *net, /* {{{ */
 
   return 0;
 } /* }}} int lcc_network_values_send */
+
+int lcc_network_values_send_batch(lcc_network_t *net, /* {{{ */
+                                  const lcc_value_list_t *vl, size_t vl_num) {
+  int ret = 0;
+
+  if ((net == NULL) || ((vl == NULL) && (vl_num > 0)))
+    return EINVAL;
+
+  for (lcc_server_t *srv = net->servers; srv != NULL; srv = srv->next) {
+    int status = server_values_add(srv, vl, vl_num);
+    if (status != 0)
+      ret = status;
+  }
+
+  return ret;
+} /* }}} int lcc_network_values_send_batch */
+
+int lcc_network_flush(lcc_network_t *net) /* {{{ */
+{
+  int ret = 0;
+
+  if (net == NULL)
+    return EINVAL;
+
+  for (lcc_server_t *srv = net->servers; srv != NULL; srv = srv->next) {
+    if (!srv->values_pending)
+      continue;
+
+    int status = server_send_buffer(srv);
+    if (status != 0)
+      ret = status;
+  }
+
+  return ret;
+} /* }}} int lcc_network_flush */
@@ -35,6 +35,7 @@
 #include <errno.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stddef.h> /* offsetof */
 #include <stdlib.h>
 #include <string.h>
 
@@ -112,18 +113,14 @@ struct lcc_network_buffer_s {
   char *password;
 
 #if HAVE_GCRYPT_H
+  /* Both handles are kept across buffers and only reset for each buffer. */
+  gcry_md_hd_t sign_hd;
   gcry_cipher_hd_t encr_cypher;
   size_t encr_header_len;
   char encr_iv[16];
 #endif
 };
 
-#define SSTRNCPY(dst, src, sz)                                                 \
-  do {                                                                         \
-    strncpy((dst), (src), (sz));                                               \
-    (dst)[(sz)-1] = 0;                                                         \
-  } while (0)
-
 /*
  * Private functions
  */
@@ -145,7 +142,7 @@ static bool have_gcrypt(void) /* {{{ */
   if (!gcry_check_version(GCRYPT_VERSION))
     return false;
 
-  if (!gcry_control(GCRYCTL_INIT_SECMEM, 32768, 0))
+  if (gcry_control(GCRYCTL_INIT_SECMEM, 32768, 0) != 0)
     return false;
 
   gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
@@ -258,229 +255,183 @@ static double htond(double val) /* {{{ */
   }
 } /* }}} double htond */
 
-static int nb_add_values(char **ret_buffer, /* {{{ */
-                         size_t *ret_buffer_len, const lcc_value_list_t *vl) {
-  if ((vl == NULL) || (vl->values_len < 1)) {
-    return EINVAL;
-  }
-
-  char *packet_ptr;
-  size_t packet_len;
+/* Sizes of the parts on the wire, including the type and length fields. */
+#define PART_HEADER_SIZE (2 * sizeof(uint16_t))
+#define PART_STRING_SIZE(len) (PART_HEADER_SIZE + (len) + 1)
+#define PART_NUMBER_SIZE (PART_HEADER_SIZE + sizeof(uint64_t))
+#define PART_VALUES_SIZE(num)                                                  \
+  (PART_HEADER_SIZE + sizeof(uint16_t) + (num) * (1 + sizeof(value_t)))
 
-  uint16_t pkg_type;
-  uint16_t pkg_length;
-  uint16_t pkg_num_values;
-  uint8_t pkg_values_types[vl->values_len];
-  value_t pkg_values[vl->values_len];
+/* The length field is 16 bits wide, which limits the number of values. */
+#define VALUES_NUM_MAX ((UINT16_MAX - PART_VALUES_SIZE(0)) / (1 + sizeof(value_t)))
 
+/* The identifier parts in the order they are written. */
+static const struct {
+  uint16_t type;
   size_t offset;
+} ident_parts[] = {
+    {TYPE_HOST, offsetof(lcc_identifier_t, host)},
+    {TYPE_PLUGIN, offsetof(lcc_identifier_t, plugin)},
+    {TYPE_PLUGIN_INSTANCE, offsetof(lcc_identifier_t, plugin_instance)},
+    {TYPE_TYPE, offsetof(lcc_identifier_t, type)},
+    {TYPE_TYPE_INSTANCE, offsetof(lcc_identifier_t, type_instance)},
+};
+#define IDENT_PARTS_NUM (sizeof(ident_parts) / sizeof(ident_parts[0]))
 
-  packet_len = sizeof(pkg_type) + sizeof(pkg_length) + sizeof(pkg_num_values) +
-               sizeof(pkg_values_types) + sizeof(pkg_values);
-
-  if (*ret_buffer_len < packet_len)
-    return ENOMEM;
-
-  pkg_type = htons(TYPE_VALUES);
-  pkg_length = htons((uint16_t)packet_len);
-  pkg_num_values = htons((uint16_t)vl->values_len);
+static int nb_check_values(const lcc_value_list_t *vl) /* {{{ */
+{
+  if ((vl->values_len < 1) || (vl->values_len > VALUES_NUM_MAX) ||
+      (vl->values == NULL) || (vl->values_types == NULL))
+    return EINVAL;
 
   for (size_t i = 0; i < vl->values_len; i++) {
-    pkg_values_types[i] = (uint8_t)vl->values_types[i];
     switch (vl->values_types[i]) {
     case LCC_TYPE_COUNTER:
-      pkg_values[i].counter = (counter_t)htonll(vl->values[i].counter);
-      break;
-
     case LCC_TYPE_GAUGE:
-      pkg_values[i].gauge = (gauge_t)htond(vl->values[i].gauge);
-      break;
-
     case LCC_TYPE_DERIVE:
-      pkg_values[i].derive = (derive_t)htonll(vl->values[i].derive);
-      break;
-
     case LCC_TYPE_ABSOLUTE:
-      pkg_values[i].absolute = (absolute_t)htonll(vl->values[i].absolute);
       break;
-
     default:
       return EINVAL;
-    } /* switch (vl->values_types[i]) */
-  }   /* for (vl->values_len) */
-
-  /*
-   * Use `memcpy' to write everything to the buffer, because the pointer
-   * may be unaligned and some architectures, such as SPARC, can't handle
-   * that.
-   */
-  packet_ptr = *ret_buffer;
-  offset = 0;
-  memcpy(packet_ptr + offset, &pkg_type, sizeof(pkg_type));
-  offset += sizeof(pkg_type);
-  memcpy(packet_ptr + offset, &pkg_length, sizeof(pkg_length));
-  offset += sizeof(pkg_length);
-  memcpy(packet_ptr + offset, &pkg_num_values, sizeof(pkg_num_values));
-  offset += sizeof(pkg_num_values);
-  memcpy(packet_ptr + offset, pkg_values_types, sizeof(pkg_values_types));
-  offset += sizeof(pkg_values_types);
-  memcpy(packet_ptr + offset, pkg_values, sizeof(pkg_values));
-  offset += sizeof(pkg_values);
-
-  assert(offset == packet_len);
-
-  *ret_buffer = packet_ptr + packet_len;
-  *ret_buffer_len -= packet_len;
+    }
+  }
+
   return 0;
-} /* }}} int nb_add_values */
+} /* }}} int nb_check_values */
 
-static int nb_add_number(char **ret_buffer, /* {{{ */
-                         size_t *ret_buffer_len, uint16_t type,
-                         uint64_t value) {
-  char *packet_ptr;
-  size_t packet_len;
+/*
+ * The nb_put_* functions write one part to "ptr" and return a pointer to the
+ * first byte after it. The caller must have made sure that the part fits into
+ * the buffer. Everything is written with `memcpy', because the pointer may be
+ * unaligned and some architectures, such as SPARC, can't handle that.
+ */
+static char *nb_put_header(char *ptr, uint16_t type, size_t len) /* {{{ */
+{
+  uint16_t pkg_type = htons(type);
+  uint16_t pkg_length = htons((uint16_t)len);
 
-  uint16_t pkg_type;
-  uint16_t pkg_length;
-  uint64_t pkg_value;
+  memcpy(ptr, &pkg_type, sizeof(pkg_type));
+  memcpy(ptr + sizeof(pkg_type), &pkg_length, sizeof(pkg_length));
+  return ptr + PART_HEADER_SIZE;
+} /* }}} char *nb_put_header */
 
-  size_t offset;
+static char *nb_put_values(char *ptr, const lcc_value_list_t *vl) /* {{{ */
+{
+  uint16_t pkg_num_values = htons((uint16_t)vl->values_len);
 
-  packet_len = sizeof(pkg_type) + sizeof(pkg_length) + sizeof(pkg_value);
+  ptr = nb_put_header(ptr, TYPE_VALUES, PART_VALUES_SIZE(vl->values_len));
+  memcpy(ptr, &pkg_num_values, sizeof(pkg_num_values));
+  ptr += sizeof(pkg_num_values);
 
-  if (*ret_buffer_len < packet_len)
-    return ENOMEM;
+  for (size_t i = 0; i < vl->values_len; i++)
+    ptr[i] = (char)vl->values_types[i];
+  ptr += vl->values_len;
 
-  pkg_type = htons(type);
-  pkg_length = htons((uint16_t)packet_len);
-  pkg_value = htonll(value);
+  for (size_t i = 0; i < vl->values_len; i++) {
+    value_t v;
+    switch (vl->values_types[i]) {
+    case LCC_TYPE_COUNTER:
+      v.counter = (counter_t)htonll(vl->values[i].counter);
+      break;
+    case LCC_TYPE_GAUGE:
+      v.gauge = (gauge_t)htond(vl->values[i].gauge);
+      break;
+    case LCC_TYPE_DERIVE:
+      v.derive = (derive_t)htonll(vl->values[i].derive);
+      break;
+    default: /* LCC_TYPE_ABSOLUTE, checked by nb_check_values */
+      v.absolute = (absolute_t)htonll(vl->values[i].absolute);
+      break;
+    }
+    memcpy(ptr, &v, sizeof(v));
+    ptr += sizeof(v);
+  }
 
-  packet_ptr = *ret_buffer;
-  offset = 0;
-  memcpy(packet_ptr + offset, &pkg_type, sizeof(pkg_type));
-  offset += sizeof(pkg_type);
-  memcpy(packet_ptr + offset, &pkg_length, sizeof(pkg_length));
-  offset += sizeof(pkg_length);
-  memcpy(packet_ptr + offset, &pkg_value, sizeof(pkg_value));
-  offset += sizeof(pkg_value);
+  return ptr;
+} /* }}} char *nb_put_values */
 
-  assert(offset == packet_len);
+static char *nb_put_number(char *ptr, uint16_t type, uint64_t value) /* {{{ */
+{
+  uint64_t pkg_value = htonll(value);
 
-  *ret_buffer = packet_ptr + packet_len;
-  *ret_buffer_len -= packet_len;
-  return 0;
-} /* }}} int nb_add_number */
+  ptr = nb_put_header(ptr, type, PART_NUMBER_SIZE);
+  memcpy(ptr, &pkg_value, sizeof(pkg_value));
+  return ptr + sizeof(pkg_value);
+} /* }}} char *nb_put_number */
 
-static int nb_add_time(char **ret_buffer, /* {{{ */
-                       size_t *ret_buffer_len, uint16_t type, double value) {
+static char *nb_put_time(char *ptr, uint16_t type, double value) /* {{{ */
+{
   /* Convert to collectd's "cdtime" representation. */
   uint64_t cdtime_value = (uint64_t)(value * 1073741824.0);
-  return nb_add_number(ret_buffer, ret_buffer_len, type, cdtime_value);
-} /* }}} int nb_add_time */
-
-static int nb_add_string(char **ret_buffer, /* {{{ */
-                         size_t *ret_buffer_len, uint16_t type, const char *str,
-                         size_t str_len) {
-  char *packet_ptr;
-  size_t packet_len;
-
-  uint16_t pkg_type;
-  uint16_t pkg_length;
-
-  size_t offset;
-
-  packet_len = sizeof(pkg_type) + sizeof(pkg_length) + str_len + 1;
-  if (*ret_buffer_len < packet_len)
-    return ENOMEM;
-
-  pkg_type = htons(type);
-  pkg_length = htons((uint16_t)packet_len);
-
-  packet_ptr = *ret_buffer;
-  offset = 0;
-  memcpy(packet_ptr + offset, &pkg_type, sizeof(pkg_type));
-  offset += sizeof(pkg_type);
-  memcpy(packet_ptr + offset, &pkg_length, sizeof(pkg_length));
-  offset += sizeof(pkg_length);
-  memcpy(packet_ptr + offset, str, str_len);
-  offset += str_len;
-  memset(packet_ptr + offset, 0, 1);
-  offset += 1;
-
-  assert(offset == packet_len);
-
-  *ret_buffer = packet_ptr + packet_len;
-  *ret_buffer_len -= packet_len;
-  return 0;
-} /* }}} int nb_add_string */
-
+  return nb_put_number(ptr, type, cdtime_value);
+} /* }}} char *nb_put_time */
+
+static char *nb_put_string(char *ptr, uint16_t type, /* {{{ */
+                           const char *str, size_t str_len) {
+  ptr = nb_put_header(ptr, type, PART_STRING_SIZE(str_len));
+  memcpy(ptr, str, str_len);
+  ptr[str_len] = 0;
+  return ptr + str_len + 1;
+} /* }}} char *nb_put_string */
+
+/* Adds "vl" to the buffer. The size of all parts that differ from the
+ * buffer's state is calculated first, so that there is a single bounds check
+ * per value list. Returns -1 if the value list doesn't fit. */
 static int nb_add_value_list(lcc_network_buffer_t *nb, /* {{{ */
                              const lcc_value_list_t *vl) {
-  char *buffer = nb->ptr;
-  size_t buffer_size = nb->free;
+  const char *src = (const char *)&vl->identifier;
+  char *dst = (char *)&nb->state.identifier;
+  size_t ident_len[IDENT_PARTS_NUM];
+  bool ident_changed[IDENT_PARTS_NUM];
 
-  const lcc_identifier_t *ident_src;
-  lcc_identifier_t *ident_dst;
+  size_t need = PART_VALUES_SIZE(vl->values_len);
 
-  ident_src = &vl->identifier;
-  ident_dst = &nb->state.identifier;
+  for (size_t i = 0; i < IDENT_PARTS_NUM; i++) {
+    const char *s = src + ident_parts[i].offset;
 
-  if (strcmp(ident_dst->host, ident_src->host) != 0) {
-    if (nb_add_string(&buffer, &buffer_size, TYPE_HOST, ident_src->host,
-                      strlen(ident_src->host)) != 0)
-      return -1;
-    SSTRNCPY(ident_dst->host, ident_src->host, sizeof(ident_dst->host));
+    ident_changed[i] = (strcmp(dst + ident_parts[i].offset, s) != 0);
+    if (ident_changed[i]) {
+      ident_len[i] = strnlen(s, LCC_NAME_LEN - 1);
+      need += PART_STRING_SIZE(ident_len[i]);
+    }
   }
 
-  if (strcmp(ident_dst->plugin, ident_src->plugin) != 0) {
-    if (nb_add_string(&buffer, &buffer_size, TYPE_PLUGIN, ident_src->plugin,
-                      strlen(ident_src->plugin)) != 0)
-      return -1;
-    SSTRNCPY(ident_dst->plugin, ident_src->plugin, sizeof(ident_dst->plugin));
-  }
+  bool time_changed = (nb->state.time != vl->time);
+  bool interval_changed = (nb->state.interval != vl->interval);
+  if (time_changed)
+    need += PART_NUMBER_SIZE;
+  if (interval_changed)
+    need += PART_NUMBER_SIZE;
 
-  if (strcmp(ident_dst->plugin_instance, ident_src->plugin_instance) != 0) {
-    if (nb_add_string(&buffer, &buffer_size, TYPE_PLUGIN_INSTANCE,
-                      ident_src->plugin_instance,
-                      strlen(ident_src->plugin_instance)) != 0)
-      return -1;
-    SSTRNCPY(ident_dst->plugin_instance, ident_src->plugin_instance,
-             sizeof(ident_dst->plugin_instance));
-  }
+  if (need > nb->free)
+    return -1;
 
-  if (strcmp(ident_dst->type, ident_src->type) != 0) {
-    if (nb_add_string(&buffer, &buffer_size, TYPE_TYPE, ident_src->type,
-                      strlen(ident_src->type)) != 0)
-      return -1;
-    SSTRNCPY(ident_dst->type, ident_src->type, sizeof(ident_dst->type));
-  }
+  char *ptr = nb->ptr;
+  for (size_t i = 0; i < IDENT_PARTS_NUM; i++) {
+    if (!ident_changed[i])
+      continue;
 
-  if (strcmp(ident_dst->type_instance, ident_src->type_instance) != 0) {
-    if (nb_add_string(&buffer, &buffer_size, TYPE_TYPE_INSTANCE,
-                      ident_src->type_instance,
-                      strlen(ident_src->type_instance)) != 0)
-      return -1;
-    SSTRNCPY(ident_dst->type_instance, ident_src->type_instance,
-             sizeof(ident_dst->type_instance));
+    const char *s = src + ident_parts[i].offset;
+    ptr = nb_put_string(ptr, ident_parts[i].type, s, ident_len[i]);
+    memcpy(dst + ident_parts[i].offset, s, ident_len[i]);
+    dst[ident_parts[i].offset + ident_len[i]] = 0;
   }
 
-  if (nb->state.time != vl->time) {
-    if (nb_add_time(&buffer, &buffer_size, TYPE_TIME_HR, vl->time))
-      return -1;
+  if (time_changed) {
+    ptr = nb_put_time(ptr, TYPE_TIME_HR, vl->time);
     nb->state.time = vl->time;
   }
 
-  if (nb->state.interval != vl->interval) {
-    if (nb_add_time(&buffer, &buffer_size, TYPE_INTERVAL_HR, vl->interval))
-      return -1;
+  if (interval_changed) {
+    ptr = nb_put_time(ptr, TYPE_INTERVAL_HR, vl->interval);
     nb->state.interval = vl->interval;
   }
 
-  if (nb_add_values(&buffer, &buffer_size, vl) != 0)
-    return -1;
+  ptr = nb_put_values(ptr, vl);
 
-  nb->ptr = buffer;
-  nb->free = buffer_size;
+  assert((size_t)(ptr - nb->ptr) == need);
+  nb->ptr = ptr;
+  nb->free -= need;
   return 0;
 } /* }}} int nb_add_value_list */
 
@@ -503,29 +454,36 @@ static int nb_add_signature(lcc_network_buffer_t *nb) /* {{{ */
   assert(nb->size >= (nb->free + PART_SIGNATURE_SHA256_SIZE));
   buffer_size = nb->size - (nb->free + PART_SIGNATURE_SHA256_SIZE);
 
-  hd = NULL;
-  err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
-  if (err != 0)
-    return -1;
+  if (nb->sign_hd == NULL) {
+    hd = NULL;
+    err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
+    if (err != 0)
+      return -1;
 
-  assert(nb->password != NULL);
-  err = gcry_md_setkey(hd, nb->password, strlen(nb->password));
-  if (err != 0) {
-    gcry_md_close(hd);
-    return -1;
+    assert(nb->password != NULL);
+    err = gcry_md_setkey(hd, nb->password, strlen(nb->password));
+    if (err != 0) {
+      gcry_md_close(hd);
+      return -1;
+    }
+    nb->sign_hd = hd;
+  } else {
+    /* Resetting an HMAC context keeps the key. */
+    hd = nb->sign_hd;
+    gcry_md_reset(hd);
   }
 
   gcry_md_write(hd, buffer, buffer_size);
   hash = gcry_md_read(hd, GCRY_MD_SHA256);
   if (hash == NULL) {
     gcry_md_close(hd);
+    nb->sign_hd = NULL;
     return -1;
   }
 
   assert(((2 * sizeof(uint16_t)) + hash_length) == PART_SIGNATURE_SHA256_SIZE);
   memcpy(nb->buffer + (2 * sizeof(uint16_t)), hash, hash_length);
 
-  gcry_md_close(hd);
   return 0;
 } /* }}} int nb_add_signature */
 
@@ -548,7 +506,7 @@ static int nb_add_encryption(lcc_network_buffer_t *nb) /* {{{ */
   memcpy(nb->buffer + 2, &pkg_length, sizeof(pkg_length));
 
   /* Calculate what to hash */
-  hash_ptr = nb->buffer + PART_ENCRYPTION_AES256_SIZE;
+  hash_ptr = nb->buffer + nb->encr_header_len;
   hash_size = package_length - nb->encr_header_len;
 
   /* Calculate what to encrypt */
@@ -604,6 +562,21 @@ static int nb_add_encryption(lcc_network_buffer_t *nb) /* {{{ */
 } /* }}} int nb_add_encryption */
 #endif
 
+/* Closes the handles that depend on the password. */
+static void nb_close_handles(lcc_network_buffer_t *nb) /* {{{ */
+{
+#if HAVE_GCRYPT_H
+  if (nb->sign_hd != NULL) {
+    gcry_md_close(nb->sign_hd);
+    nb->sign_hd = NULL;
+  }
+  if (nb->encr_cypher != NULL) {
+    gcry_cipher_close(nb->encr_cypher);
+    nb->encr_cypher = NULL;
+  }
+#endif
+} /* }}} void nb_close_handles */
+
 /*
  * Public functions
  */
@@ -645,6 +618,9 @@ void lcc_network_buffer_destroy(lcc_network_buffer_t *nb) /* {{{ */
   if (nb == NULL)
     return;
 
+  nb_close_handles(nb);
+  free(nb->username);
+  free(nb->password);
   free(nb->buffer);
   free(nb);
 } /* }}} void lcc_network_buffer_destroy */
@@ -656,6 +632,8 @@ int lcc_network_buffer_set_security_level(lcc_network_buffer_t *nb, /* {{{ */
   char *username_copy;
   char *password_copy;
 
+  nb_close_handles(nb);
+
   if (level == NONE) {
     free(nb->username);
     free(nb->password);
@@ -692,7 +670,9 @@ int lcc_network_buffer_initialize(lcc_network_buffer_t *nb) /* {{{ */
   if (nb == NULL)
     return EINVAL;
 
-  memset(nb->buffer, 0, nb->size);
+  /* Only the used part of the buffer is ever read. */
+  assert(nb->size >= nb->free);
+  memset(nb->buffer, 0, nb->size - nb->free);
   memset(&nb->state, 0, sizeof(nb->state));
   nb->ptr = nb->buffer;
   nb->free = nb->size;
@@ -760,15 +740,39 @@ int lcc_network_buffer_finalize(lcc_network_buffer_t *nb) /* {{{ */
 
 int lcc_network_buffer_add_value(lcc_network_buffer_t *nb, /* {{{ */
                                  const lcc_value_list_t *vl) {
-  int status;
-
   if ((nb == NULL) || (vl == NULL))
     return EINVAL;
 
-  status = nb_add_value_list(nb, vl);
-  return status;
+  if (nb_check_values(vl) != 0)
+    return EINVAL;
+
+  return nb_add_value_list(nb, vl);
 } /* }}} int lcc_network_buffer_add_value */
 
+int lcc_network_buffer_add_values(lcc_network_buffer_t *nb, /* {{{ */
+                                  const lcc_value_list_t *vl, size_t vl_num,
+                                  size_t *ret_added) {
+  size_t added = 0;
+  int status = 0;
+
+  if ((nb == NULL) || ((vl == NULL) && (vl_num > 0)) || (ret_added == NULL))
+    return EINVAL;
+
+  while (added < vl_num) {
+    if (nb_check_values(vl + added) != 0) {
+      status = EINVAL;
+      break;
+    }
+
+    if (nb_add_value_list(nb, vl + added) != 0)
+      break;
+    added++;
+  }
+
+  *ret_added = added;
+  return status;
+} /* }}} int lcc_network_buffer_add_values */
+
 int lcc_network_buffer_get(lcc_network_buffer_t *nb, /* {{{ */
                            void *buffer, size_t *buffer_size) {
   size_t sz_required;
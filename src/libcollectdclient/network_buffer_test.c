@@ -0,0 +1,235 @@
+/**
+ * Copyright 2026 collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd/lcc_features.h"
+
+#include "collectd/network_parse.h"
+#include "globals.h" /* for PRIsz */
+
+#include <stdio.h>
+
+#include "network_buffer.c" /* sic */
+
+#define VL_NUM 64
+
+static value_t values[VL_NUM];
+static int values_types[VL_NUM];
+static lcc_value_list_t vls[VL_NUM];
+
+static size_t parsed_num;
+static int parsed_errors;
+
+static void init_value_lists(void) {
+  for (size_t i = 0; i < VL_NUM; i++) {
+    values[i].gauge = (double)i;
+    values_types[i] = LCC_TYPE_GAUGE;
+    vls[i] = (lcc_value_list_t){
+        .values = values + i,
+        .values_types = values_types + i,
+        .values_len = 1,
+        .time = 1480063672.0 + (double)(i / 10),
+        .interval = 10.0,
+    };
+    snprintf(vls[i].identifier.host, sizeof(vls[i].identifier.host),
+             "host%zu", i % 2);
+    snprintf(vls[i].identifier.plugin, sizeof(vls[i].identifier.plugin),
+             "plugin");
+    snprintf(vls[i].identifier.type, sizeof(vls[i].identifier.type), "gauge");
+    snprintf(vls[i].identifier.type_instance,
+             sizeof(vls[i].identifier.type_instance), "%zu", i);
+  }
+}
+
+/* Checks that value lists are received in the order they were added. */
+static int check_writer(lcc_value_list_t const *vl) {
+  lcc_value_list_t const *want = vls + parsed_num;
+
+  if ((parsed_num >= VL_NUM) ||
+      (strcmp(vl->identifier.host, want->identifier.host) != 0) ||
+      (strcmp(vl->identifier.type_instance, want->identifier.type_instance) !=
+       0) ||
+      (vl->values_len != 1) || (vl->values[0].gauge != want->values[0].gauge)) {
+    fprintf(stderr, "check_writer: value list %" PRIsz " differs\n",
+            parsed_num);
+    parsed_errors++;
+  }
+
+  parsed_num++;
+  return 0;
+}
+
+static char const *check_password(__attribute__((unused))
+                                  char const *username) {
+  return "secret";
+}
+
+/* Fills buffers of "size" bytes until all value lists have been added, and
+ * parses each of them. */
+static int add_and_parse(size_t size, lcc_security_level_t level) {
+  lcc_network_buffer_t *nb = lcc_network_buffer_create(size);
+  if (nb == NULL) {
+    fprintf(stderr, "lcc_network_buffer_create(%" PRIsz ") failed\n", size);
+    return -1;
+  }
+
+  if (level != NONE) {
+    int status = lcc_network_buffer_set_security_level(nb, level, "admin",
+                                                       "secret");
+    if (status != 0) {
+      fprintf(stderr, "lcc_network_buffer_set_security_level() = %d\n",
+              status);
+      lcc_network_buffer_destroy(nb);
+      return -1;
+    }
+  }
+
+  lcc_network_parse_options_t opts = {
+      .writer = check_writer,
+      .password_lookup = check_password,
+      .security_level = level,
+  };
+
+  parsed_num = 0;
+  parsed_errors = 0;
+
+  int ret = 0;
+  size_t done = 0;
+  size_t packets_num = 0;
+  while (done < VL_NUM) {
+    size_t added = 0;
+    int status =
+        lcc_network_buffer_add_values(nb, vls + done, VL_NUM - done, &added);
+    if ((status != 0) || (added == 0)) {
+      fprintf(stderr, "lcc_network_buffer_add_values() = %d, added = %" PRIsz
+                      "\n",
+              status, added);
+      ret = -1;
+      break;
+    }
+    done += added;
+    packets_num++;
+
+    char buffer[LCC_NETWORK_BUFFER_SIZE_DEFAULT];
+    size_t buffer_size = sizeof(buffer);
+    lcc_network_buffer_finalize(nb);
+    lcc_network_buffer_get(nb, buffer, &buffer_size);
+    lcc_network_buffer_initialize(nb);
+
+    status = lcc_network_parse(buffer, buffer_size, opts);
+    if (status != 0) {
+      fprintf(stderr, "lcc_network_parse() = %d\n", status);
+      ret = -1;
+      break;
+    }
+  }
+
+  if ((ret == 0) && (parsed_num != VL_NUM)) {
+    fprintf(stderr, "parsed %" PRIsz " value lists, want %d\n", parsed_num,
+            VL_NUM);
+    ret = -1;
+  }
+  if ((ret == 0) && (size < LCC_NETWORK_BUFFER_SIZE_DEFAULT) &&
+      (packets_num < 2)) {
+    fprintf(stderr, "got %" PRIsz " packets, want more than one\n",
+            packets_num);
+    ret = -1;
+  }
+  if (parsed_errors != 0)
+    ret = -1;
+
+  lcc_network_buffer_destroy(nb);
+  return ret;
+}
+
+static int test_add_values(void) {
+  int ret = 0;
+
+  if (add_and_parse(LCC_NETWORK_BUFFER_SIZE_DEFAULT, NONE) != 0)
+    ret = -1;
+  if (add_and_parse(256, NONE) != 0)
+    ret = -1;
+
+  return ret;
+}
+
+static int test_add_values_invalid(void) {
+  lcc_network_buffer_t *nb = lcc_network_buffer_create(0);
+  int ret = 0;
+
+  lcc_value_list_t invalid[3] = {vls[0], vls[1], vls[2]};
+  invalid[1].values_len = 0;
+
+  size_t added = 42;
+  int status = lcc_network_buffer_add_values(nb, invalid, 3, &added);
+  if ((status != EINVAL) || (added != 1)) {
+    fprintf(stderr,
+            "lcc_network_buffer_add_values() = %d, added = %" PRIsz
+            ", want %d and 1\n",
+            status, added, EINVAL);
+    ret = -1;
+  }
+
+  lcc_network_buffer_destroy(nb);
+  return ret;
+}
+
+#if HAVE_GCRYPT_H
+static int test_security_levels(void) {
+  int ret = 0;
+
+  if (add_and_parse(256, SIGN) != 0) {
+    fprintf(stderr, "test_security_levels: SIGN failed\n");
+    ret = -1;
+  }
+  if (add_and_parse(256, ENCRYPT) != 0) {
+    fprintf(stderr, "test_security_levels: ENCRYPT failed\n");
+    ret = -1;
+  }
+
+  return ret;
+}
+#endif
+
+int main(void) {
+  int ret = 0;
+
+  init_value_lists();
+
+  int status;
+  if ((status = test_add_values())) {
+    ret = status;
+  }
+  if ((status = test_add_values_invalid())) {
+    ret = status;
+  }
+
+#if HAVE_GCRYPT_H
+  if ((status = test_security_levels())) {
+    ret = status;
+  }
+#endif
+
+  return ret;
+}
@@ -0,0 +1,239 @@
+/**
+ * libcollectdclient - src/libcollectdclient/shm.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "config.h"
+
+#include "collectd/client.h"
+#include "collectd/lcc_features.h"
+#include "collectd/shm.h"
+
+// clang-format off
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+// clang-format on
+
+/* Number of attempts to read a record that is being updated concurrently. */
+#define LCC_SHM_RETRIES 100
+
+struct lcc_shm_s {
+  void *addr;
+  size_t size;
+
+  lcc_shm_header_t const *header;
+  char const *records;
+  uint32_t record_size;
+  uint32_t records_max;
+
+  /* Private index of the records, mapping identifiers to record numbers.
+   * Open addressing; slots hold the record number plus one. */
+  uint32_t *index;
+  size_t index_size; /* power of two */
+  uint32_t indexed_num;
+};
+
+static uint32_t lcc_shm_hash(char const *str) /* {{{ */
+{
+  uint32_t hash = 2166136261U;
+
+  for (unsigned char const *c = (unsigned char const *)str; *c != 0; c++) {
+    hash ^= *c;
+    hash *= 16777619U;
+  }
+
+  return hash;
+} /* }}} uint32_t lcc_shm_hash */
+
+static lcc_shm_record_t const *lcc_shm_record(lcc_shm_t *shm, /* {{{ */
+                                              uint32_t i) {
+  return (lcc_shm_record_t const *)(shm->records +
+                                    (size_t)i * shm->record_size);
+} /* }}} lcc_shm_record_t const *lcc_shm_record */
+
+/* Adds records that have been created since the last call to the index. */
+static void lcc_shm_update_index(lcc_shm_t *shm) /* {{{ */
+{
+  uint32_t num = __atomic_load_n(&shm->header->records_num, __ATOMIC_ACQUIRE);
+  if (num > shm->records_max)
+    num = shm->records_max;
+
+  for (uint32_t i = shm->indexed_num; i < num; i++) {
+    lcc_shm_record_t const *r = lcc_shm_record(shm, i);
+    size_t slot = lcc_shm_hash(r->identifier) & (shm->index_size - 1);
+
+    while (shm->index[slot] != 0)
+      slot = (slot + 1) & (shm->index_size - 1);
+    shm->index[slot] = i + 1;
+  }
+
+  shm->indexed_num = num;
+} /* }}} void lcc_shm_update_index */
+
+static lcc_shm_record_t const *lcc_shm_lookup(lcc_shm_t *shm, /* {{{ */
+                                              char const *identifier) {
+  size_t slot = lcc_shm_hash(identifier) & (shm->index_size - 1);
+
+  while (shm->index[slot] != 0) {
+    lcc_shm_record_t const *r = lcc_shm_record(shm, shm->index[slot] - 1);
+    if (strncmp(r->identifier, identifier, sizeof(r->identifier)) == 0)
+      return r;
+    slot = (slot + 1) & (shm->index_size - 1);
+  }
+
+  return NULL;
+} /* }}} lcc_shm_record_t const *lcc_shm_lookup */
+
+int lcc_shm_open(const char *name, lcc_shm_t **ret_shm) /* {{{ */
+{
+  if (ret_shm == NULL)
+    return EINVAL;
+  if (name == NULL)
+    name = LCC_SHM_DEFAULT_NAME;
+
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+    return errno;
+
+  struct stat statbuf = {0};
+  if (fstat(fd, &statbuf) != 0) {
+    int status = errno;
+    close(fd);
+    return status;
+  }
+
+  if ((size_t)statbuf.st_size < sizeof(lcc_shm_header_t)) {
+    close(fd);
+    return EINVAL;
+  }
+
+  void *addr = mmap(NULL, (size_t)statbuf.st_size, PROT_READ, MAP_SHARED, fd,
+                    /* offset = */ 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return errno;
+
+  lcc_shm_header_t const *header = addr;
+  if ((__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != LCC_SHM_MAGIC) ||
+      (header->version != LCC_SHM_VERSION) ||
+      (header->record_size < sizeof(lcc_shm_record_t)) ||
+      ((size_t)header->records_max * header->record_size >
+       (size_t)statbuf.st_size - sizeof(*header))) {
+    munmap(addr, (size_t)statbuf.st_size);
+    return EINVAL;
+  }
+
+  lcc_shm_t *shm = calloc(1, sizeof(*shm));
+  if (shm == NULL) {
+    munmap(addr, (size_t)statbuf.st_size);
+    return ENOMEM;
+  }
+  shm->addr = addr;
+  shm->size = (size_t)statbuf.st_size;
+  shm->header = header;
+  shm->records = (char const *)addr + sizeof(*header);
+  shm->record_size = header->record_size;
+  shm->records_max = header->records_max;
+
+  shm->index_size = 16;
+  while (shm->index_size < 2 * (size_t)shm->records_max)
+    shm->index_size *= 2;
+  shm->index = calloc(shm->index_size, sizeof(*shm->index));
+  if (shm->index == NULL) {
+    lcc_shm_close(shm);
+    return ENOMEM;
+  }
+
+  *ret_shm = shm;
+  return 0;
+} /* }}} int lcc_shm_open */
+
+int lcc_shm_getval(lcc_shm_t *shm, const lcc_identifier_t *ident, /* {{{ */
+                   size_t *ret_values_num, gauge_t **ret_values,
+                   double *ret_time) {
+  char identifier[LCC_SHM_IDENTIFIER_SIZE];
+
+  if ((shm == NULL) || (ident == NULL) || (ret_values_num == NULL) ||
+      (ret_values == NULL))
+    return EINVAL;
+
+  if (lcc_identifier_to_string(NULL, identifier, sizeof(identifier), ident) !=
+      0)
+    return EINVAL;
+
+  lcc_shm_record_t const *r = lcc_shm_lookup(shm, identifier);
+  if (r == NULL) {
+    lcc_shm_update_index(shm);
+    r = lcc_shm_lookup(shm, identifier);
+  }
+  if (r == NULL)
+    return ENOENT;
+
+  for (int i = 0; i < LCC_SHM_RETRIES; i++) {
+    gauge_t values[LCC_SHM_VALUES_MAX];
+
+    uint32_t seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+      continue;
+
+    uint32_t values_num = r->values_num;
+    uint64_t time = r->time;
+    memcpy(values, r->values, sizeof(values));
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != seq)
+      continue;
+
+    /* The record has been created but not written yet. */
+    if (values_num == 0)
+      return ENOENT;
+    if (values_num > LCC_SHM_VALUES_MAX)
+      return EINVAL;
+
+    gauge_t *ret = calloc(values_num, sizeof(*ret));
+    if (ret == NULL)
+      return ENOMEM;
+    memcpy(ret, values, values_num * sizeof(*ret));
+
+    *ret_values = ret;
+    *ret_values_num = (size_t)values_num;
+    if (ret_time != NULL)
+      *ret_time = ((double)time) / 1073741824.0;
+    return 0;
+  }
+
+  return EAGAIN;
+} /* }}} int lcc_shm_getval */
+
+void lcc_shm_close(lcc_shm_t *shm) /* {{{ */
+{
+  if (shm == NULL)
+    return;
+
+  munmap(shm->addr, shm->size);
+  free(shm->index);
+  free(shm);
+} /* }}} void lcc_shm_close */
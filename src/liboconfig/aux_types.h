@@ -1,15 +1,20 @@
 #ifndef AUX_TYPES_H
 #define AUX_TYPES_H 1
 
+/* The "*_alloc" members hold the number of elements the arrays have room for.
+ * The arrays grow geometrically, so that long lists are built in linear
+ * time. */
 struct statement_list_s {
   oconfig_item_t *statement;
   int statement_num;
+  int statement_alloc;
 };
 typedef struct statement_list_s statement_list_t;
 
 struct argument_list_s {
   oconfig_value_t *argument;
   int argument_num;
+  int argument_alloc;
 };
 typedef struct argument_list_s argument_list_t;
 
@@ -94,13 +94,17 @@ argument_list:
 	argument_list argument
 	{
 	 $$ = $1;
-	 oconfig_value_t *tmp = realloc($$.argument,
-	                                ($$.argument_num+1) * sizeof(*$$.argument));
-	 if (tmp == NULL) {
-	   yyerror("realloc failed");
-	   YYERROR;
+	 if ($$.argument_num >= $$.argument_alloc) {
+	   int alloc = 2 * $$.argument_alloc;
+	   oconfig_value_t *tmp = realloc($$.argument,
+	                                  alloc * sizeof(*$$.argument));
+	   if (tmp == NULL) {
+	     yyerror("realloc failed");
+	     YYERROR;
+	   }
+	   $$.argument = tmp;
+	   $$.argument_alloc = alloc;
 	 }
-	 $$.argument = tmp;
 	 $$.argument[$$.argument_num] = $2;
 	 $$.argument_num++;
 	}
@@ -113,6 +117,7 @@ argument_list:
 	 }
 	 $$.argument[0] = $1;
 	 $$.argument_num = 1;
+	 $$.argument_alloc = 1;
 	}
 	;
 
@@ -194,13 +199,17 @@ statement_list:
 	 $$ = $1;
 	 if (($2.values_num > 0) || ($2.children_num > 0))
 	 {
-		 oconfig_item_t *tmp = realloc($$.statement,
-		                               ($$.statement_num+1) * sizeof(*tmp));
-		 if (tmp == NULL) {
-		   yyerror("realloc failed");
-		   YYERROR;
+		 if ($$.statement_num >= $$.statement_alloc) {
+			 int alloc = ($$.statement_alloc > 0) ? 2 * $$.statement_alloc : 1;
+			 oconfig_item_t *tmp = realloc($$.statement,
+			                               alloc * sizeof(*tmp));
+			 if (tmp == NULL) {
+			   yyerror("realloc failed");
+			   YYERROR;
+			 }
+			 $$.statement = tmp;
+			 $$.statement_alloc = alloc;
 		 }
-		 $$.statement = tmp;
 		 $$.statement[$$.statement_num] = $2;
 		 $$.statement_num++;
 	 }
@@ -216,11 +225,13 @@ statement_list:
 		 }
 		 $$.statement[0] = $1;
 		 $$.statement_num = 1;
+		 $$.statement_alloc = 1;
 	 }
 	 else
 	 {
 	 	$$.statement = NULL;
 		$$.statement_num = 0;
+		$$.statement_alloc = 0;
 	 }
 	}
 	;
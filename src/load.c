@@ -57,6 +57,10 @@
 
 static bool report_relative_load;
 
+#if !defined(HAVE_GETLOADAVG) && defined(KERNEL_LINUX)
+static proc_file_t *proc_loadavg;
+#endif
+
 static const char *config_keys[] = {"ReportRelative"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
@@ -122,26 +126,21 @@ static int load_read(void) {
 
 #elif defined(KERNEL_LINUX)
   gauge_t snum, mnum, lnum;
-  FILE *loadavg;
-  char buffer[16];
+  char *buffer;
 
   char *fields[8];
   int numfields;
 
-  if ((loadavg = fopen("/proc/loadavg", "r")) == NULL) {
-    WARNING("load: fopen: %s", STRERRNO);
-    return -1;
+  if (proc_loadavg == NULL) {
+    proc_loadavg = proc_file_create("/proc/loadavg");
+    if (proc_loadavg == NULL) {
+      WARNING("load: proc_file_create failed.");
+      return -1;
+    }
   }
 
-  if (fgets(buffer, 16, loadavg) == NULL) {
-    WARNING("load: fgets: %s", STRERRNO);
-    fclose(loadavg);
+  if ((buffer = proc_file_read(proc_loadavg, NULL)) == NULL)
     return -1;
-  }
-
-  if (fclose(loadavg)) {
-    WARNING("load: fclose: %s", STRERRNO);
-  }
 
   numfields = strsplit(buffer, fields, 8);
 
@@ -50,6 +50,11 @@ static int log_level = LOG_INFO;
 static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static char *log_file;
+/* Kept open between messages, see log_logstash_open(). */
+static FILE *log_fh;
+static dev_t log_dev;
+static ino_t log_ino;
+static cdtime_t log_checked;
 
 static const char *config_keys[] = {"LogLevel", "File"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
@@ -64,18 +69,56 @@ static int log_logstash_config(const char *key, const char *value) {
       return 1;
     }
   } else if (0 == strcasecmp(key, "File")) {
+    pthread_mutex_lock(&file_lock);
+    if (log_fh != NULL) {
+      fclose(log_fh);
+      log_fh = NULL;
+    }
     sfree(log_file);
     log_file = strdup(value);
+    pthread_mutex_unlock(&file_lock);
   } else {
     return -1;
   }
   return 0;
 } /* int log_logstash_config (const char *, const char *) */
 
+/* Returns the open handle of "log_file". Once per second, checks whether the
+ * file has been rotated away and reopens it if so. Called with "file_lock"
+ * held. */
+static FILE *log_logstash_open(void) {
+  cdtime_t now = cdtime();
+  struct stat statbuf;
+
+  if (log_fh != NULL) {
+    if ((now - log_checked) < TIME_T_TO_CDTIME_T(1))
+      return log_fh;
+    log_checked = now;
+
+    if ((stat(log_file, &statbuf) == 0) && (statbuf.st_dev == log_dev) &&
+        (statbuf.st_ino == log_ino))
+      return log_fh;
+
+    fclose(log_fh);
+    log_fh = NULL;
+  }
+
+  log_fh = fopen(log_file, "a");
+  if (log_fh == NULL)
+    return NULL;
+
+  if (fstat(fileno(log_fh), &statbuf) == 0) {
+    log_dev = statbuf.st_dev;
+    log_ino = statbuf.st_ino;
+  }
+  log_checked = now;
+
+  return log_fh;
+} /* FILE *log_logstash_open */
+
 static void log_logstash_print(yajl_gen g, int severity,
                                cdtime_t timestamp_time) {
   FILE *fh;
-  bool do_close = false;
   struct tm timestamp_tm;
   char timestamp_str[64];
   const unsigned char *buf;
@@ -150,13 +193,10 @@ static void log_logstash_print(yajl_gen g, int severity,
     fh = stderr;
   } else if (strcasecmp(log_file, "stdout") == 0) {
     fh = stdout;
-    do_close = false;
   } else if (strcasecmp(log_file, "stderr") == 0) {
     fh = stderr;
-    do_close = false;
   } else {
-    fh = fopen(log_file, "a");
-    do_close = true;
+    fh = log_logstash_open();
   }
 
   if (fh == NULL) {
@@ -164,11 +204,7 @@ static void log_logstash_print(yajl_gen g, int severity,
             STRERRNO);
   } else {
     fprintf(fh, "%s\n", buf);
-    if (do_close) {
-      fclose(fh);
-    } else {
-      fflush(fh);
-    }
+    fflush(fh);
   }
   pthread_mutex_unlock(&file_lock);
   yajl_gen_free(g);
@@ -322,6 +358,17 @@ err:
   return 0;
 } /* int log_logstash_notification */
 
+static int log_logstash_shutdown(void) {
+  pthread_mutex_lock(&file_lock);
+  if (log_fh != NULL) {
+    fclose(log_fh);
+    log_fh = NULL;
+  }
+  pthread_mutex_unlock(&file_lock);
+
+  return 0;
+} /* int log_logstash_shutdown */
+
 void module_register(void) {
   plugin_register_config("log_logstash", log_logstash_config, config_keys,
                          config_keys_num);
@@ -329,4 +376,5 @@ void module_register(void) {
                       /* user_data = */ NULL);
   plugin_register_notification("log_logstash", log_logstash_notification,
                                /* user_data = */ NULL);
+  plugin_register_shutdown("log_logstash", log_logstash_shutdown);
 } /* void module_register (void) */
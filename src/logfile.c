@@ -40,6 +40,12 @@ static int log_level = LOG_INFO;
 static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static char *log_file;
+/* The log file is kept open. It is reopened when it has been moved or removed,
+ * e.g. by logrotate, which is checked at most once per second. */
+static FILE *log_fh;
+static dev_t log_dev;
+static ino_t log_ino;
+static cdtime_t log_checked;
 static int print_timestamp = 1;
 static int print_severity;
 
@@ -56,8 +62,14 @@ static int logfile_config(const char *key, const char *value) {
       return 0;
     }
   } else if (0 == strcasecmp(key, "File")) {
+    pthread_mutex_lock(&file_lock);
+    if (log_fh != NULL) {
+      fclose(log_fh);
+      log_fh = NULL;
+    }
     sfree(log_file);
     log_file = strdup(value);
+    pthread_mutex_unlock(&file_lock);
   } else if (0 == strcasecmp(key, "Timestamp")) {
     if (IS_FALSE(value))
       print_timestamp = 0;
@@ -74,10 +86,41 @@ static int logfile_config(const char *key, const char *value) {
   return 0;
 } /* int logfile_config (const char *, const char *) */
 
+/* Returns the handle of "log_file", (re)opening it if necessary. Must be
+ * called with "file_lock" held. */
+static FILE *logfile_open(void) {
+  cdtime_t now = cdtime();
+  struct stat statbuf;
+
+  if (log_fh != NULL) {
+    if ((now - log_checked) < TIME_T_TO_CDTIME_T(1))
+      return log_fh;
+    log_checked = now;
+
+    if ((stat(log_file, &statbuf) == 0) && (statbuf.st_dev == log_dev) &&
+        (statbuf.st_ino == log_ino))
+      return log_fh;
+
+    fclose(log_fh);
+    log_fh = NULL;
+  }
+
+  log_fh = fopen(log_file, "a");
+  if (log_fh == NULL)
+    return NULL;
+
+  if (fstat(fileno(log_fh), &statbuf) == 0) {
+    log_dev = statbuf.st_dev;
+    log_ino = statbuf.st_ino;
+  }
+  log_checked = now;
+
+  return log_fh;
+} /* FILE *logfile_open */
+
 static void logfile_print(const char *msg, int severity,
                           cdtime_t timestamp_time) {
   FILE *fh;
-  bool do_close = false;
   char timestamp_str[64];
   char level_str[16] = "";
 
@@ -120,10 +163,8 @@ static void logfile_print(const char *msg, int severity,
     fh = stderr;
   else if (strcasecmp(log_file, "stdout") == 0)
     fh = stdout;
-  else {
-    fh = fopen(log_file, "a");
-    do_close = true;
-  }
+  else
+    fh = logfile_open();
 
   if (fh == NULL) {
     fprintf(stderr, "logfile plugin: fopen (%s) failed: %s\n", log_file,
@@ -134,11 +175,7 @@ static void logfile_print(const char *msg, int severity,
     else
       fprintf(fh, "%s%s\n", level_str, msg);
 
-    if (do_close) {
-      fclose(fh);
-    } else {
-      fflush(fh);
-    }
+    fflush(fh);
   }
 
   pthread_mutex_unlock(&file_lock);
@@ -196,9 +233,21 @@ static int logfile_notification(const notification_t *n,
   return 0;
 } /* int logfile_notification */
 
+static int logfile_shutdown(void) {
+  pthread_mutex_lock(&file_lock);
+  if (log_fh != NULL) {
+    fclose(log_fh);
+    log_fh = NULL;
+  }
+  pthread_mutex_unlock(&file_lock);
+
+  return 0;
+} /* int logfile_shutdown */
+
 void module_register(void) {
   plugin_register_config("logfile", logfile_config, config_keys,
                          config_keys_num);
+  plugin_register_shutdown("logfile", logfile_shutdown);
   plugin_register_log("logfile", logfile_log, /* user_data = */ NULL);
   plugin_register_notification("logfile", logfile_notification,
                                /* user_data = */ NULL);
@@ -43,19 +43,45 @@
 #define PLUGIN_READ 1
 #define PLUGIN_WRITE 2
 
-typedef struct lua_script_s {
+struct clua_callback_data_s;
+typedef struct clua_callback_data_s clua_callback_data_t;
+
+/* An independent Lua state running a copy of a script. Only one thread at a
+ * time may use a state (including the Lua threads created from it). */
+typedef struct {
   lua_State *lua_state;
+  pthread_mutex_t lock;
+} clua_state_t;
+
+typedef struct lua_script_s {
+  clua_state_t *states;
+  size_t states_num;
+
+  /* Callbacks in the order they were registered by the first state. The other
+   * states register the same callbacks in the same order. */
+  clua_callback_data_t **callbacks;
+  size_t callbacks_num;
+
   struct lua_script_s *next;
 } lua_script_t;
 
-typedef struct {
-  lua_State *lua_state;
+struct clua_callback_data_s {
+  lua_script_t *script;
   char *lua_function_name;
-  pthread_mutex_t lock;
-  int callback_id;
-} clua_callback_data_t;
+  int type;
+
+  /* Per state: the Lua thread and the reference of the callback function.
+   * "threads[i]" is NULL if state "i" did not register the callback. */
+  lua_State **threads;
+  int *callback_ids;
+
+  /* Read callbacks always run in the same state, so they can keep their
+   * state between calls. */
+  size_t read_state;
+};
 
 static char base_path[PATH_MAX];
+static size_t states_num = 1;
 static lua_script_t *scripts;
 
 static int clua_store_callback(lua_State *L, int idx) /* {{{ */
@@ -93,19 +119,48 @@ static int clua_store_thread(lua_State *L, int idx) /* {{{ */
   return 0;
 } /* }}} int clua_store_thread */
 
+/* Lock a state that has the callback and return its index. Write callbacks
+ * may run in any state, so use the first one that is free. If all states are
+ * busy, wait for the one after the state used last time. */
+static size_t clua_lock_state(clua_callback_data_t *cb) /* {{{ */
+{
+  lua_script_t *script = cb->script;
+
+  if (cb->type == PLUGIN_READ) {
+    size_t idx = (cb->threads[cb->read_state] != NULL) ? cb->read_state : 0;
+    pthread_mutex_lock(&script->states[idx].lock);
+    return idx;
+  }
+
+  size_t fallback = script->states_num;
+  for (size_t i = 0; i < script->states_num; i++) {
+    if (cb->threads[i] == NULL)
+      continue;
+    if (pthread_mutex_trylock(&script->states[i].lock) == 0)
+      return i;
+    if (fallback == script->states_num)
+      fallback = i;
+  }
+
+  /* The first state always registers the callback, so fallback is valid. */
+  pthread_mutex_lock(&script->states[fallback].lock);
+  return fallback;
+} /* }}} size_t clua_lock_state */
+
 static int clua_read(user_data_t *ud) /* {{{ */
 {
   clua_callback_data_t *cb = ud->data;
 
-  pthread_mutex_lock(&cb->lock);
+  size_t idx = clua_lock_state(cb);
+  pthread_mutex_t *lock = &cb->script->states[idx].lock;
 
-  lua_State *L = cb->lua_state;
+  lua_State *L = cb->threads[idx];
 
-  int status = clua_load_callback(L, cb->callback_id);
+  int status = clua_load_callback(L, cb->callback_ids[idx]);
   if (status != 0) {
     ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
-          cb->lua_function_name, cb->callback_id);
-    pthread_mutex_unlock(&cb->lock);
+          cb->lua_function_name, cb->callback_ids[idx]);
+    pthread_mutex_unlock(lock);
     return -1;
   }
   /* +1 = 1 */
@@ -119,14 +174,14 @@ static int clua_read(user_data_t *ud) /* {{{ */
     else
       ERROR("Lua plugin: Calling a read callback failed: %s", errmsg);
     lua_pop(L, 1);
-    pthread_mutex_unlock(&cb->lock);
+    pthread_mutex_unlock(lock);
     return -1;
   }
 
   if (!lua_isnumber(L, -1)) {
     ERROR("Lua plugin: Read function \"%s\" (id %i) did not return a numeric "
           "status.",
-          cb->lua_function_name, cb->callback_id);
+          cb->lua_function_name, cb->callback_ids[idx]);
     status = -1;
   } else {
     status = (int)lua_tointeger(L, -1);
@@ -135,7 +190,7 @@ static int clua_read(user_data_t *ud) /* {{{ */
   /* pop return value and function */
   lua_pop(L, 1); /* -1 = 0 */
 
-  pthread_mutex_unlock(&cb->lock);
+  pthread_mutex_unlock(lock);
   return status;
 } /* }}} int clua_read */
 
@@ -143,15 +198,16 @@ static int clua_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
                       user_data_t *ud) {
   clua_callback_data_t *cb = ud->data;
 
-  pthread_mutex_lock(&cb->lock);
+  size_t idx = clua_lock_state(cb);
+  pthread_mutex_t *lock = &cb->script->states[idx].lock;
 
-  lua_State *L = cb->lua_state;
+  lua_State *L = cb->threads[idx];
 
-  int status = clua_load_callback(L, cb->callback_id);
+  int status = clua_load_callback(L, cb->callback_ids[idx]);
   if (status != 0) {
     ERROR("Lua plugin: Unable to load callback \"%s\" (id %i).",
-          cb->lua_function_name, cb->callback_id);
-    pthread_mutex_unlock(&cb->lock);
+          cb->lua_function_name, cb->callback_ids[idx]);
+    pthread_mutex_unlock(lock);
     return -1;
   }
   /* +1 = 1 */
@@ -159,7 +215,7 @@ static int clua_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   status = luaC_pushvaluelist(L, ds, vl);
   if (status != 0) {
     lua_pop(L, 1); /* -1 = 0 */
-    pthread_mutex_unlock(&cb->lock);
+    pthread_mutex_unlock(lock);
     ERROR("Lua plugin: luaC_pushvaluelist failed.");
     return -1;
   }
@@ -174,21 +230,21 @@ static int clua_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     else
       ERROR("Lua plugin: Calling the write callback failed:\n%s", errmsg);
     lua_pop(L, 1); /* -1 = 0 */
-    pthread_mutex_unlock(&cb->lock);
+    pthread_mutex_unlock(lock);
     return -1;
   }
 
   if (!lua_isnumber(L, -1)) {
     ERROR("Lua plugin: Write function \"%s\" (id %i) did not return a numeric "
           "value.",
-          cb->lua_function_name, cb->callback_id);
+          cb->lua_function_name, cb->callback_ids[idx]);
     status = -1;
   } else {
     status = (int)lua_tointeger(L, -1);
   }
 
   lua_pop(L, 1); /* -1 = 0 */
-  pthread_mutex_unlock(&cb->lock);
+  pthread_mutex_unlock(lock);
   return status;
 } /* }}} int clua_write */
 
@@ -264,10 +320,66 @@ static int lua_cb_dispatch_values(lua_State *L) /* {{{ */
 static void lua_cb_free(void *data) {
   clua_callback_data_t *cb = data;
   free(cb->lua_function_name);
-  pthread_mutex_destroy(&cb->lock);
+  free(cb->threads);
+  free(cb->callback_ids);
   free(cb);
 }
 
+/* Create the callback data when the first state of a script registers a
+ * callback, and register it with the daemon. */
+static int lua_cb_register_new(lua_State *L, lua_script_t *script, /* {{{ */
+                               int type, const char *function_name,
+                               lua_State *thread, int callback_id) {
+  clua_callback_data_t **tmp =
+      realloc(script->callbacks,
+              (script->callbacks_num + 1) * sizeof(*script->callbacks));
+  if (tmp == NULL)
+    return luaL_error(L, "%s", "realloc failed");
+  script->callbacks = tmp;
+
+  clua_callback_data_t *cb = calloc(1, sizeof(*cb));
+  if (cb == NULL)
+    return luaL_error(L, "%s", "calloc failed");
+
+  cb->script = script;
+  cb->type = type;
+  cb->threads = calloc(script->states_num, sizeof(*cb->threads));
+  cb->callback_ids = calloc(script->states_num, sizeof(*cb->callback_ids));
+  cb->lua_function_name = strdup(function_name);
+  if ((cb->threads == NULL) || (cb->callback_ids == NULL) ||
+      (cb->lua_function_name == NULL)) {
+    lua_cb_free(cb);
+    return luaL_error(L, "%s", "calloc failed");
+  }
+  cb->threads[0] = thread;
+  cb->callback_ids[0] = callback_id;
+  cb->read_state = script->callbacks_num % script->states_num;
+
+  int status;
+  if (PLUGIN_READ == type)
+    status = plugin_register_complex_read(/* group = */ "lua",
+                                          /* name      = */ function_name,
+                                          /* callback  = */ clua_read,
+                                          /* interval  = */ 0,
+                                          &(user_data_t){
+                                              .data = cb,
+                                              .free_func = lua_cb_free,
+                                          });
+  else
+    status = plugin_register_write(/* name = */ function_name,
+                                   /* callback  = */ clua_write,
+                                   &(user_data_t){
+                                       .data = cb,
+                                       .free_func = lua_cb_free,
+                                   });
+  if (status != 0)
+    return luaL_error(L, "Registering callback %s failed", function_name);
+
+  script->callbacks[script->callbacks_num] = cb;
+  script->callbacks_num++;
+  return 0;
+} /* }}} int lua_cb_register_new */
+
 static int lua_cb_register_generic(lua_State *L, int type) /* {{{ */
 {
   int nargs = lua_gettop(L);
@@ -302,6 +414,39 @@ static int lua_cb_register_generic(lua_State *L, int type) /* {{{ */
             lua_tostring(L, -1), subname);
   lua_pop(L, 1);
 
+  if ((PLUGIN_READ != type) && (PLUGIN_WRITE != type))
+    return luaL_error(L, "%s", "lua_cb_register_generic unsupported type");
+
+  lua_getfield(L, LUA_REGISTRYINDEX, "collectd:script");
+  lua_script_t *script = lua_touserdata(L, -1);
+  lua_getfield(L, LUA_REGISTRYINDEX, "collectd:state");
+  size_t state = (size_t)lua_tointeger(L, -1);
+  lua_getfield(L, LUA_REGISTRYINDEX, "collectd:register_num");
+  size_t register_num = (size_t)lua_tointeger(L, -1);
+  lua_pop(L, 3);
+
+  if ((script == NULL) || (state >= script->states_num))
+    return luaL_error(L, "%s", "Unable to find the script of this state");
+
+  /* Callbacks registered by the other states are matched with the ones of
+   * the first state by the order of registration. */
+  clua_callback_data_t *cb = NULL;
+  if (state > 0) {
+    if (register_num >= script->callbacks_num)
+      return luaL_error(L, "Callback %s was not registered by the first state",
+                        function_name);
+    cb = script->callbacks[register_num];
+    if ((cb->type != type) ||
+        (strcmp(cb->lua_function_name, function_name) != 0))
+      return luaL_error(L,
+                        "Callback %s does not match callback %s registered "
+                        "by the first state",
+                        function_name, cb->lua_function_name);
+  }
+
+  lua_pushinteger(L, (lua_Integer)(register_num + 1));
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:register_num");
+
   int callback_id = clua_store_callback(L, 1);
   if (callback_id < 0)
     return luaL_error(L, "%s", "Storing callback function failed");
@@ -312,42 +457,13 @@ static int lua_cb_register_generic(lua_State *L, int type) /* {{{ */
   clua_store_thread(L, -1);
   lua_pop(L, 1);
 
-  clua_callback_data_t *cb = calloc(1, sizeof(*cb));
   if (cb == NULL)
-    return luaL_error(L, "%s", "calloc failed");
-
-  cb->lua_state = thread;
-  cb->callback_id = callback_id;
-  cb->lua_function_name = strdup(function_name);
-  pthread_mutex_init(&cb->lock, NULL);
-
-  if (PLUGIN_READ == type) {
-    int status = plugin_register_complex_read(/* group = */ "lua",
-                                              /* name      = */ function_name,
-                                              /* callback  = */ clua_read,
-                                              /* interval  = */ 0,
-                                              &(user_data_t){
-                                                  .data = cb,
-                                                  .free_func = lua_cb_free,
-                                              });
+    return lua_cb_register_new(L, script, type, function_name, thread,
+                               callback_id);
 
-    if (status != 0)
-      return luaL_error(L, "%s", "plugin_register_complex_read failed");
-    return 0;
-  } else if (PLUGIN_WRITE == type) {
-    int status = plugin_register_write(/* name = */ function_name,
-                                       /* callback  = */ clua_write,
-                                       &(user_data_t){
-                                           .data = cb,
-                                           .free_func = lua_cb_free,
-                                       });
-
-    if (status != 0)
-      return luaL_error(L, "%s", "plugin_register_write failed");
-    return 0;
-  } else {
-    return luaL_error(L, "%s", "lua_cb_register_generic unsupported type");
-  }
+  cb->callback_ids[state] = callback_id;
+  cb->threads[state] = thread;
+  return 0;
 } /* }}} int lua_cb_register_generic */
 
 static int lua_cb_register_read(lua_State *L) {
@@ -386,94 +502,115 @@ static void lua_script_free(lua_script_t *script) /* {{{ */
 
   lua_script_t *next = script->next;
 
-  if (script->lua_state != NULL) {
-    lua_close(script->lua_state);
-    script->lua_state = NULL;
+  for (size_t i = 0; i < script->states_num; i++) {
+    if (script->states[i].lua_state != NULL) {
+      lua_close(script->states[i].lua_state);
+      script->states[i].lua_state = NULL;
+    }
+    pthread_mutex_destroy(&script->states[i].lock);
   }
+  sfree(script->states);
 
+  /* The callbacks themselves are freed by the daemon. */
+  sfree(script->callbacks);
   sfree(script);
 
   lua_script_free(next);
 } /* }}} void lua_script_free */
 
-static int lua_script_init(lua_script_t *script) /* {{{ */
+static lua_State *lua_state_create(void) /* {{{ */
 {
-  memset(script, 0, sizeof(*script));
-
   /* initialize the lua context */
-  script->lua_state = luaL_newstate();
-  if (script->lua_state == NULL) {
+  lua_State *L = luaL_newstate();
+  if (L == NULL) {
     ERROR("Lua plugin: luaL_newstate() failed.");
-    return -1;
+    return NULL;
   }
 
   /* Open up all the standard Lua libraries. */
-  luaL_openlibs(script->lua_state);
+  luaL_openlibs(L);
 
 /* Load the 'collectd' library */
 #if LUA_VERSION_NUM < 502
-  lua_pushcfunction(script->lua_state, open_collectd);
-  lua_pushstring(script->lua_state, "collectd");
-  lua_call(script->lua_state, 1, 0);
+  lua_pushcfunction(L, open_collectd);
+  lua_pushstring(L, "collectd");
+  lua_call(L, 1, 0);
 #else
-  luaL_requiref(script->lua_state, "collectd", open_collectd, 1);
-  lua_pop(script->lua_state, 1);
+  luaL_requiref(L, "collectd", open_collectd, 1);
+  lua_pop(L, 1);
 #endif
 
   /* Prepend BasePath to package.path */
   if (base_path[0] != '\0') {
-    lua_getglobal(script->lua_state, "package");
-    lua_getfield(script->lua_state, -1, "path");
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "path");
 
-    const char *cur_path = lua_tostring(script->lua_state, -1);
+    const char *cur_path = lua_tostring(L, -1);
     char *new_path = ssnprintf_alloc("%s/?.lua;%s", base_path, cur_path);
 
-    lua_pop(script->lua_state, 1);
-    lua_pushstring(script->lua_state, new_path);
+    lua_pop(L, 1);
+    lua_pushstring(L, new_path);
 
     free(new_path);
 
-    lua_setfield(script->lua_state, -2, "path");
-    lua_pop(script->lua_state, 1);
+    lua_setfield(L, -2, "path");
+    lua_pop(L, 1);
   }
 
-  return 0;
-} /* }}} int lua_script_init */
+  return L;
+} /* }}} lua_State *lua_state_create */
 
-static int lua_script_load(const char *script_path) /* {{{ */
+static int lua_script_init(lua_script_t *script) /* {{{ */
 {
-  lua_script_t *script = malloc(sizeof(*script));
-  if (script == NULL) {
-    ERROR("Lua plugin: malloc failed.");
+  memset(script, 0, sizeof(*script));
+
+  script->states = calloc(states_num, sizeof(*script->states));
+  if (script->states == NULL) {
+    ERROR("Lua plugin: calloc failed.");
     return -1;
   }
 
-  int status = lua_script_init(script);
-  if (status != 0) {
-    lua_script_free(script);
-    return status;
+  for (size_t i = 0; i < states_num; i++) {
+    pthread_mutex_init(&script->states[i].lock, NULL);
+    script->states_num++;
+
+    script->states[i].lua_state = lua_state_create();
+    if (script->states[i].lua_state == NULL)
+      return -1;
   }
 
-  status = luaL_loadfile(script->lua_state, script_path);
+  return 0;
+} /* }}} int lua_script_init */
+
+/* Load and run the script in the state with index "state". */
+static int lua_script_run(lua_script_t *script, size_t state, /* {{{ */
+                          const char *script_path) {
+  lua_State *L = script->states[state].lua_state;
+
+  int status = luaL_loadfile(L, script_path);
   if (status != 0) {
-    ERROR("Lua plugin: luaL_loadfile failed: %s",
-          lua_tostring(script->lua_state, -1));
-    lua_pop(script->lua_state, 1);
-    lua_script_free(script);
+    ERROR("Lua plugin: luaL_loadfile failed: %s", lua_tostring(L, -1));
+    lua_pop(L, 1);
     return -1;
   }
 
-  lua_pushstring(script->lua_state, script_path);
-  lua_setfield(script->lua_state, LUA_REGISTRYINDEX, "collectd:script_path");
-  lua_pushinteger(script->lua_state, 0);
-  lua_setfield(script->lua_state, LUA_REGISTRYINDEX, "collectd:callback_num");
-
-  status = lua_pcall(script->lua_state,
+  lua_pushstring(L, script_path);
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:script_path");
+  lua_pushinteger(L, 0);
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:callback_num");
+  lua_pushlightuserdata(L, script);
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:script");
+  lua_pushinteger(L, (lua_Integer)state);
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:state");
+  lua_pushinteger(L, 0);
+  lua_setfield(L, LUA_REGISTRYINDEX, "collectd:register_num");
+
+  status = lua_pcall(L,
                      /* nargs = */ 0,
                      /* nresults = */ LUA_MULTRET,
                      /* errfunc = */ 0);
   if (status != 0) {
-    const char *errmsg = lua_tostring(script->lua_state, -1);
+    const char *errmsg = lua_tostring(L, -1);
 
     if (errmsg == NULL)
       ERROR("Lua plugin: lua_pcall failed with status %i. "
@@ -482,6 +619,33 @@ static int lua_script_load(const char *script_path) /* {{{ */
     else
       ERROR("Lua plugin: Executing script \"%s\" failed: %s", script_path,
             errmsg);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int lua_script_run */
+
+static int lua_script_load(const char *script_path) /* {{{ */
+{
+  lua_script_t *script = malloc(sizeof(*script));
+  if (script == NULL) {
+    ERROR("Lua plugin: malloc failed.");
+    return -1;
+  }
+
+  int status = lua_script_init(script);
+  if (status != 0) {
+    lua_script_free(script);
+    return status;
+  }
+
+  /* Run the script in every state. Callbacks registered by a state are used
+   * by the daemon as soon as they are registered, so the script is kept even
+   * if it fails in one of the states. */
+  for (size_t i = 0; i < script->states_num; i++) {
+    status = lua_script_run(script, i, script_path);
+    if (status != 0)
+      break;
   }
 
   /* Append this script to the global list of scripts. */
@@ -544,9 +708,27 @@ static int lua_config_script(const oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int lua_config_script */
 
+static int lua_config_states(const oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  int status = cf_util_get_int(ci, &tmp);
+  if (status != 0)
+    return status;
+
+  if (tmp < 1) {
+    ERROR("Lua plugin: The `States' option requires a positive number.");
+    return -1;
+  }
+
+  states_num = (size_t)tmp;
+  return 0;
+} /* }}} int lua_config_states */
+
 /*
  * <Plugin lua>
  *   BasePath "/"
+ *   States 4
  *   Script "script1.lua"
  *   Script "script2.lua"
  * </Plugin>
@@ -559,6 +741,8 @@ static int lua_config(oconfig_item_t *ci) /* {{{ */
 
     if (strcasecmp("BasePath", child->key) == 0) {
       status = lua_config_base_path(child);
+    } else if (strcasecmp("States", child->key) == 0) {
+      status = lua_config_states(child);
     } else if (strcasecmp("Script", child->key) == 0) {
       status = lua_config_script(child);
     } else {
@@ -36,6 +36,7 @@
 #include "filter_chain.h"
 #include "utils/common/common.h"
 #include "utils/metadata/meta_data.h"
+#include "utils_cache.h"
 #include "utils_llist.h"
 
 #include <regex.h>
@@ -44,6 +45,10 @@
 #define log_err(...) ERROR("`regex' match: " __VA_ARGS__)
 #define log_warn(...) WARNING("`regex' match: " __VA_ARGS__)
 
+/* Number of slots in the per-match cache of identifier results. Must be a
+ * power of two. */
+#define MR_CACHE_SIZE 1024
+
 /*
  * private data types
  */
@@ -57,6 +62,15 @@ struct mr_regex_s {
   mr_regex_t *next;
 };
 
+/* The result of matching the identifier fields of one series. The regular
+ * expressions for the identifier only depend on the identifier, so the result
+ * is remembered instead of running regexec(3) for every value. */
+typedef struct {
+  char *key;
+  uint32_t hash;
+  int result;
+} mr_cache_entry_t;
+
 struct mr_match_s;
 typedef struct mr_match_s mr_match_t;
 struct mr_match_s {
@@ -67,6 +81,9 @@ struct mr_match_s {
   mr_regex_t *type_instance;
   llist_t *meta; /* Maps each meta key into mr_regex_t* */
   bool invert;
+
+  mr_cache_entry_t *cache; /* MR_CACHE_SIZE slots, direct mapped */
+  pthread_mutex_t cache_lock;
 };
 
 /*
@@ -101,6 +118,13 @@ static void mr_free_match(mr_match_t *m) /* {{{ */
   }
   llist_destroy(m->meta);
 
+  if (m->cache != NULL) {
+    for (size_t i = 0; i < MR_CACHE_SIZE; i++)
+      sfree(m->cache[i].key);
+    sfree(m->cache);
+    pthread_mutex_destroy(&m->cache_lock);
+  }
+
   sfree(m);
 } /* }}} void mr_free_match */
 
@@ -128,6 +152,68 @@ static int mr_match_regexen(mr_regex_t *re_head, /* {{{ */
   return FC_MATCH_MATCHES;
 } /* }}} int mr_match_regexen */
 
+static int mr_match_identifier(mr_match_t *m, /* {{{ */
+                               const value_list_t *vl) {
+  if (mr_match_regexen(m->host, vl->host) == FC_MATCH_NO_MATCH)
+    return FC_MATCH_NO_MATCH;
+  if (mr_match_regexen(m->plugin, vl->plugin) == FC_MATCH_NO_MATCH)
+    return FC_MATCH_NO_MATCH;
+  if (mr_match_regexen(m->plugin_instance, vl->plugin_instance) ==
+      FC_MATCH_NO_MATCH)
+    return FC_MATCH_NO_MATCH;
+  if (mr_match_regexen(m->type, vl->type) == FC_MATCH_NO_MATCH)
+    return FC_MATCH_NO_MATCH;
+  if (mr_match_regexen(m->type_instance, vl->type_instance) ==
+      FC_MATCH_NO_MATCH)
+    return FC_MATCH_NO_MATCH;
+
+  return FC_MATCH_MATCHES;
+} /* }}} int mr_match_identifier */
+
+/* Like mr_match_identifier(), but looks the result up in the match's cache
+ * first. */
+static int mr_match_identifier_cached(mr_match_t *m, /* {{{ */
+                                      const value_list_t *vl) {
+  char key[5 * DATA_MAX_NAME_LEN];
+
+  if (m->cache == NULL)
+    return mr_match_identifier(m, vl);
+
+  /* The fields have been escaped by the time filter chains run, so they
+   * don't contain slashes and the key is unambiguous. */
+  int status = snprintf(key, sizeof(key), "%s/%s/%s/%s/%s", vl->host,
+                        vl->plugin, vl->plugin_instance, vl->type,
+                        vl->type_instance);
+  if ((status < 0) || ((size_t)status >= sizeof(key)))
+    return mr_match_identifier(m, vl);
+
+  uint32_t hash = uc_hash_name(key);
+  mr_cache_entry_t *ce = m->cache + (hash & (MR_CACHE_SIZE - 1));
+
+  pthread_mutex_lock(&m->cache_lock);
+  if ((ce->key != NULL) && (ce->hash == hash) && (strcmp(ce->key, key) == 0)) {
+    int result = ce->result;
+    pthread_mutex_unlock(&m->cache_lock);
+    return result;
+  }
+  pthread_mutex_unlock(&m->cache_lock);
+
+  int result = mr_match_identifier(m, vl);
+
+  char *key_copy = strdup(key);
+  if (key_copy == NULL)
+    return result;
+
+  pthread_mutex_lock(&m->cache_lock);
+  sfree(ce->key);
+  ce->key = key_copy;
+  ce->hash = hash;
+  ce->result = result;
+  pthread_mutex_unlock(&m->cache_lock);
+
+  return result;
+} /* }}} int mr_match_identifier_cached */
+
 static int mr_add_regex(mr_regex_t **re_head, const char *re_str, /* {{{ */
                         const char *option) {
   mr_regex_t *re;
@@ -295,6 +381,16 @@ static int mr_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
     return status;
   }
 
+  /* Without a cache every value is matched against the regular expressions.
+   * That is slower, but still correct. */
+  if ((m->host != NULL) || (m->plugin != NULL) ||
+      (m->plugin_instance != NULL) || (m->type != NULL) ||
+      (m->type_instance != NULL)) {
+    m->cache = calloc(MR_CACHE_SIZE, sizeof(*m->cache));
+    if (m->cache != NULL)
+      pthread_mutex_init(&m->cache_lock, /* attr = */ NULL);
+  }
+
   *user_data = m;
   return 0;
 } /* }}} int mr_create */
@@ -324,17 +420,7 @@ static int mr_match(const data_set_t __attribute__((unused)) * ds, /* {{{ */
     nomatch_value = FC_MATCH_MATCHES;
   }
 
-  if (mr_match_regexen(m->host, vl->host) == FC_MATCH_NO_MATCH)
-    return nomatch_value;
-  if (mr_match_regexen(m->plugin, vl->plugin) == FC_MATCH_NO_MATCH)
-    return nomatch_value;
-  if (mr_match_regexen(m->plugin_instance, vl->plugin_instance) ==
-      FC_MATCH_NO_MATCH)
-    return nomatch_value;
-  if (mr_match_regexen(m->type, vl->type) == FC_MATCH_NO_MATCH)
-    return nomatch_value;
-  if (mr_match_regexen(m->type_instance, vl->type_instance) ==
-      FC_MATCH_NO_MATCH)
+  if (mr_match_identifier_cached(m, vl) == FC_MATCH_NO_MATCH)
     return nomatch_value;
   for (llentry_t *e = llist_head(m->meta); e != NULL; e = e->next) {
     mr_regex_t *meta_re = (mr_regex_t *)e->value;
@@ -244,7 +244,7 @@ static int mv_match(const data_set_t *ds, const value_list_t *vl, /* {{{ */
                     notification_meta_t __attribute__((unused)) * *meta,
                     void **user_data) {
   mv_match_t *m;
-  gauge_t *values;
+  gauge_t values[ds->ds_num];
   int status;
 
   if ((user_data == NULL) || (*user_data == NULL))
@@ -252,8 +252,7 @@ static int mv_match(const data_set_t *ds, const value_list_t *vl, /* {{{ */
 
   m = *user_data;
 
-  values = uc_get_rate(ds, vl);
-  if (values == NULL) {
+  if (uc_get_rate_into(ds, vl, values, STATIC_ARRAY_SIZE(values)) != 0) {
     ERROR("`value' match: Retrieving the current rate from the cache "
           "failed.");
     return -1;
@@ -304,7 +303,6 @@ static int mv_match(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     }
   } /* for (i = 0; i < ds->ds_num; i++) */
 
-  free(values);
   return status;
 } /* }}} int mv_match */
 
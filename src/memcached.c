@@ -46,6 +46,7 @@
 #define MEMCACHED_DEF_PORT "11211"
 #define MEMCACHED_CONNECT_TIMEOUT 10000
 #define MEMCACHED_IO_TIMEOUT 5000
+#define MEMCACHED_BUFFER_SIZE 16384
 
 struct prev_s {
   derive_t hits;
@@ -58,6 +59,19 @@ struct prev_s {
 
 typedef struct prev_s prev_t;
 
+/* All instances are queried from one read callback: the "stats" command is
+ * sent to every instance first, then the responses are collected with a
+ * single poll(2) loop. These are the states an instance goes through during
+ * one read. */
+enum memcached_state_e {
+  MC_IDLE,       /* not part of the current read */
+  MC_CONNECTING, /* non-blocking connect(2) in progress */
+  MC_WRITING,    /* sending the "stats" command */
+  MC_READING,    /* waiting for the terminating "END" line */
+  MC_DONE,       /* complete response is in "buffer" */
+  MC_FAILED,
+};
+
 struct memcached_s {
   char *name;
   char *host;
@@ -66,22 +80,54 @@ struct memcached_s {
   char *connport;
   int fd;
   prev_t prev;
+
+  /* Connections are kept open between reads. "reused" is set when the
+   * current read started on such a connection, so that it can be
+   * re-established once if the server closed it in the meantime. */
+  bool reused;
+  struct addrinfo *ai_list;
+  struct addrinfo *ai_next;
+
+  enum memcached_state_e state;
+  cdtime_t deadline;
+  size_t sent;
+  char buffer[MEMCACHED_BUFFER_SIZE + 1];
+  size_t buffer_fill;
 };
 typedef struct memcached_s memcached_t;
 
 static bool memcached_have_instances;
 
-static void memcached_free(void *arg) {
-  memcached_t *st = arg;
-  if (st == NULL)
-    return;
+static memcached_t **instances;
+static size_t instances_num;
+static struct pollfd *pollfds;
+static memcached_t **pollfds_instance;
 
+static char const stats_command[] = "stats\r\n";
+
+static void memcached_close(memcached_t *st) {
   if (st->fd >= 0) {
     shutdown(st->fd, SHUT_RDWR);
     close(st->fd);
     st->fd = -1;
   }
 
+  if (st->ai_list != NULL) {
+    freeaddrinfo(st->ai_list);
+    st->ai_list = NULL;
+    st->ai_next = NULL;
+  }
+
+  st->reused = false;
+}
+
+static void memcached_free(void *arg) {
+  memcached_t *st = arg;
+  if (st == NULL)
+    return;
+
+  memcached_close(st);
+
   sfree(st->name);
   sfree(st->host);
   sfree(st->socket);
@@ -123,29 +169,19 @@ static int memcached_connect_unix(memcached_t *st) {
   return fd;
 } /* int memcached_connect_unix */
 
-static int memcached_connect_inet(memcached_t *st) {
-  struct addrinfo *ai_list;
-  int fd = -1;
+/* memcached_connect_next starts a non-blocking connect(2) to the next address
+ * returned by getaddrinfo(3). Returns zero if a connection attempt is in
+ * progress and -1 if all addresses have been tried. */
+static int memcached_connect_next(memcached_t *st) {
+  while (st->ai_next != NULL) {
+    struct addrinfo *ai_ptr = st->ai_next;
+    st->ai_next = ai_ptr->ai_next;
 
-  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
-                              .ai_flags = AI_ADDRCONFIG,
-                              .ai_socktype = SOCK_STREAM};
-
-  int status = getaddrinfo(st->connhost, st->connport, &ai_hints, &ai_list);
-  if (status != 0) {
-    ERROR("memcached plugin: memcached_connect_inet: "
-          "getaddrinfo(%s,%s) failed: %s",
-          st->connhost, st->connport,
-          (status == EAI_SYSTEM) ? STRERRNO : gai_strerror(status));
-    return -1;
-  }
-
-  for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
-       ai_ptr = ai_ptr->ai_next) {
     /* create our socket descriptor */
-    fd = socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+    int fd =
+        socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
     if (fd < 0) {
-      WARNING("memcached plugin: memcached_connect_inet: "
+      WARNING("memcached plugin: memcached_connect_next: "
               "socket(2) failed: %s",
               STRERRNO);
       continue;
@@ -153,10 +189,9 @@ static int memcached_connect_inet(memcached_t *st) {
 
     /* switch socket to non-blocking mode */
     int flags = fcntl(fd, F_GETFL);
-    status = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int status = fcntl(fd, F_SETFL, flags | O_NONBLOCK);
     if (status != 0) {
       close(fd);
-      fd = -1;
       continue;
     }
 
@@ -165,162 +200,179 @@ static int memcached_connect_inet(memcached_t *st) {
     if (status != 0 && errno != EINPROGRESS) {
       shutdown(fd, SHUT_RDWR);
       close(fd);
-      fd = -1;
-      continue;
-    }
-
-    /* Wait until connection establishes */
-    struct pollfd pollfd = {
-        .fd = fd,
-        .events = POLLOUT,
-    };
-    do
-      status = poll(&pollfd, 1, MEMCACHED_CONNECT_TIMEOUT);
-    while (status < 0 && errno == EINTR);
-    if (status <= 0) {
-      close(fd);
-      fd = -1;
       continue;
     }
 
-    /* Check if all is good */
-    int socket_error;
-    status = getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *)&socket_error,
-                        &(socklen_t){sizeof(socket_error)});
-    if (status != 0 || socket_error != 0) {
-      close(fd);
-      fd = -1;
-      continue;
-    }
-    /* A socket is opened and connection succeeded. We're done. */
-    break;
+    st->fd = fd;
+    st->state = MC_CONNECTING;
+    return 0;
   }
 
-  freeaddrinfo(ai_list);
-  return fd;
-} /* int memcached_connect_inet */
+  freeaddrinfo(st->ai_list);
+  st->ai_list = NULL;
+  return -1;
+} /* int memcached_connect_next */
 
-static void memcached_connect(memcached_t *st) {
-  if (st->fd >= 0)
-    return;
+static void memcached_connected(memcached_t *st) {
+  if (st->ai_list != NULL) {
+    freeaddrinfo(st->ai_list);
+    st->ai_list = NULL;
+    st->ai_next = NULL;
+  }
 
-  if (st->socket != NULL)
-    st->fd = memcached_connect_unix(st);
-  else
-    st->fd = memcached_connect_inet(st);
+  INFO("memcached plugin: Instance \"%s\": connection established.", st->name);
 
-  if (st->fd >= 0)
-    INFO("memcached plugin: Instance \"%s\": connection established.",
-         st->name);
+  st->state = MC_WRITING;
+  st->deadline = cdtime() + MS_TO_CDTIME_T(MEMCACHED_IO_TIMEOUT);
 }
 
-static int memcached_query_daemon(char *buffer, size_t buffer_size,
-                                  memcached_t *st) {
-  int status;
-  size_t buffer_fill;
+/* memcached_connect starts to establish a new connection. Returns zero on
+ * success, in which case "state" is either MC_CONNECTING or MC_WRITING. */
+static int memcached_connect(memcached_t *st) {
+  memcached_close(st);
 
-  memcached_connect(st);
-  if (st->fd < 0) {
-    ERROR("memcached plugin: Instance \"%s\" could not connect to daemon.",
-          st->name);
+  if (st->socket != NULL) {
+    st->fd = memcached_connect_unix(st);
+    if (st->fd < 0)
+      return -1;
+    memcached_connected(st);
+    return 0;
+  }
+
+  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
+                              .ai_flags = AI_ADDRCONFIG,
+                              .ai_socktype = SOCK_STREAM};
+
+  int status =
+      getaddrinfo(st->connhost, st->connport, &ai_hints, &st->ai_list);
+  if (status != 0) {
+    ERROR("memcached plugin: memcached_connect: "
+          "getaddrinfo(%s,%s) failed: %s",
+          st->connhost, st->connport,
+          (status == EAI_SYSTEM) ? STRERRNO : gai_strerror(status));
+    st->ai_list = NULL;
     return -1;
   }
 
-  struct pollfd pollfd = {
-      .fd = st->fd,
-      .events = POLLOUT,
-  };
+  st->ai_next = st->ai_list;
+  st->deadline = cdtime() + MS_TO_CDTIME_T(MEMCACHED_CONNECT_TIMEOUT);
+  return memcached_connect_next(st);
+} /* int memcached_connect */
 
-  do
-    status = poll(&pollfd, 1, MEMCACHED_IO_TIMEOUT);
-  while (status < 0 && errno == EINTR);
+/* memcached_query_start prepares an instance for the current read, either
+ * reusing its open connection or starting to establish a new one. */
+static void memcached_query_start(memcached_t *st) {
+  st->sent = 0;
+  st->buffer_fill = 0;
 
-  if (status <= 0) {
-    ERROR("memcached plugin: poll() failed for write() call.");
-    close(st->fd);
-    st->fd = -1;
-    return -1;
+  if (st->fd >= 0) {
+    st->reused = true;
+    st->state = MC_WRITING;
+    st->deadline = cdtime() + MS_TO_CDTIME_T(MEMCACHED_IO_TIMEOUT);
+    return;
   }
 
-  status = (int)swrite(st->fd, "stats\r\n", strlen("stats\r\n"));
-  if (status != 0) {
-    ERROR("memcached plugin: Instance \"%s\": write(2) failed: %s", st->name,
-          STRERRNO);
-    shutdown(st->fd, SHUT_RDWR);
-    close(st->fd);
-    st->fd = -1;
-    return -1;
+  if (memcached_connect(st) != 0) {
+    ERROR("memcached plugin: Instance \"%s\" could not connect to daemon.",
+          st->name);
+    st->state = MC_FAILED;
   }
+}
 
-  /* receive data from the memcached daemon */
-  memset(buffer, 0, buffer_size);
+/* memcached_io_error closes the connection after an error. If the connection
+ * was kept open from a previous read and nothing has been received yet, the
+ * server most likely closed the idle connection. In that case, a new
+ * connection is established and the query is retried once. */
+static void memcached_io_error(memcached_t *st, char const *msg) {
+  bool retry = st->reused && (st->buffer_fill == 0);
+
+  memcached_close(st);
+  if (retry) {
+    DEBUG("memcached plugin: Instance \"%s\": %s; reconnecting.", st->name,
+          msg);
+    st->sent = 0;
+    if (memcached_connect(st) == 0)
+      return;
+  }
 
-  buffer_fill = 0;
-  pollfd.events = POLLIN;
-  while (1) {
-    do
-      status = poll(&pollfd, 1, MEMCACHED_IO_TIMEOUT);
-    while (status < 0 && errno == EINTR);
+  ERROR("memcached plugin: Instance \"%s\": %s", st->name, msg);
+  st->state = MC_FAILED;
+}
 
-    if (status <= 0) {
-      ERROR("memcached plugin: Instance \"%s\": Timeout reading from socket",
-            st->name);
-      close(st->fd);
-      st->fd = -1;
-      return -1;
-    }
+static void memcached_handle_connect(memcached_t *st) {
+  int socket_error = 0;
+  int status = getsockopt(st->fd, SOL_SOCKET, SO_ERROR, (void *)&socket_error,
+                          &(socklen_t){sizeof(socket_error)});
+  if (status == 0 && socket_error == 0) {
+    memcached_connected(st);
+    return;
+  }
 
-    do
-      status = (int)recv(st->fd, buffer + buffer_fill,
-                         buffer_size - buffer_fill, /* flags = */ 0);
-    while (status < 0 && errno == EINTR);
+  /* Try the next address, if any. */
+  close(st->fd);
+  st->fd = -1;
+  if (memcached_connect_next(st) == 0)
+    return;
 
-    char const end_token[5] = {'E', 'N', 'D', '\r', '\n'};
-    if (status < 0) {
+  ERROR("memcached plugin: Instance \"%s\" could not connect to daemon: %s",
+        st->name, STRERROR((status != 0) ? errno : socket_error));
+  st->state = MC_FAILED;
+}
 
-      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
-        continue;
+static void memcached_handle_write(memcached_t *st) {
+  ssize_t status = send(st->fd, stats_command + st->sent,
+                        strlen(stats_command) - st->sent, MSG_NOSIGNAL);
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return;
+    memcached_io_error(st, "send(2) failed");
+    return;
+  }
 
-      ERROR("memcached plugin: Instance \"%s\": Error reading from socket: %s",
-            st->name, STRERRNO);
-      shutdown(st->fd, SHUT_RDWR);
-      close(st->fd);
-      st->fd = -1;
-      return -1;
-    } else if (status == 0) {
-      ERROR("memcached plugin: Instance \"%s\": Connection closed by peer",
-            st->name);
-      close(st->fd);
-      st->fd = -1;
-      return -1;
-    }
+  st->sent += (size_t)status;
+  if (st->sent < strlen(stats_command))
+    return;
 
-    buffer_fill += (size_t)status;
-    if (buffer_fill > buffer_size) {
-      buffer_fill = buffer_size;
-      WARNING("memcached plugin: Instance \"%s\": Message was truncated.",
-              st->name);
-      shutdown(st->fd, SHUT_RDWR);
-      close(st->fd);
-      st->fd = -1;
-      break;
-    }
+  st->state = MC_READING;
+  st->deadline = cdtime() + MS_TO_CDTIME_T(MEMCACHED_IO_TIMEOUT);
+}
 
-    /* If buffer ends in end_token, we have all the data. */
-    if (memcmp(buffer + buffer_fill - sizeof(end_token), end_token,
-               sizeof(end_token)) == 0)
-      break;
-  } /* while (recv) */
+static void memcached_handle_read(memcached_t *st) {
+  char const end_token[5] = {'E', 'N', 'D', '\r', '\n'};
 
-  status = 0;
-  if (buffer_fill == 0) {
-    WARNING("memcached plugin: Instance \"%s\": No data returned by memcached.",
-            st->name);
-    status = -1;
+  ssize_t status = recv(st->fd, st->buffer + st->buffer_fill,
+                        MEMCACHED_BUFFER_SIZE - st->buffer_fill,
+                        /* flags = */ 0);
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return;
+    memcached_io_error(st, "Error reading from socket");
+    return;
+  } else if (status == 0) {
+    memcached_io_error(st, "Connection closed by peer");
+    return;
   }
 
-  return status;
-} /* int memcached_query_daemon */
+  st->buffer_fill += (size_t)status;
+  st->buffer[st->buffer_fill] = 0;
+
+  /* If buffer ends in end_token, we have all the data. */
+  if ((st->buffer_fill >= sizeof(end_token)) &&
+      (memcmp(st->buffer + st->buffer_fill - sizeof(end_token), end_token,
+              sizeof(end_token)) == 0)) {
+    st->state = MC_DONE;
+    return;
+  }
+
+  if (st->buffer_fill == MEMCACHED_BUFFER_SIZE) {
+    WARNING("memcached plugin: Instance \"%s\": Message was truncated.",
+            st->name);
+    /* The rest of the response is still in flight, so the connection can't
+     * be reused. */
+    memcached_close(st);
+    st->state = MC_DONE;
+  }
+}
 
 static void memcached_init_vl(value_list_t *vl, memcached_t const *st) {
   sstrncpy(vl->plugin, "memcached", sizeof(vl->plugin));
@@ -442,36 +494,96 @@ static gauge_t calculate_ratio_percent2(derive_t part1, derive_t part2,
   return 100.0 * (gauge_t)num / (gauge_t)denom;
 }
 
-static int memcached_read(user_data_t *user_data) {
-  char buf[4096];
+/* Values of "stats" which are combined with others before they are
+ * dispatched. */
+enum {
+  MC_STAT_RUSAGE_USER = 0,
+  MC_STAT_RUSAGE_SYSTEM,
+  MC_STAT_THREADS,
+  MC_STAT_BYTES,
+  MC_STAT_LIMIT_MAXBYTES,
+  MC_STAT_CMD_GET,
+  MC_STAT_GET_HITS,
+  MC_STAT_INCR_HITS,
+  MC_STAT_INCR_MISSES,
+  MC_STAT_DECR_HITS,
+  MC_STAT_DECR_MISSES,
+  MC_STAT_BYTES_READ,
+  MC_STAT_BYTES_WRITTEN,
+  MC_STAT_COLLECTED_NUM,
+};
+
+struct memcached_stat_s {
+  const char *name;
+  const char *type; /* NULL if the value is only stored in "collected" */
+  const char *type_instance;
+  int ds_type;
+  int collected; /* -1 if the value isn't needed after dispatching it */
+};
+typedef struct memcached_stat_s memcached_stat_t;
+
+/*
+ * For an explanation on these fields please refer to
+ * <https://github.com/memcached/memcached/blob/master/doc/protocol.txt>
+ *
+ * Sorted by memcached_init(), so that lines can be looked up with bsearch().
+ */
+static memcached_stat_t memcached_stats[] = {
+    /* CPU time consumed by the memcached process */
+    {"rusage_user", NULL, NULL, DS_TYPE_GAUGE, MC_STAT_RUSAGE_USER},
+    {"rusage_system", NULL, NULL, DS_TYPE_GAUGE, MC_STAT_RUSAGE_SYSTEM},
+    /* Number of threads of this instance */
+    {"threads", NULL, NULL, DS_TYPE_GAUGE, MC_STAT_THREADS},
+    /* Number of items stored */
+    {"curr_items", "memcached_items", "current", DS_TYPE_GAUGE, -1},
+    /* Number of secs since the server started */
+    {"uptime", "uptime", NULL, DS_TYPE_GAUGE, -1},
+    /* Number of bytes used and available (total - used) */
+    {"bytes", NULL, NULL, DS_TYPE_GAUGE, MC_STAT_BYTES},
+    {"limit_maxbytes", NULL, NULL, DS_TYPE_GAUGE, MC_STAT_LIMIT_MAXBYTES},
+    /* Connections. The total number of connections opened since the server
+     * started running is reported as connection rate. */
+    {"curr_connections", "memcached_connections", "current", DS_TYPE_GAUGE,
+     -1},
+    {"listen_disabled_num", "total_events", "listen_disabled", DS_TYPE_DERIVE,
+     -1},
+    {"total_connections", "connections", "opened", DS_TYPE_DERIVE, -1},
+    /* Increment/Decrement */
+    {"incr_misses", "memcached_ops", "incr_misses", DS_TYPE_DERIVE,
+     MC_STAT_INCR_MISSES},
+    {"incr_hits", "memcached_ops", "incr_hits", DS_TYPE_DERIVE,
+     MC_STAT_INCR_HITS},
+    {"decr_misses", "memcached_ops", "decr_misses", DS_TYPE_DERIVE,
+     MC_STAT_DECR_MISSES},
+    {"decr_hits", "memcached_ops", "decr_hits", DS_TYPE_DERIVE,
+     MC_STAT_DECR_HITS},
+    /* Operations on the cache: get hits/misses, delete hits/misses and
+     * evictions */
+    {"get_hits", "memcached_ops", "hits", DS_TYPE_DERIVE, MC_STAT_GET_HITS},
+    {"get_misses", "memcached_ops", "misses", DS_TYPE_DERIVE, -1},
+    {"evictions", "memcached_ops", "evictions", DS_TYPE_DERIVE, -1},
+    {"delete_hits", "memcached_ops", "delete_hits", DS_TYPE_DERIVE, -1},
+    {"delete_misses", "memcached_ops", "delete_misses", DS_TYPE_DERIVE, -1},
+    /* Network traffic */
+    {"bytes_read", NULL, NULL, DS_TYPE_DERIVE, MC_STAT_BYTES_READ},
+    {"bytes_written", NULL, NULL, DS_TYPE_DERIVE, MC_STAT_BYTES_WRITTEN},
+};
+
+static int memcached_stat_compare(const void *a, const void *b) {
+  return strcmp(((const memcached_stat_t *)a)->name,
+                ((const memcached_stat_t *)b)->name);
+} /* int memcached_stat_compare */
+
+static void memcached_submit_stats(memcached_t *st) {
   char *fields[3];
   char *line;
 
-  derive_t bytes_used = 0;
-  derive_t bytes_total = 0;
-  derive_t get_hits = 0;
-  derive_t cmd_get = 0;
-  derive_t incr_hits = 0;
-  derive_t incr_misses = 0;
-  derive_t decr_hits = 0;
-  derive_t decr_misses = 0;
-  derive_t rusage_user = 0;
-  derive_t rusage_syst = 0;
-  derive_t octets_rx = 0;
-  derive_t octets_tx = 0;
-
-  memcached_t *st = user_data->data;
-  prev_t *prev = &st->prev;
-
-  /* get data from daemon */
-  if (memcached_query_daemon(buf, sizeof(buf), st) < 0) {
-    return -1;
-  }
+  gauge_t collected[MC_STAT_COLLECTED_NUM] = {0};
+  bool have[MC_STAT_COLLECTED_NUM] = {false};
 
-#define FIELD_IS(cnst)                                                         \
-  (((sizeof(cnst) - 1) == name_len) && (strcmp(cnst, fields[1]) == 0))
+  prev_t *prev = &st->prev;
 
-  char *ptr = buf;
+  char *ptr = st->buffer;
   char *saveptr = NULL;
   while ((line = strtok_r(ptr, "\n\r", &saveptr)) != NULL) {
     ptr = NULL;
@@ -479,142 +591,72 @@ static int memcached_read(user_data_t *user_data) {
     if (strsplit(line, fields, 3) != 3)
       continue;
 
-    size_t name_len = strlen(fields[1]);
-    if (name_len == 0)
+    char const *name = fields[1];
+    if (name[0] == 0)
       continue;
 
-    /*
-     * For an explanation on these fields please refer to
-     * <https://github.com/memcached/memcached/blob/master/doc/protocol.txt>
-     */
-
-    /*
-     * CPU time consumed by the memcached process
-     */
-    if (FIELD_IS("rusage_user")) {
-      /* Convert to useconds */
-      rusage_user = atof(fields[2]) * 1000000;
-    } else if (FIELD_IS("rusage_system")) {
-      rusage_syst = atof(fields[2]) * 1000000;
-    }
-
-    /*
-     * Number of threads of this instance
-     */
-    else if (FIELD_IS("threads")) {
-      submit_gauge2("ps_count", NULL, NAN, atof(fields[2]), st);
-    }
-
-    /*
-     * Number of items stored
-     */
-    else if (FIELD_IS("curr_items")) {
-      submit_gauge("memcached_items", "current", atof(fields[2]), st);
-    }
-
-    /*
-     * Number of secs since the server started
-     */
-    else if (FIELD_IS("uptime")) {
-      submit_gauge("uptime", NULL, atof(fields[2]), st);
-    }
-
-    /*
-     * Number of bytes used and available (total - used)
-     */
-    else if (FIELD_IS("bytes")) {
-      bytes_used = atoll(fields[2]);
-    } else if (FIELD_IS("limit_maxbytes")) {
-      bytes_total = atoll(fields[2]);
-    }
-
-    /*
-     * Connections
-     */
-    else if (FIELD_IS("curr_connections")) {
-      submit_gauge("memcached_connections", "current", atof(fields[2]), st);
-    } else if (FIELD_IS("listen_disabled_num")) {
-      submit_derive("total_events", "listen_disabled", atoll(fields[2]), st);
-    }
-    /*
-     * Total number of connections opened since the server started running
-     * Report this as connection rate.
-     */
-    else if (FIELD_IS("total_connections")) {
-      submit_derive("connections", "opened", atoll(fields[2]), st);
+    /* Commands */
+    if ((strncmp(name, "cmd_", 4) == 0) && (name[4] != 0)) {
+      derive_t value = atoll(fields[2]);
+      submit_derive("memcached_command", name + 4, value, st);
+      if (strcmp(name + 4, "get") == 0) {
+        collected[MC_STAT_CMD_GET] = (gauge_t)value;
+        have[MC_STAT_CMD_GET] = true;
+      }
+      continue;
     }
 
-    /*
-     * Commands
-     */
-    else if ((name_len > 4) && (strncmp(fields[1], "cmd_", 4) == 0)) {
-      const char *name = fields[1] + 4;
-      submit_derive("memcached_command", name, atoll(fields[2]), st);
-      if (strcmp(name, "get") == 0)
-        cmd_get = atoll(fields[2]);
-    }
+    memcached_stat_t *m = bsearch(
+        &(memcached_stat_t){.name = name}, memcached_stats,
+        STATIC_ARRAY_SIZE(memcached_stats), sizeof(memcached_stats[0]),
+        memcached_stat_compare);
+    if (m == NULL)
+      continue;
 
-    /*
-     * Increment/Decrement
-     */
-    else if (FIELD_IS("incr_misses")) {
-      incr_misses = atoll(fields[2]);
-      submit_derive("memcached_ops", "incr_misses", incr_misses, st);
-    } else if (FIELD_IS("incr_hits")) {
-      incr_hits = atoll(fields[2]);
-      submit_derive("memcached_ops", "incr_hits", incr_hits, st);
-    } else if (FIELD_IS("decr_misses")) {
-      decr_misses = atoll(fields[2]);
-      submit_derive("memcached_ops", "decr_misses", decr_misses, st);
-    } else if (FIELD_IS("decr_hits")) {
-      decr_hits = atoll(fields[2]);
-      submit_derive("memcached_ops", "decr_hits", decr_hits, st);
+    if (m->collected >= 0) {
+      collected[m->collected] = atof(fields[2]);
+      have[m->collected] = true;
     }
 
-    /*
-     * Operations on the cache:
-     * - get hits/misses
-     * - delete hits/misses
-     * - evictions
-     */
-    else if (FIELD_IS("get_hits")) {
-      get_hits = atoll(fields[2]);
-      submit_derive("memcached_ops", "hits", get_hits, st);
-    } else if (FIELD_IS("get_misses")) {
-      submit_derive("memcached_ops", "misses", atoll(fields[2]), st);
-    } else if (FIELD_IS("evictions")) {
-      submit_derive("memcached_ops", "evictions", atoll(fields[2]), st);
-    } else if (FIELD_IS("delete_hits")) {
-      submit_derive("memcached_ops", "delete_hits", atoll(fields[2]), st);
-    } else if (FIELD_IS("delete_misses")) {
-      submit_derive("memcached_ops", "delete_misses", atoll(fields[2]), st);
-    }
+    if (m->type == NULL)
+      continue;
 
-    /*
-     * Network traffic
-     */
-    else if (FIELD_IS("bytes_read")) {
-      octets_rx = atoll(fields[2]);
-    } else if (FIELD_IS("bytes_written")) {
-      octets_tx = atoll(fields[2]);
-    }
+    if (m->ds_type == DS_TYPE_GAUGE)
+      submit_gauge(m->type, m->type_instance, atof(fields[2]), st);
+    else
+      submit_derive(m->type, m->type_instance, atoll(fields[2]), st);
   } /* while ((line = strtok_r (ptr, "\n\r", &saveptr)) != NULL) */
 
+  if (have[MC_STAT_THREADS])
+    submit_gauge2("ps_count", NULL, NAN, collected[MC_STAT_THREADS], st);
+
+  derive_t bytes_used = (derive_t)collected[MC_STAT_BYTES];
+  derive_t bytes_total = (derive_t)collected[MC_STAT_LIMIT_MAXBYTES];
   if ((bytes_total > 0) && (bytes_used <= bytes_total))
     submit_gauge2("df", "cache", bytes_used, bytes_total - bytes_used, st);
 
+  /* Convert to useconds */
+  derive_t rusage_user = (derive_t)(collected[MC_STAT_RUSAGE_USER] * 1000000);
+  derive_t rusage_syst =
+      (derive_t)(collected[MC_STAT_RUSAGE_SYSTEM] * 1000000);
   if ((rusage_user != 0) || (rusage_syst != 0))
     submit_derive2("ps_cputime", NULL, rusage_user, rusage_syst, st);
 
+  derive_t octets_rx = (derive_t)collected[MC_STAT_BYTES_READ];
+  derive_t octets_tx = (derive_t)collected[MC_STAT_BYTES_WRITTEN];
   if ((octets_rx != 0) || (octets_tx != 0))
     submit_derive2("memcached_octets", NULL, octets_rx, octets_tx, st);
 
+  derive_t cmd_get = (derive_t)collected[MC_STAT_CMD_GET];
+  derive_t get_hits = (derive_t)collected[MC_STAT_GET_HITS];
   if ((cmd_get != 0) && (get_hits != 0)) {
     gauge_t ratio =
         calculate_ratio_percent(get_hits, cmd_get, &prev->hits, &prev->gets);
     submit_gauge("percent", "hitratio", ratio, st);
   }
 
+  derive_t incr_hits = (derive_t)collected[MC_STAT_INCR_HITS];
+  derive_t incr_misses = (derive_t)collected[MC_STAT_INCR_MISSES];
   if ((incr_hits != 0) && (incr_misses != 0)) {
     gauge_t ratio = calculate_ratio_percent2(
         incr_hits, incr_misses, &prev->incr_hits, &prev->incr_misses);
@@ -622,14 +664,95 @@ static int memcached_read(user_data_t *user_data) {
     submit_derive("memcached_ops", "incr", incr_hits + incr_misses, st);
   }
 
+  derive_t decr_hits = (derive_t)collected[MC_STAT_DECR_HITS];
+  derive_t decr_misses = (derive_t)collected[MC_STAT_DECR_MISSES];
   if ((decr_hits != 0) && (decr_misses != 0)) {
     gauge_t ratio = calculate_ratio_percent2(
         decr_hits, decr_misses, &prev->decr_hits, &prev->decr_misses);
     submit_gauge("percent", "decr_hitratio", ratio, st);
     submit_derive("memcached_ops", "decr", decr_hits + decr_misses, st);
   }
+} /* void memcached_submit_stats */
 
-  return 0;
+static bool memcached_is_active(memcached_t const *st) {
+  return (st->state == MC_CONNECTING) || (st->state == MC_WRITING) ||
+         (st->state == MC_READING);
+}
+
+static int memcached_read(void) {
+  for (size_t i = 0; i < instances_num; i++)
+    memcached_query_start(instances[i]);
+
+  while (1) {
+    cdtime_t now = cdtime();
+    cdtime_t timeout = 0;
+    nfds_t pollfds_num = 0;
+
+    for (size_t i = 0; i < instances_num; i++) {
+      memcached_t *st = instances[i];
+      if (!memcached_is_active(st))
+        continue;
+
+      if (st->deadline <= now) {
+        ERROR("memcached plugin: Instance \"%s\": Timeout %s socket",
+              st->name,
+              (st->state == MC_READING) ? "reading from" : "writing to");
+        memcached_close(st);
+        st->state = MC_FAILED;
+        continue;
+      }
+
+      if ((timeout == 0) || ((st->deadline - now) < timeout))
+        timeout = st->deadline - now;
+
+      pollfds[pollfds_num] = (struct pollfd){
+          .fd = st->fd,
+          .events = (st->state == MC_READING) ? POLLIN : POLLOUT,
+      };
+      pollfds_instance[pollfds_num] = st;
+      pollfds_num++;
+    }
+
+    if (pollfds_num == 0)
+      break;
+
+    int status = poll(pollfds, pollfds_num, (int)CDTIME_T_TO_MS(timeout) + 1);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("memcached plugin: poll(2) failed: %s", STRERRNO);
+      for (nfds_t i = 0; i < pollfds_num; i++) {
+        memcached_close(pollfds_instance[i]);
+        pollfds_instance[i]->state = MC_FAILED;
+      }
+      break;
+    }
+
+    for (nfds_t i = 0; i < pollfds_num; i++) {
+      memcached_t *st = pollfds_instance[i];
+      if (pollfds[i].revents == 0)
+        continue;
+
+      if (st->state == MC_CONNECTING)
+        memcached_handle_connect(st);
+      else if (st->state == MC_WRITING)
+        memcached_handle_write(st);
+      else if (st->state == MC_READING)
+        memcached_handle_read(st);
+    }
+  } /* while (1) */
+
+  size_t success = 0;
+  for (size_t i = 0; i < instances_num; i++) {
+    memcached_t *st = instances[i];
+    if (st->state == MC_DONE) {
+      memcached_submit_stats(st);
+      success++;
+    }
+    st->state = MC_IDLE;
+  }
+
+  return (success > 0) ? 0 : -1;
 } /* int memcached_read */
 
 static int memcached_set_defaults(memcached_t *st) {
@@ -679,27 +802,25 @@ static int memcached_set_defaults(memcached_t *st) {
   return 0;
 } /* int memcached_set_defaults */
 
-static int memcached_add_read_callback(memcached_t *st) {
-  char callback_name[3 * DATA_MAX_NAME_LEN];
-
+static int memcached_add_instance(memcached_t *st) {
   if (memcached_set_defaults(st) != 0) {
     memcached_free(st);
     return -1;
   }
 
-  snprintf(callback_name, sizeof(callback_name), "memcached/%s",
-           (st->name != NULL) ? st->name : "__legacy__");
+  memcached_t **tmp =
+      realloc(instances, (instances_num + 1) * sizeof(*instances));
+  if (tmp == NULL) {
+    ERROR("memcached plugin: realloc failed.");
+    memcached_free(st);
+    return ENOMEM;
+  }
+  instances = tmp;
+  instances[instances_num] = st;
+  instances_num++;
 
-  return plugin_register_complex_read(
-      /* group = */ "memcached",
-      /* name      = */ callback_name,
-      /* callback  = */ memcached_read,
-      /* interval  = */ 0,
-      &(user_data_t){
-          .data = st,
-          .free_func = memcached_free,
-      });
-} /* int memcached_add_read_callback */
+  return 0;
+} /* int memcached_add_instance */
 
 /* Configuration handling functiions
  * <Plugin memcached>
@@ -763,7 +884,7 @@ static int config_add_instance(oconfig_item_t *ci) {
     return -1;
   }
 
-  return memcached_add_read_callback(st);
+  return memcached_add_instance(st);
 } /* int config_add_instance */
 
 static int memcached_config(oconfig_item_t *ci) {
@@ -791,30 +912,57 @@ static int memcached_config(oconfig_item_t *ci) {
 } /* int memcached_config */
 
 static int memcached_init(void) {
+  qsort(memcached_stats, STATIC_ARRAY_SIZE(memcached_stats),
+        sizeof(memcached_stats[0]), memcached_stat_compare);
+
+  if (!memcached_have_instances) {
+    /* No instances were configured, lets start a default instance. */
+    memcached_t *st = calloc(1, sizeof(*st));
+    if (st == NULL)
+      return ENOMEM;
+    st->name = NULL;
+    st->host = NULL;
+    st->socket = NULL;
+    st->connhost = NULL;
+    st->connport = NULL;
+
+    st->fd = -1;
+
+    int status = memcached_add_instance(st);
+    if (status != 0)
+      return status;
+    memcached_have_instances = true;
+  }
 
-  if (memcached_have_instances)
+  if (instances_num == 0)
     return 0;
 
-  /* No instances were configured, lets start a default instance. */
-  memcached_t *st = calloc(1, sizeof(*st));
-  if (st == NULL)
+  pollfds = calloc(instances_num, sizeof(*pollfds));
+  pollfds_instance = calloc(instances_num, sizeof(*pollfds_instance));
+  if ((pollfds == NULL) || (pollfds_instance == NULL)) {
+    ERROR("memcached plugin: calloc failed.");
+    sfree(pollfds);
+    sfree(pollfds_instance);
     return ENOMEM;
-  st->name = NULL;
-  st->host = NULL;
-  st->socket = NULL;
-  st->connhost = NULL;
-  st->connport = NULL;
+  }
 
-  st->fd = -1;
+  return plugin_register_read("memcached", memcached_read);
+} /* int memcached_init */
 
-  int status = memcached_add_read_callback(st);
-  if (status == 0)
-    memcached_have_instances = true;
+static int memcached_shutdown(void) {
+  for (size_t i = 0; i < instances_num; i++)
+    memcached_free(instances[i]);
+  sfree(instances);
+  instances_num = 0;
 
-  return status;
-} /* int memcached_init */
+  sfree(pollfds);
+  sfree(pollfds_instance);
+
+  return 0;
+} /* int memcached_shutdown */
 
 void module_register(void) {
   plugin_register_complex_config("memcached", memcached_config);
   plugin_register_init("memcached", memcached_init);
+  plugin_register_shutdown("memcached", memcached_shutdown);
 }
@@ -78,7 +78,7 @@ static int pagesize;
 /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
-/* no global variables */
+static proc_file_t *proc_meminfo;
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKSTAT
@@ -320,8 +320,7 @@ static int memory_read_internal(value_list_t *vl) {
   /* #endif HAVE_SYSCTLBYNAME */
 
 #elif KERNEL_LINUX
-  FILE *fh;
-  char buffer[1024];
+  char *buffer;
 
   char *fields[8];
   int numfields;
@@ -339,12 +338,18 @@ static int memory_read_internal(value_list_t *vl) {
   gauge_t mem_slab_reclaimable = 0;
   gauge_t mem_slab_unreclaimable = 0;
 
-  if ((fh = fopen("/proc/meminfo", "r")) == NULL) {
-    WARNING("memory: fopen: %s", STRERRNO);
-    return -1;
+  if (proc_meminfo == NULL) {
+    proc_meminfo = proc_file_create("/proc/meminfo");
+    if (proc_meminfo == NULL) {
+      WARNING("memory: proc_file_create failed.");
+      return -1;
+    }
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  if (proc_file_read(proc_meminfo, NULL) == NULL)
+    return -1;
+
+  while ((buffer = proc_file_next_line(proc_meminfo)) != NULL) {
     gauge_t *val = NULL;
 
     if (strncasecmp(buffer, "MemTotal:", 9) == 0)
@@ -376,10 +381,6 @@ static int memory_read_internal(value_list_t *vl) {
     *val = 1024.0 * atof(fields[1]);
   }
 
-  if (fclose(fh)) {
-    WARNING("memory: fclose: %s", STRERRNO);
-  }
-
   if (mem_total < (mem_free + mem_buffered + mem_cached + mem_slab_total))
     return -1;
 
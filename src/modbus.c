@@ -45,6 +45,12 @@
 #endif
 #endif
 
+/* Maximum number of registers in one "read registers" request, limited by
+ * the size of the Modbus PDU. */
+#ifndef MODBUS_MAX_READ_REGISTERS
+#define MODBUS_MAX_READ_REGISTERS 125
+#endif
+
 /*
  * <Data "data_name">
  *   RegisterBase 1234
@@ -62,6 +68,7 @@
  *   # Baudrate 38400
  *   # (Assumes 8N1)
  *   Interval 60
+ *   MaxRegisterGap 0
  *
  *   <Slave 1>
  *     Instance "foobar" # optional
@@ -121,11 +128,28 @@ struct mb_data_s /* {{{ */
   mb_data_t *next;
 }; /* }}} */
 
+/* A block is a range of registers that is read with a single request. It
+ * holds all the data of a slave located within that range. */
+struct mb_block_s /* {{{ */
+{
+  mb_mreg_type_t modbus_register_type;
+  int start;
+  int count;
+
+  mb_data_t **data;
+  size_t data_num;
+}; /* }}} */
+typedef struct mb_block_s mb_block_t;
+
 struct mb_slave_s /* {{{ */
 {
   int id;
   char instance[DATA_MAX_NAME_LEN];
   mb_data_t *collect;
+
+  mb_block_t *blocks;
+  size_t blocks_num;
+  mb_data_t **blocks_data; /* collect, sorted by register */
 }; /* }}} */
 typedef struct mb_slave_s mb_slave_t;
 
@@ -138,6 +162,7 @@ struct mb_host_s /* {{{ */
   int baudrate;           /* for Modbus/RTU */
   mb_uarttype_t uarttype; /* UART type for Modbus/RTU */
   mb_conntype_t conntype;
+  int max_register_gap;
 
   mb_slave_t *slaves;
   size_t slaves_num;
@@ -151,16 +176,6 @@ struct mb_host_s /* {{{ */
 }; /* }}} */
 typedef struct mb_host_s mb_host_t;
 
-struct mb_data_group_s;
-typedef struct mb_data_group_s mb_data_group_t;
-struct mb_data_group_s /* {{{ */
-{
-  mb_data_t *registers;
-  size_t registers_num;
-
-  mb_data_group_t *next;
-}; /* }}} */
-
 /*
  * Global variables
  */
@@ -460,15 +475,77 @@ static int mb_init_connection(mb_host_t *host) /* {{{ */
       (vt).absolute = (((absolute_t)(raw)*scale) + shift);                     \
   } while (0)
 
-static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
-                        mb_data_t *data) {
-  uint16_t values[4] = {0};
-  int values_num;
-  const data_set_t *ds;
+static int mb_register_count(mb_register_type_t register_type) /* {{{ */
+{
+  switch (register_type) {
+  case REG_TYPE_INT32:
+  case REG_TYPE_INT32_CDAB:
+  case REG_TYPE_UINT32:
+  case REG_TYPE_UINT32_CDAB:
+  case REG_TYPE_FLOAT:
+  case REG_TYPE_FLOAT_CDAB:
+    return 2;
+  case REG_TYPE_INT64:
+  case REG_TYPE_UINT64:
+  case REG_TYPE_DOUBLE:
+    return 4;
+  default:
+    return 1;
+  }
+} /* }}} int mb_register_count */
+
+static void mb_close_connection(mb_host_t *host) /* {{{ */
+{
+#if LEGACY_LIBMODBUS
+  modbus_close(&host->connection);
+#else
+  if (host->connection != NULL) {
+    modbus_close(host->connection);
+    modbus_free(host->connection);
+  }
+  host->connection = NULL;
+#endif
+  host->is_connected = false;
+} /* }}} void mb_close_connection */
+
+static int mb_check_connection(mb_host_t *host) /* {{{ */
+{
   int status = 0;
 
-  if ((host == NULL) || (slave == NULL) || (data == NULL))
-    return EINVAL;
+  if (host->connection == NULL) {
+    status = EBADF;
+  } else if (host->conntype == MBCONN_TCP) {
+    /* getpeername() is used only to determine if the socket is connected, not
+     * because we're really interested in the peer's IP address. */
+    if (getpeername(modbus_get_socket(host->connection),
+                    (void *)&(struct sockaddr_storage){0},
+                    &(socklen_t){sizeof(struct sockaddr_storage)}) != 0)
+      status = errno;
+  }
+
+  if (status == 0)
+    return 0;
+
+  if ((status != EBADF) && (status != ENOTSOCK) && (status != ENOTCONN))
+    mb_close_connection(host);
+
+  status = mb_init_connection(host);
+  if (status != 0) {
+    ERROR("Modbus plugin: mb_init_connection (%s/%s) failed. ", host->host,
+          host->node);
+    host->is_connected = false;
+    host->connection = NULL;
+    return -1;
+  }
+
+  return 0;
+} /* }}} int mb_check_connection */
+
+/* mb_decode_data converts the registers starting at "values" to the type
+ * described by "data" and dispatches the result. */
+static int mb_decode_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
+                          mb_data_t *data, uint16_t const *values) {
+  const data_set_t *ds;
 
   ds = plugin_get_ds(data->type);
   if (ds == NULL) {
@@ -497,98 +574,12 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
         data->type, DS_TYPE_TO_STRING(ds->ds[0].type));
   }
 
-  if ((data->register_type == REG_TYPE_INT32) ||
-      (data->register_type == REG_TYPE_INT32_CDAB) ||
-      (data->register_type == REG_TYPE_UINT32) ||
-      (data->register_type == REG_TYPE_UINT32_CDAB) ||
-      (data->register_type == REG_TYPE_FLOAT) ||
-      (data->register_type == REG_TYPE_FLOAT_CDAB))
-    values_num = 2;
-  else if ((data->register_type == REG_TYPE_INT64) ||
-           (data->register_type == REG_TYPE_UINT64) ||
-           (data->register_type == REG_TYPE_DOUBLE))
-    values_num = 4;
-  else
-    values_num = 1;
-
-  if (host->connection == NULL) {
-    status = EBADF;
-  } else if (host->conntype == MBCONN_TCP) {
-    /* getpeername() is used only to determine if the socket is connected, not
-     * because we're really interested in the peer's IP address. */
-    if (getpeername(modbus_get_socket(host->connection),
-                    (void *)&(struct sockaddr_storage){0},
-                    &(socklen_t){sizeof(struct sockaddr_storage)}) != 0)
-      status = errno;
-  }
-
-  if ((status == EBADF) || (status == ENOTSOCK) || (status == ENOTCONN)) {
-    status = mb_init_connection(host);
-    if (status != 0) {
-      ERROR("Modbus plugin: mb_init_connection (%s/%s) failed. ", host->host,
-            host->node);
-      host->is_connected = false;
-      host->connection = NULL;
-      return -1;
-    }
-  } else if (status != 0) {
-#if LEGACY_LIBMODBUS
-    modbus_close(&host->connection);
-#else
-    modbus_close(host->connection);
-    modbus_free(host->connection);
-#endif
-  }
-
-#if LEGACY_LIBMODBUS
-/* Version 2.0.3: Pass the connection struct as a pointer and pass the slave
- * id to each call of "read_holding_registers". */
-#define modbus_read_registers(ctx, addr, nb, dest)                             \
-  read_holding_registers(&(ctx), slave->id, (addr), (nb), (dest))
-#else /* if !LEGACY_LIBMODBUS */
-  /* Version 2.9.2: Set the slave id once before querying the registers. */
-  status = modbus_set_slave(host->connection, slave->id);
-  if (status != 0) {
-    ERROR("Modbus plugin: modbus_set_slave (%i) failed with status %i.",
-          slave->id, status);
-    return -1;
-  }
-#endif
-  if (data->modbus_register_type == MREG_INPUT) {
-    status = modbus_read_input_registers(host->connection,
-                                         /* start_addr = */ data->register_base,
-                                         /* num_registers = */ values_num,
-                                         /* buffer = */ values);
-  } else {
-    status = modbus_read_registers(host->connection,
-                                   /* start_addr = */ data->register_base,
-                                   /* num_registers = */ values_num,
-                                   /* buffer = */ values);
-  }
-  if (status != values_num) {
-    ERROR("Modbus plugin: modbus read function (%s/%s) failed. "
-          " status = %i, start_addr = %i, values_num = %i. Giving up.",
-          host->host, host->node, status, data->register_base, values_num);
-#if LEGACY_LIBMODBUS
-    modbus_close(&host->connection);
-#else
-    modbus_close(host->connection);
-    modbus_free(host->connection);
-#endif
-    host->connection = NULL;
-    return -1;
-  }
-
-  DEBUG("Modbus plugin: mb_read_data: Success! "
-        "modbus_read_registers returned with status %i.",
-        status);
-
   if (data->register_type == REG_TYPE_FLOAT) {
     float float_value;
     value_t vt;
 
     float_value = mb_register_to_float(values[0], values[1]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned float value is %g",
           (double)float_value);
 
@@ -599,7 +590,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     float_value = mb_register_to_float(values[1], values[0]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned float value is %g",
           (double)float_value);
 
@@ -611,7 +602,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
 
     double_value =
         mb_register_to_double(values[0], values[1], values[2], values[3]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned double value is %g",
           double_value);
 
@@ -625,7 +616,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     v.u32 = (((uint32_t)values[0]) << 16) | ((uint32_t)values[1]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned int32 value is %" PRIi32,
           v.i32);
 
@@ -639,7 +630,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     v.u32 = (((uint32_t)values[1]) << 16) | ((uint32_t)values[0]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned int32 value is %" PRIi32,
           v.i32);
 
@@ -654,7 +645,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
 
     v.u16 = values[0];
 
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned int16 value is %" PRIi16,
           v.i16);
 
@@ -665,7 +656,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     v32 = (((uint32_t)values[0]) << 16) | ((uint32_t)values[1]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned uint32 value is %" PRIu32,
           v32);
 
@@ -676,7 +667,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
     value_t vt;
 
     v32 = (((uint32_t)values[1]) << 16) | ((uint32_t)values[0]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned uint32 value is %" PRIu32,
           v32);
 
@@ -688,7 +679,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
 
     v64 = (((uint64_t)values[0]) << 48) | (((uint64_t)values[1]) << 32) |
           (((uint64_t)values[2]) << 16) | (((uint64_t)values[3]));
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned uint64 value is %" PRIu64,
           v64);
 
@@ -703,7 +694,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
 
     v.u64 = (((uint64_t)values[0]) << 48) | (((uint64_t)values[1]) << 32) |
             (((uint64_t)values[2]) << 16) | ((uint64_t)values[3]);
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned uint64 value is %" PRIi64,
           v.i64);
 
@@ -713,7 +704,7 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
   {
     value_t vt;
 
-    DEBUG("Modbus plugin: mb_read_data: "
+    DEBUG("Modbus plugin: mb_decode_data: "
           "Returned uint16 value is %" PRIu16,
           values[0]);
 
@@ -722,7 +713,52 @@ static int mb_read_data(mb_host_t *host, mb_slave_t *slave, /* {{{ */
   }
 
   return 0;
-} /* }}} int mb_read_data */
+} /* }}} int mb_decode_data */
+
+static int mb_read_block(mb_host_t *host, mb_slave_t *slave, /* {{{ */
+                         mb_block_t *block) {
+  uint16_t values[MODBUS_MAX_READ_REGISTERS] = {0};
+  int success = 0;
+  int status;
+
+#if LEGACY_LIBMODBUS
+/* Version 2.0.3: Pass the connection struct as a pointer and pass the slave
+ * id to each call of "read_holding_registers". */
+#define modbus_read_registers(ctx, addr, nb, dest)                             \
+  read_holding_registers(&(ctx), slave->id, (addr), (nb), (dest))
+#endif
+  if (block->modbus_register_type == MREG_INPUT) {
+    status = modbus_read_input_registers(host->connection,
+                                         /* start_addr = */ block->start,
+                                         /* num_registers = */ block->count,
+                                         /* buffer = */ values);
+  } else {
+    status = modbus_read_registers(host->connection,
+                                   /* start_addr = */ block->start,
+                                   /* num_registers = */ block->count,
+                                   /* buffer = */ values);
+  }
+  if (status != block->count) {
+    ERROR("Modbus plugin: modbus read function (%s/%s) failed. "
+          " status = %i, start_addr = %i, values_num = %i. Giving up.",
+          host->host, host->node, status, block->start, block->count);
+    mb_close_connection(host);
+    return -1;
+  }
+
+  DEBUG("Modbus plugin: mb_read_block: Success! "
+        "Read %i registers starting at %i for %" PRIsz " data.",
+        block->count, block->start, block->data_num);
+
+  for (size_t i = 0; i < block->data_num; i++) {
+    mb_data_t *data = block->data[i];
+    if (mb_decode_data(host, slave, data,
+                       values + (data->register_base - block->start)) == 0)
+      success++;
+  }
+
+  return (success > 0) ? 0 : -1;
+} /* }}} int mb_read_block */
 
 static int mb_read_slave(mb_host_t *host, mb_slave_t *slave) /* {{{ */
 {
@@ -733,8 +769,23 @@ static int mb_read_slave(mb_host_t *host, mb_slave_t *slave) /* {{{ */
     return EINVAL;
 
   success = 0;
-  for (mb_data_t *data = slave->collect; data != NULL; data = data->next) {
-    status = mb_read_data(host, slave, data);
+  for (size_t i = 0; i < slave->blocks_num; i++) {
+    /* The connection is closed when a read fails, so check it before each
+     * request. */
+    if (mb_check_connection(host) != 0)
+      break;
+
+#if !LEGACY_LIBMODBUS
+    /* Version 2.9.2: Set the slave id once before querying the registers. */
+    status = modbus_set_slave(host->connection, slave->id);
+    if (status != 0) {
+      ERROR("Modbus plugin: modbus_set_slave (%i) failed with status %i.",
+            slave->id, status);
+      break;
+    }
+#endif
+
+    status = mb_read_block(host, slave, slave->blocks + i);
     if (status == 0)
       success++;
   }
@@ -798,8 +849,11 @@ static void slaves_free_all(mb_slave_t *slaves, size_t slaves_num) /* {{{ */
   if (slaves == NULL)
     return;
 
-  for (size_t i = 0; i < slaves_num; i++)
+  for (size_t i = 0; i < slaves_num; i++) {
+    sfree(slaves[i].blocks);
+    sfree(slaves[i].blocks_data);
     data_free_all(slaves[i].collect);
+  }
   sfree(slaves);
 } /* }}} void slaves_free_all */
 
@@ -1017,6 +1071,83 @@ static int mb_config_add_slave(mb_host_t *host, oconfig_item_t *ci) /* {{{ */
   return status;
 } /* }}} int mb_config_add_slave */
 
+static int mb_data_compare(void const *a, void const *b) /* {{{ */
+{
+  mb_data_t const *d0 = *(mb_data_t * const *)a;
+  mb_data_t const *d1 = *(mb_data_t * const *)b;
+
+  if (d0->modbus_register_type != d1->modbus_register_type)
+    return (d0->modbus_register_type < d1->modbus_register_type) ? -1 : 1;
+  if (d0->register_base != d1->register_base)
+    return (d0->register_base < d1->register_base) ? -1 : 1;
+  return 0;
+} /* }}} int mb_data_compare */
+
+/* mb_slave_build_blocks groups the data collected from a slave into as few
+ * register ranges as possible. Data of the same register type is merged into
+ * one block when the gap between them is at most "max_gap" registers and the
+ * block doesn't exceed the maximum size of a single request. */
+static int mb_slave_build_blocks(mb_slave_t *slave, int max_gap) /* {{{ */
+{
+  size_t data_num = 0;
+  for (mb_data_t *data = slave->collect; data != NULL; data = data->next)
+    data_num++;
+
+  mb_data_t **sorted = calloc(data_num, sizeof(*sorted));
+  slave->blocks = calloc(data_num, sizeof(*slave->blocks));
+  if ((sorted == NULL) || (slave->blocks == NULL)) {
+    sfree(sorted);
+    sfree(slave->blocks);
+    return ENOMEM;
+  }
+
+  size_t i = 0;
+  for (mb_data_t *data = slave->collect; data != NULL; data = data->next)
+    sorted[i++] = data;
+  qsort(sorted, data_num, sizeof(*sorted), mb_data_compare);
+
+  slave->blocks_num = 0;
+  for (i = 0; i < data_num; i++) {
+    mb_data_t *data = sorted[i];
+    int end = data->register_base + mb_register_count(data->register_type);
+    mb_block_t *block = NULL;
+
+    if (slave->blocks_num > 0) {
+      block = slave->blocks + (slave->blocks_num - 1);
+      int block_end = block->start + block->count;
+      if ((block->modbus_register_type != data->modbus_register_type) ||
+          (data->register_base > block_end + max_gap) ||
+          (end - block->start > MODBUS_MAX_READ_REGISTERS))
+        block = NULL;
+      else if (end > block_end)
+        block->count = end - block->start;
+    }
+
+    if (block == NULL) {
+      block = slave->blocks + slave->blocks_num;
+      slave->blocks_num++;
+      block->modbus_register_type = data->modbus_register_type;
+      block->start = data->register_base;
+      block->count = end - data->register_base;
+      block->data = sorted + i;
+    }
+    block->data_num++;
+  }
+
+#if COLLECT_DEBUG
+  for (i = 0; i < slave->blocks_num; i++) {
+    mb_block_t *block = slave->blocks + i;
+    DEBUG("Modbus plugin: Slave %i: Reading %" PRIsz " data from "
+          "registers %i to %i with one request.",
+          slave->id, block->data_num, block->start,
+          block->start + block->count - 1);
+  }
+#endif
+
+  slave->blocks_data = sorted;
+  return 0;
+} /* }}} int mb_slave_build_blocks */
+
 static int mb_config_add_host(oconfig_item_t *ci) /* {{{ */
 {
   cdtime_t interval = 0;
@@ -1085,7 +1216,13 @@ static int mb_config_add_host(oconfig_item_t *ci) /* {{{ */
 #endif
     } else if (strcasecmp("Interval", child->key) == 0)
       status = cf_util_get_cdtime(child, &interval);
-    else if (strcasecmp("Slave", child->key) == 0)
+    else if (strcasecmp("MaxRegisterGap", child->key) == 0) {
+      status = cf_util_get_int(child, &host->max_register_gap);
+      if ((status == 0) && (host->max_register_gap < 0)) {
+        ERROR("Modbus plugin: MaxRegisterGap must not be negative.");
+        status = -1;
+      }
+    } else if (strcasecmp("Slave", child->key) == 0)
       /* Don't set status: Gracefully continue if a slave fails. */
       mb_config_add_slave(host, child);
     else {
@@ -1118,6 +1255,9 @@ static int mb_config_add_host(oconfig_item_t *ci) /* {{{ */
     status = -1;
   }
 
+  for (size_t i = 0; (status == 0) && (i < host->slaves_num); i++)
+    status = mb_slave_build_blocks(host->slaves + i, host->max_register_gap);
+
   if (status == 0) {
     char name[1024];
 
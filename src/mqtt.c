@@ -32,6 +32,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils_complain.h"
 
@@ -43,6 +44,9 @@
 #define MQTT_DEFAULT_PORT 1883
 #define MQTT_DEFAULT_TOPIC_PREFIX "collectd"
 #define MQTT_DEFAULT_TOPIC "collectd/#"
+#define MQTT_BATCH_TOPIC "batch"
+#define MQTT_DEFAULT_BATCH_MAX_AGE TIME_T_TO_CDTIME_T(1)
+#define MQTT_MAX_QUEUE_LENGTH 65536
 #ifndef MQTT_KEEPALIVE
 #define MQTT_KEEPALIVE 60
 #endif
@@ -77,17 +81,54 @@ struct mqtt_client_conf {
   bool store_rates;
   bool retain;
 
+  /* Maps identifiers to topics, protected by "lock". */
+  c_avl_tree_t *topics;
+
+  /* Lines of the form "<identifier> <values>" which are published to
+   * "batch_topic" as one message. Disabled if "batch_max_size" is zero. */
+  char *batch_topic;
+  char *batch;
+  size_t batch_fill;
+  size_t batch_max_size;
+  cdtime_t batch_max_age;
+  cdtime_t batch_first;
+
+  /* Additional connections of a <Publish> block. Pool members are shallow
+   * copies of the block's configuration. */
+  struct mqtt_client_conf **pool;
+  size_t pool_num;
+  bool pool_member;
+
   /* For subscribing */
   pthread_t thread;
   bool loop;
   char *topic;
   bool clean_session;
 
+  /* Messages waiting for one of the "parse_threads" workers. */
+  size_t parse_threads;
+  pthread_t *workers;
+  size_t workers_num;
+  bool workers_loop;
+  struct mqtt_message *queue_head;
+  struct mqtt_message *queue_tail;
+  size_t queue_len;
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+  c_complain_t complaint_queue_full;
+
   c_complain_t complaint_cantpublish;
   pthread_mutex_t lock;
 };
 typedef struct mqtt_client_conf mqtt_client_conf_t;
 
+struct mqtt_message {
+  char *topic;
+  char *payload;
+  struct mqtt_message *next;
+};
+typedef struct mqtt_message mqtt_message_t;
+
 static mqtt_client_conf_t **subscribers;
 static size_t subscribers_num;
 
@@ -139,11 +180,34 @@ static void mqtt_free(mqtt_client_conf_t *conf) {
   if (conf == NULL)
     return;
 
+  for (size_t i = 0; i < conf->pool_num; i++)
+    mqtt_free(conf->pool[i]);
+  sfree(conf->pool);
+
   if (conf->connected)
     (void)mosquitto_disconnect(conf->mosq);
   conf->connected = false;
   (void)mosquitto_destroy(conf->mosq);
 
+  if (conf->topics != NULL) {
+    void *key;
+    void *value;
+    while (c_avl_pick(conf->topics, &key, &value) == 0) {
+      sfree(key);
+      sfree(value);
+    }
+    c_avl_destroy(conf->topics);
+  }
+  sfree(conf->batch);
+
+  /* Pool members only borrow the configuration. */
+  if (conf->pool_member) {
+    sfree(conf->client_id);
+    sfree(conf);
+    return;
+  }
+
+  sfree(conf->batch_topic);
   sfree(conf->host);
   sfree(conf->username);
   sfree(conf->password);
@@ -173,69 +237,221 @@ static char *strip_prefix(char *topic) {
   return topic;
 }
 
-static void on_message(
-#if LIBMOSQUITTO_MAJOR == 0
-#else
-    __attribute__((unused)) struct mosquitto *m,
-#endif
-    __attribute__((unused)) void *arg, const struct mosquitto_message *msg) {
-  value_list_t vl = VALUE_LIST_INIT;
+/* Parses "<values>" for the identifier "name" into "vl". On success, the
+ * caller must free vl->values. */
+static int mqtt_parse_value(char *name, char *payload, value_list_t *vl) {
   data_set_t const *ds;
-  char *topic;
-  char *name;
-  char *payload;
   int status;
 
-  if (msg->payloadlen <= 0) {
-    DEBUG("mqtt plugin: message has empty payload");
-    return;
+  status = parse_identifier_vl(name, vl);
+  if (status != 0) {
+    ERROR("mqtt plugin: Unable to parse identifier \"%s\".", name);
+    return status;
   }
 
-  topic = strdup(msg->topic);
-  name = strip_prefix(topic);
+  ds = plugin_get_ds(vl->type);
+  if (ds == NULL) {
+    ERROR("mqtt plugin: Unknown type: \"%s\".", vl->type);
+    return -1;
+  }
 
-  status = parse_identifier_vl(name, &vl);
+  vl->values = calloc(ds->ds_num, sizeof(*vl->values));
+  if (vl->values == NULL) {
+    ERROR("mqtt plugin: calloc failed.");
+    return ENOMEM;
+  }
+  vl->values_len = ds->ds_num;
+
+  DEBUG("mqtt plugin: payload = \"%s\"", payload);
+  status = parse_values(payload, vl, ds);
   if (status != 0) {
+    ERROR("mqtt plugin: Unable to parse payload \"%s\".", payload);
+    sfree(vl->values);
+    return status;
+  }
+
+  return 0;
+} /* int mqtt_parse_value */
+
+/* Handles a batch of "<identifier> <values>" lines, as sent by publishers
+ * with "BatchMaxSize" set. */
+static void mqtt_handle_batch(char *payload) {
+  value_list_t *vl = NULL;
+  size_t vl_num = 0;
+  size_t vl_size = 0;
+  char *saveptr = NULL;
+
+  for (char *line = strtok_r(payload, "\n", &saveptr); line != NULL;
+       line = strtok_r(NULL, "\n", &saveptr)) {
+    char *values = strchr(line, ' ');
+    if (values == NULL) {
+      ERROR("mqtt plugin: Unable to parse batch line \"%s\".", line);
+      continue;
+    }
+    *values = 0;
+    values++;
+
+    if (vl_num == vl_size) {
+      size_t size = (vl_size == 0) ? 16 : 2 * vl_size;
+      value_list_t *tmp = realloc(vl, size * sizeof(*vl));
+      if (tmp == NULL) {
+        ERROR("mqtt plugin: realloc failed.");
+        break;
+      }
+      vl = tmp;
+      vl_size = size;
+    }
+
+    vl[vl_num] = (value_list_t)VALUE_LIST_INIT;
+    if (mqtt_parse_value(line, values, vl + vl_num) == 0)
+      vl_num++;
+  }
+
+  if (vl_num > 0)
+    plugin_dispatch_values_batch(vl, vl_num);
+
+  for (size_t i = 0; i < vl_num; i++)
+    sfree(vl[i].values);
+  sfree(vl);
+} /* void mqtt_handle_batch */
+
+/* Parses and dispatches a received message. "payload" is modified. */
+static void mqtt_handle_message(char const *topic, char *payload) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  /* Values never contain spaces, identifiers and values in a batch are
+   * separated by one. */
+  if (strchr(payload, ' ') != NULL) {
+    mqtt_handle_batch(payload);
+    return;
+  }
+
+  char *tmp = strdup(topic);
+  if (tmp == NULL) {
+    ERROR("mqtt plugin: strdup failed.");
+    return;
+  }
+
+  char *name = strip_prefix(tmp);
+  if (name == NULL) {
     ERROR("mqtt plugin: Unable to parse topic \"%s\".", topic);
-    sfree(topic);
+    sfree(tmp);
     return;
   }
-  sfree(topic);
 
-  ds = plugin_get_ds(vl.type);
-  if (ds == NULL) {
-    ERROR("mqtt plugin: Unknown type: \"%s\".", vl.type);
+  int status = mqtt_parse_value(name, payload, &vl);
+  sfree(tmp);
+  if (status != 0)
+    return;
+
+  plugin_dispatch_values(&vl);
+  sfree(vl.values);
+} /* void mqtt_handle_message */
+
+static void mqtt_message_free(mqtt_message_t *m) {
+  if (m == NULL)
+    return;
+
+  sfree(m->topic);
+  sfree(m->payload);
+  sfree(m);
+}
+
+/* Hands a message to the workers of "conf". */
+static int mqtt_enqueue(mqtt_client_conf_t *conf, mqtt_message_t *m) {
+  pthread_mutex_lock(&conf->queue_lock);
+  if (conf->queue_len >= MQTT_MAX_QUEUE_LENGTH) {
+    pthread_mutex_unlock(&conf->queue_lock);
+    c_complain(LOG_WARNING, &conf->complaint_queue_full,
+               "mqtt plugin: The parse queue of \"%s\" is full, dropping "
+               "messages. Consider increasing \"ParseThreads\".",
+               conf->name);
+    return -1;
+  }
+
+  if (conf->queue_tail == NULL)
+    conf->queue_head = m;
+  else
+    conf->queue_tail->next = m;
+  conf->queue_tail = m;
+  conf->queue_len++;
+
+  pthread_cond_signal(&conf->queue_cond);
+  pthread_mutex_unlock(&conf->queue_lock);
+
+  c_release(LOG_INFO, &conf->complaint_queue_full,
+            "mqtt plugin: The parse queue of \"%s\" is no longer full.",
+            conf->name);
+  return 0;
+} /* int mqtt_enqueue */
+
+static void *workers_thread(void *arg) {
+  mqtt_client_conf_t *conf = arg;
+
+  pthread_mutex_lock(&conf->queue_lock);
+  while (conf->workers_loop || (conf->queue_head != NULL)) {
+    if (conf->queue_head == NULL) {
+      pthread_cond_wait(&conf->queue_cond, &conf->queue_lock);
+      continue;
+    }
+
+    mqtt_message_t *m = conf->queue_head;
+    conf->queue_head = m->next;
+    if (conf->queue_head == NULL)
+      conf->queue_tail = NULL;
+    conf->queue_len--;
+    pthread_mutex_unlock(&conf->queue_lock);
+
+    mqtt_handle_message(m->topic, m->payload);
+    mqtt_message_free(m);
+
+    pthread_mutex_lock(&conf->queue_lock);
+  }
+  pthread_mutex_unlock(&conf->queue_lock);
+
+  return NULL;
+} /* void *workers_thread */
+
+static void on_message(
+#if LIBMOSQUITTO_MAJOR == 0
+#else
+    __attribute__((unused)) struct mosquitto *m,
+#endif
+    void *arg, const struct mosquitto_message *msg) {
+  mqtt_client_conf_t *conf = arg;
+  mqtt_message_t *message;
+
+  if (msg->payloadlen <= 0) {
+    DEBUG("mqtt plugin: message has empty payload");
     return;
   }
 
-  vl.values = calloc(ds->ds_num, sizeof(*vl.values));
-  if (vl.values == NULL) {
+  message = calloc(1, sizeof(*message));
+  if (message == NULL) {
     ERROR("mqtt plugin: calloc failed.");
     return;
   }
-  vl.values_len = ds->ds_num;
 
-  payload = malloc(msg->payloadlen + 1);
-  if (payload == NULL) {
+  message->topic = strdup(msg->topic);
+  message->payload = malloc(msg->payloadlen + 1);
+  if ((message->topic == NULL) || (message->payload == NULL)) {
     ERROR("mqtt plugin: malloc for payload buffer failed.");
-    sfree(vl.values);
+    mqtt_message_free(message);
     return;
   }
-  memmove(payload, msg->payload, msg->payloadlen);
-  payload[msg->payloadlen] = 0;
-
-  DEBUG("mqtt plugin: payload = \"%s\"", payload);
-  status = parse_values(payload, &vl, ds);
-  if (status != 0) {
-    ERROR("mqtt plugin: Unable to parse payload \"%s\".", payload);
-    sfree(payload);
-    sfree(vl.values);
+  memmove(message->payload, msg->payload, msg->payloadlen);
+  message->payload[msg->payloadlen] = 0;
+
+  /* Parsing is done by the workers, so that the network loop of this
+   * subscriber is not held up. */
+  if (conf->workers_num > 0) {
+    if (mqtt_enqueue(conf, message) != 0)
+      mqtt_message_free(message);
     return;
   }
-  sfree(payload);
 
-  plugin_dispatch_values(&vl);
-  sfree(vl.values);
+  mqtt_handle_message(message->topic, message->payload);
+  mqtt_message_free(message);
 } /* void on_message */
 
 static int mqtt_subscribe(mqtt_client_conf_t *conf) {
@@ -423,15 +639,13 @@ static void *subscribers_thread(void *arg) {
   pthread_exit(0);
 } /* void *subscribers_thread */
 
+/* must hold conf->lock when calling. */
 static int publish(mqtt_client_conf_t *conf, char const *topic,
                    void const *payload, size_t payload_len) {
   int status;
 
-  pthread_mutex_lock(&conf->lock);
-
   status = mqtt_connect(conf);
   if (status != 0) {
-    pthread_mutex_unlock(&conf->lock);
     ERROR("mqtt plugin: unable to reconnect to broker");
     return status;
   }
@@ -454,7 +668,6 @@ static int publish(mqtt_client_conf_t *conf, char const *topic,
     conf->connected = false;
     mosquitto_disconnect(conf->mosq);
 
-    pthread_mutex_unlock(&conf->lock);
     return -1;
   }
 
@@ -477,26 +690,21 @@ static int publish(mqtt_client_conf_t *conf, char const *topic,
     conf->connected = 0;
     mosquitto_disconnect(conf->mosq);
 
-    pthread_mutex_unlock(&conf->lock);
     return -1;
   }
 
-  pthread_mutex_unlock(&conf->lock);
   return 0;
 } /* int publish */
 
-static int format_topic(char *buf, size_t buf_len, data_set_t const *ds,
-                        value_list_t const *vl, mqtt_client_conf_t *conf) {
-  char name[MQTT_MAX_TOPIC_SIZE];
+static int format_topic(char *buf, size_t buf_len, char const *name,
+                        mqtt_client_conf_t *conf) {
   int status;
   char *c;
 
-  if ((conf->topic_prefix == NULL) || (conf->topic_prefix[0] == 0))
-    return FORMAT_VL(buf, buf_len, vl);
-
-  status = FORMAT_VL(name, sizeof(name), vl);
-  if (status != 0)
-    return status;
+  if ((conf->topic_prefix == NULL) || (conf->topic_prefix[0] == 0)) {
+    sstrncpy(buf, name, buf_len);
+    return 0;
+  }
 
   status = ssnprintf(buf, buf_len, "%s/%s", conf->topic_prefix, name);
   if ((status < 0) || (((size_t)status) >= buf_len))
@@ -509,10 +717,119 @@ static int format_topic(char *buf, size_t buf_len, data_set_t const *ds,
   return 0;
 } /* int format_topic */
 
+/* Returns the topic for the identifier "name", formatting it only the first
+ * time a value list is seen. must hold conf->lock when calling. */
+static char const *mqtt_topic_get(mqtt_client_conf_t *conf, char const *name) {
+  char buf[MQTT_MAX_TOPIC_SIZE];
+  char *topic = NULL;
+
+  if (c_avl_get(conf->topics, name, (void *)&topic) == 0)
+    return topic;
+
+  int status = format_topic(buf, sizeof(buf), name, conf);
+  if (status != 0) {
+    ERROR("mqtt plugin: format_topic failed with status %d.", status);
+    return NULL;
+  }
+
+  char *key = strdup(name);
+  topic = strdup(buf);
+  if ((key == NULL) || (topic == NULL) ||
+      (c_avl_insert(conf->topics, key, topic) != 0)) {
+    ERROR("mqtt plugin: Caching the topic \"%s\" failed.", buf);
+    sfree(key);
+    sfree(topic);
+    return NULL;
+  }
+
+  return topic;
+} /* char const *mqtt_topic_get */
+
+/* must hold conf->lock when calling. */
+static int mqtt_batch_publish(mqtt_client_conf_t *conf) {
+  if (conf->batch_fill == 0)
+    return 0;
+
+  int status = publish(conf, conf->batch_topic, conf->batch, conf->batch_fill);
+  /* The batch is dropped on failure, just like single values are. */
+  conf->batch_fill = 0;
+  return status;
+} /* int mqtt_batch_publish */
+
+/* must hold conf->lock when calling. */
+static int mqtt_batch_add(mqtt_client_conf_t *conf, char const *name,
+                          char const *payload) {
+  size_t name_len = strlen(name);
+  size_t payload_len = strlen(payload);
+  size_t len = name_len + 1 + payload_len + 1;
+  int status = 0;
+
+  if (len > conf->batch_max_size) {
+    ERROR("mqtt plugin: The value list \"%s\" does not fit into a batch "
+          "of %" PRIsz " bytes.",
+          name, conf->batch_max_size);
+    return ENOMEM;
+  }
+
+  if (conf->batch_fill + len > conf->batch_max_size)
+    status = mqtt_batch_publish(conf);
+
+  if (conf->batch_fill == 0)
+    conf->batch_first = cdtime();
+
+  char *pos = conf->batch + conf->batch_fill;
+  memcpy(pos, name, name_len);
+  pos[name_len] = ' ';
+  memcpy(pos + name_len + 1, payload, payload_len);
+  pos[len - 1] = '\n';
+  conf->batch_fill += len;
+
+  if (cdtime() - conf->batch_first >= conf->batch_max_age) {
+    int tmp = mqtt_batch_publish(conf);
+    if (status == 0)
+      status = tmp;
+  }
+
+  return status;
+} /* int mqtt_batch_add */
+
+static mqtt_client_conf_t *mqtt_pool_member(mqtt_client_conf_t *conf,
+                                            size_t i) {
+  return (i == 0) ? conf : conf->pool[i - 1];
+}
+
+/* Locks and returns one of the connections of "conf". Writers prefer the
+ * connection chosen by the identifier, so that each connection's topic
+ * cache stays small, but take any idle connection before waiting. */
+static mqtt_client_conf_t *mqtt_pool_lock(mqtt_client_conf_t *conf,
+                                          char const *name) {
+  size_t num = conf->pool_num + 1;
+
+  if (num == 1) {
+    pthread_mutex_lock(&conf->lock);
+    return conf;
+  }
+
+  uint32_t hash = 2166136261U;
+  for (char const *c = name; *c != 0; c++)
+    hash = (hash ^ (uint8_t)*c) * 16777619U;
+  size_t start = hash % num;
+
+  for (size_t i = 0; i < num; i++) {
+    mqtt_client_conf_t *c = mqtt_pool_member(conf, (start + i) % num);
+    if (pthread_mutex_trylock(&c->lock) == 0)
+      return c;
+  }
+
+  mqtt_client_conf_t *c = mqtt_pool_member(conf, start);
+  pthread_mutex_lock(&c->lock);
+  return c;
+} /* mqtt_client_conf_t *mqtt_pool_lock */
+
 static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *user_data) {
   mqtt_client_conf_t *conf;
-  char topic[MQTT_MAX_TOPIC_SIZE];
+  char name[MQTT_MAX_TOPIC_SIZE];
   char payload[MQTT_MAX_MESSAGE_SIZE];
   int status = 0;
 
@@ -520,9 +837,9 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
     return EINVAL;
   conf = user_data->data;
 
-  status = format_topic(topic, sizeof(topic), ds, vl, conf);
+  status = FORMAT_VL(name, sizeof(name), vl);
   if (status != 0) {
-    ERROR("mqtt plugin: format_topic failed with status %d.", status);
+    ERROR("mqtt plugin: FORMAT_VL failed with status %d.", status);
     return status;
   }
 
@@ -532,7 +849,20 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
     return status;
   }
 
-  status = publish(conf, topic, payload, strlen(payload));
+  mqtt_client_conf_t *c = mqtt_pool_lock(conf, name);
+
+  if (c->batch_max_size > 0) {
+    status = mqtt_batch_add(c, name, payload);
+  } else {
+    char const *topic = mqtt_topic_get(c, name);
+    if (topic == NULL)
+      status = -1;
+    else
+      status = publish(c, topic, payload, strlen(payload));
+  }
+
+  pthread_mutex_unlock(&c->lock);
+
   if (status != 0) {
     ERROR("mqtt plugin: publish failed: %s", mosquitto_strerror(status));
     return status;
@@ -541,6 +871,76 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
   return status;
 } /* mqtt_write */
 
+static int mqtt_flush(cdtime_t timeout,
+                      __attribute__((unused)) const char *identifier,
+                      user_data_t *user_data) {
+  mqtt_client_conf_t *conf = user_data->data;
+  int status = 0;
+
+  for (size_t i = 0; i < conf->pool_num + 1; i++) {
+    mqtt_client_conf_t *c = mqtt_pool_member(conf, i);
+
+    pthread_mutex_lock(&c->lock);
+    if ((c->batch_fill > 0) &&
+        ((timeout == 0) || (cdtime() - c->batch_first >= timeout))) {
+      if (mqtt_batch_publish(c) != 0)
+        status = -1;
+    }
+    pthread_mutex_unlock(&c->lock);
+  }
+
+  return status;
+} /* mqtt_flush */
+
+/* Creates the additional connections of "conf". */
+static int mqtt_pool_create(mqtt_client_conf_t *conf, size_t num) {
+  if (num <= 1)
+    return 0;
+
+  conf->pool = calloc(num - 1, sizeof(*conf->pool));
+  if (conf->pool == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < num - 1; i++) {
+    mqtt_client_conf_t *c = malloc(sizeof(*c));
+    if (c == NULL)
+      return ENOMEM;
+
+    memcpy(c, conf, sizeof(*c));
+    c->mosq = NULL;
+    c->connected = false;
+    c->pool = NULL;
+    c->pool_num = 0;
+    c->pool_member = true;
+    c->topics = NULL;
+    c->batch = NULL;
+    c->batch_fill = 0;
+    pthread_mutex_init(&c->lock, /* attr = */ NULL);
+    C_COMPLAIN_INIT(&c->complaint_cantpublish);
+
+    /* Brokers disconnect clients whose ID is already in use. */
+    char client_id[DATA_MAX_NAME_LEN];
+    ssnprintf(client_id, sizeof(client_id), "%s-%" PRIsz,
+              (conf->client_id != NULL) ? conf->client_id : hostname_g, i + 1);
+    c->client_id = strdup(client_id);
+
+    conf->pool[i] = c;
+    conf->pool_num++;
+
+    c->topics = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if ((c->client_id == NULL) || (c->topics == NULL))
+      return ENOMEM;
+
+    if (conf->batch_max_size > 0) {
+      c->batch = malloc(conf->batch_max_size);
+      if (c->batch == NULL)
+        return ENOMEM;
+    }
+  }
+
+  return 0;
+} /* int mqtt_pool_create */
+
 /*
  * <Publish "name">
  *   Host "example.com"
@@ -556,11 +956,15 @@ static int mqtt_write(const data_set_t *ds, const value_list_t *vl,
  *   CertificateFile "client-cert.pem"	  optional
  *   CertificateKeyFile "client-key.pem"  optional
  *   TLSProtocol "tlsv1.2"                optional
+ *   Connections 1
+ *   BatchMaxSize 0                       0 disables batching
+ *   BatchMaxAge 1
  * </Publish>
  */
 static int mqtt_config_publisher(oconfig_item_t *ci) {
   mqtt_client_conf_t *conf;
   char cb_name[1024];
+  int connections = 1;
   int status;
 
   conf = calloc(1, sizeof(*conf));
@@ -583,6 +987,7 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
   conf->qos = 0;
   conf->topic_prefix = strdup(MQTT_DEFAULT_TOPIC_PREFIX);
   conf->store_rates = true;
+  conf->batch_max_age = MQTT_DEFAULT_BATCH_MAX_AGE;
 
   status = pthread_mutex_init(&conf->lock, NULL);
   if (status != 0) {
@@ -631,15 +1036,60 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
       cf_util_get_string(child, &conf->tlsprotocol);
     else if (strcasecmp("CipherSuite", child->key) == 0)
       cf_util_get_string(child, &conf->ciphersuite);
+    else if (strcasecmp("Connections", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status != 0) || (tmp < 1))
+        ERROR("mqtt plugin: Connections must be positive.");
+      else
+        connections = tmp;
+    } else if (strcasecmp("BatchMaxSize", child->key) == 0) {
+      int tmp = -1;
+      status = cf_util_get_int(child, &tmp);
+      if ((status != 0) || (tmp < 0))
+        ERROR("mqtt plugin: BatchMaxSize must not be negative.");
+      else
+        conf->batch_max_size = (size_t)tmp;
+    } else if (strcasecmp("BatchMaxAge", child->key) == 0)
+      cf_util_get_cdtime(child, &conf->batch_max_age);
     else
       ERROR("mqtt plugin: Unknown config option: %s", child->key);
   }
 
+  conf->topics = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (conf->topics == NULL) {
+    mqtt_free(conf);
+    return ENOMEM;
+  }
+
+  if (conf->batch_max_size > 0) {
+    char topic[MQTT_MAX_TOPIC_SIZE];
+    status = format_topic(topic, sizeof(topic), MQTT_BATCH_TOPIC, conf);
+    conf->batch_topic = (status == 0) ? strdup(topic) : NULL;
+    conf->batch = malloc(conf->batch_max_size);
+    if ((conf->batch_topic == NULL) || (conf->batch == NULL)) {
+      mqtt_free(conf);
+      return ENOMEM;
+    }
+  }
+
+  status = mqtt_pool_create(conf, (size_t)connections);
+  if (status != 0) {
+    ERROR("mqtt plugin: Creating %d connections failed.", connections);
+    mqtt_free(conf);
+    return status;
+  }
+
   ssnprintf(cb_name, sizeof(cb_name), "mqtt/%s", conf->name);
   plugin_register_write(cb_name, mqtt_write,
                         &(user_data_t){
                             .data = conf,
                         });
+  if (conf->batch_max_size > 0)
+    plugin_register_flush(cb_name, mqtt_flush,
+                          &(user_data_t){
+                              .data = conf,
+                          });
   return 0;
 } /* mqtt_config_publisher */
 
@@ -655,6 +1105,7 @@ static int mqtt_config_publisher(oconfig_item_t *ci) {
  *   CertificateFile "client-cert.pem"	  optional
  *   CertificateKeyFile "client-key.pem"  optional
  *   TLSProtocol "tlsv1.2"                optional
+ *   ParseThreads 0                       0 parses on the network thread
  * </Subscribe>
  */
 static int mqtt_config_subscriber(oconfig_item_t *ci) {
@@ -688,8 +1139,11 @@ static int mqtt_config_subscriber(oconfig_item_t *ci) {
     mqtt_free(conf);
     return status;
   }
+  pthread_mutex_init(&conf->queue_lock, /* attr = */ NULL);
+  pthread_cond_init(&conf->queue_cond, /* attr = */ NULL);
 
   C_COMPLAIN_INIT(&conf->complaint_cantpublish);
+  C_COMPLAIN_INIT(&conf->complaint_queue_full);
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -728,7 +1182,14 @@ static int mqtt_config_subscriber(oconfig_item_t *ci) {
       cf_util_get_string(child, &conf->tlsprotocol);
     else if (strcasecmp("CipherSuite", child->key) == 0)
       cf_util_get_string(child, &conf->ciphersuite);
-    else
+    else if (strcasecmp("ParseThreads", child->key) == 0) {
+      int threads = -1;
+      status = cf_util_get_int(child, &threads);
+      if ((status != 0) || (threads < 0))
+        ERROR("mqtt plugin: ParseThreads must not be negative.");
+      else
+        conf->parse_threads = (size_t)threads;
+    } else
       ERROR("mqtt plugin: Unknown config option: %s", child->key);
   }
 
@@ -774,11 +1235,33 @@ static int mqtt_init(void) {
   mosquitto_lib_init();
 
   for (size_t i = 0; i < subscribers_num; i++) {
+    mqtt_client_conf_t *conf = subscribers[i];
     int status;
 
     if (subscribers[i]->loop)
       continue;
 
+    if ((conf->parse_threads > 0) && (conf->workers == NULL)) {
+      conf->workers = calloc(conf->parse_threads, sizeof(*conf->workers));
+      if (conf->workers == NULL) {
+        ERROR("mqtt plugin: calloc failed.");
+        continue;
+      }
+
+      conf->workers_loop = true;
+      for (size_t j = 0; j < conf->parse_threads; j++) {
+        status = plugin_thread_create(&conf->workers[conf->workers_num],
+                                      /* func  = */ workers_thread,
+                                      /* args  = */ conf,
+                                      /* name  = */ "mqtt parse");
+        if (status != 0) {
+          ERROR("mqtt plugin: pthread_create failed: %s", STRERRNO);
+          break;
+        }
+        conf->workers_num++;
+      }
+    }
+
     status = plugin_thread_create(&subscribers[i]->thread,
                                   /* func  = */ subscribers_thread,
                                   /* args  = */ subscribers[i],
@@ -792,7 +1275,30 @@ static int mqtt_init(void) {
   return 0;
 } /* mqtt_init */
 
+static int mqtt_shutdown(void) {
+  for (size_t i = 0; i < subscribers_num; i++) {
+    mqtt_client_conf_t *conf = subscribers[i];
+
+    if (conf->workers_num == 0)
+      continue;
+
+    /* Workers drain the queue before exiting. */
+    pthread_mutex_lock(&conf->queue_lock);
+    conf->workers_loop = false;
+    pthread_cond_broadcast(&conf->queue_cond);
+    pthread_mutex_unlock(&conf->queue_lock);
+
+    for (size_t j = 0; j < conf->workers_num; j++)
+      pthread_join(conf->workers[j], NULL);
+    conf->workers_num = 0;
+    sfree(conf->workers);
+  }
+
+  return 0;
+} /* mqtt_shutdown */
+
 void module_register(void) {
   plugin_register_complex_config("mqtt", mqtt_config);
   plugin_register_init("mqtt", mqtt_init);
+  plugin_register_shutdown("mqtt", mqtt_shutdown);
 } /* void module_register */
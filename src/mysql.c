@@ -34,8 +34,10 @@
 
 #ifdef HAVE_MYSQL_H
 #include <mysql.h>
+#include <errmsg.h>
 #elif defined(HAVE_MYSQL_MYSQL_H)
 #include <mysql/mysql.h>
+#include <mysql/errmsg.h>
 #endif
 
 struct mysql_database_s /* {{{ */
@@ -73,6 +75,161 @@ struct mysql_database_s /* {{{ */
 };
 typedef struct mysql_database_s mysql_database_t; /* }}} */
 
+/* Values of "SHOW GLOBAL STATUS" which are combined with others before they
+ * are dispatched. */
+enum {
+  STATUS_QCACHE_HITS = 0,
+  STATUS_QCACHE_INSERTS,
+  STATUS_QCACHE_NOT_CACHED,
+  STATUS_QCACHE_LOWMEM_PRUNES,
+  STATUS_QCACHE_QUERIES_IN_CACHE,
+  STATUS_THREADS_RUNNING,
+  STATUS_THREADS_CONNECTED,
+  STATUS_THREADS_CACHED,
+  STATUS_THREADS_CREATED,
+  STATUS_BYTES_RECEIVED,
+  STATUS_BYTES_SENT,
+  STATUS_COLLECTED_NUM,
+};
+
+struct mysql_status_metric_s {
+  const char *key;
+  const char *type; /* NULL if the value is stored in "collected" */
+  const char *type_instance;
+  int ds_type;
+  int collected;
+  bool innodb; /* only reported with "InnodbStats" */
+};
+typedef struct mysql_status_metric_s mysql_status_metric_t;
+
+/* Sorted by mysql_config(), so that rows can be looked up with bsearch(). */
+static mysql_status_metric_t status_metrics[] = {
+    {"Qcache_hits", NULL, NULL, DS_TYPE_DERIVE, STATUS_QCACHE_HITS, false},
+    {"Qcache_inserts", NULL, NULL, DS_TYPE_DERIVE, STATUS_QCACHE_INSERTS,
+     false},
+    {"Qcache_not_cached", NULL, NULL, DS_TYPE_DERIVE, STATUS_QCACHE_NOT_CACHED,
+     false},
+    {"Qcache_lowmem_prunes", NULL, NULL, DS_TYPE_DERIVE,
+     STATUS_QCACHE_LOWMEM_PRUNES, false},
+    {"Qcache_queries_in_cache", NULL, NULL, DS_TYPE_GAUGE,
+     STATUS_QCACHE_QUERIES_IN_CACHE, false},
+
+    {"Bytes_received", NULL, NULL, DS_TYPE_DERIVE, STATUS_BYTES_RECEIVED,
+     false},
+    {"Bytes_sent", NULL, NULL, DS_TYPE_DERIVE, STATUS_BYTES_SENT, false},
+
+    {"Threads_running", NULL, NULL, DS_TYPE_GAUGE, STATUS_THREADS_RUNNING,
+     false},
+    {"Threads_connected", NULL, NULL, DS_TYPE_GAUGE, STATUS_THREADS_CONNECTED,
+     false},
+    {"Threads_cached", NULL, NULL, DS_TYPE_GAUGE, STATUS_THREADS_CACHED, false},
+    {"Threads_created", NULL, NULL, DS_TYPE_DERIVE, STATUS_THREADS_CREATED,
+     false},
+
+    /* buffer pool */
+    {"Innodb_buffer_pool_pages_data", "mysql_bpool_pages", "data",
+     DS_TYPE_GAUGE, -1, true},
+    {"Innodb_buffer_pool_pages_dirty", "mysql_bpool_pages", "dirty",
+     DS_TYPE_GAUGE, -1, true},
+    {"Innodb_buffer_pool_pages_flushed", "mysql_bpool_counters",
+     "pages_flushed", DS_TYPE_DERIVE, -1, true},
+    {"Innodb_buffer_pool_pages_free", "mysql_bpool_pages", "free",
+     DS_TYPE_GAUGE, -1, true},
+    {"Innodb_buffer_pool_pages_misc", "mysql_bpool_pages", "misc",
+     DS_TYPE_GAUGE, -1, true},
+    {"Innodb_buffer_pool_pages_total", "mysql_bpool_pages", "total",
+     DS_TYPE_GAUGE, -1, true},
+    {"Innodb_buffer_pool_read_ahead_rnd", "mysql_bpool_counters",
+     "read_ahead_rnd", DS_TYPE_DERIVE, -1, true},
+    {"Innodb_buffer_pool_read_ahead", "mysql_bpool_counters", "read_ahead",
+     DS_TYPE_DERIVE, -1, true},
+    {"Innodb_buffer_pool_read_ahead_evicted", "mysql_bpool_counters",
+     "read_ahead_evicted", DS_TYPE_DERIVE, -1, true},
+    {"Innodb_buffer_pool_read_requests", "mysql_bpool_counters",
+     "read_requests", DS_TYPE_DERIVE, -1, true},
+    {"Innodb_buffer_pool_reads", "mysql_bpool_counters", "reads",
+     DS_TYPE_DERIVE, -1, true},
+    {"Innodb_buffer_pool_wait_free", "mysql_bpool_counters", "wait_free",
+     DS_TYPE_DERIVE, -1, true},
+    {"Innodb_buffer_pool_write_requests", "mysql_bpool_counters",
+     "write_requests", DS_TYPE_DERIVE, -1, true},
+    {"Innodb_buffer_pool_bytes_data", "mysql_bpool_bytes", "data",
+     DS_TYPE_GAUGE, -1, true},
+    {"Innodb_buffer_pool_bytes_dirty", "mysql_bpool_bytes", "dirty",
+     DS_TYPE_GAUGE, -1, true},
+
+    /* data */
+    {"Innodb_data_fsyncs", "mysql_innodb_data", "fsyncs", DS_TYPE_DERIVE, -1,
+     true},
+    {"Innodb_data_read", "mysql_innodb_data", "read", DS_TYPE_DERIVE, -1,
+     true},
+    {"Innodb_data_reads", "mysql_innodb_data", "reads", DS_TYPE_DERIVE, -1,
+     true},
+    {"Innodb_data_writes", "mysql_innodb_data", "writes", DS_TYPE_DERIVE, -1,
+     true},
+    {"Innodb_data_written", "mysql_innodb_data", "written", DS_TYPE_DERIVE, -1,
+     true},
+
+    /* double write */
+    {"Innodb_dblwr_writes", "mysql_innodb_dblwr", "writes", DS_TYPE_DERIVE, -1,
+     true},
+    {"Innodb_dblwr_pages_written", "mysql_innodb_dblwr", "written",
+     DS_TYPE_DERIVE, -1, true},
+    {"Innodb_dblwr_page_size", "mysql_innodb_dblwr", "page_size",
+     DS_TYPE_GAUGE, -1, true},
+
+    /* log */
+    {"Innodb_log_waits", "mysql_innodb_log", "waits", DS_TYPE_DERIVE, -1,
+     true},
+    {"Innodb_log_write_requests", "mysql_innodb_log", "write_requests",
+     DS_TYPE_DERIVE, -1, true},
+    {"Innodb_log_writes", "mysql_innodb_log", "writes", DS_TYPE_DERIVE, -1,
+     true},
+    {"Innodb_os_log_fsyncs", "mysql_innodb_log", "fsyncs", DS_TYPE_DERIVE, -1,
+     true},
+    {"Innodb_os_log_written", "mysql_innodb_log", "written", DS_TYPE_DERIVE,
+     -1, true},
+
+    /* pages */
+    {"Innodb_pages_created", "mysql_innodb_pages", "created", DS_TYPE_DERIVE,
+     -1, true},
+    {"Innodb_pages_read", "mysql_innodb_pages", "read", DS_TYPE_DERIVE, -1,
+     true},
+    {"Innodb_pages_written", "mysql_innodb_pages", "written", DS_TYPE_DERIVE,
+     -1, true},
+
+    /* row lock */
+    {"Innodb_row_lock_time", "mysql_innodb_row_lock", "time", DS_TYPE_DERIVE,
+     -1, true},
+    {"Innodb_row_lock_waits", "mysql_innodb_row_lock", "waits",
+     DS_TYPE_DERIVE, -1, true},
+
+    /* rows */
+    {"Innodb_rows_deleted", "mysql_innodb_rows", "deleted", DS_TYPE_DERIVE, -1,
+     true},
+    {"Innodb_rows_inserted", "mysql_innodb_rows", "inserted", DS_TYPE_DERIVE,
+     -1, true},
+    {"Innodb_rows_read", "mysql_innodb_rows", "read", DS_TYPE_DERIVE, -1,
+     true},
+    {"Innodb_rows_updated", "mysql_innodb_rows", "updated", DS_TYPE_DERIVE, -1,
+     true},
+
+    {"Sort_merge_passes", "mysql_sort_merge_passes", NULL, DS_TYPE_DERIVE, -1,
+     false},
+    {"Sort_rows", "mysql_sort_rows", NULL, DS_TYPE_DERIVE, -1, false},
+    {"Sort_range", "mysql_sort", "range", DS_TYPE_DERIVE, -1, false},
+    {"Sort_scan", "mysql_sort", "scan", DS_TYPE_DERIVE, -1, false},
+
+    {"Slow_queries", "mysql_slow_queries", NULL, DS_TYPE_DERIVE, -1, false},
+    {"Uptime", "uptime", NULL, DS_TYPE_GAUGE, -1, false},
+    {"Questions", "questions", NULL, DS_TYPE_GAUGE, -1, false},
+};
+
+static int mysql_status_metric_compare(const void *a, const void *b) {
+  return strcmp(((const mysql_status_metric_t *)a)->key,
+                ((const mysql_status_metric_t *)b)->key);
+} /* int mysql_status_metric_compare */
+
 static int mysql_read(user_data_t *ud);
 
 static void mysql_database_free(void *arg) /* {{{ */
@@ -239,9 +396,17 @@ static int mysql_config_database(oconfig_item_t *ci) /* {{{ */
 
 static int mysql_config(oconfig_item_t *ci) /* {{{ */
 {
+  static bool status_metrics_sorted;
+
   if (ci == NULL)
     return EINVAL;
 
+  if (!status_metrics_sorted) {
+    qsort(status_metrics, STATIC_ARRAY_SIZE(status_metrics),
+          sizeof(status_metrics[0]), mysql_status_metric_compare);
+    status_metrics_sorted = true;
+  }
+
   /* Fill the `mysql_database_t' structure.. */
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -260,17 +425,10 @@ static int mysql_config(oconfig_item_t *ci) /* {{{ */
 static MYSQL *getconnection(mysql_database_t *db) {
   const char *cipher;
 
-  if (db->is_connected) {
-    int status;
-
-    status = mysql_ping(db->con);
-    if (status == 0)
-      return db->con;
-
-    WARNING("mysql plugin: Lost connection to instance \"%s\": %s",
-            db->instance, mysql_error(db->con));
-  }
-  db->is_connected = false;
+  /* A lost connection is detected by mysql_read() when the status query
+   * fails, which then resets "is_connected". */
+  if (db->is_connected)
+    return db->con;
 
   /* Close the old connection before initializing a new one. */
   if (db->con != NULL) {
@@ -646,12 +804,10 @@ static int mysql_read_innodb_stats(mysql_database_t *db, MYSQL *con) {
   return 0;
 }
 
-static int mysql_read_wsrep_stats(mysql_database_t *db, MYSQL *con) {
-  MYSQL_RES *res;
-  MYSQL_ROW row;
-
-  const char *query;
-  struct {
+/* Submits one "wsrep_*" row of "SHOW GLOBAL STATUS". */
+static void mysql_submit_wsrep_stat(mysql_database_t *db, const char *key,
+                                    unsigned long long val) {
+  static const struct {
     const char *key;
     const char *type;
     int ds_type;
@@ -684,37 +840,10 @@ static int mysql_read_wsrep_stats(mysql_database_t *db, MYSQL *con) {
       {"wsrep_local_recv_queue", "queue_length", DS_TYPE_GAUGE},
       {"wsrep_local_send_queue", "queue_length", DS_TYPE_GAUGE},
 
-      {NULL, NULL, 0}
-
   };
 
-  query = "SHOW GLOBAL STATUS LIKE 'wsrep_%'";
-
-  res = exec_query(con, query);
-  if (res == NULL)
-    return -1;
-
-  row = mysql_fetch_row(res);
-  if (row == NULL) {
-    ERROR("mysql plugin: Failed to get wsrep statistics: "
-          "`%s' did not return any rows.",
-          query);
-    mysql_free_result(res);
-    return -1;
-  }
-
-  while ((row = mysql_fetch_row(res))) {
-    int i;
-    char *key;
-    unsigned long long val;
-
-    key = row[0];
-    val = atoll(row[1]);
-
-    for (i = 0; metrics[i].key != NULL && strcmp(metrics[i].key, key) != 0; i++)
-      ;
-
-    if (metrics[i].key == NULL)
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(metrics); i++) {
+    if (strcmp(metrics[i].key, key) != 0)
       continue;
 
     switch (metrics[i].ds_type) {
@@ -725,11 +854,75 @@ static int mysql_read_wsrep_stats(mysql_database_t *db, MYSQL *con) {
       derive_submit(metrics[i].type, key, (derive_t)val, db);
       break;
     }
+    return;
+  }
+} /* mysql_submit_wsrep_stat */
+
+/* Returns true if "key" starts with "prefix" and stores the remainder in
+ * "suffix". */
+static bool has_prefix(const char *key, const char *prefix,
+                       const char **suffix) {
+  size_t prefix_len = strlen(prefix);
+
+  if (strncmp(key, prefix, prefix_len) != 0)
+    return false;
+
+  *suffix = key + prefix_len;
+  return true;
+} /* bool has_prefix */
+
+static void mysql_submit_status(mysql_database_t *db, const char *key,
+                                unsigned long long val,
+                                unsigned long long *collected, bool *have) {
+  const char *suffix;
+
+  if (has_prefix(key, "Com_", &suffix)) {
+    /* Ignore `prepared statements' */
+    if ((val != 0ULL) && (strncmp(suffix, "stmt_", strlen("stmt_")) != 0))
+      derive_submit("mysql_commands", suffix, val, db);
+    return;
+  } else if (has_prefix(key, "Handler_", &suffix)) {
+    if (val != 0ULL)
+      derive_submit("mysql_handler", suffix, val, db);
+    return;
+  } else if (has_prefix(key, "Table_locks_", &suffix)) {
+    derive_submit("mysql_locks", suffix, val, db);
+    return;
+  } else if (has_prefix(key, "Select_", &suffix)) {
+    derive_submit("mysql_select", suffix, val, db);
+    return;
+  } else if (has_prefix(key, "wsrep_", &suffix)) {
+    if (db->wsrep_stats)
+      mysql_submit_wsrep_stat(db, key, val);
+    return;
   }
 
-  mysql_free_result(res);
-  return 0;
-} /* mysql_read_wsrep_stats */
+  mysql_status_metric_t *m = bsearch(
+      &(mysql_status_metric_t){.key = key}, status_metrics,
+      STATIC_ARRAY_SIZE(status_metrics), sizeof(status_metrics[0]),
+      mysql_status_metric_compare);
+  if (m == NULL)
+    return;
+
+  if (m->type == NULL) {
+    collected[m->collected] = val;
+    have[m->collected] = true;
+    return;
+  }
+
+  if (m->innodb && !db->innodb_stats)
+    return;
+
+  if (m->ds_type == DS_TYPE_GAUGE)
+    gauge_submit(m->type, m->type_instance, (gauge_t)val, db);
+  else
+    derive_submit(m->type, m->type_instance, (derive_t)val, db);
+} /* void mysql_submit_status */
+
+static gauge_t collected_gauge(unsigned long long *collected, bool *have,
+                               int idx) {
+  return have[idx] ? (gauge_t)collected[idx] : NAN;
+} /* gauge_t collected_gauge */
 
 static int mysql_read(user_data_t *ud) {
   mysql_database_t *db;
@@ -738,19 +931,9 @@ static int mysql_read(user_data_t *ud) {
   MYSQL_ROW row;
   const char *query;
 
-  derive_t qcache_hits = 0;
-  derive_t qcache_inserts = 0;
-  derive_t qcache_not_cached = 0;
-  derive_t qcache_lowmem_prunes = 0;
-  gauge_t qcache_queries_in_cache = NAN;
-
-  gauge_t threads_running = NAN;
-  gauge_t threads_connected = NAN;
-  gauge_t threads_cached = NAN;
-  derive_t threads_created = 0;
-
-  unsigned long long traffic_incoming = 0ULL;
-  unsigned long long traffic_outgoing = 0ULL;
+  unsigned long long collected[STATUS_COLLECTED_NUM] = {0};
+  bool have[STATUS_COLLECTED_NUM] = {false};
+  bool have_wsrep = false;
 
   if ((ud == NULL) || (ud->data == NULL)) {
     ERROR("mysql plugin: mysql_database_read: Invalid user data.");
@@ -768,186 +951,76 @@ static int mysql_read(user_data_t *ud) {
     query = "SHOW GLOBAL STATUS";
 
   res = exec_query(con, query);
-  if (res == NULL)
-    return -1;
+  if (res == NULL) {
+    unsigned int err = mysql_errno(con);
+    if ((err != CR_SERVER_GONE_ERROR) && (err != CR_SERVER_LOST))
+      return -1;
+
+    /* The connection is only checked when it fails rather than with an
+     * additional round trip on every read. Reconnect and try once more. */
+    WARNING("mysql plugin: Lost connection to instance \"%s\", reconnecting.",
+            db->instance);
+    db->is_connected = false;
+    if ((con = getconnection(db)) == NULL)
+      return -1;
+
+    res = exec_query(con, query);
+    if (res == NULL)
+      return -1;
+  }
 
   while ((row = mysql_fetch_row(res))) {
-    char *key;
-    unsigned long long val;
+    if ((row[0] == NULL) || (row[1] == NULL))
+      continue;
 
-    key = row[0];
-    val = atoll(row[1]);
+    if (strncmp(row[0], "wsrep_", strlen("wsrep_")) == 0)
+      have_wsrep = true;
 
-    if (strncmp(key, "Com_", strlen("Com_")) == 0) {
-      if (val == 0ULL)
-        continue;
-
-      /* Ignore `prepared statements' */
-      if (strncmp(key, "Com_stmt_", strlen("Com_stmt_")) != 0)
-        derive_submit("mysql_commands", key + strlen("Com_"), val, db);
-    } else if (strncmp(key, "Handler_", strlen("Handler_")) == 0) {
-      if (val == 0ULL)
-        continue;
-
-      derive_submit("mysql_handler", key + strlen("Handler_"), val, db);
-    } else if (strncmp(key, "Qcache_", strlen("Qcache_")) == 0) {
-      if (strcmp(key, "Qcache_hits") == 0)
-        qcache_hits = (derive_t)val;
-      else if (strcmp(key, "Qcache_inserts") == 0)
-        qcache_inserts = (derive_t)val;
-      else if (strcmp(key, "Qcache_not_cached") == 0)
-        qcache_not_cached = (derive_t)val;
-      else if (strcmp(key, "Qcache_lowmem_prunes") == 0)
-        qcache_lowmem_prunes = (derive_t)val;
-      else if (strcmp(key, "Qcache_queries_in_cache") == 0)
-        qcache_queries_in_cache = (gauge_t)val;
-    } else if (strncmp(key, "Bytes_", strlen("Bytes_")) == 0) {
-      if (strcmp(key, "Bytes_received") == 0)
-        traffic_incoming += val;
-      else if (strcmp(key, "Bytes_sent") == 0)
-        traffic_outgoing += val;
-    } else if (strncmp(key, "Threads_", strlen("Threads_")) == 0) {
-      if (strcmp(key, "Threads_running") == 0)
-        threads_running = (gauge_t)val;
-      else if (strcmp(key, "Threads_connected") == 0)
-        threads_connected = (gauge_t)val;
-      else if (strcmp(key, "Threads_cached") == 0)
-        threads_cached = (gauge_t)val;
-      else if (strcmp(key, "Threads_created") == 0)
-        threads_created = (derive_t)val;
-    } else if (strncmp(key, "Table_locks_", strlen("Table_locks_")) == 0) {
-      derive_submit("mysql_locks", key + strlen("Table_locks_"), val, db);
-    } else if (db->innodb_stats &&
-               strncmp(key, "Innodb_", strlen("Innodb_")) == 0) {
-      /* buffer pool */
-      if (strcmp(key, "Innodb_buffer_pool_pages_data") == 0)
-        gauge_submit("mysql_bpool_pages", "data", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_pages_dirty") == 0)
-        gauge_submit("mysql_bpool_pages", "dirty", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_pages_flushed") == 0)
-        derive_submit("mysql_bpool_counters", "pages_flushed", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_pages_free") == 0)
-        gauge_submit("mysql_bpool_pages", "free", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_pages_misc") == 0)
-        gauge_submit("mysql_bpool_pages", "misc", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_pages_total") == 0)
-        gauge_submit("mysql_bpool_pages", "total", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_read_ahead_rnd") == 0)
-        derive_submit("mysql_bpool_counters", "read_ahead_rnd", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_read_ahead") == 0)
-        derive_submit("mysql_bpool_counters", "read_ahead", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_read_ahead_evicted") == 0)
-        derive_submit("mysql_bpool_counters", "read_ahead_evicted", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_read_requests") == 0)
-        derive_submit("mysql_bpool_counters", "read_requests", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_reads") == 0)
-        derive_submit("mysql_bpool_counters", "reads", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_wait_free") == 0)
-        derive_submit("mysql_bpool_counters", "wait_free", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_write_requests") == 0)
-        derive_submit("mysql_bpool_counters", "write_requests", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_bytes_data") == 0)
-        gauge_submit("mysql_bpool_bytes", "data", val, db);
-      else if (strcmp(key, "Innodb_buffer_pool_bytes_dirty") == 0)
-        gauge_submit("mysql_bpool_bytes", "dirty", val, db);
-
-      /* data */
-      if (strcmp(key, "Innodb_data_fsyncs") == 0)
-        derive_submit("mysql_innodb_data", "fsyncs", val, db);
-      else if (strcmp(key, "Innodb_data_read") == 0)
-        derive_submit("mysql_innodb_data", "read", val, db);
-      else if (strcmp(key, "Innodb_data_reads") == 0)
-        derive_submit("mysql_innodb_data", "reads", val, db);
-      else if (strcmp(key, "Innodb_data_writes") == 0)
-        derive_submit("mysql_innodb_data", "writes", val, db);
-      else if (strcmp(key, "Innodb_data_written") == 0)
-        derive_submit("mysql_innodb_data", "written", val, db);
-
-      /* double write */
-      else if (strcmp(key, "Innodb_dblwr_writes") == 0)
-        derive_submit("mysql_innodb_dblwr", "writes", val, db);
-      else if (strcmp(key, "Innodb_dblwr_pages_written") == 0)
-        derive_submit("mysql_innodb_dblwr", "written", val, db);
-      else if (strcmp(key, "Innodb_dblwr_page_size") == 0)
-        gauge_submit("mysql_innodb_dblwr", "page_size", val, db);
-
-      /* log */
-      else if (strcmp(key, "Innodb_log_waits") == 0)
-        derive_submit("mysql_innodb_log", "waits", val, db);
-      else if (strcmp(key, "Innodb_log_write_requests") == 0)
-        derive_submit("mysql_innodb_log", "write_requests", val, db);
-      else if (strcmp(key, "Innodb_log_writes") == 0)
-        derive_submit("mysql_innodb_log", "writes", val, db);
-      else if (strcmp(key, "Innodb_os_log_fsyncs") == 0)
-        derive_submit("mysql_innodb_log", "fsyncs", val, db);
-      else if (strcmp(key, "Innodb_os_log_written") == 0)
-        derive_submit("mysql_innodb_log", "written", val, db);
-
-      /* pages */
-      else if (strcmp(key, "Innodb_pages_created") == 0)
-        derive_submit("mysql_innodb_pages", "created", val, db);
-      else if (strcmp(key, "Innodb_pages_read") == 0)
-        derive_submit("mysql_innodb_pages", "read", val, db);
-      else if (strcmp(key, "Innodb_pages_written") == 0)
-        derive_submit("mysql_innodb_pages", "written", val, db);
-
-      /* row lock */
-      else if (strcmp(key, "Innodb_row_lock_time") == 0)
-        derive_submit("mysql_innodb_row_lock", "time", val, db);
-      else if (strcmp(key, "Innodb_row_lock_waits") == 0)
-        derive_submit("mysql_innodb_row_lock", "waits", val, db);
-
-      /* rows */
-      else if (strcmp(key, "Innodb_rows_deleted") == 0)
-        derive_submit("mysql_innodb_rows", "deleted", val, db);
-      else if (strcmp(key, "Innodb_rows_inserted") == 0)
-        derive_submit("mysql_innodb_rows", "inserted", val, db);
-      else if (strcmp(key, "Innodb_rows_read") == 0)
-        derive_submit("mysql_innodb_rows", "read", val, db);
-      else if (strcmp(key, "Innodb_rows_updated") == 0)
-        derive_submit("mysql_innodb_rows", "updated", val, db);
-    } else if (strncmp(key, "Select_", strlen("Select_")) == 0) {
-      derive_submit("mysql_select", key + strlen("Select_"), val, db);
-    } else if (strncmp(key, "Sort_", strlen("Sort_")) == 0) {
-      if (strcmp(key, "Sort_merge_passes") == 0)
-        derive_submit("mysql_sort_merge_passes", NULL, val, db);
-      else if (strcmp(key, "Sort_rows") == 0)
-        derive_submit("mysql_sort_rows", NULL, val, db);
-      else if (strcmp(key, "Sort_range") == 0)
-        derive_submit("mysql_sort", "range", val, db);
-      else if (strcmp(key, "Sort_scan") == 0)
-        derive_submit("mysql_sort", "scan", val, db);
-
-    } else if (strncmp(key, "Slow_queries", strlen("Slow_queries")) == 0) {
-      derive_submit("mysql_slow_queries", NULL, val, db);
-    } else if (strcmp(key, "Uptime") == 0) {
-      gauge_submit("uptime", NULL, val, db);
-    } else if (strcmp(key, "Questions") == 0) {
-      gauge_submit("questions", NULL, val, db);
-    }
+    mysql_submit_status(db, row[0], strtoull(row[1], NULL, 10), collected,
+                        have);
   }
   mysql_free_result(res);
   res = NULL;
 
-  if ((qcache_hits != 0) || (qcache_inserts != 0) || (qcache_not_cached != 0) ||
-      (qcache_lowmem_prunes != 0)) {
-    derive_submit("cache_result", "qcache-hits", qcache_hits, db);
-    derive_submit("cache_result", "qcache-inserts", qcache_inserts, db);
-    derive_submit("cache_result", "qcache-not_cached", qcache_not_cached, db);
-    derive_submit("cache_result", "qcache-prunes", qcache_lowmem_prunes, db);
+  if (db->wsrep_stats && !have_wsrep)
+    ERROR("mysql plugin: Failed to get wsrep statistics: "
+          "`%s' did not return any \"wsrep_\" rows.",
+          query);
 
-    gauge_submit("cache_size", "qcache", qcache_queries_in_cache, db);
+  if ((collected[STATUS_QCACHE_HITS] != 0) ||
+      (collected[STATUS_QCACHE_INSERTS] != 0) ||
+      (collected[STATUS_QCACHE_NOT_CACHED] != 0) ||
+      (collected[STATUS_QCACHE_LOWMEM_PRUNES] != 0)) {
+    derive_submit("cache_result", "qcache-hits",
+                  (derive_t)collected[STATUS_QCACHE_HITS], db);
+    derive_submit("cache_result", "qcache-inserts",
+                  (derive_t)collected[STATUS_QCACHE_INSERTS], db);
+    derive_submit("cache_result", "qcache-not_cached",
+                  (derive_t)collected[STATUS_QCACHE_NOT_CACHED], db);
+    derive_submit("cache_result", "qcache-prunes",
+                  (derive_t)collected[STATUS_QCACHE_LOWMEM_PRUNES], db);
+
+    gauge_submit("cache_size", "qcache",
+                 collected_gauge(collected, have,
+                                 STATUS_QCACHE_QUERIES_IN_CACHE),
+                 db);
   }
 
-  if (threads_created != 0) {
-    gauge_submit("threads", "running", threads_running, db);
-    gauge_submit("threads", "connected", threads_connected, db);
-    gauge_submit("threads", "cached", threads_cached, db);
+  if (collected[STATUS_THREADS_CREATED] != 0) {
+    gauge_submit("threads", "running",
+                 collected_gauge(collected, have, STATUS_THREADS_RUNNING), db);
+    gauge_submit("threads", "connected",
+                 collected_gauge(collected, have, STATUS_THREADS_CONNECTED),
+                 db);
+    gauge_submit("threads", "cached",
+                 collected_gauge(collected, have, STATUS_THREADS_CACHED), db);
 
-    derive_submit("total_threads", "created", threads_created, db);
+    derive_submit("total_threads", "created",
+                  (derive_t)collected[STATUS_THREADS_CREATED], db);
   }
 
-  traffic_submit(traffic_incoming, traffic_outgoing, db);
+  traffic_submit((derive_t)collected[STATUS_BYTES_RECEIVED],
+                 (derive_t)collected[STATUS_BYTES_SENT], db);
 
   if (db->mysql_version >= 50600 && db->innodb_stats)
     mysql_read_innodb_stats(db, con);
@@ -958,9 +1031,6 @@ static int mysql_read(user_data_t *ud) {
   if ((db->replica_stats) || (db->replica_notif))
     mysql_read_replica_stats(db, con);
 
-  if (db->wsrep_stats)
-    mysql_read_wsrep_stats(db, con);
-
   return 0;
 } /* int mysql_read */
 
@@ -25,13 +25,19 @@
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE /* For struct ip_mreq */
 
+/* _GNU_SOURCE is needed in Linux to use recvmmsg */
+#define _GNU_SOURCE
+
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils/compress/compress.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
 #include "utils_fbhash.h"
+#include "utils_probe.h"
 
 #include "network.h"
 
@@ -41,6 +47,9 @@
 #if HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #endif
+#if HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#endif
 #if HAVE_ARPA_INET_H
 #include <arpa/inet.h>
 #endif
@@ -100,6 +109,44 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #define SECURITY_LEVEL_SIGN 1
 #define SECURITY_LEVEL_ENCRYPT 2
 #endif
+
+/* With "Protocol TCP", packets are sent over a stream connection instead of
+ * as datagrams. Each packet is preceded by its length as a 32-bit integer in
+ * network byte order. */
+#define STREAM_HEADER_SIZE 4
+/* Time a blocked send on a stream connection may take before the connection
+ * is considered dead. */
+#define STREAM_SEND_TIMEOUT 30
+/* Time to wait after a failed connection attempt. */
+#define STREAM_RECONNECT_INTERVAL TIME_T_TO_CDTIME_T_STATIC(1)
+
+/* Servers in a <ServerGroup> block share the value lists between them: each
+ * value list goes to "Replicas" of them, picked by hashing its identifier onto
+ * a ring on which every server owns SERVER_GROUP_POINTS points. Adding a
+ * server or skipping one that failed only moves the value lists that hash
+ * next to that server's points. */
+#define SERVER_GROUP_POINTS 160
+#define SERVER_GROUP_RETRY_INTERVAL TIME_T_TO_CDTIME_T_STATIC(10)
+
+struct server_group_s;
+typedef struct server_group_s server_group_t;
+
+/* One of the stream connections of a client socket, see "Connections". */
+typedef struct {
+  int fd;
+  cdtime_t next_connect;
+  pthread_mutex_t lock;
+} stream_client_t;
+
+/* A connection accepted on a stream listen socket. "buffer" holds incomplete
+ * packets. */
+typedef struct {
+  char *buffer;
+  size_t size;
+  size_t fill;
+  struct sockaddr_storage sender;
+} stream_conn_t;
+
 struct sockent_client {
   int fd;
   struct sockaddr_storage *addr;
@@ -108,22 +155,40 @@ struct sockent_client {
   int security_level;
   char *username;
   char *password;
+  /* GCRY_CIPHER_MODE_OFB or GCRY_CIPHER_MODE_GCM, see "CipherMode". */
+  int cipher_mode;
   gcry_cipher_hd_t cypher;
   unsigned char password_hash[32];
 #endif
   cdtime_t next_resolve_reconnect;
   cdtime_t resolve_interval;
   struct sockaddr_storage *bind_addr;
+  compress_algorithm_t compression;
+  /* IPPROTO_UDP or IPPROTO_TCP, see the "Protocol" option. With TCP, the
+   * packets are sent over "streams" instead of "fd". */
+  int protocol;
+  stream_client_t *streams;
+  size_t streams_num;
+
+  /* Set for servers in a <ServerGroup> block. "dest" is the index of the send
+   * buffer each thread uses for the server; it is zero for all other
+   * servers, which share one send buffer. */
+  server_group_t *group;
+  size_t dest;
+  /* A grouped server that failed is skipped until this time. */
+  cdtime_t down_until;
+  uint64_t send_errors;
 };
 
 struct sockent_server {
   int *fd;
   size_t fd_num;
+  /* IPPROTO_UDP or IPPROTO_TCP, see the "Protocol" option. */
+  int protocol;
 #if HAVE_GCRYPT_H
   int security_level;
   char *auth_file;
   fbhash_t *userdb;
-  gcry_cipher_hd_t cypher;
 #endif
 };
 
@@ -145,6 +210,25 @@ typedef struct sockent {
   pthread_mutex_t lock;
 } sockent_t;
 
+typedef struct {
+  uint64_t hash;
+  size_t server; /* index into server_group_t.servers */
+} ring_point_t;
+
+struct server_group_s {
+  char *name;
+  sockent_t **servers;
+  size_t servers_num;
+  size_t replicas;
+  cdtime_t retry_interval;
+
+  /* Sorted by hash. */
+  ring_point_t *ring;
+  size_t ring_num;
+
+  server_group_t *next;
+};
+
 /*                      1 1 1 1 1 1 1 1 1 1 2 2 2 2 2 2 2 2 2 2 3 3
  *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
  * +-------+-----------------------+-------------------------------+
@@ -252,15 +336,156 @@ struct part_encryption_aes256_s {
 };
 typedef struct part_encryption_aes256_s part_encryption_aes256_t;
 
+/*                      1 1 1 1 1 1 1 1 1 1 2 2 2 2 2 2 2 2 2 2 3 3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-------------------------------+-------------------------------+
+ * ! Type                          ! Length                        !
+ * +-------------------------------+-------------------------------+
+ * ! Username length               ! Username                      :
+ * +-------------------------------+                               :
+ * :                                                               :
+ * +---------------------------------------------------------------+
+ * ! Initialization vector (Bits  0 - 31)                          !
+ * : :                                                             :
+ * ! Initialization vector (Bits 64 - 95)                          !
+ * +---------------------------------------------------------------+
+ * ! Encrypted payload                                             :
+ * :                                                               :
+ * +---------------------------------------------------------------+
+ * ! Authentication tag (Bits   0 -  31)                           !
+ * : :                                                             :
+ * ! Authentication tag (Bits  96 - 127)                           !
+ * +---------------------------------------------------------------+
+ *
+ * The tag authenticates everything up to the initialization vector as well,
+ * so no separate hash of the payload is needed.
+ */
+/* Minimum size */
+#define PART_ENCRYPTION_AES256_GCM_SIZE 34
+#define PART_ENCRYPTION_AES256_GCM_IV_SIZE 12
+#define PART_ENCRYPTION_AES256_GCM_TAG_SIZE 16
+
+/*                      1 1 1 1 1 1 1 1 1 1 2 2 2 2 2 2 2 2 2 2 3 3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-------------------------------+-------------------------------+
+ * ! Type                          ! Length                        !
+ * +-------------------------------+-------------------------------+
+ * ! Original length               ! Gzip stream ...               :
+ * +-------------------------------+                               :
+ * :                                                               :
+ * +---------------------------------------------------------------+
+ *
+ * The gzip stream holds the parts of a complete packet. Receivers that don't
+ * know this part type skip it.
+ */
+#define PART_COMPRESSION_GZIP_SIZE 6
+
 struct receive_list_entry_s {
   char *data;
   int data_len;
-  int fd;
+  sockent_t *se;
   struct sockaddr_storage sender;
   struct receive_list_entry_s *next;
 };
 typedef struct receive_list_entry_s receive_list_entry_t;
 
+/* Maximum number of packets read with one recvmmsg(2) call. */
+#define RECEIVE_BATCH_SIZE 32
+
+/* Each receiver consists of a receive thread, which reads packets from its set
+ * of sockets, and a dispatch thread, which parses and dispatches them. With
+ * more than one receiver, each listen address is bound once per receiver
+ * using SO_REUSEPORT, so that the kernel distributes the packets. */
+struct receiver_s {
+  struct pollfd *pollfd;
+  sockent_t **pollfd_se;
+  /* The connections accepted on stream listen sockets; NULL for listen
+   * sockets. */
+  stream_conn_t **pollfd_conn;
+  size_t pollfd_num;
+  size_t pollfd_size;
+
+  /* Packets waiting to be dispatched. */
+  receive_list_entry_t *head;
+  receive_list_entry_t *tail;
+  uint64_t length;
+  /* Dispatched entries, ready to be reused by the receive thread. */
+  receive_list_entry_t *free_list;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  /* Only written to by the receive thread. */
+  derive_t octets_rx;
+  derive_t packets_rx;
+
+  bool receive_thread_running;
+  pthread_t receive_thread_id;
+  bool dispatch_thread_running;
+  pthread_t dispatch_thread_id;
+};
+typedef struct receiver_s receiver_t;
+
+/* Value lists received in one packet, which are dispatched together. */
+#define DISPATCH_BATCH_SIZE 32
+typedef struct {
+  value_list_t vl[DISPATCH_BATCH_SIZE];
+  size_t num;
+
+  /* Shared by all value lists; copied when they are enqueued. */
+  meta_data_t *meta;
+  const char *username;
+  struct sockaddr_storage *address;
+} dispatch_batch_t;
+
+/* Maximum number of finished packets sent with one sendmmsg(2) call. */
+#define SEND_BATCH_SIZE 16
+
+struct send_buffer_s;
+typedef struct send_buffer_s send_buffer_t;
+struct send_buffer_s {
+  /* Finished packets, followed by the packet currently being built. */
+  char *packets[SEND_BATCH_SIZE + 1];
+  size_t packets_len[SEND_BATCH_SIZE];
+  size_t packets_num; /* number of finished packets */
+
+  /* The packet being built, i.e. packets[packets_num]. */
+  char *buffer_ptr;
+  int buffer_fill;
+  cdtime_t first_update;
+  cdtime_t last_update;
+  value_list_t vl;
+
+  /* Space for the signed or encrypted copies of the packets. */
+  char *scratch[SEND_BATCH_SIZE];
+  /* Space for the compressed copies of the packets. Only allocated if a
+   * server uses compression. */
+  char *compressed[SEND_BATCH_SIZE];
+  compressor_t *compressor;
+#if HAVE_GCRYPT_H
+  /* One cypher and HMAC object per sending socket, so that encryption doesn't
+   * need the socket's lock and signing doesn't set up a new HMAC object for
+   * each packet. */
+  gcry_cipher_hd_t *cyphers;
+  gcry_md_hd_t *hmacs;
+#endif
+  /* Picks the connection used for stream servers. */
+  size_t index;
+  /* The servers this buffer is sent to, see sockent_client.dest. */
+  size_t dest;
+  /* With server groups, the buffer with "dest" zero holds the calling
+   * thread's buffers for all destinations, indexed by "dest". */
+  send_buffer_t **peers;
+
+  derive_t octets_tx;
+  derive_t packets_tx;
+  derive_t values_sent;
+  /* Number of packets sent on by network_relay_send(). */
+  uint64_t packets_relayed;
+
+  pthread_mutex_t lock;
+  send_buffer_t *next;
+};
+
 /*
  * Private variables
  */
@@ -268,55 +493,77 @@ static int network_config_ttl;
 /* Ethernet - (IPv6 + UDP) = 1500 - (40 + 8) = 1452 */
 static size_t network_config_packet_size = 1452;
 static bool network_config_forward;
+static bool network_config_relay;
+static uint64_t network_config_relay_sample;
 static bool network_config_stats;
+static bool network_config_drop_duplicates;
+static size_t network_config_receive_threads = 1;
 
 static sockent_t *sending_sockets;
 
-static receive_list_entry_t *receive_list_head;
-static receive_list_entry_t *receive_list_tail;
-static pthread_mutex_t receive_list_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t receive_list_cond = PTHREAD_COND_INITIALIZER;
-static uint64_t receive_list_length;
-
 static sockent_t *listen_sockets;
-static struct pollfd *listen_sockets_pollfd;
 static size_t listen_sockets_num;
 
 /* The receive and dispatch threads will run as long as `listen_loop' is set to
  * zero. */
 static int listen_loop;
-static int receive_thread_running;
-static pthread_t receive_thread_id;
-static int dispatch_thread_running;
-static pthread_t dispatch_thread_id;
-
-/* Buffer in which to-be-sent network packets are constructed. */
-static char *send_buffer;
-static char *send_buffer_ptr;
-static int send_buffer_fill;
-static cdtime_t send_buffer_last_update;
-static value_list_t send_buffer_vl = VALUE_LIST_INIT;
-static pthread_mutex_t send_buffer_lock = PTHREAD_MUTEX_INITIALIZER;
+static receiver_t *receivers;
+static size_t receivers_num;
+
+/* Buffers in which to-be-sent network packets are constructed. Each thread
+ * writing to this plugin has its own send buffer, so writers don't serialize
+ * on a single lock. All buffers are kept in the "send_buffers" list so they
+ * can be flushed and freed. */
+static send_buffer_t *send_buffers;
+static size_t send_buffers_num;
+static pthread_mutex_t send_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t send_buffer_key;
+/* Each dispatch thread has a decompressor of its own. */
+static pthread_key_t decompressor_key;
+static pthread_once_t decompressor_key_once = PTHREAD_ONCE_INIT;
+static size_t sending_sockets_num;
+/* Set if any server uses "Protocol TCP". */
+static bool have_stream_servers;
+
+static server_group_t *server_groups;
+/* One for the servers outside of groups plus one per grouped server. */
+static size_t send_dests_num = 1;
+static bool have_ungrouped_servers;
 
 /* XXX: These counters are incremented from one place only. The spot in which
  * the values are incremented is either only reachable by one thread (the
- * dispatch thread, for example) or locked by some lock (send_buffer_lock for
- * example). Only if neither is true, the stats_lock is acquired. The counters
- * are always read without holding a lock in the hope that writing 8 bytes to
- * memory is an atomic operation. */
-static derive_t stats_octets_rx;
-static derive_t stats_octets_tx;
-static derive_t stats_packets_rx;
-static derive_t stats_packets_tx;
+ * dispatch thread, for example) or locked by some lock (a send buffer's lock
+ * for example). Only if neither is true, the stats_lock is acquired. The
+ * counters are always read without holding a lock in the hope that writing 8
+ * bytes to memory is an atomic operation. */
 static derive_t stats_values_dispatched;
 static derive_t stats_values_not_dispatched;
-static derive_t stats_values_sent;
+static derive_t stats_values_duplicate;
 static derive_t stats_values_not_sent;
 static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  * Private functions
  */
+
+/* Adds to a counter that is written to by the dispatch threads. */
+static void network_stats_add(derive_t *counter, derive_t n) /* {{{ */
+{
+  if (receivers_num <= 1) {
+    (*counter) += n;
+    return;
+  }
+
+  pthread_mutex_lock(&stats_lock);
+  (*counter) += n;
+  pthread_mutex_unlock(&stats_lock);
+} /* }}} void network_stats_add */
+
+static void network_stats_inc(derive_t *counter) /* {{{ */
+{
+  network_stats_add(counter, 1);
+} /* }}} void network_stats_inc */
+
 static bool check_receive_okay(const value_list_t *vl) /* {{{ */
 {
   uint64_t time_sent = 0;
@@ -332,6 +579,20 @@ static bool check_receive_okay(const value_list_t *vl) /* {{{ */
   return 1;
 } /* }}} bool check_receive_okay */
 
+/* Returns true if the value cache already holds a value of the series of "vl"
+ * that is at least as new, e.g. because a redundant sender sent the same value
+ * first. The cache would reject "vl" anyway, but only after it has been
+ * enqueued, copied and run through the pre-cache chain. */
+static bool check_receive_duplicate(const value_list_t *vl) /* {{{ */
+{
+  cdtime_t last_time = 0;
+
+  if (uc_get_last_time(vl, &last_time) != 0)
+    return 0;
+
+  return vl->time <= last_time;
+} /* }}} bool check_receive_duplicate */
+
 static bool check_send_okay(const value_list_t *vl) /* {{{ */
 {
   bool received = 0;
@@ -393,51 +654,30 @@ static bool check_send_notify_okay(const notification_t *n) /* {{{ */
   return !received;
 } /* }}} bool check_send_notify_okay */
 
-static int network_dispatch_values(value_list_t *vl, /* {{{ */
-                                   const char *username,
-                                   struct sockaddr_storage *address) {
+/* Creates the meta data shared by all value lists received in one packet. */
+static meta_data_t *network_received_meta(const char *username, /* {{{ */
+                                          struct sockaddr_storage *address) {
   int status;
 
-  if ((vl->time == 0) || (strlen(vl->host) == 0) || (strlen(vl->plugin) == 0) ||
-      (strlen(vl->type) == 0))
-    return -EINVAL;
-
-  if (!check_receive_okay(vl)) {
-#if COLLECT_DEBUG
-    char name[6 * DATA_MAX_NAME_LEN];
-    FORMAT_VL(name, sizeof(name), vl);
-    name[sizeof(name) - 1] = '\0';
-    DEBUG("network plugin: network_dispatch_values: "
-          "NOT dispatching %s.",
-          name);
-#endif
-    stats_values_not_dispatched++;
-    return 0;
-  }
-
-  assert(vl->meta == NULL);
-
-  vl->meta = meta_data_create();
-  if (vl->meta == NULL) {
+  meta_data_t *meta = meta_data_create();
+  if (meta == NULL) {
     ERROR("network plugin: meta_data_create failed.");
-    return -ENOMEM;
+    return NULL;
   }
 
-  status = meta_data_add_boolean(vl->meta, "network:received", 1);
+  status = meta_data_add_boolean(meta, "network:received", 1);
   if (status != 0) {
     ERROR("network plugin: meta_data_add_boolean failed.");
-    meta_data_destroy(vl->meta);
-    vl->meta = NULL;
-    return status;
+    meta_data_destroy(meta);
+    return NULL;
   }
 
   if (username != NULL) {
-    status = meta_data_add_string(vl->meta, "network:username", username);
+    status = meta_data_add_string(meta, "network:username", username);
     if (status != 0) {
       ERROR("network plugin: meta_data_add_string failed.");
-      meta_data_destroy(vl->meta);
-      vl->meta = NULL;
-      return status;
+      meta_data_destroy(meta);
+      return NULL;
     }
   }
 
@@ -457,26 +697,88 @@ static int network_dispatch_values(value_list_t *vl, /* {{{ */
                          NULL, 0, NI_NUMERICHOST | NI_NUMERICSERV);
     if (status != 0) {
       ERROR("network plugin: getnameinfo failed: %s", gai_strerror(status));
-      meta_data_destroy(vl->meta);
-      vl->meta = NULL;
-      return status;
+      meta_data_destroy(meta);
+      return NULL;
     }
 
-    status = meta_data_add_string(vl->meta, "network:ip_address", host);
+    status = meta_data_add_string(meta, "network:ip_address", host);
     if (status != 0) {
       ERROR("network plugin: meta_data_add_string failed.");
-      meta_data_destroy(vl->meta);
-      vl->meta = NULL;
-      return status;
+      meta_data_destroy(meta);
+      return NULL;
+    }
+  }
+
+  return meta;
+} /* }}} meta_data_t *network_received_meta */
+
+/* Hands the batched value lists to the daemon and releases their values. */
+static void network_dispatch_flush(dispatch_batch_t *batch) /* {{{ */
+{
+  if (batch->num == 0)
+    return;
+
+  plugin_dispatch_values_batch(batch->vl, batch->num);
+  network_stats_add(&stats_values_dispatched, (derive_t)batch->num);
+
+  for (size_t i = 0; i < batch->num; i++)
+    sfree(batch->vl[i].values);
+  batch->num = 0;
+} /* }}} void network_dispatch_flush */
+
+/* Adds "vl" to "batch". The values of "vl" are owned by the batch afterwards
+ * and vl->values is reset to NULL, even if an error is returned. */
+static int network_dispatch_values(dispatch_batch_t *batch, /* {{{ */
+                                   value_list_t *vl) {
+  if ((vl->time == 0) || (strlen(vl->host) == 0) || (strlen(vl->plugin) == 0) ||
+      (strlen(vl->type) == 0)) {
+    sfree(vl->values);
+    return -EINVAL;
+  }
+
+  if (!check_receive_okay(vl)) {
+#if COLLECT_DEBUG
+    char name[6 * DATA_MAX_NAME_LEN];
+    FORMAT_VL(name, sizeof(name), vl);
+    name[sizeof(name) - 1] = '\0';
+    DEBUG("network plugin: network_dispatch_values: "
+          "NOT dispatching %s.",
+          name);
+#endif
+    network_stats_inc(&stats_values_not_dispatched);
+    sfree(vl->values);
+    return 0;
+  }
+
+  if (network_config_drop_duplicates && check_receive_duplicate(vl)) {
+    network_stats_inc(&stats_values_duplicate);
+    sfree(vl->values);
+    return 0;
+  }
+
+  assert(vl->meta == NULL);
+
+  /* The meta data is the same for the entire packet and copied when the
+   * value lists are enqueued, so it's only created once. */
+  if (batch->meta == NULL) {
+    batch->meta = network_received_meta(batch->username, batch->address);
+    if (batch->meta == NULL) {
+      sfree(vl->values);
+      return -ENOMEM;
     }
   }
 
-  plugin_dispatch_values(vl);
-  stats_values_dispatched++;
+  if (vl->ds == NULL)
+    vl->ds = plugin_get_ds(vl->type);
 
-  meta_data_destroy(vl->meta);
-  vl->meta = NULL;
+  if (batch->num >= STATIC_ARRAY_SIZE(batch->vl))
+    network_dispatch_flush(batch);
 
+  batch->vl[batch->num] = *vl;
+  batch->vl[batch->num].meta = batch->meta;
+  batch->num++;
+
+  vl->values = NULL;
   return 0;
 } /* }}} int network_dispatch_values */
 
@@ -542,36 +844,18 @@ static int network_init_gcrypt(void) /* {{{ */
   return 0;
 } /* }}} int network_init_gcrypt */
 
-static gcry_cipher_hd_t network_get_aes256_cypher(sockent_t *se, /* {{{ */
-                                                  const void *iv,
-                                                  size_t iv_size,
-                                                  const char *username) {
+/* Prepares the AES-256 cypher "*cyper_ptr" for a packet with the
+ * initialization vector "iv". The handle is opened in "mode" and keyed with
+ * "key" on first use. Later calls only reset it, which keeps the expanded key,
+ * so the key schedule is computed once per handle instead of once per
+ * packet. */
+static gcry_cipher_hd_t network_get_aes256_cypher( /* {{{ */
+    gcry_cipher_hd_t *cyper_ptr, int mode, const unsigned char *key,
+    const void *iv, size_t iv_size) {
   gcry_error_t err;
-  gcry_cipher_hd_t *cyper_ptr;
-  unsigned char password_hash[32];
-
-  if (se->type == SOCKENT_TYPE_CLIENT) {
-    cyper_ptr = &se->data.client.cypher;
-    memcpy(password_hash, se->data.client.password_hash, sizeof(password_hash));
-  } else {
-    char *secret;
-
-    cyper_ptr = &se->data.server.cypher;
-
-    if (username == NULL)
-      return NULL;
-
-    secret = fbh_get(se->data.server.userdb, username);
-    if (secret == NULL)
-      return NULL;
-
-    gcry_md_hash_buffer(GCRY_MD_SHA256, password_hash, secret, strlen(secret));
-
-    sfree(secret);
-  }
 
   if (*cyper_ptr == NULL) {
-    err = gcry_cipher_open(cyper_ptr, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_OFB,
+    err = gcry_cipher_open(cyper_ptr, GCRY_CIPHER_AES256, mode,
                            /* flags = */ 0);
     if (err != 0) {
       ERROR("network plugin: gcry_cipher_open returned: %s",
@@ -579,31 +863,150 @@ static gcry_cipher_hd_t network_get_aes256_cypher(sockent_t *se, /* {{{ */
       *cyper_ptr = NULL;
       return NULL;
     }
+
+    err = gcry_cipher_setkey(*cyper_ptr, key, 32);
+    if (err != 0) {
+      ERROR("network plugin: gcry_cipher_setkey returned: %s",
+            gcry_strerror(err));
+      gcry_cipher_close(*cyper_ptr);
+      *cyper_ptr = NULL;
+      return NULL;
+    }
   } else {
     gcry_cipher_reset(*cyper_ptr);
   }
   assert(*cyper_ptr != NULL);
 
-  err = gcry_cipher_setkey(*cyper_ptr, password_hash, sizeof(password_hash));
+  err = gcry_cipher_setiv(*cyper_ptr, iv, iv_size);
   if (err != 0) {
-    ERROR("network plugin: gcry_cipher_setkey returned: %s",
+    ERROR("network plugin: gcry_cipher_setiv returned: %s",
           gcry_strerror(err));
     gcry_cipher_close(*cyper_ptr);
     *cyper_ptr = NULL;
     return NULL;
   }
 
-  err = gcry_cipher_setiv(*cyper_ptr, iv, iv_size);
+  return *cyper_ptr;
+} /* }}} gcry_cipher_hd_t network_get_aes256_cypher */
+
+/* Returns an HMAC-SHA-256 object keyed with "secret". If "hd_ptr" is not NULL,
+ * the object is kept there and reused by later calls; otherwise the caller has
+ * to close it. */
+static gcry_md_hd_t network_get_hmac(const char *secret, /* {{{ */
+                                     gcry_md_hd_t *hd_ptr) {
+  if ((hd_ptr != NULL) && (*hd_ptr != NULL)) {
+    /* Resetting keeps the key. */
+    gcry_md_reset(*hd_ptr);
+    return *hd_ptr;
+  }
+
+  gcry_md_hd_t hd = NULL;
+  gcry_error_t err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
   if (err != 0) {
-    ERROR("network plugin: gcry_cipher_setkey returned: %s",
+    ERROR("network plugin: Creating HMAC object failed: %s",
           gcry_strerror(err));
-    gcry_cipher_close(*cyper_ptr);
-    *cyper_ptr = NULL;
     return NULL;
   }
 
-  return *cyper_ptr;
-} /* }}} int network_get_aes256_cypher */
+  err = gcry_md_setkey(hd, secret, strlen(secret));
+  if (err != 0) {
+    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
+    gcry_md_close(hd);
+    return NULL;
+  }
+
+  if (hd_ptr != NULL)
+    *hd_ptr = hd;
+  return hd;
+} /* }}} gcry_md_hd_t network_get_hmac */
+
+/* The keyed crypto objects of one user of an AuthFile. Each dispatch thread
+ * keeps its own, so that signed and encrypted packets are checked in parallel
+ * and without setting up the keys for every packet. */
+typedef struct {
+  char *secret;
+  unsigned char key[32];
+  gcry_md_hd_t hmac;
+  gcry_cipher_hd_t ofb;
+  gcry_cipher_hd_t gcm;
+} crypto_user_t;
+
+static pthread_key_t crypto_users_key;
+static pthread_once_t crypto_users_key_once = PTHREAD_ONCE_INIT;
+
+static void crypto_user_clear(crypto_user_t *cu) /* {{{ */
+{
+  sfree(cu->secret);
+  if (cu->hmac != NULL)
+    gcry_md_close(cu->hmac);
+  if (cu->ofb != NULL)
+    gcry_cipher_close(cu->ofb);
+  if (cu->gcm != NULL)
+    gcry_cipher_close(cu->gcm);
+  memset(cu, 0, sizeof(*cu));
+} /* }}} void crypto_user_clear */
+
+static void crypto_users_free(void *arg) /* {{{ */
+{
+  c_avl_tree_t *users = arg;
+  char *username = NULL;
+  crypto_user_t *cu = NULL;
+
+  while (c_avl_pick(users, (void *)&username, (void *)&cu) == 0) {
+    crypto_user_clear(cu);
+    sfree(cu);
+    sfree(username);
+  }
+  c_avl_destroy(users);
+} /* }}} void crypto_users_free */
+
+static void crypto_users_key_create(void) /* {{{ */
+{
+  pthread_key_create(&crypto_users_key, crypto_users_free);
+} /* }}} void crypto_users_key_create */
+
+/* Returns the calling thread's crypto objects for "username", or NULL if the
+ * user is not in the AuthFile of "se". The objects are set up again when the
+ * user's password changes. */
+static crypto_user_t *crypto_user_get(sockent_t *se, /* {{{ */
+                                      const char *username) {
+  char *secret = fbh_get(se->data.server.userdb, username);
+  if (secret == NULL)
+    return NULL;
+
+  pthread_once(&crypto_users_key_once, crypto_users_key_create);
+  c_avl_tree_t *users = pthread_getspecific(crypto_users_key);
+  if (users == NULL) {
+    users = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (users == NULL) {
+      sfree(secret);
+      return NULL;
+    }
+    pthread_setspecific(crypto_users_key, users);
+  }
+
+  crypto_user_t *cu = NULL;
+  if (c_avl_get(users, username, (void *)&cu) == 0) {
+    if (strcmp(cu->secret, secret) == 0) {
+      sfree(secret);
+      return cu;
+    }
+    crypto_user_clear(cu);
+  } else {
+    char *key = strdup(username);
+    cu = calloc(1, sizeof(*cu));
+    if ((key == NULL) || (cu == NULL) || (c_avl_insert(users, key, cu) != 0)) {
+      sfree(key);
+      sfree(cu);
+      sfree(secret);
+      return NULL;
+    }
+  }
+
+  cu->secret = secret;
+  gcry_md_hash_buffer(GCRY_MD_SHA256, cu->key, secret, strlen(secret));
+  return cu;
+} /* }}} crypto_user_t *crypto_user_get */
 #endif /* HAVE_GCRYPT_H */
 
 static int write_part_values(char **ret_buffer, size_t *ret_buffer_len,
@@ -915,8 +1318,13 @@ static int parse_part_number(void **ret_buffer, size_t *ret_buffer_len,
   return 0;
 } /* int parse_part_number */
 
-static int parse_part_string(void **ret_buffer, size_t *ret_buffer_len,
-                             char *output, size_t const output_len) {
+/* Validates a string part and returns a pointer to the string inside the
+ * packet in "ret_string". "ret_string_size" is the size of the string
+ * including the terminating null byte. */
+static int parse_part_string_ptr(void **ret_buffer, /* {{{ */
+                                 size_t *ret_buffer_len,
+                                 const char **ret_string,
+                                 size_t *ret_string_size) {
   char *buffer = *ret_buffer;
   size_t buffer_len = *ret_buffer_len;
 
@@ -926,9 +1334,6 @@ static int parse_part_string(void **ret_buffer, size_t *ret_buffer_len,
   uint16_t pkg_length;
   size_t payload_size;
 
-  if (output_len == 0)
-    return EINVAL;
-
   if (buffer_len < header_size) {
     WARNING("network plugin: parse_part_string: "
             "Packet too short: "
@@ -967,34 +1372,55 @@ static int parse_part_string(void **ret_buffer, size_t *ret_buffer_len,
     return -1;
   }
 
-  /* Check that the package data fits into the output buffer.
-   * The previous if-statement ensures that:
-   * `pkg_length > header_size' */
-  if (output_len < payload_size) {
+  /* For some very weird reason '\0' doesn't do the trick on SPARC in
+   * this statement. */
+  if (buffer[payload_size - 1] != 0) {
+    WARNING("network plugin: parse_part_string: "
+            "Received string does not end "
+            "with a NULL-byte.");
+    return -1;
+  }
+
+  *ret_string = buffer;
+  *ret_string_size = payload_size;
+
+  *ret_buffer = buffer + payload_size;
+  *ret_buffer_len = buffer_len - pkg_length;
+
+  return 0;
+} /* }}} int parse_part_string_ptr */
+
+static int parse_part_string(void **ret_buffer, size_t *ret_buffer_len,
+                             char *output, size_t const output_len) {
+  void *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+  const char *string;
+  size_t string_size;
+  int status;
+
+  if (output_len == 0)
+    return EINVAL;
+
+  status = parse_part_string_ptr(&buffer, &buffer_len, &string, &string_size);
+  if (status != 0)
+    return status;
+
+  /* Check that the string fits into the output buffer. */
+  if (output_len < string_size) {
     WARNING("network plugin: parse_part_string: "
             "Buffer too small: "
             "Output buffer holds %" PRIsz " bytes, "
             "which is too small to hold the received "
             "%" PRIsz " byte string.",
-            output_len, payload_size);
+            output_len, string_size);
     return -1;
   }
 
   /* All sanity checks successfull, let's copy the data over */
-  memcpy((void *)output, (void *)buffer, payload_size);
-  buffer += payload_size;
-
-  /* For some very weird reason '\0' doesn't do the trick on SPARC in
-   * this statement. */
-  if (output[payload_size - 1] != 0) {
-    WARNING("network plugin: parse_part_string: "
-            "Received string does not end "
-            "with a NULL-byte.");
-    return -1;
-  }
+  memcpy((void *)output, string, string_size);
 
   *ret_buffer = buffer;
-  *ret_buffer_len = buffer_len - pkg_length;
+  *ret_buffer_len = buffer_len;
 
   return 0;
 } /* int parse_part_string */
@@ -1003,9 +1429,14 @@ static int parse_part_string(void **ret_buffer, size_t *ret_buffer_len,
  * parse_packet and vice versa. */
 #define PP_SIGNED 0x01
 #define PP_ENCRYPTED 0x02
+#define PP_COMPRESSED 0x04
+/* The packet is sent on unchanged instead of being decoded, see "Relay". */
+#define PP_RELAY 0x08
 static int parse_packet(sockent_t *se, void *buffer, size_t buffer_size,
                         int flags, const char *username,
                         struct sockaddr_storage *sender);
+static bool network_relay_send(const void *buffer, size_t buffer_size);
+static void network_relay_flush(void);
 
 #define BUFFER_READ(p, s)                                                      \
   do {                                                                         \
@@ -1024,14 +1455,12 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
   size_t buffer_offset;
 
   size_t username_len;
-  char *secret;
 
   part_signature_sha256_t pss;
   uint16_t pss_head_length;
   char hash[sizeof(pss.hash)];
 
   gcry_md_hd_t hd;
-  gcry_error_t err;
   unsigned char *hash_ptr;
 
   buffer = *ret_buffer;
@@ -1081,30 +1510,16 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
 
   assert(buffer_offset == pss_head_length);
 
-  /* Query the password */
-  secret = fbh_get(se->data.server.userdb, pss.username);
-  if (secret == NULL) {
+  /* Look up the user's HMAC object */
+  crypto_user_t *cu = crypto_user_get(se, pss.username);
+  if (cu == NULL) {
     ERROR("network plugin: Unknown user: %s", pss.username);
     sfree(pss.username);
     return -ENOENT;
   }
 
-  /* Create a hash device and check the HMAC */
-  hd = NULL;
-  err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
-  if (err != 0) {
-    ERROR("network plugin: Creating HMAC-SHA-256 object failed: %s",
-          gcry_strerror(err));
-    sfree(secret);
-    sfree(pss.username);
-    return -1;
-  }
-
-  err = gcry_md_setkey(hd, secret, strlen(secret));
-  if (err != 0) {
-    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
-    gcry_md_close(hd);
-    sfree(secret);
+  hd = network_get_hmac(cu->secret, &cu->hmac);
+  if (hd == NULL) {
     sfree(pss.username);
     return -1;
   }
@@ -1114,17 +1529,11 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
   hash_ptr = gcry_md_read(hd, GCRY_MD_SHA256);
   if (hash_ptr == NULL) {
     ERROR("network plugin: gcry_md_read failed.");
-    gcry_md_close(hd);
-    sfree(secret);
     sfree(pss.username);
     return -1;
   }
   memcpy(hash, hash_ptr, sizeof(hash));
 
-  /* Clean up */
-  gcry_md_close(hd);
-  hd = NULL;
-
   if (memcmp(pss.hash, hash, sizeof(pss.hash)) != 0) {
     WARNING("network plugin: Verifying HMAC-SHA-256 signature failed: "
             "Hash mismatch. Username: %s",
@@ -1134,7 +1543,6 @@ static int parse_part_sign_sha256(sockent_t *se, /* {{{ */
                  flags | PP_SIGNED, pss.username, sender);
   }
 
-  sfree(secret);
   sfree(pss.username);
 
   *ret_buffer = buffer + buffer_len;
@@ -1250,7 +1658,11 @@ static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
   assert(buffer_offset ==
          (username_len + PART_ENCRYPTION_AES256_SIZE - sizeof(pea.hash)));
 
-  cypher = network_get_aes256_cypher(se, pea.iv, sizeof(pea.iv), pea.username);
+  crypto_user_t *cu = crypto_user_get(se, pea.username);
+  cypher = NULL;
+  if (cu != NULL)
+    cypher = network_get_aes256_cypher(&cu->ofb, GCRY_CIPHER_MODE_OFB, cu->key,
+                                       pea.iv, sizeof(pea.iv));
   if (cypher == NULL) {
     ERROR("network plugin: Failed to get cypher. Username: %s", pea.username);
     sfree(pea.username);
@@ -1297,34 +1709,118 @@ static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
 
   return 0;
 } /* }}} int parse_part_encr_aes256 */
-/* #endif HAVE_GCRYPT_H */
 
-#else  /* if !HAVE_GCRYPT_H */
-static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
-                                  void **ret_buffer, size_t *ret_buffer_size,
-                                  int flags, struct sockaddr_storage *sender) {
-  static int warning_has_been_printed;
-
-  char *buffer;
-  size_t buffer_size;
-  size_t buffer_offset;
+static int parse_part_encr_aes256_gcm(sockent_t *se, /* {{{ */
+                                      void **ret_buffer,
+                                      size_t *ret_buffer_len, int flags,
+                                      struct sockaddr_storage *sender) {
+  char *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+  size_t buffer_offset = 0;
 
   part_header_t ph;
-  size_t ph_length;
-
-  buffer = *ret_buffer;
-  buffer_size = *ret_buffer_size;
-  buffer_offset = 0;
+  uint16_t username_len;
 
-  /* parse_packet assures this minimum size. */
-  assert(buffer_size >= (sizeof(ph.type) + sizeof(ph.length)));
+  if (buffer_len <= PART_ENCRYPTION_AES256_GCM_SIZE) {
+    NOTICE("network plugin: parse_part_encr_aes256_gcm: "
+           "Discarding short packet.");
+    return -1;
+  }
 
   BUFFER_READ(&ph.type, sizeof(ph.type));
   BUFFER_READ(&ph.length, sizeof(ph.length));
-  ph_length = ntohs(ph.length);
 
-  if ((ph_length <= PART_ENCRYPTION_AES256_SIZE) || (ph_length > buffer_size)) {
-    ERROR("network plugin: AES-256 encrypted part "
+  size_t part_size = ntohs(ph.length);
+  if ((part_size <= PART_ENCRYPTION_AES256_GCM_SIZE) ||
+      (part_size > buffer_len)) {
+    NOTICE("network plugin: parse_part_encr_aes256_gcm: "
+           "Discarding part with invalid size.");
+    return -1;
+  }
+
+  BUFFER_READ(&username_len, sizeof(username_len));
+  username_len = ntohs(username_len);
+
+  if ((username_len == 0) ||
+      (username_len > (part_size - (PART_ENCRYPTION_AES256_GCM_SIZE + 1)))) {
+    NOTICE("network plugin: parse_part_encr_aes256_gcm: "
+           "Discarding part with invalid username length.");
+    return -1;
+  }
+
+  char username[username_len + 1];
+  BUFFER_READ(username, username_len);
+  username[username_len] = 0;
+
+  char const *iv = buffer + buffer_offset;
+  buffer_offset += PART_ENCRYPTION_AES256_GCM_IV_SIZE;
+
+  size_t payload_len =
+      part_size - (buffer_offset + PART_ENCRYPTION_AES256_GCM_TAG_SIZE);
+  char const *tag = buffer + buffer_offset + payload_len;
+
+  crypto_user_t *cu = crypto_user_get(se, username);
+  gcry_cipher_hd_t cypher = NULL;
+  if (cu != NULL)
+    cypher = network_get_aes256_cypher(&cu->gcm, GCRY_CIPHER_MODE_GCM, cu->key,
+                                       iv, PART_ENCRYPTION_AES256_GCM_IV_SIZE);
+  if (cypher == NULL) {
+    ERROR("network plugin: Failed to get cypher. Username: %s", username);
+    return -1;
+  }
+
+  /* The header is authenticated, too. */
+  gcry_error_t err = gcry_cipher_authenticate(cypher, buffer, buffer_offset);
+  if (err == 0)
+    err = gcry_cipher_decrypt(cypher, buffer + buffer_offset, payload_len,
+                              /* in = */ NULL, /* in len = */ 0);
+  if (err == 0)
+    err = gcry_cipher_checktag(cypher, tag,
+                               PART_ENCRYPTION_AES256_GCM_TAG_SIZE);
+  if (err != 0) {
+    ERROR("network plugin: Decrypting AES-256-GCM part failed: %s. "
+          "Username: %s",
+          gcry_strerror(err), username);
+    return -1;
+  }
+
+  parse_packet(se, buffer + buffer_offset, payload_len, flags | PP_ENCRYPTED,
+               username, sender);
+
+  *ret_buffer = buffer + part_size;
+  *ret_buffer_len = buffer_len - part_size;
+
+  return 0;
+} /* }}} int parse_part_encr_aes256_gcm */
+/* #endif HAVE_GCRYPT_H */
+
+#else  /* if !HAVE_GCRYPT_H */
+static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
+                                  void **ret_buffer, size_t *ret_buffer_size,
+                                  int flags, struct sockaddr_storage *sender) {
+  static int warning_has_been_printed;
+
+  char *buffer;
+  size_t buffer_size;
+  size_t buffer_offset;
+
+  part_header_t ph;
+  size_t ph_length;
+
+  buffer = *ret_buffer;
+  buffer_size = *ret_buffer_size;
+  buffer_offset = 0;
+
+  /* parse_packet assures this minimum size. */
+  assert(buffer_size >= (sizeof(ph.type) + sizeof(ph.length)));
+
+  BUFFER_READ(&ph.type, sizeof(ph.type));
+  BUFFER_READ(&ph.length, sizeof(ph.length));
+  ph_length = ntohs(ph.length);
+
+  if ((ph_length <= PART_ENCRYPTION_AES256_GCM_SIZE) ||
+      (ph_length > buffer_size)) {
+    ERROR("network plugin: AES-256 encrypted part "
           "with invalid length received.");
     return -1;
   }
@@ -1341,10 +1837,137 @@ static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
 
   return 0;
 } /* }}} int parse_part_encr_aes256 */
+
+static int parse_part_encr_aes256_gcm(sockent_t *se, /* {{{ */
+                                      void **ret_buffer,
+                                      size_t *ret_buffer_size, int flags,
+                                      struct sockaddr_storage *sender) {
+  return parse_part_encr_aes256(se, ret_buffer, ret_buffer_size, flags,
+                                sender);
+} /* }}} int parse_part_encr_aes256_gcm */
 #endif /* !HAVE_GCRYPT_H */
 
+static void decompressor_free(void *d) /* {{{ */
+{
+  decompressor_destroy(d);
+} /* }}} void decompressor_free */
+
+static void decompressor_key_create(void) /* {{{ */
+{
+  pthread_key_create(&decompressor_key, decompressor_free);
+} /* }}} void decompressor_key_create */
+
+static int parse_part_compr_gzip(sockent_t *se, /* {{{ */
+                                 void **ret_buffer, size_t *ret_buffer_size,
+                                 int flags, const char *username,
+                                 struct sockaddr_storage *sender) {
+  static c_complain_t complain_unsupported = C_COMPLAIN_INIT_STATIC;
+
+  char *buffer = *ret_buffer;
+  size_t buffer_size = *ret_buffer_size;
+  size_t buffer_offset = 0;
+
+  part_header_t ph;
+  uint16_t orig_length;
+
+  /* parse_packet assures this minimum size. */
+  assert(buffer_size >= (sizeof(ph.type) + sizeof(ph.length)));
+
+  BUFFER_READ(&ph.type, sizeof(ph.type));
+  BUFFER_READ(&ph.length, sizeof(ph.length));
+  size_t part_size = (size_t)ntohs(ph.length);
+
+  if ((part_size <= PART_COMPRESSION_GZIP_SIZE) || (part_size > buffer_size)) {
+    NOTICE("network plugin: parse_part_compr_gzip: "
+           "Discarding part with invalid length.");
+    return -1;
+  }
+
+  /* Compressed packets are never nested. */
+  if (flags & PP_COMPRESSED) {
+    NOTICE("network plugin: parse_part_compr_gzip: "
+           "Discarding nested compressed part.");
+    return -1;
+  }
+
+  BUFFER_READ(&orig_length, sizeof(orig_length));
+  orig_length = ntohs(orig_length);
+
+  pthread_once(&decompressor_key_once, decompressor_key_create);
+  decompressor_t *d = pthread_getspecific(decompressor_key);
+  if (d == NULL) {
+    d = decompressor_create(COMPRESS_GZIP);
+    if (d == NULL) {
+      c_complain(LOG_WARNING, &complain_unsupported,
+                 "network plugin: Received a compressed packet, but "
+                 "decompressor_create failed: %s. Compressed parts will be "
+                 "discarded.",
+                 STRERRNO);
+      *ret_buffer = buffer + part_size;
+      *ret_buffer_size = buffer_size - part_size;
+      return 0;
+    }
+    pthread_setspecific(decompressor_key, d);
+  }
+
+  void const *payload = NULL;
+  size_t payload_size = 0;
+  int status = decompressor_decompress(d, buffer + buffer_offset,
+                                       part_size - buffer_offset, orig_length,
+                                       &payload, &payload_size);
+  if ((status != 0) || (payload_size != orig_length)) {
+    NOTICE("network plugin: parse_part_compr_gzip: "
+           "Decompressing the part failed: %s",
+           (status != 0) ? STRERROR(status) : "length mismatch");
+    return -1;
+  }
+
+  /* parse_packet may decrypt parts in-place; the buffer belongs to the
+   * decompressor, so that is fine. */
+  parse_packet(se, (void *)payload, payload_size, flags | PP_COMPRESSED,
+               username, sender);
+
+  *ret_buffer = buffer + part_size;
+  *ret_buffer_size = buffer_size - part_size;
+
+  return 0;
+} /* }}} int parse_part_compr_gzip */
+
 #undef BUFFER_READ
 
+/* What to do with a packet in relay mode, see network_relay_packet(). */
+#define RELAY_SENT 0
+#define RELAY_SAMPLE 1
+#define RELAY_UNWRAP 2
+#define RELAY_DROP 3
+
+/* Sends a packet received in relay mode on to the servers. Signed or
+ * encrypted packets that the socket can check are unwrapped first, so that
+ * they are sent signed or encrypted for each server; everything else is sent
+ * on unchanged. Returns RELAY_SAMPLE if the packet is also to be decoded and
+ * dispatched locally. */
+static int network_relay_packet(sockent_t *se, void *buffer, /* {{{ */
+                                size_t buffer_size, int flags) {
+  uint16_t type = 0;
+  memcpy(&type, buffer, sizeof(type));
+  type = ntohs(type);
+
+#if HAVE_GCRYPT_H
+  if ((se->data.server.userdb != NULL) &&
+      ((type == TYPE_SIGN_SHA256) || (type == TYPE_ENCR_AES256) ||
+       (type == TYPE_ENCR_AES256_GCM)))
+    return RELAY_UNWRAP;
+
+  if (((se->data.server.security_level == SECURITY_LEVEL_ENCRYPT) &&
+       !(flags & PP_ENCRYPTED)) ||
+      ((se->data.server.security_level == SECURITY_LEVEL_SIGN) &&
+       !(flags & (PP_ENCRYPTED | PP_SIGNED))))
+    return RELAY_DROP;
+#endif
+
+  return network_relay_send(buffer, buffer_size) ? RELAY_SAMPLE : RELAY_SENT;
+} /* }}} int network_relay_packet */
+
 static int parse_packet(sockent_t *se, /* {{{ */
                         void *buffer, size_t buffer_size, int flags,
                         const char *username,
@@ -1353,6 +1976,7 @@ static int parse_packet(sockent_t *se, /* {{{ */
 
   value_list_t vl = VALUE_LIST_INIT;
   notification_t n = {0};
+  dispatch_batch_t batch = {.username = username, .address = address};
 
 #if HAVE_GCRYPT_H
   int packet_was_signed = (flags & PP_SIGNED);
@@ -1360,6 +1984,14 @@ static int parse_packet(sockent_t *se, /* {{{ */
   int printed_ignore_warning = 0;
 #endif /* HAVE_GCRYPT_H */
 
+  if ((flags & PP_RELAY) && (buffer_size > sizeof(part_header_t))) {
+    int relay = network_relay_packet(se, buffer, buffer_size, flags);
+    if (relay == RELAY_SAMPLE)
+      flags &= ~PP_RELAY;
+    else if (relay != RELAY_UNWRAP)
+      return 0;
+  }
+
   memset(&vl, '\0', sizeof(vl));
   status = 0;
 
@@ -1381,6 +2013,14 @@ static int parse_packet(sockent_t *se, /* {{{ */
     if (pkg_length < (2 * sizeof(uint16_t)))
       break;
 
+    /* When relaying, only the signed and encrypted parts are unwrapped. */
+    if ((flags & PP_RELAY) && (pkg_type != TYPE_SIGN_SHA256) &&
+        (pkg_type != TYPE_ENCR_AES256) && (pkg_type != TYPE_ENCR_AES256_GCM)) {
+      buffer = ((char *)buffer) + pkg_length;
+      buffer_size -= (size_t)pkg_length;
+      continue;
+    }
+
     if (pkg_type == TYPE_ENCR_AES256) {
       status =
           parse_part_encr_aes256(se, &buffer, &buffer_size, flags, address);
@@ -1391,6 +2031,11 @@ static int parse_packet(sockent_t *se, /* {{{ */
               status);
         break;
       }
+    } else if (pkg_type == TYPE_ENCR_AES256_GCM) {
+      status = parse_part_encr_aes256_gcm(se, &buffer, &buffer_size, flags,
+                                          address);
+      if (status != 0)
+        break;
     }
 #if HAVE_GCRYPT_H
     else if ((se->data.server.security_level == SECURITY_LEVEL_ENCRYPT) &&
@@ -1429,29 +2074,28 @@ static int parse_packet(sockent_t *se, /* {{{ */
       continue;
     }
 #endif /* HAVE_GCRYPT_H */
-    else if (pkg_type == TYPE_VALUES) {
+    else if (pkg_type == TYPE_COMPR_GZIP) {
+      status = parse_part_compr_gzip(se, &buffer, &buffer_size, flags,
+                                     username, address);
+      if (status != 0)
+        break;
+    } else if (pkg_type == TYPE_VALUES) {
       status =
           parse_part_values(&buffer, &buffer_size, &vl.values, &vl.values_len);
       if (status != 0)
         break;
 
-      network_dispatch_values(&vl, username, address);
-
-      sfree(vl.values);
+      network_dispatch_values(&batch, &vl);
     } else if (pkg_type == TYPE_TIME) {
       uint64_t tmp = 0;
       status = parse_part_number(&buffer, &buffer_size, &tmp);
-      if (status == 0) {
+      if (status == 0)
         vl.time = TIME_T_TO_CDTIME_T(tmp);
-        n.time = TIME_T_TO_CDTIME_T(tmp);
-      }
     } else if (pkg_type == TYPE_TIME_HR) {
       uint64_t tmp = 0;
       status = parse_part_number(&buffer, &buffer_size, &tmp);
-      if (status == 0) {
+      if (status == 0)
         vl.time = (cdtime_t)tmp;
-        n.time = (cdtime_t)tmp;
-      }
     } else if (pkg_type == TYPE_INTERVAL) {
       uint64_t tmp = 0;
       status = parse_part_number(&buffer, &buffer_size, &tmp);
@@ -1465,33 +2109,48 @@ static int parse_packet(sockent_t *se, /* {{{ */
     } else if (pkg_type == TYPE_HOST) {
       status =
           parse_part_string(&buffer, &buffer_size, vl.host, sizeof(vl.host));
-      if (status == 0)
-        sstrncpy(n.host, vl.host, sizeof(n.host));
     } else if (pkg_type == TYPE_PLUGIN) {
       status = parse_part_string(&buffer, &buffer_size, vl.plugin,
                                  sizeof(vl.plugin));
-      if (status == 0)
-        sstrncpy(n.plugin, vl.plugin, sizeof(n.plugin));
     } else if (pkg_type == TYPE_PLUGIN_INSTANCE) {
       status = parse_part_string(&buffer, &buffer_size, vl.plugin_instance,
                                  sizeof(vl.plugin_instance));
-      if (status == 0)
-        sstrncpy(n.plugin_instance, vl.plugin_instance,
-                 sizeof(n.plugin_instance));
     } else if (pkg_type == TYPE_TYPE) {
-      status =
-          parse_part_string(&buffer, &buffer_size, vl.type, sizeof(vl.type));
-      if (status == 0)
-        sstrncpy(n.type, vl.type, sizeof(n.type));
+      const char *type;
+      size_t type_size;
+      status = parse_part_string_ptr(&buffer, &buffer_size, &type, &type_size);
+      if (status != 0)
+        break;
+      if (type_size > sizeof(vl.type)) {
+        WARNING("network plugin: parse_packet: Ignoring type part: "
+                "String of %" PRIsz " bytes is too long.",
+                type_size);
+        status = -1;
+        break;
+      }
+
+      /* Senders only repeat the type when it changes, but keep the resolved
+       * data set if it is the same nonetheless. */
+      if (memcmp(vl.type, type, type_size) != 0) {
+        memcpy(vl.type, type, type_size);
+        vl.ds = NULL;
+      }
     } else if (pkg_type == TYPE_TYPE_INSTANCE) {
       status = parse_part_string(&buffer, &buffer_size, vl.type_instance,
                                  sizeof(vl.type_instance));
-      if (status == 0)
-        sstrncpy(n.type_instance, vl.type_instance, sizeof(n.type_instance));
     } else if (pkg_type == TYPE_MESSAGE) {
       status = parse_part_string(&buffer, &buffer_size, n.message,
                                  sizeof(n.message));
 
+      /* The identifier and time are only copied into the notification when
+       * it is complete, rather than for every part. */
+      n.time = vl.time;
+      sstrncpy(n.host, vl.host, sizeof(n.host));
+      sstrncpy(n.plugin, vl.plugin, sizeof(n.plugin));
+      sstrncpy(n.plugin_instance, vl.plugin_instance, sizeof(n.plugin_instance));
+      sstrncpy(n.type, vl.type, sizeof(n.type));
+      sstrncpy(n.type_instance, vl.type_instance, sizeof(n.type_instance));
+
       if (status != 0) {
         /* do nothing */
       } else if ((n.severity != NOTIF_FAILURE) &&
@@ -1525,6 +2184,9 @@ static int parse_packet(sockent_t *se, /* {{{ */
     }
   } /* while (buffer_size > sizeof (part_header_t)) */
 
+  network_dispatch_flush(&batch);
+  meta_data_destroy(batch.meta);
+
   if (status == 0 && buffer_size > 0)
     WARNING("network plugin: parse_packet: Received truncated "
             "packet, try increasing `MaxPacketSize'");
@@ -1540,6 +2202,14 @@ static void free_sockent_client(struct sockent_client *sec) /* {{{ */
   }
   sfree(sec->addr);
   sfree(sec->bind_addr);
+  if (sec->streams != NULL) {
+    for (size_t i = 0; i < sec->streams_num; i++) {
+      if (sec->streams[i].fd >= 0)
+        close(sec->streams[i].fd);
+      pthread_mutex_destroy(&sec->streams[i].lock);
+    }
+    sfree(sec->streams);
+  }
 #if HAVE_GCRYPT_H
   sfree(sec->username);
   sfree(sec->password);
@@ -1561,8 +2231,6 @@ static void free_sockent_server(struct sockent_server *ses) /* {{{ */
 #if HAVE_GCRYPT_H
   sfree(ses->auth_file);
   fbh_destroy(ses->userdb);
-  if (ses->cypher != NULL)
-    gcry_cipher_close(ses->cypher);
 #endif
 } /* }}} void free_sockent_server */
 
@@ -1723,13 +2391,13 @@ static int network_set_interface(const sockent_t *se,
   return 0;
 } /* }}} network_set_interface */
 
-static int network_bind_socket_to_addr(sockent_t *se,
+static int network_bind_socket_to_addr(sockent_t *se, int fd,
                                        const struct addrinfo *ai) {
 
   if (se->data.client.bind_addr == NULL)
     return 0;
 
-  DEBUG("network_plugin: fd %i: bind socket to address", se->data.client.fd);
+  DEBUG("network_plugin: fd %i: bind socket to address", fd);
   char pbuffer[64];
 
   if (ai->ai_family == AF_INET) {
@@ -1737,8 +2405,7 @@ static int network_bind_socket_to_addr(sockent_t *se,
         (struct sockaddr_in *)(se->data.client.bind_addr);
     inet_ntop(AF_INET, &(addr->sin_addr), pbuffer, 64);
     DEBUG("network_plugin: binding client socket to ipv4 address: %s", pbuffer);
-    if (bind(se->data.client.fd, (struct sockaddr *)addr, sizeof(*addr)) ==
-        -1) {
+    if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) == -1) {
       ERROR("network plugin: failed to bind client socket (ipv4) to %s: %s",
             pbuffer, STRERRNO);
       return -1;
@@ -1748,8 +2415,7 @@ static int network_bind_socket_to_addr(sockent_t *se,
         (struct sockaddr_in6 *)(se->data.client.bind_addr);
     inet_ntop(AF_INET6, &(addr->sin6_addr), pbuffer, 64);
     DEBUG("network_plugin: binding client socket to ipv6 address: %s", pbuffer);
-    if (bind(se->data.client.fd, (struct sockaddr *)addr, sizeof(*addr)) ==
-        -1) {
+    if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) == -1) {
       ERROR("network plugin: failed to bind client socket (ipv6) to %s: %s",
             pbuffer, STRERRNO);
       return -1;
@@ -1759,6 +2425,19 @@ static int network_bind_socket_to_addr(sockent_t *se,
   return 0;
 } /* int network_bind_socket_to_addr */
 
+static bool network_addr_is_multicast(const struct addrinfo *ai) /* {{{ */
+{
+  if (ai->ai_family == AF_INET) {
+    struct sockaddr_in *addr = (struct sockaddr_in *)ai->ai_addr;
+    return IN_MULTICAST(ntohl(addr->sin_addr.s_addr));
+  } else if (ai->ai_family == AF_INET6) {
+    struct sockaddr_in6 *addr = (struct sockaddr_in6 *)ai->ai_addr;
+    return IN6_IS_ADDR_MULTICAST(&addr->sin6_addr);
+  }
+
+  return false;
+} /* }}} bool network_addr_is_multicast */
+
 static int network_bind_socket(int fd, const struct addrinfo *ai,
                                const int interface_idx) {
 #if KERNEL_SOLARIS
@@ -1901,11 +2580,11 @@ static sockent_t *sockent_create(int type) /* {{{ */
   if (type == SOCKENT_TYPE_SERVER) {
     se->data.server.fd = NULL;
     se->data.server.fd_num = 0;
+    se->data.server.protocol = IPPROTO_UDP;
 #if HAVE_GCRYPT_H
     se->data.server.security_level = SECURITY_LEVEL_NONE;
     se->data.server.auth_file = NULL;
     se->data.server.userdb = NULL;
-    se->data.server.cypher = NULL;
 #endif
   } else {
     se->data.client.fd = -1;
@@ -1913,10 +2592,14 @@ static sockent_t *sockent_create(int type) /* {{{ */
     se->data.client.bind_addr = NULL;
     se->data.client.resolve_interval = 0;
     se->data.client.next_resolve_reconnect = 0;
+    se->data.client.protocol = IPPROTO_UDP;
+    se->data.client.streams = NULL;
+    se->data.client.streams_num = 1;
 #if HAVE_GCRYPT_H
     se->data.client.security_level = SECURITY_LEVEL_NONE;
     se->data.client.username = NULL;
     se->data.client.password = NULL;
+    se->data.client.cipher_mode = GCRY_CIPHER_MODE_OFB;
     se->data.client.cypher = NULL;
 #endif
   }
@@ -2070,7 +2753,7 @@ static int sockent_client_connect(sockent_t *se) /* {{{ */
 
     network_set_ttl(se, ai_ptr);
     network_set_interface(se, ai_ptr);
-    network_bind_socket_to_addr(se, ai_ptr);
+    network_bind_socket_to_addr(se, client->fd, ai_ptr);
 
     /* We don't open more than one write-socket per
      * node/service pair.. */
@@ -2086,6 +2769,80 @@ static int sockent_client_connect(sockent_t *se) /* {{{ */
   return 0;
 } /* }}} int sockent_client_connect */
 
+/* Connects the stream connection "sc" of "se" unless it is connected. After a
+ * failed attempt, connecting is not tried again for
+ * STREAM_RECONNECT_INTERVAL. */
+static int stream_client_connect(sockent_t *se, /* {{{ */
+                                 stream_client_t *sc) {
+  static c_complain_t complaint = C_COMPLAIN_INIT_STATIC;
+
+  if (sc->fd >= 0)
+    return 0;
+
+  cdtime_t now = cdtime();
+  if (now < sc->next_connect)
+    return EAGAIN;
+  sc->next_connect = now + STREAM_RECONNECT_INTERVAL;
+
+  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
+                              .ai_flags = AI_ADDRCONFIG,
+                              .ai_protocol = IPPROTO_TCP,
+                              .ai_socktype = SOCK_STREAM};
+  struct addrinfo *ai_list = NULL;
+
+  int status = getaddrinfo(
+      se->node, (se->service != NULL) ? se->service : NET_DEFAULT_PORT,
+      &ai_hints, &ai_list);
+  if (status != 0) {
+    c_complain(
+        LOG_ERR, &complaint, "network plugin: getaddrinfo (%s, %s) failed: %s",
+        (se->node == NULL) ? "(null)" : se->node,
+        (se->service == NULL) ? "(null)" : se->service, gai_strerror(status));
+    return -1;
+  }
+
+  int fd = -1;
+  for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
+       ai_ptr = ai_ptr->ai_next) {
+    fd = socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+    if (fd < 0)
+      continue;
+
+    /* The timeout applies to connect(2), too. */
+    struct timeval timeout = {.tv_sec = STREAM_SEND_TIMEOUT};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    if ((network_bind_socket_to_addr(se, fd, ai_ptr) != 0) ||
+        (connect(fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen) != 0)) {
+      close(fd);
+      fd = -1;
+      continue;
+    }
+
+#ifdef TCP_NODELAY
+    /* Packets are only sent once they are complete. */
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#endif
+    break;
+  }
+  freeaddrinfo(ai_list);
+
+  if (fd < 0) {
+    c_complain(LOG_ERR, &complaint,
+               "network plugin: Connecting to %s (%s) failed: %s",
+               (se->node == NULL) ? "(null)" : se->node,
+               (se->service == NULL) ? NET_DEFAULT_PORT : se->service,
+               STRERRNO);
+    return -1;
+  }
+
+  c_release(LOG_NOTICE, &complaint, "network plugin: Connected to %s.",
+            se->node);
+  sc->fd = fd;
+  return 0;
+} /* }}} int stream_client_connect */
+
 /* Open the file descriptors for a initialized sockent structure. */
 static int sockent_server_listen(sockent_t *se) /* {{{ */
 {
@@ -2110,10 +2867,11 @@ static int sockent_server_listen(sockent_t *se) /* {{{ */
   DEBUG("network plugin: sockent_server_listen: node = %s; service = %s;", node,
         service);
 
+  bool stream = (se->data.server.protocol == IPPROTO_TCP);
   struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
                               .ai_flags = AI_ADDRCONFIG | AI_PASSIVE,
-                              .ai_protocol = IPPROTO_UDP,
-                              .ai_socktype = SOCK_DGRAM};
+                              .ai_protocol = se->data.server.protocol,
+                              .ai_socktype = stream ? SOCK_STREAM : SOCK_DGRAM};
 
   status = getaddrinfo(node, service, &ai_hints, &ai_list);
   if (status != 0) {
@@ -2125,32 +2883,63 @@ static int sockent_server_listen(sockent_t *se) /* {{{ */
 
   for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
        ai_ptr = ai_ptr->ai_next) {
-    int *tmp;
+    /* Open one socket per receive thread, so the kernel can distribute the
+     * packets, or the connections, between them. Multicast packets are
+     * delivered to every socket bound to the group, so only one socket is
+     * opened for those. */
+    size_t copies = network_config_receive_threads;
+    if (network_addr_is_multicast(ai_ptr))
+      copies = 1;
+
+    for (size_t i = 0; i < copies; i++) {
+      int *tmp;
+
+      tmp = realloc(se->data.server.fd,
+                    sizeof(*tmp) * (se->data.server.fd_num + 1));
+      if (tmp == NULL) {
+        ERROR("network plugin: realloc failed.");
+        continue;
+      }
+      se->data.server.fd = tmp;
+      tmp = se->data.server.fd + se->data.server.fd_num;
 
-    tmp = realloc(se->data.server.fd,
-                  sizeof(*tmp) * (se->data.server.fd_num + 1));
-    if (tmp == NULL) {
-      ERROR("network plugin: realloc failed.");
-      continue;
-    }
-    se->data.server.fd = tmp;
-    tmp = se->data.server.fd + se->data.server.fd_num;
+      *tmp =
+          socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+      if (*tmp < 0) {
+        ERROR("network plugin: socket(2) failed: %s", STRERRNO);
+        continue;
+      }
 
-    *tmp = socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
-    if (*tmp < 0) {
-      ERROR("network plugin: socket(2) failed: %s", STRERRNO);
-      continue;
-    }
+#ifdef SO_REUSEPORT
+      if ((copies > 1) && (setsockopt(*tmp, SOL_SOCKET, SO_REUSEPORT, &(int){1},
+                                      sizeof(int)) == -1)) {
+        ERROR("network plugin: setsockopt (reuseport): %s", STRERRNO);
+        close(*tmp);
+        *tmp = -1;
+        continue;
+      }
+#endif
 
-    status = network_bind_socket(*tmp, ai_ptr, se->interface);
-    if (status != 0) {
-      close(*tmp);
-      *tmp = -1;
-      continue;
-    }
+      status = network_bind_socket(*tmp, ai_ptr, se->interface);
+      if (status != 0) {
+        close(*tmp);
+        *tmp = -1;
+        continue;
+      }
 
-    se->data.server.fd_num++;
-    continue;
+      /* The listen socket is non-blocking, so that a connection reset
+       * before accept(2) doesn't block the receive thread. */
+      if (stream &&
+          ((listen(*tmp, SOMAXCONN) != 0) ||
+           (fcntl(*tmp, F_SETFL, fcntl(*tmp, F_GETFL) | O_NONBLOCK) != 0))) {
+        ERROR("network plugin: listen(2) failed: %s", STRERRNO);
+        close(*tmp);
+        *tmp = -1;
+        continue;
+      }
+
+      se->data.server.fd_num++;
+    }
   } /* for (ai_list) */
 
   freeaddrinfo(ai_list);
@@ -2169,26 +2958,8 @@ static int sockent_add(sockent_t *se) /* {{{ */
     return -1;
 
   if (se->type == SOCKENT_TYPE_SERVER) {
-    struct pollfd *tmp;
-
-    tmp = realloc(listen_sockets_pollfd,
-                  sizeof(*tmp) * (listen_sockets_num + se->data.server.fd_num));
-    if (tmp == NULL) {
-      ERROR("network plugin: realloc failed.");
-      return -1;
-    }
-    listen_sockets_pollfd = tmp;
-    tmp = listen_sockets_pollfd + listen_sockets_num;
-
-    for (size_t i = 0; i < se->data.server.fd_num; i++) {
-      memset(tmp + i, 0, sizeof(*tmp));
-      tmp[i].fd = se->data.server.fd[i];
-      tmp[i].events = POLLIN | POLLPRI;
-      tmp[i].revents = 0;
-    }
-
-    listen_sockets_num += se->data.server.fd_num;
-
+    /* The sockets are opened and assigned to the receive threads in
+     * network_init(). */
     if (listen_sockets == NULL) {
       listen_sockets = se;
       return 0;
@@ -2210,157 +2981,613 @@ static int sockent_add(sockent_t *se) /* {{{ */
   return 0;
 } /* }}} int sockent_add */
 
-static void *dispatch_thread(void __attribute__((unused)) * arg) /* {{{ */
+/* The MurmurHash3 finalizer, so that the high bits, which decide the position
+ * on the ring, depend on all bits of the FNV-1a hash. */
+static uint64_t network_hash_mix(uint64_t h) /* {{{ */
 {
-  while (42) {
-    receive_list_entry_t *ent;
-    sockent_t *se;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+} /* }}} uint64_t network_hash_mix */
+
+#define NETWORK_HASH_INIT 0xcbf29ce484222325ULL
+
+/* Adds "str" including its terminating null byte to the FNV-1a hash "h". */
+static uint64_t network_hash_string(uint64_t h, char const *str) /* {{{ */
+{
+  do {
+    h ^= (unsigned char)*str;
+    h *= 0x100000001b3ULL;
+  } while (*(str++) != 0);
+  return h;
+} /* }}} uint64_t network_hash_string */
+
+/* Hashes an identifier. Senders must agree on the hash, so that the value
+ * lists of one series end up on the same servers no matter which daemon sends
+ * them. */
+static uint64_t network_hash_identifier(char const *host, /* {{{ */
+                                        char const *plugin,
+                                        char const *plugin_instance,
+                                        char const *type,
+                                        char const *type_instance) {
+  uint64_t h = NETWORK_HASH_INIT;
+  h = network_hash_string(h, host);
+  h = network_hash_string(h, plugin);
+  h = network_hash_string(h, plugin_instance);
+  h = network_hash_string(h, type);
+  h = network_hash_string(h, type_instance);
+  return network_hash_mix(h);
+} /* }}} uint64_t network_hash_identifier */
+
+static int ring_point_compare(void const *a, void const *b) /* {{{ */
+{
+  uint64_t ha = ((ring_point_t const *)a)->hash;
+  uint64_t hb = ((ring_point_t const *)b)->hash;
+  return (ha > hb) - (ha < hb);
+} /* }}} int ring_point_compare */
+
+/* Places SERVER_GROUP_POINTS points per server on the ring. The points only
+ * depend on the server's host and port, so that all senders build the same
+ * ring and the order of the <Server> blocks doesn't matter. */
+static int server_group_build_ring(server_group_t *g) /* {{{ */
+{
+  sfree(g->ring);
+  g->ring_num = 0;
+
+  g->ring = calloc(g->servers_num * SERVER_GROUP_POINTS, sizeof(*g->ring));
+  if (g->ring == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < g->servers_num; i++) {
+    sockent_t *se = g->servers[i];
+    uint64_t base = network_hash_string(NETWORK_HASH_INIT, se->node);
+    base = network_hash_string(
+        base, (se->service != NULL) ? se->service : NET_DEFAULT_PORT);
+
+    for (uint64_t j = 0; j < SERVER_GROUP_POINTS; j++) {
+      g->ring[g->ring_num] = (ring_point_t){
+          .hash = network_hash_mix(base + j * 0x9e3779b97f4a7c15ULL),
+          .server = i,
+      };
+      g->ring_num++;
+    }
+  }
+
+  qsort(g->ring, g->ring_num, sizeof(*g->ring), ring_point_compare);
+  return 0;
+} /* }}} int server_group_build_ring */
 
-    /* Lock and wait for more data to come in */
-    pthread_mutex_lock(&receive_list_lock);
-    while ((listen_loop == 0) && (receive_list_head == NULL))
-      pthread_cond_wait(&receive_list_cond, &receive_list_lock);
+static bool server_is_down(sockent_t *se, cdtime_t now) /* {{{ */
+{
+  return __atomic_load_n(&se->data.client.down_until, __ATOMIC_RELAXED) > now;
+} /* }}} bool server_is_down */
+
+/* Stores the servers of "g" that get the value lists with hash "hash" in
+ * "ret", which must have room for g->replicas entries: the owners of the next
+ * points on the ring, skipping servers that are down. If too few servers are
+ * up, servers that are down are used anyway. Returns the number of servers
+ * stored. */
+static size_t server_group_pick(server_group_t const *g, /* {{{ */
+                                uint64_t hash, cdtime_t now, sockent_t **ret) {
+  size_t lo = 0;
+  size_t hi = g->ring_num;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (g->ring[mid].hash < hash)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
 
-    /* Remove the head entry and unlock */
-    ent = receive_list_head;
-    if (ent != NULL)
-      receive_list_head = ent->next;
-    receive_list_length--;
-    pthread_mutex_unlock(&receive_list_lock);
+  sockent_t *down[g->replicas];
+  size_t down_num = 0;
+  size_t num = 0;
 
-    /* Check whether we are supposed to exit. We do NOT check `listen_loop'
-     * because we dispatch all missing packets before shutting down. */
-    if (ent == NULL)
+  for (size_t i = 0; i < g->ring_num; i++) {
+    if ((num >= g->replicas) || ((num + down_num) >= g->servers_num))
       break;
 
-    /* Look for the correct `sockent_t' */
-    se = listen_sockets;
-    while (se != NULL) {
-      size_t i;
+    sockent_t *se = g->servers[g->ring[(lo + i) % g->ring_num].server];
 
-      for (i = 0; i < se->data.server.fd_num; i++)
-        if (se->data.server.fd[i] == ent->fd)
-          break;
+    bool seen = false;
+    for (size_t j = 0; (j < num) && !seen; j++)
+      seen = (ret[j] == se);
+    for (size_t j = 0; (j < down_num) && !seen; j++)
+      seen = (down[j] == se);
+    if (seen)
+      continue;
 
-      if (i < se->data.server.fd_num)
-        break;
+    if (!server_is_down(se, now))
+      ret[num++] = se;
+    else if (down_num < g->replicas)
+      down[down_num++] = se;
+  }
 
-      se = se->next;
-    }
+  for (size_t i = 0; (num < g->replicas) && (i < down_num); i++)
+    ret[num++] = down[i];
 
-    if (se == NULL) {
-      ERROR("network plugin: Got packet from FD %i, but can't "
-            "find an appropriate socket entry.",
-            ent->fd);
-      sfree(ent->data);
-      sfree(ent);
-      continue;
-    }
+  return num;
+} /* }}} size_t server_group_pick */
 
-    parse_packet(se, ent->data, ent->data_len, /* flags = */ 0,
-                 /* username = */ NULL, &ent->sender);
-    sfree(ent->data);
+static void server_groups_destroy(void) /* {{{ */
+{
+  while (server_groups != NULL) {
+    server_group_t *g = server_groups;
+    server_groups = g->next;
+
+    sfree(g->name);
+    sfree(g->servers);
+    sfree(g->ring);
+    sfree(g);
+  }
+  send_dests_num = 1;
+} /* }}} void server_groups_destroy */
+
+static receive_list_entry_t *receive_list_entry_create(void) /* {{{ */
+{
+  receive_list_entry_t *ent = calloc(1, sizeof(*ent));
+  if (ent == NULL)
+    return NULL;
+
+  ent->data = malloc(network_config_packet_size);
+  if (ent->data == NULL) {
     sfree(ent);
-  } /* while (42) */
+    return NULL;
+  }
 
-  return NULL;
-} /* }}} void *dispatch_thread */
+  return ent;
+} /* }}} receive_list_entry_t *receive_list_entry_create */
 
-static int network_receive(void) /* {{{ */
+static void receive_list_free(receive_list_entry_t *ent) /* {{{ */
 {
-  char buffer[network_config_packet_size];
-  int buffer_len;
+  while (ent != NULL) {
+    receive_list_entry_t *next = ent->next;
+    sfree(ent->data);
+    sfree(ent);
+    ent = next;
+  }
+} /* }}} void receive_list_free */
 
-  int status = 0;
+static void *dispatch_thread(void *arg) /* {{{ */
+{
+  receiver_t *r = arg;
+  receive_list_entry_t *done_head = NULL;
+  receive_list_entry_t *done_tail = NULL;
 
-  receive_list_entry_t *private_list_head;
-  receive_list_entry_t *private_list_tail;
-  uint64_t private_list_length;
+  while (42) {
+    pthread_mutex_lock(&r->lock);
+
+    /* Hand the entries dispatched last time back to the receive thread. */
+    if (done_head != NULL) {
+      done_tail->next = r->free_list;
+      r->free_list = done_head;
+      done_head = NULL;
+      done_tail = NULL;
+    }
 
-  assert(listen_sockets_num > 0);
+    /* Wait for more data to come in */
+    while ((listen_loop == 0) && (r->head == NULL))
+      pthread_cond_wait(&r->cond, &r->lock);
 
-  private_list_head = NULL;
-  private_list_tail = NULL;
-  private_list_length = 0;
+    /* Take all queued entries at once and unlock */
+    receive_list_entry_t *ent = r->head;
+    r->head = NULL;
+    r->tail = NULL;
+    r->length = 0;
+    pthread_mutex_unlock(&r->lock);
 
-  while (listen_loop == 0) {
-    status = poll(listen_sockets_pollfd, listen_sockets_num, -1);
-    if (status <= 0) {
-      if (errno == EINTR)
-        continue;
-      ERROR("network plugin: poll(2) failed: %s", STRERRNO);
+    /* Check whether we are supposed to exit. We do NOT check `listen_loop'
+     * because we dispatch all missing packets before shutting down. */
+    if (ent == NULL)
       break;
+
+    done_head = ent;
+    for (; ent != NULL; ent = ent->next) {
+      PROBE1(network__parse__start, ent->data_len);
+      int status = parse_packet(ent->se, ent->data, ent->data_len,
+                                network_config_relay ? PP_RELAY : 0,
+                                /* username = */ NULL, &ent->sender);
+      PROBE2(network__parse__done, ent->data_len, status);
+      done_tail = ent;
     }
 
-    for (size_t i = 0; (i < listen_sockets_num) && (status > 0); i++) {
-      receive_list_entry_t *ent;
+    if (network_config_relay)
+      network_relay_flush();
+  } /* while (42) */
+
+  receive_list_free(done_head);
+  return NULL;
+} /* }}} void *dispatch_thread */
+
+/* Takes the last entry from "spare" or allocates a new one. */
+static receive_list_entry_t *
+receive_list_entry_get(receive_list_entry_t **spare, /* {{{ */
+                       size_t *spare_num) {
+  if (*spare_num == 0)
+    return receive_list_entry_create();
+
+  (*spare_num)--;
+  return spare[*spare_num];
+} /* }}} receive_list_entry_t *receive_list_entry_get */
+
+static void receive_list_append(receive_list_entry_t **head, /* {{{ */
+                                receive_list_entry_t **tail, uint64_t *length,
+                                receive_list_entry_t *ent) {
+  ent->next = NULL;
+  if (*head == NULL)
+    *head = ent;
+  else
+    (*tail)->next = ent;
+  *tail = ent;
+  (*length)++;
+} /* }}} void receive_list_append */
+
+/* Adds "fd" to the sockets polled by "r". "conn" is NULL for listen
+ * sockets. */
+static int receiver_add_fd(receiver_t *r, int fd, sockent_t *se, /* {{{ */
+                           stream_conn_t *conn) {
+  if (r->pollfd_num >= r->pollfd_size) {
+    size_t size = (r->pollfd_size > 0) ? 2 * r->pollfd_size : 8;
+
+    struct pollfd *pollfd = realloc(r->pollfd, size * sizeof(*pollfd));
+    if (pollfd == NULL)
+      return ENOMEM;
+    r->pollfd = pollfd;
+
+    sockent_t **pollfd_se = realloc(r->pollfd_se, size * sizeof(*pollfd_se));
+    if (pollfd_se == NULL)
+      return ENOMEM;
+    r->pollfd_se = pollfd_se;
+
+    stream_conn_t **pollfd_conn =
+        realloc(r->pollfd_conn, size * sizeof(*pollfd_conn));
+    if (pollfd_conn == NULL)
+      return ENOMEM;
+    r->pollfd_conn = pollfd_conn;
+
+    r->pollfd_size = size;
+  }
+
+  r->pollfd[r->pollfd_num] = (struct pollfd){
+      .fd = fd,
+      .events = POLLIN | POLLPRI,
+  };
+  r->pollfd_se[r->pollfd_num] = se;
+  r->pollfd_conn[r->pollfd_num] = conn;
+  r->pollfd_num++;
+  return 0;
+} /* }}} int receiver_add_fd */
+
+static void stream_conn_destroy(stream_conn_t *conn) /* {{{ */
+{
+  if (conn == NULL)
+    return;
+
+  sfree(conn->buffer);
+  sfree(conn);
+} /* }}} void stream_conn_destroy */
+
+/* Closes the stream connection "index" of "r". The entry is removed by
+ * receiver_remove_closed(). */
+static void receiver_close_conn(receiver_t *r, size_t index) /* {{{ */
+{
+  close(r->pollfd[index].fd);
+  r->pollfd[index].fd = -1;
+  stream_conn_destroy(r->pollfd_conn[index]);
+  r->pollfd_conn[index] = NULL;
+} /* }}} void receiver_close_conn */
+
+static void receiver_remove_closed(receiver_t *r) /* {{{ */
+{
+  size_t n = 0;
+  for (size_t i = 0; i < r->pollfd_num; i++) {
+    if (r->pollfd[i].fd < 0)
+      continue;
+
+    r->pollfd[n] = r->pollfd[i];
+    r->pollfd_se[n] = r->pollfd_se[i];
+    r->pollfd_conn[n] = r->pollfd_conn[i];
+    n++;
+  }
+  r->pollfd_num = n;
+} /* }}} void receiver_remove_closed */
+
+/* Returns the size of the first packet in "buffer", including its header, if
+ * "buffer" holds all of it, zero if more data is needed, or -1 if the packet
+ * is empty or larger than "max". */
+static ssize_t stream_packet_size(char const *buffer, size_t fill, /* {{{ */
+                                  size_t max) {
+  uint32_t length;
+
+  if (fill < STREAM_HEADER_SIZE)
+    return 0;
+
+  memcpy(&length, buffer, sizeof(length));
+  length = ntohl(length);
+  if ((length == 0) || (length > max))
+    return -1;
 
-      if ((listen_sockets_pollfd[i].revents & (POLLIN | POLLPRI)) == 0)
+  if (fill < (STREAM_HEADER_SIZE + (size_t)length))
+    return 0;
+  return (ssize_t)(STREAM_HEADER_SIZE + length);
+} /* }}} ssize_t stream_packet_size */
+
+/* Accepts all pending connections on the stream listen socket "index" of
+ * "r". */
+static void network_stream_accept(receiver_t *r, size_t index) /* {{{ */
+{
+  int listen_fd = r->pollfd[index].fd;
+  sockent_t *se = r->pollfd_se[index];
+
+  while (42) {
+    struct sockaddr_storage sender = {0};
+    socklen_t sender_len = sizeof(sender);
+
+    int fd = accept(listen_fd, (struct sockaddr *)&sender, &sender_len);
+    if (fd < 0) {
+      if ((errno == EINTR) || (errno == ECONNABORTED))
         continue;
-      status--;
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+        ERROR("network plugin: accept(2) failed: %s", STRERRNO);
+      return;
+    }
 
-      struct sockaddr_storage address;
-      socklen_t length = sizeof(address);
-      memset(&address, 0, length);
-      buffer_len =
-          recvfrom(listen_sockets_pollfd[i].fd, buffer, sizeof(buffer),
-                   0 /* no flags */, (struct sockaddr *)&address, &length);
-      if (buffer_len < 0) {
-        status = (errno != 0) ? errno : -1;
-        ERROR("network plugin: recv(2) failed: %s", STRERRNO);
-        break;
-      }
+    stream_conn_t *conn = calloc(1, sizeof(*conn));
+    if (conn != NULL) {
+      conn->size = STREAM_HEADER_SIZE + network_config_packet_size;
+      conn->buffer = malloc(conn->size);
+      conn->sender = sender;
+    }
 
-      stats_octets_rx += ((uint64_t)buffer_len);
-      stats_packets_rx++;
-
-      /* TODO: Possible performance enhancement: Do not free
-       * these entries in the dispatch thread but put them in
-       * another list, so we don't have to allocate more and
-       * more of these structures. */
-      ent = calloc(1, sizeof(*ent));
-      if (ent == NULL) {
-        ERROR("network plugin: calloc failed.");
-        status = ENOMEM;
-        break;
-      }
+    if ((conn == NULL) || (conn->buffer == NULL) ||
+        (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) ||
+        (receiver_add_fd(r, fd, se, conn) != 0)) {
+      ERROR("network plugin: Accepting a connection failed.");
+      close(fd);
+      stream_conn_destroy(conn);
+      continue;
+    }
+  }
+} /* }}} void network_stream_accept */
+
+/* Reads from the stream connection "index" of "r" and appends the complete
+ * packets to the list. The connection is closed on end of file and on
+ * error. */
+static void network_stream_read(receiver_t *r, size_t index, /* {{{ */
+                                receive_list_entry_t **spare,
+                                size_t *spare_num,
+                                receive_list_entry_t **head,
+                                receive_list_entry_t **tail,
+                                uint64_t *length) {
+  stream_conn_t *conn = r->pollfd_conn[index];
+
+  ssize_t status = read(r->pollfd[index].fd, conn->buffer + conn->fill,
+                        conn->size - conn->fill);
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return;
+    WARNING("network plugin: read(2) failed: %s. Closing the connection.",
+            STRERRNO);
+    receiver_close_conn(r, index);
+    return;
+  } else if (status == 0) {
+    receiver_close_conn(r, index);
+    return;
+  }
 
-      ent->data = malloc(network_config_packet_size);
-      if (ent->data == NULL) {
-        sfree(ent);
-        ERROR("network plugin: malloc failed.");
-        status = ENOMEM;
-        break;
-      }
-      ent->fd = listen_sockets_pollfd[i].fd;
-      ent->next = NULL;
+  conn->fill += (size_t)status;
+  r->octets_rx += (derive_t)status;
 
-      memcpy(ent->data, buffer, buffer_len);
-      ent->data_len = buffer_len;
-      memcpy(&ent->sender, &address, sizeof(ent->sender));
+  size_t offset = 0;
+  while (42) {
+    ssize_t size = stream_packet_size(conn->buffer + offset,
+                                      conn->fill - offset,
+                                      network_config_packet_size);
+    if (size == 0)
+      break;
+    if (size < 0) {
+      WARNING("network plugin: Received a packet that is empty or larger "
+              "than MaxPacketSize (%" PRIsz " bytes). Closing the "
+              "connection.",
+              network_config_packet_size);
+      receiver_close_conn(r, index);
+      return;
+    }
 
-      if (private_list_head == NULL)
-        private_list_head = ent;
-      else
-        private_list_tail->next = ent;
-      private_list_tail = ent;
-      private_list_length++;
+    receive_list_entry_t *ent = receive_list_entry_get(spare, spare_num);
+    if (ent == NULL) {
+      ERROR("network plugin: calloc failed. Closing the connection.");
+      receiver_close_conn(r, index);
+      return;
+    }
+
+    ent->data_len = (int)(size - STREAM_HEADER_SIZE);
+    memcpy(ent->data, conn->buffer + offset + STREAM_HEADER_SIZE,
+           (size_t)ent->data_len);
+    memcpy(&ent->sender, &conn->sender, sizeof(ent->sender));
+    ent->se = r->pollfd_se[index];
+
+    PROBE1(network__receive, ent->data_len);
+    r->packets_rx++;
+    receive_list_append(head, tail, length, ent);
+
+    offset += (size_t)size;
+  }
+
+  if (offset > 0) {
+    memmove(conn->buffer, conn->buffer + offset, conn->fill - offset);
+    conn->fill -= offset;
+  }
+} /* }}} void network_stream_read */
+
+/* Reads up to "ents_num" packets from "fd" into "ents". Returns the number of
+ * packets read, which may be zero, or -1 on error. */
+static int network_recv_packets(int fd, /* {{{ */
+                                receive_list_entry_t **ents, size_t ents_num) {
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[RECEIVE_BATCH_SIZE];
+  struct iovec iovs[RECEIVE_BATCH_SIZE];
+
+  if (ents_num > RECEIVE_BATCH_SIZE)
+    ents_num = RECEIVE_BATCH_SIZE;
+
+  memset(msgs, 0, sizeof(msgs));
+  for (size_t i = 0; i < ents_num; i++) {
+    memset(&ents[i]->sender, 0, sizeof(ents[i]->sender));
+    iovs[i].iov_base = ents[i]->data;
+    iovs[i].iov_len = network_config_packet_size;
+    msgs[i].msg_hdr.msg_iov = iovs + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &ents[i]->sender;
+    msgs[i].msg_hdr.msg_namelen = sizeof(ents[i]->sender);
+  }
+
+  int status = recvmmsg(fd, msgs, (unsigned int)ents_num, MSG_DONTWAIT,
+                        /* timeout = */ NULL);
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return 0;
+    return -1;
+  }
+
+  for (int i = 0; i < status; i++)
+    ents[i]->data_len = (int)msgs[i].msg_len;
+
+  return status;
+#else
+  if (ents_num < 1)
+    return 0;
+
+  socklen_t length = sizeof(ents[0]->sender);
+  memset(&ents[0]->sender, 0, length);
+  ssize_t status =
+      recvfrom(fd, ents[0]->data, network_config_packet_size, 0 /* no flags */,
+               (struct sockaddr *)&ents[0]->sender, &length);
+  if (status < 0) {
+    if (errno == EINTR)
+      return 0;
+    return -1;
+  }
+
+  ents[0]->data_len = (int)status;
+  return 1;
+#endif
+} /* }}} int network_recv_packets */
+
+/* Reads the pending packets from the datagram socket "index" of "r" into
+ * entries taken from "spare" and appends them to the list. */
+static int network_receive_datagrams(receiver_t *r, size_t index, /* {{{ */
+                                     receive_list_entry_t **spare,
+                                     size_t *spare_num,
+                                     receive_list_entry_t **head,
+                                     receive_list_entry_t **tail,
+                                     uint64_t *length) {
+  while (*spare_num < RECEIVE_BATCH_SIZE) {
+    receive_list_entry_t *ent = receive_list_entry_create();
+    if (ent == NULL)
+      break;
+    spare[*spare_num] = ent;
+    (*spare_num)++;
+  }
+  if (*spare_num == 0) {
+    ERROR("network plugin: calloc failed.");
+    return ENOMEM;
+  }
+
+  int received = network_recv_packets(r->pollfd[index].fd, spare, *spare_num);
+  if (received < 0) {
+    int status = (errno != 0) ? errno : -1;
+    ERROR("network plugin: recv(2) failed: %s", STRERRNO);
+    return status;
+  }
+
+  /* The received packets are taken from the start of "spare". */
+  for (int i = 0; i < received; i++) {
+    receive_list_entry_t *ent = spare[i];
+
+    PROBE1(network__receive, ent->data_len);
+    r->octets_rx += ((uint64_t)ent->data_len);
+    r->packets_rx++;
+
+    ent->se = r->pollfd_se[index];
+    receive_list_append(head, tail, length, ent);
+  }
+  memmove(spare, spare + received, (*spare_num - received) * sizeof(*spare));
+  *spare_num -= received;
+
+  return 0;
+} /* }}} int network_receive_datagrams */
+
+static int network_receive(receiver_t *r) /* {{{ */
+{
+  /* Entries ready to be filled with packets. They are taken from the
+   * receiver's free list, so that each entry is only allocated once. */
+  receive_list_entry_t *spare[RECEIVE_BATCH_SIZE];
+  size_t spare_num = 0;
+
+  receive_list_entry_t *private_list_head = NULL;
+  receive_list_entry_t *private_list_tail = NULL;
+  uint64_t private_list_length = 0;
+
+  int status = 0;
+
+  assert(r->pollfd_num > 0);
+
+  while (listen_loop == 0) {
+    status = poll(r->pollfd, r->pollfd_num, -1);
+    if (status <= 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("network plugin: poll(2) failed: %s", STRERRNO);
+      break;
+    }
+
+    for (size_t i = 0; (i < r->pollfd_num) && (status > 0); i++) {
+      if ((r->pollfd[i].revents & (POLLIN | POLLPRI | POLLHUP | POLLERR)) ==
+          0)
+        continue;
+      status--;
+
+      if (r->pollfd_conn[i] != NULL) {
+        network_stream_read(r, i, spare, &spare_num, &private_list_head,
+                            &private_list_tail, &private_list_length);
+      } else if (r->pollfd_se[i]->data.server.protocol == IPPROTO_TCP) {
+        network_stream_accept(r, i);
+      } else if (network_receive_datagrams(r, i, spare, &spare_num,
+                                           &private_list_head,
+                                           &private_list_tail,
+                                           &private_list_length) != 0) {
+        status = -1;
+        break;
+      }
 
       /* Do not block here. Blocking here has led to
        * insufficient performance in the past. */
-      if (pthread_mutex_trylock(&receive_list_lock) == 0) {
-        assert(((receive_list_head == NULL) && (receive_list_length == 0)) ||
-               ((receive_list_head != NULL) && (receive_list_length != 0)));
+      if ((private_list_head != NULL) &&
+          (pthread_mutex_trylock(&r->lock) == 0)) {
+        assert(((r->head == NULL) && (r->length == 0)) ||
+               ((r->head != NULL) && (r->length != 0)));
 
-        if (receive_list_head == NULL)
-          receive_list_head = private_list_head;
+        if (r->head == NULL)
+          r->head = private_list_head;
         else
-          receive_list_tail->next = private_list_head;
-        receive_list_tail = private_list_tail;
-        receive_list_length += private_list_length;
+          r->tail->next = private_list_head;
+        r->tail = private_list_tail;
+        r->length += private_list_length;
 
-        pthread_cond_signal(&receive_list_cond);
-        pthread_mutex_unlock(&receive_list_lock);
+        /* Take back entries the dispatch thread is done with. */
+        while ((spare_num < RECEIVE_BATCH_SIZE) && (r->free_list != NULL)) {
+          spare[spare_num] = r->free_list;
+          r->free_list = r->free_list->next;
+          spare[spare_num]->next = NULL;
+          spare_num++;
+        }
+
+        pthread_cond_signal(&r->cond);
+        pthread_mutex_unlock(&r->lock);
 
         private_list_head = NULL;
         private_list_tail = NULL;
@@ -2368,7 +3595,9 @@ static int network_receive(void) /* {{{ */
       }
 
       status = 0;
-    } /* for (listen_sockets_pollfd) */
+    } /* for (r->pollfd) */
+
+    receiver_remove_closed(r);
 
     if (status != 0)
       break;
@@ -2376,47 +3605,145 @@ static int network_receive(void) /* {{{ */
 
   /* Make sure everything is dispatched before exiting. */
   if (private_list_head != NULL) {
-    pthread_mutex_lock(&receive_list_lock);
+    pthread_mutex_lock(&r->lock);
 
-    if (receive_list_head == NULL)
-      receive_list_head = private_list_head;
+    if (r->head == NULL)
+      r->head = private_list_head;
     else
-      receive_list_tail->next = private_list_head;
-    receive_list_tail = private_list_tail;
-    receive_list_length += private_list_length;
+      r->tail->next = private_list_head;
+    r->tail = private_list_tail;
+    r->length += private_list_length;
 
-    pthread_cond_signal(&receive_list_cond);
-    pthread_mutex_unlock(&receive_list_lock);
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->lock);
   }
 
+  for (size_t i = 0; i < spare_num; i++)
+    spare[i]->next = (i + 1 < spare_num) ? spare[i + 1] : NULL;
+  if (spare_num > 0)
+    receive_list_free(spare[0]);
+
   return status;
 } /* }}} int network_receive */
 
-static void *receive_thread(void __attribute__((unused)) * arg) {
-  return network_receive() ? (void *)1 : (void *)0;
+static void *receive_thread(void *arg) {
+  return network_receive(arg) ? (void *)1 : (void *)0;
 } /* void *receive_thread */
 
-static void network_init_buffer(void) {
-  memset(send_buffer, 0, network_config_packet_size);
-  send_buffer_ptr = send_buffer;
-  send_buffer_fill = 0;
-  send_buffer_last_update = 0;
+/* Opens the sockets of all <Listen> blocks, one per receive thread and
+ * address. Blocks whose addresses can't be bound are skipped. */
+static void network_listen_all(void) /* {{{ */
+{
+  listen_sockets_num = 0;
+  for (sockent_t *se = listen_sockets; se != NULL; se = se->next) {
+    if ((se->data.server.fd_num == 0) && (sockent_server_listen(se) != 0)) {
+      ERROR("network plugin: Listening on %s:%s failed.",
+            (se->node != NULL) ? se->node : "(null)",
+            (se->service != NULL) ? se->service : NET_DEFAULT_PORT);
+      continue;
+    }
+    listen_sockets_num += se->data.server.fd_num;
+  }
+} /* }}} void network_listen_all */
+
+/* Distributes the listen sockets among "receivers_num" receivers. */
+static int network_receivers_create(void) /* {{{ */
+{
+  receivers_num = network_config_receive_threads;
+  receivers = calloc(receivers_num, sizeof(*receivers));
+  if (receivers == NULL) {
+    ERROR("network plugin: calloc failed.");
+    receivers_num = 0;
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < receivers_num; i++) {
+    receiver_t *r = receivers + i;
+
+    pthread_mutex_init(&r->lock, /* attr = */ NULL);
+    pthread_cond_init(&r->cond, /* attr = */ NULL);
+  }
+
+  /* sockent_server_listen() opens the copies of one address consecutively, so
+   * assigning the sockets round-robin gives each receiver one copy. */
+  size_t n = 0;
+  for (sockent_t *se = listen_sockets; se != NULL; se = se->next) {
+    for (size_t i = 0; i < se->data.server.fd_num; i++) {
+      receiver_t *r = receivers + (n % receivers_num);
+
+      if (receiver_add_fd(r, se->data.server.fd[i], se, /* conn = */ NULL) !=
+          0) {
+        ERROR("network plugin: realloc failed.");
+        return ENOMEM;
+      }
+      n++;
+    }
+  }
+
+  return 0;
+} /* }}} int network_receivers_create */
 
-  memset(&send_buffer_vl, 0, sizeof(send_buffer_vl));
-} /* int network_init_buffer */
+static void network_receivers_destroy(void) /* {{{ */
+{
+  for (size_t i = 0; i < receivers_num; i++) {
+    receiver_t *r = receivers + i;
+
+    receive_list_free(r->head);
+    receive_list_free(r->free_list);
+    for (size_t j = 0; j < r->pollfd_num; j++)
+      if (r->pollfd_conn[j] != NULL)
+        receiver_close_conn(r, j);
+    sfree(r->pollfd);
+    sfree(r->pollfd_se);
+    sfree(r->pollfd_conn);
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+  }
 
-static void network_send_buffer_plain(sockent_t *se, /* {{{ */
-                                      const char *buffer, size_t buffer_size) {
+  sfree(receivers);
+  receivers_num = 0;
+} /* }}} void network_receivers_destroy */
+
+/* Sends "buffers" to "se". The socket's lock must be held. Returns non-zero
+ * if the socket couldn't be set up or sending failed. */
+static int network_send_buffer_plain(sockent_t *se, /* {{{ */
+                                     char *const *buffers,
+                                     const size_t *buffers_size,
+                                     size_t buffers_num) {
+  size_t sent = 0;
   int status;
 
-  while (42) {
+  while (sent < buffers_num) {
     status = sockent_client_connect(se);
     if (status != 0)
-      return;
+      return status;
 
-    status = sendto(se->data.client.fd, buffer, buffer_size,
+#if HAVE_SENDMMSG
+    struct mmsghdr msgs[SEND_BATCH_SIZE];
+    struct iovec iovs[SEND_BATCH_SIZE];
+    size_t num = buffers_num - sent;
+    if (num > SEND_BATCH_SIZE)
+      num = SEND_BATCH_SIZE;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < num; i++) {
+      iovs[i].iov_base = buffers[sent + i];
+      iovs[i].iov_len = buffers_size[sent + i];
+      msgs[i].msg_hdr.msg_iov = iovs + i;
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = se->data.client.addr;
+      msgs[i].msg_hdr.msg_namelen = se->data.client.addrlen;
+    }
+
+    status = sendmmsg(se->data.client.fd, msgs, (unsigned int)num,
+                      /* flags = */ 0);
+#else
+    status = sendto(se->data.client.fd, buffers[sent], buffers_size[sent],
                     /* flags = */ 0, (struct sockaddr *)se->data.client.addr,
                     se->data.client.addrlen);
+    if (status >= 0)
+      status = 1;
+#endif
     if (status < 0) {
       if ((errno == EINTR) || (errno == EAGAIN))
         continue;
@@ -2424,12 +3751,154 @@ static void network_send_buffer_plain(sockent_t *se, /* {{{ */
       ERROR("network plugin: sendto failed: %s. Closing sending socket.",
             STRERRNO);
       sockent_client_disconnect(se);
-      return;
+      return -1;
     }
 
-    break;
-  } /* while (42) */
-} /* }}} void network_send_buffer_plain */
+    sent += (size_t)status;
+  } /* while (sent < buffers_num) */
+
+  return 0;
+} /* }}} int network_send_buffer_plain */
+
+/* Writes "buffers" to the stream connection "fd". Returns zero if everything
+ * has been written. */
+static int network_stream_write(int fd, char *const *buffers, /* {{{ */
+                                const size_t *buffers_size,
+                                size_t buffers_num) {
+  uint32_t headers[SEND_BATCH_SIZE];
+  struct iovec iovs[2 * SEND_BATCH_SIZE];
+  size_t iovs_num = 0;
+
+  assert(buffers_num <= SEND_BATCH_SIZE);
+  for (size_t i = 0; i < buffers_num; i++) {
+    headers[i] = htonl((uint32_t)buffers_size[i]);
+    iovs[iovs_num++] = (struct iovec){.iov_base = headers + i,
+                                      .iov_len = STREAM_HEADER_SIZE};
+    iovs[iovs_num++] =
+        (struct iovec){.iov_base = buffers[i], .iov_len = buffers_size[i]};
+  }
+
+  struct iovec *iov = iovs;
+  while (iovs_num > 0) {
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = iovs_num};
+    ssize_t status = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      return errno;
+    }
+
+    /* Skip what has been written. */
+    size_t written = (size_t)status;
+    while ((iovs_num > 0) && (written >= iov->iov_len)) {
+      written -= iov->iov_len;
+      iov++;
+      iovs_num--;
+    }
+    if (iovs_num > 0) {
+      iov->iov_base = (char *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+
+  return 0;
+} /* }}} int network_stream_write */
+
+/* Sends "buffers" over the stream connection "sc" of "se". A connection that
+ * fails is reconnected once. The connection's lock must be held. Returns
+ * zero if the packets have been sent. */
+static int network_send_buffer_stream(sockent_t *se, /* {{{ */
+                                      stream_client_t *sc,
+                                      char *const *buffers,
+                                      const size_t *buffers_size,
+                                      size_t buffers_num) {
+  if (buffers_num == 0)
+    return 0;
+
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (attempt > 0)
+      sc->next_connect = 0;
+
+    int status = stream_client_connect(se, sc);
+    if (status != 0)
+      return status;
+
+    status = network_stream_write(sc->fd, buffers, buffers_size, buffers_num);
+    if (status == 0)
+      return 0;
+
+    WARNING("network plugin: Sending to %s failed: %s. Closing the "
+            "connection.",
+            se->node, STRERROR(status));
+    close(sc->fd);
+    sc->fd = -1;
+  }
+
+  return -1;
+} /* }}} int network_send_buffer_stream */
+
+/* Records whether sending to a grouped server worked. A server that failed
+ * is skipped by its group for the group's "RetryInterval"; after that, it gets
+ * its share of the value lists again and is skipped again if it still
+ * fails. */
+static void server_report_status(sockent_t *se, int status) /* {{{ */
+{
+  struct sockent_client *client = &se->data.client;
+  if (client->group == NULL)
+    return;
+
+  if (status == 0) {
+    if ((__atomic_load_n(&client->down_until, __ATOMIC_RELAXED) != 0) &&
+        (__atomic_exchange_n(&client->down_until, 0, __ATOMIC_RELAXED) != 0))
+      INFO("network plugin: Server %s (%s) of group \"%s\" is available "
+           "again.",
+           se->node, (se->service != NULL) ? se->service : NET_DEFAULT_PORT,
+           client->group->name);
+    return;
+  }
+
+  __atomic_fetch_add(&client->send_errors, 1, __ATOMIC_RELAXED);
+
+  cdtime_t retry = cdtime() + client->group->retry_interval;
+  if (__atomic_exchange_n(&client->down_until, retry, __ATOMIC_RELAXED) == 0)
+    WARNING("network plugin: Sending to server %s (%s) of group \"%s\" "
+            "failed. Its value lists go to the other servers of the group for "
+            "%.3f seconds.",
+            se->node, (se->service != NULL) ? se->service : NET_DEFAULT_PORT,
+            client->group->name,
+            CDTIME_T_TO_DOUBLE(client->group->retry_interval));
+} /* }}} void server_report_status */
+
+/* Sends "buffers" to "se", taking the lock the transport needs. For stream
+ * servers, the connection is picked by "index", so that each send buffer
+ * keeps using the same one. Returns zero on success. Failures of datagram
+ * servers are not reported, since nobody waits for those packets anyway. */
+static int network_send_buffer_locked(sockent_t *se, size_t index, /* {{{ */
+                                      char *const *buffers,
+                                      const size_t *buffers_size,
+                                      size_t buffers_num) {
+  if (buffers_num == 0)
+    return 0;
+
+  if (se->data.client.protocol == IPPROTO_TCP) {
+    stream_client_t *sc =
+        se->data.client.streams + (index % se->data.client.streams_num);
+
+    pthread_mutex_lock(&sc->lock);
+    int status =
+        network_send_buffer_stream(se, sc, buffers, buffers_size, buffers_num);
+    pthread_mutex_unlock(&sc->lock);
+    server_report_status(se, status);
+    return status;
+  }
+
+  pthread_mutex_lock(&se->lock);
+  int status =
+      network_send_buffer_plain(se, buffers, buffers_size, buffers_num);
+  pthread_mutex_unlock(&se->lock);
+  server_report_status(se, status);
+  return 0;
+} /* }}} int network_send_buffer_locked */
 
 #if HAVE_GCRYPT_H
 #define BUFFER_ADD(p, s)                                                       \
@@ -2438,39 +3907,29 @@ static void network_send_buffer_plain(sockent_t *se, /* {{{ */
     buffer_offset += (s);                                                      \
   } while (0)
 
-static void network_send_buffer_signed(sockent_t *se, /* {{{ */
-                                       const char *in_buffer,
-                                       size_t in_buffer_size) {
-  char buffer[BUFF_SIG_SIZE + in_buffer_size];
+/* Writes the signed version of "in_buffer" to "buffer", which must be at least
+ * BUFF_SIG_SIZE bytes larger than "in_buffer". See network_get_hmac() for
+ * "hd_ptr". Returns the number of bytes written or zero on error. */
+static size_t network_sign_buffer(sockent_t *se, /* {{{ */
+                                  gcry_md_hd_t *hd_ptr,
+                                  const char *in_buffer, size_t in_buffer_size,
+                                  char *buffer) {
   size_t buffer_offset;
   size_t username_len;
 
   gcry_md_hd_t hd;
-  gcry_error_t err;
   unsigned char *hash;
 
-  hd = NULL;
-  err = gcry_md_open(&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
-  if (err != 0) {
-    ERROR("network plugin: Creating HMAC object failed: %s",
-          gcry_strerror(err));
-    return;
-  }
-
-  err = gcry_md_setkey(hd, se->data.client.password,
-                       strlen(se->data.client.password));
-  if (err != 0) {
-    ERROR("network plugin: gcry_md_setkey failed: %s", gcry_strerror(err));
-    gcry_md_close(hd);
-    return;
-  }
-
   username_len = strlen(se->data.client.username);
   if (username_len > (BUFF_SIG_SIZE - PART_SIGNATURE_SHA256_SIZE)) {
     ERROR("network plugin: Username too long: %s", se->data.client.username);
-    return;
+    return 0;
   }
 
+  hd = network_get_hmac(se->data.client.password, hd_ptr);
+  if (hd == NULL)
+    return 0;
+
   memcpy(buffer + PART_SIGNATURE_SHA256_SIZE, se->data.client.username,
          username_len);
   memcpy(buffer + PART_SIGNATURE_SHA256_SIZE + username_len, in_buffer,
@@ -2487,8 +3946,9 @@ static void network_send_buffer_signed(sockent_t *se, /* {{{ */
   hash = gcry_md_read(hd, GCRY_MD_SHA256);
   if (hash == NULL) {
     ERROR("network plugin: gcry_md_read failed.");
-    gcry_md_close(hd);
-    return;
+    if (hd_ptr == NULL)
+      gcry_md_close(hd);
+    return 0;
   }
   memcpy(ps.hash, hash, sizeof(ps.hash));
 
@@ -2501,17 +3961,20 @@ static void network_send_buffer_signed(sockent_t *se, /* {{{ */
 
   assert(buffer_offset == PART_SIGNATURE_SHA256_SIZE);
 
-  gcry_md_close(hd);
-  hd = NULL;
-
-  buffer_offset = PART_SIGNATURE_SHA256_SIZE + username_len + in_buffer_size;
-  network_send_buffer_plain(se, buffer, buffer_offset);
-} /* }}} void network_send_buffer_signed */
+  if (hd_ptr == NULL)
+    gcry_md_close(hd);
 
-static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
-                                          const char *in_buffer,
-                                          size_t in_buffer_size) {
-  char buffer[BUFF_SIG_SIZE + in_buffer_size];
+  return PART_SIGNATURE_SHA256_SIZE + username_len + in_buffer_size;
+} /* }}} size_t network_sign_buffer */
+
+/* Writes the encrypted version of "in_buffer" to "buffer", which must be at
+ * least BUFF_SIG_SIZE bytes larger than "in_buffer". See
+ * network_get_aes256_cypher() for "cyper_ptr". Returns the number of bytes
+ * written or zero on error. */
+static size_t network_encrypt_buffer(sockent_t *se, /* {{{ */
+                                     gcry_cipher_hd_t *cyper_ptr,
+                                     const char *in_buffer,
+                                     size_t in_buffer_size, char *buffer) {
   size_t buffer_size;
   size_t buffer_offset;
   size_t header_size;
@@ -2526,14 +3989,13 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
   username_len = strlen(pea.username);
   if ((PART_ENCRYPTION_AES256_SIZE + username_len) > BUFF_SIG_SIZE) {
     ERROR("network plugin: Username too long: %s", pea.username);
-    return;
+    return 0;
   }
 
   buffer_size = PART_ENCRYPTION_AES256_SIZE + username_len + in_buffer_size;
   header_size = PART_ENCRYPTION_AES256_SIZE + username_len - sizeof(pea.hash);
 
-  assert(buffer_size <= sizeof(buffer));
-  DEBUG("network plugin: network_send_buffer_encrypted: "
+  DEBUG("network plugin: network_encrypt_buffer: "
         "buffer_size = %" PRIsz ";",
         buffer_size);
 
@@ -2549,7 +4011,7 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
 
   /* Initialize the buffer */
   buffer_offset = 0;
-  memset(buffer, 0, sizeof(buffer));
+  memset(buffer, 0, buffer_size);
 
   BUFFER_ADD(&pea.head.type, sizeof(pea.head.type));
   BUFFER_ADD(&pea.head.length, sizeof(pea.head.length));
@@ -2562,10 +4024,13 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
 
   assert(buffer_offset == buffer_size);
 
-  cypher = network_get_aes256_cypher(se, pea.iv, sizeof(pea.iv),
-                                     se->data.client.password);
+  if (cyper_ptr == NULL)
+    cyper_ptr = &se->data.client.cypher;
+  cypher = network_get_aes256_cypher(cyper_ptr, GCRY_CIPHER_MODE_OFB,
+                                     se->data.client.password_hash, pea.iv,
+                                     sizeof(pea.iv));
   if (cypher == NULL)
-    return;
+    return 0;
 
   /* Encrypt the buffer in-place */
   err = gcry_cipher_encrypt(cypher, buffer + header_size,
@@ -2574,32 +4039,243 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
   if (err != 0) {
     ERROR("network plugin: gcry_cipher_encrypt returned: %s",
           gcry_strerror(err));
-    return;
+    return 0;
+  }
+
+  return buffer_size;
+} /* }}} size_t network_encrypt_buffer */
+
+/* Writes a new initialization vector for AES-256-GCM to "iv". GCM breaks if an
+ * IV is ever used twice with the same key, and at high packet rates random IVs
+ * get close to that within hours. So the IV is a random prefix, drawn again
+ * whenever the counter that follows it wraps around. */
+static void network_gcm_nonce(char *iv) /* {{{ */
+{
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  static char prefix[8];
+  static uint32_t counter;
+
+  pthread_mutex_lock(&lock);
+  if (counter == 0)
+    gcry_create_nonce(prefix, sizeof(prefix));
+  uint32_t tmp = htonl(counter);
+  counter++;
+  memcpy(iv, prefix, sizeof(prefix));
+  pthread_mutex_unlock(&lock);
+
+  memcpy(iv + sizeof(prefix), &tmp, sizeof(tmp));
+} /* }}} void network_gcm_nonce */
+
+/* Like network_encrypt_buffer(), but writes an AES-256-GCM part. */
+static size_t network_encrypt_buffer_gcm(sockent_t *se, /* {{{ */
+                                         gcry_cipher_hd_t *cyper_ptr,
+                                         const char *in_buffer,
+                                         size_t in_buffer_size,
+                                         char *buffer) {
+  size_t username_len = strlen(se->data.client.username);
+  if ((PART_ENCRYPTION_AES256_GCM_SIZE + username_len) > BUFF_SIG_SIZE) {
+    ERROR("network plugin: Username too long: %s", se->data.client.username);
+    return 0;
+  }
+
+  size_t header_size =
+      PART_ENCRYPTION_AES256_GCM_SIZE + username_len -
+      PART_ENCRYPTION_AES256_GCM_TAG_SIZE;
+  size_t buffer_size =
+      PART_ENCRYPTION_AES256_GCM_SIZE + username_len + in_buffer_size;
+
+  uint16_t type = htons(TYPE_ENCR_AES256_GCM);
+  uint16_t length = htons((uint16_t)buffer_size);
+  uint16_t username_length = htons((uint16_t)username_len);
+  char *iv = buffer + header_size - PART_ENCRYPTION_AES256_GCM_IV_SIZE;
+
+  memcpy(buffer, &type, sizeof(type));
+  memcpy(buffer + 2, &length, sizeof(length));
+  memcpy(buffer + 4, &username_length, sizeof(username_length));
+  memcpy(buffer + 6, se->data.client.username, username_len);
+  network_gcm_nonce(iv);
+
+  if (cyper_ptr == NULL)
+    cyper_ptr = &se->data.client.cypher;
+  gcry_cipher_hd_t cypher = network_get_aes256_cypher(
+      cyper_ptr, GCRY_CIPHER_MODE_GCM, se->data.client.password_hash, iv,
+      PART_ENCRYPTION_AES256_GCM_IV_SIZE);
+  if (cypher == NULL)
+    return 0;
+
+  gcry_error_t err = gcry_cipher_authenticate(cypher, buffer, header_size);
+  if (err == 0)
+    err = gcry_cipher_encrypt(cypher, buffer + header_size, in_buffer_size,
+                              in_buffer, in_buffer_size);
+  if (err == 0)
+    err = gcry_cipher_gettag(cypher, buffer + header_size + in_buffer_size,
+                             PART_ENCRYPTION_AES256_GCM_TAG_SIZE);
+  if (err != 0) {
+    ERROR("network plugin: Encrypting with AES-256-GCM failed: %s",
+          gcry_strerror(err));
+    return 0;
   }
 
-  /* Send it out without further modifications */
-  network_send_buffer_plain(se, buffer, buffer_size);
-} /* }}} void network_send_buffer_encrypted */
+  return buffer_size;
+} /* }}} size_t network_encrypt_buffer_gcm */
 #undef BUFFER_ADD
 #endif /* HAVE_GCRYPT_H */
 
-static void network_send_buffer(char *buffer, size_t buffer_len) /* {{{ */
-{
-  DEBUG("network plugin: network_send_buffer: buffer_len = %" PRIsz,
-        buffer_len);
+/* Writes the compressed version of "in_buffer" to "buffer", which must be at
+ * least as large as "in_buffer". Returns the number of bytes written, or zero
+ * if compression failed or didn't make the packet smaller. */
+static size_t network_compress_buffer(compressor_t *c, /* {{{ */
+                                      const char *in_buffer,
+                                      size_t in_buffer_size, char *buffer) {
+  void const *data = NULL;
+  size_t data_size = 0;
+
+  if (compressor_compress(c, in_buffer, in_buffer_size, &data, &data_size) !=
+      0)
+    return 0;
+
+  size_t buffer_size = PART_COMPRESSION_GZIP_SIZE + data_size;
+  if (buffer_size >= in_buffer_size)
+    return 0;
+
+  uint16_t type = htons(TYPE_COMPR_GZIP);
+  uint16_t length = htons((uint16_t)buffer_size);
+  uint16_t orig_length = htons((uint16_t)in_buffer_size);
+
+  memcpy(buffer, &type, sizeof(type));
+  memcpy(buffer + 2, &length, sizeof(length));
+  memcpy(buffer + 4, &orig_length, sizeof(orig_length));
+  memcpy(buffer + PART_COMPRESSION_GZIP_SIZE, data, data_size);
+
+  return buffer_size;
+} /* }}} size_t network_compress_buffer */
+
+/* Sends "buffers" to the servers of destination "dest", i.e. to the grouped
+ * server with that "dest" or, if zero, to all servers outside of groups.
+ * "scratch" must provide "buffers_num" buffers of network_config_packet_size +
+ * BUFF_SIG_SIZE bytes for signing and encrypting. If a server uses
+ * compression, "compressed" must provide "buffers_num" buffers of
+ * network_config_packet_size bytes. If "sb" is not NULL, its compressor,
+ * cyphers and HMAC objects are used, so that encryption happens without
+ * holding the socket's lock. Returns non-zero if sending to a stream server
+ * failed. */
+static int network_send_buffers(size_t dest, /* {{{ */
+                                 char *const *all_buffers,
+                                 const size_t *all_buffers_size,
+                                 size_t buffers_num, char *const *scratch,
+                                 char *const *compressed, send_buffer_t *sb) {
+  DEBUG("network plugin: network_send_buffers: buffers_num = %" PRIsz,
+        buffers_num);
+
+  /* The packets are compressed once, when the first server that uses
+   * compression is reached. */
+  char *compressed_buffers[buffers_num];
+  size_t compressed_size[buffers_num];
+  bool have_compressed = false;
+
+  size_t index = (sb != NULL) ? sb->index : 0;
+  int ret = 0;
+
+  size_t se_index = 0;
+  for (sockent_t *se = sending_sockets; se != NULL;
+       se = se->next, se_index++) {
+    if (se->data.client.dest != dest)
+      continue;
+
+    char *const *buffers = all_buffers;
+    const size_t *buffers_size = all_buffers_size;
+
+    if (se->data.client.compression != COMPRESS_NONE) {
+      if (!have_compressed) {
+        compressor_t *c = (sb != NULL) ? sb->compressor : NULL;
+        compressor_t *tmp = NULL;
+        if (c == NULL)
+          c = tmp = compressor_create(se->data.client.compression);
+
+        for (size_t i = 0; i < buffers_num; i++) {
+          size_t size = 0;
+          if (c != NULL)
+            size = network_compress_buffer(c, all_buffers[i],
+                                           all_buffers_size[i], compressed[i]);
+          if (size == 0) {
+            compressed_buffers[i] = all_buffers[i];
+            compressed_size[i] = all_buffers_size[i];
+          } else {
+            compressed_buffers[i] = compressed[i];
+            compressed_size[i] = size;
+          }
+        }
+
+        compressor_destroy(tmp);
+        have_compressed = true;
+      }
+
+      buffers = compressed_buffers;
+      buffers_size = compressed_size;
+    }
 
-  for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
-    pthread_mutex_lock(&se->lock);
 #if HAVE_GCRYPT_H
-    if (se->data.client.security_level == SECURITY_LEVEL_ENCRYPT)
-      network_send_buffer_encrypted(se, buffer, buffer_len);
-    else if (se->data.client.security_level == SECURITY_LEVEL_SIGN)
-      network_send_buffer_signed(se, buffer, buffer_len);
-    else /* if (se->data.client.security_level == SECURITY_LEVEL_NONE) */
-#endif   /* HAVE_GCRYPT_H */
-      network_send_buffer_plain(se, buffer, buffer_len);
-    pthread_mutex_unlock(&se->lock);
+    if (se->data.client.security_level != SECURITY_LEVEL_NONE) {
+      size_t scratch_size[buffers_num];
+      size_t scratch_num = 0;
+
+      gcry_cipher_hd_t *cyper_ptr = NULL;
+      if ((sb != NULL) && (sb->cyphers != NULL))
+        cyper_ptr = sb->cyphers + se_index;
+      gcry_md_hd_t *hd_ptr = NULL;
+      if ((sb != NULL) && (sb->hmacs != NULL))
+        hd_ptr = sb->hmacs + se_index;
+
+      /* The socket's own cypher handle is shared with other threads. */
+      bool locked = (cyper_ptr == NULL) &&
+                    (se->data.client.security_level == SECURITY_LEVEL_ENCRYPT);
+      if (locked)
+        pthread_mutex_lock(&se->lock);
+
+      for (size_t i = 0; i < buffers_num; i++) {
+        size_t size;
+        if ((se->data.client.security_level == SECURITY_LEVEL_ENCRYPT) &&
+            (se->data.client.cipher_mode == GCRY_CIPHER_MODE_GCM))
+          size = network_encrypt_buffer_gcm(se, cyper_ptr, buffers[i],
+                                            buffers_size[i],
+                                            scratch[scratch_num]);
+        else if (se->data.client.security_level == SECURITY_LEVEL_ENCRYPT)
+          size = network_encrypt_buffer(se, cyper_ptr, buffers[i],
+                                        buffers_size[i], scratch[scratch_num]);
+        else /* if (se->data.client.security_level == SECURITY_LEVEL_SIGN) */
+          size = network_sign_buffer(se, hd_ptr, buffers[i], buffers_size[i],
+                                     scratch[scratch_num]);
+        if (size == 0)
+          continue;
+        scratch_size[scratch_num] = size;
+        scratch_num++;
+      }
+
+      if (locked)
+        pthread_mutex_unlock(&se->lock);
+
+      if (network_send_buffer_locked(se, index, scratch, scratch_size,
+                                     scratch_num) != 0)
+        ret = -1;
+      continue;
+    }
+#endif /* HAVE_GCRYPT_H */
+
+    if (network_send_buffer_locked(se, index, buffers, buffers_size,
+                                   buffers_num) != 0)
+      ret = -1;
   } /* for (sending_sockets) */
+
+  return ret;
+} /* }}} int network_send_buffers */
+
+static void network_send_buffer(size_t dest, char *buffer, /* {{{ */
+                                size_t buffer_len) {
+  char scratch[network_config_packet_size + BUFF_SIG_SIZE];
+  char compressed[network_config_packet_size];
+
+  (void)network_send_buffers(dest, &buffer, &buffer_len, 1, &(char *){scratch},
+                             &(char *){compressed}, /* sb = */ NULL);
 } /* }}} void network_send_buffer */
 
 static int add_to_buffer(char *buffer, size_t buffer_size, /* {{{ */
@@ -2665,86 +4341,409 @@ static int add_to_buffer(char *buffer, size_t buffer_size, /* {{{ */
   return buffer - buffer_orig;
 } /* }}} int add_to_buffer */
 
-static void flush_buffer(void) {
-  DEBUG("network plugin: flush_buffer: send_buffer_fill = %i",
-        send_buffer_fill);
 
-  network_send_buffer(send_buffer, (size_t)send_buffer_fill);
+/* Starts a new packet in "packets[packets_num]". */
+static void send_buffer_init_packet(send_buffer_t *sb) /* {{{ */
+{
+  memset(sb->packets[sb->packets_num], 0, network_config_packet_size);
+  sb->buffer_ptr = sb->packets[sb->packets_num];
+  sb->buffer_fill = 0;
+  sb->first_update = 0;
+  sb->last_update = 0;
 
-  stats_octets_tx += ((uint64_t)send_buffer_fill);
-  stats_packets_tx++;
+  memset(&sb->vl, 0, sizeof(sb->vl));
+} /* }}} void send_buffer_init_packet */
 
-  network_init_buffer();
-}
+static void send_buffer_destroy(send_buffer_t *sb) /* {{{ */
+{
+  if (sb == NULL)
+    return;
 
-static int network_write(const data_set_t *ds, const value_list_t *vl,
-                         user_data_t __attribute__((unused)) * user_data) {
-  int status;
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sb->packets); i++)
+    sfree(sb->packets[i]);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sb->scratch); i++)
+    sfree(sb->scratch[i]);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sb->compressed); i++)
+    sfree(sb->compressed[i]);
+  compressor_destroy(sb->compressor);
+#if HAVE_GCRYPT_H
+  if (sb->cyphers != NULL) {
+    for (size_t i = 0; i < sending_sockets_num; i++)
+      if (sb->cyphers[i] != NULL)
+        gcry_cipher_close(sb->cyphers[i]);
+    sfree(sb->cyphers);
+  }
+  if (sb->hmacs != NULL) {
+    for (size_t i = 0; i < sending_sockets_num; i++)
+      if (sb->hmacs[i] != NULL)
+        gcry_md_close(sb->hmacs[i]);
+    sfree(sb->hmacs);
+  }
+#endif
+  /* The peers are in the "send_buffers" list themselves. */
+  sfree(sb->peers);
+  pthread_mutex_destroy(&sb->lock);
+  sfree(sb);
+} /* }}} void send_buffer_destroy */
 
-  /* listen_loop is set to non-zero in the shutdown callback, which is
-   * guaranteed to be called *after* all the write threads have been shut
-   * down. */
-  assert(listen_loop == 0);
+static send_buffer_t *send_buffer_create(size_t dest) /* {{{ */
+{
+  send_buffer_t *sb = calloc(1, sizeof(*sb));
+  if (sb == NULL)
+    return NULL;
+  pthread_mutex_init(&sb->lock, /* attr = */ NULL);
+  sb->dest = dest;
 
-  if (!check_send_okay(vl)) {
-#if COLLECT_DEBUG
-    char name[6 * DATA_MAX_NAME_LEN];
-    FORMAT_VL(name, sizeof(name), vl);
-    name[sizeof(name) - 1] = '\0';
-    DEBUG("network plugin: network_write: "
-          "NOT sending %s.",
-          name);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sb->packets); i++) {
+    sb->packets[i] = malloc(network_config_packet_size);
+    if (sb->packets[i] == NULL) {
+      send_buffer_destroy(sb);
+      return NULL;
+    }
+  }
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sb->scratch); i++) {
+    sb->scratch[i] = malloc(network_config_packet_size + BUFF_SIG_SIZE);
+    if (sb->scratch[i] == NULL) {
+      send_buffer_destroy(sb);
+      return NULL;
+    }
+  }
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
+    if ((se->data.client.dest != dest) ||
+        (se->data.client.compression == COMPRESS_NONE))
+      continue;
+
+    sb->compressor = compressor_create(se->data.client.compression);
+    if (sb->compressor == NULL) {
+      send_buffer_destroy(sb);
+      return NULL;
+    }
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(sb->compressed); i++) {
+      sb->compressed[i] = malloc(network_config_packet_size);
+      if (sb->compressed[i] == NULL) {
+        send_buffer_destroy(sb);
+        return NULL;
+      }
+    }
+    break;
+  }
+#if HAVE_GCRYPT_H
+  /* Without own cyphers the sockets' cyphers are used. */
+  sb->cyphers = calloc(sending_sockets_num, sizeof(*sb->cyphers));
+  sb->hmacs = calloc(sending_sockets_num, sizeof(*sb->hmacs));
 #endif
-    /* Counter is not protected by another lock and may be reached by
-     * multiple threads */
-    pthread_mutex_lock(&stats_lock);
-    stats_values_not_sent++;
-    pthread_mutex_unlock(&stats_lock);
+
+  send_buffer_init_packet(sb);
+  return sb;
+} /* }}} send_buffer_t *send_buffer_create */
+
+/* Returns the calling thread's send buffer, creating it if necessary. With
+ * server groups, the buffers for the grouped servers are created along with
+ * it, see send_buffer_dest(). */
+static send_buffer_t *send_buffer_get(void) /* {{{ */
+{
+  send_buffer_t *sb = pthread_getspecific(send_buffer_key);
+  if (sb != NULL)
+    return sb;
+
+  sb = send_buffer_create(/* dest = */ 0);
+  if ((sb != NULL) && (send_dests_num > 1)) {
+    sb->peers = calloc(send_dests_num, sizeof(*sb->peers));
+    if (sb->peers == NULL) {
+      send_buffer_destroy(sb);
+      sb = NULL;
+    }
+  }
+  if (sb == NULL) {
+    ERROR("network plugin: send_buffer_create failed.");
+    return NULL;
+  }
+
+  if (sb->peers != NULL) {
+    sb->peers[0] = sb;
+    for (size_t dest = 1; dest < send_dests_num; dest++) {
+      sb->peers[dest] = send_buffer_create(dest);
+      if (sb->peers[dest] != NULL)
+        continue;
+
+      ERROR("network plugin: send_buffer_create failed.");
+      for (size_t i = 1; i < dest; i++)
+        send_buffer_destroy(sb->peers[i]);
+      send_buffer_destroy(sb);
+      return NULL;
+    }
+  }
+
+  pthread_mutex_lock(&send_buffers_lock);
+  sb->index = send_buffers_num;
+  for (size_t dest = send_dests_num; dest > 1; dest--) {
+    send_buffer_t *peer = sb->peers[dest - 1];
+    peer->index = sb->index;
+    peer->next = send_buffers;
+    send_buffers = peer;
+  }
+  sb->next = send_buffers;
+  send_buffers = sb;
+  send_buffers_num++;
+  pthread_mutex_unlock(&send_buffers_lock);
+
+  pthread_setspecific(send_buffer_key, sb);
+  return sb;
+} /* }}} send_buffer_t *send_buffer_get */
+
+/* Returns the buffer of the calling thread for destination "dest". */
+static send_buffer_t *send_buffer_dest(send_buffer_t *sb, /* {{{ */
+                                       size_t dest) {
+  return (dest == 0) ? sb : sb->peers[dest];
+} /* }}} send_buffer_t *send_buffer_dest */
+
+/* Sends all finished packets. The send buffer must be locked. Returns
+ * non-zero if sending to a stream server failed; the packets are dropped
+ * either way. */
+static int send_buffer_send(send_buffer_t *sb) /* {{{ */
+{
+  if (sb->packets_num == 0)
     return 0;
+
+  int status = network_send_buffers(sb->dest, sb->packets, sb->packets_len,
+                                    sb->packets_num, sb->scratch,
+                                    sb->compressed, sb);
+
+  /* Move the packet being built to the front. */
+  char *tmp = sb->packets[0];
+  sb->packets[0] = sb->packets[sb->packets_num];
+  sb->packets[sb->packets_num] = tmp;
+  sb->buffer_ptr = sb->packets[0] + sb->buffer_fill;
+  sb->packets_num = 0;
+
+  return status;
+} /* }}} int send_buffer_send */
+
+/* Adds "buffer" to the calling thread's send buffer as a finished packet.
+ * Relayed packets skip the dispatch and write paths, so a dispatch thread's
+ * send buffer only ever holds relayed packets. Returns true if the packet is
+ * one of the packets sampled by "RelaySample". */
+static bool network_relay_send(const void *buffer, /* {{{ */
+                               size_t buffer_size) {
+  send_buffer_t *sb = send_buffer_get();
+  if (sb == NULL)
+    return false;
+
+  pthread_mutex_lock(&sb->lock);
+  assert(sb->buffer_fill == 0);
+  memcpy(sb->packets[sb->packets_num], buffer, buffer_size);
+  sb->packets_len[sb->packets_num] = buffer_size;
+  sb->packets_num++;
+  sb->buffer_ptr = sb->packets[sb->packets_num];
+
+  sb->octets_tx += (derive_t)buffer_size;
+  sb->packets_tx++;
+  sb->packets_relayed++;
+  bool sample = (network_config_relay_sample > 0) &&
+                ((sb->packets_relayed % network_config_relay_sample) == 0);
+
+  if (sb->packets_num >= SEND_BATCH_SIZE)
+    send_buffer_send(sb);
+  pthread_mutex_unlock(&sb->lock);
+
+  return sample;
+} /* }}} bool network_relay_send */
+
+/* Sends the packets network_relay_send() has collected. */
+static void network_relay_flush(void) /* {{{ */
+{
+  send_buffer_t *sb = pthread_getspecific(send_buffer_key);
+  if (sb == NULL)
+    return;
+
+  pthread_mutex_lock(&sb->lock);
+  send_buffer_send(sb);
+  pthread_mutex_unlock(&sb->lock);
+} /* }}} void network_relay_flush */
+
+/* Marks the packet being built as finished and starts a new one. Sends the
+ * finished packets if there is no room for another one. The send buffer must
+ * be locked. Returns the status of send_buffer_send(). */
+static int send_buffer_finish_packet(send_buffer_t *sb) /* {{{ */
+{
+  int status = 0;
+
+  DEBUG("network plugin: send_buffer_finish_packet: buffer_fill = %i",
+        sb->buffer_fill);
+
+  if (sb->buffer_fill <= 0)
+    return 0;
+
+  sb->packets_len[sb->packets_num] = (size_t)sb->buffer_fill;
+  sb->packets_num++;
+
+  sb->octets_tx += ((uint64_t)sb->buffer_fill);
+  sb->packets_tx++;
+
+  if (sb->packets_num >= SEND_BATCH_SIZE) {
+    sb->buffer_fill = 0;
+    status = send_buffer_send(sb);
   }
 
-  uc_meta_data_add_unsigned_int(vl, "network:time_sent", (uint64_t)vl->time);
+  send_buffer_init_packet(sb);
+  return status;
+} /* }}} int send_buffer_finish_packet */
 
-  pthread_mutex_lock(&send_buffer_lock);
+/* Adds "vl" to the send buffer. The send buffer must be locked. Returns
+ * non-zero if "vl" couldn't be added or sending finished packets failed. */
+static int send_buffer_add(send_buffer_t *sb, /* {{{ */
+                           const data_set_t *ds, const value_list_t *vl) {
+  int status;
+  int send_status = 0;
 
-  status = add_to_buffer(send_buffer_ptr,
+  status = add_to_buffer(sb->buffer_ptr,
                          network_config_packet_size -
-                             (send_buffer_fill + BUFF_SIG_SIZE),
-                         &send_buffer_vl, ds, vl);
-  if (status >= 0) {
-    /* status == bytes added to the buffer */
-    send_buffer_fill += status;
-    send_buffer_ptr += status;
-    send_buffer_last_update = cdtime();
-
-    stats_values_sent++;
-  } else {
-    flush_buffer();
+                             (sb->buffer_fill + BUFF_SIG_SIZE),
+                         &sb->vl, ds, vl);
+  if (status < 0) {
+    send_status = send_buffer_finish_packet(sb);
 
-    status = add_to_buffer(send_buffer_ptr,
+    status = add_to_buffer(sb->buffer_ptr,
                            network_config_packet_size -
-                               (send_buffer_fill + BUFF_SIG_SIZE),
-                           &send_buffer_vl, ds, vl);
-
-    if (status >= 0) {
-      send_buffer_fill += status;
-      send_buffer_ptr += status;
-
-      stats_values_sent++;
-    }
+                               (sb->buffer_fill + BUFF_SIG_SIZE),
+                           &sb->vl, ds, vl);
   }
 
   if (status < 0) {
     ERROR("network plugin: Unable to append to the "
           "buffer for some weird reason");
-  } else if ((network_config_packet_size - send_buffer_fill) < 15) {
-    flush_buffer();
+    return -1;
+  }
+
+  /* status == bytes added to the buffer */
+  if (sb->buffer_fill == 0)
+    sb->first_update = cdtime();
+  sb->buffer_fill += status;
+  sb->buffer_ptr += status;
+  sb->last_update = cdtime();
+  sb->values_sent++;
+
+  if ((network_config_packet_size - sb->buffer_fill) < 15) {
+    if (send_buffer_finish_packet(sb) != 0)
+      send_status = -1;
+  }
+
+  return send_status;
+} /* }}} int send_buffer_add */
+
+/* Sends the packets that have been waiting for more values for longer than
+ * one interval. Without this, a packet of a write thread that rarely gets
+ * values could be held back until shutdown. Buffers locked by another thread
+ * are skipped. */
+static void send_buffers_send_stale(cdtime_t now) /* {{{ */
+{
+  cdtime_t interval = plugin_get_interval();
+
+  pthread_mutex_lock(&send_buffers_lock);
+  send_buffer_t *sb = send_buffers;
+  pthread_mutex_unlock(&send_buffers_lock);
+
+  for (; sb != NULL; sb = sb->next) {
+    if (pthread_mutex_trylock(&sb->lock) != 0)
+      continue;
+    if ((sb->buffer_fill > 0) && ((sb->first_update + interval) <= now)) {
+      send_buffer_finish_packet(sb);
+      send_buffer_send(sb);
+    }
+    pthread_mutex_unlock(&sb->lock);
+  }
+} /* }}} void send_buffers_send_stale */
+
+/* Adds "vl" to the buffers of the servers each server group picks for it.
+ * All of the calling thread's buffers must be locked. */
+static int send_buffer_add_grouped(send_buffer_t *sb, /* {{{ */
+                                   const data_set_t *ds, const value_list_t *vl,
+                                   cdtime_t now) {
+  uint64_t hash =
+      network_hash_identifier(vl->host, vl->plugin, vl->plugin_instance,
+                              vl->type, vl->type_instance);
+  int ret = 0;
+
+  for (server_group_t *g = server_groups; g != NULL; g = g->next) {
+    sockent_t *servers[g->replicas];
+    size_t servers_num = server_group_pick(g, hash, now, servers);
+
+    for (size_t i = 0; i < servers_num; i++) {
+      send_buffer_t *dest_sb =
+          send_buffer_dest(sb, servers[i]->data.client.dest);
+      if (send_buffer_add(dest_sb, ds, vl) != 0)
+        ret = -1;
+    }
+  }
+
+  return ret;
+} /* }}} int send_buffer_add_grouped */
+
+static int network_write_batch(const data_set_t *const *ds, /* {{{ */
+                               const value_list_t *const *vl, size_t num,
+                               user_data_t __attribute__((unused)) *
+                                   user_data) {
+  int ret = 0;
+
+  /* listen_loop is set to non-zero in the shutdown callback, which is
+   * guaranteed to be called *after* all the write threads have been shut
+   * down. */
+  assert(listen_loop == 0);
+
+  send_buffer_t *sb = send_buffer_get();
+  if (sb == NULL)
+    return ENOMEM;
+
+  cdtime_t now = cdtime();
+
+  /* Flushing threads only ever lock one buffer, so holding all of this
+   * thread's buffers can't deadlock. */
+  for (size_t dest = 0; dest < send_dests_num; dest++)
+    pthread_mutex_lock(&send_buffer_dest(sb, dest)->lock);
+  for (size_t i = 0; i < num; i++) {
+    if (!check_send_okay(vl[i])) {
+#if COLLECT_DEBUG
+      char name[6 * DATA_MAX_NAME_LEN];
+      FORMAT_VL(name, sizeof(name), vl[i]);
+      name[sizeof(name) - 1] = '\0';
+      DEBUG("network plugin: network_write: "
+            "NOT sending %s.",
+            name);
+#endif
+      /* Counter is not protected by another lock and may be reached by
+       * multiple threads */
+      pthread_mutex_lock(&stats_lock);
+      stats_values_not_sent++;
+      pthread_mutex_unlock(&stats_lock);
+      continue;
+    }
+
+    uc_meta_data_add_unsigned_int(vl[i], "network:time_sent",
+                                  (uint64_t)vl[i]->time);
+
+    if (have_ungrouped_servers && (send_buffer_add(sb, ds[i], vl[i]) != 0))
+      ret = -1;
+    if ((server_groups != NULL) &&
+        (send_buffer_add_grouped(sb, ds[i], vl[i], now) != 0))
+      ret = -1;
   }
 
-  pthread_mutex_unlock(&send_buffer_lock);
+  /* Packets are not kept around between calls, only the unfinished one. With
+   * stream servers, the unfinished one is sent, too, so that a failure is
+   * reported for the values of this call and the caller can retry them. */
+  for (size_t dest = 0; dest < send_dests_num; dest++) {
+    send_buffer_t *dest_sb = send_buffer_dest(sb, dest);
+    if (have_stream_servers && (send_buffer_finish_packet(dest_sb) != 0))
+      ret = -1;
+    if (send_buffer_send(dest_sb) != 0)
+      ret = -1;
+    pthread_mutex_unlock(&dest_sb->lock);
+  }
+
+  send_buffers_send_stale(now);
 
-  return (status < 0) ? -1 : 0;
-} /* int network_write */
+  return ret;
+} /* }}} int network_write_batch */
 
 static int network_config_set_ttl(const oconfig_item_t *ci) /* {{{ */
 {
@@ -2825,6 +4824,30 @@ network_config_set_bind_address(const oconfig_item_t *ci,
   return 0;
 } /* int network_config_set_bind_address */
 
+static int network_config_set_receive_threads(const oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+
+  if (tmp < 1) {
+    WARNING("network plugin: The `ReceiveThreads' option must be at least 1.");
+    return -1;
+  }
+
+#ifndef SO_REUSEPORT
+  if (tmp > 1) {
+    WARNING("network plugin: `ReceiveThreads' requires SO_REUSEPORT, which "
+            "is not available on this system. Using one receive thread.");
+    tmp = 1;
+  }
+#endif
+
+  network_config_receive_threads = (size_t)tmp;
+  return 0;
+} /* }}} int network_config_set_receive_threads */
+
 static int network_config_set_buffer_size(const oconfig_item_t *ci) /* {{{ */
 {
   int tmp = 0;
@@ -2866,8 +4889,62 @@ static int network_config_set_security_level(oconfig_item_t *ci, /* {{{ */
 
   return 0;
 } /* }}} int network_config_set_security_level */
+
+static int network_config_set_cipher_mode(const oconfig_item_t *ci, /* {{{ */
+                                          int *retval) {
+  char value[8];
+  if (cf_util_get_string_buffer(ci, value, sizeof(value)) != 0)
+    return -1;
+
+  if (strcasecmp("OFB", value) == 0)
+    *retval = GCRY_CIPHER_MODE_OFB;
+  else if (strcasecmp("GCM", value) == 0)
+    *retval = GCRY_CIPHER_MODE_GCM;
+  else {
+    WARNING("network plugin: Unknown cipher mode: %s.", value);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_cipher_mode */
 #endif /* HAVE_GCRYPT_H */
 
+static int network_config_set_compression(const oconfig_item_t *ci, /* {{{ */
+                                          compress_algorithm_t *retval) {
+  char *value = NULL;
+  if (cf_util_get_string(ci, &value) != 0)
+    return -1;
+
+  int status = compress_algorithm_parse(value, retval);
+  if (status == ENOTSUP)
+    WARNING("network plugin: collectd was built without support for "
+            "\"Compression %s\".",
+            value);
+  else if (status != 0)
+    WARNING("network plugin: Unknown compression: %s.", value);
+
+  sfree(value);
+  return (status == 0) ? 0 : -1;
+} /* }}} int network_config_set_compression */
+
+static int network_config_set_protocol(const oconfig_item_t *ci, /* {{{ */
+                                       int *retval) {
+  char value[16];
+  if (cf_util_get_string_buffer(ci, value, sizeof(value)) != 0)
+    return -1;
+
+  if (strcasecmp("UDP", value) == 0)
+    *retval = IPPROTO_UDP;
+  else if (strcasecmp("TCP", value) == 0)
+    *retval = IPPROTO_TCP;
+  else {
+    WARNING("network plugin: Unknown protocol: %s.", value);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_set_protocol */
+
 static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
 {
   sockent_t *se;
@@ -2904,6 +4981,8 @@ static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
 #endif /* HAVE_GCRYPT_H */
         if (strcasecmp("Interface", child->key) == 0)
       network_config_set_interface(child, &se->interface);
+    else if (strcasecmp("Protocol", child->key) == 0)
+      network_config_set_protocol(child, &se->data.server.protocol);
     else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
@@ -2928,14 +5007,8 @@ static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
-  status = sockent_server_listen(se);
-  if (status != 0) {
-    ERROR("network plugin: network_config_add_listen: sockent_server_listen "
-          "failed.");
-    sockent_destroy(se);
-    return -1;
-  }
-
+  /* The sockets are opened in network_init(), when the number of receive
+   * threads is known regardless of the order of the options. */
   status = sockent_add(se);
   if (status != 0) {
     ERROR("network plugin: network_config_add_listen: sockent_add failed.");
@@ -2946,8 +5019,10 @@ static int network_config_add_listen(const oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int network_config_add_listen */
 
-static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
-{
+/* Adds a <Server> block. If "group" is not NULL, the server is a member of
+ * that <ServerGroup>. */
+static int network_config_add_server(const oconfig_item_t *ci, /* {{{ */
+                                     server_group_t *group) {
   sockent_t *se;
   int status;
 
@@ -2980,6 +5055,8 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &se->data.client.password);
     else if (strcasecmp("SecurityLevel", child->key) == 0)
       network_config_set_security_level(child, &se->data.client.security_level);
+    else if (strcasecmp("CipherMode", child->key) == 0)
+      network_config_set_cipher_mode(child, &se->data.client.cipher_mode);
     else
 #endif /* HAVE_GCRYPT_H */
         if (strcasecmp("Interface", child->key) == 0)
@@ -2988,7 +5065,21 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
       network_config_set_bind_address(child, &se->data.client.bind_addr);
     else if (strcasecmp("ResolveInterval", child->key) == 0)
       cf_util_get_cdtime(child, &se->data.client.resolve_interval);
-    else {
+    else if (strcasecmp("Compression", child->key) == 0)
+      network_config_set_compression(child, &se->data.client.compression);
+    else if (strcasecmp("Protocol", child->key) == 0)
+      network_config_set_protocol(child, &se->data.client.protocol);
+    else if (strcasecmp("Connections", child->key) == 0) {
+      int tmp = 0;
+      if (cf_util_get_int(child, &tmp) != 0)
+        continue;
+      if (tmp < 1) {
+        WARNING("network plugin: The `Connections' option must be at least "
+                "1.");
+        continue;
+      }
+      se->data.client.streams_num = (size_t)tmp;
+    } else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
   }
@@ -3013,8 +5104,46 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  if (se->data.client.protocol == IPPROTO_TCP) {
+    se->data.client.streams =
+        calloc(se->data.client.streams_num, sizeof(*se->data.client.streams));
+    if (se->data.client.streams == NULL) {
+      ERROR("network plugin: calloc failed.");
+      se->data.client.streams_num = 0;
+      sockent_destroy(se);
+      return -1;
+    }
+    for (size_t i = 0; i < se->data.client.streams_num; i++) {
+      se->data.client.streams[i].fd = -1;
+      pthread_mutex_init(&se->data.client.streams[i].lock, /* attr = */ NULL);
+    }
+    have_stream_servers = true;
+  } else if (se->data.client.streams_num != 1) {
+    WARNING("network plugin: The `Connections' option only applies to "
+            "\"Protocol TCP\".");
+  }
+
   /* No call to sockent_client_connect() here -- it is called from
-   * network_send_buffer_plain(). */
+   * network_send_buffer_plain() and network_send_buffer_stream(). */
+
+  if (group != NULL) {
+    sockent_t **tmp = realloc(group->servers, (group->servers_num + 1) *
+                                                  sizeof(*group->servers));
+    if (tmp == NULL) {
+      ERROR("network plugin: realloc failed.");
+      sockent_destroy(se);
+      return -1;
+    }
+    group->servers = tmp;
+    group->servers[group->servers_num] = se;
+    group->servers_num++;
+
+    se->data.client.group = group;
+    se->data.client.dest = send_dests_num;
+    send_dests_num++;
+  } else {
+    have_ungrouped_servers = true;
+  }
 
   status = sockent_add(se);
   if (status != 0) {
@@ -3026,6 +5155,69 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int network_config_add_server */
 
+static int network_config_add_server_group(const oconfig_item_t *ci) /* {{{ */
+{
+  server_group_t *g = calloc(1, sizeof(*g));
+  if (g == NULL) {
+    ERROR("network plugin: calloc failed.");
+    return -1;
+  }
+  g->replicas = 1;
+  g->retry_interval = SERVER_GROUP_RETRY_INTERVAL;
+
+  if (cf_util_get_string(ci, &g->name) != 0) {
+    sfree(g);
+    return -1;
+  }
+
+  /* The group is added right away, because its servers point to it. */
+  server_group_t **last = &server_groups;
+  while (*last != NULL)
+    last = &(*last)->next;
+  *last = g;
+
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("Server", child->key) == 0)
+      network_config_add_server(child, g);
+    else if (strcasecmp("Replicas", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) != 0) || (tmp < 1))
+        WARNING("network plugin: `Replicas' must be at least 1.");
+      else
+        g->replicas = (size_t)tmp;
+    } else if (strcasecmp("RetryInterval", child->key) == 0)
+      cf_util_get_cdtime(child, &g->retry_interval);
+    else
+      WARNING("network plugin: Option `%s' is not allowed here.", child->key);
+  }
+
+  if (g->servers_num == 0) {
+    WARNING("network plugin: Server group \"%s\" has no servers.", g->name);
+    *last = NULL;
+    sfree(g->name);
+    sfree(g);
+    return -1;
+  }
+
+  if (g->replicas > g->servers_num) {
+    WARNING("network plugin: Server group \"%s\" has fewer servers than "
+            "`Replicas'. Sending to all of its %" PRIsz " servers.",
+            g->name, g->servers_num);
+    g->replicas = g->servers_num;
+  }
+
+  if (server_group_build_ring(g) != 0) {
+    ERROR("network plugin: Building the ring of server group \"%s\" "
+          "failed.",
+          g->name);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int network_config_add_server_group */
+
 static int network_config(oconfig_item_t *ci) /* {{{ */
 {
   /* The options need to be applied first */
@@ -3033,6 +5225,8 @@ static int network_config(oconfig_item_t *ci) /* {{{ */
     oconfig_item_t *child = ci->children + i;
     if (strcasecmp("TimeToLive", child->key) == 0)
       network_config_set_ttl(child);
+    else if (strcasecmp("ReceiveThreads", child->key) == 0)
+      network_config_set_receive_threads(child);
   }
 
   for (int i = 0; i < ci->children_num; i++) {
@@ -3041,15 +5235,29 @@ static int network_config(oconfig_item_t *ci) /* {{{ */
     if (strcasecmp("Listen", child->key) == 0)
       network_config_add_listen(child);
     else if (strcasecmp("Server", child->key) == 0)
-      network_config_add_server(child);
-    else if (strcasecmp("TimeToLive", child->key) == 0) {
+      network_config_add_server(child, /* group = */ NULL);
+    else if (strcasecmp("ServerGroup", child->key) == 0)
+      network_config_add_server_group(child);
+    else if ((strcasecmp("TimeToLive", child->key) == 0) ||
+             (strcasecmp("ReceiveThreads", child->key) == 0)) {
       /* Handled earlier */
     } else if (strcasecmp("MaxPacketSize", child->key) == 0)
       network_config_set_buffer_size(child);
     else if (strcasecmp("Forward", child->key) == 0)
       cf_util_get_boolean(child, &network_config_forward);
+    else if (strcasecmp("Relay", child->key) == 0)
+      cf_util_get_boolean(child, &network_config_relay);
+    else if (strcasecmp("RelaySample", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) != 0) || (tmp < 0))
+        WARNING("network plugin: `RelaySample' must be zero or positive.");
+      else
+        network_config_relay_sample = (uint64_t)tmp;
+    }
     else if (strcasecmp("ReportStats", child->key) == 0)
       cf_util_get_boolean(child, &network_config_stats);
+    else if (strcasecmp("DropDuplicates", child->key) == 0)
+      cf_util_get_boolean(child, &network_config_drop_duplicates);
     else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
@@ -3121,7 +5329,23 @@ static int network_notification(const notification_t *n,
   if (status != 0)
     return -1;
 
-  network_send_buffer(buffer, sizeof(buffer) - buffer_free);
+  size_t buffer_len = sizeof(buffer) - buffer_free;
+  if (have_ungrouped_servers)
+    network_send_buffer(/* dest = */ 0, buffer, buffer_len);
+
+  /* Notifications go to the servers that get the values of the same
+   * identifier. */
+  uint64_t hash = network_hash_identifier(n->host, n->plugin,
+                                          n->plugin_instance, n->type,
+                                          n->type_instance);
+  cdtime_t now = cdtime();
+  for (server_group_t *g = server_groups; g != NULL; g = g->next) {
+    sockent_t *servers[g->replicas];
+    size_t servers_num = server_group_pick(g, hash, now, servers);
+
+    for (size_t i = 0; i < servers_num; i++)
+      network_send_buffer(servers[i]->data.client.dest, buffer, buffer_len);
+  }
 
   return 0;
 } /* int network_notification */
@@ -3129,35 +5353,53 @@ static int network_notification(const notification_t *n,
 static int network_shutdown(void) {
   listen_loop++;
 
-  /* Kill the listening thread */
-  if (receive_thread_running != 0) {
+  /* Kill the listening threads */
+  for (size_t i = 0; i < receivers_num; i++) {
+    receiver_t *r = receivers + i;
+    if (!r->receive_thread_running)
+      continue;
+
     INFO("network plugin: Stopping receive thread.");
-    pthread_kill(receive_thread_id, SIGTERM);
-    pthread_join(receive_thread_id, NULL /* no return value */);
-    memset(&receive_thread_id, 0, sizeof(receive_thread_id));
-    receive_thread_running = 0;
+    pthread_kill(r->receive_thread_id, SIGTERM);
+    pthread_join(r->receive_thread_id, NULL /* no return value */);
+    memset(&r->receive_thread_id, 0, sizeof(r->receive_thread_id));
+    r->receive_thread_running = false;
   }
 
-  /* Shutdown the dispatching thread */
-  if (dispatch_thread_running != 0) {
+  /* Shutdown the dispatching threads */
+  for (size_t i = 0; i < receivers_num; i++) {
+    receiver_t *r = receivers + i;
+    if (!r->dispatch_thread_running)
+      continue;
+
     INFO("network plugin: Stopping dispatch thread.");
-    pthread_mutex_lock(&receive_list_lock);
-    pthread_cond_broadcast(&receive_list_cond);
-    pthread_mutex_unlock(&receive_list_lock);
-    pthread_join(dispatch_thread_id, /* ret = */ NULL);
-    dispatch_thread_running = 0;
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->dispatch_thread_id, /* ret = */ NULL);
+    r->dispatch_thread_running = false;
   }
 
+  network_receivers_destroy();
   sockent_destroy(listen_sockets);
 
-  if (send_buffer_fill > 0)
-    flush_buffer();
+  /* The write threads have been stopped, so the buffers are no longer used. */
+  while (send_buffers != NULL) {
+    send_buffer_t *sb = send_buffers;
+    send_buffers = sb->next;
 
-  sfree(send_buffer);
+    send_buffer_finish_packet(sb);
+    send_buffer_send(sb);
+    send_buffer_destroy(sb);
+  }
+  send_buffers_num = 0;
 
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
     sockent_client_disconnect(se);
   sockent_destroy(sending_sockets);
+  server_groups_destroy();
+  have_stream_servers = false;
+  have_ungrouped_servers = false;
 
   plugin_unregister_config("network");
   plugin_unregister_init("network");
@@ -3167,6 +5409,58 @@ static int network_shutdown(void) {
   return 0;
 } /* int network_shutdown */
 
+/* Dispatches the statistics of each server of "g", using the group's name as
+ * the plugin instance and the server's host (and port) as type instance. */
+static void network_stats_read_group(server_group_t const *g) /* {{{ */
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  vl.values = &(value_t){.derive = 0};
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "network", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, g->name, sizeof(vl.plugin_instance));
+
+  for (size_t i = 0; i < g->servers_num; i++) {
+    sockent_t *se = g->servers[i];
+    size_t dest = se->data.client.dest;
+    derive_t octets = 0;
+    derive_t packets = 0;
+    derive_t values = 0;
+
+    pthread_mutex_lock(&send_buffers_lock);
+    for (send_buffer_t *sb = send_buffers; sb != NULL; sb = sb->next) {
+      if (sb->dest != dest)
+        continue;
+      octets += sb->octets_tx;
+      packets += sb->packets_tx;
+      values += sb->values_sent;
+    }
+    pthread_mutex_unlock(&send_buffers_lock);
+
+    if (se->service != NULL)
+      ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%s:%s", se->node,
+                se->service);
+    else
+      sstrncpy(vl.type_instance, se->node, sizeof(vl.type_instance));
+
+    vl.values[0].derive = octets;
+    sstrncpy(vl.type, "if_tx_octets", sizeof(vl.type));
+    plugin_dispatch_values(&vl);
+
+    vl.values[0].derive = packets;
+    sstrncpy(vl.type, "if_tx_packets", sizeof(vl.type));
+    plugin_dispatch_values(&vl);
+
+    vl.values[0].derive = values;
+    sstrncpy(vl.type, "total_values", sizeof(vl.type));
+    plugin_dispatch_values(&vl);
+
+    vl.values[0].derive = (derive_t)__atomic_load_n(
+        &se->data.client.send_errors, __ATOMIC_RELAXED);
+    sstrncpy(vl.type, "if_tx_errors", sizeof(vl.type));
+    plugin_dispatch_values(&vl);
+  }
+} /* }}} void network_stats_read_group */
+
 static int network_stats_read(void) /* {{{ */
 {
   derive_t copy_octets_rx;
@@ -3175,21 +5469,35 @@ static int network_stats_read(void) /* {{{ */
   derive_t copy_packets_tx;
   derive_t copy_values_dispatched;
   derive_t copy_values_not_dispatched;
+  derive_t copy_values_duplicate;
   derive_t copy_values_sent;
   derive_t copy_values_not_sent;
   derive_t copy_receive_list_length;
   value_list_t vl = VALUE_LIST_INIT;
   value_t values[2];
 
-  copy_octets_rx = stats_octets_rx;
-  copy_octets_tx = stats_octets_tx;
-  copy_packets_rx = stats_packets_rx;
-  copy_packets_tx = stats_packets_tx;
+  copy_octets_rx = 0;
+  copy_packets_rx = 0;
+  copy_receive_list_length = 0;
+  for (size_t i = 0; i < receivers_num; i++) {
+    copy_octets_rx += receivers[i].octets_rx;
+    copy_packets_rx += receivers[i].packets_rx;
+    copy_receive_list_length += (derive_t)receivers[i].length;
+  }
+  copy_octets_tx = 0;
+  copy_packets_tx = 0;
+  copy_values_sent = 0;
+  pthread_mutex_lock(&send_buffers_lock);
+  for (send_buffer_t *sb = send_buffers; sb != NULL; sb = sb->next) {
+    copy_octets_tx += sb->octets_tx;
+    copy_packets_tx += sb->packets_tx;
+    copy_values_sent += sb->values_sent;
+  }
+  pthread_mutex_unlock(&send_buffers_lock);
   copy_values_dispatched = stats_values_dispatched;
   copy_values_not_dispatched = stats_values_not_dispatched;
-  copy_values_sent = stats_values_sent;
+  copy_values_duplicate = stats_values_duplicate;
   copy_values_not_sent = stats_values_not_sent;
-  copy_receive_list_length = receive_list_length;
 
   /* Initialize `vl' */
   vl.values = values;
@@ -3221,6 +5529,12 @@ static int network_stats_read(void) /* {{{ */
   sstrncpy(vl.type_instance, "dispatch-rejected", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 
+  if (network_config_drop_duplicates) {
+    vl.values[0].derive = (derive_t)copy_values_duplicate;
+    sstrncpy(vl.type_instance, "dispatch-duplicate", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
   vl.values[0].derive = (derive_t)copy_values_sent;
   sstrncpy(vl.type_instance, "send-accepted", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
@@ -3235,6 +5549,9 @@ static int network_stats_read(void) /* {{{ */
   vl.type_instance[0] = 0;
   plugin_dispatch_values(&vl);
 
+  for (server_group_t *g = server_groups; g != NULL; g = g->next)
+    network_stats_read_group(g);
+
   return 0;
 } /* }}} int network_stats_read */
 
@@ -3252,45 +5569,80 @@ static int network_init(void) {
 
   plugin_register_shutdown("network", network_shutdown);
 
-  send_buffer = malloc(network_config_packet_size);
-  if (send_buffer == NULL) {
-    ERROR("network plugin: malloc failed.");
-    return -1;
-  }
-  network_init_buffer();
-
   /* setup socket(s) and so on */
   if (sending_sockets != NULL) {
-    plugin_register_write("network", network_write,
-                          /* user_data = */ NULL);
+    int status = pthread_key_create(&send_buffer_key, /* destructor = */ NULL);
+    if (status != 0) {
+      ERROR("network plugin: pthread_key_create failed: %s", STRERROR(status));
+      return -1;
+    }
+
+    for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
+      sending_sockets_num++;
+
+    plugin_register_write_batch("network", network_write_batch,
+                                /* user_data = */ NULL);
     plugin_register_notification("network", network_notification,
                                  /* user_data = */ NULL);
+  } else if (network_config_relay) {
+    WARNING("network plugin: `Relay' is enabled, but no servers are "
+            "configured. Received packets are dispatched instead.");
+    network_config_relay = false;
+  }
+
+  /* Relayed packets hold the value lists of many series, so they can't be
+   * split up between the servers of a group without decoding them. */
+  if (network_config_relay && (server_groups != NULL)) {
+    WARNING("network plugin: `Relay' can't be combined with `ServerGroup'. "
+            "Received packets are dispatched instead.");
+    network_config_relay = false;
   }
 
+  if (receivers != NULL)
+    return 0;
+
+  network_listen_all();
+
   /* If no threads need to be started, return here. */
-  if ((listen_sockets_num == 0) ||
-      ((dispatch_thread_running != 0) && (receive_thread_running != 0)))
+  if (listen_sockets_num == 0)
     return 0;
 
-  if (dispatch_thread_running == 0) {
+  if (network_receivers_create() != 0) {
+    network_receivers_destroy();
+    return -1;
+  }
+
+  for (size_t i = 0; i < receivers_num; i++) {
+    receiver_t *r = receivers + i;
+    char name[16]; /* pthread_setname_np(3) limit */
     int status;
-    status = plugin_thread_create(&dispatch_thread_id, dispatch_thread,
-                                  NULL /* no argument */, "network disp");
+
+    /* With multicast addresses, some receivers may end up without sockets. */
+    if (r->pollfd_num == 0)
+      continue;
+
+    if (receivers_num == 1)
+      sstrncpy(name, "network disp", sizeof(name));
+    else
+      ssnprintf(name, sizeof(name), "network disp%" PRIsz, i);
+    status = plugin_thread_create(&r->dispatch_thread_id, dispatch_thread, r,
+                                  name);
     if (status != 0) {
       ERROR("network: pthread_create failed: %s", STRERRNO);
-    } else {
-      dispatch_thread_running = 1;
+      continue;
     }
-  }
+    r->dispatch_thread_running = true;
 
-  if (receive_thread_running == 0) {
-    int status;
-    status = plugin_thread_create(&receive_thread_id, receive_thread,
-                                  NULL /* no argument */, "network recv");
+    if (receivers_num == 1)
+      sstrncpy(name, "network recv", sizeof(name));
+    else
+      ssnprintf(name, sizeof(name), "network recv%" PRIsz, i);
+    status =
+        plugin_thread_create(&r->receive_thread_id, receive_thread, r, name);
     if (status != 0) {
       ERROR("network: pthread_create failed: %s", STRERRNO);
     } else {
-      receive_thread_running = 1;
+      r->receive_thread_running = true;
     }
   }
 
@@ -3307,19 +5659,23 @@ static int network_init(void) {
 static int network_flush(cdtime_t timeout,
                          __attribute__((unused)) const char *identifier,
                          __attribute__((unused)) user_data_t *user_data) {
-  pthread_mutex_lock(&send_buffer_lock);
-
-  if (send_buffer_fill > 0) {
-    if (timeout > 0) {
-      cdtime_t now = cdtime();
-      if ((send_buffer_last_update + timeout) > now) {
-        pthread_mutex_unlock(&send_buffer_lock);
-        return 0;
-      }
+  cdtime_t now = cdtime();
+
+  pthread_mutex_lock(&send_buffers_lock);
+  send_buffer_t *sb = send_buffers;
+  pthread_mutex_unlock(&send_buffers_lock);
+
+  /* Buffers are only removed from the list at shutdown, so the list can be
+   * walked without holding send_buffers_lock. */
+  for (; sb != NULL; sb = sb->next) {
+    pthread_mutex_lock(&sb->lock);
+    if ((sb->buffer_fill > 0) &&
+        ((timeout == 0) || ((sb->last_update + timeout) <= now))) {
+      send_buffer_finish_packet(sb);
+      send_buffer_send(sb);
     }
-    flush_buffer();
+    pthread_mutex_unlock(&sb->lock);
   }
-  pthread_mutex_unlock(&send_buffer_lock);
 
   return 0;
 } /* int network_flush */
@@ -76,5 +76,7 @@
 
 #define TYPE_SIGN_SHA256 0x0200
 #define TYPE_ENCR_AES256 0x0210
+#define TYPE_ENCR_AES256_GCM 0x0211
+#define TYPE_COMPR_GZIP 0x0220
 
 #endif /* NETWORK_H */
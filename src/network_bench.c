@@ -0,0 +1,87 @@
+/**
+ * collectd - src/network_bench.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#define TEST_PLUGIN_NETWORK 1
+
+#include "network.c" /* (sic) */
+
+#include "benchmark.h"
+
+/* Fills "buffer" with up to "num" values of different series, the way
+ * network_write() does. Returns the number of bytes used. */
+static size_t create_packet(char *buffer, size_t buffer_size, size_t num) {
+  const data_set_t *ds = plugin_get_ds("MAGIC");
+  value_list_t vl_def = {0};
+  value_list_t vl = {
+      .values = &(value_t){.derive = 42},
+      .values_len = 1,
+      .time = TIME_T_TO_CDTIME_T(1577836800),
+      .interval = TIME_T_TO_CDTIME_T(10),
+      .host = "example.com",
+      .plugin = "bench",
+      .type = "MAGIC",
+  };
+  size_t offset = 0;
+
+  for (size_t i = 0; i < num; i++) {
+    snprintf(vl.type_instance, sizeof(vl.type_instance), "instance%zu", i);
+    int status =
+        add_to_buffer(buffer + offset, buffer_size - offset, &vl_def, ds, &vl);
+    if (status < 0)
+      break;
+    offset += (size_t)status;
+  }
+
+  return offset;
+}
+
+/* Parses one packet holding "b->size" values (or as many as fit). */
+DEF_BENCH(parse_packet) {
+  char buffer[network_config_packet_size];
+  size_t buffer_size = create_packet(buffer, sizeof(buffer), b->size);
+  if (buffer_size == 0)
+    return -1;
+
+  sockent_t se = {0};
+  int status = 0;
+
+  BENCH_RESET_TIMER(b);
+  for (uint64_t i = 0; i < b->iterations; i++)
+    status |= parse_packet(&se, buffer, buffer_size, 0, NULL, NULL);
+  BENCH_STOP_TIMER(b);
+
+  return status;
+}
+
+int main(void) {
+  /* A single value and a full packet. */
+  size_t sizes[] = {1, 1000};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sizes); i++)
+    RUN_BENCH(parse_packet, sizes[i]);
+
+  END_BENCH;
+}
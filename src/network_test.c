@@ -239,8 +239,231 @@ DEF_TEST(parse_packet) {
   return 0;
 }
 
+#if HAVE_ZLIB
+DEF_TEST(parse_compressed_packet) {
+  sockent_t se = {0};
+  compressor_t *c = compressor_create(COMPRESS_GZIP);
+  CHECK_NOT_NULL(c);
+
+  derive_t dispatched = stats_values_dispatched;
+  for (size_t i = 0; i < sizeof(raw_packet_data) / sizeof(raw_packet_data[0]);
+       i++) {
+    uint8_t buffer[network_config_packet_size];
+    size_t buffer_size = sizeof(buffer);
+    char compressed[network_config_packet_size];
+
+    EXPECT_EQ_INT(0, decode_string(raw_packet_data[i], buffer, &buffer_size));
+    size_t compressed_size = network_compress_buffer(
+        c, (char *)buffer, buffer_size, compressed);
+    OK(compressed_size > 0);
+    OK(compressed_size < buffer_size);
+    EXPECT_EQ_INT(
+        0, parse_packet(&se, compressed, compressed_size, 0, NULL, NULL));
+
+    /* Nested compressed parts are discarded. */
+    OK(parse_packet(&se, compressed, compressed_size, PP_COMPRESSED, NULL,
+                    NULL) != 0);
+  }
+  EXPECT_EQ_INT(139, (int)(stats_values_dispatched - dispatched));
+
+  compressor_destroy(c);
+  return 0;
+}
+#endif
+
+DEF_TEST(stream_packet_size) {
+  char buffer[16] = {0};
+
+  /* The header is incomplete. */
+  EXPECT_EQ_INT(0, (int)stream_packet_size(buffer, 3, 1024));
+
+  uint32_t length = htonl(10);
+  memcpy(buffer, &length, sizeof(length));
+  EXPECT_EQ_INT(0, (int)stream_packet_size(buffer, 4, 1024));
+  EXPECT_EQ_INT(0, (int)stream_packet_size(buffer, 13, 1024));
+  EXPECT_EQ_INT(14, (int)stream_packet_size(buffer, 14, 1024));
+  EXPECT_EQ_INT(14, (int)stream_packet_size(buffer, 16, 1024));
+
+  /* Packets larger than the limit and empty packets are errors. */
+  EXPECT_EQ_INT(-1, (int)stream_packet_size(buffer, 16, 9));
+  length = 0;
+  memcpy(buffer, &length, sizeof(length));
+  EXPECT_EQ_INT(-1, (int)stream_packet_size(buffer, 16, 1024));
+
+  return 0;
+}
+
+#if HAVE_GCRYPT_H
+/* Encrypts the test packets with "mode" and parses them on "server". Returns
+ * the number of values dispatched. */
+static int encrypt_and_parse(sockent_t *client, sockent_t *server, /* {{{ */
+                             int mode, bool corrupt) {
+  client->data.client.cipher_mode = mode;
+  if (client->data.client.cypher != NULL) {
+    gcry_cipher_close(client->data.client.cypher);
+    client->data.client.cypher = NULL;
+  }
+
+  derive_t dispatched = stats_values_dispatched;
+  for (size_t i = 0; i < sizeof(raw_packet_data) / sizeof(raw_packet_data[0]);
+       i++) {
+    uint8_t buffer[network_config_packet_size];
+    size_t buffer_size = sizeof(buffer);
+    char encrypted[network_config_packet_size + BUFF_SIG_SIZE];
+
+    if (decode_string(raw_packet_data[i], buffer, &buffer_size) != 0)
+      return -1;
+
+    size_t size;
+    if (mode == GCRY_CIPHER_MODE_GCM)
+      size = network_encrypt_buffer_gcm(client, NULL, (char *)buffer,
+                                        buffer_size, encrypted);
+    else
+      size = network_encrypt_buffer(client, NULL, (char *)buffer, buffer_size,
+                                    encrypted);
+    if (size == 0)
+      return -1;
+
+    if (corrupt)
+      encrypted[size - 20] ^= 0x01;
+    parse_packet(server, encrypted, size, 0, NULL, NULL);
+  }
+
+  return (int)(stats_values_dispatched - dispatched);
+} /* }}} int encrypt_and_parse */
+
+DEF_TEST(encrypted_packet) {
+  char auth_file[] = "/tmp/collectd-network-test-XXXXXX";
+  int fd = mkstemp(auth_file);
+  OK(fd >= 0);
+  char const *users = "user: secret\n";
+  EXPECT_EQ_INT((int)strlen(users), (int)write(fd, users, strlen(users)));
+  close(fd);
+
+  sockent_t *client = sockent_create(SOCKENT_TYPE_CLIENT);
+  CHECK_NOT_NULL(client);
+  client->data.client.security_level = SECURITY_LEVEL_ENCRYPT;
+  client->data.client.username = strdup("user");
+  client->data.client.password = strdup("secret");
+  EXPECT_EQ_INT(0, sockent_init_crypto(client));
+
+  sockent_t *server = sockent_create(SOCKENT_TYPE_SERVER);
+  CHECK_NOT_NULL(server);
+  server->data.server.security_level = SECURITY_LEVEL_ENCRYPT;
+  server->data.server.auth_file = strdup(auth_file);
+  EXPECT_EQ_INT(0, sockent_init_crypto(server));
+
+  EXPECT_EQ_INT(139, encrypt_and_parse(client, server, GCRY_CIPHER_MODE_OFB,
+                                       /* corrupt = */ false));
+  EXPECT_EQ_INT(139, encrypt_and_parse(client, server, GCRY_CIPHER_MODE_GCM,
+                                       /* corrupt = */ false));
+
+  /* Modified packets are discarded. */
+  EXPECT_EQ_INT(0, encrypt_and_parse(client, server, GCRY_CIPHER_MODE_OFB,
+                                     /* corrupt = */ true));
+  EXPECT_EQ_INT(0, encrypt_and_parse(client, server, GCRY_CIPHER_MODE_GCM,
+                                     /* corrupt = */ true));
+
+  sockent_destroy(client);
+  sockent_destroy(server);
+  unlink(auth_file);
+  return 0;
+}
+#endif
+
+/* Returns the hash of the i-th test identifier. */
+static uint64_t test_hash(int i) /* {{{ */
+{
+  char type_instance[16];
+  snprintf(type_instance, sizeof(type_instance), "%d", i);
+  return network_hash_identifier("host", "plugin", "", "type", type_instance);
+} /* }}} uint64_t test_hash */
+
+DEF_TEST(server_group) {
+  char *nodes[] = {"agg0", "agg1", "agg2", "agg3"};
+  sockent_t *servers[STATIC_ARRAY_SIZE(nodes)];
+  server_group_t g = {.name = "test",
+                      .servers = servers,
+                      .servers_num = STATIC_ARRAY_SIZE(servers),
+                      .replicas = 1};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(nodes); i++) {
+    CHECK_NOT_NULL(servers[i] = sockent_create(SOCKENT_TYPE_CLIENT));
+    servers[i]->node = strdup(nodes[i]);
+  }
+  EXPECT_EQ_INT(0, server_group_build_ring(&g));
+  EXPECT_EQ_INT(STATIC_ARRAY_SIZE(nodes) * SERVER_GROUP_POINTS,
+                (int)g.ring_num);
+
+#define KEYS 4000
+  sockent_t *primary[KEYS];
+  int count[STATIC_ARRAY_SIZE(nodes)] = {0};
+  int bad_replicas = 0;
+  cdtime_t now = TIME_T_TO_CDTIME_T(1000);
+
+  for (int i = 0; i < KEYS; i++) {
+    if (server_group_pick(&g, test_hash(i), now, primary + i) != 1)
+      bad_replicas++;
+    for (size_t j = 0; j < g.servers_num; j++)
+      if (primary[i] == servers[j])
+        count[j]++;
+
+    /* Replicas are distinct, and the first one is the primary. */
+    sockent_t *r[3];
+    g.replicas = 3;
+    if ((server_group_pick(&g, test_hash(i), now, r) != 3) ||
+        (r[0] != primary[i]) || (r[0] == r[1]) || (r[0] == r[2]) ||
+        (r[1] == r[2]))
+      bad_replicas++;
+    g.replicas = 1;
+  }
+  EXPECT_EQ_INT(0, bad_replicas);
+
+  /* Each server gets roughly a quarter of the keys. */
+  for (size_t j = 0; j < g.servers_num; j++) {
+    OK(count[j] > KEYS / 6);
+    OK(count[j] < KEYS / 3);
+  }
+
+  /* With one server down, only its keys move. */
+  servers[1]->data.client.down_until = now + 1;
+  int moved = 0;
+  int bad_moves = 0;
+  for (int i = 0; i < KEYS; i++) {
+    sockent_t *se = NULL;
+    server_group_pick(&g, test_hash(i), now, &se);
+    if (se == servers[1])
+      bad_moves++;
+    else if (se != primary[i])
+      moved++;
+  }
+  EXPECT_EQ_INT(0, bad_moves);
+  EXPECT_EQ_INT(count[1], moved);
+
+  /* Without any server up, the servers are used anyway. */
+  for (size_t j = 0; j < g.servers_num; j++)
+    servers[j]->data.client.down_until = now + 1;
+  sockent_t *se = NULL;
+  EXPECT_EQ_INT(1, (int)server_group_pick(&g, test_hash(0), now, &se));
+  OK(se == primary[0]);
+#undef KEYS
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(nodes); i++)
+    sockent_destroy(servers[i]);
+  sfree(g.ring);
+  return 0;
+}
+
 int main() {
   RUN_TEST(parse_packet);
+#if HAVE_ZLIB
+  RUN_TEST(parse_compressed_packet);
+#endif
+  RUN_TEST(stream_packet_size);
+  RUN_TEST(server_group);
+#if HAVE_GCRYPT_H
+  RUN_TEST(encrypted_packet);
+#endif
 
   END_TEST;
 }
@@ -26,25 +26,52 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils_complain.h"
 
 #include <auth-client.h>
 #include <libesmtp.h>
 
 #define MAXSTRING 256
 
-static const char *config_keys[] = {"SMTPServer",   "SMTPPort", "SMTPUser",
-                                    "SMTPPassword", "From",     "Recipient",
-                                    "Subject"};
+static const char *config_keys[] = {
+    "SMTPServer", "SMTPPort", "SMTPUser",       "SMTPPassword", "From",
+    "Recipient",  "Subject",  "DigestInterval", "QueueLimit"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static char **recipients;
 static int recipients_len;
 
-static smtp_session_t session;
-static pthread_mutex_t session_lock = PTHREAD_MUTEX_INITIALIZER;
-static smtp_message_t message;
+/* Only used by the email thread after initialization. */
 static auth_context_t authctx;
 
+/* A notification waiting to be mailed. "text" is the part of the mail body
+ * describing the notification, with \r\n EOLs. */
+typedef struct email_entry_s email_entry_t;
+struct email_entry_s {
+  int severity;
+  char host[DATA_MAX_NAME_LEN];
+  char *text;
+  email_entry_t *next;
+};
+
+/* Notifications are queued by the notification callback and mailed by the
+ * email thread, so that the dispatching thread never waits for the SMTP
+ * server. */
+static email_entry_t *queue_head;
+static email_entry_t *queue_tail;
+static int queue_length;
+/* Number of notifications dropped because the queue was full, reported in
+ * the next mail. */
+static uint64_t queue_dropped;
+static bool email_loop;
+static bool email_thread_running;
+static pthread_t email_thread;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static cdtime_t digest_interval;
+static int queue_limit = 1000;
+
 static int smtp_port = 25;
 static char *smtp_host;
 static char *smtp_user;
@@ -83,6 +110,19 @@ static void print_recipient_status(smtp_recipient_t recipient,
        status->text);
 } /* void print_recipient_status */
 
+/* Callback to print the status of each message */
+static void print_message_status(smtp_message_t message,
+                                 void __attribute__((unused)) * arg) {
+#if COLLECT_DEBUG
+  const smtp_status_t *status;
+  /* Report on the success or otherwise of the mail transfer. */
+  status = smtp_message_transfer_status(message);
+  DEBUG("notify_email plugin: SMTP server report: %d %s", status->code,
+        (status->text != NULL) ? status->text : "\n");
+#endif
+  smtp_enumerate_recipients(message, print_recipient_status, NULL);
+} /* void print_message_status */
+
 /* Callback to monitor SMTP activity */
 static void monitor_cb(const char *buf, int buflen, int writing,
                        void __attribute__((unused)) * arg) {
@@ -101,49 +141,301 @@ static void monitor_cb(const char *buf, int buflen, int writing,
         log_str);
 } /* void monitor_cb */
 
-static int notify_email_init(void) {
+static char const *severity_name(int severity) {
+  if (severity == NOTIF_FAILURE)
+    return "FAILURE";
+  if (severity == NOTIF_WARNING)
+    return "WARNING";
+  if (severity == NOTIF_OKAY)
+    return "OKAY";
+  return "UNKNOWN";
+} /* char const *severity_name */
+
+static void email_entry_free(email_entry_t *e) {
+  while (e != NULL) {
+    email_entry_t *next = e->next;
+    sfree(e->text);
+    sfree(e);
+    e = next;
+  }
+} /* void email_entry_free */
+
+/* Formats the description of "n" that goes into the mail body. */
+static email_entry_t *email_entry_create(const notification_t *n) {
+  struct tm timestamp_tm;
+  char timestamp_str[64];
+
+  char buf[4096] = "";
+  char *buf_ptr = buf;
+  int buf_len = sizeof(buf);
+
+  localtime_r(&CDTIME_T_TO_TIME_T(n->time), &timestamp_tm);
+  strftime(timestamp_str, sizeof(timestamp_str), "%Y-%m-%d %H:%M:%S",
+           &timestamp_tm);
+  timestamp_str[sizeof(timestamp_str) - 1] = '\0';
+
+  int status = ssnprintf(buf, buf_len, "%s - %s@%s\r\n\r\n", timestamp_str,
+                         severity_name(n->severity), n->host);
+  if (status > 0) {
+    buf_ptr += status;
+    buf_len -= status;
+  }
+
+#define APPEND(format, value)                                                  \
+  if ((buf_len > 0) && (strlen(value) > 0)) {                                  \
+    status = ssnprintf(buf_ptr, buf_len, format "\r\n", value);                \
+    if (status > 0) {                                                          \
+      buf_ptr += status;                                                       \
+      buf_len -= status;                                                       \
+    }                                                                          \
+  }
+
+  APPEND("Host: %s", n->host);
+  APPEND("Plugin: %s", n->plugin);
+  APPEND("Plugin instance: %s", n->plugin_instance);
+  APPEND("Type: %s", n->type);
+  APPEND("Type instance: %s", n->type_instance);
+  APPEND("\r\nMessage: %s", n->message);
+
+  email_entry_t *e = calloc(1, sizeof(*e));
+  if (e == NULL)
+    return NULL;
+
+  e->text = strdup(buf);
+  if (e->text == NULL) {
+    sfree(e);
+    return NULL;
+  }
+  e->severity = n->severity;
+  sstrncpy(e->host, n->host, sizeof(e->host));
+
+  return e;
+} /* email_entry_t *email_entry_create */
+
+/* Builds an RFC822 message with \r\n EOLs from "num" entries starting at
+ * "first". The subject names the most severe notification and the host, or
+ * "multiple hosts" if the entries are from more than one host. */
+static char *email_build(email_entry_t const *first, size_t num,
+                         uint64_t dropped) {
+  int severity = first->severity;
+  char const *host = first->host;
+  size_t text_len = 0;
+
+  email_entry_t const *e = first;
+  for (size_t i = 0; i < num; i++, e = e->next) {
+    /* NOTIF_FAILURE < NOTIF_WARNING < NOTIF_OKAY */
+    if (e->severity < severity)
+      severity = e->severity;
+    if (strcmp(host, e->host) != 0)
+      host = "multiple hosts";
+    text_len += strlen(e->text) + 2;
+  }
+
+  char subject[MAXSTRING];
+  ssnprintf(subject, sizeof(subject),
+            (email_subject == NULL) ? DEFAULT_SMTP_SUBJECT : email_subject,
+            severity_name(severity), host);
+
+  char header[2 * MAXSTRING];
+  int header_len =
+      ssnprintf(header, sizeof(header),
+                "MIME-Version: 1.0\r\n"
+                "Content-Type: text/plain; charset=\"US-ASCII\"\r\n"
+                "Content-Transfer-Encoding: 8bit\r\n"
+                "Subject: %s\r\n"
+                "\r\n",
+                subject);
+  if (header_len < 0)
+    return NULL;
+
+  char summary[MAXSTRING] = "";
+  int summary_len = 0;
+  if (num > 1)
+    summary_len = ssnprintf(summary, sizeof(summary),
+                            "%" PRIsz " notifications\r\n\r\n", num);
+  if (dropped > 0)
+    summary_len += ssnprintf(summary + summary_len,
+                             sizeof(summary) - summary_len,
+                             "%" PRIu64 " notifications were dropped because "
+                             "too many were waiting to be mailed.\r\n\r\n",
+                             dropped);
+
+  size_t size = (size_t)header_len + (size_t)summary_len + text_len + 1;
+  char *buf = malloc(size);
+  if (buf == NULL)
+    return NULL;
+
+  char *ptr = buf;
+  ptr = stpcpy(ptr, header);
+  ptr = stpcpy(ptr, summary);
+  e = first;
+  for (size_t i = 0; i < num; i++, e = e->next) {
+    if (i > 0)
+      ptr = stpcpy(ptr, "\r\n");
+    ptr = stpcpy(ptr, e->text);
+  }
+
+  return buf;
+} /* char *email_build */
+
+/* Mails the entries of "list". With a "DigestInterval", all entries go into
+ * one mail, otherwise each gets a mail of its own. All mails are sent in one
+ * SMTP session, which libESMTP pipelines if the server supports it. */
+static void email_send(email_entry_t *list, uint64_t dropped) {
   char server[MAXSTRING];
+  char errbuf[256];
 
-  ssnprintf(server, sizeof(server), "%s:%i",
-            (smtp_host == NULL) ? DEFAULT_SMTP_HOST : smtp_host, smtp_port);
+  size_t entries_num = 0;
+  for (email_entry_t *e = list; e != NULL; e = e->next)
+    entries_num++;
+  if (entries_num == 0)
+    return;
 
-  pthread_mutex_lock(&session_lock);
+  size_t mails_num = (digest_interval > 0) ? 1 : entries_num;
+  char **bodies = calloc(mails_num, sizeof(*bodies));
+  if (bodies == NULL) {
+    ERROR("notify_email plugin: calloc failed.");
+    return;
+  }
 
-  auth_client_init();
+  ssnprintf(server, sizeof(server), "%s:%i",
+            (smtp_host == NULL) ? DEFAULT_SMTP_HOST : smtp_host, smtp_port);
 
-  session = smtp_create_session();
+  smtp_session_t session = smtp_create_session();
   if (session == NULL) {
-    pthread_mutex_unlock(&session_lock);
     ERROR("notify_email plugin: cannot create SMTP session");
-    return -1;
+    sfree(bodies);
+    return;
   }
 
   smtp_set_monitorcb(session, monitor_cb, NULL, 1);
   smtp_set_hostname(session, hostname_g);
   smtp_set_server(session, server);
 
+  if (!smtp_auth_set_context(session, authctx)) {
+    ERROR("notify_email plugin: cannot set SMTP auth context");
+    smtp_destroy_session(session);
+    sfree(bodies);
+    return;
+  }
+
+  email_entry_t *e = list;
+  for (size_t i = 0; i < mails_num; i++, e = e->next) {
+    bodies[i] = email_build(e, (mails_num == 1) ? entries_num : 1,
+                            (i == 0) ? dropped : 0);
+    if (bodies[i] == NULL) {
+      ERROR("notify_email plugin: cannot build message");
+      continue;
+    }
+
+    smtp_message_t message = smtp_add_message(session);
+    if (message == NULL) {
+      ERROR("notify_email plugin: cannot set SMTP message");
+      continue;
+    }
+    smtp_set_reverse_path(message, email_from);
+    smtp_set_header(message, "To", NULL, NULL);
+    smtp_set_message_str(message, bodies[i]);
+
+    for (int j = 0; j < recipients_len; j++)
+      smtp_add_recipient(message, recipients[j]);
+  }
+
+  /* Initiate a connection to the SMTP server and transfer the messages. */
+  if (!smtp_start_session(session)) {
+    ERROR("notify_email plugin: SMTP server problem: %s",
+          smtp_strerror(smtp_errno(), errbuf, sizeof(errbuf)));
+  } else {
+    smtp_enumerate_messages(session, print_message_status, NULL);
+  }
+
+  smtp_destroy_session(session);
+  for (size_t i = 0; i < mails_num; i++)
+    sfree(bodies[i]);
+  sfree(bodies);
+} /* void email_send */
+
+static void *email_thread_main(void __attribute__((unused)) * arg) {
+  pthread_mutex_lock(&queue_lock);
+  while (42) {
+    while (email_loop && (queue_head == NULL))
+      pthread_cond_wait(&queue_cond, &queue_lock);
+
+    /* Exit once the queue has been emptied after shutdown. */
+    if (queue_head == NULL)
+      break;
+
+    /* Collect the notifications of the digest interval that started with the
+     * first one. */
+    if (email_loop && (digest_interval > 0)) {
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(cdtime() + digest_interval);
+      while (email_loop &&
+             (pthread_cond_timedwait(&queue_cond, &queue_lock, &ts) !=
+              ETIMEDOUT))
+        /* wait */;
+    }
+
+    email_entry_t *list = queue_head;
+    uint64_t dropped = queue_dropped;
+    queue_head = NULL;
+    queue_tail = NULL;
+    queue_length = 0;
+    queue_dropped = 0;
+    pthread_mutex_unlock(&queue_lock);
+
+    email_send(list, dropped);
+    email_entry_free(list);
+
+    pthread_mutex_lock(&queue_lock);
+  }
+  pthread_mutex_unlock(&queue_lock);
+
+  return NULL;
+} /* void *email_thread_main */
+
+static int notify_email_init(void) {
+  if (email_thread_running)
+    return 0;
+
+  auth_client_init();
+
   if (smtp_user && smtp_password) {
     authctx = auth_create_context();
     auth_set_mechanism_flags(authctx, AUTH_PLUGIN_PLAIN, 0);
     auth_set_interact_cb(authctx, authinteract, NULL);
   }
 
-  if (!smtp_auth_set_context(session, authctx)) {
-    pthread_mutex_unlock(&session_lock);
-    ERROR("notify_email plugin: cannot set SMTP auth context");
+  email_loop = true;
+  int status = plugin_thread_create(&email_thread, email_thread_main,
+                                    /* arg = */ NULL, "notify_email");
+  if (status != 0) {
+    ERROR("notify_email plugin: cannot start email thread: %s",
+          STRERROR(status));
+    email_loop = false;
     return -1;
   }
+  email_thread_running = true;
 
-  pthread_mutex_unlock(&session_lock);
   return 0;
 } /* int notify_email_init */
 
 static int notify_email_shutdown(void) {
-  pthread_mutex_lock(&session_lock);
+  if (email_thread_running) {
+    /* The thread mails the notifications still in the queue before it
+     * exits. */
+    pthread_mutex_lock(&queue_lock);
+    email_loop = false;
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+
+    pthread_join(email_thread, NULL);
+    email_thread_running = false;
+  }
 
-  if (session != NULL)
-    smtp_destroy_session(session);
-  session = NULL;
+  email_entry_free(queue_head);
+  queue_head = NULL;
+  queue_tail = NULL;
+  queue_length = 0;
 
   if (authctx != NULL)
     auth_destroy_context(authctx);
@@ -151,7 +443,6 @@ static int notify_email_shutdown(void) {
 
   auth_client_exit();
 
-  pthread_mutex_unlock(&session_lock);
   return 0;
 } /* int notify_email_shutdown */
 
@@ -194,6 +485,20 @@ static int notify_email_config(const char *key, const char *value) {
   } else if (0 == strcasecmp(key, "Subject")) {
     sfree(email_subject);
     email_subject = strdup(value);
+  } else if (0 == strcasecmp(key, "DigestInterval")) {
+    double tmp = atof(value);
+    if (tmp < 0.0) {
+      WARNING("notify_email plugin: Invalid DigestInterval: %s", value);
+      return 1;
+    }
+    digest_interval = DOUBLE_TO_CDTIME_T(tmp);
+  } else if (0 == strcasecmp(key, "QueueLimit")) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      WARNING("notify_email plugin: Invalid QueueLimit: %s", value);
+      return 1;
+    }
+    queue_limit = tmp;
   } else {
     return -1;
   }
@@ -203,103 +508,41 @@ static int notify_email_config(const char *key, const char *value) {
 static int notify_email_notification(const notification_t *n,
                                      user_data_t __attribute__((unused)) *
                                          user_data) {
+  static c_complain_t queue_complaint = C_COMPLAIN_INIT_STATIC;
 
-  struct tm timestamp_tm;
-  char timestamp_str[64];
-
-  char severity[32];
-  char subject[MAXSTRING];
-
-  char buf[4096] = "";
-  char *buf_ptr = buf;
-  int buf_len = sizeof(buf);
-
-  ssnprintf(severity, sizeof(severity), "%s",
-            (n->severity == NOTIF_FAILURE)
-                ? "FAILURE"
-                : ((n->severity == NOTIF_WARNING)
-                       ? "WARNING"
-                       : ((n->severity == NOTIF_OKAY) ? "OKAY" : "UNKNOWN")));
-
-  ssnprintf(subject, sizeof(subject),
-            (email_subject == NULL) ? DEFAULT_SMTP_SUBJECT : email_subject,
-            severity, n->host);
-
-  localtime_r(&CDTIME_T_TO_TIME_T(n->time), &timestamp_tm);
-  strftime(timestamp_str, sizeof(timestamp_str), "%Y-%m-%d %H:%M:%S",
-           &timestamp_tm);
-  timestamp_str[sizeof(timestamp_str) - 1] = '\0';
-
-  /* Let's make RFC822 message text with \r\n EOLs */
-  int status = ssnprintf(buf, buf_len,
-                         "MIME-Version: 1.0\r\n"
-                         "Content-Type: text/plain; charset=\"US-ASCII\"\r\n"
-                         "Content-Transfer-Encoding: 8bit\r\n"
-                         "Subject: %s\r\n"
-                         "\r\n"
-                         "%s - %s@%s\r\n"
-                         "\r\n",
-                         subject, timestamp_str, severity, n->host);
-
-  if (status > 0) {
-    buf_ptr += status;
-    buf_len -= status;
-  }
-
-#define APPEND(format, value)                                                  \
-  if ((buf_len > 0) && (strlen(value) > 0)) {                                  \
-    status = ssnprintf(buf_ptr, buf_len, format "\r\n", value);                \
-    if (status > 0) {                                                          \
-      buf_ptr += status;                                                       \
-      buf_len -= status;                                                       \
-    }                                                                          \
-  }
-
-  APPEND("Host: %s", n->host);
-  APPEND("Plugin: %s", n->plugin);
-  APPEND("Plugin instance: %s", n->plugin_instance);
-  APPEND("Type: %s", n->type);
-  APPEND("Type instance: %s", n->type_instance);
-  APPEND("\r\nMessage: %s", n->message);
-
-  pthread_mutex_lock(&session_lock);
+  if (!email_thread_running)
+    return -1;
 
-  if (session == NULL) {
-    /* Initialization failed or we're in the process of shutting down. */
-    pthread_mutex_unlock(&session_lock);
+  email_entry_t *e = email_entry_create(n);
+  if (e == NULL) {
+    ERROR("notify_email plugin: email_entry_create failed.");
     return -1;
   }
 
-  if (!(message = smtp_add_message(session))) {
-    pthread_mutex_unlock(&session_lock);
-    ERROR("notify_email plugin: cannot set SMTP message");
+  pthread_mutex_lock(&queue_lock);
+  if (queue_length >= queue_limit) {
+    queue_dropped++;
+    pthread_mutex_unlock(&queue_lock);
+    c_complain(LOG_WARNING, &queue_complaint,
+               "notify_email plugin: %i notifications are waiting to be "
+               "mailed. Dropping notifications.",
+               queue_limit);
+    email_entry_free(e);
     return -1;
   }
-  smtp_set_reverse_path(message, email_from);
-  smtp_set_header(message, "To", NULL, NULL);
-  smtp_set_message_str(message, buf);
 
-  for (int i = 0; i < recipients_len; i++)
-    smtp_add_recipient(message, recipients[i]);
-
-  /* Initiate a connection to the SMTP server and transfer the message. */
-  if (!smtp_start_session(session)) {
-    ERROR("notify_email plugin: SMTP server problem: %s",
-          smtp_strerror(smtp_errno(), buf, sizeof buf));
-    pthread_mutex_unlock(&session_lock);
-    return -1;
+  if (queue_tail == NULL) {
+    queue_head = e;
+    pthread_cond_signal(&queue_cond);
   } else {
-#if COLLECT_DEBUG
-    const smtp_status_t *status;
-    /* Report on the success or otherwise of the mail transfer. */
-    status = smtp_message_transfer_status(message);
-    DEBUG("notify_email plugin: SMTP server report: %d %s", status->code,
-          (status->text != NULL) ? status->text : "\n");
-#endif
-    smtp_enumerate_recipients(message, print_recipient_status, NULL);
+    queue_tail->next = e;
   }
+  queue_tail = e;
+  queue_length++;
+  pthread_mutex_unlock(&queue_lock);
 
-  pthread_mutex_unlock(&session_lock);
+  c_release(LOG_INFO, &queue_complaint,
+            "notify_email plugin: Notifications are no longer dropped.");
   return 0;
 } /* int notify_email_notification */
 
@@ -28,6 +28,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/file_batch/file_batch.h"
 
 #if !KERNEL_LINUX
 #error "No applicable input method."
@@ -39,6 +40,9 @@
 
 static int max_node = -1;
 
+/* The "numastat" files of all nodes, indexed by node number. */
+static file_batch_t *files;
+
 static void numa_dispatch_value(int node, /* {{{ */
                                 const char *type_instance, value_t v) {
   value_list_t vl = VALUE_LIST_INIT;
@@ -56,26 +60,29 @@ static void numa_dispatch_value(int node, /* {{{ */
 
 static int numa_read_node(int node) /* {{{ */
 {
-  char path[PATH_MAX];
-  FILE *fh;
+  char const *data;
   char buffer[128];
   int status;
   int success;
 
-  snprintf(path, sizeof(path), NUMA_ROOT_DIR "/node%i/numastat", node);
-
-  fh = fopen(path, "r");
-  if (fh == NULL) {
-    ERROR("numa plugin: Reading node %i failed: open(%s): %s", node, path,
-          STRERRNO);
+  data = file_batch_data(files, (size_t)node, NULL);
+  if (data == NULL) {
+    ERROR("numa plugin: Reading node %i failed: %s", node,
+          file_batch_path(files, (size_t)node));
     return -1;
   }
 
   success = 0;
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  while (*data != 0) {
     char *fields[4];
     value_t v;
 
+    size_t len = strcspn(data, "\n");
+    sstrncpy(buffer, data, (len < sizeof(buffer)) ? len + 1 : sizeof(buffer));
+    data += len;
+    if (*data == '\n')
+      data++;
+
     status = strsplit(buffer, fields, STATIC_ARRAY_SIZE(fields));
     if (status != 2) {
       WARNING("numa plugin: Ignoring line with unexpected "
@@ -93,7 +100,6 @@ static int numa_read_node(int node) /* {{{ */
     success++;
   }
 
-  fclose(fh);
   return success ? 0 : -1;
 } /* }}} int numa_read_node */
 
@@ -108,6 +114,8 @@ static int numa_read(void) /* {{{ */
     return -1;
   }
 
+  file_batch_read(files);
+
   success = 0;
   for (i = 0; i <= max_node; i++) {
     status = numa_read_node(i);
@@ -142,10 +150,35 @@ static int numa_init(void) /* {{{ */
   }
 
   DEBUG("numa plugin: Found %i nodes.", max_node + 1);
+
+  files = file_batch_create();
+  if (files == NULL) {
+    ERROR("numa plugin: file_batch_create failed.");
+    return -1;
+  }
+
+  for (int i = 0; i <= max_node; i++) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), NUMA_ROOT_DIR "/node%i/numastat", i);
+
+    if (file_batch_add(files, path) != i) {
+      ERROR("numa plugin: file_batch_add failed.");
+      return -1;
+    }
+  }
+
   return 0;
 } /* }}} int numa_init */
 
+static int numa_shutdown(void) /* {{{ */
+{
+  file_batch_destroy(files);
+  files = NULL;
+  return 0;
+} /* }}} int numa_shutdown */
+
 void module_register(void) {
   plugin_register_init("numa", numa_init);
   plugin_register_read("numa", numa_read);
+  plugin_register_shutdown("numa", numa_shutdown);
 } /* void module_register */
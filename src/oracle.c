@@ -53,6 +53,9 @@
 
 #include <oci.h>
 
+/* Number of rows fetched with one call to OCIStmtFetch2(). */
+#define O_FETCH_ROWS 256
+
 /*
  * Data types
  */
@@ -354,7 +357,10 @@ static int o_read_database_query(o_database_t *db, /* {{{ */
                                  udb_query_t *q,
                                  udb_query_preparation_area_t *prep_area) {
   char **column_names;
-  char **column_values;
+  char *column_buffers;
+  ub2 *column_types;
+  sb2 *indicators;
+  udb_column_t *columns;
   size_t column_num;
 
   OCIStmt *oci_statement;
@@ -395,6 +401,14 @@ static int o_read_database_query(o_database_t *db, /* {{{ */
       oci_statement = NULL;
       return -1;
     }
+    /* Let the execute round trip return the first rows right away. */
+    ub4 prefetch_rows = O_FETCH_ROWS;
+    status = OCIAttrSet(oci_statement, OCI_HTYPE_STMT, &prefetch_rows,
+                        /* size = */ 0, OCI_ATTR_PREFETCH_ROWS, oci_error);
+    if (status != OCI_SUCCESS)
+      o_report_error("o_read_database_query", db->name, udb_query_get_name(q),
+                     "OCIAttrSet (OCI_ATTR_PREFETCH_ROWS)", oci_error);
+
     udb_query_set_user_data(q, oci_statement);
 
     DEBUG("oracle plugin: o_read_database_query (%s, %s): "
@@ -435,26 +449,32 @@ static int o_read_database_query(o_database_t *db, /* {{{ */
 
 /* Allocate the following buffers:
  *
- *  +---------------+-----------------------------------+
- *  ! Name          ! Size                              !
- *  +---------------+-----------------------------------+
- *  ! column_names  ! column_num x DATA_MAX_NAME_LEN    !
- *  ! column_values ! column_num x DATA_MAX_NAME_LEN    !
- *  ! oci_defines   ! column_num x sizeof (OCIDefine *) !
- *  +---------------+-----------------------------------+
+ *  +----------------+--------------------------------------------------+
+ *  ! Name           ! Size                                             !
+ *  +----------------+--------------------------------------------------+
+ *  ! column_names   ! column_num x DATA_MAX_NAME_LEN                   !
+ *  ! column_buffers ! column_num x O_FETCH_ROWS x DATA_MAX_NAME_LEN    !
+ *  ! column_types   ! column_num x sizeof (ub2)                        !
+ *  ! indicators     ! column_num x O_FETCH_ROWS x sizeof (sb2)         !
+ *  ! columns        ! column_num x sizeof (udb_column_t)               !
+ *  ! oci_defines    ! column_num x sizeof (OCIDefine *)                !
+ *  +----------------+--------------------------------------------------+
+ *
+ * Each column is fetched into an array of O_FETCH_ROWS elements, so that
+ * one round trip returns up to O_FETCH_ROWS rows.
  *
  * {{{ */
-#define NUMBER_BUFFER_SIZE 64
+#define COLUMN_BUFFER_SIZE (O_FETCH_ROWS * DATA_MAX_NAME_LEN)
 
 #define FREE_ALL                                                               \
   if (column_names != NULL) {                                                  \
     sfree(column_names[0]);                                                    \
     sfree(column_names);                                                       \
   }                                                                            \
-  if (column_values != NULL) {                                                 \
-    sfree(column_values[0]);                                                   \
-    sfree(column_values);                                                      \
-  }                                                                            \
+  sfree(column_buffers);                                                       \
+  sfree(column_types);                                                         \
+  sfree(indicators);                                                           \
+  sfree(columns);                                                              \
   sfree(oci_defines)
 
 #define ALLOC_OR_FAIL(ptr, ptr_size)                                           \
@@ -470,7 +490,10 @@ static int o_read_database_query(o_database_t *db, /* {{{ */
 
   /* Initialize everything to NULL so the above works. */
   column_names = NULL;
-  column_values = NULL;
+  column_buffers = NULL;
+  column_types = NULL;
+  indicators = NULL;
+  columns = NULL;
   oci_defines = NULL;
 
   ALLOC_OR_FAIL(column_names, column_num * sizeof(char *));
@@ -478,22 +501,26 @@ static int o_read_database_query(o_database_t *db, /* {{{ */
   for (size_t i = 1; i < column_num; i++)
     column_names[i] = column_names[i - 1] + DATA_MAX_NAME_LEN;
 
-  ALLOC_OR_FAIL(column_values, column_num * sizeof(char *));
-  ALLOC_OR_FAIL(column_values[0], column_num * DATA_MAX_NAME_LEN);
-  for (size_t i = 1; i < column_num; i++)
-    column_values[i] = column_values[i - 1] + DATA_MAX_NAME_LEN;
-
+  ALLOC_OR_FAIL(column_buffers, column_num * COLUMN_BUFFER_SIZE);
+  ALLOC_OR_FAIL(column_types, column_num * sizeof(*column_types));
+  ALLOC_OR_FAIL(indicators, column_num * O_FETCH_ROWS * sizeof(*indicators));
+  ALLOC_OR_FAIL(columns, column_num * sizeof(*columns));
   ALLOC_OR_FAIL(oci_defines, column_num * sizeof(OCIDefine *));
   /* }}} End of buffer allocations. */
 
   /* ``Define'' the returned data, i. e. bind the columns to the buffers
-   * allocated above. */
+   * allocated above. Numbers are fetched as 64 bit integers or doubles, so
+   * that they needn't be converted to strings and parsed again. */
   for (size_t i = 0; i < column_num; i++) /* {{{ */
   {
     char *column_name;
     ub4 column_name_length;
+    ub2 data_type;
+    sb2 precision;
+    sb1 scale;
     OCIParam *oci_param;
 
+    column_types[i] = SQLT_STR;
     oci_param = NULL;
 
     status = OCIParamGet(oci_statement, OCI_HTYPE_STMT, oci_error,
@@ -519,8 +546,17 @@ static int o_read_database_query(o_database_t *db, /* {{{ */
       continue;
     }
 
-    OCIDescriptorFree(oci_param, OCI_DTYPE_PARAM);
-    oci_param = NULL;
+    data_type = 0;
+    precision = 0;
+    scale = 0;
+    OCIAttrGet(oci_param, OCI_DTYPE_PARAM, &data_type, /* size = */ NULL,
+               OCI_ATTR_DATA_TYPE, oci_error);
+    if (data_type == SQLT_NUM) {
+      OCIAttrGet(oci_param, OCI_DTYPE_PARAM, &precision, /* size = */ NULL,
+                 OCI_ATTR_PRECISION, oci_error);
+      OCIAttrGet(oci_param, OCI_DTYPE_PARAM, &scale, /* size = */ NULL,
+                 OCI_ATTR_SCALE, oci_error);
+    }
 
     /* Copy the name to column_names. Warning: The ``string'' returned by OCI
      * may not be null terminated! */
@@ -530,13 +566,32 @@ static int o_read_database_query(o_database_t *db, /* {{{ */
     memcpy(column_names[i], column_name, column_name_length);
     column_names[i][column_name_length] = 0;
 
-    DEBUG("oracle plugin: o_read_database_query: column_names[%" PRIsz "] = %s;"
-          " column_name_length = %" PRIu32 ";",
-          i, column_names[i], (uint32_t)column_name_length);
+    OCIDescriptorFree(oci_param, OCI_DTYPE_PARAM);
+    oci_param = NULL;
+
+    /* Integers with up to 18 digits fit into 64 bits. Other numbers,
+     * including NUMBER columns without precision, are fetched as doubles. */
+    sb4 value_size = DATA_MAX_NAME_LEN;
+    if ((data_type == SQLT_NUM) && (scale == 0) && (precision > 0) &&
+        (precision <= 18)) {
+      column_types[i] = SQLT_INT;
+      value_size = (sb4)sizeof(int64_t);
+    } else if ((data_type == SQLT_NUM) || (data_type == SQLT_BFLOAT) ||
+               (data_type == SQLT_BDOUBLE) || (data_type == SQLT_IBFLOAT) ||
+               (data_type == SQLT_IBDOUBLE)) {
+      column_types[i] = SQLT_BDOUBLE;
+      value_size = (sb4)sizeof(double);
+    }
 
-    status = OCIDefineByPos(oci_statement, &oci_defines[i], oci_error,
-                            (ub4)(i + 1), column_values[i], DATA_MAX_NAME_LEN,
-                            SQLT_STR, NULL, NULL, NULL, OCI_DEFAULT);
+    DEBUG("oracle plugin: o_read_database_query: column_names[%" PRIsz "] = %s;"
+          " column_name_length = %" PRIu32 "; data_type = %" PRIu16 ";",
+          i, column_names[i], (uint32_t)column_name_length,
+          (uint16_t)data_type);
+
+    status = OCIDefineByPos(
+        oci_statement, &oci_defines[i], oci_error, (ub4)(i + 1),
+        column_buffers + i * COLUMN_BUFFER_SIZE, value_size, column_types[i],
+        indicators + i * O_FETCH_ROWS, NULL, NULL, OCI_DEFAULT);
     if (status != OCI_SUCCESS) {
       o_report_error("o_read_database_query", db->name, udb_query_get_name(q),
                      "OCIDefineByPos", oci_error);
@@ -560,24 +615,60 @@ static int o_read_database_query(o_database_t *db, /* {{{ */
   /* Fetch and handle all the rows that matched the query. */
   while (42) /* {{{ */
   {
+    ub4 rows_num = 0;
+
     status = OCIStmtFetch2(oci_statement, oci_error,
-                           /* nrows = */ 1, /* orientation = */ OCI_FETCH_NEXT,
+                           /* nrows = */ O_FETCH_ROWS,
+                           /* orientation = */ OCI_FETCH_NEXT,
                            /* fetch offset = */ 0, /* mode = */ OCI_DEFAULT);
-    if (status == OCI_NO_DATA) {
-      status = OCI_SUCCESS;
-      break;
-    } else if ((status != OCI_SUCCESS) && (status != OCI_SUCCESS_WITH_INFO)) {
+    if ((status != OCI_SUCCESS) && (status != OCI_SUCCESS_WITH_INFO) &&
+        (status != OCI_NO_DATA)) {
       o_report_error("o_read_database_query", db->name, udb_query_get_name(q),
                      "OCIStmtFetch2", oci_error);
       break;
     }
 
-    status = udb_query_handle_result(q, prep_area, column_values);
-    if (status != 0) {
-      WARNING("oracle plugin: o_read_database_query (%s, %s): "
-              "udb_query_handle_result failed.",
-              db->name, udb_query_get_name(q));
+    /* The last call returns the remaining rows and OCI_NO_DATA. */
+    bool done = (status == OCI_NO_DATA);
+    status = OCIAttrGet(oci_statement, OCI_HTYPE_STMT, &rows_num,
+                        /* size = */ NULL, OCI_ATTR_ROWS_FETCHED, oci_error);
+    if (status != OCI_SUCCESS) {
+      o_report_error("o_read_database_query", db->name, udb_query_get_name(q),
+                     "OCIAttrGet (OCI_ATTR_ROWS_FETCHED)", oci_error);
+      break;
+    }
+
+    for (ub4 row = 0; row < rows_num; row++) {
+      for (size_t i = 0; i < column_num; i++) {
+        char *buffer = column_buffers + i * COLUMN_BUFFER_SIZE;
+
+        if (indicators[i * O_FETCH_ROWS + row] == -1) { /* NULL */
+          columns[i].type = UDB_COLUMN_STRING;
+          columns[i].value.string = "";
+        } else if (column_types[i] == SQLT_INT) {
+          columns[i].type = UDB_COLUMN_INT64;
+          memcpy(&columns[i].value.integer, buffer + row * sizeof(int64_t),
+                 sizeof(int64_t));
+        } else if (column_types[i] == SQLT_BDOUBLE) {
+          columns[i].type = UDB_COLUMN_DOUBLE;
+          memcpy(&columns[i].value.number, buffer + row * sizeof(double),
+                 sizeof(double));
+        } else {
+          columns[i].type = UDB_COLUMN_STRING;
+          columns[i].value.string = buffer + row * DATA_MAX_NAME_LEN;
+        }
+      }
+
+      status = udb_query_handle_result_columns(q, prep_area, columns);
+      if (status != 0) {
+        WARNING("oracle plugin: o_read_database_query (%s, %s): "
+                "udb_query_handle_result_columns failed.",
+                db->name, udb_query_get_name(q));
+      }
     }
+
+    if (done)
+      break;
   } /* }}} while (42) */
 
   udb_query_finish_result(q, prep_area);
@@ -587,6 +678,7 @@ static int o_read_database_query(o_database_t *db, /* {{{ */
   FREE_ALL;
 
   return 0;
+#undef COLUMN_BUFFER_SIZE
 #undef FREE_ALL
 #undef ALLOC_OR_FAIL
 } /* }}} int o_read_database_query */
@@ -28,6 +28,7 @@
  *   Taras Chornyi <tarasx.chornyi@intel.com>
  */
 
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 
 #include "utils/ovs/ovs.h" /* OvS helpers */
@@ -100,6 +101,7 @@ typedef struct interface_s {
   char ex_iface_id[UUID_SIZE];        /* External iface id */
   char ex_vm_id[UUID_SIZE];           /* External vm id */
   int64_t stats[IFACE_COUNTER_COUNT]; /* Statistics for interface */
+  struct port_s *port;                /* Port of the interface */
   struct interface_s *next;           /* Next interface for associated port */
 } interface_list_t;
 
@@ -109,6 +111,7 @@ typedef struct port_s {
   struct bridge_list_s *br;      /* Pointer to bridge */
   struct interface_s *iface;     /* Pointer to first interface */
   struct port_s *next;           /* Next port */
+  struct port_s *prev;           /* Previous port */
 } port_list_t;
 
 typedef struct bridge_list_s {
@@ -116,6 +119,13 @@ typedef struct bridge_list_s {
   struct bridge_list_s *next; /* Next bridge*/
 } bridge_list_t;
 
+/* Copy of a port taken by the read callback */
+typedef struct port_snapshot_s {
+  port_list_t port;
+  bridge_list_t br;
+  char br_name[PORT_NAME_SIZE_MAX];
+} port_snapshot_t;
+
 #define cnt_str(x) [x] = #x
 
 static const char *const iface_counter_table[IFACE_COUNTER_COUNT] = {
@@ -180,6 +190,20 @@ static bridge_list_t *g_monitored_bridge_list_head;
 
 /* entry into the list of network bridges */
 static port_list_t *g_port_list_head;
+static size_t g_ports_num;
+static size_t g_ifaces_num;
+
+/* Indexes of ports and interfaces by UUID, so that applying an update doesn't
+ * scan all ports. */
+static c_avl_tree_t *g_port_index;
+static c_avl_tree_t *g_iface_index;
+
+/* Snapshot of the port list used by the read callback, so that values are
+ * dispatched without holding g_stats_lock. */
+static port_snapshot_t *g_snapshot_ports;
+static size_t g_snapshot_ports_size;
+static interface_list_t *g_snapshot_ifaces;
+static size_t g_snapshot_ifaces_size;
 
 /* lock for statistics cache */
 static pthread_mutex_t g_stats_lock;
@@ -525,28 +549,31 @@ static void ovs_stats_submit_port(port_list_t *port) {
 }
 
 static port_list_t *ovs_stats_get_port(const char *uuid) {
+  port_list_t *port = NULL;
+
   if (uuid == NULL)
     return NULL;
 
-  for (port_list_t *port = g_port_list_head; port != NULL; port = port->next) {
-    if (strncmp(port->port_uuid, uuid, strlen(port->port_uuid)) == 0)
-      return port;
-  }
-  return NULL;
+  if (c_avl_get(g_port_index, uuid, (void *)&port) != 0)
+    return NULL;
+  return port;
 }
 
-static port_list_t *ovs_stats_get_port_by_interface_uuid(const char *uuid) {
+static interface_list_t *ovs_stats_get_interface(const char *uuid) {
+  interface_list_t *iface = NULL;
+
   if (uuid == NULL)
     return NULL;
 
-  for (port_list_t *port = g_port_list_head; port != NULL; port = port->next) {
-    for (interface_list_t *iface = port->iface; iface != NULL;
-         iface = iface->next) {
-      if (strncmp(iface->iface_uuid, uuid, strlen(uuid)) == 0)
-        return port;
-    }
-  }
-  return NULL;
+  if (c_avl_get(g_iface_index, uuid, (void *)&iface) != 0)
+    return NULL;
+  return iface;
+}
+
+static port_list_t *ovs_stats_get_port_by_interface_uuid(const char *uuid) {
+  interface_list_t *iface = ovs_stats_get_interface(uuid);
+
+  return (iface != NULL) ? iface->port : NULL;
 }
 
 static interface_list_t *ovs_stats_get_port_interface(port_list_t *port,
@@ -554,26 +581,23 @@ static interface_list_t *ovs_stats_get_port_interface(port_list_t *port,
   if (port == NULL || uuid == NULL)
     return NULL;
 
-  for (interface_list_t *iface = port->iface; iface != NULL;
-       iface = iface->next) {
-    if (strncmp(iface->iface_uuid, uuid, strlen(uuid)) == 0)
+  interface_list_t *iface = ovs_stats_get_interface(uuid);
+  if ((iface != NULL) && (iface->port == port))
+    return iface;
+
+  /* Not indexed if another port had an interface with the same UUID when it
+   * was added. */
+  for (iface = port->iface; iface != NULL; iface = iface->next) {
+    if (strcmp(iface->iface_uuid, uuid) == 0)
       return iface;
   }
   return NULL;
 }
 
-static interface_list_t *ovs_stats_get_interface(const char *uuid) {
-  if (uuid == NULL)
-    return NULL;
-
-  for (port_list_t *port = g_port_list_head; port != NULL; port = port->next) {
-    for (interface_list_t *iface = port->iface; iface != NULL;
-         iface = iface->next) {
-      if (strncmp(iface->iface_uuid, uuid, strlen(uuid)) == 0)
-        return iface;
-    }
-  }
-  return NULL;
+/* Remove "iface" from the interface index, if it is indexed */
+static void ovs_stats_unindex_interface(interface_list_t *iface) {
+  if (ovs_stats_get_interface(iface->iface_uuid) == iface)
+    c_avl_remove(g_iface_index, iface->iface_uuid, NULL, NULL);
 }
 
 static interface_list_t *ovs_stats_new_port_interface(port_list_t *port,
@@ -591,9 +615,13 @@ static interface_list_t *ovs_stats_new_port_interface(port_list_t *port,
     }
     memset(iface->stats, -1, sizeof(int64_t[IFACE_COUNTER_COUNT]));
     sstrncpy(iface->iface_uuid, uuid, sizeof(iface->iface_uuid));
+    iface->port = port;
+    if (ovs_stats_get_interface(iface->iface_uuid) == NULL)
+      c_avl_insert(g_iface_index, iface->iface_uuid, iface);
     interface_list_t *iface_head = port->iface;
     iface->next = iface_head;
     port->iface = iface;
+    g_ifaces_num++;
   }
   return iface;
 }
@@ -613,8 +641,16 @@ static port_list_t *ovs_stats_new_port(bridge_list_t *bridge,
       return NULL;
     }
     sstrncpy(port->port_uuid, uuid, sizeof(port->port_uuid));
+    if (c_avl_insert(g_port_index, port->port_uuid, port) != 0) {
+      ERROR("%s: Error indexing port", plugin_name);
+      sfree(port);
+      return NULL;
+    }
     port->next = g_port_list_head;
+    if (g_port_list_head != NULL)
+      g_port_list_head->prev = port;
     g_port_list_head = port;
+    g_ports_num++;
   }
   if (bridge != NULL) {
     port->br = bridge;
@@ -676,6 +712,11 @@ static int ovs_stats_del_bridge(yajl_val bridge) {
         g_bridge_list_head = br->next;
       else
         prev_br->next = br->next;
+      for (port_list_t *port = g_port_list_head; port != NULL;
+           port = port->next) {
+        if (port->br == br)
+          port->br = NULL;
+      }
       sfree(br->name);
       sfree(br);
       break;
@@ -886,26 +927,28 @@ static int ovs_stats_update_port(const char *uuid, yajl_val port) {
 
 /* Delete port from global port list */
 static int ovs_stats_del_port(const char *uuid) {
-  port_list_t *prev_port = g_port_list_head;
-  for (port_list_t *port = g_port_list_head; port != NULL;
-       prev_port = port, port = port->next) {
-    if (strncmp(port->port_uuid, uuid, strlen(port->port_uuid)) == 0) {
-      if (port == g_port_list_head)
-        g_port_list_head = port->next;
-      else
-        prev_port->next = port->next;
+  port_list_t *port = NULL;
+  if (c_avl_remove(g_port_index, uuid, NULL, (void *)&port) != 0)
+    return 0;
 
-      for (interface_list_t *iface = port->iface; iface != NULL;
-           iface = port->iface) {
-        interface_list_t *del = iface;
-        port->iface = iface->next;
-        sfree(del);
-      }
+  if (port->prev == NULL)
+    g_port_list_head = port->next;
+  else
+    port->prev->next = port->next;
+  if (port->next != NULL)
+    port->next->prev = port->prev;
 
-      sfree(port);
-      break;
-    }
+  for (interface_list_t *iface = port->iface; iface != NULL;
+       iface = port->iface) {
+    interface_list_t *del = iface;
+    port->iface = iface->next;
+    ovs_stats_unindex_interface(del);
+    sfree(del);
+    g_ifaces_num--;
   }
+
+  sfree(port);
+  g_ports_num--;
   return 0;
 }
 
@@ -1082,31 +1125,24 @@ static int ovs_stats_update_iface(yajl_val iface_obj) {
 
 /* Delete interface */
 static int ovs_stats_del_interface(const char *uuid) {
-  port_list_t *port = ovs_stats_get_port_by_interface_uuid(uuid);
+  interface_list_t *del = ovs_stats_get_interface(uuid);
 
-  if (port == NULL)
+  if (del == NULL)
     return 0;
 
-  interface_list_t *prev_iface = NULL;
-
-  for (interface_list_t *iface = port->iface; iface != NULL;
-       iface = iface->next) {
-    if (!strncmp(iface->iface_uuid, uuid, strlen(iface->iface_uuid))) {
-
-      interface_list_t *del = iface;
-
-      if (prev_iface == NULL)
-        port->iface = iface->next;
-      else
-        prev_iface->next = iface->next;
-
-      sfree(del);
+  port_list_t *port = del->port;
+  for (interface_list_t **iface = &port->iface; *iface != NULL;
+       iface = &(*iface)->next) {
+    if (*iface == del) {
+      *iface = del->next;
       break;
-    } else {
-      prev_iface = iface;
     }
   }
 
+  ovs_stats_unindex_interface(del);
+  sfree(del);
+  g_ifaces_num--;
+
   return 0;
 }
 
@@ -1255,6 +1291,18 @@ static void ovs_stats_free_port_list(port_list_t *head) {
     i = i->next;
     sfree(del);
   }
+
+  /* The keys are part of the freed ports and interfaces. */
+  void *key;
+  void *value;
+  while ((g_port_index != NULL) &&
+         (c_avl_pick(g_port_index, &key, &value) == 0))
+    ;
+  while ((g_iface_index != NULL) &&
+         (c_avl_pick(g_iface_index, &key, &value) == 0))
+    ;
+  g_ports_num = 0;
+  g_ifaces_num = 0;
 }
 
 /* Delete all bridges from bridge list */
@@ -1360,6 +1408,16 @@ static int ovs_stats_plugin_init(void) {
   ovs_db_callback_t cb = {.post_conn_init = ovs_stats_initialize,
                           .post_conn_terminate = ovs_stats_conn_terminate};
 
+  g_port_index = c_avl_create((int (*)(const void *, const void *))strcmp);
+  g_iface_index = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if ((g_port_index == NULL) || (g_iface_index == NULL)) {
+    ERROR("%s: plugin: failed to create port index", plugin_name);
+    c_avl_destroy(g_port_index);
+    c_avl_destroy(g_iface_index);
+    g_port_index = g_iface_index = NULL;
+    return -1;
+  }
+
   INFO("%s: Connecting to OVS DB using address=%s, service=%s, unix=%s",
        plugin_name, ovs_stats_cfg.ovs_db_node, ovs_stats_cfg.ovs_db_serv,
        ovs_stats_cfg.ovs_db_unix);
@@ -1379,9 +1437,28 @@ static int ovs_stats_plugin_init(void) {
   return 0;
 }
 
-/* OvS stats read callback. Read bridge/port information and submit it*/
-static int ovs_stats_plugin_read(__attribute__((unused)) user_data_t *ud) {
-  pthread_mutex_lock(&g_stats_lock);
+/* Copy the ports and their interfaces into the snapshot. Must be called with
+ * g_stats_lock held. */
+static int ovs_stats_take_snapshot(size_t *ret_num) {
+  if (g_snapshot_ports_size < g_ports_num) {
+    port_snapshot_t *tmp =
+        realloc(g_snapshot_ports, g_ports_num * sizeof(*g_snapshot_ports));
+    if (tmp == NULL)
+      return ENOMEM;
+    g_snapshot_ports = tmp;
+    g_snapshot_ports_size = g_ports_num;
+  }
+  if (g_snapshot_ifaces_size < g_ifaces_num) {
+    interface_list_t *tmp =
+        realloc(g_snapshot_ifaces, g_ifaces_num * sizeof(*g_snapshot_ifaces));
+    if (tmp == NULL)
+      return ENOMEM;
+    g_snapshot_ifaces = tmp;
+    g_snapshot_ifaces_size = g_ifaces_num;
+  }
+
+  size_t ports_num = 0;
+  size_t ifaces_num = 0;
   for (port_list_t *port = g_port_list_head; port != NULL; port = port->next) {
     if (strlen(port->name) == 0)
       /* Skip port w/o name. This is possible when read callback
@@ -1393,12 +1470,53 @@ static int ovs_stats_plugin_read(__attribute__((unused)) user_data_t *ud) {
     if (!port->br)
       continue;
 
+    port_snapshot_t *snap = g_snapshot_ports + ports_num;
+    ports_num++;
+
+    snap->port = *port;
+    snap->port.next = snap->port.prev = NULL;
+    sstrncpy(snap->br_name, port->br->name, sizeof(snap->br_name));
+    snap->br = (bridge_list_t){.name = snap->br_name};
+    snap->port.br = &snap->br;
+
+    interface_list_t **tail = &snap->port.iface;
+    for (interface_list_t *iface = port->iface; iface != NULL;
+         iface = iface->next) {
+      interface_list_t *copy = g_snapshot_ifaces + ifaces_num;
+      ifaces_num++;
+
+      *copy = *iface;
+      copy->port = &snap->port;
+      *tail = copy;
+      tail = &copy->next;
+    }
+    *tail = NULL;
+  }
+
+  *ret_num = ports_num;
+  return 0;
+}
+
+/* OvS stats read callback. Read bridge/port information and submit it*/
+static int ovs_stats_plugin_read(__attribute__((unused)) user_data_t *ud) {
+  size_t ports_num = 0;
+
+  pthread_mutex_lock(&g_stats_lock);
+  int status = ovs_stats_take_snapshot(&ports_num);
+  pthread_mutex_unlock(&g_stats_lock);
+  if (status != 0) {
+    ERROR("%s: Error allocating port snapshot", plugin_name);
+    return -1;
+  }
+
+  for (size_t i = 0; i < ports_num; i++) {
+    port_list_t *port = &g_snapshot_ports[i].port;
+
     ovs_stats_submit_port(port);
 
     if (interface_stats)
       ovs_stats_submit_interfaces(port);
   }
-  pthread_mutex_unlock(&g_stats_lock);
   return 0;
 }
 
@@ -1410,8 +1528,17 @@ static int ovs_stats_plugin_shutdown(void) {
   ovs_stats_free_bridge_list(g_bridge_list_head);
   ovs_stats_free_bridge_list(g_monitored_bridge_list_head);
   ovs_stats_free_port_list(g_port_list_head);
+  g_port_list_head = NULL;
+  c_avl_destroy(g_port_index);
+  c_avl_destroy(g_iface_index);
+  g_port_index = g_iface_index = NULL;
   pthread_mutex_unlock(&g_stats_lock);
   pthread_mutex_destroy(&g_stats_lock);
+
+  sfree(g_snapshot_ports);
+  g_snapshot_ports_size = 0;
+  sfree(g_snapshot_ifaces);
+  g_snapshot_ifaces_size = 0;
   return 0;
 }
 
@@ -136,6 +136,14 @@ typedef struct c_ithread_s {
   /* double linked list of threads */
   struct c_ithread_s *prev;
   struct c_ithread_s *next;
+
+  /* list of unused interpreters in the pool */
+  struct c_ithread_s *pool_next;
+
+  /* data set arrays by type and the hash reused for value lists; these are
+   * owned by this interpreter */
+  HV *data_sets;
+  HV *value_list;
 } c_ithread_t;
 
 typedef struct {
@@ -149,6 +157,11 @@ typedef struct {
 
   pthread_mutex_t mutex;
   pthread_mutexattr_t mutexattr;
+
+  /* interpreters shared by all threads, see c_ithread_acquire() */
+  c_ithread_t *pool_free;
+  pthread_mutex_t pool_lock;
+  pthread_cond_t pool_cond;
 } c_ithread_list_t;
 
 /* name / user_data for Perl matches / targets */
@@ -176,6 +189,9 @@ extern char **environ;
 
 static bool register_legacy_flush = true;
 
+/* number of interpreters in the pool; zero creates one per thread */
+static int perl_interpreters;
+
 /* if perl_threads != NULL perl_threads->head must
  * point to the "base" thread */
 static c_ithread_list_t *perl_threads;
@@ -626,6 +642,53 @@ static int data_set2av(pTHX_ data_set_t *ds, AV *array) {
   return 0;
 } /* static int data_set2av (data_set_t *, AV *) */
 
+/* Returns a new reference to the array describing "ds". If "t" is not NULL,
+ * the arrays are created once per type and interpreter and shared by all
+ * calls. Returns NULL on error. */
+static SV *data_set2rv(pTHX_ c_ithread_t *t, data_set_t *ds) {
+  size_t type_len = strlen(ds->type);
+
+  if ((NULL != t) && (NULL != t->data_sets)) {
+    SV **cached = hv_fetch(t->data_sets, ds->type, type_len, 0);
+    if (NULL != cached)
+      return newSVsv(*cached);
+  }
+
+  AV *pds = newAV();
+  if (-1 == data_set2av(aTHX_ ds, pds)) {
+    SvREFCNT_dec((SV *)pds);
+    return NULL;
+  }
+
+  SV *rv = newRV_noinc((SV *)pds);
+  if (NULL != t) {
+    if (NULL == t->data_sets)
+      t->data_sets = newHV();
+    hv_store(t->data_sets, ds->type, type_len, newSVsv(rv), 0);
+  }
+  return rv;
+} /* static SV *data_set2rv (pTHX_ c_ithread_t *, data_set_t *) */
+
+/* Returns an empty hash for a value list, owning one reference to it. If "t"
+ * is not NULL, its hash is reused unless a callback kept a reference to it. */
+static HV *value_list_hv(pTHX_ c_ithread_t *t) {
+  if (NULL == t)
+    return newHV();
+
+  if ((NULL != t->value_list) && (SvREFCNT((SV *)t->value_list) > 1)) {
+    SvREFCNT_dec((SV *)t->value_list);
+    t->value_list = NULL;
+  }
+
+  if (NULL == t->value_list)
+    t->value_list = newHV();
+  else
+    hv_clear(t->value_list);
+
+  SvREFCNT_inc_simple_void_NN((SV *)t->value_list);
+  return t->value_list;
+} /* static HV *value_list_hv (pTHX_ c_ithread_t *) */
+
 static int value_list2hv(pTHX_ value_list_t *vl, data_set_t *ds, HV *hash) {
   AV *values = NULL;
   size_t i;
@@ -1021,8 +1084,9 @@ static int pplugin_call(pTHX_ int type, ...) {
     data_set_t *ds;
     value_list_t *vl;
 
-    AV *pds = newAV();
-    HV *pvl = newHV();
+    c_ithread_t *t = (c_ithread_t *)pthread_getspecific(perl_thr_key);
+    SV *pds;
+    HV *pvl;
 
     subname = va_arg(ap, char *);
     /*
@@ -1053,22 +1117,22 @@ static int pplugin_call(pTHX_ int type, ...) {
     ds = va_arg(ap, data_set_t *);
     vl = va_arg(ap, value_list_t *);
 
-    if (-1 == data_set2av(aTHX_ ds, pds)) {
-      av_clear(pds);
-      av_undef(pds);
-      pds = (AV *)&PL_sv_undef;
+    pds = data_set2rv(aTHX_ t, ds);
+    if (NULL == pds) {
+      pds = newRV_noinc(&PL_sv_undef);
       ret = -1;
     }
 
+    pvl = value_list_hv(aTHX_ t);
     if (-1 == value_list2hv(aTHX_ vl, ds, pvl)) {
       hv_clear(pvl);
-      hv_undef(pvl);
+      SvREFCNT_dec((SV *)pvl);
       pvl = (HV *)&PL_sv_undef;
       ret = -1;
     }
 
     XPUSHs(sv_2mortal(newSVpv(ds->type, 0)));
-    XPUSHs(sv_2mortal(newRV_noinc((SV *)pds)));
+    XPUSHs(sv_2mortal(pds));
     XPUSHs(sv_2mortal(newRV_noinc((SV *)pvl)));
   } else if (PLUGIN_LOG == type) {
     subname = va_arg(ap, char *);
@@ -1183,6 +1247,11 @@ static void c_ithread_destroy(c_ithread_t *ithread) {
   ithread->running = true;
   log_debug("Shutting down Perl interpreter %p...", aTHX);
 
+  if (NULL != ithread->data_sets)
+    SvREFCNT_dec((SV *)ithread->data_sets);
+  if (NULL != ithread->value_list)
+    SvREFCNT_dec((SV *)ithread->value_list);
+
 #if COLLECT_DEBUG
   sv_report_used();
 
@@ -1274,6 +1343,82 @@ static c_ithread_t *c_ithread_create(PerlInterpreter *base) {
   return t;
 } /* static c_ithread_t *c_ithread_create (PerlInterpreter *) */
 
+/*
+ * Returns the Perl interpreter to be used by the calling thread. Threads that
+ * already use an interpreter keep using it. Otherwise, if a pool of
+ * interpreters has been configured, one is taken from the pool (waiting for
+ * one to become available) and "*borrowed" is set; it has to be handed back
+ * using c_ithread_release() once the call is done. Without a pool, a new
+ * interpreter is cloned for the thread.
+ */
+static PerlInterpreter *c_ithread_acquire(c_ithread_t **borrowed) {
+  c_ithread_t *t = NULL;
+  dTHX;
+
+  *borrowed = NULL;
+
+  if (NULL != aTHX)
+    return aTHX;
+
+  if (0 == perl_interpreters) {
+    pthread_mutex_lock(&perl_threads->mutex);
+    t = c_ithread_create(perl_threads->head->interp);
+    pthread_mutex_unlock(&perl_threads->mutex);
+
+    return t->interp;
+  }
+
+  pthread_mutex_lock(&perl_threads->pool_lock);
+  while (NULL == perl_threads->pool_free)
+    pthread_cond_wait(&perl_threads->pool_cond, &perl_threads->pool_lock);
+  t = perl_threads->pool_free;
+  perl_threads->pool_free = t->pool_next;
+  pthread_mutex_unlock(&perl_threads->pool_lock);
+
+  t->pool_next = NULL;
+  t->pthread = pthread_self();
+
+  PERL_SET_CONTEXT(t->interp);
+  pthread_setspecific(perl_thr_key, (const void *)t);
+
+  *borrowed = t;
+  return t->interp;
+} /* static PerlInterpreter *c_ithread_acquire (c_ithread_t **) */
+
+static void c_ithread_release(c_ithread_t *borrowed) {
+  if (NULL == borrowed)
+    return;
+
+  pthread_setspecific(perl_thr_key, NULL);
+  PERL_SET_CONTEXT(NULL);
+
+  pthread_mutex_lock(&perl_threads->pool_lock);
+  borrowed->pool_next = perl_threads->pool_free;
+  perl_threads->pool_free = borrowed;
+  pthread_cond_signal(&perl_threads->pool_cond);
+  pthread_mutex_unlock(&perl_threads->pool_lock);
+} /* static void c_ithread_release (c_ithread_t *) */
+
+/* Clones the base interpreter "perl_interpreters" times. Must be called from
+ * the base thread with perl_threads->mutex locked. */
+static void c_ithread_pool_create(void) {
+  c_ithread_t *base = perl_threads->head;
+
+  for (int i = 0; i < perl_interpreters; ++i) {
+    c_ithread_t *t = c_ithread_create(base->interp);
+
+    t->pool_next = perl_threads->pool_free;
+    perl_threads->pool_free = t;
+  }
+
+  /* c_ithread_create() made the last clone the current interpreter */
+  PERL_SET_CONTEXT(base->interp);
+  pthread_setspecific(perl_thr_key, (const void *)base);
+
+  log_debug("c_ithread_pool_create: created %i interpreters",
+            perl_interpreters);
+} /* static void c_ithread_pool_create (void) */
+
 /*
  * Filter chains implementation.
  */
@@ -1418,6 +1563,7 @@ static int fc_call(pTHX_ int type, int cb_type, pfc_user_data_t *data, ...) {
 
 static int fc_create(int type, const oconfig_item_t *ci, void **user_data) {
   pfc_user_data_t *data;
+  c_ithread_t *borrowed = NULL;
 
   int ret = 0;
 
@@ -1426,25 +1572,18 @@ static int fc_create(int type, const oconfig_item_t *ci, void **user_data) {
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
-
-  log_debug("fc_create: c_ithread: interp = %p (active threads: %i)", aTHX,
-            perl_threads->number_of_threads);
-
   if ((1 != ci->values_num) || (OCONFIG_TYPE_STRING != ci->values[0].type)) {
     log_warn("A \"%s\" block expects a single string argument.",
              (FC_MATCH == type) ? "Match" : "Target");
     return -1;
   }
 
+  if (NULL == aTHX)
+    aTHX = c_ithread_acquire(&borrowed);
+
+  log_debug("fc_create: c_ithread: interp = %p (active threads: %i)", aTHX,
+            perl_threads->number_of_threads);
+
   data = smalloc(sizeof(*data));
   data->name = sstrdup(ci->values[0].value.string);
   data->user_data = newSV(0);
@@ -1455,11 +1594,14 @@ static int fc_create(int type, const oconfig_item_t *ci, void **user_data) {
     PFC_USER_DATA_FREE(data);
   else
     *user_data = data;
+
+  c_ithread_release(borrowed);
   return ret;
 } /* static int fc_create (int, const oconfig_item_t *, void **) */
 
 static int fc_destroy(int type, void **user_data) {
   pfc_user_data_t *data = *(pfc_user_data_t **)user_data;
+  c_ithread_t *borrowed = NULL;
 
   int ret = 0;
 
@@ -1468,15 +1610,8 @@ static int fc_destroy(int type, void **user_data) {
   if ((NULL == perl_threads) || (NULL == data))
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  if (NULL == aTHX)
+    aTHX = c_ithread_acquire(&borrowed);
 
   log_debug("fc_destroy: c_ithread: interp = %p (active threads: %i)", aTHX,
             perl_threads->number_of_threads);
@@ -1485,12 +1620,16 @@ static int fc_destroy(int type, void **user_data) {
 
   PFC_USER_DATA_FREE(data);
   *user_data = NULL;
+
+  c_ithread_release(borrowed);
   return ret;
 } /* static int fc_destroy (int, void **) */
 
 static int fc_exec(int type, const data_set_t *ds, const value_list_t *vl,
                    notification_meta_t **meta, void **user_data) {
   pfc_user_data_t *data = *(pfc_user_data_t **)user_data;
+  c_ithread_t *borrowed = NULL;
+  int ret;
 
   dTHX;
 
@@ -1499,20 +1638,16 @@ static int fc_exec(int type, const data_set_t *ds, const value_list_t *vl,
 
   assert(NULL != data);
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  if (NULL == aTHX)
+    aTHX = c_ithread_acquire(&borrowed);
 
   log_debug("fc_exec: c_ithread: interp = %p (active threads: %i)", aTHX,
             perl_threads->number_of_threads);
 
-  return fc_call(aTHX_ type, FC_CB_EXEC, data, ds, vl, meta);
+  ret = fc_call(aTHX_ type, FC_CB_EXEC, data, ds, vl, meta);
+
+  c_ithread_release(borrowed);
+  return ret;
 } /* static int fc_exec (int, const data_set_t *, const value_list_t *,
                 notification_meta_t **, void **) */
 
@@ -2086,26 +2221,27 @@ static int perl_init(void) {
 
   status = pplugin_call(aTHX_ PLUGIN_INIT);
 
+  /* Clone the interpreters after the init callbacks, so that they start with
+   * the same state as the per-thread interpreters did. */
+  if ((0 < perl_interpreters) && (NULL == perl_threads->pool_free))
+    c_ithread_pool_create();
+
   pthread_mutex_unlock(&perl_threads->mutex);
 
   return status;
 } /* static int perl_init (void) */
 
 static int perl_read(user_data_t *user_data) {
+  c_ithread_t *borrowed = NULL;
+  int status;
+
   dTHX;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  if (NULL == aTHX)
+    aTHX = c_ithread_acquire(&borrowed);
 
   /* Assert that we're not running as the base thread. Otherwise, we might
    * run into concurrency issues with c_ithread_create(). See
@@ -2115,26 +2251,23 @@ static int perl_read(user_data_t *user_data) {
   log_debug("perl_read: c_ithread: interp = %p (active threads: %i)", aTHX,
             perl_threads->number_of_threads);
 
-  return pplugin_call(aTHX_ PLUGIN_READ, user_data->data);
+  status = pplugin_call(aTHX_ PLUGIN_READ, user_data->data);
+
+  c_ithread_release(borrowed);
+  return status;
 } /* static int perl_read (user_data_t *user_data) */
 
 static int perl_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *user_data) {
+  c_ithread_t *borrowed = NULL;
   int status;
   dTHX;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  if (NULL == aTHX)
+    aTHX = c_ithread_acquire(&borrowed);
 
   /* Lock the base thread if this is not called from one of the read threads
    * to avoid race conditions with c_ithread_create(). See
@@ -2149,24 +2282,19 @@ static int perl_write(const data_set_t *ds, const value_list_t *vl,
   if (aTHX == perl_threads->head->interp)
     pthread_mutex_unlock(&perl_threads->mutex);
 
+  c_ithread_release(borrowed);
   return status;
 } /* static int perl_write (const data_set_t *, const value_list_t *) */
 
 static void perl_log(int level, const char *msg, user_data_t *user_data) {
+  c_ithread_t *borrowed = NULL;
   dTHX;
 
   if (NULL == perl_threads)
     return;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  if (NULL == aTHX)
+    aTHX = c_ithread_acquire(&borrowed);
 
   /* Lock the base thread if this is not called from one of the read threads
    * to avoid race conditions with c_ithread_create(). See
@@ -2181,49 +2309,47 @@ static void perl_log(int level, const char *msg, user_data_t *user_data) {
   if (aTHX == perl_threads->head->interp)
     pthread_mutex_unlock(&perl_threads->mutex);
 
+  c_ithread_release(borrowed);
   return;
 } /* static void perl_log (int, const char *) */
 
 static int perl_notify(const notification_t *notif, user_data_t *user_data) {
+  c_ithread_t *borrowed = NULL;
+  int status;
   dTHX;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
+  if (NULL == aTHX)
+    aTHX = c_ithread_acquire(&borrowed);
+  status = pplugin_call(aTHX_ PLUGIN_NOTIF, user_data->data, notif);
 
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
-  return pplugin_call(aTHX_ PLUGIN_NOTIF, user_data->data, notif);
+  c_ithread_release(borrowed);
+  return status;
 } /* static int perl_notify (const notification_t *) */
 
 static int perl_flush(cdtime_t timeout, const char *identifier,
                       user_data_t *user_data) {
+  c_ithread_t *borrowed = NULL;
+  int status;
   dTHX;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  if (NULL == aTHX)
+    aTHX = c_ithread_acquire(&borrowed);
 
   /* For collectd-5.6 only, #1731 */
   if (user_data == NULL || user_data->data == NULL)
-    return pplugin_call(aTHX_ PLUGIN_FLUSH_ALL, timeout, identifier);
+    status = pplugin_call(aTHX_ PLUGIN_FLUSH_ALL, timeout, identifier);
+  else
+    status = pplugin_call(aTHX_ PLUGIN_FLUSH, user_data->data, timeout,
+                          identifier);
 
-  return pplugin_call(aTHX_ PLUGIN_FLUSH, user_data->data, timeout, identifier);
+  c_ithread_release(borrowed);
+  return status;
 } /* static int perl_flush (const int) */
 
 static int perl_shutdown(void) {
@@ -2283,6 +2409,8 @@ static int perl_shutdown(void) {
   pthread_mutex_unlock(&perl_threads->mutex);
   pthread_mutex_destroy(&perl_threads->mutex);
   pthread_mutexattr_destroy(&perl_threads->mutexattr);
+  pthread_mutex_destroy(&perl_threads->pool_lock);
+  pthread_cond_destroy(&perl_threads->pool_cond);
 
   sfree(perl_threads);
 
@@ -2435,6 +2563,8 @@ static int init_pi(int argc, char **argv) {
   pthread_mutexattr_init(&perl_threads->mutexattr);
   pthread_mutexattr_settype(&perl_threads->mutexattr, PTHREAD_MUTEX_RECURSIVE);
   pthread_mutex_init(&perl_threads->mutex, &perl_threads->mutexattr);
+  pthread_mutex_init(&perl_threads->pool_lock, NULL);
+  pthread_cond_init(&perl_threads->pool_cond, NULL);
   /* locking the mutex should not be necessary at this point
    * but let's just do it for the sake of completeness */
   pthread_mutex_lock(&perl_threads->mutex);
@@ -2690,6 +2820,14 @@ static int perl_config(oconfig_item_t *ci) {
       current_status = perl_config_plugin(aTHX_ c);
     else if (0 == strcasecmp(c->key, "RegisterLegacyFlush"))
       cf_util_get_boolean(c, &register_legacy_flush);
+    else if (0 == strcasecmp(c->key, "Interpreters")) {
+      current_status = cf_util_get_int(c, &perl_interpreters);
+      if ((0 == current_status) && (0 > perl_interpreters)) {
+        log_warn("Interpreters must not be negative.");
+        perl_interpreters = 0;
+        current_status = 1;
+      }
+    }
     else {
       log_warn("Ignoring unknown config key \"%s\".", c->key);
       current_status = 0;
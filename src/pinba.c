@@ -27,6 +27,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/latency/histogram.h"
 
 #include <netdb.h>
 #include <poll.h>
@@ -74,7 +75,9 @@ struct float_counter_s {
 };
 typedef struct float_counter_s float_counter_t;
 
-struct pinba_statnode_s {
+/* A configured <View>. The hashes of the match strings are computed once, so
+ * that matching a request usually only compares integers. */
+struct pinba_view_s {
   /* collector name, used as plugin instance */
   char *name;
 
@@ -83,6 +86,13 @@ struct pinba_statnode_s {
   char *server;
   char *script;
 
+  uint32_t host_hash;
+  uint32_t server_hash;
+  uint32_t script_hash;
+};
+typedef struct pinba_view_s pinba_view_t;
+
+struct pinba_statnode_s {
   derive_t req_count;
 
   float_counter_t req_time;
@@ -91,24 +101,48 @@ struct pinba_statnode_s {
 
   derive_t doc_size;
   gauge_t mem_peak;
+
+  /* Request times; only allocated if percentiles are configured. */
+  latency_histogram_t *req_times;
 };
 typedef struct pinba_statnode_s pinba_statnode_t;
+
+/* Each receiver has a thread reading from sockets of its own and accounts the
+ * requests in statnodes of its own, one per view. With more than one
+ * receiver, the sockets share the port using SO_REUSEPORT and the kernel
+ * distributes the packets. The lock is only contended while plugin_read()
+ * merges the receiver's statnodes into "stat_nodes". */
+struct pinba_receiver_s {
+  pthread_t thread;
+  bool thread_running;
+
+  pinba_statnode_t *nodes;
+  pthread_mutex_t lock;
+
+  uint8_t buffer[PINBA_UDP_BUFFER_SIZE];
+};
+typedef struct pinba_receiver_s pinba_receiver_t;
 /* }}} */
 
 /*
  * Module global variables
  */
 /* {{{ */
+static pinba_view_t *views;
+static size_t views_num;
+
+/* Totals per view, only accessed by plugin_read(). */
 static pinba_statnode_t *stat_nodes;
-static unsigned int stat_nodes_num;
-static pthread_mutex_t stat_nodes_lock;
+
+static pinba_receiver_t *receivers;
+static size_t receivers_num;
+static bool receivers_do_shutdown;
 
 static char *conf_node;
 static char *conf_service;
-
-static bool collector_thread_running;
-static bool collector_thread_do_shutdown;
-static pthread_t collector_thread_id;
+static size_t conf_receive_threads = 1;
+static double *conf_percentile;
+static size_t conf_percentile_num;
 /* }}} */
 
 /*
@@ -144,6 +178,18 @@ static derive_t float_counter_get(const float_counter_t *fc, /* {{{ */
   return ret;
 } /* }}} derive_t float_counter_get */
 
+static void float_counter_merge(float_counter_t *dst, /* {{{ */
+                                const float_counter_t *src) {
+  dst->i += src->i;
+  dst->n += src->n;
+
+  if (dst->n >= 1000000000) {
+    dst->i += 1;
+    dst->n -= 1000000000;
+    assert(dst->n < 1000000000);
+  }
+} /* }}} void float_counter_merge */
+
 static void strset(char **str, const char *new) /* {{{ */
 {
   char *tmp;
@@ -159,67 +205,116 @@ static void strset(char **str, const char *new) /* {{{ */
   *str = tmp;
 } /* }}} void strset */
 
-static void service_statnode_add(const char *name, /* {{{ */
-                                 const char *host, const char *server,
-                                 const char *script) {
-  pinba_statnode_t *node;
+/* FNV-1a hash of "str". */
+static uint32_t pinba_hash(const char *str) /* {{{ */
+{
+  uint32_t hash = 2166136261u;
+
+  for (const unsigned char *ptr = (const unsigned char *)str; *ptr != 0;
+       ptr++) {
+    hash ^= (uint32_t)*ptr;
+    hash *= 16777619u;
+  }
+
+  return hash;
+} /* }}} uint32_t pinba_hash */
+
+static void service_view_add(const char *name, /* {{{ */
+                             const char *host, const char *server,
+                             const char *script) {
+  pinba_view_t *view;
 
-  node = realloc(stat_nodes, sizeof(*stat_nodes) * (stat_nodes_num + 1));
-  if (node == NULL) {
+  view = realloc(views, sizeof(*views) * (views_num + 1));
+  if (view == NULL) {
     ERROR("pinba plugin: realloc failed");
     return;
   }
-  stat_nodes = node;
+  views = view;
 
-  node = stat_nodes + stat_nodes_num;
-  memset(node, 0, sizeof(*node));
+  view = views + views_num;
+  memset(view, 0, sizeof(*view));
 
   /* reset strings */
-  node->name = NULL;
-  node->host = NULL;
-  node->server = NULL;
-  node->script = NULL;
-
-  node->mem_peak = NAN;
+  view->name = NULL;
+  view->host = NULL;
+  view->server = NULL;
+  view->script = NULL;
 
   /* fill query data */
-  strset(&node->name, name);
-  strset(&node->host, host);
-  strset(&node->server, server);
-  strset(&node->script, script);
+  strset(&view->name, name);
+  strset(&view->host, host);
+  strset(&view->server, server);
+  strset(&view->script, script);
+
+  if (view->host != NULL)
+    view->host_hash = pinba_hash(view->host);
+  if (view->server != NULL)
+    view->server_hash = pinba_hash(view->server);
+  if (view->script != NULL)
+    view->script_hash = pinba_hash(view->script);
 
   /* increment counter */
-  stat_nodes_num++;
-} /* }}} void service_statnode_add */
-
-/* Copy the data from the global "stat_nodes" list into the buffer pointed to
- * by "res", doing the derivation in the process. Returns the next index or
- * zero if the end of the list has been reached. */
-static unsigned int service_statnode_collect(pinba_statnode_t *res, /* {{{ */
-                                             unsigned int index) {
-  pinba_statnode_t *node;
+  views_num++;
+} /* }}} void service_view_add */
 
-  if (stat_nodes_num == 0)
-    return 0;
+/* Allocates one statnode per view. Returns NULL on failure. */
+static pinba_statnode_t *service_statnodes_create(void) /* {{{ */
+{
+  pinba_statnode_t *nodes = calloc(views_num, sizeof(*nodes));
+  if (nodes == NULL)
+    return NULL;
 
-  /* begin collecting */
-  if (index == 0)
-    pthread_mutex_lock(&stat_nodes_lock);
+  for (size_t i = 0; i < views_num; i++) {
+    nodes[i].mem_peak = NAN;
+    if (conf_percentile_num == 0)
+      continue;
 
-  /* end collecting */
-  if (index >= stat_nodes_num) {
-    pthread_mutex_unlock(&stat_nodes_lock);
-    return 0;
+    nodes[i].req_times = latency_histogram_create();
+    if (nodes[i].req_times == NULL) {
+      for (size_t j = 0; j < i; j++)
+        latency_histogram_destroy(nodes[j].req_times);
+      sfree(nodes);
+      return NULL;
+    }
   }
 
-  node = stat_nodes + index;
-  memcpy(res, node, sizeof(*res));
+  return nodes;
+} /* }}} pinba_statnode_t *service_statnodes_create */
+
+static void service_statnodes_free(pinba_statnode_t *nodes) /* {{{ */
+{
+  if (nodes == NULL)
+    return;
+
+  for (size_t i = 0; i < views_num; i++)
+    latency_histogram_destroy(nodes[i].req_times);
+  sfree(nodes);
+} /* }}} void service_statnodes_free */
+
+/* Adds the data of "src" to "dst" and resets "src". */
+static void service_statnode_merge(pinba_statnode_t *dst, /* {{{ */
+                                   pinba_statnode_t *src) {
+  dst->req_count += src->req_count;
+
+  float_counter_merge(&dst->req_time, &src->req_time);
+  float_counter_merge(&dst->ru_utime, &src->ru_utime);
+  float_counter_merge(&dst->ru_stime, &src->ru_stime);
 
-  /* reset node */
-  node->mem_peak = NAN;
+  dst->doc_size += src->doc_size;
 
-  return index + 1;
-} /* }}} unsigned int service_statnode_collect */
+  if (isnan(dst->mem_peak) || (dst->mem_peak < src->mem_peak))
+    dst->mem_peak = src->mem_peak;
+
+  if ((dst->req_times != NULL) && (src->req_times != NULL)) {
+    latency_histogram_merge(dst->req_times, src->req_times);
+    latency_histogram_reset(src->req_times);
+  }
+
+  latency_histogram_t *req_times = src->req_times;
+  memset(src, 0, sizeof(*src));
+  src->mem_peak = NAN;
+  src->req_times = req_times;
+} /* }}} void service_statnode_merge */
 
 static void service_statnode_process(pinba_statnode_t *node, /* {{{ */
                                      Pinba__Request *request) {
@@ -235,29 +330,43 @@ static void service_statnode_process(pinba_statnode_t *node, /* {{{ */
       (node->mem_peak < ((gauge_t)request->memory_peak)))
     node->mem_peak = (gauge_t)request->memory_peak;
 
+  if ((node->req_times != NULL) && (request->request_time >= 0.0))
+    latency_histogram_add(node->req_times,
+                          DOUBLE_TO_CDTIME_T(request->request_time));
 } /* }}} void service_statnode_process */
 
-static void service_process_request(Pinba__Request *request) /* {{{ */
-{
-  pthread_mutex_lock(&stat_nodes_lock);
+static bool service_view_match(const char *match, /* {{{ */
+                               uint32_t match_hash, const char *value,
+                               uint32_t value_hash) {
+  if (match == NULL)
+    return true;
 
-  for (unsigned int i = 0; i < stat_nodes_num; i++) {
-    if ((stat_nodes[i].host != NULL) &&
-        (strcmp(request->hostname, stat_nodes[i].host) != 0))
-      continue;
+  return (match_hash == value_hash) && (strcmp(match, value) == 0);
+} /* }}} bool service_view_match */
 
-    if ((stat_nodes[i].server != NULL) &&
-        (strcmp(request->server_name, stat_nodes[i].server) != 0))
-      continue;
+static void service_process_request(pinba_receiver_t *r, /* {{{ */
+                                    Pinba__Request *request) {
+  uint32_t host_hash = pinba_hash(request->hostname);
+  uint32_t server_hash = pinba_hash(request->server_name);
+  uint32_t script_hash = pinba_hash(request->script_name);
+
+  pthread_mutex_lock(&r->lock);
 
-    if ((stat_nodes[i].script != NULL) &&
-        (strcmp(request->script_name, stat_nodes[i].script) != 0))
+  for (size_t i = 0; i < views_num; i++) {
+    pinba_view_t *view = views + i;
+
+    if (!service_view_match(view->host, view->host_hash, request->hostname,
+                            host_hash) ||
+        !service_view_match(view->server, view->server_hash,
+                            request->server_name, server_hash) ||
+        !service_view_match(view->script, view->script_hash,
+                            request->script_name, script_hash))
       continue;
 
-    service_statnode_process(&stat_nodes[i], request);
+    service_statnode_process(r->nodes + i, request);
   }
 
-  pthread_mutex_unlock(&stat_nodes_lock);
+  pthread_mutex_unlock(&r->lock);
 } /* }}} void service_process_request */
 
 static int pb_del_socket(pinba_socket_t *s, /* {{{ */
@@ -279,7 +388,7 @@ static int pb_del_socket(pinba_socket_t *s, /* {{{ */
 } /* }}} int pb_del_socket */
 
 static int pb_add_socket(pinba_socket_t *s, /* {{{ */
-                         const struct addrinfo *ai) {
+                         const struct addrinfo *ai, bool reuse_port) {
 
   if (s->fd_num == PINBA_MAX_SOCKETS) {
     WARNING("pinba plugin: Sorry, you have hit the built-in limit of "
@@ -300,6 +409,16 @@ static int pb_add_socket(pinba_socket_t *s, /* {{{ */
     WARNING("pinba plugin: setsockopt(SO_REUSEADDR) failed: %s", STRERRNO);
   }
 
+#ifdef SO_REUSEPORT
+  /* Let the sockets of all receivers bind to the same address. */
+  if (reuse_port &&
+      (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int)) != 0)) {
+    ERROR("pinba plugin: setsockopt(SO_REUSEPORT) failed: %s", STRERRNO);
+    close(fd);
+    return 0;
+  }
+#endif
+
   status = bind(fd, ai->ai_addr, ai->ai_addrlen);
   if (status != 0) {
     ERROR("pinba plugin: bind(2) failed: %s", STRERRNO);
@@ -316,7 +435,8 @@ static int pb_add_socket(pinba_socket_t *s, /* {{{ */
 } /* }}} int pb_add_socket */
 
 static pinba_socket_t *pinba_socket_open(const char *node, /* {{{ */
-                                         const char *service) {
+                                         const char *service,
+                                         bool reuse_port) {
   pinba_socket_t *s;
   struct addrinfo *ai_list;
   int status;
@@ -347,7 +467,7 @@ static pinba_socket_t *pinba_socket_open(const char *node, /* {{{ */
 
   for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
        ai_ptr = ai_ptr->ai_next) {
-    status = pb_add_socket(s, ai_ptr);
+    status = pb_add_socket(s, ai_ptr, reuse_port);
     if (status != 0)
       break;
   } /* for (ai_list) */
@@ -378,7 +498,8 @@ static void pinba_socket_free(pinba_socket_t *socket) /* {{{ */
   sfree(socket);
 } /* }}} void pinba_socket_free */
 
-static int pinba_process_stats_packet(const uint8_t *buffer, /* {{{ */
+static int pinba_process_stats_packet(pinba_receiver_t *r, /* {{{ */
+                                      const uint8_t *buffer,
                                       size_t buffer_size) {
   Pinba__Request *request;
 
@@ -387,20 +508,20 @@ static int pinba_process_stats_packet(const uint8_t *buffer, /* {{{ */
   if (!request)
     return -1;
 
-  service_process_request(request);
+  service_process_request(r, request);
   pinba__request__free_unpacked(request, NULL);
 
   return 0;
 } /* }}} int pinba_process_stats_packet */
 
-static int pinba_udp_read_callback_fn(int sock) /* {{{ */
+static int pinba_udp_read_callback_fn(pinba_receiver_t *r, int sock) /* {{{ */
 {
-  uint8_t buffer[PINBA_UDP_BUFFER_SIZE];
+  uint8_t *buffer = r->buffer;
   size_t buffer_size;
   int status;
 
   while (42) {
-    buffer_size = sizeof(buffer);
+    buffer_size = sizeof(r->buffer);
     status = recvfrom(sock, buffer, buffer_size - 1, MSG_DONTWAIT,
                       /* from = */ NULL, /* from len = */ 0);
     if (status < 0) {
@@ -424,7 +545,7 @@ static int pinba_udp_read_callback_fn(int sock) /* {{{ */
       buffer_size = (size_t)status;
       buffer[buffer_size] = 0;
 
-      status = pinba_process_stats_packet(buffer, buffer_size);
+      status = pinba_process_stats_packet(r, buffer, buffer_size);
       if (status != 0)
         DEBUG("pinba plugin: Parsing packet failed.");
       return status;
@@ -436,17 +557,18 @@ static int pinba_udp_read_callback_fn(int sock) /* {{{ */
   return -1;
 } /* }}} void pinba_udp_read_callback_fn */
 
-static int receive_loop(void) /* {{{ */
+static int receive_loop(pinba_receiver_t *r) /* {{{ */
 {
   pinba_socket_t *s;
 
-  s = pinba_socket_open(conf_node, conf_service);
+  s = pinba_socket_open(conf_node, conf_service,
+                        /* reuse_port = */ receivers_num > 1);
   if (s == NULL) {
     ERROR("pinba plugin: Collector thread is exiting prematurely.");
     return -1;
   }
 
-  while (!collector_thread_do_shutdown) {
+  while (!receivers_do_shutdown) {
     int status;
 
     if (s->fd_num < 1)
@@ -470,10 +592,10 @@ static int receive_loop(void) /* {{{ */
         pb_del_socket(s, i);
         i--;
       } else if (s->fd[i].revents & (POLLIN | POLLPRI)) {
-        pinba_udp_read_callback_fn(s->fd[i].fd);
+        pinba_udp_read_callback_fn(r, s->fd[i].fd);
       }
     } /* for (s->fd) */
-  }   /* while (!collector_thread_do_shutdown) */
+  }   /* while (!receivers_do_shutdown) */
 
   pinba_socket_free(s);
   s = NULL;
@@ -483,10 +605,8 @@ static int receive_loop(void) /* {{{ */
 
 static void *collector_thread(void *arg) /* {{{ */
 {
-  receive_loop();
+  receive_loop(arg);
 
-  memset(&collector_thread_id, 0, sizeof(collector_thread_id));
-  collector_thread_running = false;
   pthread_exit(NULL);
   return NULL;
 } /* }}} void *collector_thread */
@@ -525,7 +645,7 @@ static int pinba_config_view(const oconfig_item_t *ci) /* {{{ */
   }
 
   if (status == 0)
-    service_statnode_add(name, host, server, script);
+    service_view_add(name, host, server, script);
 
   sfree(name);
   sfree(host);
@@ -535,12 +655,62 @@ static int pinba_config_view(const oconfig_item_t *ci) /* {{{ */
   return status;
 } /* }}} int pinba_config_view */
 
-static int plugin_config(oconfig_item_t *ci) /* {{{ */
+static int pinba_config_receive_threads(const oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+
+  if (tmp < 1) {
+    WARNING("pinba plugin: The `ReceiveThreads' option must be at least 1.");
+    return -1;
+  }
+
+#ifndef SO_REUSEPORT
+  if (tmp > 1) {
+    WARNING("pinba plugin: `ReceiveThreads' requires SO_REUSEPORT, which "
+            "is not available on this system. Using one receive thread.");
+    tmp = 1;
+  }
+#endif
+
+  conf_receive_threads = (size_t)tmp;
+  return 0;
+} /* }}} int pinba_config_receive_threads */
+
+static int pinba_config_percentile(const oconfig_item_t *ci) /* {{{ */
 {
-  /* The lock should not be necessary in the config callback, but let's be
-   * sure.. */
-  pthread_mutex_lock(&stat_nodes_lock);
+  double percent = NAN;
+  double *tmp;
+  int status;
+
+  status = cf_util_get_double(ci, &percent);
+  if (status != 0)
+    return status;
+
+  if ((percent <= 0.0) || (percent >= 100)) {
+    ERROR("pinba plugin: The value for \"%s\" must be between 0 and 100, "
+          "exclusively.",
+          ci->key);
+    return ERANGE;
+  }
+
+  tmp = realloc(conf_percentile,
+                sizeof(*conf_percentile) * (conf_percentile_num + 1));
+  if (tmp == NULL) {
+    ERROR("pinba plugin: realloc failed.");
+    return ENOMEM;
+  }
+  conf_percentile = tmp;
+  conf_percentile[conf_percentile_num] = percent;
+  conf_percentile_num++;
 
+  return 0;
+} /* }}} int pinba_config_percentile */
+
+static int plugin_config(oconfig_item_t *ci) /* {{{ */
+{
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
 
@@ -548,70 +718,114 @@ static int plugin_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &conf_node);
     else if (strcasecmp("Port", child->key) == 0)
       cf_util_get_service(child, &conf_service);
+    else if (strcasecmp("ReceiveThreads", child->key) == 0)
+      pinba_config_receive_threads(child);
+    else if (strcasecmp("RequestTimePercentile", child->key) == 0)
+      pinba_config_percentile(child);
     else if (strcasecmp("View", child->key) == 0)
       pinba_config_view(child);
     else
       WARNING("pinba plugin: Unknown config option: %s", child->key);
   }
 
-  pthread_mutex_unlock(&stat_nodes_lock);
-
   return 0;
 } /* }}} int pinba_config */
 
-static int plugin_init(void) /* {{{ */
+static void receivers_free(void) /* {{{ */
 {
-  int status;
+  for (size_t i = 0; i < receivers_num; i++) {
+    service_statnodes_free(receivers[i].nodes);
+    pthread_mutex_destroy(&receivers[i].lock);
+  }
+  sfree(receivers);
+  receivers_num = 0;
+} /* }}} void receivers_free */
 
-  if (stat_nodes == NULL) {
+static int plugin_init(void) /* {{{ */
+{
+  if (views == NULL) {
     /* Collect the "total" data by default. */
-    service_statnode_add("total",
-                         /* host   = */ NULL,
-                         /* server = */ NULL,
-                         /* script = */ NULL);
+    service_view_add("total",
+                     /* host   = */ NULL,
+                     /* server = */ NULL,
+                     /* script = */ NULL);
   }
 
-  if (collector_thread_running)
+  if (receivers != NULL)
     return 0;
 
-  status = plugin_thread_create(&collector_thread_id, collector_thread,
-                                /* args = */ NULL, "pinba collector");
-  if (status != 0) {
-    ERROR("pinba plugin: pthread_create(3) failed: %s", STRERRNO);
+  stat_nodes = service_statnodes_create();
+  if (stat_nodes == NULL) {
+    ERROR("pinba plugin: Allocating statistics failed.");
+    return -1;
+  }
+
+  receivers = calloc(conf_receive_threads, sizeof(*receivers));
+  if (receivers == NULL) {
+    ERROR("pinba plugin: calloc failed.");
     return -1;
   }
-  collector_thread_running = true;
+
+  for (size_t i = 0; i < conf_receive_threads; i++) {
+    receivers[i].nodes = service_statnodes_create();
+    if (receivers[i].nodes == NULL) {
+      ERROR("pinba plugin: Allocating statistics failed.");
+      receivers_free();
+      return -1;
+    }
+    pthread_mutex_init(&receivers[i].lock, /* attr = */ NULL);
+    receivers_num++;
+  }
+
+  for (size_t i = 0; i < receivers_num; i++) {
+    pinba_receiver_t *r = receivers + i;
+
+    int status = plugin_thread_create(&r->thread, collector_thread, r,
+                                      "pinba collector");
+    if (status != 0) {
+      ERROR("pinba plugin: pthread_create(3) failed: %s", STRERROR(status));
+      continue;
+    }
+    r->thread_running = true;
+  }
 
   return 0;
 } /* }}} */
 
 static int plugin_shutdown(void) /* {{{ */
 {
-  if (collector_thread_running) {
-    int status;
+  DEBUG("pinba plugin: Shutting down collector threads.");
+  receivers_do_shutdown = true;
 
-    DEBUG("pinba plugin: Shutting down collector thread.");
-    collector_thread_do_shutdown = true;
+  for (size_t i = 0; i < receivers_num; i++) {
+    pinba_receiver_t *r = receivers + i;
 
-    status = pthread_join(collector_thread_id, /* retval = */ NULL);
+    if (!r->thread_running)
+      continue;
+
+    int status = pthread_join(r->thread, /* retval = */ NULL);
     if (status != 0) {
       ERROR("pinba plugin: pthread_join(3) failed: %s", STRERROR(status));
     }
+    r->thread_running = false;
+  }
+
+  receivers_free();
+  receivers_do_shutdown = false;
 
-    collector_thread_running = false;
-    collector_thread_do_shutdown = false;
-  } /* if (collector_thread_running) */
+  service_statnodes_free(stat_nodes);
+  stat_nodes = NULL;
 
   return 0;
 } /* }}} int plugin_shutdown */
 
-static int plugin_submit(const pinba_statnode_t *res) /* {{{ */
-{
+static int plugin_submit(const pinba_view_t *view, /* {{{ */
+                         const pinba_statnode_t *res) {
   value_list_t vl = VALUE_LIST_INIT;
 
   vl.values_len = 1;
   sstrncpy(vl.plugin, "pinba", sizeof(vl.plugin));
-  sstrncpy(vl.plugin_instance, res->name, sizeof(vl.plugin_instance));
+  sstrncpy(vl.plugin_instance, view->name, sizeof(vl.plugin_instance));
 
   vl.values = &(value_t){.derive = res->req_count};
   sstrncpy(vl.type, "total_requests", sizeof(vl.type));
@@ -643,16 +857,51 @@ static int plugin_submit(const pinba_statnode_t *res) /* {{{ */
   sstrncpy(vl.type_instance, "peak", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 
+  if (res->req_times != NULL) {
+    /* Look up all percentiles in one pass over the histogram. */
+    cdtime_t percentile[conf_percentile_num];
+    bool have_requests = (latency_histogram_get_num(res->req_times) > 0);
+
+    latency_histogram_get_percentiles(res->req_times, conf_percentile,
+                                      percentile, conf_percentile_num);
+
+    sstrncpy(vl.type, "response_time", sizeof(vl.type));
+    for (size_t i = 0; i < conf_percentile_num; i++) {
+      ssnprintf(vl.type_instance, sizeof(vl.type_instance), "percentile-%g",
+                conf_percentile[i]);
+      vl.values = &(value_t){
+          .gauge = have_requests ? CDTIME_T_TO_DOUBLE(percentile[i]) : NAN};
+      plugin_dispatch_values(&vl);
+    }
+  }
+
   return 0;
 } /* }}} int plugin_submit */
 
 static int plugin_read(void) /* {{{ */
 {
-  unsigned int i = 0;
-  pinba_statnode_t data;
+  if (stat_nodes == NULL)
+    return -1;
+
+  /* Merge the statistics of all receivers into the totals. */
+  for (size_t i = 0; i < receivers_num; i++) {
+    pinba_receiver_t *r = receivers + i;
+
+    pthread_mutex_lock(&r->lock);
+    for (size_t j = 0; j < views_num; j++)
+      service_statnode_merge(stat_nodes + j, r->nodes + j);
+    pthread_mutex_unlock(&r->lock);
+  }
+
+  for (size_t i = 0; i < views_num; i++) {
+    pinba_statnode_t *node = stat_nodes + i;
+
+    plugin_submit(views + i, node);
 
-  while ((i = service_statnode_collect(&data, i)) != 0) {
-    plugin_submit(&data);
+    /* The peak memory usage and percentiles refer to the last interval. */
+    node->mem_peak = NAN;
+    if (node->req_times != NULL)
+      latency_histogram_reset(node->req_times);
   }
 
   return 0;
@@ -28,6 +28,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/latency/histogram.h"
 #include "utils_complain.h"
 
 #include <netinet/in.h>
@@ -58,18 +59,42 @@ struct hostlist_s {
   uint32_t pkg_sent;
   uint32_t pkg_recv;
   uint32_t pkg_missed;
+  bool resolve;
 
   double latency_total;
   double latency_squared;
+  latency_histogram_t *latency;
 
   struct hostlist_s *next;
 };
 typedef struct hostlist_s hostlist_t;
 
+/* A group of hosts that is pinged at once, using its own liboping object.
+ * The groups of all threads are sent at evenly spaced offsets within the
+ * interval, so that packets are not sent to all hosts in a single burst. */
+typedef struct {
+  pingobj_t *pingobj;
+  hostlist_t **hosts;
+  size_t hosts_num;
+  cdtime_t offset;
+} ping_group_t;
+
+typedef struct {
+  pthread_t id;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int loop;
+  int error;
+
+  ping_group_t *groups;
+  size_t groups_num;
+} ping_thread_t;
+
 /*
  * Private variables
  */
 static hostlist_t *hostlist_head;
+static size_t hostlist_num;
 
 static int ping_af = PING_DEF_AF;
 static char *ping_source;
@@ -81,98 +106,80 @@ static int ping_ttl = PING_DEF_TTL;
 static double ping_interval = 1.0;
 static double ping_timeout = 0.9;
 static int ping_max_missed = -1;
-
-static pthread_mutex_t ping_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t ping_cond = PTHREAD_COND_INITIALIZER;
-static int ping_thread_loop;
-static int ping_thread_error;
-static pthread_t ping_thread_id;
-
-static const char *config_keys[] = {"Host",    "SourceAddress", "AddressFamily",
+static size_t ping_threads_num = 1;
+static size_t ping_groups_num = 1;
+static double *ping_percentile;
+static size_t ping_percentile_num;
+
+static ping_thread_t *ping_threads;
+/* Protects "ping_threads" against concurrent restarts. */
+static pthread_mutex_t ping_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *config_keys[] = {"Host",
+                                    "SourceAddress",
+                                    "AddressFamily",
 #ifdef HAVE_OPING_1_3
                                     "Device",
 #endif
-                                    "Size",    "TTL",           "Interval",
-                                    "Timeout", "MaxMissed"};
+                                    "Size",
+                                    "TTL",
+                                    "Interval",
+                                    "Timeout",
+                                    "MaxMissed",
+                                    "Threads",
+                                    "SendGroups",
+                                    "LatencyPercentile"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /*
  * Private functions
  */
-/* Assure that `ts->tv_nsec' is in the range 0 .. 999999999 */
-static void time_normalize(struct timespec *ts) /* {{{ */
-{
-  while (ts->tv_nsec < 0) {
-    if (ts->tv_sec == 0) {
-      ts->tv_nsec = 0;
-      return;
-    }
+static hostlist_t *ping_group_host(ping_group_t const *g, /* {{{ */
+                                   char const *name) {
+  for (size_t i = 0; i < g->hosts_num; i++)
+    if (strcmp(name, g->hosts[i]->host) == 0)
+      return g->hosts[i];
 
-    ts->tv_sec -= 1;
-    ts->tv_nsec += 1000000000;
-  }
-
-  while (ts->tv_nsec >= 1000000000) {
-    ts->tv_sec += 1;
-    ts->tv_nsec -= 1000000000;
-  }
-} /* }}} void time_normalize */
-
-/* Add `ts_int' to `tv_begin' and store the result in `ts_dest'. If the result
- * is larger than `tv_end', copy `tv_end' to `ts_dest' instead. */
-static void time_calc(struct timespec *ts_dest, /* {{{ */
-                      const struct timespec *ts_int,
-                      const struct timeval *tv_begin,
-                      const struct timeval *tv_end) {
-  ts_dest->tv_sec = tv_begin->tv_sec + ts_int->tv_sec;
-  ts_dest->tv_nsec = (tv_begin->tv_usec * 1000) + ts_int->tv_nsec;
-  time_normalize(ts_dest);
-
-  /* Assure that `(begin + interval) > end'.
-   * This may seem overly complicated, but `tv_sec' is of type `time_t'
-   * which may be `unsigned. *sigh* */
-  if ((tv_end->tv_sec > ts_dest->tv_sec) ||
-      ((tv_end->tv_sec == ts_dest->tv_sec) &&
-       ((tv_end->tv_usec * 1000) > ts_dest->tv_nsec))) {
-    ts_dest->tv_sec = tv_end->tv_sec;
-    ts_dest->tv_nsec = 1000 * tv_end->tv_usec;
-  }
+  return NULL;
+} /* }}} hostlist_t *ping_group_host */
 
-  time_normalize(ts_dest);
-} /* }}} void time_calc */
-
-static int ping_dispatch_all(pingobj_t *pingobj) /* {{{ */
+/* Must be called with the thread's lock held. */
+static int ping_dispatch_all(ping_group_t *g) /* {{{ */
 {
-  hostlist_t *hl;
+  pingobj_t *pingobj = g->pingobj;
   int status;
 
   for (pingobj_iter_t *iter = ping_iterator_get(pingobj); iter != NULL;
        iter = ping_iterator_next(iter)) { /* {{{ */
-    char userhost[NI_MAXHOST];
     double latency;
     size_t param_size;
 
-    param_size = sizeof(userhost);
-    status = ping_iterator_get_info(iter,
+    /* The host is looked up by name once and then remembered in the
+     * iterator's context. */
+    hostlist_t *hl = ping_iterator_get_context(iter);
+    if (hl == NULL) {
+      char userhost[NI_MAXHOST];
+
+      param_size = sizeof(userhost);
+      status = ping_iterator_get_info(iter,
 #ifdef PING_INFO_USERNAME
-                                    PING_INFO_USERNAME,
+                                      PING_INFO_USERNAME,
 #else
-                                    PING_INFO_HOSTNAME,
+                                      PING_INFO_HOSTNAME,
 #endif
-                                    userhost, &param_size);
-    if (status != 0) {
-      WARNING("ping plugin: ping_iterator_get_info failed: %s",
-              ping_get_error(pingobj));
-      continue;
-    }
-
-    for (hl = hostlist_head; hl != NULL; hl = hl->next)
-      if (strcmp(userhost, hl->host) == 0)
-        break;
+                                      userhost, &param_size);
+      if (status != 0) {
+        WARNING("ping plugin: ping_iterator_get_info failed: %s",
+                ping_get_error(pingobj));
+        continue;
+      }
 
-    if (hl == NULL) {
-      WARNING("ping plugin: Cannot find host %s.", userhost);
-      continue;
+      hl = ping_group_host(g, userhost);
+      if (hl == NULL) {
+        WARNING("ping plugin: Cannot find host %s.", userhost);
+        continue;
+      }
+      ping_iterator_set_context(iter, hl);
     }
 
     param_size = sizeof(latency);
@@ -189,6 +196,8 @@ static int ping_dispatch_all(pingobj_t *pingobj) /* {{{ */
       hl->pkg_recv++;
       hl->latency_total += latency;
       hl->latency_squared += (latency * latency);
+      /* liboping reports the latency in milliseconds. */
+      latency_histogram_add(hl->latency, DOUBLE_TO_CDTIME_T(latency / 1000.0));
 
       /* reset missed packages counter */
       hl->pkg_missed = 0;
@@ -207,40 +216,41 @@ static int ping_dispatch_all(pingobj_t *pingobj) /* {{{ */
               " triggering resolve",
               hl->host, ping_max_missed);
 
-      /* we trigger the resolv simply be removeing and adding the host to our
-       * ping object */
-      status = ping_host_remove(pingobj, hl->host);
-      if (status != 0) {
-        WARNING("ping plugin: ping_host_remove (%s) failed.", hl->host);
-      } else {
-        status = ping_host_add(pingobj, hl->host);
-        if (status != 0)
-          ERROR("ping plugin: ping_host_add (%s) failed.", hl->host);
-      }
+      /* Removing the host would invalidate the iterator, so this is done
+       * below. */
+      hl->resolve = true;
     } /* }}} ping_max_missed */
   }   /* }}} for (iter) */
 
+  for (size_t i = 0; i < g->hosts_num; i++) { /* {{{ */
+    hostlist_t *hl = g->hosts[i];
+    if (!hl->resolve)
+      continue;
+    hl->resolve = false;
+
+    /* we trigger the resolv simply be removeing and adding the host to our
+     * ping object */
+    status = ping_host_remove(pingobj, hl->host);
+    if (status != 0) {
+      WARNING("ping plugin: ping_host_remove (%s) failed.", hl->host);
+    } else {
+      status = ping_host_add(pingobj, hl->host);
+      if (status != 0)
+        ERROR("ping plugin: ping_host_add (%s) failed.", hl->host);
+    }
+  } /* }}} for (i = 0; i < g->hosts_num; i++) */
+
   return 0;
 } /* }}} int ping_dispatch_all */
 
-static void *ping_thread(void *arg) /* {{{ */
+/* Creates the liboping object of a group and adds its hosts. Returns the
+ * number of hosts that could be added. */
+static size_t ping_group_setup(ping_group_t *g) /* {{{ */
 {
-  struct timeval tv_begin;
-  struct timeval tv_end;
-  struct timespec ts_wait;
-  struct timespec ts_int;
-
-  int count;
-
-  c_complain_t complaint = C_COMPLAIN_INIT_STATIC;
-
   pingobj_t *pingobj = ping_construct();
   if (pingobj == NULL) {
     ERROR("ping plugin: ping_construct failed.");
-    pthread_mutex_lock(&ping_lock);
-    ping_thread_error = 1;
-    pthread_mutex_unlock(&ping_lock);
-    return (void *)-1;
+    return 0;
   }
 
   if (ping_af != PING_DEF_AF) {
@@ -267,8 +277,9 @@ static void *ping_thread(void *arg) /* {{{ */
     ping_setopt(pingobj, PING_OPT_DATA, (void *)ping_data);
 
   /* Add all the hosts to the ping object. */
-  count = 0;
-  for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next) {
+  size_t count = 0;
+  for (size_t i = 0; i < g->hosts_num; i++) {
+    hostlist_t *hl = g->hosts[i];
     int tmp_status;
     tmp_status = ping_host_add(pingobj, hl->host);
     if (tmp_status != 0)
@@ -278,125 +289,213 @@ static void *ping_thread(void *arg) /* {{{ */
       count++;
   }
 
+  g->pingobj = pingobj;
+  return count;
+} /* }}} size_t ping_group_setup */
+
+static void *ping_thread(void *arg) /* {{{ */
+{
+  ping_thread_t *t = arg;
+  cdtime_t interval = DOUBLE_TO_CDTIME_T(ping_interval);
+
+  c_complain_t complaint = C_COMPLAIN_INIT_STATIC;
+
+  size_t count = 0;
+  for (size_t i = 0; i < t->groups_num; i++)
+    count += ping_group_setup(t->groups + i);
+
   if (count == 0) {
     ERROR("ping plugin: No host could be added to ping object. Giving up.");
-    pthread_mutex_lock(&ping_lock);
-    ping_thread_error = 1;
-    pthread_mutex_unlock(&ping_lock);
+    pthread_mutex_lock(&t->lock);
+    t->error = 1;
+    pthread_mutex_unlock(&t->lock);
     return (void *)-1;
   }
 
-  /* Set up `ts_int' */
-  {
-    double temp_sec;
-    double temp_nsec;
+  cdtime_t begin = cdtime();
+
+  pthread_mutex_lock(&t->lock);
+  while (t->loop > 0) {
+    for (size_t i = 0; (i < t->groups_num) && (t->loop > 0); i++) { /* {{{ */
+      ping_group_t *g = t->groups + i;
+      if (g->pingobj == NULL)
+        continue;
+
+      /* Wait until it is this group's turn. */
+      struct timespec ts_wait = CDTIME_T_TO_TIMESPEC(begin + g->offset);
+      while ((t->loop > 0) && (cdtime() < begin + g->offset))
+        pthread_cond_timedwait(&t->cond, &t->lock, &ts_wait);
+      if (t->loop <= 0)
+        break;
 
-    temp_nsec = modf(ping_interval, &temp_sec);
-    ts_int.tv_sec = (time_t)temp_sec;
-    ts_int.tv_nsec = (long)(temp_nsec * 1000000000L);
+      pthread_mutex_unlock(&t->lock);
+
+      bool send_successful = false;
+      int status = ping_send(g->pingobj);
+      if (status < 0) {
+        c_complain(LOG_ERR, &complaint, "ping plugin: ping_send failed: %s",
+                   ping_get_error(g->pingobj));
+      } else {
+        c_release(LOG_NOTICE, &complaint, "ping plugin: ping_send succeeded.");
+        send_successful = true;
+      }
+
+      pthread_mutex_lock(&t->lock);
+
+      if (send_successful)
+        (void)ping_dispatch_all(g);
+    } /* }}} for (i = 0; i < t->groups_num; i++) */
+
+    begin += interval;
+    /* If sending took longer than a whole interval, skip the missed rounds
+     * rather than sending them back to back. */
+    cdtime_t now = cdtime();
+    if (begin + interval < now)
+      begin = now;
+  } /* while (t->loop > 0) */
+  pthread_mutex_unlock(&t->lock);
+
+  for (size_t i = 0; i < t->groups_num; i++) {
+    if (t->groups[i].pingobj != NULL)
+      ping_destroy(t->groups[i].pingobj);
+    t->groups[i].pingobj = NULL;
   }
 
-  pthread_mutex_lock(&ping_lock);
-  while (ping_thread_loop > 0) {
-    bool send_successful = false;
+  return (void *)0;
+} /* }}} void *ping_thread */
 
-    if (gettimeofday(&tv_begin, NULL) < 0) {
-      ERROR("ping plugin: gettimeofday failed: %s", STRERRNO);
-      ping_thread_error = 1;
-      break;
-    }
+static void ping_threads_free(void) /* {{{ */
+{
+  if (ping_threads == NULL)
+    return;
 
-    pthread_mutex_unlock(&ping_lock);
+  for (size_t i = 0; i < ping_threads_num; i++) {
+    ping_thread_t *t = ping_threads + i;
 
-    int status = ping_send(pingobj);
-    if (status < 0) {
-      c_complain(LOG_ERR, &complaint, "ping plugin: ping_send failed: %s",
-                 ping_get_error(pingobj));
-    } else {
-      c_release(LOG_NOTICE, &complaint, "ping plugin: ping_send succeeded.");
-      send_successful = true;
-    }
+    for (size_t j = 0; j < t->groups_num; j++)
+      sfree(t->groups[j].hosts);
+    sfree(t->groups);
 
-    pthread_mutex_lock(&ping_lock);
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->cond);
+  }
+  sfree(ping_threads);
+} /* }}} void ping_threads_free */
 
-    if (ping_thread_loop <= 0)
-      break;
+/* Distributes the hosts round-robin over all threads and their groups. Group
+ * "j" of thread "i" is sent at ((j * threads + i) / (threads * groups)) of the
+ * interval. */
+static int ping_threads_alloc(void) /* {{{ */
+{
+  ping_threads = calloc(ping_threads_num, sizeof(*ping_threads));
+  if (ping_threads == NULL) {
+    ERROR("ping plugin: calloc failed.");
+    return -1;
+  }
 
-    if (send_successful)
-      (void)ping_dispatch_all(pingobj);
+  size_t slots_num = ping_threads_num * ping_groups_num;
+  cdtime_t interval = DOUBLE_TO_CDTIME_T(ping_interval);
 
-    if (gettimeofday(&tv_end, NULL) < 0) {
-      ERROR("ping plugin: gettimeofday failed: %s", STRERRNO);
-      ping_thread_error = 1;
-      break;
-    }
+  for (size_t i = 0; i < ping_threads_num; i++) {
+    ping_thread_t *t = ping_threads + i;
 
-    /* Calculate the absolute time until which to wait and store it in
-     * `ts_wait'. */
-    time_calc(&ts_wait, &ts_int, &tv_begin, &tv_end);
+    pthread_mutex_init(&t->lock, /* attr = */ NULL);
+    pthread_cond_init(&t->cond, /* attr = */ NULL);
 
-    pthread_cond_timedwait(&ping_cond, &ping_lock, &ts_wait);
-    if (ping_thread_loop <= 0)
-      break;
-  } /* while (ping_thread_loop > 0) */
+    t->groups = calloc(ping_groups_num, sizeof(*t->groups));
+    if (t->groups == NULL) {
+      ERROR("ping plugin: calloc failed.");
+      ping_threads_free();
+      return -1;
+    }
+    t->groups_num = ping_groups_num;
+
+    for (size_t j = 0; j < ping_groups_num; j++) {
+      ping_group_t *g = t->groups + j;
+      size_t slot = j * ping_threads_num + i;
+
+      g->offset = (cdtime_t)((double)interval * (double)slot /
+                             (double)slots_num);
+      g->hosts = calloc(hostlist_num / slots_num + 1, sizeof(*g->hosts));
+      if (g->hosts == NULL) {
+        ERROR("ping plugin: calloc failed.");
+        ping_threads_free();
+        return -1;
+      }
+    }
+  }
 
-  pthread_mutex_unlock(&ping_lock);
-  ping_destroy(pingobj);
+  size_t n = 0;
+  for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next, n++) {
+    size_t slot = n % slots_num;
+    ping_group_t *g = ping_threads[slot % ping_threads_num].groups +
+                      (slot / ping_threads_num);
+    g->hosts[g->hosts_num] = hl;
+    g->hosts_num++;
+  }
 
-  return (void *)0;
-} /* }}} void *ping_thread */
+  return 0;
+} /* }}} int ping_threads_alloc */
 
 static int start_thread(void) /* {{{ */
 {
-  int status;
-
-  pthread_mutex_lock(&ping_lock);
+  pthread_mutex_lock(&ping_threads_lock);
 
-  if (ping_thread_loop != 0) {
-    pthread_mutex_unlock(&ping_lock);
+  if (ping_threads != NULL) {
+    pthread_mutex_unlock(&ping_threads_lock);
     return 0;
   }
 
-  ping_thread_loop = 1;
-  ping_thread_error = 0;
-  status = plugin_thread_create(&ping_thread_id, ping_thread,
-                                /* arg = */ (void *)0, "ping");
-  if (status != 0) {
-    ping_thread_loop = 0;
-    ERROR("ping plugin: Starting thread failed.");
-    pthread_mutex_unlock(&ping_lock);
+  if (ping_threads_alloc() != 0) {
+    pthread_mutex_unlock(&ping_threads_lock);
     return -1;
   }
 
-  pthread_mutex_unlock(&ping_lock);
+  for (size_t i = 0; i < ping_threads_num; i++) {
+    ping_thread_t *t = ping_threads + i;
+
+    t->loop = 1;
+    t->error = 0;
+    int status = plugin_thread_create(&t->id, ping_thread, t, "ping");
+    if (status != 0) {
+      t->loop = 0;
+      ERROR("ping plugin: Starting thread failed.");
+      /* Let ping_read() restart all threads. */
+      t->error = 1;
+    }
+  }
+
+  pthread_mutex_unlock(&ping_threads_lock);
   return 0;
 } /* }}} int start_thread */
 
 static int stop_thread(void) /* {{{ */
 {
-  int status;
+  int status = 0;
 
-  pthread_mutex_lock(&ping_lock);
+  pthread_mutex_lock(&ping_threads_lock);
 
-  if (ping_thread_loop == 0) {
-    pthread_mutex_unlock(&ping_lock);
+  if (ping_threads == NULL) {
+    pthread_mutex_unlock(&ping_threads_lock);
     return -1;
   }
 
-  ping_thread_loop = 0;
-  pthread_cond_broadcast(&ping_cond);
-  pthread_mutex_unlock(&ping_lock);
-
-  status = pthread_join(ping_thread_id, /* return = */ NULL);
-  if (status != 0) {
-    ERROR("ping plugin: Stopping thread failed.");
-    status = -1;
+  for (size_t i = 0; i < ping_threads_num; i++) {
+    ping_thread_t *t = ping_threads + i;
+    pthread_mutex_lock(&t->lock);
+    bool running = (t->loop != 0);
+    t->loop = 0;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+
+    if (running && (pthread_join(t->id, /* return = */ NULL) != 0)) {
+      ERROR("ping plugin: Stopping thread failed.");
+      status = -1;
+    }
   }
 
-  pthread_mutex_lock(&ping_lock);
-  memset(&ping_thread_id, 0, sizeof(ping_thread_id));
-  ping_thread_error = 0;
-  pthread_mutex_unlock(&ping_lock);
+  ping_threads_free();
+  pthread_mutex_unlock(&ping_threads_lock);
 
   return status;
 } /* }}} int stop_thread */
@@ -408,11 +507,18 @@ static int ping_init(void) /* {{{ */
     return -1;
   }
 
-  if (ping_timeout > ping_interval) {
-    ping_timeout = 0.9 * ping_interval;
-    WARNING("ping plugin: Timeout is greater than interval. "
+  if (ping_threads_num > hostlist_num)
+    ping_threads_num = hostlist_num;
+  if (ping_groups_num > hostlist_num / ping_threads_num)
+    ping_groups_num = hostlist_num / ping_threads_num;
+
+  /* Each group of a thread has to finish before the next one is due. */
+  double group_interval = ping_interval / (double)ping_groups_num;
+  if (ping_timeout > group_interval) {
+    ping_timeout = 0.9 * group_interval;
+    WARNING("ping plugin: Timeout is greater than interval%s. "
             "Will use a timeout of %gs.",
-            ping_timeout);
+            (ping_groups_num > 1) ? " / SendGroups" : "", ping_timeout);
   }
 
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_NET_RAW)
@@ -467,14 +573,24 @@ static int ping_config(const char *key, const char *value) /* {{{ */
       return 1;
     }
 
+    hl->latency = latency_histogram_create();
+    if (hl->latency == NULL) {
+      sfree(host);
+      sfree(hl);
+      ERROR("ping plugin: latency_histogram_create failed.");
+      return 1;
+    }
+
     hl->host = host;
     hl->pkg_sent = 0;
     hl->pkg_recv = 0;
     hl->pkg_missed = 0;
+    hl->resolve = false;
     hl->latency_total = 0.0;
     hl->latency_squared = 0.0;
     hl->next = hostlist_head;
     hostlist_head = hl;
+    hostlist_num++;
   } else if (strcasecmp(key, "AddressFamily") == 0) {
     char *af = NULL;
     int status = config_set_string(key, &af, value);
@@ -558,6 +674,34 @@ static int ping_config(const char *key, const char *value) /* {{{ */
     ping_max_missed = atoi(value);
     if (ping_max_missed < 0)
       INFO("ping plugin: MaxMissed < 0, disabled re-resolving of hosts");
+  } else if (strcasecmp(key, "Threads") == 0) {
+    int tmp = atoi(value);
+    if (tmp > 0)
+      ping_threads_num = (size_t)tmp;
+    else
+      WARNING("ping plugin: Ignoring invalid Threads %i.", tmp);
+  } else if (strcasecmp(key, "SendGroups") == 0) {
+    int tmp = atoi(value);
+    if (tmp > 0)
+      ping_groups_num = (size_t)tmp;
+    else
+      WARNING("ping plugin: Ignoring invalid SendGroups %i.", tmp);
+  } else if (strcasecmp(key, "LatencyPercentile") == 0) {
+    double percent = atof(value);
+    if ((percent <= 0.0) || (percent >= 100.0)) {
+      WARNING("ping plugin: Ignoring invalid LatencyPercentile %g.", percent);
+      return 0;
+    }
+
+    double *tmp = realloc(ping_percentile,
+                          sizeof(*ping_percentile) * (ping_percentile_num + 1));
+    if (tmp == NULL) {
+      ERROR("ping plugin: realloc failed.");
+      return 1;
+    }
+    ping_percentile = tmp;
+    ping_percentile[ping_percentile_num] = percent;
+    ping_percentile_num++;
   } else {
     return -1;
   }
@@ -578,83 +722,146 @@ static void submit(const char *host, const char *type, /* {{{ */
   plugin_dispatch_values(&vl);
 } /* }}} void ping_submit */
 
-static int ping_read(void) /* {{{ */
+static void ping_reset(hostlist_t *hl) /* {{{ */
 {
-  if (ping_thread_error != 0) {
-    ERROR("ping plugin: The ping thread had a problem. Restarting it.");
+  hl->pkg_sent = 0;
+  hl->pkg_recv = 0;
+  hl->latency_total = 0.0;
+  hl->latency_squared = 0.0;
+  latency_histogram_reset(hl->latency);
+} /* }}} void ping_reset */
+
+/* "spare" points to an empty histogram, which is swapped with the host's.
+ * On return, it points to an empty histogram again. */
+static void ping_submit_host(hostlist_t *hl, /* {{{ */
+                             pthread_mutex_t *lock,
+                             latency_histogram_t **spare) {
+  uint32_t pkg_sent;
+  uint32_t pkg_recv;
+  double latency_total;
+  double latency_squared;
 
-    stop_thread();
+  double latency_average;
+  double latency_stddev;
 
-    for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next) {
-      hl->pkg_sent = 0;
-      hl->pkg_recv = 0;
-      hl->latency_total = 0.0;
-      hl->latency_squared = 0.0;
-    }
+  double droprate;
 
-    start_thread();
+  /* Locking here works, because the structure of the linked list is only
+   * changed during configure and shutdown. The histogram is swapped with an
+   * empty one, so that percentiles are computed without holding the lock. */
+  pthread_mutex_lock(lock);
 
-    return -1;
-  } /* if (ping_thread_error != 0) */
+  pkg_sent = hl->pkg_sent;
+  pkg_recv = hl->pkg_recv;
+  latency_total = hl->latency_total;
+  latency_squared = hl->latency_squared;
 
-  for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next) /* {{{ */
-  {
-    uint32_t pkg_sent;
-    uint32_t pkg_recv;
-    double latency_total;
-    double latency_squared;
+  latency_histogram_t *latency = hl->latency;
+  hl->latency = *spare;
+  *spare = latency;
 
-    double latency_average;
-    double latency_stddev;
+  hl->pkg_sent = 0;
+  hl->pkg_recv = 0;
+  hl->latency_total = 0.0;
+  hl->latency_squared = 0.0;
 
-    double droprate;
+  pthread_mutex_unlock(lock);
 
-    /* Locking here works, because the structure of the linked list is only
-     * changed during configure and shutdown. */
-    pthread_mutex_lock(&ping_lock);
+  /* This e. g. happens when starting up. */
+  if (pkg_sent == 0) {
+    DEBUG("ping plugin: No packages for host %s have been sent.", hl->host);
+    latency_histogram_reset(latency);
+    return;
+  }
 
-    pkg_sent = hl->pkg_sent;
-    pkg_recv = hl->pkg_recv;
-    latency_total = hl->latency_total;
-    latency_squared = hl->latency_squared;
+  /* Calculate average. Beware of division by zero. */
+  if (pkg_recv == 0)
+    latency_average = NAN;
+  else
+    latency_average = latency_total / ((double)pkg_recv);
+
+  /* Calculate standard deviation. Beware even more of division by zero. */
+  if (pkg_recv == 0)
+    latency_stddev = NAN;
+  else if (pkg_recv == 1)
+    latency_stddev = 0.0;
+  else
+    latency_stddev = sqrt(((((double)pkg_recv) * latency_squared) -
+                           (latency_total * latency_total)) /
+                          ((double)(pkg_recv * (pkg_recv - 1))));
+
+  /* Calculate drop rate. */
+  droprate = ((double)(pkg_sent - pkg_recv)) / ((double)pkg_sent);
+
+  submit(hl->host, "ping", latency_average);
+  submit(hl->host, "ping_stddev", latency_stddev);
+  submit(hl->host, "ping_droprate", droprate);
+
+  if (ping_percentile_num > 0) {
+    /* Look up all percentiles in one pass over the histogram. */
+    cdtime_t percentile[ping_percentile_num];
+    latency_histogram_get_percentiles(latency, ping_percentile, percentile,
+                                      ping_percentile_num);
+
+    for (size_t i = 0; i < ping_percentile_num; i++) {
+      char type_instance[DATA_MAX_NAME_LEN];
+      ssnprintf(type_instance, sizeof(type_instance), "%s-percentile-%g",
+                hl->host, ping_percentile[i]);
+
+      /* Like the average, in milliseconds. */
+      submit(type_instance, "ping",
+             (pkg_recv == 0) ? NAN
+                             : 1000.0 * CDTIME_T_TO_DOUBLE(percentile[i]));
+    }
+  }
 
-    hl->pkg_sent = 0;
-    hl->pkg_recv = 0;
-    hl->latency_total = 0.0;
-    hl->latency_squared = 0.0;
+  latency_histogram_reset(latency);
+} /* }}} void ping_submit_host */
 
-    pthread_mutex_unlock(&ping_lock);
+static int ping_read(void) /* {{{ */
+{
+  bool error = false;
+  for (size_t i = 0; (ping_threads != NULL) && (i < ping_threads_num); i++) {
+    pthread_mutex_lock(&ping_threads[i].lock);
+    if (ping_threads[i].error != 0)
+      error = true;
+    pthread_mutex_unlock(&ping_threads[i].lock);
+  }
 
-    /* This e. g. happens when starting up. */
-    if (pkg_sent == 0) {
-      DEBUG("ping plugin: No packages for host %s have been sent.", hl->host);
-      continue;
-    }
+  if (error) {
+    ERROR("ping plugin: The ping thread had a problem. Restarting it.");
 
-    /* Calculate average. Beware of division by zero. */
-    if (pkg_recv == 0)
-      latency_average = NAN;
-    else
-      latency_average = latency_total / ((double)pkg_recv);
+    stop_thread();
 
-    /* Calculate standard deviation. Beware even more of division by zero. */
-    if (pkg_recv == 0)
-      latency_stddev = NAN;
-    else if (pkg_recv == 1)
-      latency_stddev = 0.0;
-    else
-      latency_stddev = sqrt(((((double)pkg_recv) * latency_squared) -
-                             (latency_total * latency_total)) /
-                            ((double)(pkg_recv * (pkg_recv - 1))));
+    for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next)
+      ping_reset(hl);
+
+    start_thread();
+
+    return -1;
+  } /* if (error) */
+
+  if (ping_threads == NULL)
+    return -1;
+
+  latency_histogram_t *latency = latency_histogram_create();
+  if (latency == NULL) {
+    ERROR("ping plugin: latency_histogram_create failed.");
+    return -1;
+  }
 
-    /* Calculate drop rate. */
-    droprate = ((double)(pkg_sent - pkg_recv)) / ((double)pkg_sent);
+  for (size_t i = 0; i < ping_threads_num; i++) { /* {{{ */
+    ping_thread_t *t = ping_threads + i;
 
-    submit(hl->host, "ping", latency_average);
-    submit(hl->host, "ping_stddev", latency_stddev);
-    submit(hl->host, "ping_droprate", droprate);
-  } /* }}} for (hl = hostlist_head; hl != NULL; hl = hl->next) */
+    for (size_t j = 0; j < t->groups_num; j++) {
+      ping_group_t *g = t->groups + j;
 
+      for (size_t k = 0; k < g->hosts_num; k++)
+        ping_submit_host(g->hosts[k], &t->lock, &latency);
+    }
+  } /* }}} for (i = 0; i < ping_threads_num; i++) */
+
+  latency_histogram_destroy(latency);
   return 0;
 } /* }}} int ping_read */
 
@@ -673,16 +880,23 @@ static int ping_shutdown(void) /* {{{ */
     hl_next = hl->next;
 
     sfree(hl->host);
+    latency_histogram_destroy(hl->latency);
     sfree(hl);
 
     hl = hl_next;
   }
 
+  hostlist_head = NULL;
+  hostlist_num = 0;
+
   if (ping_data != NULL) {
     free(ping_data);
     ping_data = NULL;
   }
 
+  sfree(ping_percentile);
+  ping_percentile_num = 0;
+
   return 0;
 } /* }}} int ping_shutdown */
 
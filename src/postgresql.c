@@ -40,6 +40,7 @@
 #include "utils_cache.h"
 #include "utils_complain.h"
 
+#include <arpa/inet.h>
 #include <libpq-fe.h>
 #include <pg_config_manual.h>
 
@@ -52,6 +53,10 @@
 #define C_PSQL_DEFAULT_CONF PKGDATADIR "/postgresql_default.conf"
 #endif
 
+/* Defaults of COPY writers. */
+#define C_PSQL_COPY_BUFFER_SIZE (1024 * 1024)
+#define C_PSQL_COPY_FLUSH_INTERVAL TIME_T_TO_CDTIME_T_STATIC(10)
+
 /* Appends the (parameter, value) pair to the string
  * pointed to by 'buf' suitable to be used as argument
  * for PQconnectdb(). If value equals NULL, the pair
@@ -103,8 +108,27 @@ typedef struct {
   char *name;
   char *statement;
   bool store_rates;
+
+  /* COPY writers stream one row per data source into "table" instead of
+   * executing "statement". */
+  char *table;
+  size_t buffer_size;
+  cdtime_t flush_interval;
 } c_psql_writer_t;
 
+/* Per-connection state of a writer. */
+typedef struct {
+  /* Statement writers: "statement" has been prepared on the current
+   * connection. */
+  bool prepared;
+
+  /* COPY writers: rows in binary COPY format, without header and trailer. */
+  char *buffer;
+  size_t buffer_fill;
+  size_t rows_num;
+  cdtime_t first_row;
+} c_psql_writer_state_t;
+
 typedef struct {
   PGconn *conn;
   c_complain_t conn_complaint;
@@ -120,11 +144,15 @@ typedef struct {
   size_t queries_num;
 
   c_psql_writer_t **writers;
+  c_psql_writer_state_t *writer_states;
   size_t writers_num;
 
   /* make sure we don't access the database object in parallel */
   pthread_mutex_t db_lock;
 
+  /* send all queries in one round-trip */
+  bool pipeline;
+
   /* writer "caching" settings */
   cdtime_t commit_interval;
   cdtime_t next_commit;
@@ -196,6 +224,246 @@ static int c_psql_commit(c_psql_database_t *db) {
   return status;
 } /* c_psql_commit */
 
+/* Binary COPY format, see the "COPY" chapter of the PostgreSQL manual. */
+#define C_PSQL_COPY_COLUMNS                                                    \
+  "time, host, plugin, plugin_instance, type, type_instance, dsname, dstype, " \
+  "value"
+#define C_PSQL_COPY_COLUMNS_NUM 9
+/* Signature, flags and header extension length. */
+static const char c_psql_copy_header[] = "PGCOPY\n\377\r\n\0"
+                                         "\0\0\0\0"
+                                         "\0\0\0\0";
+/* A field count of -1 marks the end of the data. */
+static const char c_psql_copy_trailer[] = "\377\377";
+
+/* Seconds between the Unix epoch and the PostgreSQL epoch (2000-01-01). */
+#define C_PSQL_EPOCH_OFFSET 946684800
+
+/* Sends the rows buffered for the COPY writer "idx" to the server. The
+ * buffer is emptied, even if that fails. You must hold "db->db_lock" and have
+ * checked the connection when calling this function. */
+static int c_psql_copy_flush(c_psql_database_t *db, size_t idx) {
+  c_psql_writer_t *writer = db->writers[idx];
+  c_psql_writer_state_t *state = db->writer_states + idx;
+  char query[1024];
+  int status = 0;
+
+  if (state->rows_num == 0)
+    return 0;
+
+  ssnprintf(query, sizeof(query),
+            "COPY %s (" C_PSQL_COPY_COLUMNS ") FROM STDIN (FORMAT binary)",
+            writer->table);
+
+  PGresult *res = PQexec(db->conn, query);
+  if (PQresultStatus(res) != PGRES_COPY_IN) {
+    log_err("Writer \"%s\": Failed to start COPY: %s", writer->name,
+            PQerrorMessage(db->conn));
+    PQclear(res);
+    status = -1;
+  } else {
+    PQclear(res);
+
+    if ((PQputCopyData(db->conn, c_psql_copy_header,
+                       sizeof(c_psql_copy_header) - 1) != 1) ||
+        (PQputCopyData(db->conn, state->buffer, (int)state->buffer_fill) !=
+         1) ||
+        (PQputCopyData(db->conn, c_psql_copy_trailer,
+                       sizeof(c_psql_copy_trailer) - 1) != 1) ||
+        (PQputCopyEnd(db->conn, /* errormsg = */ NULL) != 1)) {
+      log_err("Writer \"%s\": Failed to send COPY data: %s", writer->name,
+              PQerrorMessage(db->conn));
+      status = -1;
+    }
+
+    /* Collect the results, also after errors, to get the connection out of
+     * the COPY state. */
+    while ((res = PQgetResult(db->conn)) != NULL) {
+      if ((status == 0) && (PQresultStatus(res) != PGRES_COMMAND_OK)) {
+        log_err("Writer \"%s\": COPY failed: %s", writer->name,
+                PQerrorMessage(db->conn));
+        status = -1;
+      }
+      PQclear(res);
+    }
+  }
+
+  if (status != 0) {
+    log_warn("Writer \"%s\": Dropping %" PRIsz " rows.", writer->name,
+             state->rows_num);
+    /* this will abort any current transaction -> restart */
+    if (db->next_commit > 0)
+      c_psql_commit(db);
+  } else {
+    log_debug("Writer \"%s\": Copied %" PRIsz " rows.", writer->name,
+              state->rows_num);
+  }
+
+  state->buffer_fill = 0;
+  state->rows_num = 0;
+  state->first_row = 0;
+  return status;
+} /* c_psql_copy_flush */
+
+static void c_psql_copy_put(char **ptr, const void *data, size_t len) {
+  memcpy(*ptr, data, len);
+  *ptr += len;
+} /* c_psql_copy_put */
+
+static void c_psql_copy_put_int16(char **ptr, int16_t v) {
+  uint16_t tmp = htons((uint16_t)v);
+  c_psql_copy_put(ptr, &tmp, sizeof(tmp));
+} /* c_psql_copy_put_int16 */
+
+static void c_psql_copy_put_int32(char **ptr, int32_t v) {
+  uint32_t tmp = htonl((uint32_t)v);
+  c_psql_copy_put(ptr, &tmp, sizeof(tmp));
+} /* c_psql_copy_put_int32 */
+
+static void c_psql_copy_put_int64(char **ptr, int64_t v) {
+  uint64_t tmp = htonll((uint64_t)v);
+  c_psql_copy_put(ptr, &tmp, sizeof(tmp));
+} /* c_psql_copy_put_int64 */
+
+/* Empty strings are stored as NULL, like the statement writers do. */
+static void c_psql_copy_put_text(char **ptr, const char *str) {
+  size_t len = strlen(str);
+
+  if (len == 0) {
+    c_psql_copy_put_int32(ptr, -1);
+    return;
+  }
+  c_psql_copy_put_int32(ptr, (int32_t)len);
+  c_psql_copy_put(ptr, str, len);
+} /* c_psql_copy_put_text */
+
+static void c_psql_copy_put_float8(char **ptr, double v) {
+  uint64_t tmp;
+
+  memcpy(&tmp, &v, sizeof(tmp));
+  c_psql_copy_put_int32(ptr, (int32_t)sizeof(tmp));
+  c_psql_copy_put_int64(ptr, (int64_t)tmp);
+} /* c_psql_copy_put_float8 */
+
+/* Appends one row per data source of "vl" to the buffer of the COPY writer
+ * "idx", flushing it first if the rows do not fit. You must hold
+ * "db->db_lock" when calling this function. */
+static int c_psql_copy_add(c_psql_database_t *db, size_t idx,
+                           const data_set_t *ds, const value_list_t *vl) {
+  c_psql_writer_t *writer = db->writers[idx];
+  c_psql_writer_state_t *state = db->writer_states + idx;
+
+  size_t ident_len = strlen(vl->host) + strlen(vl->plugin) +
+                     strlen(vl->plugin_instance) + strlen(vl->type) +
+                     strlen(vl->type_instance);
+  size_t need = 0;
+  for (size_t i = 0; i < ds->ds_num; i++)
+    need += sizeof(int16_t) + C_PSQL_COPY_COLUMNS_NUM * sizeof(int32_t) +
+            sizeof(int64_t) /* time */ + ident_len + strlen(ds->ds[i].name) +
+            strlen("absolute") + sizeof(double);
+
+  if (need > writer->buffer_size) {
+    log_err("Writer \"%s\": A value list of type \"%s\" needs %" PRIsz
+            " bytes, which exceeds the BufferSize of %" PRIsz " bytes.",
+            writer->name, vl->type, need, writer->buffer_size);
+    return -1;
+  }
+
+  if (state->buffer == NULL) {
+    state->buffer = malloc(writer->buffer_size);
+    if (state->buffer == NULL) {
+      log_err("Out of memory.");
+      return -1;
+    }
+  }
+
+  if (state->buffer_fill + need > writer->buffer_size)
+    c_psql_copy_flush(db, idx);
+
+  gauge_t *rates = NULL;
+  if (writer->store_rates) {
+    for (size_t i = 0; i < ds->ds_num; i++) {
+      if (ds->ds[i].type == DS_TYPE_GAUGE)
+        continue;
+      rates = uc_get_rate(ds, vl);
+      if (rates == NULL) {
+        log_err("c_psql_write: Failed to determine rate");
+        return -1;
+      }
+      break;
+    }
+  }
+
+  int64_t time_us = (int64_t)CDTIME_T_TO_US(vl->time) -
+                    ((int64_t)C_PSQL_EPOCH_OFFSET) * 1000000;
+  char *ptr = state->buffer + state->buffer_fill;
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    double value;
+    const char *type = "gauge";
+
+    if (ds->ds[i].type == DS_TYPE_GAUGE)
+      value = vl->values[i].gauge;
+    else if (rates != NULL)
+      value = rates[i];
+    else {
+      type = DS_TYPE_TO_STRING(ds->ds[i].type);
+      if (ds->ds[i].type == DS_TYPE_COUNTER)
+        value = (double)vl->values[i].counter;
+      else if (ds->ds[i].type == DS_TYPE_DERIVE)
+        value = (double)vl->values[i].derive;
+      else
+        value = (double)vl->values[i].absolute;
+    }
+
+    c_psql_copy_put_int16(&ptr, C_PSQL_COPY_COLUMNS_NUM);
+    c_psql_copy_put_int32(&ptr, (int32_t)sizeof(time_us));
+    c_psql_copy_put_int64(&ptr, time_us);
+    c_psql_copy_put_text(&ptr, vl->host);
+    c_psql_copy_put_text(&ptr, vl->plugin);
+    c_psql_copy_put_text(&ptr, vl->plugin_instance);
+    c_psql_copy_put_text(&ptr, vl->type);
+    c_psql_copy_put_text(&ptr, vl->type_instance);
+    c_psql_copy_put_text(&ptr, ds->ds[i].name);
+    c_psql_copy_put_text(&ptr, type);
+    c_psql_copy_put_float8(&ptr, value);
+  }
+  sfree(rates);
+
+  if (state->rows_num == 0)
+    state->first_row = cdtime();
+  state->buffer_fill = (size_t)(ptr - state->buffer);
+  state->rows_num += ds->ds_num;
+
+  if ((cdtime() - state->first_row) >= writer->flush_interval)
+    return c_psql_copy_flush(db, idx);
+  return 0;
+} /* c_psql_copy_add */
+
+/* Executes the statement of writer "idx", preparing it first if this has not
+ * been done on the current connection yet. */
+static PGresult *c_psql_exec_writer(c_psql_database_t *db, size_t idx,
+                                    const char *const *params,
+                                    int params_num) {
+  c_psql_writer_state_t *state = db->writer_states + idx;
+  char name[64];
+
+  ssnprintf(name, sizeof(name), "collectd_writer_%" PRIsz, idx);
+
+  if (!state->prepared) {
+    PGresult *res = PQprepare(db->conn, name, db->writers[idx]->statement,
+                              params_num, /* param types = */ NULL);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+      return res;
+    PQclear(res);
+    state->prepared = true;
+  }
+
+  return PQexecPrepared(db->conn, name, params_num, params,
+                        /* param lengths = */ NULL, /* param formats = */ NULL,
+                        /* return text data */ 0);
+} /* c_psql_exec_writer */
+
 static c_psql_database_t *c_psql_database_new(const char *name) {
   c_psql_database_t **tmp;
   c_psql_database_t *db;
@@ -231,10 +499,13 @@ static c_psql_database_t *c_psql_database_new(const char *name) {
   db->queries_num = 0;
 
   db->writers = NULL;
+  db->writer_states = NULL;
   db->writers_num = 0;
 
   pthread_mutex_init(&db->db_lock, /* attrs = */ NULL);
 
+  db->pipeline = false;
+
   db->commit_interval = 0;
   db->next_commit = 0;
   db->expire_delay = 0;
@@ -270,6 +541,13 @@ static void c_psql_database_delete(void *data) {
   /* wait for the lock to be released by the last writer */
   pthread_mutex_lock(&db->db_lock);
 
+  for (size_t i = 0; i < db->writers_num; ++i) {
+    if ((db->writer_states[i].rows_num > 0) && (db->conn != NULL) &&
+        (PQstatus(db->conn) == CONNECTION_OK))
+      c_psql_copy_flush(db, i);
+    sfree(db->writer_states[i].buffer);
+  }
+
   if (db->next_commit > 0)
     c_psql_commit(db);
 
@@ -285,6 +563,7 @@ static void c_psql_database_delete(void *data) {
   db->queries_num = 0;
 
   sfree(db->writers);
+  sfree(db->writer_states);
   db->writers_num = 0;
 
   pthread_mutex_unlock(&db->db_lock);
@@ -371,6 +650,10 @@ static int c_psql_check_connection(c_psql_database_t *db) {
     }
 
     db->proto_version = PQprotocolVersion(db->conn);
+
+    /* prepared statements do not survive the session */
+    for (size_t i = 0; i < db->writers_num; ++i)
+      db->writer_states[i].prepared = false;
   }
 
   db->server_version = PQserverVersion(db->conn);
@@ -403,16 +686,11 @@ static PGresult *c_psql_exec_query_noparams(c_psql_database_t *db,
   return PQexec(db->conn, udb_query_get_statement(q));
 } /* c_psql_exec_query_noparams */
 
-static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
-                                          c_psql_user_data_t *data) {
-  const char *params[db->max_params_num];
-  char interval[64];
-
-  if ((data == NULL) || (data->params_num == 0))
-    return c_psql_exec_query_noparams(db, q);
-
-  assert(db->max_params_num >= data->params_num);
-
+/* Fills "params" with the values of the parameters of a query. "interval" is
+ * used as storage for the interval parameter and must be at least 64 bytes
+ * large. */
+static void c_psql_query_params(c_psql_database_t *db, c_psql_user_data_t *data,
+                                const char **params, char *interval) {
   for (int i = 0; i < data->params_num; ++i) {
     switch (data->params[i]) {
     case C_PSQL_PARAM_HOST:
@@ -426,7 +704,7 @@ static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
       params[i] = db->user;
       break;
     case C_PSQL_PARAM_INTERVAL:
-      ssnprintf(interval, sizeof(interval), "%.3f",
+      ssnprintf(interval, 64, "%.3f",
                 CDTIME_T_TO_DOUBLE(plugin_get_interval()));
       params[i] = interval;
       break;
@@ -437,18 +715,28 @@ static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
       assert(0);
     }
   }
+} /* c_psql_query_params */
+
+static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
+                                          c_psql_user_data_t *data) {
+  const char *params[db->max_params_num];
+  char interval[64];
+
+  if ((data == NULL) || (data->params_num == 0))
+    return c_psql_exec_query_noparams(db, q);
+
+  assert(db->max_params_num >= data->params_num);
+
+  c_psql_query_params(db, data, params, interval);
 
   return PQexecParams(db->conn, udb_query_get_statement(q), data->params_num,
                       NULL, (const char *const *)params, NULL, NULL, 0);
 } /* c_psql_exec_query_params */
 
-/* db->db_lock must be locked when calling this function */
-static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
-                             udb_query_preparation_area_t *prep_area) {
-  PGresult *res;
-
-  c_psql_user_data_t *data;
-
+/* Dispatches the rows of "res", which is cleared. */
+static int c_psql_handle_result(c_psql_database_t *db, udb_query_t *q,
+                                udb_query_preparation_area_t *prep_area,
+                                PGresult *res) {
   const char *host;
 
   char **column_names;
@@ -458,51 +746,13 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
   int rows_num;
   int status;
 
-  /* The user data may hold parameter information, but may be NULL. */
-  data = udb_query_get_user_data(q);
-
-  /* Versions up to `3' don't know how to handle parameters. */
-  if (3 <= db->proto_version)
-    res = c_psql_exec_query_params(db, q, data);
-  else if ((NULL == data) || (0 == data->params_num))
-    res = c_psql_exec_query_noparams(db, q);
-  else {
-    log_err("Connection to database \"%s\" (%s) does not support "
-            "parameters (protocol version %d) - "
-            "cannot execute query \"%s\".",
-            db->database, db->instance, db->proto_version,
-            udb_query_get_name(q));
-    return -1;
-  }
-
-  /* give c_psql_write() a chance to acquire the lock if called recursively
-   * through dispatch_values(); this will happen if, both, queries and
-   * writers are configured for a single connection */
-  pthread_mutex_unlock(&db->db_lock);
-
   column_names = NULL;
   column_values = NULL;
 
-  if (PGRES_TUPLES_OK != PQresultStatus(res)) {
-    pthread_mutex_lock(&db->db_lock);
-
-    if ((CONNECTION_OK != PQstatus(db->conn)) &&
-        (0 == c_psql_check_connection(db))) {
-      PQclear(res);
-      return c_psql_exec_query(db, q, prep_area);
-    }
-
-    log_err("Failed to execute SQL query: %s", PQerrorMessage(db->conn));
-    log_info("SQL query was: %s", udb_query_get_statement(q));
-    PQclear(res);
-    return -1;
-  }
-
 #define BAIL_OUT(status)                                                       \
   sfree(column_names);                                                         \
   sfree(column_values);                                                        \
   PQclear(res);                                                                \
-  pthread_mutex_lock(&db->db_lock);                                            \
   return status
 
   rows_num = PQntuples(res);
@@ -576,8 +826,156 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
 
   BAIL_OUT(0);
 #undef BAIL_OUT
+} /* c_psql_handle_result */
+
+/* db->db_lock must be locked when calling this function */
+static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
+                             udb_query_preparation_area_t *prep_area) {
+  PGresult *res;
+
+  c_psql_user_data_t *data;
+
+  int status;
+
+  /* The user data may hold parameter information, but may be NULL. */
+  data = udb_query_get_user_data(q);
+
+  /* Versions up to `3' don't know how to handle parameters. */
+  if (3 <= db->proto_version)
+    res = c_psql_exec_query_params(db, q, data);
+  else if ((NULL == data) || (0 == data->params_num))
+    res = c_psql_exec_query_noparams(db, q);
+  else {
+    log_err("Connection to database \"%s\" (%s) does not support "
+            "parameters (protocol version %d) - "
+            "cannot execute query \"%s\".",
+            db->database, db->instance, db->proto_version,
+            udb_query_get_name(q));
+    return -1;
+  }
+
+  /* give c_psql_write() a chance to acquire the lock if called recursively
+   * through dispatch_values(); this will happen if, both, queries and
+   * writers are configured for a single connection */
+  pthread_mutex_unlock(&db->db_lock);
+
+  if (PGRES_TUPLES_OK != PQresultStatus(res)) {
+    pthread_mutex_lock(&db->db_lock);
+
+    if ((CONNECTION_OK != PQstatus(db->conn)) &&
+        (0 == c_psql_check_connection(db))) {
+      PQclear(res);
+      return c_psql_exec_query(db, q, prep_area);
+    }
+
+    log_err("Failed to execute SQL query: %s", PQerrorMessage(db->conn));
+    log_info("SQL query was: %s", udb_query_get_statement(q));
+    PQclear(res);
+    return -1;
+  }
+
+  status = c_psql_handle_result(db, q, prep_area, res);
+
+  pthread_mutex_lock(&db->db_lock);
+  return status;
 } /* c_psql_exec_query */
 
+#ifdef LIBPQ_HAS_PIPELINING
+/* Sends all queries of "db" at once using the pipeline mode of libpq, so that
+ * the queries cost a single round-trip instead of one each. Every query is
+ * followed by a sync, so that a failing query does not abort the others.
+ * db->db_lock must be locked when calling this function */
+static int c_psql_read_pipeline(c_psql_database_t *db) {
+  PGresult *results[db->queries_num];
+  const char *params[db->max_params_num > 0 ? db->max_params_num : 1];
+  char interval[64];
+  int success = 0;
+
+  memset(results, 0, sizeof(results));
+
+  if (PQenterPipelineMode(db->conn) != 1) {
+    log_err("Failed to enter pipeline mode: %s", PQerrorMessage(db->conn));
+    return -1;
+  }
+
+  bool sent[db->queries_num];
+  size_t sent_num = 0;
+  for (size_t i = 0; i < db->queries_num; ++i) {
+    udb_query_t *q = db->queries[i];
+    c_psql_user_data_t *data = udb_query_get_user_data(q);
+    int params_num = (data != NULL) ? data->params_num : 0;
+
+    sent[i] = false;
+    if ((0 != db->server_version) &&
+        (udb_query_check_version(q, db->server_version) <= 0))
+      continue;
+
+    if (params_num > 0)
+      c_psql_query_params(db, data, params, interval);
+
+    if ((PQsendQueryParams(db->conn, udb_query_get_statement(q), params_num,
+                           NULL, (const char *const *)params, NULL, NULL,
+                           /* return text data */ 0) != 1) ||
+        (PQpipelineSync(db->conn) != 1)) {
+      log_err("Failed to send SQL query \"%s\": %s", udb_query_get_name(q),
+              PQerrorMessage(db->conn));
+      break;
+    }
+    sent[i] = true;
+    ++sent_num;
+  }
+
+  /* Each query yields its result, NULL and a PGRES_PIPELINE_SYNC result. */
+  for (size_t i = 0; (i < db->queries_num) && (sent_num > 0); ++i) {
+    PGresult *res;
+
+    if (!sent[i])
+      continue;
+    --sent_num;
+
+    results[i] = PQgetResult(db->conn);
+    if (results[i] == NULL)
+      break;
+    while ((res = PQgetResult(db->conn)) != NULL)
+      PQclear(res);
+
+    res = PQgetResult(db->conn);
+    if (PQresultStatus(res) != PGRES_PIPELINE_SYNC)
+      log_warn("Unexpected result in pipeline: %s", PQerrorMessage(db->conn));
+    PQclear(res);
+  }
+
+  if (PQexitPipelineMode(db->conn) != 1)
+    log_warn("Failed to exit pipeline mode: %s", PQerrorMessage(db->conn));
+
+  /* see c_psql_exec_query() */
+  pthread_mutex_unlock(&db->db_lock);
+
+  for (size_t i = 0; i < db->queries_num; ++i) {
+    if (results[i] == NULL)
+      continue;
+
+    if (PQresultStatus(results[i]) != PGRES_TUPLES_OK) {
+      log_err("Failed to execute SQL query \"%s\": %s",
+              udb_query_get_name(db->queries[i]),
+              PQresultErrorMessage(results[i]));
+      PQclear(results[i]);
+      continue;
+    }
+
+    if (c_psql_handle_result(db, db->queries[i], db->q_prep_areas[i],
+                             results[i]) == 0)
+      success = 1;
+  }
+
+  pthread_mutex_lock(&db->db_lock);
+
+  if (!success)
+    return -1;
+  return 0;
+} /* c_psql_read_pipeline */
+#endif /* LIBPQ_HAS_PIPELINING */
+
 static int c_psql_read(user_data_t *ud) {
   c_psql_database_t *db;
 
@@ -601,6 +999,14 @@ static int c_psql_read(user_data_t *ud) {
     return -1;
   }
 
+#ifdef LIBPQ_HAS_PIPELINING
+  if (db->pipeline && (3 <= db->proto_version)) {
+    int status = c_psql_read_pipeline(db);
+    pthread_mutex_unlock(&db->db_lock);
+    return status;
+  }
+#endif
+
   for (size_t i = 0; i < db->queries_num; ++i) {
     udb_query_preparation_area_t *prep_area;
     udb_query_t *q;
@@ -838,6 +1244,15 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
 
     writer = db->writers[i];
 
+    if (writer->table != NULL) {
+      if (c_psql_copy_add(db, i, ds, vl) != 0) {
+        pthread_mutex_unlock(&db->db_lock);
+        return -1;
+      }
+      success = 1;
+      continue;
+    }
+
     if (values_type_to_sqlarray(ds, values_type_str, sizeof(values_type_str),
                                 writer->store_rates) == NULL) {
       pthread_mutex_unlock(&db->db_lock);
@@ -853,9 +1268,7 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
     params[7] = values_type_str;
     params[8] = values_str;
 
-    res = PQexecParams(db->conn, writer->statement, STATIC_ARRAY_SIZE(params),
-                       NULL, (const char *const *)params, NULL, NULL,
-                       /* return text data */ 0);
+    res = c_psql_exec_writer(db, i, params, STATIC_ARRAY_SIZE(params));
 
     if ((PGRES_COMMAND_OK != PQresultStatus(res)) &&
         (PGRES_TUPLES_OK != PQresultStatus(res))) {
@@ -864,9 +1277,7 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
       if ((CONNECTION_OK != PQstatus(db->conn)) &&
           (0 == c_psql_check_connection(db))) {
         /* try again */
-        res = PQexecParams(
-            db->conn, writer->statement, STATIC_ARRAY_SIZE(params), NULL,
-            (const char *const *)params, NULL, NULL, /* return text data */ 0);
+        res = c_psql_exec_writer(db, i, params, STATIC_ARRAY_SIZE(params));
 
         if ((PGRES_COMMAND_OK == PQresultStatus(res)) ||
             (PGRES_TUPLES_OK == PQresultStatus(res))) {
@@ -921,11 +1332,25 @@ static int c_psql_flush(cdtime_t timeout,
   for (size_t i = 0; i < dbs_num; ++i) {
     c_psql_database_t *db = dbs[i];
 
+    pthread_mutex_lock(&db->db_lock);
+
+    /* send buffered COPY rows which are older than "timeout" */
+    for (size_t j = 0; j < db->writers_num; ++j) {
+      c_psql_writer_state_t *state = db->writer_states + j;
+      if ((state->rows_num == 0) ||
+          ((timeout > 0) && ((cdtime() - state->first_row) < timeout)))
+        continue;
+      if (c_psql_check_connection(db) == 0)
+        c_psql_copy_flush(db, j);
+    }
+
     /* don't commit if the timeout is larger than the regular commit
      * interval as in that case all requested data has already been
      * committed */
     if ((db->next_commit > 0) && (db->commit_interval > timeout))
       c_psql_commit(db);
+
+    pthread_mutex_unlock(&db->db_lock);
   }
   return 0;
 } /* c_psql_flush */
@@ -1093,6 +1518,9 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
   writer->name = sstrdup(ci->values[0].value.string);
   writer->statement = NULL;
   writer->store_rates = true;
+  writer->table = NULL;
+  writer->buffer_size = C_PSQL_COPY_BUFFER_SIZE;
+  writer->flush_interval = C_PSQL_COPY_FLUSH_INTERVAL;
 
   for (int i = 0; i < ci->children_num; ++i) {
     oconfig_item_t *c = ci->children + i;
@@ -1101,12 +1529,38 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
       status = cf_util_get_string(c, &writer->statement);
     else if (strcasecmp("StoreRates", c->key) == 0)
       status = cf_util_get_boolean(c, &writer->store_rates);
+    else if (strcasecmp("Table", c->key) == 0)
+      status = cf_util_get_string(c, &writer->table);
+    else if (strcasecmp("BufferSize", c->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(c, &tmp);
+      if ((status == 0) && (tmp < 1024)) {
+        log_err("Writer \"%s\": BufferSize must be at least 1024.",
+                writer->name);
+        status = -1;
+      }
+      if (status == 0)
+        writer->buffer_size = (size_t)tmp;
+    } else if (strcasecmp("FlushInterval", c->key) == 0)
+      status = cf_util_get_cdtime(c, &writer->flush_interval);
     else
       log_warn("Ignoring unknown config key \"%s\".", c->key);
+
+    if (status != 0)
+      break;
+  }
+
+  if ((status == 0) &&
+      ((writer->statement == NULL) == (writer->table == NULL))) {
+    log_err("Writer \"%s\": Exactly one of \"Statement\" and \"Table\" "
+            "has to be given.",
+            writer->name);
+    status = -1;
   }
 
   if (status != 0) {
     sfree(writer->statement);
+    sfree(writer->table);
     sfree(writer->name);
     return status;
   }
@@ -1115,10 +1569,121 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
   return 0;
 } /* c_psql_config_writer */
 
+/* Creates a database with the connection settings of "src" but without any
+ * queries or writers. */
+static c_psql_database_t *c_psql_database_clone(const c_psql_database_t *src) {
+  c_psql_database_t *db = c_psql_database_new(src->database);
+  if (db == NULL)
+    return NULL;
+
+  sfree(db->instance);
+  db->instance = sstrdup(src->instance);
+  db->host = sstrdup(src->host);
+  db->port = sstrdup(src->port);
+  db->user = sstrdup(src->user);
+  db->password = sstrdup(src->password);
+  db->plugin_name = sstrdup(src->plugin_name);
+  db->sslmode = sstrdup(src->sslmode);
+  db->krbsrvname = sstrdup(src->krbsrvname);
+  db->service = sstrdup(src->service);
+  db->pipeline = src->pipeline;
+
+  return db;
+} /* c_psql_database_clone */
+
+/* Moves every "num"th query of "src", starting at "offset", to "dst". */
+static int c_psql_database_move_queries(c_psql_database_t *dst,
+                                        c_psql_database_t *src, size_t offset,
+                                        size_t num) {
+  size_t src_num = 0;
+
+  for (size_t i = 0; i < src->queries_num; ++i) {
+    if ((i % num) != offset) {
+      src->queries[src_num++] = src->queries[i];
+      continue;
+    }
+
+    udb_query_t **tmp =
+        realloc(dst->queries, (dst->queries_num + 1) * sizeof(*dst->queries));
+    if (tmp == NULL) {
+      log_err("Out of memory.");
+      return -1;
+    }
+    dst->queries = tmp;
+    dst->queries[dst->queries_num++] = src->queries[i];
+  }
+
+  src->queries_num = src_num;
+  return 0;
+} /* c_psql_database_move_queries */
+
+static int c_psql_database_prepare_queries(c_psql_database_t *db) {
+  if (db->queries_num > 0) {
+    db->q_prep_areas = calloc(db->queries_num, sizeof(*db->q_prep_areas));
+    if (db->q_prep_areas == NULL) {
+      log_err("Out of memory.");
+      return -1;
+    }
+  }
+
+  for (int i = 0; (size_t)i < db->queries_num; ++i) {
+    c_psql_user_data_t *data;
+    data = udb_query_get_user_data(db->queries[i]);
+    if ((data != NULL) && (data->params_num > db->max_params_num))
+      db->max_params_num = data->params_num;
+
+    db->q_prep_areas[i] = udb_query_allocate_preparation_area(db->queries[i]);
+
+    if (db->q_prep_areas[i] == NULL) {
+      log_err("Out of memory.");
+      return -1;
+    }
+  }
+
+  return 0;
+} /* c_psql_database_prepare_queries */
+
+/* Spreads the queries of "db" over "connections" databases with their own
+ * connection and read callback, so that the queries are executed in
+ * parallel by the read threads. */
+static int c_psql_database_split(c_psql_database_t *db, size_t connections,
+                                 cdtime_t interval) {
+  if (connections > db->queries_num)
+    connections = db->queries_num;
+
+  for (size_t i = 1; i < connections; ++i) {
+    char cb_name[DATA_MAX_NAME_LEN];
+
+    c_psql_database_t *clone = c_psql_database_clone(db);
+    if (clone == NULL)
+      return -1;
+
+    /* The queries are taken from "db", which keeps every "connections"th
+     * query, so the offset shifts down with every clone. */
+    if ((c_psql_database_move_queries(clone, db, 1, connections - i + 1) !=
+         0) ||
+        (c_psql_database_prepare_queries(clone) != 0)) {
+      c_psql_database_delete(clone);
+      return -1;
+    }
+
+    ssnprintf(cb_name, sizeof(cb_name), "postgresql-%s-%" PRIsz, clone->instance,
+              i);
+
+    ++clone->ref_cnt;
+    plugin_register_complex_read(
+        "postgresql", cb_name, c_psql_read, interval,
+        &(user_data_t){.data = clone, .free_func = c_psql_database_delete});
+  }
+
+  return 0;
+} /* c_psql_database_split */
+
 static int c_psql_config_database(oconfig_item_t *ci) {
   c_psql_database_t *db;
 
   cdtime_t interval = 0;
+  int connections = 1;
   char cb_name[DATA_MAX_NAME_LEN];
   static bool have_flush;
 
@@ -1164,6 +1729,10 @@ static int c_psql_config_database(oconfig_item_t *ci) {
       cf_util_get_cdtime(c, &db->commit_interval);
     else if (strcasecmp("ExpireDelay", c->key) == 0)
       cf_util_get_cdtime(c, &db->expire_delay);
+    else if (strcasecmp("Pipeline", c->key) == 0)
+      cf_util_get_boolean(c, &db->pipeline);
+    else if (strcasecmp("Connections", c->key) == 0)
+      cf_util_get_int(c, &connections);
     else
       log_warn("Ignoring unknown config key \"%s\".", c->key);
   }
@@ -1175,24 +1744,29 @@ static int c_psql_config_database(oconfig_item_t *ci) {
                                        &db->queries, &db->queries_num);
   }
 
-  if (db->queries_num > 0) {
-    db->q_prep_areas = calloc(db->queries_num, sizeof(*db->q_prep_areas));
-    if (db->q_prep_areas == NULL) {
-      log_err("Out of memory.");
-      c_psql_database_delete(db);
-      return -1;
-    }
+#ifndef LIBPQ_HAS_PIPELINING
+  if (db->pipeline) {
+    log_warn("Database '%s': \"Pipeline\" requires libpq 14 or later. "
+             "Queries will be executed one by one.",
+             db->database);
+    db->pipeline = false;
   }
+#endif
 
-  for (int i = 0; (size_t)i < db->queries_num; ++i) {
-    c_psql_user_data_t *data;
-    data = udb_query_get_user_data(db->queries[i]);
-    if ((data != NULL) && (data->params_num > db->max_params_num))
-      db->max_params_num = data->params_num;
+  if ((connections > 1) && (db->queries_num > 1) &&
+      (c_psql_database_split(db, (size_t)connections, interval) != 0)) {
+    c_psql_database_delete(db);
+    return -1;
+  }
 
-    db->q_prep_areas[i] = udb_query_allocate_preparation_area(db->queries[i]);
+  if (c_psql_database_prepare_queries(db) != 0) {
+    c_psql_database_delete(db);
+    return -1;
+  }
 
-    if (db->q_prep_areas[i] == NULL) {
+  if (db->writers_num > 0) {
+    db->writer_states = calloc(db->writers_num, sizeof(*db->writer_states));
+    if (db->writer_states == NULL) {
       log_err("Out of memory.");
       c_psql_database_delete(db);
       return -1;
@@ -39,6 +39,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 
 #if HAVE_LIBTASKSTATS
@@ -96,6 +97,7 @@
 #if HAVE_LINUX_CONFIG_H
 #include <linux/config.h>
 #endif
+#include <sys/resource.h>
 #ifndef CONFIG_HZ
 #define CONFIG_HZ 100
 #endif
@@ -209,6 +211,7 @@ typedef struct process_entry_s {
 
 #if HAVE_LIBTASKSTATS
   ts_delay_t delay;
+  bool has_taskstats;
 #endif
   bool has_delay;
 
@@ -304,6 +307,9 @@ static bool report_fd_num;
 static bool report_maps_num;
 static bool report_delay;
 static bool report_sys_ctxt_switch;
+#if HAVE_LIBTASKSTATS
+static bool use_taskstats;
+#endif
 
 #if HAVE_THREAD_INFO
 static mach_port_t port_host_self;
@@ -316,6 +322,7 @@ static mach_msg_type_number_t pset_list_len;
 #elif KERNEL_LINUX
 static long pagesize_g;
 static void ps_fill_details(const procstat_t *ps, process_entry_t *entry);
+static char *ps_get_cmdline(long pid, char *name, char *buf, size_t buf_len);
 /* #endif KERNEL_LINUX */
 
 #elif HAVE_LIBKVM_GETPROCS &&                                                  \
@@ -347,6 +354,32 @@ int getargs(void *processBuffer, int bufferLen, char *argsBuffer, int argsLen);
 static ts_t *taskstats_handle;
 #endif
 
+#if KERNEL_LINUX
+/* State kept for each process between reads, so that its command line and
+ * the matching `Process' and `ProcessMatch' blocks are only determined once
+ * per process lifetime. */
+typedef struct ps_cache_entry_s {
+  long pid;
+  /* "/proc/<pid>/stat", kept open and read with pread(2). Reading fails once
+   * the process has exited, even if its PID has been reused. -1 if the file
+   * descriptor limit doesn't allow keeping it open. */
+  int stat_fd;
+  /* Name of the process when "cmdline" and "matches" were determined. exec(3)
+   * changes it. */
+  char name[PROCSTAT_NAME_LEN];
+  char *cmdline;
+  procstat_t **matches;
+  size_t matches_num;
+  bool have_matches;
+  unsigned int generation;
+} ps_cache_entry_t;
+
+static c_avl_tree_t *ps_cache;
+static unsigned int ps_cache_generation;
+static size_t ps_cache_fds_num;
+static size_t ps_cache_fds_max;
+#endif
+
 /* put name of process from config to list_head_g tree
  * list_head_g is a list of 'procstat_t' structs with
  * processes names we want to watch */
@@ -516,92 +549,97 @@ static void ps_update_delay(procstat_t *out, procstat_entry_t *prev,
 }
 #endif
 
-/* add process entry to 'instances' of process 'name' (or refresh it) */
-static void ps_list_add(const char *name, const char *cmdline,
-                        process_entry_t *entry) {
+/* add process entry to the 'instances' of the matching 'ps' (or refresh it) */
+static void ps_list_add_one(procstat_t *ps, process_entry_t *entry) {
   procstat_entry_t *pse;
 
-  if (entry->id == 0)
-    return;
-
-  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next) {
-    if ((ps_list_match(name, cmdline, ps)) == 0)
-      continue;
-
 #if KERNEL_LINUX
-    ps_fill_details(ps, entry);
+  ps_fill_details(ps, entry);
 #endif
 
-    for (pse = ps->instances; pse != NULL; pse = pse->next)
-      if ((pse->id == entry->id) || (pse->next == NULL))
-        break;
+  for (pse = ps->instances; pse != NULL; pse = pse->next)
+    if ((pse->id == entry->id) || (pse->next == NULL))
+      break;
 
-    if ((pse == NULL) || (pse->id != entry->id)) {
-      procstat_entry_t *new;
+  if ((pse == NULL) || (pse->id != entry->id)) {
+    procstat_entry_t *new;
 
-      new = calloc(1, sizeof(*new));
-      if (new == NULL)
-        return;
-      new->id = entry->id;
+    new = calloc(1, sizeof(*new));
+    if (new == NULL)
+      return;
+    new->id = entry->id;
 
-      if (pse == NULL)
-        ps->instances = new;
-      else
-        pse->next = new;
+    if (pse == NULL)
+      ps->instances = new;
+    else
+      pse->next = new;
 
-      pse = new;
-    }
+    pse = new;
+  }
 
-    pse->age = 0;
-
-    ps->num_proc += entry->num_proc;
-    ps->num_lwp += entry->num_lwp;
-    ps->num_fd += entry->num_fd;
-    ps->num_maps += entry->num_maps;
-    ps->vmem_size += entry->vmem_size;
-    ps->vmem_rss += entry->vmem_rss;
-    ps->vmem_data += entry->vmem_data;
-    ps->vmem_code += entry->vmem_code;
-    ps->stack_size += entry->stack_size;
-
-    if ((entry->io_rchar != -1) && (entry->io_wchar != -1)) {
-      ps_update_counter(&ps->io_rchar, &pse->io_rchar, entry->io_rchar);
-      ps_update_counter(&ps->io_wchar, &pse->io_wchar, entry->io_wchar);
-    }
+  pse->age = 0;
 
-    if ((entry->io_syscr != -1) && (entry->io_syscw != -1)) {
-      ps_update_counter(&ps->io_syscr, &pse->io_syscr, entry->io_syscr);
-      ps_update_counter(&ps->io_syscw, &pse->io_syscw, entry->io_syscw);
-    }
+  ps->num_proc += entry->num_proc;
+  ps->num_lwp += entry->num_lwp;
+  ps->num_fd += entry->num_fd;
+  ps->num_maps += entry->num_maps;
+  ps->vmem_size += entry->vmem_size;
+  ps->vmem_rss += entry->vmem_rss;
+  ps->vmem_data += entry->vmem_data;
+  ps->vmem_code += entry->vmem_code;
+  ps->stack_size += entry->stack_size;
 
-    if ((entry->io_diskr != -1) && (entry->io_diskw != -1)) {
-      ps_update_counter(&ps->io_diskr, &pse->io_diskr, entry->io_diskr);
-      ps_update_counter(&ps->io_diskw, &pse->io_diskw, entry->io_diskw);
-    }
+  if ((entry->io_rchar != -1) && (entry->io_wchar != -1)) {
+    ps_update_counter(&ps->io_rchar, &pse->io_rchar, entry->io_rchar);
+    ps_update_counter(&ps->io_wchar, &pse->io_wchar, entry->io_wchar);
+  }
 
-    if ((entry->cswitch_vol != -1) && (entry->cswitch_invol != -1)) {
-      ps_update_counter(&ps->cswitch_vol, &pse->cswitch_vol,
-                        entry->cswitch_vol);
-      ps_update_counter(&ps->cswitch_invol, &pse->cswitch_invol,
-                        entry->cswitch_invol);
-    }
+  if ((entry->io_syscr != -1) && (entry->io_syscw != -1)) {
+    ps_update_counter(&ps->io_syscr, &pse->io_syscr, entry->io_syscr);
+    ps_update_counter(&ps->io_syscw, &pse->io_syscw, entry->io_syscw);
+  }
+
+  if ((entry->io_diskr != -1) && (entry->io_diskw != -1)) {
+    ps_update_counter(&ps->io_diskr, &pse->io_diskr, entry->io_diskr);
+    ps_update_counter(&ps->io_diskw, &pse->io_diskw, entry->io_diskw);
+  }
+
+  if ((entry->cswitch_vol != -1) && (entry->cswitch_invol != -1)) {
+    ps_update_counter(&ps->cswitch_vol, &pse->cswitch_vol,
+                      entry->cswitch_vol);
+    ps_update_counter(&ps->cswitch_invol, &pse->cswitch_invol,
+                      entry->cswitch_invol);
+  }
 
-    ps_update_counter(&ps->vmem_minflt_counter, &pse->vmem_minflt_counter,
-                      entry->vmem_minflt_counter);
-    ps_update_counter(&ps->vmem_majflt_counter, &pse->vmem_majflt_counter,
-                      entry->vmem_majflt_counter);
+  ps_update_counter(&ps->vmem_minflt_counter, &pse->vmem_minflt_counter,
+                    entry->vmem_minflt_counter);
+  ps_update_counter(&ps->vmem_majflt_counter, &pse->vmem_majflt_counter,
+                    entry->vmem_majflt_counter);
 
-    ps_update_counter(&ps->cpu_user_counter, &pse->cpu_user_counter,
-                      entry->cpu_user_counter);
-    ps_update_counter(&ps->cpu_system_counter, &pse->cpu_system_counter,
-                      entry->cpu_system_counter);
+  ps_update_counter(&ps->cpu_user_counter, &pse->cpu_user_counter,
+                    entry->cpu_user_counter);
+  ps_update_counter(&ps->cpu_system_counter, &pse->cpu_system_counter,
+                    entry->cpu_system_counter);
 
 #if HAVE_LIBTASKSTATS
-    if (entry->has_delay)
-      ps_update_delay(ps, pse, entry);
+  if (entry->has_delay)
+    ps_update_delay(ps, pse, entry);
 #endif
+} /* void ps_list_add_one */
+
+/* add process entry to 'instances' of process 'name' (or refresh it) */
+static void ps_list_add(const char *name, const char *cmdline,
+                        process_entry_t *entry) {
+  if (entry->id == 0)
+    return;
+
+  for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next) {
+    if ((ps_list_match(name, cmdline, ps)) == 0)
+      continue;
+
+    ps_list_add_one(ps, entry);
   }
-}
+} /* void ps_list_add */
 
 /* remove old entries from instances of processes in list_head_g */
 static void ps_list_reset(void) {
@@ -737,6 +775,13 @@ static int ps_config(oconfig_item_t *ci) {
 #endif
     } else if (strcasecmp(c->key, "CollectSystemContextSwitch") == 0) {
       cf_util_get_boolean(c, &report_sys_ctxt_switch);
+    } else if (strcasecmp(c->key, "UseTaskstats") == 0) {
+#if HAVE_LIBTASKSTATS
+      cf_util_get_boolean(c, &use_taskstats);
+#else
+      WARNING("processes plugin: The plugin has been compiled without support "
+              "for the \"UseTaskstats\" option.");
+#endif
     } else {
       ERROR("processes plugin: The `%s' configuration option is not "
             "understood and will be ignored.",
@@ -775,6 +820,16 @@ static int ps_init(void) {
   pagesize_g = sysconf(_SC_PAGESIZE);
   DEBUG("pagesize_g = %li; CONFIG_HZ = %i;", pagesize_g, CONFIG_HZ);
 
+  /* Keep "/proc/<pid>/stat" open for at most half of the file descriptors
+   * we may use, so other plugins don't run out of them. */
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) != 0)
+    ps_cache_fds_max = 0;
+  else if ((rl.rlim_cur == RLIM_INFINITY) || (rl.rlim_cur > 131072))
+    ps_cache_fds_max = 65536;
+  else
+    ps_cache_fds_max = (size_t)rl.rlim_cur / 2;
+
 #if HAVE_LIBTASKSTATS
   if (taskstats_handle == NULL) {
     taskstats_handle = ts_create();
@@ -1227,12 +1282,15 @@ static int ps_count_fd(int pid) {
 } /* int ps_count_fd (pid) */
 
 #if HAVE_LIBTASKSTATS
-static int ps_delay(process_entry_t *ps) {
+/* ps_taskstats reads the delay accounting information and the context
+ * switches of all threads of the process with a single netlink request. */
+static int ps_taskstats(process_entry_t *ps) {
   if (taskstats_handle == NULL) {
     return ENOTCONN;
   }
 
-  int status = ts_delay_by_tgid(taskstats_handle, (uint32_t)ps->id, &ps->delay);
+  ts_tgid_stats_t stats = {0};
+  int status = ts_stats_by_tgid(taskstats_handle, (uint32_t)ps->id, &stats);
   if (status == EPERM) {
     static c_complain_t c;
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_NET_ADMIN)
@@ -1256,7 +1314,7 @@ static int ps_delay(process_entry_t *ps) {
             STRERROR(status));
       }
     } else {
-      ERROR("processes plugin: ts_delay_by_tgid failed: %s. The CAP_NET_ADMIN "
+      ERROR("processes plugin: ts_stats_by_tgid failed: %s. The CAP_NET_ADMIN "
             "capability is available (I checked), so this error is utterly "
             "unexpected.",
             STRERROR(status));
@@ -1269,10 +1327,17 @@ static int ps_delay(process_entry_t *ps) {
 #endif
     return status;
   } else if (status != 0) {
-    ERROR("processes plugin: ts_delay_by_tgid failed: %s", STRERROR(status));
+    ERROR("processes plugin: ts_stats_by_tgid failed: %s", STRERROR(status));
     return status;
   }
 
+  ps->delay = stats.delay;
+  if (use_taskstats) {
+    ps->cswitch_vol = (derive_t)stats.cswitch_vol;
+    ps->cswitch_invol = (derive_t)stats.cswitch_invol;
+    ps->has_cswitch = true;
+  }
+
   return 0;
 }
 #endif
@@ -1283,6 +1348,21 @@ static void ps_fill_details(const procstat_t *ps, process_entry_t *entry) {
     entry->has_io = true;
   }
 
+#if HAVE_LIBTASKSTATS
+  /* With "UseTaskstats", the context switches are read with the delay
+   * accounting data instead of from "/proc/<pid>/task/<tid>/status". */
+  if ((ps->report_delay || (use_taskstats && ps->report_ctx_switch)) &&
+      !entry->has_taskstats) {
+    if (ps_taskstats(entry) == 0) {
+      entry->has_taskstats = true;
+    }
+  }
+
+  if (ps->report_delay && entry->has_taskstats) {
+    entry->has_delay = true;
+  }
+#endif
+
   if (ps->report_ctx_switch) {
     if (entry->has_cswitch == false) {
       ps_read_tasks_status(entry);
@@ -1305,19 +1385,183 @@ static void ps_fill_details(const procstat_t *ps, process_entry_t *entry) {
     }
     entry->has_fd = true;
   }
+} /* void ps_fill_details (...) */
 
-#if HAVE_LIBTASKSTATS
-  if (ps->report_delay && !entry->has_delay) {
-    if (ps_delay(entry) == 0) {
-      entry->has_delay = true;
+static int ps_cache_compare(const void *a, const void *b) {
+  long pid_a = *((const long *)a);
+  long pid_b = *((const long *)b);
+
+  if (pid_a < pid_b)
+    return -1;
+  if (pid_a > pid_b)
+    return 1;
+  return 0;
+} /* int ps_cache_compare */
+
+/* Forgets everything that was determined for the previous process. */
+static void ps_cache_entry_reset(ps_cache_entry_t *pce) {
+  pce->name[0] = 0;
+  sfree(pce->cmdline);
+  sfree(pce->matches);
+  pce->matches_num = 0;
+  pce->have_matches = false;
+} /* void ps_cache_entry_reset */
+
+static void ps_cache_entry_close(ps_cache_entry_t *pce) {
+  if (pce->stat_fd < 0)
+    return;
+
+  close(pce->stat_fd);
+  pce->stat_fd = -1;
+  ps_cache_fds_num--;
+} /* void ps_cache_entry_close */
+
+static void ps_cache_entry_free(ps_cache_entry_t *pce) {
+  if (pce == NULL)
+    return;
+
+  ps_cache_entry_close(pce);
+  ps_cache_entry_reset(pce);
+  sfree(pce);
+} /* void ps_cache_entry_free */
+
+static ps_cache_entry_t *ps_cache_get(long pid) {
+  ps_cache_entry_t *pce = NULL;
+
+  if (ps_cache == NULL) {
+    ps_cache = c_avl_create(ps_cache_compare);
+    if (ps_cache == NULL)
+      return NULL;
+  }
+
+  if (c_avl_get(ps_cache, &pid, (void *)&pce) == 0)
+    return pce;
+
+  pce = calloc(1, sizeof(*pce));
+  if (pce == NULL)
+    return NULL;
+  pce->pid = pid;
+  pce->stat_fd = -1;
+
+  if (c_avl_insert(ps_cache, &pce->pid, pce) != 0) {
+    sfree(pce);
+    return NULL;
+  }
+
+  return pce;
+} /* ps_cache_entry_t *ps_cache_get */
+
+/* Removes the entries of all processes that weren't seen in this read. */
+static void ps_cache_prune(void) {
+  ps_cache_entry_t **stale = NULL;
+  size_t stale_num = 0;
+  ps_cache_entry_t *pce;
+  long *pid;
+
+  if (ps_cache == NULL)
+    return;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(ps_cache);
+  while (c_avl_iterator_next(iter, (void *)&pid, (void *)&pce) == 0) {
+    if (pce->generation == ps_cache_generation)
+      continue;
+
+    ps_cache_entry_t **tmp =
+        realloc(stale, (stale_num + 1) * sizeof(*stale));
+    if (tmp == NULL)
+      break;
+    stale = tmp;
+    stale[stale_num++] = pce;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < stale_num; i++) {
+    c_avl_remove(ps_cache, &stale[i]->pid, NULL, NULL);
+    ps_cache_entry_free(stale[i]);
+  }
+  sfree(stale);
+} /* void ps_cache_prune */
+
+/* Reads "/proc/<pid>/stat" into "buffer", which is null-terminated. */
+static ssize_t ps_cache_read_stat(ps_cache_entry_t *pce, char *buffer,
+                                  size_t buffer_size) {
+  char filename[64];
+
+  snprintf(filename, sizeof(filename), "/proc/%li/stat", pce->pid);
+
+  for (int i = 0; i < 2; i++) {
+    if ((pce->stat_fd < 0) && (ps_cache_fds_num < ps_cache_fds_max)) {
+      pce->stat_fd = open(filename, O_RDONLY | O_CLOEXEC);
+      if (pce->stat_fd < 0)
+        return -1;
+      ps_cache_fds_num++;
+    }
+
+    if (pce->stat_fd < 0)
+      return read_text_file_contents(filename, buffer, buffer_size);
+
+    ssize_t len = pread(pce->stat_fd, buffer, buffer_size - 1, 0);
+    if (len > 0) {
+      buffer[len] = 0;
+      return len;
     }
+
+    /* The process has exited. Its PID may already belong to a new one. */
+    ps_cache_entry_close(pce);
+    ps_cache_entry_reset(pce);
   }
-#endif
-} /* void ps_fill_details (...) */
+
+  return -1;
+} /* ssize_t ps_cache_read_stat */
+
+/* Like ps_list_add(), but remembers the command line and the matching
+ * entries of list_head_g for the lifetime of the process. */
+static void ps_cache_list_add(ps_cache_entry_t *pce, process_entry_t *entry,
+                              char *cmdline_buffer, size_t cmdline_buffer_size) {
+  if (entry->id == 0)
+    return;
+
+  if (strcmp(pce->name, entry->name) != 0) {
+    ps_cache_entry_reset(pce);
+    sstrncpy(pce->name, entry->name, sizeof(pce->name));
+  }
+
+  if (!pce->have_matches) {
+    char *cmdline = ps_get_cmdline(pce->pid, entry->name, cmdline_buffer,
+                                   cmdline_buffer_size);
+    if (cmdline != NULL) {
+      pce->cmdline = strdup(cmdline);
+      if (pce->cmdline == NULL) {
+        ps_list_add(entry->name, cmdline, entry);
+        return;
+      }
+    }
+
+    for (procstat_t *ps = list_head_g; ps != NULL; ps = ps->next) {
+      if (ps_list_match(entry->name, pce->cmdline, ps) == 0)
+        continue;
+
+      procstat_t **tmp = realloc(pce->matches, (pce->matches_num + 1) *
+                                                   sizeof(*pce->matches));
+      if (tmp == NULL) {
+        ps_cache_entry_reset(pce);
+        ps_list_add(entry->name, cmdline, entry);
+        return;
+      }
+      pce->matches = tmp;
+      pce->matches[pce->matches_num++] = ps;
+    }
+    pce->have_matches = true;
+  }
+
+  for (size_t i = 0; i < pce->matches_num; i++)
+    ps_list_add_one(pce->matches[i], entry);
+} /* void ps_cache_list_add */
 
 /* ps_read_process reads process counters on Linux. */
-static int ps_read_process(long pid, process_entry_t *ps, char *state) {
-  char filename[64];
+static int ps_read_process(ps_cache_entry_t *pce, process_entry_t *ps,
+                           char *state) {
+  long pid = pce->pid;
   char buffer[1024];
 
   char *fields[64];
@@ -1338,9 +1582,7 @@ static int ps_read_process(long pid, process_entry_t *ps, char *state) {
 
   ssize_t status;
 
-  snprintf(filename, sizeof(filename), "/proc/%li/stat", pid);
-
-  status = read_text_file_contents(filename, buffer, sizeof(buffer));
+  status = ps_cache_read_stat(pce, buffer, sizeof(buffer));
   if (status <= 0)
     return -1;
   buffer_len = (size_t)status;
@@ -1380,8 +1622,8 @@ static int ps_read_process(long pid, process_entry_t *ps, char *state) {
   fields_len = strsplit(buffer_ptr, fields, STATIC_ARRAY_SIZE(fields));
   if (fields_len < 22) {
     DEBUG("processes plugin: ps_read_process (pid = %li):"
-          " `%s' has only %i fields..",
-          pid, filename, fields_len);
+          " `/proc/%li/stat' has only %i fields..",
+          pid, pid, fields_len);
     return -1;
   }
 
@@ -2109,6 +2351,7 @@ static int ps_read(void) {
     return -1;
   }
 
+  ps_cache_generation++;
   while ((ent = readdir(proc)) != NULL) {
     if (!isdigit(ent->d_name[0]))
       continue;
@@ -2116,10 +2359,15 @@ static int ps_read(void) {
     if ((pid = atol(ent->d_name)) < 1)
       continue;
 
+    ps_cache_entry_t *pce = ps_cache_get(pid);
+    if (pce == NULL)
+      continue;
+    pce->generation = ps_cache_generation;
+
     memset(&pse, 0, sizeof(pse));
     pse.id = pid;
 
-    status = ps_read_process(pid, &pse, &state);
+    status = ps_read_process(pce, &pse, &state);
     if (status != 0) {
       DEBUG("ps_read_process failed: %i", status);
       continue;
@@ -2143,11 +2391,11 @@ static int ps_read(void) {
       break;
     }
 
-    ps_list_add(pse.name,
-                ps_get_cmdline(pid, pse.name, cmdline, sizeof(cmdline)), &pse);
+    ps_cache_list_add(pce, &pse, cmdline, sizeof(cmdline));
   }
 
   closedir(proc);
+  ps_cache_prune();
 
   if (read_file_contents("/proc/stat", buffer, sizeof(buffer) - 1) <= 0) {
     ERROR("Cannot read `/proc/stat`");
@@ -24,6 +24,9 @@
  *     Andrew Bays <abays at redhat.com>
  **/
 
+/* _GNU_SOURCE is needed in Linux to use recvmmsg */
+#define _GNU_SOURCE
+
 #include "collectd.h"
 
 #include "plugin.h"
@@ -59,12 +62,10 @@
 
 #define PROCEVENT_EXITED 0
 #define PROCEVENT_STARTED 1
-#define PROCEVENT_FIELDS 3 // pid, status, timestamp
 #define BUFSIZE 512
 #define PROCDIR "/proc"
-#define RBUF_PROC_ID_INDEX 0
-#define RBUF_PROC_STATUS_INDEX 1
-#define RBUF_TIME_INDEX 2
+// Number of netlink messages received with one recvmmsg() call
+#define PROCEVENT_RECV_BATCH 64
 
 #define PROCEVENT_DOMAIN_FIELD "domain"
 #define PROCEVENT_DOMAIN_VALUE "fault"
@@ -105,11 +106,21 @@
  * Private data types
  */
 
+typedef struct {
+  long pid;
+  int status;
+  cdtime_t time;
+  char process[DATA_MAX_NAME_LEN];
+} procevent_event_t;
+
+// Single producer (netlink thread), single consumer (dequeue thread) ring.
+// "head" is only written by the producer and "tail" only by the consumer, so
+// neither side needs a lock to access the buffer.
 typedef struct {
   int head;
   int tail;
   int maxLen;
-  cdtime_t **buffer;
+  procevent_event_t *buffer;
 } circbuf_t;
 
 struct processlist_s {
@@ -136,8 +147,9 @@ static pthread_mutex_t procevent_thread_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t procevent_data_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t procevent_cond = PTHREAD_COND_INITIALIZER;
 static int nl_sock = -1;
-static int buffer_length;
+static int buffer_length = 10;
 static circbuf_t ring;
+static c_complain_t ring_complaint = C_COMPLAIN_INIT_STATIC;
 static processlist_t *processlist_head = NULL;
 static int event_id = 0;
 
@@ -426,7 +438,8 @@ err:
 }
 
 // Does /proc/<pid>/comm contain a process name we are interested in?
-// NOTE: Caller MUST hold procevent_data_lock when calling this function
+// NOTE: The process list is owned by the netlink thread. Only call this
+// function from there, or before the thread has been started.
 static processlist_t *process_check(long pid) {
   char file[BUFSIZE];
 
@@ -554,7 +567,7 @@ static processlist_t *process_check(long pid) {
 }
 
 // Does our map have this PID or name?
-// NOTE: Caller MUST hold procevent_data_lock when calling this function
+// NOTE: Same rules as for process_check() apply
 static processlist_t *process_map_check(long pid, char *process) {
   for (processlist_t *pl = processlist_head; pl != NULL; pl = pl->next) {
     int match_pid = 0;
@@ -648,9 +661,7 @@ static int process_map_refresh(void) {
     // Check if we need to store this pid/name combo in our processlist_t linked
     // list
     int this_pid = atoi(dent->d_name);
-    pthread_mutex_lock(&procevent_data_lock);
     processlist_t *pl = process_check(this_pid);
-    pthread_mutex_unlock(&procevent_data_lock);
 
     if (pl != NULL)
       DEBUG("procevent plugin: process map refreshed for PID %d and name %s",
@@ -716,52 +727,131 @@ static int set_proc_ev_listen(bool enable) {
   return 0;
 }
 
+static bool netlink_thread_running(void) {
+  pthread_mutex_lock(&procevent_thread_lock);
+  bool running = (procevent_netlink_thread_loop > 0);
+  pthread_mutex_unlock(&procevent_thread_lock);
+
+  return running;
+}
+
+static void ring_signal(void) {
+  pthread_mutex_lock(&procevent_data_lock);
+  pthread_cond_signal(&procevent_cond);
+  pthread_mutex_unlock(&procevent_data_lock);
+}
+
+// Write an event to the ring buffer. If it is full, wait for the dequeue
+// thread to make room; meanwhile the kernel keeps buffering messages in the
+// socket. Returns false if the event has not been queued.
+// NOTE: Only call this function from the netlink thread
+static bool ring_push(long pid, int status, char const *process) {
+  // Nobody would receive the notification
+  if (!plugin_notification_has_consumers())
+    return true;
+
+  int head = ring.head;
+  int next = head + 1;
+  if (next >= ring.maxLen)
+    next = 0;
+
+  while (next == __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE)) {
+    c_complain(LOG_WARNING, &ring_complaint,
+               "procevent plugin: ring buffer full");
+
+    ring_signal();
+    usleep(1000);
+
+    if (!netlink_thread_running())
+      return false;
+  }
+
+  procevent_event_t *ev = ring.buffer + head;
+  ev->pid = pid;
+  ev->status = status;
+  ev->time = cdtime();
+  sstrncpy(ev->process, process, sizeof(ev->process));
+
+  __atomic_store_n(&ring.head, next, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Check a process status change against the process list and queue a
+// notification if it concerns a process we are interested in
+// NOTE: Only call this function from the netlink thread
+static void handle_event(long pid, int proc_status) {
+  if (proc_status == PROCEVENT_EXITED) {
+    processlist_t *pl = process_map_check(pid, NULL);
+
+    if (pl == NULL)
+      return;
+
+    // This process is of interest to us, so publish its EXITED status
+    ring_push(pid, proc_status, pl->process);
+
+    DEBUG("procevent plugin: PID %ld (%s) EXITED, removing PID from process "
+          "list",
+          pl->pid, pl->process);
+    pl->pid = -1;
+    pl->last_status = -1;
+  } else if (proc_status == PROCEVENT_STARTED) {
+    // a new process has started, so check if we should monitor it
+    processlist_t *pl = process_check(pid);
+
+    // If we had already seen this process name and pid combo before,
+    // and the last message was a "process started" message, don't send
+    // the notfication again
+    if (pl == NULL || pl->last_status == PROCEVENT_STARTED)
+      return;
+
+    // This process is of interest to us, so publish its STARTED status
+    if (ring_push(pid, proc_status, pl->process))
+      pl->last_status = PROCEVENT_STARTED;
+
+    DEBUG("procevent plugin: PID %ld (%s) STARTED, adding PID to process "
+          "list",
+          pl->pid, pl->process);
+  }
+}
+
 // Read from netlink socket and write to ring buffer
 static int read_event() {
-  int recv_flags = MSG_DONTWAIT;
-  struct __attribute__((aligned(NLMSG_ALIGNTO))) {
+  typedef struct __attribute__((aligned(NLMSG_ALIGNTO))) {
     struct nlmsghdr nl_hdr;
     struct __attribute__((__packed__)) {
       struct cn_msg cn_msg;
       struct proc_event proc_ev;
     };
-  } nlcn_msg;
+  } nlcn_msg_t;
+
+  nlcn_msg_t nlcn_msgs[PROCEVENT_RECV_BATCH];
+  struct iovec iovs[PROCEVENT_RECV_BATCH];
+  struct mmsghdr msgs[PROCEVENT_RECV_BATCH];
 
   if (nl_sock == -1)
     return 0;
 
   while (42) {
-    pthread_mutex_lock(&procevent_thread_lock);
-
-    if (procevent_netlink_thread_loop <= 0) {
-      pthread_mutex_unlock(&procevent_thread_lock);
+    if (!netlink_thread_running())
       return 0;
-    }
 
-    pthread_mutex_unlock(&procevent_thread_lock);
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < PROCEVENT_RECV_BATCH; i++) {
+      iovs[i].iov_base = nlcn_msgs + i;
+      iovs[i].iov_len = sizeof(nlcn_msgs[i]);
+      msgs[i].msg_hdr.msg_iov = iovs + i;
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
 
-    int status = recv(nl_sock, &nlcn_msg, sizeof(nlcn_msg), recv_flags);
+    // Block until there is at least one message, then take all messages
+    // that are already queued (up to the batch size)
+    int status = recvmmsg(nl_sock, msgs, PROCEVENT_RECV_BATCH, MSG_WAITFORONE,
+                          /* timeout = */ NULL);
 
     if (status == 0) {
       return 0;
     } else if (status < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        pthread_mutex_lock(&procevent_data_lock);
-
-        // There was nothing more to receive for now, so...
-        // If ring head does not equal ring tail, then there is data
-        // in the ring buffer for the dequeue thread to read, so
-        // signal it
-        if (ring.head != ring.tail)
-          pthread_cond_signal(&procevent_cond);
-
-        pthread_mutex_unlock(&procevent_data_lock);
-
-        // Since there was nothing to receive, set recv to block and
-        // try again
-        recv_flags = 0;
-        continue;
-      } else if (errno != EINTR) {
+      if (errno != EINTR) {
         ERROR("procevent plugin: socket receive error: %d", errno);
         return -1;
       } else {
@@ -770,62 +860,26 @@ static int read_event() {
       }
     }
 
-    // We successfully received a message, so don't block on the next
-    // read in case there are more (and if there aren't, it will be
-    // handled above in the EWOULDBLOCK error-checking)
-    recv_flags = MSG_DONTWAIT;
-
-    int proc_id = -1;
-    int proc_status = -1;
-
-    switch (nlcn_msg.proc_ev.what) {
-    case PROC_EVENT_EXEC:
-      proc_status = PROCEVENT_STARTED;
-      proc_id = nlcn_msg.proc_ev.event_data.exec.process_pid;
-      break;
-    case PROC_EVENT_EXIT:
-      proc_id = nlcn_msg.proc_ev.event_data.exit.process_pid;
-      proc_status = PROCEVENT_EXITED;
-      break;
-    default:
-      // Otherwise not of interest
-      break;
-    }
-
-    // If we're interested in this process status event, place the event
-    // in the ring buffer for consumption by the dequeue (dispatch) thread.
-
-    if (proc_status != -1) {
-      pthread_mutex_lock(&procevent_data_lock);
-
-      int next = ring.head + 1;
-      if (next >= ring.maxLen)
-        next = 0;
-
-      if (next == ring.tail) {
-        // Buffer is full, signal the dequeue thread to process the buffer
-        // and clean it out, and then sleep
-        WARNING("procevent plugin: ring buffer full");
-
-        pthread_cond_signal(&procevent_cond);
-        pthread_mutex_unlock(&procevent_data_lock);
-
-        usleep(1000);
-        continue;
-      } else {
-        DEBUG("procevent plugin: Process %d status is now %s at %llu", proc_id,
-              (proc_status == PROCEVENT_EXITED ? "EXITED" : "STARTED"),
-              (unsigned long long)cdtime());
-
-        ring.buffer[ring.head][RBUF_PROC_ID_INDEX] = proc_id;
-        ring.buffer[ring.head][RBUF_PROC_STATUS_INDEX] = proc_status;
-        ring.buffer[ring.head][RBUF_TIME_INDEX] = cdtime();
-
-        ring.head = next;
+    for (int i = 0; i < status; i++) {
+      switch (nlcn_msgs[i].proc_ev.what) {
+      case PROC_EVENT_EXEC:
+        handle_event(nlcn_msgs[i].proc_ev.event_data.exec.process_pid,
+                     PROCEVENT_STARTED);
+        break;
+      case PROC_EVENT_EXIT:
+        handle_event(nlcn_msgs[i].proc_ev.event_data.exit.process_pid,
+                     PROCEVENT_EXITED);
+        break;
+      default:
+        // Otherwise not of interest
+        break;
       }
-
-      pthread_mutex_unlock(&procevent_data_lock);
     }
+
+    // The socket has been drained (or the batch is full), so let the
+    // dequeue thread dispatch what has been queued
+    if (ring.head != __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE))
+      ring_signal();
   }
 
   return 0;
@@ -873,63 +927,27 @@ static void procevent_dispatch_notification(long pid, gauge_t value,
 
 // Read from ring buffer and dispatch to write plugins
 static void read_ring_buffer() {
-  pthread_mutex_lock(&procevent_data_lock);
-
   // If there's currently nothing to read from the buffer,
   // then wait
-  if (ring.head == ring.tail)
+  pthread_mutex_lock(&procevent_data_lock);
+  if (__atomic_load_n(&ring.head, __ATOMIC_ACQUIRE) == ring.tail)
     pthread_cond_wait(&procevent_cond, &procevent_data_lock);
+  pthread_mutex_unlock(&procevent_data_lock);
 
-  while (ring.head != ring.tail) {
-    int next = ring.tail + 1;
+  // The events have been filtered by the netlink thread already, so all
+  // that is left is building the notifications
+  while (__atomic_load_n(&ring.head, __ATOMIC_ACQUIRE) != ring.tail) {
+    procevent_event_t *ev = ring.buffer + ring.tail;
+
+    procevent_dispatch_notification(ev->pid, ev->status, ev->process,
+                                    ev->time);
 
+    int next = ring.tail + 1;
     if (next >= ring.maxLen)
       next = 0;
 
-    if (ring.buffer[ring.tail][RBUF_PROC_STATUS_INDEX] == PROCEVENT_EXITED) {
-      processlist_t *pl = process_map_check(ring.buffer[ring.tail][0], NULL);
-
-      if (pl != NULL) {
-        // This process is of interest to us, so publish its EXITED status
-        procevent_dispatch_notification(
-            ring.buffer[ring.tail][RBUF_PROC_ID_INDEX],
-            ring.buffer[ring.tail][RBUF_PROC_STATUS_INDEX], pl->process,
-            ring.buffer[ring.tail][RBUF_TIME_INDEX]);
-        DEBUG(
-            "procevent plugin: PID %ld (%s) EXITED, removing PID from process "
-            "list",
-            pl->pid, pl->process);
-        pl->pid = -1;
-        pl->last_status = -1;
-      }
-    } else if (ring.buffer[ring.tail][RBUF_PROC_STATUS_INDEX] ==
-               PROCEVENT_STARTED) {
-      // a new process has started, so check if we should monitor it
-      processlist_t *pl = process_check(ring.buffer[ring.tail][0]);
-
-      // If we had already seen this process name and pid combo before,
-      // and the last message was a "process started" message, don't send
-      // the notfication again
-
-      if (pl != NULL && pl->last_status != PROCEVENT_STARTED) {
-        // This process is of interest to us, so publish its STARTED status
-        procevent_dispatch_notification(
-            ring.buffer[ring.tail][RBUF_PROC_ID_INDEX],
-            ring.buffer[ring.tail][RBUF_PROC_STATUS_INDEX], pl->process,
-            ring.buffer[ring.tail][RBUF_TIME_INDEX]);
-
-        pl->last_status = PROCEVENT_STARTED;
-
-        DEBUG("procevent plugin: PID %ld (%s) STARTED, adding PID to process "
-              "list",
-              pl->pid, pl->process);
-      }
-    }
-
-    ring.tail = next;
+    __atomic_store_n(&ring.tail, next, __ATOMIC_RELEASE);
   }
-
-  pthread_mutex_unlock(&procevent_data_lock);
 }
 
 // Entry point for thread responsible for listening
@@ -1190,10 +1208,11 @@ static int procevent_init(void) /* {{{ */
   ring.head = 0;
   ring.tail = 0;
   ring.maxLen = buffer_length;
-  ring.buffer = (cdtime_t **)calloc(buffer_length, sizeof(cdtime_t *));
+  ring.buffer = calloc(buffer_length, sizeof(*ring.buffer));
 
-  for (int i = 0; i < buffer_length; i++) {
-    ring.buffer[i] = (cdtime_t *)calloc(PROCEVENT_FIELDS, sizeof(cdtime_t));
+  if (ring.buffer == NULL) {
+    ERROR("procevent plugin: calloc failed during init: %s", STRERRNO);
+    return -1;
   }
 
   int status = process_map_refresh();
@@ -1222,6 +1241,11 @@ static int procevent_config(const char *key, const char *value) /* {{{ */
 
   if (strcasecmp(key, "BufferLength") == 0) {
     buffer_length = atoi(value);
+
+    if (buffer_length < 2) {
+      ERROR("procevent plugin: BufferLength must be at least 2.");
+      return 1;
+    }
   } else if (strcasecmp(key, "Process") == 0) {
     ignorelist_add(ignorelist, value);
   } else if (strcasecmp(key, "ProcessRegex") == 0) {
@@ -1271,11 +1295,7 @@ static int procevent_shutdown(void) /* {{{ */
 
   int status = stop_threads();
 
-  for (int i = 0; i < buffer_length; i++) {
-    free(ring.buffer[i]);
-  }
-
-  free(ring.buffer);
+  sfree(ring.buffer);
 
   processlist_t *pl = processlist_head;
   while (pl != NULL) {
@@ -62,6 +62,20 @@ static char flush_doc[] = "flush([plugin][, timeout][, identifier]) -> None\n"
                           "\n"
                           "Flushes the cache of another plugin.";
 
+static char dispatch_many_doc[] =
+    "dispatch_many(values[, template][, instances]) -> None\n"
+    "\n"
+    "Dispatches many value lists with a single call.\n"
+    "\n"
+    "'values' is a list of Values objects or (type, type_instance, values)\n"
+    "    tuples. The tuples take the rest of their identifier, the time,\n"
+    "    interval and meta data from 'template'.\n"
+    "'template' is a Values object. If omitted, the plugin name defaults to\n"
+    "    'python' and the host to the global host name.\n"
+    "'instances' is a list of type instances. If given, 'values' must be a\n"
+    "    list of the same length holding one list of values per instance,\n"
+    "    all of the template's type.";
+
 static char unregister_doc[] =
     "Unregisters a callback. This function needs exactly one parameter either\n"
     "the function to unregister or the callback identifier to unregister.";
@@ -172,6 +186,33 @@ static char reg_write_doc[] =
     "data: The optional data parameter passed to the register function.\n"
     "    If the parameter was omitted it will be omitted here, too.";
 
+static char reg_write_batch_doc[] =
+    "register_write_batch(callback[, batch_size][, data][, name]) -> "
+    "identifier\n"
+    "\n"
+    "Register a callback function to receive values dispatched by other\n"
+    "plugins in batches.\n"
+    "'callback' is a callable object that will be called with a list of\n"
+    "    Values objects.\n"
+    "'batch_size' is the maximum number of Values objects passed to the\n"
+    "    callback in one call. Values are also passed on when the oldest one\n"
+    "    has been waiting for one interval and before the shutdown\n"
+    "    callbacks are called.\n"
+    "'data' is an optional object that will be passed back to the callback\n"
+    "    function every time it is called.\n"
+    "'name' is an optional identifier for this callback. The default name\n"
+    "    is 'python.<module>'.\n"
+    "    Every callback needs a unique identifier, so if you want to\n"
+    "    register this callback multiple time from the same module you need\n"
+    "    to specify a name here.\n"
+    "'identifier' is the full identifier assigned to this callback.\n"
+    "\n"
+    "The callback function will be called with one or two parameters:\n"
+    "values: A list of Values objects which are copies of the dispatched\n"
+    "    values.\n"
+    "data: The optional data parameter passed to the register function.\n"
+    "    If the parameter was omitted it will be omitted here, too.";
+
 static char reg_notification_doc[] =
     "register_notification(callback[, data][, name]) -> identifier\n"
     "\n"
@@ -398,18 +439,18 @@ static int cpy_read_callback(user_data_t *data) {
   return 0;
 }
 
-static int cpy_write_callback(const data_set_t *ds,
-                              const value_list_t *value_list,
-                              user_data_t *data) {
-  cpy_callback_t *c = data->data;
-  PyObject *ret, *list, *temp, *dict = NULL;
+/* cpy_values_from_list returns a new Values object holding a copy of
+ * "value_list", or NULL after logging the error.
+ * You must hold the GIL to call this function! */
+static PyObject *cpy_values_from_list(const data_set_t *ds,
+                                      const value_list_t *value_list) {
+  PyObject *list, *temp, *dict = NULL;
   Values *v;
 
-  CPY_LOCK_THREADS
   list = PyList_New(value_list->values_len); /* New reference. */
   if (list == NULL) {
     cpy_log_exception("write callback");
-    CPY_RETURN_FROM_THREADS 0;
+    return NULL;
   }
   for (size_t i = 0; i < value_list->values_len; ++i) {
     if (ds->ds[i].type == DS_TYPE_COUNTER) {
@@ -428,12 +469,12 @@ static int cpy_write_callback(const data_set_t *ds,
       ERROR("cpy_write_callback: Unknown value type %d.", ds->ds[i].type);
       Py_END_ALLOW_THREADS;
       Py_DECREF(list);
-      CPY_RETURN_FROM_THREADS 0;
+      return NULL;
     }
     if (PyErr_Occurred() != NULL) {
       cpy_log_exception("value building for write callback");
       Py_DECREF(list);
-      CPY_RETURN_FROM_THREADS 0;
+      return NULL;
     }
   }
   dict = PyDict_New(); /* New reference. */
@@ -508,6 +549,20 @@ static int cpy_write_callback(const data_set_t *ds,
   v->values = list;
   Py_CLEAR(v->meta);
   v->meta = dict; /* Steals a reference. */
+  return (PyObject *)v;
+}
+
+static int cpy_write_callback(const data_set_t *ds,
+                              const value_list_t *value_list,
+                              user_data_t *data) {
+  cpy_callback_t *c = data->data;
+  PyObject *ret, *v;
+
+  CPY_LOCK_THREADS
+  v = cpy_values_from_list(ds, value_list); /* New reference. */
+  if (v == NULL) {
+    CPY_RETURN_FROM_THREADS 0;
+  }
   ret = PyObject_CallFunctionObjArgs(c->callback, v, c->data,
                                      (void *)0); /* New reference. */
   Py_XDECREF(v);
@@ -520,6 +575,146 @@ static int cpy_write_callback(const data_set_t *ds,
   return 0;
 }
 
+/* Batch writers collect copies of the dispatched value lists and pass them to
+ * Python as one list, so that the GIL is taken once per batch instead of once
+ * per value list. */
+typedef struct cpy_write_batch_s {
+  cpy_callback_t *callback;
+
+  pthread_mutex_t lock;
+  size_t size;
+  cdtime_t timeout;
+  const data_set_t **ds;
+  value_list_t *vl;
+  size_t num;
+  cdtime_t first_time;
+
+  struct cpy_write_batch_s *next;
+} cpy_write_batch_t;
+
+/* List of all batch writers, so they can be flushed before the shutdown
+ * callbacks run. */
+static cpy_write_batch_t *cpy_write_batches;
+static pthread_mutex_t cpy_write_batches_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void cpy_write_batch_clear(cpy_write_batch_t *b) {
+  for (size_t i = 0; i < b->num; i++) {
+    sfree(b->vl[i].values);
+    meta_data_destroy(b->vl[i].meta);
+  }
+  b->num = 0;
+}
+
+/* cpy_write_batch_deliver_nolock calls the Python callback with all collected
+ * value lists. When "final" is true and the shutdown callbacks have already
+ * run, the values are dropped instead.
+ * You must hold b->lock and must NOT hold the GIL when calling this
+ * function! */
+static void cpy_write_batch_deliver_nolock(cpy_write_batch_t *b, bool final) {
+  cpy_callback_t *c = b->callback;
+  PyObject *list, *ret;
+
+  if (b->num == 0)
+    return;
+
+  CPY_LOCK_THREADS
+  if (!final || !cpy_shutdown_triggered) {
+    list = PyList_New(0); /* New reference. */
+    if (list == NULL)
+      cpy_log_exception("write callback");
+    for (size_t i = 0; (list != NULL) && (i < b->num); i++) {
+      PyObject *v = cpy_values_from_list(b->ds[i], &b->vl[i]);
+      if (v == NULL)
+        continue;
+      PyList_Append(list, v);
+      Py_DECREF(v);
+    }
+
+    if (list != NULL) {
+      ret = PyObject_CallFunctionObjArgs(c->callback, list, c->data,
+                                         (void *)0); /* New reference. */
+      Py_DECREF(list);
+      if (ret == NULL) {
+        cpy_log_exception("write callback");
+      } else {
+        Py_DECREF(ret);
+      }
+    }
+  }
+  CPY_RELEASE_THREADS
+
+  cpy_write_batch_clear(b);
+}
+
+static int cpy_write_batch_callback(const data_set_t *ds,
+                                    const value_list_t *value_list,
+                                    user_data_t *data) {
+  cpy_write_batch_t *b = data->data;
+  cdtime_t now = cdtime();
+
+  pthread_mutex_lock(&b->lock);
+
+  value_list_t *vl = b->vl + b->num;
+  *vl = *value_list;
+  vl->values = calloc(value_list->values_len, sizeof(*vl->values));
+  if (vl->values == NULL) {
+    pthread_mutex_unlock(&b->lock);
+    ERROR("python plugin: calloc failed.");
+    return ENOMEM;
+  }
+  memcpy(vl->values, value_list->values,
+         value_list->values_len * sizeof(*vl->values));
+  vl->meta = meta_data_clone(value_list->meta);
+  b->ds[b->num] = ds;
+
+  if (b->num == 0)
+    b->first_time = now;
+  b->num++;
+
+  if ((b->num >= b->size) || ((now - b->first_time) >= b->timeout))
+    cpy_write_batch_deliver_nolock(b, /* final = */ false);
+
+  pthread_mutex_unlock(&b->lock);
+  return 0;
+}
+
+/* Delivers the values collected by all batch writers.
+ * You must NOT hold the GIL when calling this function! */
+static void cpy_write_batches_flush(void) {
+  pthread_mutex_lock(&cpy_write_batches_lock);
+  for (cpy_write_batch_t *b = cpy_write_batches; b != NULL; b = b->next) {
+    pthread_mutex_lock(&b->lock);
+    cpy_write_batch_deliver_nolock(b, /* final = */ false);
+    pthread_mutex_unlock(&b->lock);
+  }
+  pthread_mutex_unlock(&cpy_write_batches_lock);
+}
+
+static void cpy_write_batch_destroy(void *data) {
+  cpy_write_batch_t *b = data;
+
+  pthread_mutex_lock(&cpy_write_batches_lock);
+  for (cpy_write_batch_t **ptr = &cpy_write_batches; *ptr != NULL;
+       ptr = &(*ptr)->next) {
+    if (*ptr == b) {
+      *ptr = b->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&cpy_write_batches_lock);
+
+  pthread_mutex_lock(&b->lock);
+  cpy_write_batch_deliver_nolock(b, /* final = */ true);
+  cpy_write_batch_clear(b);
+  pthread_mutex_unlock(&b->lock);
+  pthread_mutex_destroy(&b->lock);
+
+  sfree(b->ds);
+  sfree(b->vl);
+  cpy_destroy_user_data(b->callback);
+  sfree(b);
+}
+
 static int cpy_notification_callback(const notification_t *notification,
                                      user_data_t *data) {
   cpy_callback_t *c = data->data;
@@ -838,6 +1033,76 @@ static PyObject *cpy_register_write(PyObject *self, PyObject *args,
                                        (void *)cpy_write_callback, args, kwds);
 }
 
+static PyObject *cpy_register_write_batch(PyObject *self, PyObject *args,
+                                          PyObject *kwds) {
+  char buf[512];
+  cpy_callback_t *c = NULL;
+  cpy_write_batch_t *b = NULL;
+  int batch_size = 64;
+  char *name = NULL;
+  PyObject *callback = NULL, *data = NULL;
+  static char *kwlist[] = {"callback", "batch_size", "data", "name", NULL};
+
+  if (PyArg_ParseTupleAndKeywords(args, kwds, "O|iOet", kwlist, &callback,
+                                  &batch_size, &data, NULL, &name) == 0)
+    return NULL;
+  if (PyCallable_Check(callback) == 0) {
+    PyMem_Free(name);
+    PyErr_SetString(PyExc_TypeError, "callback needs a be a callable object.");
+    return NULL;
+  }
+  if (batch_size < 1) {
+    PyMem_Free(name);
+    PyErr_SetString(PyExc_ValueError, "batch_size must be positive.");
+    return NULL;
+  }
+  cpy_build_name(buf, sizeof(buf), callback, name);
+  PyMem_Free(name);
+
+  c = calloc(1, sizeof(*c));
+  b = calloc(1, sizeof(*b));
+  if ((c == NULL) || (b == NULL)) {
+    free(c);
+    free(b);
+    return PyErr_NoMemory();
+  }
+  b->ds = calloc((size_t)batch_size, sizeof(*b->ds));
+  b->vl = calloc((size_t)batch_size, sizeof(*b->vl));
+  if ((b->ds == NULL) || (b->vl == NULL)) {
+    free(b->ds);
+    free(b->vl);
+    free(c);
+    free(b);
+    return PyErr_NoMemory();
+  }
+
+  Py_INCREF(callback);
+  Py_XINCREF(data);
+
+  c->name = strdup(buf);
+  c->callback = callback;
+  c->data = data;
+  c->next = NULL;
+
+  b->callback = c;
+  b->size = (size_t)batch_size;
+  b->timeout = plugin_get_interval();
+  pthread_mutex_init(&b->lock, NULL);
+
+  pthread_mutex_lock(&cpy_write_batches_lock);
+  b->next = cpy_write_batches;
+  cpy_write_batches = b;
+  pthread_mutex_unlock(&cpy_write_batches_lock);
+
+  plugin_register_write(buf, cpy_write_batch_callback,
+                        &(user_data_t){
+                            .data = b,
+                            .free_func = cpy_write_batch_destroy,
+                        });
+  ++cpy_num_callbacks;
+  return cpy_string_to_unicode_or_bytes(buf);
+}
+
 static PyObject *cpy_register_notification(PyObject *self, PyObject *args,
                                            PyObject *kwds) {
   return cpy_register_generic_userdata((void *)plugin_register_notification,
@@ -984,7 +1249,13 @@ cpy_unregister_generic_userdata(cpy_unregister_function_t *unreg, PyObject *arg,
     cpy_build_name(buf, sizeof(buf), arg, NULL);
     name = buf;
   }
-  if (unreg(name) == 0) {
+  /* Batch writers deliver their pending values when being unregistered, which
+   * requires acquiring their lock before the GIL. */
+  int status;
+  Py_BEGIN_ALLOW_THREADS;
+  status = unreg(name);
+  Py_END_ALLOW_THREADS;
+  if (status == 0) {
     Py_DECREF(arg);
     Py_RETURN_NONE;
   }
@@ -1035,6 +1306,8 @@ static PyMethodDef cpy_methods[] = {
     {"error", cpy_error, METH_VARARGS, log_doc},
     {"get_dataset", (PyCFunction)cpy_get_dataset, METH_VARARGS, get_ds_doc},
     {"flush", (PyCFunction)cpy_flush, METH_VARARGS | METH_KEYWORDS, flush_doc},
+    {"dispatch_many", (PyCFunction)cpy_dispatch_many,
+     METH_VARARGS | METH_KEYWORDS, dispatch_many_doc},
     {"register_log", (PyCFunction)cpy_register_log,
      METH_VARARGS | METH_KEYWORDS, reg_log_doc},
     {"register_init", (PyCFunction)cpy_register_init,
@@ -1045,6 +1318,8 @@ static PyMethodDef cpy_methods[] = {
      METH_VARARGS | METH_KEYWORDS, reg_read_doc},
     {"register_write", (PyCFunction)cpy_register_write,
      METH_VARARGS | METH_KEYWORDS, reg_write_doc},
+    {"register_write_batch", (PyCFunction)cpy_register_write_batch,
+     METH_VARARGS | METH_KEYWORDS, reg_write_batch_doc},
     {"register_notification", (PyCFunction)cpy_register_notification,
      METH_VARARGS | METH_KEYWORDS, reg_notification_doc},
     {"register_flush", (PyCFunction)cpy_register_flush,
@@ -1078,6 +1353,9 @@ static int cpy_shutdown(void) {
         "================================================================\n");
   }
 
+  /* Hand pending values to batch writers while their modules still work. */
+  cpy_write_batches_flush();
+
   CPY_LOCK_THREADS
 
   for (cpy_callback_t *c = cpy_shutdown_callbacks; c; c = c->next) {
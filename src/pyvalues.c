@@ -586,69 +586,28 @@ static void cpy_build_notification_meta(notification_t *n, PyObject *meta) {
   cpy_build_meta_generic(meta, &cpy_plugin_notification_meta, (void *)n);
 }
 
-static PyObject *Values_dispatch(Values *self, PyObject *args, PyObject *kwds) {
-  int ret;
-  const data_set_t *ds;
+/* Converts the list or tuple "values" into the "ds->ds_num" values of "value"
+ * according to the data source types. Returns -1 with a Python exception set
+ * on failure. */
+static int cpy_build_values(const data_set_t *ds, PyObject *values,
+                            value_t *value) {
   size_t size;
-  value_t *value;
-  value_list_t value_list = VALUE_LIST_INIT;
-  PyObject *values = self->values, *meta = self->meta;
-  double time = self->data.time, interval = self->interval;
-  char *host = NULL, *plugin = NULL, *plugin_instance = NULL, *type = NULL,
-       *type_instance = NULL;
-
-  static char *kwlist[] = {
-      "type", "values", "plugin_instance", "type_instance", "plugin",
-      "host", "time",   "interval",        "meta",          NULL};
-  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|etOetetetetddO", kwlist, NULL,
-                                   &type, &values, NULL, &plugin_instance, NULL,
-                                   &type_instance, NULL, &plugin, NULL, &host,
-                                   &time, &interval, &meta))
-    return NULL;
 
-  sstrncpy(value_list.host, host ? host : self->data.host,
-           sizeof(value_list.host));
-  sstrncpy(value_list.plugin, plugin ? plugin : self->data.plugin,
-           sizeof(value_list.plugin));
-  sstrncpy(value_list.plugin_instance,
-           plugin_instance ? plugin_instance : self->data.plugin_instance,
-           sizeof(value_list.plugin_instance));
-  sstrncpy(value_list.type, type ? type : self->data.type,
-           sizeof(value_list.type));
-  sstrncpy(value_list.type_instance,
-           type_instance ? type_instance : self->data.type_instance,
-           sizeof(value_list.type_instance));
-  FreeAll();
-  if (value_list.type[0] == 0) {
-    PyErr_SetString(PyExc_RuntimeError, "type not set");
-    FreeAll();
-    return NULL;
-  }
-  ds = plugin_get_ds(value_list.type);
-  if (ds == NULL) {
-    PyErr_Format(PyExc_TypeError, "Dataset %s not found", value_list.type);
-    return NULL;
-  }
   if (values == NULL ||
       (PyTuple_Check(values) == 0 && PyList_Check(values) == 0)) {
     PyErr_Format(PyExc_TypeError, "values must be list or tuple");
-    return NULL;
-  }
-  if (meta != NULL && meta != Py_None && !PyDict_Check(meta)) {
-    PyErr_Format(PyExc_TypeError, "meta must be a dict");
-    return NULL;
+    return -1;
   }
   size = (size_t)PySequence_Length(values);
   if (size != ds->ds_num) {
     PyErr_Format(PyExc_RuntimeError,
-                 "type %s needs %" PRIsz " values, got %" PRIsz,
-                 value_list.type, ds->ds_num, size);
-    return NULL;
+                 "type %s needs %" PRIsz " values, got %" PRIsz, ds->type,
+                 ds->ds_num, size);
+    return -1;
   }
-  value = calloc(size, sizeof(*value));
   for (size_t i = 0; i < size; ++i) {
     PyObject *item, *num;
-    item = PySequence_Fast_GET_ITEM(values, (int)i); /* Borrowed reference. */
+    item = PySequence_Fast_GET_ITEM(values, i); /* Borrowed reference. */
     switch (ds->ds[i].type) {
     case DS_TYPE_COUNTER:
       num = PyNumber_Long(item); /* New reference. */
@@ -683,15 +642,70 @@ static PyObject *Values_dispatch(Values *self, PyObject *args, PyObject *kwds) {
       }
       break;
     default:
-      free(value);
       PyErr_Format(PyExc_RuntimeError, "unknown data type %d for %s",
-                   ds->ds[i].type, value_list.type);
-      return NULL;
-    }
-    if (PyErr_Occurred() != NULL) {
-      free(value);
-      return NULL;
+                   ds->ds[i].type, ds->type);
+      return -1;
     }
+    if (PyErr_Occurred() != NULL)
+      return -1;
+  }
+  return 0;
+}
+
+static PyObject *Values_dispatch(Values *self, PyObject *args, PyObject *kwds) {
+  int ret;
+  const data_set_t *ds;
+  size_t size;
+  value_t *value;
+  value_list_t value_list = VALUE_LIST_INIT;
+  PyObject *values = self->values, *meta = self->meta;
+  double time = self->data.time, interval = self->interval;
+  char *host = NULL, *plugin = NULL, *plugin_instance = NULL, *type = NULL,
+       *type_instance = NULL;
+
+  static char *kwlist[] = {
+      "type", "values", "plugin_instance", "type_instance", "plugin",
+      "host", "time",   "interval",        "meta",          NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|etOetetetetddO", kwlist, NULL,
+                                   &type, &values, NULL, &plugin_instance, NULL,
+                                   &type_instance, NULL, &plugin, NULL, &host,
+                                   &time, &interval, &meta))
+    return NULL;
+
+  sstrncpy(value_list.host, host ? host : self->data.host,
+           sizeof(value_list.host));
+  sstrncpy(value_list.plugin, plugin ? plugin : self->data.plugin,
+           sizeof(value_list.plugin));
+  sstrncpy(value_list.plugin_instance,
+           plugin_instance ? plugin_instance : self->data.plugin_instance,
+           sizeof(value_list.plugin_instance));
+  sstrncpy(value_list.type, type ? type : self->data.type,
+           sizeof(value_list.type));
+  sstrncpy(value_list.type_instance,
+           type_instance ? type_instance : self->data.type_instance,
+           sizeof(value_list.type_instance));
+  FreeAll();
+  if (value_list.type[0] == 0) {
+    PyErr_SetString(PyExc_RuntimeError, "type not set");
+    FreeAll();
+    return NULL;
+  }
+  ds = plugin_get_ds(value_list.type);
+  if (ds == NULL) {
+    PyErr_Format(PyExc_TypeError, "Dataset %s not found", value_list.type);
+    return NULL;
+  }
+  if (meta != NULL && meta != Py_None && !PyDict_Check(meta)) {
+    PyErr_Format(PyExc_TypeError, "meta must be a dict");
+    return NULL;
+  }
+  size = ds->ds_num;
+  value = calloc(size, sizeof(*value));
+  if (value == NULL)
+    return PyErr_NoMemory();
+  if (cpy_build_values(ds, values, value) != 0) {
+    free(value);
+    return NULL;
   }
   value_list.values = value;
   value_list.meta = cpy_build_meta(meta);
@@ -758,65 +772,13 @@ static PyObject *Values_write(Values *self, PyObject *args, PyObject *kwds) {
     PyErr_Format(PyExc_TypeError, "Dataset %s not found", value_list.type);
     return NULL;
   }
-  if (values == NULL ||
-      (PyTuple_Check(values) == 0 && PyList_Check(values) == 0)) {
-    PyErr_Format(PyExc_TypeError, "values must be list or tuple");
-    return NULL;
-  }
-  size = (size_t)PySequence_Length(values);
-  if (size != ds->ds_num) {
-    PyErr_Format(PyExc_RuntimeError,
-                 "type %s needs %" PRIsz " values, got %" PRIsz,
-                 value_list.type, ds->ds_num, size);
-    return NULL;
-  }
+  size = ds->ds_num;
   value = calloc(size, sizeof(*value));
-  for (size_t i = 0; i < size; ++i) {
-    PyObject *item, *num;
-    item = PySequence_Fast_GET_ITEM(values, i); /* Borrowed reference. */
-    switch (ds->ds[i].type) {
-    case DS_TYPE_COUNTER:
-      num = PyNumber_Long(item); /* New reference. */
-      if (num != NULL) {
-        value[i].counter = PyLong_AsUnsignedLongLong(num);
-        Py_XDECREF(num);
-      }
-      break;
-    case DS_TYPE_GAUGE:
-      num = PyNumber_Float(item); /* New reference. */
-      if (num != NULL) {
-        value[i].gauge = PyFloat_AsDouble(num);
-        Py_XDECREF(num);
-      }
-      break;
-    case DS_TYPE_DERIVE:
-      /* This might overflow without raising an exception.
-       * Not much we can do about it */
-      num = PyNumber_Long(item); /* New reference. */
-      if (num != NULL) {
-        value[i].derive = PyLong_AsLongLong(num);
-        Py_XDECREF(num);
-      }
-      break;
-    case DS_TYPE_ABSOLUTE:
-      /* This might overflow without raising an exception.
-       * Not much we can do about it */
-      num = PyNumber_Long(item); /* New reference. */
-      if (num != NULL) {
-        value[i].absolute = PyLong_AsUnsignedLongLong(num);
-        Py_XDECREF(num);
-      }
-      break;
-    default:
-      free(value);
-      PyErr_Format(PyExc_RuntimeError, "unknown data type %d for %s",
-                   ds->ds[i].type, value_list.type);
-      return NULL;
-    }
-    if (PyErr_Occurred() != NULL) {
-      free(value);
-      return NULL;
-    }
+  if (value == NULL)
+    return PyErr_NoMemory();
+  if (cpy_build_values(ds, values, value) != 0) {
+    free(value);
+    return NULL;
   }
   value_list.values = value;
   value_list.values_len = size;
@@ -840,6 +802,266 @@ static PyObject *Values_write(Values *self, PyObject *args, PyObject *kwds) {
   Py_RETURN_NONE;
 }
 
+/* Copies identifier, time and interval of "v" into "vl", filling in the same
+ * defaults as Values.dispatch(). */
+static void cpy_values_identity(Values const *v, value_list_t *vl) {
+  sstrncpy(vl->host, (v->data.host[0] != 0) ? v->data.host : hostname_g,
+           sizeof(vl->host));
+  sstrncpy(vl->plugin, (v->data.plugin[0] != 0) ? v->data.plugin : "python",
+           sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, v->data.plugin_instance,
+           sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, v->data.type, sizeof(vl->type));
+  sstrncpy(vl->type_instance, v->data.type_instance,
+           sizeof(vl->type_instance));
+  vl->time = DOUBLE_TO_CDTIME_T(v->data.time);
+  vl->interval = DOUBLE_TO_CDTIME_T(v->interval);
+}
+
+static int cpy_check_meta(PyObject *meta) {
+  if (meta != NULL && meta != Py_None && !PyDict_Check(meta)) {
+    PyErr_Format(PyExc_TypeError, "meta must be a dict");
+    return -1;
+  }
+  return 0;
+}
+
+/* dispatch_many(values, template, instances): "seq" holds one list of values
+ * per type instance. All of them share the identifier of "base" and are handed
+ * to plugin_dispatch_instances() in one go. */
+static PyObject *cpy_dispatch_many_instances(value_list_t *base,
+                                             PyObject *instances,
+                                             PyObject *seq) {
+  size_t num = (size_t)PySequence_Fast_GET_SIZE(seq);
+  const data_set_t *ds;
+  PyObject *inst;
+  value_t *value = NULL;
+  char *names = NULL;
+  char const **names_ptr = NULL;
+  PyObject *ret = NULL;
+  int status;
+
+  if (base->type[0] == 0) {
+    PyErr_SetString(PyExc_RuntimeError, "type not set");
+    return NULL;
+  }
+  ds = plugin_get_ds(base->type);
+  if (ds == NULL) {
+    PyErr_Format(PyExc_TypeError, "Dataset %s not found", base->type);
+    return NULL;
+  }
+
+  inst = PySequence_Fast(instances, "instances must be a sequence");
+  if (inst == NULL)
+    return NULL;
+  if ((size_t)PySequence_Fast_GET_SIZE(inst) != num) {
+    PyErr_Format(PyExc_ValueError,
+                 "got %" PRIsz " instances but %" PRIsz " lists of values",
+                 (size_t)PySequence_Fast_GET_SIZE(inst), num);
+    goto out;
+  }
+  if (num == 0) {
+    ret = Py_None;
+    Py_INCREF(ret);
+    goto out;
+  }
+
+  value = calloc(num * ds->ds_num, sizeof(*value));
+  names = calloc(num, DATA_MAX_NAME_LEN);
+  names_ptr = calloc(num, sizeof(*names_ptr));
+  if (value == NULL || names == NULL || names_ptr == NULL) {
+    PyErr_NoMemory();
+    goto out;
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    PyObject *name = PySequence_Fast_GET_ITEM(inst, i); /* Borrowed. */
+    const char *str;
+
+    Py_INCREF(name);
+    str = cpy_unicode_or_bytes_to_string(&name);
+    if (str == NULL) {
+      Py_DECREF(name);
+      goto out;
+    }
+    names_ptr[i] = names + i * DATA_MAX_NAME_LEN;
+    sstrncpy(names + i * DATA_MAX_NAME_LEN, str, DATA_MAX_NAME_LEN);
+    Py_DECREF(name);
+
+    if (cpy_build_values(ds, PySequence_Fast_GET_ITEM(seq, i),
+                         value + i * ds->ds_num) != 0)
+      goto out;
+  }
+
+  base->values_len = ds->ds_num;
+  Py_BEGIN_ALLOW_THREADS;
+  status = plugin_dispatch_instances(base, names_ptr, value, num);
+  Py_END_ALLOW_THREADS;
+  if (status != 0) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "error dispatching values, read the logs");
+    goto out;
+  }
+  ret = Py_None;
+  Py_INCREF(ret);
+
+out:
+  free(names_ptr);
+  free(names);
+  free(value);
+  Py_DECREF(inst);
+  return ret;
+}
+
+/* dispatch_many(values[, template]): every element of "seq" is either a
+ * Values object or a (type, type_instance, values) tuple which takes the rest
+ * of its identifier from "base". All value lists are converted first and then
+ * handed to plugin_dispatch_values_batch() at once. */
+static PyObject *cpy_dispatch_many_list(value_list_t *base, PyObject *seq) {
+  size_t num = (size_t)PySequence_Fast_GET_SIZE(seq);
+  const data_set_t *ds = NULL;
+  value_list_t *vl;
+  size_t vl_num = 0;
+  PyObject *ret = NULL;
+  int status;
+
+  if (num == 0)
+    Py_RETURN_NONE;
+
+  vl = calloc(num, sizeof(*vl));
+  if (vl == NULL)
+    return PyErr_NoMemory();
+
+  for (size_t i = 0; i < num; i++) {
+    PyObject *item = PySequence_Fast_GET_ITEM(seq, i); /* Borrowed. */
+    PyObject *values;
+
+    vl[i] = *base;
+    vl[i].values = NULL;
+    vl_num++;
+
+    if (PyObject_TypeCheck(item, &ValuesType)) {
+      Values *v = (Values *)item;
+
+      vl[i].meta = NULL;
+      if (cpy_check_meta(v->meta) != 0)
+        goto out;
+      cpy_values_identity(v, vl + i);
+      vl[i].meta = cpy_build_meta(v->meta);
+      values = v->values;
+    } else if (PyTuple_Check(item) && PyTuple_GET_SIZE(item) == 3) {
+      char *type = NULL, *type_instance = NULL;
+
+      if (!PyArg_ParseTuple(item, "etetO", NULL, &type, NULL, &type_instance,
+                            &values))
+        goto out;
+      sstrncpy(vl[i].type, type, sizeof(vl[i].type));
+      sstrncpy(vl[i].type_instance, type_instance,
+               sizeof(vl[i].type_instance));
+      PyMem_Free(type);
+      PyMem_Free(type_instance);
+    } else {
+      PyErr_SetString(PyExc_TypeError,
+                      "values must contain Values objects or "
+                      "(type, type_instance, values) tuples");
+      goto out;
+    }
+
+    if (vl[i].type[0] == 0) {
+      PyErr_SetString(PyExc_RuntimeError, "type not set");
+      goto out;
+    }
+    /* Collectors usually emit runs of the same type. */
+    if ((ds == NULL) || (strcmp(ds->type, vl[i].type) != 0)) {
+      ds = plugin_get_ds(vl[i].type);
+      if (ds == NULL) {
+        PyErr_Format(PyExc_TypeError, "Dataset %s not found", vl[i].type);
+        goto out;
+      }
+    }
+
+    vl[i].values = calloc(ds->ds_num, sizeof(*vl[i].values));
+    if (vl[i].values == NULL) {
+      PyErr_NoMemory();
+      goto out;
+    }
+    vl[i].values_len = ds->ds_num;
+    if (cpy_build_values(ds, values, vl[i].values) != 0)
+      goto out;
+  }
+
+  Py_BEGIN_ALLOW_THREADS;
+  status = plugin_dispatch_values_batch(vl, num);
+  Py_END_ALLOW_THREADS;
+  if (status != 0) {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "error dispatching values, read the logs");
+    goto out;
+  }
+  ret = Py_None;
+  Py_INCREF(ret);
+
+out:
+  for (size_t i = 0; i < vl_num; i++) {
+    free(vl[i].values);
+    if (vl[i].meta != base->meta)
+      meta_data_destroy(vl[i].meta);
+  }
+  free(vl);
+  return ret;
+}
+
+PyObject *cpy_dispatch_many(PyObject *self, PyObject *args, PyObject *kwds) {
+  PyObject *values, *template = NULL, *instances = NULL;
+  value_list_t base = VALUE_LIST_INIT;
+  PyObject *seq, *ret;
+
+  static char *kwlist[] = {"values", "template", "instances", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", kwlist, &values,
+                                   &template, &instances))
+    return NULL;
+
+  if (template == Py_None)
+    template = NULL;
+  if (instances == Py_None)
+    instances = NULL;
+
+  if (template != NULL) {
+    if (!PyObject_TypeCheck(template, &ValuesType)) {
+      PyErr_SetString(PyExc_TypeError, "template must be a Values object");
+      return NULL;
+    }
+    if (cpy_check_meta(((Values *)template)->meta) != 0)
+      return NULL;
+    cpy_values_identity((Values *)template, &base);
+  } else {
+    sstrncpy(base.host, hostname_g, sizeof(base.host));
+    sstrncpy(base.plugin, "python", sizeof(base.plugin));
+  }
+  if ((instances != NULL) && (template == NULL)) {
+    PyErr_SetString(PyExc_TypeError, "instances require a template");
+    return NULL;
+  }
+
+  seq = PySequence_Fast(values, "values must be a sequence");
+  if (seq == NULL)
+    return NULL;
+
+  /* The template's meta data is converted once and shared by all value
+   * lists built from it. */
+  if (template != NULL)
+    base.meta = cpy_build_meta(((Values *)template)->meta);
+
+  if (instances != NULL)
+    ret = cpy_dispatch_many_instances(&base, instances, seq);
+  else
+    ret = cpy_dispatch_many_list(&base, seq);
+
+  meta_data_destroy(base.meta);
+  Py_DECREF(seq);
+  return ret;
+}
+
 static PyObject *Values_repr(PyObject *s) {
   PyObject *ret, *tmp;
   static PyObject *l_interval, *l_values, *l_meta, *l_closing;
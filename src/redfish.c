@@ -71,6 +71,9 @@ struct redfish_service_s {
   size_t queries_num;
   enumeratorAuthentication auth;
   redfishService *redfish;
+  /* Number of queries that have been queued or sent but not answered yet.
+   * Protected by ctx.jobs_lock. */
+  size_t jobs_pending;
 };
 typedef struct redfish_service_s redfish_service_t;
 
@@ -101,12 +104,19 @@ struct redfish_ctx_s {
   llist_t *services;
   c_avl_tree_t *queries;
   pthread_t worker_thread;
+  bool worker_running;
+  bool worker_stop;
+  pthread_mutex_t jobs_lock;
+  pthread_cond_t jobs_cond;
   redfish_job_list_t jobs;
 };
 typedef struct redfish_ctx_s redfish_ctx_t;
 
 /* Globals */
-static redfish_ctx_t ctx;
+static redfish_ctx_t ctx = {
+    .jobs_lock = PTHREAD_MUTEX_INITIALIZER,
+    .jobs_cond = PTHREAD_COND_INITIALIZER,
+};
 
 static int redfish_cleanup(void);
 static int redfish_validate_config(void);
@@ -195,6 +205,15 @@ static void redfish_job_destroy(redfish_job_t *job) {
   sfree(job);
 }
 
+/* Marks the job's query as answered and destroys the job. */
+static void redfish_job_done(redfish_job_t *job) {
+  pthread_mutex_lock(&ctx.jobs_lock);
+  job->service_query->service->jobs_pending--;
+  pthread_mutex_unlock(&ctx.jobs_lock);
+
+  redfish_job_destroy(job);
+}
+
 static int redfish_init(void) {
 #if COLLECT_DEBUG
   /* Registering plugin_log as the printing function dedicated to logging
@@ -211,12 +230,14 @@ static int redfish_init(void) {
   }
 
   DEQ_INIT(ctx.jobs);
+  ctx.worker_stop = false;
   ret = pthread_create(&ctx.worker_thread, NULL, redfish_worker_thread, NULL);
 
   if (ret != 0) {
     ERROR(PLUGIN_NAME ": Creation of thread failed");
     return ret;
   }
+  ctx.worker_running = true;
 
   for (llentry_t *le = llist_head(ctx.services); le != NULL; le = le->next) {
     redfish_service_t *service = (redfish_service_t *)le->value;
@@ -861,30 +882,38 @@ static void redfish_process_payload(bool success, unsigned short http_code,
 
 free_job:
   cleanupPayload(payload);
-  redfish_job_destroy(job);
+  redfish_job_done(job);
 }
 
 static void *redfish_worker_thread(void __attribute__((unused)) * args) {
   INFO(PLUGIN_NAME ": Worker is running");
 
-  for (;;) {
-    usleep(10);
-
-    if (DEQ_IS_EMPTY(ctx.jobs))
+  pthread_mutex_lock(&ctx.jobs_lock);
+  while (!ctx.worker_stop) {
+    if (DEQ_IS_EMPTY(ctx.jobs)) {
+      pthread_cond_wait(&ctx.jobs_cond, &ctx.jobs_lock);
       continue;
-
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    }
 
     redfish_job_t *job = DEQ_HEAD(ctx.jobs);
-    getPayloadByPathAsync(job->service_query->service->redfish,
-                          job->service_query->query->endpoint, NULL,
-                          redfish_process_payload, job);
     DEQ_REMOVE_HEAD(ctx.jobs);
+    pthread_mutex_unlock(&ctx.jobs_lock);
+
+    /* The request is sent by libredfish's own thread of the service, which
+     * keeps the connection to the BMC open between requests. */
+    if (!getPayloadByPathAsync(job->service_query->service->redfish,
+                               job->service_query->query->endpoint, NULL,
+                               redfish_process_payload, job)) {
+      WARNING(PLUGIN_NAME ": Sending query \"%s\" to service \"%s\" failed",
+              job->service_query->query->name,
+              job->service_query->service->name);
+      redfish_job_done(job);
+    }
 
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    pthread_mutex_lock(&ctx.jobs_lock);
   }
+  pthread_mutex_unlock(&ctx.jobs_lock);
 
-  pthread_exit(NULL);
   return NULL;
 }
 
@@ -892,6 +921,18 @@ static int redfish_read(__attribute__((unused)) user_data_t *ud) {
   for (llentry_t *le = llist_head(ctx.services); le != NULL; le = le->next) {
     redfish_service_t *service = (redfish_service_t *)le->value;
 
+    /* Don't queue more queries for a BMC that hasn't answered the previous
+     * ones yet, so that a slow BMC doesn't build up a backlog. */
+    pthread_mutex_lock(&ctx.jobs_lock);
+    size_t pending = service->jobs_pending;
+    pthread_mutex_unlock(&ctx.jobs_lock);
+    if (pending > 0) {
+      WARNING(PLUGIN_NAME ": Service \"%s\" has %" PRIsz " pending "
+                          "queries, skipping this interval",
+              service->name, pending);
+      continue;
+    }
+
     for (llentry_t *le = llist_head(service->query_ptrs); le != NULL;
          le = le->next) {
       redfish_query_t *query = (redfish_query_t *)le->value;
@@ -916,7 +957,11 @@ static int redfish_read(__attribute__((unused)) user_data_t *ud) {
       serv_res->service = service;
       job->service_query = serv_res;
 
+      pthread_mutex_lock(&ctx.jobs_lock);
       DEQ_INSERT_TAIL(ctx.jobs, job);
+      service->jobs_pending++;
+      pthread_cond_signal(&ctx.jobs_cond);
+      pthread_mutex_unlock(&ctx.jobs_lock);
     }
   }
   return 0;
@@ -925,18 +970,25 @@ static int redfish_read(__attribute__((unused)) user_data_t *ud) {
 static int redfish_cleanup(void) {
   INFO(PLUGIN_NAME ": Cleaning up");
   /* Shutting down a worker thread */
-  if (pthread_cancel(ctx.worker_thread) != 0)
-    ERROR(PLUGIN_NAME ": Failed to cancel the worker thread");
-
-  if (pthread_join(ctx.worker_thread, NULL) != 0)
-    ERROR(PLUGIN_NAME ": Failed to join the worker thread");
+  if (ctx.worker_running) {
+    pthread_mutex_lock(&ctx.jobs_lock);
+    ctx.worker_stop = true;
+    pthread_cond_broadcast(&ctx.jobs_cond);
+    pthread_mutex_unlock(&ctx.jobs_lock);
+
+    if (pthread_join(ctx.worker_thread, NULL) != 0)
+      ERROR(PLUGIN_NAME ": Failed to join the worker thread");
+    ctx.worker_running = false;
+  }
 
   /* Cleaning worker's queue */
+  pthread_mutex_lock(&ctx.jobs_lock);
   while (!DEQ_IS_EMPTY(ctx.jobs)) {
     redfish_job_t *job = DEQ_HEAD(ctx.jobs);
     DEQ_REMOVE_HEAD(ctx.jobs);
     redfish_job_destroy(job);
   }
+  pthread_mutex_unlock(&ctx.jobs_lock);
 
   for (llentry_t *le = llist_head(ctx.services); le; le = le->next) {
     redfish_service_t *service = (redfish_service_t *)le->value;
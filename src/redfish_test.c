@@ -559,6 +559,19 @@ DEF_TEST(job_destroy) {
   return 0;
 }
 
+DEF_TEST(job_done) {
+  redfish_service_t service = {.jobs_pending = 2};
+  redfish_job_t *job = calloc(1, sizeof(*job));
+  CHECK_NOT_NULL(job);
+  job->service_query = calloc(1, sizeof(*job->service_query));
+  CHECK_NOT_NULL(job->service_query);
+  job->service_query->service = &service;
+
+  redfish_job_done(job);
+  EXPECT_EQ_UINT64(1, service.jobs_pending);
+  return 0;
+}
+
 DEF_TEST(json_get_string_1) {
   const char *json_text = "{ \"MemberId\": \"1234\" }";
 
@@ -610,6 +623,7 @@ int main(void) {
   RUN_TEST(process_payload_property);
   RUN_TEST(service_destroy);
   RUN_TEST(job_destroy);
+  RUN_TEST(job_done);
   RUN_TEST(json_get_string_1);
   RUN_TEST(json_get_string_2);
   END_TEST;
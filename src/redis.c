@@ -77,6 +77,8 @@ struct redis_node_s {
   bool report_command_stats;
   bool report_cpu_usage;
   redisContext *redisContext;
+  /* Database selected on the connection, -1 if unknown. */
+  int database;
   redis_query_t *queries;
   prev_t prev;
 
@@ -359,44 +361,140 @@ static void *c_redisCommand(redis_node_t *rn, const char *format, ...) {
   return reply;
 } /* void c_redisCommand */
 
-static int redis_get_info_value(char const *info_line, char const *field_name,
-                                int ds_type, value_t *val) {
-  char *str = strstr(info_line, field_name);
-  static char buf[MAX_REDIS_VAL_SIZE];
-  if (str) {
-    int i;
-
-    str += strlen(field_name) + 1; /* also skip the ':' */
-    for (i = 0; (*str && (isdigit((unsigned char)*str) || *str == '.'));
-         i++, str++)
-      buf[i] = *str;
-    buf[i] = '\0';
-
-    if (parse_value(buf, val, ds_type) == -1) {
-      WARNING("redis plugin: Unable to parse field `%s'.", field_name);
-      return -1;
-    }
+/* c_redisAppendCommand queues a command in the output buffer of the
+ * connection. The commands are sent by the first c_redisGetReply call. */
+static int c_redisAppendCommand(redis_node_t *rn, const char *format, ...) {
+  redisContext *c = rn->redisContext;
 
-    return 0;
-  }
-  return -1;
-} /* int redis_get_info_value */
+  if (c == NULL)
+    return -1;
 
-static int redis_handle_info(char *node, char const *info_line,
-                             char const *type, char const *type_instance,
-                             char const *field_name, int ds_type) /* {{{ */
-{
-  value_t val;
-  if (redis_get_info_value(info_line, field_name, ds_type, &val) != 0)
+  va_list ap;
+  va_start(ap, format);
+  int status = redisvAppendCommand(c, format, ap);
+  va_end(ap);
+
+  if (status != REDIS_OK) {
+    ERROR("redis plugin: Connection error: %s", c->errstr);
+    redisFree(rn->redisContext);
+    rn->redisContext = NULL;
     return -1;
+  }
 
-  redis_submit(node, type, type_instance, val);
   return 0;
-} /* }}} int redis_handle_info */
+} /* int c_redisAppendCommand */
+
+static redisReply *c_redisGetReply(redis_node_t *rn) {
+  redisContext *c = rn->redisContext;
+
+  if (c == NULL)
+    return NULL;
 
-static int redis_handle_query(redis_node_t *rn, redis_query_t *rq) /* {{{ */
+  void *reply = NULL;
+  if ((redisGetReply(c, &reply) != REDIS_OK) || (reply == NULL)) {
+    ERROR("redis plugin: Connection error: %s", c->errstr);
+    redisFree(rn->redisContext);
+    rn->redisContext = NULL;
+    return NULL;
+  }
+
+  return reply;
+} /* redisReply *c_redisGetReply */
+
+/* Fields of the INFO output the plugin is interested in. */
+enum {
+  RI_UPTIME,
+  RI_CONNECTED_CLIENTS,
+  RI_BLOCKED_CLIENTS,
+  RI_USED_MEMORY,
+  RI_USED_MEMORY_LUA,
+  RI_CHANGES_SINCE_LAST_SAVE,
+  RI_RDB_CHANGES_SINCE_LAST_SAVE,
+  RI_TOTAL_CONNECTIONS_RECEIVED,
+  RI_TOTAL_COMMANDS_PROCESSED,
+  RI_EXPIRED_KEYS,
+  RI_EVICTED_KEYS,
+  RI_PUBSUB_CHANNELS,
+  RI_PUBSUB_PATTERNS,
+  RI_CONNECTED_SLAVES,
+  RI_TOTAL_NET_INPUT_BYTES,
+  RI_TOTAL_NET_OUTPUT_BYTES,
+  /* Not dispatched as is, see redis_submit_info(). */
+  RI_KEYSPACE_HITS,
+  RI_KEYSPACE_MISSES,
+  RI_USED_CPU_USER,
+  RI_USED_CPU_SYS,
+  RI_USED_CPU_USER_CHILDREN,
+  RI_USED_CPU_SYS_CHILDREN,
+  RI_FIELDS_NUM,
+};
+
+typedef struct {
+  const char *field;
+  size_t field_len;
+  const char *type;
+  const char *type_instance;
+  int ds_type;
+} redis_info_field_t;
+
+#define RI_FIELD(f) f, sizeof(f) - 1
+
+static const redis_info_field_t redis_info_fields[RI_FIELDS_NUM] = {
+    [RI_UPTIME] = {RI_FIELD("uptime_in_seconds"), "uptime", NULL,
+                   DS_TYPE_GAUGE},
+    [RI_CONNECTED_CLIENTS] = {RI_FIELD("connected_clients"),
+                              "current_connections", "clients", DS_TYPE_GAUGE},
+    [RI_BLOCKED_CLIENTS] = {RI_FIELD("blocked_clients"), "blocked_clients",
+                            NULL, DS_TYPE_GAUGE},
+    [RI_USED_MEMORY] = {RI_FIELD("used_memory"), "memory", NULL, DS_TYPE_GAUGE},
+    [RI_USED_MEMORY_LUA] = {RI_FIELD("used_memory_lua"), "memory_lua", NULL,
+                            DS_TYPE_GAUGE},
+    /* changes_since_last_save: Deprecated in redis version 2.6 and above */
+    [RI_CHANGES_SINCE_LAST_SAVE] = {RI_FIELD("changes_since_last_save"),
+                                    "volatile_changes", NULL, DS_TYPE_GAUGE},
+    [RI_RDB_CHANGES_SINCE_LAST_SAVE] = {RI_FIELD("rdb_changes_since_last_save"),
+                                        "volatile_changes", NULL,
+                                        DS_TYPE_GAUGE},
+    [RI_TOTAL_CONNECTIONS_RECEIVED] = {RI_FIELD("total_connections_received"),
+                                       "total_connections", NULL,
+                                       DS_TYPE_DERIVE},
+    [RI_TOTAL_COMMANDS_PROCESSED] = {RI_FIELD("total_commands_processed"),
+                                     "total_operations", NULL, DS_TYPE_DERIVE},
+    [RI_EXPIRED_KEYS] = {RI_FIELD("expired_keys"), "expired_keys", NULL,
+                         DS_TYPE_DERIVE},
+    [RI_EVICTED_KEYS] = {RI_FIELD("evicted_keys"), "evicted_keys", NULL,
+                         DS_TYPE_DERIVE},
+    [RI_PUBSUB_CHANNELS] = {RI_FIELD("pubsub_channels"), "pubsub", "channels",
+                            DS_TYPE_GAUGE},
+    [RI_PUBSUB_PATTERNS] = {RI_FIELD("pubsub_patterns"), "pubsub", "patterns",
+                            DS_TYPE_GAUGE},
+    [RI_CONNECTED_SLAVES] = {RI_FIELD("connected_slaves"),
+                             "current_connections", "slaves", DS_TYPE_GAUGE},
+    [RI_TOTAL_NET_INPUT_BYTES] = {RI_FIELD("total_net_input_bytes"),
+                                  "total_bytes", "input", DS_TYPE_DERIVE},
+    [RI_TOTAL_NET_OUTPUT_BYTES] = {RI_FIELD("total_net_output_bytes"),
+                                   "total_bytes", "output", DS_TYPE_DERIVE},
+    [RI_KEYSPACE_HITS] = {RI_FIELD("keyspace_hits"), NULL, NULL,
+                          DS_TYPE_DERIVE},
+    [RI_KEYSPACE_MISSES] = {RI_FIELD("keyspace_misses"), NULL, NULL,
+                            DS_TYPE_DERIVE},
+    [RI_USED_CPU_USER] = {RI_FIELD("used_cpu_user"), NULL, NULL,
+                          DS_TYPE_GAUGE},
+    [RI_USED_CPU_SYS] = {RI_FIELD("used_cpu_sys"), NULL, NULL, DS_TYPE_GAUGE},
+    [RI_USED_CPU_USER_CHILDREN] = {RI_FIELD("used_cpu_user_children"), NULL,
+                                   NULL, DS_TYPE_GAUGE},
+    [RI_USED_CPU_SYS_CHILDREN] = {RI_FIELD("used_cpu_sys_children"), NULL, NULL,
+                                  DS_TYPE_GAUGE},
+};
+
+typedef struct {
+  value_t values[RI_FIELDS_NUM];
+  bool found[RI_FIELDS_NUM];
+} redis_info_t;
+
+static int redis_handle_query(redis_node_t *rn, redis_query_t *rq,
+                              redisReply *rr) /* {{{ */
 {
-  redisReply *rr;
   const data_set_t *ds;
   value_t val;
 
@@ -413,17 +511,6 @@ static int redis_handle_query(redis_node_t *rn, redis_query_t *rq) /* {{{ */
     return -1;
   }
 
-  if ((rr = c_redisCommand(rn, "SELECT %d", rq->database)) == NULL) {
-    WARNING("redis plugin: unable to switch to database `%d' on node `%s'.",
-            rq->database, rn->name);
-    return -1;
-  }
-
-  if ((rr = c_redisCommand(rn, rq->query)) == NULL) {
-    WARNING("redis plugin: unable to carry out query `%s'.", rq->query);
-    return -1;
-  }
-
   switch (rr->type) {
   case REDIS_REPLY_INTEGER:
     switch (ds->ds[0].type) {
@@ -434,119 +521,109 @@ static int redis_handle_query(redis_node_t *rn, redis_query_t *rq) /* {{{ */
       val.gauge = (gauge_t)rr->integer;
       break;
     case DS_TYPE_DERIVE:
-      val.gauge = (derive_t)rr->integer;
+      val.derive = (derive_t)rr->integer;
       break;
     case DS_TYPE_ABSOLUTE:
-      val.gauge = (absolute_t)rr->integer;
+      val.absolute = (absolute_t)rr->integer;
       break;
     }
     break;
   case REDIS_REPLY_STRING:
     if (parse_value(rr->str, &val, ds->ds[0].type) == -1) {
       WARNING("redis plugin: Query `%s': Unable to parse value.", rq->query);
-      freeReplyObject(rr);
       return -1;
     }
     break;
   case REDIS_REPLY_ERROR:
     WARNING("redis plugin: Query `%s' failed: %s.", rq->query, rr->str);
-    freeReplyObject(rr);
     return -1;
   case REDIS_REPLY_ARRAY:
     WARNING("redis plugin: Query `%s' should return string or integer. Arrays "
             "are not supported.",
             rq->query);
-    freeReplyObject(rr);
     return -1;
   default:
     WARNING("redis plugin: Query `%s': Cannot coerce redis type (%i).",
             rq->query, rr->type);
-    freeReplyObject(rr);
     return -1;
   }
 
   redis_submit(rn->name, rq->type,
                (strlen(rq->instance) > 0) ? rq->instance : NULL, val);
-  freeReplyObject(rr);
   return 0;
 } /* }}} int redis_handle_query */
 
-static int redis_db_stats(const char *node, char const *info_line) /* {{{ */
+static int redis_db_stats(const char *node, char const *db_id,
+                          char *value) /* {{{ */
 {
   /* redis_db_stats parses and dispatches Redis database statistics,
    * currently the number of keys for each database.
-   * info_line needs to have the following format:
+   * The INFO line needs to have the following format:
    *   db0:keys=4,expires=0,avg_ttl=0
    */
+  char *endptr = NULL;
+  long db = strtol(db_id, &endptr, 10);
+  if ((endptr == db_id) || (*endptr != '\0') || (db < 0) ||
+      (db >= REDIS_DEF_DB_COUNT))
+    return -1;
 
-  for (int db = 0; db < REDIS_DEF_DB_COUNT; db++) {
-    static char buf[MAX_REDIS_VAL_SIZE];
-    static char field_name[12];
-    static char db_id[4];
-    value_t val;
-    char *str;
-    int i;
-
-    ssnprintf(field_name, sizeof(field_name), "db%d:keys=", db);
-
-    str = strstr(info_line, field_name);
-    if (!str)
-      continue;
-
-    str += strlen(field_name);
-    for (i = 0; (*str && isdigit((int)*str)); i++, str++)
-      buf[i] = *str;
-    buf[i] = '\0';
+  if (strncmp(value, "keys=", strlen("keys=")) != 0)
+    return -1;
+  value += strlen("keys=");
 
-    if (parse_value(buf, &val, DS_TYPE_GAUGE) != 0) {
-      WARNING("redis plugin: Unable to parse field `%s'.", field_name);
-      return -1;
-    }
+  char *end = strchr(value, ',');
+  if (end != NULL)
+    *end = '\0';
 
-    ssnprintf(db_id, sizeof(db_id), "%d", db);
-    redis_submit(node, "records", db_id, val);
+  value_t val;
+  if (parse_value(value, &val, DS_TYPE_GAUGE) != 0) {
+    WARNING("redis plugin: Unable to parse field `db%s:keys'.", db_id);
+    return -1;
   }
-  return 0;
 
+  redis_submit(node, "records", db_id, val);
+  return 0;
 } /* }}} int redis_db_stats */
 
-static void redis_cpu_usage(const char *node, char const *info_line) {
-  while (42) {
-    value_t rusage_user;
-    value_t rusage_syst;
-
-    if (redis_get_info_value(info_line, "used_cpu_user", DS_TYPE_GAUGE,
-                             &rusage_user) != 0)
-      break;
+/* redis_parse_info walks the INFO output once, looking up each field in
+ * redis_info_fields. Database statistics are dispatched right away. */
+static void redis_parse_info(const char *node, char *info,
+                             redis_info_t *ri) /* {{{ */
+{
+  char *line;
+  char *ptr = info;
+  char *saveptr = NULL;
+  while ((line = strtok_r(ptr, "\r\n", &saveptr)) != NULL) {
+    ptr = NULL;
 
-    if (redis_get_info_value(info_line, "used_cpu_sys", DS_TYPE_GAUGE,
-                             &rusage_syst) != 0)
-      break;
+    if (line[0] == '#')
+      continue;
 
-    redis_submit2(node, "ps_cputime", "daemon",
-                  (value_t){.derive = rusage_user.gauge * 1000000},
-                  (value_t){.derive = rusage_syst.gauge * 1000000});
-    break;
-  }
+    char *value = strchr(line, ':');
+    if (value == NULL)
+      continue;
+    size_t field_len = (size_t)(value - line);
+    *value = '\0';
+    value++;
 
-  while (42) {
-    value_t rusage_user;
-    value_t rusage_syst;
+    if ((strncmp(line, "db", 2) == 0) && isdigit((unsigned char)line[2])) {
+      redis_db_stats(node, line + 2, value);
+      continue;
+    }
 
-    if (redis_get_info_value(info_line, "used_cpu_user_children", DS_TYPE_GAUGE,
-                             &rusage_user) != 0)
-      break;
+    for (size_t i = 0; i < RI_FIELDS_NUM; i++) {
+      const redis_info_field_t *f = redis_info_fields + i;
+      if ((f->field_len != field_len) || (memcmp(line, f->field, field_len)))
+        continue;
 
-    if (redis_get_info_value(info_line, "used_cpu_sys_children", DS_TYPE_GAUGE,
-                             &rusage_syst) != 0)
+      if (parse_value(value, &ri->values[i], f->ds_type) != 0)
+        WARNING("redis plugin: Unable to parse field `%s'.", f->field);
+      else
+        ri->found[i] = true;
       break;
-
-    redis_submit2(node, "ps_cputime", "children",
-                  (value_t){.derive = rusage_user.gauge * 1000000},
-                  (value_t){.derive = rusage_syst.gauge * 1000000});
-    break;
+    }
   }
-} /* void redis_cpu_usage */
+} /* }}} void redis_parse_info */
 
 static gauge_t calculate_ratio_percent(derive_t part1, derive_t part2,
                                        derive_t *prev1, derive_t *prev2) {
@@ -571,16 +648,12 @@ static gauge_t calculate_ratio_percent(derive_t part1, derive_t part2,
   return 100.0 * (gauge_t)num / (gauge_t)denom;
 } /* gauge_t calculate_ratio_percent */
 
-static void redis_keyspace_usage(redis_node_t *rn, char const *info_line) {
-  value_t hits, misses;
-
-  if (redis_get_info_value(info_line, "keyspace_hits", DS_TYPE_DERIVE, &hits) !=
-      0)
+static void redis_keyspace_usage(redis_node_t *rn, redis_info_t const *ri) {
+  if (!ri->found[RI_KEYSPACE_HITS] || !ri->found[RI_KEYSPACE_MISSES])
     return;
 
-  if (redis_get_info_value(info_line, "keyspace_misses", DS_TYPE_DERIVE,
-                           &misses) != 0)
-    return;
+  value_t hits = ri->values[RI_KEYSPACE_HITS];
+  value_t misses = ri->values[RI_KEYSPACE_MISSES];
 
   redis_submit(rn->name, "cache_result", "hits", hits);
   redis_submit(rn->name, "cache_result", "misses", misses);
@@ -592,6 +665,23 @@ static void redis_keyspace_usage(redis_node_t *rn, char const *info_line) {
 
 } /* void redis_keyspace_usage */
 
+static void redis_cpu_usage(const char *node, redis_info_t const *ri) {
+  if (ri->found[RI_USED_CPU_USER] && ri->found[RI_USED_CPU_SYS])
+    redis_submit2(
+        node, "ps_cputime", "daemon",
+        (value_t){.derive = ri->values[RI_USED_CPU_USER].gauge * 1000000},
+        (value_t){.derive = ri->values[RI_USED_CPU_SYS].gauge * 1000000});
+
+  if (ri->found[RI_USED_CPU_USER_CHILDREN] &&
+      ri->found[RI_USED_CPU_SYS_CHILDREN])
+    redis_submit2(
+        node, "ps_cputime", "children",
+        (value_t){.derive =
+                      ri->values[RI_USED_CPU_USER_CHILDREN].gauge * 1000000},
+        (value_t){.derive =
+                      ri->values[RI_USED_CPU_SYS_CHILDREN].gauge * 1000000});
+} /* void redis_cpu_usage */
+
 static void redis_check_connection(redis_node_t *rn) {
   if (rn->redisContext)
     return;
@@ -618,6 +708,8 @@ static void redis_check_connection(redis_node_t *rn) {
   }
 
   rn->redisContext = rh;
+  /* New connections start out on database 0. */
+  rn->database = 0;
 
   if (rn->passwd) {
     redisReply *rr;
@@ -643,70 +735,34 @@ static void redis_check_connection(redis_node_t *rn) {
   return;
 } /* void redis_check_connection */
 
-static void redis_read_server_info(redis_node_t *rn) {
-  redisReply *rr;
-
-  if ((rr = c_redisCommand(rn, "INFO")) == NULL) {
+static void redis_read_server_info(redis_node_t *rn, redisReply *rr) {
+  if (rr->type != REDIS_REPLY_STRING) {
     WARNING("redis plugin: unable to get INFO from node `%s'.", rn->name);
     return;
   }
 
-  redis_handle_info(rn->name, rr->str, "uptime", NULL, "uptime_in_seconds",
-                    DS_TYPE_GAUGE);
-  redis_handle_info(rn->name, rr->str, "current_connections", "clients",
-                    "connected_clients", DS_TYPE_GAUGE);
-  redis_handle_info(rn->name, rr->str, "blocked_clients", NULL,
-                    "blocked_clients", DS_TYPE_GAUGE);
-  redis_handle_info(rn->name, rr->str, "memory", NULL, "used_memory",
-                    DS_TYPE_GAUGE);
-  redis_handle_info(rn->name, rr->str, "memory_lua", NULL, "used_memory_lua",
-                    DS_TYPE_GAUGE);
-  /* changes_since_last_save: Deprecated in redis version 2.6 and above */
-  redis_handle_info(rn->name, rr->str, "volatile_changes", NULL,
-                    "changes_since_last_save", DS_TYPE_GAUGE);
-  redis_handle_info(rn->name, rr->str, "total_connections", NULL,
-                    "total_connections_received", DS_TYPE_DERIVE);
-  redis_handle_info(rn->name, rr->str, "total_operations", NULL,
-                    "total_commands_processed", DS_TYPE_DERIVE);
-  redis_handle_info(rn->name, rr->str, "expired_keys", NULL, "expired_keys",
-                    DS_TYPE_DERIVE);
-  redis_handle_info(rn->name, rr->str, "evicted_keys", NULL, "evicted_keys",
-                    DS_TYPE_DERIVE);
-  redis_handle_info(rn->name, rr->str, "pubsub", "channels", "pubsub_channels",
-                    DS_TYPE_GAUGE);
-  redis_handle_info(rn->name, rr->str, "pubsub", "patterns", "pubsub_patterns",
-                    DS_TYPE_GAUGE);
-  redis_handle_info(rn->name, rr->str, "current_connections", "slaves",
-                    "connected_slaves", DS_TYPE_GAUGE);
-  redis_handle_info(rn->name, rr->str, "total_bytes", "input",
-                    "total_net_input_bytes", DS_TYPE_DERIVE);
-  redis_handle_info(rn->name, rr->str, "total_bytes", "output",
-                    "total_net_output_bytes", DS_TYPE_DERIVE);
-
-  redis_keyspace_usage(rn, rr->str);
-
-  redis_db_stats(rn->name, rr->str);
+  redis_info_t ri = {0};
+  redis_parse_info(rn->name, rr->str, &ri);
 
-  if (rn->report_cpu_usage)
-    redis_cpu_usage(rn->name, rr->str);
+  for (size_t i = 0; i < RI_FIELDS_NUM; i++) {
+    const redis_info_field_t *f = redis_info_fields + i;
+    if ((f->type == NULL) || !ri.found[i])
+      continue;
 
-  freeReplyObject(rr);
-} /* void redis_read_server_info */
+    redis_submit(rn->name, f->type, f->type_instance, ri.values[i]);
+  }
 
-static void redis_read_command_stats(redis_node_t *rn) {
-  redisReply *rr;
+  redis_keyspace_usage(rn, &ri);
 
-  if ((rr = c_redisCommand(rn, "INFO commandstats")) == NULL) {
-    WARNING("redis plugin: node `%s': unable to get `INFO commandstats'.",
-            rn->name);
-    return;
-  }
+  if (rn->report_cpu_usage)
+    redis_cpu_usage(rn->name, &ri);
+} /* void redis_read_server_info */
 
+static void redis_read_command_stats(redis_node_t *rn, redisReply *rr) {
   if (rr->type != REDIS_REPLY_STRING) {
     WARNING("redis plugin: node `%s' `INFO commandstats' returned unsupported "
             "redis type %i.",
             rn->name, rr->type);
-    freeReplyObject(rr);
     return;
   }
 
@@ -766,7 +822,6 @@ static void redis_read_command_stats(redis_node_t *rn) {
       redis_submit(rn->name, type, command, (value_t){.derive = value});
     }
   }
-  freeReplyObject(rr);
 } /* void redis_read_command_stats */
 
 static int redis_read(user_data_t *user_data) /* {{{ */
@@ -787,22 +842,62 @@ static int redis_read(user_data_t *user_data) /* {{{ */
   if (!rn->redisContext) /* no connection */
     return -1;
 
-  redis_read_server_info(rn);
+  /* Queue all commands first and read the replies afterwards, so that a read
+   * takes a single round trip. SELECT is only sent when a query uses a
+   * different database than the previous one. */
+  if (c_redisAppendCommand(rn, "INFO") != 0)
+    return -1;
 
-  if (!rn->redisContext) /* connection lost */
+  if (rn->report_command_stats &&
+      (c_redisAppendCommand(rn, "INFO commandstats") != 0))
     return -1;
 
-  if (rn->report_command_stats) {
-    redis_read_command_stats(rn);
+  int database = rn->database;
+  for (redis_query_t *rq = rn->queries; rq != NULL; rq = rq->next) {
+    if (rq->database != database) {
+      if (c_redisAppendCommand(rn, "SELECT %d", rq->database) != 0)
+        return -1;
+      database = rq->database;
+    }
+    if (c_redisAppendCommand(rn, rq->query) != 0)
+      return -1;
+  }
 
-    if (!rn->redisContext) /* connection lost */
+  redisReply *rr;
+  if ((rr = c_redisGetReply(rn)) == NULL) /* connection lost */
+    return -1;
+  redis_read_server_info(rn, rr);
+  freeReplyObject(rr);
+
+  if (rn->report_command_stats) {
+    if ((rr = c_redisGetReply(rn)) == NULL) /* connection lost */
       return -1;
+    redis_read_command_stats(rn, rr);
+    freeReplyObject(rr);
   }
 
+  bool database_ok = true;
+  database = rn->database;
   for (redis_query_t *rq = rn->queries; rq != NULL; rq = rq->next) {
-    redis_handle_query(rn, rq);
-    if (!rn->redisContext) /* connection lost */
+    if (rq->database != database) {
+      if ((rr = c_redisGetReply(rn)) == NULL) /* connection lost */
+        return -1;
+      database = rq->database;
+      database_ok = (rr->type != REDIS_REPLY_ERROR);
+      /* If SELECT failed, the selected database is not known any more. */
+      rn->database = database_ok ? rq->database : -1;
+      freeReplyObject(rr);
+    }
+
+    if ((rr = c_redisGetReply(rn)) == NULL) /* connection lost */
       return -1;
+
+    if (database_ok)
+      redis_handle_query(rn, rq, rr);
+    else
+      WARNING("redis plugin: unable to switch to database `%d' on node `%s'.",
+              rq->database, rn->name);
+    freeReplyObject(rr);
   }
 
   return 0;
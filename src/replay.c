@@ -0,0 +1,283 @@
+/**
+ * collectd - src/replay.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/cmds/putbin.h"
+#include "utils/common/common.h"
+
+#if HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+/* File format written by the write_record plugin. */
+#define RECORD_MAGIC "CDREC001"
+#define RECORD_MAGIC_SIZE 8
+
+/* State of one pass over the recording. Timestamps are rebased so that the
+ * first value list of a pass is dispatched "now", and the distance to it is
+ * divided by "speed". */
+typedef struct {
+  bool have_start;
+  cdtime_t record_start;
+  cdtime_t wall_start;
+
+  cdtime_t last_time;
+  cdtime_t last_interval;
+  uint64_t dispatched;
+} replay_state_t;
+
+static char *file_path;
+static double speed = 1.0;
+static bool loop;
+
+static pthread_mutex_t replay_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t replay_cond = PTHREAD_COND_INITIALIZER;
+static bool replay_stop;
+static bool replay_running;
+static pthread_t replay_tid;
+
+static bool replay_stopping(void) {
+  return __atomic_load_n(&replay_stop, __ATOMIC_RELAXED);
+}
+
+/* Sleeps until "t" or until the plugin is shut down. Returns false in the
+ * latter case. */
+static bool replay_wait_until(cdtime_t t) {
+  pthread_mutex_lock(&replay_lock);
+  while (!replay_stop && (cdtime() < t)) {
+    struct timespec ts = CDTIME_T_TO_TIMESPEC(t);
+    pthread_cond_timedwait(&replay_cond, &replay_lock, &ts);
+  }
+  bool ok = !replay_stop;
+  pthread_mutex_unlock(&replay_lock);
+
+  return ok;
+}
+
+static int replay_dispatch(value_list_t const *vl, void *user_data) {
+  replay_state_t *st = user_data;
+
+  if (replay_stopping())
+    return ECANCELED;
+
+  if (!st->have_start) {
+    st->record_start = vl->time;
+    /* When looping, don't go back behind the previous pass. */
+    st->wall_start = cdtime();
+    if (st->wall_start < st->last_time + st->last_interval)
+      st->wall_start = st->last_time + st->last_interval;
+    st->have_start = true;
+  }
+
+  /* Value lists may be slightly out of order, because the write threads
+   * don't preserve the dispatch order. */
+  cdtime_t offset =
+      (vl->time > st->record_start) ? (vl->time - st->record_start) : 0;
+
+  value_list_t copy = *vl;
+  if (speed > 0) {
+    offset = (cdtime_t)((double)offset / speed);
+    copy.interval = (cdtime_t)((double)vl->interval / speed);
+  }
+  copy.time = st->wall_start + offset;
+
+  if ((speed > 0) && !replay_wait_until(copy.time))
+    return ECANCELED;
+
+  int status = plugin_dispatch_values(&copy);
+  if (status != 0)
+    return status;
+
+  st->last_time = copy.time;
+  st->last_interval = copy.interval;
+  st->dispatched++;
+  return 0;
+}
+
+static void replay_parse_error(__attribute__((unused)) void *ud,
+                               cmd_status_t status, const char *format,
+                               va_list ap) {
+  char buffer[1024];
+
+  if (status == CMD_OK)
+    return;
+
+  vsnprintf(buffer, sizeof(buffer), format, ap);
+  ERROR("replay plugin: \"%s\" contains an invalid frame: %s", file_path,
+        buffer);
+}
+
+/* Dispatches all value lists in the recording once. */
+static int replay_file(replay_state_t *st) {
+  FILE *fh = fopen(file_path, "r");
+  if (fh == NULL) {
+    ERROR("replay plugin: Opening \"%s\" failed: %s", file_path, STRERRNO);
+    return -1;
+  }
+
+  char magic[RECORD_MAGIC_SIZE];
+  if ((fread(magic, sizeof(magic), 1, fh) != 1) ||
+      (memcmp(magic, RECORD_MAGIC, sizeof(magic)) != 0)) {
+    ERROR("replay plugin: \"%s\" is not a recording.", file_path);
+    fclose(fh);
+    return -1;
+  }
+
+  cmd_error_handler_t err = {replay_parse_error, NULL};
+  char *frame = NULL;
+  size_t frame_size = 0;
+  int status = 0;
+
+  while (!replay_stopping()) {
+    uint32_t len = 0;
+    if (fread(&len, sizeof(len), 1, fh) != 1)
+      break;
+    len = ntohl(len);
+
+    if ((len == 0) || (len > CMD_PUTBIN_MAX_SIZE)) {
+      ERROR("replay plugin: \"%s\" contains a frame of %" PRIu32 " bytes.",
+            file_path, len);
+      status = -1;
+      break;
+    }
+
+    if (len > frame_size) {
+      char *tmp = realloc(frame, len);
+      if (tmp == NULL) {
+        ERROR("replay plugin: realloc failed.");
+        status = -1;
+        break;
+      }
+      frame = tmp;
+      frame_size = len;
+    }
+
+    if (fread(frame, len, 1, fh) != 1) {
+      /* The recording may still be written to. */
+      WARNING("replay plugin: \"%s\" ends with a truncated frame.", file_path);
+      break;
+    }
+
+    if (cmd_parse_putbin(frame, len, replay_dispatch, st, &err) != CMD_OK) {
+      status = -1;
+      break;
+    }
+  }
+
+  if ((status == 0) && ferror(fh)) {
+    ERROR("replay plugin: Reading \"%s\" failed: %s", file_path, STRERRNO);
+    status = -1;
+  }
+
+  sfree(frame);
+  fclose(fh);
+  return status;
+}
+
+static void *replay_thread(__attribute__((unused)) void *arg) {
+  replay_state_t st = {0};
+
+  do {
+    st.have_start = false;
+    if (replay_file(&st) != 0)
+      break;
+  } while (loop && !replay_stopping());
+
+  INFO("replay plugin: Dispatched %" PRIu64 " value lists from \"%s\".",
+       st.dispatched, file_path);
+  return NULL;
+}
+
+static int replay_config(oconfig_item_t *ci) {
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+    int status = 0;
+
+    if (strcasecmp("File", child->key) == 0) {
+      status = cf_util_get_string(child, &file_path);
+    } else if (strcasecmp("Speed", child->key) == 0) {
+      status = cf_util_get_double(child, &speed);
+      if ((status == 0) && !(speed >= 0)) {
+        ERROR("replay plugin: \"Speed\" must not be negative.");
+        status = -1;
+      }
+    } else if (strcasecmp("Loop", child->key) == 0) {
+      status = cf_util_get_boolean(child, &loop);
+    } else {
+      WARNING("replay plugin: Ignoring unknown config option \"%s\".",
+              child->key);
+    }
+
+    if (status != 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+static int replay_init(void) {
+  if (file_path == NULL) {
+    ERROR("replay plugin: The \"File\" option is required.");
+    return -1;
+  }
+
+  if (replay_running)
+    return 0;
+
+  replay_stop = false;
+  int status = plugin_thread_create(&replay_tid, replay_thread,
+                                    /* arg = */ NULL, "replay");
+  if (status != 0) {
+    ERROR("replay plugin: Starting thread failed: %s", STRERROR(status));
+    return -1;
+  }
+  replay_running = true;
+
+  return 0;
+}
+
+static int replay_shutdown(void) {
+  if (replay_running) {
+    pthread_mutex_lock(&replay_lock);
+    __atomic_store_n(&replay_stop, true, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&replay_cond);
+    pthread_mutex_unlock(&replay_lock);
+
+    pthread_join(replay_tid, NULL);
+    replay_running = false;
+  }
+
+  sfree(file_path);
+  return 0;
+}
+
+void module_register(void) {
+  plugin_register_complex_config("replay", replay_config);
+  plugin_register_init("replay", replay_init);
+  plugin_register_shutdown("replay", replay_shutdown);
+}
@@ -0,0 +1,547 @@
+/**
+ * collectd - src/ringbuffer.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/avltree/avltree.h"
+#include "utils/common/common.h"
+#include "utils/gorilla/gorilla.h"
+
+#include <sys/mman.h>
+
+/*
+ * Stores the values of each series in a ring of compressed blocks. With
+ * "DataDir", each ring is a memory mapped file, so that values survive a
+ * restart; otherwise anonymous memory is used.
+ *
+ * File layout: one page with an rb_header_t, followed by "blocks_num" blocks
+ * of "block_size" bytes. Each block starts with an rb_block_t and holds a
+ * Gorilla stream (see utils/gorilla/gorilla.h) of points with the time in
+ * milliseconds and the raw bits of each value_t.
+ *
+ * Blocks are numbered with a sequence number that is never reused; block
+ * "seq" is stored at position "seq % blocks_num". When "Forward" is set, the
+ * values are written to the given plugins from a read callback. The position
+ * of the next value to forward is kept in the header, so that values which
+ * could not be written while a plugin was failing are written once it
+ * succeeds again.
+ */
+
+#define RB_MAGIC "CDRING01"
+#define RB_HEADER_SIZE 4096
+
+struct rb_header_s {
+  char magic[8];
+  uint32_t ds_num;
+  uint32_t block_size;
+  uint32_t blocks_num;
+  uint32_t forward_index; /* number of points of "forward_seq" written */
+  uint64_t head_seq;      /* block currently being written */
+  uint64_t forward_seq;   /* block of the next point to forward */
+  uint64_t interval;      /* cdtime_t */
+  char identifier[6 * DATA_MAX_NAME_LEN];
+};
+typedef struct rb_header_s rb_header_t;
+
+struct rb_block_s {
+  uint64_t seq;
+  uint32_t count;
+  uint32_t bits;
+};
+typedef struct rb_block_s rb_block_t;
+
+struct rb_series_s {
+  pthread_mutex_t lock;
+  rb_header_t *header;
+  size_t map_size;
+  gorilla_stream_t stream; /* of block "header->head_seq" */
+};
+typedef struct rb_series_s rb_series_t;
+
+static char *datadir;
+static size_t block_size = 4096;
+static size_t blocks_num = 16;
+static char **forward_plugins;
+static size_t forward_plugins_num;
+
+static c_avl_tree_t *series_tree;
+static pthread_mutex_t series_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static rb_block_t *rb_block(rb_series_t *s, uint64_t seq) /* {{{ */
+{
+  uint8_t *blocks = (uint8_t *)s->header + RB_HEADER_SIZE;
+  return (rb_block_t *)(blocks + (seq % s->header->blocks_num) *
+                                     s->header->block_size);
+} /* }}} rb_block_t *rb_block */
+
+static void *rb_block_data(rb_block_t *b) /* {{{ */
+{
+  return (uint8_t *)b + sizeof(*b);
+} /* }}} void *rb_block_data */
+
+static size_t rb_block_data_size(rb_series_t *s) /* {{{ */
+{
+  return s->header->block_size - sizeof(rb_block_t);
+} /* }}} size_t rb_block_data_size */
+
+/* Starts block "seq" and makes it the head. */
+static void rb_start_block(rb_series_t *s, uint64_t seq) /* {{{ */
+{
+  rb_block_t *b = rb_block(s, seq);
+
+  b->seq = seq;
+  b->count = 0;
+  b->bits = 0;
+  s->header->head_seq = seq;
+
+  gorilla_init(&s->stream, rb_block_data(b), rb_block_data_size(s),
+               s->header->ds_num);
+} /* }}} void rb_start_block */
+
+/* Converts the identifier to a file name which is unique and contains no
+ * slashes, by escaping all but a few characters as "%XX". */
+static int rb_file_name(char *buffer, size_t buffer_size, /* {{{ */
+                        const char *identifier) {
+  int len = snprintf(buffer, buffer_size, "%s/", datadir);
+  if ((len < 0) || ((size_t)len >= buffer_size))
+    return ENAMETOOLONG;
+
+  size_t pos = (size_t)len;
+  for (const char *c = identifier; *c != 0; c++) {
+    if (isalnum((unsigned char)*c) || (*c == '-') || (*c == '_') ||
+        (*c == '.' && c != identifier)) {
+      if (pos + 1 >= buffer_size)
+        return ENAMETOOLONG;
+      buffer[pos++] = *c;
+    } else {
+      if (pos + 3 >= buffer_size)
+        return ENAMETOOLONG;
+      snprintf(buffer + pos, buffer_size - pos, "%%%02X", (unsigned char)*c);
+      pos += 3;
+    }
+  }
+
+  if (pos + strlen(".ring") >= buffer_size)
+    return ENAMETOOLONG;
+  sstrncpy(buffer + pos, ".ring", buffer_size - pos);
+  return 0;
+} /* }}} int rb_file_name */
+
+static void *rb_map(const char *identifier, size_t map_size) /* {{{ */
+{
+  if (datadir == NULL) {
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (map == MAP_FAILED) ? NULL : map;
+  }
+
+  char file[PATH_MAX];
+  if (rb_file_name(file, sizeof(file), identifier) != 0) {
+    ERROR("ringbuffer plugin: File name for \"%s\" is too long.", identifier);
+    return NULL;
+  }
+
+  int fd = open(file, O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+  if (fd < 0) {
+    ERROR("ringbuffer plugin: open (%s) failed: %s", file, STRERRNO);
+    return NULL;
+  }
+
+  /* The file is sparse; blocks take up disk space once they are written. */
+  if (ftruncate(fd, (off_t)map_size) != 0) {
+    ERROR("ringbuffer plugin: ftruncate (%s) failed: %s", file, STRERRNO);
+    close(fd);
+    return NULL;
+  }
+
+  void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    ERROR("ringbuffer plugin: mmap (%s) failed: %s", file, STRERRNO);
+    close(fd);
+    return NULL;
+  }
+
+  /* The mapping stays valid; don't keep one descriptor per series open. */
+  close(fd);
+  return map;
+} /* }}} void *rb_map */
+
+static void rb_series_destroy(rb_series_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  if (s->header != NULL) {
+    if (datadir != NULL)
+      msync(s->header, s->map_size, MS_SYNC);
+    munmap(s->header, s->map_size);
+  }
+  pthread_mutex_destroy(&s->lock);
+  sfree(s);
+} /* }}} void rb_series_destroy */
+
+static rb_series_t *rb_series_create(const char *identifier, /* {{{ */
+                                     size_t ds_num) {
+  rb_series_t *s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+  pthread_mutex_init(&s->lock, NULL);
+
+  s->map_size = RB_HEADER_SIZE + blocks_num * block_size;
+  s->header = rb_map(identifier, s->map_size);
+  if (s->header == NULL) {
+    sfree(s);
+    return NULL;
+  }
+
+  rb_header_t *h = s->header;
+  if ((memcmp(h->magic, RB_MAGIC, sizeof(h->magic)) == 0) &&
+      (h->ds_num == ds_num) && (h->block_size == block_size) &&
+      (h->blocks_num == blocks_num) &&
+      (strcmp(h->identifier, identifier) == 0)) {
+    rb_block_t *b = rb_block(s, h->head_seq);
+    if ((b->seq == h->head_seq) &&
+        (gorilla_resume(&s->stream, rb_block_data(b), rb_block_data_size(s),
+                        ds_num, b->bits, b->count) == 0))
+      return s;
+
+    /* The head block is corrupt, e.g. after a crash; start the next one. */
+    WARNING("ringbuffer plugin: Discarding corrupt block of \"%s\".",
+            identifier);
+    rb_start_block(s, h->head_seq + 1);
+    return s;
+  }
+
+  if (h->magic[0] != 0)
+    NOTICE("ringbuffer plugin: Discarding the buffer of \"%s\" because its "
+           "format or size has changed.",
+           identifier);
+
+  memset(h, 0, RB_HEADER_SIZE);
+  h->ds_num = (uint32_t)ds_num;
+  h->block_size = (uint32_t)block_size;
+  h->blocks_num = (uint32_t)blocks_num;
+  sstrncpy(h->identifier, identifier, sizeof(h->identifier));
+  rb_start_block(s, 0);
+  memcpy(h->magic, RB_MAGIC, sizeof(h->magic));
+
+  return s;
+} /* }}} rb_series_t *rb_series_create */
+
+static rb_series_t *rb_series_get(const char *identifier, /* {{{ */
+                                  size_t ds_num) {
+  rb_series_t *s = NULL;
+
+  pthread_mutex_lock(&series_lock);
+  if (c_avl_get(series_tree, identifier, (void *)&s) == 0) {
+    pthread_mutex_unlock(&series_lock);
+    return s;
+  }
+
+  char *key = strdup(identifier);
+  s = rb_series_create(identifier, ds_num);
+  if ((key == NULL) || (s == NULL) || (c_avl_insert(series_tree, key, s) != 0)) {
+    pthread_mutex_unlock(&series_lock);
+    sfree(key);
+    rb_series_destroy(s);
+    return NULL;
+  }
+  pthread_mutex_unlock(&series_lock);
+
+  return s;
+} /* }}} rb_series_t *rb_series_get */
+
+static int rb_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
+                    user_data_t __attribute__((unused)) * ud) {
+  char identifier[6 * DATA_MAX_NAME_LEN];
+  uint64_t values[GORILLA_VALUES_MAX];
+
+  if (0 != strcmp(ds->type, vl->type)) {
+    ERROR("ringbuffer plugin: DS type does not match value list type");
+    return -1;
+  }
+  if ((ds->ds_num == 0) || (ds->ds_num > GORILLA_VALUES_MAX))
+    return 0;
+
+  if (FORMAT_VL(identifier, sizeof(identifier), vl) != 0)
+    return -1;
+
+  rb_series_t *s = rb_series_get(identifier, ds->ds_num);
+  if (s == NULL)
+    return -1;
+
+  /* The raw bits of each value_t are stored, whatever its type is. */
+  for (size_t i = 0; i < ds->ds_num; i++)
+    memcpy(&values[i], &vl->values[i], sizeof(values[i]));
+
+  uint64_t time = (uint64_t)CDTIME_T_TO_MS(vl->time);
+
+  pthread_mutex_lock(&s->lock);
+
+  s->header->interval = (uint64_t)vl->interval;
+
+  int status = gorilla_append(&s->stream, time, values);
+  if (status == ENOSPC) {
+    rb_start_block(s, s->header->head_seq + 1);
+    status = gorilla_append(&s->stream, time, values);
+  }
+  if (status == 0) {
+    rb_block_t *b = rb_block(s, s->header->head_seq);
+    b->bits = (uint32_t)s->stream.state.bits;
+    b->count = (uint32_t)s->stream.state.count;
+  }
+
+  pthread_mutex_unlock(&s->lock);
+
+  if (status != 0) {
+    ERROR("ringbuffer plugin: Storing a value of \"%s\" failed: %s",
+          identifier, STRERROR(status));
+    return -1;
+  }
+  return 0;
+} /* }}} int rb_write */
+
+/* Writes all points from the forward position on to the forward plugins.
+ * Returns non-zero if a plugin failed; the position is kept at the point
+ * which failed. Must be called with "s->lock" held. */
+static int rb_forward_series(rb_series_t *s) /* {{{ */
+{
+  rb_header_t *h = s->header;
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[GORILLA_VALUES_MAX];
+  uint64_t raw[GORILLA_VALUES_MAX];
+
+  if (parse_identifier_vl(h->identifier, &vl) != 0)
+    return 0;
+
+  const data_set_t *ds = plugin_get_ds(vl.type);
+  if ((ds == NULL) || (ds->ds_num != h->ds_num))
+    return 0;
+
+  uint64_t oldest =
+      (h->head_seq >= h->blocks_num) ? (h->head_seq - h->blocks_num + 1) : 0;
+  if (h->forward_seq < oldest) {
+    WARNING("ringbuffer plugin: Values of \"%s\" were overwritten before they "
+            "could be forwarded.",
+            h->identifier);
+    h->forward_seq = oldest;
+    h->forward_index = 0;
+  }
+
+  vl.values = values;
+  vl.values_len = h->ds_num;
+  vl.interval = (cdtime_t)h->interval;
+
+  for (; h->forward_seq <= h->head_seq; h->forward_seq++, h->forward_index = 0) {
+    rb_block_t *b = rb_block(s, h->forward_seq);
+    if (b->seq != h->forward_seq)
+      continue;
+
+    gorilla_iter_t it;
+    uint64_t time;
+    uint32_t index = 0;
+
+    gorilla_iter_init(&it, rb_block_data(b), b->bits, b->count, h->ds_num);
+    while (gorilla_iter_next(&it, &time, raw) == 0) {
+      if (index++ < h->forward_index)
+        continue;
+
+      vl.time = MS_TO_CDTIME_T(time);
+      for (size_t i = 0; i < h->ds_num; i++)
+        memcpy(&values[i], &raw[i], sizeof(values[i]));
+
+      for (size_t i = 0; i < forward_plugins_num; i++) {
+        int status = plugin_write(forward_plugins[i], ds, &vl);
+        if (status != 0)
+          return status;
+      }
+      h->forward_index = index;
+    }
+
+    /* Keep the position within the head block, which is still growing. */
+    if (h->forward_seq == h->head_seq)
+      break;
+  }
+
+  return 0;
+} /* }}} int rb_forward_series */
+
+static int rb_forward(user_data_t __attribute__((unused)) * ud) /* {{{ */
+{
+  c_avl_iterator_t *iter;
+  char *key;
+  rb_series_t *s;
+
+  /* Series are only removed on shutdown, so they can be used after
+   * releasing "series_lock". */
+  pthread_mutex_lock(&series_lock);
+  size_t series_num = (size_t)c_avl_size(series_tree);
+  rb_series_t **series = calloc(series_num + 1, sizeof(*series));
+  if (series == NULL) {
+    pthread_mutex_unlock(&series_lock);
+    return -1;
+  }
+  size_t n = 0;
+  iter = c_avl_get_iterator(series_tree);
+  while ((n < series_num) &&
+         (c_avl_iterator_next(iter, (void *)&key, (void *)&s) == 0))
+    series[n++] = s;
+  c_avl_iterator_destroy(iter);
+  pthread_mutex_unlock(&series_lock);
+
+  for (size_t i = 0; i < n; i++) {
+    pthread_mutex_lock(&series[i]->lock);
+    int status = rb_forward_series(series[i]);
+    pthread_mutex_unlock(&series[i]->lock);
+
+    /* A forward plugin is failing; try again with the next read. */
+    if (status != 0)
+      break;
+  }
+
+  sfree(series);
+  return 0;
+} /* }}} int rb_forward */
+
+static int rb_config_add_forward(oconfig_item_t *ci) /* {{{ */
+{
+  char *plugin = NULL;
+
+  int status = cf_util_get_string(ci, &plugin);
+  if (status != 0)
+    return status;
+
+  char **tmp = realloc(forward_plugins,
+                       (forward_plugins_num + 1) * sizeof(*forward_plugins));
+  if (tmp == NULL) {
+    ERROR("ringbuffer plugin: realloc failed.");
+    sfree(plugin);
+    return -1;
+  }
+  forward_plugins = tmp;
+  forward_plugins[forward_plugins_num++] = plugin;
+
+  return 0;
+} /* }}} int rb_config_add_forward */
+
+static int rb_config(oconfig_item_t *ci) /* {{{ */
+{
+  int status = 0;
+
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+    int tmp = 0;
+
+    if (strcasecmp("DataDir", child->key) == 0) {
+      status = cf_util_get_string(child, &datadir);
+    } else if (strcasecmp("BlockSize", child->key) == 0) {
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 256)) {
+        ERROR("ringbuffer plugin: BlockSize must be at least 256 bytes.");
+        status = -1;
+      }
+      if (status == 0)
+        block_size = (size_t)tmp;
+    } else if (strcasecmp("BlocksPerSeries", child->key) == 0) {
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 2)) {
+        ERROR("ringbuffer plugin: BlocksPerSeries must be at least 2.");
+        status = -1;
+      }
+      if (status == 0)
+        blocks_num = (size_t)tmp;
+    } else if (strcasecmp("Forward", child->key) == 0) {
+      status = rb_config_add_forward(child);
+    } else {
+      WARNING("ringbuffer plugin: Ignoring unknown config option \"%s\".",
+              child->key);
+    }
+
+    if (status != 0)
+      return -1;
+  }
+
+  /* Keep blocks 8 byte aligned within the mapping. */
+  block_size = (block_size + 7) & ~((size_t)7);
+
+  return 0;
+} /* }}} int rb_config */
+
+static int rb_init(void) /* {{{ */
+{
+  if (series_tree != NULL)
+    return 0;
+
+  if (datadir != NULL) {
+    char file[PATH_MAX];
+    snprintf(file, sizeof(file), "%s/", datadir);
+    if (check_create_dir(file) != 0) {
+      ERROR("ringbuffer plugin: Creating \"%s\" failed.", datadir);
+      return -1;
+    }
+  }
+
+  series_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (series_tree == NULL)
+    return -1;
+
+  if (forward_plugins_num > 0)
+    plugin_register_complex_read(/* group = */ NULL, "ringbuffer", rb_forward,
+                                 /* interval = */ 0, /* user_data = */ NULL);
+
+  return 0;
+} /* }}} int rb_init */
+
+static int rb_shutdown(void) /* {{{ */
+{
+  char *key;
+  rb_series_t *s;
+
+  if (series_tree != NULL) {
+    while (c_avl_pick(series_tree, (void *)&key, (void *)&s) == 0) {
+      sfree(key);
+      rb_series_destroy(s);
+    }
+    c_avl_destroy(series_tree);
+    series_tree = NULL;
+  }
+
+  for (size_t i = 0; i < forward_plugins_num; i++)
+    sfree(forward_plugins[i]);
+  sfree(forward_plugins);
+  forward_plugins_num = 0;
+  sfree(datadir);
+
+  return 0;
+} /* }}} int rb_shutdown */
+
+void module_register(void) {
+  plugin_register_complex_config("ringbuffer", rb_config);
+  plugin_register_init("ringbuffer", rb_init);
+  plugin_register_write("ringbuffer", rb_write, /* user_data = */ NULL);
+  plugin_register_shutdown("ringbuffer", rb_shutdown);
+} /* void module_register */
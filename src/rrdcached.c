@@ -29,11 +29,48 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 #include "utils/rrdcreate/rrdcreate.h"
+#include "utils_complain.h"
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #undef HAVE_CONFIG_H
 #include <rrd.h>
 #include <rrd_client.h>
 
+#define RRDCACHED_DEFAULT_PORT "42217"
+#define RRDCACHED_IO_TIMEOUT TIME_T_TO_CDTIME_T_STATIC(10)
+
+/*
+ * Private types
+ */
+typedef struct {
+  int fd;
+  char read_buffer[4096];
+  size_t read_len;
+
+  /* The fields below are protected by "lock". "updates" holds "UPDATE"
+   * commands, one per line. */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  char *updates;
+  size_t updates_size;
+  size_t updates_len;
+  size_t updates_num;
+  char *spare;
+  size_t spare_size;
+  char **flushes;
+  size_t flushes_num;
+  bool flush_all;
+  bool shutdown;
+
+  pthread_t thread;
+  bool thread_running;
+  c_complain_t complaint;
+  c_complain_t queue_complaint;
+} rc_conn_t;
+
 /*
  * Private variables
  */
@@ -51,6 +88,12 @@ static rrdcreate_config_t rrdcreate_config = {.stepsize = 0,
                                               .consolidation_functions_num = 0,
                                               .async = 0};
 
+static size_t conns_num = 1;
+static int batch_size = 1000;
+static int queue_limit = 100000;
+static cdtime_t flush_interval = TIME_T_TO_CDTIME_T_STATIC(1);
+static rc_conn_t *conns;
+
 /*
  * Prototypes.
  */
@@ -264,6 +307,369 @@ static int try_reconnect(void) {
   return 0;
 } /* int try_reconnect */
 
+/*
+ * Connections
+ *
+ * Updates are not sent with librrd's rrdc_update(), which needs one round
+ * trip per update. Instead, each connection queues "UPDATE" commands and a
+ * thread sends them in one "BATCH" every "FlushInterval" or whenever
+ * "BatchSize" updates are queued. Files are assigned to connections by the
+ * hash of their name, so updates of one file are sent in order. Flush
+ * requests are collected, too, and sent after the next batch.
+ * {{{ */
+static int rc_conn_connect(rc_conn_t *c) {
+  char const *path = NULL;
+  if (strncmp("unix:", daemon_address, strlen("unix:")) == 0)
+    path = daemon_address + strlen("unix:");
+  else if (daemon_address[0] == '/')
+    path = daemon_address;
+
+  if (path != NULL) {
+    struct sockaddr_un sa = {.sun_family = AF_UNIX};
+    sstrncpy(sa.sun_path, path, sizeof(sa.sun_path));
+
+    c->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (c->fd < 0)
+      return errno;
+    if (connect(c->fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+      int status = errno;
+      close(c->fd);
+      c->fd = -1;
+      return status;
+    }
+  } else {
+    /* "host", "host:port", "[address]" or "[address]:port" */
+    char node[256];
+    char const *service = RRDCACHED_DEFAULT_PORT;
+    sstrncpy(node, daemon_address, sizeof(node));
+
+    char *port = NULL;
+    if (node[0] == '[') {
+      char *end = strchr(node, ']');
+      if (end == NULL)
+        return EINVAL;
+      *end = 0;
+      memmove(node, node + 1, strlen(node + 1) + 1);
+      if (end[1] == ':')
+        port = end + 1;
+    } else if ((port = strchr(node, ':')) != NULL) {
+      /* An IPv6 address without brackets has no port. */
+      if (strchr(port + 1, ':') != NULL)
+        port = NULL;
+      else
+        *port = 0;
+    }
+    if (port != NULL)
+      service = port + 1;
+
+    struct addrinfo ai_hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = AI_ADDRCONFIG,
+    };
+    struct addrinfo *ai_list = NULL;
+    int status = getaddrinfo(node, service, &ai_hints, &ai_list);
+    if (status != 0) {
+      ERROR("rrdcached plugin: getaddrinfo (%s, %s) failed: %s", node, service,
+            gai_strerror(status));
+      return EINVAL;
+    }
+
+    status = ECONNREFUSED;
+    for (struct addrinfo *ai = ai_list; ai != NULL; ai = ai->ai_next) {
+      c->fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+                     ai->ai_protocol);
+      if (c->fd < 0) {
+        status = errno;
+        continue;
+      }
+      if (connect(c->fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+        status = 0;
+        break;
+      }
+      status = errno;
+      close(c->fd);
+      c->fd = -1;
+    }
+    freeaddrinfo(ai_list);
+    if (status != 0)
+      return status;
+  }
+
+  /* Don't wait forever for a daemon that has stopped responding. */
+  struct timeval tv = CDTIME_T_TO_TIMEVAL(RRDCACHED_IO_TIMEOUT);
+  setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(c->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  c->read_len = 0;
+  return 0;
+} /* int rc_conn_connect */
+
+static void rc_conn_disconnect(rc_conn_t *c) {
+  if (c->fd >= 0)
+    close(c->fd);
+  c->fd = -1;
+  c->read_len = 0;
+} /* void rc_conn_disconnect */
+
+static int rc_conn_send(rc_conn_t *c, char const *buffer, size_t buffer_len) {
+  while (buffer_len > 0) {
+    ssize_t status = send(c->fd, buffer, buffer_len, MSG_NOSIGNAL);
+    if ((status < 0) && (errno == EINTR))
+      continue;
+    if (status < 0)
+      return errno;
+    buffer += status;
+    buffer_len -= (size_t)status;
+  }
+  return 0;
+} /* int rc_conn_send */
+
+/* rc_conn_read_line reads one line of the response, without the newline. */
+static int rc_conn_read_line(rc_conn_t *c, char *buffer, size_t buffer_size) {
+  while (42) {
+    char *newline = memchr(c->read_buffer, '\n', c->read_len);
+    if (newline != NULL) {
+      size_t line_len = (size_t)(newline - c->read_buffer);
+      sstrncpy(buffer, c->read_buffer,
+               (line_len < buffer_size) ? line_len + 1 : buffer_size);
+      c->read_len -= line_len + 1;
+      memmove(c->read_buffer, newline + 1, c->read_len);
+      return 0;
+    }
+
+    if (c->read_len == sizeof(c->read_buffer)) {
+      /* Overlong line: return the beginning and skip the rest. */
+      sstrncpy(buffer, c->read_buffer, buffer_size);
+      c->read_len = 0;
+      continue;
+    }
+
+    ssize_t status = recv(c->fd, c->read_buffer + c->read_len,
+                          sizeof(c->read_buffer) - c->read_len, 0);
+    if ((status < 0) && (errno == EINTR))
+      continue;
+    if (status < 0)
+      return errno;
+    if (status == 0)
+      return ECONNRESET;
+    c->read_len += (size_t)status;
+  }
+} /* int rc_conn_read_line */
+
+/* rc_conn_read_response reads a response and returns its status in
+ * "ret_status". A positive status is the number of lines following the
+ * status line; the first of those is copied to "first_line". */
+static int rc_conn_read_response(rc_conn_t *c, int *ret_status,
+                                 char *message, size_t message_size,
+                                 char *first_line, size_t first_line_size) {
+  char line[1024];
+  int status = rc_conn_read_line(c, line, sizeof(line));
+  if (status != 0)
+    return status;
+
+  char *endptr = NULL;
+  errno = 0;
+  long response_status = strtol(line, &endptr, 10);
+  if ((errno != 0) || (endptr == line))
+    return EPROTO;
+  while (*endptr == ' ')
+    endptr++;
+  sstrncpy(message, endptr, message_size);
+
+  if (first_line_size > 0)
+    first_line[0] = 0;
+  for (long i = 0; i < response_status; i++) {
+    status = rc_conn_read_line(c, line, sizeof(line));
+    if (status != 0)
+      return status;
+    if ((i == 0) && (first_line_size > 0))
+      sstrncpy(first_line, line, first_line_size);
+  }
+
+  *ret_status = (int)response_status;
+  return 0;
+} /* int rc_conn_read_response */
+
+/* rc_conn_send_batch sends the queued updates in one batch, followed by the
+ * flush requests. Returns an error only if the connection failed. */
+static int rc_conn_send_batch(rc_conn_t *c, char const *updates,
+                              size_t updates_len, size_t updates_num,
+                              char **flushes, size_t flushes_num,
+                              bool flush_all) {
+  int status;
+  int response_status = 0;
+  char message[1024];
+  char first_line[1024];
+
+  if (c->fd < 0) {
+    status = rc_conn_connect(c);
+    if (status != 0)
+      return status;
+  }
+
+  if (updates_num > 0) {
+    /* The batch is written in one go; rrdcached replies to "BATCH" right away
+     * and to the final dot once all commands have been processed. */
+    status = rc_conn_send(c, "BATCH\n", strlen("BATCH\n"));
+    if (status == 0)
+      status = rc_conn_send(c, updates, updates_len);
+    if (status == 0)
+      status = rc_conn_send(c, ".\n", strlen(".\n"));
+    if (status == 0)
+      status = rc_conn_read_response(c, &response_status, message,
+                                     sizeof(message), NULL, 0);
+    if (status != 0)
+      return status;
+    if (response_status < 0) {
+      ERROR("rrdcached plugin: The daemon at %s refused the BATCH command: %s",
+            daemon_address, message);
+      return EPROTO;
+    }
+
+    status = rc_conn_read_response(c, &response_status, message,
+                                   sizeof(message), first_line,
+                                   sizeof(first_line));
+    if (status != 0)
+      return status;
+    if (response_status > 0)
+      c_complain(LOG_ERR, &c->complaint,
+                 "rrdcached plugin: %d of %" PRIsz " updates failed, e.g. "
+                 "command %s",
+                 response_status, updates_num, first_line);
+    else
+      c_release(LOG_INFO, &c->complaint,
+                "rrdcached plugin: Updates succeed again.");
+  }
+
+  /* Flush requests are pipelined, too. */
+  char command[PATH_MAX + 16];
+  for (size_t i = 0; i < flushes_num; i++) {
+    ssnprintf(command, sizeof(command), "FLUSH %s\n", flushes[i]);
+    status = rc_conn_send(c, command, strlen(command));
+    if (status != 0)
+      return status;
+  }
+  if (flush_all) {
+    status = rc_conn_send(c, "FLUSHALL\n", strlen("FLUSHALL\n"));
+    if (status != 0)
+      return status;
+  }
+  for (size_t i = 0; i < flushes_num + (flush_all ? 1 : 0); i++) {
+    status = rc_conn_read_response(c, &response_status, message,
+                                   sizeof(message), NULL, 0);
+    if (status != 0)
+      return status;
+    if (response_status < 0)
+      WARNING("rrdcached plugin: Flushing %s failed: %s",
+              (i < flushes_num) ? flushes[i] : "all files", message);
+  }
+
+  return 0;
+} /* int rc_conn_send_batch */
+
+static void *rc_conn_thread(void *arg) {
+  rc_conn_t *c = arg;
+  cdtime_t next_send = cdtime() + flush_interval;
+
+  pthread_mutex_lock(&c->lock);
+  while (42) {
+    bool flush_requested = c->flush_all || (c->flushes_num > 0);
+    bool shutting_down = c->shutdown;
+
+    if (!shutting_down && !flush_requested &&
+        (c->updates_num < (size_t)batch_size) && (cdtime() < next_send)) {
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(next_send);
+      pthread_cond_timedwait(&c->cond, &c->lock, &ts);
+      continue;
+    }
+
+    /* Take the queue, so that writes can go on while the batch is sent. */
+    char *updates = c->updates;
+    size_t updates_size = c->updates_size;
+    size_t updates_len = c->updates_len;
+    size_t updates_num = c->updates_num;
+    char **flushes = c->flushes;
+    size_t flushes_num = c->flushes_num;
+    bool flush_all = c->flush_all;
+
+    c->updates = c->spare;
+    c->updates_size = c->spare_size;
+    c->spare = NULL;
+    c->spare_size = 0;
+    c->updates_len = 0;
+    c->updates_num = 0;
+    c->flushes = NULL;
+    c->flushes_num = 0;
+    c->flush_all = false;
+    next_send = cdtime() + flush_interval;
+    pthread_mutex_unlock(&c->lock);
+
+    if ((updates_num > 0) || (flushes_num > 0) || flush_all) {
+      int status = rc_conn_send_batch(c, updates, updates_len, updates_num,
+                                      flushes, flushes_num, flush_all);
+      if (status != 0) {
+        /* The RRD client lib does not provide any means for checking a
+         * connection either, so retry once on a new connection. */
+        rc_conn_disconnect(c);
+        status = rc_conn_send_batch(c, updates, updates_len, updates_num,
+                                    flushes, flushes_num, flush_all);
+      }
+      if (status != 0) {
+        ERROR("rrdcached plugin: Sending %" PRIsz " updates to %s failed: %s",
+              updates_num, daemon_address, STRERROR(status));
+        rc_conn_disconnect(c);
+      }
+    }
+
+    for (size_t i = 0; i < flushes_num; i++)
+      sfree(flushes[i]);
+    sfree(flushes);
+
+    pthread_mutex_lock(&c->lock);
+    /* Keep the buffer around for the next batch. */
+    if (c->spare == NULL) {
+      c->spare = updates;
+      c->spare_size = updates_size;
+    } else {
+      sfree(updates);
+    }
+
+    if (shutting_down && (c->updates_num == 0))
+      break;
+  }
+  pthread_mutex_unlock(&c->lock);
+
+  rc_conn_disconnect(c);
+  return NULL;
+} /* void *rc_conn_thread */
+
+/* rc_conn_get returns the connection for "filename". */
+static rc_conn_t *rc_conn_get(char const *filename) {
+  uint32_t hash = 2166136261u;
+  for (char const *ptr = filename; *ptr != 0; ptr++)
+    hash = (hash ^ (uint8_t)*ptr) * 16777619u;
+  return conns + (hash % conns_num);
+} /* rc_conn_t *rc_conn_get */
+
+/* rc_escape escapes spaces and backslashes in file names, like librrd does. */
+static int rc_escape(char *buffer, size_t buffer_size, char const *s) {
+  size_t len = 0;
+  for (; *s != 0; s++) {
+    if ((*s == ' ') || (*s == '\\')) {
+      if (len + 1 >= buffer_size)
+        return ENOMEM;
+      buffer[len++] = '\\';
+    }
+    if (len + 1 >= buffer_size)
+      return ENOMEM;
+    buffer[len++] = *s;
+  }
+  buffer[len] = 0;
+  return 0;
+} /* int rc_escape */
+/* }}} */
+
 static int rc_read(void) {
 
   value_list_t vl = VALUE_LIST_INIT;
@@ -366,6 +772,52 @@ static int rc_init(void) {
   if (config_collect_stats)
     plugin_register_read("rrdcached", rc_read);
 
+  if (daemon_address == NULL)
+    return 0;
+
+  /* librrd sends absolute file names to local daemons. Do the same, so that
+   * the daemon doesn't resolve a relative "DataDir" in its base directory. */
+  if (((strncmp("unix:", daemon_address, strlen("unix:")) == 0) ||
+       (daemon_address[0] == '/')) &&
+      ((datadir == NULL) || (datadir[0] != '/'))) {
+    char cwd[PATH_MAX];
+    char path[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+      ERROR("rrdcached plugin: getcwd failed: %s", STRERRNO);
+      return -1;
+    }
+    if (datadir != NULL)
+      ssnprintf(path, sizeof(path), "%s/%s", cwd, datadir);
+    else
+      sstrncpy(path, cwd, sizeof(path));
+    sfree(datadir);
+    datadir = strdup(path);
+    if (datadir == NULL)
+      return ENOMEM;
+  }
+
+  conns = calloc(conns_num, sizeof(*conns));
+  if (conns == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < conns_num; i++) {
+    rc_conn_t *c = conns + i;
+    c->fd = -1;
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->cond, NULL);
+    C_COMPLAIN_INIT(&c->complaint);
+    C_COMPLAIN_INIT(&c->queue_complaint);
+
+    int status = plugin_thread_create(&c->thread, rc_conn_thread, c,
+                                      "rrdcached conn");
+    if (status != 0) {
+      ERROR("rrdcached plugin: Starting a connection thread failed: %s",
+            STRERROR(status));
+      return -1;
+    }
+    c->thread_running = true;
+  }
+
   return 0;
 } /* int rc_init */
 
@@ -374,9 +826,8 @@ static int rc_write(const data_set_t *ds, const value_list_t *vl,
   char filename[PATH_MAX];
   char values[512];
   int status;
-  bool retried = false;
 
-  if (daemon_address == NULL) {
+  if ((daemon_address == NULL) || (conns == NULL)) {
     ERROR("rrdcached plugin: daemon_address == NULL.");
     plugin_unregister_write("rrdcached");
     return -1;
@@ -416,92 +867,143 @@ static int rc_write(const data_set_t *ds, const value_list_t *vl,
     }
   }
 
-  rrd_clear_error();
-  status = rrdc_connect(daemon_address);
-  if (status != 0) {
-    ERROR("rrdcached plugin: Failed to connect to RRDCacheD "
-          "at %s: %s (status=%d)",
-          daemon_address, rrd_get_error(), status);
+  char escaped[2 * sizeof(filename)];
+  if (rc_escape(escaped, sizeof(escaped), filename) != 0) {
+    ERROR("rrdcached plugin: The file name \"%s\" is too long.", filename);
     return -1;
   }
 
-  char *values_array[2] = {
-      [0] = values,
-      [1] = NULL,
-  };
-
-  while (42) {
-    /* The RRD client lib does not provide any means for checking a
-     * connection, hence we'll have to retry upon failed operations. */
-    rrd_clear_error();
-    status = rrdc_update(filename, /* values_num = */ 1, (void *)values_array);
-    if (status == 0)
-      break;
+  char command[sizeof(escaped) + sizeof(values) + 16];
+  int command_len =
+      ssnprintf(command, sizeof(command), "UPDATE %s %s\n", escaped, values);
+  if ((command_len < 0) || ((size_t)command_len >= sizeof(command)))
+    return -1;
 
-    if (!retried) {
-      retried = true;
-      if (try_reconnect() == 0)
-        continue;
-      /* else: report the error and fail */
-    }
+  rc_conn_t *c = rc_conn_get(filename);
+  pthread_mutex_lock(&c->lock);
 
-    ERROR("rrdcached plugin: rrdc_update (%s, [%s], 1) failed: %s (status=%i)",
-          filename, values_array[0], rrd_get_error(), status);
+  if ((queue_limit > 0) && (c->updates_num >= (size_t)queue_limit)) {
+    c_complain(LOG_WARNING, &c->queue_complaint,
+               "rrdcached plugin: %" PRIsz " updates are queued for %s, "
+               "dropping new updates.",
+               c->updates_num, daemon_address);
+    pthread_mutex_unlock(&c->lock);
     return -1;
   }
+  c_release(LOG_INFO, &c->queue_complaint,
+            "rrdcached plugin: The update queue for %s is no longer full.",
+            daemon_address);
+
+  if (c->updates_size - c->updates_len < (size_t)command_len) {
+    size_t new_size = (c->updates_size == 0) ? 65536 : 2 * c->updates_size;
+    char *tmp = realloc(c->updates, new_size);
+    if (tmp == NULL) {
+      pthread_mutex_unlock(&c->lock);
+      ERROR("rrdcached plugin: realloc failed.");
+      return -1;
+    }
+    c->updates = tmp;
+    c->updates_size = new_size;
+  }
+  memcpy(c->updates + c->updates_len, command, (size_t)command_len);
+  c->updates_len += (size_t)command_len;
+  c->updates_num++;
+
+  if (c->updates_num == (size_t)batch_size)
+    pthread_cond_signal(&c->cond);
+  pthread_mutex_unlock(&c->lock);
 
   return 0;
 } /* int rc_write */
 
+/* rc_flush only queues the request. It is sent after the next batch of
+ * updates, and requests for the same file are sent only once. */
 static int rc_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
                     const char *identifier,
                     __attribute__((unused)) user_data_t *ud) {
-  if (identifier == NULL)
-    return EINVAL;
+  if (conns == NULL)
+    return -1;
+
+  if (identifier == NULL) {
+    for (size_t i = 0; i < conns_num; i++) {
+      pthread_mutex_lock(&conns[i].lock);
+      conns[i].flush_all = true;
+      pthread_cond_signal(&conns[i].cond);
+      pthread_mutex_unlock(&conns[i].lock);
+    }
+    return 0;
+  }
 
   char filename[PATH_MAX + 1];
+  char escaped[2 * sizeof(filename)];
 
   if (datadir != NULL)
     ssnprintf(filename, sizeof(filename), "%s/%s.rrd", datadir, identifier);
   else
     ssnprintf(filename, sizeof(filename), "%s.rrd", identifier);
 
-  rrd_clear_error();
-  int status = rrdc_connect(daemon_address);
-  if (status != 0) {
-    ERROR("rrdcached plugin: Failed to connect to RRDCacheD "
-          "at %s: %s (status=%d)",
-          daemon_address, rrd_get_error(), status);
-    return -1;
-  }
+  if (rc_escape(escaped, sizeof(escaped), filename) != 0)
+    return ENOMEM;
 
-  bool retried = false;
+  rc_conn_t *c = rc_conn_get(filename);
+  int status = 0;
 
-  while (42) {
-    /* The RRD client lib does not provide any means for checking a
-     * connection, hence we'll have to retry upon failed operations. */
-    rrd_clear_error();
-    status = rrdc_flush(filename);
-    if (status == 0)
+  pthread_mutex_lock(&c->lock);
+  bool queued = false;
+  for (size_t i = 0; i < c->flushes_num; i++) {
+    if (strcmp(c->flushes[i], escaped) == 0) {
+      queued = true;
       break;
-
-    if (!retried) {
-      retried = true;
-      if (try_reconnect() == 0)
-        continue;
-      /* else: report the error and fail */
     }
-
-    ERROR("rrdcached plugin: rrdc_flush (%s) failed: %s (status=%i).", filename,
-          rrd_get_error(), status);
-    return -1;
   }
-  DEBUG("rrdcached plugin: rrdc_flush (%s): Success.", filename);
+  if (!queued) {
+    char **tmp =
+        realloc(c->flushes, (c->flushes_num + 1) * sizeof(*c->flushes));
+    char *copy = strdup(escaped);
+    if (tmp != NULL)
+      c->flushes = tmp;
+    if ((tmp == NULL) || (copy == NULL)) {
+      sfree(copy);
+      status = ENOMEM;
+    } else {
+      c->flushes[c->flushes_num] = copy;
+      c->flushes_num++;
+    }
+  }
+  pthread_cond_signal(&c->cond);
+  pthread_mutex_unlock(&c->lock);
 
-  return 0;
+  DEBUG("rrdcached plugin: rc_flush (%s): Queued.", filename);
+  return status;
 } /* }}} int rc_flush */
 
 static int rc_shutdown(void) {
+  for (size_t i = 0; (conns != NULL) && (i < conns_num); i++) {
+    rc_conn_t *c = conns + i;
+    if (!c->thread_running)
+      continue;
+
+    /* The thread sends what is still queued before it exits. */
+    pthread_mutex_lock(&c->lock);
+    c->shutdown = true;
+    pthread_cond_signal(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+    c->thread_running = false;
+  }
+
+  for (size_t i = 0; (conns != NULL) && (i < conns_num); i++) {
+    rc_conn_t *c = conns + i;
+    for (size_t j = 0; j < c->flushes_num; j++)
+      sfree(c->flushes[j]);
+    sfree(c->flushes);
+    sfree(c->updates);
+    sfree(c->spare);
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->cond);
+  }
+  sfree(conns);
+
   rrdc_disconnect();
   return 0;
 } /* int rc_shutdown */
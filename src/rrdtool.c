@@ -36,31 +36,60 @@
 /*
  * Private types
  */
-typedef struct rrd_cache_s {
+typedef struct rrd_cache_s rrd_cache_t;
+struct rrd_cache_s {
   int values_num;
   char **values;
   cdtime_t first_value;
   cdtime_t last_value;
   int64_t random_variation;
   enum { FLAG_NONE = 0x00, FLAG_QUEUED = 0x01, FLAG_FLUSHQ = 0x02 } flags;
-} rrd_cache_t;
+
+  /* The key of this entry, owned by the "cache" tree. */
+  char *filename;
+  /* All entries are linked in a circular list, which rrd_cache_flush_step()
+   * walks a few entries at a time. */
+  rrd_cache_t *flush_prev;
+  rrd_cache_t *flush_next;
+};
 
 enum rrd_queue_dir_e { QUEUE_INSERT_FRONT, QUEUE_INSERT_BACK };
 typedef enum rrd_queue_dir_e rrd_queue_dir_t;
 
 struct rrd_queue_s {
   char *filename;
+  cdtime_t time;
   struct rrd_queue_s *next;
 };
 typedef struct rrd_queue_s rrd_queue_t;
 
+/* Each update thread drains a queue of its own. Files are assigned to queues
+ * by the hash of their name, so the updates of one file are always written in
+ * order by the same thread. */
+struct rrd_queue_shard_s {
+  rrd_queue_t *head;
+  rrd_queue_t *tail;
+  rrd_queue_t *flushq_head;
+  rrd_queue_t *flushq_tail;
+  size_t length;
+  size_t flushq_length;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  pthread_t thread;
+  bool thread_running;
+};
+typedef struct rrd_queue_shard_s rrd_queue_shard_t;
+
 /*
  * Private variables
  */
 static const char *config_keys[] = {
-    "CacheTimeout", "CacheFlush",      "CreateFilesAsync", "DataDir",
-    "StepSize",     "HeartBeat",       "RRARows",          "RRATimespan",
-    "XFF",          "WritesPerSecond", "RandomTimeout"};
+    "CacheTimeout",  "CacheFlush",      "CreateFilesAsync", "DataDir",
+    "StepSize",      "HeartBeat",       "RRARows",          "RRATimespan",
+    "XFF",           "WritesPerSecond", "RandomTimeout",    "UpdateThreads",
+    "ReportStats"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /* If datadir is zero, the daemon's basedir is used. If stepsize or heartbeat
@@ -82,23 +111,28 @@ static rrdcreate_config_t rrdcreate_config = {
 
     /* async = */ 0};
 
-/* XXX: If you need to lock both, cache_lock and queue_lock, at the same time,
- * ALWAYS lock `cache_lock' first! */
+/* XXX: If you need to lock both, cache_lock and a queue's lock, at the same
+ * time, ALWAYS lock `cache_lock' first! */
 static cdtime_t cache_timeout;
 static cdtime_t cache_flush_timeout;
 static cdtime_t random_timeout;
 static cdtime_t cache_flush_last;
+static double cache_flush_credit;
 static c_avl_tree_t *cache;
+static rrd_cache_t *cache_flush_cursor;
 static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static rrd_queue_t *queue_head;
-static rrd_queue_t *queue_tail;
-static rrd_queue_t *flushq_head;
-static rrd_queue_t *flushq_tail;
-static pthread_t queue_thread;
-static int queue_thread_running = 1;
-static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static int update_threads = 1;
+static rrd_queue_shard_t *queues;
+static size_t queues_num;
+
+static bool report_stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static derive_t stats_updates;
+static derive_t stats_values;
+static cdtime_t stats_latency_sum;
+static cdtime_t stats_latency_max;
+static uint64_t stats_latency_num;
 
 #if !HAVE_THREADSAFE_LIBRRD
 static pthread_mutex_t librrd_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -279,10 +313,14 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
   return 0;
 } /* int value_list_to_filename */
 
-static void *rrd_queue_thread(void __attribute__((unused)) * data) {
+static void *rrd_queue_thread(void *data) {
+  rrd_queue_shard_t *q = data;
   struct timeval tv_next_update;
   struct timeval tv_now;
 
+  /* "WritesPerSecond" is shared by all update threads. */
+  double thread_write_rate = write_rate * (double)queues_num;
+
   gettimeofday(&tv_next_update, /* timezone = */ NULL);
 
   while (42) {
@@ -295,20 +333,20 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
     values = NULL;
     values_num = 0;
 
-    pthread_mutex_lock(&queue_lock);
+    pthread_mutex_lock(&q->lock);
     /* Wait for values to arrive */
     while (42) {
       struct timespec ts_wait;
 
-      while ((flushq_head == NULL) && (queue_head == NULL) &&
+      while ((q->flushq_head == NULL) && (q->head == NULL) &&
              (do_shutdown == 0))
-        pthread_cond_wait(&queue_cond, &queue_lock);
+        pthread_cond_wait(&q->cond, &q->lock);
 
-      if ((flushq_head == NULL) && (queue_head == NULL))
+      if ((q->flushq_head == NULL) && (q->head == NULL))
         break;
 
       /* Don't delay if there's something to flush */
-      if (flushq_head != NULL)
+      if (q->flushq_head != NULL)
         break;
 
       /* Don't delay if we're shutting down */
@@ -316,7 +354,7 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
         break;
 
       /* Don't delay if no delay was configured. */
-      if (write_rate <= 0.0)
+      if (thread_write_rate <= 0.0)
         break;
 
       gettimeofday(&tv_now, /* timezone = */ NULL);
@@ -331,39 +369,41 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
       ts_wait.tv_sec = tv_next_update.tv_sec;
       ts_wait.tv_nsec = 1000 * tv_next_update.tv_usec;
 
-      status = pthread_cond_timedwait(&queue_cond, &queue_lock, &ts_wait);
+      status = pthread_cond_timedwait(&q->cond, &q->lock, &ts_wait);
       if (status == ETIMEDOUT)
         break;
     } /* while (42) */
 
-    /* XXX: If you need to lock both, cache_lock and queue_lock, at
+    /* XXX: If you need to lock both, cache_lock and a queue's lock, at
      * the same time, ALWAYS lock `cache_lock' first! */
 
     /* We're in the shutdown phase */
-    if ((flushq_head == NULL) && (queue_head == NULL)) {
-      pthread_mutex_unlock(&queue_lock);
+    if ((q->flushq_head == NULL) && (q->head == NULL)) {
+      pthread_mutex_unlock(&q->lock);
       break;
     }
 
-    if (flushq_head != NULL) {
+    if (q->flushq_head != NULL) {
       /* Dequeue the first flush entry */
-      queue_entry = flushq_head;
-      if (flushq_head == flushq_tail)
-        flushq_head = flushq_tail = NULL;
+      queue_entry = q->flushq_head;
+      if (q->flushq_head == q->flushq_tail)
+        q->flushq_head = q->flushq_tail = NULL;
       else
-        flushq_head = flushq_head->next;
-    } else /* if (queue_head != NULL) */
+        q->flushq_head = q->flushq_head->next;
+      q->flushq_length--;
+    } else /* if (q->head != NULL) */
     {
       /* Dequeue the first regular entry */
-      queue_entry = queue_head;
-      if (queue_head == queue_tail)
-        queue_head = queue_tail = NULL;
+      queue_entry = q->head;
+      if (q->head == q->tail)
+        q->head = q->tail = NULL;
       else
-        queue_head = queue_head->next;
+        q->head = q->head->next;
+      q->length--;
     }
 
     /* Unlock the queue again */
-    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_unlock(&q->lock);
 
     /* We now need the cache lock so the entry isn't updated while
      * we make a copy of its values */
@@ -389,11 +429,11 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
     }
 
     /* Update `tv_next_update' */
-    if (write_rate > 0.0) {
+    if (thread_write_rate > 0.0) {
       gettimeofday(&tv_now, /* timezone = */ NULL);
       tv_next_update.tv_sec = tv_now.tv_sec;
       tv_next_update.tv_usec =
-          tv_now.tv_usec + ((suseconds_t)(1000000 * write_rate));
+          tv_now.tv_usec + ((suseconds_t)(1000000 * thread_write_rate));
       while (tv_next_update.tv_usec > 1000000) {
         tv_next_update.tv_sec++;
         tv_next_update.tv_usec -= 1000000;
@@ -405,6 +445,19 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
     DEBUG("rrdtool plugin: queue thread: Wrote %i value%s to %s", values_num,
           (values_num == 1) ? "" : "s", queue_entry->filename);
 
+    if (report_stats) {
+      cdtime_t latency = cdtime() - queue_entry->time;
+
+      pthread_mutex_lock(&stats_lock);
+      stats_updates++;
+      stats_values += (derive_t)values_num;
+      stats_latency_sum += latency;
+      stats_latency_num++;
+      if (stats_latency_max < latency)
+        stats_latency_max = latency;
+      pthread_mutex_unlock(&stats_lock);
+    }
+
     for (int i = 0; i < values_num; i++) {
       sfree(values[i]);
     }
@@ -417,8 +470,18 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
   return (void *)0;
 } /* void *rrd_queue_thread */
 
-static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
-                             rrd_queue_t **tail) {
+/* rrd_queue_get returns the queue "filename" is assigned to. */
+static rrd_queue_shard_t *rrd_queue_get(const char *filename) {
+  /* FNV-1a */
+  uint32_t hash = 2166136261u;
+  for (const char *c = filename; *c != 0; c++)
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+
+  return queues + (hash % queues_num);
+} /* rrd_queue_shard_t *rrd_queue_get */
+
+static int rrd_queue_enqueue(const char *filename, bool flush) {
+  rrd_queue_shard_t *q = rrd_queue_get(filename);
   rrd_queue_t *queue_entry;
 
   queue_entry = malloc(sizeof(*queue_entry));
@@ -431,9 +494,13 @@ static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
     return -1;
   }
 
+  queue_entry->time = cdtime();
   queue_entry->next = NULL;
 
-  pthread_mutex_lock(&queue_lock);
+  pthread_mutex_lock(&q->lock);
+
+  rrd_queue_t **head = flush ? &q->flushq_head : &q->head;
+  rrd_queue_t **tail = flush ? &q->flushq_tail : &q->tail;
 
   if (*tail == NULL)
     *head = queue_entry;
@@ -441,21 +508,27 @@ static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
     (*tail)->next = queue_entry;
   *tail = queue_entry;
 
-  pthread_cond_signal(&queue_cond);
-  pthread_mutex_unlock(&queue_lock);
+  if (flush)
+    q->flushq_length++;
+  else
+    q->length++;
+
+  pthread_cond_signal(&q->cond);
+  pthread_mutex_unlock(&q->lock);
 
   return 0;
 } /* int rrd_queue_enqueue */
 
-static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
-                             rrd_queue_t **tail) {
+/* rrd_queue_dequeue removes "filename" from the regular (non-flush) queue. */
+static int rrd_queue_dequeue(const char *filename) {
+  rrd_queue_shard_t *q = rrd_queue_get(filename);
   rrd_queue_t *this;
   rrd_queue_t *prev;
 
-  pthread_mutex_lock(&queue_lock);
+  pthread_mutex_lock(&q->lock);
 
   prev = NULL;
-  this = *head;
+  this = q->head;
 
   while (this != NULL) {
     if (strcmp(this->filename, filename) == 0)
@@ -466,19 +539,21 @@ static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
   }
 
   if (this == NULL) {
-    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_unlock(&q->lock);
     return -1;
   }
 
   if (prev == NULL)
-    *head = this->next;
+    q->head = this->next;
   else
     prev->next = this->next;
 
   if (this->next == NULL)
-    *tail = prev;
+    q->tail = prev;
+
+  q->length--;
 
-  pthread_mutex_unlock(&queue_lock);
+  pthread_mutex_unlock(&q->lock);
 
   sfree(this->filename);
   sfree(this);
@@ -487,68 +562,119 @@ static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
 } /* int rrd_queue_dequeue */
 
 /* XXX: You must hold "cache_lock" when calling this function! */
-static void rrd_cache_flush(cdtime_t timeout) {
-  rrd_cache_t *rc;
-  cdtime_t now;
+static void rrd_cache_link(rrd_cache_t *rc) {
+  if (cache_flush_cursor == NULL) {
+    rc->flush_prev = rc;
+    rc->flush_next = rc;
+    cache_flush_cursor = rc;
+    return;
+  }
 
-  char **keys = NULL;
-  int keys_num = 0;
+  /* Insert right before the cursor, i.e. new entries are checked last. */
+  rc->flush_next = cache_flush_cursor;
+  rc->flush_prev = cache_flush_cursor->flush_prev;
+  rc->flush_prev->flush_next = rc;
+  cache_flush_cursor->flush_prev = rc;
+} /* void rrd_cache_link */
 
-  char *key;
-  c_avl_iterator_t *iter;
+/* XXX: You must hold "cache_lock" when calling this function! */
+static void rrd_cache_unlink(rrd_cache_t *rc) {
+  if (rc->flush_next == NULL)
+    return;
 
-  DEBUG("rrdtool plugin: Flushing cache, timeout = %.3f",
-        CDTIME_T_TO_DOUBLE(timeout));
+  if (rc->flush_next == rc) {
+    cache_flush_cursor = NULL;
+  } else {
+    rc->flush_prev->flush_next = rc->flush_next;
+    rc->flush_next->flush_prev = rc->flush_prev;
+    if (cache_flush_cursor == rc)
+      cache_flush_cursor = rc->flush_next;
+  }
 
-  now = cdtime();
+  rc->flush_prev = NULL;
+  rc->flush_next = NULL;
+} /* void rrd_cache_unlink */
+
+/* rrd_cache_flush_walk checks up to "num" entries, starting at the cursor.
+ * Entries older than "timeout" are queued, ancient and empty entries are
+ * removed.
+ * XXX: You must hold "cache_lock" when calling this function! */
+static void rrd_cache_flush_walk(cdtime_t now, cdtime_t timeout, size_t num) {
+  for (size_t i = 0; (i < num) && (cache_flush_cursor != NULL); i++) {
+    rrd_cache_t *rc = cache_flush_cursor;
+    cache_flush_cursor = rc->flush_next;
 
-  /* Build a list of entries to be flushed */
-  iter = c_avl_get_iterator(cache);
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&rc) == 0) {
     if (rc->flags != FLAG_NONE)
       continue;
     /* timeout == 0  =>  flush everything */
     else if ((timeout != 0) && ((now - rc->first_value) < timeout))
       continue;
     else if (rc->values_num > 0) {
-      int status;
-
-      status = rrd_queue_enqueue(key, &queue_head, &queue_tail);
-      if (status == 0)
+      if (rrd_queue_enqueue(rc->filename, /* flush = */ false) == 0)
         rc->flags = FLAG_QUEUED;
-    } else /* ancient and no values -> waste of memory */
-    {
-      char **tmp = realloc(keys, (keys_num + 1) * sizeof(char *));
-      if (tmp == NULL) {
-        ERROR("rrdtool plugin: realloc failed: %s", STRERRNO);
-        c_avl_iterator_destroy(iter);
-        sfree(keys);
-        return;
-      }
-      keys = tmp;
-      keys[keys_num] = key;
-      keys_num++;
+      continue;
     }
-  } /* while (c_avl_iterator_next) */
-  c_avl_iterator_destroy(iter);
 
-  for (int i = 0; i < keys_num; i++) {
-    if (c_avl_remove(cache, keys[i], (void *)&key, (void *)&rc) != 0) {
-      DEBUG("rrdtool plugin: c_avl_remove (%s) failed.", keys[i]);
+    /* ancient and no values -> waste of memory */
+    char *key = NULL;
+    if (c_avl_remove(cache, rc->filename, (void *)&key, NULL) != 0) {
+      DEBUG("rrdtool plugin: c_avl_remove (%s) failed.", rc->filename);
       continue;
     }
+    rrd_cache_unlink(rc);
 
     assert(rc->values == NULL);
     assert(rc->values_num == 0);
 
     sfree(rc);
     sfree(key);
-    keys[i] = NULL;
-  } /* for (i = 0..keys_num) */
+  }
+} /* void rrd_cache_flush_walk */
+
+/* rrd_cache_flush_step checks the share of the cache that became due since
+ * the last call. Every entry is still checked once per "CacheFlush" interval,
+ * but the work is spread evenly instead of walking the whole cache at once.
+ * XXX: You must hold "cache_lock" when calling this function! */
+static void rrd_cache_flush_step(cdtime_t now) {
+  size_t size = (size_t)c_avl_size(cache);
+
+  if ((size == 0) || (cache_flush_timeout == 0) || (now <= cache_flush_last)) {
+    cache_flush_last = now;
+    return;
+  }
+
+  cache_flush_credit += (double)size *
+                        CDTIME_T_TO_DOUBLE(now - cache_flush_last) /
+                        CDTIME_T_TO_DOUBLE(cache_flush_timeout);
+  cache_flush_last = now;
+
+  if (cache_flush_credit < 1.0)
+    return;
+
+  size_t num = (size_t)cache_flush_credit;
+  if (num >= size) {
+    num = size;
+    cache_flush_credit = 0.0;
+  } else {
+    cache_flush_credit -= (double)num;
+  }
+
+  rrd_cache_flush_walk(now, cache_timeout + random_timeout, num);
+} /* void rrd_cache_flush_step */
+
+/* XXX: You must hold "cache_lock" when calling this function! */
+static void rrd_cache_flush(cdtime_t timeout) {
+  cdtime_t now;
+
+  DEBUG("rrdtool plugin: Flushing cache, timeout = %.3f",
+        CDTIME_T_TO_DOUBLE(timeout));
+
+  now = cdtime();
 
-  sfree(keys);
+  rrd_cache_flush_walk(now, timeout, (size_t)c_avl_size(cache));
 
   cache_flush_last = now;
+  cache_flush_credit = 0.0;
 } /* void rrd_cache_flush */
 
 static int rrd_cache_flush_identifier(cdtime_t timeout,
@@ -582,14 +708,14 @@ static int rrd_cache_flush_identifier(cdtime_t timeout,
   if (rc->flags == FLAG_FLUSHQ) {
     status = 0;
   } else if (rc->flags == FLAG_QUEUED) {
-    rrd_queue_dequeue(key, &queue_head, &queue_tail);
-    status = rrd_queue_enqueue(key, &flushq_head, &flushq_tail);
+    rrd_queue_dequeue(key);
+    status = rrd_queue_enqueue(key, /* flush = */ true);
     if (status == 0)
       rc->flags = FLAG_FLUSHQ;
   } else if ((now - rc->first_value) < timeout) {
     status = 0;
   } else if (rc->values_num > 0) {
-    status = rrd_queue_enqueue(key, &flushq_head, &flushq_tail);
+    status = rrd_queue_enqueue(key, /* flush = */ true);
     if (status == 0)
       rc->flags = FLAG_FLUSHQ;
   }
@@ -634,6 +760,9 @@ static int rrd_cache_insert(const char *filename, const char *value,
     rc->last_value = 0;
     rc->random_variation = rrd_get_random_variation();
     rc->flags = FLAG_NONE;
+    rc->filename = NULL;
+    rc->flush_prev = NULL;
+    rc->flush_next = NULL;
     new_rc = 1;
   }
 
@@ -652,6 +781,7 @@ static int rrd_cache_insert(const char *filename, const char *value,
     void *cache_key = NULL;
 
     c_avl_remove(cache, filename, &cache_key, NULL);
+    rrd_cache_unlink(rc);
     pthread_mutex_unlock(&cache_lock);
 
     ERROR("rrdtool plugin: realloc failed: %s", STRERRNO);
@@ -687,6 +817,8 @@ static int rrd_cache_insert(const char *filename, const char *value,
     }
 
     c_avl_insert(cache, cache_key, rc);
+    rc->filename = cache_key;
+    rrd_cache_link(rc);
   }
 
   DEBUG("rrdtool plugin: rrd_cache_insert: file = %s; "
@@ -696,12 +828,12 @@ static int rrd_cache_insert(const char *filename, const char *value,
 
   if ((rc->last_value - rc->first_value) >=
       (cache_timeout + rc->random_variation)) {
-    /* XXX: If you need to lock both, cache_lock and queue_lock, at
+    /* XXX: If you need to lock both, cache_lock and a queue's lock, at
      * the same time, ALWAYS lock `cache_lock' first! */
     if (rc->flags == FLAG_NONE) {
       int status;
 
-      status = rrd_queue_enqueue(filename, &queue_head, &queue_tail);
+      status = rrd_queue_enqueue(filename, /* flush = */ false);
       if (status == 0)
         rc->flags = FLAG_QUEUED;
 
@@ -711,9 +843,8 @@ static int rrd_cache_insert(const char *filename, const char *value,
     }
   }
 
-  if ((cache_timeout > 0) &&
-      ((cdtime() - cache_flush_last) > cache_flush_timeout))
-    rrd_cache_flush(cache_timeout + random_timeout);
+  if (cache_timeout > 0)
+    rrd_cache_flush_step(cdtime());
 
   pthread_mutex_unlock(&cache_lock);
 
@@ -754,6 +885,7 @@ static int rrd_cache_destroy(void) /* {{{ */
 
   c_avl_destroy(cache);
   cache = NULL;
+  cache_flush_cursor = NULL;
 
   if (non_empty > 0) {
     INFO("rrdtool plugin: %i cache %s had values when destroying the cache.",
@@ -978,40 +1110,142 @@ static int rrd_config(const char *key, const char *value) {
     } else {
       random_timeout = DOUBLE_TO_CDTIME_T(tmp);
     }
+  } else if (strcasecmp("UpdateThreads", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      fprintf(stderr, "rrdtool: `UpdateThreads' must "
+                      "be greater than zero.\n");
+      ERROR("rrdtool: `UpdateThreads' must "
+            "be greater than zero.");
+      return 1;
+    }
+    update_threads = tmp;
+  } else if (strcasecmp("ReportStats", key) == 0) {
+    report_stats = IS_TRUE(value);
   } else {
     return -1;
   }
   return 0;
 } /* int rrd_config */
 
+static int rrd_stats_read(void) /* {{{ */
+{
+  gauge_t copy_queue_length = 0;
+  gauge_t copy_flushq_length = 0;
+  derive_t copy_updates;
+  derive_t copy_values;
+  gauge_t copy_latency_average = NAN;
+  gauge_t copy_latency_max = NAN;
+  value_list_t vl = VALUE_LIST_INIT;
+
+  for (size_t i = 0; i < queues_num; i++) {
+    pthread_mutex_lock(&queues[i].lock);
+    copy_queue_length += (gauge_t)queues[i].length;
+    copy_flushq_length += (gauge_t)queues[i].flushq_length;
+    pthread_mutex_unlock(&queues[i].lock);
+  }
+
+  /* The latency is reported per interval, reset it when copying. */
+  pthread_mutex_lock(&stats_lock);
+  copy_updates = stats_updates;
+  copy_values = stats_values;
+  if (stats_latency_num > 0) {
+    copy_latency_average = CDTIME_T_TO_DOUBLE(stats_latency_sum) /
+                           (gauge_t)stats_latency_num;
+    copy_latency_max = CDTIME_T_TO_DOUBLE(stats_latency_max);
+  }
+  stats_latency_sum = 0;
+  stats_latency_max = 0;
+  stats_latency_num = 0;
+  pthread_mutex_unlock(&stats_lock);
+
+  vl.values = &(value_t){.gauge = copy_queue_length};
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "rrdtool", sizeof(vl.plugin));
+
+  /* Entries waiting for an update thread */
+  sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "update", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = copy_flushq_length};
+  sstrncpy(vl.type_instance, "flush", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Values written and update operations performed */
+  vl.values = &(value_t){.derive = copy_values};
+  sstrncpy(vl.type, "total_values", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "written", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = copy_updates};
+  sstrncpy(vl.type, "total_operations", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "update", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Time from queueing a file until it has been written */
+  vl.values = &(value_t){.gauge = copy_latency_average};
+  sstrncpy(vl.type, "latency", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "average", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = copy_latency_max};
+  sstrncpy(vl.type_instance, "max", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  return 0;
+} /* }}} int rrd_stats_read */
+
 static int rrd_shutdown(void) {
   pthread_mutex_lock(&cache_lock);
   rrd_cache_flush(0);
   pthread_mutex_unlock(&cache_lock);
 
-  pthread_mutex_lock(&queue_lock);
-  do_shutdown = 1;
-  pthread_cond_signal(&queue_cond);
-  pthread_mutex_unlock(&queue_lock);
+  bool busy = false;
+  bool running = false;
+  for (size_t i = 0; i < queues_num; i++) {
+    rrd_queue_shard_t *q = queues + i;
+
+    pthread_mutex_lock(&q->lock);
+    do_shutdown = 1;
+    pthread_cond_signal(&q->cond);
+    if ((q->head != NULL) || (q->flushq_head != NULL))
+      busy = true;
+    pthread_mutex_unlock(&q->lock);
 
-  if ((queue_thread_running != 0) &&
-      ((queue_head != NULL) || (flushq_head != NULL))) {
-    INFO("rrdtool plugin: Shutting down the queue thread. "
+    if (q->thread_running)
+      running = true;
+  }
+
+  if (running && busy) {
+    INFO("rrdtool plugin: Shutting down the queue threads. "
          "This may take a while.");
-  } else if (queue_thread_running != 0) {
-    INFO("rrdtool plugin: Shutting down the queue thread.");
+  } else if (running) {
+    INFO("rrdtool plugin: Shutting down the queue threads.");
   }
 
   /* Wait for all the values to be written to disk before returning. */
-  if (queue_thread_running != 0) {
-    pthread_join(queue_thread, NULL);
-    memset(&queue_thread, 0, sizeof(queue_thread));
-    queue_thread_running = 0;
-    DEBUG("rrdtool plugin: queue_thread exited.");
+  for (size_t i = 0; i < queues_num; i++) {
+    rrd_queue_shard_t *q = queues + i;
+
+    if (!q->thread_running)
+      continue;
+
+    pthread_join(q->thread, NULL);
+    memset(&q->thread, 0, sizeof(q->thread));
+    q->thread_running = false;
   }
+  DEBUG("rrdtool plugin: queue threads exited.");
 
   rrd_cache_destroy();
 
+  for (size_t i = 0; i < queues_num; i++) {
+    pthread_mutex_destroy(&queues[i].lock);
+    pthread_cond_destroy(&queues[i].cond);
+  }
+  sfree(queues);
+  queues_num = 0;
+
   return 0;
 } /* int rrd_shutdown */
 
@@ -1025,6 +1259,19 @@ static int rrd_init(void) {
   if (rrdcreate_config.heartbeat <= 0)
     rrdcreate_config.heartbeat = 2 * rrdcreate_config.stepsize;
 
+  /* Set the queues up before the cache, so that rrd_cache_insert() never
+   * sees a cache without queues. */
+  queues = calloc((size_t)update_threads, sizeof(*queues));
+  if (queues == NULL) {
+    ERROR("rrdtool plugin: calloc failed.");
+    return -1;
+  }
+  queues_num = (size_t)update_threads;
+  for (size_t i = 0; i < queues_num; i++) {
+    pthread_mutex_init(&queues[i].lock, /* attr = */ NULL);
+    pthread_cond_init(&queues[i].cond, /* attr = */ NULL);
+  }
+
   /* Set the cache up */
   pthread_mutex_lock(&cache_lock);
 
@@ -1057,19 +1304,24 @@ static int rrd_init(void) {
 
   pthread_mutex_unlock(&cache_lock);
 
-  int status = plugin_thread_create(&queue_thread, rrd_queue_thread,
-                                    /* args = */ NULL, "rrdtool queue");
-  if (status != 0) {
-    ERROR("rrdtool plugin: Cannot create queue-thread.");
-    return -1;
+  for (size_t i = 0; i < queues_num; i++) {
+    int status = plugin_thread_create(&queues[i].thread, rrd_queue_thread,
+                                      queues + i, "rrdtool queue");
+    if (status != 0) {
+      ERROR("rrdtool plugin: Cannot create queue-thread.");
+      return -1;
+    }
+    queues[i].thread_running = true;
   }
-  queue_thread_running = 1;
+
+  if (report_stats)
+    plugin_register_read("rrdtool", rrd_stats_read);
 
   DEBUG("rrdtool plugin: rrd_init: datadir = %s; stepsize = %lu;"
-        " heartbeat = %i; rrarows = %i; xff = %lf;",
+        " heartbeat = %i; rrarows = %i; xff = %lf; update_threads = %zu;",
         (datadir == NULL) ? "(null)" : datadir, rrdcreate_config.stepsize,
         rrdcreate_config.heartbeat, rrdcreate_config.rrarows,
-        rrdcreate_config.xff);
+        rrdcreate_config.xff, queues_num);
 
   return 0;
 } /* int rrd_init */
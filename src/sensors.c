@@ -37,6 +37,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/file_batch/file_batch.h"
 #include "utils/ignorelist/ignorelist.h"
 
 #if defined(HAVE_SENSORS_SENSORS_H)
@@ -66,15 +67,27 @@ static char *conffile = SENSORS_CONF_PATH;
 /* #endif SENSORS_API_VERSION < 0x400 */
 
 #elif (SENSORS_API_VERSION >= 0x400)
+/* The identifier of each subfeature is built when the list is loaded. Features
+ * excluded by the "Sensor" option are not added to the list at all. */
 typedef struct featurelist {
   const sensors_chip_name *chip;
   const sensors_feature *feature;
   const sensors_subfeature *subfeature;
+  const char *type;
+  char plugin_instance[DATA_MAX_NAME_LEN];
+  char type_instance[DATA_MAX_NAME_LEN];
+  /* Index of the subfeature's sysfs file in "sensor_files", or -1 if the
+   * value is read with sensors_get_value(). */
+  int file;
+  /* Divisor converting the raw sysfs value to the unit used by libsensors. */
+  double scale;
   struct featurelist *next;
 } featurelist_t;
 
 static char *conffile;
 static bool use_labels;
+/* The "*_input" sysfs files of the subfeatures, kept open between reads. */
+static file_batch_t *sensor_files;
 #endif
 
 static featurelist_t *first_feature;
@@ -129,7 +142,105 @@ static void sensors_free_features(void) {
     sfree(thisft);
   }
   first_feature = NULL;
+
+#if (SENSORS_API_VERSION >= 0x400)
+  file_batch_destroy(sensor_files);
+  sensor_files = NULL;
+#endif
+}
+
+static bool sensors_ignored(const char *plugin_instance, const char *type,
+                            const char *type_instance) {
+  char match_key[1024];
+
+  if (sensor_list == NULL)
+    return false;
+
+  int status = snprintf(match_key, sizeof(match_key), "%s/%s-%s",
+                        plugin_instance, type, type_instance);
+  if (status < 1)
+    return true;
+
+  DEBUG("sensors plugin: Checking ignorelist for `%s'", match_key);
+  return ignorelist_match(sensor_list, match_key) != 0;
+}
+
+#if (SENSORS_API_VERSION >= 0x400)
+static const char *sensors_type_name(const sensors_feature *feature) {
+  if (feature->type == SENSORS_FEATURE_IN)
+    return "voltage";
+  else if (feature->type == SENSORS_FEATURE_FAN)
+    return "fanspeed";
+  else if (feature->type == SENSORS_FEATURE_TEMP)
+    return "temperature";
+  else if (feature->type == SENSORS_FEATURE_POWER)
+    return "power";
+#if SENSORS_API_VERSION >= 0x402
+  else if (feature->type == SENSORS_FEATURE_CURR)
+    return "current";
+#endif
+#if SENSORS_API_VERSION >= 0x431
+  else if (feature->type == SENSORS_FEATURE_HUMIDITY)
+    return "humidity";
+#endif
+
+  return NULL;
+}
+
+/* Same scaling libsensors applies to the raw sysfs values. */
+static double sensors_subfeature_scale(const sensors_subfeature *subfeature) {
+  if (subfeature->type == SENSORS_SUBFEATURE_FAN_INPUT)
+    return 1.0;
+  if (subfeature->type == SENSORS_SUBFEATURE_POWER_INPUT)
+    return 1000000.0;
+  return 1000.0;
+}
+
+/* Returns true if the scaled content of "path" is what sensors_get_value()
+ * returns for the subfeature. This is not the case if sensors.conf has a
+ * "compute" statement for the feature. The file is read before and after
+ * calling libsensors, so a value changing in between is handled. */
+static bool sensors_file_usable(const featurelist_t *fl, const char *path) {
+  value_t before;
+  value_t after;
+  double value;
+
+  if ((parse_value_file(path, &before, DS_TYPE_GAUGE) != 0) ||
+      (sensors_get_value(fl->chip, fl->subfeature->number, &value) < 0) ||
+      (parse_value_file(path, &after, DS_TYPE_GAUGE) != 0))
+    return false;
+
+  double min = fmin(before.gauge, after.gauge) / fl->scale;
+  double max = fmax(before.gauge, after.gauge) / fl->scale;
+  double epsilon = 1e-9 * fmax(fabs(min), fabs(max));
+
+  return (value >= (min - epsilon)) && (value <= (max + epsilon));
+}
+
+/* Sets up reading the subfeature from its sysfs file instead of calling
+ * sensors_get_value(), which opens, reads and closes the file every time. */
+static void sensors_add_file(featurelist_t *fl) {
+  char path[PATH_MAX];
+
+  fl->file = -1;
+  fl->scale = sensors_subfeature_scale(fl->subfeature);
+
+  if ((fl->chip->path == NULL) || (sensor_files == NULL))
+    return;
+
+  int status = snprintf(path, sizeof(path), "%s/%s", fl->chip->path,
+                        fl->subfeature->name);
+  if ((status < 0) || ((size_t)status >= sizeof(path)))
+    return;
+
+  if (!sensors_file_usable(fl, path)) {
+    DEBUG("sensors plugin: Reading `%s' with libsensors.", path);
+    return;
+  }
+
+  fl->file = file_batch_add(sensor_files, path);
 }
+#endif
 
 static int sensors_load_conf(void) {
   static int call_once;
@@ -233,8 +344,20 @@ static int sensors_load_conf(void) {
       /* #endif SENSORS_API_VERSION < 0x400 */
 
 #elif (SENSORS_API_VERSION >= 0x400)
+  sensor_files = file_batch_create();
+  if (sensor_files == NULL)
+    ERROR("sensors plugin: file_batch_create failed. Falling back to "
+          "libsensors for reading values.");
+
   chip_num = 0;
   while ((chip = sensors_get_detected_chips(NULL, &chip_num)) != NULL) {
+    char plugin_instance[DATA_MAX_NAME_LEN];
+
+    status = sensors_snprintf_chip_name(plugin_instance,
+                                        sizeof(plugin_instance), chip);
+    if (status < 0)
+      continue;
+
     const sensors_feature *feature;
     int feature_num = 0;
 
@@ -277,6 +400,24 @@ static int sensors_load_conf(void) {
             (subfeature->type != SENSORS_SUBFEATURE_POWER_INPUT))
           continue;
 
+        const char *type = sensors_type_name(feature);
+        if (type == NULL)
+          continue;
+
+        char type_instance[DATA_MAX_NAME_LEN];
+        if (use_labels) {
+          char *sensor_label = sensors_get_label(chip, feature);
+          sstrncpy(type_instance,
+                   (sensor_label != NULL) ? sensor_label : feature->name,
+                   sizeof(type_instance));
+          free(sensor_label);
+        } else {
+          sstrncpy(type_instance, feature->name, sizeof(type_instance));
+        }
+
+        if (sensors_ignored(plugin_instance, type, type_instance))
+          continue;
+
         fl = calloc(1, sizeof(*fl));
         if (fl == NULL) {
           ERROR("sensors plugin: calloc failed.");
@@ -286,6 +427,11 @@ static int sensors_load_conf(void) {
         fl->chip = chip;
         fl->feature = feature;
         fl->subfeature = subfeature;
+        fl->type = type;
+        sstrncpy(fl->plugin_instance, plugin_instance,
+                 sizeof(fl->plugin_instance));
+        sstrncpy(fl->type_instance, type_instance, sizeof(fl->type_instance));
+        sensors_add_file(fl);
 
         if (first_feature == NULL)
           first_feature = fl;
@@ -299,6 +445,10 @@ static int sensors_load_conf(void) {
 
   if (first_feature == NULL) {
     sensors_cleanup();
+#if (SENSORS_API_VERSION >= 0x400)
+    file_batch_destroy(sensor_files);
+    sensor_files = NULL;
+#endif
     INFO("sensors plugin: lm_sensors reports no "
          "features. Data will not be collected.");
     return -1;
@@ -316,22 +466,8 @@ static int sensors_shutdown(void) {
 
 static void sensors_submit(const char *plugin_instance, const char *type,
                            const char *type_instance, double value) {
-  char match_key[1024];
-  int status;
-
   value_list_t vl = VALUE_LIST_INIT;
 
-  status = snprintf(match_key, sizeof(match_key), "%s/%s-%s", plugin_instance,
-                    type, type_instance);
-  if (status < 1)
-    return;
-
-  if (sensor_list != NULL) {
-    DEBUG("sensors plugin: Checking ignorelist for `%s'", match_key);
-    if (ignorelist_match(sensor_list, match_key))
-      return;
-  }
-
   vl.values = &(value_t){.gauge = value};
   vl.values_len = 1;
 
@@ -365,57 +501,33 @@ static int sensors_read(void) {
 
     sstrncpy(type_instance, fl->data->name, sizeof(type_instance));
 
+    if (sensors_ignored(plugin_instance, sensor_type_name_map[fl->type],
+                        type_instance))
+      continue;
+
     sensors_submit(plugin_instance, sensor_type_name_map[fl->type],
                    type_instance, value);
   } /* for fl = first_feature .. NULL */
     /* #endif SENSORS_API_VERSION < 0x400 */
 
 #elif (SENSORS_API_VERSION >= 0x400)
+  if (sensor_files != NULL)
+    file_batch_read(sensor_files);
+
   for (featurelist_t *fl = first_feature; fl != NULL; fl = fl->next) {
     double value;
-    int status;
-    char plugin_instance[DATA_MAX_NAME_LEN];
-    char type_instance[DATA_MAX_NAME_LEN];
-    char *sensor_label;
-    const char *type;
-
-    status = sensors_get_value(fl->chip, fl->subfeature->number, &value);
-    if (status < 0)
-      continue;
-
-    status = sensors_snprintf_chip_name(plugin_instance,
-                                        sizeof(plugin_instance), fl->chip);
-    if (status < 0)
-      continue;
-
-    if (use_labels) {
-      sensor_label = sensors_get_label(fl->chip, fl->feature);
-      sstrncpy(type_instance, sensor_label, sizeof(type_instance));
-      free(sensor_label);
-    } else {
-      sstrncpy(type_instance, fl->feature->name, sizeof(type_instance));
-    }
-
-    if (fl->feature->type == SENSORS_FEATURE_IN)
-      type = "voltage";
-    else if (fl->feature->type == SENSORS_FEATURE_FAN)
-      type = "fanspeed";
-    else if (fl->feature->type == SENSORS_FEATURE_TEMP)
-      type = "temperature";
-    else if (fl->feature->type == SENSORS_FEATURE_POWER)
-      type = "power";
-#if SENSORS_API_VERSION >= 0x402
-    else if (fl->feature->type == SENSORS_FEATURE_CURR)
-      type = "current";
-#endif
-#if SENSORS_API_VERSION >= 0x431
-    else if (fl->feature->type == SENSORS_FEATURE_HUMIDITY)
-      type = "humidity";
-#endif
-    else
+    value_t raw;
+
+    /* Files that failed to read are opened again by the next read, until then
+     * libsensors is used. */
+    if ((fl->file >= 0) &&
+        (file_batch_value(sensor_files, (size_t)fl->file, &raw,
+                          DS_TYPE_GAUGE) == 0))
+      value = raw.gauge / fl->scale;
+    else if (sensors_get_value(fl->chip, fl->subfeature->number, &value) < 0)
       continue;
 
-    sensors_submit(plugin_instance, type, type_instance, value);
+    sensors_submit(fl->plugin_instance, fl->type, fl->type_instance, value);
   } /* for fl = first_feature .. NULL */
 #endif /* (SENSORS_API_VERSION >= 0x400) */
 
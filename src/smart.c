@@ -64,7 +64,7 @@ struct nvme_admin_cmd {
 #define NVME_IOCTL_ADMIN_CMD _IOWR('N', 0x41, struct nvme_admin_cmd)
 
 static const char *config_keys[] = {"Disk", "IgnoreSelected", "IgnoreSleepMode",
-                                    "UseSerial"};
+                                    "UseSerial", "DiskInterval"};
 
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
@@ -72,6 +72,24 @@ static ignorelist_t *ignorelist, *ignorelist_by_serial;
 static int ignore_sleep_mode;
 static int use_serial;
 static int invert_ignorelist;
+static cdtime_t disk_interval;
+
+/* Each disk is read by a read callback of its own, so that disks are read in
+ * parallel by the daemon's read threads. The handles are kept open between
+ * reads. Only the callback of a disk accesses its smart_disk_t. */
+typedef struct {
+  char *dev;
+  char *name;
+  bool nvme;
+  int fd;
+  int vendor_id;
+  SkDisk *sk;
+} smart_disk_t;
+
+/* Device nodes of the disks with a registered read callback. Only used by
+ * smart_read(), which looks for added and removed disks. */
+static char **disk_devs;
+static size_t disk_devs_num;
 
 static int smart_config(const char *key, const char *value) {
   if (ignorelist == NULL)
@@ -92,6 +110,13 @@ static int smart_config(const char *key, const char *value) {
   } else if (strcasecmp("UseSerial", key) == 0) {
     if (IS_TRUE(value))
       use_serial = 1;
+  } else if (strcasecmp("DiskInterval", key) == 0) {
+    double tmp = atof(value);
+    if (tmp < 0.0) {
+      ERROR(PLUGIN_NAME ": DiskInterval must not be negative.");
+      return 1;
+    }
+    disk_interval = DOUBLE_TO_CDTIME_T(tmp);
   } else {
     return -1;
   }
@@ -274,17 +299,11 @@ static void smart_nvme_submit_16b(char const *name, __u8 *raw) {
   }
 }
 
-static int get_vendor_id(const char *dev, char const *name) {
+static int get_vendor_id(int fd) {
 
-  int fd, err;
+  int err;
   __le16 vid;
 
-  fd = open(dev, O_RDWR);
-  if (fd < 0) {
-    ERROR(PLUGIN_NAME ": open failed with %s\n", strerror(errno));
-    return fd;
-  }
-
   err = ioctl(fd, NVME_IOCTL_ADMIN_CMD,
               &(struct nvme_admin_cmd){.opcode = NVME_ADMIN_IDENTIFY,
                                        .nsid = NVME_NSID_ALL,
@@ -296,23 +315,15 @@ static int get_vendor_id(const char *dev, char const *name) {
   if (err < 0) {
     ERROR(PLUGIN_NAME ": ioctl for NVME_IOCTL_ADMIN_CMD failed with %s\n",
           strerror(errno));
-    close(fd);
     return err;
   }
 
-  close(fd);
   return (int)le16_to_cpu(vid);
 }
 
-static int smart_read_nvme_disk(const char *dev, char const *name) {
+static int smart_read_nvme_disk(int fd, char const *name) {
   union nvme_smart_log smart_log = {};
-  int fd, status;
-
-  fd = open(dev, O_RDWR);
-  if (fd < 0) {
-    ERROR(PLUGIN_NAME ": open failed with %s\n", strerror(errno));
-    return fd;
-  }
+  int status;
 
   /**
    * Prepare Get Log Page command
@@ -331,7 +342,6 @@ static int smart_read_nvme_disk(const char *dev, char const *name) {
   if (status < 0) {
     ERROR(PLUGIN_NAME ": ioctl for NVME_IOCTL_ADMIN_CMD failed with %s\n",
           strerror(errno));
-    close(fd);
     return status;
   } else {
     smart_submit(name, "nvme_critical_warning", "",
@@ -378,22 +388,15 @@ static int smart_read_nvme_disk(const char *dev, char const *name) {
     smart_nvme_submit_16b(name, smart_log.raw);
   }
 
-  close(fd);
   return 0;
 }
 
-static int smart_read_nvme_intel_disk(const char *dev, char const *name) {
+static int smart_read_nvme_intel_disk(int fd, char const *name) {
 
   DEBUG("name = %s", name);
-  DEBUG("dev = %s", dev);
 
   struct nvme_additional_smart_log intel_smart_log;
-  int fd, status;
-  fd = open(dev, O_RDWR);
-  if (fd < 0) {
-    ERROR(PLUGIN_NAME ": open failed with %s\n", strerror(errno));
-    return fd;
-  }
+  int status;
 
   /**
    * Prepare Get Log Page command
@@ -410,7 +413,6 @@ static int smart_read_nvme_intel_disk(const char *dev, char const *name) {
   if (status < 0) {
     ERROR(PLUGIN_NAME ": ioctl for NVME_IOCTL_ADMIN_CMD failed with %s\n",
           strerror(errno));
-    close(fd);
     return status;
   } else {
 
@@ -482,11 +484,19 @@ static int smart_read_nvme_intel_disk(const char *dev, char const *name) {
                  int48_to_double(intel_smart_log.host_bytes_written.raw));
   }
 
-  close(fd);
   return 0;
 }
 
 static void smart_read_sata_disk(SkDisk *d, char const *name) {
+  /* CHECK POWER MODE does not spin up a disk in standby. It is issued first,
+   * so that nothing else touches a sleeping disk. */
+  if (!ignore_sleep_mode) {
+    SkBool awake = FALSE;
+    if (sk_disk_check_sleep_mode(d, &awake) < 0 || !awake) {
+      DEBUG(PLUGIN_NAME ": disk %s is sleeping.", name);
+      return;
+    }
+  }
   SkBool available = FALSE;
   if (sk_disk_identify_is_available(d, &available) < 0 || !available) {
     DEBUG(PLUGIN_NAME ": disk %s cannot be identified.", name);
@@ -496,13 +506,6 @@ static void smart_read_sata_disk(SkDisk *d, char const *name) {
     DEBUG(PLUGIN_NAME ": disk %s has no SMART support.", name);
     return;
   }
-  if (!ignore_sleep_mode) {
-    SkBool awake = FALSE;
-    if (sk_disk_check_sleep_mode(d, &awake) < 0 || !awake) {
-      DEBUG(PLUGIN_NAME ": disk %s is sleeping.", name);
-      return;
-    }
-  }
   if (sk_disk_smart_read_data(d) < 0) {
     ERROR(PLUGIN_NAME ": unable to get SMART data for disk %s", name);
     return;
@@ -543,11 +546,99 @@ static void smart_read_sata_disk(SkDisk *d, char const *name) {
   }
 }
 
-static void smart_handle_disk(const char *dev, const char *serial) {
-  SkDisk *d = NULL;
-  const char *name;
+static void smart_disk_close(smart_disk_t *disk) {
+  if (disk->fd >= 0) {
+    close(disk->fd);
+    disk->fd = -1;
+  }
+  if (disk->sk != NULL) {
+    sk_disk_free(disk->sk);
+    disk->sk = NULL;
+  }
+}
+
+static void smart_disk_free(void *arg) {
+  smart_disk_t *disk = arg;
+  if (disk == NULL)
+    return;
+
+  smart_disk_close(disk);
+  sfree(disk->dev);
+  sfree(disk->name);
+  sfree(disk);
+}
+
+static int smart_disk_open(smart_disk_t *disk) {
+  if (disk->nvme) {
+    disk->fd = open(disk->dev, O_RDWR | O_CLOEXEC);
+    if (disk->fd < 0) {
+      ERROR(PLUGIN_NAME ": open(%s) failed with %s", disk->dev, STRERRNO);
+      return -1;
+    }
+    /* The vendor does not change while the device is open. */
+    disk->vendor_id = get_vendor_id(disk->fd);
+    return 0;
+  }
+
+  if (sk_disk_open(disk->dev, &disk->sk) < 0) {
+    ERROR(PLUGIN_NAME ": unable to open %s", disk->dev);
+    disk->sk = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+static int smart_read_disk(user_data_t *ud) {
+  smart_disk_t *disk = ud->data;
   int err;
 
+  if ((disk->fd < 0) && (disk->sk == NULL)) {
+    if (smart_disk_open(disk) != 0)
+      return -1;
+  }
+
+  DEBUG(PLUGIN_NAME ": checking SMART status of %s.", disk->dev);
+
+  if (!disk->nvme) {
+    smart_read_sata_disk(disk->sk, disk->name);
+    return 0;
+  }
+
+  err = smart_read_nvme_disk(disk->fd, disk->name);
+  if (err) {
+    ERROR(PLUGIN_NAME ": smart_read_nvme_disk failed, %d", err);
+    /* Reopen the device on the next read. */
+    smart_disk_close(disk);
+    return -1;
+  }
+
+  switch (disk->vendor_id) {
+  case INTEL_VENDOR_ID:
+    err = smart_read_nvme_intel_disk(disk->fd, disk->name);
+    if (err) {
+      ERROR(PLUGIN_NAME ": smart_read_nvme_intel_disk failed, %d", err);
+    }
+    break;
+
+  default:
+    DEBUG("No support vendor specific attributes");
+    break;
+  }
+
+  return 0;
+}
+
+static void smart_disk_callback_name(char *buffer, size_t buffer_size,
+                                     const char *dev) {
+  const char *base = strrchr(dev, '/');
+  ssnprintf(buffer, buffer_size, PLUGIN_NAME "/%s",
+            (base != NULL) ? base + 1 : dev);
+}
+
+/* Registers a read callback for a newly found disk. */
+static void smart_add_disk(const char *dev, const char *serial) {
+  const char *name;
+
   if (use_serial && serial) {
     name = serial;
   } else {
@@ -569,38 +660,52 @@ static void smart_handle_disk(const char *dev, const char *serial) {
     }
   }
 
-  DEBUG(PLUGIN_NAME ": checking SMART status of %s.", dev);
-
-  if (strstr(dev, "nvme")) {
-    err = smart_read_nvme_disk(dev, name);
-    if (err) {
-      ERROR(PLUGIN_NAME ": smart_read_nvme_disk failed, %d", err);
-    } else {
-      switch (get_vendor_id(dev, name)) {
-      case INTEL_VENDOR_ID:
-        err = smart_read_nvme_intel_disk(dev, name);
-        if (err) {
-          ERROR(PLUGIN_NAME ": smart_read_nvme_intel_disk failed, %d", err);
-        }
-        break;
+  char **tmp = realloc(disk_devs, (disk_devs_num + 1) * sizeof(*disk_devs));
+  if (tmp == NULL) {
+    ERROR(PLUGIN_NAME ": realloc failed.");
+    return;
+  }
+  disk_devs = tmp;
 
-      default:
-        DEBUG("No support vendor specific attributes");
-        break;
-      }
-    }
+  smart_disk_t *disk = calloc(1, sizeof(*disk));
+  if (disk == NULL) {
+    ERROR(PLUGIN_NAME ": calloc failed.");
+    return;
+  }
+  disk->dev = strdup(dev);
+  disk->name = strdup(name);
+  disk->nvme = (strstr(dev, "nvme") != NULL);
+  disk->fd = -1;
+  disk->vendor_id = -1;
+  disk_devs[disk_devs_num] = strdup(dev);
+  if ((disk->dev == NULL) || (disk->name == NULL) ||
+      (disk_devs[disk_devs_num] == NULL)) {
+    ERROR(PLUGIN_NAME ": strdup failed.");
+    sfree(disk_devs[disk_devs_num]);
+    smart_disk_free(disk);
+    return;
+  }
 
-  } else {
+  char cb_name[DATA_MAX_NAME_LEN];
+  smart_disk_callback_name(cb_name, sizeof(cb_name), dev);
 
-    if (sk_disk_open(dev, &d) < 0) {
-      ERROR(PLUGIN_NAME ": unable to open %s", dev);
-      return;
-    }
-    smart_read_sata_disk(d, name);
-    sk_disk_free(d);
+  /* The daemon spreads the first reads of the callbacks across the interval,
+   * so with a DiskInterval of several intervals only some of the disks are
+   * read in each interval. */
+  int status = plugin_register_complex_read(
+      /* group = */ PLUGIN_NAME, cb_name, smart_read_disk, disk_interval,
+      &(user_data_t){.data = disk, .free_func = smart_disk_free});
+  if (status != 0) {
+    ERROR(PLUGIN_NAME ": registering read callback for %s failed.", dev);
+    sfree(disk_devs[disk_devs_num]);
+    return;
   }
+  disk_devs_num++;
 }
 
+/* Enumerates the disks with udev, registers read callbacks for new disks and
+ * removes the callbacks of disks that are gone. The disks themselves are not
+ * accessed. */
 static int smart_read(void) {
   struct udev *handle_udev;
   struct udev_enumerate *enumerate;
@@ -616,6 +721,7 @@ static int smart_read(void) {
   enumerate = udev_enumerate_new(handle_udev);
   if (enumerate == NULL) {
     ERROR(PLUGIN_NAME ": fail udev_enumerate_new");
+    udev_unref(handle_udev);
     return -1;
   }
   udev_enumerate_add_match_subsystem(enumerate, "block");
@@ -623,29 +729,60 @@ static int smart_read(void) {
 
   if (udev_enumerate_scan_devices(enumerate) < 0) {
     WARNING(PLUGIN_NAME ": udev scan devices failed");
+    udev_enumerate_unref(enumerate);
+    udev_unref(handle_udev);
     return -1;
   }
 
+  bool seen[disk_devs_num + 1];
+  memset(seen, 0, sizeof(seen));
+
   devices = udev_enumerate_get_list_entry(enumerate);
-  if (devices == NULL) {
-    ERROR(PLUGIN_NAME ": udev returned an empty list devices");
-    return -1;
-  }
   udev_list_entry_foreach(dev_list_entry, devices) {
     const char *path, *devpath, *serial;
     path = udev_list_entry_get_name(dev_list_entry);
     dev = udev_device_new_from_syspath(handle_udev, path);
+    if (dev == NULL)
+      continue;
     devpath = udev_device_get_devnode(dev);
     serial = udev_device_get_property_value(dev, "ID_SERIAL_SHORT");
 
-    /* Query status with libatasmart */
-    smart_handle_disk(devpath, serial);
+    if (devpath != NULL) {
+      bool known = false;
+      for (size_t i = 0; i < disk_devs_num; i++) {
+        if (strcmp(disk_devs[i], devpath) == 0) {
+          seen[i] = true;
+          known = true;
+          break;
+        }
+      }
+      if (!known)
+        smart_add_disk(devpath, serial);
+    }
     udev_device_unref(dev);
   }
 
   udev_enumerate_unref(enumerate);
   udev_unref(handle_udev);
 
+  /* Remove disks that have disappeared. Disks added above are at the end of
+   * the array and are not covered by "seen". */
+  size_t seen_num = STATIC_ARRAY_SIZE(seen) - 1;
+  size_t j = 0;
+  for (size_t i = 0; i < disk_devs_num; i++) {
+    if ((i >= seen_num) || seen[i]) {
+      disk_devs[j++] = disk_devs[i];
+      continue;
+    }
+
+    char cb_name[DATA_MAX_NAME_LEN];
+    smart_disk_callback_name(cb_name, sizeof(cb_name), disk_devs[i]);
+    INFO(PLUGIN_NAME ": %s has disappeared.", disk_devs[i]);
+    plugin_unregister_read(cb_name);
+    sfree(disk_devs[i]);
+  }
+  disk_devs_num = j;
+
   return 0;
 } /* int smart_read */
 
@@ -674,11 +811,27 @@ static int smart_init(void) {
               "running \"setcap cap_sys_rawio=ep\" on the collectd binary.");
   }
 #endif
+
+  /* Register the per-disk callbacks right away, so that the disks are read in
+   * the first interval already. */
+  smart_read();
   return 0;
 } /* int smart_init */
 
+static int smart_shutdown(void) {
+  plugin_unregister_read_group(PLUGIN_NAME);
+
+  for (size_t i = 0; i < disk_devs_num; i++)
+    sfree(disk_devs[i]);
+  sfree(disk_devs);
+  disk_devs_num = 0;
+
+  return 0;
+} /* int smart_shutdown */
+
 void module_register(void) {
   plugin_register_config("smart", smart_config, config_keys, config_keys_num);
   plugin_register_init("smart", smart_init);
   plugin_register_read("smart", smart_read);
+  plugin_register_shutdown("smart", smart_shutdown);
 } /* void module_register */
@@ -33,6 +33,7 @@
 
 #include <net-snmp/net-snmp-config.h>
 #include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/large_fd_set.h>
 
 #include <fnmatch.h>
 
@@ -75,9 +76,25 @@ struct data_definition_s {
   size_t ignores_len;
   bool invert_match;
   bool count;
+  /* Tables only: interval in which the instance columns (TypeInstanceOID,
+   * PluginInstanceOID, HostOID and FilterOID) are walked. Zero means on every
+   * read. */
+  cdtime_t instance_refresh;
 };
 typedef struct data_definition_s data_definition_t;
 
+/* Instance columns of a table, kept between reads of a host if
+ * `InstanceRefresh' is set. */
+struct csnmp_instance_cache_s {
+  /* Time the columns were walked, zero if they haven't been yet. */
+  cdtime_t time;
+  struct csnmp_cell_char_s *type_instance_cells;
+  struct csnmp_cell_char_s *plugin_instance_cells;
+  struct csnmp_cell_char_s *hostname_cells;
+  struct csnmp_cell_char_s *filter_cells;
+};
+typedef struct csnmp_instance_cache_s csnmp_instance_cache_t;
+
 struct host_definition_s {
   char *name;
   char *address;
@@ -103,7 +120,20 @@ struct host_definition_s {
   c_complain_t complaint;
   data_definition_t **data_list;
   int data_list_len;
+  /* One entry per element of `data_list', allocated on first use. */
+  csnmp_instance_cache_t *instance_cache;
   int bulk_size;
+  bool report_latency;
+
+  /* Interval of the read callback, used when dispatching values. */
+  cdtime_t interval;
+  /* Current GETBULK budget and number of successful responses since it was
+   * last changed. See `csnmp_bulk_repetitions'. */
+  int bulk_budget;
+  int bulk_success_num;
+  /* Set while the host is handled by the asynchronous poller. Protected by
+   * `csnmp_async_lock'. */
+  bool async_busy;
 };
 typedef struct host_definition_s host_definition_t;
 
@@ -132,15 +162,83 @@ typedef enum {
   OID_TYPE_FILTER,
 } csnmp_oid_type_t;
 
+/* State of a table walk. The walk is driven either by `csnmp_read_table' or
+ * by the asynchronous poller. */
+struct csnmp_table_walk_s {
+  host_definition_t *host;
+  data_definition_t *data;
+  const data_set_t *ds;
+  bool is_bulk;
+
+  /* Holds the last OID returned by the device. We use this in the GETNEXT
+   * request to proceed. */
+  oid_t *oid_list;
+  /* Set to false when an OID has left its subtree so we don't re-request it
+   * again. */
+  csnmp_oid_type_t *oid_list_todo;
+  size_t oid_list_len;
+  /* Maps the variables of the last request to indices of `oid_list'. */
+  size_t *var_idx;
+  size_t oid_list_todo_num;
+
+  /* `value_list_head' and `value_cells_tail' implement a linked list for each
+   * value. `instance_cells_head' and `instance_cells_tail' implement a linked
+   * list of instance names. This is used to jump gaps in the table. */
+  csnmp_cell_char_t *type_instance_cells_head;
+  csnmp_cell_char_t *type_instance_cells_tail;
+  csnmp_cell_char_t *plugin_instance_cells_head;
+  csnmp_cell_char_t *plugin_instance_cells_tail;
+  csnmp_cell_char_t *hostname_cells_head;
+  csnmp_cell_char_t *hostname_cells_tail;
+  csnmp_cell_char_t *filter_cells_head;
+  csnmp_cell_char_t *filter_cells_tail;
+  csnmp_cell_value_t **value_cells_head;
+  csnmp_cell_value_t **value_cells_tail;
+
+  /* Instance columns of this table if `InstanceRefresh' is set, and whether
+   * they are still current, in which case they are not walked. */
+  csnmp_instance_cache_t *cache;
+  bool instances_cached;
+};
+typedef struct csnmp_table_walk_s csnmp_table_walk_t;
+
+/* A poll of one host by the asynchronous poller. */
+struct csnmp_async_job_s {
+  host_definition_t *host;
+  cdtime_t start;
+  /* Index of the data definition currently being read. */
+  int data_index;
+  int success;
+  bool walk_active;
+  csnmp_table_walk_t walk;
+  bool done;
+  bool close_session;
+  struct csnmp_async_job_s *next;
+};
+typedef struct csnmp_async_job_s csnmp_async_job_t;
+
+/* Number of successful GETBULK responses before the budget is doubled. */
+#define CSNMP_BULK_GROW_AFTER 16
+
 /*
  * Private variables
  */
 static data_definition_t *data_head;
 
+static bool csnmp_async;
+static pthread_mutex_t csnmp_async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t csnmp_async_thread_id;
+static bool csnmp_async_thread_running;
+static bool csnmp_async_shutdown;
+static int csnmp_async_pipe[2] = {-1, -1};
+static csnmp_async_job_t *csnmp_async_pending;
+
 /*
  * Prototypes
  */
 static int csnmp_read_host(user_data_t *ud);
+static void csnmp_instance_cache_reset(csnmp_instance_cache_t *cache);
+static void csnmp_async_stop(void);
 
 /*
  * Private functions
@@ -205,6 +303,8 @@ static void csnmp_host_definition_destroy(void *arg) /* {{{ */
     DEBUG("snmp plugin: Destroying host definition for host `%s'.", hd->name);
   }
 
+  /* The poller may still reference this host. */
+  csnmp_async_stop();
   csnmp_host_close_session(hd);
 
   sfree(hd->name);
@@ -214,6 +314,11 @@ static void csnmp_host_definition_destroy(void *arg) /* {{{ */
   sfree(hd->auth_passphrase);
   sfree(hd->priv_passphrase);
   sfree(hd->context);
+  if (hd->instance_cache != NULL) {
+    for (int i = 0; i < hd->data_list_len; i++)
+      csnmp_instance_cache_reset(hd->instance_cache + i);
+    sfree(hd->instance_cache);
+  }
   sfree(hd->data_list);
 
   sfree(hd);
@@ -479,6 +584,8 @@ static int csnmp_config_add_data(oconfig_item_t *ci) {
         ignorelist_set_invert(dd->ignorelist, /* invert = */ !t);
     } else if (strcasecmp("Count", option->key) == 0)
       status = cf_util_get_boolean(option, &dd->count);
+    else if (strcasecmp("InstanceRefresh", option->key) == 0)
+      status = cf_util_get_cdtime(option, &dd->instance_refresh);
     else {
       WARNING("snmp plugin: data %s: Option `%s' not allowed here.", dd->name,
               option->key);
@@ -880,6 +987,8 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
       status = cf_util_get_string(option, &hd->context);
     else if (strcasecmp("BulkSize", option->key) == 0)
       status = cf_util_get_int(option, &hd->bulk_size);
+    else if (strcasecmp("ReportLatency", option->key) == 0)
+      status = cf_util_get_boolean(option, &hd->report_latency);
     else {
       WARNING(
           "snmp plugin: csnmp_config_add_host: Option `%s' not allowed here.",
@@ -987,6 +1096,8 @@ static int csnmp_config(oconfig_item_t *ci) {
       csnmp_config_add_data(child);
     else if (strcasecmp("Host", child->key) == 0)
       csnmp_config_add_host(child);
+    else if (strcasecmp("Asynchronous", child->key) == 0)
+      cf_util_get_boolean(child, &csnmp_async);
     else {
       WARNING("snmp plugin: Ignoring unknown config option `%s'.", child->key);
     }
@@ -1371,6 +1482,100 @@ static void csnmp_cell_replace_reserved_chars(csnmp_cell_char_t *cell) {
   }
 } /* void csnmp_cell_replace_reserved_chars */
 
+/* Open addressing hash table of the cells of one table column, keyed by their
+ * index suffix. It is used to join the columns of a table row by row. Both
+ * cell types start with the suffix, so the table stores pointers to it. */
+typedef struct {
+  oid_t const **slots;
+  size_t mask;
+} csnmp_cell_index_t;
+
+static uint64_t csnmp_oid_hash(oid_t const *o) {
+  /* FNV-1a */
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < o->oid_len; i++) {
+    hash ^= (uint64_t)o->oid[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+} /* uint64_t csnmp_oid_hash */
+
+static int csnmp_cell_index_init(csnmp_cell_index_t *idx, size_t num) {
+  size_t size = 16;
+  while (size < 2 * num)
+    size *= 2;
+
+  idx->slots = calloc(size, sizeof(*idx->slots));
+  if (idx->slots == NULL)
+    return ENOMEM;
+  idx->mask = size - 1;
+  return 0;
+} /* int csnmp_cell_index_init */
+
+static void csnmp_cell_index_add(csnmp_cell_index_t *idx, oid_t const *suffix) {
+  size_t i = (size_t)csnmp_oid_hash(suffix) & idx->mask;
+  while (idx->slots[i] != NULL) {
+    if (csnmp_oid_compare(idx->slots[i], suffix) == 0)
+      return;
+    i = (i + 1) & idx->mask;
+  }
+  idx->slots[i] = suffix;
+} /* void csnmp_cell_index_add */
+
+/* Returns the cell with the index "suffix", or NULL. */
+static void const *csnmp_cell_index_get(csnmp_cell_index_t const *idx,
+                                        oid_t const *suffix) {
+  size_t i = (size_t)csnmp_oid_hash(suffix) & idx->mask;
+  while (idx->slots[i] != NULL) {
+    if (csnmp_oid_compare(idx->slots[i], suffix) == 0)
+      return idx->slots[i];
+    i = (i + 1) & idx->mask;
+  }
+  return NULL;
+} /* void *csnmp_cell_index_get */
+
+static int csnmp_cell_index_chars(csnmp_cell_index_t *idx,
+                                  csnmp_cell_char_t const *head) {
+  size_t num = 0;
+  for (csnmp_cell_char_t const *c = head; c != NULL; c = c->next)
+    num++;
+
+  if (csnmp_cell_index_init(idx, num) != 0)
+    return ENOMEM;
+  for (csnmp_cell_char_t const *c = head; c != NULL; c = c->next)
+    csnmp_cell_index_add(idx, &c->suffix);
+  return 0;
+} /* int csnmp_cell_index_chars */
+
+static int csnmp_cell_index_values(csnmp_cell_index_t *idx,
+                                   csnmp_cell_value_t const *head) {
+  size_t num = 0;
+  for (csnmp_cell_value_t const *c = head; c != NULL; c = c->next)
+    num++;
+
+  if (csnmp_cell_index_init(idx, num) != 0)
+    return ENOMEM;
+  for (csnmp_cell_value_t const *c = head; c != NULL; c = c->next)
+    csnmp_cell_index_add(idx, &c->suffix);
+  return 0;
+} /* int csnmp_cell_index_values */
+
+static void csnmp_dispatch_table_free(data_definition_t const *data,
+                                      csnmp_cell_index_t *plugin_instance_index,
+                                      csnmp_cell_index_t *hostname_index,
+                                      csnmp_cell_index_t *filter_index,
+                                      csnmp_cell_index_t *value_index) {
+  sfree(plugin_instance_index->slots);
+  sfree(hostname_index->slots);
+  sfree(filter_index->slots);
+  for (size_t i = 0; i < data->values_len; i++)
+    sfree(value_index[i].slots);
+} /* void csnmp_dispatch_table_free */
+
+/* Joins the columns of a table by their index suffix and dispatches one value
+ * list per row. Rows are taken from the type instance column or, if there is
+ * none, from the first value column. Rows missing from any other non-empty
+ * column are skipped. */
 static int csnmp_dispatch_table(host_definition_t *host,
                                 data_definition_t *data,
                                 csnmp_cell_char_t *type_instance_cells,
@@ -1382,15 +1587,14 @@ static int csnmp_dispatch_table(host_definition_t *host,
   const data_set_t *ds;
   value_list_t vl = VALUE_LIST_INIT;
 
-  csnmp_cell_char_t *type_instance_cell_ptr = type_instance_cells;
-  csnmp_cell_char_t *plugin_instance_cell_ptr = plugin_instance_cells;
-  csnmp_cell_char_t *hostname_cell_ptr = hostname_cells;
-  csnmp_cell_char_t *filter_cell_ptr = filter_cells;
-  csnmp_cell_value_t *value_cell_ptr[data->values_len];
+  csnmp_cell_char_t const *type_instance_cell_ptr = type_instance_cells;
+  csnmp_cell_char_t const *plugin_instance_cell_ptr = NULL;
+  csnmp_cell_char_t const *hostname_cell_ptr = NULL;
+  csnmp_cell_char_t const *filter_cell_ptr = NULL;
+  csnmp_cell_value_t const *value_cell_ptr[data->values_len];
 
   size_t i;
-  bool have_more;
-  oid_t current_suffix;
+  oid_t const *current_suffix;
   size_t count;
 
   ds = plugin_get_ds(data->type);
@@ -1405,163 +1609,87 @@ static int csnmp_dispatch_table(host_definition_t *host,
     assert(ds->ds_num == data->values_len);
   assert(data->values_len > 0);
 
-  for (i = 0; i < data->values_len; i++)
-    value_cell_ptr[i] = value_cells[i];
+  /* Index all columns except the one the rows are taken from. */
+  csnmp_cell_index_t plugin_instance_index = {0};
+  csnmp_cell_index_t hostname_index = {0};
+  csnmp_cell_index_t filter_index = {0};
+  csnmp_cell_index_t value_index[data->values_len];
+  memset(value_index, 0, sizeof(value_index));
+
+  int status = 0;
+  if (plugin_instance_cells != NULL)
+    status |= csnmp_cell_index_chars(&plugin_instance_index,
+                                     plugin_instance_cells);
+  if (hostname_cells != NULL)
+    status |= csnmp_cell_index_chars(&hostname_index, hostname_cells);
+  if (filter_cells != NULL)
+    status |= csnmp_cell_index_chars(&filter_index, filter_cells);
+  for (i = (type_instance_cells != NULL) ? 0 : 1; i < data->values_len; i++)
+    status |= csnmp_cell_index_values(value_index + i, value_cells[i]);
+  if (status != 0) {
+    ERROR("snmp plugin: csnmp_dispatch_table: calloc failed.");
+    csnmp_dispatch_table_free(data, &plugin_instance_index, &hostname_index,
+                              &filter_index, value_index);
+    return -1;
+  }
 
   sstrncpy(vl.plugin, data->plugin_name, sizeof(vl.plugin));
   sstrncpy(vl.type, data->type, sizeof(vl.type));
+  vl.interval = host->interval;
 
-  have_more = 1;
-  while (have_more) {
-    bool suffix_skipped = 0;
-
+  csnmp_cell_value_t const *row_value_ptr =
+      (type_instance_cells != NULL) ? NULL : value_cells[0];
+  while (true) {
     /* Determine next suffix to handle. */
     if (type_instance_cells != NULL) {
-      if (type_instance_cell_ptr == NULL) {
-        have_more = 0;
-        continue;
-      }
-
-      memcpy(&current_suffix, &type_instance_cell_ptr->suffix,
-             sizeof(current_suffix));
+      if (type_instance_cell_ptr == NULL)
+        break;
+      current_suffix = &type_instance_cell_ptr->suffix;
     } else {
       /* no instance configured */
-      csnmp_cell_value_t *ptr = value_cell_ptr[0];
-      if (ptr == NULL) {
-        have_more = 0;
-        continue;
-      }
-
-      memcpy(&current_suffix, &ptr->suffix, sizeof(current_suffix));
+      if (row_value_ptr == NULL)
+        break;
+      current_suffix = &row_value_ptr->suffix;
+      value_cell_ptr[0] = row_value_ptr;
     }
 
-    /*
-    char oid_buffer[1024] = {0};
-    snprint_objid(oid_buffer, sizeof(oid_buffer) - 1, current_suffix.oid,
-                          current_suffix.oid_len);
-    DEBUG("SNMP PLUGIN: SUFFIX %s", oid_buffer);
-    */
-
-    /* Update plugin_instance_cell_ptr to point expected suffix */
+    /* Look up the cells of this row in the other columns. A row that is
+     * missing from any of them is skipped. */
+    bool suffix_skipped = false;
     if (plugin_instance_cells != NULL) {
-      while ((plugin_instance_cell_ptr != NULL) &&
-             (csnmp_oid_compare(&plugin_instance_cell_ptr->suffix,
-                                &current_suffix) < 0))
-        plugin_instance_cell_ptr = plugin_instance_cell_ptr->next;
-
-      if (plugin_instance_cell_ptr == NULL) {
-        have_more = 0;
-        continue;
-      }
-
-      if (csnmp_oid_compare(&plugin_instance_cell_ptr->suffix,
-                            &current_suffix) > 0) {
-        /* This suffix is missing in the subtree. Indicate this with the
-         * "suffix_skipped" flag and try the next instance / suffix. */
-        suffix_skipped = 1;
-      }
+      plugin_instance_cell_ptr =
+          csnmp_cell_index_get(&plugin_instance_index, current_suffix);
+      suffix_skipped |= (plugin_instance_cell_ptr == NULL);
     }
-
-    /* Update hostname_cell_ptr to point expected suffix */
     if (hostname_cells != NULL) {
-      while (
-          (hostname_cell_ptr != NULL) &&
-          (csnmp_oid_compare(&hostname_cell_ptr->suffix, &current_suffix) < 0))
-        hostname_cell_ptr = hostname_cell_ptr->next;
-
-      if (hostname_cell_ptr == NULL) {
-        have_more = 0;
-        continue;
-      }
-
-      if (csnmp_oid_compare(&hostname_cell_ptr->suffix, &current_suffix) > 0) {
-        /* This suffix is missing in the subtree. Indicate this with the
-         * "suffix_skipped" flag and try the next instance / suffix. */
-        suffix_skipped = 1;
-      }
+      hostname_cell_ptr = csnmp_cell_index_get(&hostname_index, current_suffix);
+      suffix_skipped |= (hostname_cell_ptr == NULL);
     }
-
-    /* Update filter_cell_ptr to point expected suffix */
     if (filter_cells != NULL) {
-      while ((filter_cell_ptr != NULL) &&
-             (csnmp_oid_compare(&filter_cell_ptr->suffix, &current_suffix) < 0))
-        filter_cell_ptr = filter_cell_ptr->next;
-
-      if (filter_cell_ptr == NULL) {
-        have_more = 0;
-        continue;
-      }
-
-      if (csnmp_oid_compare(&filter_cell_ptr->suffix, &current_suffix) > 0) {
-        /* This suffix is missing in the subtree. Indicate this with the
-         * "suffix_skipped" flag and try the next instance / suffix. */
-        suffix_skipped = 1;
-      }
+      filter_cell_ptr = csnmp_cell_index_get(&filter_index, current_suffix);
+      suffix_skipped |= (filter_cell_ptr == NULL);
+    }
+    for (i = (type_instance_cells != NULL) ? 0 : 1;
+         !suffix_skipped && (i < data->values_len); i++) {
+      value_cell_ptr[i] = csnmp_cell_index_get(value_index + i, current_suffix);
+      suffix_skipped |= (value_cell_ptr[i] == NULL);
     }
 
-    /* Update all the value_cell_ptr to point at the entry with the same
-     * trailing partial OID */
-    for (i = 0; i < data->values_len; i++) {
-      while (
-          (value_cell_ptr[i] != NULL) &&
-          (csnmp_oid_compare(&value_cell_ptr[i]->suffix, &current_suffix) < 0))
-        value_cell_ptr[i] = value_cell_ptr[i]->next;
-
-      if (value_cell_ptr[i] == NULL) {
-        have_more = 0;
-        break;
-      } else if (csnmp_oid_compare(&value_cell_ptr[i]->suffix,
-                                   &current_suffix) > 0) {
-        /* This suffix is missing in the subtree. Indicate this with the
-         * "suffix_skipped" flag and try the next instance / suffix. */
-        suffix_skipped = 1;
-        break;
-      }
-    } /* for (i = 0; i < columns; i++) */
-
-    if (!have_more)
-      break;
-
-    /* Matching the values failed. Start from the beginning again. */
     if (suffix_skipped) {
       if (type_instance_cells != NULL)
         type_instance_cell_ptr = type_instance_cell_ptr->next;
       else
-        value_cell_ptr[0] = value_cell_ptr[0]->next;
-
+        row_value_ptr = row_value_ptr->next;
       continue;
     }
 
-/* if we reach this line, all value_cell_ptr[i] are non-NULL and are set
- * to the same subid. type_instance_cell_ptr is either NULL or points to the
- * same subid, too. */
-#if COLLECT_DEBUG
-    for (i = 1; i < data->values_len; i++) {
-      assert(value_cell_ptr[i] != NULL);
-      assert(csnmp_oid_compare(&value_cell_ptr[i - 1]->suffix,
-                               &value_cell_ptr[i]->suffix) == 0);
-    }
-    assert((type_instance_cell_ptr == NULL) ||
-           (csnmp_oid_compare(&type_instance_cell_ptr->suffix,
-                              &value_cell_ptr[0]->suffix) == 0));
-    assert((plugin_instance_cell_ptr == NULL) ||
-           (csnmp_oid_compare(&plugin_instance_cell_ptr->suffix,
-                              &value_cell_ptr[0]->suffix) == 0));
-    assert((hostname_cell_ptr == NULL) ||
-           (csnmp_oid_compare(&hostname_cell_ptr->suffix,
-                              &value_cell_ptr[0]->suffix) == 0));
-    assert((filter_cell_ptr == NULL) ||
-           (csnmp_oid_compare(&filter_cell_ptr->suffix,
-                              &value_cell_ptr[0]->suffix) == 0));
-#endif
-
     /* Check the value in filter column */
     if (filter_cell_ptr &&
         ignorelist_match(data->ignorelist, filter_cell_ptr->value) != 0) {
       if (type_instance_cells != NULL)
         type_instance_cell_ptr = type_instance_cell_ptr->next;
       else
-        value_cell_ptr[0] = value_cell_ptr[0]->next;
+        row_value_ptr = row_value_ptr->next;
 
       continue;
     }
@@ -1573,7 +1701,7 @@ static int csnmp_dispatch_table(host_definition_t *host,
       if (data->host.configured) {
         char temp[DATA_MAX_NAME_LEN];
         if (hostname_cell_ptr == NULL)
-          csnmp_oid_to_string(temp, sizeof(temp), &current_suffix);
+          csnmp_oid_to_string(temp, sizeof(temp), current_suffix);
         else
           sstrncpy(temp, hostname_cell_ptr->value, sizeof(temp));
 
@@ -1589,7 +1717,7 @@ static int csnmp_dispatch_table(host_definition_t *host,
       if (data->type_instance.configured) {
         char temp[DATA_MAX_NAME_LEN];
         if (type_instance_cell_ptr == NULL)
-          csnmp_oid_to_string(temp, sizeof(temp), &current_suffix);
+          csnmp_oid_to_string(temp, sizeof(temp), current_suffix);
         else
           sstrncpy(temp, type_instance_cell_ptr->value, sizeof(temp));
 
@@ -1607,7 +1735,7 @@ static int csnmp_dispatch_table(host_definition_t *host,
       if (data->plugin_instance.configured) {
         char temp[DATA_MAX_NAME_LEN];
         if (plugin_instance_cell_ptr == NULL)
-          csnmp_oid_to_string(temp, sizeof(temp), &current_suffix);
+          csnmp_oid_to_string(temp, sizeof(temp), current_suffix);
         else
           sstrncpy(temp, plugin_instance_cell_ptr->value, sizeof(temp));
 
@@ -1638,8 +1766,11 @@ static int csnmp_dispatch_table(host_definition_t *host,
     if (type_instance_cells != NULL)
       type_instance_cell_ptr = type_instance_cell_ptr->next;
     else
-      value_cell_ptr[0] = value_cell_ptr[0]->next;
-  } /* while (have_more) */
+      row_value_ptr = row_value_ptr->next;
+  } /* while (true) */
+
+  csnmp_dispatch_table_free(data, &plugin_instance_index, &hostname_index,
+                            &filter_index, value_index);
 
   if (count_values) {
     /* the first `ds' means `data set', the second means `data source' */
@@ -1682,58 +1813,117 @@ static int csnmp_dispatch_table(host_definition_t *host,
   return 0;
 } /* int csnmp_dispatch_table */
 
-static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
-  struct snmp_pdu *req;
-  struct snmp_pdu *res = NULL;
-  struct variable_list *vb;
-
-  const data_set_t *ds;
-
-  size_t oid_list_len = data->values_len;
-
-  if (data->type_instance.oid.oid_len > 0)
-    oid_list_len++;
+/* Returns the number of repetitions per variable for the next GETBULK
+ * request. The budget starts at `BulkSize', is halved when the agent
+ * signals that a response got too big or stops responding and grows back
+ * after a run of successful responses. */
+static long csnmp_bulk_repetitions(host_definition_t *host, size_t vars_num) {
+  if ((host->bulk_budget <= 0) || (host->bulk_budget > host->bulk_size))
+    host->bulk_budget = host->bulk_size;
+
+  long repetitions = host->bulk_budget / (long)vars_num;
+  return (repetitions > 0) ? repetitions : 1;
+} /* long csnmp_bulk_repetitions */
+
+/* Returns false if the budget cannot be reduced any further. */
+static bool csnmp_bulk_shrink(host_definition_t *host, size_t vars_num) {
+  if (csnmp_bulk_repetitions(host, vars_num) <= 1)
+    return false;
+
+  host->bulk_budget /= 2;
+  host->bulk_success_num = 0;
+  DEBUG("snmp plugin: host %s: Reduced the bulk budget to %i.", host->name,
+        host->bulk_budget);
+  return true;
+} /* bool csnmp_bulk_shrink */
+
+static void csnmp_bulk_success(host_definition_t *host) {
+  if (host->bulk_budget >= host->bulk_size)
+    return;
 
-  if (data->plugin_instance.oid.oid_len > 0)
-    oid_list_len++;
+  host->bulk_success_num++;
+  if (host->bulk_success_num < CSNMP_BULK_GROW_AFTER)
+    return;
 
-  if (data->host.oid.oid_len > 0)
-    oid_list_len++;
+  host->bulk_success_num = 0;
+  host->bulk_budget *= 2;
+  if (host->bulk_budget > host->bulk_size)
+    host->bulk_budget = host->bulk_size;
+  DEBUG("snmp plugin: host %s: Increased the bulk budget to %i.", host->name,
+        host->bulk_budget);
+} /* void csnmp_bulk_success */
+
+static void csnmp_cells_free(csnmp_cell_char_t *head) {
+  while (head != NULL) {
+    csnmp_cell_char_t *next = head->next;
+    sfree(head);
+    head = next;
+  }
+} /* void csnmp_cells_free */
+
+static void csnmp_instance_cache_reset(csnmp_instance_cache_t *cache) {
+  csnmp_cells_free(cache->type_instance_cells);
+  csnmp_cells_free(cache->plugin_instance_cells);
+  csnmp_cells_free(cache->hostname_cells);
+  csnmp_cells_free(cache->filter_cells);
+  *cache = (csnmp_instance_cache_t){0};
+} /* void csnmp_instance_cache_reset */
+
+/* Returns the instance cache of "data" on "host", or NULL if it has none. */
+static csnmp_instance_cache_t *csnmp_instance_cache_get(host_definition_t *host,
+                                                        data_definition_t *data) {
+  if (data->instance_refresh == 0)
+    return NULL;
 
-  if (data->filter_oid.oid_len > 0)
-    oid_list_len++;
+  if (host->instance_cache == NULL) {
+    host->instance_cache =
+        calloc(host->data_list_len, sizeof(*host->instance_cache));
+    if (host->instance_cache == NULL)
+      return NULL;
+  }
+
+  for (int i = 0; i < host->data_list_len; i++)
+    if (host->data_list[i] == data)
+      return host->instance_cache + i;
+  return NULL;
+} /* csnmp_instance_cache_t *csnmp_instance_cache_get */
+
+static void csnmp_table_walk_free(csnmp_table_walk_t *w) {
+  csnmp_cells_free(w->type_instance_cells_head);
+  w->type_instance_cells_head = NULL;
+  csnmp_cells_free(w->plugin_instance_cells_head);
+  w->plugin_instance_cells_head = NULL;
+  csnmp_cells_free(w->hostname_cells_head);
+  w->hostname_cells_head = NULL;
+  csnmp_cells_free(w->filter_cells_head);
+  w->filter_cells_head = NULL;
+
+  if (w->value_cells_head != NULL) {
+    for (size_t i = 0; i < w->data->values_len; i++) {
+      while (w->value_cells_head[i] != NULL) {
+        csnmp_cell_value_t *next = w->value_cells_head[i]->next;
+        sfree(w->value_cells_head[i]);
+        w->value_cells_head[i] = next;
+      }
+    }
+  }
 
-  /* Holds the last OID returned by the device. We use this in the GETNEXT
-   * request to proceed. */
-  oid_t oid_list[oid_list_len];
-  /* Set to false when an OID has left its subtree so we don't re-request it
-   * again. */
-  csnmp_oid_type_t oid_list_todo[oid_list_len];
+  sfree(w->value_cells_head);
+  sfree(w->value_cells_tail);
+  sfree(w->oid_list);
+  sfree(w->oid_list_todo);
+  sfree(w->var_idx);
+} /* void csnmp_table_walk_free */
 
-  int status;
+static int csnmp_table_walk_init(csnmp_table_walk_t *w,
+                                 host_definition_t *host,
+                                 data_definition_t *data) {
+  const data_set_t *ds;
   size_t i;
 
-  /* `value_list_head' and `value_cells_tail' implement a linked list for each
-   * value. `instance_cells_head' and `instance_cells_tail' implement a linked
-   * list of instance names. This is used to jump gaps in the table. */
-  csnmp_cell_char_t *type_instance_cells_head = NULL;
-  csnmp_cell_char_t *type_instance_cells_tail = NULL;
-  csnmp_cell_char_t *plugin_instance_cells_head = NULL;
-  csnmp_cell_char_t *plugin_instance_cells_tail = NULL;
-  csnmp_cell_char_t *hostname_cells_head = NULL;
-  csnmp_cell_char_t *hostname_cells_tail = NULL;
-  csnmp_cell_char_t *filter_cells_head = NULL;
-  csnmp_cell_char_t *filter_cells_tail = NULL;
-  csnmp_cell_value_t **value_cells_head;
-  csnmp_cell_value_t **value_cells_tail;
-
-  DEBUG("snmp plugin: csnmp_read_table (host = %s, data = %s)", host->name,
-        data->name);
-
-  if (host->sess_handle == NULL) {
-    DEBUG("snmp plugin: csnmp_read_table: host->sess_handle == NULL");
-    return -1;
-  }
+  memset(w, 0, sizeof(*w));
+  w->host = host;
+  w->data = data;
 
   ds = plugin_get_ds(data->type);
   if (!ds) {
@@ -1758,428 +1948,502 @@ static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
     }
   }
   assert(data->values_len > 0);
+  w->ds = ds;
+
+  /* If SNMP v2 and later and bulk transfers enabled, use GETBULK PDU */
+  w->is_bulk = (host->version > 1) && (host->bulk_size > 0);
+
+  /* Instance names rarely change, so with `InstanceRefresh' only the values
+   * are walked until the cached instance columns expire. */
+  w->cache = csnmp_instance_cache_get(host, data);
+  w->instances_cached =
+      (w->cache != NULL) && (w->cache->time != 0) &&
+      ((cdtime() - w->cache->time) < data->instance_refresh);
+  bool walk_instances = !w->instances_cached;
+
+  w->oid_list_len = data->values_len;
+
+  if (walk_instances && (data->type_instance.oid.oid_len > 0))
+    w->oid_list_len++;
+
+  if (walk_instances && (data->plugin_instance.oid.oid_len > 0))
+    w->oid_list_len++;
+
+  if (walk_instances && (data->host.oid.oid_len > 0))
+    w->oid_list_len++;
+
+  if (walk_instances && (data->filter_oid.oid_len > 0))
+    w->oid_list_len++;
+
+  w->oid_list = calloc(w->oid_list_len, sizeof(*w->oid_list));
+  w->oid_list_todo = calloc(w->oid_list_len, sizeof(*w->oid_list_todo));
+  w->var_idx = calloc(w->oid_list_len, sizeof(*w->var_idx));
+  /* We're going to construct n linked lists, one for each "value".
+   * value_cells_head will contain pointers to the heads of these linked lists,
+   * value_cells_tail will contain pointers to the tail of the lists. */
+  w->value_cells_head = calloc(data->values_len, sizeof(*w->value_cells_head));
+  w->value_cells_tail = calloc(data->values_len, sizeof(*w->value_cells_tail));
+  if ((w->oid_list == NULL) || (w->oid_list_todo == NULL) ||
+      (w->var_idx == NULL) || (w->value_cells_head == NULL) ||
+      (w->value_cells_tail == NULL)) {
+    ERROR("snmp plugin: csnmp_table_walk_init: calloc failed.");
+    csnmp_table_walk_free(w);
+    return -1;
+  }
 
   for (i = 0; i < data->values_len; i++)
-    oid_list_todo[i] = OID_TYPE_VARIABLE;
+    w->oid_list_todo[i] = OID_TYPE_VARIABLE;
 
   /* We need a copy of all the OIDs, because GETNEXT will destroy them. */
-  memcpy(oid_list, data->values, data->values_len * sizeof(oid_t));
+  memcpy(w->oid_list, data->values, data->values_len * sizeof(oid_t));
 
-  if (data->type_instance.oid.oid_len > 0) {
-    memcpy(oid_list + i, &data->type_instance.oid, sizeof(oid_t));
-    oid_list_todo[i] = OID_TYPE_TYPEINSTANCE;
+  if (walk_instances && (data->type_instance.oid.oid_len > 0)) {
+    memcpy(w->oid_list + i, &data->type_instance.oid, sizeof(oid_t));
+    w->oid_list_todo[i] = OID_TYPE_TYPEINSTANCE;
     i++;
   }
 
-  if (data->plugin_instance.oid.oid_len > 0) {
-    memcpy(oid_list + i, &data->plugin_instance.oid, sizeof(oid_t));
-    oid_list_todo[i] = OID_TYPE_PLUGININSTANCE;
+  if (walk_instances && (data->plugin_instance.oid.oid_len > 0)) {
+    memcpy(w->oid_list + i, &data->plugin_instance.oid, sizeof(oid_t));
+    w->oid_list_todo[i] = OID_TYPE_PLUGININSTANCE;
     i++;
   }
 
-  if (data->host.oid.oid_len > 0) {
-    memcpy(oid_list + i, &data->host.oid, sizeof(oid_t));
-    oid_list_todo[i] = OID_TYPE_HOST;
+  if (walk_instances && (data->host.oid.oid_len > 0)) {
+    memcpy(w->oid_list + i, &data->host.oid, sizeof(oid_t));
+    w->oid_list_todo[i] = OID_TYPE_HOST;
     i++;
   }
 
-  if (data->filter_oid.oid_len > 0) {
-    memcpy(oid_list + i, &data->filter_oid, sizeof(oid_t));
-    oid_list_todo[i] = OID_TYPE_FILTER;
+  if (walk_instances && (data->filter_oid.oid_len > 0)) {
+    memcpy(w->oid_list + i, &data->filter_oid, sizeof(oid_t));
+    w->oid_list_todo[i] = OID_TYPE_FILTER;
     i++;
   }
 
-  /* We're going to construct n linked lists, one for each "value".
-   * value_cells_head will contain pointers to the heads of these linked lists,
-   * value_cells_tail will contain pointers to the tail of the lists. */
-  value_cells_head = calloc(data->values_len, sizeof(*value_cells_head));
-  value_cells_tail = calloc(data->values_len, sizeof(*value_cells_tail));
-  if ((value_cells_head == NULL) || (value_cells_tail == NULL)) {
-    ERROR("snmp plugin: csnmp_read_table: calloc failed.");
-    sfree(value_cells_head);
-    sfree(value_cells_tail);
+  return 0;
+} /* int csnmp_table_walk_init */
+
+/* Creates the next request of a table walk. Sets `ret_req' to NULL when all
+ * variables have left their subtree. */
+static int csnmp_table_walk_request(csnmp_table_walk_t *w,
+                                    struct snmp_pdu **ret_req) {
+  struct snmp_pdu *req;
+
+  *ret_req = NULL;
+
+  if (w->is_bulk)
+    req = snmp_pdu_create(SNMP_MSG_GETBULK);
+  else
+    req = snmp_pdu_create(SNMP_MSG_GETNEXT);
+  if (req == NULL) {
+    ERROR("snmp plugin: snmp_pdu_create failed.");
     return -1;
   }
 
-  status = 0;
-  while (status == 0) {
-    /* If SNMP v2 and later and bulk transfers enabled, use GETBULK PDU */
-    if (host->version > 1 && host->bulk_size > 0) {
-      req = snmp_pdu_create(SNMP_MSG_GETBULK);
-      req->non_repeaters = 0;
-      req->max_repetitions = host->bulk_size;
-    } else {
-      req = snmp_pdu_create(SNMP_MSG_GETNEXT);
-    }
-    if (req == NULL) {
-      ERROR("snmp plugin: snmp_pdu_create failed.");
-      status = -1;
-      break;
-    }
+  w->oid_list_todo_num = 0;
+  memset(w->var_idx, 0, w->oid_list_len * sizeof(*w->var_idx));
 
-    size_t oid_list_todo_num = 0;
-    size_t var_idx[oid_list_len];
-    memset(var_idx, 0, sizeof(var_idx));
+  for (size_t i = 0; i < w->oid_list_len; i++) {
+    /* Do not rerequest already finished OIDs */
+    if (!w->oid_list_todo[i])
+      continue;
+    snmp_add_null_var(req, w->oid_list[i].oid, w->oid_list[i].oid_len);
+    w->var_idx[w->oid_list_todo_num] = i;
+    w->oid_list_todo_num++;
+  }
 
-    for (i = 0; i < oid_list_len; i++) {
-      /* Do not rerequest already finished OIDs */
-      if (!oid_list_todo[i])
-        continue;
-      snmp_add_null_var(req, oid_list[i].oid, oid_list[i].oid_len);
-      var_idx[oid_list_todo_num] = i;
-      oid_list_todo_num++;
-    }
+  if (w->oid_list_todo_num == 0) {
+    /* The request is still empty - so we are finished */
+    DEBUG("snmp plugin: all variables have left their subtree");
+    snmp_free_pdu(req);
+    return 0;
+  }
 
-    if (oid_list_todo_num == 0) {
-      /* The request is still empty - so we are finished */
-      DEBUG("snmp plugin: all variables have left their subtree");
-      snmp_free_pdu(req);
-      status = 0;
-      break;
-    }
+  if (req->command == SNMP_MSG_GETBULK) {
+    /* In bulk mode the host will send 'max_repetitions' values per
+       requested variable, so we need to split it per number of variable
+       to stay 'in budget' */
+    req->non_repeaters = 0;
+    req->max_repetitions =
+        csnmp_bulk_repetitions(w->host, w->oid_list_todo_num);
+  }
 
-    if (req->command == SNMP_MSG_GETBULK) {
-      /* In bulk mode the host will send 'max_repetitions' values per
-         requested variable, so we need to split it per number of variable
-         to stay 'in budget' */
-      req->max_repetitions = floor(host->bulk_size / oid_list_todo_num);
-    }
+  *ret_req = req;
+  return 0;
+} /* int csnmp_table_walk_request */
+
+/* Processes the response to the last request of a table walk. Returns EAGAIN
+ * if the request has to be repeated with a smaller bulk size. Does not free
+ * `res'. */
+static int csnmp_table_walk_response(csnmp_table_walk_t *w,
+                                     struct snmp_pdu *res) {
+  host_definition_t *host = w->host;
+  data_definition_t *data = w->data;
+  struct variable_list *vb;
+  size_t i;
 
-    res = NULL;
-    status = snmp_sess_synch_response(host->sess_handle, req, &res);
+  vb = res->variables;
+  if (vb == NULL)
+    return -1;
 
-    /* snmp_sess_synch_response always frees our req PDU */
-    req = NULL;
+  if ((res->errstat == SNMP_ERR_TOOBIG) && w->is_bulk &&
+      csnmp_bulk_shrink(host, w->oid_list_todo_num))
+    return EAGAIN;
 
-    if ((status != STAT_SUCCESS) || (res == NULL)) {
-      char *errstr = NULL;
+  if (res->errstat != SNMP_ERR_NOERROR) {
+    if (res->errindex != 0) {
+      /* Find the OID which caused error */
+      for (i = 1, vb = res->variables; vb != NULL && i != res->errindex;
+           vb = vb->next_variable, i++)
+        /* do nothing */;
+    }
 
-      snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
+    if ((res->errindex == 0) || (vb == NULL)) {
+      ERROR("snmp plugin: host %s; data %s: response error: %s (%li) ",
+            host->name, data->name, snmp_errstring(res->errstat),
+            res->errstat);
+      return -1;
+    }
 
-      c_complain(LOG_ERR, &host->complaint,
-                 "snmp plugin: host %s: snmp_sess_synch_response failed: %s",
-                 host->name, (errstr == NULL) ? "Unknown problem" : errstr);
+    char oid_buffer[1024] = {0};
+    snprint_objid(oid_buffer, sizeof(oid_buffer) - 1, vb->name,
+                  vb->name_length);
+    NOTICE("snmp plugin: host %s; data %s: OID `%s` failed: %s", host->name,
+           data->name, oid_buffer, snmp_errstring(res->errstat));
 
-      if (res != NULL)
-        snmp_free_pdu(res);
-      res = NULL;
+    /* Get value index from todo list and skip OID found */
+    assert(res->errindex <= w->oid_list_todo_num);
+    i = w->var_idx[res->errindex - 1];
+    assert(i < w->oid_list_len);
+    w->oid_list_todo[i] = 0;
 
-      sfree(errstr);
-      csnmp_host_close_session(host);
+    return 0;
+  }
 
-      status = -1;
+  size_t j;
+  for (vb = res->variables, j = 0; (vb != NULL);
+       vb = vb->next_variable, j++) {
+    i = j;
+    /* If bulk request is active convert value index of the extra value */
+    if (w->is_bulk) {
+      i %= w->oid_list_todo_num;
+    }
+    /* Calculate value index from todo list */
+    while ((i < w->oid_list_len) && !w->oid_list_todo[i]) {
+      i++;
+      j++;
+    }
+    if (i >= w->oid_list_len) {
       break;
     }
 
-    status = 0;
-    assert(res != NULL);
-    c_release(LOG_INFO, &host->complaint,
-              "snmp plugin: host %s: snmp_sess_synch_response successful.",
+    /* An instance is configured and the res variable we process is the
+     * instance value */
+    if (w->oid_list_todo[i] == OID_TYPE_TYPEINSTANCE) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(data->type_instance.oid.oid,
+                             data->type_instance.oid.oid_len, vb->name,
+                             vb->name_length,
+                             data->type_instance.oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; TypeInstance left its "
+              "subtree.",
+              host->name, data->name);
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
+
+      /* Allocate a new `csnmp_cell_char_t', insert the instance name and
+       * add it to the list */
+      csnmp_cell_char_t *cell =
+          csnmp_get_char_cell(vb, &data->type_instance.oid, host, data);
+      if (cell == NULL) {
+        ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
               host->name);
+        return -1;
+      }
 
-    vb = res->variables;
-    if (vb == NULL) {
-      status = -1;
-      break;
-    }
+      if (csnmp_ignore_instance(cell, data)) {
+        sfree(cell);
+      } else {
+        csnmp_cell_replace_reserved_chars(cell);
 
-    if (res->errstat != SNMP_ERR_NOERROR) {
-      if (res->errindex != 0) {
-        /* Find the OID which caused error */
-        for (i = 1, vb = res->variables; vb != NULL && i != res->errindex;
-             vb = vb->next_variable, i++)
-          /* do nothing */;
+        DEBUG("snmp plugin: il->type_instance = `%s';", cell->value);
+        csnmp_cells_append(&w->type_instance_cells_head,
+                           &w->type_instance_cells_tail, cell);
+      }
+    } else if (w->oid_list_todo[i] == OID_TYPE_PLUGININSTANCE) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(data->plugin_instance.oid.oid,
+                             data->plugin_instance.oid.oid_len, vb->name,
+                             vb->name_length,
+                             data->plugin_instance.oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; TypeInstance left its "
+              "subtree.",
+              host->name, data->name);
+        w->oid_list_todo[i] = 0;
+        continue;
       }
 
-      if ((res->errindex == 0) || (vb == NULL)) {
-        ERROR("snmp plugin: host %s; data %s: response error: %s (%li) ",
-              host->name, data->name, snmp_errstring(res->errstat),
-              res->errstat);
-        status = -1;
-        break;
+      /* Allocate a new `csnmp_cell_char_t', insert the instance name and
+       * add it to the list */
+      csnmp_cell_char_t *cell =
+          csnmp_get_char_cell(vb, &data->plugin_instance.oid, host, data);
+      if (cell == NULL) {
+        ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
+              host->name);
+        return -1;
       }
 
-      char oid_buffer[1024] = {0};
-      snprint_objid(oid_buffer, sizeof(oid_buffer) - 1, vb->name,
-                    vb->name_length);
-      NOTICE("snmp plugin: host %s; data %s: OID `%s` failed: %s", host->name,
-             data->name, oid_buffer, snmp_errstring(res->errstat));
+      csnmp_cell_replace_reserved_chars(cell);
+
+      DEBUG("snmp plugin: il->plugin_instance = `%s';", cell->value);
+      csnmp_cells_append(&w->plugin_instance_cells_head,
+                         &w->plugin_instance_cells_tail, cell);
+    } else if (w->oid_list_todo[i] == OID_TYPE_HOST) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(data->host.oid.oid, data->host.oid.oid_len,
+                             vb->name, vb->name_length,
+                             data->host.oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; Host left its subtree.",
+              host->name, data->name);
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
 
-      /* Get value index from todo list and skip OID found */
-      assert(res->errindex <= oid_list_todo_num);
-      i = var_idx[res->errindex - 1];
-      assert(i < oid_list_len);
-      oid_list_todo[i] = 0;
+      /* Allocate a new `csnmp_cell_char_t', insert the instance name and
+       * add it to the list */
+      csnmp_cell_char_t *cell =
+          csnmp_get_char_cell(vb, &data->host.oid, host, data);
+      if (cell == NULL) {
+        ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
+              host->name);
+        return -1;
+      }
 
-      snmp_free_pdu(res);
-      res = NULL;
-      continue;
-    }
+      csnmp_cell_replace_reserved_chars(cell);
+
+      DEBUG("snmp plugin: il->hostname = `%s';", cell->value);
+      csnmp_cells_append(&w->hostname_cells_head, &w->hostname_cells_tail,
+                         cell);
+    } else if (w->oid_list_todo[i] == OID_TYPE_FILTER) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(data->filter_oid.oid, data->filter_oid.oid_len,
+                             vb->name, vb->name_length,
+                             data->filter_oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; Host left its subtree.",
+              host->name, data->name);
+        w->oid_list_todo[i] = 0;
+        continue;
+      }
 
-    size_t j;
-    for (vb = res->variables, j = 0; (vb != NULL);
-         vb = vb->next_variable, j++) {
-      i = j;
-      /* If bulk request is active convert value index of the extra value */
-      if (host->version > 1 && host->bulk_size > 0) {
-        i %= oid_list_todo_num;
+      /* Allocate a new `csnmp_cell_char_t', insert the instance name and
+       * add it to the list */
+      csnmp_cell_char_t *cell =
+          csnmp_get_char_cell(vb, &data->filter_oid, host, data);
+      if (cell == NULL) {
+        ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
+              host->name);
+        return -1;
       }
-      /* Calculate value index from todo list */
-      while ((i < oid_list_len) && !oid_list_todo[i]) {
-        i++;
-        j++;
+
+      csnmp_cell_replace_reserved_chars(cell);
+
+      DEBUG("snmp plugin: il->filter = `%s';", cell->value);
+      csnmp_cells_append(&w->filter_cells_head, &w->filter_cells_tail, cell);
+    } else /* The variable we are processing is a normal value */
+    {
+      assert(w->oid_list_todo[i] == OID_TYPE_VARIABLE);
+
+      csnmp_cell_value_t *vt;
+      oid_t vb_name;
+      oid_t suffix;
+      int ret;
+
+      csnmp_oid_init(&vb_name, vb->name, vb->name_length);
+
+      /* Calculate the current suffix. This is later used to check that the
+       * suffix is increasing. This also checks if we left the subtree */
+      ret = csnmp_oid_suffix(&suffix, &vb_name, data->values + i);
+      if (ret != 0) {
+        DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
+              "Value probably left its subtree.",
+              host->name, data->name, i);
+        w->oid_list_todo[i] = 0;
+        continue;
       }
-      if (i >= oid_list_len) {
-        break;
+
+      /* Make sure the OIDs returned by the agent are increasing. Otherwise
+       * our table matching algorithm will get confused. */
+      if ((w->value_cells_tail[i] != NULL) &&
+          (csnmp_oid_compare(&suffix, &w->value_cells_tail[i]->suffix) <= 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
+              "Suffix is not increasing.",
+              host->name, data->name, i);
+        w->oid_list_todo[i] = 0;
+        continue;
       }
 
-      /* An instance is configured and the res variable we process is the
-       * instance value */
-      if (oid_list_todo[i] == OID_TYPE_TYPEINSTANCE) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(data->type_instance.oid.oid,
-                               data->type_instance.oid.oid_len, vb->name,
-                               vb->name_length,
-                               data->type_instance.oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; TypeInstance left its "
-                "subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+      vt = calloc(1, sizeof(*vt));
+      if (vt == NULL) {
+        ERROR("snmp plugin: calloc failed.");
+        return -1;
+      }
 
-        /* Allocate a new `csnmp_cell_char_t', insert the instance name and
-         * add it to the list */
-        csnmp_cell_char_t *cell =
-            csnmp_get_char_cell(vb, &data->type_instance.oid, host, data);
-        if (cell == NULL) {
-          ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
-                host->name);
-          status = -1;
-          break;
-        }
+      vt->value =
+          csnmp_value_list_to_value(vb, w->ds->ds[i].type, data->scale,
+                                    data->shift, host->name, data->name);
+      memcpy(&vt->suffix, &suffix, sizeof(vt->suffix));
+      vt->next = NULL;
 
-        if (csnmp_ignore_instance(cell, data)) {
-          sfree(cell);
-        } else {
-          csnmp_cell_replace_reserved_chars(cell);
+      if (w->value_cells_tail[i] == NULL)
+        w->value_cells_head[i] = vt;
+      else
+        w->value_cells_tail[i]->next = vt;
+      w->value_cells_tail[i] = vt;
+    }
 
-          DEBUG("snmp plugin: il->type_instance = `%s';", cell->value);
-          csnmp_cells_append(&type_instance_cells_head,
-                             &type_instance_cells_tail, cell);
-        }
-      } else if (oid_list_todo[i] == OID_TYPE_PLUGININSTANCE) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(data->plugin_instance.oid.oid,
-                               data->plugin_instance.oid.oid_len, vb->name,
-                               vb->name_length,
-                               data->plugin_instance.oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; TypeInstance left its "
-                "subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+    /* Copy OID to oid_list[i] */
+    memcpy(w->oid_list[i].oid, vb->name, sizeof(oid) * vb->name_length);
+    w->oid_list[i].oid_len = vb->name_length;
 
-        /* Allocate a new `csnmp_cell_char_t', insert the instance name and
-         * add it to the list */
-        csnmp_cell_char_t *cell =
-            csnmp_get_char_cell(vb, &data->plugin_instance.oid, host, data);
-        if (cell == NULL) {
-          ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
-                host->name);
-          status = -1;
-          break;
-        }
+  } /* for (vb = res->variables ...) */
 
-        csnmp_cell_replace_reserved_chars(cell);
+  if (w->is_bulk)
+    csnmp_bulk_success(host);
 
-        DEBUG("snmp plugin: il->plugin_instance = `%s';", cell->value);
-        csnmp_cells_append(&plugin_instance_cells_head,
-                           &plugin_instance_cells_tail, cell);
-      } else if (oid_list_todo[i] == OID_TYPE_HOST) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(data->host.oid.oid, data->host.oid.oid_len,
-                               vb->name, vb->name_length,
-                               data->host.oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; Host left its subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+  return 0;
+} /* int csnmp_table_walk_response */
+
+static int csnmp_table_walk_dispatch(csnmp_table_walk_t *w) {
+  csnmp_instance_cache_t *cache = w->cache;
+  if (cache == NULL)
+    return csnmp_dispatch_table(
+        w->host, w->data, w->type_instance_cells_head,
+        w->plugin_instance_cells_head, w->hostname_cells_head,
+        w->filter_cells_head, w->value_cells_head, w->data->count);
+
+  /* The walk was complete, so its instance columns replace the cached ones. */
+  if (!w->instances_cached) {
+    csnmp_instance_cache_reset(cache);
+    cache->time = cdtime();
+    cache->type_instance_cells = w->type_instance_cells_head;
+    cache->plugin_instance_cells = w->plugin_instance_cells_head;
+    cache->hostname_cells = w->hostname_cells_head;
+    cache->filter_cells = w->filter_cells_head;
+    w->type_instance_cells_head = NULL;
+    w->plugin_instance_cells_head = NULL;
+    w->hostname_cells_head = NULL;
+    w->filter_cells_head = NULL;
+  }
+
+  return csnmp_dispatch_table(w->host, w->data, cache->type_instance_cells,
+                              cache->plugin_instance_cells,
+                              cache->hostname_cells, cache->filter_cells,
+                              w->value_cells_head, w->data->count);
+} /* int csnmp_table_walk_dispatch */
 
-        /* Allocate a new `csnmp_cell_char_t', insert the instance name and
-         * add it to the list */
-        csnmp_cell_char_t *cell =
-            csnmp_get_char_cell(vb, &data->host.oid, host, data);
-        if (cell == NULL) {
-          ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
-                host->name);
-          status = -1;
-          break;
-        }
+static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
+  csnmp_table_walk_t walk;
+  struct snmp_pdu *req;
+  struct snmp_pdu *res = NULL;
+  int status;
 
-        csnmp_cell_replace_reserved_chars(cell);
+  DEBUG("snmp plugin: csnmp_read_table (host = %s, data = %s)", host->name,
+        data->name);
 
-        DEBUG("snmp plugin: il->hostname = `%s';", cell->value);
-        csnmp_cells_append(&hostname_cells_head, &hostname_cells_tail, cell);
-      } else if (oid_list_todo[i] == OID_TYPE_FILTER) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(data->filter_oid.oid, data->filter_oid.oid_len,
-                               vb->name, vb->name_length,
-                               data->filter_oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; Host left its subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+  if (host->sess_handle == NULL) {
+    DEBUG("snmp plugin: csnmp_read_table: host->sess_handle == NULL");
+    return -1;
+  }
 
-        /* Allocate a new `csnmp_cell_char_t', insert the instance name and
-         * add it to the list */
-        csnmp_cell_char_t *cell =
-            csnmp_get_char_cell(vb, &data->filter_oid, host, data);
-        if (cell == NULL) {
-          ERROR("snmp plugin: host %s: csnmp_get_char_cell() failed.",
-                host->name);
-          status = -1;
-          break;
-        }
+  if (csnmp_table_walk_init(&walk, host, data) != 0)
+    return -1;
 
-        csnmp_cell_replace_reserved_chars(cell);
+  while (true) {
+    status = csnmp_table_walk_request(&walk, &req);
+    if ((status != 0) || (req == NULL))
+      break;
 
-        DEBUG("snmp plugin: il->filter = `%s';", cell->value);
-        csnmp_cells_append(&filter_cells_head, &filter_cells_tail, cell);
-      } else /* The variable we are processing is a normal value */
-      {
-        assert(oid_list_todo[i] == OID_TYPE_VARIABLE);
-
-        csnmp_cell_value_t *vt;
-        oid_t vb_name;
-        oid_t suffix;
-        int ret;
-
-        csnmp_oid_init(&vb_name, vb->name, vb->name_length);
-
-        /* Calculate the current suffix. This is later used to check that the
-         * suffix is increasing. This also checks if we left the subtree */
-        ret = csnmp_oid_suffix(&suffix, &vb_name, data->values + i);
-        if (ret != 0) {
-          DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
-                "Value probably left its subtree.",
-                host->name, data->name, i);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+    res = NULL;
+    status = snmp_sess_synch_response(host->sess_handle, req, &res);
 
-        /* Make sure the OIDs returned by the agent are increasing. Otherwise
-         * our table matching algorithm will get confused. */
-        if ((value_cells_tail[i] != NULL) &&
-            (csnmp_oid_compare(&suffix, &value_cells_tail[i]->suffix) <= 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; i = %" PRIsz "; "
-                "Suffix is not increasing.",
-                host->name, data->name, i);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+    /* snmp_sess_synch_response always frees our req PDU */
+    req = NULL;
 
-        vt = calloc(1, sizeof(*vt));
-        if (vt == NULL) {
-          ERROR("snmp plugin: calloc failed.");
-          status = -1;
-          break;
-        }
+    if ((status != STAT_SUCCESS) || (res == NULL)) {
+      char *errstr = NULL;
 
-        vt->value =
-            csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
-                                      data->shift, host->name, data->name);
-        memcpy(&vt->suffix, &suffix, sizeof(vt->suffix));
-        vt->next = NULL;
+      snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
 
-        if (value_cells_tail[i] == NULL)
-          value_cells_head[i] = vt;
-        else
-          value_cells_tail[i]->next = vt;
-        value_cells_tail[i] = vt;
-      }
+      c_complain(LOG_ERR, &host->complaint,
+                 "snmp plugin: host %s: snmp_sess_synch_response failed: %s",
+                 host->name, (errstr == NULL) ? "Unknown problem" : errstr);
 
-      /* Copy OID to oid_list[i] */
-      memcpy(oid_list[i].oid, vb->name, sizeof(oid) * vb->name_length);
-      oid_list[i].oid_len = vb->name_length;
+      /* Agents may silently drop requests whose responses would not fit
+       * into a datagram. */
+      if ((status == STAT_TIMEOUT) && walk.is_bulk)
+        csnmp_bulk_shrink(host, walk.oid_list_todo_num);
 
-    } /* for (vb = res->variables ...) */
+      if (res != NULL)
+        snmp_free_pdu(res);
+      res = NULL;
 
-    if (res != NULL)
-      snmp_free_pdu(res);
-    res = NULL;
-  } /* while (status == 0) */
+      sfree(errstr);
+      csnmp_host_close_session(host);
 
-  if (res != NULL)
+      status = -1;
+      break;
+    }
+
+    c_release(LOG_INFO, &host->complaint,
+              "snmp plugin: host %s: snmp_sess_synch_response successful.",
+              host->name);
+
+    status = csnmp_table_walk_response(&walk, res);
     snmp_free_pdu(res);
-  res = NULL;
+    res = NULL;
 
-  if (status == 0)
-    csnmp_dispatch_table(host, data, type_instance_cells_head,
-                         plugin_instance_cells_head, hostname_cells_head,
-                         filter_cells_head, value_cells_head, data->count);
+    if (status == EAGAIN)
+      status = 0;
+    else if (status != 0)
+      break;
+  } /* while (true) */
 
-  /* Free all allocated variables here */
-  while (type_instance_cells_head != NULL) {
-    csnmp_cell_char_t *next = type_instance_cells_head->next;
-    sfree(type_instance_cells_head);
-    type_instance_cells_head = next;
-  }
+  if (status == 0)
+    csnmp_table_walk_dispatch(&walk);
 
-  while (plugin_instance_cells_head != NULL) {
-    csnmp_cell_char_t *next = plugin_instance_cells_head->next;
-    sfree(plugin_instance_cells_head);
-    plugin_instance_cells_head = next;
-  }
+  csnmp_table_walk_free(&walk);
 
-  while (hostname_cells_head != NULL) {
-    csnmp_cell_char_t *next = hostname_cells_head->next;
-    sfree(hostname_cells_head);
-    hostname_cells_head = next;
-  }
+  return 0;
+} /* int csnmp_read_table */
 
-  while (filter_cells_head != NULL) {
-    csnmp_cell_char_t *next = filter_cells_head->next;
-    sfree(filter_cells_head);
-    filter_cells_head = next;
-  }
+static struct snmp_pdu *csnmp_value_request(data_definition_t *data) {
+  struct snmp_pdu *req;
 
-  for (i = 0; i < data->values_len; i++) {
-    while (value_cells_head[i] != NULL) {
-      csnmp_cell_value_t *next = value_cells_head[i]->next;
-      sfree(value_cells_head[i]);
-      value_cells_head[i] = next;
-    }
+  req = snmp_pdu_create(SNMP_MSG_GET);
+  if (req == NULL) {
+    ERROR("snmp plugin: snmp_pdu_create failed.");
+    return NULL;
   }
 
-  sfree(value_cells_head);
-  sfree(value_cells_tail);
+  for (size_t i = 0; i < data->values_len; i++)
+    snmp_add_null_var(req, data->values[i].oid, data->values[i].oid_len);
 
-  return 0;
-} /* int csnmp_read_table */
+  return req;
+} /* struct snmp_pdu *csnmp_value_request */
 
-static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
-  struct snmp_pdu *req;
-  struct snmp_pdu *res = NULL;
+/* Dispatches the values of a GET response. Does not free `res'. */
+static int csnmp_value_response(host_definition_t *host,
+                                data_definition_t *data,
+                                struct snmp_pdu *res) {
   struct variable_list *vb;
 
   const data_set_t *ds;
   value_list_t vl = VALUE_LIST_INIT;
 
-  int status;
   size_t i;
 
-  DEBUG("snmp plugin: csnmp_read_value (host = %s, data = %s)", host->name,
-        data->name);
-
-  if (host->sess_handle == NULL) {
-    DEBUG("snmp plugin: csnmp_read_value: host->sess_handle == NULL");
-    return -1;
-  }
-
   ds = plugin_get_ds(data->type);
   if (!ds) {
     ERROR("snmp plugin: DataSet `%s' not defined.", data->type);
@@ -2214,16 +2478,46 @@ static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
   if (data->plugin_instance.value)
     sstrncpy(vl.plugin_instance, data->plugin_instance.value,
              sizeof(vl.plugin_instance));
+  vl.interval = host->interval;
 
-  req = snmp_pdu_create(SNMP_MSG_GET);
-  if (req == NULL) {
-    ERROR("snmp plugin: snmp_pdu_create failed.");
-    sfree(vl.values);
+  for (vb = res->variables; vb != NULL; vb = vb->next_variable) {
+#if COLLECT_DEBUG
+    char buffer[1024];
+    snprint_variable(buffer, sizeof(buffer), vb->name, vb->name_length, vb);
+    DEBUG("snmp plugin: Got this variable: %s", buffer);
+#endif /* COLLECT_DEBUG */
+
+    for (i = 0; i < data->values_len; i++)
+      if (snmp_oid_compare(data->values[i].oid, data->values[i].oid_len,
+                           vb->name, vb->name_length) == 0)
+        vl.values[i] =
+            csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
+                                      data->shift, host->name, data->name);
+  } /* for (res->variables) */
+
+  DEBUG("snmp plugin: -> plugin_dispatch_values (&vl);");
+  plugin_dispatch_values(&vl);
+  sfree(vl.values);
+
+  return 0;
+} /* int csnmp_value_response */
+
+static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
+  struct snmp_pdu *req;
+  struct snmp_pdu *res = NULL;
+  int status;
+
+  DEBUG("snmp plugin: csnmp_read_value (host = %s, data = %s)", host->name,
+        data->name);
+
+  if (host->sess_handle == NULL) {
+    DEBUG("snmp plugin: csnmp_read_value: host->sess_handle == NULL");
     return -1;
   }
 
-  for (i = 0; i < data->values_len; i++)
-    snmp_add_null_var(req, data->values[i].oid, data->values[i].oid_len);
+  req = csnmp_value_request(data);
+  if (req == NULL)
+    return -1;
 
   status = snmp_sess_synch_response(host->sess_handle, req, &res);
 
@@ -2238,43 +2532,391 @@ static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
       snmp_free_pdu(res);
 
     sfree(errstr);
-    sfree(vl.values);
     csnmp_host_close_session(host);
 
     return -1;
   }
 
-  for (vb = res->variables; vb != NULL; vb = vb->next_variable) {
-#if COLLECT_DEBUG
-    char buffer[1024];
-    snprint_variable(buffer, sizeof(buffer), vb->name, vb->name_length, vb);
-    DEBUG("snmp plugin: Got this variable: %s", buffer);
-#endif /* COLLECT_DEBUG */
+  status = csnmp_value_response(host, data, res);
+  snmp_free_pdu(res);
 
-    for (i = 0; i < data->values_len; i++)
-      if (snmp_oid_compare(data->values[i].oid, data->values[i].oid_len,
-                           vb->name, vb->name_length) == 0)
-        vl.values[i] =
-            csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
-                                      data->shift, host->name, data->name);
-  } /* for (res->variables) */
+  return status;
+} /* int csnmp_read_value */
 
-  snmp_free_pdu(res);
+static void csnmp_dispatch_latency(host_definition_t *host,
+                                   cdtime_t latency) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(latency)};
+  vl.values_len = 1;
+  vl.interval = host->interval;
+  sstrncpy(vl.host, host->name, sizeof(vl.host));
+  sstrncpy(vl.plugin, "snmp", sizeof(vl.plugin));
+  sstrncpy(vl.type, "duration", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "poll", sizeof(vl.type_instance));
 
-  DEBUG("snmp plugin: -> plugin_dispatch_values (&vl);");
   plugin_dispatch_values(&vl);
-  sfree(vl.values);
+} /* void csnmp_dispatch_latency */
+
+/* The asynchronous poller. {{{
+ *
+ * With `Asynchronous' enabled the read callbacks only hand their host over to
+ * a single poller thread, which keeps the requests of all hosts in flight at
+ * the same time. Each host is polled by a `csnmp_async_job_t' which walks
+ * through the host's data definitions one request at a time: the response
+ * callback processes a response and immediately sends the next request. */
+static void csnmp_async_data_done(csnmp_async_job_t *job, bool ok) {
+  if (job->walk_active) {
+    if (ok)
+      csnmp_table_walk_dispatch(&job->walk);
+    csnmp_table_walk_free(&job->walk);
+    job->walk_active = false;
+  }
+
+  if (ok)
+    job->success++;
+  job->data_index++;
+} /* void csnmp_async_data_done */
+
+static int csnmp_async_callback(int operation, netsnmp_session *sess,
+                                int reqid, netsnmp_pdu *res, void *arg);
+
+/* Sends the next request of a job. Marks the job as done when all data
+ * definitions have been read. */
+static void csnmp_async_next(csnmp_async_job_t *job) {
+  host_definition_t *host = job->host;
+
+  while (job->data_index < host->data_list_len) {
+    data_definition_t *data = host->data_list[job->data_index];
+    struct snmp_pdu *req = NULL;
+    int status = 0;
+
+    if (data->is_table) {
+      if (!job->walk_active) {
+        status = csnmp_table_walk_init(&job->walk, host, data);
+        job->walk_active = (status == 0);
+      }
+      if (status == 0)
+        status = csnmp_table_walk_request(&job->walk, &req);
+      if ((status == 0) && (req == NULL)) {
+        csnmp_async_data_done(job, /* ok = */ true);
+        continue;
+      }
+    } else {
+      req = csnmp_value_request(data);
+      if (req == NULL)
+        status = -1;
+    }
+
+    if (status != 0) {
+      csnmp_async_data_done(job, /* ok = */ false);
+      continue;
+    }
+
+    if (snmp_sess_async_send(host->sess_handle, req, csnmp_async_callback,
+                             job) == 0) {
+      char *errstr = NULL;
+
+      snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
+      c_complain(LOG_ERR, &host->complaint,
+                 "snmp plugin: host %s: snmp_sess_async_send failed: %s",
+                 host->name, (errstr == NULL) ? "Unknown problem" : errstr);
+      sfree(errstr);
+      snmp_free_pdu(req);
+
+      job->close_session = true;
+      break;
+    }
+
+    return;
+  } /* while (job->data_index < host->data_list_len) */
+
+  job->done = true;
+} /* void csnmp_async_next */
+
+static int csnmp_async_callback(int operation,
+                                __attribute__((unused)) netsnmp_session *sess,
+                                __attribute__((unused)) int reqid,
+                                netsnmp_pdu *res, void *arg) {
+  csnmp_async_job_t *job = arg;
+  host_definition_t *host = job->host;
+  int status;
+
+  /* The session of an aborted job is being closed. */
+  if (job->done)
+    return 1;
+
+  if ((operation != NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE) || (res == NULL)) {
+    c_complain(LOG_ERR, &host->complaint,
+               "snmp plugin: host %s: %s", host->name,
+               (operation == NETSNMP_CALLBACK_OP_TIMED_OUT)
+                   ? "Timeout"
+                   : "Receiving the response failed");
+
+    /* Agents may silently drop requests whose responses would not fit
+     * into a datagram. */
+    if ((operation == NETSNMP_CALLBACK_OP_TIMED_OUT) && job->walk_active &&
+        job->walk.is_bulk)
+      csnmp_bulk_shrink(host, job->walk.oid_list_todo_num);
+
+    /* The session must not be closed from within its own callback. */
+    job->close_session = true;
+    job->done = true;
+    return 1;
+  }
+
+  c_release(LOG_INFO, &host->complaint,
+            "snmp plugin: host %s: Received a response.", host->name);
+
+  if (job->walk_active) {
+    status = csnmp_table_walk_response(&job->walk, res);
+    if ((status != 0) && (status != EAGAIN))
+      csnmp_async_data_done(job, /* ok = */ false);
+  } else {
+    status = csnmp_value_response(host, host->data_list[job->data_index], res);
+    csnmp_async_data_done(job, /* ok = */ (status == 0));
+  }
+
+  /* `res' is freed by the library once we return. */
+  csnmp_async_next(job);
+  return 1;
+} /* int csnmp_async_callback */
+
+static void csnmp_async_start(csnmp_async_job_t *job) {
+  host_definition_t *host = job->host;
+
+  if (host->sess_handle == NULL)
+    csnmp_host_open_session(host);
+
+  if (host->sess_handle == NULL) {
+    job->done = true;
+    return;
+  }
+
+  csnmp_async_next(job);
+} /* void csnmp_async_start */
+
+static void csnmp_async_finish(csnmp_async_job_t *job) {
+  host_definition_t *host = job->host;
+
+  if (job->walk_active) {
+    csnmp_table_walk_free(&job->walk);
+    job->walk_active = false;
+  }
+
+  if (job->close_session)
+    csnmp_host_close_session(host);
+
+  if (host->report_latency && (job->success > 0))
+    csnmp_dispatch_latency(host, cdtime() - job->start);
+
+  pthread_mutex_lock(&csnmp_async_lock);
+  host->async_busy = false;
+  pthread_mutex_unlock(&csnmp_async_lock);
+
+  sfree(job);
+} /* void csnmp_async_finish */
+
+static void *csnmp_async_thread(__attribute__((unused)) void *arg) {
+  csnmp_async_job_t *active = NULL;
+  netsnmp_large_fd_set fdset;
+
+  netsnmp_large_fd_set_init(&fdset, FD_SETSIZE);
+
+  while (true) {
+    csnmp_async_job_t *pending;
+    bool shutdown;
 
+    pthread_mutex_lock(&csnmp_async_lock);
+    shutdown = csnmp_async_shutdown;
+    pending = csnmp_async_pending;
+    csnmp_async_pending = NULL;
+    pthread_mutex_unlock(&csnmp_async_lock);
+
+    while (pending != NULL) {
+      csnmp_async_job_t *job = pending;
+      pending = job->next;
+
+      job->next = active;
+      active = job;
+      if (!shutdown)
+        csnmp_async_start(job);
+    }
+
+    for (csnmp_async_job_t **job_ptr = &active; *job_ptr != NULL;) {
+      csnmp_async_job_t *job = *job_ptr;
+
+      if (shutdown && !job->done) {
+        /* Closing the session cancels the outstanding request. */
+        job->done = true;
+        job->close_session = true;
+      }
+
+      if (!job->done) {
+        job_ptr = &job->next;
+        continue;
+      }
+
+      *job_ptr = job->next;
+      csnmp_async_finish(job);
+    }
+
+    if (shutdown)
+      break;
+
+    int numfds = csnmp_async_pipe[0] + 1;
+    struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+
+    NETSNMP_LARGE_FD_ZERO(&fdset);
+    NETSNMP_LARGE_FD_SET(csnmp_async_pipe[0], &fdset);
+    for (csnmp_async_job_t *job = active; job != NULL; job = job->next) {
+      struct timeval sess_timeout = timeout;
+      int block = 0;
+
+      snmp_sess_select_info2(job->host->sess_handle, &numfds, &fdset,
+                             &sess_timeout, &block);
+      if (!block && timercmp(&sess_timeout, &timeout, <))
+        timeout = sess_timeout;
+    }
+
+    int status =
+        netsnmp_large_fd_set_select(numfds, &fdset, NULL, NULL, &timeout);
+    if ((status < 0) && (errno != EINTR)) {
+      ERROR("snmp plugin: select failed: %s", STRERRNO);
+      continue;
+    }
+
+    if (status > 0) {
+      if (NETSNMP_LARGE_FD_ISSET(csnmp_async_pipe[0], &fdset)) {
+        char buffer[64];
+        while (read(csnmp_async_pipe[0], buffer, sizeof(buffer)) > 0)
+          /* continue */;
+      }
+
+      for (csnmp_async_job_t *job = active; job != NULL; job = job->next)
+        if (!job->done)
+          snmp_sess_read2(job->host->sess_handle, &fdset);
+    }
+
+    /* Handles retransmissions and timeouts. */
+    for (csnmp_async_job_t *job = active; job != NULL; job = job->next)
+      if (!job->done)
+        snmp_sess_timeout(job->host->sess_handle);
+  } /* while (true) */
+
+  netsnmp_large_fd_set_cleanup(&fdset);
+  return NULL;
+} /* void *csnmp_async_thread */
+
+static void csnmp_async_wakeup(void) {
+  /* The pipe is non-blocking: if it is full, the thread is awake anyway. */
+  if (write(csnmp_async_pipe[1], "", 1) < 0) {
+    /* nothing to do */
+  }
+} /* void csnmp_async_wakeup */
+
+/* Must be called with `csnmp_async_lock' held. */
+static int csnmp_async_start_thread(void) {
+  if (csnmp_async_thread_running)
+    return 0;
+
+  if (pipe(csnmp_async_pipe) != 0) {
+    ERROR("snmp plugin: pipe failed: %s", STRERRNO);
+    return -1;
+  }
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(csnmp_async_pipe); i++) {
+    int flags = fcntl(csnmp_async_pipe[i], F_GETFL);
+    fcntl(csnmp_async_pipe[i], F_SETFL, flags | O_NONBLOCK);
+  }
+
+  csnmp_async_shutdown = false;
+  int status = plugin_thread_create(&csnmp_async_thread_id, csnmp_async_thread,
+                                    NULL, "snmp poller");
+  if (status != 0) {
+    ERROR("snmp plugin: Starting the poller thread failed: %s",
+          STRERROR(status));
+    close(csnmp_async_pipe[0]);
+    close(csnmp_async_pipe[1]);
+    csnmp_async_pipe[0] = csnmp_async_pipe[1] = -1;
+    return -1;
+  }
+
+  csnmp_async_thread_running = true;
   return 0;
-} /* int csnmp_read_value */
+} /* int csnmp_async_start_thread */
+
+static int csnmp_async_submit(host_definition_t *host) {
+  csnmp_async_job_t *job;
+
+  pthread_mutex_lock(&csnmp_async_lock);
+  if (host->async_busy) {
+    pthread_mutex_unlock(&csnmp_async_lock);
+    WARNING("snmp plugin: host %s: The previous poll has not finished yet, "
+            "skipping this interval.",
+            host->name);
+    return 0;
+  }
+
+  if (csnmp_async_start_thread() != 0) {
+    pthread_mutex_unlock(&csnmp_async_lock);
+    return -1;
+  }
+
+  job = calloc(1, sizeof(*job));
+  if (job == NULL) {
+    pthread_mutex_unlock(&csnmp_async_lock);
+    ERROR("snmp plugin: csnmp_async_submit: calloc failed.");
+    return -1;
+  }
+  job->host = host;
+  job->start = cdtime();
+
+  job->next = csnmp_async_pending;
+  csnmp_async_pending = job;
+  host->async_busy = true;
+
+  csnmp_async_wakeup();
+  pthread_mutex_unlock(&csnmp_async_lock);
+
+  return 0;
+} /* int csnmp_async_submit */
+
+/* Stops the poller thread, aborting all polls in flight. */
+static void csnmp_async_stop(void) {
+  pthread_mutex_lock(&csnmp_async_lock);
+  if (!csnmp_async_thread_running) {
+    pthread_mutex_unlock(&csnmp_async_lock);
+    return;
+  }
+  csnmp_async_shutdown = true;
+  csnmp_async_wakeup();
+  pthread_mutex_unlock(&csnmp_async_lock);
+
+  pthread_join(csnmp_async_thread_id, NULL);
+
+  pthread_mutex_lock(&csnmp_async_lock);
+  csnmp_async_thread_running = false;
+  close(csnmp_async_pipe[0]);
+  close(csnmp_async_pipe[1]);
+  csnmp_async_pipe[0] = csnmp_async_pipe[1] = -1;
+  pthread_mutex_unlock(&csnmp_async_lock);
+} /* void csnmp_async_stop */
+/* }}} */
 
 static int csnmp_read_host(user_data_t *ud) {
   host_definition_t *host;
+  cdtime_t start;
   int status;
   int success;
   int i;
 
   host = ud->data;
+  host->interval = plugin_get_interval();
+
+  if (csnmp_async)
+    return csnmp_async_submit(host);
+
+  start = cdtime();
 
   if (host->sess_handle == NULL)
     csnmp_host_open_session(host);
@@ -2298,6 +2940,9 @@ static int csnmp_read_host(user_data_t *ud) {
   if (success == 0)
     return -1;
 
+  if (host->report_latency)
+    csnmp_dispatch_latency(host, cdtime() - start);
+
   return 0;
 } /* int csnmp_read_host */
 
@@ -2313,6 +2958,8 @@ static int csnmp_shutdown(void) {
 
   /* When we get here, the read threads have been stopped and all the
    * `host_definition_t' will be freed. */
+  csnmp_async_stop();
+
   DEBUG("snmp plugin: Destroying all data definitions.");
 
   data_this = data_head;
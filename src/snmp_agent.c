@@ -102,6 +102,13 @@ struct table_definition_s {
                                              tokens */
 
   bool tokens_done; /* Set to true when all tokens are generated */
+
+  /* Protects the instance trees, tokens, index_list_cont and oid_names. Lock
+   * order is agentx_lock, then a table's lock, then the global lock. */
+  pthread_mutex_t lock;
+  c_avl_tree_t *oid_names; /* Maps requested OIDs to oid_name_t, so that
+                              repeated requests, e.g. of a walk, don't need
+                              to parse the index again. */
 };
 typedef struct table_definition_s table_definition_t;
 
@@ -121,10 +128,18 @@ struct data_definition_s {
 };
 typedef struct data_definition_s data_definition_t;
 
+/* Identifier a column OID of a table row resolves to. */
+struct oid_name_s {
+  data_definition_t *dd;
+  int oid_index;
+  char name[DATA_MAX_NAME_LEN];
+};
+typedef struct oid_name_s oid_name_t;
+
 struct snmp_agent_ctx_s {
   pthread_t thread;
-  pthread_mutex_t lock;
-  pthread_mutex_t agentx_lock;
+  pthread_mutex_t lock;        /* Protects registered_oids */
+  pthread_mutex_t agentx_lock; /* Recursive, see snmp_agent_init() */
   struct tree *tp;
 
   llist_t *tables;
@@ -153,6 +168,7 @@ static int snmp_agent_unregister_oid_index(oid_t *oid, int index);
 static int snmp_agent_update_instance_oids(c_avl_tree_t *tree, oid_t *index_oid,
                                            int value);
 static int num_compare(const int *a, const int *b);
+static int oid_compare(const oid_t *a, const oid_t *b);
 
 static u_char snmp_agent_get_asn_type(oid *oid, size_t oid_len) {
   struct tree *node = get_tree(oid, oid_len, g_agent->tp);
@@ -650,10 +666,16 @@ static int snmp_agent_register_oid_string(const oid_t *oid,
 }
 
 static int snmp_agent_unregister_oid(oid_t *oid) {
-  int ret = c_avl_remove(g_agent->registered_oids, (void *)oid, NULL, NULL);
+  oid_t *registered_oid = NULL;
+
+  pthread_mutex_lock(&g_agent->lock);
+  int ret = c_avl_remove(g_agent->registered_oids, (void *)oid,
+                         (void **)&registered_oid, NULL);
+  pthread_mutex_unlock(&g_agent->lock);
 
   if (ret != 0)
     ERROR(PLUGIN_NAME ": Could not delete registration info");
+  sfree(registered_oid);
 
   return unregister_mib(oid->oid, oid->oid_len);
 }
@@ -675,6 +697,19 @@ static int snmp_agent_unregister_oid_string(oid_t *oid,
   return snmp_agent_unregister_oid(&new_oid);
 }
 
+static void snmp_agent_clear_oid_names(table_definition_t *td) {
+  void *key;
+  void *value;
+
+  if (td->oid_names == NULL)
+    return;
+
+  while (c_avl_pick(td->oid_names, &key, &value) == 0) {
+    sfree(key);
+    sfree(value);
+  }
+}
+
 static void snmp_agent_table_data_remove(data_definition_t *dd,
                                          table_definition_t *td,
                                          oid_t *index_oid) {
@@ -752,6 +787,9 @@ static void snmp_agent_table_data_remove(data_definition_t *dd,
   c_avl_remove(td->instance_oids, index_oid, NULL, (void **)&val);
   sfree(val);
 
+  /* Indexes may be reused by new rows. */
+  snmp_agent_clear_oid_names(td);
+
   if (index != NULL) {
     pthread_mutex_lock(&g_agent->agentx_lock);
     snmp_agent_unregister_oid_index(&td->index_oid, *index);
@@ -787,10 +825,16 @@ static int snmp_agent_clear_missing(const value_list_t *vl,
             return -ENOMEM;
           }
 
+          /* Unregistering OIDs requires the AgentX lock, which has to be
+           * taken before the table's lock. */
+          pthread_mutex_lock(&g_agent->agentx_lock);
+          pthread_mutex_lock(&td->lock);
           int ret = snmp_agent_generate_index(td, vl, index_oid);
 
           if (ret == 0)
             snmp_agent_table_data_remove(dd, td, index_oid);
+          pthread_mutex_unlock(&td->lock);
+          pthread_mutex_unlock(&g_agent->agentx_lock);
           sfree(index_oid);
 
           return ret;
@@ -929,6 +973,12 @@ static void snmp_agent_free_table(table_definition_t **td) {
       c_avl_destroy((*td)->tokens[i]);
       (*td)->tokens[i] = NULL;
     }
+  if ((*td)->oid_names != NULL) {
+    snmp_agent_clear_oid_names(*td);
+    c_avl_destroy((*td)->oid_names);
+    (*td)->oid_names = NULL;
+  }
+  pthread_mutex_destroy(&(*td)->lock);
   sfree((*td)->name);
   sfree(*td);
 
@@ -1043,56 +1093,9 @@ static int snmp_agent_format_name(char *name, int name_len,
   return 0;
 }
 
-static int snmp_agent_form_reply(struct netsnmp_request_info_s *requests,
-                                 data_definition_t *dd, oid_t *index_oid,
-                                 int oid_index) {
-  int ret;
-
-  if (dd->is_index_key) {
-    const table_definition_t *td = dd->table;
-    int ret = snmp_agent_parse_oid_index_keys(td, index_oid);
-
-    if (ret != 0)
-      return ret;
-
-    netsnmp_variable_list *key = td->index_list_cont;
-    /* Searching index key */
-    for (int pos = 0; pos < dd->index_key_pos; pos++)
-      key = key->next_variable;
-
-    requests->requestvb->type = td->index_keys[dd->index_key_pos].type;
-
-    if (requests->requestvb->type == ASN_INTEGER)
-#ifdef HAVE_NETSNMP_OLD_API
-      snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
-                               (const u_char *)key->val.integer,
-                               sizeof(*key->val.integer));
-#else
-      snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
-                               key->val.integer, sizeof(*key->val.integer));
-#endif
-    else /* OCTET_STR */
-#ifdef HAVE_NETSNMP_OLD_API
-      snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
-                               (const u_char *)key->val.string,
-                               strlen((const char *)key->val.string));
-#else
-      snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
-                               key->val.string,
-                               strlen((const char *)key->val.string));
-#endif
-
-    pthread_mutex_unlock(&g_agent->lock);
-
-    return SNMP_ERR_NOERROR;
-  }
-
-  char name[DATA_MAX_NAME_LEN];
-
-  ret = snmp_agent_format_name(name, sizeof(name), dd, index_oid);
-  if (ret != 0)
-    return ret;
-
+static int snmp_agent_reply_value(struct netsnmp_request_info_s *requests,
+                                  data_definition_t *dd, const char *name,
+                                  int oid_index) {
   DEBUG(PLUGIN_NAME ": Identifier '%s'", name);
 
   value_t *values;
@@ -1103,7 +1106,7 @@ static int snmp_agent_form_reply(struct netsnmp_request_info_s *requests,
     return SNMP_NOSUCHINSTANCE;
   }
 
-  ret = uc_get_value_by_name(name, &values, &values_num);
+  int ret = uc_get_value_by_name(name, &values, &values_num);
 
   if (ret != 0) {
     ERROR(PLUGIN_NAME ": Failed to get value for '%s'", name);
@@ -1133,6 +1136,145 @@ static int snmp_agent_form_reply(struct netsnmp_request_info_s *requests,
   return SNMP_ERR_NOERROR;
 }
 
+/* Replies with an index key column of a table. The table's lock must be
+ * held. */
+static int snmp_agent_reply_index_key(struct netsnmp_request_info_s *requests,
+                                      data_definition_t *dd,
+                                      oid_t *index_oid) {
+  const table_definition_t *td = dd->table;
+  int ret = snmp_agent_parse_oid_index_keys(td, index_oid);
+
+  if (ret != 0)
+    return ret;
+
+  netsnmp_variable_list *key = td->index_list_cont;
+  /* Searching index key */
+  for (int pos = 0; pos < dd->index_key_pos; pos++)
+    key = key->next_variable;
+
+  requests->requestvb->type = td->index_keys[dd->index_key_pos].type;
+
+  if (requests->requestvb->type == ASN_INTEGER)
+#ifdef HAVE_NETSNMP_OLD_API
+    snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
+                             (const u_char *)key->val.integer,
+                             sizeof(*key->val.integer));
+#else
+    snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
+                             key->val.integer, sizeof(*key->val.integer));
+#endif
+  else /* OCTET_STR */
+#ifdef HAVE_NETSNMP_OLD_API
+    snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
+                             (const u_char *)key->val.string,
+                             strlen((const char *)key->val.string));
+#else
+    snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
+                             key->val.string,
+                             strlen((const char *)key->val.string));
+#endif
+
+  return SNMP_ERR_NOERROR;
+}
+
+static void snmp_agent_cache_oid_name(table_definition_t *td,
+                                      const oid_t *oid,
+                                      const oid_name_t *on) {
+  if (td->oid_names == NULL) {
+    td->oid_names =
+        c_avl_create((int (*)(const void *, const void *))oid_compare);
+    if (td->oid_names == NULL)
+      return;
+  }
+
+  oid_t *key = malloc(sizeof(*key));
+  oid_name_t *value = malloc(sizeof(*value));
+  if ((key == NULL) || (value == NULL)) {
+    sfree(key);
+    sfree(value);
+    return;
+  }
+  memcpy(key, oid, sizeof(*key));
+  memcpy(value, on, sizeof(*value));
+
+  if (c_avl_insert(td->oid_names, key, value) != 0) {
+    sfree(key);
+    sfree(value);
+  }
+}
+
+/* Resolves a requested column OID of table "td" to the data definition and
+ * identifier it belongs to. Returns SNMP_NOSUCHINSTANCE if the OID doesn't
+ * belong to the table or its row doesn't exist. If the OID belongs to an index
+ * key column, the reply is formed right away and "ret_on" is left untouched.
+ * The table's lock must be held. */
+static int snmp_agent_resolve_table_oid(struct netsnmp_request_info_s *requests,
+                                        table_definition_t *td, oid_t *oid,
+                                        oid_name_t *ret_on) {
+  oid_name_t *cached = NULL;
+
+  if ((td->oid_names != NULL) &&
+      (c_avl_get(td->oid_names, oid, (void **)&cached) == 0)) {
+    memcpy(ret_on, cached, sizeof(*ret_on));
+    return 0;
+  }
+
+  for (llentry_t *de = llist_head(td->columns); de != NULL; de = de->next) {
+    data_definition_t *dd = de->value;
+
+    for (size_t i = 0; i < dd->oids_len; i++) {
+      int ret = snmp_oid_ncompare(oid->oid, oid->oid_len, dd->oids[i].oid,
+                                  dd->oids[i].oid_len,
+                                  SNMP_MIN(oid->oid_len, dd->oids[i].oid_len));
+      if (ret != 0)
+        continue;
+
+      oid_t index_oid; /* Index part of requested OID */
+
+      /* Calculating OID length for index part */
+      index_oid.oid_len = oid->oid_len - dd->oids[i].oid_len;
+      /* Fetching index part of the OID */
+      memcpy(index_oid.oid, &oid->oid[dd->oids[i].oid_len],
+             index_oid.oid_len * sizeof(*oid->oid));
+
+      char index_str[DATA_MAX_NAME_LEN];
+      snmp_agent_oid_to_string(index_str, sizeof(index_str), &index_oid);
+
+      if (!td->index_oid.oid_len) {
+        ret = c_avl_get(td->instance_index, &index_oid, NULL);
+      } else {
+        oid_t *temp_oid;
+
+        assert(index_oid.oid_len == 1);
+        ret = c_avl_get(td->index_instance, (int *)&index_oid.oid[0],
+                        (void **)&temp_oid);
+        if (ret == 0)
+          memcpy(&index_oid, temp_oid, sizeof(index_oid));
+      }
+
+      if (ret != 0) {
+        INFO(PLUGIN_NAME ": Non-existing index (%s) requested", index_str);
+        return SNMP_NOSUCHINSTANCE;
+      }
+
+      if (dd->is_index_key)
+        return snmp_agent_reply_index_key(requests, dd, &index_oid);
+
+      ret_on->dd = dd;
+      ret_on->oid_index = (int)i;
+      ret = snmp_agent_format_name(ret_on->name, sizeof(ret_on->name), dd,
+                                   &index_oid);
+      if (ret != 0)
+        return ret;
+
+      snmp_agent_cache_oid_name(td, oid, ret_on);
+      return 0;
+    }
+  }
+
+  return SNMP_NOSUCHINSTANCE;
+}
+
 static int
 snmp_agent_table_oid_handler(struct netsnmp_mib_handler_s *handler,
                              struct netsnmp_handler_registration_s *reginfo,
@@ -1144,8 +1286,6 @@ snmp_agent_table_oid_handler(struct netsnmp_mib_handler_s *handler,
     return SNMP_ERR_NOERROR;
   }
 
-  pthread_mutex_lock(&g_agent->lock);
-
   oid_t oid; /* Requested OID */
   memcpy(oid.oid, requests->requestvb->name,
          sizeof(oid.oid[0]) * requests->requestvb->name_length);
@@ -1156,57 +1296,27 @@ snmp_agent_table_oid_handler(struct netsnmp_mib_handler_s *handler,
   snmp_agent_oid_to_string(oid_str, sizeof(oid_str), &oid);
   DEBUG(PLUGIN_NAME ": Get request received for table OID '%s'", oid_str);
 #endif
-  oid_t index_oid; /* Index part of requested OID */
 
+  /* The list of tables and their columns doesn't change after the
+   * configuration has been read, so only the table's own state is locked. */
   for (llentry_t *te = llist_head(g_agent->tables); te != NULL; te = te->next) {
     table_definition_t *td = te->value;
+    oid_name_t on = {0};
 
-    for (llentry_t *de = llist_head(td->columns); de != NULL; de = de->next) {
-      data_definition_t *dd = de->value;
-
-      for (size_t i = 0; i < dd->oids_len; i++) {
-        int ret = snmp_oid_ncompare(oid.oid, oid.oid_len, dd->oids[i].oid,
-                                    dd->oids[i].oid_len,
-                                    SNMP_MIN(oid.oid_len, dd->oids[i].oid_len));
-        if (ret != 0)
-          continue;
-
-        /* Calculating OID length for index part */
-        index_oid.oid_len = oid.oid_len - dd->oids[i].oid_len;
-        /* Fetching index part of the OID */
-        memcpy(index_oid.oid, &oid.oid[dd->oids[i].oid_len],
-               index_oid.oid_len * sizeof(*oid.oid));
-
-        char index_str[DATA_MAX_NAME_LEN];
-        snmp_agent_oid_to_string(index_str, sizeof(index_str), &index_oid);
-
-        if (!td->index_oid.oid_len) {
-          ret = c_avl_get(td->instance_index, &index_oid, NULL);
-        } else {
-          oid_t *temp_oid;
-
-          assert(index_oid.oid_len == 1);
-          ret = c_avl_get(td->index_instance, (int *)&index_oid.oid[0],
-                          (void **)&temp_oid);
-          memcpy(&index_oid, temp_oid, sizeof(index_oid));
-        }
-
-        if (ret != 0) {
-          INFO(PLUGIN_NAME ": Non-existing index (%s) requested", index_str);
-          pthread_mutex_unlock(&g_agent->lock);
-          return SNMP_NOSUCHINSTANCE;
-        }
+    pthread_mutex_lock(&td->lock);
+    int ret = snmp_agent_resolve_table_oid(requests, td, &oid, &on);
+    pthread_mutex_unlock(&td->lock);
 
-        ret = snmp_agent_form_reply(requests, dd, &index_oid, i);
-        pthread_mutex_unlock(&g_agent->lock);
+    if (ret == SNMP_NOSUCHINSTANCE)
+      continue;
+    else if ((ret != 0) || (on.dd == NULL))
+      return ret;
 
-        return ret;
-      }
-    }
+    /* The value is looked up without holding the table's lock, so that
+     * writes to the table are not blocked by the value cache. */
+    return snmp_agent_reply_value(requests, on.dd, on.name, on.oid_index);
   }
 
-  pthread_mutex_unlock(&g_agent->lock);
-
   return SNMP_NOSUCHINSTANCE;
 }
 
@@ -1221,8 +1331,6 @@ static int snmp_agent_table_index_oid_handler(
     return SNMP_ERR_NOERROR;
   }
 
-  pthread_mutex_lock(&g_agent->lock);
-
   oid_t oid;
   memcpy(oid.oid, requests->requestvb->name,
          sizeof(oid.oid[0]) * requests->requestvb->name_length);
@@ -1240,10 +1348,11 @@ static int snmp_agent_table_index_oid_handler(
 
       int index = oid.oid[oid.oid_len - 1];
 
+      pthread_mutex_lock(&td->lock);
       int ret = c_avl_get(td->index_instance, &index, NULL);
+      pthread_mutex_unlock(&td->lock);
       if (ret != 0) {
         /* nonexisting index requested */
-        pthread_mutex_unlock(&g_agent->lock);
         return SNMP_NOSUCHINSTANCE;
       }
 
@@ -1251,14 +1360,10 @@ static int snmp_agent_table_index_oid_handler(
       snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
                                (const u_char *)&index, sizeof(index));
 
-      pthread_mutex_unlock(&g_agent->lock);
-
       return SNMP_ERR_NOERROR;
     }
   }
 
-  pthread_mutex_unlock(&g_agent->lock);
-
   return SNMP_NOSUCHINSTANCE;
 }
 
@@ -1273,8 +1378,6 @@ static int snmp_agent_table_size_oid_handler(
     return SNMP_ERR_NOERROR;
   }
 
-  pthread_mutex_lock(&g_agent->lock);
-
   oid_t oid;
   memcpy(oid.oid, requests->requestvb->name,
          sizeof(oid.oid[0]) * requests->requestvb->name_length);
@@ -1292,23 +1395,21 @@ static int snmp_agent_table_size_oid_handler(
       DEBUG(PLUGIN_NAME ": Handle '%s' table size OID", td->name);
 
       long size;
+      pthread_mutex_lock(&td->lock);
       if (td->index_oid.oid_len)
         size = c_avl_size(td->index_instance);
       else
         size = c_avl_size(td->instance_index);
+      pthread_mutex_unlock(&td->lock);
 
       requests->requestvb->type = ASN_INTEGER;
       snmp_set_var_typed_value(requests->requestvb, requests->requestvb->type,
                                (const u_char *)&size, sizeof(size));
 
-      pthread_mutex_unlock(&g_agent->lock);
-
       return SNMP_ERR_NOERROR;
     }
   }
 
-  pthread_mutex_unlock(&g_agent->lock);
-
   return SNMP_NOSUCHINSTANCE;
 }
 
@@ -1323,8 +1424,6 @@ snmp_agent_scalar_oid_handler(struct netsnmp_mib_handler_s *handler,
     return SNMP_ERR_NOERROR;
   }
 
-  pthread_mutex_lock(&g_agent->lock);
-
   oid_t oid;
   memcpy(oid.oid, requests->requestvb->name,
          sizeof(oid.oid[0]) * requests->requestvb->name_length);
@@ -1347,16 +1446,15 @@ snmp_agent_scalar_oid_handler(struct netsnmp_mib_handler_s *handler,
       if (ret != 0)
         continue;
 
-      ret = snmp_agent_form_reply(requests, dd, NULL, i);
-
-      pthread_mutex_unlock(&g_agent->lock);
+      char name[DATA_MAX_NAME_LEN];
+      ret = snmp_agent_format_name(name, sizeof(name), dd, NULL);
+      if (ret != 0)
+        return ret;
 
-      return ret;
+      return snmp_agent_reply_value(requests, dd, name, i);
     }
   }
 
-  pthread_mutex_unlock(&g_agent->lock);
-
   return SNMP_NOSUCHINSTANCE;
 }
 
@@ -1699,10 +1797,11 @@ static int snmp_agent_config_table(oconfig_item_t *ci) {
     ERROR(PLUGIN_NAME ": Failed to allocate memory for table definition");
     return -ENOMEM;
   }
+  pthread_mutex_init(&td->lock, NULL);
 
   ret = cf_util_get_string(ci, &td->name);
   if (ret != 0) {
-    sfree(td);
+    snmp_agent_free_table(&td);
     return -1;
   }
 
@@ -2029,6 +2128,35 @@ error:
   return ret;
 }
 
+/* Returns true if the row "index_oid" exists in table "td" and the OIDs of
+ * column "dd" have been registered for it, i.e. if snmp_agent_update_index()
+ * has nothing to do. The table's lock must be held. */
+static bool snmp_agent_is_registered(data_definition_t *dd,
+                                     table_definition_t *td,
+                                     oid_t *index_oid) {
+  int *index = NULL;
+
+  if ((dd->oids_len == 0) ||
+      (c_avl_get(td->instance_index, (void *)index_oid, (void **)&index) != 0))
+    return false;
+
+  oid_t oid;
+  memcpy(&oid, &dd->oids[0], sizeof(oid));
+  if (td->index_oid.oid_len) {
+    if (oid.oid_len >= MAX_OID_LEN)
+      return false;
+    oid.oid[oid.oid_len++] = *index;
+  } else if (snmp_agent_append_oid(&oid, index_oid) != 0) {
+    return false;
+  }
+
+  pthread_mutex_lock(&g_agent->lock);
+  bool registered = (c_avl_get(g_agent->registered_oids, &oid, NULL) == 0);
+  pthread_mutex_unlock(&g_agent->lock);
+
+  return registered;
+}
+
 static int snmp_agent_write(value_list_t const *vl) {
   if (vl == NULL)
     return -EINVAL;
@@ -2050,10 +2178,22 @@ static int snmp_agent_write(value_list_t const *vl) {
             return -ENOMEM;
           }
 
+          pthread_mutex_lock(&td->lock);
           int ret = snmp_agent_generate_index(td, vl, index_oid);
-
-          if (ret == 0)
+          bool registered =
+              (ret == 0) && snmp_agent_is_registered(dd, td, index_oid);
+          pthread_mutex_unlock(&td->lock);
+
+          /* Registering OIDs for a new row requires the AgentX lock, which
+           * has to be taken before the table's lock. Rows which exist
+           * already, by far the most common case, don't need it. */
+          if ((ret == 0) && !registered) {
+            pthread_mutex_lock(&g_agent->agentx_lock);
+            pthread_mutex_lock(&td->lock);
             ret = snmp_agent_update_index(dd, td, index_oid, &free_index_oid);
+            pthread_mutex_unlock(&td->lock);
+            pthread_mutex_unlock(&g_agent->agentx_lock);
+          }
 
           /* Index exists or update failed */
           if (free_index_oid)
@@ -2071,12 +2211,8 @@ static int snmp_agent_write(value_list_t const *vl) {
 static int snmp_agent_collect(const data_set_t *ds, const value_list_t *vl,
                               user_data_t __attribute__((unused)) * user_data) {
 
-  pthread_mutex_lock(&g_agent->lock);
-
   snmp_agent_write(vl);
 
-  pthread_mutex_unlock(&g_agent->lock);
-
   return 0;
 }
 
@@ -2145,26 +2281,32 @@ static int snmp_agent_init(void) {
 
   plugin_register_shutdown(PLUGIN_NAME, snmp_agent_shutdown);
 
-  ret = snmp_agent_register_scalar_oids();
-  if (ret != 0)
-    return ret;
-
-  ret = snmp_agent_register_table_oids();
-  if (ret != 0)
-    return ret;
-
   ret = pthread_mutex_init(&g_agent->lock, NULL);
   if (ret != 0) {
     ERROR(PLUGIN_NAME ": Failed to initialize mutex, err %u", ret);
     return ret;
   }
 
-  ret = pthread_mutex_init(&g_agent->agentx_lock, NULL);
+  /* The AgentX lock is held while OIDs of new rows are registered and
+   * registering takes it again, so it has to be recursive. */
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  ret = pthread_mutex_init(&g_agent->agentx_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
   if (ret != 0) {
     ERROR(PLUGIN_NAME ": Failed to initialize AgentX mutex, err %u", ret);
     return ret;
   }
 
+  ret = snmp_agent_register_scalar_oids();
+  if (ret != 0)
+    return ret;
+
+  ret = snmp_agent_register_table_oids();
+  if (ret != 0)
+    return ret;
+
   /* create a second thread to listen for requests from AgentX*/
   ret = pthread_create(&g_agent->thread, NULL, &snmp_agent_thread_run, NULL);
   if (ret != 0) {
@@ -2200,12 +2342,15 @@ static void *snmp_agent_thread_run(void __attribute__((unused)) * arg) {
 static int snmp_agent_register_oid(oid_t *oid, Netsnmp_Node_Handler *handler) {
   netsnmp_handler_registration *reg;
 
-  if (c_avl_get(g_agent->registered_oids, (void *)oid, NULL) == 0)
+  pthread_mutex_lock(&g_agent->lock);
+  if (c_avl_get(g_agent->registered_oids, (void *)oid, NULL) == 0) {
+    pthread_mutex_unlock(&g_agent->lock);
     return OID_EXISTS;
-  else {
+  } else {
     oid_t *new_oid = calloc(1, sizeof(*new_oid));
     if (new_oid == NULL) {
       ERROR(PLUGIN_NAME ": Could not allocate memory to register new OID");
+      pthread_mutex_unlock(&g_agent->lock);
       return -ENOMEM;
     }
 
@@ -2215,9 +2360,11 @@ static int snmp_agent_register_oid(oid_t *oid, Netsnmp_Node_Handler *handler) {
     if (ret != 0) {
       ERROR(PLUGIN_NAME ": Could not allocate memory to register new OID");
       sfree(new_oid);
+      pthread_mutex_unlock(&g_agent->lock);
       return -ENOMEM;
     }
   }
+  pthread_mutex_unlock(&g_agent->lock);
 
   char *oid_name = snmp_agent_get_oid_name(oid->oid, oid->oid_len - 1);
   char oid_str[DATA_MAX_NAME_LEN];
@@ -24,16 +24,22 @@
  *   Florian octo Forster <octo at collectd.org>
  */
 
+/* _GNU_SOURCE is needed in Linux to use recvmmsg */
+#define _GNU_SOURCE
+
 #include "collectd.h"
 
 #include "plugin.h"
 #include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
-#include "utils/latency/latency.h"
+#include "utils/latency/histogram.h"
+#include "utils/strconv/strconv.h"
 
 #include <netdb.h>
 #include <poll.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 
 /* AIX doesn't have MSG_DONTWAIT */
 #ifndef MSG_DONTWAIT
@@ -48,28 +54,108 @@
 #define STATSD_DEFAULT_SERVICE "8125"
 #endif
 
+/* Maximum size of a datagram. */
+#define STATSD_PACKET_SIZE 4096
+
+/* Maximum number of datagrams read with one recvmmsg(2) call. */
+#define STATSD_RECEIVE_BATCH 16
+
+/* Default number of values per timer and interval that are kept as they are,
+ * see statsd_timer_t. */
+#define STATSD_TIMER_SAMPLES_DEFAULT 16
+
 enum metric_type_e { STATSD_COUNTER, STATSD_TIMER, STATSD_GAUGE, STATSD_SET };
 typedef enum metric_type_e metric_type_t;
 
+/* Values of a timer received in the current interval. Most timers only get a
+ * handful of values per interval, so up to "conf_timer_samples" values are
+ * kept in "samples" and their percentiles are exact. Only when there are more
+ * values, all of them are moved into a histogram, whose percentiles have a
+ * relative error of about 3%. */
+struct statsd_timer_s {
+  uint64_t num;
+  cdtime_t sum;
+  cdtime_t min;
+  cdtime_t max;
+
+  cdtime_t *samples;
+  size_t samples_num;
+  size_t samples_size;
+
+  latency_histogram_t *histogram;
+};
+typedef struct statsd_timer_s statsd_timer_t;
+
 struct statsd_metric_s {
   metric_type_t type;
   double value;
   derive_t counter;
-  latency_counter_t *latency;
+  statsd_timer_t *timer;
   c_avl_tree_t *set;
   unsigned long updates_num;
+  /* Gauges only: "value" was set rather than only changed since the metric
+   * was last merged, see statsd_metric_merge(). */
+  bool value_set;
 };
 typedef struct statsd_metric_s statsd_metric_t;
 
+enum statsd_socket_kind_e {
+  /* UDP or unix datagram socket, one or more lines per datagram. */
+  STATSD_SOCKET_DGRAM,
+  /* Listening TCP socket. */
+  STATSD_SOCKET_LISTEN,
+  /* Accepted TCP connection, a stream of newline-terminated lines. */
+  STATSD_SOCKET_STREAM,
+};
+typedef enum statsd_socket_kind_e statsd_socket_kind_t;
+
+struct statsd_socket_s {
+  statsd_socket_kind_t kind;
+
+  /* Streams only: received data that is not terminated by a newline yet. */
+  char *buffer;
+  size_t fill;
+};
+typedef struct statsd_socket_s statsd_socket_t;
+
+/* Each receiver has a thread reading from sockets of its own and collects the
+ * metrics it receives in a table of its own, so that receivers don't contend
+ * on a global lock. With more than one receiver, the UDP and TCP sockets share
+ * the port using SO_REUSEPORT and the kernel distributes the datagrams and
+ * connections. The unix socket is read by the first receiver. The tables are
+ * merged into "metrics_tree" by statsd_read(). */
+struct statsd_receiver_s {
+  pthread_t thread;
+  bool thread_running;
+
+  /* Metrics received since the last statsd_read(). Protected by "lock". */
+  c_avl_tree_t *metrics;
+  pthread_mutex_t lock;
+
+  /* Sockets polled by the thread, "sockets" holds the state of "fds" with
+   * the same index. Only used by the receiver's thread. */
+  struct pollfd *fds;
+  statsd_socket_t *sockets;
+  size_t fds_num;
+
+  char buffers[STATSD_RECEIVE_BATCH][STATSD_PACKET_SIZE];
+};
+typedef struct statsd_receiver_s statsd_receiver_t;
+
 static c_avl_tree_t *metrics_tree;
 static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static pthread_t network_thread;
-static bool network_thread_running;
+static statsd_receiver_t *receivers;
+static size_t receivers_num;
 static bool network_thread_shutdown;
 
 static char *conf_node;
 static char *conf_service;
+static char *conf_tcp_service;
+static char *conf_socket_file;
+static int conf_socket_perms = S_IRWXU | S_IRWXG;
+static bool conf_delete_socket;
+static int conf_receive_threads = 1;
 
 static bool conf_delete_counters;
 static bool conf_delete_timers;
@@ -78,6 +164,7 @@ static bool conf_delete_sets;
 
 static double *conf_timer_percentile;
 static size_t conf_timer_percentile_num;
+static size_t conf_timer_samples = STATSD_TIMER_SAMPLES_DEFAULT;
 
 static bool conf_counter_sum;
 static bool conf_counter_gauge;
@@ -86,9 +173,10 @@ static bool conf_timer_upper;
 static bool conf_timer_sum;
 static bool conf_timer_count;
 
-/* Must hold metrics_lock when calling this function. */
-static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
-                                                    metric_type_t type) {
+/* Must hold the lock protecting "tree" when calling this function. */
+static statsd_metric_t *
+statsd_metric_lookup_unsafe(c_avl_tree_t *tree, /* {{{ */
+                            char const *name, metric_type_t type) {
   char key[DATA_MAX_NAME_LEN + 2];
   char *key_copy;
   statsd_metric_t *metric;
@@ -114,7 +202,7 @@ static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
   key[1] = ':';
   sstrncpy(&key[2], name, sizeof(key) - 2);
 
-  status = c_avl_get(metrics_tree, key, (void *)&metric);
+  status = c_avl_get(tree, key, (void *)&metric);
   if (status == 0)
     return metric;
 
@@ -132,10 +220,10 @@ static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
   }
 
   metric->type = type;
-  metric->latency = NULL;
+  metric->timer = NULL;
   metric->set = NULL;
 
-  status = c_avl_insert(metrics_tree, key_copy, metric);
+  status = c_avl_insert(tree, key_copy, metric);
   if (status != 0) {
     ERROR("statsd plugin: c_avl_insert failed.");
     sfree(key_copy);
@@ -146,54 +234,204 @@ static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
   return metric;
 } /* }}} statsd_metric_lookup_unsafe */
 
-static int statsd_metric_set(char const *name, double value, /* {{{ */
+/* Must hold the lock protecting "tree" when calling this function. */
+static int statsd_metric_set(c_avl_tree_t *tree, /* {{{ */
+                             char const *name, double value,
                              metric_type_t type) {
-  statsd_metric_t *metric;
-
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, type);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  statsd_metric_t *metric = statsd_metric_lookup_unsafe(tree, name, type);
+  if (metric == NULL)
     return -1;
-  }
 
   metric->value = value;
+  metric->value_set = true;
   metric->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
-
   return 0;
 } /* }}} int statsd_metric_set */
 
-static int statsd_metric_add(char const *name, double delta, /* {{{ */
+/* Must hold the lock protecting "tree" when calling this function. */
+static int statsd_metric_add(c_avl_tree_t *tree, /* {{{ */
+                             char const *name, double delta,
                              metric_type_t type) {
-  statsd_metric_t *metric;
-
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, type);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  statsd_metric_t *metric = statsd_metric_lookup_unsafe(tree, name, type);
+  if (metric == NULL)
     return -1;
-  }
 
   metric->value += delta;
   metric->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
-
   return 0;
 } /* }}} int statsd_metric_add */
 
+static void statsd_timer_free(statsd_timer_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return;
+
+  sfree(t->samples);
+  latency_histogram_destroy(t->histogram);
+  sfree(t);
+} /* }}} void statsd_timer_free */
+
+/* Moves the samples of "t" into its histogram, creating it if necessary. */
+static int statsd_timer_fold(statsd_timer_t *t) /* {{{ */
+{
+  if (t->histogram == NULL) {
+    t->histogram = latency_histogram_create();
+    if (t->histogram == NULL)
+      return ENOMEM;
+  }
+
+  for (size_t i = 0; i < t->samples_num; i++)
+    latency_histogram_add(t->histogram, t->samples[i]);
+
+  sfree(t->samples);
+  t->samples_num = 0;
+  t->samples_size = 0;
+
+  return 0;
+} /* }}} int statsd_timer_fold */
+
+/* Stores "value" in the samples or the histogram of "t", without updating the
+ * totals. */
+static int statsd_timer_store(statsd_timer_t *t, cdtime_t value) /* {{{ */
+{
+  if ((t->histogram == NULL) && (t->samples_num >= conf_timer_samples)) {
+    int status = statsd_timer_fold(t);
+    if (status != 0)
+      return status;
+  }
+
+  if (t->histogram != NULL) {
+    latency_histogram_add(t->histogram, value);
+    return 0;
+  }
+
+  if (t->samples_num >= t->samples_size) {
+    size_t size = (t->samples_size == 0) ? 4 : 2 * t->samples_size;
+    if (size > conf_timer_samples)
+      size = conf_timer_samples;
+
+    cdtime_t *tmp = realloc(t->samples, size * sizeof(*t->samples));
+    if (tmp == NULL)
+      return ENOMEM;
+    t->samples = tmp;
+    t->samples_size = size;
+  }
+
+  t->samples[t->samples_num] = value;
+  t->samples_num++;
+
+  return 0;
+} /* }}} int statsd_timer_store */
+
+static int statsd_timer_add(statsd_timer_t *t, cdtime_t value) /* {{{ */
+{
+  int status = statsd_timer_store(t, value);
+  if (status != 0)
+    return status;
+
+  if ((t->num == 0) || (t->min > value))
+    t->min = value;
+  if (t->max < value)
+    t->max = value;
+  t->sum += value;
+  t->num++;
+
+  return 0;
+} /* }}} int statsd_timer_add */
+
+/* Adds the values of "src" to "dst". "src" is not modified. */
+static void statsd_timer_merge(statsd_timer_t *dst, /* {{{ */
+                               statsd_timer_t const *src) {
+  if (src->num == 0)
+    return;
+
+  if (src->histogram != NULL) {
+    if (statsd_timer_fold(dst) != 0)
+      return;
+    latency_histogram_merge(dst->histogram, src->histogram);
+  }
+  for (size_t i = 0; i < src->samples_num; i++)
+    statsd_timer_store(dst, src->samples[i]);
+
+  if ((dst->num == 0) || (dst->min > src->min))
+    dst->min = src->min;
+  if (dst->max < src->max)
+    dst->max = src->max;
+  dst->sum += src->sum;
+  dst->num += src->num;
+} /* }}} void statsd_timer_merge */
+
+static int statsd_cdtime_compare(void const *a, void const *b) /* {{{ */
+{
+  cdtime_t x = *(cdtime_t const *)a;
+  cdtime_t y = *(cdtime_t const *)b;
+
+  return (x > y) - (x < y);
+} /* }}} int statsd_cdtime_compare */
+
+/* Looks up "num" percentiles. Percentiles of samples are exact, using the
+ * nearest rank method. */
+static void statsd_timer_percentiles(statsd_timer_t *t, /* {{{ */
+                                     double const *percent, cdtime_t *ret,
+                                     size_t num) {
+  if (t->histogram != NULL) {
+    latency_histogram_get_percentiles(t->histogram, percent, ret, num);
+    return;
+  }
+
+  qsort(t->samples, t->samples_num, sizeof(*t->samples),
+        statsd_cdtime_compare);
+
+  for (size_t i = 0; i < num; i++) {
+    if (t->samples_num == 0) {
+      ret[i] = 0;
+      continue;
+    }
+
+    size_t rank = (size_t)ceil(percent[i] / 100.0 * (double)t->samples_num);
+    if (rank < 1)
+      rank = 1;
+    if (rank > t->samples_num)
+      rank = t->samples_num;
+    ret[i] = t->samples[rank - 1];
+  }
+} /* }}} void statsd_timer_percentiles */
+
+/* Starts a new interval. Memory is kept for timers that are still busy and
+ * released for timers that have become quiet. */
+static void statsd_timer_reset(statsd_timer_t *t) /* {{{ */
+{
+  if (t->histogram != NULL) {
+    if (t->num > conf_timer_samples)
+      latency_histogram_reset(t->histogram);
+    else {
+      latency_histogram_destroy(t->histogram);
+      t->histogram = NULL;
+    }
+  }
+
+  if (t->num == 0) {
+    sfree(t->samples);
+    t->samples_size = 0;
+  }
+  t->samples_num = 0;
+
+  t->num = 0;
+  t->sum = 0;
+  t->min = 0;
+  t->max = 0;
+} /* }}} void statsd_timer_reset */
+
 static void statsd_metric_free(statsd_metric_t *metric) /* {{{ */
 {
   if (metric == NULL)
     return;
 
-  if (metric->latency != NULL) {
-    latency_counter_destroy(metric->latency);
-    metric->latency = NULL;
+  if (metric->timer != NULL) {
+    statsd_timer_free(metric->timer);
+    metric->timer = NULL;
   }
 
   if (metric->set != NULL) {
@@ -212,19 +450,97 @@ static void statsd_metric_free(statsd_metric_t *metric) /* {{{ */
   sfree(metric);
 } /* }}} void statsd_metric_free */
 
+static void statsd_metrics_destroy(c_avl_tree_t *tree) /* {{{ */
+{
+  void *key;
+  void *value;
+
+  if (tree == NULL)
+    return;
+
+  while (c_avl_pick(tree, &key, &value) == 0) {
+    sfree(key);
+    statsd_metric_free(value);
+  }
+  c_avl_destroy(tree);
+} /* }}} void statsd_metrics_destroy */
+
+/* Adds the updates collected in "src" to "dst" and frees "src". */
+static void statsd_metric_merge(statsd_metric_t *dst, /* {{{ */
+                                statsd_metric_t *src) {
+  if ((src->type == STATSD_GAUGE) && src->value_set)
+    dst->value = src->value;
+  else
+    dst->value += src->value;
+  dst->updates_num += src->updates_num;
+
+  if (src->timer != NULL) {
+    if (dst->timer == NULL) {
+      dst->timer = src->timer;
+      src->timer = NULL;
+    } else {
+      statsd_timer_merge(dst->timer, src->timer);
+    }
+  }
+
+  if (src->set != NULL) {
+    if (dst->set == NULL) {
+      dst->set = src->set;
+      src->set = NULL;
+    } else {
+      void *key;
+      void *value;
+
+      while (c_avl_pick(src->set, &key, &value) == 0) {
+        if (c_avl_insert(dst->set, key, value) != 0)
+          sfree(key);
+      }
+    }
+  }
+
+  statsd_metric_free(src);
+} /* }}} void statsd_metric_merge */
+
+/* Moves all metrics from "src" to "dst" and destroys "src". Must hold
+ * metrics_lock when calling this function. */
+static void statsd_metrics_merge_unsafe(c_avl_tree_t *dst, /* {{{ */
+                                        c_avl_tree_t *src) {
+  char *key;
+  statsd_metric_t *metric;
+
+  while (c_avl_pick(src, (void *)&key, (void *)&metric) == 0) {
+    statsd_metric_t *existing = NULL;
+
+    if (c_avl_get(dst, key, (void *)&existing) == 0) {
+      statsd_metric_merge(existing, metric);
+      sfree(key);
+      continue;
+    }
+
+    if (c_avl_insert(dst, key, metric) != 0) {
+      ERROR("statsd plugin: c_avl_insert failed.");
+      sfree(key);
+      statsd_metric_free(metric);
+    }
+  }
+
+  c_avl_destroy(src);
+} /* }}} void statsd_metrics_merge_unsafe */
+
 static int statsd_parse_value(char const *str, value_t *ret_value) /* {{{ */
 {
   char *endptr = NULL;
 
-  ret_value->gauge = (gauge_t)strtod(str, &endptr);
+  ret_value->gauge = (gauge_t)strtod_fast(str, &endptr);
   if ((str == endptr) || ((endptr != NULL) && (*endptr != 0)))
     return -1;
 
   return 0;
 } /* }}} int statsd_parse_value */
 
-static int statsd_handle_counter(char const *name, /* {{{ */
-                                 char const *value_str, char const *extra) {
+static int statsd_handle_counter(c_avl_tree_t *tree, /* {{{ */
+                                 char const *name, char const *value_str,
+                                 char const *extra) {
   value_t value;
   value_t scale;
   int status;
@@ -249,12 +565,12 @@ static int statsd_handle_counter(char const *name, /* {{{ */
 
   /* Changes to the counter are added to (statsd_metric_t*)->value. ->counter is
    * only updated in statsd_metric_submit_unsafe(). */
-  return statsd_metric_add(name, (double)(value.gauge / scale.gauge),
+  return statsd_metric_add(tree, name, (double)(value.gauge / scale.gauge),
                            STATSD_COUNTER);
 } /* }}} int statsd_handle_counter */
 
-static int statsd_handle_gauge(char const *name, /* {{{ */
-                               char const *value_str) {
+static int statsd_handle_gauge(c_avl_tree_t *tree, /* {{{ */
+                               char const *name, char const *value_str) {
   value_t value;
   int status;
 
@@ -264,13 +580,14 @@ static int statsd_handle_gauge(char const *name, /* {{{ */
     return status;
 
   if ((value_str[0] == '+') || (value_str[0] == '-'))
-    return statsd_metric_add(name, (double)value.gauge, STATSD_GAUGE);
+    return statsd_metric_add(tree, name, (double)value.gauge, STATSD_GAUGE);
   else
-    return statsd_metric_set(name, (double)value.gauge, STATSD_GAUGE);
+    return statsd_metric_set(tree, name, (double)value.gauge, STATSD_GAUGE);
 } /* }}} int statsd_handle_gauge */
 
-static int statsd_handle_timer(char const *name, /* {{{ */
-                               char const *value_str, char const *extra) {
+static int statsd_handle_timer(c_avl_tree_t *tree, /* {{{ */
+                               char const *name, char const *value_str,
+                               char const *extra) {
   statsd_metric_t *metric;
   value_t value_ms;
   value_t scale;
@@ -297,62 +614,49 @@ static int statsd_handle_timer(char const *name, /* {{{ */
 
   value = MS_TO_CDTIME_T(value_ms.gauge / scale.gauge);
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, STATSD_TIMER);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  metric = statsd_metric_lookup_unsafe(tree, name, STATSD_TIMER);
+  if (metric == NULL)
     return -1;
-  }
 
-  if (metric->latency == NULL)
-    metric->latency = latency_counter_create();
-  if (metric->latency == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  if (metric->timer == NULL)
+    metric->timer = calloc(1, sizeof(*metric->timer));
+  if (metric->timer == NULL)
     return -1;
-  }
 
-  latency_counter_add(metric->latency, value);
+  if (statsd_timer_add(metric->timer, value) != 0)
+    return -1;
   metric->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
   return 0;
 } /* }}} int statsd_handle_timer */
 
-static int statsd_handle_set(char const *name, /* {{{ */
-                             char const *set_key_orig) {
+static int statsd_handle_set(c_avl_tree_t *tree, /* {{{ */
+                             char const *name, char const *set_key_orig) {
   statsd_metric_t *metric = NULL;
   char *set_key;
   int status;
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, STATSD_SET);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  metric = statsd_metric_lookup_unsafe(tree, name, STATSD_SET);
+  if (metric == NULL)
     return -1;
-  }
 
   /* Make sure metric->set exists. */
   if (metric->set == NULL)
     metric->set = c_avl_create((int (*)(const void *, const void *))strcmp);
 
   if (metric->set == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
     ERROR("statsd plugin: c_avl_create failed.");
     return -1;
   }
 
   set_key = strdup(set_key_orig);
   if (set_key == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
     ERROR("statsd plugin: strdup failed.");
     return -1;
   }
 
   status = c_avl_insert(metric->set, set_key, /* value = */ NULL);
   if (status < 0) {
-    pthread_mutex_unlock(&metrics_lock);
     ERROR("statsd plugin: c_avl_insert (\"%s\") failed with status %i.",
           set_key, status);
     sfree(set_key);
@@ -364,11 +668,11 @@ static int statsd_handle_set(char const *name, /* {{{ */
 
   metric->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
   return 0;
 } /* }}} int statsd_handle_set */
 
-static int statsd_parse_line(char *buffer) /* {{{ */
+/* Must hold the lock protecting "tree" when calling this function. */
+static int statsd_parse_line(c_avl_tree_t *tree, char *buffer) /* {{{ */
 {
   char *name = buffer;
   char *value;
@@ -394,23 +698,24 @@ static int statsd_parse_line(char *buffer) /* {{{ */
   }
 
   if (strcmp("c", type) == 0)
-    return statsd_handle_counter(name, value, extra);
+    return statsd_handle_counter(tree, name, value, extra);
   else if (strcmp("ms", type) == 0)
-    return statsd_handle_timer(name, value, extra);
+    return statsd_handle_timer(tree, name, value, extra);
 
   /* extra is only valid for counters and timers */
   if (extra != NULL)
     return -1;
 
   if (strcmp("g", type) == 0)
-    return statsd_handle_gauge(name, value);
+    return statsd_handle_gauge(tree, name, value);
   else if (strcmp("s", type) == 0)
-    return statsd_handle_set(name, value);
+    return statsd_handle_set(tree, name, value);
   else
     return -1;
 } /* }}} void statsd_parse_line */
 
-static void statsd_parse_buffer(char *buffer) /* {{{ */
+/* Must hold the lock protecting "tree" when calling this function. */
+static void statsd_parse_buffer(c_avl_tree_t *tree, char *buffer) /* {{{ */
 {
   while (buffer != NULL) {
     char orig[64];
@@ -430,7 +735,7 @@ static void statsd_parse_buffer(char *buffer) /* {{{ */
 
     sstrncpy(orig, buffer, sizeof(orig));
 
-    status = statsd_parse_line(buffer);
+    status = statsd_parse_line(tree, buffer);
     if (status != 0)
       ERROR("statsd plugin: Unable to parse line: \"%s\"", orig);
 
@@ -438,14 +743,49 @@ static void statsd_parse_buffer(char *buffer) /* {{{ */
   }
 } /* }}} void statsd_parse_buffer */
 
-static void statsd_network_read(int fd) /* {{{ */
+/* Reads up to STATSD_RECEIVE_BATCH datagrams into the receiver's buffers and
+ * returns the number of datagrams read, or -1 on error. */
+static int statsd_network_recv(statsd_receiver_t *r, int fd, /* {{{ */
+                               size_t *sizes) {
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[STATSD_RECEIVE_BATCH];
+  struct iovec iovs[STATSD_RECEIVE_BATCH];
+
+  memset(msgs, 0, sizeof(msgs));
+  for (size_t i = 0; i < STATSD_RECEIVE_BATCH; i++) {
+    /* Leave room for the terminating null byte. */
+    iovs[i].iov_base = r->buffers[i];
+    iovs[i].iov_len = sizeof(r->buffers[i]) - 1;
+    msgs[i].msg_hdr.msg_iov = iovs + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int status = recvmmsg(fd, msgs, STATSD_RECEIVE_BATCH, MSG_DONTWAIT,
+                        /* timeout = */ NULL);
+  if (status < 0)
+    return -1;
+
+  for (int i = 0; i < status; i++)
+    sizes[i] = (size_t)msgs[i].msg_len;
+
+  return status;
+#else
+  ssize_t status = recv(fd, r->buffers[0], sizeof(r->buffers[0]) - 1,
+                        /* flags = */ MSG_DONTWAIT);
+  if (status < 0)
+    return -1;
+
+  sizes[0] = (size_t)status;
+  return 1;
+#endif
+} /* }}} int statsd_network_recv */
+
+static void statsd_network_read(statsd_receiver_t *r, int fd) /* {{{ */
 {
-  char buffer[4096];
-  size_t buffer_size;
-  ssize_t status;
+  size_t sizes[STATSD_RECEIVE_BATCH];
 
-  status = recv(fd, buffer, sizeof(buffer), /* flags = */ MSG_DONTWAIT);
-  if (status < 0) {
+  int num = statsd_network_recv(r, fd, sizes);
+  if (num < 0) {
 
     if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
       return;
@@ -454,29 +794,137 @@ static void statsd_network_read(int fd) /* {{{ */
     return;
   }
 
-  buffer_size = (size_t)status;
-  if (buffer_size >= sizeof(buffer))
-    buffer_size = sizeof(buffer) - 1;
-  buffer[buffer_size] = 0;
-
-  statsd_parse_buffer(buffer);
+  /* The lock is only contended while statsd_read() swaps the tables, so it
+   * is taken once per batch. */
+  pthread_mutex_lock(&r->lock);
+  for (int i = 0; i < num; i++) {
+    r->buffers[i][sizes[i]] = 0;
+    statsd_parse_buffer(r->metrics, r->buffers[i]);
+  }
+  pthread_mutex_unlock(&r->lock);
 } /* }}} void statsd_network_read */
 
-static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
-                               size_t *ret_fds_num) {
-  struct pollfd *fds = NULL;
-  size_t fds_num = 0;
+static int statsd_socket_add(statsd_receiver_t *r, int fd, /* {{{ */
+                             statsd_socket_kind_t kind) {
+  struct pollfd *fds;
+  statsd_socket_t *sockets;
+  char *buffer = NULL;
+
+  if (kind == STATSD_SOCKET_STREAM) {
+    buffer = malloc(STATSD_PACKET_SIZE);
+    if (buffer == NULL)
+      return ENOMEM;
+  }
+
+  fds = realloc(r->fds, sizeof(*fds) * (r->fds_num + 1));
+  if (fds == NULL) {
+    free(buffer);
+    return ENOMEM;
+  }
+  r->fds = fds;
+
+  sockets = realloc(r->sockets, sizeof(*sockets) * (r->fds_num + 1));
+  if (sockets == NULL) {
+    free(buffer);
+    return ENOMEM;
+  }
+  r->sockets = sockets;
+
+  r->fds[r->fds_num] = (struct pollfd){.fd = fd, .events = POLLIN | POLLPRI};
+  r->sockets[r->fds_num] = (statsd_socket_t){.kind = kind, .buffer = buffer};
+  r->fds_num++;
+  return 0;
+} /* }}} int statsd_socket_add */
 
+/* Closes the socket at "idx" and moves the last socket into its place. */
+static void statsd_socket_remove(statsd_receiver_t *r, size_t idx) /* {{{ */
+{
+  close(r->fds[idx].fd);
+  sfree(r->sockets[idx].buffer);
+
+  r->fds_num--;
+  r->fds[idx] = r->fds[r->fds_num];
+  r->sockets[idx] = r->sockets[r->fds_num];
+} /* }}} void statsd_socket_remove */
+
+static void statsd_network_accept(statsd_receiver_t *r, int fd) /* {{{ */
+{
+  int conn = accept(fd, /* addr = */ NULL, /* addrlen = */ NULL);
+  if (conn < 0) {
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+      ERROR("statsd plugin: accept(2) failed: %s", STRERRNO);
+    return;
+  }
+
+  if (statsd_socket_add(r, conn, STATSD_SOCKET_STREAM) != 0) {
+    ERROR("statsd plugin: Unable to add TCP connection: out of memory.");
+    close(conn);
+  }
+} /* }}} void statsd_network_accept */
+
+/* Reads from a TCP connection and parses all complete lines. Returns non-zero
+ * if the connection has been closed and should be removed. */
+static int statsd_network_read_stream(statsd_receiver_t *r, /* {{{ */
+                                      int fd, statsd_socket_t *s) {
+  ssize_t status = recv(fd, s->buffer + s->fill,
+                        STATSD_PACKET_SIZE - 1 - s->fill, MSG_DONTWAIT);
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return 0;
+
+    ERROR("statsd plugin: recv(2) failed: %s", STRERRNO);
+    return -1;
+  }
+
+  if (status == 0) {
+    /* Connection closed. The last line may lack the newline. */
+    if (s->fill > 0) {
+      s->buffer[s->fill] = 0;
+      pthread_mutex_lock(&r->lock);
+      statsd_parse_buffer(r->metrics, s->buffer);
+      pthread_mutex_unlock(&r->lock);
+    }
+    return -1;
+  }
+
+  s->fill += (size_t)status;
+
+  size_t end = s->fill;
+  while ((end > 0) && (s->buffer[end - 1] != '\n'))
+    end--;
+
+  if (end == 0) {
+    if (s->fill >= STATSD_PACKET_SIZE - 1) {
+      ERROR("statsd plugin: Discarding a line longer than %d bytes.",
+            STATSD_PACKET_SIZE - 1);
+      s->fill = 0;
+    }
+    return 0;
+  }
+
+  s->buffer[end - 1] = 0;
+  pthread_mutex_lock(&r->lock);
+  statsd_parse_buffer(r->metrics, s->buffer);
+  pthread_mutex_unlock(&r->lock);
+
+  memmove(s->buffer, s->buffer + end, s->fill - end);
+  s->fill -= end;
+  return 0;
+} /* }}} int statsd_network_read_stream */
+
+static int statsd_network_init(statsd_receiver_t *r, /* {{{ */
+                               int socktype, char const *service,
+                               bool reuse_port) {
   struct addrinfo *ai_list;
   int status;
+  size_t fds_num = r->fds_num;
+  char const *proto = (socktype == SOCK_STREAM) ? "TCP" : "UDP";
 
   char const *node = (conf_node != NULL) ? conf_node : STATSD_DEFAULT_NODE;
-  char const *service =
-      (conf_service != NULL) ? conf_service : STATSD_DEFAULT_SERVICE;
 
   struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
                               .ai_flags = AI_PASSIVE | AI_ADDRCONFIG,
-                              .ai_socktype = SOCK_DGRAM};
+                              .ai_socktype = socktype};
 
   status = getaddrinfo(node, service, &ai_hints, &ai_list);
   if (status != 0) {
@@ -488,7 +936,6 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
   for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
        ai_ptr = ai_ptr->ai_next) {
     int fd;
-    struct pollfd *tmp;
 
     char str_node[NI_MAXHOST];
     char str_service[NI_MAXSERV];
@@ -507,9 +954,20 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
       continue;
     }
 
+#ifdef SO_REUSEPORT
+    /* Let the sockets of all receivers bind to the same address. */
+    if (reuse_port &&
+        (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == -1)) {
+      ERROR("statsd plugin: setsockopt (reuseport): %s", STRERRNO);
+      close(fd);
+      continue;
+    }
+#endif
+
     getnameinfo(ai_ptr->ai_addr, ai_ptr->ai_addrlen, str_node, sizeof(str_node),
                 str_service, sizeof(str_service),
-                NI_DGRAM | NI_NUMERICHOST | NI_NUMERICSERV);
+                ((socktype == SOCK_DGRAM) ? NI_DGRAM : 0) | NI_NUMERICHOST |
+                    NI_NUMERICSERV);
     DEBUG("statsd plugin: Trying to bind to [%s]:%s ...", str_node,
           str_service);
 
@@ -521,49 +979,114 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
       continue;
     }
 
-    tmp = realloc(fds, sizeof(*fds) * (fds_num + 1));
-    if (tmp == NULL) {
-      ERROR("statsd plugin: realloc failed.");
+    if ((socktype == SOCK_STREAM) && (listen(fd, SOMAXCONN) != 0)) {
+      ERROR("statsd plugin: listen(2) on [%s]:%s failed: %s", str_node,
+            str_service, STRERRNO);
       close(fd);
       continue;
     }
-    fds = tmp;
-    tmp = fds + fds_num;
-    fds_num++;
 
-    memset(tmp, 0, sizeof(*tmp));
-    tmp->fd = fd;
-    tmp->events = POLLIN | POLLPRI;
-    INFO("statsd plugin: Listening on [%s]:%s.", str_node, str_service);
+    if (statsd_socket_add(r, fd,
+                          (socktype == SOCK_STREAM) ? STATSD_SOCKET_LISTEN
+                                                    : STATSD_SOCKET_DGRAM) !=
+        0) {
+      ERROR("statsd plugin: realloc failed.");
+      close(fd);
+      continue;
+    }
+    INFO("statsd plugin: Listening on [%s]:%s (%s).", str_node, str_service,
+         proto);
   }
 
   freeaddrinfo(ai_list);
 
-  if (fds_num == 0) {
-    ERROR("statsd plugin: Unable to create listening socket for [%s]:%s.",
-          (node != NULL) ? node : "::", service);
+  if (r->fds_num == fds_num) {
+    ERROR("statsd plugin: Unable to create listening %s socket for [%s]:%s.",
+          proto, (node != NULL) ? node : "::", service);
     return ENOENT;
   }
 
-  *ret_fds = fds;
-  *ret_fds_num = fds_num;
   return 0;
 } /* }}} int statsd_network_init */
 
+/* Opens the unix datagram socket. Local senders block instead of losing
+ * datagrams when the socket's receive queue is full. */
+static int statsd_network_init_unix(statsd_receiver_t *r) /* {{{ */
+{
+  struct sockaddr_un sa = {.sun_family = AF_UNIX};
+  int fd;
+
+  sstrncpy(sa.sun_path, conf_socket_file, sizeof(sa.sun_path));
+
+  fd = socket(PF_UNIX, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    ERROR("statsd plugin: socket(2) failed: %s", STRERRNO);
+    return -1;
+  }
+
+  if (conf_delete_socket) {
+    errno = 0;
+    if ((unlink(sa.sun_path) != 0) && (errno != ENOENT))
+      WARNING("statsd plugin: Deleting socket file \"%s\" failed: %s",
+              sa.sun_path, STRERRNO);
+  }
+
+  if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+    ERROR("statsd plugin: bind(2) to \"%s\" failed: %s", sa.sun_path,
+          STRERRNO);
+    close(fd);
+    return -1;
+  }
+
+  if (chmod(sa.sun_path, conf_socket_perms) != 0) {
+    ERROR("statsd plugin: chmod (\"%s\") failed: %s", sa.sun_path, STRERRNO);
+    close(fd);
+    unlink(sa.sun_path);
+    return -1;
+  }
+
+  if (statsd_socket_add(r, fd, STATSD_SOCKET_DGRAM) != 0) {
+    ERROR("statsd plugin: realloc failed.");
+    close(fd);
+    unlink(sa.sun_path);
+    return -1;
+  }
+
+  INFO("statsd plugin: Listening on \"%s\".", sa.sun_path);
+  return 0;
+} /* }}} int statsd_network_init_unix */
+
+static void statsd_network_close(statsd_receiver_t *r) /* {{{ */
+{
+  while (r->fds_num > 0)
+    statsd_socket_remove(r, r->fds_num - 1);
+  sfree(r->fds);
+  sfree(r->sockets);
+} /* }}} void statsd_network_close */
+
 static void *statsd_network_thread(void *args) /* {{{ */
 {
-  struct pollfd *fds = NULL;
-  size_t fds_num = 0;
+  statsd_receiver_t *r = args;
+  bool reuse_port = receivers_num > 1;
+  bool has_unix = (conf_socket_file != NULL) && (r == receivers);
   int status;
 
-  status = statsd_network_init(&fds, &fds_num);
+  status = statsd_network_init(
+      r, SOCK_DGRAM,
+      (conf_service != NULL) ? conf_service : STATSD_DEFAULT_SERVICE,
+      reuse_port);
+  if ((status == 0) && (conf_tcp_service != NULL))
+    status = statsd_network_init(r, SOCK_STREAM, conf_tcp_service, reuse_port);
+  if ((status == 0) && has_unix)
+    status = statsd_network_init_unix(r);
   if (status != 0) {
     ERROR("statsd plugin: Unable to open listening sockets.");
+    statsd_network_close(r);
     pthread_exit((void *)0);
   }
 
   while (!network_thread_shutdown) {
-    status = poll(fds, (nfds_t)fds_num, /* timeout = */ -1);
+    status = poll(r->fds, (nfds_t)r->fds_num, /* timeout = */ -1);
     if (status < 0) {
 
       if ((errno == EINTR) || (errno == EAGAIN))
@@ -573,19 +1096,41 @@ static void *statsd_network_thread(void *args) /* {{{ */
       break;
     }
 
-    for (size_t i = 0; i < fds_num; i++) {
-      if ((fds[i].revents & (POLLIN | POLLPRI)) == 0)
-        continue;
+    /* Accepted connections are appended and removed sockets are replaced by
+     * the last one, so this walks the array by index. */
+    size_t i = 0;
+    while (i < r->fds_num) {
+      short revents = r->fds[i].revents;
 
-      statsd_network_read(fds[i].fd);
-      fds[i].revents = 0;
+      r->fds[i].revents = 0;
+      if ((revents & (POLLIN | POLLPRI | POLLHUP | POLLERR)) == 0) {
+        i++;
+        continue;
+      }
+
+      switch (r->sockets[i].kind) {
+      case STATSD_SOCKET_DGRAM:
+        statsd_network_read(r, r->fds[i].fd);
+        break;
+      case STATSD_SOCKET_LISTEN:
+        statsd_network_accept(r, r->fds[i].fd);
+        break;
+      case STATSD_SOCKET_STREAM:
+        if (statsd_network_read_stream(r, r->fds[i].fd, r->sockets + i) !=
+            0) {
+          statsd_socket_remove(r, i);
+          continue;
+        }
+        break;
+      }
+      i++;
     }
   } /* while (!network_thread_shutdown) */
 
   /* Clean up */
-  for (size_t i = 0; i < fds_num; i++)
-    close(fds[i].fd);
-  sfree(fds);
+  statsd_network_close(r);
+  if (has_unix)
+    unlink(conf_socket_file);
 
   return (void *)0;
 } /* }}} void *statsd_network_thread */
@@ -629,6 +1174,20 @@ static int statsd_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &conf_node);
     else if (strcasecmp("Port", child->key) == 0)
       cf_util_get_service(child, &conf_service);
+    else if (strcasecmp("TCPPort", child->key) == 0)
+      cf_util_get_service(child, &conf_tcp_service);
+    else if (strcasecmp("SocketFile", child->key) == 0)
+      cf_util_get_string(child, &conf_socket_file);
+    else if (strcasecmp("SocketPerms", child->key) == 0) {
+      char *perms = NULL;
+      if (cf_util_get_string(child, &perms) != 0)
+        continue;
+      conf_socket_perms = (int)strtol(perms, NULL, 8);
+      sfree(perms);
+    } else if (strcasecmp("DeleteSocket", child->key) == 0)
+      cf_util_get_boolean(child, &conf_delete_socket);
+    else if (strcasecmp("ReceiveThreads", child->key) == 0)
+      cf_util_get_int(child, &conf_receive_threads);
     else if (strcasecmp("DeleteCounters", child->key) == 0)
       cf_util_get_boolean(child, &conf_delete_counters);
     else if (strcasecmp("DeleteTimers", child->key) == 0)
@@ -651,11 +1210,34 @@ static int statsd_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_boolean(child, &conf_timer_count);
     else if (strcasecmp("TimerPercentile", child->key) == 0)
       statsd_config_timer_percentile(child);
+    else if (strcasecmp("TimerSamples", child->key) == 0) {
+      int tmp = 0;
+      if (cf_util_get_int(child, &tmp) != 0)
+        continue;
+      if (tmp < 0) {
+        ERROR("statsd plugin: The `TimerSamples' option must not be "
+              "negative.");
+        continue;
+      }
+      conf_timer_samples = (size_t)tmp;
+    }
     else
       ERROR("statsd plugin: The \"%s\" config option is not valid.",
             child->key);
   }
 
+  if (conf_receive_threads < 1) {
+    WARNING("statsd plugin: The `ReceiveThreads' option must be at least 1.");
+    conf_receive_threads = 1;
+  }
+#ifndef SO_REUSEPORT
+  if (conf_receive_threads > 1) {
+    WARNING("statsd plugin: `ReceiveThreads' requires SO_REUSEPORT, which "
+            "is not available on this system. Using one receive thread.");
+    conf_receive_threads = 1;
+  }
+#endif
+
   return 0;
 } /* }}} int statsd_config */
 
@@ -665,19 +1247,44 @@ static int statsd_init(void) /* {{{ */
   if (metrics_tree == NULL)
     metrics_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
 
-  if (!network_thread_running) {
-    int status;
+  if (receivers == NULL) {
+    receivers = calloc((size_t)conf_receive_threads, sizeof(*receivers));
+    if (receivers == NULL) {
+      pthread_mutex_unlock(&metrics_lock);
+      ERROR("statsd plugin: calloc failed.");
+      return ENOMEM;
+    }
+    receivers_num = (size_t)conf_receive_threads;
+
+    for (size_t i = 0; i < receivers_num; i++) {
+      statsd_receiver_t *r = receivers + i;
+
+      pthread_mutex_init(&r->lock, /* attr = */ NULL);
+      r->metrics = c_avl_create((int (*)(const void *, const void *))strcmp);
+      if (r->metrics == NULL) {
+        pthread_mutex_unlock(&metrics_lock);
+        ERROR("statsd plugin: c_avl_create failed.");
+        return ENOMEM;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < receivers_num; i++) {
+    statsd_receiver_t *r = receivers + i;
+
+    if (r->thread_running)
+      continue;
 
-    status = pthread_create(&network_thread,
-                            /* attr = */ NULL, statsd_network_thread,
-                            /* args = */ NULL);
+    int status = pthread_create(&r->thread,
+                                /* attr = */ NULL, statsd_network_thread,
+                                /* args = */ r);
     if (status != 0) {
       pthread_mutex_unlock(&metrics_lock);
-      ERROR("statsd plugin: pthread_create failed: %s", STRERRNO);
+      ERROR("statsd plugin: pthread_create failed: %s", STRERROR(status));
       return status;
     }
+    r->thread_running = true;
   }
-  network_thread_running = true;
 
   pthread_mutex_unlock(&metrics_lock);
 
@@ -728,53 +1335,49 @@ static int statsd_metric_submit_unsafe(char const *name,
   if (metric->type == STATSD_GAUGE)
     vl.values[0].gauge = (gauge_t)metric->value;
   else if (metric->type == STATSD_TIMER) {
-    bool have_events = (metric->updates_num > 0);
+    statsd_timer_t *t = metric->timer;
+    bool have_events = (metric->updates_num > 0) && (t != NULL);
 
     /* Make sure all timer metrics share the *same* timestamp. */
     vl.time = cdtime();
 
     snprintf(vl.type_instance, sizeof(vl.type_instance), "%s-average", name);
     vl.values[0].gauge =
-        have_events
-            ? CDTIME_T_TO_DOUBLE(latency_counter_get_average(metric->latency))
-            : NAN;
+        have_events ? CDTIME_T_TO_DOUBLE(t->sum / (cdtime_t)t->num) : NAN;
     plugin_dispatch_values(&vl);
 
     if (conf_timer_lower) {
       snprintf(vl.type_instance, sizeof(vl.type_instance), "%s-lower", name);
-      vl.values[0].gauge =
-          have_events
-              ? CDTIME_T_TO_DOUBLE(latency_counter_get_min(metric->latency))
-              : NAN;
+      vl.values[0].gauge = have_events ? CDTIME_T_TO_DOUBLE(t->min) : NAN;
       plugin_dispatch_values(&vl);
     }
 
     if (conf_timer_upper) {
       snprintf(vl.type_instance, sizeof(vl.type_instance), "%s-upper", name);
-      vl.values[0].gauge =
-          have_events
-              ? CDTIME_T_TO_DOUBLE(latency_counter_get_max(metric->latency))
-              : NAN;
+      vl.values[0].gauge = have_events ? CDTIME_T_TO_DOUBLE(t->max) : NAN;
       plugin_dispatch_values(&vl);
     }
 
     if (conf_timer_sum) {
       snprintf(vl.type_instance, sizeof(vl.type_instance), "%s-sum", name);
-      vl.values[0].gauge =
-          have_events
-              ? CDTIME_T_TO_DOUBLE(latency_counter_get_sum(metric->latency))
-              : NAN;
+      vl.values[0].gauge = have_events ? CDTIME_T_TO_DOUBLE(t->sum) : NAN;
       plugin_dispatch_values(&vl);
     }
 
-    for (size_t i = 0; i < conf_timer_percentile_num; i++) {
-      snprintf(vl.type_instance, sizeof(vl.type_instance), "%s-percentile-%.0f",
-               name, conf_timer_percentile[i]);
-      vl.values[0].gauge =
-          have_events ? CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(
-                            metric->latency, conf_timer_percentile[i]))
-                      : NAN;
-      plugin_dispatch_values(&vl);
+    if (conf_timer_percentile_num > 0) {
+      /* Look up all percentiles in one pass over the values. */
+      cdtime_t percentile[conf_timer_percentile_num];
+      if (have_events)
+        statsd_timer_percentiles(t, conf_timer_percentile, percentile,
+                                 conf_timer_percentile_num);
+
+      for (size_t i = 0; i < conf_timer_percentile_num; i++) {
+        snprintf(vl.type_instance, sizeof(vl.type_instance),
+                 "%s-percentile-%.0f", name, conf_timer_percentile[i]);
+        vl.values[0].gauge =
+            have_events ? CDTIME_T_TO_DOUBLE(percentile[i]) : NAN;
+        plugin_dispatch_values(&vl);
+      }
     }
 
     /* Keep this at the end, since vl.type is set to "gauge" here. The
@@ -782,11 +1385,12 @@ static int statsd_metric_submit_unsafe(char const *name,
     if (conf_timer_count) {
       sstrncpy(vl.type, "gauge", sizeof(vl.type));
       snprintf(vl.type_instance, sizeof(vl.type_instance), "%s-count", name);
-      vl.values[0].gauge = latency_counter_get_num(metric->latency);
+      vl.values[0].gauge = (t != NULL) ? (gauge_t)t->num : 0.0;
       plugin_dispatch_values(&vl);
     }
 
-    latency_counter_reset(metric->latency);
+    if (t != NULL)
+      statsd_timer_reset(t);
     return 0;
   } else if (metric->type == STATSD_SET) {
     if (metric->set == NULL)
@@ -863,8 +1467,11 @@ static int statsd_read(void) /* {{{ */
   char *name;
   statsd_metric_t *metric;
 
+  /* Keys of the metrics to delete. They are owned by "metrics_tree" until
+   * the metrics are removed. */
   char **to_be_deleted = NULL;
   size_t to_be_deleted_num = 0;
+  size_t to_be_deleted_size = 0;
 
   pthread_mutex_lock(&metrics_lock);
 
@@ -873,6 +1480,25 @@ static int statsd_read(void) /* {{{ */
     return 0;
   }
 
+  /* Give each receiver an empty table and merge the metrics it collected. */
+  for (size_t i = 0; i < receivers_num; i++) {
+    statsd_receiver_t *r = receivers + i;
+
+    c_avl_tree_t *empty =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (empty == NULL) {
+      ERROR("statsd plugin: c_avl_create failed.");
+      continue;
+    }
+
+    pthread_mutex_lock(&r->lock);
+    c_avl_tree_t *received = r->metrics;
+    r->metrics = empty;
+    pthread_mutex_unlock(&r->lock);
+
+    statsd_metrics_merge_unsafe(metrics_tree, received);
+  }
+
   iter = c_avl_get_iterator(metrics_tree);
   while (c_avl_iterator_next(iter, (void *)&name, (void *)&metric) == 0) {
     if ((metric->updates_num == 0) &&
@@ -881,7 +1507,18 @@ static int statsd_read(void) /* {{{ */
          (conf_delete_gauges && (metric->type == STATSD_GAUGE)) ||
          (conf_delete_sets && (metric->type == STATSD_SET)))) {
       DEBUG("statsd plugin: Deleting metric \"%s\".", name);
-      strarray_add(&to_be_deleted, &to_be_deleted_num, name);
+      if (to_be_deleted_num >= to_be_deleted_size) {
+        size_t size = (to_be_deleted_size == 0) ? 16 : 2 * to_be_deleted_size;
+        char **tmp = realloc(to_be_deleted, size * sizeof(*to_be_deleted));
+        if (tmp == NULL) {
+          ERROR("statsd plugin: realloc failed.");
+          continue;
+        }
+        to_be_deleted = tmp;
+        to_be_deleted_size = size;
+      }
+      to_be_deleted[to_be_deleted_num] = name;
+      to_be_deleted_num++;
       continue;
     }
 
@@ -913,34 +1550,41 @@ static int statsd_read(void) /* {{{ */
 
   pthread_mutex_unlock(&metrics_lock);
 
-  strarray_free(to_be_deleted, to_be_deleted_num);
+  sfree(to_be_deleted);
 
   return 0;
 } /* }}} int statsd_read */
 
 static int statsd_shutdown(void) /* {{{ */
 {
-  void *key;
-  void *value;
+  network_thread_shutdown = true;
+  for (size_t i = 0; i < receivers_num; i++) {
+    statsd_receiver_t *r = receivers + i;
+
+    if (!r->thread_running)
+      continue;
 
-  if (network_thread_running) {
-    network_thread_shutdown = true;
-    pthread_kill(network_thread, SIGTERM);
-    pthread_join(network_thread, /* retval = */ NULL);
+    pthread_kill(r->thread, SIGTERM);
+    pthread_join(r->thread, /* retval = */ NULL);
+    r->thread_running = false;
   }
-  network_thread_running = false;
 
   pthread_mutex_lock(&metrics_lock);
 
-  while (c_avl_pick(metrics_tree, &key, &value) == 0) {
-    sfree(key);
-    statsd_metric_free(value);
+  for (size_t i = 0; i < receivers_num; i++) {
+    statsd_metrics_destroy(receivers[i].metrics);
+    pthread_mutex_destroy(&receivers[i].lock);
   }
-  c_avl_destroy(metrics_tree);
+  sfree(receivers);
+  receivers_num = 0;
+
+  statsd_metrics_destroy(metrics_tree);
   metrics_tree = NULL;
 
   sfree(conf_node);
   sfree(conf_service);
+  sfree(conf_tcp_service);
+  sfree(conf_socket_file);
 
   pthread_mutex_unlock(&metrics_lock);
 
@@ -24,6 +24,9 @@
  *     Andrew Bays <abays at redhat.com>
  **/
 
+/* _GNU_SOURCE is needed in Linux to use recvmmsg */
+#define _GNU_SOURCE
+
 #include "collectd.h"
 
 #include "plugin.h"
@@ -86,10 +89,16 @@
 #define SYSEVENT_SYSLOG_TAG_FIELD "syslogTag"
 #define SYSEVENT_SYSLOG_TAG_VALUE "NILVALUE"
 
+/* Maximum number of datagrams read with one recvmmsg(2) call. */
+#define SYSEVENT_RECV_BATCH 64
+
 /*
  * Private data types
  */
 
+/* Single producer (socket thread), single consumer (dequeue thread) ring.
+ * "head" is only written by the producer and "tail" only by the consumer, so
+ * neither side needs a lock to access the buffer. */
 typedef struct {
   int head;
   int tail;
@@ -115,6 +124,7 @@ static pthread_cond_t sysevent_cond = PTHREAD_COND_INITIALIZER;
 static int sock = -1;
 static int event_id = 0;
 static circbuf_t ring;
+static c_complain_t ring_complaint = C_COMPLAIN_INIT_STATIC;
 
 static char *listen_ip;
 static char *listen_port;
@@ -401,83 +411,103 @@ err:
   return -1;
 }
 
-static int read_socket() {
-  int recv_flags = MSG_DONTWAIT;
+static void ring_signal(void) {
+  pthread_mutex_lock(&sysevent_data_lock);
+  pthread_cond_signal(&sysevent_cond);
+  pthread_mutex_unlock(&sysevent_data_lock);
+}
 
-  while (42) {
-    struct sockaddr_storage src_addr;
-    socklen_t src_addr_len = sizeof(src_addr);
+// Receive datagrams directly into the free entries of the ring buffer, so
+// that they don't need to be copied. Returns the number of datagrams read.
+static int receive_batch(int head, int num) {
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[SYSEVENT_RECV_BATCH];
+  struct iovec iovs[SYSEVENT_RECV_BATCH];
+
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < num; i++) {
+    // Leave room for the terminating null byte
+    iovs[i].iov_base = ring.buffer[(head + i) % ring.maxLen];
+    iovs[i].iov_len = listen_buffer_size - 1;
+    msgs[i].msg_hdr.msg_iov = iovs + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
 
-    char buffer[listen_buffer_size];
-    memset(buffer, '\0', listen_buffer_size);
+  // Block until there is at least one datagram, then take all datagrams
+  // that are already queued (up to "num")
+  int count = recvmmsg(sock, msgs, num, MSG_WAITFORONE, /* timeout = */ NULL);
+  if (count < 0)
+    return -1;
 
-    ssize_t count = recvfrom(sock, buffer, sizeof(buffer), recv_flags,
-                             (struct sockaddr *)&src_addr, &src_addr_len);
+  for (int i = 0; i < count; i++) {
+    if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+      WARNING("sysevent plugin: datagram too large for buffer: truncated");
 
-    if (count < 0) {
-      if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        pthread_mutex_lock(&sysevent_data_lock);
+    ring.buffer[(head + i) % ring.maxLen][msgs[i].msg_len] = '\0';
+  }
 
-        // There was nothing more to receive for now, so...
-        // If ring head does not equal ring tail, there is data
-        // in the ring buffer for the dequeue thread to read, so
-        // signal it
-        if (ring.head != ring.tail)
-          pthread_cond_signal(&sysevent_cond);
+  return count;
+#else
+  ssize_t len = recv(sock, ring.buffer[head], listen_buffer_size - 1,
+                     /* flags = */ 0);
+  if (len < 0)
+    return -1;
 
-        pthread_mutex_unlock(&sysevent_data_lock);
+  ring.buffer[head][len] = '\0';
+  return 1;
+#endif
+}
 
-        // Since there was nothing to receive, set recv to block and
-        // try again
-        recv_flags = 0;
-        continue;
-      } else if (errno != EINTR) {
-        ERROR("sysevent plugin: failed to receive data: %s", STRERRNO);
-        return -1;
-      } else {
-        // Interrupt, so continue and try again
-        continue;
-      }
-    }
+static int read_socket() {
+  while (42) {
+    int head = ring.head;
+    int tail = __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE);
 
-    if (count >= sizeof(buffer)) {
-      WARNING("sysevent plugin: datagram too large for buffer: truncated");
-    }
+    int num = tail - head - 1;
+    if (num < 0)
+      num += ring.maxLen;
 
-    // We successfully received a message, so don't block on the next
-    // read in case there are more (and if there aren't, it will be
-    // handled above in the EWOULDBLOCK error-checking)
-    recv_flags = MSG_DONTWAIT;
+    if (num == 0) {
+      // Buffer is full, signal the dequeue thread to process the buffer and
+      // clean it out, and then sleep. The datagrams remain queued in the
+      // socket meanwhile.
+      c_complain(LOG_WARNING, &ring_complaint,
+                 "sysevent plugin: ring buffer full");
 
-    // 1. Acquire data lock
-    // 2. Push to buffer if there is room, otherwise raise warning
-    //    and allow dequeue thread to take over
+      ring_signal();
+      usleep(1000);
+      continue;
+    }
 
-    pthread_mutex_lock(&sysevent_data_lock);
+    if (num > SYSEVENT_RECV_BATCH)
+      num = SYSEVENT_RECV_BATCH;
 
-    int next = ring.head + 1;
-    if (next >= ring.maxLen)
-      next = 0;
+    int count = receive_batch(head, num);
 
-    if (next == ring.tail) {
-      // Buffer is full, signal the dequeue thread to process the buffer
-      // and clean it out, and then sleep
-      WARNING("sysevent plugin: ring buffer full");
+    if (count < 0) {
+      if (errno == EINTR)
+        // Interrupt, so continue and try again
+        continue;
 
-      pthread_cond_signal(&sysevent_cond);
-      pthread_mutex_unlock(&sysevent_data_lock);
+      ERROR("sysevent plugin: failed to receive data: %s", STRERRNO);
+      return -1;
+    }
 
-      usleep(1000);
-      continue;
-    } else {
-      DEBUG("sysevent plugin: writing %s", buffer);
+    cdtime_t now = cdtime();
+
+    for (int i = 0; i < count; i++) {
+      int idx = (head + i) % ring.maxLen;
 
-      sstrncpy(ring.buffer[ring.head], buffer, sizeof(buffer));
-      ring.timestamp[ring.head] = cdtime();
-      ring.head = next;
+      DEBUG("sysevent plugin: writing %s", ring.buffer[idx]);
+      ring.timestamp[idx] = now;
     }
 
-    pthread_mutex_unlock(&sysevent_data_lock);
+    __atomic_store_n(&ring.head, (head + count) % ring.maxLen,
+                     __ATOMIC_RELEASE);
+
+    // The socket has been drained (or the batch is full), so let the
+    // dequeue thread dispatch what has been received
+    ring_signal();
   }
 }
 
@@ -609,19 +639,28 @@ static void sysevent_dispatch_notification(const char *message,
 }
 
 static void read_ring_buffer() {
-  pthread_mutex_lock(&sysevent_data_lock);
-
   // If there's currently nothing to read from the buffer,
   // then wait
-  if (ring.head == ring.tail)
+  pthread_mutex_lock(&sysevent_data_lock);
+  if (__atomic_load_n(&ring.head, __ATOMIC_ACQUIRE) == ring.tail)
     pthread_cond_wait(&sysevent_cond, &sysevent_data_lock);
+  pthread_mutex_unlock(&sysevent_data_lock);
 
-  while (ring.head != ring.tail) {
+  // Parsing and filtering the messages is only worth it if someone receives
+  // the notifications
+  bool dispatch = plugin_notification_has_consumers();
+
+  while (__atomic_load_n(&ring.head, __ATOMIC_ACQUIRE) != ring.tail) {
     int next = ring.tail + 1;
 
     if (next >= ring.maxLen)
       next = 0;
 
+    if (!dispatch) {
+      __atomic_store_n(&ring.tail, next, __ATOMIC_RELEASE);
+      continue;
+    }
+
     DEBUG("sysevent plugin: reading from ring buffer: %s",
           ring.buffer[ring.tail]);
 
@@ -678,20 +717,21 @@ static void read_ring_buffer() {
     }
 
 #if HAVE_YAJL_V2
-    if (is_match == 1 && node != NULL) {
+    if (is_match == 1 && node != NULL)
       sysevent_dispatch_notification(NULL, &node, timestamp);
-      yajl_tree_free(node);
-    } else if (is_match == 1)
+    else if (is_match == 1)
       sysevent_dispatch_notification(ring.buffer[ring.tail], NULL, timestamp);
+
+    if (node != NULL)
+      yajl_tree_free(node);
 #else
     if (is_match == 1)
       sysevent_dispatch_notification(ring.buffer[ring.tail], timestamp);
 #endif
 
-    ring.tail = next;
+    // The entry may only be reused once it has been dispatched
+    __atomic_store_n(&ring.tail, next, __ATOMIC_RELEASE);
   }
-
-  pthread_mutex_unlock(&sysevent_data_lock);
 }
 
 static void *sysevent_socket_thread(void *arg) /* {{{ */
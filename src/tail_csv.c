@@ -25,6 +25,7 @@
 
 #include "plugin.h"              /* plugin_register_*, plugin_dispatch_values */
 #include "utils/common/common.h" /* auxiliary functions */
+#include "utils/strconv/strconv.h"
 #include "utils/tail/tail.h"
 
 #include <fcntl.h>
@@ -43,15 +44,26 @@ struct metric_definition_s {
 };
 typedef struct metric_definition_s metric_definition_t;
 
+/* A field of a line, which is not null terminated. */
+typedef struct {
+  char const *ptr;
+  size_t len;
+} tcsv_field_t;
+
 struct instance_definition_s {
   char *plugin_name;
   char *instance;
   char *path;
   char field_separator;
+  bool memory_map;
   cu_tail_t *tail;
   metric_definition_t **metric_list;
   size_t metric_list_len;
   ssize_t time_from;
+  /* Lines are only split up to the last field used by "metric_list" and
+   * "time_from". */
+  tcsv_field_t *fields;
+  size_t fields_max;
   struct instance_definition_s *next;
 };
 typedef struct instance_definition_s instance_definition_t;
@@ -86,17 +98,30 @@ static cdtime_t parse_time(char const *tbuf) {
   char *endptr = NULL;
 
   errno = 0;
-  t = strtod(tbuf, &endptr);
+  t = strtod_fast(tbuf, &endptr);
   if ((errno != 0) || (endptr == NULL) || (endptr[0] != 0))
     return cdtime();
 
   return DOUBLE_TO_CDTIME_T(t);
 }
 
+/* Copies "f" to "buffer" as a null terminated string. Returns false if it
+ * doesn't fit. */
+static bool tcsv_field_copy(tcsv_field_t const *f, char *buffer,
+                            size_t buffer_size) {
+  if (f->len >= buffer_size)
+    return false;
+
+  memcpy(buffer, f->ptr, f->len);
+  buffer[f->len] = 0;
+  return true;
+}
+
 static int tcsv_read_metric(instance_definition_t *id, metric_definition_t *md,
-                            char **fields, size_t fields_num) {
+                            tcsv_field_t const *fields, size_t fields_num,
+                            cdtime_t t) {
+  char buffer[DATA_MAX_NAME_LEN];
   value_t v;
-  cdtime_t t = 0;
   int status;
 
   if (md->data_source_type == -1)
@@ -106,16 +131,13 @@ static int tcsv_read_metric(instance_definition_t *id, metric_definition_t *md,
   if (((size_t)md->value_from) >= fields_num)
     return EINVAL;
 
-  status = parse_value(fields[md->value_from], &v, md->data_source_type);
+  if (!tcsv_field_copy(&fields[md->value_from], buffer, sizeof(buffer)))
+    return EINVAL;
+
+  status = parse_value(buffer, &v, md->data_source_type);
   if (status != 0)
     return status;
 
-  if (id->time_from >= 0) {
-    if (((size_t)id->time_from) >= fields_num)
-      return EINVAL;
-    t = parse_time(fields[id->time_from]);
-  }
-
   return tcsv_submit(id, md, v, t);
 }
 
@@ -132,76 +154,66 @@ static bool tcsv_check_index(ssize_t index, size_t fields_num,
   return false;
 }
 
-static int tcsv_read_buffer(instance_definition_t *id, char *buffer,
-                            size_t buffer_size) {
-  char **metrics;
-  size_t metrics_num;
-
-  char *ptr;
-  size_t i;
+static int tcsv_read_line(void *data, char const *line, size_t len) {
+  instance_definition_t *id = data;
 
   /* Remove newlines at the end of line. */
-  while (buffer_size > 0) {
-    if ((buffer[buffer_size - 1] == '\n') ||
-        (buffer[buffer_size - 1] == '\r')) {
-      buffer[buffer_size - 1] = '\0';
-      buffer_size--;
-    } else {
-      break;
-    }
-  }
+  while ((len > 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r')))
+    len--;
 
   /* Ignore empty lines. */
-  if ((buffer_size == 0) || (buffer[0] == '#'))
+  if ((len == 0) || (line[0] == '#'))
     return 0;
 
-  /* Count the number of fields. */
-  metrics_num = 1;
-  for (i = 0; i < buffer_size; i++) {
-    if (buffer[i] == id->field_separator)
-      metrics_num++;
+  /* Split the line in a single pass, stopping at the last field that is
+   * used. memchr(3) scans many bytes at a time. */
+  char const *end = line + len;
+  char const *ptr = line;
+  size_t fields_num = 0;
+  bool have_separator = false;
+  while (fields_num < id->fields_max) {
+    char const *sep = memchr(ptr, id->field_separator, (size_t)(end - ptr));
+
+    id->fields[fields_num] = (tcsv_field_t){
+        .ptr = ptr,
+        .len = (sep != NULL) ? (size_t)(sep - ptr) : (size_t)(end - ptr),
+    };
+    fields_num++;
+
+    if (sep == NULL)
+      break;
+    have_separator = true;
+    ptr = sep + 1;
   }
 
-  if (metrics_num == 1) {
+  if (!have_separator) {
     ERROR("tail_csv plugin: last line of `%s' does not contain "
           "enough values.",
           id->path);
-    return -1;
-  }
-
-  /* Create a list of all values */
-  metrics = calloc(metrics_num, sizeof(*metrics));
-  if (metrics == NULL) {
-    ERROR("tail_csv plugin: calloc failed.");
-    return ENOMEM;
+    return 0;
   }
 
-  ptr = buffer;
-  metrics[0] = ptr;
-  i = 1;
-  for (ptr = buffer; *ptr != 0; ptr++) {
-    if (*ptr != id->field_separator)
-      continue;
-
-    *ptr = 0;
-    metrics[i] = ptr + 1;
-    i++;
+  cdtime_t t = 0;
+  if ((id->time_from >= 0) && (((size_t)id->time_from) < fields_num)) {
+    char buffer[DATA_MAX_NAME_LEN];
+    t = tcsv_field_copy(&id->fields[id->time_from], buffer, sizeof(buffer))
+            ? parse_time(buffer)
+            : cdtime();
   }
-  assert(i == metrics_num);
 
   /* Register values */
-  for (i = 0; i < id->metric_list_len; ++i) {
+  for (size_t i = 0; i < id->metric_list_len; ++i) {
     metric_definition_t *md = id->metric_list[i];
 
-    if (!tcsv_check_index(md->value_from, metrics_num, md->name) ||
-        !tcsv_check_index(id->time_from, metrics_num, md->name))
+    if (!tcsv_check_index(md->value_from, fields_num, md->name) ||
+        !tcsv_check_index(id->time_from, fields_num, md->name))
       continue;
 
-    tcsv_read_metric(id, md, metrics, metrics_num);
+    tcsv_read_metric(id, md, id->fields, fields_num, t);
   }
 
-  /* Free up resources */
-  sfree(metrics);
+  /* Errors are reported above; returning non-zero would only make
+   * cu_tail_read_lines() report them again. */
   return 0;
 }
 
@@ -217,24 +229,13 @@ static int tcsv_read(user_data_t *ud) {
     }
   }
 
-  while (42) {
-    char buffer[1024];
-    size_t buffer_len;
-    int status;
-
-    status = cu_tail_readline(id->tail, buffer, (int)sizeof(buffer), 0);
-    if (status != 0) {
-      ERROR("tail_csv plugin: File \"%s\": cu_tail_readline failed "
-            "with status %i.",
-            id->path, status);
-      return -1;
-    }
-
-    buffer_len = strlen(buffer);
-    if (buffer_len == 0)
-      break;
-
-    tcsv_read_buffer(id, buffer, buffer_len);
+  int status = cu_tail_read_lines(id->tail, tcsv_read_line, id,
+                                  /* force_rewind = */ false, id->memory_map);
+  if (status != 0) {
+    ERROR("tail_csv plugin: File \"%s\": cu_tail_read_lines failed "
+          "with status %i.",
+          id->path, status);
+    return -1;
   }
 
   return 0;
@@ -385,6 +386,7 @@ static void tcsv_instance_definition_destroy(void *arg) {
   sfree(id->instance);
   sfree(id->path);
   sfree(id->metric_list);
+  sfree(id->fields);
   sfree(id);
 }
 
@@ -475,6 +477,8 @@ static int tcsv_config_add_file(oconfig_item_t *ci) {
       status = cf_util_get_string(option, &id->plugin_name);
     else if (strcasecmp("FieldSeparator", option->key) == 0)
       status = tcsv_config_get_separator(option, &id->field_separator);
+    else if (strcasecmp("MemoryMap", option->key) == 0)
+      status = cf_util_get_boolean(option, &id->memory_map);
     else {
       WARNING("tail_csv plugin: Option `%s' not allowed here.", option->key);
       status = -1;
@@ -503,6 +507,24 @@ static int tcsv_config_add_file(oconfig_item_t *ci) {
     return -1;
   }
 
+  id->fields_max = (size_t)(id->time_from + 1);
+  for (size_t i = 0; i < id->metric_list_len; i++) {
+    size_t max = (size_t)(id->metric_list[i]->value_from + 1);
+    if (id->fields_max < max)
+      id->fields_max = max;
+  }
+  /* At least two fields are looked at, so that lines without any separator
+   * are recognized. */
+  if (id->fields_max < 2)
+    id->fields_max = 2;
+
+  id->fields = calloc(id->fields_max, sizeof(*id->fields));
+  if (id->fields == NULL) {
+    ERROR("tail_csv plugin: calloc failed.");
+    tcsv_instance_definition_destroy(id);
+    return -1;
+  }
+
   snprintf(cb_name, sizeof(cb_name), "tail_csv/%s", id->path);
 
   status = plugin_register_complex_read(
@@ -27,11 +27,16 @@
 #include "collectd.h"
 
 #include "filter_chain.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils_subst.h"
 
 #include <regex.h>
 
+/* Maximum number of cached results per field. When a cache is full, it is
+ * cleared, so that series which have disappeared don't use memory forever. */
+#define TR_CACHE_SIZE 4096
+
 struct tr_action_s;
 typedef struct tr_action_s tr_action_t;
 struct tr_action_s {
@@ -59,6 +64,15 @@ struct tr_data_s {
   /* tr_action_t *type; */
   tr_action_t *type_instance;
   tr_meta_data_action_t *meta;
+
+  /* The result of the actions only depends on the field's value, i.e. it is
+   * the same for every value list of a series. The caches map the original
+   * value of a field to the replaced one. */
+  pthread_mutex_t cache_lock;
+  c_avl_tree_t *host_cache;
+  c_avl_tree_t *plugin_cache;
+  c_avl_tree_t *plugin_instance_cache;
+  c_avl_tree_t *type_instance_cache;
 };
 typedef struct tr_data_s tr_data_t;
 
@@ -423,6 +437,77 @@ static int tr_meta_data_action_invoke(/* {{{ */
   return 0;
 } /* }}} int tr_meta_data_action_invoke */
 
+static void tr_cache_clear(c_avl_tree_t *cache) /* {{{ */
+{
+  void *key;
+  void *value;
+
+  if (cache == NULL)
+    return;
+
+  while (c_avl_pick(cache, &key, &value) == 0) {
+    sfree(key);
+    sfree(value);
+  }
+} /* }}} void tr_cache_clear */
+
+static void tr_cache_destroy(c_avl_tree_t *cache) /* {{{ */
+{
+  if (cache == NULL)
+    return;
+
+  tr_cache_clear(cache);
+  c_avl_destroy(cache);
+} /* }}} void tr_cache_destroy */
+
+static void tr_cache_insert(tr_data_t *data, c_avl_tree_t **cache, /* {{{ */
+                            const char *key, const char *value) {
+  pthread_mutex_lock(&data->cache_lock);
+
+  if (*cache == NULL) {
+    *cache = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (*cache == NULL) {
+      pthread_mutex_unlock(&data->cache_lock);
+      return;
+    }
+  } else if (c_avl_size(*cache) >= TR_CACHE_SIZE) {
+    tr_cache_clear(*cache);
+  }
+
+  char *key_copy = strdup(key);
+  char *value_copy = strdup(value);
+  if ((key_copy == NULL) || (value_copy == NULL) ||
+      (c_avl_insert(*cache, key_copy, value_copy) != 0)) {
+    /* Out of memory, or another thread has inserted the key already. */
+    sfree(key_copy);
+    sfree(value_copy);
+  }
+
+  pthread_mutex_unlock(&data->cache_lock);
+} /* }}} void tr_cache_insert */
+
+/* Replaces the content of "buffer" using the actions "act_head", looking up
+ * and storing the result in "cache". */
+static void tr_field_invoke(tr_data_t *data, /* {{{ */
+                            tr_action_t *act_head, c_avl_tree_t **cache,
+                            char *buffer, size_t buffer_size,
+                            bool may_be_empty) {
+  char orig[DATA_MAX_NAME_LEN];
+  char *result = NULL;
+
+  pthread_mutex_lock(&data->cache_lock);
+  if ((*cache != NULL) && (c_avl_get(*cache, buffer, (void *)&result) == 0)) {
+    sstrncpy(buffer, result, buffer_size);
+    pthread_mutex_unlock(&data->cache_lock);
+    return;
+  }
+  pthread_mutex_unlock(&data->cache_lock);
+
+  sstrncpy(orig, buffer, sizeof(orig));
+  tr_action_invoke(act_head, buffer, buffer_size, may_be_empty);
+  tr_cache_insert(data, cache, orig, buffer);
+} /* }}} void tr_field_invoke */
+
 static int tr_destroy(void **user_data) /* {{{ */
 {
   tr_data_t *data;
@@ -440,6 +525,11 @@ static int tr_destroy(void **user_data) /* {{{ */
   /* tr_action_destroy (data->type); */
   tr_action_destroy(data->type_instance);
   tr_meta_data_action_destroy(data->meta);
+  tr_cache_destroy(data->host_cache);
+  tr_cache_destroy(data->plugin_cache);
+  tr_cache_destroy(data->plugin_instance_cache);
+  tr_cache_destroy(data->type_instance_cache);
+  pthread_mutex_destroy(&data->cache_lock);
   sfree(data);
 
   return 0;
@@ -462,6 +552,7 @@ static int tr_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
   /* data->type = NULL; */
   data->type_instance = NULL;
   data->meta = NULL;
+  pthread_mutex_init(&data->cache_lock, /* attr = */ NULL);
 
   status = 0;
   for (int i = 0; i < ci->children_num; i++) {
@@ -545,7 +636,7 @@ static int tr_invoke(const data_set_t *ds, value_list_t *vl, /* {{{ */
 
 #define HANDLE_FIELD(f, e)                                                     \
   if (data->f != NULL)                                                         \
-  tr_action_invoke(data->f, vl->f, sizeof(vl->f), e)
+  tr_field_invoke(data, data->f, &data->f##_cache, vl->f, sizeof(vl->f), e)
   HANDLE_FIELD(host, false);
   HANDLE_FIELD(plugin, false);
   HANDLE_FIELD(plugin_instance, true);
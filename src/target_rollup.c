@@ -0,0 +1,531 @@
+/**
+ * collectd - src/target_rollup.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "filter_chain.h"
+#include "utils/avltree/avltree.h"
+#include "utils/common/common.h"
+
+/*
+ * The "rollup" target keeps one window per series and writes a downsampled
+ * value list to the configured write plugins whenever a window is complete.
+ * Gauges are consolidated with the configured functions; counters and derives
+ * are cumulative, so the last value of a window is written; absolute values
+ * are summed up.
+ */
+
+#define TR_CF_MIN 0x01
+#define TR_CF_AVERAGE 0x02
+#define TR_CF_MAX 0x04
+
+static const struct {
+  const char *name;
+  unsigned int flag;
+} tr_cf_names[] = {
+    {"min", TR_CF_MIN},
+    {"average", TR_CF_AVERAGE},
+    {"max", TR_CF_MAX},
+};
+
+struct tr_window_s {
+  const data_set_t *ds;
+  value_list_t vl; /* identifier only; values and meta are not used */
+
+  cdtime_t start;
+  cdtime_t end;
+
+  gauge_t *min;
+  gauge_t *max;
+  gauge_t *sum;
+  size_t *count;
+  value_t *last;
+
+  /* Next complete window to write, see tr_invoke(). */
+  struct tr_window_s *next;
+};
+typedef struct tr_window_s tr_window_t;
+
+struct tr_data_s {
+  cdtime_t interval;
+  unsigned int cf;
+
+  char **plugins;
+  size_t plugins_num;
+
+  pthread_mutex_t lock;
+  c_avl_tree_t *windows;
+  cdtime_t next_gc;
+};
+typedef struct tr_data_s tr_data_t;
+
+static void tr_window_free(tr_window_t *w) /* {{{ */
+{
+  if (w == NULL)
+    return;
+
+  sfree(w->min);
+  sfree(w->max);
+  sfree(w->sum);
+  sfree(w->count);
+  sfree(w->last);
+  sfree(w);
+} /* }}} void tr_window_free */
+
+static void tr_window_reset(tr_window_t *w, cdtime_t start, /* {{{ */
+                            cdtime_t interval) {
+  w->start = start;
+  w->end = start + interval;
+
+  for (size_t i = 0; i < w->ds->ds_num; i++) {
+    w->min[i] = NAN;
+    w->max[i] = NAN;
+    w->sum[i] = 0.0;
+    w->count[i] = 0;
+    if (w->ds->ds[i].type == DS_TYPE_ABSOLUTE)
+      w->last[i].absolute = 0;
+  }
+} /* }}} void tr_window_reset */
+
+static tr_window_t *tr_window_create(const data_set_t *ds, /* {{{ */
+                                     const value_list_t *vl) {
+  tr_window_t *w = calloc(1, sizeof(*w));
+  if (w == NULL)
+    return NULL;
+
+  w->ds = ds;
+  w->vl = *vl;
+  w->vl.values = NULL;
+  w->vl.values_len = 0;
+  w->vl.meta = NULL;
+
+  w->min = calloc(ds->ds_num, sizeof(*w->min));
+  w->max = calloc(ds->ds_num, sizeof(*w->max));
+  w->sum = calloc(ds->ds_num, sizeof(*w->sum));
+  w->count = calloc(ds->ds_num, sizeof(*w->count));
+  w->last = calloc(ds->ds_num, sizeof(*w->last));
+  if ((w->min == NULL) || (w->max == NULL) || (w->sum == NULL) ||
+      (w->count == NULL) || (w->last == NULL)) {
+    tr_window_free(w);
+    return NULL;
+  }
+
+  return w;
+} /* }}} tr_window_t *tr_window_create */
+
+static void tr_write(tr_data_t *data, tr_window_t *w, /* {{{ */
+                     value_t *values, const char *cf_name) {
+  value_list_t vl = w->vl;
+
+  vl.values = values;
+  vl.values_len = w->ds->ds_num;
+  vl.time = w->end;
+  vl.interval = data->interval;
+
+  if (cf_name != NULL) {
+    if (w->vl.type_instance[0] == 0)
+      sstrncpy(vl.type_instance, cf_name, sizeof(vl.type_instance));
+    else
+      strjoin(vl.type_instance, sizeof(vl.type_instance),
+              (char *[]){w->vl.type_instance, (char *)cf_name}, 2, "-");
+  }
+
+  if (data->plugins_num == 0) {
+    plugin_write(/* plugin = */ NULL, w->ds, &vl);
+    return;
+  }
+
+  for (size_t i = 0; i < data->plugins_num; i++) {
+    int status = plugin_write(data->plugins[i], w->ds, &vl);
+    if (status != 0)
+      DEBUG("Target `rollup': plugin_write (%s) failed with status %i.",
+            data->plugins[i], status);
+  }
+} /* }}} void tr_write */
+
+/* Writes the consolidated values of a window, if it has seen any. */
+static void tr_window_flush(tr_data_t *data, tr_window_t *w) /* {{{ */
+{
+  size_t ds_num = w->ds->ds_num;
+  bool have_gauge = false;
+  bool have_values = false;
+
+  for (size_t i = 0; i < ds_num; i++) {
+    if (w->count[i] == 0)
+      continue;
+    have_values = true;
+    if (w->ds->ds[i].type == DS_TYPE_GAUGE)
+      have_gauge = true;
+  }
+  if (!have_values)
+    return;
+
+  value_t values[ds_num];
+  memcpy(values, w->last, sizeof(values));
+
+  /* Without gauges there is nothing to consolidate; the identifier is kept
+   * as is. */
+  if (!have_gauge) {
+    tr_write(data, w, values, /* cf_name = */ NULL);
+    return;
+  }
+
+  for (size_t j = 0; j < STATIC_ARRAY_SIZE(tr_cf_names); j++) {
+    if ((data->cf & tr_cf_names[j].flag) == 0)
+      continue;
+
+    for (size_t i = 0; i < ds_num; i++) {
+      if (w->ds->ds[i].type != DS_TYPE_GAUGE)
+        continue;
+
+      if (w->count[i] == 0)
+        values[i].gauge = NAN;
+      else if (tr_cf_names[j].flag == TR_CF_MIN)
+        values[i].gauge = w->min[i];
+      else if (tr_cf_names[j].flag == TR_CF_MAX)
+        values[i].gauge = w->max[i];
+      else
+        values[i].gauge = w->sum[i] / (gauge_t)w->count[i];
+    }
+
+    tr_write(data, w, values, tr_cf_names[j].name);
+  }
+} /* }}} void tr_window_flush */
+
+/* Moves the values of "w" into a new window, which is returned, and resets
+ * "w" to start a new window at "start". The returned window can be written
+ * without holding "data->lock". */
+static tr_window_t *tr_window_detach(tr_window_t *w, cdtime_t start, /* {{{ */
+                                     cdtime_t interval) {
+  tr_window_t *old = tr_window_create(w->ds, &w->vl);
+  if (old == NULL)
+    return NULL;
+
+  tr_window_t tmp = *old;
+  *old = *w;
+  *w = tmp;
+
+  tr_window_reset(w, start, interval);
+  return old;
+} /* }}} tr_window_t *tr_window_detach */
+
+/* Writes and frees a list of complete windows. */
+static void tr_window_flush_list(tr_data_t *data, tr_window_t *w) /* {{{ */
+{
+  while (w != NULL) {
+    tr_window_t *next = w->next;
+    tr_window_flush(data, w);
+    tr_window_free(w);
+    w = next;
+  }
+} /* }}} void tr_window_flush_list */
+
+static void tr_window_add(tr_window_t *w, const value_list_t *vl) /* {{{ */
+{
+  for (size_t i = 0; i < w->ds->ds_num; i++) {
+    switch (w->ds->ds[i].type) {
+    case DS_TYPE_GAUGE: {
+      gauge_t v = vl->values[i].gauge;
+      if (isnan(v))
+        continue;
+      if (isnan(w->min[i]) || (v < w->min[i]))
+        w->min[i] = v;
+      if (isnan(w->max[i]) || (v > w->max[i]))
+        w->max[i] = v;
+      w->sum[i] += v;
+      w->last[i].gauge = v;
+      break;
+    }
+    case DS_TYPE_ABSOLUTE:
+      w->last[i].absolute += vl->values[i].absolute;
+      break;
+    default: /* DS_TYPE_COUNTER, DS_TYPE_DERIVE */
+      w->last[i] = vl->values[i];
+      break;
+    }
+    w->count[i]++;
+  }
+} /* }}} void tr_window_add */
+
+/* Removes windows of series which have not been updated for a full interval,
+ * so that series which disappear don't use memory forever, and prepends them
+ * to "pending", so that their last window is not lost. Must be called with
+ * "data->lock" held. */
+static void tr_gc(tr_data_t *data, cdtime_t now, /* {{{ */
+                  tr_window_t **pending) {
+  c_avl_iterator_t *iter;
+  char *key;
+  tr_window_t *w;
+  char **expired = NULL;
+  size_t expired_num = 0;
+
+  if (now < data->next_gc)
+    return;
+  data->next_gc = now + data->interval;
+
+  iter = c_avl_get_iterator(data->windows);
+  if (iter == NULL)
+    return;
+
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&w) == 0) {
+    if ((w->end + data->interval) > now)
+      continue;
+
+    char **tmp = realloc(expired, (expired_num + 1) * sizeof(*expired));
+    if (tmp == NULL)
+      break;
+    expired = tmp;
+    expired[expired_num++] = key;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < expired_num; i++) {
+    if (c_avl_remove(data->windows, expired[i], (void *)&key, (void *)&w) != 0)
+      continue;
+
+    sfree(key);
+    w->next = *pending;
+    *pending = w;
+  }
+  sfree(expired);
+} /* }}} void tr_gc */
+
+static int tr_config_add_cf(tr_data_t *data, oconfig_item_t *ci) /* {{{ */
+{
+  if (ci->values_num < 1) {
+    ERROR("Target `rollup': The `%s' option needs at least one argument.",
+          ci->key);
+    return -1;
+  }
+
+  data->cf = 0;
+  for (int i = 0; i < ci->values_num; i++) {
+    size_t j;
+
+    if (ci->values[i].type != OCONFIG_TYPE_STRING) {
+      ERROR("Target `rollup': The `%s' option accepts only string arguments.",
+            ci->key);
+      return -1;
+    }
+
+    for (j = 0; j < STATIC_ARRAY_SIZE(tr_cf_names); j++)
+      if (strcasecmp(tr_cf_names[j].name, ci->values[i].value.string) == 0)
+        break;
+
+    if (j >= STATIC_ARRAY_SIZE(tr_cf_names)) {
+      ERROR("Target `rollup': Unknown consolidation function `%s'. Valid "
+            "functions are `min', `average' and `max'.",
+            ci->values[i].value.string);
+      return -1;
+    }
+
+    data->cf |= tr_cf_names[j].flag;
+  }
+
+  return 0;
+} /* }}} int tr_config_add_cf */
+
+static int tr_config_add_plugin(tr_data_t *data, /* {{{ */
+                                oconfig_item_t *ci) {
+  char *plugin = NULL;
+
+  int status = cf_util_get_string(ci, &plugin);
+  if (status != 0)
+    return status;
+
+  char **tmp =
+      realloc(data->plugins, (data->plugins_num + 1) * sizeof(*data->plugins));
+  if (tmp == NULL) {
+    ERROR("Target `rollup': realloc failed.");
+    sfree(plugin);
+    return -1;
+  }
+  data->plugins = tmp;
+  data->plugins[data->plugins_num++] = plugin;
+
+  return 0;
+} /* }}} int tr_config_add_plugin */
+
+static int tr_destroy(void **user_data) /* {{{ */
+{
+  tr_data_t *data;
+  char *key;
+  tr_window_t *w;
+
+  if (user_data == NULL)
+    return -EINVAL;
+
+  data = *user_data;
+  if (data == NULL)
+    return 0;
+
+  /* Write the incomplete windows, so that values since the last window
+   * boundary are not lost on shutdown or reconfiguration. */
+  if (data->windows != NULL) {
+    while (c_avl_pick(data->windows, (void *)&key, (void *)&w) == 0) {
+      sfree(key);
+      tr_window_flush(data, w);
+      tr_window_free(w);
+    }
+    c_avl_destroy(data->windows);
+  }
+
+  for (size_t i = 0; i < data->plugins_num; i++)
+    sfree(data->plugins[i]);
+  sfree(data->plugins);
+
+  pthread_mutex_destroy(&data->lock);
+  sfree(data);
+  *user_data = NULL;
+
+  return 0;
+} /* }}} int tr_destroy */
+
+static int tr_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
+{
+  tr_data_t *data;
+  int status;
+
+  data = calloc(1, sizeof(*data));
+  if (data == NULL) {
+    ERROR("tr_create: calloc failed.");
+    return -ENOMEM;
+  }
+
+  data->cf = TR_CF_AVERAGE;
+  pthread_mutex_init(&data->lock, NULL);
+
+  data->windows = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (data->windows == NULL) {
+    ERROR("tr_create: c_avl_create failed.");
+    tr_destroy((void *)&data);
+    return -ENOMEM;
+  }
+
+  status = 0;
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("Interval", child->key) == 0)
+      status = cf_util_get_cdtime(child, &data->interval);
+    else if (strcasecmp("Consolidation", child->key) == 0)
+      status = tr_config_add_cf(data, child);
+    else if (strcasecmp("Plugin", child->key) == 0)
+      status = tr_config_add_plugin(data, child);
+    else {
+      ERROR("Target `rollup': The `%s' configuration option is not understood "
+            "and will be ignored.",
+            child->key);
+      status = 0;
+    }
+
+    if (status != 0)
+      break;
+  }
+
+  if ((status == 0) && (data->interval == 0)) {
+    ERROR("Target `rollup': The `Interval' option is required.");
+    status = -1;
+  }
+
+  if (status != 0) {
+    tr_destroy((void *)&data);
+    return status;
+  }
+
+  *user_data = data;
+  return 0;
+} /* }}} int tr_create */
+
+static int tr_invoke(const data_set_t *ds, value_list_t *vl, /* {{{ */
+                     notification_meta_t __attribute__((unused)) * *meta,
+                     void **user_data) {
+  tr_data_t *data;
+  char name[6 * DATA_MAX_NAME_LEN];
+  tr_window_t *w = NULL;
+  tr_window_t *pending = NULL;
+
+  if ((ds == NULL) || (vl == NULL) || (user_data == NULL))
+    return -EINVAL;
+
+  data = *user_data;
+  if (data == NULL) {
+    ERROR("Target `rollup': Invoke: `data' is NULL.");
+    return -EINVAL;
+  }
+
+  if ((vl->values_len != ds->ds_num) ||
+      (FORMAT_VL(name, sizeof(name), vl) != 0))
+    return FC_TARGET_CONTINUE;
+
+  cdtime_t start = vl->time - (vl->time % data->interval);
+
+  pthread_mutex_lock(&data->lock);
+
+  if (c_avl_get(data->windows, name, (void *)&w) != 0) {
+    char *key = strdup(name);
+    w = tr_window_create(ds, vl);
+    if ((key == NULL) || (w == NULL) ||
+        (c_avl_insert(data->windows, key, w) != 0)) {
+      pthread_mutex_unlock(&data->lock);
+      ERROR("Target `rollup': Adding a window for %s failed.", name);
+      sfree(key);
+      tr_window_free(w);
+      return FC_TARGET_CONTINUE;
+    }
+    tr_window_reset(w, start, data->interval);
+  } else if (start >= w->end) {
+    pending = tr_window_detach(w, start, data->interval);
+    if (pending == NULL) {
+      ERROR("Target `rollup': Detaching the window of %s failed.", name);
+      tr_window_reset(w, start, data->interval);
+    }
+  }
+
+  /* Values older than the current window are ignored. */
+  if (vl->time >= w->start)
+    tr_window_add(w, vl);
+
+  tr_gc(data, vl->time, &pending);
+
+  pthread_mutex_unlock(&data->lock);
+
+  /* Complete windows are written without holding the lock, so that slow
+   * write plugins don't block other series and may dispatch values back into
+   * the filter chain. */
+  tr_window_flush_list(data, pending);
+
+  return FC_TARGET_CONTINUE;
+} /* }}} int tr_invoke */
+
+void module_register(void) {
+  target_proc_t tproc = {0};
+
+  tproc.create = tr_create;
+  tproc.destroy = tr_destroy;
+  tproc.invoke = tr_invoke;
+  fc_register_target("rollup", tproc);
+} /* module_register */
@@ -57,6 +57,9 @@ struct ts_data_s {
   /* char *type; */
   char *type_instance;
   meta_data_t *meta;
+  /* True if none of the "MetaData" values contains a "%{...}" placeholder,
+   * in which case "meta" is merged into value lists as it is. */
+  bool meta_is_static;
   ts_key_list_t *meta_delete;
 };
 typedef struct ts_data_s ts_data_t;
@@ -314,6 +317,23 @@ static int ts_create(const oconfig_item_t *ci, void **user_data) /* {{{ */
     break;
   }
 
+  if ((status == 0) && (data->meta != NULL)) {
+    char **meta_toc = NULL;
+    int meta_entries = meta_data_toc(data->meta, &meta_toc);
+
+    data->meta_is_static = (meta_entries >= 0);
+    for (int i = 0; i < meta_entries; i++) {
+      char *string = NULL;
+      if ((meta_data_get_string(data->meta, meta_toc[i], &string) != 0) ||
+          (strchr(string, '%') != NULL) ||
+          (strlen(string) >= DATA_MAX_NAME_LEN * 2))
+        data->meta_is_static = false;
+      sfree(string);
+    }
+    if (meta_entries > 0)
+      strarray_free(meta_toc, (size_t)meta_entries);
+  }
+
   if (status != 0) {
     ts_destroy((void *)&data);
     return status;
@@ -341,7 +361,7 @@ static int ts_invoke(const data_set_t *ds, value_list_t *vl, /* {{{ */
 
   orig = *vl;
 
-  if (data->meta != NULL) {
+  if ((data->meta != NULL) && !data->meta_is_static) {
     char temp[DATA_MAX_NAME_LEN * 2];
     char **meta_toc;
 
@@ -404,7 +424,9 @@ static int ts_invoke(const data_set_t *ds, value_list_t *vl, /* {{{ */
   SUBST_FIELD(type_instance);
 
   /* Need to merge the metadata in now, because of the shallow copy. */
-  if (new_meta != NULL) {
+  if ((data->meta != NULL) && data->meta_is_static) {
+    meta_data_clone_merge(&(vl->meta), data->meta);
+  } else if (new_meta != NULL) {
     meta_data_clone_merge(&(vl->meta), new_meta);
     meta_data_destroy(new_meta);
   }
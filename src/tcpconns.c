@@ -264,6 +264,10 @@ static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 static int port_collect_listening;
 static int port_collect_total;
 static port_entry_t *port_list_head;
+/* Direct-indexed lookup table for the entries in port_list_head. Looking up a
+ * port is done for every socket, so this must not depend on the number of
+ * configured ports. */
+static port_entry_t *port_table[UINT16_MAX + 1];
 static uint32_t count_total[TCP_STATE_MAX + 1];
 
 #if KERNEL_LINUX
@@ -272,6 +276,12 @@ static uint32_t count_total[TCP_STATE_MAX + 1];
  * sequence_number is useless and we get a compilation warning.
  */
 static uint32_t sequence_number;
+
+/* Socket filter in inet_diag bytecode, passed to the kernel so that it only
+ * reports sockets using one of the configured ports. NULL if all sockets are
+ * needed. */
+static void *diag_filter;
+static size_t diag_filter_len;
 #endif
 
 static enum { SRC_DUNNO, SRC_NETLINK, SRC_PROC } linux_source = SRC_DUNNO;
@@ -346,12 +356,7 @@ static void conn_submit_all(void) {
 static port_entry_t *conn_get_port_entry(uint16_t port, int create) {
   port_entry_t *ret;
 
-  ret = port_list_head;
-  while (ret != NULL) {
-    if (ret->port == port)
-      break;
-    ret = ret->next;
-  }
+  ret = port_table[port];
 
   if ((ret == NULL) && (create != 0)) {
     ret = calloc(1, sizeof(*ret));
@@ -361,6 +366,7 @@ static port_entry_t *conn_get_port_entry(uint16_t port, int create) {
     ret->port = port;
     ret->next = port_list_head;
     port_list_head = ret;
+    port_table[port] = ret;
   }
 
   return ret;
@@ -390,6 +396,7 @@ static void conn_reset_port_entry(void) {
       else
         prev->next = next;
 
+      port_table[pe->port] = NULL;
       sfree(pe);
       pe = next;
 
@@ -444,6 +451,85 @@ static int conn_handle_ports(uint16_t port_local, uint16_t port_remote,
 } /* int conn_handle_ports */
 
 #if KERNEL_LINUX
+#if HAVE_STRUCT_LINUX_INET_DIAG_REQ
+/* The length of a netlink attribute is 16 bits wide. */
+#define DIAG_FILTER_MAX (UINT16_MAX - NLA_HDRLEN)
+
+/* conn_filter_add_port appends a condition matching sockets whose port equals
+ * "port" to the filter. "ge" and "le" select the local or the remote port. If
+ * the condition is false, both comparisons jump past the end of the condition
+ * and the following jump op, i.e. to the next condition. After the last
+ * condition this is beyond the end of the program, which rejects the socket.
+ * If the condition is true, the following jump op skips to the end of the
+ * program, which accepts the socket. Returns the new number of ops. */
+static size_t conn_filter_add_port(struct inet_diag_bc_op *ops, size_t n,
+                                   size_t ops_num, unsigned char ge,
+                                   unsigned char le, uint16_t port) {
+  size_t op_size = sizeof(*ops);
+
+  ops[n++] = (struct inet_diag_bc_op){
+      .code = ge, .yes = 2 * op_size, .no = 5 * op_size};
+  ops[n++] = (struct inet_diag_bc_op){.no = port};
+  ops[n++] = (struct inet_diag_bc_op){
+      .code = le, .yes = 2 * op_size, .no = 3 * op_size};
+  ops[n++] = (struct inet_diag_bc_op){.no = port};
+
+  if (n < ops_num) {
+    ops[n] = (struct inet_diag_bc_op){
+        .code = INET_DIAG_BC_JMP, .yes = op_size, .no = (ops_num - n) * op_size};
+    n++;
+  }
+
+  return n;
+} /* size_t conn_filter_add_port */
+
+/* conn_build_filter compiles the configured local and remote ports into an
+ * inet_diag bytecode program. Only call this if neither the listening ports
+ * nor the summary of all ports are collected. */
+static void conn_build_filter(void) {
+  size_t conditions_num = 0;
+
+  sfree(diag_filter);
+  diag_filter_len = 0;
+
+  for (port_entry_t *pe = port_list_head; pe != NULL; pe = pe->next) {
+    if (pe->flags & PORT_COLLECT_LOCAL)
+      conditions_num++;
+    if (pe->flags & PORT_COLLECT_REMOTE)
+      conditions_num++;
+  }
+  if (conditions_num == 0)
+    return;
+
+  /* Four ops per condition and one jump between two conditions. */
+  size_t ops_num = 5 * conditions_num - 1;
+  if (ops_num * sizeof(struct inet_diag_bc_op) > DIAG_FILTER_MAX) {
+    INFO("tcpconns plugin: Too many ports to filter sockets in the kernel.");
+    return;
+  }
+
+  struct inet_diag_bc_op *ops = calloc(ops_num, sizeof(*ops));
+  if (ops == NULL) {
+    ERROR("tcpconns plugin: calloc failed.");
+    return;
+  }
+
+  size_t n = 0;
+  for (port_entry_t *pe = port_list_head; pe != NULL; pe = pe->next) {
+    if (pe->flags & PORT_COLLECT_LOCAL)
+      n = conn_filter_add_port(ops, n, ops_num, INET_DIAG_BC_S_GE,
+                               INET_DIAG_BC_S_LE, pe->port);
+    if (pe->flags & PORT_COLLECT_REMOTE)
+      n = conn_filter_add_port(ops, n, ops_num, INET_DIAG_BC_D_GE,
+                               INET_DIAG_BC_D_LE, pe->port);
+  }
+  assert(n == ops_num);
+
+  diag_filter = ops;
+  diag_filter_len = ops_num * sizeof(*ops);
+} /* void conn_build_filter */
+#endif /* HAVE_STRUCT_LINUX_INET_DIAG_REQ */
+
 /* Returns zero on success, less than zero on socket error and greater than
  * zero on other errors. */
 static int conn_read_netlink(void) {
@@ -480,12 +566,24 @@ static int conn_read_netlink(void) {
       .r.idiag_states = 0xfff,
       .r.idiag_ext = 0};
 
-  struct iovec iov = {.iov_base = &req, .iov_len = sizeof(req)};
+  /* The filter is appended to the request as INET_DIAG_REQ_BYTECODE
+   * attribute. */
+  struct nlattr nla = {
+      .nla_len = NLA_HDRLEN + diag_filter_len,
+      .nla_type = INET_DIAG_REQ_BYTECODE,
+  };
+  struct iovec req_iov[] = {
+      {.iov_base = &req, .iov_len = sizeof(req)},
+      {.iov_base = &nla, .iov_len = NLA_HDRLEN},
+      {.iov_base = diag_filter, .iov_len = diag_filter_len},
+  };
+  if (diag_filter != NULL)
+    req.nlh.nlmsg_len += nla.nla_len;
 
   struct msghdr msg = {.msg_name = (void *)&nladdr,
                        .msg_namelen = sizeof(nladdr),
-                       .msg_iov = &iov,
-                       .msg_iovlen = 1};
+                       .msg_iov = req_iov,
+                       .msg_iovlen = (diag_filter != NULL) ? 3 : 1};
 
   if (sendmsg(fd, &msg, 0) < 0) {
     ERROR("tcpconns plugin: conn_read_netlink: sendmsg(2) failed: %s",
@@ -494,8 +592,7 @@ static int conn_read_netlink(void) {
     return -1;
   }
 
-  iov.iov_base = buf;
-  iov.iov_len = sizeof(buf);
+  struct iovec iov = {.iov_base = buf, .iov_len = sizeof(buf)};
 
   while (1) {
     struct nlmsghdr *h;
@@ -536,10 +633,21 @@ static int conn_read_netlink(void) {
         struct nlmsgerr *msg_error;
 
         msg_error = NLMSG_DATA(h);
+        close(fd);
+
+        /* Retry without the filter, in case this kernel does not support the
+         * bytecode. */
+        if (diag_filter != NULL) {
+          WARNING("tcpconns plugin: conn_read_netlink: The socket filter was "
+                  "rejected with error %i. Requesting all sockets instead.",
+                  msg_error->error);
+          sfree(diag_filter);
+          diag_filter_len = 0;
+          return conn_read_netlink();
+        }
+
         WARNING("tcpconns plugin: conn_read_netlink: Received error %i.",
                 msg_error->error);
-
-        close(fd);
         return 1;
       }
 
@@ -681,6 +789,12 @@ static int conn_init(void) {
   if (port_collect_total == 0 && port_list_head == NULL)
     port_collect_listening = 1;
 
+#if HAVE_STRUCT_LINUX_INET_DIAG_REQ
+  /* All sockets are needed to find listening ports and for the summary. */
+  if (port_collect_total == 0 && port_collect_listening == 0)
+    conn_build_filter();
+#endif
+
   return 0;
 } /* int conn_init */
 
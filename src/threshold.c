@@ -31,6 +31,14 @@
 #include "utils_cache.h"
 #include "utils_threshold.h"
 
+/* If set, the thresholds are checked once per interval against a snapshot of
+ * the value cache instead of on every written value list. See
+ * ut_check_snapshot(). */
+static bool ut_batch;
+/* Epoch of the last snapshot, so that only the value lists updated since are
+ * checked. */
+static uint64_t ut_snapshot_epoch;
+
 /*
  * Threshold management
  * ====================
@@ -91,6 +99,7 @@ static int ut_threshold_add(const threshold_t *th) { /* {{{ */
     /* name_copy isn't needed */
     sfree(name_copy);
   }
+  threshold_generation++;
 
   pthread_mutex_unlock(&threshold_lock);
 
@@ -270,56 +279,58 @@ static int ut_config_host(const threshold_t *th_orig, oconfig_item_t *ci) {
 /* }}} */
 
 /*
- * int ut_report_state
+ * bool ut_hits_reached
  *
- * Checks if the `state' differs from the old state and creates a notification
- * if appropriate.
- * Does not fail.
+ * Checks the hit counter of a value list whose thresholds have been checked.
+ * Returns true if the state is to be reported and the hit counter reset.
+ * Otherwise the hit counter is to be incremented and nothing is reported.
  */
-static int ut_report_state(const data_set_t *ds, const value_list_t *vl,
-                           const threshold_t *th, const gauge_t *values,
-                           int ds_index, int state) { /* {{{ */
-  int state_old;
-  notification_t n;
-
-  char *buf;
-  size_t bufsize;
-
-  int status;
-
-  /* Check if hits matched */
-  if ((th->hits != 0)) {
-    int hits = uc_get_hits(ds, vl);
-    /* STATE_OKAY resets hits unless PERSIST_OK flag is set. Hits resets if
-     * threshold is hit. */
-    if (((state == STATE_OKAY) && ((th->flags & UT_FLAG_PERSIST_OK) == 0)) ||
-        (hits > th->hits)) {
-      DEBUG("ut_report_state: reset uc_get_hits = 0");
-      uc_set_hits(ds, vl, 0); /* reset hit counter and notify */
-    } else {
-      DEBUG("ut_report_state: th->hits = %d, uc_get_hits = %d", th->hits,
-            uc_get_hits(ds, vl));
-      (void)uc_inc_hits(ds, vl, 1); /* increase hit counter */
-      return 0;
-    }
-  } /* end check hits */
-
-  state_old = uc_get_state(ds, vl);
+static bool ut_hits_reached(const threshold_t *th, int state,
+                            int hits) { /* {{{ */
+  /* STATE_OKAY resets hits unless PERSIST_OK flag is set. Hits resets if
+   * threshold is hit. */
+  return ((state == STATE_OKAY) && ((th->flags & UT_FLAG_PERSIST_OK) == 0)) ||
+         (hits > th->hits);
+} /* }}} bool ut_hits_reached */
 
+/*
+ * bool ut_state_reportable
+ *
+ * Returns true if a notification is to be created for a value list whose
+ * state has changed from `state_old' to `state'.
+ */
+static bool ut_state_reportable(const threshold_t *th, int state,
+                                int state_old) { /* {{{ */
   /* If the state didn't change, report if `persistent' is specified. If the
    * state is `okay', then only report if `persist_ok` flag is set. */
   if (state == state_old) {
     if (state == STATE_UNKNOWN) {
       /* From UNKNOWN to UNKNOWN. Persist doesn't apply here. */
-      return 0;
+      return false;
     } else if ((th->flags & UT_FLAG_PERSIST) == 0)
-      return 0;
+      return false;
     else if ((state == STATE_OKAY) && ((th->flags & UT_FLAG_PERSIST_OK) == 0))
-      return 0;
+      return false;
   }
 
-  if (state != state_old)
-    uc_set_state(ds, vl, state);
+  return true;
+} /* }}} bool ut_state_reportable */
+
+/*
+ * void ut_notify
+ *
+ * Creates and dispatches the notification for a value list whose state has
+ * changed from `state_old' to `state'.
+ */
+static void ut_notify(const data_set_t *ds, const value_list_t *vl,
+                      const threshold_t *th, const gauge_t *values,
+                      int ds_index, int state, int state_old) { /* {{{ */
+  notification_t n;
+
+  char *buf;
+  size_t bufsize;
+
+  int status;
 
   NOTIFICATION_INIT_VL(&n, vl);
 
@@ -374,7 +385,7 @@ static int ut_report_state(const data_set_t *ds, const value_list_t *vl,
   } else if (state == STATE_UNKNOWN) {
     ERROR("ut_report_state: metric transition to UNKNOWN from a different "
           "state. This shouldn't happen.");
-    return 0;
+    return;
   } else {
     double min;
     double max;
@@ -440,6 +451,39 @@ static int ut_report_state(const data_set_t *ds, const value_list_t *vl,
   plugin_dispatch_notification(&n);
 
   plugin_notification_meta_free(n.meta);
+} /* }}} void ut_notify */
+
+/*
+ * int ut_report_state
+ *
+ * Checks if the `state' differs from the old state and creates a notification
+ * if appropriate.
+ * Does not fail.
+ */
+static int ut_report_state(const data_set_t *ds, const value_list_t *vl,
+                           const threshold_t *th, const gauge_t *values,
+                           int ds_index, int state) { /* {{{ */
+  /* Check if hits matched */
+  if ((th->hits != 0)) {
+    int hits = uc_get_hits(ds, vl);
+    if (!ut_hits_reached(th, state, hits)) {
+      DEBUG("ut_report_state: th->hits = %d, uc_get_hits = %d", th->hits,
+            hits);
+      (void)uc_inc_hits(ds, vl, 1); /* increase hit counter */
+      return 0;
+    }
+    DEBUG("ut_report_state: reset uc_get_hits = 0");
+    uc_set_hits(ds, vl, 0); /* reset hit counter and notify */
+  } /* end check hits */
+
+  int state_old = uc_get_state(ds, vl);
+  if (!ut_state_reportable(th, state, state_old))
+    return 0;
+
+  if (state != state_old)
+    uc_set_state(ds, vl, state);
+
+  ut_notify(ds, vl, th, values, ds_index, state, state_old);
   return 0;
 } /* }}} int ut_report_state */
 
@@ -451,11 +495,15 @@ static int ut_report_state(const data_set_t *ds, const value_list_t *vl,
  * `okay' is returned. If the threshold does match, its failure and warning
  * min and max values are checked and `failure' or `warning' is returned if
  * appropriate.
+ * The previous state, which the hysteresis depends on, is looked up in the
+ * value cache unless `state_old' is given.
  * Does not fail.
  */
-static int ut_check_one_data_source(
-    const data_set_t *ds, const value_list_t __attribute__((unused)) * vl,
-    const threshold_t *th, const gauge_t *values, int ds_index) { /* {{{ */
+static int ut_check_one_data_source(const data_set_t *ds,
+                                    const value_list_t *vl,
+                                    const threshold_t *th,
+                                    const gauge_t *values, int ds_index,
+                                    const int *state_old) { /* {{{ */
   const char *ds_name;
   int is_warning = 0;
   int is_failure = 0;
@@ -476,7 +524,7 @@ static int ut_check_one_data_source(
   /* XXX: This is an experimental code, not optimized, not fast, not reliable,
    * and probably, do not work as you expect. Enjoy! :D */
   if (th->hysteresis > 0) {
-    prev_state = uc_get_state(ds, vl);
+    prev_state = (state_old != NULL) ? *state_old : uc_get_state(ds, vl);
     /* The purpose of hysteresis is elliminating flapping state when the value
      * oscilates around the thresholds. In other words, what is important is
      * the previous state; if the new value would trigger a transition, make
@@ -542,6 +590,7 @@ static int ut_check_one_data_source(
  */
 static int ut_check_one_threshold(const data_set_t *ds, const value_list_t *vl,
                                   const threshold_t *th, const gauge_t *values,
+                                  const int *state_old,
                                   int *ret_ds_index) { /* {{{ */
   int ret = -1;
   int ds_index = -1;
@@ -584,7 +633,7 @@ static int ut_check_one_threshold(const data_set_t *ds, const value_list_t *vl,
   for (size_t i = 0; i < ds->ds_num; i++) {
     int status;
 
-    status = ut_check_one_data_source(ds, vl, th, values_copy, i);
+    status = ut_check_one_data_source(ds, vl, th, values_copy, i, state_old);
     if (ret < status) {
       ret = status;
       ds_index = i;
@@ -610,7 +659,7 @@ static int ut_check_threshold(const data_set_t *ds, const value_list_t *vl,
                               __attribute__((unused))
                               user_data_t *ud) { /* {{{ */
   threshold_t *th;
-  gauge_t *values;
+  gauge_t values[ds->ds_num];
   int status;
 
   int worst_state = -1;
@@ -630,17 +679,16 @@ static int ut_check_threshold(const data_set_t *ds, const value_list_t *vl,
 
   DEBUG("ut_check_threshold: Found matching threshold(s)");
 
-  values = uc_get_rate(ds, vl);
-  if (values == NULL)
+  if (uc_get_rate_into(ds, vl, values, STATIC_ARRAY_SIZE(values)) != 0)
     return 0;
 
   while (th != NULL) {
     int ds_index = -1;
 
-    status = ut_check_one_threshold(ds, vl, th, values, &ds_index);
+    status = ut_check_one_threshold(ds, vl, th, values, /* state_old = */ NULL,
+                                    &ds_index);
     if (status < 0) {
       ERROR("ut_check_threshold: ut_check_one_threshold failed.");
-      sfree(values);
       return -1;
     }
 
@@ -657,15 +705,136 @@ static int ut_check_threshold(const data_set_t *ds, const value_list_t *vl,
       ut_report_state(ds, vl, worst_th, values, worst_ds_index, worst_state);
   if (status != 0) {
     ERROR("ut_check_threshold: ut_report_state failed.");
-    sfree(values);
     return -1;
   }
 
-  sfree(values);
-
   return 0;
 } /* }}} int ut_check_threshold */
 
+/*
+ * void ut_check_entry
+ *
+ * Like ut_check_threshold and ut_report_state, but for a value list from a
+ * snapshot of the value cache. The state and the hit counter are taken from
+ * and stored in `st' instead of the cache.
+ */
+static void ut_check_entry(const data_set_t *ds, const value_list_t *vl,
+                           const gauge_t *values,
+                           uc_threshold_state_t *st) { /* {{{ */
+  int worst_state = -1;
+  threshold_t *worst_th = NULL;
+  int worst_ds_index = -1;
+
+  for (threshold_t *th = st->threshold; th != NULL; th = th->next) {
+    int ds_index = -1;
+
+    int status = ut_check_one_threshold(ds, vl, th, values, &st->state,
+                                        &ds_index);
+    if (status < 0) {
+      ERROR("ut_check_entry: ut_check_one_threshold failed.");
+      return;
+    }
+
+    if (worst_state < status) {
+      worst_state = status;
+      worst_th = th;
+      worst_ds_index = ds_index;
+    }
+  }
+
+  if (worst_th->hits != 0) {
+    if (!ut_hits_reached(worst_th, worst_state, st->hits)) {
+      st->hits++;
+      return;
+    }
+    st->hits = 0;
+  }
+
+  int state_old = st->state;
+  if (!ut_state_reportable(worst_th, worst_state, state_old))
+    return;
+
+  st->state = worst_state;
+  ut_notify(ds, vl, worst_th, values, worst_ds_index, worst_state, state_old);
+} /* }}} void ut_check_entry */
+
+/*
+ * int ut_check_snapshot
+ *
+ * Checks the value lists updated since the last call against their
+ * thresholds, using a snapshot of the value cache. Unlike
+ * ut_check_threshold, this doesn't look up the cache for each value list:
+ * the states and hit counters that changed are stored in one batch at the
+ * end. Registered as a read callback if `BatchEvaluation' is enabled.
+ */
+static int ut_check_snapshot(__attribute__((unused))
+                             user_data_t *ud) { /* {{{ */
+  uc_snapshot_t *snap = uc_snapshot(ut_snapshot_epoch);
+  if (snap == NULL)
+    return -1;
+  ut_snapshot_epoch = uc_snapshot_epoch(snap);
+
+  pthread_mutex_lock(&threshold_lock);
+  uint64_t generation = threshold_generation;
+  pthread_mutex_unlock(&threshold_lock);
+
+  size_t entries_num = uc_snapshot_size(snap);
+  uc_threshold_state_t *states =
+      calloc((entries_num > 0) ? entries_num : 1, sizeof(*states));
+  if (states == NULL) {
+    ERROR("ut_check_snapshot: calloc failed.");
+    uc_snapshot_destroy(snap);
+    return -1;
+  }
+  size_t states_num = 0;
+
+  for (size_t i = 0; i < entries_num; i++) {
+    uc_snapshot_entry_t const *e = uc_snapshot_get(snap, i);
+    value_list_t vl = VALUE_LIST_INIT;
+
+    if (parse_identifier_vl(e->name, &vl) != 0)
+      continue;
+
+    uc_threshold_state_t st = {
+        .name = e->name,
+        .state = e->state,
+        .hits = e->hits,
+        .threshold = e->threshold,
+        .threshold_generation = e->threshold_generation,
+    };
+
+    if (st.threshold_generation != generation) {
+      pthread_mutex_lock(&threshold_lock);
+      st.threshold = threshold_search_uncached(&vl);
+      pthread_mutex_unlock(&threshold_lock);
+      st.threshold_generation = generation;
+    }
+
+    if (st.threshold != NULL) {
+      const data_set_t *ds = plugin_get_ds(vl.type);
+      if ((ds != NULL) && (ds->ds_num == e->values_num)) {
+        vl.values_len = e->values_num;
+        vl.time = e->time;
+        vl.interval = e->interval;
+        ut_check_entry(ds, &vl, e->rates, &st);
+      }
+    }
+
+    if ((st.state != e->state) || (st.hits != e->hits) ||
+        (st.threshold_generation != e->threshold_generation))
+      states[states_num++] = st;
+  }
+
+  int status = uc_set_threshold_states(states, states_num);
+  if (status != 0)
+    ERROR("ut_check_snapshot: uc_set_threshold_states failed: %s",
+          STRERROR(status));
+
+  sfree(states);
+  uc_snapshot_destroy(snap);
+  return 0;
+} /* }}} int ut_check_snapshot */
+
 /*
  * int ut_missing
  *
@@ -704,7 +873,6 @@ static int ut_missing(const value_list_t *vl,
 
 static int ut_config(oconfig_item_t *ci) { /* {{{ */
   int status = 0;
-  int old_size = c_avl_size(threshold_tree);
 
   if (threshold_tree == NULL) {
     threshold_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
@@ -731,6 +899,8 @@ static int ut_config(oconfig_item_t *ci) { /* {{{ */
       status = ut_config_plugin(&th, option);
     else if (strcasecmp("Host", option->key) == 0)
       status = ut_config_host(&th, option);
+    else if (strcasecmp("BatchEvaluation", option->key) == 0)
+      status = cf_util_get_boolean(option, &ut_batch);
     else {
       WARNING("threshold values: Option `%s' not allowed here.", option->key);
       status = -1;
@@ -740,17 +910,29 @@ static int ut_config(oconfig_item_t *ci) { /* {{{ */
       break;
   }
 
-  /* register callbacks if this is the first time we see a valid config */
-  if ((old_size == 0) && (c_avl_size(threshold_tree) > 0)) {
-    plugin_register_missing("threshold", ut_missing,
-                            /* user data = */ NULL);
+  return status;
+} /* }}} int um_config */
+
+/* The callbacks are registered once the configuration is complete, because
+ * "BatchEvaluation" decides which callback checks the thresholds. */
+static int ut_init(void) { /* {{{ */
+  if (c_avl_size(threshold_tree) == 0)
+    return 0;
+
+  plugin_register_missing("threshold", ut_missing,
+                          /* user data = */ NULL);
+  if (ut_batch)
+    plugin_register_complex_read(/* group = */ NULL, "threshold",
+                                 ut_check_snapshot, /* interval = */ 0,
+                                 /* user data = */ NULL);
+  else
     plugin_register_write("threshold", ut_check_threshold,
                           /* user data = */ NULL);
-  }
 
-  return status;
-} /* }}} int um_config */
+  return 0;
+} /* }}} int ut_init */
 
 void module_register(void) {
   plugin_register_complex_config("threshold", ut_config);
+  plugin_register_init("threshold", ut_init);
 }
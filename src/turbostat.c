@@ -243,6 +243,11 @@ static struct topology {
 
 static cdtime_t time_even, time_odd, time_delta;
 
+/* MSR device file descriptors, indexed by CPU id. They are opened on first use
+ * and kept open until the buffers are freed, e.g. when CPUs are hotplugged. */
+static int *msr_fds;
+static unsigned int msr_fds_num;
+
 static const char *config_keys[] = {
     "CoreCstates",
     "PackageCstates",
@@ -261,7 +266,7 @@ static const int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
  *****************************/
 
 /*
- * Open a MSR device for reading
+ * Open a MSR device for reading, or return the cached file descriptor
  * Can change the scheduling affinity of the current process if multiple_read is
  * true
  */
@@ -286,15 +291,52 @@ open_msr(unsigned int cpu, bool multiple_read) {
     }
   }
 
+  if ((cpu < msr_fds_num) && (msr_fds[cpu] >= 0))
+    return msr_fds[cpu];
+
   snprintf(pathname, sizeof(pathname), "/dev/cpu/%d/msr", cpu);
   fd = open(pathname, O_RDONLY);
   if (fd < 0) {
     ERROR("turbostat plugin: failed to open %s", pathname);
     return -1;
   }
+
+  if (cpu < msr_fds_num)
+    msr_fds[cpu] = fd;
   return fd;
 }
 
+/*
+ * Close a MSR device opened by open_msr(), unless it is cached
+ */
+static void close_msr(unsigned int cpu, int fd) {
+  if ((cpu < msr_fds_num) && (msr_fds[cpu] == fd))
+    return;
+  close(fd);
+}
+
+static int __attribute__((warn_unused_result)) allocate_msr_fds(void) {
+  msr_fds = calloc(topology.max_cpu_id + 1, sizeof(*msr_fds));
+  if (msr_fds == NULL) {
+    ERROR("turbostat plugin: calloc failed");
+    return -1;
+  }
+  msr_fds_num = topology.max_cpu_id + 1;
+
+  for (unsigned int cpu = 0; cpu < msr_fds_num; ++cpu)
+    msr_fds[cpu] = -1;
+  return 0;
+}
+
+static void free_msr_fds(void) {
+  for (unsigned int cpu = 0; cpu < msr_fds_num; ++cpu) {
+    if (msr_fds[cpu] >= 0)
+      close(msr_fds[cpu]);
+  }
+  sfree(msr_fds);
+  msr_fds_num = 0;
+}
+
 /*
  * Read a single MSR from an open file descriptor
  */
@@ -313,7 +355,7 @@ read_msr(int fd, off_t offset, unsigned long long *msr) {
 }
 
 /*
- * Open a MSR device for reading, read the value asked for and close it.
+ * Read the value asked for from a MSR device.
  * This call will not affect the scheduling affinity of this thread.
  */
 static ssize_t __attribute__((warn_unused_result))
@@ -325,7 +367,7 @@ get_msr(unsigned int cpu, off_t offset, unsigned long long *msr) {
   if (fd < 0)
     return fd;
   retval = read_msr(fd, offset, msr);
-  close(fd);
+  close_msr(cpu, fd);
   return retval;
 }
 
@@ -434,13 +476,12 @@ get_counters(struct thread_data *t, struct core_data *c, struct pkg_data *p) {
     READ_MSR(MSR_IA32_PACKAGE_THERM_STATUS, &msr);
     p->pkg_temp_c = p->tcc_activation_temp - ((msr >> 16) & 0x7F);
   }
-  if (do_power_fields & TURBO_PLATFORM) {
-    READ_MSR(MSR_IA32_MISC_ENABLE, &msr);
-    p->turbo_enabled = !((msr >> 38) & 0x1);
-  }
-  if (do_power_fields & PSTATES_PLATFORM) {
+  if (do_power_fields & (TURBO_PLATFORM | PSTATES_PLATFORM)) {
     READ_MSR(MSR_IA32_MISC_ENABLE, &msr);
-    p->pstates_enabled = (msr >> 16) & 0x1;
+    if (do_power_fields & TURBO_PLATFORM)
+      p->turbo_enabled = !((msr >> 38) & 0x1);
+    if (do_power_fields & PSTATES_PLATFORM)
+      p->pstates_enabled = (msr >> 16) & 0x1;
   }
   if (do_power_fields & UFS_PLATFORM) {
     READ_MSR(MSR_UNCORE_FREQ_SCALING, &msr);
@@ -448,7 +489,7 @@ get_counters(struct thread_data *t, struct core_data *c, struct pkg_data *p) {
   }
 
 out:
-  close(msr_fd);
+  close_msr(cpu, msr_fd);
   return retval;
 }
 
@@ -1426,6 +1467,8 @@ static void free_all_buffers(void) {
   allocated = false;
   initialized = false;
 
+  free_msr_fds();
+
   CPU_FREE(cpu_present_set);
   cpu_present_set = NULL;
   cpu_present_setsize = 0;
@@ -1478,6 +1521,7 @@ static int setup_all_buffers(void) {
   int ret;
 
   DO_OR_GOTO_ERR(topology_probe());
+  DO_OR_GOTO_ERR(allocate_msr_fds());
   DO_OR_GOTO_ERR(allocate_counters(&thread_even, &core_even, &package_even));
   DO_OR_GOTO_ERR(allocate_counters(&thread_odd, &core_odd, &package_odd));
   DO_OR_GOTO_ERR(allocate_counters(&thread_delta, &core_delta, &package_delta));
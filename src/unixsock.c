@@ -33,6 +33,7 @@
 #include "utils/cmds/getthreshold.h"
 #include "utils/cmds/getval.h"
 #include "utils/cmds/listval.h"
+#include "utils/cmds/putbin.h"
 #include "utils/cmds/putnotif.h"
 #include "utils/cmds/putval.h"
 
@@ -40,19 +41,44 @@
 #include <sys/un.h>
 
 #include <grp.h>
+#include <poll.h>
 
 #ifndef UNIX_PATH_MAX
 #define UNIX_PATH_MAX sizeof(((struct sockaddr_un *)0)->sun_path)
 #endif
 
 #define US_DEFAULT_PATH LOCALSTATEDIR "/run/" PACKAGE_NAME "-unixsock"
+#define US_DEFAULT_WORKER_THREADS 4
+
+/* An open client connection. While no input is pending, the connection is
+ * watched by the listening thread. As soon as input arrives, it is handed to
+ * one of the worker threads, which handles all complete commands received so
+ * far and then hands the connection back. */
+struct us_client_s;
+typedef struct us_client_s us_client_t;
+struct us_client_s {
+  int fd;
+  FILE *fhout;
+
+  /* Incomplete command received so far. Large enough for a GETVALS command
+   * with a few hundred identifiers. */
+  char buffer[16384];
+  size_t buffer_fill;
+
+  /* Binary frame announced by a PUTBIN command, NULL if none is pending. */
+  char *frame;
+  size_t frame_size;
+  size_t frame_fill;
+
+  us_client_t *next;
+};
 
 /*
  * Private variables
  */
 /* valid configuration file keys */
 static const char *config_keys[] = {"SocketFile", "SocketGroup", "SocketPerms",
-                                    "DeleteSocket"};
+                                    "DeleteSocket", "WorkerThreads"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int loop;
@@ -66,6 +92,21 @@ static bool delete_socket;
 
 static pthread_t listen_thread = (pthread_t)0;
 
+static size_t worker_threads_num = US_DEFAULT_WORKER_THREADS;
+static pthread_t *worker_threads;
+static size_t worker_threads_started;
+
+static pthread_mutex_t client_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t client_cond = PTHREAD_COND_INITIALIZER;
+/* Connections with pending input, waiting for a worker thread. */
+static us_client_t *busy_head;
+static us_client_t *busy_tail;
+/* Connections handed back to the listening thread by the worker threads. */
+static us_client_t *returned_head;
+
+/* Wakes up the listening thread. */
+static int wakeup_pipe[2] = {-1, -1};
+
 /*
  * Functions
  */
@@ -113,7 +154,7 @@ static int us_open_socket(void) {
     return -1;
   }
 
-  status = listen(sock_fd, 8);
+  status = listen(sock_fd, 128);
   if (status != 0) {
     ERROR("unixsock plugin: listen failed: %s", STRERRNO);
     close(sock_fd);
@@ -158,162 +199,470 @@ static int us_open_socket(void) {
   return 0;
 } /* int us_open_socket */
 
-static void *us_handle_client(void *arg) {
-  int fdin;
-  int fdout;
-  FILE *fhin, *fhout;
-
-  fdin = *((int *)arg);
-  free(arg);
-  arg = NULL;
+static void us_wakeup(void) {
+  if (write(wakeup_pipe[1], "", 1) < 0) {
+    /* nothing to do */
+  }
+} /* void us_wakeup */
+
+static us_client_t *us_client_create(int fd) {
+  us_client_t *client = calloc(1, sizeof(*client));
+  if (client == NULL) {
+    ERROR("unixsock plugin: calloc failed.");
+    close(fd);
+    return NULL;
+  }
+  client->fd = fd;
 
-  DEBUG("unixsock plugin: us_handle_client: Reading from fd #%i", fdin);
+  /* Replies are written with blocking I/O. Input is read with MSG_DONTWAIT, so
+   * the socket itself stays blocking. */
+  int flags = fcntl(fd, F_GETFL);
+  if ((flags != -1) && (flags & O_NONBLOCK))
+    fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
 
-  fdout = dup(fdin);
+  int fdout = dup(fd);
   if (fdout < 0) {
     ERROR("unixsock plugin: dup failed: %s", STRERRNO);
-    close(fdin);
-    pthread_exit((void *)1);
+    close(fd);
+    sfree(client);
+    return NULL;
   }
 
-  fhin = fdopen(fdin, "r");
-  if (fhin == NULL) {
+  client->fhout = fdopen(fdout, "w");
+  if (client->fhout == NULL) {
     ERROR("unixsock plugin: fdopen failed: %s", STRERRNO);
-    close(fdin);
     close(fdout);
-    pthread_exit((void *)1);
-    return (void *)1;
+    close(fd);
+    sfree(client);
+    return NULL;
   }
 
-  fhout = fdopen(fdout, "w");
-  if (fhout == NULL) {
-    ERROR("unixsock plugin: fdopen failed: %s", STRERRNO);
-    fclose(fhin); /* this closes fdin as well */
-    close(fdout);
-    pthread_exit((void *)1);
-    return (void *)1;
+  return client;
+} /* us_client_t *us_client_create */
+
+static void us_client_destroy(us_client_t *client) {
+  while (client != NULL) {
+    us_client_t *next = client->next;
+
+    DEBUG("unixsock plugin: Closing connection on fd #%i", client->fd);
+    fclose(client->fhout); /* this closes fdout */
+    close(client->fd);
+    sfree(client->frame);
+    sfree(client);
+
+    client = next;
   }
+} /* void us_client_destroy */
 
-  /* change output buffer to line buffered mode */
-  if (setvbuf(fhout, NULL, _IOLBF, 0) != 0) {
-    ERROR("unixsock plugin: setvbuf failed: %s", STRERRNO);
-    fclose(fhin);
-    fclose(fhout);
-    pthread_exit((void *)1);
-    return (void *)0;
+static void us_handle_stats(FILE *fhout) /* {{{ */
+{
+  char **lines = NULL;
+  size_t lines_num = 0;
+
+  int status = plugin_get_stats(&lines, &lines_num);
+  if (status != 0) {
+    fprintf(fhout, "-1 Collecting the statistics failed: %s\n",
+            STRERROR(status));
+    return;
   }
 
-  while (42) {
-    char buffer[1024];
-    char buffer_copy[1024];
-    char *fields[128];
-    int fields_num;
+  fprintf(fhout, "%" PRIsz " Line%s follow\n", lines_num,
+          (lines_num == 1) ? "" : "s");
+  for (size_t i = 0; i < lines_num; i++) {
+    fprintf(fhout, "%s\n", lines[i]);
+    sfree(lines[i]);
+  }
+  sfree(lines);
+} /* }}} void us_handle_stats */
 
-    errno = 0;
-    if (fgets(buffer, sizeof(buffer), fhin) == NULL) {
-      if ((errno == EINTR) || (errno == EAGAIN))
+/* Handles one command. Returns non-zero if the connection should be closed. */
+static int us_handle_command(FILE *fhout, char *buffer) {
+  char buffer_copy[1024];
+  char *fields[128];
+  int fields_num;
+
+  size_t len = strlen(buffer);
+  while ((len > 0) && ((buffer[len - 1] == '\n') || (buffer[len - 1] == '\r')))
+    buffer[--len] = '\0';
+
+  if (len == 0)
+    return 0;
+
+  sstrncpy(buffer_copy, buffer, sizeof(buffer_copy));
+
+  fields_num =
+      strsplit(buffer_copy, fields, sizeof(fields) / sizeof(fields[0]));
+  if (fields_num < 1) {
+    fprintf(fhout, "-1 Internal error\n");
+    return -1;
+  }
+
+  if (strcasecmp(fields[0], "getval") == 0) {
+    cmd_handle_getval(fhout, buffer);
+  } else if (strcasecmp(fields[0], "getvals") == 0) {
+    cmd_handle_getvals(fhout, buffer);
+  } else if (strcasecmp(fields[0], "getthreshold") == 0) {
+    handle_getthreshold(fhout, buffer);
+  } else if (strcasecmp(fields[0], "putval") == 0) {
+    cmd_handle_putval(fhout, buffer);
+  } else if (strcasecmp(fields[0], "listval") == 0) {
+    cmd_handle_listval(fhout, buffer);
+  } else if (strcasecmp(fields[0], "putnotif") == 0) {
+    handle_putnotif(fhout, buffer);
+  } else if (strcasecmp(fields[0], "flush") == 0) {
+    cmd_handle_flush(fhout, buffer);
+  } else if (strcasecmp(fields[0], "stats") == 0) {
+    us_handle_stats(fhout);
+  } else if (strcasecmp(fields[0], "reload") == 0) {
+    /* The configuration is reloaded by the main thread. This thread may be
+     * stopped by it, so the reply doesn't wait for the result. */
+    plugin_reload_request();
+    fprintf(fhout, "0 Reload requested\n");
+  } else {
+    if (fprintf(fhout, "-1 Unknown command: %s\n", fields[0]) < 0) {
+      WARNING("unixsock plugin: failed to write to socket #%i: %s",
+              fileno(fhout), STRERRNO);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* int us_handle_command */
+
+/* Dispatches the client's PUTBIN frame once it has been received completely.
+ * The reply is written even if the frame couldn't be parsed: the frame has
+ * been consumed, so the connection is still usable. */
+static void us_client_finish_frame(us_client_t *client) {
+  if ((client->frame == NULL) || (client->frame_fill < client->frame_size))
+    return;
+
+  cmd_handle_putbin(client->fhout, client->frame, client->frame_size);
+
+  sfree(client->frame);
+  client->frame_size = 0;
+  client->frame_fill = 0;
+} /* void us_client_finish_frame */
+
+/* Handles a "PUTBIN <size>" line by allocating a buffer for the frame that
+ * follows. If the line is malformed, the connection has to be closed, because
+ * the binary data would otherwise be interpreted as commands. */
+static int us_client_start_frame(us_client_t *client, char *line) {
+  char *fields[3];
+  int fields_num;
+
+  size_t len = strlen(line);
+  while ((len > 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r')))
+    line[--len] = '\0';
+
+  fields_num = strsplit(line, fields, STATIC_ARRAY_SIZE(fields));
+  if (fields_num != 2) {
+    fprintf(client->fhout, "-1 Usage: PUTBIN <size>\n");
+    return -1;
+  }
+
+  char *endptr = NULL;
+  errno = 0;
+  unsigned long long size = strtoull(fields[1], &endptr, 10);
+  if ((errno != 0) || (endptr == fields[1]) || (*endptr != 0) ||
+      (fields[1][0] == '-')) {
+    fprintf(client->fhout, "-1 Invalid frame size: %s\n", fields[1]);
+    return -1;
+  }
+  if (size > CMD_PUTBIN_MAX_SIZE) {
+    fprintf(client->fhout, "-1 Frame size %llu exceeds the limit of %d bytes\n",
+            size, CMD_PUTBIN_MAX_SIZE);
+    return -1;
+  }
+
+  /* Allocate at least one byte so a pending frame is always non-NULL. */
+  client->frame = malloc((size_t)size + 1);
+  if (client->frame == NULL) {
+    ERROR("unixsock plugin: malloc failed.");
+    fprintf(client->fhout, "-1 Internal error\n");
+    return -1;
+  }
+  client->frame_size = (size_t)size;
+  client->frame_fill = 0;
+
+  us_client_finish_frame(client);
+  return 0;
+} /* int us_client_start_frame */
+
+/* Handles all complete commands in the client's buffer. If "eof" is true, an
+ * incomplete command at the end is handled, too. Lines that don't fit into the
+ * buffer are split, like fgets() does. */
+static int us_client_handle_buffer(us_client_t *client, bool eof) {
+  size_t start = 0;
+  int status = 0;
+
+  while ((start < client->buffer_fill) && (status == 0)) {
+    char *line = client->buffer + start;
+    size_t avail = client->buffer_fill - start;
+
+    if (client->frame != NULL) {
+      size_t n = client->frame_size - client->frame_fill;
+      if (n > avail)
+        n = avail;
+
+      memcpy(client->frame + client->frame_fill, line, n);
+      client->frame_fill += n;
+      start += n;
+
+      us_client_finish_frame(client);
+      continue;
+    }
+
+    char *newline = memchr(line, '\n', avail);
+    size_t len = avail;
+    if (newline != NULL)
+      len = (size_t)(newline - line);
+    else if (!eof && ((start != 0) ||
+                      (client->buffer_fill < sizeof(client->buffer) - 1)))
+      break;
+
+    /* There is always room for the terminating null byte, see
+     * us_client_read(). */
+    line[len] = 0;
+    if ((strncasecmp(line, "PUTBIN", strlen("PUTBIN")) == 0) &&
+        isspace((unsigned char)line[strlen("PUTBIN")]))
+      status = us_client_start_frame(client, line);
+    else
+      status = us_handle_command(client->fhout, line);
+
+    start += len;
+    if (newline != NULL)
+      start++;
+  }
+
+  if (start > 0) {
+    memmove(client->buffer, client->buffer + start,
+            client->buffer_fill - start);
+    client->buffer_fill -= start;
+  }
+
+  return status;
+} /* int us_client_handle_buffer */
+
+/* Reads and handles everything the client has sent so far without blocking.
+ * Returns non-zero if the connection has been closed or should be closed. */
+static int us_client_read(us_client_t *client) {
+  int status = 0;
+
+  while (status == 0) {
+    /* Frame data is received directly into the frame buffer. */
+    char *dst = client->buffer + client->buffer_fill;
+    size_t dst_size = sizeof(client->buffer) - 1 - client->buffer_fill;
+    if (client->frame != NULL) {
+      dst = client->frame + client->frame_fill;
+      dst_size = client->frame_size - client->frame_fill;
+    }
+
+    ssize_t len = recv(client->fd, dst, dst_size, MSG_DONTWAIT);
+    if (len < 0) {
+      if (errno == EINTR)
         continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        break;
 
-      if (errno != 0) {
-        WARNING("unixsock plugin: failed to read from socket #%i: %s",
-                fileno(fhin), STRERRNO);
-      }
+      WARNING("unixsock plugin: failed to read from socket #%i: %s",
+              client->fd, STRERRNO);
+      status = -1;
+      break;
+    } else if (len == 0) {
+      us_client_handle_buffer(client, /* eof = */ true);
+      status = -1;
       break;
     }
 
-    size_t len = strlen(buffer);
-    while ((len > 0) &&
-           ((buffer[len - 1] == '\n') || (buffer[len - 1] == '\r')))
-      buffer[--len] = '\0';
+    if (client->frame != NULL) {
+      client->frame_fill += (size_t)len;
+      us_client_finish_frame(client);
+      continue;
+    }
+
+    client->buffer_fill += (size_t)len;
+    status = us_client_handle_buffer(client, /* eof = */ false);
+  }
 
-    if (len == 0)
+  if (fflush(client->fhout) != 0) {
+    WARNING("unixsock plugin: failed to write to socket #%i: %s", client->fd,
+            STRERRNO);
+    status = -1;
+  }
+
+  return status;
+} /* int us_client_read */
+
+static void *us_worker_thread(void __attribute__((unused)) * arg) {
+  pthread_mutex_lock(&client_lock);
+  while (loop != 0) {
+    if (busy_head == NULL) {
+      pthread_cond_wait(&client_cond, &client_lock);
       continue;
+    }
 
-    sstrncpy(buffer_copy, buffer, sizeof(buffer_copy));
+    us_client_t *client = busy_head;
+    busy_head = client->next;
+    if (busy_head == NULL)
+      busy_tail = NULL;
+    client->next = NULL;
+    pthread_mutex_unlock(&client_lock);
 
-    fields_num =
-        strsplit(buffer_copy, fields, sizeof(fields) / sizeof(fields[0]));
-    if (fields_num < 1) {
-      fprintf(fhout, "-1 Internal error\n");
-      fclose(fhin);
-      fclose(fhout);
-      pthread_exit((void *)1);
-      return (void *)1;
+    int status = us_client_read(client);
+
+    pthread_mutex_lock(&client_lock);
+    if (status != 0) {
+      us_client_destroy(client);
+      continue;
     }
 
-    if (strcasecmp(fields[0], "getval") == 0) {
-      cmd_handle_getval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "getthreshold") == 0) {
-      handle_getthreshold(fhout, buffer);
-    } else if (strcasecmp(fields[0], "putval") == 0) {
-      cmd_handle_putval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "listval") == 0) {
-      cmd_handle_listval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "putnotif") == 0) {
-      handle_putnotif(fhout, buffer);
-    } else if (strcasecmp(fields[0], "flush") == 0) {
-      cmd_handle_flush(fhout, buffer);
-    } else {
-      if (fprintf(fhout, "-1 Unknown command: %s\n", fields[0]) < 0) {
-        WARNING("unixsock plugin: failed to write to socket #%i: %s",
-                fileno(fhout), STRERRNO);
+    client->next = returned_head;
+    returned_head = client;
+    us_wakeup();
+  }
+  pthread_mutex_unlock(&client_lock);
+
+  return (void *)0;
+} /* void *us_worker_thread */
+
+/* Accepts all pending connections and prepends them to "idle". Returns the
+ * number of new connections or -1 if accepting connections failed. */
+static int us_accept(us_client_t **idle) {
+  int num = 0;
+
+  while (42) {
+    int fd = accept(sock_fd, NULL, NULL);
+    if (fd < 0) {
+      if ((errno == EINTR) || (errno == ECONNABORTED))
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
         break;
-      }
+
+      ERROR("unixsock plugin: accept failed: %s", STRERRNO);
+      return -1;
     }
-  } /* while (fgets) */
 
-  DEBUG("unixsock plugin: us_handle_client: Exiting..");
-  fclose(fhin);
-  fclose(fhout);
+    DEBUG("unixsock plugin: Accepted connection on fd #%i", fd);
 
-  pthread_exit((void *)0);
-  return (void *)0;
-} /* void *us_handle_client */
+    us_client_t *client = us_client_create(fd);
+    if (client == NULL)
+      continue;
+
+    client->next = *idle;
+    *idle = client;
+    num++;
+  }
+
+  return num;
+} /* int us_accept */
 
 static void *us_server_thread(void __attribute__((unused)) * arg) {
+  us_client_t *idle = NULL;
+  size_t idle_num = 0;
+  struct pollfd *fds = NULL;
+  size_t fds_size = 0;
   int status;
-  int *remote_fd;
-  pthread_t th;
 
   if (us_open_socket() != 0)
     pthread_exit((void *)1);
 
+  int flags = fcntl(sock_fd, F_GETFL);
+  if ((flags == -1) || (fcntl(sock_fd, F_SETFL, flags | O_NONBLOCK) != 0)) {
+    ERROR("unixsock plugin: fcntl failed: %s", STRERRNO);
+    close(sock_fd);
+    sock_fd = -1;
+    pthread_exit((void *)1);
+  }
+
   while (loop != 0) {
-    DEBUG("unixsock plugin: Calling accept..");
-    status = accept(sock_fd, NULL, NULL);
-    if (status < 0) {
+    /* Take back the connections the worker threads are done with. */
+    pthread_mutex_lock(&client_lock);
+    while (returned_head != NULL) {
+      us_client_t *client = returned_head;
+      returned_head = client->next;
+      client->next = idle;
+      idle = client;
+      idle_num++;
+    }
+    pthread_mutex_unlock(&client_lock);
+
+    size_t fds_num = idle_num + 2;
+    if (fds_num > fds_size) {
+      struct pollfd *tmp = realloc(fds, 2 * fds_num * sizeof(*fds));
+      if (tmp == NULL) {
+        ERROR("unixsock plugin: realloc failed.");
+        break;
+      }
+      fds = tmp;
+      fds_size = 2 * fds_num;
+    }
+
+    fds[0] = (struct pollfd){.fd = sock_fd, .events = POLLIN};
+    fds[1] = (struct pollfd){.fd = wakeup_pipe[0], .events = POLLIN};
+    size_t i = 2;
+    for (us_client_t *client = idle; client != NULL; client = client->next)
+      fds[i++] = (struct pollfd){.fd = client->fd, .events = POLLIN};
 
+    status = poll(fds, (nfds_t)fds_num, /* timeout = */ -1);
+    if (status < 0) {
       if (errno == EINTR)
         continue;
 
-      ERROR("unixsock plugin: accept failed: %s", STRERRNO);
-      close(sock_fd);
-      sock_fd = -1;
-      pthread_exit((void *)1);
+      ERROR("unixsock plugin: poll failed: %s", STRERRNO);
+      break;
     }
 
-    remote_fd = malloc(sizeof(*remote_fd));
-    if (remote_fd == NULL) {
-      WARNING("unixsock plugin: malloc failed: %s", STRERRNO);
-      close(status);
-      continue;
+    if (fds[1].revents != 0) {
+      char buffer[64];
+      while (read(wakeup_pipe[0], buffer, sizeof(buffer)) > 0)
+        /* drain */;
     }
-    *remote_fd = status;
-
-    DEBUG("Spawning child to handle connection on fd #%i", *remote_fd);
-
-    status = plugin_thread_create(&th, us_handle_client, (void *)remote_fd,
-                                  "unixsock conn");
-    if (status == 0) {
-      pthread_detach(th);
-    } else {
-      WARNING("unixsock plugin: pthread_create failed: %s", STRERRNO);
-      close(*remote_fd);
-      free(remote_fd);
-      continue;
+
+    /* Hand the connections with pending input (or errors) to the worker
+     * threads. "idle" is still in the order "fds" was filled in. */
+    us_client_t **prev = &idle;
+    size_t busy_num = 0;
+    i = 2;
+    pthread_mutex_lock(&client_lock);
+    for (us_client_t *client = idle; client != NULL; i++) {
+      us_client_t *next = client->next;
+
+      if (fds[i].revents == 0) {
+        prev = &client->next;
+        client = next;
+        continue;
+      }
+
+      *prev = next;
+      idle_num--;
+
+      client->next = NULL;
+      if (busy_tail == NULL)
+        busy_head = client;
+      else
+        busy_tail->next = client;
+      busy_tail = client;
+      busy_num++;
+
+      client = next;
+    }
+    if (busy_num == 1)
+      pthread_cond_signal(&client_cond);
+    else if (busy_num > 1)
+      pthread_cond_broadcast(&client_cond);
+    pthread_mutex_unlock(&client_lock);
+
+    if (fds[0].revents != 0) {
+      status = us_accept(&idle);
+      if (status < 0)
+        break;
+      idle_num += (size_t)status;
     }
   } /* while (loop) */
 
+  sfree(fds);
+  us_client_destroy(idle);
+
   close(sock_fd);
   sock_fd = -1;
 
@@ -348,6 +697,15 @@ static int us_config(const char *key, const char *val) {
       delete_socket = true;
     else
       delete_socket = false;
+  } else if (strcasecmp(key, "WorkerThreads") == 0) {
+    int tmp = atoi(val);
+    if (tmp < 1) {
+      WARNING("unixsock plugin: WorkerThreads must be at least 1, "
+              "ignoring \"%s\".",
+              val);
+      return 1;
+    }
+    worker_threads_num = (size_t)tmp;
   } else {
     return -1;
   }
@@ -365,8 +723,36 @@ static int us_init(void) {
     return 0;
   have_init = 1;
 
+  if (pipe(wakeup_pipe) != 0) {
+    ERROR("unixsock plugin: pipe failed: %s", STRERRNO);
+    return -1;
+  }
+  for (size_t i = 0; i < 2; i++) {
+    int flags = fcntl(wakeup_pipe[i], F_GETFL);
+    if (flags != -1)
+      fcntl(wakeup_pipe[i], F_SETFL, flags | O_NONBLOCK);
+  }
+
   loop = 1;
 
+  worker_threads = calloc(worker_threads_num, sizeof(*worker_threads));
+  if (worker_threads == NULL) {
+    ERROR("unixsock plugin: calloc failed.");
+    return -1;
+  }
+
+  for (size_t i = 0; i < worker_threads_num; i++) {
+    status = plugin_thread_create(&worker_threads[i], us_worker_thread, NULL,
+                                  "unixsock worker");
+    if (status != 0) {
+      ERROR("unixsock plugin: pthread_create failed: %s", STRERRNO);
+      break;
+    }
+    worker_threads_started++;
+  }
+  if (worker_threads_started == 0)
+    return -1;
+
   status = plugin_thread_create(&listen_thread, us_server_thread, NULL,
                                 "unixsock listen");
   if (status != 0) {
@@ -383,11 +769,32 @@ static int us_shutdown(void) {
   loop = 0;
 
   if (listen_thread != (pthread_t)0) {
-    pthread_kill(listen_thread, SIGTERM);
+    us_wakeup();
     pthread_join(listen_thread, &ret);
     listen_thread = (pthread_t)0;
   }
 
+  pthread_mutex_lock(&client_lock);
+  pthread_cond_broadcast(&client_cond);
+  pthread_mutex_unlock(&client_lock);
+
+  for (size_t i = 0; i < worker_threads_started; i++)
+    pthread_join(worker_threads[i], &ret);
+  worker_threads_started = 0;
+  sfree(worker_threads);
+
+  us_client_destroy(busy_head);
+  busy_head = busy_tail = NULL;
+  us_client_destroy(returned_head);
+  returned_head = NULL;
+
+  for (size_t i = 0; i < 2; i++) {
+    if (wakeup_pipe[i] >= 0) {
+      close(wakeup_pipe[i]);
+      wakeup_pipe[i] = -1;
+    }
+  }
+
   plugin_unregister_init("unixsock");
   plugin_unregister_shutdown("unixsock");
 
@@ -0,0 +1,652 @@
+/**
+ * collectd - src/utils/async_sender/async_sender.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/async_sender/async_sender.h"
+#include "utils/common/common.h"
+#include "utils_complain.h"
+#include "utils_random.h"
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+/* Failed connection attempts are retried after an interval that doubles with
+ * every failure, from AS_BACKOFF_MIN up to AS_BACKOFF_MAX. */
+#define AS_BACKOFF_MIN TIME_T_TO_CDTIME_T_STATIC(1)
+#define AS_BACKOFF_MAX TIME_T_TO_CDTIME_T_STATIC(64)
+#define AS_CONNECT_TIMEOUT TIME_T_TO_CDTIME_T_STATIC(10)
+/* Time async_sender_destroy() waits for queued buffers to be sent. */
+#define AS_DRAIN_TIMEOUT TIME_T_TO_CDTIME_T_STATIC(2)
+/* Maximum number of queued buffers written with one sendmsg() call. */
+#define AS_SEND_IOV_MAX 64
+
+#ifdef MSG_NOSIGNAL
+#define AS_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define AS_SEND_FLAGS 0
+#endif
+
+typedef struct {
+  char *data;
+  size_t size;
+} as_buffer_t;
+
+struct async_sender_s {
+  char *log_prefix;
+  char *node;
+  char *service;
+  int socktype;
+  size_t buffer_size;
+  cdtime_t reconnect_interval;
+  cdtime_t resolve_interval;
+  cdtime_t resolve_jitter;
+  bool log_send_errors;
+
+  /* Protects the queue, the statistics and the thread state. */
+  pthread_mutex_t lock;
+  as_buffer_t *queue;
+  size_t queue_length;
+  size_t queue_head;
+  size_t queue_num;
+  uint64_t sent_bytes;
+  uint64_t dropped_bytes;
+  c_complain_t queue_complaint;
+
+  pthread_t thread;
+  bool thread_running;
+  bool shutdown;
+  bool wakeup_pending;
+  int wakeup_fd[2];
+
+  /* Only used by the sender thread. */
+  int sock_fd;
+  size_t send_offset;
+  cdtime_t connect_time;
+  cdtime_t next_connect;
+  cdtime_t backoff;
+  struct addrinfo *ai_list;
+  cdtime_t ai_expires;
+  c_complain_t connect_complaint;
+};
+
+static void as_wakeup(async_sender_t *s) {
+  /* The pipe is non-blocking: if it is full, the thread is awake anyway. */
+  if (write(s->wakeup_fd[1], "", 1) < 0) {
+    /* nothing to do */
+  }
+}
+
+static void as_drain_wakeup(async_sender_t *s) {
+  char buffer[64];
+  while (read(s->wakeup_fd[0], buffer, sizeof(buffer)) > 0)
+    /* continue */;
+}
+
+static bool as_is_shutdown(async_sender_t *s) {
+  pthread_mutex_lock(&s->lock);
+  bool shutdown = s->shutdown;
+  pthread_mutex_unlock(&s->lock);
+  return shutdown;
+}
+
+static void as_close(async_sender_t *s) {
+  if (s->sock_fd < 0)
+    return;
+
+  close(s->sock_fd);
+  s->sock_fd = -1;
+  s->send_offset = 0;
+}
+
+/* as_pop removes the buffer at the head of the queue, which has been sent up
+ * to s->send_offset. */
+static void as_pop(async_sender_t *s) {
+  pthread_mutex_lock(&s->lock);
+  as_buffer_t *b = s->queue + s->queue_head;
+  s->sent_bytes += (uint64_t)s->send_offset;
+  s->dropped_bytes += (uint64_t)(b->size - s->send_offset);
+  s->queue_head = (s->queue_head + 1) % s->queue_length;
+  s->queue_num--;
+  pthread_mutex_unlock(&s->lock);
+
+  s->send_offset = 0;
+}
+
+static int as_resolve(async_sender_t *s, cdtime_t now) {
+  if ((s->ai_list != NULL) && (s->resolve_interval > 0) &&
+      (now < s->ai_expires))
+    return 0;
+
+  if (s->ai_list != NULL) {
+    freeaddrinfo(s->ai_list);
+    s->ai_list = NULL;
+  }
+
+  struct addrinfo ai_hints = {
+      .ai_family = AF_UNSPEC,
+      .ai_flags = AI_ADDRCONFIG,
+      .ai_socktype = s->socktype,
+  };
+
+  int status = getaddrinfo(s->node, s->service, &ai_hints, &s->ai_list);
+  if (status != 0) {
+    c_complain(LOG_ERR, &s->connect_complaint,
+               "%s: getaddrinfo (%s, %s) failed: %s", s->log_prefix, s->node,
+               s->service, gai_strerror(status));
+    s->ai_list = NULL;
+    return -1;
+  }
+
+  s->ai_expires = now + s->resolve_interval;
+  if (s->resolve_jitter > 0)
+    s->ai_expires += (cdtime_t)cdrand_range(0, (long)s->resolve_jitter);
+
+  return 0;
+}
+
+/* as_connect_addr opens a non-blocking socket and connects it to "ai". While
+ * the connection is in progress, the thread still reacts to shutdown
+ * requests. Returns the socket or -1. */
+static int as_connect_addr(async_sender_t *s, struct addrinfo const *ai,
+                           char *errbuf, size_t errbuf_size) {
+  int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+  if (fd < 0) {
+    snprintf(errbuf, errbuf_size, "failed to open socket: %s", STRERRNO);
+    return -1;
+  }
+
+  set_sock_opts(fd);
+
+  int flags = fcntl(fd, F_GETFL);
+  if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)) {
+    snprintf(errbuf, errbuf_size, "fcntl failed: %s", STRERRNO);
+    close(fd);
+    return -1;
+  }
+
+  if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+    return fd;
+  if (errno != EINPROGRESS) {
+    snprintf(errbuf, errbuf_size, "failed to connect to remote host: %s",
+             STRERRNO);
+    close(fd);
+    return -1;
+  }
+
+  cdtime_t deadline = cdtime() + AS_CONNECT_TIMEOUT;
+  while (true) {
+    cdtime_t now = cdtime();
+    if (now >= deadline) {
+      snprintf(errbuf, errbuf_size, "connection timed out");
+      break;
+    }
+
+    struct pollfd fds[] = {
+        {.fd = fd, .events = POLLOUT},
+        {.fd = s->wakeup_fd[0], .events = POLLIN},
+    };
+    int status = poll(fds, STATIC_ARRAY_SIZE(fds),
+                      (int)CDTIME_T_TO_MS(deadline - now) + 1);
+    if ((status < 0) && (errno != EINTR)) {
+      snprintf(errbuf, errbuf_size, "poll failed: %s", STRERRNO);
+      break;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      as_drain_wakeup(s);
+      if (as_is_shutdown(s)) {
+        snprintf(errbuf, errbuf_size, "shutting down");
+        break;
+      }
+    }
+
+    if (fds[0].revents != 0) {
+      int error = 0;
+      socklen_t error_len = sizeof(error);
+      if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0)
+        error = errno;
+      if (error == 0)
+        return fd;
+
+      snprintf(errbuf, errbuf_size, "failed to connect to remote host: %s",
+               STRERROR(error));
+      break;
+    }
+  }
+
+  close(fd);
+  return -1;
+}
+
+static void as_connect(async_sender_t *s) {
+  char errbuf[1024] = "";
+  cdtime_t now = cdtime();
+
+  if (as_resolve(s, now) == 0) {
+    for (struct addrinfo *ai = s->ai_list; ai != NULL; ai = ai->ai_next) {
+      s->sock_fd = as_connect_addr(s, ai, errbuf, sizeof(errbuf));
+      if (s->sock_fd >= 0)
+        break;
+    }
+
+    if (s->sock_fd < 0)
+      c_complain(LOG_ERR, &s->connect_complaint,
+                 "%s: Connecting to %s:%s failed. The last error was: %s",
+                 s->log_prefix, s->node, s->service, errbuf);
+  }
+
+  now = cdtime();
+  if (s->sock_fd < 0) {
+    /* Resolve the name again before the next attempt, the address may have
+     * changed. */
+    if (s->ai_list != NULL) {
+      freeaddrinfo(s->ai_list);
+      s->ai_list = NULL;
+    }
+
+    if (s->backoff == 0)
+      s->backoff = AS_BACKOFF_MIN;
+    else if (s->backoff < AS_BACKOFF_MAX)
+      s->backoff = 2 * s->backoff;
+    s->next_connect = now + s->backoff;
+    return;
+  }
+
+  c_release(LOG_INFO, &s->connect_complaint,
+            "%s: Successfully connected to %s:%s.", s->log_prefix, s->node,
+            s->service);
+  s->backoff = 0;
+  s->connect_time = now;
+  s->send_offset = 0;
+}
+
+/* as_send writes queued buffers to the socket. On stream sockets, up to
+ * AS_SEND_IOV_MAX buffers are written with a single sendmsg() call, so that
+ * many small buffers don't cost one system call and TCP segment each. */
+static void as_send(async_sender_t *s) {
+  pthread_mutex_lock(&s->lock);
+  size_t queue_num = s->queue_num;
+  size_t queue_head = s->queue_head;
+  pthread_mutex_unlock(&s->lock);
+  if (queue_num == 0)
+    return;
+
+  /* Write callbacks only fill slots behind the queued buffers, so these can
+   * be read without holding the lock. */
+  struct iovec iov[AS_SEND_IOV_MAX];
+  size_t iov_num = 0;
+  if (s->socktype != SOCK_STREAM)
+    queue_num = 1;
+  for (size_t i = 0; (i < queue_num) && (iov_num < AS_SEND_IOV_MAX); i++) {
+    as_buffer_t const *b = s->queue + ((queue_head + i) % s->queue_length);
+    size_t offset = (i == 0) ? s->send_offset : 0;
+    iov[iov_num++] = (struct iovec){
+        .iov_base = b->data + offset,
+        .iov_len = b->size - offset,
+    };
+  }
+
+  struct msghdr msg = {
+      .msg_iov = iov,
+      .msg_iovlen = iov_num,
+  };
+  ssize_t status = sendmsg(s->sock_fd, &msg, AS_SEND_FLAGS);
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return;
+
+    if (s->log_send_errors)
+      ERROR("%s: Sending to %s:%s failed: %s", s->log_prefix, s->node,
+            s->service, STRERRNO);
+
+    /* The rest of a partially sent buffer can't be sent on a new connection
+     * without garbling a line. */
+    bool partial = (s->send_offset > 0);
+    if (partial)
+      as_pop(s);
+    as_close(s);
+    s->next_connect = cdtime();
+    return;
+  }
+
+  /* Pop all buffers that have been sent completely. */
+  size_t sent = (size_t)status;
+  for (size_t i = 0; (i < iov_num) && (sent > 0); i++) {
+    as_buffer_t const *b = s->queue + s->queue_head;
+    size_t left = b->size - s->send_offset;
+    if (sent < left) {
+      s->send_offset += sent;
+      break;
+    }
+    sent -= left;
+    s->send_offset = b->size;
+    as_pop(s);
+  }
+}
+
+/* as_receive discards data sent by the server and detects closed
+ * connections. */
+static void as_receive(async_sender_t *s) {
+  char buffer[512];
+
+  ssize_t status = recv(s->sock_fd, buffer, sizeof(buffer), 0);
+  if (status > 0)
+    return;
+  if ((status < 0) &&
+      ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+    return;
+
+  if (s->log_send_errors) {
+    if (status == 0)
+      ERROR("%s: Connection to %s:%s closed by the remote host.",
+            s->log_prefix, s->node, s->service);
+    else
+      ERROR("%s: Connection to %s:%s failed: %s", s->log_prefix, s->node,
+            s->service, STRERRNO);
+  }
+
+  if (s->send_offset > 0)
+    as_pop(s);
+  as_close(s);
+  s->next_connect = cdtime();
+}
+
+static void *as_thread(void *arg) {
+  async_sender_t *s = arg;
+  cdtime_t drain_deadline = 0;
+
+  while (true) {
+    pthread_mutex_lock(&s->lock);
+    bool shutdown = s->shutdown;
+    bool have_data = (s->queue_num > 0);
+    s->wakeup_pending = false;
+    pthread_mutex_unlock(&s->lock);
+
+    cdtime_t now = cdtime();
+    if (shutdown) {
+      if (drain_deadline == 0)
+        drain_deadline = now + AS_DRAIN_TIMEOUT;
+      if (!have_data || (s->sock_fd < 0) || (now >= drain_deadline))
+        break;
+    }
+
+    /* Forced reconnects only happen between two buffers. */
+    if ((s->sock_fd >= 0) && (s->reconnect_interval > 0) &&
+        (s->send_offset == 0) &&
+        ((now - s->connect_time) >= s->reconnect_interval)) {
+      INFO("%s: Connection to %s:%s closed after %.3f seconds.",
+           s->log_prefix, s->node, s->service,
+           CDTIME_T_TO_DOUBLE(now - s->connect_time));
+      as_close(s);
+      s->next_connect = now;
+    }
+
+    if (have_data && (s->sock_fd < 0) && (now >= s->next_connect)) {
+      as_connect(s);
+      continue;
+    }
+
+    struct pollfd fds[] = {
+        {.fd = s->wakeup_fd[0], .events = POLLIN},
+        {.fd = s->sock_fd, .events = 0},
+    };
+    int timeout = -1;
+
+    if (s->sock_fd >= 0) {
+      if (have_data)
+        fds[1].events |= POLLOUT;
+      if (s->socktype == SOCK_STREAM)
+        fds[1].events |= POLLIN;
+    } else if (have_data) {
+      timeout = (int)CDTIME_T_TO_MS(s->next_connect - now) + 1;
+    }
+
+    if (shutdown) {
+      int drain_timeout = (int)CDTIME_T_TO_MS(drain_deadline - now) + 1;
+      if ((timeout < 0) || (drain_timeout < timeout))
+        timeout = drain_timeout;
+    }
+
+    /* A negative fd is ignored by poll(2). */
+    int status = poll(fds, STATIC_ARRAY_SIZE(fds), timeout);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("%s: poll failed: %s", s->log_prefix, STRERRNO);
+      break;
+    }
+
+    if (fds[0].revents & POLLIN)
+      as_drain_wakeup(s);
+
+    if ((s->sock_fd >= 0) && (fds[1].revents & POLLIN))
+      as_receive(s);
+
+    if ((s->sock_fd >= 0) && (fds[1].revents & (POLLOUT | POLLERR | POLLHUP))) {
+      if (have_data)
+        as_send(s);
+      else
+        as_receive(s);
+    }
+  }
+
+  as_close(s);
+  return NULL;
+}
+
+async_sender_t *async_sender_create(async_sender_options_t const *opts) {
+  if ((opts == NULL) || (opts->node == NULL) || (opts->service == NULL) ||
+      (opts->buffer_size == 0) || (opts->queue_length == 0))
+    return NULL;
+
+  async_sender_t *s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+
+  s->sock_fd = -1;
+  s->wakeup_fd[0] = -1;
+  s->wakeup_fd[1] = -1;
+  pthread_mutex_init(&s->lock, NULL);
+  C_COMPLAIN_INIT(&s->queue_complaint);
+  C_COMPLAIN_INIT(&s->connect_complaint);
+
+  s->log_prefix =
+      strdup((opts->log_prefix != NULL) ? opts->log_prefix : "async_sender");
+  s->node = strdup(opts->node);
+  s->service = strdup(opts->service);
+  s->socktype = opts->socktype;
+  s->buffer_size = opts->buffer_size;
+  s->reconnect_interval = opts->reconnect_interval;
+  s->resolve_interval = opts->resolve_interval;
+  s->resolve_jitter = opts->resolve_jitter;
+  s->log_send_errors = opts->log_send_errors;
+
+  s->queue_length = opts->queue_length;
+  s->queue = calloc(s->queue_length, sizeof(*s->queue));
+  if ((s->log_prefix == NULL) || (s->node == NULL) || (s->service == NULL) ||
+      (s->queue == NULL)) {
+    async_sender_destroy(s);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < s->queue_length; i++) {
+    s->queue[i].data = malloc(s->buffer_size);
+    if (s->queue[i].data == NULL) {
+      async_sender_destroy(s);
+      return NULL;
+    }
+  }
+
+  if (pipe(s->wakeup_fd) != 0) {
+    ERROR("%s: pipe failed: %s", s->log_prefix, STRERRNO);
+    s->wakeup_fd[0] = s->wakeup_fd[1] = -1;
+    async_sender_destroy(s);
+    return NULL;
+  }
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(s->wakeup_fd); i++) {
+    int flags = fcntl(s->wakeup_fd[i], F_GETFL);
+    fcntl(s->wakeup_fd[i], F_SETFL, flags | O_NONBLOCK);
+  }
+
+  return s;
+} /* async_sender_t *async_sender_create */
+
+int async_sender_enqueue(async_sender_t *s, void const *data, size_t size) {
+  if ((s == NULL) || (data == NULL))
+    return EINVAL;
+  if (size == 0)
+    return 0;
+  if (size > s->buffer_size)
+    return EINVAL;
+
+  pthread_mutex_lock(&s->lock);
+
+  if (!s->thread_running && !s->shutdown) {
+    int status = plugin_thread_create(&s->thread, as_thread, s, "async sender");
+    if (status != 0) {
+      ERROR("%s: Starting the sender thread failed: %s", s->log_prefix,
+            STRERROR(status));
+      s->dropped_bytes += (uint64_t)size;
+      pthread_mutex_unlock(&s->lock);
+      return status;
+    }
+    s->thread_running = true;
+  }
+
+  if (s->queue_num >= s->queue_length) {
+    s->dropped_bytes += (uint64_t)size;
+    c_complain(LOG_WARNING, &s->queue_complaint,
+               "%s: The send queue for %s:%s is full. Dropping data.",
+               s->log_prefix, s->node, s->service);
+    pthread_mutex_unlock(&s->lock);
+    return ENOBUFS;
+  }
+  c_release(LOG_INFO, &s->queue_complaint,
+            "%s: The send queue for %s:%s accepts data again.", s->log_prefix,
+            s->node, s->service);
+
+  size_t tail = (s->queue_head + s->queue_num) % s->queue_length;
+  as_buffer_t *b = s->queue + tail;
+  memcpy(b->data, data, size);
+  b->size = size;
+  s->queue_num++;
+
+  bool wakeup = !s->wakeup_pending;
+  s->wakeup_pending = true;
+
+  pthread_mutex_unlock(&s->lock);
+
+  if (wakeup)
+    as_wakeup(s);
+
+  return 0;
+} /* int async_sender_enqueue */
+
+void async_sender_stats(async_sender_t *s, async_sender_stats_t *ret) {
+  pthread_mutex_lock(&s->lock);
+  *ret = (async_sender_stats_t){
+      .sent_bytes = s->sent_bytes,
+      .dropped_bytes = s->dropped_bytes,
+      .queue_length = s->queue_num,
+  };
+  pthread_mutex_unlock(&s->lock);
+}
+
+void async_sender_dispatch_stats(async_sender_t *s, char const *plugin,
+                                 char const *plugin_instance) {
+  async_sender_stats_t stats;
+  value_list_t vl = VALUE_LIST_INIT;
+
+  async_sender_stats(s, &stats);
+
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, plugin, sizeof(vl.plugin));
+  if (plugin_instance != NULL)
+    sstrncpy(vl.plugin_instance, plugin_instance, sizeof(vl.plugin_instance));
+
+  vl.values = &(value_t){.derive = (derive_t)stats.sent_bytes};
+  sstrncpy(vl.type, "total_bytes", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "sent", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.derive = (derive_t)stats.dropped_bytes};
+  sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values = &(value_t){.gauge = (gauge_t)stats.queue_length};
+  sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+  vl.type_instance[0] = 0;
+  plugin_dispatch_values(&vl);
+}
+
+void async_sender_destroy(async_sender_t *s) {
+  if (s == NULL)
+    return;
+
+  pthread_mutex_lock(&s->lock);
+  s->shutdown = true;
+  bool thread_running = s->thread_running;
+  pthread_mutex_unlock(&s->lock);
+
+  if (thread_running) {
+    as_wakeup(s);
+    pthread_join(s->thread, NULL);
+    s->thread_running = false;
+  }
+  as_close(s);
+
+  /* Whatever is still queued is lost. */
+  for (size_t i = 0; i < s->queue_num; i++)
+    s->dropped_bytes +=
+        (uint64_t)s->queue[(s->queue_head + i) % s->queue_length].size;
+  s->queue_num = 0;
+
+  if (s->dropped_bytes > 0)
+    WARNING("%s: Dropped %" PRIu64 " bytes that could not be sent to %s:%s.",
+            s->log_prefix, s->dropped_bytes, s->node, s->service);
+
+  if (s->ai_list != NULL)
+    freeaddrinfo(s->ai_list);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(s->wakeup_fd); i++)
+    if (s->wakeup_fd[i] >= 0)
+      close(s->wakeup_fd[i]);
+
+  if (s->queue != NULL) {
+    for (size_t i = 0; i < s->queue_length; i++)
+      sfree(s->queue[i].data);
+    sfree(s->queue);
+  }
+
+  sfree(s->log_prefix);
+  sfree(s->node);
+  sfree(s->service);
+  pthread_mutex_destroy(&s->lock);
+  sfree(s);
+} /* void async_sender_destroy */
@@ -0,0 +1,130 @@
+/**
+ * collectd - src/utils/async_sender/async_sender.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#ifndef UTILS_ASYNC_SENDER_H
+#define UTILS_ASYNC_SENDER_H 1
+
+#include "collectd.h"
+
+#include "utils_time.h"
+
+/* An async_sender_t owns a socket and a thread that writes queued buffers to
+ * it. Write callbacks only copy their data into a bounded ring of buffers, so
+ * a slow or unreachable server never blocks them: connecting, resolving and
+ * sending are all done by the sender thread. When the ring is full, new
+ * buffers are dropped and counted. On stream sockets, the connection is kept
+ * open and up to 64 queued buffers are written with one system call. */
+struct async_sender_s;
+typedef struct async_sender_s async_sender_t;
+
+typedef struct {
+  /* Prefix of log messages, e.g. "write_graphite plugin". */
+  char const *log_prefix;
+
+  char const *node;
+  char const *service;
+  int socktype; /* SOCK_STREAM or SOCK_DGRAM */
+
+  /* Largest buffer that can be queued and the number of queued buffers. */
+  size_t buffer_size;
+  size_t queue_length;
+
+  /* Close the connection after it has been open for this long, e.g. to
+   * spread load over a set of servers behind a load balancer. Zero
+   * disables forced reconnects. */
+  cdtime_t reconnect_interval;
+
+  /* Reuse resolved addresses for "resolve_interval" plus a random value of
+   * up to "resolve_jitter". Zero resolves the address for every connection
+   * attempt. */
+  cdtime_t resolve_interval;
+  cdtime_t resolve_jitter;
+
+  bool log_send_errors;
+} async_sender_options_t;
+
+typedef struct {
+  uint64_t sent_bytes;
+  uint64_t dropped_bytes;
+  size_t queue_length;
+} async_sender_stats_t;
+
+/*
+ * NAME
+ *   async_sender_create
+ *
+ * DESCRIPTION
+ *   Allocates a sender. Strings in "opts" are copied. The sender thread is
+ *   started by the first call to async_sender_enqueue(), i.e. after the daemon
+ *   has forked.
+ */
+async_sender_t *async_sender_create(async_sender_options_t const *opts);
+
+/*
+ * NAME
+ *   async_sender_enqueue
+ *
+ * DESCRIPTION
+ *   Copies "size" bytes at "data" into the send queue. The data is written to
+ *   the socket as one unit, so a buffer should contain complete lines. Returns
+ *   ENOBUFS if the queue is full and the data has been dropped, and EINVAL if
+ *   "size" exceeds the buffer size.
+ */
+int async_sender_enqueue(async_sender_t *s, void const *data, size_t size);
+
+/*
+ * NAME
+ *   async_sender_stats
+ *
+ * DESCRIPTION
+ *   Returns the number of bytes sent and dropped since the sender has been
+ *   created and the number of buffers currently queued.
+ */
+void async_sender_stats(async_sender_t *s, async_sender_stats_t *ret);
+
+/*
+ * NAME
+ *   async_sender_dispatch_stats
+ *
+ * DESCRIPTION
+ *   Dispatches the statistics of the sender as "total_bytes-sent",
+ *   "total_bytes-dropped" and "queue_length" value lists.
+ */
+void async_sender_dispatch_stats(async_sender_t *s, char const *plugin,
+                                 char const *plugin_instance);
+
+/*
+ * NAME
+ *   async_sender_destroy
+ *
+ * DESCRIPTION
+ *   Stops the sender thread. Buffers that are still queued are sent if the
+ *   connection is up and this takes less than a few seconds; the remaining
+ *   data is dropped.
+ */
+void async_sender_destroy(async_sender_t *s);
+
+#endif /* UTILS_ASYNC_SENDER_H */
@@ -25,6 +25,7 @@
  **/
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 
 #include "utils/avltree/avltree.h"
@@ -47,10 +48,28 @@ struct c_avl_node_s {
 };
 typedef struct c_avl_node_s c_avl_node_t;
 
+/* Nodes are allocated in chunks, so that nodes inserted one after another are
+ * close to each other in memory and insertions rarely call malloc(). Removed
+ * nodes are kept in a free list, linked via their "parent" pointer, and are
+ * reused by later insertions. Chunks are only freed with the tree. */
+#define C_AVL_CHUNK_MIN 16
+#define C_AVL_CHUNK_MAX 1024
+
+struct c_avl_chunk_s {
+  struct c_avl_chunk_s *next;
+  size_t size;
+  size_t used;
+  c_avl_node_t nodes[];
+};
+typedef struct c_avl_chunk_s c_avl_chunk_t;
+
 struct c_avl_tree_s {
   c_avl_node_t *root;
   int (*compare)(const void *, const void *);
   int size;
+
+  c_avl_chunk_t *chunks; /* the first chunk is the one being filled */
+  c_avl_node_t *free_nodes;
 };
 
 struct c_avl_iterator_s {
@@ -77,16 +96,43 @@ static void verify_tree (c_avl_node_t *n)
 #define verify_tree(n) /**/
 #endif
 
-static void free_node(c_avl_node_t *n) {
-  if (n == NULL)
-    return;
+static c_avl_chunk_t *chunk_create(c_avl_tree_t *t, size_t size) {
+  c_avl_chunk_t *c = malloc(sizeof(*c) + size * sizeof(c->nodes[0]));
+  if (c == NULL)
+    return NULL;
+
+  c->size = size;
+  c->used = 0;
+  c->next = t->chunks;
+  t->chunks = c;
+  return c;
+}
 
-  if (n->left != NULL)
-    free_node(n->left);
-  if (n->right != NULL)
-    free_node(n->right);
+static c_avl_node_t *alloc_node(c_avl_tree_t *t) {
+  c_avl_node_t *n = t->free_nodes;
+  if (n != NULL) {
+    t->free_nodes = n->parent;
+    return n;
+  }
 
-  free(n);
+  c_avl_chunk_t *c = t->chunks;
+  if ((c == NULL) || (c->used >= c->size)) {
+    /* Grow the chunks with the tree. */
+    size_t size = (c == NULL) ? C_AVL_CHUNK_MIN : 2 * c->size;
+    if (size > C_AVL_CHUNK_MAX)
+      size = C_AVL_CHUNK_MAX;
+
+    c = chunk_create(t, size);
+    if (c == NULL)
+      return NULL;
+  }
+
+  return c->nodes + c->used++;
+}
+
+static void free_node(c_avl_tree_t *t, c_avl_node_t *n) {
+  n->parent = t->free_nodes;
+  t->free_nodes = n;
 }
 
 static int calc_height(c_avl_node_t *n) {
@@ -366,7 +412,7 @@ static int _remove(c_avl_tree_t *t, c_avl_node_t *n) {
       rebalance(t, n->parent);
     }
 
-    free_node(n);
+    free_node(t, n);
   } else if (n->left == NULL) {
     assert(BALANCE(n) == -1);
     assert((n->parent == NULL) || (n->parent->left == n) ||
@@ -385,7 +431,7 @@ static int _remove(c_avl_tree_t *t, c_avl_node_t *n) {
       rebalance(t, n->parent);
 
     n->right = NULL;
-    free_node(n);
+    free_node(t, n);
   } else if (n->right == NULL) {
     assert(BALANCE(n) == 1);
     assert((n->parent == NULL) || (n->parent->left == n) ||
@@ -404,7 +450,7 @@ static int _remove(c_avl_tree_t *t, c_avl_node_t *n) {
       rebalance(t, n->parent);
 
     n->left = NULL;
-    free_node(n);
+    free_node(t, n);
   } else {
     assert(0);
   }
@@ -427,6 +473,8 @@ c_avl_tree_t *c_avl_create(int (*compare)(const void *, const void *)) {
   t->root = NULL;
   t->compare = compare;
   t->size = 0;
+  t->chunks = NULL;
+  t->free_nodes = NULL;
 
   return t;
 }
@@ -434,16 +482,65 @@ c_avl_tree_t *c_avl_create(int (*compare)(const void *, const void *)) {
 void c_avl_destroy(c_avl_tree_t *t) {
   if (t == NULL)
     return;
-  free_node(t->root);
+
+  while (t->chunks != NULL) {
+    c_avl_chunk_t *next = t->chunks->next;
+    free(t->chunks);
+    t->chunks = next;
+  }
   free(t);
 }
 
+/* Builds a balanced subtree of the "num" entries starting at "first". */
+static c_avl_node_t *build(c_avl_node_t *nodes, void **keys, void **values,
+                           size_t first, size_t num, c_avl_node_t *parent) {
+  if (num == 0)
+    return NULL;
+
+  size_t mid = first + num / 2;
+  c_avl_node_t *n = nodes + mid;
+
+  n->key = keys[mid];
+  n->value = values[mid];
+  n->parent = parent;
+  n->left = build(nodes, keys, values, first, mid - first, n);
+  n->right = build(nodes, keys, values, mid + 1, first + num - (mid + 1), n);
+  n->height = calc_height(n);
+
+  return n;
+}
+
+int c_avl_build(c_avl_tree_t *t, void **keys, void **values, size_t num) {
+  if ((t == NULL) || (keys == NULL) || (values == NULL) || (t->size != 0) ||
+      (num > INT_MAX))
+    return -1;
+
+  for (size_t i = 1; i < num; i++)
+    if (t->compare(keys[i - 1], keys[i]) >= 0)
+      return -1;
+
+  if (num == 0)
+    return 0;
+
+  /* Use one chunk, in key order, for all nodes. */
+  c_avl_chunk_t *c = chunk_create(t, num);
+  if (c == NULL)
+    return -1;
+  c->used = num;
+
+  t->root = build(c->nodes, keys, values, 0, num, NULL);
+  t->size = (int)num;
+
+  verify_tree(t->root);
+  return 0;
+} /* int c_avl_build */
+
 int c_avl_insert(c_avl_tree_t *t, void *key, void *value) {
   c_avl_node_t *new;
   c_avl_node_t *nptr;
   int cmp;
 
-  if ((new = malloc(sizeof(*new))) == NULL)
+  if ((new = alloc_node(t)) == NULL)
     return -1;
 
   new->key = key;
@@ -463,7 +560,7 @@ int c_avl_insert(c_avl_tree_t *t, void *key, void *value) {
   while (42) {
     cmp = t->compare(nptr->key, new->key);
     if (cmp == 0) {
-      free_node(new);
+      free_node(t, new);
       return 1;
     } else if (cmp < 0) {
       /* nptr < new */
@@ -568,7 +665,7 @@ int c_avl_pick(c_avl_tree_t *t, void **key, void **value) {
   *key = n->key;
   *value = n->value;
 
-  free_node(n);
+  free_node(t, n);
   --t->size;
   rebalance(t, p);
 
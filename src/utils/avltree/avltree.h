@@ -27,6 +27,8 @@
 #ifndef UTILS_AVLTREE_H
 #define UTILS_AVLTREE_H 1
 
+#include <stddef.h>
+
 struct c_avl_tree_s;
 typedef struct c_avl_tree_s c_avl_tree_t;
 
@@ -85,6 +87,29 @@ void c_avl_destroy(c_avl_tree_t *t);
  */
 int c_avl_insert(c_avl_tree_t *t, void *key, void *value);
 
+/*
+ * NAME
+ *   c_avl_build
+ *
+ * DESCRIPTION
+ *   Fills an empty AVL-tree with `num' key-value-pairs at once. This is faster
+ *   than inserting the pairs one by one and places the nodes next to each
+ *   other in memory, in key order.
+ *
+ * PARAMETERS
+ *   `t'        Empty AVL-tree to store the data in.
+ *   `keys'     Array of `num' keys, sorted in ascending order according to the
+ *              tree's compare function. Keys must be unique. As with
+ *              `c_avl_insert', the keys are not copied.
+ *   `values'   Array of `num' values, `values[i]' belonging to `keys[i]'.
+ *   `num'      Number of key-value-pairs.
+ *
+ * RETURN VALUE
+ *   Zero upon success, non-zero if the tree is not empty, the keys are not
+ *   sorted and unique, or memory could not be allocated.
+ */
+int c_avl_build(c_avl_tree_t *t, void **keys, void **values, size_t num);
+
 /*
  * NAME
  *   c_avl_remove
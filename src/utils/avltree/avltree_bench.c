@@ -0,0 +1,176 @@
+/**
+ * collectd - src/utils/avltree/avltree_bench.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+#include "utils/common/common.h" /* STATIC_ARRAY_SIZE */
+
+#include "benchmark.h"
+#include "utils/avltree/avltree.h"
+
+static int compare_string(void const *a, void const *b) {
+  return strcmp(a, b);
+}
+
+/* Returns "num" distinct keys in a random, but reproducible, order. */
+static char **create_keys(size_t num) {
+  char **keys = calloc(num, sizeof(*keys));
+  if (keys == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < num; i++) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "host%zu/plugin/type-%zu", i % 1000, i);
+    keys[i] = strdup(buffer);
+  }
+
+  uint32_t seed = 42;
+  for (size_t i = num - 1; i > 0; i--) {
+    seed = seed * 1103515245 + 12345;
+    size_t j = (size_t)(seed >> 8) % (i + 1);
+    char *tmp = keys[i];
+    keys[i] = keys[j];
+    keys[j] = tmp;
+  }
+
+  return keys;
+}
+
+static void destroy_keys(char **keys, size_t num) {
+  for (size_t i = 0; i < num; i++)
+    free(keys[i]);
+  free(keys);
+}
+
+static c_avl_tree_t *create_tree(char **keys, size_t num) {
+  c_avl_tree_t *t = c_avl_create(compare_string);
+  for (size_t i = 0; (t != NULL) && (i < num); i++)
+    c_avl_insert(t, keys[i], NULL);
+  return t;
+}
+
+DEF_BENCH(c_avl_insert) {
+  char **keys = create_keys(b->size);
+  if (keys == NULL)
+    return -1;
+
+  BENCH_RESET_TIMER(b);
+  c_avl_tree_t *t = c_avl_create(compare_string);
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    size_t idx = (size_t)(i % b->size);
+    if ((idx == 0) && (i != 0)) {
+      BENCH_STOP_TIMER(b);
+      c_avl_destroy(t);
+      t = c_avl_create(compare_string);
+      BENCH_START_TIMER(b);
+    }
+    c_avl_insert(t, keys[idx], NULL);
+  }
+  BENCH_STOP_TIMER(b);
+
+  c_avl_destroy(t);
+  destroy_keys(keys, b->size);
+  return 0;
+}
+
+DEF_BENCH(c_avl_get) {
+  char **keys = create_keys(b->size);
+  if (keys == NULL)
+    return -1;
+  c_avl_tree_t *t = create_tree(keys, b->size);
+  int found = 0;
+
+  BENCH_RESET_TIMER(b);
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    /* Look up the keys in a different order than they were inserted. */
+    size_t idx = (size_t)((i * 7919) % b->size);
+    if (c_avl_get(t, keys[idx], NULL) == 0)
+      found++;
+  }
+  BENCH_STOP_TIMER(b);
+
+  c_avl_destroy(t);
+  destroy_keys(keys, b->size);
+  return ((uint64_t)found == b->iterations) ? 0 : -1;
+}
+
+/* Removes one key and inserts it again, like series that come and go. */
+DEF_BENCH(c_avl_remove_insert) {
+  char **keys = create_keys(b->size);
+  if (keys == NULL)
+    return -1;
+  c_avl_tree_t *t = create_tree(keys, b->size);
+  int status = 0;
+
+  BENCH_RESET_TIMER(b);
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    size_t idx = (size_t)((i * 7919) % b->size);
+    status |= c_avl_remove(t, keys[idx], NULL, NULL);
+    status |= c_avl_insert(t, keys[idx], NULL);
+  }
+  BENCH_STOP_TIMER(b);
+
+  c_avl_destroy(t);
+  destroy_keys(keys, b->size);
+  return status;
+}
+
+/* Iterates over the whole tree; one operation is one element. */
+DEF_BENCH(c_avl_iterator) {
+  char **keys = create_keys(b->size);
+  if (keys == NULL)
+    return -1;
+  c_avl_tree_t *t = create_tree(keys, b->size);
+  uint64_t n = 0;
+
+  BENCH_RESET_TIMER(b);
+  while (n < b->iterations) {
+    c_avl_iterator_t *iter = c_avl_get_iterator(t);
+    void *key;
+    void *value;
+    while ((n < b->iterations) &&
+           (c_avl_iterator_next(iter, &key, &value) == 0))
+      n++;
+    c_avl_iterator_destroy(iter);
+  }
+  BENCH_STOP_TIMER(b);
+
+  c_avl_destroy(t);
+  destroy_keys(keys, b->size);
+  return 0;
+}
+
+int main(void) {
+  size_t sizes[] = {1000, 100000};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sizes); i++) {
+    RUN_BENCH(c_avl_insert, sizes[i]);
+    RUN_BENCH(c_avl_get, sizes[i]);
+    RUN_BENCH(c_avl_remove_insert, sizes[i]);
+    RUN_BENCH(c_avl_iterator, sizes[i]);
+  }
+
+  END_BENCH;
+}
@@ -173,8 +173,69 @@ DEF_TEST(success) {
   return 0;
 }
 
+DEF_TEST(build) {
+  char *keys[100];
+  char *values[100];
+  char buffer[16];
+  c_avl_tree_t *t;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(keys); i++) {
+    snprintf(buffer, sizeof(buffer), "%03zu", i);
+    CHECK_NOT_NULL(keys[i] = strdup(buffer));
+    values[i] = keys[i];
+  }
+
+  CHECK_NOT_NULL(t = c_avl_create(compare_callback));
+
+  /* Keys must be sorted. */
+  char *unsorted[] = {keys[1], keys[0]};
+  OK(c_avl_build(t, (void **)unsorted, (void **)unsorted, 2) != 0);
+  EXPECT_EQ_INT(0, c_avl_size(t));
+
+  CHECK_ZERO(c_avl_build(t, (void **)keys, (void **)values,
+                         STATIC_ARRAY_SIZE(keys)));
+  EXPECT_EQ_INT((int)STATIC_ARRAY_SIZE(keys), c_avl_size(t));
+
+  /* Only empty trees can be built. */
+  OK(c_avl_build(t, (void **)keys, (void **)values, 1) != 0);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(keys); i++) {
+    char *value = NULL;
+    CHECK_ZERO(c_avl_get(t, keys[i], (void *)&value));
+    EXPECT_EQ_STR(keys[i], value);
+  }
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(t);
+  char *key;
+  char *value;
+  size_t i = 0;
+  while (c_avl_iterator_next(iter, (void **)&key, (void **)&value) == 0) {
+    EXPECT_EQ_STR(keys[i], key);
+    i++;
+  }
+  c_avl_iterator_destroy(iter);
+  EXPECT_EQ_INT((int)STATIC_ARRAY_SIZE(keys), (int)i);
+
+  /* Removed nodes are reused by later insertions. */
+  for (i = 0; i < STATIC_ARRAY_SIZE(keys); i += 2)
+    CHECK_ZERO(c_avl_remove(t, keys[i], NULL, NULL));
+  EXPECT_EQ_INT((int)STATIC_ARRAY_SIZE(keys) / 2, c_avl_size(t));
+  for (i = 0; i < STATIC_ARRAY_SIZE(keys); i += 2)
+    CHECK_ZERO(c_avl_insert(t, keys[i], values[i]));
+  EXPECT_EQ_INT((int)STATIC_ARRAY_SIZE(keys), c_avl_size(t));
+  for (i = 0; i < STATIC_ARRAY_SIZE(keys); i++)
+    CHECK_ZERO(c_avl_get(t, keys[i], NULL));
+
+  c_avl_destroy(t);
+  for (i = 0; i < STATIC_ARRAY_SIZE(keys); i++)
+    free(keys[i]);
+
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(success);
+  RUN_TEST(build);
 
   END_TEST;
 }
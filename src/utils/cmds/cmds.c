@@ -204,6 +204,10 @@ cmd_status_t cmd_parsev(size_t argc, char **argv, cmd_t *ret_cmd,
     ret_cmd->type = CMD_GETVAL;
     status =
         cmd_parse_getval(argc - 1, argv + 1, &ret_cmd->cmd.getval, opts, err);
+  } else if (strcasecmp("GETVALS", command) == 0) {
+    ret_cmd->type = CMD_GETVALS;
+    status = cmd_parse_getvals(argc - 1, argv + 1, &ret_cmd->cmd.getvals, opts,
+                               err);
   } else if (strcasecmp("LISTVAL", command) == 0) {
     ret_cmd->type = CMD_LISTVAL;
     status = cmd_parse_listval(argc - 1, argv + 1, opts, err);
@@ -250,6 +254,9 @@ void cmd_destroy(cmd_t *cmd) {
   case CMD_GETVAL:
     cmd_destroy_getval(&cmd->cmd.getval);
     break;
+  case CMD_GETVALS:
+    cmd_destroy_getvals(&cmd->cmd.getvals);
+    break;
   case CMD_LISTVAL:
     break;
   case CMD_PUTVAL:
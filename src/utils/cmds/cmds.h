@@ -37,6 +37,7 @@ typedef enum {
   CMD_GETVAL = 2,
   CMD_LISTVAL = 3,
   CMD_PUTVAL = 4,
+  CMD_GETVALS = 5,
 } cmd_type_t;
 #define CMD_TO_STRING(type)                                                    \
   ((type) == CMD_FLUSH)                                                        \
@@ -45,10 +46,14 @@ typedef enum {
             ? "GETVAL"                                                         \
             : ((type) == CMD_LISTVAL)                                          \
                   ? "LISTVAL"                                                  \
-                  : ((type) == CMD_PUTVAL) ? "PUTVAL" : "UNKNOWN"
+                  : ((type) == CMD_PUTVAL)                                     \
+                        ? "PUTVAL"                                             \
+                        : ((type) == CMD_GETVALS) ? "GETVALS" : "UNKNOWN"
 
 typedef struct {
   double timeout;
+  /* Seconds to wait for the flush callbacks; zero means no limit. */
+  double deadline;
 
   char **plugins;
   size_t plugins_num;
@@ -61,6 +66,13 @@ typedef struct {
   identifier_t identifier;
 } cmd_getval_t;
 
+typedef struct {
+  /* Identifiers, which may contain shell wildcards. The host is filled in
+   * from "identifier_default_host" if it was omitted. */
+  char **patterns;
+  size_t patterns_num;
+} cmd_getvals_t;
+
 typedef struct {
   /* The raw identifier as provided by the user. */
   char *raw_identifier;
@@ -83,6 +95,7 @@ typedef struct {
   union {
     cmd_flush_t flush;
     cmd_getval_t getval;
+    cmd_getvals_t getvals;
     cmd_putval_t putval;
   } cmd;
 } cmd_t;
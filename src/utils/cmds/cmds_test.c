@@ -32,8 +32,13 @@
 #include "utils/common/common.h"
 #include "testing.h"
 #include "utils/cmds/cmds.h"
+#include "utils/cmds/putbin.h"
 // clang-format on
 
+#if HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
 static void error_cb(void *ud, cmd_status_t status, const char *format,
                      va_list ap) {
   if (status == CMD_OK)
@@ -80,6 +85,12 @@ static struct {
         CMD_OK,
         CMD_FLUSH,
     },
+    {
+        "FLUSH deadline=2.5",
+        NULL,
+        CMD_OK,
+        CMD_FLUSH,
+    },
     /* Invalid FLUSH commands. */
     {
         /* Missing hostname; no default. */
@@ -102,6 +113,13 @@ static struct {
         CMD_PARSE_ERROR,
         CMD_UNKNOWN,
     },
+    {
+        /* Invalid deadline. */
+        "FLUSH deadline=-1",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
     {
         /* Invalid identifier. */
         "FLUSH identifier=invalid",
@@ -151,6 +169,40 @@ static struct {
         CMD_UNKNOWN,
     },
 
+    /* Valid GETVALS commands. */
+    {
+        "GETVALS myhost/magic/MAGIC",
+        NULL,
+        CMD_OK,
+        CMD_GETVALS,
+    },
+    {
+        "GETVALS myhost/magic/MAGIC \"other host/*/*\" magic/MAGIC-?",
+        &default_host_opts,
+        CMD_OK,
+        CMD_GETVALS,
+    },
+
+    /* Invalid GETVALS commands. */
+    {
+        "GETVALS",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
+    {
+        "GETVALS myhost/magic/MAGIC magic/MAGIC",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
+    {
+        "GETVALS myhost/*/*/*",
+        NULL,
+        CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
+
     /* Valid LISTVAL commands. */
     {
         "LISTVAL",
@@ -330,7 +382,142 @@ DEF_TEST(parse) {
   return test_result;
 }
 
+static size_t putbin_add_part(char *buffer, uint16_t type, void const *payload,
+                              size_t payload_size) {
+  uint16_t tmp;
+
+  tmp = htons(type);
+  memcpy(buffer, &tmp, sizeof(tmp));
+  tmp = htons((uint16_t)(payload_size + 2 * sizeof(tmp)));
+  memcpy(buffer + sizeof(tmp), &tmp, sizeof(tmp));
+  memcpy(buffer + 2 * sizeof(tmp), payload, payload_size);
+
+  return payload_size + 2 * sizeof(tmp);
+}
+
+static size_t putbin_add_gauge(char *buffer, gauge_t g) {
+  char payload[sizeof(uint16_t) + sizeof(uint8_t) + sizeof(value_t)];
+  uint16_t num = htons(1);
+  value_t v = {.gauge = htond(g)};
+
+  memcpy(payload, &num, sizeof(num));
+  payload[sizeof(num)] = DS_TYPE_GAUGE;
+  memcpy(payload + sizeof(num) + 1, &v, sizeof(v));
+
+  return putbin_add_part(buffer, 0x0006, payload, sizeof(payload));
+}
+
+typedef struct {
+  int num;
+  gauge_t sum;
+  char last_host[DATA_MAX_NAME_LEN];
+  char last_type_instance[DATA_MAX_NAME_LEN];
+  cdtime_t last_time;
+} putbin_result_t;
+
+static int putbin_cb(value_list_t const *vl, void *user_data) {
+  putbin_result_t *r = user_data;
+
+  r->num++;
+  r->sum += vl->values[0].gauge;
+  sstrncpy(r->last_host, vl->host, sizeof(r->last_host));
+  sstrncpy(r->last_type_instance, vl->type_instance,
+           sizeof(r->last_type_instance));
+  r->last_time = vl->time;
+  return 0;
+}
+
+DEF_TEST(parse_putbin) {
+  cmd_error_handler_t err = {error_cb, NULL};
+  char buffer[1024];
+  size_t size = 0;
+  uint64_t t = htonll(TIME_T_TO_CDTIME_T(1480063672));
+
+  size += putbin_add_part(buffer + size, 0x0000, "example.com",
+                          sizeof("example.com"));
+  size += putbin_add_part(buffer + size, 0x0008, &t, sizeof(t));
+  size += putbin_add_part(buffer + size, 0x0002, "test", sizeof("test"));
+  size += putbin_add_part(buffer + size, 0x0004, "gauge", sizeof("gauge"));
+  size += putbin_add_part(buffer + size, 0x0005, "a", sizeof("a"));
+  size += putbin_add_gauge(buffer + size, 1.5);
+  /* Unknown parts are skipped. */
+  size += putbin_add_part(buffer + size, 0x0100, "x", sizeof("x"));
+  size += putbin_add_part(buffer + size, 0x0005, "b", sizeof("b"));
+  size += putbin_add_gauge(buffer + size, 40.5);
+
+  putbin_result_t r = {0};
+  EXPECT_EQ_INT(CMD_OK, cmd_parse_putbin(buffer, size, putbin_cb, &r, &err));
+  EXPECT_EQ_INT(2, r.num);
+  EXPECT_EQ_DOUBLE(42.0, r.sum);
+  EXPECT_EQ_STR("example.com", r.last_host);
+  EXPECT_EQ_STR("b", r.last_type_instance);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(1480063672), r.last_time);
+
+  /* A truncated frame is an error. */
+  memset(&r, 0, sizeof(r));
+  EXPECT_EQ_INT(CMD_PARSE_ERROR,
+                cmd_parse_putbin(buffer, size - 1, putbin_cb, &r, &err));
+  EXPECT_EQ_INT(1, r.num);
+
+  /* Strings must be null-terminated. */
+  size = putbin_add_part(buffer, 0x0000, "abc", 3);
+  EXPECT_EQ_INT(CMD_PARSE_ERROR,
+                cmd_parse_putbin(buffer, size, putbin_cb, &r, &err));
+
+  return 0;
+}
+
+DEF_TEST(create_putbin) {
+  cmd_error_handler_t err = {error_cb, NULL};
+  data_source_t dsrc[] = {{"value", DS_TYPE_GAUGE, NAN, NAN}};
+  data_set_t ds = {"gauge", STATIC_ARRAY_SIZE(dsrc), dsrc};
+  char buffer[1024];
+  size_t size = 0;
+
+  value_list_t prev = VALUE_LIST_INIT;
+  for (int i = 0; i < 3; i++) {
+    value_list_t vl = {
+        .values = &(value_t){.gauge = 10.0 * (i + 1)},
+        .values_len = 1,
+        .time = TIME_T_TO_CDTIME_T(1480063672),
+        .interval = TIME_T_TO_CDTIME_T(10),
+    };
+    sstrncpy(vl.host, "example.com", sizeof(vl.host));
+    sstrncpy(vl.plugin, "test", sizeof(vl.plugin));
+    sstrncpy(vl.type, "gauge", sizeof(vl.type));
+    snprintf(vl.type_instance, sizeof(vl.type_instance), "%c", 'a' + i);
+
+    ssize_t n = cmd_create_putbin(buffer + size, sizeof(buffer) - size, &ds,
+                                  &vl, (i == 0) ? NULL : &prev);
+    OK(n > 0);
+    size += (size_t)n;
+    prev = vl;
+  }
+
+  /* Only the type instance and values are repeated. */
+  size_t first = 4 + sizeof("example.com") + 2 * (4 + 8) + 4 + sizeof("test") +
+                 4 + sizeof("") + 4 + sizeof("gauge") + 4 + sizeof("a") + 4 +
+                 2 + 1 + 8;
+  EXPECT_EQ_UINT64(first + 2 * (4 + sizeof("b") + 4 + 2 + 1 + 8), size);
+
+  putbin_result_t r = {0};
+  EXPECT_EQ_INT(CMD_OK, cmd_parse_putbin(buffer, size, putbin_cb, &r, &err));
+  EXPECT_EQ_INT(3, r.num);
+  EXPECT_EQ_DOUBLE(60.0, r.sum);
+  EXPECT_EQ_STR("example.com", r.last_host);
+  EXPECT_EQ_STR("c", r.last_type_instance);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(1480063672), r.last_time);
+
+  /* The value list doesn't fit. */
+  value_list_t vl = prev;
+  EXPECT_EQ_INT(-1, (int)cmd_create_putbin(buffer, first - 1, &ds, &vl, NULL));
+
+  return 0;
+}
+
 int main(int argc, char **argv) {
   RUN_TEST(parse);
+  RUN_TEST(parse_putbin);
+  RUN_TEST(create_putbin);
   END_TEST;
 }
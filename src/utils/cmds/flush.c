@@ -95,6 +95,20 @@ cmd_status_t cmd_parse_flush(size_t argc, char **argv, cmd_flush_t *ret_flush,
       } else if (ret_flush->timeout < 0.0) {
         ret_flush->timeout = 0.0;
       }
+    } else if (strcasecmp("deadline", opt_key) == 0) {
+      char *endptr;
+
+      errno = 0;
+      endptr = NULL;
+      ret_flush->deadline = strtod(opt_value, &endptr);
+
+      if ((endptr == opt_value) || (errno != 0) ||
+          (!isfinite(ret_flush->deadline)) || (ret_flush->deadline < 0.0)) {
+        cmd_error(CMD_PARSE_ERROR, err,
+                  "Invalid value for option `deadline': %s", opt_value);
+        cmd_destroy_flush(ret_flush);
+        return CMD_PARSE_ERROR;
+      }
     } else {
       cmd_error(CMD_PARSE_ERROR, err, "Cannot parse option `%s'.", opt_key);
       cmd_destroy_flush(ret_flush);
@@ -128,6 +142,11 @@ cmd_status_t cmd_handle_flush(FILE *fh, char *buffer) {
     return CMD_UNKNOWN_COMMAND;
   }
 
+  /* All flushes of this command share the deadline. */
+  cdtime_t deadline = 0;
+  if (cmd.cmd.flush.deadline > 0.0)
+    deadline = cdtime() + DOUBLE_TO_CDTIME_T(cmd.cmd.flush.deadline);
+
   for (size_t i = 0; (i == 0) || (i < cmd.cmd.flush.plugins_num); i++) {
     char *plugin = NULL;
 
@@ -149,8 +168,9 @@ cmd_status_t cmd_handle_flush(FILE *fh, char *buffer) {
         identifier = buf;
       }
 
-      if (plugin_flush(plugin, DOUBLE_TO_CDTIME_T(cmd.cmd.flush.timeout),
-                       identifier) == 0)
+      if (plugin_flush_deadline(plugin,
+                                DOUBLE_TO_CDTIME_T(cmd.cmd.flush.timeout),
+                                identifier, deadline) == 0)
         success++;
       else
         error++;
@@ -82,7 +82,6 @@ cmd_status_t cmd_parse_getval(size_t argc, char **argv,
               fileno(fh), STRERRNO);                                           \
       return -1;                                                               \
     }                                                                          \
-    fflush(fh);                                                                \
   } while (0)
 
 cmd_status_t cmd_handle_getval(FILE *fh, char *buffer) {
@@ -150,6 +149,7 @@ cmd_status_t cmd_handle_getval(FILE *fh, char *buffer) {
       print_to_socket(fh, "%12e\n", values[i]);
     }
   }
+  fflush(fh);
 
   sfree(values);
   cmd_destroy(&cmd);
@@ -163,3 +163,149 @@ void cmd_destroy_getval(cmd_getval_t *getval) {
 
   sfree(getval->raw_identifier);
 } /* void cmd_destroy_getval */
+
+cmd_status_t cmd_parse_getvals(size_t argc, char **argv,
+                               cmd_getvals_t *ret_getvals,
+                               const cmd_options_t *opts,
+                               cmd_error_handler_t *err) {
+  if ((ret_getvals == NULL) || (opts == NULL)) {
+    errno = EINVAL;
+    cmd_error(CMD_ERROR, err, "Invalid arguments to cmd_parse_getvals.");
+    return CMD_ERROR;
+  }
+
+  if (argc == 0) {
+    cmd_error(CMD_PARSE_ERROR, err, "Missing identifier.");
+    return CMD_PARSE_ERROR;
+  }
+
+  ret_getvals->patterns = calloc(argc, sizeof(*ret_getvals->patterns));
+  if (ret_getvals->patterns == NULL) {
+    cmd_error(CMD_ERROR, err, "calloc failed.");
+    return CMD_ERROR;
+  }
+
+  for (size_t i = 0; i < argc; i++) {
+    size_t slashes = 0;
+    for (char const *c = argv[i]; *c != 0; c++)
+      if (*c == '/')
+        slashes++;
+
+    char *pattern = NULL;
+    if (slashes == 2) {
+      pattern = strdup(argv[i]);
+    } else if ((slashes == 1) && (opts->identifier_default_host != NULL)) {
+      size_t size = strlen(opts->identifier_default_host) + strlen(argv[i]) + 2;
+      pattern = malloc(size);
+      if (pattern != NULL)
+        ssnprintf(pattern, size, "%s/%s", opts->identifier_default_host,
+                  argv[i]);
+    } else {
+      cmd_error(CMD_PARSE_ERROR, err, "Cannot parse identifier `%s'.",
+                argv[i]);
+      cmd_destroy_getvals(ret_getvals);
+      return CMD_PARSE_ERROR;
+    }
+
+    if (pattern == NULL) {
+      cmd_error(CMD_ERROR, err, "strdup failed.");
+      cmd_destroy_getvals(ret_getvals);
+      return CMD_ERROR;
+    }
+    ret_getvals->patterns[ret_getvals->patterns_num++] = pattern;
+  }
+
+  return CMD_OK;
+} /* cmd_status_t cmd_parse_getvals */
+
+/* Prints one line of the GETVALS response. The data source names are taken
+ * from the type of the identifier. */
+static int getvals_print_entry(FILE *fh, uc_snapshot_entry_t const *e) {
+  char name[6 * DATA_MAX_NAME_LEN];
+  char *host, *plugin, *plugin_instance, *type, *type_instance;
+
+  sstrncpy(name, e->name, sizeof(name));
+  const data_set_t *ds = NULL;
+  if (parse_identifier(name, &host, &plugin, &plugin_instance, &type,
+                       &type_instance, /* default_host = */ NULL) == 0)
+    ds = plugin_get_ds(type);
+  if ((ds != NULL) && (ds->ds_num != e->values_num))
+    ds = NULL;
+
+  sstrncpy(name, e->name, sizeof(name));
+  escape_string(name, sizeof(name));
+  print_to_socket(fh, "%s", name);
+
+  for (size_t i = 0; i < e->values_num; i++) {
+    if (ds != NULL)
+      print_to_socket(fh, " %s=", ds->ds[i].name);
+    else
+      print_to_socket(fh, " %" PRIsz "=", i);
+
+    if (isnan(e->rates[i]))
+      print_to_socket(fh, "NaN");
+    else
+      print_to_socket(fh, "%e", e->rates[i]);
+  }
+  print_to_socket(fh, "\n");
+
+  return 0;
+} /* int getvals_print_entry */
+
+cmd_status_t cmd_handle_getvals(FILE *fh, char *buffer) {
+  cmd_error_handler_t err = {cmd_error_fh, fh};
+  cmd_status_t status;
+  cmd_t cmd;
+
+  if ((fh == NULL) || (buffer == NULL))
+    return -1;
+
+  DEBUG("utils_cmd_getval: cmd_handle_getvals (fh = %p, buffer = %s);",
+        (void *)fh, buffer);
+
+  if ((status = cmd_parse(buffer, &cmd, NULL, &err)) != CMD_OK)
+    return status;
+  if (cmd.type != CMD_GETVALS) {
+    cmd_error(CMD_UNKNOWN_COMMAND, &err, "Unexpected command: `%s'.",
+              CMD_TO_STRING(cmd.type));
+    cmd_destroy(&cmd);
+    return CMD_UNKNOWN_COMMAND;
+  }
+
+  /* All identifiers are answered from one pass over the cache, and the
+   * response is written without holding any cache lock. */
+  uc_snapshot_t *snap =
+      uc_snapshot_match((char const *const *)cmd.cmd.getvals.patterns,
+                        cmd.cmd.getvals.patterns_num);
+  cmd_destroy(&cmd);
+  if (snap == NULL) {
+    cmd_error(CMD_ERROR, &err, "Reading the value cache failed.");
+    return CMD_ERROR;
+  }
+
+  size_t entries_num = uc_snapshot_size(snap);
+  int ret = 0;
+  if (fprintf(fh, "%" PRIsz " Value%s found\n", entries_num,
+              (entries_num == 1) ? "" : "s") < 0) {
+    WARNING("cmd_handle_getvals: failed to write to socket #%i: %s",
+            fileno(fh), STRERRNO);
+    ret = -1;
+  }
+  for (size_t i = 0; (i < entries_num) && (ret == 0); i++)
+    ret = getvals_print_entry(fh, uc_snapshot_get(snap, i));
+  fflush(fh);
+
+  uc_snapshot_destroy(snap);
+
+  return (ret == 0) ? CMD_OK : CMD_ERROR;
+} /* cmd_status_t cmd_handle_getvals */
+
+void cmd_destroy_getvals(cmd_getvals_t *getvals) {
+  if (getvals == NULL)
+    return;
+
+  for (size_t i = 0; i < getvals->patterns_num; i++)
+    sfree(getvals->patterns[i]);
+  sfree(getvals->patterns);
+  getvals->patterns_num = 0;
+} /* void cmd_destroy_getvals */
@@ -40,4 +40,17 @@ cmd_status_t cmd_handle_getval(FILE *fh, char *buffer);
 
 void cmd_destroy_getval(cmd_getval_t *getval);
 
+cmd_status_t cmd_parse_getvals(size_t argc, char **argv,
+                               cmd_getvals_t *ret_getvals,
+                               const cmd_options_t *opts,
+                               cmd_error_handler_t *err);
+
+/* Handles "GETVALS <identifier> [<identifier> ...]". Identifiers may contain
+ * shell wildcards. All matching values are returned in one response, one line
+ * per value list: the identifier, quoted if necessary, followed by
+ * "<ds>=<value>" for each data source. */
+cmd_status_t cmd_handle_getvals(FILE *fh, char *buffer);
+
+void cmd_destroy_getvals(cmd_getvals_t *getvals);
+
 #endif /* UTILS_CMD_GETVAL_H */
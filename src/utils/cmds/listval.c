@@ -64,7 +64,6 @@ cmd_status_t cmd_parse_listval(size_t argc, char **argv,
               STRERRNO);                                                       \
       free_everything_and_return(CMD_ERROR);                                   \
     }                                                                          \
-    fflush(fh);                                                                \
   } while (0)
 
 cmd_status_t cmd_handle_listval(FILE *fh, char *buffer) {
@@ -96,8 +95,11 @@ cmd_status_t cmd_handle_listval(FILE *fh, char *buffer) {
 
   print_to_socket(fh, "%i Value%s found\n", (int)number,
                   (number == 1) ? "" : "s");
+  /* The lines are buffered by "fh" and written in large chunks, rather than
+   * one write per value. */
   for (size_t i = 0; i < number; i++)
     print_to_socket(fh, "%.3f %s\n", CDTIME_T_TO_DOUBLE(times[i]), names[i]);
+  fflush(fh);
 
   free_everything_and_return(CMD_OK);
 } /* cmd_status_t cmd_handle_listval */
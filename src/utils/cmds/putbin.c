@@ -0,0 +1,425 @@
+/**
+ * collectd - src/utils/cmds/putbin.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+
+#include "utils/cmds/putbin.h"
+
+#if HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#if HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+/* Part types of the binary network protocol, see src/network.h. */
+#define PB_TYPE_HOST 0x0000
+#define PB_TYPE_TIME 0x0001
+#define PB_TYPE_PLUGIN 0x0002
+#define PB_TYPE_PLUGIN_INSTANCE 0x0003
+#define PB_TYPE_TYPE 0x0004
+#define PB_TYPE_TYPE_INSTANCE 0x0005
+#define PB_TYPE_VALUES 0x0006
+#define PB_TYPE_INTERVAL 0x0007
+#define PB_TYPE_TIME_HR 0x0008
+#define PB_TYPE_INTERVAL_HR 0x0009
+#define PB_TYPE_SIGN_SHA256 0x0200
+#define PB_TYPE_ENCR_AES256 0x0210
+
+#define PB_HEADER_SIZE (2 * sizeof(uint16_t))
+
+static cmd_status_t pb_parse_string(char const *payload, size_t payload_size,
+                                    char *output, size_t output_size,
+                                    cmd_error_handler_t *err) {
+  if ((payload_size == 0) || (payload[payload_size - 1] != 0)) {
+    cmd_error(CMD_PARSE_ERROR, err, "String part is not null-terminated.");
+    return CMD_PARSE_ERROR;
+  }
+  if (payload_size > output_size) {
+    cmd_error(CMD_PARSE_ERROR, err,
+              "String part is too long: %" PRIsz " bytes.", payload_size);
+    return CMD_PARSE_ERROR;
+  }
+
+  memcpy(output, payload, payload_size);
+  return CMD_OK;
+} /* cmd_status_t pb_parse_string */
+
+static cmd_status_t pb_parse_number(char const *payload, size_t payload_size,
+                                    uint64_t *ret_value,
+                                    cmd_error_handler_t *err) {
+  uint64_t tmp;
+
+  if (payload_size != sizeof(tmp)) {
+    cmd_error(CMD_PARSE_ERROR, err, "Number part has %" PRIsz " bytes.",
+              payload_size);
+    return CMD_PARSE_ERROR;
+  }
+
+  memcpy(&tmp, payload, sizeof(tmp));
+  *ret_value = ntohll(tmp);
+  return CMD_OK;
+} /* cmd_status_t pb_parse_number */
+
+/* Parses a values part into "values", which must have room for the maximum
+ * number of values a part can hold. */
+static cmd_status_t pb_parse_values(char const *payload, size_t payload_size,
+                                    value_t *values, size_t *ret_values_num,
+                                    cmd_error_handler_t *err) {
+  uint16_t tmp16;
+
+  if (payload_size < sizeof(tmp16)) {
+    cmd_error(CMD_PARSE_ERROR, err, "Values part is too short.");
+    return CMD_PARSE_ERROR;
+  }
+  memcpy(&tmp16, payload, sizeof(tmp16));
+  size_t values_num = (size_t)ntohs(tmp16);
+
+  uint8_t const *types = (uint8_t const *)payload + sizeof(tmp16);
+  char const *raw = (char const *)types + values_num;
+
+  if ((values_num == 0) ||
+      (payload_size !=
+       sizeof(tmp16) + values_num * (sizeof(uint8_t) + sizeof(value_t)))) {
+    cmd_error(CMD_PARSE_ERROR, err,
+              "Size of the values part doesn't match its %" PRIsz " values.",
+              values_num);
+    return CMD_PARSE_ERROR;
+  }
+
+  for (size_t i = 0; i < values_num; i++) {
+    value_t v;
+    memcpy(&v, raw + i * sizeof(v), sizeof(v));
+
+    switch (types[i]) {
+    case DS_TYPE_COUNTER:
+      values[i].counter = (counter_t)ntohll(v.counter);
+      break;
+    case DS_TYPE_GAUGE:
+      values[i].gauge = (gauge_t)ntohd(v.gauge);
+      break;
+    case DS_TYPE_DERIVE:
+      values[i].derive = (derive_t)ntohll(v.derive);
+      break;
+    case DS_TYPE_ABSOLUTE:
+      values[i].absolute = (absolute_t)ntohll(v.absolute);
+      break;
+    default:
+      cmd_error(CMD_PARSE_ERROR, err, "Unknown data source type %" PRIu8 ".",
+                types[i]);
+      return CMD_PARSE_ERROR;
+    }
+  }
+
+  *ret_values_num = values_num;
+  return CMD_OK;
+} /* cmd_status_t pb_parse_values */
+
+cmd_status_t cmd_parse_putbin(void const *buffer, size_t buffer_size,
+                              cmd_putbin_callback_t callback, void *user_data,
+                              cmd_error_handler_t *err) {
+  char const *ptr = buffer;
+  size_t left = buffer_size;
+  value_list_t vl = VALUE_LIST_INIT;
+  cmd_status_t status = CMD_OK;
+
+  if ((buffer == NULL) || (callback == NULL)) {
+    cmd_error(CMD_ERROR, err, "Invalid arguments to cmd_parse_putbin.");
+    return CMD_ERROR;
+  }
+
+  /* A values part is at most UINT16_MAX bytes long, and each value takes at
+   * least nine bytes. */
+  value_t *values = calloc(UINT16_MAX / 9, sizeof(*values));
+  if (values == NULL) {
+    cmd_error(CMD_ERROR, err, "calloc failed.");
+    return CMD_ERROR;
+  }
+
+  while ((left > 0) && (status == CMD_OK)) {
+    uint16_t tmp16;
+
+    if (left < PB_HEADER_SIZE) {
+      cmd_error(CMD_PARSE_ERROR, err, "Truncated part header.");
+      status = CMD_PARSE_ERROR;
+      break;
+    }
+
+    memcpy(&tmp16, ptr, sizeof(tmp16));
+    uint16_t part_type = ntohs(tmp16);
+    memcpy(&tmp16, ptr + sizeof(tmp16), sizeof(tmp16));
+    size_t part_size = (size_t)ntohs(tmp16);
+
+    if ((part_size < PB_HEADER_SIZE) || (part_size > left)) {
+      cmd_error(CMD_PARSE_ERROR, err, "Invalid part size %" PRIsz ".",
+                part_size);
+      status = CMD_PARSE_ERROR;
+      break;
+    }
+
+    char const *payload = ptr + PB_HEADER_SIZE;
+    size_t payload_size = part_size - PB_HEADER_SIZE;
+    uint64_t n = 0;
+
+    switch (part_type) {
+    case PB_TYPE_HOST:
+      status = pb_parse_string(payload, payload_size, vl.host, sizeof(vl.host),
+                               err);
+      break;
+    case PB_TYPE_PLUGIN:
+      status = pb_parse_string(payload, payload_size, vl.plugin,
+                               sizeof(vl.plugin), err);
+      break;
+    case PB_TYPE_PLUGIN_INSTANCE:
+      status = pb_parse_string(payload, payload_size, vl.plugin_instance,
+                               sizeof(vl.plugin_instance), err);
+      break;
+    case PB_TYPE_TYPE:
+      status = pb_parse_string(payload, payload_size, vl.type, sizeof(vl.type),
+                               err);
+      break;
+    case PB_TYPE_TYPE_INSTANCE:
+      status = pb_parse_string(payload, payload_size, vl.type_instance,
+                               sizeof(vl.type_instance), err);
+      break;
+    case PB_TYPE_TIME:
+      status = pb_parse_number(payload, payload_size, &n, err);
+      vl.time = TIME_T_TO_CDTIME_T(n);
+      break;
+    case PB_TYPE_TIME_HR:
+      status = pb_parse_number(payload, payload_size, &n, err);
+      vl.time = (cdtime_t)n;
+      break;
+    case PB_TYPE_INTERVAL:
+      status = pb_parse_number(payload, payload_size, &n, err);
+      vl.interval = TIME_T_TO_CDTIME_T(n);
+      break;
+    case PB_TYPE_INTERVAL_HR:
+      status = pb_parse_number(payload, payload_size, &n, err);
+      vl.interval = (cdtime_t)n;
+      break;
+    case PB_TYPE_VALUES:
+      status = pb_parse_values(payload, payload_size, values, &vl.values_len,
+                               err);
+      if (status == CMD_OK) {
+        vl.values = values;
+        callback(&vl, user_data);
+        vl.values = NULL;
+        vl.values_len = 0;
+      }
+      break;
+    case PB_TYPE_SIGN_SHA256:
+    case PB_TYPE_ENCR_AES256:
+      cmd_error(CMD_PARSE_ERROR, err,
+                "Signed and encrypted data is not supported.");
+      status = CMD_PARSE_ERROR;
+      break;
+    default:
+      /* Skip unknown parts, like the network plugin does. */
+      break;
+    }
+
+    ptr += part_size;
+    left -= part_size;
+  }
+
+  sfree(values);
+  return status;
+} /* cmd_status_t cmd_parse_putbin */
+
+/* Appends a part with the given payload to "buffer". Returns false if it
+ * doesn't fit. */
+static bool pb_write_part(char **buffer, size_t *buffer_size, uint16_t type,
+                          void const *payload, size_t payload_size) {
+  size_t part_size = PB_HEADER_SIZE + payload_size;
+  if ((part_size > UINT16_MAX) || (part_size > *buffer_size))
+    return false;
+
+  uint16_t tmp16 = htons(type);
+  memcpy(*buffer, &tmp16, sizeof(tmp16));
+  tmp16 = htons((uint16_t)part_size);
+  memcpy(*buffer + sizeof(tmp16), &tmp16, sizeof(tmp16));
+  memcpy(*buffer + PB_HEADER_SIZE, payload, payload_size);
+
+  *buffer += part_size;
+  *buffer_size -= part_size;
+  return true;
+} /* bool pb_write_part */
+
+static bool pb_write_string(char **buffer, size_t *buffer_size, uint16_t type,
+                            char const *str) {
+  return pb_write_part(buffer, buffer_size, type, str, strlen(str) + 1);
+} /* bool pb_write_string */
+
+static bool pb_write_number(char **buffer, size_t *buffer_size, uint16_t type,
+                            uint64_t n) {
+  uint64_t tmp = htonll(n);
+  return pb_write_part(buffer, buffer_size, type, &tmp, sizeof(tmp));
+} /* bool pb_write_number */
+
+static bool pb_write_values(char **buffer, size_t *buffer_size,
+                            data_set_t const *ds, value_list_t const *vl) {
+  size_t part_size = PB_HEADER_SIZE + sizeof(uint16_t) +
+                     vl->values_len * (sizeof(uint8_t) + sizeof(value_t));
+  if ((vl->values_len != ds->ds_num) || (part_size > UINT16_MAX) ||
+      (part_size > *buffer_size))
+    return false;
+
+  /* The payload is written in place, after the header. */
+  char *payload = *buffer + PB_HEADER_SIZE;
+  uint16_t tmp16 = htons((uint16_t)vl->values_len);
+  memcpy(payload, &tmp16, sizeof(tmp16));
+
+  uint8_t *types = (uint8_t *)payload + sizeof(tmp16);
+  char *raw = (char *)types + vl->values_len;
+  for (size_t i = 0; i < vl->values_len; i++) {
+    value_t v;
+
+    types[i] = (uint8_t)ds->ds[i].type;
+    switch (ds->ds[i].type) {
+    case DS_TYPE_COUNTER:
+      v.counter = (counter_t)htonll(vl->values[i].counter);
+      break;
+    case DS_TYPE_GAUGE:
+      v.gauge = htond(vl->values[i].gauge);
+      break;
+    case DS_TYPE_DERIVE:
+      v.derive = (derive_t)htonll((uint64_t)vl->values[i].derive);
+      break;
+    case DS_TYPE_ABSOLUTE:
+      v.absolute = (absolute_t)htonll(vl->values[i].absolute);
+      break;
+    default:
+      return false;
+    }
+    memcpy(raw + i * sizeof(v), &v, sizeof(v));
+  }
+
+  tmp16 = htons(PB_TYPE_VALUES);
+  memcpy(*buffer, &tmp16, sizeof(tmp16));
+  tmp16 = htons((uint16_t)part_size);
+  memcpy(*buffer + sizeof(tmp16), &tmp16, sizeof(tmp16));
+
+  *buffer += part_size;
+  *buffer_size -= part_size;
+  return true;
+} /* bool pb_write_values */
+
+ssize_t cmd_create_putbin(char *buffer, size_t buffer_size,
+                          data_set_t const *ds, value_list_t const *vl,
+                          value_list_t const *prev) {
+  char *ptr = buffer;
+  size_t left = buffer_size;
+
+  if ((buffer == NULL) || (ds == NULL) || (vl == NULL))
+    return -1;
+
+#define PB_STRING_CHANGED(field)                                                 ((prev == NULL) || (strcmp(prev->field, vl->field) != 0))
+
+  if (PB_STRING_CHANGED(host) &&
+      !pb_write_string(&ptr, &left, PB_TYPE_HOST, vl->host))
+    return -1;
+  if (((prev == NULL) || (prev->time != vl->time)) &&
+      !pb_write_number(&ptr, &left, PB_TYPE_TIME_HR, (uint64_t)vl->time))
+    return -1;
+  if (((prev == NULL) || (prev->interval != vl->interval)) &&
+      !pb_write_number(&ptr, &left, PB_TYPE_INTERVAL_HR,
+                       (uint64_t)vl->interval))
+    return -1;
+  if (PB_STRING_CHANGED(plugin) &&
+      !pb_write_string(&ptr, &left, PB_TYPE_PLUGIN, vl->plugin))
+    return -1;
+  if (PB_STRING_CHANGED(plugin_instance) &&
+      !pb_write_string(&ptr, &left, PB_TYPE_PLUGIN_INSTANCE,
+                       vl->plugin_instance))
+    return -1;
+  if (PB_STRING_CHANGED(type) &&
+      !pb_write_string(&ptr, &left, PB_TYPE_TYPE, vl->type))
+    return -1;
+  if (PB_STRING_CHANGED(type_instance) &&
+      !pb_write_string(&ptr, &left, PB_TYPE_TYPE_INSTANCE, vl->type_instance))
+    return -1;
+
+#undef PB_STRING_CHANGED
+
+  if (!pb_write_values(&ptr, &left, ds, vl))
+    return -1;
+
+  return (ssize_t)(buffer_size - left);
+} /* ssize_t cmd_create_putbin */
+
+typedef struct {
+  size_t dispatched;
+  size_t failed;
+} pb_stats_t;
+
+static int pb_dispatch(value_list_t const *vl, void *user_data) {
+  pb_stats_t *stats = user_data;
+
+  data_set_t const *ds = plugin_get_ds(vl->type);
+  if ((ds == NULL) || (ds->ds_num != vl->values_len)) {
+    stats->failed++;
+    return EINVAL;
+  }
+
+  if (plugin_dispatch_values(vl) != 0) {
+    stats->failed++;
+    return -1;
+  }
+
+  stats->dispatched++;
+  return 0;
+} /* int pb_dispatch */
+
+cmd_status_t cmd_handle_putbin(FILE *fh, void const *buffer,
+                               size_t buffer_size) {
+  cmd_error_handler_t err = {cmd_error_fh, fh};
+  pb_stats_t stats = {0};
+
+  DEBUG("utils_cmd_putbin: cmd_handle_putbin (fh = %p, buffer_size = %" PRIsz
+        ");",
+        (void *)fh, buffer_size);
+
+  cmd_status_t status =
+      cmd_parse_putbin(buffer, buffer_size, pb_dispatch, &stats, &err);
+  if (status != CMD_OK)
+    return status;
+
+  if (stats.failed > 0) {
+    cmd_error(CMD_ERROR, &err,
+              "%" PRIsz " of %" PRIsz " values could not be dispatched.",
+              stats.failed, stats.failed + stats.dispatched);
+    return CMD_ERROR;
+  }
+
+  cmd_error(CMD_OK, &err, "Success: %" PRIsz " %s been dispatched.",
+            stats.dispatched,
+            (stats.dispatched == 1) ? "value has" : "values have");
+  return CMD_OK;
+} /* cmd_status_t cmd_handle_putbin */
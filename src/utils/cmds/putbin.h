@@ -0,0 +1,62 @@
+/**
+ * collectd - src/utils/cmds/putbin.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#ifndef UTILS_CMD_PUTBIN_H
+#define UTILS_CMD_PUTBIN_H 1
+
+#include "plugin.h"
+#include "utils/cmds/cmds.h"
+
+#include <stdio.h>
+
+/* Largest frame accepted by the PUTBIN command. */
+#define CMD_PUTBIN_MAX_SIZE (1024 * 1024)
+
+typedef int (*cmd_putbin_callback_t)(value_list_t const *vl, void *user_data);
+
+/* Parses value lists encoded in the binary network protocol, as created by
+ * lcc_network_buffer_add_value(), and calls "callback" with each of them.
+ * Signed and encrypted data is not supported. Parsing stops at the first
+ * malformed part; value lists before it have been passed to "callback". */
+cmd_status_t cmd_parse_putbin(void const *buffer, size_t buffer_size,
+                              cmd_putbin_callback_t callback, void *user_data,
+                              cmd_error_handler_t *err);
+
+/* Encodes "vl" in the binary network protocol and appends it to "buffer".
+ * The identifier, time and interval parts are only written if they differ
+ * from "prev", the value list encoded right before "vl" into the same buffer.
+ * Pass NULL as "prev" for the first value list of a buffer. Returns the
+ * number of bytes written, or -1 if they don't fit into "buffer_size". */
+ssize_t cmd_create_putbin(char *buffer, size_t buffer_size,
+                          data_set_t const *ds, value_list_t const *vl,
+                          value_list_t const *prev);
+
+/* Dispatches all value lists in "buffer" and writes a single status line to
+ * "fh". */
+cmd_status_t cmd_handle_putbin(FILE *fh, void const *buffer,
+                               size_t buffer_size);
+
+#endif /* UTILS_CMD_PUTBIN_H */
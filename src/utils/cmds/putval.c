@@ -30,6 +30,7 @@
 
 #include "utils/cmds/putval.h"
 #include "utils/common/common.h"
+#include "utils/strconv/strconv.h"
 
 /*
  * private helper functions
@@ -54,7 +55,7 @@ static int set_option(value_list_t *vl, const char *key, const char *value,
 
     endptr = NULL;
     errno = 0;
-    tmp = strtod(value, &endptr);
+    tmp = strtod_fast(value, &endptr);
 
     if ((errno == 0) && (endptr != NULL) && (endptr != value) && (tmp > 0.0))
       vl->interval = DOUBLE_TO_CDTIME_T(tmp);
@@ -31,6 +31,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/strconv/strconv.h"
 #include "utils_cache.h"
 
 /* for getaddrinfo */
@@ -1055,57 +1056,47 @@ int parse_identifier_vl(const char *str, value_list_t *vl) /* {{{ */
 } /* }}} int parse_identifier_vl */
 
 int parse_value(const char *value_orig, value_t *ret_value, int ds_type) {
-  char *value;
   char *endptr = NULL;
-  size_t value_len;
 
   if (value_orig == NULL)
     return EINVAL;
 
-  value = strdup(value_orig);
-  if (value == NULL)
-    return ENOMEM;
-  value_len = strlen(value);
-
-  while ((value_len > 0) && isspace((int)value[value_len - 1])) {
-    value[value_len - 1] = '\0';
-    value_len--;
-  }
-
   switch (ds_type) {
   case DS_TYPE_COUNTER:
-    ret_value->counter = (counter_t)strtoull(value, &endptr, 0);
+    ret_value->counter = (counter_t)strtoull_fast(value_orig, &endptr);
     break;
 
   case DS_TYPE_GAUGE:
-    ret_value->gauge = (gauge_t)strtod(value, &endptr);
+    ret_value->gauge = (gauge_t)strtod_fast(value_orig, &endptr);
     break;
 
   case DS_TYPE_DERIVE:
-    ret_value->derive = (derive_t)strtoll(value, &endptr, 0);
+    ret_value->derive = (derive_t)strtoll_fast(value_orig, &endptr);
     break;
 
   case DS_TYPE_ABSOLUTE:
-    ret_value->absolute = (absolute_t)strtoull(value, &endptr, 0);
+    ret_value->absolute = (absolute_t)strtoull_fast(value_orig, &endptr);
     break;
 
   default:
-    sfree(value);
     P_ERROR("parse_value: Invalid data source type: %i.", ds_type);
     return -1;
   }
 
-  if (value == endptr) {
+  if (value_orig == endptr) {
     P_ERROR("parse_value: Failed to parse string as %s: \"%s\".",
-            DS_TYPE_TO_STRING(ds_type), value);
-    sfree(value);
+            DS_TYPE_TO_STRING(ds_type), value_orig);
     return -1;
-  } else if ((NULL != endptr) && ('\0' != *endptr))
+  }
+
+  /* Trailing white space is fine. */
+  while ((endptr != NULL) && isspace((int)*endptr))
+    endptr++;
+  if ((NULL != endptr) && ('\0' != *endptr))
     P_INFO("parse_value: Ignoring trailing garbage \"%s\" after %s value. "
            "Input string was \"%s\".",
            endptr, DS_TYPE_TO_STRING(ds_type), value_orig);
 
-  sfree(value);
   return 0;
 } /* int parse_value */
 
@@ -1139,7 +1130,7 @@ int parse_values(char *buffer, value_list_t *vl, const data_set_t *ds) {
         double tmp;
 
         errno = 0;
-        tmp = strtod(ptr, &endptr);
+        tmp = strtod_fast(ptr, &endptr);
         if ((errno != 0)        /* Overflow */
             || (endptr == ptr)  /* Invalid string */
             || (endptr == NULL) /* This should not happen */
@@ -1330,6 +1321,120 @@ ssize_t read_text_file_contents(const char *filename, char *buf,
   return ret + 1;
 }
 
+#define PROC_FILE_INITIAL_SIZE 4096
+
+struct proc_file_s {
+  char *path;
+  int fd;
+
+  char *buffer;
+  size_t buffer_size;
+  size_t buffer_fill;
+  size_t next_line;
+};
+
+proc_file_t *proc_file_create(char const *path) {
+  if (path == NULL)
+    return NULL;
+
+  proc_file_t *pf = calloc(1, sizeof(*pf));
+  if (pf == NULL)
+    return NULL;
+
+  pf->path = strdup(path);
+  if (pf->path == NULL) {
+    sfree(pf);
+    return NULL;
+  }
+  pf->fd = -1;
+
+  return pf;
+} /* proc_file_t *proc_file_create */
+
+void proc_file_destroy(proc_file_t *pf) {
+  if (pf == NULL)
+    return;
+
+  if (pf->fd >= 0)
+    close(pf->fd);
+  sfree(pf->buffer);
+  sfree(pf->path);
+  sfree(pf);
+} /* void proc_file_destroy */
+
+char *proc_file_read(proc_file_t *pf, size_t *ret_len) {
+  if (pf == NULL)
+    return NULL;
+
+  pf->buffer_fill = 0;
+  pf->next_line = 0;
+
+  if (pf->fd < 0) {
+    pf->fd = open(pf->path, O_RDONLY | O_CLOEXEC);
+    if (pf->fd < 0) {
+      P_ERROR("proc_file_read: open(\"%s\") failed: %s", pf->path, STRERRNO);
+      return NULL;
+    }
+  }
+
+  /* Files in /proc are generated while being read and may return fewer bytes
+   * than requested before the end of the file, so read until pread(2) returns
+   * zero. */
+  while (true) {
+    /* Keep room for the terminating null byte. */
+    if (pf->buffer_size - pf->buffer_fill < 2) {
+      size_t size = (pf->buffer_size == 0) ? PROC_FILE_INITIAL_SIZE
+                                           : 2 * pf->buffer_size;
+      char *tmp = realloc(pf->buffer, size);
+      if (tmp == NULL) {
+        P_ERROR("proc_file_read: realloc failed.");
+        return NULL;
+      }
+      pf->buffer = tmp;
+      pf->buffer_size = size;
+    }
+
+    ssize_t status =
+        pread(pf->fd, pf->buffer + pf->buffer_fill,
+              pf->buffer_size - pf->buffer_fill - 1, (off_t)pf->buffer_fill);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+
+      P_ERROR("proc_file_read: pread(\"%s\") failed: %s", pf->path, STRERRNO);
+      close(pf->fd);
+      pf->fd = -1;
+      pf->buffer_fill = 0;
+      return NULL;
+    } else if (status == 0) {
+      break;
+    }
+
+    pf->buffer_fill += (size_t)status;
+  }
+
+  pf->buffer[pf->buffer_fill] = '\0';
+  if (ret_len != NULL)
+    *ret_len = pf->buffer_fill;
+  return pf->buffer;
+} /* char *proc_file_read */
+
+char *proc_file_next_line(proc_file_t *pf) {
+  if ((pf == NULL) || (pf->next_line >= pf->buffer_fill))
+    return NULL;
+
+  char *line = pf->buffer + pf->next_line;
+  char *end = memchr(line, '\n', pf->buffer_fill - pf->next_line);
+  if (end == NULL) {
+    pf->next_line = pf->buffer_fill;
+  } else {
+    *end = '\0';
+    pf->next_line = (size_t)(end - pf->buffer) + 1;
+  }
+
+  return line;
+} /* char *proc_file_next_line */
+
 counter_t counter_diff(counter_t old_value, counter_t new_value) {
   counter_t diff;
 
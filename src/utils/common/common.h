@@ -365,6 +365,25 @@ ssize_t read_file_contents(char const *filename, void *buf, size_t bufsize);
 ssize_t read_text_file_contents(char const *filename, char *buf,
                                 size_t bufsize);
 
+/* proc_file_t keeps a file, usually in /proc or /sys, open between reads.
+ * Each read fetches the file with pread(2) from offset zero into a buffer that
+ * is reused (and grown as necessary), avoiding the open/close and stdio
+ * overhead of reading the file from scratch. */
+struct proc_file_s;
+typedef struct proc_file_s proc_file_t;
+
+proc_file_t *proc_file_create(char const *path);
+void proc_file_destroy(proc_file_t *pf);
+/* Reads the complete file. Returns a pointer to the NUL-terminated contents,
+ * which remain valid until the next call, or NULL on error. If "ret_len" is
+ * not NULL, the length of the contents is stored there. The file is re-opened
+ * on the next call after an error. */
+char *proc_file_read(proc_file_t *pf, size_t *ret_len);
+/* Returns the next line of the contents read by the last call to
+ * proc_file_read(), without the trailing newline, or NULL if there are no more
+ * lines. The line may be modified by the caller. */
+char *proc_file_next_line(proc_file_t *pf);
+
 counter_t counter_diff(counter_t old_value, counter_t new_value);
 
 /* Convert a rate back to a value_t. When converting to a derive_t, counter_t
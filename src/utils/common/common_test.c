@@ -375,6 +375,66 @@ DEF_TEST(value_to_rate) {
   return 0;
 }
 
+DEF_TEST(proc_file) {
+  char path[] = "/tmp/collectd_proc_file_test.XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    printf("mkstemp failed: %s\n", STRERRNO);
+    return -1;
+  }
+
+  /* Larger than the initial buffer, so that the buffer has to grow. */
+  char line[100];
+  memset(line, 'x', sizeof(line) - 1);
+  line[sizeof(line) - 1] = '\n';
+  for (int i = 0; i < 100; i++)
+    EXPECT_EQ_INT(0, swrite(fd, line, sizeof(line)));
+  EXPECT_EQ_INT(0, swrite(fd, "last", strlen("last")));
+
+  proc_file_t *pf = proc_file_create(path);
+  CHECK_NOT_NULL(pf);
+
+  for (int round = 0; round < 2; round++) {
+    size_t len = 0;
+    CHECK_NOT_NULL(proc_file_read(pf, &len));
+    EXPECT_EQ_UINT64(100 * sizeof(line) + strlen("last"), len);
+
+    int lines_num = 0;
+    char *l;
+    while ((l = proc_file_next_line(pf)) != NULL) {
+      if (lines_num < 100)
+        EXPECT_EQ_UINT64(sizeof(line) - 1, strlen(l));
+      else
+        EXPECT_EQ_STR("last", l);
+      lines_num++;
+    }
+    EXPECT_EQ_INT(101, lines_num);
+
+    /* The file is kept open, so changes are seen by the next read. */
+    EXPECT_EQ_INT(0, ftruncate(fd, 0));
+    EXPECT_EQ_INT(0, (int)pwrite(fd, "a\nb\n", 4, 0) - 4);
+    CHECK_NOT_NULL(proc_file_read(pf, &len));
+    EXPECT_EQ_UINT64(4, len);
+    EXPECT_EQ_STR("a", proc_file_next_line(pf));
+    EXPECT_EQ_STR("b", proc_file_next_line(pf));
+    EXPECT_EQ_PTR(NULL, proc_file_next_line(pf));
+
+    /* Restore the original contents for the next round. */
+    EXPECT_EQ_INT(0, ftruncate(fd, 0));
+    EXPECT_EQ_INT(0, (int)lseek(fd, 0, SEEK_SET));
+    for (int i = 0; i < 100; i++)
+      EXPECT_EQ_INT(0, swrite(fd, line, sizeof(line)));
+    EXPECT_EQ_INT(0, swrite(fd, "last", strlen("last")));
+  }
+
+  proc_file_destroy(pf);
+  close(fd);
+  unlink(path);
+
+  EXPECT_EQ_PTR(NULL, proc_file_create(NULL));
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(sstrncpy);
   RUN_TEST(sstrdup);
@@ -385,6 +445,7 @@ int main(void) {
   RUN_TEST(strunescape);
   RUN_TEST(parse_values);
   RUN_TEST(value_to_rate);
+  RUN_TEST(proc_file);
 
   END_TEST;
 }
@@ -0,0 +1,539 @@
+/**
+ * collectd - src/utils/compress/compress.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+#include "utils/compress/compress.h"
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/* Snappy matches 4-byte sequences, which are looked up in a hash table of
+ * 2^SNAPPY_HASH_BITS positions. Input is split into blocks of
+ * SNAPPY_BLOCK_SIZE bytes, so that positions fit into 16 bits and all copies
+ * can use a 2-byte offset. */
+#define SNAPPY_HASH_BITS 14
+#define SNAPPY_BLOCK_SIZE 65536
+#define SNAPPY_MAX_LENGTH 0xffffffffu
+
+struct compressor_s {
+  compress_algorithm_t alg;
+#if HAVE_ZLIB
+  z_stream zs;
+#endif
+  uint16_t *table;
+
+  unsigned char *buffer;
+  size_t buffer_size;
+};
+
+struct decompressor_s {
+  compress_algorithm_t alg;
+#if HAVE_ZLIB
+  z_stream zs;
+#endif
+
+  unsigned char *buffer;
+  size_t buffer_size;
+};
+
+int compress_algorithm_parse(char const *name, compress_algorithm_t *ret) {
+  if ((name == NULL) || (ret == NULL))
+    return EINVAL;
+
+  if (strcasecmp("None", name) == 0) {
+    *ret = COMPRESS_NONE;
+    return 0;
+  } else if (strcasecmp("Gzip", name) == 0) {
+#if HAVE_ZLIB
+    *ret = COMPRESS_GZIP;
+    return 0;
+#else
+    return ENOTSUP;
+#endif
+  } else if (strcasecmp("Snappy", name) == 0) {
+    *ret = COMPRESS_SNAPPY;
+    return 0;
+  }
+
+  return EINVAL;
+} /* int compress_algorithm_parse */
+
+char const *compress_content_encoding(compress_algorithm_t alg) {
+  switch (alg) {
+  case COMPRESS_GZIP:
+    return "gzip";
+  case COMPRESS_SNAPPY:
+    return "snappy";
+  default:
+    return NULL;
+  }
+} /* char const *compress_content_encoding */
+
+compressor_t *compressor_create(compress_algorithm_t alg) {
+  compressor_t *c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return NULL;
+  c->alg = alg;
+
+  switch (alg) {
+  case COMPRESS_NONE:
+    return c;
+#if HAVE_ZLIB
+  case COMPRESS_GZIP:
+    /* windowBits 16 + MAX_WBITS selects the gzip container. */
+    if (deflateInit2(&c->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS,
+                     /* memLevel = */ 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      ERROR("compressor_create: deflateInit2 failed: %s",
+            (c->zs.msg != NULL) ? c->zs.msg : "unknown error");
+      sfree(c);
+      return NULL;
+    }
+    return c;
+#endif
+  case COMPRESS_SNAPPY:
+    c->table = calloc(1 << SNAPPY_HASH_BITS, sizeof(*c->table));
+    if (c->table == NULL) {
+      sfree(c);
+      return NULL;
+    }
+    return c;
+  default:
+    sfree(c);
+    errno = ENOTSUP;
+    return NULL;
+  }
+} /* compressor_t *compressor_create */
+
+#if HAVE_ZLIB
+static int compress_gzip(compressor_t *c, void const *data, size_t size,
+                         void const **ret_data, size_t *ret_size) {
+  if (deflateReset(&c->zs) != Z_OK)
+    return -1;
+
+  size_t bound = (size_t)deflateBound(&c->zs, (uLong)size);
+  if (c->buffer_size < bound) {
+    unsigned char *tmp = realloc(c->buffer, bound);
+    if (tmp == NULL)
+      return ENOMEM;
+    c->buffer = tmp;
+    c->buffer_size = bound;
+  }
+
+  c->zs.next_in = (Bytef *)data;
+  c->zs.avail_in = (uInt)size;
+  c->zs.next_out = c->buffer;
+  c->zs.avail_out = (uInt)c->buffer_size;
+
+  /* The output buffer is large enough for the entire stream, so a single call
+   * has to finish it. */
+  if (deflate(&c->zs, Z_FINISH) != Z_STREAM_END)
+    return -1;
+
+  *ret_data = c->buffer;
+  *ret_size = c->buffer_size - (size_t)c->zs.avail_out;
+  return 0;
+} /* int compress_gzip */
+#endif
+
+static int compress_buffer_reserve(unsigned char **buffer, size_t *buffer_size,
+                                   size_t size) {
+  if (*buffer_size >= size)
+    return 0;
+
+  unsigned char *tmp = realloc(*buffer, size);
+  if (tmp == NULL)
+    return ENOMEM;
+  *buffer = tmp;
+  *buffer_size = size;
+  return 0;
+} /* int compress_buffer_reserve */
+
+static uint32_t snappy_load32(unsigned char const *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+} /* uint32_t snappy_load32 */
+
+static uint32_t snappy_hash(uint32_t v) {
+  return (v * 0x1e35a7bdu) >> (32 - SNAPPY_HASH_BITS);
+} /* uint32_t snappy_hash */
+
+static unsigned char *snappy_literal(unsigned char *op, unsigned char const *lit,
+                                     size_t len) {
+  size_t n = len - 1;
+  if (n < 60) {
+    *op++ = (unsigned char)(n << 2);
+  } else {
+    /* Tags 60 to 63 are followed by the length minus one in 1 to 4 bytes,
+     * little endian. */
+    unsigned char *tag = op++;
+    int bytes = 0;
+    while (n > 0) {
+      *op++ = (unsigned char)(n & 0xff);
+      n >>= 8;
+      bytes++;
+    }
+    *tag = (unsigned char)((59 + bytes) << 2);
+  }
+
+  memcpy(op, lit, len);
+  return op + len;
+} /* unsigned char *snappy_literal */
+
+static unsigned char *snappy_copy(unsigned char *op, size_t offset,
+                                  size_t len) {
+  /* Copies with a 2-byte offset are at most 64 bytes long. Emitting 60 bytes
+   * when 65 to 67 bytes are left keeps the remainder at four bytes or more,
+   * the minimum length of the 1-byte offset form. */
+  while (len >= 68) {
+    *op++ = (unsigned char)((63 << 2) | 2);
+    *op++ = (unsigned char)(offset & 0xff);
+    *op++ = (unsigned char)(offset >> 8);
+    len -= 64;
+  }
+  if (len > 64) {
+    *op++ = (unsigned char)((59 << 2) | 2);
+    *op++ = (unsigned char)(offset & 0xff);
+    *op++ = (unsigned char)(offset >> 8);
+    len -= 60;
+  }
+
+  if ((len < 12) && (offset < 2048)) {
+    *op++ = (unsigned char)(((offset >> 8) << 5) | ((len - 4) << 2) | 1);
+    *op++ = (unsigned char)(offset & 0xff);
+  } else {
+    *op++ = (unsigned char)(((len - 1) << 2) | 2);
+    *op++ = (unsigned char)(offset & 0xff);
+    *op++ = (unsigned char)(offset >> 8);
+  }
+  return op;
+} /* unsigned char *snappy_copy */
+
+static unsigned char *snappy_block(uint16_t *table, unsigned char *op,
+                                   unsigned char const *block, size_t size) {
+  size_t lit = 0;
+
+  /* Matches are only searched where four bytes can be loaded. */
+  if (size >= 16) {
+    memset(table, 0, sizeof(*table) << SNAPPY_HASH_BITS);
+
+    size_t ip = 1;
+    size_t skip = 32;
+    while (ip + 4 <= size) {
+      uint32_t v = snappy_load32(block + ip);
+      uint32_t h = snappy_hash(v);
+      size_t candidate = table[h];
+      table[h] = (uint16_t)ip;
+
+      if (snappy_load32(block + candidate) != v) {
+        /* Step over incompressible data faster the longer no match has been
+         * found. */
+        ip += skip >> 5;
+        skip++;
+        continue;
+      }
+
+      if (ip > lit)
+        op = snappy_literal(op, block + lit, ip - lit);
+
+      size_t len = 4;
+      while ((ip + len < size) && (block[candidate + len] == block[ip + len]))
+        len++;
+
+      op = snappy_copy(op, ip - candidate, len);
+      ip += len;
+      lit = ip;
+      skip = 32;
+    }
+  }
+
+  if (size > lit)
+    op = snappy_literal(op, block + lit, size - lit);
+  return op;
+} /* unsigned char *snappy_block */
+
+static int compress_snappy(compressor_t *c, void const *data, size_t size,
+                           void const **ret_data, size_t *ret_size) {
+  if (size > SNAPPY_MAX_LENGTH)
+    return EMSGSIZE;
+
+  /* The maximum compressed length of the reference implementation. */
+  size_t bound = 32 + size + size / 6;
+  int status = compress_buffer_reserve(&c->buffer, &c->buffer_size, bound);
+  if (status != 0)
+    return status;
+
+  unsigned char *op = c->buffer;
+  uint32_t n = (uint32_t)size;
+  while (n >= 0x80) {
+    *op++ = (unsigned char)(n | 0x80);
+    n >>= 7;
+  }
+  *op++ = (unsigned char)n;
+
+  unsigned char const *ip = data;
+  for (size_t off = 0; off < size; off += SNAPPY_BLOCK_SIZE) {
+    size_t block_size = size - off;
+    if (block_size > SNAPPY_BLOCK_SIZE)
+      block_size = SNAPPY_BLOCK_SIZE;
+    op = snappy_block(c->table, op, ip + off, block_size);
+  }
+
+  *ret_data = c->buffer;
+  *ret_size = (size_t)(op - c->buffer);
+  return 0;
+} /* int compress_snappy */
+
+int compressor_compress(compressor_t *c, void const *data, size_t size,
+                        void const **ret_data, size_t *ret_size) {
+  if ((c == NULL) || (ret_data == NULL) || (ret_size == NULL))
+    return EINVAL;
+
+  switch (c->alg) {
+  case COMPRESS_NONE:
+    *ret_data = data;
+    *ret_size = size;
+    return 0;
+#if HAVE_ZLIB
+  case COMPRESS_GZIP:
+    return compress_gzip(c, data, size, ret_data, ret_size);
+#endif
+  case COMPRESS_SNAPPY:
+    return compress_snappy(c, data, size, ret_data, ret_size);
+  default:
+    return ENOTSUP;
+  }
+} /* int compressor_compress */
+
+void compressor_destroy(compressor_t *c) {
+  if (c == NULL)
+    return;
+
+#if HAVE_ZLIB
+  if (c->alg == COMPRESS_GZIP)
+    deflateEnd(&c->zs);
+#endif
+
+  sfree(c->table);
+  sfree(c->buffer);
+  sfree(c);
+} /* void compressor_destroy */
+
+decompressor_t *decompressor_create(compress_algorithm_t alg) {
+  decompressor_t *d = calloc(1, sizeof(*d));
+  if (d == NULL)
+    return NULL;
+  d->alg = alg;
+
+  switch (alg) {
+  case COMPRESS_NONE:
+    return d;
+#if HAVE_ZLIB
+  case COMPRESS_GZIP:
+    if (inflateInit2(&d->zs, 16 + MAX_WBITS) != Z_OK) {
+      ERROR("decompressor_create: inflateInit2 failed: %s",
+            (d->zs.msg != NULL) ? d->zs.msg : "unknown error");
+      sfree(d);
+      return NULL;
+    }
+    return d;
+#endif
+  case COMPRESS_SNAPPY:
+    return d;
+  default:
+    sfree(d);
+    errno = ENOTSUP;
+    return NULL;
+  }
+} /* decompressor_t *decompressor_create */
+
+#if HAVE_ZLIB
+static int decompress_gzip(decompressor_t *d, void const *data, size_t size,
+                           size_t max_size, void const **ret_data,
+                           size_t *ret_size) {
+  if (inflateReset(&d->zs) != Z_OK)
+    return -1;
+
+  /* One byte more than allowed tells an oversized stream from one that fills
+   * the buffer exactly. */
+  if (d->buffer_size < max_size + 1) {
+    unsigned char *tmp = realloc(d->buffer, max_size + 1);
+    if (tmp == NULL)
+      return ENOMEM;
+    d->buffer = tmp;
+    d->buffer_size = max_size + 1;
+  }
+
+  d->zs.next_in = (Bytef *)data;
+  d->zs.avail_in = (uInt)size;
+  d->zs.next_out = d->buffer;
+  d->zs.avail_out = (uInt)(max_size + 1);
+
+  int status = inflate(&d->zs, Z_FINISH);
+  size_t out_size = (max_size + 1) - (size_t)d->zs.avail_out;
+  if (out_size > max_size)
+    return EMSGSIZE;
+  if (status != Z_STREAM_END)
+    return EINVAL;
+
+  *ret_data = d->buffer;
+  *ret_size = out_size;
+  return 0;
+} /* int decompress_gzip */
+#endif
+
+static int decompress_snappy(decompressor_t *d, void const *data, size_t size,
+                             size_t max_size, void const **ret_data,
+                             size_t *ret_size) {
+  unsigned char const *ip = data;
+  unsigned char const *end = ip + size;
+
+  uint64_t length = 0;
+  for (int shift = 0;; shift += 7) {
+    if ((ip == end) || (shift > 28))
+      return EINVAL;
+    length |= (uint64_t)(*ip & 0x7f) << shift;
+    if ((*ip++ & 0x80) == 0)
+      break;
+  }
+  if (length > SNAPPY_MAX_LENGTH)
+    return EINVAL;
+  if (length > max_size)
+    return EMSGSIZE;
+
+  /* Reserve at least one byte so that empty streams return a valid pointer. */
+  int status = compress_buffer_reserve(&d->buffer, &d->buffer_size,
+                                       (size_t)length + 1);
+  if (status != 0)
+    return status;
+
+  unsigned char *out = d->buffer;
+  size_t op = 0;
+  while (ip < end) {
+    unsigned char tag = *ip++;
+    size_t len;
+    size_t offset;
+
+    switch (tag & 0x03) {
+    case 0: /* literal */
+      len = (size_t)(tag >> 2);
+      if (len >= 60) {
+        size_t bytes = len - 59;
+        if ((size_t)(end - ip) < bytes)
+          return EINVAL;
+        len = 0;
+        for (size_t i = 0; i < bytes; i++)
+          len |= (size_t)ip[i] << (8 * i);
+        ip += bytes;
+      }
+      len++;
+      if (((size_t)(end - ip) < len) || (length - op < len))
+        return EINVAL;
+      memcpy(out + op, ip, len);
+      ip += len;
+      op += len;
+      continue;
+    case 1: /* copy with 1-byte offset */
+      if (end - ip < 1)
+        return EINVAL;
+      len = (size_t)((tag >> 2) & 0x07) + 4;
+      offset = ((size_t)(tag >> 5) << 8) | ip[0];
+      ip += 1;
+      break;
+    case 2: /* copy with 2-byte offset */
+      if (end - ip < 2)
+        return EINVAL;
+      len = (size_t)(tag >> 2) + 1;
+      offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+      ip += 2;
+      break;
+    default: /* copy with 4-byte offset */
+      if (end - ip < 4)
+        return EINVAL;
+      len = (size_t)(tag >> 2) + 1;
+      offset = (size_t)ip[0] | ((size_t)ip[1] << 8) | ((size_t)ip[2] << 16) |
+               ((size_t)ip[3] << 24);
+      ip += 4;
+      break;
+    }
+
+    if ((offset == 0) || (offset > op) || (length - op < len))
+      return EINVAL;
+    /* Copies may overlap their own output, e.g. to repeat a single byte, so
+     * they are done byte by byte. */
+    for (size_t i = 0; i < len; i++)
+      out[op + i] = out[op - offset + i];
+    op += len;
+  }
+
+  if (op != length)
+    return EINVAL;
+
+  *ret_data = d->buffer;
+  *ret_size = op;
+  return 0;
+} /* int decompress_snappy */
+
+int decompressor_decompress(decompressor_t *d, void const *data, size_t size,
+                            size_t max_size, void const **ret_data,
+                            size_t *ret_size) {
+  if ((d == NULL) || (ret_data == NULL) || (ret_size == NULL))
+    return EINVAL;
+
+  switch (d->alg) {
+  case COMPRESS_NONE:
+    if (size > max_size)
+      return EMSGSIZE;
+    *ret_data = data;
+    *ret_size = size;
+    return 0;
+#if HAVE_ZLIB
+  case COMPRESS_GZIP:
+    return decompress_gzip(d, data, size, max_size, ret_data, ret_size);
+#endif
+  case COMPRESS_SNAPPY:
+    return decompress_snappy(d, data, size, max_size, ret_data, ret_size);
+  default:
+    return ENOTSUP;
+  }
+} /* int decompressor_decompress */
+
+void decompressor_destroy(decompressor_t *d) {
+  if (d == NULL)
+    return;
+
+#if HAVE_ZLIB
+  if (d->alg == COMPRESS_GZIP)
+    inflateEnd(&d->zs);
+#endif
+
+  sfree(d->buffer);
+  sfree(d);
+} /* void decompressor_destroy */
@@ -0,0 +1,121 @@
+/**
+ * collectd - src/utils/compress/compress.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#ifndef UTILS_COMPRESS_H
+#define UTILS_COMPRESS_H 1
+
+#include "collectd.h"
+
+typedef enum {
+  COMPRESS_NONE = 0,
+  COMPRESS_GZIP,
+  COMPRESS_SNAPPY,
+} compress_algorithm_t;
+
+struct compressor_s;
+typedef struct compressor_s compressor_t;
+
+/*
+ * NAME
+ *   compress_algorithm_parse
+ *
+ * DESCRIPTION
+ *   Parses the value of a "Compression" option, "None", "Gzip" or "Snappy".
+ *   Returns ENOTSUP if the algorithm is known but collectd was built without
+ *   support for it and EINVAL if the name is unknown. Snappy is always
+ *   available; it uses the raw block format without the framing format's
+ *   chunk headers and checksums, as expected e.g. by Prometheus.
+ */
+int compress_algorithm_parse(char const *name, compress_algorithm_t *ret);
+
+/*
+ * NAME
+ *   compress_content_encoding
+ *
+ * DESCRIPTION
+ *   Returns the value of the HTTP "Content-Encoding" header for "alg", or NULL
+ *   for COMPRESS_NONE.
+ */
+char const *compress_content_encoding(compress_algorithm_t alg);
+
+/*
+ * NAME
+ *   compressor_create
+ *
+ * DESCRIPTION
+ *   Allocates a compressor context. The context and its output buffer are
+ *   reused by all calls to compressor_compress(), so that compressing a
+ *   payload doesn't allocate once the buffer has grown to its working size.
+ *   A compressor must not be used by several threads at the same time.
+ */
+compressor_t *compressor_create(compress_algorithm_t alg);
+
+/*
+ * NAME
+ *   compressor_compress
+ *
+ * DESCRIPTION
+ *   Compresses "size" bytes at "data" into one complete stream, e.g. one gzip
+ *   member or one snappy block. On success, "ret_data" points to the compressed data, which is
+ *   owned by the compressor and valid until the next call.
+ */
+int compressor_compress(compressor_t *c, void const *data, size_t size,
+                        void const **ret_data, size_t *ret_size);
+
+void compressor_destroy(compressor_t *c);
+
+struct decompressor_s;
+typedef struct decompressor_s decompressor_t;
+
+/*
+ * NAME
+ *   decompressor_create
+ *
+ * DESCRIPTION
+ *   Allocates a decompressor context, the counterpart of compressor_create().
+ *   Like a compressor, it reuses its context and output buffer and must not
+ *   be used by several threads at the same time.
+ */
+decompressor_t *decompressor_create(compress_algorithm_t alg);
+
+/*
+ * NAME
+ *   decompressor_decompress
+ *
+ * DESCRIPTION
+ *   Decompresses one complete stream of "size" bytes at "data". Returns
+ *   EMSGSIZE if the decompressed data is larger than "max_size" bytes and
+ *   EINVAL if the stream is invalid or truncated. On success, "ret_data"
+ *   points to the decompressed data, which is owned by the decompressor and
+ *   valid until the next call.
+ */
+int decompressor_decompress(decompressor_t *d, void const *data, size_t size,
+                            size_t max_size, void const **ret_data,
+                            size_t *ret_size);
+
+void decompressor_destroy(decompressor_t *d);
+
+#endif /* UTILS_COMPRESS_H */
@@ -0,0 +1,238 @@
+/**
+ * collectd - src/utils/compress/compress_test.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/compress/compress.h"
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+DEF_TEST(parse) {
+  compress_algorithm_t alg = COMPRESS_GZIP;
+
+  EXPECT_EQ_INT(0, compress_algorithm_parse("none", &alg));
+  EXPECT_EQ_INT(COMPRESS_NONE, alg);
+#if HAVE_ZLIB
+  EXPECT_EQ_INT(0, compress_algorithm_parse("Gzip", &alg));
+  EXPECT_EQ_INT(COMPRESS_GZIP, alg);
+  EXPECT_EQ_STR("gzip", compress_content_encoding(alg));
+#else
+  EXPECT_EQ_INT(ENOTSUP, compress_algorithm_parse("Gzip", &alg));
+#endif
+  EXPECT_EQ_INT(0, compress_algorithm_parse("snappy", &alg));
+  EXPECT_EQ_INT(COMPRESS_SNAPPY, alg);
+  EXPECT_EQ_STR("snappy", compress_content_encoding(alg));
+  EXPECT_EQ_INT(EINVAL, compress_algorithm_parse("invalid", &alg));
+  OK(compress_content_encoding(COMPRESS_NONE) == NULL);
+
+  return 0;
+}
+
+DEF_TEST(none) {
+  char const *data = "[{\"values\":[42]}]";
+  void const *out = NULL;
+  size_t out_size = 0;
+
+  compressor_t *c = compressor_create(COMPRESS_NONE);
+  CHECK_NOT_NULL(c);
+  EXPECT_EQ_INT(0, compressor_compress(c, data, strlen(data), &out, &out_size));
+  OK(out == data);
+  EXPECT_EQ_INT(strlen(data), out_size);
+  compressor_destroy(c);
+
+  return 0;
+}
+
+#if HAVE_ZLIB
+DEF_TEST(gzip) {
+  char data[8192];
+  size_t data_size = 0;
+
+  while (data_size + 64 < sizeof(data)) {
+    int n = snprintf(data + data_size, sizeof(data) - data_size,
+                     "{\"values\":[%zu],\"dstypes\":[\"gauge\"]},", data_size);
+    data_size += (size_t)n;
+  }
+
+  compressor_t *c = compressor_create(COMPRESS_GZIP);
+  CHECK_NOT_NULL(c);
+
+  /* The second round checks that the context is reset properly. */
+  for (int round = 0; round < 2; round++) {
+    void const *out = NULL;
+    size_t out_size = 0;
+    EXPECT_EQ_INT(0, compressor_compress(c, data, data_size, &out, &out_size));
+    OK(out_size > 0);
+    OK(out_size < data_size / 4);
+
+    char got[sizeof(data)];
+    z_stream zs = {0};
+    EXPECT_EQ_INT(Z_OK, inflateInit2(&zs, 16 + MAX_WBITS));
+    zs.next_in = (Bytef *)out;
+    zs.avail_in = (uInt)out_size;
+    zs.next_out = (Bytef *)got;
+    zs.avail_out = (uInt)sizeof(got);
+    EXPECT_EQ_INT(Z_STREAM_END, inflate(&zs, Z_FINISH));
+    EXPECT_EQ_INT(data_size, sizeof(got) - zs.avail_out);
+    OK(memcmp(data, got, data_size) == 0);
+    inflateEnd(&zs);
+  }
+
+  compressor_destroy(c);
+  return 0;
+}
+
+DEF_TEST(gzip_roundtrip) {
+  char data[4096];
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = (char)('a' + (i % 7));
+
+  compressor_t *c = compressor_create(COMPRESS_GZIP);
+  CHECK_NOT_NULL(c);
+  decompressor_t *d = decompressor_create(COMPRESS_GZIP);
+  CHECK_NOT_NULL(d);
+
+  void const *compressed = NULL;
+  size_t compressed_size = 0;
+  EXPECT_EQ_INT(0, compressor_compress(c, data, sizeof(data), &compressed,
+                                       &compressed_size));
+
+  /* The second round checks that the context is reset properly. */
+  for (int round = 0; round < 2; round++) {
+    void const *out = NULL;
+    size_t out_size = 0;
+    EXPECT_EQ_INT(0, decompressor_decompress(d, compressed, compressed_size,
+                                             sizeof(data), &out, &out_size));
+    EXPECT_EQ_INT(sizeof(data), out_size);
+    OK(memcmp(data, out, sizeof(data)) == 0);
+  }
+
+  void const *out = NULL;
+  size_t out_size = 0;
+  EXPECT_EQ_INT(EMSGSIZE,
+                decompressor_decompress(d, compressed, compressed_size,
+                                        sizeof(data) - 1, &out, &out_size));
+  EXPECT_EQ_INT(EINVAL,
+                decompressor_decompress(d, compressed, compressed_size / 2,
+                                        sizeof(data), &out, &out_size));
+
+  decompressor_destroy(d);
+  compressor_destroy(c);
+  return 0;
+}
+#endif
+
+DEF_TEST(snappy) {
+  /* "abcdabcdab": a literal "abcd" and a copy of six bytes at offset four,
+   * which overlaps its own output. */
+  unsigned char const stream[] = {0x0a, 0x0c, 'a', 'b', 'c', 'd', 0x09, 0x04};
+
+  decompressor_t *d = decompressor_create(COMPRESS_SNAPPY);
+  CHECK_NOT_NULL(d);
+
+  void const *out = NULL;
+  size_t out_size = 0;
+  EXPECT_EQ_INT(0, decompressor_decompress(d, stream, sizeof(stream), 64, &out,
+                                           &out_size));
+  EXPECT_EQ_INT(10, out_size);
+  OK(memcmp("abcdabcdab", out, out_size) == 0);
+
+  EXPECT_EQ_INT(EMSGSIZE, decompressor_decompress(d, stream, sizeof(stream),
+                                                  9, &out, &out_size));
+  EXPECT_EQ_INT(EINVAL, decompressor_decompress(d, stream, sizeof(stream) - 1,
+                                                64, &out, &out_size));
+  /* An offset pointing before the start of the output. */
+  unsigned char const invalid[] = {0x0a, 0x0c, 'a', 'b', 'c', 'd', 0x09, 0x05};
+  EXPECT_EQ_INT(EINVAL, decompressor_decompress(d, invalid, sizeof(invalid),
+                                                64, &out, &out_size));
+
+  decompressor_destroy(d);
+  return 0;
+}
+
+DEF_TEST(snappy_roundtrip) {
+  /* Larger than one snappy block, with a compressible first half and a
+   * pseudo-random second half. */
+  static char data[200000];
+  size_t half = sizeof(data) / 2;
+  size_t n = 0;
+  while (n + 64 < half) {
+    n += (size_t)snprintf(data + n, half - n,
+                          "collectd_cpu_total{cpu=\"%zu\",type=\"idle\"} ",
+                          n % 16);
+  }
+  uint32_t x = 2463534242u;
+  for (size_t i = n; i < sizeof(data); i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    data[i] = (char)(x & 0xff);
+  }
+
+  compressor_t *c = compressor_create(COMPRESS_SNAPPY);
+  CHECK_NOT_NULL(c);
+  decompressor_t *d = decompressor_create(COMPRESS_SNAPPY);
+  CHECK_NOT_NULL(d);
+
+  size_t sizes[] = {0, 1, 15, 16, 1000, half, sizeof(data)};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sizes); i++) {
+    void const *compressed = NULL;
+    size_t compressed_size = 0;
+    EXPECT_EQ_INT(0, compressor_compress(c, data, sizes[i], &compressed,
+                                         &compressed_size));
+    OK(compressed_size <= 32 + sizes[i] + sizes[i] / 6);
+    if (sizes[i] == half)
+      OK(compressed_size < half / 4);
+
+    void const *out = NULL;
+    size_t out_size = 0;
+    EXPECT_EQ_INT(0, decompressor_decompress(d, compressed, compressed_size,
+                                             sizeof(data), &out, &out_size));
+    EXPECT_EQ_INT(sizes[i], out_size);
+    OK(memcmp(data, out, sizes[i]) == 0);
+  }
+
+  decompressor_destroy(d);
+  compressor_destroy(c);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(parse);
+  RUN_TEST(none);
+  RUN_TEST(snappy);
+  RUN_TEST(snappy_roundtrip);
+#if HAVE_ZLIB
+  RUN_TEST(gzip);
+  RUN_TEST(gzip_roundtrip);
+#endif
+
+  END_TEST;
+}
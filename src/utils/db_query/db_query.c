@@ -30,6 +30,10 @@
 #include "utils/common/common.h"
 #include "utils/db_query/db_query.h"
 
+/* Value lists created from the rows of a result are dispatched in batches of
+ * this size, and when the result is finished. */
+#define UDB_DISPATCH_BATCH_SIZE 128
+
 /*
  * Data types
  */
@@ -68,7 +72,7 @@ struct udb_result_preparation_area_s /* {{{ */
   size_t *values_pos;
   size_t *metadata_pos;
   char **instances_buffer;
-  char **values_buffer;
+  udb_column_t const **values_buffer;
   char **metadata_buffer;
   char *plugin_instance;
 
@@ -84,6 +88,15 @@ struct udb_query_preparation_area_s /* {{{ */
   char *plugin;
   char *db_name;
 
+  /* Numeric columns that are used as strings, and their string buffers. */
+  bool *string_columns;
+  char (*number_strings)[DATA_MAX_NAME_LEN];
+
+  /* Value lists waiting to be dispatched. "values" and "meta" are owned by
+   * the batch. */
+  value_list_t *batch;
+  size_t batch_num;
+
   udb_result_preparation_area_t *result_prep_areas;
 }; /* }}} */
 
@@ -153,6 +166,46 @@ static int udb_config_set_uint(unsigned int *ret_value, /* {{{ */
   return 0;
 } /* }}} int udb_config_set_uint */
 
+/*
+ * Batch private functions
+ */
+static void udb_batch_flush(udb_query_preparation_area_t *q_area) /* {{{ */
+{
+  if (q_area->batch_num == 0)
+    return;
+
+  plugin_dispatch_values_batch(q_area->batch, q_area->batch_num);
+
+  for (size_t i = 0; i < q_area->batch_num; i++) {
+    sfree(q_area->batch[i].values);
+    meta_data_destroy(q_area->batch[i].meta);
+    q_area->batch[i].meta = NULL;
+  }
+  q_area->batch_num = 0;
+} /* }}} void udb_batch_flush */
+
+/* Takes ownership of the values and meta data of "vl". */
+static int udb_batch_add(udb_query_preparation_area_t *q_area, /* {{{ */
+                         value_list_t const *vl) {
+  if (q_area->batch == NULL) {
+    q_area->batch = calloc(UDB_DISPATCH_BATCH_SIZE, sizeof(*q_area->batch));
+    if (q_area->batch == NULL) {
+      /* Fall back to dispatching this value list on its own. */
+      int status = plugin_dispatch_values(vl);
+      free(vl->values);
+      meta_data_destroy(vl->meta);
+      return status;
+    }
+  }
+
+  q_area->batch[q_area->batch_num] = *vl;
+  q_area->batch_num++;
+
+  if (q_area->batch_num >= UDB_DISPATCH_BATCH_SIZE)
+    udb_batch_flush(q_area);
+  return 0;
+} /* }}} int udb_batch_add */
+
 /*
  * Result private functions
  */
@@ -175,11 +228,35 @@ static int udb_result_submit(udb_result_t *r, /* {{{ */
   vl.values_len = r_area->ds->ds_num;
 
   for (size_t i = 0; i < r->values_num; i++) {
-    char *value_str = r_area->values_buffer[i];
+    udb_column_t const *c = r_area->values_buffer[i];
+    int ds_type = r_area->ds->ds[i].type;
+
+    if (c->type == UDB_COLUMN_DOUBLE) {
+      if (ds_type == DS_TYPE_GAUGE)
+        vl.values[i].gauge = (gauge_t)c->value.number;
+      else if (ds_type == DS_TYPE_DERIVE)
+        vl.values[i].derive = (derive_t)c->value.number;
+      else if (ds_type == DS_TYPE_COUNTER)
+        vl.values[i].counter = (counter_t)c->value.number;
+      else
+        vl.values[i].absolute = (absolute_t)c->value.number;
+      continue;
+    } else if (c->type == UDB_COLUMN_INT64) {
+      if (ds_type == DS_TYPE_GAUGE)
+        vl.values[i].gauge = (gauge_t)c->value.integer;
+      else if (ds_type == DS_TYPE_DERIVE)
+        vl.values[i].derive = (derive_t)c->value.integer;
+      else if (ds_type == DS_TYPE_COUNTER)
+        vl.values[i].counter = (counter_t)c->value.integer;
+      else
+        vl.values[i].absolute = (absolute_t)c->value.integer;
+      continue;
+    }
 
-    if (0 != parse_value(value_str, &vl.values[i], r_area->ds->ds[i].type)) {
+    char const *value_str = c->value.string;
+    if (0 != parse_value(value_str, &vl.values[i], ds_type)) {
       P_ERROR("udb_result_submit: Parsing `%s' as %s failed.", value_str,
-              DS_TYPE_TO_STRING(r_area->ds->ds[i].type));
+              DS_TYPE_TO_STRING(ds_type));
       errno = EINVAL;
       free(vl.values);
       return -1;
@@ -213,6 +290,7 @@ static int udb_result_submit(udb_result_t *r, /* {{{ */
         P_ERROR(
             "udb_result_submit: creating type_instance failed with status %d.",
             status);
+        free(vl.values);
         return status;
       }
     } else {
@@ -224,6 +302,7 @@ static int udb_result_submit(udb_result_t *r, /* {{{ */
         P_ERROR(
             "udb_result_submit: creating type_instance failed with status %d.",
             status);
+        free(vl.values);
         return status;
       }
       tmp[sizeof(tmp) - 1] = '\0';
@@ -258,14 +337,7 @@ static int udb_result_submit(udb_result_t *r, /* {{{ */
   }
   /* }}} */
 
-  plugin_dispatch_values(&vl);
-
-  if (r->metadata_num > 0) {
-    meta_data_destroy(vl.meta);
-    vl.meta = NULL;
-  }
-  sfree(vl.values);
-  return 0;
+  return udb_batch_add(q_area, &vl);
 } /* }}} void udb_result_submit */
 
 static void udb_result_finish_result(udb_result_t const *r, /* {{{ */
@@ -286,6 +358,7 @@ static int udb_result_handle_result(udb_result_t *r, /* {{{ */
                                     udb_query_preparation_area_t *q_area,
                                     udb_result_preparation_area_t *r_area,
                                     udb_query_t const *q,
+                                    udb_column_t const *columns,
                                     char **column_values) {
   assert(r && q_area && r_area);
 
@@ -293,7 +366,7 @@ static int udb_result_handle_result(udb_result_t *r, /* {{{ */
     r_area->instances_buffer[i] = column_values[r_area->instances_pos[i]];
 
   for (size_t i = 0; i < r->values_num; i++)
-    r_area->values_buffer[i] = column_values[r_area->values_pos[i]];
+    r_area->values_buffer[i] = columns + r_area->values_pos[i];
 
   for (size_t i = 0; i < r->metadata_num; i++)
     r_area->metadata_buffer[i] = column_values[r_area->metadata_pos[i]];
@@ -828,10 +901,14 @@ void udb_query_finish_result(udb_query_t const *q, /* {{{ */
   if ((q == NULL) || (prep_area == NULL))
     return;
 
+  udb_batch_flush(prep_area);
+
   prep_area->column_num = 0;
   sfree(prep_area->host);
   sfree(prep_area->plugin);
   sfree(prep_area->db_name);
+  sfree(prep_area->string_columns);
+  sfree(prep_area->number_strings);
 
   for (r = q->results, r_area = prep_area->result_prep_areas; r != NULL;
        r = r->next, r_area = r_area->next) {
@@ -842,31 +919,32 @@ void udb_query_finish_result(udb_query_t const *q, /* {{{ */
   }
 } /* }}} void udb_query_finish_result */
 
-int udb_query_handle_result(udb_query_t const *q, /* {{{ */
-                            udb_query_preparation_area_t *prep_area,
-                            char **column_values) {
+/* udb_query_handle_row passes one row to all results. "column_values" holds
+ * the string of each column that is used as a string. */
+static int udb_query_handle_row(udb_query_t const *q, /* {{{ */
+                                udb_query_preparation_area_t *prep_area,
+                                udb_column_t const *columns,
+                                char **column_values) {
   udb_result_preparation_area_t *r_area;
   udb_result_t *r;
   int success;
   int status;
 
-  if ((q == NULL) || (prep_area == NULL))
-    return -EINVAL;
-
-  if ((prep_area->column_num < 1) || (prep_area->host == NULL) ||
-      (prep_area->plugin == NULL) || (prep_area->db_name == NULL)) {
-    P_ERROR("Query `%s': Query is not prepared; "
-            "can't handle result.",
-            q->name);
-    return -EINVAL;
-  }
-
 #if defined(COLLECT_DEBUG) && COLLECT_DEBUG /* {{{ */
   do {
     for (size_t i = 0; i < prep_area->column_num; i++) {
-      DEBUG("udb_query_handle_result (%s, %s): "
-            "column[%" PRIsz "] = %s;",
-            prep_area->db_name, q->name, i, column_values[i]);
+      if (columns[i].type == UDB_COLUMN_STRING)
+        DEBUG("udb_query_handle_result (%s, %s): "
+              "column[%" PRIsz "] = %s;",
+              prep_area->db_name, q->name, i, columns[i].value.string);
+      else if (columns[i].type == UDB_COLUMN_DOUBLE)
+        DEBUG("udb_query_handle_result (%s, %s): "
+              "column[%" PRIsz "] = %g;",
+              prep_area->db_name, q->name, i, columns[i].value.number);
+      else
+        DEBUG("udb_query_handle_result (%s, %s): "
+              "column[%" PRIsz "] = %" PRIi64 ";",
+              prep_area->db_name, q->name, i, columns[i].value.integer);
     }
   } while (0);
 #endif /* }}} */
@@ -874,7 +952,8 @@ int udb_query_handle_result(udb_query_t const *q, /* {{{ */
   success = 0;
   for (r = q->results, r_area = prep_area->result_prep_areas; r != NULL;
        r = r->next, r_area = r_area->next) {
-    status = udb_result_handle_result(r, prep_area, r_area, q, column_values);
+    status = udb_result_handle_result(r, prep_area, r_area, q, columns,
+                                      column_values);
     if (status == 0)
       success++;
   }
@@ -887,8 +966,71 @@ int udb_query_handle_result(udb_query_t const *q, /* {{{ */
   }
 
   return 0;
+} /* }}} int udb_query_handle_row */
+
+static int udb_query_check_prepared(udb_query_t const *q, /* {{{ */
+                                    udb_query_preparation_area_t *prep_area) {
+  if ((q == NULL) || (prep_area == NULL))
+    return -EINVAL;
+
+  if ((prep_area->column_num < 1) || (prep_area->host == NULL) ||
+      (prep_area->plugin == NULL) || (prep_area->db_name == NULL)) {
+    P_ERROR("Query `%s': Query is not prepared; "
+            "can't handle result.",
+            q->name);
+    return -EINVAL;
+  }
+
+  return 0;
+} /* }}} int udb_query_check_prepared */
+
+int udb_query_handle_result(udb_query_t const *q, /* {{{ */
+                            udb_query_preparation_area_t *prep_area,
+                            char **column_values) {
+  int status = udb_query_check_prepared(q, prep_area);
+  if (status != 0)
+    return status;
+
+  udb_column_t columns[prep_area->column_num];
+  for (size_t i = 0; i < prep_area->column_num; i++)
+    columns[i] = (udb_column_t){
+        .type = UDB_COLUMN_STRING,
+        .value.string = column_values[i],
+    };
+
+  return udb_query_handle_row(q, prep_area, columns, column_values);
 } /* }}} int udb_query_handle_result */
 
+int udb_query_handle_result_columns(udb_query_t const *q, /* {{{ */
+                                    udb_query_preparation_area_t *prep_area,
+                                    udb_column_t const *columns) {
+  int status = udb_query_check_prepared(q, prep_area);
+  if (status != 0)
+    return status;
+
+  char *column_values[prep_area->column_num];
+  for (size_t i = 0; i < prep_area->column_num; i++) {
+    udb_column_t const *c = columns + i;
+
+    if (c->type == UDB_COLUMN_STRING) {
+      column_values[i] = (char *)c->value.string;
+      continue;
+    }
+
+    column_values[i] = prep_area->number_strings[i];
+    if (!prep_area->string_columns[i])
+      continue;
+
+    if (c->type == UDB_COLUMN_DOUBLE)
+      ssnprintf(column_values[i], DATA_MAX_NAME_LEN, "%.15g", c->value.number);
+    else
+      ssnprintf(column_values[i], DATA_MAX_NAME_LEN, "%" PRIi64,
+                c->value.integer);
+  }
+
+  return udb_query_handle_row(q, prep_area, columns, column_values);
+} /* }}} int udb_query_handle_result_columns */
+
 int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
                              udb_query_preparation_area_t *prep_area,
                              const char *host, const char *plugin,
@@ -968,6 +1110,30 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
     }
   }
 
+  /* Remember which columns are used as strings, for
+   * udb_query_handle_result_columns(). {{{ */
+  prep_area->string_columns =
+      calloc(column_num, sizeof(*prep_area->string_columns));
+  prep_area->number_strings =
+      calloc(column_num, sizeof(*prep_area->number_strings));
+  if ((prep_area->string_columns == NULL) ||
+      (prep_area->number_strings == NULL)) {
+    P_ERROR("Query `%s': Prepare failed: Out of memory.", q->name);
+    udb_query_finish_result(q, prep_area);
+    return -ENOMEM;
+  }
+
+  if (q->plugin_instance_from != NULL)
+    prep_area->string_columns[prep_area->plugin_instance_pos] = true;
+  for (r = q->results, r_area = prep_area->result_prep_areas; r != NULL;
+       r = r->next, r_area = r_area->next) {
+    for (size_t i = 0; i < r->instances_num; i++)
+      prep_area->string_columns[r_area->instances_pos[i]] = true;
+    for (size_t i = 0; i < r->metadata_num; i++)
+      prep_area->string_columns[r_area->metadata_pos[i]] = true;
+  }
+  /* }}} */
+
   return 0;
 } /* }}} int udb_query_prepare_result */
 
@@ -1028,9 +1194,14 @@ void udb_query_delete_preparation_area(
     free(area);
   }
 
+  udb_batch_flush(q_area);
+  sfree(q_area->batch);
+
   sfree(q_area->host);
   sfree(q_area->plugin);
   sfree(q_area->db_name);
+  sfree(q_area->string_columns);
+  sfree(q_area->number_strings);
 
   free(q_area);
 } /* }}} void udb_query_delete_preparation_area */
@@ -38,6 +38,23 @@ typedef struct udb_query_preparation_area_s udb_query_preparation_area_t;
 
 typedef int (*udb_query_create_callback_t)(udb_query_t *q, oconfig_item_t *ci);
 
+/* A column of a result row. Drivers that know the type of a column can pass
+ * numbers as such, which saves converting them to strings and back. */
+typedef enum {
+  UDB_COLUMN_STRING = 0,
+  UDB_COLUMN_DOUBLE,
+  UDB_COLUMN_INT64,
+} udb_column_type_t;
+
+typedef struct {
+  udb_column_type_t type;
+  union {
+    char const *string;
+    double number;
+    int64_t integer;
+  } value;
+} udb_column_t;
+
 /*
  * Public functions
  */
@@ -75,6 +92,12 @@ int udb_query_prepare_result(udb_query_t const *q,
 int udb_query_handle_result(udb_query_t const *q,
                             udb_query_preparation_area_t *prep_area,
                             char **column_values);
+/* Like udb_query_handle_result(), with "column_num" typed columns. Numeric
+ * columns are formatted as strings only if used for instances, meta data or
+ * the plugin instance. */
+int udb_query_handle_result_columns(udb_query_t const *q,
+                                    udb_query_preparation_area_t *prep_area,
+                                    udb_column_t const *columns);
 void udb_query_finish_result(udb_query_t const *q,
                              udb_query_preparation_area_t *prep_area);
 
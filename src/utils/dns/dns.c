@@ -159,14 +159,6 @@ static ip_list_t *IgnoreList;
 
 #if HAVE_PCAP_H
 static void (*Callback)(const rfc1035_header_t *);
-
-static int query_count_intvl;
-static int query_count_total;
-#ifdef __OpenBSD__
-static struct bpf_timeval last_ts;
-#else
-static struct timeval last_ts;
-#endif /* __OpenBSD__ */
 #endif /* HAVE_PCAP_H */
 
 static int cmp_in6_addr(const struct in6_addr *a, const struct in6_addr *b) {
@@ -256,12 +248,14 @@ void dnstop_set_callback(void (*cb)(const rfc1035_header_t *)) {
 }
 
 #define RFC1035_MAXLABELSZ 63
+/* "loop_detect" is the number of compression pointers followed so far. It is
+ * passed along instead of kept in a static variable, so that packets can be
+ * parsed by several threads at once. */
 static int rfc1035NameUnpack(const char *buf, size_t sz, off_t *off, char *name,
-                             size_t ns) {
+                             size_t ns, int loop_detect) {
   off_t no = 0;
   unsigned char c;
   size_t len;
-  static int loop_detect;
   if (loop_detect > 2)
     return 4; /* compression loop */
   if (ns == 0)
@@ -287,9 +281,8 @@ static int rfc1035NameUnpack(const char *buf, size_t sz, off_t *off, char *name,
         return 2; /* bad compression ptr */
       if (ptr < DNS_MSG_HDR_SZ)
         return 2; /* bad compression ptr */
-      loop_detect++;
-      rc = rfc1035NameUnpack(buf, sz, &ptr, name + no, ns - no);
-      loop_detect--;
+      rc = rfc1035NameUnpack(buf, sz, &ptr, name + no, ns - no,
+                             loop_detect + 1);
       return rc;
     } else if (c > RFC1035_MAXLABELSZ) {
       /*
@@ -361,7 +354,8 @@ static int handle_dns(const char *buf, int len) {
 
   offset = DNS_MSG_HDR_SZ;
   memset(qh.qname, '\0', MAX_QNAME_SZ);
-  status = rfc1035NameUnpack(buf, len, &offset, qh.qname, MAX_QNAME_SZ);
+  status = rfc1035NameUnpack(buf, len, &offset, qh.qname, MAX_QNAME_SZ,
+                             /* loop_detect = */ 0);
   if (status != 0) {
     INFO("utils_dns: handle_dns: rfc1035NameUnpack failed "
          "with status %i.",
@@ -607,54 +601,48 @@ static int handle_linux_sll(const u_char *pkt, int len) {
 #endif /* DLT_LINUX_SLL */
 
 /* public function */
+/* "udata" may be the pcap handle the packet was captured with. This allows
+ * several threads to capture at once. Otherwise, the handle set with
+ * dnstop_set_pcap_obj() is used. */
 void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
                  const u_char *pkt) {
-  int status;
+  pcap_t *p = (udata != NULL) ? (pcap_t *)udata : pcap_obj;
 
   if (hdr->caplen < ETHER_HDR_LEN)
     return;
 
-  switch (pcap_datalink(pcap_obj)) {
+  switch (pcap_datalink(p)) {
   case DLT_EN10MB:
-    status = handle_ether(pkt, hdr->caplen);
+    handle_ether(pkt, hdr->caplen);
     break;
 #if HAVE_NET_IF_PPP_H
   case DLT_PPP:
-    status = handle_ppp(pkt, hdr->caplen);
+    handle_ppp(pkt, hdr->caplen);
     break;
 #endif
 #ifdef DLT_LOOP
   case DLT_LOOP:
-    status = handle_loop(pkt, hdr->caplen);
+    handle_loop(pkt, hdr->caplen);
     break;
 #endif
 #ifdef DLT_RAW
   case DLT_RAW:
-    status = handle_raw(pkt, hdr->caplen);
+    handle_raw(pkt, hdr->caplen);
     break;
 #endif
 #ifdef DLT_LINUX_SLL
   case DLT_LINUX_SLL:
-    status = handle_linux_sll(pkt, hdr->caplen);
+    handle_linux_sll(pkt, hdr->caplen);
     break;
 #endif
   case DLT_NULL:
-    status = handle_null(pkt, hdr->caplen);
+    handle_null(pkt, hdr->caplen);
     break;
 
   default:
-    ERROR("handle_pcap: unsupported data link type %d",
-          pcap_datalink(pcap_obj));
-    status = 0;
+    ERROR("handle_pcap: unsupported data link type %d", pcap_datalink(p));
     break;
-  } /* switch (pcap_datalink(pcap_obj)) */
-
-  if (0 == status)
-    return;
-
-  query_count_intvl++;
-  query_count_total++;
-  last_ts = hdr->ts;
+  } /* switch (pcap_datalink(p)) */
 }
 #endif /* HAVE_PCAP_H */
 
@@ -0,0 +1,184 @@
+/**
+ * collectd - src/utils/file_batch/file_batch.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/common/common.h"
+#include "utils/file_batch/file_batch.h"
+
+#define FILE_BATCH_BUFFER_MIN 256
+
+typedef struct {
+  char *path;
+  int fd;
+  bool ok;
+
+  char *buffer;
+  size_t buffer_size;
+  size_t len;
+} file_batch_entry_t;
+
+struct file_batch_s {
+  file_batch_entry_t *entries;
+  size_t entries_num;
+};
+
+file_batch_t *file_batch_create(void) /* {{{ */
+{
+  return calloc(1, sizeof(file_batch_t));
+} /* }}} file_batch_t *file_batch_create */
+
+void file_batch_destroy(file_batch_t *fb) /* {{{ */
+{
+  if (fb == NULL)
+    return;
+
+  for (size_t i = 0; i < fb->entries_num; i++) {
+    file_batch_entry_t *e = fb->entries + i;
+    if (e->fd >= 0)
+      close(e->fd);
+    sfree(e->path);
+    sfree(e->buffer);
+  }
+  sfree(fb->entries);
+  sfree(fb);
+} /* }}} void file_batch_destroy */
+
+int file_batch_add(file_batch_t *fb, char const *path) /* {{{ */
+{
+  if ((fb == NULL) || (path == NULL))
+    return -1;
+
+  file_batch_entry_t *tmp =
+      realloc(fb->entries, (fb->entries_num + 1) * sizeof(*fb->entries));
+  if (tmp == NULL)
+    return -1;
+  fb->entries = tmp;
+
+  file_batch_entry_t *e = fb->entries + fb->entries_num;
+  *e = (file_batch_entry_t){
+      .path = strdup(path),
+      .fd = -1,
+  };
+  if (e->path == NULL)
+    return -1;
+
+  return (int)fb->entries_num++;
+} /* }}} int file_batch_add */
+
+char const *file_batch_path(file_batch_t *fb, size_t idx) /* {{{ */
+{
+  if ((fb == NULL) || (idx >= fb->entries_num))
+    return NULL;
+  return fb->entries[idx].path;
+} /* }}} char const *file_batch_path */
+
+static int file_batch_read_entry(file_batch_entry_t *e) /* {{{ */
+{
+  if (e->fd < 0) {
+    e->fd = open(e->path, O_RDONLY | O_CLOEXEC);
+    if (e->fd < 0)
+      return errno;
+  }
+
+  e->len = 0;
+  while (42) {
+    /* Keep one byte for the null terminator. */
+    if ((e->buffer_size - e->len) < 2) {
+      size_t size = (e->buffer_size > 0) ? 2 * e->buffer_size
+                                          : FILE_BATCH_BUFFER_MIN;
+      char *tmp = realloc(e->buffer, size);
+      if (tmp == NULL)
+        return ENOMEM;
+      e->buffer = tmp;
+      e->buffer_size = size;
+    }
+
+    ssize_t status = pread(e->fd, e->buffer + e->len,
+                           e->buffer_size - e->len - 1, (off_t)e->len);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+
+      int err = errno;
+      close(e->fd);
+      e->fd = -1;
+      return err;
+    }
+    if (status == 0)
+      break;
+
+    e->len += (size_t)status;
+  }
+
+  e->buffer[e->len] = 0;
+  return 0;
+} /* }}} int file_batch_read_entry */
+
+size_t file_batch_read(file_batch_t *fb) /* {{{ */
+{
+  size_t num = 0;
+
+  if (fb == NULL)
+    return 0;
+
+  for (size_t i = 0; i < fb->entries_num; i++) {
+    file_batch_entry_t *e = fb->entries + i;
+
+    int status = file_batch_read_entry(e);
+    e->ok = (status == 0);
+    if (e->ok)
+      num++;
+    else
+      DEBUG("file_batch: Reading \"%s\" failed: %s", e->path, STRERROR(status));
+  }
+
+  return num;
+} /* }}} size_t file_batch_read */
+
+char const *file_batch_data(file_batch_t *fb, size_t idx, /* {{{ */
+                            size_t *ret_len) {
+  if ((fb == NULL) || (idx >= fb->entries_num) || !fb->entries[idx].ok)
+    return NULL;
+
+  if (ret_len != NULL)
+    *ret_len = fb->entries[idx].len;
+  return fb->entries[idx].buffer;
+} /* }}} char const *file_batch_data */
+
+int file_batch_value(file_batch_t *fb, size_t idx, /* {{{ */
+                     value_t *ret_value, int ds_type) {
+  char const *data = file_batch_data(fb, idx, NULL);
+  if (data == NULL)
+    return -1;
+
+  char buffer[256];
+  sstrncpy(buffer, data, sizeof(buffer));
+  buffer[strcspn(buffer, "\r\n")] = 0;
+
+  return parse_value(buffer, ret_value, ds_type);
+} /* }}} int file_batch_value */
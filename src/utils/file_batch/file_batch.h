@@ -0,0 +1,117 @@
+/**
+ * collectd - src/utils/file_batch/file_batch.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#ifndef UTILS_FILE_BATCH_H
+#define UTILS_FILE_BATCH_H 1
+
+#include "collectd.h"
+
+#include "plugin.h"
+
+/*
+ * A file batch is a set of small files, e.g. sysfs or procfs attributes, that
+ * are read together once per interval. The files are opened on first use and
+ * kept open; each read re-reads them from offset zero with pread(2). A file
+ * that fails to read is closed and opened again by the next read, so files
+ * that appear later, e.g. after CPU hotplug, are picked up.
+ *
+ * A file batch must not be used by several threads at the same time.
+ */
+struct file_batch_s;
+typedef struct file_batch_s file_batch_t;
+
+/*
+ * NAME
+ *   file_batch_create
+ *
+ * DESCRIPTION
+ *   Allocates an empty file batch. Returns NULL on failure.
+ */
+file_batch_t *file_batch_create(void);
+
+/*
+ * NAME
+ *   file_batch_destroy
+ *
+ * DESCRIPTION
+ *   Closes all files and frees the batch.
+ */
+void file_batch_destroy(file_batch_t *fb);
+
+/*
+ * NAME
+ *   file_batch_add
+ *
+ * DESCRIPTION
+ *   Adds "path" to the batch. The file is not opened until the next call to
+ *   file_batch_read(). Returns the index of the file, which is used to access
+ *   its content, or -1 on failure.
+ */
+int file_batch_add(file_batch_t *fb, char const *path);
+
+/*
+ * NAME
+ *   file_batch_path
+ *
+ * DESCRIPTION
+ *   Returns the path of the file with index "idx".
+ */
+char const *file_batch_path(file_batch_t *fb, size_t idx);
+
+/*
+ * NAME
+ *   file_batch_read
+ *
+ * DESCRIPTION
+ *   Reads the content of all files. Returns the number of files that could be
+ *   read.
+ */
+size_t file_batch_read(file_batch_t *fb);
+
+/*
+ * NAME
+ *   file_batch_data
+ *
+ * DESCRIPTION
+ *   Returns the content of the file with index "idx" as read by the last call
+ *   to file_batch_read(), or NULL if the file could not be read. The content is
+ *   null terminated and valid until the next call to file_batch_read(). If
+ *   "ret_len" is not NULL, the length of the content is stored there.
+ */
+char const *file_batch_data(file_batch_t *fb, size_t idx, size_t *ret_len);
+
+/*
+ * NAME
+ *   file_batch_value
+ *
+ * DESCRIPTION
+ *   Parses the first line of the file with index "idx" like
+ *   parse_value_file() does. Returns zero on success.
+ */
+int file_batch_value(file_batch_t *fb, size_t idx, value_t *ret_value,
+                     int ds_type);
+
+#endif /* UTILS_FILE_BATCH_H */
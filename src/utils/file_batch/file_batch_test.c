@@ -0,0 +1,106 @@
+/**
+ * collectd - src/utils/file_batch/file_batch_test.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/file_batch/file_batch.h"
+
+static char test_dir[] = "/tmp/collectd-file-batch-test-XXXXXX";
+
+static void write_file(char const *path, char const *content) {
+  FILE *fh = fopen(path, "w");
+  if (fh == NULL)
+    return;
+  fputs(content, fh);
+  fclose(fh);
+}
+
+DEF_TEST(read) {
+  char value_path[PATH_MAX];
+  char large_path[PATH_MAX];
+  char missing_path[PATH_MAX];
+  snprintf(value_path, sizeof(value_path), "%s/value", test_dir);
+  snprintf(large_path, sizeof(large_path), "%s/large", test_dir);
+  snprintf(missing_path, sizeof(missing_path), "%s/missing", test_dir);
+
+  char large[4096];
+  for (size_t i = 0; i < sizeof(large) - 1; i++)
+    large[i] = (i % 64 == 63) ? '\n' : 'a' + (i % 26);
+  large[sizeof(large) - 1] = 0;
+
+  write_file(value_path, "42\n");
+  write_file(large_path, large);
+
+  file_batch_t *fb = file_batch_create();
+  CHECK_NOT_NULL(fb);
+  EXPECT_EQ_INT(0, file_batch_add(fb, value_path));
+  EXPECT_EQ_INT(1, file_batch_add(fb, large_path));
+  EXPECT_EQ_INT(2, file_batch_add(fb, missing_path));
+  EXPECT_EQ_STR(missing_path, file_batch_path(fb, 2));
+
+  EXPECT_EQ_UINT64(2, file_batch_read(fb));
+
+  value_t v;
+  EXPECT_EQ_INT(0, file_batch_value(fb, 0, &v, DS_TYPE_DERIVE));
+  EXPECT_EQ_UINT64(42, (uint64_t)v.derive);
+
+  size_t len = 0;
+  EXPECT_EQ_STR(large, file_batch_data(fb, 1, &len));
+  EXPECT_EQ_UINT64(strlen(large), len);
+
+  OK(file_batch_data(fb, 2, NULL) == NULL);
+  OK(file_batch_value(fb, 2, &v, DS_TYPE_DERIVE) != 0);
+
+  /* Files are re-read from the start and missing files are retried. */
+  write_file(value_path, "23\n");
+  write_file(missing_path, "1.5\nignored\n");
+  EXPECT_EQ_UINT64(3, file_batch_read(fb));
+
+  EXPECT_EQ_INT(0, file_batch_value(fb, 0, &v, DS_TYPE_DERIVE));
+  EXPECT_EQ_UINT64(23, (uint64_t)v.derive);
+  EXPECT_EQ_INT(0, file_batch_value(fb, 2, &v, DS_TYPE_GAUGE));
+  EXPECT_EQ_DOUBLE(1.5, v.gauge);
+
+  unlink(value_path);
+  unlink(large_path);
+  unlink(missing_path);
+
+  file_batch_destroy(fb);
+  return 0;
+}
+
+int main(void) {
+  if (mkdtemp(test_dir) == NULL) {
+    fprintf(stderr, "mkdtemp failed: %s\n", STRERRNO);
+    return 1;
+  }
+
+  RUN_TEST(read);
+
+  rmdir(test_dir);
+
+  END_TEST;
+}
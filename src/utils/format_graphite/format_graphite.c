@@ -26,11 +26,51 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 
+#include "utils/avltree/avltree.h"
 #include "utils/format_graphite/format_graphite.h"
 #include "utils_cache.h"
 
 #define GRAPHITE_FORBIDDEN " \t\"\\:!,/()\n\r"
 
+/* Cached names are dropped when their series has not been written for this
+ * many intervals. The cache is scanned for such entries at most once per
+ * GRAPHITE_CACHE_PRUNE_INTERVAL. */
+#define GRAPHITE_CACHE_TIMEOUT_FACTOR 10
+#define GRAPHITE_CACHE_PRUNE_INTERVAL TIME_T_TO_CDTIME_T_STATIC(60)
+
+typedef struct {
+  char *host;
+  char *plugin;
+  char *plugin_instance;
+  char *type;
+  char *type_instance;
+} gr_ident_t;
+
+typedef struct {
+  gr_ident_t ident; /* must be first: used as the AVL key */
+
+  /* One rendered metric name per data source. */
+  char **names;
+  size_t *names_len;
+  size_t names_num;
+
+  cdtime_t last_time;
+  cdtime_t interval;
+} gr_name_entry_t;
+
+struct graphite_cache_s {
+  c_avl_tree_t *tree;
+
+  char *prefix;
+  char *postfix;
+  char escape_char;
+  unsigned int flags;
+  /* See gr_format_key(). NULL if the options don't fit. */
+  char *format_key;
+
+  cdtime_t last_prune;
+};
+
 /* Utils functions to format data sets in graphite format.
  * Largely taken from write_graphite.c as it remains the same formatting */
 
@@ -71,8 +111,6 @@ static int gr_format_values(char *ret, size_t ret_len, int ds_num,
 
   assert(0 == strcmp(ds->type, vl->type));
 
-  memset(ret, 0, ret_len);
-
 #define BUFFER_ADD(...)                                                        \
   do {                                                                         \
     status = snprintf(ret + offset, ret_len - offset, __VA_ARGS__);            \
@@ -294,12 +332,126 @@ static void escape_graphite_string(char *buffer, char escape_char) {
     *head = escape_char;
 }
 
+/* gr_format_line appends one "<name> <value> <time>\r\n" line to "buffer",
+ * starting at "*pos". On success "*pos" is advanced and the buffer is null
+ * terminated. If the line doesn't fit, -ENOMEM is returned and the buffer,
+ * up to and including the null byte at "*pos", is left unchanged. */
+static int gr_format_line(char *buffer, size_t buffer_size, size_t *pos,
+                          char const *name, size_t name_len,
+                          data_set_t const *ds, value_list_t const *vl,
+                          size_t ds_index, gauge_t const *rates) {
+  size_t offset = *pos;
+
+  /* name, separator and at least one digit of the value */
+  if ((offset + name_len + 2) >= buffer_size)
+    return -ENOMEM;
+
+  memcpy(buffer + offset, name, name_len);
+  offset += name_len;
+  buffer[offset] = ' ';
+  offset++;
+
+  int status = gr_format_values(buffer + offset, buffer_size - offset,
+                                (int)ds_index, ds, vl, rates);
+  if (status != 0) {
+    buffer[*pos] = 0;
+    return -ENOMEM;
+  }
+  offset += strlen(buffer + offset);
+
+  status = snprintf(buffer + offset, buffer_size - offset, " %u\r\n",
+                    (unsigned int)CDTIME_T_TO_TIME_T(vl->time));
+  if ((status < 1) || ((size_t)status >= (buffer_size - offset))) {
+    buffer[*pos] = 0;
+    return -ENOMEM;
+  }
+  offset += (size_t)status;
+
+  *pos = offset;
+  return 0;
+} /* int gr_format_line */
+
+/* gr_render_name writes the escaped metric name of data source "ds_index"
+ * to "ret". */
+static int gr_render_name(char *ret, size_t ret_len, data_set_t const *ds,
+                          value_list_t const *vl, size_t ds_index,
+                          char const *prefix, char const *postfix,
+                          char const escape_char, unsigned int flags) {
+  char const *ds_name = NULL;
+  int status;
+
+  if ((flags & GRAPHITE_ALWAYS_APPEND_DS) || (ds->ds_num > 1))
+    ds_name = ds->ds[ds_index].name;
+
+  /* Copy the identifier to `ret' and escape it. */
+  if (flags & GRAPHITE_USE_TAGS) {
+    status = gr_format_name_tagged(ret, (int)ret_len, vl, ds_name, prefix,
+                                   postfix, escape_char, flags);
+    if (status != 0) {
+      P_ERROR("format_graphite: error with gr_format_name_tagged");
+      return status;
+    }
+  } else {
+    status = gr_format_name(ret, (int)ret_len, vl, ds_name, prefix, postfix,
+                            escape_char, flags);
+    if (status != 0) {
+      P_ERROR("format_graphite: error with gr_format_name");
+      return status;
+    }
+  }
+
+  escape_graphite_string(ret, escape_char);
+  return 0;
+} /* int gr_render_name */
+
+/* Creates the key the output is shared with other write plugins under, see
+ * plugin_write_format_get(). It contains all options that change the output.
+ * Returns non-zero if the key doesn't fit into "key". */
+static int gr_format_key(char *key, size_t key_size, char const *prefix,
+                         char const *postfix, char const escape_char,
+                         unsigned int flags) {
+  int status = snprintf(key, key_size, "graphite:%#x:%d:%s:%s", flags,
+                        (int)escape_char, (prefix != NULL) ? prefix : "",
+                        (postfix != NULL) ? postfix : "");
+  return ((status < 0) || ((size_t)status >= key_size)) ? -1 : 0;
+} /* int gr_format_key */
+
+/* Copies the output of another write plugin for the same value list, if
+ * there is one. Returns ENOENT if there is none. */
+static int gr_format_shared(char *buffer, size_t buffer_size, size_t *ret_len,
+                            value_list_t const *vl, char const *key) {
+  size_t len = 0;
+  char const *formatted = plugin_write_format_get(vl, key, &len);
+  if (formatted == NULL)
+    return ENOENT;
+
+  if (len >= buffer_size)
+    return -ENOMEM;
+  memcpy(buffer, formatted, len + 1);
+  *ret_len = len;
+  return 0;
+} /* int gr_format_shared */
+
 int format_graphite(char *buffer, size_t buffer_size, data_set_t const *ds,
                     value_list_t const *vl, char const *prefix,
                     char const *postfix, char const escape_char,
                     unsigned int flags) {
   int status = 0;
-  int buffer_pos = 0;
+  size_t buffer_pos = 0;
+
+  if (buffer_size < 1)
+    return -ENOMEM;
+  buffer[0] = 0;
+
+  char format_key[3 * DATA_MAX_NAME_LEN];
+  bool shared = (gr_format_key(format_key, sizeof(format_key), prefix, postfix,
+                               escape_char, flags) == 0);
+  if (shared) {
+    status = gr_format_shared(buffer, buffer_size, &buffer_pos, vl, format_key);
+    if (status != ENOENT)
+      return status;
+    status = 0;
+  }
 
   gauge_t *rates = NULL;
   if (flags & GRAPHITE_STORE_RATES) {
@@ -311,67 +463,278 @@ int format_graphite(char *buffer, size_t buffer_size, data_set_t const *ds,
   }
 
   for (size_t i = 0; i < ds->ds_num; i++) {
-    char const *ds_name = NULL;
     char key[10 * DATA_MAX_NAME_LEN];
-    char values[512];
-    size_t message_len;
-    char message[1024];
-
-    if ((flags & GRAPHITE_ALWAYS_APPEND_DS) || (ds->ds_num > 1))
-      ds_name = ds->ds[i].name;
-
-    /* Copy the identifier to `key' and escape it. */
-    if (flags & GRAPHITE_USE_TAGS) {
-      status = gr_format_name_tagged(key, sizeof(key), vl, ds_name, prefix,
-                                     postfix, escape_char, flags);
-      if (status != 0) {
-        P_ERROR("format_graphite: error with gr_format_name_tagged");
-        sfree(rates);
-        return status;
-      }
-    } else {
-      status = gr_format_name(key, sizeof(key), vl, ds_name, prefix, postfix,
-                              escape_char, flags);
-      if (status != 0) {
-        P_ERROR("format_graphite: error with gr_format_name");
-        sfree(rates);
-        return status;
-      }
-    }
-
-    escape_graphite_string(key, escape_char);
 
-    /* Convert the values to an ASCII representation and put that into
-     * `values'. */
-    status = gr_format_values(values, sizeof(values), i, ds, vl, rates);
+    status = gr_render_name(key, sizeof(key), ds, vl, i, prefix, postfix,
+                            escape_char, flags);
     if (status != 0) {
-      P_ERROR("format_graphite: error with gr_format_values");
       sfree(rates);
       return status;
     }
 
-    /* Compute the graphite command */
-    message_len =
-        (size_t)snprintf(message, sizeof(message), "%s %s %u\r\n", key, values,
-                         (unsigned int)CDTIME_T_TO_TIME_T(vl->time));
-    if (message_len >= sizeof(message)) {
-      P_ERROR("format_graphite: message buffer too small: "
-              "Need %" PRIsz " bytes.",
-              message_len + 1);
-      sfree(rates);
-      return -ENOMEM;
-    }
-
     /* Append it in case we got multiple data set */
-    if ((buffer_pos + message_len) >= buffer_size) {
+    status = gr_format_line(buffer, buffer_size, &buffer_pos, key,
+                            strlen(key), ds, vl, i, rates);
+    if (status != 0) {
       P_ERROR("format_graphite: target buffer too small");
       sfree(rates);
-      return -ENOMEM;
+      return status;
     }
-    memcpy((void *)(buffer + buffer_pos), message, message_len);
-    buffer_pos += message_len;
-    buffer[buffer_pos] = '\0';
   }
   sfree(rates);
+
+  if (shared)
+    plugin_write_format_put(vl, format_key, buffer, buffer_pos);
   return status;
 } /* int format_graphite */
+
+static int gr_ident_compare(void const *a, void const *b) {
+  gr_ident_t const *ia = a;
+  gr_ident_t const *ib = b;
+  int status;
+
+  if ((status = strcmp(ia->type, ib->type)) != 0)
+    return status;
+  if ((status = strcmp(ia->plugin, ib->plugin)) != 0)
+    return status;
+  if ((status = strcmp(ia->type_instance, ib->type_instance)) != 0)
+    return status;
+  if ((status = strcmp(ia->plugin_instance, ib->plugin_instance)) != 0)
+    return status;
+  return strcmp(ia->host, ib->host);
+} /* int gr_ident_compare */
+
+static void gr_name_entry_free_names(gr_name_entry_t *e) {
+  for (size_t i = 0; i < e->names_num; i++)
+    sfree(e->names[i]);
+  sfree(e->names);
+  sfree(e->names_len);
+  e->names_num = 0;
+}
+
+static void gr_name_entry_free(gr_name_entry_t *e) {
+  if (e == NULL)
+    return;
+
+  gr_name_entry_free_names(e);
+  sfree(e->ident.host);
+  sfree(e->ident.plugin);
+  sfree(e->ident.plugin_instance);
+  sfree(e->ident.type);
+  sfree(e->ident.type_instance);
+  sfree(e);
+}
+
+static gr_name_entry_t *gr_name_entry_create(value_list_t const *vl) {
+  gr_name_entry_t *e = calloc(1, sizeof(*e));
+  if (e == NULL)
+    return NULL;
+
+  e->ident.host = strdup(vl->host);
+  e->ident.plugin = strdup(vl->plugin);
+  e->ident.plugin_instance = strdup(vl->plugin_instance);
+  e->ident.type = strdup(vl->type);
+  e->ident.type_instance = strdup(vl->type_instance);
+  if ((e->ident.host == NULL) || (e->ident.plugin == NULL) ||
+      (e->ident.plugin_instance == NULL) || (e->ident.type == NULL) ||
+      (e->ident.type_instance == NULL)) {
+    gr_name_entry_free(e);
+    return NULL;
+  }
+
+  return e;
+}
+
+/* gr_name_entry_render (re-)renders the names of all data sources of "ds". */
+static int gr_name_entry_render(graphite_cache_t *gc, gr_name_entry_t *e,
+                                data_set_t const *ds, value_list_t const *vl) {
+  gr_name_entry_free_names(e);
+
+  e->names = calloc(ds->ds_num, sizeof(*e->names));
+  e->names_len = calloc(ds->ds_num, sizeof(*e->names_len));
+  if ((e->names == NULL) || (e->names_len == NULL)) {
+    gr_name_entry_free_names(e);
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    char key[10 * DATA_MAX_NAME_LEN];
+
+    int status = gr_render_name(key, sizeof(key), ds, vl, i, gc->prefix,
+                                gc->postfix, gc->escape_char, gc->flags);
+    if (status == 0) {
+      e->names[i] = strdup(key);
+      if (e->names[i] == NULL)
+        status = ENOMEM;
+    }
+    if (status != 0) {
+      e->names_num = i;
+      gr_name_entry_free_names(e);
+      return status;
+    }
+    e->names_len[i] = strlen(key);
+  }
+  e->names_num = ds->ds_num;
+
+  return 0;
+} /* int gr_name_entry_render */
+
+/* gr_cache_prune removes entries whose series have not been written for
+ * GRAPHITE_CACHE_TIMEOUT_FACTOR intervals. */
+static void gr_cache_prune(graphite_cache_t *gc, cdtime_t now) {
+  gr_name_entry_t *expired[64];
+  size_t expired_num;
+
+  do {
+    c_avl_iterator_t *iter = c_avl_get_iterator(gc->tree);
+    gr_name_entry_t *e;
+    void *key;
+
+    expired_num = 0;
+    while ((expired_num < STATIC_ARRAY_SIZE(expired)) &&
+           (c_avl_iterator_next(iter, &key, (void *)&e) == 0)) {
+      if ((e->last_time + GRAPHITE_CACHE_TIMEOUT_FACTOR * e->interval) < now)
+        expired[expired_num++] = e;
+    }
+    c_avl_iterator_destroy(iter);
+
+    for (size_t i = 0; i < expired_num; i++) {
+      c_avl_remove(gc->tree, &expired[i]->ident, NULL, NULL);
+      gr_name_entry_free(expired[i]);
+    }
+  } while (expired_num == STATIC_ARRAY_SIZE(expired));
+
+  gc->last_prune = now;
+} /* void gr_cache_prune */
+
+graphite_cache_t *graphite_cache_create(char const *prefix,
+                                        char const *postfix,
+                                        char const escape_char,
+                                        unsigned int flags) {
+  graphite_cache_t *gc = calloc(1, sizeof(*gc));
+  if (gc == NULL)
+    return NULL;
+
+  gc->tree = c_avl_create(gr_ident_compare);
+  gc->prefix = (prefix != NULL) ? strdup(prefix) : NULL;
+  gc->postfix = (postfix != NULL) ? strdup(postfix) : NULL;
+  if ((gc->tree == NULL) || ((prefix != NULL) && (gc->prefix == NULL)) ||
+      ((postfix != NULL) && (gc->postfix == NULL))) {
+    graphite_cache_destroy(gc);
+    return NULL;
+  }
+  gc->escape_char = escape_char;
+  gc->flags = flags;
+
+  char format_key[3 * DATA_MAX_NAME_LEN];
+  if (gr_format_key(format_key, sizeof(format_key), prefix, postfix,
+                    escape_char, flags) == 0) {
+    gc->format_key = strdup(format_key);
+    if (gc->format_key == NULL) {
+      graphite_cache_destroy(gc);
+      return NULL;
+    }
+  }
+
+  return gc;
+} /* graphite_cache_t *graphite_cache_create */
+
+void graphite_cache_destroy(graphite_cache_t *gc) {
+  if (gc == NULL)
+    return;
+
+  if (gc->tree != NULL) {
+    void *key;
+    gr_name_entry_t *e;
+
+    while (c_avl_pick(gc->tree, &key, (void *)&e) == 0)
+      gr_name_entry_free(e);
+    c_avl_destroy(gc->tree);
+  }
+
+  sfree(gc->prefix);
+  sfree(gc->postfix);
+  sfree(gc->format_key);
+  sfree(gc);
+} /* void graphite_cache_destroy */
+
+int format_graphite_cached(graphite_cache_t *gc, char *buffer,
+                           size_t buffer_size, size_t *ret_len,
+                           data_set_t const *ds, value_list_t const *vl) {
+  if ((gc == NULL) || (buffer == NULL) || (buffer_size < 1) ||
+      (ret_len == NULL))
+    return -EINVAL;
+
+  if (gc->format_key != NULL) {
+    int status = gr_format_shared(buffer, buffer_size, ret_len, vl,
+                                  gc->format_key);
+    if (status != ENOENT)
+      return status;
+  }
+
+  gr_ident_t ident = {
+      .host = (char *)vl->host,
+      .plugin = (char *)vl->plugin,
+      .plugin_instance = (char *)vl->plugin_instance,
+      .type = (char *)vl->type,
+      .type_instance = (char *)vl->type_instance,
+  };
+
+  gr_name_entry_t *e = NULL;
+  if (c_avl_get(gc->tree, &ident, (void *)&e) != 0) {
+    e = gr_name_entry_create(vl);
+    if (e == NULL) {
+      P_ERROR("format_graphite_cached: calloc failed.");
+      return -ENOMEM;
+    }
+    if (c_avl_insert(gc->tree, &e->ident, e) != 0) {
+      P_ERROR("format_graphite_cached: c_avl_insert failed.");
+      gr_name_entry_free(e);
+      return -ENOMEM;
+    }
+  }
+
+  if (e->names_num != ds->ds_num) {
+    int status = gr_name_entry_render(gc, e, ds, vl);
+    if (status != 0)
+      return (status > 0) ? -status : status;
+  }
+  e->last_time = vl->time;
+  e->interval = vl->interval;
+
+  gauge_t *rates = NULL;
+  if (gc->flags & GRAPHITE_STORE_RATES) {
+    rates = uc_get_rate(ds, vl);
+    if (rates == NULL) {
+      P_ERROR("format_graphite_cached: error with uc_get_rate");
+      return -1;
+    }
+  }
+
+  size_t pos = 0;
+  buffer[0] = 0;
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    int status = gr_format_line(buffer, buffer_size, &pos, e->names[i],
+                                e->names_len[i], ds, vl, i, rates);
+    if (status != 0) {
+      /* Don't leave a partial value list behind. */
+      buffer[0] = 0;
+      sfree(rates);
+      return status;
+    }
+  }
+  sfree(rates);
+
+  if ((vl->time - gc->last_prune) >= GRAPHITE_CACHE_PRUNE_INTERVAL) {
+    if (gc->last_prune != 0)
+      gr_cache_prune(gc, vl->time);
+    else
+      gc->last_prune = vl->time;
+  }
+
+  if (gc->format_key != NULL)
+    plugin_write_format_put(vl, gc->format_key, buffer, pos);
+
+  *ret_len = pos;
+  return 0;
+} /* int format_graphite_cached */
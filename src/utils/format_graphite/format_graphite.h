@@ -39,4 +39,26 @@ int format_graphite(char *buffer, size_t buffer_size, const data_set_t *ds,
                     const char *postfix, const char escape_char,
                     unsigned int flags);
 
+/* graphite_cache_t holds the rendered metric names of value lists, so that
+ * only the values and the timestamp have to be formatted for every write.
+ * The names depend on the prefix, postfix, escape character and flags, which
+ * are fixed when creating the cache. A cache is not thread-safe: callers must
+ * serialize calls using the same cache. */
+struct graphite_cache_s;
+typedef struct graphite_cache_s graphite_cache_t;
+
+graphite_cache_t *graphite_cache_create(const char *prefix,
+                                        const char *postfix,
+                                        const char escape_char,
+                                        unsigned int flags);
+void graphite_cache_destroy(graphite_cache_t *gc);
+
+/* format_graphite_cached formats "vl" like format_graphite() and stores the
+ * number of bytes written, not including the null byte, in "ret_len". If the
+ * lines don't fit into "buffer", -ENOMEM is returned without logging an error
+ * and "buffer" is set to the empty string. */
+int format_graphite_cached(graphite_cache_t *gc, char *buffer,
+                           size_t buffer_size, size_t *ret_len,
+                           const data_set_t *ds, const value_list_t *vl);
+
 #endif /* UTILS_FORMAT_GRAPHITE_H */
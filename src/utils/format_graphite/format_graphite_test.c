@@ -205,9 +205,55 @@ DEF_TEST(null_termination) {
   return 0;
 }
 
+DEF_TEST(cached) {
+  value_list_t vl = {
+      .values = &(value_t){.gauge = 42},
+      .values_len = 1,
+      .time = TIME_T_TO_CDTIME_T_STATIC(1480063672),
+      .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+      .host = "example.com",
+      .plugin = "test",
+      .plugin_instance = "foo",
+      .type = "single",
+  };
+
+  graphite_cache_t *gc = graphite_cache_create("pre.", NULL, '_', 0);
+  CHECK_NOT_NULL(gc);
+
+  char want[128];
+  char got[128];
+  size_t got_len = 0;
+
+  /* The second call uses the cached name and must format the new value. */
+  for (int i = 0; i < 2; i++) {
+    vl.values[0].gauge = 42 + i;
+    EXPECT_EQ_INT(0, format_graphite(want, sizeof(want), &ds_single, &vl,
+                                     "pre.", NULL, '_', 0));
+    EXPECT_EQ_INT(0, format_graphite_cached(gc, got, sizeof(got), &got_len,
+                                            &ds_single, &vl));
+    EXPECT_EQ_STR(want, got);
+    EXPECT_EQ_INT((int)strlen(want), (int)got_len);
+  }
+
+  /* A different series must not use the cached name. */
+  sstrncpy(vl.plugin_instance, "bar", sizeof(vl.plugin_instance));
+  EXPECT_EQ_INT(0, format_graphite_cached(gc, got, sizeof(got), &got_len,
+                                          &ds_single, &vl));
+  EXPECT_EQ_STR("pre.example_com.test-bar.single 43 1480063672\r\n", got);
+
+  /* Too small buffers are reported and leave an empty string behind. */
+  EXPECT_EQ_INT(-ENOMEM, format_graphite_cached(gc, got, 16, &got_len,
+                                                &ds_single, &vl));
+  EXPECT_EQ_STR("", got);
+
+  graphite_cache_destroy(gc);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(metric_name);
   RUN_TEST(null_termination);
+  RUN_TEST(cached);
 
   END_TEST;
 }
@@ -28,12 +28,44 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils/metadata/meta_data.h"
 #include "utils_cache.h"
 
 #include "utils/format_influxdb/format_influxdb.h"
 
+/* Cached prefixes are dropped when their series has not been written for this
+ * many intervals. The cache is scanned for such entries at most once per
+ * FI_CACHE_PRUNE_INTERVAL. */
+#define FI_CACHE_TIMEOUT_FACTOR 10
+#define FI_CACHE_PRUNE_INTERVAL TIME_T_TO_CDTIME_T_STATIC(60)
+
+typedef struct {
+  char *host;
+  char *plugin;
+  char *plugin_instance;
+  char *type;
+  char *type_instance;
+} fi_ident_t;
+
+typedef struct {
+  fi_ident_t ident; /* must be first: used as the AVL key */
+
+  /* The measurement and the tags, e.g. "cpu,host=example,type=cpu". */
+  char *prefix;
+  size_t prefix_len;
+
+  cdtime_t last_time;
+  cdtime_t interval;
+} fi_prefix_entry_t;
+
+struct format_influxdb_cache_s {
+  c_avl_tree_t *tree;
+  cdtime_t last_prune;
+  pthread_mutex_t lock;
+};
+
 static int format_influxdb_escape_string(char *buffer, size_t buffer_size,
                                          const char *string) {
 
@@ -72,16 +104,12 @@ static int format_influxdb_escape_string(char *buffer, size_t buffer_size,
   return dst_pos;
 } /* int format_influxdb_escape_string */
 
-int format_influxdb_value_list(char *buffer, int buffer_len,
-                               const data_set_t *ds, const value_list_t *vl,
-                               format_influxdb_time_precision_t time_precision,
-                               bool store_rates, bool write_meta) {
+/* fi_format_prefix writes the measurement and the tags of "vl" to "buffer".
+ * These don't depend on the values, so they can be cached per series. */
+static int fi_format_prefix(char *buffer, int buffer_len,
+                            const value_list_t *vl) {
   int status;
   int offset = 0;
-  gauge_t *rates = NULL;
-  bool have_values = false;
-
-  assert(0 == strcmp(ds->type, vl->type));
 
 #define BUFFER_ADD_ESCAPE(...)                                                 \
   do {                                                                         \
@@ -95,10 +123,8 @@ int format_influxdb_value_list(char *buffer, int buffer_len,
 #define BUFFER_ADD(...)                                                        \
   do {                                                                         \
     status = snprintf(buffer + offset, buffer_len - offset, __VA_ARGS__);      \
-    if ((status < 0) || (status >= (buffer_len - offset))) {                   \
-      sfree(rates);                                                            \
+    if ((status < 0) || (status >= (buffer_len - offset)))                     \
       return -ENOMEM;                                                          \
-    }                                                                          \
     offset += status;                                                          \
   } while (0)
 
@@ -117,6 +143,43 @@ int format_influxdb_value_list(char *buffer, int buffer_len,
     BUFFER_ADD(",type_instance=");
     BUFFER_ADD_ESCAPE(vl->type_instance);
   }
+
+#undef BUFFER_ADD_ESCAPE
+#undef BUFFER_ADD
+
+  return offset;
+} /* int fi_format_prefix */
+
+/* fi_format_fields appends the meta data tags, the fields and the timestamp
+ * of "vl" to the prefix of "offset" bytes in "buffer". Returns the length of
+ * the line, zero if there are no values to send, or a negative error code. */
+static int fi_format_fields(char *buffer, int buffer_len, int offset,
+                            const data_set_t *ds, const value_list_t *vl,
+                            format_influxdb_time_precision_t time_precision,
+                            bool store_rates, bool write_meta) {
+  int status;
+  gauge_t *rates = NULL;
+  bool have_values = false;
+
+#define BUFFER_ADD_ESCAPE(...)                                                 \
+  do {                                                                         \
+    status = format_influxdb_escape_string(buffer + offset,                    \
+                                           buffer_len - offset, __VA_ARGS__);  \
+    if (status < 0)                                                            \
+      return status;                                                           \
+    offset += status;                                                          \
+  } while (0)
+
+#define BUFFER_ADD(...)                                                        \
+  do {                                                                         \
+    status = snprintf(buffer + offset, buffer_len - offset, __VA_ARGS__);      \
+    if ((status < 0) || (status >= (buffer_len - offset))) {                   \
+      sfree(rates);                                                            \
+      return -ENOMEM;                                                          \
+    }                                                                          \
+    offset += status;                                                          \
+  } while (0)
+
   if (write_meta && vl->meta) {
     for (meta_entry_t *it = meta_data_iter(vl->meta); it != NULL;
          it = meta_data_iter_next(it)) {
@@ -130,8 +193,12 @@ int format_influxdb_value_list(char *buffer, int buffer_len,
       BUFFER_ADD(",");
       BUFFER_ADD_ESCAPE(key);
       BUFFER_ADD("=");
-      BUFFER_ADD_ESCAPE(value);
+      status = format_influxdb_escape_string(buffer + offset,
+                                             buffer_len - offset, value);
       free(value);
+      if (status < 0)
+        return status;
+      offset += status;
     }
   }
 
@@ -209,4 +276,204 @@ int format_influxdb_value_list(char *buffer, int buffer_len,
 #undef BUFFER_ADD
 
   return offset;
+} /* int fi_format_fields */
+
+int format_influxdb_value_list(char *buffer, int buffer_len,
+                               const data_set_t *ds, const value_list_t *vl,
+                               format_influxdb_time_precision_t time_precision,
+                               bool store_rates, bool write_meta) {
+  assert(0 == strcmp(ds->type, vl->type));
+
+  int offset = fi_format_prefix(buffer, buffer_len, vl);
+  if (offset < 0)
+    return offset;
+
+  return fi_format_fields(buffer, buffer_len, offset, ds, vl, time_precision,
+                          store_rates, write_meta);
 } /* int format_influxdb_value_list */
+
+static int fi_ident_compare(void const *a, void const *b) {
+  fi_ident_t const *ia = a;
+  fi_ident_t const *ib = b;
+  int status;
+
+  if ((status = strcmp(ia->type, ib->type)) != 0)
+    return status;
+  if ((status = strcmp(ia->plugin, ib->plugin)) != 0)
+    return status;
+  if ((status = strcmp(ia->type_instance, ib->type_instance)) != 0)
+    return status;
+  if ((status = strcmp(ia->plugin_instance, ib->plugin_instance)) != 0)
+    return status;
+  return strcmp(ia->host, ib->host);
+} /* int fi_ident_compare */
+
+static void fi_prefix_entry_free(fi_prefix_entry_t *e) {
+  if (e == NULL)
+    return;
+
+  sfree(e->prefix);
+  sfree(e->ident.host);
+  sfree(e->ident.plugin);
+  sfree(e->ident.plugin_instance);
+  sfree(e->ident.type);
+  sfree(e->ident.type_instance);
+  sfree(e);
+}
+
+static fi_prefix_entry_t *fi_prefix_entry_create(value_list_t const *vl) {
+  char prefix[6 * 2 * DATA_MAX_NAME_LEN];
+
+  int status = fi_format_prefix(prefix, sizeof(prefix), vl);
+  if (status < 0)
+    return NULL;
+
+  fi_prefix_entry_t *e = calloc(1, sizeof(*e));
+  if (e == NULL)
+    return NULL;
+
+  e->ident.host = strdup(vl->host);
+  e->ident.plugin = strdup(vl->plugin);
+  e->ident.plugin_instance = strdup(vl->plugin_instance);
+  e->ident.type = strdup(vl->type);
+  e->ident.type_instance = strdup(vl->type_instance);
+  e->prefix = strdup(prefix);
+  if ((e->ident.host == NULL) || (e->ident.plugin == NULL) ||
+      (e->ident.plugin_instance == NULL) || (e->ident.type == NULL) ||
+      (e->ident.type_instance == NULL) || (e->prefix == NULL)) {
+    fi_prefix_entry_free(e);
+    return NULL;
+  }
+  e->prefix_len = (size_t)status;
+
+  return e;
+}
+
+/* fi_cache_prune removes entries whose series have not been written for
+ * FI_CACHE_TIMEOUT_FACTOR intervals. The cache's lock must be held. */
+static void fi_cache_prune(format_influxdb_cache_t *fc, cdtime_t now) {
+  fi_prefix_entry_t *expired[64];
+  size_t expired_num;
+
+  do {
+    c_avl_iterator_t *iter = c_avl_get_iterator(fc->tree);
+    fi_prefix_entry_t *e;
+    void *key;
+
+    expired_num = 0;
+    while ((expired_num < STATIC_ARRAY_SIZE(expired)) &&
+           (c_avl_iterator_next(iter, &key, (void *)&e) == 0)) {
+      if ((e->last_time + FI_CACHE_TIMEOUT_FACTOR * e->interval) < now)
+        expired[expired_num++] = e;
+    }
+    c_avl_iterator_destroy(iter);
+
+    for (size_t i = 0; i < expired_num; i++) {
+      c_avl_remove(fc->tree, &expired[i]->ident, NULL, NULL);
+      fi_prefix_entry_free(expired[i]);
+    }
+  } while (expired_num == STATIC_ARRAY_SIZE(expired));
+
+  fc->last_prune = now;
+} /* void fi_cache_prune */
+
+format_influxdb_cache_t *format_influxdb_cache_create(void) {
+  format_influxdb_cache_t *fc = calloc(1, sizeof(*fc));
+  if (fc == NULL)
+    return NULL;
+
+  fc->tree = c_avl_create(fi_ident_compare);
+  if (fc->tree == NULL) {
+    sfree(fc);
+    return NULL;
+  }
+  pthread_mutex_init(&fc->lock, /* attr = */ NULL);
+
+  return fc;
+} /* format_influxdb_cache_t *format_influxdb_cache_create */
+
+void format_influxdb_cache_destroy(format_influxdb_cache_t *fc) {
+  if (fc == NULL)
+    return;
+
+  void *key;
+  fi_prefix_entry_t *e;
+  while (c_avl_pick(fc->tree, &key, (void *)&e) == 0)
+    fi_prefix_entry_free(e);
+  c_avl_destroy(fc->tree);
+
+  pthread_mutex_destroy(&fc->lock);
+  sfree(fc);
+} /* void format_influxdb_cache_destroy */
+
+/* fi_cache_copy_prefix copies the cached prefix of "vl" to "buffer", creating
+ * the cache entry if necessary. Returns the length of the prefix or a negative
+ * error code. */
+static int fi_cache_copy_prefix(format_influxdb_cache_t *fc, char *buffer,
+                                int buffer_len, value_list_t const *vl) {
+  fi_ident_t ident = {
+      .host = (char *)vl->host,
+      .plugin = (char *)vl->plugin,
+      .plugin_instance = (char *)vl->plugin_instance,
+      .type = (char *)vl->type,
+      .type_instance = (char *)vl->type_instance,
+  };
+
+  pthread_mutex_lock(&fc->lock);
+
+  fi_prefix_entry_t *e = NULL;
+  if (c_avl_get(fc->tree, &ident, (void *)&e) != 0) {
+    e = fi_prefix_entry_create(vl);
+    if (e == NULL) {
+      pthread_mutex_unlock(&fc->lock);
+      /* Fall back to formatting the prefix directly. */
+      return fi_format_prefix(buffer, buffer_len, vl);
+    }
+    if (c_avl_insert(fc->tree, &e->ident, e) != 0) {
+      pthread_mutex_unlock(&fc->lock);
+      P_ERROR("format_influxdb_value_list_cached: c_avl_insert failed.");
+      fi_prefix_entry_free(e);
+      return -ENOMEM;
+    }
+  }
+  e->last_time = vl->time;
+  e->interval = vl->interval;
+
+  int status = -ENOMEM;
+  if (e->prefix_len < (size_t)buffer_len) {
+    memcpy(buffer, e->prefix, e->prefix_len + 1);
+    status = (int)e->prefix_len;
+  }
+
+  if ((vl->time - fc->last_prune) >= FI_CACHE_PRUNE_INTERVAL) {
+    if (fc->last_prune != 0)
+      fi_cache_prune(fc, vl->time);
+    else
+      fc->last_prune = vl->time;
+  }
+
+  pthread_mutex_unlock(&fc->lock);
+  return status;
+} /* int fi_cache_copy_prefix */
+
+int format_influxdb_value_list_cached(
+    format_influxdb_cache_t *fc, char *buffer, int buffer_len,
+    const data_set_t *ds, const value_list_t *vl,
+    format_influxdb_time_precision_t time_precision, bool store_rates,
+    bool write_meta) {
+  if (fc == NULL)
+    return format_influxdb_value_list(buffer, buffer_len, ds, vl,
+                                      time_precision, store_rates, write_meta);
+
+  assert(0 == strcmp(ds->type, vl->type));
+
+  if ((buffer == NULL) || (buffer_len < 1))
+    return -ENOMEM;
+
+  int offset = fi_cache_copy_prefix(fc, buffer, buffer_len, vl);
+  if (offset < 0)
+    return offset;
+
+  return fi_format_fields(buffer, buffer_len, offset, ds, vl, time_precision,
+                          store_rates, write_meta);
+} /* int format_influxdb_value_list_cached */
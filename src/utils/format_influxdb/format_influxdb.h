@@ -43,4 +43,21 @@ int format_influxdb_value_list(char *buffer, int buffer_len,
                                format_influxdb_time_precision_t time_precision,
                                bool store_rates, bool write_meta);
 
+/* format_influxdb_cache_t holds the measurement and tags of value lists, which
+ * never change for a series, so that only the fields and the timestamp have to
+ * be formatted for every write. A cache may be shared by multiple threads. */
+struct format_influxdb_cache_s;
+typedef struct format_influxdb_cache_s format_influxdb_cache_t;
+
+format_influxdb_cache_t *format_influxdb_cache_create(void);
+void format_influxdb_cache_destroy(format_influxdb_cache_t *fc);
+
+/* format_influxdb_value_list_cached formats "vl" like
+ * format_influxdb_value_list(), taking the measurement and tags from "fc". */
+int format_influxdb_value_list_cached(
+    format_influxdb_cache_t *fc, char *buffer, int buffer_len,
+    const data_set_t *ds, const value_list_t *vl,
+    format_influxdb_time_precision_t time_precision, bool store_rates,
+    bool write_meta);
+
 #endif /* UTILS_FORMAT_INFLUXDB_H */
@@ -0,0 +1,126 @@
+/**
+ * collectd - src/utils/format_influxdb/format_influxdb_test.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; only version 2 of the License is applicable.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h" /* for sstrncpy */
+#include "utils/format_influxdb/format_influxdb.h"
+
+static data_set_t ds_single = {
+    .type = "single",
+    .ds_num = 1,
+    .ds = &(data_source_t){"value", DS_TYPE_GAUGE, NAN, NAN},
+};
+
+static data_set_t ds_double = {
+    .type = "double",
+    .ds_num = 2,
+    .ds =
+        (data_source_t[]){
+            {"one", DS_TYPE_GAUGE, NAN, NAN},
+            {"two", DS_TYPE_DERIVE, 0, NAN},
+        },
+};
+
+DEF_TEST(value_list) {
+  value_list_t vl = {
+      .values = (value_t[]){{.gauge = 42}, {.derive = 7}},
+      .values_len = 2,
+      .time = TIME_T_TO_CDTIME_T_STATIC(1480063672),
+      .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+      .host = "example.com",
+      .plugin = "test",
+      .plugin_instance = "foo bar",
+      .type = "double",
+  };
+  char got[256];
+
+  EXPECT_EQ_INT(87, format_influxdb_value_list(got, sizeof(got), &ds_double,
+                                               &vl, MS, false, false));
+  EXPECT_EQ_STR("test,host=example.com,instance=foo\\ bar,type=double "
+                "one=42.000000,two=7i 1480063672000\n",
+                got);
+
+  /* Lines without values are skipped. */
+  vl.values[0].gauge = NAN;
+  vl.values_len = 1;
+  sstrncpy(vl.type, "single", sizeof(vl.type));
+  EXPECT_EQ_INT(0, format_influxdb_value_list(got, sizeof(got), &ds_single,
+                                              &vl, MS, false, false));
+
+  return 0;
+}
+
+DEF_TEST(cached) {
+  value_list_t vl = {
+      .values = (value_t[]){{.gauge = 42}, {.derive = 7}},
+      .values_len = 2,
+      .time = TIME_T_TO_CDTIME_T_STATIC(1480063672),
+      .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+      .host = "example.com",
+      .plugin = "test",
+      .type = "double",
+      .type_instance = "a=b",
+  };
+
+  format_influxdb_cache_t *fc = format_influxdb_cache_create();
+  CHECK_NOT_NULL(fc);
+
+  char want[256];
+  char got[256];
+
+  /* The second call uses the cached prefix and must format the new values. */
+  for (int i = 0; i < 2; i++) {
+    vl.values[0].gauge = 42 + i;
+    vl.time += TIME_T_TO_CDTIME_T_STATIC(10);
+
+    int want_len = format_influxdb_value_list(want, sizeof(want), &ds_double,
+                                              &vl, NS, false, false);
+    OK(want_len > 0);
+    EXPECT_EQ_INT(want_len,
+                  format_influxdb_value_list_cached(fc, got, sizeof(got),
+                                                    &ds_double, &vl, NS, false,
+                                                    false));
+    EXPECT_EQ_STR(want, got);
+  }
+
+  /* Other series must not get the cached prefix. */
+  sstrncpy(vl.host, "example.org", sizeof(vl.host));
+  EXPECT_EQ_INT(format_influxdb_value_list(want, sizeof(want), &ds_double, &vl,
+                                           NS, false, false),
+                format_influxdb_value_list_cached(fc, got, sizeof(got),
+                                                  &ds_double, &vl, NS, false,
+                                                  false));
+  EXPECT_EQ_STR(want, got);
+
+  /* Too small buffers are reported, so that callers can start a new one. */
+  EXPECT_EQ_INT(-ENOMEM, format_influxdb_value_list_cached(
+                             fc, got, 16, &ds_double, &vl, NS, false, false));
+  EXPECT_EQ_INT(-ENOMEM, format_influxdb_value_list_cached(
+                             fc, got, 64, &ds_double, &vl, NS, false, false));
+
+  format_influxdb_cache_destroy(fc);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(value_list);
+  RUN_TEST(cached);
+
+  END_TEST;
+}
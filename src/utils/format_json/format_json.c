@@ -29,7 +29,9 @@
 #include "utils/format_json/format_json.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
+#include "utils/metadata/meta_data.h"
 #include "utils_cache.h"
 
 #if HAVE_LIBYAJL
@@ -43,6 +45,43 @@
 #endif
 #endif
 
+/* Cached fragments are dropped when their series has not been written for
+ * this many intervals. The cache is scanned for such entries at most once per
+ * JSON_CACHE_PRUNE_INTERVAL. */
+#define JSON_CACHE_TIMEOUT_FACTOR 10
+#define JSON_CACHE_PRUNE_INTERVAL TIME_T_TO_CDTIME_T_STATIC(60)
+
+typedef struct {
+  char *host;
+  char *plugin;
+  char *plugin_instance;
+  char *type;
+  char *type_instance;
+} json_ident_t;
+
+typedef struct {
+  json_ident_t ident; /* must be first: used as the AVL key */
+
+  /* ,"dstypes":[...],"dsnames":[...] */
+  char *ds;
+  size_t ds_len;
+  size_t ds_num;
+  /* ,"host":"...", ... ,"type_instance":"..." */
+  char *names;
+  size_t names_len;
+
+  cdtime_t last_time;
+  cdtime_t interval;
+} json_cache_entry_t;
+
+struct format_json_cache_s {
+  c_avl_tree_t *tree;
+  cdtime_t last_prune;
+  pthread_mutex_t lock;
+};
+
+/* Writes "string" as a quoted JSON string to "buffer". Returns the number of
+ * bytes written, not including the null byte, or -ENOMEM. */
 static int json_escape_string(char *buffer, size_t buffer_size, /* {{{ */
                               const char *string) {
   size_t dst_pos;
@@ -81,321 +120,544 @@ static int json_escape_string(char *buffer, size_t buffer_size, /* {{{ */
 
 #undef BUFFER_ADD
 
-  return 0;
+  return (int)dst_pos;
 } /* }}} int json_escape_string */
 
-static int values_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                          const data_set_t *ds, const value_list_t *vl,
-                          int store_rates) {
-  size_t offset = 0;
-  gauge_t *rates = NULL;
+/* Writes "value" in decimal notation to "buffer", which must have room for at
+ * least 21 bytes. Returns the number of bytes written. */
+static size_t json_format_uint(char *buffer, uint64_t value) /* {{{ */
+{
+  char digits[20];
+  size_t digits_num = 0;
+
+  do {
+    digits[digits_num++] = (char)('0' + (value % 10));
+    value /= 10;
+  } while (value != 0);
 
-  memset(buffer, 0, buffer_size);
+  for (size_t i = 0; i < digits_num; i++)
+    buffer[i] = digits[digits_num - (i + 1)];
+  buffer[digits_num] = 0;
 
+  return digits_num;
+} /* }}} size_t json_format_uint */
+
+static size_t json_format_int(char *buffer, int64_t value) /* {{{ */
+{
+  if (value >= 0)
+    return json_format_uint(buffer, (uint64_t)value);
+
+  buffer[0] = '-';
+  return 1 + json_format_uint(buffer + 1, ((uint64_t)0) - ((uint64_t)value));
+} /* }}} size_t json_format_int */
+
+/* Formats "value" like JSON_GAUGE_FORMAT does. Whole numbers, which are the
+ * common case, are formatted without snprintf(3): "%.15g" prints them without
+ * exponent and decimal point as long as they have at most 15 digits. */
+static int json_format_gauge(char *buffer, size_t buffer_size, /* {{{ */
+                             gauge_t value) {
+  if ((buffer_size >= 21) && (fabs(value) < 1e15) &&
+      (value == (gauge_t)(int64_t)value) &&
+      ((value != 0.0) || !signbit(value)))
+    return (int)json_format_int(buffer, (int64_t)value);
+
+  return snprintf(buffer, buffer_size, JSON_GAUGE_FORMAT, value);
+} /* }}} int json_format_gauge */
+
+/* The BUFFER_* macros append to "buffer" at "offset". On error, they return
+ * from the calling function, which must not hold any resources. */
 #define BUFFER_ADD(...)                                                        \
   do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1) {                                                          \
-      sfree(rates);                                                            \
+    int status =                                                               \
+        snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);          \
+    if (status < 1)                                                            \
       return -1;                                                               \
-    } else if (((size_t)status) >= (buffer_size - offset)) {                   \
-      sfree(rates);                                                            \
+    else if (((size_t)status) >= (buffer_size - offset))                       \
       return -ENOMEM;                                                          \
-    } else                                                                     \
-      offset += ((size_t)status);                                              \
+    offset += (size_t)status;                                                  \
   } while (0)
 
-  BUFFER_ADD("[");
-  for (size_t i = 0; i < ds->ds_num; i++) {
+#define BUFFER_ADD_MEM(ptr, len)                                               \
+  do {                                                                         \
+    size_t l = (len);                                                          \
+    if (l >= (buffer_size - offset))                                           \
+      return -ENOMEM;                                                          \
+    memcpy(buffer + offset, (ptr), l);                                         \
+    offset += l;                                                               \
+    buffer[offset] = 0;                                                        \
+  } while (0)
+
+#define BUFFER_ADD_STR(str) BUFFER_ADD_MEM(str, strlen(str))
+
+#define BUFFER_ADD_ESCAPED(str)                                                \
+  do {                                                                         \
+    int status =                                                               \
+        json_escape_string(buffer + offset, buffer_size - offset, (str));      \
+    if (status < 0)                                                            \
+      return status;                                                           \
+    offset += (size_t)status;                                                  \
+  } while (0)
+
+/* The number formatters need up to 21 bytes; the remaining space is checked
+ * first, so that the formatter never writes beyond the buffer. */
+#define BUFFER_ADD_NUMBER(func, value)                                         \
+  do {                                                                         \
+    if ((buffer_size - offset) < 22)                                           \
+      return -ENOMEM;                                                          \
+    offset += func(buffer + offset, (value));                                  \
+  } while (0)
+
+static int values_to_json(char *buffer, size_t buffer_size, /* {{{ */
+                          size_t *ret_offset, const data_set_t *ds,
+                          const value_list_t *vl, int store_rates) {
+  size_t offset = *ret_offset;
+  gauge_t *rates = NULL;
+  int status = 0;
+
+  BUFFER_ADD_STR("\"values\":[");
+  for (size_t i = 0; (status == 0) && (i < ds->ds_num); i++) {
+    if ((buffer_size - offset) < 32) {
+      status = -ENOMEM;
+      break;
+    }
     if (i > 0)
-      BUFFER_ADD(",");
+      buffer[offset++] = ',';
 
-    if (ds->ds[i].type == DS_TYPE_GAUGE) {
-      if (isfinite(vl->values[i].gauge))
-        BUFFER_ADD(JSON_GAUGE_FORMAT, vl->values[i].gauge);
-      else
-        BUFFER_ADD("null");
-    } else if (store_rates) {
+    gauge_t gauge = NAN;
+    bool is_gauge = true;
+    if (ds->ds[i].type == DS_TYPE_GAUGE)
+      gauge = vl->values[i].gauge;
+    else if (store_rates) {
       if (rates == NULL)
         rates = uc_get_rate(ds, vl);
       if (rates == NULL) {
         WARNING("utils_format_json: uc_get_rate failed.");
-        sfree(rates);
-        return -1;
+        status = -1;
+        break;
       }
-
-      if (isfinite(rates[i]))
-        BUFFER_ADD(JSON_GAUGE_FORMAT, rates[i]);
+      gauge = rates[i];
+    } else
+      is_gauge = false;
+
+    if (is_gauge) {
+      if (!isfinite(gauge)) {
+        memcpy(buffer + offset, "null", 4);
+        offset += 4;
+        continue;
+      }
+      int len = json_format_gauge(buffer + offset, buffer_size - offset, gauge);
+      if (len < 1)
+        status = -1;
+      else if ((size_t)len >= (buffer_size - offset))
+        status = -ENOMEM;
       else
-        BUFFER_ADD("null");
+        offset += (size_t)len;
     } else if (ds->ds[i].type == DS_TYPE_COUNTER)
-      BUFFER_ADD("%" PRIu64, (uint64_t)vl->values[i].counter);
+      offset += json_format_uint(buffer + offset,
+                                 (uint64_t)vl->values[i].counter);
     else if (ds->ds[i].type == DS_TYPE_DERIVE)
-      BUFFER_ADD("%" PRIi64, vl->values[i].derive);
+      offset += json_format_int(buffer + offset, vl->values[i].derive);
     else if (ds->ds[i].type == DS_TYPE_ABSOLUTE)
-      BUFFER_ADD("%" PRIu64, vl->values[i].absolute);
+      offset += json_format_uint(buffer + offset, vl->values[i].absolute);
     else {
       ERROR("format_json: Unknown data source type: %i", ds->ds[i].type);
-      sfree(rates);
-      return -1;
+      status = -1;
     }
   } /* for ds->ds_num */
-  BUFFER_ADD("]");
+  sfree(rates);
+  if (status != 0)
+    return status;
 
-#undef BUFFER_ADD
+  BUFFER_ADD_STR("]");
 
-  sfree(rates);
+  *ret_offset = offset;
   return 0;
 } /* }}} int values_to_json */
 
-static int dstypes_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                           const data_set_t *ds) {
-  size_t offset = 0;
-
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
+/* Writes the parts of the value list depending on the data set only. */
+static int ds_to_json(char *buffer, size_t buffer_size, /* {{{ */
+                      size_t *ret_offset, const data_set_t *ds) {
+  size_t offset = *ret_offset;
 
-  BUFFER_ADD("[");
+  BUFFER_ADD_STR(",\"dstypes\":[");
   for (size_t i = 0; i < ds->ds_num; i++) {
     if (i > 0)
-      BUFFER_ADD(",");
-
+      BUFFER_ADD_STR(",");
     BUFFER_ADD("\"%s\"", DS_TYPE_TO_STRING(ds->ds[i].type));
   } /* for ds->ds_num */
-  BUFFER_ADD("]");
-
-#undef BUFFER_ADD
-
-  return 0;
-} /* }}} int dstypes_to_json */
 
-static int dsnames_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                           const data_set_t *ds) {
-  size_t offset = 0;
-
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    int status;                                                                \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
-  BUFFER_ADD("[");
+  BUFFER_ADD_STR("],\"dsnames\":[");
   for (size_t i = 0; i < ds->ds_num; i++) {
     if (i > 0)
-      BUFFER_ADD(",");
-
+      BUFFER_ADD_STR(",");
     BUFFER_ADD("\"%s\"", ds->ds[i].name);
   } /* for ds->ds_num */
-  BUFFER_ADD("]");
-
-#undef BUFFER_ADD
+  BUFFER_ADD_STR("]");
 
+  *ret_offset = offset;
+  return 0;
+} /* }}} int ds_to_json */
+
+/* Writes the parts of the value list identifying the series. */
+static int names_to_json(char *buffer, size_t buffer_size, /* {{{ */
+                         size_t *ret_offset, const value_list_t *vl) {
+  size_t offset = *ret_offset;
+
+  BUFFER_ADD_STR(",\"host\":");
+  BUFFER_ADD_ESCAPED(vl->host);
+  BUFFER_ADD_STR(",\"plugin\":");
+  BUFFER_ADD_ESCAPED(vl->plugin);
+  BUFFER_ADD_STR(",\"plugin_instance\":");
+  BUFFER_ADD_ESCAPED(vl->plugin_instance);
+  BUFFER_ADD_STR(",\"type\":");
+  BUFFER_ADD_ESCAPED(vl->type);
+  BUFFER_ADD_STR(",\"type_instance\":");
+  BUFFER_ADD_ESCAPED(vl->type_instance);
+
+  *ret_offset = offset;
   return 0;
-} /* }}} int dsnames_to_json */
+} /* }}} int names_to_json */
 
-static int meta_data_keys_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                                  meta_data_t *meta, char **keys,
-                                  size_t keys_num) {
-  size_t offset = 0;
-  int status;
+/* Writes the ",\"meta\":{...}" part. Nothing is written if "meta" has no
+ * readable entries. */
+static int meta_data_to_json(char *buffer, size_t buffer_size, /* {{{ */
+                             size_t *ret_offset, meta_data_t *meta) {
+  size_t offset = *ret_offset;
+  size_t entries_num = 0;
 
-  buffer[0] = 0;
+  meta_entry_t *e = meta_data_iter(meta);
+  if (e == NULL)
+    return 0;
 
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
+  BUFFER_ADD_STR(",\"meta\":{");
+  for (; e != NULL; e = meta_data_iter_next(e)) {
+    size_t entry_start = offset;
+    bool added = false;
 
-  for (size_t i = 0; i < keys_num; ++i) {
-    int type;
-    char *key = keys[i];
+    BUFFER_ADD("%s\"%s\":", (entries_num > 0) ? "," : "",
+               meta_data_iter_key(e));
 
-    type = meta_data_type(meta, key);
-    if (type == MD_TYPE_STRING) {
+    switch (meta_data_iter_type(e)) {
+    case MD_TYPE_STRING: {
       char *value = NULL;
-      if (meta_data_get_string(meta, key, &value) == 0) {
-        char temp[512] = "";
-
-        status = json_escape_string(temp, sizeof(temp), value);
-        sfree(value);
-        if (status != 0)
-          return status;
-
-        BUFFER_ADD(",\"%s\":%s", key, temp);
-      }
-    } else if (type == MD_TYPE_SIGNED_INT) {
+      if (meta_data_iter_get_string(meta, e, &value) != 0)
+        break;
+      int status =
+          json_escape_string(buffer + offset, buffer_size - offset, value);
+      sfree(value);
+      if (status < 0)
+        return status;
+      offset += (size_t)status;
+      added = true;
+      break;
+    }
+    case MD_TYPE_SIGNED_INT: {
       int64_t value = 0;
-      if (meta_data_get_signed_int(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%" PRIi64, key, value);
-    } else if (type == MD_TYPE_UNSIGNED_INT) {
+      if (meta_data_iter_get_signed_int(meta, e, &value) != 0)
+        break;
+      BUFFER_ADD_NUMBER(json_format_int, value);
+      added = true;
+      break;
+    }
+    case MD_TYPE_UNSIGNED_INT: {
       uint64_t value = 0;
-      if (meta_data_get_unsigned_int(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%" PRIu64, key, value);
-    } else if (type == MD_TYPE_DOUBLE) {
+      if (meta_data_iter_get_unsigned_int(meta, e, &value) != 0)
+        break;
+      BUFFER_ADD_NUMBER(json_format_uint, value);
+      added = true;
+      break;
+    }
+    case MD_TYPE_DOUBLE: {
       double value = 0.0;
-      if (meta_data_get_double(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%f", key, value);
-    } else if (type == MD_TYPE_BOOLEAN) {
+      if (meta_data_iter_get_double(meta, e, &value) != 0)
+        break;
+      BUFFER_ADD("%f", value);
+      added = true;
+      break;
+    }
+    case MD_TYPE_BOOLEAN: {
       bool value = false;
-      if (meta_data_get_boolean(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%s", key, value ? "true" : "false");
+      if (meta_data_iter_get_boolean(meta, e, &value) != 0)
+        break;
+      BUFFER_ADD_STR(value ? "true" : "false");
+      added = true;
+      break;
+    }
     }
-  } /* for (keys) */
-
-  if (offset == 0)
-    return ENOENT;
 
-  buffer[0] = '{'; /* replace leading ',' */
-  BUFFER_ADD("}");
+    if (added)
+      entries_num++;
+    else /* Drop the key of entries which can't be read. */
+      offset = entry_start;
+  } /* for (meta entries) */
 
-#undef BUFFER_ADD
+  if (entries_num == 0) {
+    buffer[*ret_offset] = 0;
+    return 0;
+  }
+  BUFFER_ADD_STR("}");
 
+  *ret_offset = offset;
   return 0;
-} /* }}} int meta_data_keys_to_json */
+} /* }}} int meta_data_to_json */
 
-static int meta_data_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                             meta_data_t *meta) {
-  char **keys = NULL;
-  size_t keys_num;
+static int json_ident_compare(void const *a, void const *b) /* {{{ */
+{
+  json_ident_t const *ia = a;
+  json_ident_t const *ib = b;
   int status;
 
-  if ((buffer == NULL) || (buffer_size == 0) || (meta == NULL))
-    return EINVAL;
+  if ((status = strcmp(ia->type, ib->type)) != 0)
+    return status;
+  if ((status = strcmp(ia->plugin, ib->plugin)) != 0)
+    return status;
+  if ((status = strcmp(ia->type_instance, ib->type_instance)) != 0)
+    return status;
+  if ((status = strcmp(ia->plugin_instance, ib->plugin_instance)) != 0)
+    return status;
+  return strcmp(ia->host, ib->host);
+} /* }}} int json_ident_compare */
+
+static void json_cache_entry_free(json_cache_entry_t *e) /* {{{ */
+{
+  if (e == NULL)
+    return;
+
+  sfree(e->ds);
+  sfree(e->names);
+  sfree(e->ident.host);
+  sfree(e->ident.plugin);
+  sfree(e->ident.plugin_instance);
+  sfree(e->ident.type);
+  sfree(e->ident.type_instance);
+  sfree(e);
+} /* }}} void json_cache_entry_free */
+
+/* Renders the data set fragment of "e". Called again when the number of data
+ * sources changes. */
+static int json_cache_entry_render_ds(json_cache_entry_t *e, /* {{{ */
+                                      const data_set_t *ds) {
+  size_t buffer_size = 64 + ds->ds_num * (DATA_MAX_NAME_LEN + 16);
+  char buffer[buffer_size];
+  size_t offset = 0;
 
-  status = meta_data_toc(meta, &keys);
-  if (status <= 0)
+  int status = ds_to_json(buffer, buffer_size, &offset, ds);
+  if (status != 0)
     return status;
-  keys_num = (size_t)status;
 
-  status = meta_data_keys_to_json(buffer, buffer_size, meta, keys, keys_num);
+  char *tmp = strdup(buffer);
+  if (tmp == NULL)
+    return -ENOMEM;
 
-  for (size_t i = 0; i < keys_num; ++i)
-    sfree(keys[i]);
-  sfree(keys);
+  sfree(e->ds);
+  e->ds = tmp;
+  e->ds_len = offset;
+  e->ds_num = ds->ds_num;
+  return 0;
+} /* }}} int json_cache_entry_render_ds */
 
-  return status;
-} /* }}} int meta_data_to_json */
+static json_cache_entry_t *json_cache_entry_create(/* {{{ */
+                                                   const data_set_t *ds,
+                                                   const value_list_t *vl) {
+  char buffer[6 * 2 * DATA_MAX_NAME_LEN + 128];
+  size_t offset = 0;
+
+  if (names_to_json(buffer, sizeof(buffer), &offset, vl) != 0)
+    return NULL;
+
+  json_cache_entry_t *e = calloc(1, sizeof(*e));
+  if (e == NULL)
+    return NULL;
+
+  e->ident.host = strdup(vl->host);
+  e->ident.plugin = strdup(vl->plugin);
+  e->ident.plugin_instance = strdup(vl->plugin_instance);
+  e->ident.type = strdup(vl->type);
+  e->ident.type_instance = strdup(vl->type_instance);
+  e->names = strdup(buffer);
+  if ((e->ident.host == NULL) || (e->ident.plugin == NULL) ||
+      (e->ident.plugin_instance == NULL) || (e->ident.type == NULL) ||
+      (e->ident.type_instance == NULL) || (e->names == NULL) ||
+      (json_cache_entry_render_ds(e, ds) != 0)) {
+    json_cache_entry_free(e);
+    return NULL;
+  }
+  e->names_len = offset;
+  e->last_time = vl->time;
+  e->interval = vl->interval;
+
+  return e;
+} /* }}} json_cache_entry_t *json_cache_entry_create */
+
+/* Removes entries whose series have not been written for
+ * JSON_CACHE_TIMEOUT_FACTOR intervals. The cache's lock must be held. */
+static void json_cache_prune(format_json_cache_t *fc, cdtime_t now) /* {{{ */
+{
+  json_cache_entry_t *expired[64];
+  size_t expired_num;
+
+  do {
+    c_avl_iterator_t *iter = c_avl_get_iterator(fc->tree);
+    json_cache_entry_t *e;
+    void *key;
+
+    expired_num = 0;
+    while ((expired_num < STATIC_ARRAY_SIZE(expired)) &&
+           (c_avl_iterator_next(iter, &key, (void *)&e) == 0)) {
+      if ((e->last_time + JSON_CACHE_TIMEOUT_FACTOR * e->interval) < now)
+        expired[expired_num++] = e;
+    }
+    c_avl_iterator_destroy(iter);
+
+    for (size_t i = 0; i < expired_num; i++) {
+      c_avl_remove(fc->tree, &expired[i]->ident, NULL, NULL);
+      json_cache_entry_free(expired[i]);
+    }
+  } while (expired_num == STATIC_ARRAY_SIZE(expired));
+
+  fc->last_prune = now;
+} /* }}} void json_cache_prune */
+
+format_json_cache_t *format_json_cache_create(void) /* {{{ */
+{
+  format_json_cache_t *fc = calloc(1, sizeof(*fc));
+  if (fc == NULL)
+    return NULL;
+
+  fc->tree = c_avl_create(json_ident_compare);
+  if (fc->tree == NULL) {
+    sfree(fc);
+    return NULL;
+  }
+  pthread_mutex_init(&fc->lock, /* attr = */ NULL);
+
+  return fc;
+} /* }}} format_json_cache_t *format_json_cache_create */
+
+void format_json_cache_destroy(format_json_cache_t *fc) /* {{{ */
+{
+  if (fc == NULL)
+    return;
+
+  void *key;
+  json_cache_entry_t *e;
+  while (c_avl_pick(fc->tree, &key, (void *)&e) == 0)
+    json_cache_entry_free(e);
+  c_avl_destroy(fc->tree);
+
+  pthread_mutex_destroy(&fc->lock);
+  sfree(fc);
+} /* }}} void format_json_cache_destroy */
+
+/* Copies the cached fragments of "vl" to "buffer". Returns ENOENT if they
+ * could not be cached, so that the caller formats them itself. */
+static int json_cache_copy(format_json_cache_t *fc, /* {{{ */
+                           char *buffer, size_t buffer_size,
+                           size_t *ret_offset, const data_set_t *ds,
+                           const value_list_t *vl, bool names) {
+  size_t offset = *ret_offset;
+  json_ident_t ident = {
+      .host = (char *)vl->host,
+      .plugin = (char *)vl->plugin,
+      .plugin_instance = (char *)vl->plugin_instance,
+      .type = (char *)vl->type,
+      .type_instance = (char *)vl->type_instance,
+  };
+
+  pthread_mutex_lock(&fc->lock);
+
+  json_cache_entry_t *e = NULL;
+  if (c_avl_get(fc->tree, &ident, (void *)&e) != 0) {
+    e = json_cache_entry_create(ds, vl);
+    if ((e == NULL) || (c_avl_insert(fc->tree, &e->ident, e) != 0)) {
+      pthread_mutex_unlock(&fc->lock);
+      json_cache_entry_free(e);
+      return ENOENT;
+    }
+  }
+  if ((e->ds_num != ds->ds_num) && (json_cache_entry_render_ds(e, ds) != 0)) {
+    pthread_mutex_unlock(&fc->lock);
+    return ENOENT;
+  }
+
+  char const *fragment = names ? e->names : e->ds;
+  size_t fragment_len = names ? e->names_len : e->ds_len;
+  if (fragment_len >= (buffer_size - offset)) {
+    pthread_mutex_unlock(&fc->lock);
+    return -ENOMEM;
+  }
+  memcpy(buffer + offset, fragment, fragment_len + 1);
+  *ret_offset = offset + fragment_len;
+
+  if (names) {
+    e->last_time = vl->time;
+    e->interval = vl->interval;
+
+    if ((vl->time - fc->last_prune) >= JSON_CACHE_PRUNE_INTERVAL) {
+      if (fc->last_prune != 0)
+        json_cache_prune(fc, vl->time);
+      else
+        fc->last_prune = vl->time;
+    }
+  }
+
+  pthread_mutex_unlock(&fc->lock);
+  return 0;
+} /* }}} int json_cache_copy */
 
 static int value_list_to_json(char *buffer, size_t buffer_size, /* {{{ */
+                              size_t *ret_offset, format_json_cache_t *fc,
                               const data_set_t *ds, const value_list_t *vl,
                               int store_rates) {
-  char temp[512];
-  size_t offset = 0;
+  size_t offset = *ret_offset;
   int status;
 
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = snprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);     \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
   /* All value lists have a leading comma. The first one will be replaced with
    * a square bracket in `format_json_finalize'. */
-  BUFFER_ADD(",{");
+  BUFFER_ADD_STR(",{");
 
-  status = values_to_json(temp, sizeof(temp), ds, vl, store_rates);
+  status = values_to_json(buffer, buffer_size, &offset, ds, vl, store_rates);
   if (status != 0)
     return status;
-  BUFFER_ADD("\"values\":%s", temp);
 
-  status = dstypes_to_json(temp, sizeof(temp), ds);
+  status = ENOENT;
+  if (fc != NULL)
+    status = json_cache_copy(fc, buffer, buffer_size, &offset, ds, vl,
+                             /* names = */ false);
+  if (status == ENOENT)
+    status = ds_to_json(buffer, buffer_size, &offset, ds);
   if (status != 0)
     return status;
-  BUFFER_ADD(",\"dstypes\":%s", temp);
 
-  status = dsnames_to_json(temp, sizeof(temp), ds);
+  BUFFER_ADD(",\"time\":%.3f,\"interval\":%.3f", CDTIME_T_TO_DOUBLE(vl->time),
+             CDTIME_T_TO_DOUBLE(vl->interval));
+
+  status = ENOENT;
+  if (fc != NULL)
+    status = json_cache_copy(fc, buffer, buffer_size, &offset, ds, vl,
+                             /* names = */ true);
+  if (status == ENOENT)
+    status = names_to_json(buffer, buffer_size, &offset, vl);
   if (status != 0)
     return status;
-  BUFFER_ADD(",\"dsnames\":%s", temp);
-
-  BUFFER_ADD(",\"time\":%.3f", CDTIME_T_TO_DOUBLE(vl->time));
-  BUFFER_ADD(",\"interval\":%.3f", CDTIME_T_TO_DOUBLE(vl->interval));
-
-#define BUFFER_ADD_KEYVAL(key, value)                                          \
-  do {                                                                         \
-    status = json_escape_string(temp, sizeof(temp), (value));                  \
-    if (status != 0)                                                           \
-      return status;                                                           \
-    BUFFER_ADD(",\"%s\":%s", (key), temp);                                     \
-  } while (0)
-
-  BUFFER_ADD_KEYVAL("host", vl->host);
-  BUFFER_ADD_KEYVAL("plugin", vl->plugin);
-  BUFFER_ADD_KEYVAL("plugin_instance", vl->plugin_instance);
-  BUFFER_ADD_KEYVAL("type", vl->type);
-  BUFFER_ADD_KEYVAL("type_instance", vl->type_instance);
 
   if (vl->meta != NULL) {
-    char meta_buffer[buffer_size];
-    memset(meta_buffer, 0, sizeof(meta_buffer));
-    status = meta_data_to_json(meta_buffer, sizeof(meta_buffer), vl->meta);
+    status = meta_data_to_json(buffer, buffer_size, &offset, vl->meta);
     if (status != 0)
       return status;
+  }
 
-    BUFFER_ADD(",\"meta\":%s", meta_buffer);
-  } /* if (vl->meta != NULL) */
-
-  BUFFER_ADD("}");
-
-#undef BUFFER_ADD_KEYVAL
-#undef BUFFER_ADD
+  BUFFER_ADD_STR("}");
 
+  *ret_offset = offset;
   return 0;
 } /* }}} int value_list_to_json */
 
-static int format_json_value_list_nocheck(char *buffer, /* {{{ */
-                                          size_t *ret_buffer_fill,
-                                          size_t *ret_buffer_free,
-                                          const data_set_t *ds,
-                                          const value_list_t *vl,
-                                          int store_rates, size_t temp_size) {
-  char temp[temp_size];
-  int status;
-
-  status = value_list_to_json(temp, sizeof(temp), ds, vl, store_rates);
-  if (status != 0)
-    return status;
-  temp_size = strlen(temp);
-
-  memcpy(buffer + (*ret_buffer_fill), temp, temp_size + 1);
-  (*ret_buffer_fill) += temp_size;
-  (*ret_buffer_free) -= temp_size;
-
-  return 0;
-} /* }}} int format_json_value_list_nocheck */
+#undef BUFFER_ADD
+#undef BUFFER_ADD_MEM
+#undef BUFFER_ADD_STR
+#undef BUFFER_ADD_ESCAPED
+#undef BUFFER_ADD_NUMBER
 
 int format_json_initialize(char *buffer, /* {{{ */
                            size_t *ret_buffer_fill, size_t *ret_buffer_free) {
@@ -449,20 +711,58 @@ int format_json_finalize(char *buffer, /* {{{ */
   return 0;
 } /* }}} int format_json_finalize */
 
-int format_json_value_list(char *buffer, /* {{{ */
-                           size_t *ret_buffer_fill, size_t *ret_buffer_free,
-                           const data_set_t *ds, const value_list_t *vl,
-                           int store_rates) {
+int format_json_value_list_cached(format_json_cache_t *fc, /* {{{ */
+                                  char *buffer, size_t *ret_buffer_fill,
+                                  size_t *ret_buffer_free,
+                                  const data_set_t *ds, const value_list_t *vl,
+                                  int store_rates) {
   if ((buffer == NULL) || (ret_buffer_fill == NULL) ||
       (ret_buffer_free == NULL) || (ds == NULL) || (vl == NULL))
     return -EINVAL;
 
+  /* Two bytes are reserved for the closing bracket added by
+   * `format_json_finalize' and the null byte. */
   if (*ret_buffer_free < 3)
     return -ENOMEM;
 
-  return format_json_value_list_nocheck(buffer, ret_buffer_fill,
-                                        ret_buffer_free, ds, vl, store_rates,
-                                        (*ret_buffer_free) - 2);
+  char *start = buffer + (*ret_buffer_fill);
+  size_t offset = 0;
+
+  /* Other write plugins may have formatted the same value list already. */
+  char key[32];
+  ssnprintf(key, sizeof(key), "json:%d", store_rates ? 1 : 0);
+  char const *formatted = plugin_write_format_get(vl, key, &offset);
+  if (formatted != NULL) {
+    if (offset >= (*ret_buffer_free) - 2) {
+      start[0] = 0;
+      return -ENOMEM;
+    }
+    memcpy(start, formatted, offset + 1);
+  } else {
+    int status = value_list_to_json(start, (*ret_buffer_free) - 2, &offset,
+                                    fc, ds, vl, store_rates);
+    if (status != 0) {
+      /* Leave the buffer as it was, so that the caller can flush it and
+       * retry. */
+      start[0] = 0;
+      return status;
+    }
+    plugin_write_format_put(vl, key, start, offset);
+  }
+
+  (*ret_buffer_fill) += offset;
+  (*ret_buffer_free) -= offset;
+
+  return 0;
+} /* }}} int format_json_value_list_cached */
+
+int format_json_value_list(char *buffer, /* {{{ */
+                           size_t *ret_buffer_fill, size_t *ret_buffer_free,
+                           const data_set_t *ds, const value_list_t *vl,
+                           int store_rates) {
+  return format_json_value_list_cached(/* cache = */ NULL, buffer,
+                                       ret_buffer_fill, ret_buffer_free, ds,
+                                       vl, store_rates);
 } /* }}} int format_json_value_list */
 
 #if HAVE_LIBYAJL
@@ -40,6 +40,25 @@ int format_json_initialize(char *buffer, size_t *ret_buffer_fill,
 int format_json_value_list(char *buffer, size_t *ret_buffer_fill,
                            size_t *ret_buffer_free, const data_set_t *ds,
                            const value_list_t *vl, int store_rates);
+
+/* format_json_cache_t holds the JSON fragments of value lists which never
+ * change for a series, i.e. the data source types and names and the escaped
+ * identifier, so that only the values, times and meta data have to be
+ * formatted for every write. A cache may be shared by multiple threads. */
+struct format_json_cache_s;
+typedef struct format_json_cache_s format_json_cache_t;
+
+format_json_cache_t *format_json_cache_create(void);
+void format_json_cache_destroy(format_json_cache_t *fc);
+
+/* format_json_value_list_cached formats "vl" like format_json_value_list(),
+ * taking the constant fragments from "fc". "fc" may be NULL. */
+int format_json_value_list_cached(format_json_cache_t *fc, char *buffer,
+                                  size_t *ret_buffer_fill,
+                                  size_t *ret_buffer_free,
+                                  const data_set_t *ds, const value_list_t *vl,
+                                  int store_rates);
+
 int format_json_finalize(char *buffer, size_t *ret_buffer_fill,
                          size_t *ret_buffer_free);
 int format_json_notification(char *buffer, size_t buffer_size,
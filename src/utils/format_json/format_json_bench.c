@@ -0,0 +1,148 @@
+/**
+ * collectd - src/utils/format_json/format_json_bench.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+#include "utils/common/common.h" /* STATIC_ARRAY_SIZE */
+
+#include "benchmark.h"
+#include "utils/format_json/format_json.h"
+
+static data_set_t ds = {
+    .type = "if_octets",
+    .ds_num = 2,
+    .ds =
+        (data_source_t[]){
+            {"rx", DS_TYPE_DERIVE, 0, NAN},
+            {"tx", DS_TYPE_DERIVE, 0, NAN},
+        },
+};
+
+/* Creates "num" value lists of different series. */
+static value_list_t *create_value_lists(size_t num) {
+  value_list_t *vl = calloc(num, sizeof(*vl));
+  value_t *values = calloc(2 * num, sizeof(*values));
+  if ((vl == NULL) || (values == NULL)) {
+    free(vl);
+    free(values);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    values[2 * i].derive = 1234567;
+    values[2 * i + 1].derive = 7654321;
+    vl[i] = (value_list_t){
+        .values = values + 2 * i,
+        .values_len = 2,
+        .time = TIME_T_TO_CDTIME_T_STATIC(1480063672),
+        .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+        .host = "example.com",
+        .plugin = "interface",
+        .type = "if_octets",
+    };
+    snprintf(vl[i].plugin_instance, sizeof(vl[i].plugin_instance), "eth%zu",
+             i);
+  }
+
+  return vl;
+}
+
+static void destroy_value_lists(value_list_t *vl) {
+  if (vl == NULL)
+    return;
+  free(vl[0].values);
+  free(vl);
+}
+
+DEF_BENCH(format_json_value_list) {
+  value_list_t *vl = create_value_lists(b->size);
+  if (vl == NULL)
+    return -1;
+
+  char buffer[4096];
+  size_t fill = 0;
+  size_t free_bytes = sizeof(buffer);
+  int status = format_json_initialize(buffer, &fill, &free_bytes);
+
+  BENCH_RESET_TIMER(b);
+  for (uint64_t i = 0; (i < b->iterations) && (status == 0); i++) {
+    /* Start a new buffer when the current one is full, like the write
+     * plugins do. */
+    if (free_bytes < 1024) {
+      fill = 0;
+      free_bytes = sizeof(buffer);
+      format_json_initialize(buffer, &fill, &free_bytes);
+    }
+    status = format_json_value_list(buffer, &fill, &free_bytes, &ds,
+                                    vl + (i % b->size), /* store_rates = */ 0);
+  }
+  BENCH_STOP_TIMER(b);
+
+  destroy_value_lists(vl);
+  return status;
+}
+
+DEF_BENCH(format_json_value_list_cached) {
+  value_list_t *vl = create_value_lists(b->size);
+  format_json_cache_t *fc = format_json_cache_create();
+  if ((vl == NULL) || (fc == NULL)) {
+    destroy_value_lists(vl);
+    format_json_cache_destroy(fc);
+    return -1;
+  }
+
+  char buffer[4096];
+  size_t fill = 0;
+  size_t free_bytes = sizeof(buffer);
+  int status = format_json_initialize(buffer, &fill, &free_bytes);
+
+  BENCH_RESET_TIMER(b);
+  for (uint64_t i = 0; (i < b->iterations) && (status == 0); i++) {
+    if (free_bytes < 1024) {
+      fill = 0;
+      free_bytes = sizeof(buffer);
+      format_json_initialize(buffer, &fill, &free_bytes);
+    }
+    status = format_json_value_list_cached(fc, buffer, &fill, &free_bytes, &ds,
+                                           vl + (i % b->size),
+                                           /* store_rates = */ 0);
+  }
+  BENCH_STOP_TIMER(b);
+
+  format_json_cache_destroy(fc);
+  destroy_value_lists(vl);
+  return status;
+}
+
+int main(void) {
+  size_t sizes[] = {1, 10000};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sizes); i++) {
+    RUN_BENCH(format_json_value_list, sizes[i]);
+    RUN_BENCH(format_json_value_list_cached, sizes[i]);
+  }
+
+  END_BENCH;
+}
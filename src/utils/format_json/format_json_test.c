@@ -41,6 +41,7 @@
 #include "testing.h"
 #include "utils/common/common.h" /* for STATIC_ARRAY_SIZE */
 #include "utils/format_json/format_json.h"
+#include "utils/metadata/meta_data.h"
 
 #include <yajl/yajl_common.h>
 #include <yajl/yajl_parse.h>
@@ -177,8 +178,126 @@ DEF_TEST(notification) {
   return expect_json_labels(got, labels, STATIC_ARRAY_SIZE(labels));
 }
 
+static data_set_t ds_double = {
+    .type = "double",
+    .ds_num = 2,
+    .ds =
+        (data_source_t[]){
+            {"one", DS_TYPE_GAUGE, NAN, NAN},
+            {"two", DS_TYPE_DERIVE, 0, NAN},
+        },
+};
+
+static int format_value_list(format_json_cache_t *fc, char *buffer,
+                             size_t buffer_size, value_list_t const *vl) {
+  size_t bfill = 0;
+  size_t bfree = buffer_size;
+
+  int status = format_json_initialize(buffer, &bfill, &bfree);
+  if (status == 0)
+    status = format_json_value_list_cached(fc, buffer, &bfill, &bfree,
+                                           &ds_double, vl, false);
+  if (status == 0)
+    status = format_json_finalize(buffer, &bfill, &bfree);
+  return status;
+}
+
+DEF_TEST(value_list) {
+  value_list_t vl = {
+      .values = (value_t[]){{.gauge = 42}, {.derive = -7}},
+      .values_len = 2,
+      .time = TIME_T_TO_CDTIME_T_STATIC(1480063672),
+      .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+      .host = "example.com",
+      .plugin = "test",
+      .plugin_instance = "\"quoted\"",
+      .type = "double",
+  };
+  char got[1024];
+
+  CHECK_ZERO(format_value_list(NULL, got, sizeof(got), &vl));
+  EXPECT_EQ_STR("[{\"values\":[42,-7],\"dstypes\":[\"gauge\",\"derive\"],"
+                "\"dsnames\":[\"one\",\"two\"],\"time\":1480063672.000,"
+                "\"interval\":10.000,\"host\":\"example.com\","
+                "\"plugin\":\"test\",\"plugin_instance\":\"\\\"quoted\\\"\","
+                "\"type\":\"double\",\"type_instance\":\"\"}]",
+                got);
+
+  /* Fractions and non-finite gauges. */
+  vl.values[0].gauge = 0.1;
+  CHECK_ZERO(format_value_list(NULL, got, sizeof(got), &vl));
+  OK(strstr(got, "\"values\":[0.1,-7]") != NULL);
+  vl.values[0].gauge = NAN;
+  CHECK_ZERO(format_value_list(NULL, got, sizeof(got), &vl));
+  OK(strstr(got, "\"values\":[null,-7]") != NULL);
+
+  CHECK_NOT_NULL(vl.meta = meta_data_create());
+  CHECK_ZERO(meta_data_add_string(vl.meta, "s", "x"));
+  CHECK_ZERO(meta_data_add_signed_int(vl.meta, "i", -1));
+  CHECK_ZERO(meta_data_add_boolean(vl.meta, "b", true));
+  CHECK_ZERO(format_value_list(NULL, got, sizeof(got), &vl));
+  OK(strstr(got, "\"type_instance\":\"\",\"meta\":{") != NULL);
+  OK(strstr(got, "\"s\":\"x\"") != NULL);
+  OK(strstr(got, "\"i\":-1") != NULL);
+  OK(strstr(got, "\"b\":true") != NULL);
+  meta_data_destroy(vl.meta);
+
+  return 0;
+}
+
+DEF_TEST(cached) {
+  value_list_t vl = {
+      .values = (value_t[]){{.gauge = 42}, {.derive = 7}},
+      .values_len = 2,
+      .time = TIME_T_TO_CDTIME_T_STATIC(1480063672),
+      .interval = TIME_T_TO_CDTIME_T_STATIC(10),
+      .host = "example.com",
+      .plugin = "test",
+      .type = "double",
+      .type_instance = "a\\b",
+  };
+
+  format_json_cache_t *fc = format_json_cache_create();
+  CHECK_NOT_NULL(fc);
+
+  char want[1024];
+  char got[1024];
+
+  /* The second call uses the cached fragments and must format the new
+   * values. */
+  for (int i = 0; i < 2; i++) {
+    vl.values[0].gauge = 42.5 + i;
+    vl.time += TIME_T_TO_CDTIME_T_STATIC(10);
+
+    CHECK_ZERO(format_value_list(NULL, want, sizeof(want), &vl));
+    CHECK_ZERO(format_value_list(fc, got, sizeof(got), &vl));
+    EXPECT_EQ_STR(want, got);
+  }
+
+  /* Other series must not get the cached fragments. */
+  sstrncpy(vl.host, "example.org", sizeof(vl.host));
+  CHECK_ZERO(format_value_list(NULL, want, sizeof(want), &vl));
+  CHECK_ZERO(format_value_list(fc, got, sizeof(got), &vl));
+  EXPECT_EQ_STR(want, got);
+
+  /* Too small buffers are reported and left unchanged, so that callers can
+   * flush them and retry. */
+  size_t bfill = 0;
+  size_t bfree = 64;
+  CHECK_ZERO(format_json_initialize(got, &bfill, &bfree));
+  EXPECT_EQ_INT(-ENOMEM, format_json_value_list_cached(
+                             fc, got, &bfill, &bfree, &ds_double, &vl, false));
+  EXPECT_EQ_INT(0, (int)bfill);
+  EXPECT_EQ_STR("", got);
+
+  format_json_cache_destroy(fc);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(notification);
+  RUN_TEST(value_list);
+  RUN_TEST(cached);
 
   END_TEST;
 }
@@ -41,6 +41,7 @@ struct sd_output_s {
   sd_resource_t *res;
   yajl_gen gen;
   c_avl_tree_t *staged;
+  size_t time_series_num;
   c_avl_tree_t *metric_descriptors;
 };
 
@@ -567,6 +568,12 @@ int sd_output_add(sd_output_t *out, data_set_t const *ds,
     return EEXIST;
   }
 
+  /* Stackdriver rejects requests with too many time series. */
+  if ((out->time_series_num > 0) &&
+      (out->time_series_num + ds->ds_num > SD_MAX_TIME_SERIES)) {
+    return ENOSPC;
+  }
+
   _Bool staged = 0;
   for (size_t i = 0; i < ds->ds_num; i++) {
     int status = format_time_series(out->gen, ds, vl, i, out->res);
@@ -578,6 +585,7 @@ int sd_output_add(sd_output_t *out, data_set_t const *ds,
       ERROR("sd_output_add: format_time_series failed with status %d.", status);
       return status;
     }
+    out->time_series_num++;
     staged = 1;
   }
 
@@ -587,7 +595,8 @@ int sd_output_add(sd_output_t *out, data_set_t const *ds,
 
   size_t json_buffer_size = 0;
   yajl_gen_get_buf(out->gen, &(unsigned char const *){NULL}, &json_buffer_size);
-  if (json_buffer_size > 65535)
+  if ((json_buffer_size > 65535) ||
+      (out->time_series_num >= SD_MAX_TIME_SERIES))
     return ENOBUFS;
 
   return 0;
@@ -620,6 +629,7 @@ char *sd_output_reset(sd_output_t *out) /* {{{ */
   char *ret = strdup((void const *)json_buffer);
 
   sd_output_reset_staged(out);
+  out->time_series_num = 0;
 
   yajl_gen_free(out->gen);
   out->gen = yajl_gen_alloc(/* funcs = */ NULL);
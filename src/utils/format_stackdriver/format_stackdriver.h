@@ -26,6 +26,12 @@
 #include "collectd.h"
 #include "plugin.h"
 
+/* Maximum number of time series in one projects.timeSeries.create()
+ * request. */
+#ifndef SD_MAX_TIME_SERIES
+#define SD_MAX_TIME_SERIES 200
+#endif
+
 /* sd_output_t is a buffer to which value_list_t* can be added and from which
  * an appropriately formatted char* can be read. */
 struct sd_output_s;
@@ -48,6 +54,8 @@ void sd_output_destroy(sd_output_t *out);
  *   - ENOBUFS  Success, but the buffer should be flushed soon.
  *   - EEXIST   The value list is already encoded in the buffer.
  *              Flush the buffer, then call sd_output_add again.
+ *   - ENOSPC   The value list would exceed SD_MAX_TIME_SERIES.
+ *              Flush the buffer, then call sd_output_add again.
  *   - ENOENT   First time we encounter this metric. Create a metric descriptor
  *              using the Stackdriver API and then call
  *              sd_output_register_metric.
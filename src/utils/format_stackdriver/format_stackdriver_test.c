@@ -75,8 +75,62 @@ DEF_TEST(sd_format_metric_descriptor) {
   return 0;
 }
 
+DEF_TEST(sd_output_add_limit) {
+  sd_resource_t *res = sd_resource_create("global");
+  CHECK_NOT_NULL(res);
+  sd_output_t *out = sd_output_create(res);
+  CHECK_NOT_NULL(out);
+
+  data_set_t ds = {
+      .type = "example",
+      .ds_num = 1,
+      .ds =
+          &(data_source_t){
+              .name = "value",
+              .type = DS_TYPE_GAUGE,
+              .min = NAN,
+              .max = NAN,
+          },
+  };
+  value_list_t vl = {
+      .values = &(value_t){.gauge = 42},
+      .values_len = 1,
+      .time = TIME_T_TO_CDTIME_T(1592000000),
+      .host = "example.com",
+      .plugin = "unit-test",
+      .type = "example",
+  };
+
+  EXPECT_EQ_INT(ENOENT, sd_output_add(out, &ds, &vl));
+  EXPECT_EQ_INT(0, sd_output_register_metric(out, &ds, &vl));
+
+  /* ENOBUFS may be returned early because of the payload size. */
+  int status = 0;
+  for (int i = 0; i < SD_MAX_TIME_SERIES; i++) {
+    snprintf(vl.type_instance, sizeof(vl.type_instance), "%d", i);
+    status = sd_output_add(out, &ds, &vl);
+    if ((status != 0) && (status != ENOBUFS))
+      break;
+  }
+  EXPECT_EQ_INT(ENOBUFS, status);
+
+  snprintf(vl.type_instance, sizeof(vl.type_instance), "%d",
+           SD_MAX_TIME_SERIES);
+  EXPECT_EQ_INT(ENOSPC, sd_output_add(out, &ds, &vl));
+
+  char *payload = sd_output_reset(out);
+  CHECK_NOT_NULL(payload);
+  free(payload);
+
+  EXPECT_EQ_INT(0, sd_output_add(out, &ds, &vl));
+
+  sd_output_destroy(out);
+  return 0;
+}
+
 int main(int argc, char **argv) {
   RUN_TEST(sd_format_metric_descriptor);
+  RUN_TEST(sd_output_add_limit);
 
   END_TEST;
 }
@@ -0,0 +1,345 @@
+/**
+ * collectd - src/utils/gorilla/gorilla.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils/gorilla/gorilla.h"
+
+/* Marks "prev_leading" as not set, i.e. the next non-zero XOR has to store
+ * its window explicitly. */
+#define GORILLA_NO_WINDOW 0xff
+
+/* Delta-of-delta buckets: control bits, number of control bits and number of
+ * value bits. The last bucket stores the full 64 bits. */
+static const struct {
+  uint64_t control;
+  unsigned int control_bits;
+  unsigned int value_bits;
+} dod_buckets[] = {
+    {0x2, 2, 7},
+    {0x6, 3, 9},
+    {0xe, 4, 12},
+    {0xf, 4, 64},
+};
+
+static void state_reset(gorilla_state_t *st, size_t values_num) /* {{{ */
+{
+  memset(st, 0, sizeof(*st));
+  st->values_num = values_num;
+  memset(st->prev_leading, GORILLA_NO_WINDOW, sizeof(st->prev_leading));
+} /* }}} void state_reset */
+
+static int write_bits(uint8_t *data, size_t size, size_t *pos, /* {{{ */
+                      uint64_t value, unsigned int n) {
+  if ((*pos + n) > (8 * size))
+    return ENOSPC;
+
+  while (n > 0) {
+    size_t byte = *pos / 8;
+    unsigned int room = 8 - (unsigned int)(*pos % 8);
+    unsigned int take = (n < room) ? n : room;
+    unsigned int shift = room - take;
+    uint8_t mask = (uint8_t)(((1u << take) - 1) << shift);
+    uint8_t chunk = (uint8_t)((value >> (n - take)) & ((1u << take) - 1));
+
+    data[byte] = (uint8_t)((data[byte] & ~mask) | (chunk << shift));
+    *pos += take;
+    n -= take;
+  }
+
+  return 0;
+} /* }}} int write_bits */
+
+static int read_bits(const uint8_t *data, size_t bits, size_t *pos, /* {{{ */
+                     uint64_t *ret, unsigned int n) {
+  uint64_t value = 0;
+
+  if ((*pos + n) > bits)
+    return EINVAL;
+
+  while (n > 0) {
+    size_t byte = *pos / 8;
+    unsigned int room = 8 - (unsigned int)(*pos % 8);
+    unsigned int take = (n < room) ? n : room;
+    unsigned int shift = room - take;
+
+    value = (value << take) | ((data[byte] >> shift) & ((1u << take) - 1));
+    *pos += take;
+    n -= take;
+  }
+
+  *ret = value;
+  return 0;
+} /* }}} int read_bits */
+
+static int encode_time(gorilla_stream_t *s, uint64_t time) /* {{{ */
+{
+  gorilla_state_t *st = &s->state;
+
+  if (st->count == 0)
+    return write_bits(s->data, s->size, &st->bits, time, 64);
+
+  int64_t delta = (int64_t)(time - st->prev_time);
+  int64_t dod = delta - st->prev_delta;
+
+  if (dod == 0)
+    return write_bits(s->data, s->size, &st->bits, 0, 1);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(dod_buckets); i++) {
+    unsigned int n = dod_buckets[i].value_bits;
+    if ((n < 64) && ((dod < -(INT64_C(1) << (n - 1))) ||
+                     (dod >= (INT64_C(1) << (n - 1)))))
+      continue;
+
+    uint64_t v = (uint64_t)dod;
+    if (n < 64)
+      v &= (UINT64_C(1) << n) - 1;
+
+    int status = write_bits(s->data, s->size, &st->bits,
+                            dod_buckets[i].control,
+                            dod_buckets[i].control_bits);
+    if (status == 0)
+      status = write_bits(s->data, s->size, &st->bits, v, n);
+    return status;
+  }
+
+  return EINVAL; /* not reached */
+} /* }}} int encode_time */
+
+static int decode_time(gorilla_iter_t *it, uint64_t *time) /* {{{ */
+{
+  gorilla_state_t *st = &it->state;
+  uint64_t bit;
+  int status;
+
+  if (st->count == 0)
+    return read_bits(it->data, it->bits, &st->bits, time, 64);
+
+  /* Count the leading one bits of the control sequence. */
+  unsigned int ones = 0;
+  while (ones < 4) {
+    if ((status = read_bits(it->data, it->bits, &st->bits, &bit, 1)) != 0)
+      return status;
+    if (bit == 0)
+      break;
+    ones++;
+  }
+
+  int64_t dod = 0;
+  if (ones > 0) {
+    unsigned int n = dod_buckets[ones - 1].value_bits;
+    uint64_t v;
+
+    if ((status = read_bits(it->data, it->bits, &st->bits, &v, n)) != 0)
+      return status;
+
+    if ((n < 64) && (v & (UINT64_C(1) << (n - 1))))
+      dod = (int64_t)v - (INT64_C(1) << n);
+    else
+      dod = (int64_t)v;
+  }
+
+  *time = st->prev_time + (uint64_t)(st->prev_delta + dod);
+  return 0;
+} /* }}} int decode_time */
+
+static int encode_value(gorilla_stream_t *s, size_t i, /* {{{ */
+                        uint64_t value) {
+  gorilla_state_t *st = &s->state;
+  int status;
+
+  if (st->count == 0)
+    return write_bits(s->data, s->size, &st->bits, value, 64);
+
+  uint64_t xor = value ^ st->prev_value[i];
+  if (xor == 0)
+    return write_bits(s->data, s->size, &st->bits, 0, 1);
+
+  unsigned int leading = (unsigned int)__builtin_clzll(xor);
+  unsigned int trailing = (unsigned int)__builtin_ctzll(xor);
+  if (leading > 31)
+    leading = 31;
+
+  if ((st->prev_leading[i] != GORILLA_NO_WINDOW) &&
+      (leading >= st->prev_leading[i]) && (trailing >= st->prev_trailing[i])) {
+    unsigned int n = 64 - st->prev_leading[i] - st->prev_trailing[i];
+
+    status = write_bits(s->data, s->size, &st->bits, 0x2, 2);
+    if (status == 0)
+      status = write_bits(s->data, s->size, &st->bits,
+                          xor >> st->prev_trailing[i], n);
+    return status;
+  }
+
+  unsigned int n = 64 - leading - trailing;
+
+  status = write_bits(s->data, s->size, &st->bits, 0x3, 2);
+  if (status == 0)
+    status = write_bits(s->data, s->size, &st->bits, leading, 5);
+  if (status == 0)
+    status = write_bits(s->data, s->size, &st->bits, n - 1, 6);
+  if (status == 0)
+    status = write_bits(s->data, s->size, &st->bits, xor >> trailing, n);
+
+  st->prev_leading[i] = (uint8_t)leading;
+  st->prev_trailing[i] = (uint8_t)trailing;
+  return status;
+} /* }}} int encode_value */
+
+static int decode_value(gorilla_iter_t *it, size_t i, /* {{{ */
+                        uint64_t *value) {
+  gorilla_state_t *st = &it->state;
+  uint64_t bit;
+  uint64_t v;
+  int status;
+
+  if (st->count == 0)
+    return read_bits(it->data, it->bits, &st->bits, value, 64);
+
+  if ((status = read_bits(it->data, it->bits, &st->bits, &bit, 1)) != 0)
+    return status;
+  if (bit == 0) {
+    *value = st->prev_value[i];
+    return 0;
+  }
+
+  if ((status = read_bits(it->data, it->bits, &st->bits, &bit, 1)) != 0)
+    return status;
+
+  if (bit == 1) {
+    uint64_t leading;
+    uint64_t n;
+
+    if (((status = read_bits(it->data, it->bits, &st->bits, &leading, 5)) !=
+         0) ||
+        ((status = read_bits(it->data, it->bits, &st->bits, &n, 6)) != 0))
+      return status;
+    n++;
+    if ((leading + n) > 64)
+      return EINVAL;
+
+    st->prev_leading[i] = (uint8_t)leading;
+    st->prev_trailing[i] = (uint8_t)(64 - leading - n);
+  } else if (st->prev_leading[i] == GORILLA_NO_WINDOW) {
+    return EINVAL;
+  }
+
+  unsigned int n = 64 - st->prev_leading[i] - st->prev_trailing[i];
+  if ((status = read_bits(it->data, it->bits, &st->bits, &v, n)) != 0)
+    return status;
+
+  *value = st->prev_value[i] ^ (v << st->prev_trailing[i]);
+  return 0;
+} /* }}} int decode_value */
+
+int gorilla_init(gorilla_stream_t *s, void *data, size_t size, /* {{{ */
+                 size_t values_num) {
+  if ((s == NULL) || (data == NULL) || (values_num == 0) ||
+      (values_num > GORILLA_VALUES_MAX))
+    return EINVAL;
+
+  s->data = data;
+  s->size = size;
+  state_reset(&s->state, values_num);
+
+  return 0;
+} /* }}} int gorilla_init */
+
+int gorilla_resume(gorilla_stream_t *s, void *data, size_t size, /* {{{ */
+                   size_t values_num, size_t bits, size_t count) {
+  int status = gorilla_init(s, data, size, values_num);
+  if (status != 0)
+    return status;
+  if (bits > (8 * size))
+    return EINVAL;
+
+  gorilla_iter_t it;
+  uint64_t time;
+  uint64_t values[GORILLA_VALUES_MAX];
+
+  gorilla_iter_init(&it, data, bits, count, values_num);
+  while ((status = gorilla_iter_next(&it, &time, values)) == 0)
+    ;
+  if ((status != ENOENT) || (it.state.bits != bits))
+    return EINVAL;
+
+  s->state = it.state;
+  return 0;
+} /* }}} int gorilla_resume */
+
+int gorilla_append(gorilla_stream_t *s, uint64_t time, /* {{{ */
+                   const uint64_t *values) {
+  gorilla_state_t saved = s->state;
+  gorilla_state_t *st = &s->state;
+
+  int status = encode_time(s, time);
+  for (size_t i = 0; (status == 0) && (i < st->values_num); i++)
+    status = encode_value(s, i, values[i]);
+
+  if (status != 0) {
+    s->state = saved;
+    return status;
+  }
+
+  if (st->count > 0)
+    st->prev_delta = (int64_t)(time - st->prev_time);
+  st->prev_time = time;
+  memcpy(st->prev_value, values, st->values_num * sizeof(*values));
+  st->count++;
+
+  return 0;
+} /* }}} int gorilla_append */
+
+void gorilla_iter_init(gorilla_iter_t *it, const void *data, /* {{{ */
+                       size_t bits, size_t count, size_t values_num) {
+  it->data = data;
+  it->bits = bits;
+  it->count = count;
+  state_reset(&it->state, values_num);
+} /* }}} void gorilla_iter_init */
+
+int gorilla_iter_next(gorilla_iter_t *it, uint64_t *time, /* {{{ */
+                      uint64_t *values) {
+  gorilla_state_t *st = &it->state;
+
+  if (st->count >= it->count)
+    return ENOENT;
+
+  int status = decode_time(it, time);
+  for (size_t i = 0; (status == 0) && (i < st->values_num); i++)
+    status = decode_value(it, i, &values[i]);
+  if (status != 0)
+    return EINVAL;
+
+  if (st->count > 0)
+    st->prev_delta = (int64_t)(*time - st->prev_time);
+  st->prev_time = *time;
+  memcpy(st->prev_value, values, st->values_num * sizeof(*values));
+  st->count++;
+
+  return 0;
+} /* }}} int gorilla_iter_next */
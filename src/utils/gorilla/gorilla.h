@@ -0,0 +1,130 @@
+/**
+ * collectd - src/utils/gorilla/gorilla.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#ifndef UTILS_GORILLA_H
+#define UTILS_GORILLA_H 1
+
+#include "collectd.h"
+
+/*
+ * Compression of time series as described in "Gorilla: A Fast, Scalable,
+ * In-Memory Time Series Database" (Pelkonen et al., 2015). Timestamps are
+ * stored as delta-of-delta, values as the XOR with the previous value of the
+ * same column. Values are opaque 64 bit patterns, so that gauges as well as
+ * counters can be stored losslessly.
+ *
+ * A stream is a bit string in a caller provided buffer. The number of bits
+ * and points written is all that is needed to continue or read a stream, so
+ * that the buffer can live in a memory mapped file.
+ */
+
+#define GORILLA_VALUES_MAX 32
+
+struct gorilla_state_s {
+  size_t values_num;
+  size_t bits;
+  size_t count;
+
+  uint64_t prev_time;
+  int64_t prev_delta;
+  uint64_t prev_value[GORILLA_VALUES_MAX];
+  uint8_t prev_leading[GORILLA_VALUES_MAX];
+  uint8_t prev_trailing[GORILLA_VALUES_MAX];
+};
+typedef struct gorilla_state_s gorilla_state_t;
+
+struct gorilla_stream_s {
+  uint8_t *data;
+  size_t size; /* in bytes */
+  gorilla_state_t state;
+};
+typedef struct gorilla_stream_s gorilla_stream_t;
+
+struct gorilla_iter_s {
+  const uint8_t *data;
+  size_t bits; /* number of valid bits in "data" */
+  size_t count;
+  gorilla_state_t state; /* "state.bits" is the read position */
+};
+typedef struct gorilla_iter_s gorilla_iter_t;
+
+/*
+ * NAME
+ *   gorilla_init
+ *
+ * DESCRIPTION
+ *   Initializes an empty stream of points with "values_num" values each in
+ *   the "size" bytes at "data". Returns EINVAL if "values_num" is zero or
+ *   larger than GORILLA_VALUES_MAX.
+ */
+int gorilla_init(gorilla_stream_t *s, void *data, size_t size,
+                 size_t values_num);
+
+/*
+ * NAME
+ *   gorilla_resume
+ *
+ * DESCRIPTION
+ *   Like gorilla_init(), but for a buffer which already holds "count" points
+ *   in "bits" bits. The stream is decoded once to restore the encoder state.
+ *   Returns EINVAL if the buffer doesn't hold a valid stream.
+ */
+int gorilla_resume(gorilla_stream_t *s, void *data, size_t size,
+                   size_t values_num, size_t bits, size_t count);
+
+/*
+ * NAME
+ *   gorilla_append
+ *
+ * DESCRIPTION
+ *   Appends a point. Returns ENOSPC, leaving the stream unchanged, if the
+ *   point doesn't fit into the buffer.
+ */
+int gorilla_append(gorilla_stream_t *s, uint64_t time, const uint64_t *values);
+
+/*
+ * NAME
+ *   gorilla_iter_init
+ *
+ * DESCRIPTION
+ *   Initializes "it" to read the "count" points in the first "bits" bits of
+ *   "data".
+ */
+void gorilla_iter_init(gorilla_iter_t *it, const void *data, size_t bits,
+                       size_t count, size_t values_num);
+
+/*
+ * NAME
+ *   gorilla_iter_next
+ *
+ * DESCRIPTION
+ *   Reads the next point into "time" and "values", which must have room for
+ *   "values_num" values. Returns ENOENT after the last point and EINVAL if
+ *   the stream is corrupt.
+ */
+int gorilla_iter_next(gorilla_iter_t *it, uint64_t *time, uint64_t *values);
+
+#endif /* UTILS_GORILLA_H */
@@ -0,0 +1,128 @@
+/**
+ * collectd - src/utils/gorilla/gorilla_test.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/gorilla/gorilla.h"
+
+#define POINTS_NUM 1000
+
+static uint64_t test_time(size_t i) {
+  /* Ten second interval with a few milliseconds of jitter and a gap. */
+  uint64_t t = UINT64_C(1700000000000) + 10000 * (uint64_t)i;
+  if (i % 7 == 3)
+    t += 3;
+  if (i > 500)
+    t += 3600000;
+  return t;
+}
+
+static void test_values(size_t i, uint64_t *values) {
+  double gauge = 20.0 + (double)(i % 17) * 0.25;
+  memcpy(&values[0], &gauge, sizeof(gauge));
+  values[1] = 123456789 + 100 * (uint64_t)i; /* derive */
+  values[2] = 0;
+}
+
+DEF_TEST(roundtrip) {
+  uint8_t buffer[65536];
+  gorilla_stream_t s;
+  uint64_t values[3];
+
+  EXPECT_EQ_INT(0, gorilla_init(&s, buffer, sizeof(buffer), 3));
+  for (size_t i = 0; i < POINTS_NUM; i++) {
+    test_values(i, values);
+    EXPECT_EQ_INT(0, gorilla_append(&s, test_time(i), values));
+  }
+  EXPECT_EQ_INT(POINTS_NUM, s.state.count);
+  /* Uncompressed, this would be 32 bytes per point. */
+  OK(s.state.bits / 8 < POINTS_NUM * 8);
+
+  gorilla_iter_t it;
+  uint64_t time;
+  uint64_t got[3];
+  gorilla_iter_init(&it, buffer, s.state.bits, s.state.count, 3);
+  for (size_t i = 0; i < POINTS_NUM; i++) {
+    EXPECT_EQ_INT(0, gorilla_iter_next(&it, &time, got));
+    test_values(i, values);
+    EXPECT_EQ_UINT64(test_time(i), time);
+    EXPECT_EQ_UINT64(values[0], got[0]);
+    EXPECT_EQ_UINT64(values[1], got[1]);
+    EXPECT_EQ_UINT64(values[2], got[2]);
+  }
+  EXPECT_EQ_INT(ENOENT, gorilla_iter_next(&it, &time, got));
+
+  return 0;
+}
+
+DEF_TEST(full) {
+  uint8_t buffer[64];
+  gorilla_stream_t s;
+  uint64_t values[1];
+  size_t i;
+
+  EXPECT_EQ_INT(0, gorilla_init(&s, buffer, sizeof(buffer), 1));
+  for (i = 0; i < POINTS_NUM; i++) {
+    values[0] = (uint64_t)i * UINT64_C(0x0101010101);
+    if (gorilla_append(&s, test_time(i), values) != 0)
+      break;
+  }
+  OK(i > 2);
+  OK(i < POINTS_NUM);
+  EXPECT_EQ_INT(i, s.state.count);
+
+  /* The failed append must not have changed the stream. */
+  gorilla_stream_t resumed;
+  EXPECT_EQ_INT(0, gorilla_resume(&resumed, buffer, sizeof(buffer), 1,
+                                  s.state.bits, s.state.count));
+  EXPECT_EQ_INT(s.state.bits, resumed.state.bits);
+  EXPECT_EQ_UINT64(s.state.prev_time, resumed.state.prev_time);
+  EXPECT_EQ_UINT64(s.state.prev_value[0], resumed.state.prev_value[0]);
+
+  return 0;
+}
+
+DEF_TEST(invalid) {
+  uint8_t buffer[16] = {0};
+  gorilla_stream_t s;
+
+  EXPECT_EQ_INT(EINVAL, gorilla_init(&s, buffer, sizeof(buffer), 0));
+  EXPECT_EQ_INT(EINVAL, gorilla_init(&s, buffer, sizeof(buffer),
+                                     GORILLA_VALUES_MAX + 1));
+  /* More points than bits. */
+  EXPECT_EQ_INT(EINVAL, gorilla_resume(&s, buffer, sizeof(buffer), 1, 64, 2));
+
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(roundtrip);
+  RUN_TEST(full);
+  RUN_TEST(invalid);
+
+  END_TEST;
+}
@@ -62,30 +62,211 @@
 struct ignorelist_item_s {
 #if HAVE_REGEX_H
   regex_t *rmatch; /* regular expression entry identification */
+  char *rstring;   /* source of the regular expression */
 #endif
-  char *smatch; /* string entry identification */
+  char *smatch;  /* string entry identification */
+  uint32_t hash; /* hash of smatch */
+  int count;     /* number of times smatch has been added */
   struct ignorelist_item_s *next;
 };
 typedef struct ignorelist_item_s ignorelist_item_t;
 
+/* Number of slots in the cache of regular expression match results. */
+#define IGNORELIST_CACHE_SIZE 256
+
+#if HAVE_REGEX_H
+struct ignorelist_cache_entry_s {
+  char *entry;
+  bool matches;
+};
+typedef struct ignorelist_cache_entry_s ignorelist_cache_entry_t;
+#endif
+
 struct ignorelist_s {
-  int ignore;              /* ignore entries */
-  ignorelist_item_t *head; /* pointer to the first entry */
+  int ignore; /* ignore entries */
+
+  /* String entries, in a hash table with chaining. */
+  ignorelist_item_t **buckets;
+  size_t buckets_num; /* power of two */
+  size_t strings_num;
+
+#if HAVE_REGEX_H
+  ignorelist_item_t *regex_head; /* list of regular expression entries */
+
+  /* All regular expressions which can be combined are compiled into a single
+   * alternation, so that only one regexec() is necessary. Built on demand. */
+  pthread_mutex_t regex_lock;
+  bool combined_done;
+  regex_t *combined;
+
+  /* Results of recent regular expression matches, indexed by the hash of the
+   * entry. Protected by regex_lock. */
+  ignorelist_cache_entry_t cache[IGNORELIST_CACHE_SIZE];
+#endif
 };
 
 /* *** *** *** ********************************************* *** *** *** */
 /* *** *** *** *** *** ***   private functions   *** *** *** *** *** *** */
 /* *** *** *** ********************************************* *** *** *** */
 
-static inline void ignorelist_append(ignorelist_t *il,
-                                     ignorelist_item_t *item) {
-  assert((il != NULL) && (item != NULL));
+/* 32 bit FNV-1a hash. */
+static uint32_t ignorelist_hash(const char *str) {
+  uint32_t hash = 2166136261U;
+
+  for (const unsigned char *c = (const unsigned char *)str; *c != 0; c++) {
+    hash ^= *c;
+    hash *= 16777619U;
+  }
+
+  return hash;
+} /* uint32_t ignorelist_hash */
 
-  item->next = il->head;
-  il->head = item;
+static ignorelist_item_t **ignorelist_bucket(ignorelist_t *il, uint32_t hash) {
+  return &il->buckets[hash & (il->buckets_num - 1)];
 }
 
+/*
+ * look up a string entry
+ * return the entry or NULL if not found
+ */
+static ignorelist_item_t *ignorelist_lookup_string(ignorelist_t *il,
+                                                   const char *entry,
+                                                   uint32_t hash) {
+  if (il->strings_num == 0)
+    return NULL;
+
+  for (ignorelist_item_t *item = *ignorelist_bucket(il, hash); item != NULL;
+       item = item->next) {
+    if ((item->hash == hash) && (strcmp(entry, item->smatch) == 0))
+      return item;
+  }
+
+  return NULL;
+} /* ignorelist_item_t *ignorelist_lookup_string */
+
+/* Doubles the number of buckets if the table is getting crowded. */
+static int ignorelist_grow(ignorelist_t *il) {
+  if ((il->buckets != NULL) && (il->strings_num < il->buckets_num))
+    return 0;
+
+  size_t buckets_num = (il->buckets_num == 0) ? 16 : 2 * il->buckets_num;
+  ignorelist_item_t **buckets = calloc(buckets_num, sizeof(*buckets));
+  if (buckets == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < il->buckets_num; i++) {
+    ignorelist_item_t *next;
+    for (ignorelist_item_t *item = il->buckets[i]; item != NULL; item = next) {
+      next = item->next;
+      ignorelist_item_t **bucket = &buckets[item->hash & (buckets_num - 1)];
+      item->next = *bucket;
+      *bucket = item;
+    }
+  }
+
+  sfree(il->buckets);
+  il->buckets = buckets;
+  il->buckets_num = buckets_num;
+  return 0;
+} /* int ignorelist_grow */
+
 #if HAVE_REGEX_H
+static void ignorelist_free_regex(regex_t *re) {
+  if (re == NULL)
+    return;
+
+  regfree(re);
+  sfree(re);
+}
+
+/* Forgets the combined regular expression and all cached results. Must be
+ * called whenever the regular expression entries change. */
+static void ignorelist_reset_regex(ignorelist_t *il) {
+  ignorelist_free_regex(il->combined);
+  il->combined = NULL;
+  il->combined_done = false;
+
+  for (size_t i = 0; i < IGNORELIST_CACHE_SIZE; i++) {
+    sfree(il->cache[i].entry);
+    il->cache[i].matches = false;
+  }
+}
+
+/* Back-references refer to groups by number, which changes when the regular
+ * expression is embedded into a larger one. */
+static bool ignorelist_regex_combinable(const char *re_str) {
+  for (const char *c = re_str; *c != 0; c++) {
+    if (*c != '\\')
+      continue;
+    if (isdigit((unsigned char)c[1]))
+      return false;
+    if (c[1] == 0)
+      break;
+    c++;
+  }
+  return true;
+}
+
+/* Compiles all combinable regular expressions into "(re0)|(re1)|...". If this
+ * fails for any reason, the expressions are matched one by one. */
+static void ignorelist_combine(ignorelist_t *il) {
+  size_t len = 0;
+  size_t num = 0;
+  size_t nsub = 0;
+
+  il->combined_done = true;
+
+  for (ignorelist_item_t *item = il->regex_head; item != NULL;
+       item = item->next) {
+    if (!ignorelist_regex_combinable(item->rstring))
+      continue;
+    len += strlen(item->rstring) + strlen("()|");
+    nsub += item->rmatch->re_nsub + 1;
+    num++;
+  }
+
+  /* Nothing to gain from combining a single expression. */
+  if (num < 2)
+    return;
+
+  char *str = malloc(len + 1);
+  if (str == NULL)
+    return;
+
+  size_t offset = 0;
+  for (ignorelist_item_t *item = il->regex_head; item != NULL;
+       item = item->next) {
+    if (!ignorelist_regex_combinable(item->rstring))
+      continue;
+    offset += snprintf(str + offset, len + 1 - offset, "%s(%s)",
+                       (offset == 0) ? "" : "|", item->rstring);
+  }
+
+  regex_t *re = calloc(1, sizeof(*re));
+  if (re == NULL) {
+    sfree(str);
+    return;
+  }
+
+  int status = regcomp(re, str, REG_EXTENDED | REG_NOSUB);
+  sfree(str);
+  if (status != 0) {
+    DEBUG("ignorelist_combine: Compiling the combined regular expression "
+          "failed with status %i.",
+          status);
+    sfree(re);
+    return;
+  }
+
+  /* Make sure the expressions have not been merged in an unexpected way. */
+  if (re->re_nsub != nsub) {
+    ignorelist_free_regex(re);
+    return;
+  }
+
+  il->combined = re;
+} /* void ignorelist_combine */
+
 static int ignorelist_append_regex(ignorelist_t *il, const char *re_str) {
   regex_t *re;
   ignorelist_item_t *entry;
@@ -112,19 +293,42 @@ static int ignorelist_append_regex(ignorelist_t *il, const char *re_str) {
   entry = calloc(1, sizeof(*entry));
   if (entry == NULL) {
     ERROR("ignorelist_append_regex: calloc failed.");
-    regfree(re);
-    sfree(re);
+    ignorelist_free_regex(re);
     return ENOMEM;
   }
   entry->rmatch = re;
+  entry->rstring = strdup(re_str);
+  if (entry->rstring == NULL) {
+    ERROR("ignorelist_append_regex: strdup failed.");
+    ignorelist_free_regex(re);
+    sfree(entry);
+    return ENOMEM;
+  }
+
+  pthread_mutex_lock(&il->regex_lock);
+  entry->next = il->regex_head;
+  il->regex_head = entry;
+  ignorelist_reset_regex(il);
+  pthread_mutex_unlock(&il->regex_lock);
 
-  ignorelist_append(il, entry);
   return 0;
 } /* int ignorelist_append_regex */
 #endif
 
 static int ignorelist_append_string(ignorelist_t *il, const char *entry) {
   ignorelist_item_t *new;
+  uint32_t hash = ignorelist_hash(entry);
+
+  new = ignorelist_lookup_string(il, entry, hash);
+  if (new != NULL) {
+    new->count++;
+    return 0;
+  }
+
+  if (ignorelist_grow(il) != 0) {
+    ERROR("cannot allocate hash table");
+    return 1;
+  }
 
   /* create new entry */
   if ((new = calloc(1, sizeof(*new))) == NULL) {
@@ -132,43 +336,61 @@ static int ignorelist_append_string(ignorelist_t *il, const char *entry) {
     return 1;
   }
   new->smatch = sstrdup(entry);
+  new->hash = hash;
+  new->count = 1;
 
   /* append new entry */
-  ignorelist_append(il, new);
+  ignorelist_item_t **bucket = ignorelist_bucket(il, hash);
+  new->next = *bucket;
+  *bucket = new;
+  il->strings_num++;
 
   return 0;
 } /* int ignorelist_append_string(ignorelist_t *il, const char *entry) */
 
 #if HAVE_REGEX_H
 /*
- * check list for entry regex match
- * return 1 if found
+ * check the regular expression entries
+ * return true if any of them matches
  */
-static int ignorelist_match_regex(ignorelist_item_t *item, const char *entry) {
-  assert((item != NULL) && (item->rmatch != NULL) && (entry != NULL) &&
-         (strlen(entry) > 0));
+static bool ignorelist_match_regex(ignorelist_t *il, const char *entry,
+                                   uint32_t hash) {
+  bool matches = false;
 
-  /* match regex */
-  if (regexec(item->rmatch, entry, 0, NULL, 0) == 0)
-    return 1;
+  pthread_mutex_lock(&il->regex_lock);
 
-  return 0;
-} /* int ignorelist_match_regex (ignorelist_item_t *item, const char *entry) */
-#endif
+  ignorelist_cache_entry_t *ce = &il->cache[hash % IGNORELIST_CACHE_SIZE];
+  if ((ce->entry != NULL) && (strcmp(ce->entry, entry) == 0)) {
+    matches = ce->matches;
+    pthread_mutex_unlock(&il->regex_lock);
+    return matches;
+  }
 
-/*
- * check list for entry string match
- * return 1 if found
- */
-static int ignorelist_match_string(ignorelist_item_t *item, const char *entry) {
-  assert((item != NULL) && (item->smatch != NULL) && (entry != NULL) &&
-         (strlen(entry) > 0));
+  if (!il->combined_done)
+    ignorelist_combine(il);
 
-  if (strcmp(entry, item->smatch) == 0)
-    return 1;
+  if (il->combined != NULL)
+    matches = (regexec(il->combined, entry, 0, NULL, 0) == 0);
 
-  return 0;
-} /* int ignorelist_match_string (ignorelist_item_t *item, const char *entry) */
+  for (ignorelist_item_t *item = il->regex_head; (item != NULL) && !matches;
+       item = item->next) {
+    if ((il->combined != NULL) && ignorelist_regex_combinable(item->rstring))
+      continue;
+
+    matches = (regexec(item->rmatch, entry, 0, NULL, 0) == 0);
+  }
+
+  char *copy = strdup(entry);
+  if (copy != NULL) {
+    sfree(ce->entry);
+    ce->entry = copy;
+    ce->matches = matches;
+  }
+
+  pthread_mutex_unlock(&il->regex_lock);
+  return matches;
+} /* bool ignorelist_match_regex */
+#endif
 
 /* *** *** *** ******************************************** *** *** *** */
 /* *** *** *** *** *** ***   public functions   *** *** *** *** *** *** */
@@ -191,6 +413,10 @@ ignorelist_t *ignorelist_create(int invert) {
    */
   il->ignore = invert ? 0 : 1;
 
+#if HAVE_REGEX_H
+  pthread_mutex_init(&il->regex_lock, /* attr = */ NULL);
+#endif
+
   return il;
 } /* ignorelist_t *ignorelist_create (int ignore) */
 
@@ -204,22 +430,27 @@ void ignorelist_free(ignorelist_t *il) {
   if (il == NULL)
     return;
 
-  for (this = il->head; this != NULL; this = next) {
-    next = this->next;
-#if HAVE_REGEX_H
-    if (this->rmatch != NULL) {
-      regfree(this->rmatch);
-      sfree(this->rmatch);
-      this->rmatch = NULL;
-    }
-#endif
-    if (this->smatch != NULL) {
+  for (size_t i = 0; i < il->buckets_num; i++) {
+    for (this = il->buckets[i]; this != NULL; this = next) {
+      next = this->next;
       sfree(this->smatch);
-      this->smatch = NULL;
+      sfree(this);
     }
+  }
+  sfree(il->buckets);
+
+#if HAVE_REGEX_H
+  for (this = il->regex_head; this != NULL; this = next) {
+    next = this->next;
+    ignorelist_free_regex(this->rmatch);
+    sfree(this->rstring);
     sfree(this);
   }
 
+  ignorelist_reset_regex(il);
+  pthread_mutex_destroy(&il->regex_lock);
+#endif
+
   sfree(il);
 } /* void ignorelist_destroy (ignorelist_t *il) */
 
@@ -284,27 +515,29 @@ int ignorelist_add(ignorelist_t *il, const char *entry) {
  */
 int ignorelist_remove(ignorelist_t *il, const char *entry) {
   /* if no entries, nothing to remove */
-  if ((il == NULL) || (il->head == NULL))
+  if ((il == NULL) || (il->strings_num == 0))
     return 1;
 
   if ((entry == NULL) || (strlen(entry) == 0))
     return 1;
 
-  /* traverse list and check entries */
-  for (ignorelist_item_t *prev = NULL, *traverse = il->head; traverse != NULL;
-       prev = traverse, traverse = traverse->next) {
-    if (traverse->smatch != NULL && strcmp(traverse->smatch, entry) == 0) {
-      if (prev == NULL) {
-        il->head = traverse->next;
-      } else {
-        prev->next = traverse->next;
-      }
-      sfree(traverse->smatch);
-      traverse->smatch = NULL;
-      sfree(traverse);
+  uint32_t hash = ignorelist_hash(entry);
+  for (ignorelist_item_t **prev = ignorelist_bucket(il, hash); *prev != NULL;
+       prev = &(*prev)->next) {
+    ignorelist_item_t *item = *prev;
+    if ((item->hash != hash) || (strcmp(item->smatch, entry) != 0))
+      continue;
+
+    /* The entry was added more than once. */
+    if (--item->count > 0)
       return 0;
-    }
-  } /* for traverse */
+
+    *prev = item->next;
+    sfree(item->smatch);
+    sfree(item);
+    il->strings_num--;
+    return 0;
+  }
 
   return 1;
 } /* int ignorelist_remove (ignorelist_t *il, const char *entry) */
@@ -315,26 +548,27 @@ int ignorelist_remove(ignorelist_t *il, const char *entry) {
  */
 int ignorelist_match(ignorelist_t *il, const char *entry) {
   /* if no entries, collect all */
-  if ((il == NULL) || (il->head == NULL))
+  if (il == NULL)
     return 0;
+#if HAVE_REGEX_H
+  if ((il->strings_num == 0) && (il->regex_head == NULL))
+    return 0;
+#else
+  if (il->strings_num == 0)
+    return 0;
+#endif
 
   if ((entry == NULL) || (strlen(entry) == 0))
     return 0;
 
-  /* traverse list and check entries */
-  for (ignorelist_item_t *traverse = il->head; traverse != NULL;
-       traverse = traverse->next) {
+  uint32_t hash = ignorelist_hash(entry);
+  if (ignorelist_lookup_string(il, entry, hash) != NULL)
+    return il->ignore;
+
 #if HAVE_REGEX_H
-    if (traverse->rmatch != NULL) {
-      if (ignorelist_match_regex(traverse, entry))
-        return il->ignore;
-    } else
+  if ((il->regex_head != NULL) && ignorelist_match_regex(il, entry, hash))
+    return il->ignore;
 #endif
-    {
-      if (ignorelist_match_string(traverse, entry))
-        return il->ignore;
-    }
-  } /* for traverse */
 
   return 1 - il->ignore;
 } /* int ignorelist_match (ignorelist_t *il, const char *entry) */
@@ -0,0 +1,110 @@
+/**
+ * collectd - src/utils/ignorelist/ignorelist_test.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/ignorelist/ignorelist.h"
+
+DEF_TEST(strings) {
+  ignorelist_t *il;
+  char name[32];
+
+  CHECK_NOT_NULL(il = ignorelist_create(/* invert = */ 1));
+
+  /* An empty list collects everything. */
+  EXPECT_EQ_INT(0, ignorelist_match(il, "eth0"));
+
+  /* Enough entries to force the hash table to grow a few times. */
+  for (int i = 0; i < 100; i++) {
+    snprintf(name, sizeof(name), "eth%d", i);
+    CHECK_ZERO(ignorelist_add(il, name));
+  }
+
+  for (int i = 0; i < 100; i++) {
+    snprintf(name, sizeof(name), "eth%d", i);
+    EXPECT_EQ_INT(0, ignorelist_match(il, name));
+  }
+  EXPECT_EQ_INT(1, ignorelist_match(il, "eth100"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "lo"));
+
+  /* Entries which have been added twice have to be removed twice. */
+  CHECK_ZERO(ignorelist_add(il, "eth0"));
+  CHECK_ZERO(ignorelist_remove(il, "eth0"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, "eth0"));
+  CHECK_ZERO(ignorelist_remove(il, "eth0"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "eth0"));
+  EXPECT_EQ_INT(1, ignorelist_remove(il, "eth0"));
+
+  ignorelist_set_invert(il, /* invert = */ 0);
+  EXPECT_EQ_INT(1, ignorelist_match(il, "eth1"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, "eth0"));
+
+  ignorelist_free(il);
+  return 0;
+}
+
+DEF_TEST(regex) {
+  struct {
+    char const *entry;
+    int want;
+  } cases[] = {
+      {"sda", 1},  {"sda1", 1},  {"sdb", 1},   {"hda", 0},
+      {"loop0", 1}, {"loop", 0}, {"aa", 1},    {"ab", 0},
+      {"dm-0", 1}, {"md0", 0},   {"vda", 0},   {"", 0},
+  };
+  ignorelist_t *il;
+
+  CHECK_NOT_NULL(il = ignorelist_create(/* invert = */ 0));
+
+  CHECK_ZERO(ignorelist_add(il, "/^sd[a-z]/"));
+  CHECK_ZERO(ignorelist_add(il, "/^loop[0-9]+$/"));
+  /* Back-references can not be combined and are matched on their own. */
+  CHECK_ZERO(ignorelist_add(il, "/^(a)\\1$/"));
+  CHECK_ZERO(ignorelist_add(il, "dm-0"));
+  OK(ignorelist_add(il, "/[/") != 0);
+
+  /* Match twice to exercise the result cache. */
+  for (int n = 0; n < 2; n++) {
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+      printf("## Case %zu: \"%s\"\n", i, cases[i].entry);
+      EXPECT_EQ_INT(cases[i].want, ignorelist_match(il, cases[i].entry));
+    }
+  }
+
+  /* Adding an expression must invalidate cached results. */
+  CHECK_ZERO(ignorelist_add(il, "/^vd/"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "vda"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "sdc"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, "hdc"));
+
+  ignorelist_free(il);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(strings);
+  RUN_TEST(regex);
+
+  END_TEST;
+}
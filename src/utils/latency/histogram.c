@@ -0,0 +1,343 @@
+/**
+ * collectd - src/utils/latency/histogram.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "utils/common/common.h"
+#include "utils/latency/histogram.h"
+
+/* Values are recorded in units of 2^UNIT_BITS cdtime_t, i.e. about one
+ * microsecond. */
+#define UNIT_BITS 10
+/* Values below 2^SUB_BITS units have a bin each. Above that, each power of
+ * two is split into 2^(SUB_BITS - 1) bins. */
+#define SUB_BITS 6
+#define SUB_NUM (1 << SUB_BITS)
+#define SUB_HALF (SUB_NUM / 2)
+/* Values of 2^MAX_BITS units or more are counted in the last bin. */
+#define MAX_BITS 36
+#define BINS_NUM ((MAX_BITS - SUB_BITS + 2) * SUB_HALF)
+/* The bins are allocated in groups of SUB_HALF bins, i.e. one power of two,
+ * when the first value falls into the group. Most histograms only ever see
+ * values spanning a few powers of two. */
+#define GROUPS_NUM (BINS_NUM / SUB_HALF)
+
+struct latency_histogram_s {
+  uint64_t num;
+  cdtime_t sum;
+  cdtime_t min;
+  cdtime_t max;
+
+  uint64_t *groups[GROUPS_NUM];
+};
+
+static uint64_t bin_get(latency_histogram_t const *h, size_t i) /* {{{ */
+{
+  uint64_t const *group = h->groups[i / SUB_HALF];
+  return (group != NULL) ? group[i % SUB_HALF] : 0;
+} /* }}} uint64_t bin_get */
+
+/* Returns a pointer to bin "i", allocating its group if necessary, or NULL if
+ * the allocation fails. */
+static uint64_t *bin_ptr(latency_histogram_t *h, size_t i) /* {{{ */
+{
+  uint64_t **group = &h->groups[i / SUB_HALF];
+  if (*group == NULL) {
+    *group = calloc(SUB_HALF, sizeof(**group));
+    if (*group == NULL)
+      return NULL;
+  }
+
+  return &(*group)[i % SUB_HALF];
+} /* }}} uint64_t *bin_ptr */
+
+/* Returns the position of the most significant bit set in "v". "v" must not
+ * be zero. */
+static int log2_floor(uint64_t v) /* {{{ */
+{
+  int ret = 0;
+
+  for (int shift = 32; shift > 0; shift /= 2) {
+    if ((v >> shift) != 0) {
+      v >>= shift;
+      ret += shift;
+    }
+  }
+
+  return ret;
+} /* }}} int log2_floor */
+
+static size_t bin_index(cdtime_t latency) /* {{{ */
+{
+  uint64_t v = latency >> UNIT_BITS;
+
+  if (v < SUB_NUM)
+    return (size_t)v;
+  if (v >= (UINT64_C(1) << MAX_BITS))
+    return BINS_NUM - 1;
+
+  int e = log2_floor(v) - (SUB_BITS - 1);
+  return (size_t)(e * SUB_HALF) + (size_t)(v >> e);
+} /* }}} size_t bin_index */
+
+/* Returns the smallest value counted in bin "i" and its width, both in
+ * cdtime_t. */
+static void bin_range(size_t i, cdtime_t *ret_lower, /* {{{ */
+                      cdtime_t *ret_width) {
+  if (i < SUB_NUM) {
+    *ret_lower = ((cdtime_t)i) << UNIT_BITS;
+    *ret_width = ((cdtime_t)1) << UNIT_BITS;
+    return;
+  }
+
+  int e = (int)(i / SUB_HALF) - 1;
+  cdtime_t m = (cdtime_t)((i % SUB_HALF) + SUB_HALF);
+
+  *ret_lower = m << (e + UNIT_BITS);
+  *ret_width = ((cdtime_t)1) << (e + UNIT_BITS);
+} /* }}} void bin_range */
+
+latency_histogram_t *latency_histogram_create(void) /* {{{ */
+{
+  return calloc(1, sizeof(latency_histogram_t));
+} /* }}} latency_histogram_t *latency_histogram_create */
+
+void latency_histogram_destroy(latency_histogram_t *h) /* {{{ */
+{
+  if (h == NULL)
+    return;
+
+  for (size_t i = 0; i < GROUPS_NUM; i++)
+    sfree(h->groups[i]);
+  sfree(h);
+} /* }}} void latency_histogram_destroy */
+
+void latency_histogram_add(latency_histogram_t *h, cdtime_t latency) /* {{{ */
+{
+  latency_histogram_add_n(h, latency, 1);
+} /* }}} void latency_histogram_add */
+
+void latency_histogram_add_n(latency_histogram_t *h, /* {{{ */
+                             cdtime_t latency, uint64_t count) {
+  if ((h == NULL) || (count == 0))
+    return;
+
+  /* If the bin can't be allocated, the value is dropped altogether so that
+   * the bins and "num" stay consistent. */
+  uint64_t *bin = bin_ptr(h, bin_index(latency));
+  if (bin == NULL)
+    return;
+  *bin += count;
+
+  if ((h->num == 0) || (h->min > latency))
+    h->min = latency;
+  if (h->max < latency)
+    h->max = latency;
+  h->sum += latency * count;
+  h->num += count;
+} /* }}} void latency_histogram_add_n */
+
+void latency_histogram_reset(latency_histogram_t *h) /* {{{ */
+{
+  if (h == NULL)
+    return;
+
+  /* Allocated groups are kept, because the next values likely fall into the
+   * same ones. */
+  for (size_t i = 0; i < GROUPS_NUM; i++) {
+    if (h->groups[i] != NULL)
+      memset(h->groups[i], 0, SUB_HALF * sizeof(*h->groups[i]));
+  }
+
+  h->num = 0;
+  h->sum = 0;
+  h->min = 0;
+  h->max = 0;
+} /* }}} void latency_histogram_reset */
+
+void latency_histogram_merge(latency_histogram_t *dst, /* {{{ */
+                             latency_histogram_t const *src) {
+  if ((dst == NULL) || (src == NULL) || (src->num == 0))
+    return;
+
+  uint64_t num = 0;
+  for (size_t i = 0; i < GROUPS_NUM; i++) {
+    uint64_t const *group = src->groups[i];
+    if (group == NULL)
+      continue;
+
+    for (size_t j = 0; j < SUB_HALF; j++) {
+      if (group[j] == 0)
+        continue;
+
+      uint64_t *bin = bin_ptr(dst, (i * SUB_HALF) + j);
+      if (bin == NULL)
+        continue;
+      *bin += group[j];
+      num += group[j];
+    }
+  }
+
+  if ((dst->num == 0) || (dst->min > src->min))
+    dst->min = src->min;
+  if (dst->max < src->max)
+    dst->max = src->max;
+  /* Values in groups that couldn't be allocated are dropped. */
+  dst->sum += (num == src->num) ? src->sum : src->sum / src->num * num;
+  dst->num += num;
+} /* }}} void latency_histogram_merge */
+
+cdtime_t latency_histogram_get_min(latency_histogram_t const *h) /* {{{ */
+{
+  return (h != NULL) ? h->min : 0;
+} /* }}} cdtime_t latency_histogram_get_min */
+
+cdtime_t latency_histogram_get_max(latency_histogram_t const *h) /* {{{ */
+{
+  return (h != NULL) ? h->max : 0;
+} /* }}} cdtime_t latency_histogram_get_max */
+
+cdtime_t latency_histogram_get_sum(latency_histogram_t const *h) /* {{{ */
+{
+  return (h != NULL) ? h->sum : 0;
+} /* }}} cdtime_t latency_histogram_get_sum */
+
+uint64_t latency_histogram_get_num(latency_histogram_t const *h) /* {{{ */
+{
+  return (h != NULL) ? h->num : 0;
+} /* }}} uint64_t latency_histogram_get_num */
+
+cdtime_t latency_histogram_get_average(latency_histogram_t const *h) /* {{{ */
+{
+  if ((h == NULL) || (h->num == 0))
+    return 0;
+
+  return h->sum / (cdtime_t)h->num;
+} /* }}} cdtime_t latency_histogram_get_average */
+
+double latency_histogram_get_count(latency_histogram_t const *h, /* {{{ */
+                                   cdtime_t lower, cdtime_t upper) {
+  if ((h == NULL) || (h->num == 0))
+    return 0.0;
+  if ((upper != 0) && (upper <= lower))
+    return 0.0;
+
+  double sum = 0.0;
+  for (size_t bin = 0; bin < BINS_NUM; bin++) {
+    uint64_t count = bin_get(h, bin);
+    if (count == 0)
+      continue;
+
+    cdtime_t bin_lower;
+    cdtime_t width;
+    bin_range(bin, &bin_lower, &width);
+    /* The last bin has no upper bound; use the largest value instead. */
+    if ((bin == BINS_NUM - 1) && (h->max > bin_lower))
+      width = h->max - bin_lower + 1;
+    cdtime_t bin_upper = bin_lower + width;
+
+    /* Count the part of the bin overlapping the interval, assuming values
+     * are spread evenly within the bin. */
+    cdtime_t from = (lower > bin_lower) ? lower : bin_lower;
+    cdtime_t to = ((upper != 0) && (upper < bin_upper)) ? upper : bin_upper;
+    if (to <= from)
+      continue;
+
+    sum += ((double)count) * ((double)(to - from)) / ((double)width);
+  }
+
+  return sum;
+} /* }}} double latency_histogram_get_count */
+
+void latency_histogram_get_percentiles(latency_histogram_t const *h, /* {{{ */
+                                       double const *percent, cdtime_t *ret,
+                                       size_t num) {
+  if ((percent == NULL) || (ret == NULL) || (num == 0))
+    return;
+
+  /* Sort the requested percentiles (by index), so that all of them can be
+   * looked up while walking the bins once. */
+  size_t order[num];
+  size_t order_num = 0;
+  for (size_t i = 0; i < num; i++) {
+    ret[i] = 0;
+    if ((h == NULL) || (h->num == 0) ||
+        !((percent[i] > 0.0) && (percent[i] < 100.0)))
+      continue;
+
+    size_t j = order_num;
+    while ((j > 0) && (percent[order[j - 1]] > percent[i])) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+    order_num++;
+  }
+
+  size_t next = 0;
+  uint64_t sum = 0;
+  for (size_t bin = 0; (bin < BINS_NUM) && (next < order_num); bin++) {
+    uint64_t count = bin_get(h, bin);
+    if (count == 0)
+      continue;
+
+    uint64_t sum_lower = sum;
+    sum += count;
+    double percent_upper = 100.0 * ((double)sum) / ((double)h->num);
+
+    while ((next < order_num) && (percent_upper >= percent[order[next]])) {
+      double p = percent[order[next]];
+      double percent_lower = 100.0 * ((double)sum_lower) / ((double)h->num);
+
+      cdtime_t lower;
+      cdtime_t width;
+      bin_range(bin, &lower, &width);
+      /* The last bin has no upper bound; use the largest value instead. */
+      if ((bin == BINS_NUM - 1) && (h->max > lower))
+        width = h->max - lower;
+
+      /* Interpolate linearly within the bin. */
+      double ratio = (p - percent_lower) / (percent_upper - percent_lower);
+      cdtime_t latency = lower + (cdtime_t)(ratio * (double)width);
+
+      if (latency < h->min)
+        latency = h->min;
+      if (latency > h->max)
+        latency = h->max;
+
+      ret[order[next]] = latency;
+      next++;
+    }
+  }
+} /* }}} void latency_histogram_get_percentiles */
+
+cdtime_t latency_histogram_get_percentile(latency_histogram_t const *h, /* {{{ */
+                                          double percent) {
+  cdtime_t ret = 0;
+
+  latency_histogram_get_percentiles(h, &percent, &ret, 1);
+  return ret;
+} /* }}} cdtime_t latency_histogram_get_percentile */
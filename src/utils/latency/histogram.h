@@ -0,0 +1,109 @@
+/**
+ * collectd - src/utils/latency/histogram.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#ifndef UTILS_LATENCY_HISTOGRAM_H
+#define UTILS_LATENCY_HISTOGRAM_H 1
+
+#include "collectd.h"
+
+#include "utils_time.h"
+
+/*
+ * A log-linear ("HDR") latency histogram. Each power of two is split into a
+ * fixed number of equally wide bins, so the relative error of a recorded
+ * value is at most about 3%, regardless of its magnitude. Unlike
+ * latency_counter_t, the bins never have to be rescaled, which makes adding a
+ * value O(1) and lets histograms be merged bin by bin.
+ *
+ * The resolution is about one microsecond; values of more than 2^16 seconds
+ * are counted in the last bin.
+ *
+ * The bins of each power of two are allocated when the first value falls into
+ * them, so a histogram of values within a narrow range takes less than a
+ * kilobyte. If that allocation fails, the value is not recorded.
+ *
+ * A histogram is not thread-safe. Threads can record into histograms of their
+ * own without any locking and combine them with latency_histogram_merge().
+ */
+struct latency_histogram_s;
+typedef struct latency_histogram_s latency_histogram_t;
+
+latency_histogram_t *latency_histogram_create(void);
+void latency_histogram_destroy(latency_histogram_t *h);
+
+void latency_histogram_add(latency_histogram_t *h, cdtime_t latency);
+/* Records "latency" "count" times. */
+void latency_histogram_add_n(latency_histogram_t *h, cdtime_t latency,
+                             uint64_t count);
+void latency_histogram_reset(latency_histogram_t *h);
+
+/*
+ * NAME
+ *   latency_histogram_merge
+ *
+ * DESCRIPTION
+ *   Adds all values recorded in "src" to "dst". "src" is not modified.
+ */
+void latency_histogram_merge(latency_histogram_t *dst,
+                             latency_histogram_t const *src);
+
+cdtime_t latency_histogram_get_min(latency_histogram_t const *h);
+cdtime_t latency_histogram_get_max(latency_histogram_t const *h);
+cdtime_t latency_histogram_get_sum(latency_histogram_t const *h);
+uint64_t latency_histogram_get_num(latency_histogram_t const *h);
+cdtime_t latency_histogram_get_average(latency_histogram_t const *h);
+
+/* Returns the latency below which "percent" percent of the values fall, or
+ * zero if "percent" is not within (0, 100) or there are no values. */
+cdtime_t latency_histogram_get_percentile(latency_histogram_t const *h,
+                                          double percent);
+
+/*
+ * NAME
+ *   latency_histogram_get_count
+ *
+ * DESCRIPTION
+ *   Returns the approximate number of values within (lower, upper]. When
+ *   "upper" is zero, the interval is (lower, infinity). Bins that are only
+ *   partly covered by the interval are counted proportionally.
+ */
+double latency_histogram_get_count(latency_histogram_t const *h,
+                                   cdtime_t lower, cdtime_t upper);
+
+/*
+ * NAME
+ *   latency_histogram_get_percentiles
+ *
+ * DESCRIPTION
+ *   Like latency_histogram_get_percentile(), but looks up "num" percentiles
+ *   in a single pass over the bins. "percent" does not need to be sorted. The
+ *   result for "percent[i]" is stored in "ret[i]".
+ */
+void latency_histogram_get_percentiles(latency_histogram_t const *h,
+                                       double const *percent, cdtime_t *ret,
+                                       size_t num);
+
+#endif /* UTILS_LATENCY_HISTOGRAM_H */
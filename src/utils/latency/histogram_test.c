@@ -0,0 +1,208 @@
+/**
+ * collectd - src/utils/latency/histogram_test.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#define DBL_PRECISION 1e-6
+
+#include "collectd.h"
+#include "utils/common/common.h" /* for STATIC_ARRAY_SIZE */
+
+#include "testing.h"
+#include "utils/latency/histogram.h"
+#include "utils_time.h"
+
+/* The histogram's relative error is about 3%. */
+#define EXPECT_PERCENTILE(expect, h, percent)                                  \
+  do {                                                                         \
+    double got =                                                               \
+        CDTIME_T_TO_DOUBLE(latency_histogram_get_percentile(h, percent));      \
+    printf("# percentile %g: expected %g, got %g\n", percent, expect, got);    \
+    OK(fabs(got - (expect)) <= 0.035 * (expect));                              \
+  } while (0)
+
+DEF_TEST(simple) {
+  latency_histogram_t *h;
+
+  CHECK_NOT_NULL(h = latency_histogram_create());
+  EXPECT_EQ_UINT64(0, latency_histogram_get_num(h));
+  EXPECT_EQ_UINT64(0, latency_histogram_get_average(h));
+  EXPECT_EQ_UINT64(0, latency_histogram_get_percentile(h, 50.0));
+
+  latency_histogram_add(h, DOUBLE_TO_CDTIME_T(0.5));
+  latency_histogram_add(h, DOUBLE_TO_CDTIME_T(0.3));
+  latency_histogram_add(h, DOUBLE_TO_CDTIME_T(2.5));
+  latency_histogram_add(h, 0);
+
+  EXPECT_EQ_UINT64(4, latency_histogram_get_num(h));
+  EXPECT_EQ_DOUBLE(0.0, CDTIME_T_TO_DOUBLE(latency_histogram_get_min(h)));
+  EXPECT_EQ_DOUBLE(2.5, CDTIME_T_TO_DOUBLE(latency_histogram_get_max(h)));
+  EXPECT_EQ_DOUBLE(3.3, CDTIME_T_TO_DOUBLE(latency_histogram_get_sum(h)));
+  EXPECT_EQ_DOUBLE(0.825,
+                   CDTIME_T_TO_DOUBLE(latency_histogram_get_average(h)));
+
+  /* Values above the histogram's range are counted in the last bin. */
+  latency_histogram_add(h, TIME_T_TO_CDTIME_T(1000000));
+  EXPECT_EQ_UINT64(5, latency_histogram_get_num(h));
+  EXPECT_EQ_DOUBLE(1000000.0,
+                   CDTIME_T_TO_DOUBLE(latency_histogram_get_max(h)));
+  OK(latency_histogram_get_percentile(h, 99.0) > TIME_T_TO_CDTIME_T(65536));
+
+  latency_histogram_reset(h);
+  EXPECT_EQ_UINT64(0, latency_histogram_get_num(h));
+  EXPECT_EQ_UINT64(0, latency_histogram_get_max(h));
+
+  latency_histogram_destroy(h);
+  return 0;
+}
+
+DEF_TEST(percentile) {
+  latency_histogram_t *h;
+
+  CHECK_NOT_NULL(h = latency_histogram_create());
+
+  /* 1 ms .. 100 ms and 1 s .. 100 s, to cover both small and large bins. */
+  for (size_t i = 0; i < 100; i++)
+    latency_histogram_add(h, MS_TO_CDTIME_T(i + 1));
+
+  EXPECT_PERCENTILE(50.0e-3, h, 50.0);
+  EXPECT_PERCENTILE(80.0e-3, h, 80.0);
+  EXPECT_PERCENTILE(95.0e-3, h, 95.0);
+  EXPECT_PERCENTILE(99.0e-3, h, 99.0);
+
+  latency_histogram_reset(h);
+  for (size_t i = 0; i < 100; i++)
+    latency_histogram_add(h, TIME_T_TO_CDTIME_T(((time_t)i) + 1));
+
+  EXPECT_EQ_DOUBLE(1.0, CDTIME_T_TO_DOUBLE(latency_histogram_get_min(h)));
+  EXPECT_EQ_DOUBLE(100.0, CDTIME_T_TO_DOUBLE(latency_histogram_get_max(h)));
+  EXPECT_EQ_DOUBLE(50.5, CDTIME_T_TO_DOUBLE(latency_histogram_get_average(h)));
+
+  EXPECT_PERCENTILE(50.0, h, 50.0);
+  EXPECT_PERCENTILE(80.0, h, 80.0);
+  EXPECT_PERCENTILE(95.0, h, 95.0);
+  EXPECT_PERCENTILE(99.0, h, 99.0);
+
+  /* Several percentiles at once, in any order. */
+  double percent[] = {99.0, 50.0, 101.0, 80.0};
+  cdtime_t got[STATIC_ARRAY_SIZE(percent)];
+  latency_histogram_get_percentiles(h, percent, got, STATIC_ARRAY_SIZE(got));
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(percent); i++)
+    EXPECT_EQ_UINT64(latency_histogram_get_percentile(h, percent[i]), got[i]);
+
+  CHECK_ZERO(latency_histogram_get_percentile(h, -1.0));
+  CHECK_ZERO(latency_histogram_get_percentile(h, 101.0));
+
+  latency_histogram_destroy(h);
+  return 0;
+}
+
+DEF_TEST(merge) {
+  latency_histogram_t *all;
+  latency_histogram_t *part[2];
+
+  CHECK_NOT_NULL(all = latency_histogram_create());
+  CHECK_NOT_NULL(part[0] = latency_histogram_create());
+  CHECK_NOT_NULL(part[1] = latency_histogram_create());
+
+  for (size_t i = 0; i < 1000; i++) {
+    cdtime_t latency = US_TO_CDTIME_T(1 + 37 * i);
+    latency_histogram_add(all, latency);
+    latency_histogram_add(part[i % 2], latency);
+  }
+
+  latency_histogram_t *merged;
+  CHECK_NOT_NULL(merged = latency_histogram_create());
+  latency_histogram_merge(merged, part[0]);
+  latency_histogram_merge(merged, part[1]);
+
+  EXPECT_EQ_UINT64(latency_histogram_get_num(all),
+                   latency_histogram_get_num(merged));
+  EXPECT_EQ_UINT64(latency_histogram_get_min(all),
+                   latency_histogram_get_min(merged));
+  EXPECT_EQ_UINT64(latency_histogram_get_max(all),
+                   latency_histogram_get_max(merged));
+  EXPECT_EQ_UINT64(latency_histogram_get_sum(all),
+                   latency_histogram_get_sum(merged));
+  for (double p = 1.0; p < 100.0; p += 7.0)
+    EXPECT_EQ_UINT64(latency_histogram_get_percentile(all, p),
+                     latency_histogram_get_percentile(merged, p));
+
+  latency_histogram_destroy(merged);
+  latency_histogram_destroy(part[1]);
+  latency_histogram_destroy(part[0]);
+  latency_histogram_destroy(all);
+  return 0;
+}
+
+DEF_TEST(count) {
+  latency_histogram_t *h;
+  latency_histogram_t *h_n;
+
+  CHECK_NOT_NULL(h = latency_histogram_create());
+  CHECK_NOT_NULL(h_n = latency_histogram_create());
+
+  /* 100 values of 1ms and 300 values of 10ms. */
+  for (size_t i = 0; i < 100; i++)
+    latency_histogram_add(h, MS_TO_CDTIME_T(1));
+  for (size_t i = 0; i < 300; i++)
+    latency_histogram_add(h, MS_TO_CDTIME_T(10));
+  latency_histogram_add_n(h_n, MS_TO_CDTIME_T(1), 100);
+  latency_histogram_add_n(h_n, MS_TO_CDTIME_T(10), 300);
+  latency_histogram_add_n(h_n, MS_TO_CDTIME_T(5), 0);
+
+  EXPECT_EQ_UINT64(latency_histogram_get_num(h),
+                   latency_histogram_get_num(h_n));
+  EXPECT_EQ_UINT64(latency_histogram_get_sum(h),
+                   latency_histogram_get_sum(h_n));
+  EXPECT_EQ_UINT64(latency_histogram_get_min(h),
+                   latency_histogram_get_min(h_n));
+  EXPECT_EQ_UINT64(latency_histogram_get_max(h),
+                   latency_histogram_get_max(h_n));
+  EXPECT_EQ_UINT64(latency_histogram_get_percentile(h, 50.0),
+                   latency_histogram_get_percentile(h_n, 50.0));
+
+  EXPECT_EQ_DOUBLE(400.0, latency_histogram_get_count(h_n, 0, 0));
+  EXPECT_EQ_DOUBLE(100.0,
+                   latency_histogram_get_count(h_n, 0, MS_TO_CDTIME_T(5)));
+  EXPECT_EQ_DOUBLE(300.0,
+                   latency_histogram_get_count(h_n, MS_TO_CDTIME_T(5), 0));
+  EXPECT_EQ_DOUBLE(0.0,
+                   latency_histogram_get_count(h_n, MS_TO_CDTIME_T(20), 0));
+  EXPECT_EQ_DOUBLE(0.0, latency_histogram_get_count(h_n, MS_TO_CDTIME_T(5),
+                                                    MS_TO_CDTIME_T(5)));
+
+  latency_histogram_destroy(h_n);
+  latency_histogram_destroy(h);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(simple);
+  RUN_TEST(percentile);
+  RUN_TEST(merge);
+  RUN_TEST(count);
+
+  END_TEST;
+}
@@ -51,6 +51,14 @@ kstat_ctl_t *kc;
   } while (0)
 #endif
 
+/* The results of matching a value list against all user classes are
+ * remembered per identifier, so that repeated values of the same series skip
+ * matching entirely. The memo is split into LU_CACHE_STRIPES independent
+ * stripes, each protected by its own lock. Once a stripe holds
+ * LU_CACHE_STRIPE_MAX entries, further identifiers are matched every time. */
+#define LU_CACHE_STRIPES 16
+#define LU_CACHE_STRIPE_MAX 16384
+
 /*
  * Types
  */
@@ -72,8 +80,15 @@ struct identifier_match_s {
 };
 typedef struct identifier_match_s identifier_match_t;
 
+struct lu_cache_stripe_s {
+  pthread_mutex_t lock;
+  c_avl_tree_t *tree; /* identifier -> lu_cache_entry_t */
+};
+typedef struct lu_cache_stripe_s lu_cache_stripe_t;
+
 struct lookup_s {
   c_avl_tree_t *by_type_tree;
+  lu_cache_stripe_t cache[LU_CACHE_STRIPES];
 
   lookup_class_callback_t cb_user_class;
   lookup_obj_callback_t cb_user_obj;
@@ -111,6 +126,29 @@ struct by_type_entry_s {
 };
 typedef struct by_type_entry_s by_type_entry_t;
 
+/* A user class matching a value list and the user object the value list
+ * belongs to. */
+struct lu_match_s {
+  user_class_t *user_class;
+  user_obj_t *user_obj;
+};
+typedef struct lu_match_s lu_match_t;
+
+struct lu_match_list_s {
+  lu_match_t *matches;
+  size_t matches_num;
+  size_t matches_size;
+  bool failed; /* a match could not be recorded */
+};
+typedef struct lu_match_list_s lu_match_list_t;
+
+struct lu_cache_entry_s {
+  char *key;
+  lu_match_t *matches;
+  size_t matches_num;
+};
+typedef struct lu_cache_entry_s lu_cache_entry_t;
+
 /*
  * Private functions
  */
@@ -269,11 +307,15 @@ static user_obj_t *lu_find_user_obj(user_class_t *user_class, /* {{{ */
   return NULL;
 } /* }}} user_obj_t *lu_find_user_obj */
 
+/* Checks whether "vl" matches "user_class" and looks up, or creates, the user
+ * object it belongs to. Returns zero and stores the user object in
+ * "ret_user_obj" on success, one if the value list does not match and a
+ * negative value on error. */
 static int lu_handle_user_class(lookup_t *obj, /* {{{ */
                                 data_set_t const *ds, value_list_t const *vl,
-                                user_class_t *user_class) {
+                                user_class_t *user_class,
+                                user_obj_t **ret_user_obj) {
   user_obj_t *user_obj;
-  int status;
 
   assert(strcmp(vl->type, user_class->match.type.str) == 0);
   assert(user_class->match.plugin.is_regex ||
@@ -299,7 +341,17 @@ static int lu_handle_user_class(lookup_t *obj, /* {{{ */
   }
   pthread_mutex_unlock(&user_class->lock);
 
-  status = obj->cb_user_obj(ds, vl, user_class->user_class, user_obj->user_obj);
+  *ret_user_obj = user_obj;
+  return 0;
+} /* }}} int lu_handle_user_class */
+
+/* Calls lookup_obj_callback_t() for one match. Returns zero on success, one if
+ * the callback failed and a negative value if the search has to be aborted. */
+static int lu_handle_match(lookup_t *obj, /* {{{ */
+                           data_set_t const *ds, value_list_t const *vl,
+                           lu_match_t const *match) {
+  int status = obj->cb_user_obj(ds, vl, match->user_class->user_class,
+                                match->user_obj->user_obj);
   if (status != 0) {
     ERROR("utils_vl_lookup: The user object callback failed with status %i.",
           status);
@@ -311,19 +363,50 @@ static int lu_handle_user_class(lookup_t *obj, /* {{{ */
   }
 
   return 0;
-} /* }}} int lu_handle_user_class */
+} /* }}} int lu_handle_match */
+
+static void lu_match_list_append(lu_match_list_t *list, /* {{{ */
+                                 lu_match_t const *match) {
+  if (list->failed)
+    return;
+
+  if (list->matches_num >= list->matches_size) {
+    size_t new_size = (list->matches_size == 0) ? 4 : 2 * list->matches_size;
+    lu_match_t *tmp = realloc(list->matches, new_size * sizeof(*tmp));
+    if (tmp == NULL) {
+      ERROR("utils_vl_lookup: realloc failed.");
+      list->failed = true;
+      return;
+    }
+    list->matches = tmp;
+    list->matches_size = new_size;
+  }
+
+  list->matches[list->matches_num] = *match;
+  list->matches_num++;
+} /* }}} void lu_match_list_append */
 
 static int lu_handle_user_class_list(lookup_t *obj, /* {{{ */
                                      data_set_t const *ds,
                                      value_list_t const *vl,
-                                     user_class_list_t *user_class_list) {
+                                     user_class_list_t *user_class_list,
+                                     lu_match_list_t *list) {
   user_class_list_t *ptr;
   int retval = 0;
 
   for (ptr = user_class_list; ptr != NULL; ptr = ptr->next) {
-    int status;
+    lu_match_t match = {.user_class = &ptr->entry};
 
-    status = lu_handle_user_class(obj, ds, vl, &ptr->entry);
+    int status = lu_handle_user_class(obj, ds, vl, &ptr->entry,
+                                      &match.user_obj);
+    if (status < 0)
+      return status;
+    else if (status > 0)
+      continue;
+
+    lu_match_list_append(list, &match);
+
+    status = lu_handle_match(obj, ds, vl, &match);
     if (status < 0)
       return status;
     else if (status == 0)
@@ -333,6 +416,107 @@ static int lu_handle_user_class_list(lookup_t *obj, /* {{{ */
   return retval;
 } /* }}} int lu_handle_user_class_list */
 
+/* Same format as format_name(), which isn't available to the tests. */
+static void lu_cache_key(char *buffer, size_t buffer_size, /* {{{ */
+                         value_list_t const *vl) {
+  if (vl->plugin_instance[0] == 0 && vl->type_instance[0] == 0)
+    snprintf(buffer, buffer_size, "%s/%s/%s", vl->host, vl->plugin, vl->type);
+  else if (vl->type_instance[0] == 0)
+    snprintf(buffer, buffer_size, "%s/%s-%s/%s", vl->host, vl->plugin,
+             vl->plugin_instance, vl->type);
+  else if (vl->plugin_instance[0] == 0)
+    snprintf(buffer, buffer_size, "%s/%s/%s-%s", vl->host, vl->plugin,
+             vl->type, vl->type_instance);
+  else
+    snprintf(buffer, buffer_size, "%s/%s-%s/%s-%s", vl->host, vl->plugin,
+             vl->plugin_instance, vl->type, vl->type_instance);
+} /* }}} void lu_cache_key */
+
+static lu_cache_stripe_t *lu_cache_stripe(lookup_t *obj, /* {{{ */
+                                          char const *key) {
+  uint32_t hash = 5381;
+  for (char const *c = key; *c != 0; c++)
+    hash = (hash * 33) + (uint32_t)(unsigned char)*c;
+
+  return &obj->cache[hash % LU_CACHE_STRIPES];
+} /* }}} lu_cache_stripe_t *lu_cache_stripe */
+
+static void lu_cache_entry_free(lu_cache_entry_t *entry) /* {{{ */
+{
+  if (entry == NULL)
+    return;
+
+  sfree(entry->key);
+  sfree(entry->matches);
+  sfree(entry);
+} /* }}} void lu_cache_entry_free */
+
+/* Returns the remembered matches of "key" or NULL if there are none. The
+ * returned entry stays valid until the cache is cleared, which only happens in
+ * lookup_add() and lookup_destroy(). */
+static lu_cache_entry_t *lu_cache_get(lu_cache_stripe_t *stripe, /* {{{ */
+                                      char const *key) {
+  lu_cache_entry_t *entry = NULL;
+
+  pthread_mutex_lock(&stripe->lock);
+  if (c_avl_get(stripe->tree, key, (void *)&entry) != 0)
+    entry = NULL;
+  pthread_mutex_unlock(&stripe->lock);
+
+  return entry;
+} /* }}} lu_cache_entry_t *lu_cache_get */
+
+/* Remembers the matches in "list". Takes ownership of the list's memory. */
+static void lu_cache_put(lu_cache_stripe_t *stripe, /* {{{ */
+                         char const *key, lu_match_list_t *list) {
+  if (list->failed) {
+    sfree(list->matches);
+    return;
+  }
+
+  lu_cache_entry_t *entry = calloc(1, sizeof(*entry));
+  if (entry == NULL) {
+    sfree(list->matches);
+    return;
+  }
+  entry->key = strdup(key);
+  entry->matches = list->matches;
+  entry->matches_num = list->matches_num;
+  list->matches = NULL;
+  if (entry->key == NULL) {
+    lu_cache_entry_free(entry);
+    return;
+  }
+
+  pthread_mutex_lock(&stripe->lock);
+  int status = -1;
+  if (c_avl_size(stripe->tree) < LU_CACHE_STRIPE_MAX)
+    status = c_avl_insert(stripe->tree, entry->key, entry);
+  pthread_mutex_unlock(&stripe->lock);
+
+  /* Either the stripe is full or another thread has inserted the same
+   * identifier in the meantime. */
+  if (status != 0)
+    lu_cache_entry_free(entry);
+} /* }}} void lu_cache_put */
+
+static void lu_cache_clear(lookup_t *obj) /* {{{ */
+{
+  for (size_t i = 0; i < LU_CACHE_STRIPES; i++) {
+    lu_cache_stripe_t *stripe = obj->cache + i;
+    char *key = NULL;
+    lu_cache_entry_t *entry = NULL;
+
+    if (stripe->tree == NULL)
+      continue;
+
+    pthread_mutex_lock(&stripe->lock);
+    while (c_avl_pick(stripe->tree, (void *)&key, (void *)&entry) == 0)
+      lu_cache_entry_free(entry);
+    pthread_mutex_unlock(&stripe->lock);
+  }
+} /* }}} void lu_cache_clear */
+
 static by_type_entry_t *lu_search_by_type(lookup_t *obj, /* {{{ */
                                           char const *type,
                                           bool allocate_if_missing) {
@@ -536,6 +720,17 @@ lookup_t *lookup_create(lookup_class_callback_t cb_user_class, /* {{{ */
     return NULL;
   }
 
+  for (size_t i = 0; i < LU_CACHE_STRIPES; i++) {
+    pthread_mutex_init(&obj->cache[i].lock, /* attr = */ NULL);
+    obj->cache[i].tree =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (obj->cache[i].tree == NULL) {
+      ERROR("utils_vl_lookup: c_avl_create failed.");
+      lookup_destroy(obj);
+      return NULL;
+    }
+  }
+
   obj->cb_user_class = cb_user_class;
   obj->cb_user_obj = cb_user_obj;
   obj->cb_free_class = cb_free_class;
@@ -551,6 +746,13 @@ void lookup_destroy(lookup_t *obj) /* {{{ */
   if (obj == NULL)
     return;
 
+  lu_cache_clear(obj);
+  for (size_t i = 0; i < LU_CACHE_STRIPES; i++) {
+    c_avl_destroy(obj->cache[i].tree);
+    obj->cache[i].tree = NULL;
+    pthread_mutex_destroy(&obj->cache[i].lock);
+  }
+
   while (42) {
     char *type = NULL;
     by_type_entry_t *by_type = NULL;
@@ -580,6 +782,9 @@ int lookup_add(lookup_t *obj, /* {{{ */
   if (by_type == NULL)
     return -1;
 
+  /* The new class may match identifiers that have been looked up before. */
+  lu_cache_clear(obj);
+
   user_class_obj = calloc(1, sizeof(*user_class_obj));
   if (user_class_obj == NULL) {
     ERROR("utils_vl_lookup: calloc failed.");
@@ -609,22 +814,45 @@ int lookup_search(lookup_t *obj, /* {{{ */
   if (by_type == NULL)
     return 0;
 
+  char key[6 * DATA_MAX_NAME_LEN];
+  lu_cache_key(key, sizeof(key), vl);
+  lu_cache_stripe_t *stripe = lu_cache_stripe(obj, key);
+
+  lu_cache_entry_t *entry = lu_cache_get(stripe, key);
+  if (entry != NULL) {
+    for (size_t i = 0; i < entry->matches_num; i++) {
+      status = lu_handle_match(obj, ds, vl, entry->matches + i);
+      if (status < 0)
+        return status;
+      else if (status == 0)
+        retval++;
+    }
+    return retval;
+  }
+
+  lu_match_list_t list = {0};
+
   status =
       c_avl_get(by_type->by_plugin_tree, vl->plugin, (void *)&user_class_list);
   if (status == 0) {
-    status = lu_handle_user_class_list(obj, ds, vl, user_class_list);
-    if (status < 0)
+    status = lu_handle_user_class_list(obj, ds, vl, user_class_list, &list);
+    if (status < 0) {
+      sfree(list.matches);
       return status;
+    }
     retval += status;
   }
 
   if (by_type->wildcard_plugin_list != NULL) {
-    status =
-        lu_handle_user_class_list(obj, ds, vl, by_type->wildcard_plugin_list);
-    if (status < 0)
+    status = lu_handle_user_class_list(obj, ds, vl,
+                                       by_type->wildcard_plugin_list, &list);
+    if (status < 0) {
+      sfree(list.matches);
       return status;
+    }
     retval += status;
   }
 
+  lu_cache_put(stripe, key, &list);
   return retval;
 } /* }}} lookup_search */
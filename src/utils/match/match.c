@@ -41,6 +41,12 @@ struct cu_match_s {
   regex_t excluderegex;
   int flags;
 
+  /* Strings every line matching "regex" or "excluderegex" must contain, or
+   * NULL if none could be determined. Checking them with strstr(3) is much
+   * cheaper than running regexec(3) on lines that can't match. */
+  char *literal;
+  char *excludeliteral;
+
   int (*callback)(const char *str, char *const *matches, size_t matches_num,
                   void *user_data);
   void *user_data;
@@ -72,6 +78,153 @@ static char *match_substr(const char *str, int begin, int end) {
   return ret;
 } /* char *match_substr */
 
+/* Returns the index of the character following the parenthesized group or
+ * bracket expression starting at "re[i]", or -1 if it isn't terminated. */
+static int match_skip_group(const char *re, int i) {
+  int depth = 0;
+
+  while (re[i] != 0) {
+    if (re[i] == '\\') {
+      if (re[i + 1] == 0)
+        return -1;
+      i += 2;
+      continue;
+    }
+
+    if (re[i] == '[') {
+      i++;
+      if (re[i] == '^')
+        i++;
+      if (re[i] == ']')
+        i++;
+      while ((re[i] != 0) && (re[i] != ']')) {
+        /* Character classes, e.g. "[:digit:]", may contain a ']'. */
+        if ((re[i] == '[') &&
+            ((re[i + 1] == ':') || (re[i + 1] == '.') || (re[i + 1] == '='))) {
+          char delim = re[i + 1];
+          i += 2;
+          while ((re[i] != 0) && !((re[i] == delim) && (re[i + 1] == ']')))
+            i++;
+          if (re[i] == 0)
+            return -1;
+          i++;
+        }
+        i++;
+      }
+      if (re[i] == 0)
+        return -1;
+      i++;
+    } else if (re[i] == '(') {
+      depth++;
+      i++;
+    } else if (re[i] == ')') {
+      depth--;
+      i++;
+    } else {
+      i++;
+    }
+
+    if (depth <= 0)
+      return i;
+  }
+
+  return -1;
+} /* int match_skip_group */
+
+/* Returns the longest string that is contained in every string matched by the
+ * extended regular expression "re", or NULL if there is none. The result is
+ * conservative: alternations at the top level and anything unusual make it
+ * return NULL. */
+static char *match_required_literal(const char *re) {
+  size_t re_len = strlen(re);
+  char run[re_len + 1];
+  size_t run_len = 0;
+  char best[re_len + 1];
+  size_t best_len = 0;
+
+  int i = 0;
+  while (re[i] != 0) {
+    bool is_literal = false;
+    char c = re[i];
+    int next;
+
+    switch (c) {
+    case '\\':
+      if ((re[i + 1] != 0) && (strchr(".[]()*+?{}|^$\\/", re[i + 1]) != NULL)) {
+        c = re[i + 1];
+        is_literal = true;
+      }
+      /* Other escapes, e.g. "\w" or back references, aren't literals. */
+      next = (re[i + 1] != 0) ? i + 2 : i + 1;
+      break;
+    case '[':
+    case '(':
+      next = match_skip_group(re, i);
+      if (next < 0)
+        return NULL;
+      break;
+    case '|':
+    case ')':
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+      return NULL;
+    case '.':
+    case '^':
+    case '$':
+      next = i + 1;
+      break;
+    default:
+      is_literal = true;
+      next = i + 1;
+    }
+
+    /* A quantifier makes the atom optional, except for "+". */
+    bool optional = false;
+    bool repeated = false;
+    while ((re[next] == '*') || (re[next] == '+') || (re[next] == '?') ||
+           (re[next] == '{')) {
+      if (re[next] == '{') {
+        const char *end = strchr(re + next, '}');
+        if (end == NULL)
+          return NULL;
+        optional = true;
+        next = (int)(end - re) + 1;
+      } else {
+        if (re[next] != '+')
+          optional = true;
+        repeated = true;
+        next++;
+      }
+    }
+
+    if (is_literal && !optional)
+      run[run_len++] = c;
+
+    if (!is_literal || optional || repeated) {
+      if (run_len > best_len) {
+        memcpy(best, run, run_len);
+        best_len = run_len;
+      }
+      run_len = 0;
+    }
+
+    i = next;
+  }
+
+  if (run_len > best_len) {
+    memcpy(best, run, run_len);
+    best_len = run_len;
+  }
+
+  if (best_len == 0)
+    return NULL;
+
+  best[best_len] = 0;
+  return strdup(best);
+} /* char *match_required_literal */
+
 static int default_callback(const char __attribute__((unused)) * str,
                             char *const *matches, size_t matches_num,
                             void *user_data) {
@@ -236,16 +389,20 @@ match_create_callback(const char *regex, const char *excluderegex,
     return NULL;
   }
   obj->flags |= UTILS_MATCH_FLAGS_REGEX;
+  obj->literal = match_required_literal(regex);
 
   if (excluderegex && strcmp(excluderegex, "") != 0) {
     status = regcomp(&obj->excluderegex, excluderegex, REG_EXTENDED);
     if (status != 0) {
       ERROR("Compiling the excluding regular expression \"%s\" failed.",
             excluderegex);
+      regfree(&obj->regex);
+      sfree(obj->literal);
       sfree(obj);
       return NULL;
     }
     obj->flags |= UTILS_MATCH_FLAGS_EXCLUDE_REGEX;
+    obj->excludeliteral = match_required_literal(excluderegex);
   }
 
   obj->callback = callback;
@@ -307,6 +464,8 @@ void match_destroy(cu_match_t *obj) {
     regfree(&obj->regex);
   if (obj->flags & UTILS_MATCH_FLAGS_EXCLUDE_REGEX)
     regfree(&obj->excluderegex);
+  sfree(obj->literal);
+  sfree(obj->excludeliteral);
   if ((obj->user_data != NULL) && (obj->free != NULL))
     (*obj->free)(obj->user_data);
 
@@ -322,10 +481,15 @@ int match_apply(cu_match_t *obj, const char *str) {
   if ((obj == NULL) || (str == NULL))
     return -1;
 
-  if (obj->flags & UTILS_MATCH_FLAGS_EXCLUDE_REGEX) {
-    status =
-        regexec(&obj->excluderegex, str, STATIC_ARRAY_SIZE(re_match), re_match,
-                /* eflags = */ 0);
+  /* Most lines don't match most regular expressions. */
+  if ((obj->literal != NULL) && (strstr(str, obj->literal) == NULL))
+    return 0;
+
+  if ((obj->flags & UTILS_MATCH_FLAGS_EXCLUDE_REGEX) &&
+      ((obj->excludeliteral == NULL) ||
+       (strstr(str, obj->excludeliteral) != NULL))) {
+    status = regexec(&obj->excluderegex, str, /* nmatch = */ 0,
+                     /* pmatch = */ NULL, /* eflags = */ 0);
     /* Regex did match, so exclude this line */
     if (status == 0) {
       DEBUG("ExludeRegex matched, don't count that line\n");
@@ -333,15 +497,20 @@ int match_apply(cu_match_t *obj, const char *str) {
     }
   }
 
-  status = regexec(&obj->regex, str, STATIC_ARRAY_SIZE(re_match), re_match,
+  /* Only ask for as many sub-matches as the expression has: regexec(3) is
+   * considerably faster when it doesn't have to track unused ones. */
+  size_t re_match_num = obj->regex.re_nsub + 1;
+  if (re_match_num > STATIC_ARRAY_SIZE(re_match))
+    re_match_num = STATIC_ARRAY_SIZE(re_match);
+
+  status = regexec(&obj->regex, str, re_match_num, re_match,
                    /* eflags = */ 0);
 
   /* Regex did not match */
   if (status != 0)
     return 0;
 
-  for (matches_num = 0; matches_num < STATIC_ARRAY_SIZE(matches);
-       matches_num++) {
+  for (matches_num = 0; matches_num < re_match_num; matches_num++) {
     if ((re_match[matches_num].rm_so < 0) || (re_match[matches_num].rm_eo < 0))
       break;
 
@@ -0,0 +1,103 @@
+/**
+ * collectd - src/utils/match/match_test.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ */
+
+#include "collectd.h"
+#include "utils/common/common.h" /* for STATIC_ARRAY_SIZE */
+
+#include "testing.h"
+#include "utils/match/match.h"
+
+typedef struct {
+  int num;
+  char last[64];
+} match_result_t;
+
+static int count_callback(const char __attribute__((unused)) * str,
+                          char *const *matches, size_t matches_num,
+                          void *user_data) {
+  match_result_t *r = user_data;
+
+  r->num++;
+  sstrncpy(r->last, matches[matches_num - 1], sizeof(r->last));
+  return 0;
+}
+
+DEF_TEST(apply) {
+  struct {
+    const char *regex;
+    const char *excluderegex;
+    const char *line;
+    bool want_match;
+    const char *want_last;
+  } cases[] = {
+      {"GET", NULL, "\"GET /index.html\"", true, "GET"},
+      {"GET", NULL, "\"POST /index.html\"", false, NULL},
+      {"status=([0-9]+)", NULL, "status=200 ok", true, "200"},
+      {"status=([0-9]+)", NULL, "state=200 ok", false, NULL},
+      /* Optional and repeated atoms aren't part of the required string. */
+      {"colou?r", NULL, "color", true, "color"},
+      {"ab*c", NULL, "ac", true, "ac"},
+      {"ab+c", NULL, "abbbc", true, "abbbc"},
+      {"ab{0,2}c", NULL, "ac", true, "ac"},
+      {"x(yz)?w", NULL, "xw", true, "xw"},
+      {"x(yz)?w", NULL, "xyzw", true, "yz"},
+      /* Alternations can't be filtered. */
+      {"foo|bar", NULL, "bar", true, "bar"},
+      {"(foo|bar)baz", NULL, "barbaz", true, "bar"},
+      {"[[:digit:]]+ms", NULL, "took 42ms", true, "42ms"},
+      {"[]a]b", NULL, "]b", true, "]b"},
+      {"\\.log$", NULL, "app.log", true, ".log"},
+      {"\\.log$", NULL, "applog", false, NULL},
+      {"^a.c$", NULL, "abc", true, "abc"},
+      {"GET", "health", "GET /health", false, NULL},
+      {"GET", "health", "GET /index", true, "GET"},
+      {"GET", "x|/in", "GET /index", false, NULL},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    match_result_t r = {0};
+    cu_match_t *m = match_create_callback(
+        cases[i].regex, cases[i].excluderegex, count_callback, &r, NULL);
+    CHECK_NOT_NULL(m);
+
+    printf("## Case %" PRIsz ": /%s/ ~ \"%s\"\n", i, cases[i].regex,
+           cases[i].line);
+    EXPECT_EQ_INT(0, match_apply(m, cases[i].line));
+    EXPECT_EQ_INT(cases[i].want_match ? 1 : 0, r.num);
+    if (cases[i].want_match)
+      EXPECT_EQ_STR(cases[i].want_last, r.last);
+
+    match_destroy(m);
+  }
+
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(apply);
+
+  END_TEST;
+}
@@ -32,6 +32,12 @@
 
 #define MD_MAX_NONSTRING_CHARS 128
 
+/* Initial number of entries allocated for a meta data object. */
+#define MD_ENTRIES_INITIAL 4
+
+/* Initial number of buckets of the key table, see md_intern(). */
+#define MD_KEYS_INITIAL 64
+
 /*
  * Data types
  */
@@ -45,17 +51,43 @@ union meta_value_u {
 typedef union meta_value_u meta_value_t;
 
 struct meta_entry_s {
-  char *key;
+  const char *key; /* interned, see md_intern() */
   meta_value_t value;
   int type;
-  meta_entry_t *next;
 };
 
+/* The entries of a meta data object are stored in a flat array, which may be
+ * shared by several meta data objects: meta_data_clone() only increments the
+ * reference count. The array is copied when one of the objects sharing it is
+ * modified ("copy on write"), so a shared array is never changed. The last
+ * entry is followed by one with a NULL key. */
+typedef struct {
+  pthread_mutex_t lock; /* protects "refcount" */
+  size_t refcount;
+  size_t num;  /* number of entries */
+  size_t size; /* number of entries allocated, not counting the terminator */
+  meta_entry_t entry[];
+} meta_entries_t;
+
 struct meta_data_s {
-  meta_entry_t *head;
+  meta_entries_t *entries; /* NULL if there are no entries */
   pthread_mutex_t lock;
 };
 
+/* Keys are interned: each distinct key is stored only once and never freed,
+ * so that entries can be copied without copying their keys. The number of
+ * distinct keys is small in practice, since they are chosen by plugins and
+ * the configuration. */
+typedef struct md_key_s {
+  struct md_key_s *next;
+  char key[];
+} md_key_t;
+
+static md_key_t **md_keys;
+static size_t md_keys_size; /* always a power of two */
+static size_t md_keys_num;
+static pthread_mutex_t md_keys_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * Private functions
  */
@@ -77,198 +109,266 @@ static char *md_strdup(const char *orig) /* {{{ */
   return dest;
 } /* }}} char *md_strdup */
 
-static meta_entry_t *md_entry_alloc(const char *key) /* {{{ */
+static uint32_t md_key_hash(const char *key) /* {{{ */
 {
-  meta_entry_t *e;
+  /* FNV-1a */
+  uint32_t hash = 2166136261u;
+  for (; *key != 0; key++) {
+    hash ^= (uint32_t)(unsigned char)*key;
+    hash *= 16777619u;
+  }
+  return hash;
+} /* }}} uint32_t md_key_hash */
 
-  e = calloc(1, sizeof(*e));
-  if (e == NULL) {
-    ERROR("md_entry_alloc: calloc failed.");
-    return NULL;
+/* Doubles the number of buckets of the key table. md_keys_lock must be held.
+ */
+static int md_keys_grow(void) /* {{{ */
+{
+  size_t size = (md_keys_size == 0) ? MD_KEYS_INITIAL : 2 * md_keys_size;
+
+  md_key_t **keys = calloc(size, sizeof(*keys));
+  if (keys == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < md_keys_size; i++) {
+    md_key_t *k = md_keys[i];
+    while (k != NULL) {
+      md_key_t *next = k->next;
+      size_t idx = md_key_hash(k->key) & (size - 1);
+
+      k->next = keys[idx];
+      keys[idx] = k;
+      k = next;
+    }
   }
 
-  e->key = md_strdup(key);
-  if (e->key == NULL) {
-    free(e);
-    ERROR("md_entry_alloc: md_strdup failed.");
-    return NULL;
+  sfree(md_keys);
+  md_keys = keys;
+  md_keys_size = size;
+  return 0;
+} /* }}} int md_keys_grow */
+
+/* Returns the one copy of "key" that is used by all entries. */
+static const char *md_intern(const char *key) /* {{{ */
+{
+  uint32_t hash = md_key_hash(key);
+
+  pthread_mutex_lock(&md_keys_lock);
+
+  if (md_keys_size > 0) {
+    for (md_key_t *k = md_keys[hash & (md_keys_size - 1)]; k != NULL;
+         k = k->next) {
+      if (strcmp(k->key, key) == 0) {
+        pthread_mutex_unlock(&md_keys_lock);
+        return k->key;
+      }
+    }
   }
 
-  e->type = 0;
-  e->next = NULL;
+  if ((md_keys_size == 0) || (md_keys_num >= md_keys_size)) {
+    /* Keep going with the current table, unless there is none. */
+    if ((md_keys_grow() != 0) && (md_keys_size == 0)) {
+      pthread_mutex_unlock(&md_keys_lock);
+      ERROR("md_intern: md_keys_grow failed.");
+      return NULL;
+    }
+  }
 
-  return e;
-} /* }}} meta_entry_t *md_entry_alloc */
+  size_t key_len = strlen(key);
+  md_key_t *k = malloc(sizeof(*k) + key_len + 1);
+  if (k == NULL) {
+    pthread_mutex_unlock(&md_keys_lock);
+    ERROR("md_intern: malloc failed.");
+    return NULL;
+  }
+  memcpy(k->key, key, key_len + 1);
 
-/* XXX: The lock on md must be held while calling this function! */
-static meta_entry_t *md_entry_clone_contents(const meta_entry_t *orig) /* {{{ */
-{
-  meta_entry_t *copy;
+  md_key_t **bucket = md_keys + (hash & (md_keys_size - 1));
+  k->next = *bucket;
+  *bucket = k;
+  md_keys_num++;
 
-  /* WARNINGS :
-   *  - we do not check that orig != NULL here. You should have done it before.
-   *  - we do not set copy->next. DO NOT FORGET TO SET copy->next IN YOUR
-   * FUNCTION
-   */
+  pthread_mutex_unlock(&md_keys_lock);
+  return k->key;
+} /* }}} const char *md_intern */
 
-  copy = md_entry_alloc(orig->key);
-  if (copy == NULL)
+static meta_entries_t *md_entries_alloc(size_t size) /* {{{ */
+{
+  meta_entries_t *entries =
+      malloc(sizeof(*entries) + (size + 1) * sizeof(entries->entry[0]));
+  if (entries == NULL) {
+    ERROR("md_entries_alloc: malloc failed.");
     return NULL;
-  copy->type = orig->type;
-  if (copy->type == MD_TYPE_STRING)
-    copy->value.mv_string = strdup(orig->value.mv_string);
-  else
-    copy->value = orig->value;
+  }
 
-  return copy;
-} /* }}} meta_entry_t *md_entry_clone_contents */
+  pthread_mutex_init(&entries->lock, /* attr = */ NULL);
+  entries->refcount = 1;
+  entries->num = 0;
+  entries->size = size;
+  entries->entry[0].key = NULL;
+
+  return entries;
+} /* }}} meta_entries_t *md_entries_alloc */
 
-static meta_entry_t *md_entry_clone(const meta_entry_t *orig) /* {{{ */
+static void md_entry_free_value(meta_entry_t *e) /* {{{ */
 {
-  meta_entry_t *copy;
+  if (e->type == MD_TYPE_STRING)
+    sfree(e->value.mv_string);
+} /* }}} void md_entry_free_value */
 
-  if (orig == NULL)
+static meta_entries_t *md_entries_ref(meta_entries_t *entries) /* {{{ */
+{
+  if (entries == NULL)
     return NULL;
 
-  copy = md_entry_clone_contents(orig);
+  pthread_mutex_lock(&entries->lock);
+  entries->refcount++;
+  pthread_mutex_unlock(&entries->lock);
 
-  copy->next = md_entry_clone(orig->next);
-  return copy;
-} /* }}} meta_entry_t *md_entry_clone */
+  return entries;
+} /* }}} meta_entries_t *md_entries_ref */
 
-static void md_entry_free(meta_entry_t *e) /* {{{ */
+static void md_entries_unref(meta_entries_t *entries) /* {{{ */
 {
-  if (e == NULL)
+  if (entries == NULL)
     return;
 
-  free(e->key);
+  pthread_mutex_lock(&entries->lock);
+  size_t refcount = --entries->refcount;
+  pthread_mutex_unlock(&entries->lock);
 
-  if (e->type == MD_TYPE_STRING)
-    free(e->value.mv_string);
+  if (refcount > 0)
+    return;
 
-  if (e->next != NULL)
-    md_entry_free(e->next);
+  for (size_t i = 0; i < entries->num; i++)
+    md_entry_free_value(entries->entry + i);
 
-  free(e);
-} /* }}} void md_entry_free */
+  pthread_mutex_destroy(&entries->lock);
+  free(entries);
+} /* }}} void md_entries_unref */
 
-static int md_entry_insert(meta_data_t *md, meta_entry_t *e) /* {{{ */
+/* Makes sure md->entries is not shared with another meta data object and has
+ * room for at least "extra" more entries. md->lock must be held. */
+static int md_entries_writable(meta_data_t *md, size_t extra) /* {{{ */
 {
-  meta_entry_t *this;
-  meta_entry_t *prev;
+  meta_entries_t *old = md->entries;
 
-  if ((md == NULL) || (e == NULL))
-    return -EINVAL;
-
-  pthread_mutex_lock(&md->lock);
-
-  prev = NULL;
-  this = md->head;
-  while (this != NULL) {
-    if (strcasecmp(e->key, this->key) == 0)
-      break;
-
-    prev = this;
-    this = this->next;
+  if (old == NULL) {
+    md->entries = md_entries_alloc(
+        (extra > MD_ENTRIES_INITIAL) ? extra : MD_ENTRIES_INITIAL);
+    return (md->entries == NULL) ? -ENOMEM : 0;
   }
 
-  if (this == NULL) {
-    /* This key does not exist yet. */
-    if (md->head == NULL)
-      md->head = e;
-    else {
-      assert(prev != NULL);
-      prev->next = e;
-    }
+  /* Nobody else can take a new reference while md->lock is held and we hold
+   * the only one. */
+  pthread_mutex_lock(&old->lock);
+  bool shared = (old->refcount > 1);
+  pthread_mutex_unlock(&old->lock);
 
-    e->next = NULL;
-  } else /* (this != NULL) */
-  {
-    if (prev == NULL)
-      md->head = e;
-    else
-      prev->next = e;
+  if (!shared && ((old->num + extra) <= old->size))
+    return 0;
 
-    e->next = this->next;
-  }
+  size_t size = old->size;
+  while ((old->num + extra) > size)
+    size *= 2;
 
-  pthread_mutex_unlock(&md->lock);
+  meta_entries_t *new = md_entries_alloc(size);
+  if (new == NULL)
+    return -ENOMEM;
 
-  if (this != NULL) {
-    this->next = NULL;
-    md_entry_free(this);
+  for (size_t i = 0; i < old->num; i++) {
+    meta_entry_t *e = new->entry + i;
+
+    *e = old->entry[i];
+    if (shared && (e->type == MD_TYPE_STRING)) {
+      e->value.mv_string = md_strdup(e->value.mv_string);
+      if (e->value.mv_string == NULL) {
+        ERROR("md_entries_writable: md_strdup failed.");
+        new->num = i;
+        md_entries_unref(new);
+        return -ENOMEM;
+      }
+    }
+  }
+  new->num = old->num;
+  new->entry[new->num].key = NULL;
+
+  if (shared) {
+    md_entries_unref(old);
+  } else {
+    /* The string values have been moved over to "new". */
+    pthread_mutex_destroy(&old->lock);
+    free(old);
   }
 
+  md->entries = new;
   return 0;
-} /* }}} int md_entry_insert */
+} /* }}} int md_entries_writable */
 
 /* XXX: The lock on md must be held while calling this function! */
-static int md_entry_insert_clone(meta_data_t *md, meta_entry_t *orig) /* {{{ */
-{
-  meta_entry_t *e;
-  meta_entry_t *this;
-  meta_entry_t *prev;
-
-  /* WARNINGS :
-   *  - we do not check that md and e != NULL here. You should have done it
-   * before.
-   *  - we do not use the lock. You should have set it before.
-   */
-
-  e = md_entry_clone_contents(orig);
-
-  prev = NULL;
-  this = md->head;
-  while (this != NULL) {
-    if (strcasecmp(e->key, this->key) == 0)
-      break;
-
-    prev = this;
-    this = this->next;
-  }
-
-  if (this == NULL) {
-    /* This key does not exist yet. */
-    if (md->head == NULL)
-      md->head = e;
-    else {
-      assert(prev != NULL);
-      prev->next = e;
-    }
+static meta_entry_t *md_entry_lookup(meta_data_t *md, /* {{{ */
+                                     const char *key) {
+  if ((md == NULL) || (key == NULL) || (md->entries == NULL))
+    return NULL;
 
-    e->next = NULL;
-  } else /* (this != NULL) */
-  {
-    if (prev == NULL)
-      md->head = e;
-    else
-      prev->next = e;
+  for (size_t i = 0; i < md->entries->num; i++) {
+    meta_entry_t *e = md->entries->entry + i;
+    if ((e->key == key) || (strcasecmp(key, e->key) == 0))
+      return e;
+  }
+
+  return NULL;
+} /* }}} meta_entry_t *md_entry_lookup */
 
-    e->next = this->next;
+/* Sets "key" to "value", replacing an existing entry with the same key. The
+ * meta data object takes ownership of string values, even on failure.
+ * XXX: The lock on md must be held while calling this function! */
+static int md_entry_set(meta_data_t *md, const char *key, /* {{{ */
+                        int type, meta_value_t value) {
+  int status = md_entries_writable(md, 1);
+  if (status != 0) {
+    if (type == MD_TYPE_STRING)
+      free(value.mv_string);
+    return status;
   }
 
-  if (this != NULL) {
-    this->next = NULL;
-    md_entry_free(this);
+  meta_entry_t *e = md_entry_lookup(md, key);
+  if (e == NULL) {
+    const char *interned = md_intern(key);
+    if (interned == NULL) {
+      if (type == MD_TYPE_STRING)
+        free(value.mv_string);
+      return -ENOMEM;
+    }
+
+    e = md->entries->entry + md->entries->num;
+    md->entries->num++;
+    md->entries->entry[md->entries->num].key = NULL;
+
+    e->key = interned;
+  } else {
+    md_entry_free_value(e);
   }
 
+  e->type = type;
+  e->value = value;
   return 0;
-} /* }}} int md_entry_insert_clone */
+} /* }}} int md_entry_set */
 
-/* XXX: The lock on md must be held while calling this function! */
-static meta_entry_t *md_entry_lookup(meta_data_t *md, /* {{{ */
-                                     const char *key) {
-  meta_entry_t *e;
-
-  if ((md == NULL) || (key == NULL))
-    return NULL;
+static int md_add(meta_data_t *md, const char *key, /* {{{ */
+                  int type, meta_value_t value) {
+  if ((md == NULL) || (key == NULL)) {
+    if (type == MD_TYPE_STRING)
+      free(value.mv_string);
+    return -EINVAL;
+  }
 
-  for (e = md->head; e != NULL; e = e->next)
-    if (strcasecmp(key, e->key) == 0)
-      break;
+  pthread_mutex_lock(&md->lock);
+  int status = md_entry_set(md, key, type, value);
+  pthread_mutex_unlock(&md->lock);
 
-  return e;
-} /* }}} meta_entry_t *md_entry_lookup */
+  return status;
+} /* }}} int md_add */
 
 /*
  * Each value_list_t*, as it is going through the system, is handled by exactly
@@ -310,8 +410,9 @@ meta_data_t *meta_data_clone(meta_data_t *orig) /* {{{ */
   if (copy == NULL)
     return NULL;
 
+  /* The entries are shared until one of the two is modified. */
   pthread_mutex_lock(&orig->lock);
-  copy->head = md_entry_clone(orig->head);
+  copy->entries = md_entries_ref(orig->entries);
   pthread_mutex_unlock(&orig->lock);
 
   return copy;
@@ -328,11 +429,31 @@ int meta_data_clone_merge(meta_data_t **dest, meta_data_t *orig) /* {{{ */
   }
 
   pthread_mutex_lock(&orig->lock);
-  for (meta_entry_t *e = orig->head; e != NULL; e = e->next) {
-    md_entry_insert_clone((*dest), e);
-  }
+  meta_entries_t *entries = md_entries_ref(orig->entries);
   pthread_mutex_unlock(&orig->lock);
 
+  if (entries == NULL)
+    return 0;
+
+  pthread_mutex_lock(&(*dest)->lock);
+  if ((*dest)->entries == NULL) {
+    (*dest)->entries = entries;
+    entries = NULL;
+  }
+  for (size_t i = 0; (entries != NULL) && (i < entries->num); i++) {
+    meta_entry_t *e = entries->entry + i;
+    meta_value_t value = e->value;
+
+    if (e->type == MD_TYPE_STRING) {
+      value.mv_string = md_strdup(e->value.mv_string);
+      if (value.mv_string == NULL)
+        continue;
+    }
+    md_entry_set(*dest, e->key, e->type, value);
+  }
+  pthread_mutex_unlock(&(*dest)->lock);
+
+  md_entries_unref(entries);
   return 0;
 } /* }}} int meta_data_clone_merge */
 
@@ -341,7 +462,7 @@ void meta_data_destroy(meta_data_t *md) /* {{{ */
   if (md == NULL)
     return;
 
-  md_entry_free(md->head);
+  md_entries_unref(md->entries);
   pthread_mutex_destroy(&md->lock);
   free(md);
 } /* }}} void meta_data_destroy */
@@ -352,16 +473,10 @@ int meta_data_exists(meta_data_t *md, const char *key) /* {{{ */
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
-
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next) {
-    if (strcasecmp(key, e->key) == 0) {
-      pthread_mutex_unlock(&md->lock);
-      return 1;
-    }
-  }
-
+  int exists = (md_entry_lookup(md, key) != NULL);
   pthread_mutex_unlock(&md->lock);
-  return 0;
+
+  return exists;
 } /* }}} int meta_data_exists */
 
 int meta_data_type(meta_data_t *md, const char *key) /* {{{ */
@@ -370,29 +485,24 @@ int meta_data_type(meta_data_t *md, const char *key) /* {{{ */
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
-
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next) {
-    if (strcasecmp(key, e->key) == 0) {
-      pthread_mutex_unlock(&md->lock);
-      return e->type;
-    }
-  }
-
+  meta_entry_t *e = md_entry_lookup(md, key);
+  int type = (e != NULL) ? e->type : 0;
   pthread_mutex_unlock(&md->lock);
-  return 0;
+
+  return type;
 } /* }}} int meta_data_type */
 
 int meta_data_toc(meta_data_t *md, char ***toc) /* {{{ */
 {
-  int i = 0, count = 0;
+  int count = 0;
 
   if ((md == NULL) || (toc == NULL))
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
 
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next)
-    ++count;
+  if (md->entries != NULL)
+    count = (int)md->entries->num;
 
   if (count == 0) {
     pthread_mutex_unlock(&md->lock);
@@ -400,8 +510,8 @@ int meta_data_toc(meta_data_t *md, char ***toc) /* {{{ */
   }
 
   *toc = calloc(count, sizeof(**toc));
-  for (meta_entry_t *e = md->head; e != NULL; e = e->next)
-    (*toc)[i++] = strdup(e->key);
+  for (int i = 0; i < count; i++)
+    (*toc)[i] = strdup(md->entries->entry[i].key);
 
   pthread_mutex_unlock(&md->lock);
   return count;
@@ -409,39 +519,32 @@ int meta_data_toc(meta_data_t *md, char ***toc) /* {{{ */
 
 int meta_data_delete(meta_data_t *md, const char *key) /* {{{ */
 {
-  meta_entry_t *this;
-  meta_entry_t *prev;
-
   if ((md == NULL) || (key == NULL))
     return -EINVAL;
 
   pthread_mutex_lock(&md->lock);
 
-  prev = NULL;
-  this = md->head;
-  while (this != NULL) {
-    if (strcasecmp(key, this->key) == 0)
-      break;
-
-    prev = this;
-    this = this->next;
-  }
-
-  if (this == NULL) {
+  if (md_entry_lookup(md, key) == NULL) {
     pthread_mutex_unlock(&md->lock);
     return -ENOENT;
   }
 
-  if (prev == NULL)
-    md->head = this->next;
-  else
-    prev->next = this->next;
+  int status = md_entries_writable(md, 0);
+  if (status != 0) {
+    pthread_mutex_unlock(&md->lock);
+    return status;
+  }
 
-  pthread_mutex_unlock(&md->lock);
+  /* The entries may have been copied, so look the key up again. */
+  meta_entries_t *entries = md->entries;
+  meta_entry_t *e = md_entry_lookup(md, key);
+  size_t idx = (size_t)(e - entries->entry);
 
-  this->next = NULL;
-  md_entry_free(this);
+  md_entry_free_value(e);
+  memmove(e, e + 1, (entries->num - idx) * sizeof(*e));
+  entries->num--;
 
+  pthread_mutex_unlock(&md->lock);
   return 0;
 } /* }}} int meta_data_delete */
 
@@ -450,92 +553,38 @@ int meta_data_delete(meta_data_t *md, const char *key) /* {{{ */
  */
 int meta_data_add_string(meta_data_t *md, /* {{{ */
                          const char *key, const char *value) {
-  meta_entry_t *e;
-
   if ((md == NULL) || (key == NULL) || (value == NULL))
     return -EINVAL;
 
-  e = md_entry_alloc(key);
-  if (e == NULL)
-    return -ENOMEM;
-
-  e->value.mv_string = md_strdup(value);
-  if (e->value.mv_string == NULL) {
+  meta_value_t v = {.mv_string = md_strdup(value)};
+  if (v.mv_string == NULL) {
     ERROR("meta_data_add_string: md_strdup failed.");
-    md_entry_free(e);
     return -ENOMEM;
   }
-  e->type = MD_TYPE_STRING;
 
-  return md_entry_insert(md, e);
+  return md_add(md, key, MD_TYPE_STRING, v);
 } /* }}} int meta_data_add_string */
 
 int meta_data_add_signed_int(meta_data_t *md, /* {{{ */
                              const char *key, int64_t value) {
-  meta_entry_t *e;
-
-  if ((md == NULL) || (key == NULL))
-    return -EINVAL;
-
-  e = md_entry_alloc(key);
-  if (e == NULL)
-    return -ENOMEM;
-
-  e->value.mv_signed_int = value;
-  e->type = MD_TYPE_SIGNED_INT;
-
-  return md_entry_insert(md, e);
+  return md_add(md, key, MD_TYPE_SIGNED_INT,
+                (meta_value_t){.mv_signed_int = value});
 } /* }}} int meta_data_add_signed_int */
 
 int meta_data_add_unsigned_int(meta_data_t *md, /* {{{ */
                                const char *key, uint64_t value) {
-  meta_entry_t *e;
-
-  if ((md == NULL) || (key == NULL))
-    return -EINVAL;
-
-  e = md_entry_alloc(key);
-  if (e == NULL)
-    return -ENOMEM;
-
-  e->value.mv_unsigned_int = value;
-  e->type = MD_TYPE_UNSIGNED_INT;
-
-  return md_entry_insert(md, e);
+  return md_add(md, key, MD_TYPE_UNSIGNED_INT,
+                (meta_value_t){.mv_unsigned_int = value});
 } /* }}} int meta_data_add_unsigned_int */
 
 int meta_data_add_double(meta_data_t *md, /* {{{ */
                          const char *key, double value) {
-  meta_entry_t *e;
-
-  if ((md == NULL) || (key == NULL))
-    return -EINVAL;
-
-  e = md_entry_alloc(key);
-  if (e == NULL)
-    return -ENOMEM;
-
-  e->value.mv_double = value;
-  e->type = MD_TYPE_DOUBLE;
-
-  return md_entry_insert(md, e);
+  return md_add(md, key, MD_TYPE_DOUBLE, (meta_value_t){.mv_double = value});
 } /* }}} int meta_data_add_double */
 
 int meta_data_add_boolean(meta_data_t *md, /* {{{ */
                           const char *key, bool value) {
-  meta_entry_t *e;
-
-  if ((md == NULL) || (key == NULL))
-    return -EINVAL;
-
-  e = md_entry_alloc(key);
-  if (e == NULL)
-    return -ENOMEM;
-
-  e->value.mv_boolean = value;
-  e->type = MD_TYPE_BOOLEAN;
-
-  return md_entry_insert(md, e);
+  return md_add(md, key, MD_TYPE_BOOLEAN, (meta_value_t){.mv_boolean = value});
 } /* }}} int meta_data_add_boolean */
 
 /*
@@ -749,9 +798,16 @@ int meta_data_as_string(meta_data_t *md, /* {{{ */
   return 0;
 } /* }}} int meta_data_as_string */
 
-meta_entry_t *meta_data_iter(meta_data_t *md) { return md->head; }
+meta_entry_t *meta_data_iter(meta_data_t *md) {
+  if ((md == NULL) || (md->entries == NULL) || (md->entries->num == 0))
+    return NULL;
+  return md->entries->entry;
+}
 
-meta_entry_t *meta_data_iter_next(meta_entry_t *iter) { return iter->next; }
+/* The entry following the last one has a NULL key. */
+meta_entry_t *meta_data_iter_next(meta_entry_t *iter) {
+  return (iter[1].key != NULL) ? iter + 1 : NULL;
+}
 
 int meta_data_iter_type(meta_entry_t *iter) { return iter->type; }
 
@@ -771,3 +827,28 @@ int meta_data_iter_get_string(meta_data_t *md, meta_entry_t *iter,
   pthread_mutex_unlock(&md->lock);
   return res;
 }
+
+#define MD_ITER_GET(func, md_type, member, value_type)                         \
+  int func(meta_data_t *md, meta_entry_t *iter, value_type *value) {           \
+    if ((md == NULL) || (iter == NULL) || (value == NULL))                     \
+      return -EINVAL;                                                          \
+                                                                               \
+    pthread_mutex_lock(&md->lock);                                             \
+    if (iter->type != (md_type)) {                                             \
+      ERROR(#func ": Type mismatch for key `%s'", iter->key);                  \
+      pthread_mutex_unlock(&md->lock);                                         \
+      return -ENOENT;                                                          \
+    }                                                                          \
+    *value = iter->value.member;                                               \
+    pthread_mutex_unlock(&md->lock);                                           \
+    return 0;                                                                  \
+  }
+
+MD_ITER_GET(meta_data_iter_get_signed_int, MD_TYPE_SIGNED_INT, mv_signed_int,
+            int64_t)
+MD_ITER_GET(meta_data_iter_get_unsigned_int, MD_TYPE_UNSIGNED_INT,
+            mv_unsigned_int, uint64_t)
+MD_ITER_GET(meta_data_iter_get_double, MD_TYPE_DOUBLE, mv_double, double)
+MD_ITER_GET(meta_data_iter_get_boolean, MD_TYPE_BOOLEAN, mv_boolean, bool)
+
+#undef MD_ITER_GET
@@ -77,5 +77,13 @@ int meta_data_iter_type(meta_entry_t *iter);
 const char *meta_data_iter_key(meta_entry_t *iter);
 int meta_data_iter_get_string(meta_data_t *md, meta_entry_t *iter,
                               char **value);
+int meta_data_iter_get_signed_int(meta_data_t *md, meta_entry_t *iter,
+                                  int64_t *value);
+int meta_data_iter_get_unsigned_int(meta_data_t *md, meta_entry_t *iter,
+                                    uint64_t *value);
+int meta_data_iter_get_double(meta_data_t *md, meta_entry_t *iter,
+                              double *value);
+int meta_data_iter_get_boolean(meta_data_t *md, meta_entry_t *iter,
+                               bool *value);
 
 #endif /* META_DATA_H */
@@ -0,0 +1,108 @@
+/**
+ * collectd - src/utils/metadata/meta_data_bench.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+#include "utils/common/common.h" /* STATIC_ARRAY_SIZE */
+
+#include "benchmark.h"
+#include "utils/metadata/meta_data.h"
+
+/* Creates meta data with "num" entries of mixed types, similar to what the
+ * network and write plugins attach to value lists. */
+static meta_data_t *create_meta(size_t num) {
+  meta_data_t *md = meta_data_create();
+  if (md == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < num; i++) {
+    char key[32];
+    snprintf(key, sizeof(key), "key%zu", i);
+
+    switch (i % 4) {
+    case 0:
+      meta_data_add_string(md, key, "some string value");
+      break;
+    case 1:
+      meta_data_add_signed_int(md, key, -(int64_t)i);
+      break;
+    case 2:
+      meta_data_add_unsigned_int(md, key, (uint64_t)i);
+      break;
+    default:
+      meta_data_add_boolean(md, key, true);
+    }
+  }
+
+  return md;
+}
+
+DEF_BENCH(meta_data_clone) {
+  meta_data_t *md = create_meta(b->size);
+  if (md == NULL)
+    return -1;
+
+  BENCH_RESET_TIMER(b);
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    meta_data_t *copy = meta_data_clone(md);
+    meta_data_destroy(copy);
+  }
+  BENCH_STOP_TIMER(b);
+
+  meta_data_destroy(md);
+  return 0;
+}
+
+DEF_BENCH(meta_data_get_string) {
+  meta_data_t *md = create_meta(b->size);
+  if (md == NULL)
+    return -1;
+
+  char key[32];
+  snprintf(key, sizeof(key), "key%zu", (b->size - 1) & ~(size_t)3);
+
+  int status = 0;
+  BENCH_RESET_TIMER(b);
+  for (uint64_t i = 0; i < b->iterations; i++) {
+    char *value = NULL;
+    status |= meta_data_get_string(md, key, &value);
+    free(value);
+  }
+  BENCH_STOP_TIMER(b);
+
+  meta_data_destroy(md);
+  return status;
+}
+
+int main(void) {
+  size_t sizes[] = {1, 4, 16};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sizes); i++) {
+    RUN_BENCH(meta_data_clone, sizes[i]);
+    RUN_BENCH(meta_data_get_string, sizes[i]);
+  }
+
+  END_BENCH;
+}
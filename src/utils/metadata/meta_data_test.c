@@ -110,8 +110,65 @@ DEF_TEST(base) {
   return 0;
 }
 
+DEF_TEST(clone) {
+  meta_data_t *m;
+  meta_data_t *c;
+  char *s;
+  int64_t si;
+
+  CHECK_NOT_NULL(m = meta_data_create());
+  CHECK_ZERO(meta_data_add_string(m, "string", "foobar"));
+  CHECK_ZERO(meta_data_add_signed_int(m, "signed_int", 42));
+
+  /* clones see the same entries */
+  CHECK_NOT_NULL(c = meta_data_clone(m));
+  CHECK_ZERO(meta_data_get_string(c, "string", &s));
+  EXPECT_EQ_STR("foobar", s);
+  sfree(s);
+
+  /* modifying the clone doesn't change the original and vice versa */
+  CHECK_ZERO(meta_data_add_string(c, "string", "barqux"));
+  CHECK_ZERO(meta_data_delete(c, "signed_int"));
+  CHECK_ZERO(meta_data_add_signed_int(m, "new", 23));
+
+  CHECK_ZERO(meta_data_get_string(m, "string", &s));
+  EXPECT_EQ_STR("foobar", s);
+  sfree(s);
+  CHECK_ZERO(meta_data_get_signed_int(m, "signed_int", &si));
+  EXPECT_EQ_INT(42, (int)si);
+
+  CHECK_ZERO(meta_data_get_string(c, "string", &s));
+  EXPECT_EQ_STR("barqux", s);
+  sfree(s);
+  OK(!meta_data_exists(c, "signed_int"));
+  OK(!meta_data_exists(c, "new"));
+
+  /* the original outlives its clone */
+  meta_data_destroy(c);
+  CHECK_ZERO(meta_data_get_string(m, "string", &s));
+  EXPECT_EQ_STR("foobar", s);
+  sfree(s);
+
+  /* iterating visits all entries */
+  int count = 0;
+  for (meta_entry_t *e = meta_data_iter(m); e != NULL;
+       e = meta_data_iter_next(e)) {
+    if (meta_data_iter_type(e) == MD_TYPE_SIGNED_INT) {
+      CHECK_ZERO(meta_data_iter_get_signed_int(m, e, &si));
+      OK((si == 42) || (si == 23));
+      EXPECT_EQ_INT(-ENOENT, meta_data_iter_get_double(m, e, &(double){0}));
+    }
+    count++;
+  }
+  EXPECT_EQ_INT(3, count);
+
+  meta_data_destroy(m);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(base);
+  RUN_TEST(clone);
 
   END_TEST;
 }
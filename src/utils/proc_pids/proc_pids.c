@@ -151,20 +151,23 @@ static int read_proc_name(const char *procfs_path,
 
   const char *comm_file_name = "comm";
 
-  char *path = ssnprintf_alloc("%s/%s/%s", procfs_path, pid_entry->d_name,
-                               comm_file_name);
-  if (path == NULL)
+  /* This is called for every process on the system, so avoid allocating
+   * memory and stdio buffers here. */
+  char path[PATH_MAX];
+  int status = snprintf(path, sizeof(path), "%s/%s/%s", procfs_path,
+                        pid_entry->d_name, comm_file_name);
+  if ((status < 0) || ((size_t)status >= sizeof(path)))
     return -1;
-  FILE *f = fopen(path, "r");
-  if (f == NULL) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
     ERROR(UTIL_NAME ": Failed to open comm file, error: %d\n", errno);
-    sfree(path);
     return -1;
   }
-  size_t read_length = fread(name, sizeof(char), out_size, f);
-  name[out_size - 1] = '\0';
-  fclose(f);
-  sfree(path);
+  ssize_t read_length = read(fd, name, out_size - 1);
+  close(fd);
+  if (read_length < 0)
+    return -1;
+  name[read_length] = '\0';
   /* strip new line ending */
   char *newline = strchr(name, '\n');
   if (newline) {
@@ -245,6 +248,17 @@ proc_pids_init_error:
   return -1;
 }
 
+static int pid_compare(const void *a, const void *b) {
+  pid_t pid_a = *(const pid_t *)a;
+  pid_t pid_b = *(const pid_t *)b;
+
+  if (pid_a < pid_b)
+    return -1;
+  if (pid_a > pid_b)
+    return 1;
+  return 0;
+}
+
 static void swap_proc_pids(proc_pids_t **proc_pids, size_t proc_pids_num) {
   for (size_t i = 0; i < proc_pids_num; i++) {
     pids_list_t *swap = proc_pids[i]->prev;
@@ -306,6 +320,12 @@ int proc_pids_update(const char *procfs_path, proc_pids_t **proc_pids,
     ERROR(UTIL_NAME ": failed to close /proc directory, error: %d", errno);
     goto update_error;
   }
+
+  /* Sorted lists let pids_list_diff() compare snapshots in linear time. */
+  for (size_t i = 0; i < proc_pids_num; i++)
+    qsort(proc_pids[i]->curr->pids, proc_pids[i]->curr->size, sizeof(pid_t),
+          pid_compare);
+
   return 0;
 
 update_error:
@@ -319,30 +339,36 @@ int pids_list_diff(proc_pids_t *proc, pids_list_t *added,
   assert(added);
   assert(removed);
 
-  added->size = 0;
-  removed->size = 0;
-
-  if (NULL == proc->prev || 0 == proc->prev->size) {
-    /* append all PIDs from curr to added*/
-    return pids_list_add_list(added, proc->curr);
-  } else if (NULL == proc->curr || 0 == proc->curr->size) {
+  if (NULL == proc->curr || 0 == proc->curr->size) {
+    if (NULL == proc->prev)
+      return 0;
     /* append all PIDs from prev to removed*/
     return pids_list_add_list(removed, proc->prev);
+  } else if (NULL == proc->prev || 0 == proc->prev->size) {
+    /* append all PIDs from curr to added*/
+    return pids_list_add_list(added, proc->curr);
   }
 
-  for (int i = 0; i < proc->prev->size; i++)
-    if (0 == pids_list_contains_pid(proc->curr, proc->prev->pids[i])) {
-      int add_result = pids_list_add_pid(removed, proc->prev->pids[i]);
-      if (add_result < 0)
-        return add_result;
-    }
-
-  for (int i = 0; i < proc->curr->size; i++)
-    if (0 == pids_list_contains_pid(proc->prev, proc->curr->pids[i])) {
-      int add_result = pids_list_add_pid(added, proc->curr->pids[i]);
-      if (add_result < 0)
-        return add_result;
+  /* Both lists are sorted: walk them side by side. */
+  size_t i = 0;
+  size_t j = 0;
+  while (i < proc->prev->size || j < proc->curr->size) {
+    int add_result = 0;
+    if (j == proc->curr->size ||
+        (i < proc->prev->size && proc->prev->pids[i] < proc->curr->pids[j])) {
+      add_result = pids_list_add_pid(removed, proc->prev->pids[i]);
+      i++;
+    } else if (i == proc->prev->size ||
+               proc->curr->pids[j] < proc->prev->pids[i]) {
+      add_result = pids_list_add_pid(added, proc->curr->pids[j]);
+      j++;
+    } else {
+      i++;
+      j++;
     }
+    if (add_result < 0)
+      return add_result;
+  }
 
   return 0;
 }
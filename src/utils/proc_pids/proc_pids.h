@@ -143,7 +143,10 @@ int pids_list_contains_pid(pids_list_t *list, const pid_t pid);
  *   pids_list_diff
  *
  * DESCRIPTION
- *   Searches for differences in two given lists
+ *   Searches for differences between the previous and the current PIDs list.
+ *   Both lists must be sorted, as they are after proc_pids_update().
+ *   Differences are appended to `added' and `removed', so the same lists can
+ *   be used to collect the changes of several proc_pids.
  *
  * PARAMETERS
  *   `proc'            List of pids
@@ -200,6 +203,7 @@ int proc_pids_init(const char **procs_names_array,
  * DESCRIPTION
  *   Updates PIDs matching processes's names.
  *   Searches all PID directories in /proc fs and updates current pids_list.
+ *   The previous list is kept for pids_list_diff(). Lists are sorted by PID.
  *
  * PARAMETERS
  *   `procfs_path'     Path to systems proc directory (e.g. /proc)
@@ -489,6 +489,45 @@ DEF_TEST(pids_list_diff__one_removed) {
   return 0;
 }
 
+DEF_TEST(pids_list_diff__appends_changes) {
+  /* setup */
+  pid_t pids_array_before[] = {1000, 1002, 1004, 1006};
+  pid_t pids_array_after[] = {1001, 1002, 1006, 1007};
+  proc_pids_t proc_pids;
+  pids_list_t curr;
+  pids_list_t prev;
+
+  prev.pids = pids_array_before;
+  prev.size = STATIC_ARRAY_SIZE(pids_array_before);
+  prev.allocated = prev.size;
+  curr.pids = pids_array_after;
+  curr.size = STATIC_ARRAY_SIZE(pids_array_after);
+  curr.allocated = curr.size;
+  proc_pids.curr = &curr;
+  proc_pids.prev = &prev;
+
+  pids_list_t *new_pids = calloc(1, sizeof(*new_pids));
+  pids_list_t *lost_pids = calloc(1, sizeof(*lost_pids));
+  pids_list_add_pid(new_pids, 42);
+
+  /* check */
+  int result = pids_list_diff(&proc_pids, new_pids, lost_pids);
+  EXPECT_EQ_INT(0, result);
+  EXPECT_EQ_INT(3, new_pids->size);
+  EXPECT_EQ_INT(42, new_pids->pids[0]);
+  EXPECT_EQ_INT(1001, new_pids->pids[1]);
+  EXPECT_EQ_INT(1007, new_pids->pids[2]);
+  EXPECT_EQ_INT(2, lost_pids->size);
+  EXPECT_EQ_INT(1000, lost_pids->pids[0]);
+  EXPECT_EQ_INT(1004, lost_pids->pids[1]);
+
+  /* cleanup */
+  pids_list_free(lost_pids);
+  pids_list_free(new_pids);
+
+  return 0;
+}
+
 int main(void) {
   stub_procfs_teardown();
   RUN_TEST(proc_pids_init__on_nullptr);
@@ -506,6 +545,7 @@ int main(void) {
   RUN_TEST(pids_list_diff__nothing_changed);
   RUN_TEST(pids_list_diff__one_added);
   RUN_TEST(pids_list_diff__one_removed);
+  RUN_TEST(pids_list_diff__appends_changes);
   stub_procfs_teardown();
   END_TEST;
 }
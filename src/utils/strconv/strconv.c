@@ -0,0 +1,207 @@
+/**
+ * collectd - src/utils/strconv/strconv.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "utils/strconv/strconv.h"
+
+/* Integers up to 2^53 and powers of ten up to 10^22 are exactly representable
+ * as doubles. Multiplying or dividing one by the other is then correctly
+ * rounded, i.e. the result is exactly what strtod(3) returns. */
+#define MANTISSA_EXACT_MAX (UINT64_C(1) << 53)
+#define EXPONENT_EXACT_MAX 22
+
+/* More digits may overflow the 64 bit accumulators. */
+#define DIGITS_MAX 19
+
+static double const exact_powers_of_ten[EXPONENT_EXACT_MAX + 1] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static bool is_digit(char c) { return (c >= '0') && (c <= '9'); }
+
+/* Isolates the decimal digits after an optional sign. Returns false if the
+ * number can't safely be converted inline. */
+static bool parse_integer(char const **ptr, bool *ret_negative, /* {{{ */
+                          uint64_t *ret_value) {
+  char const *s = *ptr;
+
+  while (isspace((int)*s))
+    s++;
+
+  bool negative = false;
+  if ((*s == '+') || (*s == '-')) {
+    negative = (*s == '-');
+    s++;
+  }
+
+  /* Leading zeros select an octal or hexadecimal base. */
+  if ((s[0] == '0') && (is_digit(s[1]) || (s[1] == 'x') || (s[1] == 'X')))
+    return false;
+
+  char const *digits = s;
+  uint64_t value = 0;
+  while (is_digit(*s)) {
+    if ((s - digits) >= DIGITS_MAX)
+      return false;
+    value = 10 * value + (uint64_t)(*s - '0');
+    s++;
+  }
+  if (s == digits)
+    return false;
+
+  *ptr = s;
+  *ret_negative = negative;
+  *ret_value = value;
+  return true;
+} /* }}} bool parse_integer */
+
+double strtod_fast(char const *nptr, char **endptr) /* {{{ */
+{
+  char const *s = nptr;
+
+  while (isspace((int)*s))
+    s++;
+
+  bool negative = false;
+  if ((*s == '+') || (*s == '-')) {
+    negative = (*s == '-');
+    s++;
+  }
+
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  int digits_num = 0;
+  bool have_digits = false;
+
+  /* Leading zeros don't count towards the significant digits. */
+  while (*s == '0') {
+    have_digits = true;
+    s++;
+  }
+  /* "0x" starts a hexadecimal number. */
+  if (have_digits && ((*s == 'x') || (*s == 'X')))
+    return strtod(nptr, endptr);
+
+  while (is_digit(*s)) {
+    if (digits_num >= DIGITS_MAX)
+      return strtod(nptr, endptr);
+    mantissa = 10 * mantissa + (uint64_t)(*s - '0');
+    digits_num++;
+    have_digits = true;
+    s++;
+  }
+
+  if (*s == '.') {
+    s++;
+    while (is_digit(*s)) {
+      if ((mantissa == 0) && (*s == '0')) {
+        exponent--;
+      } else {
+        if (digits_num >= DIGITS_MAX)
+          return strtod(nptr, endptr);
+        mantissa = 10 * mantissa + (uint64_t)(*s - '0');
+        digits_num++;
+        exponent--;
+      }
+      have_digits = true;
+      s++;
+    }
+  }
+
+  /* Handles "inf", "nan" and malformed input. */
+  if (!have_digits)
+    return strtod(nptr, endptr);
+
+  /* The exponent is only part of the number if it has at least one digit. */
+  if ((*s == 'e') || (*s == 'E')) {
+    char const *e = s + 1;
+    bool exponent_negative = false;
+
+    if ((*e == '+') || (*e == '-')) {
+      exponent_negative = (*e == '-');
+      e++;
+    }
+
+    if (is_digit(*e)) {
+      int value = 0;
+      while (is_digit(*e)) {
+        if (value > 1000)
+          return strtod(nptr, endptr);
+        value = 10 * value + (*e - '0');
+        e++;
+      }
+      exponent += exponent_negative ? -value : value;
+      s = e;
+    }
+  }
+
+  if ((mantissa > MANTISSA_EXACT_MAX) || (exponent > EXPONENT_EXACT_MAX) ||
+      (exponent < -EXPONENT_EXACT_MAX)) {
+    if (mantissa != 0)
+      return strtod(nptr, endptr);
+    exponent = 0;
+  }
+
+  double value = (double)mantissa;
+  if (exponent < 0)
+    value /= exact_powers_of_ten[-exponent];
+  else
+    value *= exact_powers_of_ten[exponent];
+
+  if (endptr != NULL)
+    *endptr = (char *)s;
+  return negative ? -value : value;
+} /* }}} double strtod_fast */
+
+unsigned long long strtoull_fast(char const *nptr, char **endptr) /* {{{ */
+{
+  char const *s = nptr;
+  bool negative;
+  uint64_t value;
+
+  /* strtoull(3) negates negative numbers, leave that to the C library. */
+  if (!parse_integer(&s, &negative, &value) || negative)
+    return strtoull(nptr, endptr, 0);
+
+  if (endptr != NULL)
+    *endptr = (char *)s;
+  return (unsigned long long)value;
+} /* }}} unsigned long long strtoull_fast */
+
+long long strtoll_fast(char const *nptr, char **endptr) /* {{{ */
+{
+  char const *s = nptr;
+  bool negative;
+  uint64_t value;
+
+  if (!parse_integer(&s, &negative, &value) || (value > INT64_MAX))
+    return strtoll(nptr, endptr, 0);
+
+  if (endptr != NULL)
+    *endptr = (char *)s;
+  return negative ? -(long long)value : (long long)value;
+} /* }}} long long strtoll_fast */
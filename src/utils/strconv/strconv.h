@@ -0,0 +1,60 @@
+/**
+ * collectd - src/utils/strconv/strconv.h
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#ifndef UTILS_STRCONV_H
+#define UTILS_STRCONV_H 1
+
+#include "collectd.h"
+
+/*
+ * NAME
+ *   strtod_fast
+ *
+ * DESCRIPTION
+ *   Drop-in replacement for strtod(3) for the ingestion paths. Plain decimal
+ *   numbers with at most 19 significant digits whose value can be computed
+ *   exactly, e.g. "42", "-0.125" or "1.5e3", are converted without calling
+ *   into the C library. Everything else, such as hexadecimal numbers, "inf",
+ *   "nan" or numbers that would need rounding, is handed to strtod(3), so the
+ *   result is always identical to what strtod(3) returns. errno is only set
+ *   by strtod(3).
+ */
+double strtod_fast(char const *nptr, char **endptr);
+
+/*
+ * NAME
+ *   strtoull_fast, strtoll_fast
+ *
+ * DESCRIPTION
+ *   Drop-in replacements for strtoull(3) and strtoll(3) with a base of zero.
+ *   Decimal numbers that can't overflow are converted inline, everything else
+ *   (octal and hexadecimal numbers, overflows, negative numbers passed to
+ *   strtoull_fast) is handed to the C library.
+ */
+unsigned long long strtoull_fast(char const *nptr, char **endptr);
+long long strtoll_fast(char const *nptr, char **endptr);
+
+#endif /* UTILS_STRCONV_H */
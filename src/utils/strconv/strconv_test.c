@@ -0,0 +1,134 @@
+/**
+ * collectd - src/utils/strconv/strconv_test.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils/common/common.h"
+#include "utils/strconv/strconv.h"
+
+static int check_strtod(char const *str) {
+  char *want_end = NULL;
+  char *got_end = NULL;
+
+  errno = 0;
+  double want = strtod(str, &want_end);
+  int want_errno = errno;
+
+  errno = 0;
+  double got = strtod_fast(str, &got_end);
+
+  if ((memcmp(&want, &got, sizeof(want)) != 0) && !(isnan(want) && isnan(got)))
+    return -1;
+  if ((want_end != got_end) || (want_errno != errno))
+    return -1;
+  return 0;
+}
+
+DEF_TEST(strtod_fast) {
+  char const *cases[] = {
+      "0",        "-0",      "+0",       "42",     "-42",
+      "  17",     "3.25",    "-0.125",   ".5",     "5.",
+      "1e3",      "1.5E-3",  "2e",       "2e+",    "1e22",
+      "1e23",     "1e-22",   "1e-23",    "0.1",    "0.3",
+      "123456789012345678", "1234567890123456789", "12345678901234567890",
+      "9007199254740992",   "9007199254740993",    "0.000000000000000000000001",
+      "0e500",    "1e500",   "1e-500",   "0x1p3",  "0X10",
+      "inf",      "-Infinity", "nan",    "",       "-",
+      ".",        "U",       "12abc",    "1.5:2",  "00.5",
+      "1.000000000000000000000000001",
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    printf("# strtod_fast(\"%s\")\n", cases[i]);
+    EXPECT_EQ_INT(0, check_strtod(cases[i]));
+  }
+
+  /* Random decimal numbers. */
+  uint64_t seed = 42;
+  for (int i = 0; i < 100000; i++) {
+    char buffer[64];
+
+    seed = seed * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+    uint64_t mantissa = (seed >> 11) % UINT64_C(100000000000);
+    int decimals = (int)((seed >> 3) % 12);
+    int exponent = (int)((seed >> 7) % 60) - 30;
+
+    snprintf(buffer, sizeof(buffer), "%s%" PRIu64 ".%0*" PRIu64 "e%d",
+             (seed & 1) ? "-" : "", mantissa / 1000, decimals,
+             mantissa % 1000, exponent);
+    if (check_strtod(buffer) != 0) {
+      printf("# strtod_fast(\"%s\")\n", buffer);
+      EXPECT_EQ_INT(0, check_strtod(buffer));
+    }
+  }
+
+  return 0;
+}
+
+DEF_TEST(strtoll_fast) {
+  char const *cases[] = {
+      "0",   "-0",   "42",    "-42",  "  17",  "+5",
+      "010", "0x1f", "08",    "12ab", "",      "-",
+      "9223372036854775807",  "-9223372036854775808",
+      "9223372036854775808",  "18446744073709551615",
+      "18446744073709551616", "1.5",
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char *want_end = NULL;
+    char *got_end = NULL;
+
+    printf("# strtoll_fast(\"%s\")\n", cases[i]);
+
+    errno = 0;
+    long long want_ll = strtoll(cases[i], &want_end, 0);
+    int want_errno = errno;
+    errno = 0;
+    long long got_ll = strtoll_fast(cases[i], &got_end);
+    EXPECT_EQ_INT(want_errno, errno);
+    OK(want_ll == got_ll);
+    OK(want_end == got_end);
+
+    errno = 0;
+    unsigned long long want_ull = strtoull(cases[i], &want_end, 0);
+    want_errno = errno;
+    errno = 0;
+    unsigned long long got_ull = strtoull_fast(cases[i], &got_end);
+    EXPECT_EQ_INT(want_errno, errno);
+    OK(want_ull == got_ull);
+    OK(want_end == got_end);
+  }
+
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(strtod_fast);
+  RUN_TEST(strtoll_fast);
+
+  END_TEST;
+}
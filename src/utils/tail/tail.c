@@ -35,12 +35,201 @@
 #include "utils/common/common.h"
 #include "utils/tail/tail.h"
 
+#include <sys/mman.h>
+
+#if HAVE_SYS_INOTIFY_H
+#include <libgen.h>
+#include <sys/inotify.h>
+#endif
+
+/* Size of the blocks read by cu_tail_read(). Longer lines are split. */
+#define CU_TAIL_BUFFER_SIZE 65536
+/* cu_tail_read_lines() maps appended regions of at least this size into
+ * memory rather than copying them. For less data, read(2) is cheaper than
+ * setting up and tearing down a mapping. */
+#define CU_TAIL_MMAP_MIN (4 * CU_TAIL_BUFFER_SIZE)
+
 struct cu_tail_s {
   char *file;
   FILE *fh;
   struct stat stat;
+
+  /* Data read by cu_tail_read() that doesn't end in a newline yet. */
+  char *buffer;
+  size_t buffer_fill;
+
+#if HAVE_SYS_INOTIFY_H
+  /* Watches for the open file and its directory, -1 if not watched. */
+  int wd_file;
+  int wd_dir;
+  char *dir;
+  char *base;
+  /* Set by inotify events, cleared when the end of the file is reached. */
+  bool changed;
+  cu_tail_t *next;
+#endif
 };
 
+#if HAVE_SYS_INOTIFY_H
+/* All tail objects share one inotify instance: the number of instances per
+ * user is limited to 128 by default. */
+static pthread_mutex_t cu_tail_lock = PTHREAD_MUTEX_INITIALIZER;
+static int cu_tail_inotify_fd = -1;
+static bool cu_tail_inotify_failed;
+static cu_tail_t *cu_tail_list;
+
+/* Removes a watch unless another object still uses it. Must be called with
+ * cu_tail_lock held. */
+static void cu_tail_rm_watch(cu_tail_t *obj, int wd) {
+  if (wd < 0)
+    return;
+
+  for (cu_tail_t *other = cu_tail_list; other != NULL; other = other->next) {
+    if ((other != obj) && ((other->wd_file == wd) || (other->wd_dir == wd)))
+      return;
+  }
+
+  inotify_rm_watch(cu_tail_inotify_fd, wd);
+} /* void cu_tail_rm_watch */
+
+/* Watches the newly opened file, so cu_tail_read() and cu_tail_readline() can
+ * skip it while it is idle. Failing to do so isn't an error: the file is then
+ * polled on every read. */
+static void cu_tail_watch(cu_tail_t *obj) {
+  pthread_mutex_lock(&cu_tail_lock);
+
+  if ((cu_tail_inotify_fd < 0) && !cu_tail_inotify_failed) {
+    cu_tail_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (cu_tail_inotify_fd < 0) {
+      WARNING("utils_tail: inotify_init1 failed, falling back to polling: %s",
+              STRERRNO);
+      cu_tail_inotify_failed = true;
+    }
+  }
+
+  if (cu_tail_inotify_fd < 0) {
+    pthread_mutex_unlock(&cu_tail_lock);
+    return;
+  }
+
+  int old_wd_file = obj->wd_file;
+  obj->wd_file = -1;
+  cu_tail_rm_watch(obj, old_wd_file);
+
+  if ((obj->dir != NULL) && (obj->base != NULL)) {
+    if (obj->wd_dir < 0)
+      obj->wd_dir = inotify_add_watch(cu_tail_inotify_fd, obj->dir,
+                                      IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+    if (obj->wd_dir >= 0)
+      obj->wd_file = inotify_add_watch(
+          cu_tail_inotify_fd, obj->file,
+          IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+  }
+
+  if ((obj->wd_dir < 0) || (obj->wd_file < 0))
+    P_WARNING("utils_tail: Watching `%s' failed, falling back to polling: %s",
+              obj->file, STRERRNO);
+
+  obj->changed = true;
+  pthread_mutex_unlock(&cu_tail_lock);
+} /* void cu_tail_watch */
+
+/* Returns true if the file is open and no events have been received for it
+ * since its end has been reached. */
+static bool cu_tail_idle(cu_tail_t *obj) {
+  if (obj->fh == NULL)
+    return false;
+
+  pthread_mutex_lock(&cu_tail_lock);
+
+  if ((cu_tail_inotify_fd < 0) || (obj->wd_dir < 0) || (obj->wd_file < 0)) {
+    pthread_mutex_unlock(&cu_tail_lock);
+    return false;
+  }
+
+  char buffer[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  while ((len = read(cu_tail_inotify_fd, buffer, sizeof(buffer))) > 0) {
+    for (char *ptr = buffer; ptr < buffer + len;) {
+      struct inotify_event const *ev = (struct inotify_event const *)ptr;
+
+      for (cu_tail_t *t = cu_tail_list; t != NULL; t = t->next) {
+        if ((ev->wd == t->wd_file) ||
+            ((ev->wd == t->wd_dir) && (ev->len > 0) &&
+             (strcmp(ev->name, t->base) == 0)))
+          t->changed = true;
+        /* The kernel removed the watch, e.g. because the file was deleted. */
+        if ((ev->mask & IN_IGNORED) && (ev->wd == t->wd_file))
+          t->wd_file = -1;
+      }
+
+      ptr += sizeof(*ev) + ev->len;
+    }
+  }
+
+  bool idle = !obj->changed && (obj->wd_file >= 0);
+  pthread_mutex_unlock(&cu_tail_lock);
+  return idle;
+} /* bool cu_tail_idle */
+
+/* Called when the end of the unchanged file has been reached. */
+static void cu_tail_settle(cu_tail_t *obj) {
+  pthread_mutex_lock(&cu_tail_lock);
+  obj->changed = false;
+  pthread_mutex_unlock(&cu_tail_lock);
+} /* void cu_tail_settle */
+
+static void cu_tail_register(cu_tail_t *obj) {
+  /* dirname(3) and basename(3) may modify their argument. */
+  char *tmp = strdup(obj->file);
+  if (tmp != NULL) {
+    obj->dir = strdup(dirname(tmp));
+    sfree(tmp);
+  }
+  tmp = strdup(obj->file);
+  if (tmp != NULL) {
+    obj->base = strdup(basename(tmp));
+    sfree(tmp);
+  }
+
+  obj->wd_file = -1;
+  obj->wd_dir = -1;
+
+  pthread_mutex_lock(&cu_tail_lock);
+  obj->next = cu_tail_list;
+  cu_tail_list = obj;
+  pthread_mutex_unlock(&cu_tail_lock);
+} /* void cu_tail_register */
+
+static void cu_tail_unregister(cu_tail_t *obj) {
+  pthread_mutex_lock(&cu_tail_lock);
+  for (cu_tail_t **prev = &cu_tail_list; *prev != NULL;
+       prev = &(*prev)->next) {
+    if (*prev == obj) {
+      *prev = obj->next;
+      break;
+    }
+  }
+  if (cu_tail_inotify_fd >= 0) {
+    cu_tail_rm_watch(obj, obj->wd_file);
+    cu_tail_rm_watch(obj, obj->wd_dir);
+  }
+  pthread_mutex_unlock(&cu_tail_lock);
+
+  sfree(obj->dir);
+  sfree(obj->base);
+} /* void cu_tail_unregister */
+#else
+static void cu_tail_watch(cu_tail_t __attribute__((unused)) * obj) {}
+static bool cu_tail_idle(cu_tail_t __attribute__((unused)) * obj) {
+  return false;
+}
+static void cu_tail_settle(cu_tail_t __attribute__((unused)) * obj) {}
+static void cu_tail_register(cu_tail_t __attribute__((unused)) * obj) {}
+static void cu_tail_unregister(cu_tail_t __attribute__((unused)) * obj) {}
+#endif /* HAVE_SYS_INOTIFY_H */
+
 static int cu_tail_reopen(cu_tail_t *obj, bool force_rewind) {
   int seek_end = 0;
   struct stat stat_buf = {0};
@@ -63,6 +252,9 @@ static int cu_tail_reopen(cu_tail_t *obj, bool force_rewind) {
         obj->fh = NULL;
         return -1;
       }
+      obj->buffer_fill = 0;
+    } else {
+      cu_tail_settle(obj);
     }
     memcpy(&obj->stat, &stat_buf, sizeof(struct stat));
     return 1;
@@ -93,6 +285,7 @@ static int cu_tail_reopen(cu_tail_t *obj, bool force_rewind) {
     fclose(obj->fh);
   obj->fh = fh;
   memcpy(&obj->stat, &stat_buf, sizeof(struct stat));
+  cu_tail_watch(obj);
 
   return 0;
 } /* int cu_tail_reopen */
@@ -111,14 +304,19 @@ cu_tail_t *cu_tail_create(const char *file) {
   }
 
   obj->fh = NULL;
+  obj->buffer = NULL;
+  obj->buffer_fill = 0;
+  cu_tail_register(obj);
 
   return obj;
 } /* cu_tail_t *cu_tail_create */
 
 int cu_tail_destroy(cu_tail_t *obj) {
+  cu_tail_unregister(obj);
   if (obj->fh != NULL)
     fclose(obj->fh);
   free(obj->file);
+  free(obj->buffer);
   free(obj);
 
   return 0;
@@ -132,6 +330,11 @@ int cu_tail_readline(cu_tail_t *obj, char *buf, int buflen, bool force_rewind) {
     return -1;
   }
 
+  if (cu_tail_idle(obj)) {
+    buf[0] = 0;
+    return 0;
+  }
+
   if (obj->fh == NULL) {
     status = cu_tail_reopen(obj, force_rewind);
     if (status < 0)
@@ -186,33 +389,36 @@ int cu_tail_readline(cu_tail_t *obj, char *buf, int buflen, bool force_rewind) {
   return 0;
 } /* int cu_tail_readline */
 
-int cu_tail_read(cu_tail_t *obj, char *buf, int buflen, tailfunc_t *callback,
-                 void *data, bool force_rewind) {
-  int status;
+/* Passes all complete lines in the buffer to "callback" and moves the rest to
+ * the front. If "flush" is true, the remainder is passed on as well. */
+static int cu_tail_handle_buffer(cu_tail_t *obj, tailfunc_t *callback,
+                                 void *data, bool flush) {
+  char *line = obj->buffer;
+  size_t avail = obj->buffer_fill;
+  int status = 0;
 
-  while (42) {
+  while (avail > 0) {
+    char *newline = memchr(line, '\n', avail);
     size_t len;
 
-    status = cu_tail_readline(obj, buf, buflen, force_rewind);
-    if (status != 0) {
-      ERROR("utils_tail: cu_tail_read: cu_tail_readline "
-            "failed.");
+    if (newline != NULL) {
+      len = (size_t)(newline - line);
+    } else if (flush || (avail == CU_TAIL_BUFFER_SIZE)) {
+      /* Lines that don't fit into the buffer are split, like fgets() does. */
+      len = avail;
+    } else {
       break;
     }
 
-    /* check for EOF */
-    if (buf[0] == 0)
-      break;
+    /* There is always room for the terminating null byte. */
+    line[len] = 0;
+    status = callback(data, line, (int)(len + 1));
 
-    len = strlen(buf);
-    while (len > 0) {
-      if (buf[len - 1] != '\n')
-        break;
-      buf[len - 1] = '\0';
-      len--;
-    }
+    if (newline != NULL)
+      len++;
+    line += len;
+    avail -= len;
 
-    status = callback(data, buf, buflen);
     if (status != 0) {
       ERROR("utils_tail: cu_tail_read: callback returned "
             "status %i.",
@@ -221,5 +427,269 @@ int cu_tail_read(cu_tail_t *obj, char *buf, int buflen, tailfunc_t *callback,
     }
   }
 
+  if ((avail > 0) && (line != obj->buffer))
+    memmove(obj->buffer, line, avail);
+  obj->buffer_fill = avail;
+
   return status;
+} /* int cu_tail_handle_buffer */
+
+int cu_tail_read(cu_tail_t *obj, tailfunc_t *callback, void *data,
+                 bool force_rewind) {
+  int status;
+
+  if (obj->buffer == NULL) {
+    obj->buffer = malloc(CU_TAIL_BUFFER_SIZE + 1);
+    if (obj->buffer == NULL) {
+      ERROR("utils_tail: cu_tail_read: malloc failed.");
+      return -1;
+    }
+    obj->buffer_fill = 0;
+  }
+
+  if (cu_tail_idle(obj))
+    return 0;
+
+  while (42) {
+    if (obj->fh == NULL) {
+      status = cu_tail_reopen(obj, force_rewind);
+      if (status < 0)
+        return status;
+    }
+
+    /* Read in large blocks straight into our own buffer. The stream is only
+     * used for seeking, so its own buffer is always empty. */
+    ssize_t len = read(fileno(obj->fh), obj->buffer + obj->buffer_fill,
+                       CU_TAIL_BUFFER_SIZE - obj->buffer_fill);
+    if (len > 0) {
+      obj->buffer_fill += (size_t)len;
+      status = cu_tail_handle_buffer(obj, callback, data, /* flush = */ false);
+      if (status != 0)
+        return status;
+      continue;
+    }
+
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      WARNING("utils_tail: read (%s) failed: %s", obj->file, STRERRNO);
+      fclose(obj->fh);
+      obj->fh = NULL;
+    }
+
+    /* EOF: check if the file was moved away and reopen the new file if so. */
+    status = cu_tail_reopen(obj, force_rewind);
+    if (status < 0)
+      return status;
+    /* File end reached and file not reopened -> nothing more to read. An
+     * incomplete last line is kept until the rest of it has been written. */
+    if (status > 0)
+      return 0;
+
+    /* The file was re-opened, so the last line of the old one is complete. */
+    status = cu_tail_handle_buffer(obj, callback, data, /* flush = */ true);
+    if (status != 0)
+      return status;
+  }
 } /* int cu_tail_read */
+
+/* Passes the complete lines in "ptr" to "callback" and returns the number of
+ * bytes consumed in "ret_consumed". If "flush" is true, an incomplete last
+ * line is passed on as well. */
+static int cu_tail_handle_lines(char const *ptr, size_t avail, bool flush,
+                                tailspanfunc_t *callback, void *data,
+                                size_t *ret_consumed) {
+  size_t consumed = 0;
+  int status = 0;
+
+  while (avail > 0) {
+    char const *newline = memchr(ptr, '\n', avail);
+    size_t len;
+
+    if (newline != NULL) {
+      len = (size_t)(newline - ptr);
+    } else if (flush || (avail >= CU_TAIL_BUFFER_SIZE)) {
+      /* Lines that don't fit into the buffer are split, like cu_tail_read()
+       * does. */
+      len = (avail < CU_TAIL_BUFFER_SIZE) ? avail : CU_TAIL_BUFFER_SIZE;
+    } else {
+      break;
+    }
+
+    if ((newline != NULL) && (len > CU_TAIL_BUFFER_SIZE)) {
+      len = CU_TAIL_BUFFER_SIZE;
+      newline = NULL;
+    }
+
+    status = callback(data, ptr, len);
+
+    if (newline != NULL)
+      len++;
+    ptr += len;
+    avail -= len;
+    consumed += len;
+
+    if (status != 0) {
+      ERROR("utils_tail: cu_tail_read_lines: callback returned status %i.",
+            status);
+      break;
+    }
+  }
+
+  *ret_consumed = consumed;
+  return status;
+} /* int cu_tail_handle_lines */
+
+/* Like cu_tail_handle_buffer(), for cu_tail_read_lines(). */
+static int cu_tail_handle_buffer_lines(cu_tail_t *obj, tailspanfunc_t *callback,
+                                       void *data, bool flush) {
+  size_t consumed = 0;
+  int status = cu_tail_handle_lines(obj->buffer, obj->buffer_fill, flush,
+                                    callback, data, &consumed);
+
+  obj->buffer_fill -= consumed;
+  if ((obj->buffer_fill > 0) && (consumed > 0))
+    memmove(obj->buffer, obj->buffer + consumed, obj->buffer_fill);
+
+  return status;
+} /* int cu_tail_handle_buffer_lines */
+
+/* Maps the region from "offset" to "end" of the open file into memory and
+ * passes the lines in it to "callback". An incomplete last line is moved to
+ * the buffer. Returns a positive value if the region could not be mapped, in
+ * which case nothing has been read. */
+static int cu_tail_read_map(cu_tail_t *obj, off_t offset, off_t end,
+                            tailspanfunc_t *callback, void *data) {
+  int fd = fileno(obj->fh);
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (page_size <= 0)
+    return 1;
+
+  off_t start = offset - (offset % (off_t)page_size);
+  size_t map_size = (size_t)(end - start);
+  char *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, start);
+  if (map == MAP_FAILED)
+    return 1;
+  (void)posix_madvise(map, map_size, POSIX_MADV_SEQUENTIAL);
+
+  char const *ptr = map + (offset - start);
+  size_t avail = (size_t)(end - offset);
+  int status = 0;
+
+  /* Complete the line held back by the previous call first. */
+  if (obj->buffer_fill > 0) {
+    char const *newline = memchr(ptr, '\n', avail);
+    size_t len = (newline != NULL) ? (size_t)(newline - ptr) + 1 : avail;
+    if (len > CU_TAIL_BUFFER_SIZE - obj->buffer_fill)
+      len = CU_TAIL_BUFFER_SIZE - obj->buffer_fill;
+
+    memcpy(obj->buffer + obj->buffer_fill, ptr, len);
+    obj->buffer_fill += len;
+    ptr += len;
+    avail -= len;
+
+    status = cu_tail_handle_buffer_lines(obj, callback, data,
+                                         /* flush = */ false);
+  }
+
+  if ((status == 0) && (obj->buffer_fill == 0)) {
+    size_t consumed = 0;
+    status = cu_tail_handle_lines(ptr, avail, /* flush = */ false, callback,
+                                  data, &consumed);
+    ptr += consumed;
+    avail -= consumed;
+
+    /* The rest is shorter than the buffer, see cu_tail_handle_lines(). */
+    if ((status == 0) && (avail > 0)) {
+      memcpy(obj->buffer, ptr, avail);
+      obj->buffer_fill = avail;
+      avail = 0;
+    }
+  }
+
+  munmap(map, map_size);
+
+  /* Continue after the data passed to the callback or moved to the buffer. */
+  if (lseek(fd, end - (off_t)avail, SEEK_SET) == (off_t)-1) {
+    WARNING("utils_tail: lseek (%s) failed: %s", obj->file, STRERRNO);
+    fclose(obj->fh);
+    obj->fh = NULL;
+  }
+
+  return (status != 0) ? -1 : 0;
+} /* int cu_tail_read_map */
+
+int cu_tail_read_lines(cu_tail_t *obj, tailspanfunc_t *callback, void *data,
+                       bool force_rewind, bool use_mmap) {
+  int status;
+
+  if (obj->buffer == NULL) {
+    obj->buffer = malloc(CU_TAIL_BUFFER_SIZE + 1);
+    if (obj->buffer == NULL) {
+      ERROR("utils_tail: cu_tail_read_lines: malloc failed.");
+      return -1;
+    }
+    obj->buffer_fill = 0;
+  }
+
+  if (cu_tail_idle(obj))
+    return 0;
+
+  while (42) {
+    if (obj->fh == NULL) {
+      status = cu_tail_reopen(obj, force_rewind);
+      if (status < 0)
+        return status;
+    }
+
+    int fd = fileno(obj->fh);
+
+    if (use_mmap) {
+      struct stat statbuf;
+      off_t offset = lseek(fd, 0, SEEK_CUR);
+
+      if ((offset != (off_t)-1) && (fstat(fd, &statbuf) == 0) &&
+          S_ISREG(statbuf.st_mode) &&
+          (statbuf.st_size - offset >= CU_TAIL_MMAP_MIN)) {
+        status = cu_tail_read_map(obj, offset, statbuf.st_size, callback, data);
+        if (status < 0)
+          return status;
+        if (status == 0)
+          continue;
+        /* Mapping failed: use read(2) instead. */
+      }
+    }
+
+    ssize_t len = read(fd, obj->buffer + obj->buffer_fill,
+                       CU_TAIL_BUFFER_SIZE - obj->buffer_fill);
+    if (len > 0) {
+      obj->buffer_fill += (size_t)len;
+      status = cu_tail_handle_buffer_lines(obj, callback, data,
+                                           /* flush = */ false);
+      if (status != 0)
+        return status;
+      continue;
+    }
+
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      WARNING("utils_tail: read (%s) failed: %s", obj->file, STRERRNO);
+      fclose(obj->fh);
+      obj->fh = NULL;
+    }
+
+    /* EOF: check if the file was moved away and reopen the new file if so. */
+    status = cu_tail_reopen(obj, force_rewind);
+    if (status < 0)
+      return status;
+    if (status > 0)
+      return 0;
+
+    /* The file was re-opened, so the last line of the old one is complete. */
+    status = cu_tail_handle_buffer_lines(obj, callback, data,
+                                         /* flush = */ true);
+    if (status != 0)
+      return status;
+  }
+} /* int cu_tail_read_lines */
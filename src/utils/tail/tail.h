@@ -36,6 +36,7 @@ struct cu_tail_s;
 typedef struct cu_tail_s cu_tail_t;
 
 typedef int tailfunc_t(void *data, char *buf, int buflen);
+typedef int tailspanfunc_t(void *data, char const *line, size_t len);
 
 /*
  * NAME
@@ -76,13 +77,33 @@ int cu_tail_destroy(cu_tail_t *obj);
 int cu_tail_readline(cu_tail_t *obj, char *buf, int buflen, bool force_rewind);
 
 /*
- * cu_tail_readline
+ * cu_tail_read
+ *
+ * Reads from the file until eof condition or an error is encountered and
+ * calls `callback' with each line, without the trailing newline. The file is
+ * read in large blocks; lines longer than 64 kiB are split. An incomplete
+ * last line is held back until it has been completed or the file has been
+ * rotated. Don't mix this with `cu_tail_readline' on the same object.
+ *
+ * Returns 0 when successful and non-zero otherwise.
+ */
+int cu_tail_read(cu_tail_t *obj, tailfunc_t *callback, void *data,
+                 bool force_rewind);
+
+/*
+ * cu_tail_read_lines
  *
- * Reads from the file until eof condition or an error is encountered.
+ * Like `cu_tail_read', but passes each line to `callback' as a pointer and a
+ * length, without the trailing newline and without a terminating null byte.
+ * The line must not be modified. If `use_mmap' is true and the file is a
+ * regular file, large appended regions are mapped into memory and the lines
+ * are passed without copying them. The file must then not be truncated while
+ * it is being read: accessing the truncated part of a mapping raises SIGBUS.
+ * Don't mix this with the other read functions on the same object.
  *
  * Returns 0 when successful and non-zero otherwise.
  */
-int cu_tail_read(cu_tail_t *obj, char *buf, int buflen, tailfunc_t *callback,
-                 void *data, bool force_rewind);
+int cu_tail_read_lines(cu_tail_t *obj, tailspanfunc_t *callback, void *data,
+                       bool force_rewind, bool use_mmap);
 
 #endif /* UTILS_TAIL_H */
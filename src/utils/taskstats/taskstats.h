@@ -37,6 +37,12 @@ typedef struct {
   uint64_t freepages_ns;
 } ts_delay_t;
 
+typedef struct {
+  uint64_t cswitch_vol;
+  uint64_t cswitch_invol;
+  ts_delay_t delay;
+} ts_tgid_stats_t;
+
 ts_t *ts_create(void);
 void ts_destroy(ts_t *);
 
@@ -44,4 +50,9 @@ void ts_destroy(ts_t *);
  * identified by tgid. Returns zero on success and an errno otherwise. */
 int ts_delay_by_tgid(ts_t *ts, uint32_t tgid, ts_delay_t *out);
 
+/* ts_stats_by_tgid returns the context switch counters and the delay
+ * accounting information of all threads in the thread group tgid, using a
+ * single request. Returns zero on success and an errno otherwise. */
+int ts_stats_by_tgid(ts_t *ts, uint32_t tgid, ts_tgid_stats_t *out);
+
 #endif /* UTILS_TASKSTATS_H */
@@ -34,6 +34,7 @@
 struct fbhash_s {
   char *filename;
   time_t mtime;
+  time_t checked;
 
   pthread_mutex_t lock;
   c_avl_tree_t *tree;
@@ -170,9 +171,16 @@ static int fbh_check_file(fbhash_t *h) /* {{{ */
   struct stat statbuf = {0};
   int status;
 
+  /* The modification time has a resolution of one second, so checking more
+   * often would not notice more changes. */
+  time_t now = time(NULL);
+  if ((h->checked != 0) && (h->checked == now))
+    return 0;
+
   status = stat(h->filename, &statbuf);
   if (status != 0)
     return -1;
+  h->checked = now;
 
   if (h->mtime >= statbuf.st_mtime)
     return 0;
@@ -242,7 +250,6 @@ char *fbh_get(fbhash_t *h, const char *key) /* {{{ */
 
   pthread_mutex_lock(&h->lock);
 
-  /* TODO: Checking this every time may be a bit much..? */
   fbh_check_file(h);
 
   status = c_avl_get(h->tree, key, (void *)&value);
@@ -103,7 +103,7 @@ static int luaC_pushvalues(lua_State *L, const data_set_t *ds,
 {
   assert(vl->values_len == ds->ds_num);
 
-  lua_newtable(L);
+  lua_createtable(L, (int)vl->values_len, 0);
   for (size_t i = 0; i < vl->values_len; i++) {
     lua_pushinteger(L, (lua_Integer)i + 1);
     luaC_pushvalue(L, vl->values[i], ds->ds[i].type);
@@ -115,7 +115,7 @@ static int luaC_pushvalues(lua_State *L, const data_set_t *ds,
 
 static int luaC_pushdstypes(lua_State *L, const data_set_t *ds) /* {{{ */
 {
-  lua_newtable(L);
+  lua_createtable(L, 0, (int)ds->ds_num);
   for (size_t i = 0; i < ds->ds_num; i++) {
     lua_pushinteger(L, (lua_Integer)i);
     lua_pushstring(L, DS_TYPE_TO_STRING(ds->ds[i].type));
@@ -127,7 +127,7 @@ static int luaC_pushdstypes(lua_State *L, const data_set_t *ds) /* {{{ */
 
 static int luaC_pushdsnames(lua_State *L, const data_set_t *ds) /* {{{ */
 {
-  lua_newtable(L);
+  lua_createtable(L, 0, (int)ds->ds_num);
   for (size_t i = 0; i < ds->ds_num; i++) {
     lua_pushinteger(L, (lua_Integer)i);
     lua_pushstring(L, ds->ds[i].name);
@@ -137,6 +137,35 @@ static int luaC_pushdsnames(lua_State *L, const data_set_t *ds) /* {{{ */
   return 0;
 } /* }}} int luaC_pushdsnames */
 
+/* Pushes a table holding the "dstypes" table at index 1 and the "dsnames"
+ * table at index 2. Both only depend on the type, so they are created once
+ * per Lua state and kept in the registry. */
+static int luaC_pushdstables(lua_State *L, const data_set_t *ds) /* {{{ */
+{
+  lua_getfield(L, LUA_REGISTRYINDEX, "collectd:ds_tables"); /* +1 = 1 */
+  if (!lua_istable(L, -1)) {
+    lua_pop(L, 1); /* -1 = 0 */
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, "collectd:ds_tables");
+  }
+
+  lua_getfield(L, -1, ds->type); /* +1 = 2 */
+  if (!lua_istable(L, -1)) {
+    lua_pop(L, 1); /* -1 = 1 */
+    lua_createtable(L, 2, 0);
+    luaC_pushdstypes(L, ds);
+    lua_rawseti(L, -2, 1);
+    luaC_pushdsnames(L, ds);
+    lua_rawseti(L, -2, 2);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -3, ds->type); /* = 2 */
+  }
+
+  lua_remove(L, -2); /* -1 = 1 */
+  return 0;
+} /* }}} int luaC_pushdstables */
+
 /*
  * Public functions
  */
@@ -281,7 +310,7 @@ int luaC_pushvalue(lua_State *L, value_t v, int ds_type) /* {{{ */
 int luaC_pushvaluelist(lua_State *L, const data_set_t *ds,
                        const value_list_t *vl) /* {{{ */
 {
-  lua_newtable(L);
+  lua_createtable(L, 0, 10);
 
   lua_pushstring(L, vl->host);
   lua_setfield(L, -2, "host");
@@ -299,11 +328,12 @@ int luaC_pushvaluelist(lua_State *L, const data_set_t *ds,
   luaC_pushvalues(L, ds, vl);
   lua_setfield(L, -2, "values");
 
-  luaC_pushdstypes(L, ds);
-  lua_setfield(L, -2, "dstypes");
-
-  luaC_pushdsnames(L, ds);
-  lua_setfield(L, -2, "dsnames");
+  luaC_pushdstables(L, ds);
+  lua_rawgeti(L, -1, 1);
+  lua_setfield(L, -3, "dstypes");
+  lua_rawgeti(L, -1, 2);
+  lua_setfield(L, -3, "dsnames");
+  lua_pop(L, 1);
 
   luaC_pushcdtime(L, vl->time);
   lua_setfield(L, -2, "time");
@@ -28,6 +28,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils_llist.h"
 
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
 #include <vapi/vsc.h>
@@ -95,11 +96,49 @@ struct user_config_s {
 #if HAVE_VARNISH_V6
   bool collect_goto;
 #endif
+
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+  /* Maps counter names to varnish_counter_t, see varnish_counter_get(). */
+  llist_t *counters;
+  /* Incremented by every read; counters not seen by a read are removed. */
+  uint64_t generation;
+  int counters_seen;
+#endif
 };
 typedef struct user_config_s user_config_t; /* }}} */
 
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+/* How a VSC counter is submitted. Finding this out takes a long chain of
+ * string comparisons, so it is done once per counter name and cached. */
+struct varnish_counter_s {
+  /* DS_TYPE_DERIVE, DS_TYPE_GAUGE, or -1 if the counter is not collected. */
+  int ds_type;
+  uint64_t generation;
+
+  char plugin_instance[DATA_MAX_NAME_LEN];
+  char type[DATA_MAX_NAME_LEN];
+  char type_instance[DATA_MAX_NAME_LEN];
+};
+typedef struct varnish_counter_s varnish_counter_t;
+#endif
+
 static bool have_instance;
 
+static void varnish_plugin_instance(char *buffer, size_t buffer_size, /* {{{ */
+                                    const char *plugin_instance,
+                                    const char *category, const char *target) {
+  if (plugin_instance == NULL)
+    plugin_instance = "default";
+
+  if (target != NULL) {
+    ssnprintf(buffer, buffer_size, "%s-%s-%s", plugin_instance, category,
+              target);
+  } else {
+    ssnprintf(buffer, buffer_size, "%s-%s", plugin_instance, category);
+  }
+} /* }}} void varnish_plugin_instance */
+
+#if HAVE_VARNISH_V2
 static int varnish_submit(const char *plugin_instance, /* {{{ */
                           const char *category, const char *target,
                           const char *type, const char *type_instance,
@@ -110,17 +149,8 @@ static int varnish_submit(const char *plugin_instance, /* {{{ */
   vl.values_len = 1;
 
   sstrncpy(vl.plugin, "varnish", sizeof(vl.plugin));
-
-  if (plugin_instance == NULL)
-    plugin_instance = "default";
-
-  if (target != NULL) {
-    ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%s-%s-%s",
-              plugin_instance, category, target);
-  } else {
-    ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%s-%s",
-              plugin_instance, category);
-  }
+  varnish_plugin_instance(vl.plugin_instance, sizeof(vl.plugin_instance),
+                          plugin_instance, category, target);
 
   sstrncpy(vl.type, type, sizeof(vl.type));
 
@@ -140,20 +170,6 @@ static int varnish_submit_gauge(const char *plugin_instance, /* {{{ */
                         });
 } /* }}} int varnish_submit_gauge */
 
-#if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-static int
-varnish_submit_gauge_with_target(const char *plugin_instance, /* {{{ */
-                                 const char *category, const char *target,
-                                 const char *type, const char *type_instance,
-                                 uint64_t gauge_value) {
-
-  return varnish_submit(plugin_instance, category, target, type, type_instance,
-                        (value_t){
-                            .gauge = (gauge_t)gauge_value,
-                        });
-} /* }}} int varnish_submit_gauge_with_target */
-#endif
-
 static int varnish_submit_derive(const char *plugin_instance, /* {{{ */
                                  const char *category, const char *type,
                                  const char *type_instance,
@@ -163,35 +179,66 @@ static int varnish_submit_derive(const char *plugin_instance, /* {{{ */
                             .derive = (derive_t)derive_value,
                         });
 } /* }}} int varnish_submit_derive */
-
-#if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-static int
-varnish_submit_derive_with_target(const char *plugin_instance, /* {{{ */
-                                  const char *category, const char *target,
-                                  const char *type, const char *type_instance,
-                                  uint64_t derive_value) {
-  return varnish_submit(plugin_instance, category, target, type, type_instance,
-                        (value_t){
-                            .derive = (derive_t)derive_value,
-                        });
-} /* }}} int varnish_submit_derive_with_target */
 #endif
 
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
-static int varnish_monitor(void *priv,
-                           const struct VSC_point *const pt) /* {{{ */
-{
-  uint64_t val;
-  const user_config_t *conf;
+static int varnish_map(varnish_counter_t *ret, /* {{{ */
+                       const char *plugin_instance, const char *category,
+                       const char *target, const char *type,
+                       const char *type_instance, int ds_type) {
+  ret->ds_type = ds_type;
+  varnish_plugin_instance(ret->plugin_instance, sizeof(ret->plugin_instance),
+                          plugin_instance, category, target);
+  sstrncpy(ret->type, type, sizeof(ret->type));
+  sstrncpy(ret->type_instance, (type_instance != NULL) ? type_instance : "",
+           sizeof(ret->type_instance));
+  return 0;
+} /* }}} int varnish_map */
+
+static int varnish_map_gauge(varnish_counter_t *ret, /* {{{ */
+                             const char *plugin_instance, const char *category,
+                             const char *type, const char *type_instance) {
+  return varnish_map(ret, plugin_instance, category, NULL, type, type_instance,
+                     DS_TYPE_GAUGE);
+} /* }}} int varnish_map_gauge */
+
+static int varnish_map_derive(varnish_counter_t *ret, /* {{{ */
+                              const char *plugin_instance, const char *category,
+                              const char *type, const char *type_instance) {
+  return varnish_map(ret, plugin_instance, category, NULL, type, type_instance,
+                     DS_TYPE_DERIVE);
+} /* }}} int varnish_map_derive */
+
+#if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+static int varnish_map_gauge_with_target(varnish_counter_t *ret, /* {{{ */
+                                         const char *plugin_instance,
+                                         const char *category,
+                                         const char *target, const char *type,
+                                         const char *type_instance) {
+  return varnish_map(ret, plugin_instance, category, target, type,
+                     type_instance, DS_TYPE_GAUGE);
+} /* }}} int varnish_map_gauge_with_target */
+
+static int varnish_map_derive_with_target(varnish_counter_t *ret, /* {{{ */
+                                          const char *plugin_instance,
+                                          const char *category,
+                                          const char *target, const char *type,
+                                          const char *type_instance) {
+  return varnish_map(ret, plugin_instance, category, target, type,
+                     type_instance, DS_TYPE_DERIVE);
+} /* }}} int varnish_map_derive_with_target */
+#endif
+
+/* Looks up how the counter "key" is submitted. "ret->ds_type" is set to -1 if
+ * the counter is not collected. */
+static int varnish_counter_resolve(const user_config_t *conf, /* {{{ */
+                                   const char *key, varnish_counter_t *ret) {
   const char *name;
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
   const char *stat_target = NULL;
 #endif
 
-  if (pt == NULL)
-    return 0;
-
-  conf = priv;
+  ret->ds_type = -1;
 
 #if HAVE_VARNISH_V6
   /*
@@ -205,7 +252,7 @@ static int varnish_monitor(void *priv,
   char namebuff[DATA_MAX_NAME_LEN];
   char targetbuff[DATA_MAX_NAME_LEN];
 
-  char *buffer = strdup(pt->name);
+  char *buffer = strdup(key);
   char *tokens[4] = {NULL};
   size_t tokens_num = 0;
   char *ptr = buffer;
@@ -237,616 +284,599 @@ static int varnish_monitor(void *priv,
 #elif HAVE_VARNISH_V5
   char namebuff[DATA_MAX_NAME_LEN];
 
-  char const *c = strrchr(pt->name, '.');
+  char const *c = strrchr(key, '.');
   if (c == NULL) {
     return EINVAL;
   }
   sstrncpy(namebuff, c + 1, sizeof(namebuff));
   name = namebuff;
 
-#elif HAVE_VARNISH_V4
-  if (strcmp(pt->section->fantom->type, "MAIN") != 0)
-    return 0;
-
-  name = pt->desc->name;
-#elif HAVE_VARNISH_V3
-  if (strcmp(pt->class, "") != 0)
-    return 0;
-
-  name = pt->name;
+#elif HAVE_VARNISH_V3 || HAVE_VARNISH_V4
+  name = key;
 #endif
 
-  val = *(const volatile uint64_t *)pt->ptr;
 
   if (conf->collect_cache) {
     if (strcmp(name, "cache_hit") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
-                                   "hit", val);
+      return varnish_map_derive(ret, conf->instance, "cache", "cache_result",
+                                "hit");
     else if (strcmp(name, "cache_miss") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
-                                   "miss", val);
+      return varnish_map_derive(ret, conf->instance, "cache", "cache_result",
+                                "miss");
     else if (strcmp(name, "cache_hitpass") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
-                                   "hitpass", val);
+      return varnish_map_derive(ret, conf->instance, "cache", "cache_result",
+                                "hitpass");
 #if HAVE_VARNISH_V6
     else if (strcmp(name, "cache_hit_grace") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
-                                   "hit_grace", val);
+      return varnish_map_derive(ret, conf->instance, "cache", "cache_result",
+                                "hit_grace");
     else if (strcmp(name, "cache_hitmiss") == 0)
-      return varnish_submit_derive(conf->instance, "cache", "cache_result",
-                                   "hitmiss", val);
+      return varnish_map_derive(ret, conf->instance, "cache", "cache_result",
+                                "hitmiss");
 #endif
   }
 
   if (conf->collect_connections) {
     if (strcmp(name, "client_conn") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
-                                   "accepted", val);
+      return varnish_map_derive(ret, conf->instance, "connections",
+                                "connections", "accepted");
     else if (strcmp(name, "client_drop") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
-                                   "dropped", val);
+      return varnish_map_derive(ret, conf->instance, "connections",
+                                "connections", "dropped");
     else if (strcmp(name, "client_req") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
-                                   "received", val);
+      return varnish_map_derive(ret, conf->instance, "connections",
+                                "connections", "received");
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
     else if (strcmp(name, "client_req_400") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
-                                   "error_400", val);
+      return varnish_map_derive(ret, conf->instance, "connections",
+                                "connections", "error_400");
     else if (strcmp(name, "client_req_417") == 0)
-      return varnish_submit_derive(conf->instance, "connections", "connections",
-                                   "error_417", val);
+      return varnish_map_derive(ret, conf->instance, "connections",
+                                "connections", "error_417");
 #endif
   }
 
 #ifdef HAVE_VARNISH_V3
   if (conf->collect_dirdns) {
     if (strcmp(name, "dir_dns_lookups") == 0)
-      return varnish_submit_derive(conf->instance, "dirdns", "cache_operation",
-                                   "lookups", val);
+      return varnish_map_derive(ret, conf->instance, "dirdns",
+                                "cache_operation", "lookups");
     else if (strcmp(name, "dir_dns_failed") == 0)
-      return varnish_submit_derive(conf->instance, "dirdns", "cache_result",
-                                   "failed", val);
+      return varnish_map_derive(ret, conf->instance, "dirdns", "cache_result",
+                                "failed");
     else if (strcmp(name, "dir_dns_hit") == 0)
-      return varnish_submit_derive(conf->instance, "dirdns", "cache_result",
-                                   "hits", val);
+      return varnish_map_derive(ret, conf->instance, "dirdns", "cache_result",
+                                "hits");
     else if (strcmp(name, "dir_dns_cache_full") == 0)
-      return varnish_submit_derive(conf->instance, "dirdns", "cache_result",
-                                   "cache_full", val);
+      return varnish_map_derive(ret, conf->instance, "dirdns", "cache_result",
+                                "cache_full");
   }
 #endif
 
   if (conf->collect_esi) {
     if (strcmp(name, "esi_errors") == 0)
-      return varnish_submit_derive(conf->instance, "esi", "total_operations",
-                                   "error", val);
+      return varnish_map_derive(ret, conf->instance, "esi", "total_operations",
+                                "error");
     else if (strcmp(name, "esi_parse") == 0)
-      return varnish_submit_derive(conf->instance, "esi", "total_operations",
-                                   "parsed", val);
+      return varnish_map_derive(ret, conf->instance, "esi", "total_operations",
+                                "parsed");
     else if (strcmp(name, "esi_warnings") == 0)
-      return varnish_submit_derive(conf->instance, "esi", "total_operations",
-                                   "warning", val);
+      return varnish_map_derive(ret, conf->instance, "esi", "total_operations",
+                                "warning");
     else if (strcmp(name, "esi_maxdepth") == 0)
-      return varnish_submit_derive(conf->instance, "esi", "total_operations",
-                                   "max_depth", val);
+      return varnish_map_derive(ret, conf->instance, "esi", "total_operations",
+                                "max_depth");
   }
 
   if (conf->collect_backend) {
     if (strcmp(name, "backend_conn") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "success", val);
+      return varnish_map_derive(ret, conf->instance, "backend", "connections",
+                                "success");
     else if (strcmp(name, "backend_unhealthy") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "not-attempted", val);
+      return varnish_map_derive(ret, conf->instance, "backend", "connections",
+                                "not-attempted");
     else if (strcmp(name, "backend_busy") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "too-many", val);
+      return varnish_map_derive(ret, conf->instance, "backend", "connections",
+                                "too-many");
     else if (strcmp(name, "backend_fail") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "failures", val);
+      return varnish_map_derive(ret, conf->instance, "backend", "connections",
+                                "failures");
     else if (strcmp(name, "backend_reuse") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "reuses", val);
+      return varnish_map_derive(ret, conf->instance, "backend", "connections",
+                                "reuses");
     else if (strcmp(name, "backend_toolate") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "was-closed", val);
+      return varnish_map_derive(ret, conf->instance, "backend", "connections",
+                                "was-closed");
     else if (strcmp(name, "backend_recycle") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "recycled", val);
+      return varnish_map_derive(ret, conf->instance, "backend", "connections",
+                                "recycled");
     else if (strcmp(name, "backend_unused") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "unused", val);
+      return varnish_map_derive(ret, conf->instance, "backend", "connections",
+                                "unused");
     else if (strcmp(name, "backend_retry") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "connections",
-                                   "retries", val);
+      return varnish_map_derive(ret, conf->instance, "backend", "connections",
+                                "retries");
     else if (strcmp(name, "backend_req") == 0)
-      return varnish_submit_derive(conf->instance, "backend", "http_requests",
-                                   "requests", val);
+      return varnish_map_derive(ret, conf->instance, "backend", "http_requests",
+                                "requests");
     else if (strcmp(name, "n_backend") == 0)
-      return varnish_submit_gauge(conf->instance, "backend", "backends",
-                                  "n_backends", val);
+      return varnish_map_gauge(ret, conf->instance, "backend", "backends",
+                               "n_backends");
   }
 
   if (conf->collect_fetch) {
     if (strcmp(name, "fetch_head") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "head", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "head");
     else if (strcmp(name, "fetch_length") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "length", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "length");
     else if (strcmp(name, "fetch_chunked") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "chunked", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "chunked");
     else if (strcmp(name, "fetch_eof") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "eof", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "eof");
     else if (strcmp(name, "fetch_bad") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "bad_headers", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "bad_headers");
     else if (strcmp(name, "fetch_close") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "close", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "close");
     else if (strcmp(name, "fetch_oldhttp") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "oldhttp", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "oldhttp");
     else if (strcmp(name, "fetch_zero") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "zero", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "zero");
     else if (strcmp(name, "fetch_failed") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "failed", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "failed");
     else if (strcmp(name, "fetch_1xx") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "no_body_1xx", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "no_body_1xx");
     else if (strcmp(name, "fetch_204") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "no_body_204", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "no_body_204");
     else if (strcmp(name, "fetch_304") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "no_body_304", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "no_body_304");
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
     else if (strcmp(name, "fetch_no_thread") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "no_thread", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "no_thread");
     else if (strcmp(name, "fetch_none") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "none", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "none");
     else if (strcmp(name, "busy_sleep") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "busy_sleep", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "busy_sleep");
     else if (strcmp(name, "busy_wakeup") == 0)
-      return varnish_submit_derive(conf->instance, "fetch", "http_requests",
-                                   "busy_wakeup", val);
+      return varnish_map_derive(ret, conf->instance, "fetch", "http_requests",
+                                "busy_wakeup");
 #endif
   }
 
   if (conf->collect_hcb) {
     if (strcmp(name, "hcb_nolock") == 0)
-      return varnish_submit_derive(conf->instance, "hcb", "cache_operation",
-                                   "lookup_nolock", val);
+      return varnish_map_derive(ret, conf->instance, "hcb", "cache_operation",
+                                "lookup_nolock");
     else if (strcmp(name, "hcb_lock") == 0)
-      return varnish_submit_derive(conf->instance, "hcb", "cache_operation",
-                                   "lookup_lock", val);
+      return varnish_map_derive(ret, conf->instance, "hcb", "cache_operation",
+                                "lookup_lock");
     else if (strcmp(name, "hcb_insert") == 0)
-      return varnish_submit_derive(conf->instance, "hcb", "cache_operation",
-                                   "insert", val);
+      return varnish_map_derive(ret, conf->instance, "hcb", "cache_operation",
+                                "insert");
   }
 
   if (conf->collect_objects) {
     if (strcmp(name, "n_expired") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "expired", val);
+      return varnish_map_derive(ret, conf->instance, "objects", "total_objects",
+                                "expired");
     else if (strcmp(name, "n_lru_nuked") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "lru_nuked", val);
+      return varnish_map_derive(ret, conf->instance, "objects", "total_objects",
+                                "lru_nuked");
     else if (strcmp(name, "n_lru_saved") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "lru_saved", val);
+      return varnish_map_derive(ret, conf->instance, "objects", "total_objects",
+                                "lru_saved");
     else if (strcmp(name, "n_lru_moved") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "lru_moved", val);
+      return varnish_map_derive(ret, conf->instance, "objects", "total_objects",
+                                "lru_moved");
 #if HAVE_VARNISH_V6
     else if (strcmp(name, "n_lru_limited") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "lru_limited", val);
+      return varnish_map_derive(ret, conf->instance, "objects", "total_objects",
+                                "lru_limited");
 #endif
     else if (strcmp(name, "n_deathrow") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "deathrow", val);
+      return varnish_map_derive(ret, conf->instance, "objects", "total_objects",
+                                "deathrow");
     else if (strcmp(name, "losthdr") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "header_overflow", val);
+      return varnish_map_derive(ret, conf->instance, "objects", "total_objects",
+                                "header_overflow");
     else if (strcmp(name, "n_obj_purged") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "purged", val);
+      return varnish_map_derive(ret, conf->instance, "objects", "total_objects",
+                                "purged");
     else if (strcmp(name, "n_objsendfile") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "sent_sendfile", val);
+      return varnish_map_derive(ret, conf->instance, "objects", "total_objects",
+                                "sent_sendfile");
     else if (strcmp(name, "n_objwrite") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "sent_write", val);
+      return varnish_map_derive(ret, conf->instance, "objects", "total_objects",
+                                "sent_write");
     else if (strcmp(name, "n_objoverflow") == 0)
-      return varnish_submit_derive(conf->instance, "objects", "total_objects",
-                                   "workspace_overflow", val);
+      return varnish_map_derive(ret, conf->instance, "objects", "total_objects",
+                                "workspace_overflow");
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
     else if (strcmp(name, "exp_mailed") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "exp_mailed", val);
+      return varnish_map_gauge(ret, conf->instance, "struct", "objects",
+                               "exp_mailed");
     else if (strcmp(name, "exp_received") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "exp_received", val);
+      return varnish_map_gauge(ret, conf->instance, "struct", "objects",
+                               "exp_received");
 #endif
   }
 
 #if HAVE_VARNISH_V3
   if (conf->collect_ban) {
     if (strcmp(name, "n_ban") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "total", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "total");
     else if (strcmp(name, "n_ban_add") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "added", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "added");
     else if (strcmp(name, "n_ban_retire") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "deleted", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "deleted");
     else if (strcmp(name, "n_ban_obj_test") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "objects_tested", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "objects_tested");
     else if (strcmp(name, "n_ban_re_test") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "regexps_tested", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "regexps_tested");
     else if (strcmp(name, "n_ban_dups") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "duplicate", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "duplicate");
   }
 #endif
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
   if (conf->collect_ban) {
     if (strcmp(name, "bans") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "total", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "total");
     else if (strcmp(name, "bans_added") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "added", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "added");
     else if (strcmp(name, "bans_obj") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "obj", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "obj");
     else if (strcmp(name, "bans_req") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "req", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "req");
     else if (strcmp(name, "bans_completed") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "completed", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "completed");
     else if (strcmp(name, "bans_deleted") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "deleted", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "deleted");
     else if (strcmp(name, "bans_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "tested", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "tested");
     else if (strcmp(name, "bans_dups") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "duplicate", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "duplicate");
     else if (strcmp(name, "bans_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "tested", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "tested");
     else if (strcmp(name, "bans_lurker_contention") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "lurker_contention", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "lurker_contention");
     else if (strcmp(name, "bans_lurker_obj_killed") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "lurker_obj_killed", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "lurker_obj_killed");
     else if (strcmp(name, "bans_lurker_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "lurker_tested", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "lurker_tested");
     else if (strcmp(name, "bans_lurker_tests_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "lurker_tests_tested", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "lurker_tests_tested");
     else if (strcmp(name, "bans_obj_killed") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "obj_killed", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "obj_killed");
     else if (strcmp(name, "bans_persisted_bytes") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_bytes",
-                                   "persisted_bytes", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_bytes",
+                                "persisted_bytes");
     else if (strcmp(name, "bans_persisted_fragmentation") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_bytes",
-                                   "persisted_fragmentation", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_bytes",
+                                "persisted_fragmentation");
     else if (strcmp(name, "bans_tests_tested") == 0)
-      return varnish_submit_derive(conf->instance, "ban", "total_operations",
-                                   "tests_tested", val);
+      return varnish_map_derive(ret, conf->instance, "ban", "total_operations",
+                                "tests_tested");
   }
 #endif
 
   if (conf->collect_session) {
     if (strcmp(name, "sess_closed") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "closed", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "closed");
     else if (strcmp(name, "sess_pipeline") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "pipeline", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "pipeline");
     else if (strcmp(name, "sess_readahead") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "readahead", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "readahead");
     else if (strcmp(name, "sess_conn") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "accepted", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "accepted");
     else if (strcmp(name, "sess_drop") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "dropped", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "dropped");
     else if (strcmp(name, "sess_fail") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "failed", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "failed");
 #if HAVE_VARNISH_V6
     else if (strcmp(name, "sess_fail_econnaborted") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "failed_econnaborted",
-                                   val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "failed_econnaborted");
     else if (strcmp(name, "sess_fail_eintr") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "failed_eintr", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "failed_eintr");
     else if (strcmp(name, "sess_fail_emfile") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "failed_emfile", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "failed_emfile");
     else if (strcmp(name, "sess_fail_ebadf") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "failed_ebadf", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "failed_ebadf");
     else if (strcmp(name, "sess_fail_enomem") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "failed_enomem", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "failed_enomem");
     else if (strcmp(name, "sess_fail_other") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "failed_other", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "failed_other");
 #endif
     else if (strcmp(name, "sess_pipe_overflow") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "overflow", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "overflow");
     else if (strcmp(name, "sess_queued") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "queued", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "queued");
     else if (strcmp(name, "sess_linger") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "linger", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "linger");
     else if (strcmp(name, "sess_herd") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "herd", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "herd");
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
     else if (strcmp(name, "sess_closed_err") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "closed_err", val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "closed_err");
     else if (strcmp(name, "sess_dropped") == 0)
-      return varnish_submit_derive(conf->instance, "session",
-                                   "total_operations", "dropped_for_thread",
-                                   val);
+      return varnish_map_derive(ret, conf->instance, "session",
+                                "total_operations", "dropped_for_thread");
 #endif
   }
 
   if (conf->collect_shm) {
     if (strcmp(name, "shm_records") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
-                                   "records", val);
+      return varnish_map_derive(ret, conf->instance, "shm", "total_operations",
+                                "records");
     else if (strcmp(name, "shm_writes") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
-                                   "writes", val);
+      return varnish_map_derive(ret, conf->instance, "shm", "total_operations",
+                                "writes");
     else if (strcmp(name, "shm_flushes") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
-                                   "flushes", val);
+      return varnish_map_derive(ret, conf->instance, "shm", "total_operations",
+                                "flushes");
     else if (strcmp(name, "shm_cont") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
-                                   "contention", val);
+      return varnish_map_derive(ret, conf->instance, "shm", "total_operations",
+                                "contention");
     else if (strcmp(name, "shm_cycles") == 0)
-      return varnish_submit_derive(conf->instance, "shm", "total_operations",
-                                   "cycles", val);
+      return varnish_map_derive(ret, conf->instance, "shm", "total_operations",
+                                "cycles");
   }
 
   if (conf->collect_sms) {
     if (strcmp(name, "sms_nreq") == 0)
-      return varnish_submit_derive(conf->instance, "sms", "total_requests",
-                                   "allocator", val);
+      return varnish_map_derive(ret, conf->instance, "sms", "total_requests",
+                                "allocator");
     else if (strcmp(name, "sms_nobj") == 0)
-      return varnish_submit_gauge(conf->instance, "sms", "requests",
-                                  "outstanding", val);
+      return varnish_map_gauge(ret, conf->instance, "sms", "requests",
+                               "outstanding");
     else if (strcmp(name, "sms_nbytes") == 0)
-      return varnish_submit_gauge(conf->instance, "sms", "bytes", "outstanding",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "sms", "bytes",
+                               "outstanding");
     else if (strcmp(name, "sms_balloc") == 0)
-      return varnish_submit_derive(conf->instance, "sms", "total_bytes",
-                                   "allocated", val);
+      return varnish_map_derive(ret, conf->instance, "sms", "total_bytes",
+                                "allocated");
     else if (strcmp(name, "sms_bfree") == 0)
-      return varnish_submit_derive(conf->instance, "sms", "total_bytes", "free",
-                                   val);
+      return varnish_map_derive(ret, conf->instance, "sms", "total_bytes",
+                                "free");
   }
 
   if (conf->collect_struct) {
     if (strcmp(name, "n_sess_mem") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "current_sessions",
-                                  "sess_mem", val);
+      return varnish_map_gauge(ret, conf->instance, "struct",
+                               "current_sessions", "sess_mem");
     else if (strcmp(name, "n_sess") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "current_sessions",
-                                  "sess", val);
+      return varnish_map_gauge(ret, conf->instance, "struct",
+                               "current_sessions", "sess");
     else if (strcmp(name, "n_object") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects", "object",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "struct", "objects",
+                               "object");
     else if (strcmp(name, "n_vampireobject") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "vampireobject", val);
+      return varnish_map_gauge(ret, conf->instance, "struct", "objects",
+                               "vampireobject");
     else if (strcmp(name, "n_objectcore") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "objectcore", val);
+      return varnish_map_gauge(ret, conf->instance, "struct", "objects",
+                               "objectcore");
     else if (strcmp(name, "n_waitinglist") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "waitinglist", val);
+      return varnish_map_gauge(ret, conf->instance, "struct", "objects",
+                               "waitinglist");
     else if (strcmp(name, "n_objecthead") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "objecthead", val);
+      return varnish_map_gauge(ret, conf->instance, "struct", "objects",
+                               "objecthead");
     else if (strcmp(name, "n_smf") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects", "smf",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "struct", "objects", "smf");
     else if (strcmp(name, "n_smf_frag") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "smf_frag", val);
+      return varnish_map_gauge(ret, conf->instance, "struct", "objects",
+                               "smf_frag");
     else if (strcmp(name, "n_smf_large") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "smf_large", val);
+      return varnish_map_gauge(ret, conf->instance, "struct", "objects",
+                               "smf_large");
     else if (strcmp(name, "n_vbe_conn") == 0)
-      return varnish_submit_gauge(conf->instance, "struct", "objects",
-                                  "vbe_conn", val);
+      return varnish_map_gauge(ret, conf->instance, "struct", "objects",
+                               "vbe_conn");
   }
 
   if (conf->collect_totals) {
     if (strcmp(name, "s_sess") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_sessions",
-                                   "sessions", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_sessions",
+                                "sessions");
     else if (strcmp(name, "s_req") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_requests",
-                                   "requests", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_requests",
+                                "requests");
     else if (strcmp(name, "s_pipe") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
-                                   "pipe", val);
+      return varnish_map_derive(ret, conf->instance, "totals",
+                                "total_operations", "pipe");
     else if (strcmp(name, "s_pass") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
-                                   "pass", val);
+      return varnish_map_derive(ret, conf->instance, "totals",
+                                "total_operations", "pass");
     else if (strcmp(name, "s_fetch") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
-                                   "fetches", val);
+      return varnish_map_derive(ret, conf->instance, "totals",
+                                "total_operations", "fetches");
     else if (strcmp(name, "s_synth") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "synth", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_bytes",
+                                "synth");
     else if (strcmp(name, "s_req_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "req_header", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_bytes",
+                                "req_header");
     else if (strcmp(name, "s_req_bodybytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "req_body", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_bytes",
+                                "req_body");
     else if (strcmp(name, "s_req_protobytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "req_proto", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_bytes",
+                                "req_proto");
     else if (strcmp(name, "s_resp_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "resp_header", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_bytes",
+                                "resp_header");
     else if (strcmp(name, "s_resp_bodybytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "resp_body", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_bytes",
+                                "resp_body");
     else if (strcmp(name, "s_resp_protobytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "resp_proto", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_bytes",
+                                "resp_proto");
     else if (strcmp(name, "s_pipe_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "pipe_header", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_bytes",
+                                "pipe_header");
     else if (strcmp(name, "s_pipe_in") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "pipe_in", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_bytes",
+                                "pipe_in");
     else if (strcmp(name, "s_pipe_out") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "pipe_out", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_bytes",
+                                "pipe_out");
     else if (strcmp(name, "n_purges") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
-                                   "purges", val);
+      return varnish_map_derive(ret, conf->instance, "totals",
+                                "total_operations", "purges");
     else if (strcmp(name, "s_hdrbytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "header-bytes", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_bytes",
+                                "header-bytes");
     else if (strcmp(name, "s_bodybytes") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_bytes",
-                                   "body-bytes", val);
+      return varnish_map_derive(ret, conf->instance, "totals", "total_bytes",
+                                "body-bytes");
     else if (strcmp(name, "n_gzip") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
-                                   "gzip", val);
+      return varnish_map_derive(ret, conf->instance, "totals",
+                                "total_operations", "gzip");
     else if (strcmp(name, "n_gunzip") == 0)
-      return varnish_submit_derive(conf->instance, "totals", "total_operations",
-                                   "gunzip", val);
+      return varnish_map_derive(ret, conf->instance, "totals",
+                                "total_operations", "gunzip");
   }
 
   if (conf->collect_uptime) {
     if (strcmp(name, "uptime") == 0)
-      return varnish_submit_gauge(conf->instance, "uptime", "uptime",
-                                  "client_uptime", val);
+      return varnish_map_gauge(ret, conf->instance, "uptime", "uptime",
+                               "client_uptime");
   }
 
   if (conf->collect_vcl) {
     if (strcmp(name, "n_vcl") == 0)
-      return varnish_submit_gauge(conf->instance, "vcl", "vcl", "total_vcl",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "vcl", "vcl", "total_vcl");
     else if (strcmp(name, "n_vcl_avail") == 0)
-      return varnish_submit_gauge(conf->instance, "vcl", "vcl", "avail_vcl",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "vcl", "vcl", "avail_vcl");
     else if (strcmp(name, "n_vcl_discard") == 0)
-      return varnish_submit_gauge(conf->instance, "vcl", "vcl", "discarded_vcl",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "vcl", "vcl",
+                               "discarded_vcl");
     else if (strcmp(name, "vmods") == 0)
-      return varnish_submit_gauge(conf->instance, "vcl", "objects", "vmod",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "vcl", "objects", "vmod");
   }
 
   if (conf->collect_workers) {
     if (strcmp(name, "threads") == 0)
-      return varnish_submit_gauge(conf->instance, "workers", "threads",
-                                  "worker", val);
+      return varnish_map_gauge(ret, conf->instance, "workers", "threads",
+                               "worker");
     else if (strcmp(name, "threads_created") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "created", val);
+      return varnish_map_derive(ret, conf->instance, "workers", "total_threads",
+                                "created");
     else if (strcmp(name, "threads_failed") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "failed", val);
+      return varnish_map_derive(ret, conf->instance, "workers", "total_threads",
+                                "failed");
     else if (strcmp(name, "threads_limited") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "limited", val);
+      return varnish_map_derive(ret, conf->instance, "workers", "total_threads",
+                                "limited");
     else if (strcmp(name, "threads_destroyed") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "dropped", val);
+      return varnish_map_derive(ret, conf->instance, "workers", "total_threads",
+                                "dropped");
     else if (strcmp(name, "thread_queue_len") == 0)
-      return varnish_submit_gauge(conf->instance, "workers", "queue_length",
-                                  "threads", val);
+      return varnish_map_gauge(ret, conf->instance, "workers", "queue_length",
+                               "threads");
 #if HAVE_VARNISH_V2 || HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5
     else if (strcmp(name, "n_wrk") == 0)
-      return varnish_submit_gauge(conf->instance, "workers", "threads",
-                                  "worker", val);
+      return varnish_map_gauge(ret, conf->instance, "workers", "threads",
+                               "worker");
     else if (strcmp(name, "n_wrk_create") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "created", val);
+      return varnish_map_derive(ret, conf->instance, "workers", "total_threads",
+                                "created");
     else if (strcmp(name, "n_wrk_failed") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "failed", val);
+      return varnish_map_derive(ret, conf->instance, "workers", "total_threads",
+                                "failed");
     else if (strcmp(name, "n_wrk_max") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "limited", val);
+      return varnish_map_derive(ret, conf->instance, "workers", "total_threads",
+                                "limited");
     else if (strcmp(name, "n_wrk_drop") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_threads",
-                                   "dropped", val);
+      return varnish_map_derive(ret, conf->instance, "workers", "total_threads",
+                                "dropped");
     else if (strcmp(name, "n_wrk_queue") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_requests",
-                                   "queued", val);
+      return varnish_map_derive(ret, conf->instance, "workers",
+                                "total_requests", "queued");
     else if (strcmp(name, "n_wrk_overflow") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_requests",
-                                   "overflowed", val);
+      return varnish_map_derive(ret, conf->instance, "workers",
+                                "total_requests", "overflowed");
     else if (strcmp(name, "n_wrk_queued") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_requests",
-                                   "queued", val);
+      return varnish_map_derive(ret, conf->instance, "workers",
+                                "total_requests", "queued");
     else if (strcmp(name, "n_wrk_lqueue") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "total_requests",
-                                   "queue_length", val);
+      return varnish_map_derive(ret, conf->instance, "workers",
+                                "total_requests", "queue_length");
 #endif
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
     else if (strcmp(name, "pools") == 0)
-      return varnish_submit_gauge(conf->instance, "workers", "pools", "pools",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "workers", "pools",
+                               "pools");
     else if (strcmp(name, "busy_killed") == 0)
-      return varnish_submit_derive(conf->instance, "workers", "http_requests",
-                                   "busy_killed", val);
+      return varnish_map_derive(ret, conf->instance, "workers", "http_requests",
+                                "busy_killed");
 #endif
   }
 
 #if HAVE_VARNISH_V4 || HAVE_VARNISH_V5
   if (conf->collect_vsm) {
     if (strcmp(name, "vsm_free") == 0)
-      return varnish_submit_gauge(conf->instance, "vsm", "bytes", "free", val);
+      return varnish_map_gauge(ret, conf->instance, "vsm", "bytes", "free");
     else if (strcmp(name, "vsm_used") == 0)
-      return varnish_submit_gauge(conf->instance, "vsm", "bytes", "used", val);
+      return varnish_map_gauge(ret, conf->instance, "vsm", "bytes", "used");
     else if (strcmp(name, "vsm_cooling") == 0)
-      return varnish_submit_gauge(conf->instance, "vsm", "bytes", "cooling",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "vsm", "bytes", "cooling");
     else if (strcmp(name, "vsm_overflow") == 0)
-      return varnish_submit_gauge(conf->instance, "vsm", "bytes", "overflow",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "vsm", "bytes", "overflow");
     else if (strcmp(name, "vsm_overflowed") == 0)
-      return varnish_submit_derive(conf->instance, "vsm", "total_bytes",
-                                   "overflowed", val);
+      return varnish_map_derive(ret, conf->instance, "vsm", "total_bytes",
+                                "overflowed");
   }
 #endif
 
@@ -854,49 +884,53 @@ static int varnish_monitor(void *priv,
   if (conf->collect_vbe) {
     /* @TODO figure out the collectd type for bitmap
     if (strcmp(name, "happy") == 0)
-      return varnish_submit_derive(conf->instance, "vbe",
-                                   "bitmap", "happy_hprobes", val);
+      return varnish_map_derive(ret, conf->instance, "vbe", "bitmap",
+                                "happy_hprobes");
     */
     if (strcmp(name, "bereq_hdrbytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
-                                               stat_target, "total_bytes",
-                                               "bereq_hdrbytes", val);
+      return varnish_map_derive_with_target(ret, conf->instance, "vbe",
+                                            stat_target, "total_bytes",
+                                            "bereq_hdrbytes");
     else if (strcmp(name, "bereq_bodybytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
-                                               stat_target, "total_bytes",
-                                               "bereq_bodybytes", val);
+      return varnish_map_derive_with_target(ret, conf->instance, "vbe",
+                                            stat_target, "total_bytes",
+                                            "bereq_bodybytes");
     else if (strcmp(name, "bereq_protobytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
-                                               stat_target, "total_bytes",
-                                               "bereq_protobytes", val);
+      return varnish_map_derive_with_target(ret, conf->instance, "vbe",
+                                            stat_target, "total_bytes",
+                                            "bereq_protobytes");
     else if (strcmp(name, "beresp_hdrbytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
-                                               stat_target, "total_bytes",
-                                               "beresp_hdrbytes", val);
+      return varnish_map_derive_with_target(ret, conf->instance, "vbe",
+                                            stat_target, "total_bytes",
+                                            "beresp_hdrbytes");
     else if (strcmp(name, "beresp_bodybytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
-                                               stat_target, "total_bytes",
-                                               "beresp_bodybytes", val);
+      return varnish_map_derive_with_target(ret, conf->instance, "vbe",
+                                            stat_target, "total_bytes",
+                                            "beresp_bodybytes");
     else if (strcmp(name, "beresp_protobytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
-                                               stat_target, "total_bytes",
-                                               "beresp_protobytes", val);
+      return varnish_map_derive_with_target(ret, conf->instance, "vbe",
+                                            stat_target, "total_bytes",
+                                            "beresp_protobytes");
     else if (strcmp(name, "pipe_hdrbytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, "vbe",
-                                               stat_target, "total_bytes",
-                                               "pipe_hdrbytes", val);
+      return varnish_map_derive_with_target(ret, conf->instance, "vbe",
+                                            stat_target, "total_bytes",
+                                            "pipe_hdrbytes");
     else if (strcmp(name, "pipe_out") == 0)
-      return varnish_submit_derive_with_target(
-          conf->instance, "vbe", stat_target, "total_bytes", "pipe_out", val);
+      return varnish_map_derive_with_target(ret, conf->instance, "vbe",
+                                            stat_target, "total_bytes",
+                                            "pipe_out");
     else if (strcmp(name, "pipe_in") == 0)
-      return varnish_submit_derive_with_target(
-          conf->instance, "vbe", stat_target, "total_bytes", "pipe_in", val);
+      return varnish_map_derive_with_target(ret, conf->instance, "vbe",
+                                            stat_target, "total_bytes",
+                                            "pipe_in");
     else if (strcmp(name, "conn") == 0)
-      return varnish_submit_derive_with_target(
-          conf->instance, "vbe", stat_target, "connections", "c_conns", val);
+      return varnish_map_derive_with_target(ret, conf->instance, "vbe",
+                                            stat_target, "connections",
+                                            "c_conns");
     else if (strcmp(name, "req") == 0)
-      return varnish_submit_derive_with_target(
-          conf->instance, "vbe", stat_target, "http_requests", "b_reqs", val);
+      return varnish_map_derive_with_target(ret, conf->instance, "vbe",
+                                            stat_target, "http_requests",
+                                            "b_reqs");
   }
 
   /* All Stevedores support these counters */
@@ -911,236 +945,235 @@ static int varnish_monitor(void *priv,
       strncpy(category, "mse", 4);
 
     if (strcmp(name, "c_req") == 0)
-      return varnish_submit_derive_with_target(conf->instance, category,
-                                               stat_target, "total_operations",
-                                               "alloc_req", val);
+      return varnish_map_derive_with_target(ret, conf->instance, category,
+                                            stat_target, "total_operations",
+                                            "alloc_req");
     else if (strcmp(name, "c_fail") == 0)
-      return varnish_submit_derive_with_target(conf->instance, category,
-                                               stat_target, "total_operations",
-                                               "alloc_fail", val);
+      return varnish_map_derive_with_target(ret, conf->instance, category,
+                                            stat_target, "total_operations",
+                                            "alloc_fail");
     else if (strcmp(name, "c_bytes") == 0)
-      return varnish_submit_derive_with_target(conf->instance, category,
-                                               stat_target, "total_bytes",
-                                               "bytes_allocated", val);
+      return varnish_map_derive_with_target(ret, conf->instance, category,
+                                            stat_target, "total_bytes",
+                                            "bytes_allocated");
     else if (strcmp(name, "c_freed") == 0)
-      return varnish_submit_derive_with_target(conf->instance, category,
-                                               stat_target, "total_bytes",
-                                               "bytes_freed", val);
+      return varnish_map_derive_with_target(ret, conf->instance, category,
+                                            stat_target, "total_bytes",
+                                            "bytes_freed");
     else if (strcmp(name, "g_alloc") == 0)
-      return varnish_submit_derive_with_target(conf->instance, category,
-                                               stat_target, "total_operations",
-                                               "alloc_outstanding", val);
+      return varnish_map_derive_with_target(ret, conf->instance, category,
+                                            stat_target, "total_operations",
+                                            "alloc_outstanding");
     else if (strcmp(name, "g_bytes") == 0)
-      return varnish_submit_gauge_with_target(conf->instance, category,
-                                              stat_target, "bytes",
-                                              "bytes_outstanding", val);
+      return varnish_map_gauge_with_target(ret, conf->instance, category,
+                                           stat_target, "bytes",
+                                           "bytes_outstanding");
     else if (strcmp(name, "g_space") == 0)
-      return varnish_submit_gauge_with_target(conf->instance, category,
-                                              stat_target, "bytes",
-                                              "bytes_available", val);
+      return varnish_map_gauge_with_target(ret, conf->instance, category,
+                                           stat_target, "bytes",
+                                           "bytes_available");
   }
 
 #if HAVE_VARNISH_V6
   /* No SMA specific counters */
   if (conf->collect_mse) {
     if (strcmp(name, "c_fail_malloc") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "alloc_fail_malloc", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_operations",
+                                "alloc_fail_malloc");
     else if (strcmp(name, "n_lru_nuked") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_objects",
-                                   "lru_nuked", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_objects",
+                                "lru_nuked");
     else if (strcmp(name, "n_lru_moved") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_objects",
-                                   "lru_moved", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_objects",
+                                "lru_moved");
     else if (strcmp(name, "n_vary") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_objects",
-                                   "vary_headers", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_objects",
+                                "vary_headers");
     else if (strcmp(name, "c_memcache_hit") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "memcache_hit", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_operations",
+                                "memcache_hit");
     else if (strcmp(name, "c_memcache_miss") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "memcache_miss", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_operations",
+                                "memcache_miss");
     else if (strcmp(name, "g_ykey_keys") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "objects", "ykey",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "mse", "objects", "ykey");
   }
 #endif
 
   /* No SMA specific counters */
   if (conf->collect_smf) {
     if (strcmp(name, "g_smf") == 0)
-      return varnish_submit_gauge(conf->instance, "smf", "objects",
-                                  "n_struct_smf", val);
+      return varnish_map_gauge(ret, conf->instance, "smf", "objects",
+                               "n_struct_smf");
     else if (strcmp(name, "g_smf_frag") == 0)
-      return varnish_submit_gauge(conf->instance, "smf", "objects",
-                                  "n_small_free_smf", val);
+      return varnish_map_gauge(ret, conf->instance, "smf", "objects",
+                               "n_small_free_smf");
     else if (strcmp(name, "g_smf_large") == 0)
-      return varnish_submit_gauge(conf->instance, "smf", "objects",
-                                  "n_large_free_smf", val);
+      return varnish_map_gauge(ret, conf->instance, "smf", "objects",
+                               "n_large_free_smf");
   }
 
   if (conf->collect_mgt) {
     if (strcmp(name, "uptime") == 0)
-      return varnish_submit_gauge(conf->instance, "mgt", "uptime",
-                                  "mgt_proc_uptime", val);
+      return varnish_map_gauge(ret, conf->instance, "mgt", "uptime",
+                               "mgt_proc_uptime");
     else if (strcmp(name, "child_start") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
-                                   "child_start", val);
+      return varnish_map_derive(ret, conf->instance, "mgt", "total_operations",
+                                "child_start");
     else if (strcmp(name, "child_exit") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
-                                   "child_exit", val);
+      return varnish_map_derive(ret, conf->instance, "mgt", "total_operations",
+                                "child_exit");
     else if (strcmp(name, "child_stop") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
-                                   "child_stop", val);
+      return varnish_map_derive(ret, conf->instance, "mgt", "total_operations",
+                                "child_stop");
     else if (strcmp(name, "child_died") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
-                                   "child_died", val);
+      return varnish_map_derive(ret, conf->instance, "mgt", "total_operations",
+                                "child_died");
     else if (strcmp(name, "child_dump") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
-                                   "child_dump", val);
+      return varnish_map_derive(ret, conf->instance, "mgt", "total_operations",
+                                "child_dump");
     else if (strcmp(name, "child_panic") == 0)
-      return varnish_submit_derive(conf->instance, "mgt", "total_operations",
-                                   "child_panic", val);
+      return varnish_map_derive(ret, conf->instance, "mgt", "total_operations",
+                                "child_panic");
   }
 
   if (conf->collect_lck) {
     if (strcmp(name, "creat") == 0)
-      return varnish_submit_gauge(conf->instance, "lck", "objects", "created",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "lck", "objects",
+                               "created");
     else if (strcmp(name, "destroy") == 0)
-      return varnish_submit_gauge(conf->instance, "lck", "objects", "destroyed",
-                                  val);
+      return varnish_map_gauge(ret, conf->instance, "lck", "objects",
+                               "destroyed");
     else if (strcmp(name, "locks") == 0)
-      return varnish_submit_derive(conf->instance, "lck", "total_operations",
-                                   "lock_ops", val);
+      return varnish_map_derive(ret, conf->instance, "lck", "total_operations",
+                                "lock_ops");
   }
 
   if (conf->collect_mempool) {
     if (strcmp(name, "live") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "in_use", val);
+      return varnish_map_gauge(ret, conf->instance, "mempool", "objects",
+                               "in_use");
     else if (strcmp(name, "pool") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "in_pool", val);
+      return varnish_map_gauge(ret, conf->instance, "mempool", "objects",
+                               "in_pool");
     else if (strcmp(name, "sz_wanted") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "bytes",
-                                  "size_requested", val);
+      return varnish_map_gauge(ret, conf->instance, "mempool", "bytes",
+                               "size_requested");
     else if (strcmp(name, "sz_actual") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "bytes",
-                                  "size_allocated", val);
+      return varnish_map_gauge(ret, conf->instance, "mempool", "bytes",
+                               "size_allocated");
     else if (strcmp(name, "allocs") == 0)
-      return varnish_submit_derive(conf->instance, "mempool",
-                                   "total_operations", "allocations", val);
+      return varnish_map_derive(ret, conf->instance, "mempool",
+                                "total_operations", "allocations");
     else if (strcmp(name, "frees") == 0)
-      return varnish_submit_derive(conf->instance, "mempool",
-                                   "total_operations", "frees", val);
+      return varnish_map_derive(ret, conf->instance, "mempool",
+                                "total_operations", "frees");
     else if (strcmp(name, "recycle") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "recycled", val);
+      return varnish_map_gauge(ret, conf->instance, "mempool", "objects",
+                               "recycled");
     else if (strcmp(name, "timeout") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "timed_out", val);
+      return varnish_map_gauge(ret, conf->instance, "mempool", "objects",
+                               "timed_out");
     else if (strcmp(name, "toosmall") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "too_small", val);
+      return varnish_map_gauge(ret, conf->instance, "mempool", "objects",
+                               "too_small");
     else if (strcmp(name, "surplus") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "surplus", val);
+      return varnish_map_gauge(ret, conf->instance, "mempool", "objects",
+                               "surplus");
     else if (strcmp(name, "randry") == 0)
-      return varnish_submit_gauge(conf->instance, "mempool", "objects",
-                                  "ran_dry", val);
+      return varnish_map_gauge(ret, conf->instance, "mempool", "objects",
+                               "ran_dry");
   }
 
   if (conf->collect_mse) {
     if (strcmp(name, "c_full") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "full_allocs", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_operations",
+                                "full_allocs");
     else if (strcmp(name, "c_truncated") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "truncated_allocs", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_operations",
+                                "truncated_allocs");
     else if (strcmp(name, "c_expanded") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "expanded_allocs", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_operations",
+                                "expanded_allocs");
     else if (strcmp(name, "c_failed") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "failed_allocs", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_operations",
+                                "failed_allocs");
     else if (strcmp(name, "c_bytes") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_bytes",
-                                   "bytes_allocated", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_bytes",
+                                "bytes_allocated");
     else if (strcmp(name, "c_freed") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_bytes",
-                                   "bytes_freed", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_bytes",
+                                "bytes_freed");
     else if (strcmp(name, "g_fo_alloc") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "fo_allocs_outstanding", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_operations",
+                                "fo_allocs_outstanding");
     else if (strcmp(name, "g_fo_bytes") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "bytes",
-                                  "fo_bytes_outstanding", val);
+      return varnish_map_gauge(ret, conf->instance, "mse", "bytes",
+                               "fo_bytes_outstanding");
     else if (strcmp(name, "g_membuf_alloc") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "objects",
-                                  "membufs_allocated", val);
+      return varnish_map_gauge(ret, conf->instance, "mse", "objects",
+                               "membufs_allocated");
     else if (strcmp(name, "g_membuf_inuse") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "objects",
-                                  "membufs_inuse", val);
+      return varnish_map_gauge(ret, conf->instance, "mse", "objects",
+                               "membufs_inuse");
     else if (strcmp(name, "g_bans_bytes") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "bytes",
-                                  "persisted_banspace_used", val);
+      return varnish_map_gauge(ret, conf->instance, "mse", "bytes",
+                               "persisted_banspace_used");
     else if (strcmp(name, "g_bans_space") == 0)
-      return varnish_submit_gauge(conf->instance, "mse", "bytes",
-                                  "persisted_banspace_available", val);
+      return varnish_map_gauge(ret, conf->instance, "mse", "bytes",
+                               "persisted_banspace_available");
     else if (strcmp(name, "g_bans_persisted") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "bans_persisted", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_operations",
+                                "bans_persisted");
     else if (strcmp(name, "g_bans_lost") == 0)
-      return varnish_submit_derive(conf->instance, "mse", "total_operations",
-                                   "bans_lost", val);
+      return varnish_map_derive(ret, conf->instance, "mse", "total_operations",
+                                "bans_lost");
 
     /* mse seg */
     else if (strcmp(name, "g_journal_bytes") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_reg", "bytes",
-                                  "journal_bytes_used", val);
+      return varnish_map_gauge(ret, conf->instance, "mse_reg", "bytes",
+                               "journal_bytes_used");
     else if (strcmp(name, "g_journal_space") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_reg", "bytes",
-                                  "journal_bytes_free", val);
+      return varnish_map_gauge(ret, conf->instance, "mse_reg", "bytes",
+                               "journal_bytes_free");
 
     /* mse segagg */
     else if (strcmp(name, "g_bigspace") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "bytes",
-                                  "big_extents_bytes_available", val);
+      return varnish_map_gauge(ret, conf->instance, "mse_segagg", "bytes",
+                               "big_extents_bytes_available");
     else if (strcmp(name, "g_extfree") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
-                                  "free_extents", val);
+      return varnish_map_gauge(ret, conf->instance, "mse_segagg", "objects",
+                               "free_extents");
     else if (strcmp(name, "g_sparenode") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
-                                  "spare_nodes_available", val);
+      return varnish_map_gauge(ret, conf->instance, "mse_segagg", "objects",
+                               "spare_nodes_available");
     else if (strcmp(name, "g_objnode") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
-                                  "object_nodes_in_use", val);
+      return varnish_map_gauge(ret, conf->instance, "mse_segagg", "objects",
+                               "object_nodes_in_use");
     else if (strcmp(name, "g_extnode") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
-                                  "extent_nodes_in_use", val);
+      return varnish_map_gauge(ret, conf->instance, "mse_segagg", "objects",
+                               "extent_nodes_in_use");
     else if (strcmp(name, "g_bigextfree") == 0)
-      return varnish_submit_gauge(conf->instance, "mse_segagg", "objects",
-                                  "free_big_extents", val);
+      return varnish_map_gauge(ret, conf->instance, "mse_segagg", "objects",
+                               "free_big_extents");
     else if (strcmp(name, "c_pruneloop") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
-                                   "total_operations", "prune_loops", val);
+      return varnish_map_derive(ret, conf->instance, "mse_segagg",
+                                "total_operations", "prune_loops");
     else if (strcmp(name, "c_pruned") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
-                                   "total_objects", "pruned_objects", val);
+      return varnish_map_derive(ret, conf->instance, "mse_segagg",
+                                "total_objects", "pruned_objects");
     else if (strcmp(name, "c_spared") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
-                                   "total_operations", "spared_objects", val);
+      return varnish_map_derive(ret, conf->instance, "mse_segagg",
+                                "total_operations", "spared_objects");
     else if (strcmp(name, "c_skipped") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
-                                   "total_operations", "missed_objects", val);
+      return varnish_map_derive(ret, conf->instance, "mse_segagg",
+                                "total_operations", "missed_objects");
     else if (strcmp(name, "c_nuked") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
-                                   "total_operations", "nuked_objects", val);
+      return varnish_map_derive(ret, conf->instance, "mse_segagg",
+                                "total_operations", "nuked_objects");
     else if (strcmp(name, "c_sniped") == 0)
-      return varnish_submit_derive(conf->instance, "mse_segagg",
-                                   "total_operations", "sniped_objects", val);
+      return varnish_map_derive(ret, conf->instance, "mse_segagg",
+                                "total_operations", "sniped_objects");
   }
 
 #endif
@@ -1148,20 +1181,132 @@ static int varnish_monitor(void *priv,
 #if HAVE_VARNISH_V6
   if (conf->collect_goto) {
     if (strcmp(name, "goto_dns_cache_hits") == 0)
-      return varnish_submit_derive(conf->instance, "goto", "total_operations",
-                                   "dns_cache_hits", val);
+      return varnish_map_derive(ret, conf->instance, "goto", "total_operations",
+                                "dns_cache_hits");
     else if (strcmp(name, "goto_dns_lookups") == 0)
-      return varnish_submit_derive(conf->instance, "goto", "total_operations",
-                                   "dns_lookups", val);
+      return varnish_map_derive(ret, conf->instance, "goto", "total_operations",
+                                "dns_lookups");
     else if (strcmp(name, "goto_dns_lookup_fails") == 0)
-      return varnish_submit_derive(conf->instance, "goto", "total_operations",
-                                   "dns_lookup_fails", val);
+      return varnish_map_derive(ret, conf->instance, "goto", "total_operations",
+                                "dns_lookup_fails");
   }
 #endif
 
   return 0;
 
-} /* }}} static int varnish_monitor */
+} /* }}} int varnish_counter_resolve */
+
+/* Returns the cached mapping of the counter "key", resolving and caching it
+ * if the counter hasn't been seen before. */
+static varnish_counter_t *varnish_counter_get(user_config_t *conf, /* {{{ */
+                                              const char *key) {
+  llentry_t *le = llist_search(conf->counters, key);
+  if (le != NULL)
+    return le->value;
+
+  varnish_counter_t *c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return NULL;
+  varnish_counter_resolve(conf, key, c);
+
+  char *key_copy = strdup(key);
+  le = (key_copy != NULL) ? llentry_create(key_copy, c) : NULL;
+  if (le == NULL) {
+    sfree(key_copy);
+    sfree(c);
+    return NULL;
+  }
+  llist_append(conf->counters, le);
+
+  return c;
+} /* }}} varnish_counter_t *varnish_counter_get */
+
+/* Removes counters which have not been seen by the last read, e.g. those of a
+ * backend or VCL that has been discarded. */
+static void varnish_counters_prune(user_config_t *conf) /* {{{ */
+{
+  llentry_t *le = llist_head(conf->counters);
+
+  while (le != NULL) {
+    llentry_t *next = le->next;
+    varnish_counter_t *c = le->value;
+
+    if (c->generation != conf->generation) {
+      llist_remove(conf->counters, le);
+      sfree(le->key);
+      sfree(c);
+      llentry_destroy(le);
+    }
+
+    le = next;
+  }
+} /* }}} void varnish_counters_prune */
+
+static void varnish_counters_free(llist_t *counters) /* {{{ */
+{
+  if (counters == NULL)
+    return;
+
+  for (llentry_t *le = llist_head(counters); le != NULL; le = le->next) {
+    sfree(le->key);
+    sfree(le->value);
+  }
+  llist_destroy(counters);
+} /* }}} void varnish_counters_free */
+
+static int varnish_monitor(void *priv,
+                           const struct VSC_point *const pt) /* {{{ */
+{
+  user_config_t *conf;
+  const char *key;
+
+  if (pt == NULL)
+    return 0;
+
+  conf = priv;
+
+#if HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+  key = pt->name;
+#elif HAVE_VARNISH_V4
+  if (strcmp(pt->section->fantom->type, "MAIN") != 0)
+    return 0;
+
+  key = pt->desc->name;
+#elif HAVE_VARNISH_V3
+  if (strcmp(pt->class, "") != 0)
+    return 0;
+
+  key = pt->name;
+#endif
+
+  varnish_counter_t *c = varnish_counter_get(conf, key);
+  if (c == NULL)
+    return 0;
+
+  c->generation = conf->generation;
+  conf->counters_seen++;
+
+  if (c->ds_type < 0)
+    return 0;
+
+  value_list_t vl = VALUE_LIST_INIT;
+  uint64_t val = *(const volatile uint64_t *)pt->ptr;
+  value_t value;
+
+  if (c->ds_type == DS_TYPE_GAUGE)
+    value.gauge = (gauge_t)val;
+  else
+    value.derive = (derive_t)val;
+  vl.values = &value;
+  vl.values_len = 1;
+
+  sstrncpy(vl.plugin, "varnish", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, c->plugin_instance, sizeof(vl.plugin_instance));
+  sstrncpy(vl.type, c->type, sizeof(vl.type));
+  sstrncpy(vl.type_instance, c->type_instance, sizeof(vl.type_instance));
+
+  return plugin_dispatch_values(&vl);
+} /* }}} int varnish_monitor */
 #else /* if HAVE_VARNISH_V2 */
 static void varnish_monitor(const user_config_t *conf, /* {{{ */
                             const c_varnish_stats_t *stats) {
@@ -1597,6 +1742,22 @@ static int varnish_read(user_data_t *ud) /* {{{ */
   }
 #endif
 
+  if (conf->counters == NULL) {
+    conf->counters = llist_create();
+    if (conf->counters == NULL) {
+      ERROR("varnish plugin: llist_create failed.");
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
+      VSM_Delete(vd);
+#elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+      VSC_Destroy(&vsc, vd);
+      VSM_Destroy(&vd);
+#endif
+      return -1;
+    }
+  }
+  conf->generation++;
+  conf->counters_seen = 0;
+
 #if HAVE_VARNISH_V3
   VSC_Iter(vd, varnish_monitor, conf);
 #elif HAVE_VARNISH_V4
@@ -1605,6 +1766,10 @@ static int varnish_read(user_data_t *ud) /* {{{ */
   VSC_Iter(vsc, vd, varnish_monitor, conf);
 #endif
 
+  /* Counters have been removed, e.g. because a VCL has been discarded. */
+  if (conf->counters_seen < llist_size(conf->counters))
+    varnish_counters_prune(conf);
+
 #if HAVE_VARNISH_V3 || HAVE_VARNISH_V4
   VSM_Delete(vd);
 #elif HAVE_VARNISH_V5 || HAVE_VARNISH_V6
@@ -1646,6 +1811,9 @@ static void varnish_config_free(void *ptr) /* {{{ */
   if (conf == NULL)
     return;
 
+#if HAVE_VARNISH_V3 || HAVE_VARNISH_V4 || HAVE_VARNISH_V5 || HAVE_VARNISH_V6
+  varnish_counters_free(conf->counters);
+#endif
   sfree(conf->instance);
   sfree(conf);
 } /* }}} */
@@ -87,6 +87,10 @@
 #define HAVE_DOM_REASON_PAUSED_CRASHED 1
 #endif
 
+#if LIBVIR_CHECK_VERSION(1, 2, 8)
+#define HAVE_LIST_GET_STATS 1
+#endif
+
 #if LIBVIR_CHECK_VERSION(1, 2, 9)
 #define HAVE_JOB_STATS 1
 #endif
@@ -500,6 +504,52 @@ typedef struct domain_s {
   bool active;
 } domain_t;
 
+struct lv_block_stats {
+  virDomainBlockStatsStruct bi;
+
+  long long rd_total_times;
+  long long wr_total_times;
+
+  long long fl_req;
+  long long fl_total_times;
+};
+
+#ifdef HAVE_LIST_GET_STATS
+/* Statistics of a block device, parsed from a virDomainStatsRecord. */
+struct lv_bulk_block {
+  const char *name; /* target, e.g. "vda" */
+  const char *path; /* source */
+  struct lv_block_stats bstats;
+  virDomainBlockInfo binfo;
+};
+
+/* Statistics of a network interface, parsed from a virDomainStatsRecord. */
+struct lv_bulk_interface {
+  const char *name;
+  virDomainInterfaceStatsStruct stats;
+};
+
+/* Statistics of one domain, parsed from a virDomainStatsRecord. The arrays are
+ * reused for all domains and read cycles; the strings point into the record
+ * and are only valid as long as the record is. */
+struct lv_bulk_stats {
+  virDomainPtr *domains; /* NULL terminated argument of virDomainListGetStats */
+  size_t domains_size;
+
+  /* Fields of `info' found in the record, see `lv_bulk_info_fields'. */
+  unsigned int info_fields;
+  virDomainInfo info;
+
+  struct lv_bulk_block *blocks;
+  size_t nr_blocks;
+  size_t blocks_size;
+
+  struct lv_bulk_interface *interfaces;
+  size_t nr_interfaces;
+  size_t interfaces_size;
+};
+#endif /* HAVE_LIST_GET_STATS */
+
 struct lv_read_state {
   /* Actual list of domains found on last refresh. */
   domain_t *domains;
@@ -510,6 +560,10 @@ struct lv_read_state {
 
   struct interface_device *interface_devices;
   int nr_interface_devices;
+
+#ifdef HAVE_LIST_GET_STATS
+  struct lv_bulk_stats bulk;
+#endif
 };
 
 static void free_domains(struct lv_read_state *state);
@@ -536,6 +590,11 @@ struct lv_read_instance {
   struct lv_read_state read_state;
   char tag[PARTITION_TAG_MAX_LEN];
   size_t id;
+
+  /* Time that we last refreshed and the value of `lists_generation' at that
+   * time. */
+  time_t last_refresh;
+  unsigned long lists_generation;
 };
 
 struct lv_user_data {
@@ -645,23 +704,20 @@ static bool blockdevice_format_basename;
 static enum bd_field blockdevice_format = target;
 static enum if_field interface_format = if_name;
 
-/* Time that we last refreshed. */
-static time_t last_refresh = (time_t)0;
+/* Incremented whenever the lists of domains and devices have to be
+ * refreshed, e.g. on domain lifecycle events. */
+static unsigned long lists_generation;
+static pthread_mutex_t lists_generation_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef HAVE_LIST_GET_STATS
+/* Cleared if the hypervisor driver does not implement bulk statistics. */
+static bool bulk_stats_supported = true;
+#endif
 
 static int refresh_lists(struct lv_read_instance *inst);
 static int register_event_impl(void);
 static int start_event_loop(virt_notif_thread_t *thread_data);
 
-struct lv_block_stats {
-  virDomainBlockStatsStruct bi;
-
-  long long rd_total_times;
-  long long wr_total_times;
-
-  long long fl_req;
-  long long fl_total_times;
-};
-
 static void init_block_stats(struct lv_block_stats *bstats) {
   if (bstats == NULL)
     return;
@@ -1546,6 +1602,10 @@ static int lv_domain_block_stats(virDomainPtr dom, const char *path,
 #ifdef HAVE_PERF_STATS
 static void perf_submit(virDomainStatsRecordPtr stats) {
   for (int i = 0; i < stats->nparams; ++i) {
+    /* Bulk records contain other stat groups, too. */
+    if (strncmp(stats->params[i].field, "perf.", strlen("perf.")) != 0)
+      continue;
+
     /* Replace '.' with '_' in event field to match other metrics' naming
      * convention */
     char *c = strchr(stats->params[i].field, '.');
@@ -2079,19 +2139,11 @@ static int get_job_stats(virDomainPtr domain) {
 }
 #endif /* HAVE_JOB_STATS */
 
-static int get_domain_metrics(domain_t *domain) {
-  if (!domain || !domain->ptr) {
-    ERROR(PLUGIN_NAME " plugin: get_domain_metrics: NULL pointer");
-    return -1;
-  }
-
-  virDomainInfo info;
-  int status = virDomainGetInfo(domain->ptr, &info);
-  if (status != 0) {
-    ERROR(PLUGIN_NAME " plugin: virDomainGetInfo failed with status %i.",
-          status);
-    return -1;
-  }
+/* Submits the metrics of a domain. If `record' is not NULL, it holds the
+ * stat groups which have been retrieved in bulk already. */
+static int submit_domain_metrics(domain_t *domain, const virDomainInfo *info,
+                                 virDomainStatsRecordPtr record) {
+  int status = 0;
 
   if (extra_stats & ex_stats_domain_state) {
 #ifdef HAVE_DOM_REASON
@@ -2104,7 +2156,7 @@ static int get_domain_metrics(domain_t *domain) {
   }
 
   /* Gather remaining stats only for running domains */
-  if (info.state != VIR_DOMAIN_RUNNING)
+  if (info->state != VIR_DOMAIN_RUNNING)
     return 0;
 
 #ifdef HAVE_CPU_STATS
@@ -2112,18 +2164,23 @@ static int get_domain_metrics(domain_t *domain) {
     get_pcpu_stats(domain->ptr);
 #endif
 
-  cpu_submit(domain, info.cpuTime);
+  cpu_submit(domain, info->cpuTime);
 
-  memory_submit(domain->ptr, (gauge_t)info.memory * 1024);
+  memory_submit(domain->ptr, (gauge_t)info->memory * 1024);
 
   if (extra_stats & (ex_stats_vcpu | ex_stats_vcpupin))
-    GET_STATS(get_vcpu_stats, "vcpu stats", domain->ptr, info.nrVirtCpu);
+    GET_STATS(get_vcpu_stats, "vcpu stats", domain->ptr, info->nrVirtCpu);
   if (extra_stats & ex_stats_memory)
     GET_STATS(get_memory_stats, "memory stats", domain->ptr);
 
 #ifdef HAVE_PERF_STATS
-  if (extra_stats & ex_stats_perf)
-    GET_STATS(get_perf_events, "performance monitoring events", domain->ptr);
+  if (extra_stats & ex_stats_perf) {
+    if (record != NULL)
+      perf_submit(record);
+    else
+      GET_STATS(get_perf_events, "performance monitoring events",
+                domain->ptr);
+  }
 #endif
 
 #ifdef HAVE_FS_INFO
@@ -2143,20 +2200,32 @@ static int get_domain_metrics(domain_t *domain) {
 #endif
 
   /* Update cached virDomainInfo. It has to be done after cpu_submit */
-  memcpy(&domain->info, &info, sizeof(domain->info));
+  memcpy(&domain->info, info, sizeof(domain->info));
 
   return 0;
 }
 
-static int get_if_dev_stats(struct interface_device *if_dev) {
-  virDomainInterfaceStatsStruct stats = {0};
-  char *display_name = NULL;
+static int get_domain_metrics(domain_t *domain) {
+  if (!domain || !domain->ptr) {
+    ERROR(PLUGIN_NAME " plugin: get_domain_metrics: NULL pointer");
+    return -1;
+  }
 
-  if (!if_dev) {
-    ERROR(PLUGIN_NAME " plugin: get_if_dev_stats: NULL pointer");
+  virDomainInfo info;
+  int status = virDomainGetInfo(domain->ptr, &info);
+  if (status != 0) {
+    ERROR(PLUGIN_NAME " plugin: virDomainGetInfo failed with status %i.",
+          status);
     return -1;
   }
 
+  return submit_domain_metrics(domain, &info, /* record = */ NULL);
+}
+
+static void if_dev_stats_submit(const virDomainInterfaceStatsStruct *stats,
+                                const struct interface_device *if_dev) {
+  char *display_name = NULL;
+
   switch (interface_format) {
   case if_address:
     display_name = if_dev->address;
@@ -2169,28 +2238,52 @@ static int get_if_dev_stats(struct interface_device *if_dev) {
     display_name = if_dev->path;
   }
 
+  if ((stats->rx_bytes != -1) && (stats->tx_bytes != -1))
+    submit_derive2("if_octets", (derive_t)stats->rx_bytes,
+                   (derive_t)stats->tx_bytes, if_dev->dom, display_name);
+
+  if ((stats->rx_packets != -1) && (stats->tx_packets != -1))
+    submit_derive2("if_packets", (derive_t)stats->rx_packets,
+                   (derive_t)stats->tx_packets, if_dev->dom, display_name);
+
+  if ((stats->rx_errs != -1) && (stats->tx_errs != -1))
+    submit_derive2("if_errors", (derive_t)stats->rx_errs,
+                   (derive_t)stats->tx_errs, if_dev->dom, display_name);
+
+  if ((stats->rx_drop != -1) && (stats->tx_drop != -1))
+    submit_derive2("if_dropped", (derive_t)stats->rx_drop,
+                   (derive_t)stats->tx_drop, if_dev->dom, display_name);
+}
+
+static int get_if_dev_stats(struct interface_device *if_dev) {
+  virDomainInterfaceStatsStruct stats = {0};
+
+  if (!if_dev) {
+    ERROR(PLUGIN_NAME " plugin: get_if_dev_stats: NULL pointer");
+    return -1;
+  }
+
   if (virDomainInterfaceStats(if_dev->dom, if_dev->path, &stats,
                               sizeof(stats)) != 0) {
     ERROR(PLUGIN_NAME " plugin: virDomainInterfaceStats failed");
     return -1;
   }
 
-  if ((stats.rx_bytes != -1) && (stats.tx_bytes != -1))
-    submit_derive2("if_octets", (derive_t)stats.rx_bytes,
-                   (derive_t)stats.tx_bytes, if_dev->dom, display_name);
-
-  if ((stats.rx_packets != -1) && (stats.tx_packets != -1))
-    submit_derive2("if_packets", (derive_t)stats.rx_packets,
-                   (derive_t)stats.tx_packets, if_dev->dom, display_name);
+  if_dev_stats_submit(&stats, if_dev);
+  return 0;
+}
 
-  if ((stats.rx_errs != -1) && (stats.tx_errs != -1))
-    submit_derive2("if_errors", (derive_t)stats.rx_errs,
-                   (derive_t)stats.tx_errs, if_dev->dom, display_name);
+static void lists_changed(void) {
+  pthread_mutex_lock(&lists_generation_lock);
+  lists_generation++;
+  pthread_mutex_unlock(&lists_generation_lock);
+}
 
-  if ((stats.rx_drop != -1) && (stats.tx_drop != -1))
-    submit_derive2("if_dropped", (derive_t)stats.rx_drop,
-                   (derive_t)stats.tx_drop, if_dev->dom, display_name);
-  return 0;
+static unsigned long get_lists_generation(void) {
+  pthread_mutex_lock(&lists_generation_lock);
+  unsigned long generation = lists_generation;
+  pthread_mutex_unlock(&lists_generation_lock);
+  return generation;
 }
 
 static int domain_lifecycle_event_cb(__attribute__((unused)) virConnectPtr con_,
@@ -2203,6 +2296,10 @@ static int domain_lifecycle_event_cb(__attribute__((unused)) virConnectPtr con_,
 #endif
   domain_state_submit_notif(dom, domain_state, domain_reason);
 
+  /* Domains have been started, stopped, etc.: refresh the cached lists of
+   * domains and devices on the next read. */
+  lists_changed();
+
   return 0;
 }
 
@@ -2401,6 +2498,338 @@ static int persistent_domains_state_notification(void) {
   return status;
 }
 
+#ifdef HAVE_LIST_GET_STATS
+static long long typed_param_to_ll(const virTypedParameter *param) {
+  switch (param->type) {
+  case VIR_TYPED_PARAM_INT:
+    return param->value.i;
+  case VIR_TYPED_PARAM_UINT:
+    return param->value.ui;
+  case VIR_TYPED_PARAM_LLONG:
+    return param->value.l;
+  case VIR_TYPED_PARAM_ULLONG:
+    return (long long)param->value.ul;
+  default:
+    return -1;
+  }
+}
+
+static void lv_bulk_block_set(struct lv_bulk_block *b, const char *key,
+                              const virTypedParameter *param) {
+  if (param->type == VIR_TYPED_PARAM_STRING) {
+    if (strcmp(key, "name") == 0)
+      b->name = param->value.s;
+    else if (strcmp(key, "path") == 0)
+      b->path = param->value.s;
+    return;
+  }
+
+  long long value = typed_param_to_ll(param);
+  if (strcmp(key, "rd.reqs") == 0)
+    b->bstats.bi.rd_req = value;
+  else if (strcmp(key, "rd.bytes") == 0)
+    b->bstats.bi.rd_bytes = value;
+  else if (strcmp(key, "rd.times") == 0)
+    b->bstats.rd_total_times = value;
+  else if (strcmp(key, "wr.reqs") == 0)
+    b->bstats.bi.wr_req = value;
+  else if (strcmp(key, "wr.bytes") == 0)
+    b->bstats.bi.wr_bytes = value;
+  else if (strcmp(key, "wr.times") == 0)
+    b->bstats.wr_total_times = value;
+  else if (strcmp(key, "fl.reqs") == 0)
+    b->bstats.fl_req = value;
+  else if (strcmp(key, "fl.times") == 0)
+    b->bstats.fl_total_times = value;
+  else if (strcmp(key, "allocation") == 0)
+    b->binfo.allocation = (unsigned long long)value;
+  else if (strcmp(key, "capacity") == 0)
+    b->binfo.capacity = (unsigned long long)value;
+  else if (strcmp(key, "physical") == 0)
+    b->binfo.physical = (unsigned long long)value;
+}
+
+static void lv_bulk_interface_set(struct lv_bulk_interface *itf,
+                                  const char *key,
+                                  const virTypedParameter *param) {
+  if (param->type == VIR_TYPED_PARAM_STRING) {
+    if (strcmp(key, "name") == 0)
+      itf->name = param->value.s;
+    return;
+  }
+
+  long long value = typed_param_to_ll(param);
+  if (strcmp(key, "rx.bytes") == 0)
+    itf->stats.rx_bytes = value;
+  else if (strcmp(key, "rx.pkts") == 0)
+    itf->stats.rx_packets = value;
+  else if (strcmp(key, "rx.errs") == 0)
+    itf->stats.rx_errs = value;
+  else if (strcmp(key, "rx.drop") == 0)
+    itf->stats.rx_drop = value;
+  else if (strcmp(key, "tx.bytes") == 0)
+    itf->stats.tx_bytes = value;
+  else if (strcmp(key, "tx.pkts") == 0)
+    itf->stats.tx_packets = value;
+  else if (strcmp(key, "tx.errs") == 0)
+    itf->stats.tx_errs = value;
+  else if (strcmp(key, "tx.drop") == 0)
+    itf->stats.tx_drop = value;
+}
+
+/* Parses "<prefix>.<index>.<key>" and returns a pointer to <key>, or NULL if
+ * the field does not look like this or the index is out of range. */
+static const char *lv_bulk_field_index(const char *field, const char *prefix,
+                                       size_t num, size_t *ret_index) {
+  size_t prefix_len = strlen(prefix);
+  if (strncmp(field, prefix, prefix_len) != 0)
+    return NULL;
+
+  char *endptr = NULL;
+  unsigned long index = strtoul(field + prefix_len, &endptr, 10);
+  if ((endptr == field + prefix_len) || (*endptr != '.') || (index >= num))
+    return NULL;
+
+  *ret_index = (size_t)index;
+  return endptr + 1;
+}
+
+/* Makes sure `*array' can hold `num' elements of size `elem_size'. */
+static int lv_bulk_reserve(void **array, size_t *size, size_t num,
+                           size_t elem_size) {
+  if (num <= *size)
+    return 0;
+
+  void *tmp = realloc(*array, num * elem_size);
+  if (tmp == NULL) {
+    ERROR(PLUGIN_NAME " plugin: realloc failed.");
+    return ENOMEM;
+  }
+  *array = tmp;
+  *size = num;
+  return 0;
+}
+
+#define LV_BULK_INFO_STATE 0x01
+#define LV_BULK_INFO_CPU 0x02
+#define LV_BULK_INFO_MEMORY 0x04
+#define LV_BULK_INFO_VCPU 0x08
+
+/* Returns the fields of virDomainInfo that submit_domain_metrics() needs. */
+static unsigned int lv_bulk_info_fields(void) {
+  unsigned int fields =
+      LV_BULK_INFO_STATE | LV_BULK_INFO_CPU | LV_BULK_INFO_MEMORY;
+  if (extra_stats & (ex_stats_vcpu | ex_stats_vcpupin))
+    fields |= LV_BULK_INFO_VCPU;
+  return fields;
+}
+
+static int lv_bulk_parse(struct lv_bulk_stats *bulk,
+                         virDomainStatsRecordPtr record) {
+  size_t nr_blocks = 0;
+  size_t nr_interfaces = 0;
+
+  /* The counts precede the per-device fields, but don't rely on it. */
+  for (int i = 0; i < record->nparams; ++i) {
+    if (strcmp(record->params[i].field, "block.count") == 0)
+      nr_blocks = (size_t)typed_param_to_ll(&record->params[i]);
+    else if (strcmp(record->params[i].field, "net.count") == 0)
+      nr_interfaces = (size_t)typed_param_to_ll(&record->params[i]);
+  }
+
+  if ((lv_bulk_reserve((void **)&bulk->blocks, &bulk->blocks_size, nr_blocks,
+                       sizeof(*bulk->blocks)) != 0) ||
+      (lv_bulk_reserve((void **)&bulk->interfaces, &bulk->interfaces_size,
+                       nr_interfaces, sizeof(*bulk->interfaces)) != 0))
+    return ENOMEM;
+
+  bulk->nr_blocks = nr_blocks;
+  for (size_t i = 0; i < nr_blocks; ++i) {
+    bulk->blocks[i].name = NULL;
+    bulk->blocks[i].path = NULL;
+    init_block_stats(&bulk->blocks[i].bstats);
+    init_block_info(&bulk->blocks[i].binfo);
+  }
+
+  bulk->nr_interfaces = nr_interfaces;
+  for (size_t i = 0; i < nr_interfaces; ++i) {
+    bulk->interfaces[i].name = NULL;
+    memset(&bulk->interfaces[i].stats, 0xff,
+           sizeof(bulk->interfaces[i].stats)); /* all -1 */
+  }
+
+  bulk->info_fields = 0;
+  memset(&bulk->info, 0, sizeof(bulk->info));
+
+  for (int i = 0; i < record->nparams; ++i) {
+    const virTypedParameter *param = &record->params[i];
+    const char *key;
+    size_t index;
+
+    if ((key = lv_bulk_field_index(param->field, "block.", nr_blocks,
+                                   &index)) != NULL)
+      lv_bulk_block_set(&bulk->blocks[index], key, param);
+    else if ((key = lv_bulk_field_index(param->field, "net.", nr_interfaces,
+                                        &index)) != NULL)
+      lv_bulk_interface_set(&bulk->interfaces[index], key, param);
+    else if (strcmp(param->field, "state.state") == 0) {
+      bulk->info.state = (unsigned char)typed_param_to_ll(param);
+      bulk->info_fields |= LV_BULK_INFO_STATE;
+    } else if (strcmp(param->field, "cpu.time") == 0) {
+      bulk->info.cpuTime = (unsigned long long)typed_param_to_ll(param);
+      bulk->info_fields |= LV_BULK_INFO_CPU;
+    } else if (strcmp(param->field, "balloon.current") == 0) {
+      bulk->info.memory = (unsigned long)typed_param_to_ll(param);
+      bulk->info_fields |= LV_BULK_INFO_MEMORY;
+    } else if (strcmp(param->field, "balloon.maximum") == 0) {
+      bulk->info.maxMem = (unsigned long)typed_param_to_ll(param);
+    } else if (strcmp(param->field, "vcpu.current") == 0) {
+      bulk->info.nrVirtCpu = (unsigned short)typed_param_to_ll(param);
+      bulk->info_fields |= LV_BULK_INFO_VCPU;
+    }
+  }
+
+  return 0;
+}
+
+static domain_t *lv_bulk_find_domain(struct lv_read_state *state,
+                                     virDomainPtr dom, int hint) {
+  const char *name = virDomainGetName(dom);
+  if (name == NULL)
+    return NULL;
+
+  /* Records are usually returned in the order of the domains. */
+  if ((hint < state->nr_domains) &&
+      (strcmp(virDomainGetName(state->domains[hint].ptr), name) == 0))
+    return &state->domains[hint];
+
+  for (int i = 0; i < state->nr_domains; ++i)
+    if (strcmp(virDomainGetName(state->domains[i].ptr), name) == 0)
+      return &state->domains[i];
+
+  return NULL;
+}
+
+static void lv_bulk_submit_devices(struct lv_read_state *state,
+                                   const domain_t *dom) {
+  struct lv_bulk_stats *bulk = &state->bulk;
+
+  for (int i = 0; i < state->nr_block_devices; ++i) {
+    struct block_device *block_dev = &state->block_devices[i];
+    if (block_dev->dom != dom->ptr)
+      continue;
+
+    for (size_t j = 0; j < bulk->nr_blocks; ++j) {
+      const char *name = (blockdevice_format == source) ? bulk->blocks[j].path
+                                                        : bulk->blocks[j].name;
+      if ((name == NULL) || (strcmp(name, block_dev->path) != 0))
+        continue;
+
+      disk_block_stats_submit(&bulk->blocks[j].bstats, block_dev->dom,
+                              block_dev->path, &bulk->blocks[j].binfo);
+      break;
+    }
+  }
+
+  for (int i = 0; i < state->nr_interface_devices; ++i) {
+    struct interface_device *if_dev = &state->interface_devices[i];
+    if (if_dev->dom != dom->ptr)
+      continue;
+
+    for (size_t j = 0; j < bulk->nr_interfaces; ++j) {
+      if ((bulk->interfaces[j].name == NULL) ||
+          (strcmp(bulk->interfaces[j].name, if_dev->path) != 0))
+        continue;
+
+      if_dev_stats_submit(&bulk->interfaces[j].stats, if_dev);
+      break;
+    }
+  }
+}
+
+/* Retrieves the statistics of all active domains of an instance with a single
+ * call to virDomainListGetStats. Returns non-zero if the caller has to fall
+ * back to the per-domain calls. */
+static int lv_read_bulk(struct lv_read_state *state) {
+  struct lv_bulk_stats *bulk = &state->bulk;
+
+  if (lv_bulk_reserve((void **)&bulk->domains, &bulk->domains_size,
+                      state->nr_domains + 1, sizeof(*bulk->domains)) != 0)
+    return -1;
+
+  size_t nr_active = 0;
+  for (int i = 0; i < state->nr_domains; ++i) {
+    domain_t *dom = &state->domains[i];
+    if (dom->active) {
+      bulk->domains[nr_active++] = dom->ptr;
+      continue;
+    }
+#ifdef HAVE_DOM_REASON
+    if ((extra_stats & ex_stats_domain_state) &&
+        (submit_domain_state(dom->ptr) != 0))
+      ERROR(PLUGIN_NAME " plugin: failed to get metrics for domain=%s",
+            virDomainGetName(dom->ptr));
+#endif
+  }
+  bulk->domains[nr_active] = NULL;
+
+  if (nr_active == 0)
+    return 0;
+
+  unsigned int stats = VIR_DOMAIN_STATS_STATE | VIR_DOMAIN_STATS_CPU_TOTAL |
+                       VIR_DOMAIN_STATS_BALLOON;
+  if (extra_stats & (ex_stats_vcpu | ex_stats_vcpupin))
+    stats |= VIR_DOMAIN_STATS_VCPU;
+  if (state->nr_block_devices > 0)
+    stats |= VIR_DOMAIN_STATS_BLOCK;
+  if (state->nr_interface_devices > 0)
+    stats |= VIR_DOMAIN_STATS_INTERFACE;
+#ifdef HAVE_PERF_STATS
+  if (extra_stats & ex_stats_perf)
+    stats |= VIR_DOMAIN_STATS_PERF;
+#endif
+
+  virDomainStatsRecordPtr *records = NULL;
+  int nr_records = virDomainListGetStats(bulk->domains, stats, &records, 0);
+  if (nr_records < 0) {
+    virErrorPtr err = virGetLastError();
+    if ((err != NULL) && (err->code == VIR_ERR_NO_SUPPORT)) {
+      WARNING(PLUGIN_NAME " plugin: Bulk statistics are not supported by the "
+                          "hypervisor driver, querying domains one by one.");
+      bulk_stats_supported = false;
+    } else {
+      VIRT_ERROR(conn, "virDomainListGetStats");
+    }
+    return -1;
+  }
+
+  for (int i = 0; i < nr_records; ++i) {
+    domain_t *dom = lv_bulk_find_domain(state, records[i]->dom, i);
+    if (dom == NULL)
+      continue;
+
+    if (lv_bulk_parse(bulk, records[i]) != 0)
+      continue;
+
+    /* E.g. the balloon driver may be missing; ask for the domain info then. */
+    unsigned int needed = lv_bulk_info_fields();
+    int status;
+    if ((bulk->info_fields & needed) == needed)
+      status = submit_domain_metrics(dom, &bulk->info, records[i]);
+    else
+      status = get_domain_metrics(dom);
+    if (status != 0)
+      ERROR(PLUGIN_NAME " plugin: failed to get metrics for domain=%s",
+            virDomainGetName(dom->ptr));
+
+    lv_bulk_submit_devices(state, dom);
+  }
+
+  virDomainStatsRecordListFree(records);
+  return 0;
+}
+#endif /* HAVE_LIST_GET_STATS */
+
 static int lv_read(user_data_t *ud) {
   if (ud->data == NULL) {
     ERROR(PLUGIN_NAME " plugin: NULL userdata");
@@ -2431,7 +2860,7 @@ static int lv_read(user_data_t *ud) {
         stop_event_loop(&notif_thread);
 
       lv_disconnect();
-      last_refresh = 0;
+      lists_changed();
     }
     return -1;
   }
@@ -2440,8 +2869,10 @@ static int lv_read(user_data_t *ud) {
   time(&t);
 
   /* Need to refresh domain or device lists? */
-  if ((last_refresh == (time_t)0) ||
-      ((interval > 0) && ((last_refresh + interval) <= t))) {
+  unsigned long generation = get_lists_generation();
+  if ((inst->last_refresh == (time_t)0) ||
+      (inst->lists_generation != generation) ||
+      ((interval > 0) && ((inst->last_refresh + interval) <= t))) {
     if (refresh_lists(inst) != 0) {
       if (inst->id == 0) {
         if (!persistent_notification)
@@ -2450,7 +2881,8 @@ static int lv_read(user_data_t *ud) {
       }
       return -1;
     }
-    last_refresh = t;
+    inst->last_refresh = t;
+    inst->lists_generation = generation;
   }
 
   /* persistent domains state notifications are handled by instance 0 */
@@ -2476,6 +2908,11 @@ static int lv_read(user_data_t *ud) {
           state->interface_devices[i].path);
 #endif
 
+#ifdef HAVE_LIST_GET_STATS
+  if (bulk_stats_supported && (lv_read_bulk(state) == 0))
+    return 0;
+#endif
+
   /* Get domains' metrics */
   for (int i = 0; i < state->nr_domains; ++i) {
     domain_t *dom = &state->domains[i];
@@ -2545,6 +2982,11 @@ static void lv_fini_instance(size_t i) {
   struct lv_read_state *state = &(inst->read_state);
 
   lv_clean_read_state(state);
+#ifdef HAVE_LIST_GET_STATS
+  sfree(state->bulk.domains);
+  sfree(state->bulk.blocks);
+  sfree(state->bulk.interfaces);
+#endif
 
   INFO(PLUGIN_NAME " plugin: reader %s finalized", inst->tag);
 }
@@ -85,11 +85,76 @@ DEF_TEST(persistent_domains_state_notification) {
   return 0;
 }
 
+#ifdef HAVE_LIST_GET_STATS
+DEF_TEST(lv_bulk_parse) {
+  virTypedParameter params[] = {
+      {.field = "state.state", .type = VIR_TYPED_PARAM_INT, .value.i = 1},
+      {.field = "cpu.time", .type = VIR_TYPED_PARAM_ULLONG, .value.ul = 42},
+      {.field = "balloon.current",
+       .type = VIR_TYPED_PARAM_ULLONG,
+       .value.ul = 1024},
+      {.field = "net.count", .type = VIR_TYPED_PARAM_UINT, .value.ui = 1},
+      {.field = "net.0.name",
+       .type = VIR_TYPED_PARAM_STRING,
+       .value.s = "vnet0"},
+      {.field = "net.0.rx.bytes",
+       .type = VIR_TYPED_PARAM_ULLONG,
+       .value.ul = 100},
+      {.field = "block.count", .type = VIR_TYPED_PARAM_UINT, .value.ui = 2},
+      {.field = "block.0.name",
+       .type = VIR_TYPED_PARAM_STRING,
+       .value.s = "vda"},
+      {.field = "block.1.name",
+       .type = VIR_TYPED_PARAM_STRING,
+       .value.s = "vdb"},
+      {.field = "block.1.wr.bytes",
+       .type = VIR_TYPED_PARAM_ULLONG,
+       .value.ul = 4096},
+      /* out of range, must be ignored */
+      {.field = "block.2.rd.reqs",
+       .type = VIR_TYPED_PARAM_ULLONG,
+       .value.ul = 1},
+  };
+  virDomainStatsRecord record = {
+      .params = params,
+      .nparams = STATIC_ARRAY_SIZE(params),
+  };
+  struct lv_bulk_stats bulk = {0};
+
+  EXPECT_EQ_INT(0, lv_bulk_parse(&bulk, &record));
+
+  EXPECT_EQ_INT(LV_BULK_INFO_STATE | LV_BULK_INFO_CPU | LV_BULK_INFO_MEMORY,
+                bulk.info_fields);
+  EXPECT_EQ_UINT64(42, bulk.info.cpuTime);
+  EXPECT_EQ_UINT64(1024, bulk.info.memory);
+
+  EXPECT_EQ_INT(1, (int)bulk.nr_interfaces);
+  EXPECT_EQ_STR("vnet0", bulk.interfaces[0].name);
+  EXPECT_EQ_INT(100, (int)bulk.interfaces[0].stats.rx_bytes);
+  EXPECT_EQ_INT(-1, (int)bulk.interfaces[0].stats.tx_bytes);
+
+  EXPECT_EQ_INT(2, (int)bulk.nr_blocks);
+  EXPECT_EQ_STR("vda", bulk.blocks[0].name);
+  EXPECT_EQ_STR("vdb", bulk.blocks[1].name);
+  EXPECT_EQ_INT(-1, (int)bulk.blocks[0].bstats.bi.wr_bytes);
+  EXPECT_EQ_INT(4096, (int)bulk.blocks[1].bstats.bi.wr_bytes);
+  EXPECT_EQ_INT(-1, (int)bulk.blocks[1].bstats.bi.rd_req);
+
+  sfree(bulk.blocks);
+  sfree(bulk.interfaces);
+
+  return 0;
+}
+#endif
+
 int main(void) {
 #ifdef HAVE_LIST_ALL_DOMAINS
   RUN_TEST(get_domain_state_notify);
 #endif
   RUN_TEST(persistent_domains_state_notification);
+#ifdef HAVE_LIST_GET_STATS
+  RUN_TEST(lv_bulk_parse);
+#endif
 
   END_TEST;
 }
@@ -34,6 +34,7 @@ static const char *config_keys[] = {"Verbose"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int verbose_output;
+static proc_file_t *proc_vmstat;
 /* #endif KERNEL_LINUX */
 
 #else
@@ -100,16 +101,20 @@ static int vmem_read(void) {
   derive_t pgmajfault = 0;
   int pgfaultvalid = 0;
 
-  FILE *fh;
-  char buffer[1024];
+  char *buffer;
 
-  fh = fopen("/proc/vmstat", "r");
-  if (fh == NULL) {
-    ERROR("vmem plugin: fopen (/proc/vmstat) failed: %s", STRERRNO);
-    return -1;
+  if (proc_vmstat == NULL) {
+    proc_vmstat = proc_file_create("/proc/vmstat");
+    if (proc_vmstat == NULL) {
+      ERROR("vmem plugin: proc_file_create failed.");
+      return -1;
+    }
   }
 
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
+  if (proc_file_read(proc_vmstat, NULL) == NULL)
+    return -1;
+
+  while ((buffer = proc_file_next_line(proc_vmstat)) != NULL) {
     char *fields[4];
     int fields_num;
     char *key;
@@ -236,10 +241,7 @@ static int vmem_read(void) {
       value_t value = {.derive = counter};
       submit_one(NULL, "vmpage_action", "deactivate", value);
     }
-  } /* while (fgets) */
-
-  fclose(fh);
-  fh = NULL;
+  } /* while (proc_file_next_line) */
 
   if (pgfaultvalid == 0x03)
     submit_two(NULL, "vmpage_faults", NULL, pgfault, pgmajfault);
@@ -49,6 +49,7 @@
 #include "plugin.h"
 #include "utils/common/common.h"
 
+#include "utils/async_sender/async_sender.h"
 #include "utils/format_graphite/format_graphite.h"
 #include "utils_complain.h"
 
@@ -100,6 +101,7 @@ struct wg_callback {
   char escape_char;
 
   unsigned int format_flags;
+  graphite_cache_t *name_cache;
 
   char send_buf[WG_SEND_BUF_SIZE];
   size_t send_buf_free;
@@ -114,6 +116,13 @@ struct wg_callback {
   cdtime_t last_reconnect_time;
   cdtime_t reconnect_interval;
   bool reconnect_interval_reached;
+
+  /* With "SendQueueLength", full send buffers are handed to a sender thread
+   * which connects and writes to the socket. Otherwise writes are
+   * synchronous. */
+  int send_queue_length;
+  bool report_stats;
+  async_sender_t *sender;
 };
 
 /* wg_force_reconnect_check closes cb->sock_fd when it was open for longer
@@ -142,7 +151,7 @@ static void wg_force_reconnect_check(struct wg_callback *cb) {
  * Functions
  */
 static void wg_reset_buffer(struct wg_callback *cb) {
-  memset(cb->send_buf, 0, sizeof(cb->send_buf));
+  cb->send_buf[0] = 0;
   cb->send_buf_free = sizeof(cb->send_buf);
   cb->send_buf_fill = 0;
   cb->send_buf_init_time = cdtime();
@@ -151,6 +160,12 @@ static void wg_reset_buffer(struct wg_callback *cb) {
 static int wg_send_buffer(struct wg_callback *cb) {
   ssize_t status;
 
+  if (cb->sender != NULL) {
+    /* The sender complains about full queues itself. */
+    status = async_sender_enqueue(cb->sender, cb->send_buf, cb->send_buf_fill);
+    return (status == ENOBUFS) ? 0 : (int)status;
+  }
+
   if (cb->sock_fd < 0)
     return -1;
 
@@ -291,6 +306,7 @@ static void wg_callback_free(void *data) {
   pthread_mutex_lock(&cb->send_lock);
 
   wg_flush_nolock(/* timeout = */ 0, cb);
+  async_sender_destroy(cb->sender);
 
   if (cb->sock_fd >= 0) {
     close(cb->sock_fd);
@@ -303,6 +319,7 @@ static void wg_callback_free(void *data) {
   sfree(cb->service);
   sfree(cb->prefix);
   sfree(cb->postfix);
+  graphite_cache_destroy(cb->name_cache);
 
   pthread_mutex_unlock(&cb->send_lock);
   pthread_mutex_destroy(&cb->send_lock);
@@ -323,7 +340,7 @@ static int wg_flush(cdtime_t timeout,
 
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->sock_fd < 0) {
+  if ((cb->sender == NULL) && (cb->sock_fd < 0)) {
     status = wg_callback_init(cb);
     if (status != 0) {
       /* An error message has already been printed. */
@@ -338,48 +355,66 @@ static int wg_flush(cdtime_t timeout,
   return status;
 }
 
-static int wg_send_message(char const *message, struct wg_callback *cb) {
+/* wg_send_message formats the value list directly into the send buffer,
+ * flushing the buffer first if the lines don't fit. */
+static int wg_send_message(const data_set_t *ds, const value_list_t *vl,
+                           struct wg_callback *cb) {
   int status;
-  size_t message_len;
-
-  message_len = strlen(message);
+  size_t message_len = 0;
 
   pthread_mutex_lock(&cb->send_lock);
 
-  wg_force_reconnect_check(cb);
+  /* With a sender thread, connecting is left to that thread. */
+  if (cb->sender == NULL) {
+    wg_force_reconnect_check(cb);
 
-  if (cb->sock_fd < 0) {
-    status = wg_callback_init(cb);
-    if (status != 0) {
-      /* An error message has already been printed. */
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
+    if (cb->sock_fd < 0) {
+      status = wg_callback_init(cb);
+      if (status != 0) {
+        /* An error message has already been printed. */
+        pthread_mutex_unlock(&cb->send_lock);
+        return -1;
+      }
     }
   }
 
-  if (message_len >= cb->send_buf_free) {
+  status = format_graphite_cached(cb->name_cache,
+                                  cb->send_buf + cb->send_buf_fill,
+                                  cb->send_buf_free, &message_len, ds, vl);
+  if ((status == -ENOMEM) && (cb->send_buf_fill > 0)) {
     status = wg_flush_nolock(/* timeout = */ 0, cb);
     if (status != 0) {
       pthread_mutex_unlock(&cb->send_lock);
       return status;
     }
+
+    status = format_graphite_cached(cb->name_cache, cb->send_buf,
+                                    cb->send_buf_free, &message_len, ds, vl);
+  }
+  if (status == -ENOMEM) {
+    ERROR("write_graphite plugin: The lines of value list \"%s/%s\" do not "
+          "fit into the send buffer of %" PRIsz " bytes.",
+          vl->plugin, vl->type, sizeof(cb->send_buf));
+  }
+  if (status != 0) {
+    pthread_mutex_unlock(&cb->send_lock);
+    return status;
   }
 
-  /* Assert that we have enough space for this message. */
+  /* Assert that we have enough space for this message. `message_len' does
+   * not include the trailing null byte. Neither does `send_buffer_fill'. */
   assert(message_len < cb->send_buf_free);
 
-  /* `message_len + 1' because `message_len' does not include the
-   * trailing null byte. Neither does `send_buffer_fill'. */
-  memcpy(cb->send_buf + cb->send_buf_fill, message, message_len + 1);
-  cb->send_buf_fill += message_len;
-  cb->send_buf_free -= message_len;
-
   DEBUG("write_graphite plugin: [%s]:%s (%s) buf %" PRIsz "/%" PRIsz
         " (%.1f %%) \"%s\"",
-        cb->node, cb->service, cb->protocol, cb->send_buf_fill,
-        sizeof(cb->send_buf),
-        100.0 * ((double)cb->send_buf_fill) / ((double)sizeof(cb->send_buf)),
-        message);
+        cb->node, cb->service, cb->protocol,
+        cb->send_buf_fill + message_len, sizeof(cb->send_buf),
+        100.0 * ((double)(cb->send_buf_fill + message_len)) /
+            ((double)sizeof(cb->send_buf)),
+        cb->send_buf + cb->send_buf_fill);
+
+  cb->send_buf_fill += message_len;
+  cb->send_buf_free -= message_len;
 
   pthread_mutex_unlock(&cb->send_lock);
 
@@ -388,26 +423,14 @@ static int wg_send_message(char const *message, struct wg_callback *cb) {
 
 static int wg_write_messages(const data_set_t *ds, const value_list_t *vl,
                              struct wg_callback *cb) {
-  char buffer[WG_SEND_BUF_SIZE] = {0};
-  int status;
-
   if (0 != strcmp(ds->type, vl->type)) {
     ERROR("write_graphite plugin: DS type does not match "
           "value list type");
     return -1;
   }
 
-  status = format_graphite(buffer, sizeof(buffer), ds, vl, cb->prefix,
-                           cb->postfix, cb->escape_char, cb->format_flags);
-  if (status != 0) /* error message has been printed already. */
-    return status;
-
   /* Send the message to graphite */
-  status = wg_send_message(buffer, cb);
-  if (status != 0) /* error message has been printed already. */
-    return status;
-
-  return 0;
+  return wg_send_message(ds, vl, cb);
 } /* int wg_write_messages */
 
 static int wg_write(const data_set_t *ds, const value_list_t *vl,
@@ -425,6 +448,14 @@ static int wg_write(const data_set_t *ds, const value_list_t *vl,
   return status;
 }
 
+static int wg_stats_read(user_data_t *user_data) {
+  struct wg_callback *cb = user_data->data;
+
+  async_sender_dispatch_stats(cb->sender, "write_graphite",
+                              cb->name != NULL ? cb->name : cb->node);
+  return 0;
+}
+
 static int config_set_char(char *dest, oconfig_item_t *ci) {
   char buffer[4] = {0};
   int status;
@@ -525,6 +556,10 @@ static int wg_config_node(oconfig_item_t *ci) {
       cf_util_get_flag(child, &cb->format_flags, GRAPHITE_REVERSE_HOST);
     else if (strcasecmp("EscapeCharacter", child->key) == 0)
       config_set_char(&cb->escape_char, child);
+    else if (strcasecmp("SendQueueLength", child->key) == 0)
+      status = cf_util_get_int(child, &cb->send_queue_length);
+    else if (strcasecmp("ReportStats", child->key) == 0)
+      status = cf_util_get_boolean(child, &cb->report_stats);
     else {
       ERROR("write_graphite plugin: Invalid configuration "
             "option: %s.",
@@ -541,6 +576,48 @@ static int wg_config_node(oconfig_item_t *ci) {
     return status;
   }
 
+  cb->name_cache = graphite_cache_create(cb->prefix, cb->postfix,
+                                         cb->escape_char, cb->format_flags);
+  if (cb->name_cache == NULL) {
+    ERROR("write_graphite plugin: graphite_cache_create failed.");
+    wg_callback_free(cb);
+    return -1;
+  }
+
+  if (cb->send_queue_length < 0) {
+    WARNING("write_graphite plugin: \"SendQueueLength\" must not be "
+            "negative. Sending synchronously.");
+    cb->send_queue_length = 0;
+  }
+
+  if (cb->send_queue_length > 0) {
+    char log_prefix[DATA_MAX_NAME_LEN];
+    snprintf(log_prefix, sizeof(log_prefix), "write_graphite plugin (%s)",
+             cb->name != NULL ? cb->name : cb->node);
+
+    cb->sender = async_sender_create(&(async_sender_options_t){
+        .log_prefix = log_prefix,
+        .node = cb->node,
+        .service = cb->service,
+        .socktype = (strcasecmp("tcp", cb->protocol) == 0) ? SOCK_STREAM
+                                                            : SOCK_DGRAM,
+        .buffer_size = sizeof(cb->send_buf),
+        .queue_length = (size_t)cb->send_queue_length,
+        .reconnect_interval = cb->reconnect_interval,
+        .log_send_errors = cb->log_send_errors,
+    });
+    if (cb->sender == NULL) {
+      ERROR("write_graphite plugin: async_sender_create failed.");
+      wg_callback_free(cb);
+      return -1;
+    }
+    wg_reset_buffer(cb);
+  } else if (cb->report_stats) {
+    WARNING("write_graphite plugin: \"ReportStats\" requires "
+            "\"SendQueueLength\" and will be ignored.");
+    cb->report_stats = false;
+  }
+
   /* FIXME: Legacy configuration syntax. */
   if (cb->name == NULL)
     snprintf(callback_name, sizeof(callback_name), "write_graphite/%s/%s/%s",
@@ -557,6 +634,11 @@ static int wg_config_node(oconfig_item_t *ci) {
 
   plugin_register_flush(callback_name, wg_flush, &(user_data_t){.data = cb});
 
+  if (cb->report_stats)
+    plugin_register_complex_read(/* group = */ NULL, callback_name,
+                                 wg_stats_read, /* interval = */ 0,
+                                 &(user_data_t){.data = cb});
+
   return 0;
 }
 
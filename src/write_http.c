@@ -27,6 +27,7 @@
 
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/compress/compress.h"
 #include "utils/curl_stats/curl_stats.h"
 #include "utils/format_influxdb/format_influxdb.h"
 #include "utils/format_json/format_json.h"
@@ -46,9 +47,43 @@
 #define WRITE_HTTP_RESPONSE_BUFFER_SIZE 1024
 #endif
 
+#ifndef WRITE_HTTP_DEFAULT_STREAM_BUFFER_SIZE
+#define WRITE_HTTP_DEFAULT_STREAM_BUFFER_SIZE 65536
+#endif
+
+#ifndef WRITE_HTTP_DEFAULT_STREAM_MAX_SIZE
+#define WRITE_HTTP_DEFAULT_STREAM_MAX_SIZE (16 * 1024 * 1024)
+#endif
+
+#ifndef WRITE_HTTP_DEFAULT_STREAM_MAX_AGE
+#define WRITE_HTTP_DEFAULT_STREAM_MAX_AGE TIME_T_TO_CDTIME_T_STATIC(60)
+#endif
+
 /*
  * Private variables
  */
+typedef struct wh_callback_s wh_callback_t;
+
+/* One slot for an asynchronous POST. Each request owns a payload buffer of
+ * "send_buffer_size" bytes, which is swapped with the callback's send buffer
+ * when a batch is submitted. */
+struct wh_request_s {
+  CURL *curl;
+  char curl_errbuf[CURL_ERROR_SIZE];
+
+  char *buffer;
+  size_t buffer_fill;
+  /* Each request may be in flight at the same time, so each has its own
+   * compressor and output buffer. */
+  compressor_t *compressor;
+
+  char response_buffer[WRITE_HTTP_RESPONSE_BUFFER_SIZE];
+  unsigned int response_buffer_pos;
+
+  struct wh_request_s *next;
+};
+typedef struct wh_request_s wh_request_t;
+
 struct wh_callback_s {
   char *name;
 
@@ -77,8 +112,10 @@ struct wh_callback_s {
   int format;
   bool send_metrics;
   bool send_notifications;
+  compress_algorithm_t compression;
 
   CURL *curl;
+  compressor_t *compressor;
   curl_stats_t *curl_stats;
   struct curl_slist *headers;
   char curl_errbuf[CURL_ERROR_SIZE];
@@ -89,6 +126,11 @@ struct wh_callback_s {
   size_t send_buffer_fill;
   cdtime_t send_buffer_init_time;
 
+  /* Measurement and tags of the InfluxDB line protocol, per series. */
+  format_influxdb_cache_t *influxdb_cache;
+  /* Data source and identifier fragments of the JSON format, per series. */
+  format_json_cache_t *json_cache;
+
   pthread_mutex_t send_lock;
 
   char response_buffer[WRITE_HTTP_RESPONSE_BUFFER_SIZE];
@@ -98,8 +140,53 @@ struct wh_callback_s {
   char *metrics_prefix;
 
   char *unix_socket_path;
+
+  /* Asynchronous sending, enabled by "ConcurrentRequests". The sender
+   * thread runs all requests on a curl multi handle, which reuses
+   * connections and, with "HTTP2", multiplexes them. */
+  int concurrent_requests;
+  bool drop_when_busy;
+  bool http2;
+
+  CURLM *multi;
+  wh_request_t *requests;
+  wh_request_t *requests_free;
+  wh_request_t *requests_pending_head;
+  wh_request_t *requests_pending_tail;
+  int requests_busy;
+  uint64_t requests_dropped;
+  pthread_mutex_t requests_lock;
+  pthread_cond_t requests_cond;
+  pthread_t sender_thread;
+  bool sender_running;
+  bool sender_shutdown;
+
+  /* Streaming, enabled by "Streaming". Flushed batches are copied into a
+   * ring buffer, from which the sender thread feeds a long-running POST with
+   * chunked transfer encoding. The POST is ended at a batch boundary and a
+   * new one started once it has sent "stream_max_size" bytes or is older
+   * than "stream_max_age". Uses the "requests_*" and "sender_*" fields
+   * above, which are otherwise used by "ConcurrentRequests". */
+  bool streaming;
+  size_t stream_buffer_size;
+  size_t stream_max_size;
+  cdtime_t stream_max_age;
+
+  wh_request_t *stream;
+  struct curl_slist *stream_headers;
+  char *ring;
+  /* Total number of bytes written to and read from "ring". */
+  uint64_t ring_in;
+  uint64_t ring_out;
+
+  /* State of the current POST, protected by "requests_lock". */
+  size_t stream_sent;
+  cdtime_t stream_deadline;
+  bool stream_opened;
+  bool stream_ending;
+  bool stream_closed;
+  uint64_t stream_end;
 };
-typedef struct wh_callback_s wh_callback_t;
 
 static char **http_attrs;
 static size_t http_attrs_num;
@@ -107,38 +194,52 @@ static size_t http_attrs_num;
 /* libcurl may call this multiple times depending on how big the server's
  * http response is
  */
-static size_t wh_curl_write_callback(char *ptr, size_t size, size_t nmemb,
-                                     void *userdata) {
-
-  wh_callback_t *cb = (wh_callback_t *)userdata;
+static size_t wh_response_append(char *buffer, unsigned int *buffer_pos,
+                                 char const *ptr, size_t nmemb) /* {{{ */
+{
   unsigned int len = 0;
 
-  if ((cb->response_buffer_pos + nmemb) > sizeof(cb->response_buffer))
-    len = sizeof(cb->response_buffer) - cb->response_buffer_pos;
+  if ((*buffer_pos + nmemb) > WRITE_HTTP_RESPONSE_BUFFER_SIZE)
+    len = WRITE_HTTP_RESPONSE_BUFFER_SIZE - *buffer_pos;
   else
     len = nmemb;
 
   DEBUG(
       "write_http plugin: curl callback nmemb=%zu buffer_pos=%u write_len=%u ",
-      nmemb, cb->response_buffer_pos, len);
+      nmemb, *buffer_pos, len);
 
-  memcpy(cb->response_buffer + cb->response_buffer_pos, ptr, len);
-  cb->response_buffer_pos += len;
-  cb->response_buffer[sizeof(cb->response_buffer) - 1] = '\0';
+  memcpy(buffer + *buffer_pos, ptr, len);
+  *buffer_pos += len;
+  buffer[WRITE_HTTP_RESPONSE_BUFFER_SIZE - 1] = '\0';
 
   /* Always return nmemb even if we write less so libcurl won't throw an error
    */
   return nmemb;
+} /* }}} size_t wh_response_append */
+
+static size_t wh_curl_write_callback(char *ptr, size_t size, size_t nmemb,
+                                     void *userdata) {
+  wh_callback_t *cb = (wh_callback_t *)userdata;
 
+  return wh_response_append(cb->response_buffer, &cb->response_buffer_pos, ptr,
+                            nmemb);
 } /* }}} wh_curl_write_callback */
 
-static void wh_log_http_error(wh_callback_t *cb) {
+static size_t wh_request_write_callback(char *ptr, size_t size, size_t nmemb,
+                                        void *userdata) {
+  wh_request_t *req = (wh_request_t *)userdata;
+
+  return wh_response_append(req->response_buffer, &req->response_buffer_pos,
+                            ptr, nmemb);
+} /* }}} wh_request_write_callback */
+
+static void wh_log_http_error(wh_callback_t *cb, CURL *curl) {
   if (!cb->log_http_error)
     return;
 
   long http_code = 0;
 
-  curl_easy_getinfo(cb->curl, CURLINFO_RESPONSE_CODE, &http_code);
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
 
   if (http_code != 200)
     INFO("write_http plugin: HTTP Error code: %lu", http_code);
@@ -170,6 +271,21 @@ static int wh_post_nolock(wh_callback_t *cb, char const *data,
 {
   int status = 0;
 
+  if (cb->compressor != NULL) {
+    void const *out = NULL;
+    size_t out_size = 0;
+
+    status = compressor_compress(cb->compressor, data,
+                                 (size < 0) ? strlen(data) : (size_t)size,
+                                 &out, &out_size);
+    if (status != 0) {
+      ERROR("write_http plugin: Compressing the request failed.");
+      return status;
+    }
+    data = out;
+    size = (long)out_size;
+  }
+
   curl_easy_setopt(cb->curl, CURLOPT_URL, cb->location);
   curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDSIZE, size);
   curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDS, data);
@@ -177,7 +293,7 @@ static int wh_post_nolock(wh_callback_t *cb, char const *data,
   curl_easy_setopt(cb->curl, CURLOPT_WRITEDATA, (void *)cb);
   status = curl_easy_perform(cb->curl);
 
-  wh_log_http_error(cb);
+  wh_log_http_error(cb, cb->curl);
 
   if (cb->curl_stats != NULL) {
     int rc = curl_stats_dispatch(cb->curl_stats, cb->curl, NULL, "write_http",
@@ -202,96 +318,664 @@ static int wh_post_nolock(wh_callback_t *cb, char const *data,
   return status;
 } /* }}} wh_post_nolock */
 
-static int wh_callback_init(wh_callback_t *cb) /* {{{ */
+/* wh_curl_setopt applies the node's settings to "curl". */
+static int wh_curl_setopt(wh_callback_t *cb, CURL *curl,
+                          char *errbuf) /* {{{ */
 {
-  if (cb->curl != NULL)
-    return 0;
-
-  cb->curl = curl_easy_init();
-  if (cb->curl == NULL) {
-    ERROR("curl plugin: curl_easy_init failed.");
-    return -1;
-  }
-
   if (cb->low_speed_limit > 0 && cb->low_speed_time > 0) {
-    curl_easy_setopt(cb->curl, CURLOPT_LOW_SPEED_LIMIT,
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT,
                      (long)(cb->low_speed_limit * cb->low_speed_time));
-    curl_easy_setopt(cb->curl, CURLOPT_LOW_SPEED_TIME,
-                     (long)cb->low_speed_time);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)cb->low_speed_time);
   }
 
 #ifdef HAVE_CURLOPT_TIMEOUT_MS
   if (cb->timeout > 0)
-    curl_easy_setopt(cb->curl, CURLOPT_TIMEOUT_MS, (long)cb->timeout);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)cb->timeout);
 #endif
 
-  curl_easy_setopt(cb->curl, CURLOPT_NOSIGNAL, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
 
-  cb->headers = curl_slist_append(cb->headers, "Accept:  */*");
-  if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB)
-    cb->headers =
-        curl_slist_append(cb->headers, "Content-Type: application/json");
-  else
-    cb->headers = curl_slist_append(cb->headers, "Content-Type: text/plain");
-  cb->headers = curl_slist_append(cb->headers, "Expect:");
-  curl_easy_setopt(cb->curl, CURLOPT_HTTPHEADER, cb->headers);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, cb->headers);
 
-  curl_easy_setopt(cb->curl, CURLOPT_ERRORBUFFER, cb->curl_errbuf);
-  curl_easy_setopt(cb->curl, CURLOPT_FOLLOWLOCATION, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_MAXREDIRS, 50L);
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 50L);
 
   if (cb->user != NULL) {
 #ifdef HAVE_CURLOPT_USERNAME
-    curl_easy_setopt(cb->curl, CURLOPT_USERNAME, cb->user);
-    curl_easy_setopt(cb->curl, CURLOPT_PASSWORD,
+    curl_easy_setopt(curl, CURLOPT_USERNAME, cb->user);
+    curl_easy_setopt(curl, CURLOPT_PASSWORD,
                      (cb->pass == NULL) ? "" : cb->pass);
 #else
-    size_t credentials_size;
+    if (cb->credentials == NULL) {
+      size_t credentials_size;
 
-    credentials_size = strlen(cb->user) + 2;
-    if (cb->pass != NULL)
-      credentials_size += strlen(cb->pass);
+      credentials_size = strlen(cb->user) + 2;
+      if (cb->pass != NULL)
+        credentials_size += strlen(cb->pass);
 
-    cb->credentials = malloc(credentials_size);
-    if (cb->credentials == NULL) {
-      ERROR("curl plugin: malloc failed.");
-      return -1;
-    }
+      cb->credentials = malloc(credentials_size);
+      if (cb->credentials == NULL) {
+        ERROR("curl plugin: malloc failed.");
+        return -1;
+      }
 
-    snprintf(cb->credentials, credentials_size, "%s:%s", cb->user,
-             (cb->pass == NULL) ? "" : cb->pass);
-    curl_easy_setopt(cb->curl, CURLOPT_USERPWD, cb->credentials);
+      snprintf(cb->credentials, credentials_size, "%s:%s", cb->user,
+               (cb->pass == NULL) ? "" : cb->pass);
+    }
+    curl_easy_setopt(curl, CURLOPT_USERPWD, cb->credentials);
 #endif
-    curl_easy_setopt(cb->curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
+    curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
   }
 
-  curl_easy_setopt(cb->curl, CURLOPT_SSL_VERIFYPEER, (long)cb->verify_peer);
-  curl_easy_setopt(cb->curl, CURLOPT_SSL_VERIFYHOST, cb->verify_host ? 2L : 0L);
-  curl_easy_setopt(cb->curl, CURLOPT_SSLVERSION, cb->sslversion);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, (long)cb->verify_peer);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, cb->verify_host ? 2L : 0L);
+  curl_easy_setopt(curl, CURLOPT_SSLVERSION, cb->sslversion);
   if (cb->cacert != NULL)
-    curl_easy_setopt(cb->curl, CURLOPT_CAINFO, cb->cacert);
+    curl_easy_setopt(curl, CURLOPT_CAINFO, cb->cacert);
   if (cb->capath != NULL)
-    curl_easy_setopt(cb->curl, CURLOPT_CAPATH, cb->capath);
+    curl_easy_setopt(curl, CURLOPT_CAPATH, cb->capath);
 
   if (cb->clientkey != NULL && cb->clientcert != NULL) {
-    curl_easy_setopt(cb->curl, CURLOPT_SSLKEY, cb->clientkey);
-    curl_easy_setopt(cb->curl, CURLOPT_SSLCERT, cb->clientcert);
+    curl_easy_setopt(curl, CURLOPT_SSLKEY, cb->clientkey);
+    curl_easy_setopt(curl, CURLOPT_SSLCERT, cb->clientcert);
 
     if (cb->clientkeypass != NULL)
-      curl_easy_setopt(cb->curl, CURLOPT_SSLKEYPASSWD, cb->clientkeypass);
+      curl_easy_setopt(curl, CURLOPT_SSLKEYPASSWD, cb->clientkeypass);
   }
 #ifdef CURL_VERSION_UNIX_SOCKETS
   if (cb->unix_socket_path) {
-    curl_easy_setopt(cb->curl, CURLOPT_UNIX_SOCKET_PATH, cb->unix_socket_path);
+    curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, cb->unix_socket_path);
   }
 #endif // CURL_VERSION_UNIX_SOCKETS
 
+#ifdef CURL_HTTP_VERSION_2TLS
+  if (cb->http2)
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#endif
+
+  return 0;
+} /* }}} int wh_curl_setopt */
+
+static void *wh_sender_thread(void *arg);
+
+/* wh_sender_init sets up the requests and starts the sender thread.
+ * must hold cb->send_lock when calling */
+static int wh_sender_init(wh_callback_t *cb) /* {{{ */
+{
+  cb->multi = curl_multi_init();
+  if (cb->multi == NULL) {
+    ERROR("write_http plugin: curl_multi_init failed.");
+    return -1;
+  }
+
+  curl_multi_setopt(cb->multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                    (long)cb->concurrent_requests);
+#ifdef CURLPIPE_MULTIPLEX
+  if (cb->http2)
+    curl_multi_setopt(cb->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+
+  cb->requests = calloc(cb->concurrent_requests, sizeof(*cb->requests));
+  if (cb->requests == NULL) {
+    ERROR("write_http plugin: calloc failed.");
+    return -1;
+  }
+
+  for (int i = 0; i < cb->concurrent_requests; i++) {
+    wh_request_t *req = cb->requests + i;
+
+    req->buffer = malloc(cb->send_buffer_size);
+    req->curl = curl_easy_init();
+    if (cb->compression != COMPRESS_NONE)
+      req->compressor = compressor_create(cb->compression);
+    if ((req->buffer == NULL) || (req->curl == NULL) ||
+        ((cb->compression != COMPRESS_NONE) && (req->compressor == NULL))) {
+      ERROR("write_http plugin: Allocating request %d failed.", i);
+      return -1;
+    }
+
+    if (wh_curl_setopt(cb, req->curl, req->curl_errbuf) != 0)
+      return -1;
+    curl_easy_setopt(req->curl, CURLOPT_URL, cb->location);
+    curl_easy_setopt(req->curl, CURLOPT_WRITEFUNCTION,
+                     &wh_request_write_callback);
+    curl_easy_setopt(req->curl, CURLOPT_WRITEDATA, (void *)req);
+    curl_easy_setopt(req->curl, CURLOPT_PRIVATE, (void *)req);
+
+    req->next = cb->requests_free;
+    cb->requests_free = req;
+  }
+
+  int status = plugin_thread_create(&cb->sender_thread, wh_sender_thread, cb,
+                                    "write_http send");
+  if (status != 0) {
+    ERROR("write_http plugin: Creating the sender thread failed: %s",
+          STRERROR(status));
+    return -1;
+  }
+  cb->sender_running = true;
+
+  return 0;
+} /* }}} int wh_sender_init */
+
+static void wh_sender_destroy(wh_callback_t *cb) /* {{{ */
+{
+  if (cb->sender_running) {
+    pthread_mutex_lock(&cb->requests_lock);
+    cb->sender_shutdown = true;
+    pthread_cond_broadcast(&cb->requests_cond);
+    pthread_mutex_unlock(&cb->requests_lock);
+#if LIBCURL_VERSION_NUM >= 0x074400
+    curl_multi_wakeup(cb->multi);
+#endif
+
+    pthread_join(cb->sender_thread, NULL);
+    cb->sender_running = false;
+  }
+
+  if (cb->requests != NULL) {
+    for (int i = 0; i < cb->concurrent_requests; i++) {
+      if (cb->requests[i].curl != NULL)
+        curl_easy_cleanup(cb->requests[i].curl);
+      compressor_destroy(cb->requests[i].compressor);
+      sfree(cb->requests[i].buffer);
+    }
+    sfree(cb->requests);
+    cb->requests_free = NULL;
+  }
+
+  if (cb->multi != NULL) {
+    curl_multi_cleanup(cb->multi);
+    cb->multi = NULL;
+  }
+
+  if (cb->requests_dropped > 0)
+    WARNING("write_http plugin: <%s> dropped %" PRIu64 " batches because %s.",
+            cb->name, cb->requests_dropped,
+            (cb->ring != NULL) ? "the stream buffer was full"
+                               : "all requests were busy");
+
+  if (cb->stream != NULL) {
+    if (cb->stream->curl != NULL)
+      curl_easy_cleanup(cb->stream->curl);
+    sfree(cb->stream);
+  }
+  if (cb->stream_headers != NULL) {
+    curl_slist_free_all(cb->stream_headers);
+    cb->stream_headers = NULL;
+  }
+  sfree(cb->ring);
+} /* }}} void wh_sender_destroy */
+
+static size_t wh_stream_read_callback(char *buffer, size_t size,
+                                      size_t nitems, void *userdata);
+static void *wh_stream_thread(void *arg);
+
+/* wh_stream_init allocates the ring buffer and starts the sender thread.
+ * must hold cb->send_lock when calling */
+static int wh_stream_init(wh_callback_t *cb) /* {{{ */
+{
+  wh_request_t *req;
+
+  cb->ring = malloc(cb->stream_buffer_size);
+  cb->stream = calloc(1, sizeof(*cb->stream));
+  if ((cb->ring == NULL) || (cb->stream == NULL)) {
+    ERROR("write_http plugin: Allocating the stream buffer failed.");
+    return -1;
+  }
+  req = cb->stream;
+
+  req->curl = curl_easy_init();
+  if (req->curl == NULL) {
+    ERROR("write_http plugin: curl_easy_init failed.");
+    return -1;
+  }
+
+  for (struct curl_slist *h = cb->headers; h != NULL; h = h->next)
+    cb->stream_headers = curl_slist_append(cb->stream_headers, h->data);
+  cb->stream_headers =
+      curl_slist_append(cb->stream_headers, "Transfer-Encoding: chunked");
+
+  if (wh_curl_setopt(cb, req->curl, req->curl_errbuf) != 0)
+    return -1;
+
+  /* The body is produced as values arrive, so the transfer is idle most of
+   * the time. Rely on TCP keep-alive rather than the timeouts. */
+  curl_easy_setopt(req->curl, CURLOPT_LOW_SPEED_LIMIT, 0L);
+#ifdef HAVE_CURLOPT_TIMEOUT_MS
+  curl_easy_setopt(req->curl, CURLOPT_TIMEOUT_MS, 0L);
+#endif
+  curl_easy_setopt(req->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+  curl_easy_setopt(req->curl, CURLOPT_HTTPHEADER, cb->stream_headers);
+  curl_easy_setopt(req->curl, CURLOPT_URL, cb->location);
+  curl_easy_setopt(req->curl, CURLOPT_POST, 1L);
+  curl_easy_setopt(req->curl, CURLOPT_READFUNCTION, &wh_stream_read_callback);
+  curl_easy_setopt(req->curl, CURLOPT_READDATA, (void *)cb);
+  curl_easy_setopt(req->curl, CURLOPT_WRITEFUNCTION,
+                   &wh_request_write_callback);
+  curl_easy_setopt(req->curl, CURLOPT_WRITEDATA, (void *)req);
+
+  int status = plugin_thread_create(&cb->sender_thread, wh_stream_thread, cb,
+                                    "write_http strm");
+  if (status != 0) {
+    ERROR("write_http plugin: Creating the sender thread failed: %s",
+          STRERROR(status));
+    return -1;
+  }
+  cb->sender_running = true;
+
+  return 0;
+} /* }}} int wh_stream_init */
+
+static int wh_callback_init(wh_callback_t *cb) /* {{{ */
+{
+  if (cb->curl != NULL)
+    return 0;
+
+  cb->curl = curl_easy_init();
+  if (cb->curl == NULL) {
+    ERROR("curl plugin: curl_easy_init failed.");
+    return -1;
+  }
+
+  cb->headers = curl_slist_append(cb->headers, "Accept:  */*");
+  if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB)
+    cb->headers =
+        curl_slist_append(cb->headers, "Content-Type: application/json");
+  else
+    cb->headers = curl_slist_append(cb->headers, "Content-Type: text/plain");
+  cb->headers = curl_slist_append(cb->headers, "Expect:");
+
+  if (cb->compression != COMPRESS_NONE) {
+    char header[64];
+    ssnprintf(header, sizeof(header), "Content-Encoding: %s",
+              compress_content_encoding(cb->compression));
+    cb->headers = curl_slist_append(cb->headers, header);
+
+    cb->compressor = compressor_create(cb->compression);
+    if (cb->compressor == NULL) {
+      ERROR("write_http plugin: compressor_create failed.");
+      return -1;
+    }
+  }
+
+  if (wh_curl_setopt(cb, cb->curl, cb->curl_errbuf) != 0)
+    return -1;
+
+  if (cb->streaming) {
+    if (wh_stream_init(cb) != 0) {
+      WARNING("write_http plugin: <%s>: Sending synchronously.", cb->name);
+      wh_sender_destroy(cb);
+    }
+  } else if ((cb->concurrent_requests > 0) && (wh_sender_init(cb) != 0)) {
+    WARNING("write_http plugin: <%s>: Sending synchronously.", cb->name);
+    wh_sender_destroy(cb);
+  }
+
   wh_reset_buffer(cb);
 
   return 0;
 } /* }}} int wh_callback_init */
 
+/* wh_request_log logs the result of an asynchronous request or stream.
+ * Called by the sender thread only. */
+static void wh_request_log(wh_callback_t *cb, wh_request_t *req,
+                           CURLcode status) /* {{{ */
+{
+  wh_log_http_error(cb, req->curl);
+
+  if (cb->curl_stats != NULL) {
+    int rc = curl_stats_dispatch(cb->curl_stats, req->curl, NULL,
+                                 "write_http", cb->name);
+    if (rc != 0) {
+      ERROR("write_http plugin: curl_stats_dispatch failed with "
+            "status %i",
+            rc);
+    }
+  }
+
+  if (status != CURLE_OK) {
+    ERROR("write_http plugin: curl request failed with "
+          "status %i: %s",
+          status, req->curl_errbuf);
+    if (strlen(req->response_buffer) > 0) {
+      ERROR("write_http plugin: curl_response=%s", req->response_buffer);
+    }
+  } else {
+    DEBUG("write_http plugin: curl_response=%s", req->response_buffer);
+  }
+} /* }}} void wh_request_log */
+
+/* wh_request_done logs the result of an asynchronous request and returns it
+ * to the free list. Called by the sender thread only. */
+static void wh_request_done(wh_callback_t *cb, wh_request_t *req,
+                            CURLcode status) /* {{{ */
+{
+  wh_request_log(cb, req, status);
+
+  pthread_mutex_lock(&cb->requests_lock);
+  req->next = cb->requests_free;
+  cb->requests_free = req;
+  cb->requests_busy--;
+  pthread_cond_broadcast(&cb->requests_cond);
+  pthread_mutex_unlock(&cb->requests_lock);
+} /* }}} void wh_request_done */
+
+static void *wh_sender_thread(void *arg) /* {{{ */
+{
+  wh_callback_t *cb = arg;
+  int running = 0;
+
+  while (42) {
+    wh_request_t *pending;
+
+    pthread_mutex_lock(&cb->requests_lock);
+    /* Sleep until there is something to send, unless requests are in
+     * flight. */
+    while ((running == 0) && (cb->requests_pending_head == NULL) &&
+           !cb->sender_shutdown)
+      pthread_cond_wait(&cb->requests_cond, &cb->requests_lock);
+
+    if ((running == 0) && (cb->requests_pending_head == NULL) &&
+        cb->sender_shutdown) {
+      pthread_mutex_unlock(&cb->requests_lock);
+      break;
+    }
+
+    pending = cb->requests_pending_head;
+    cb->requests_pending_head = NULL;
+    cb->requests_pending_tail = NULL;
+    pthread_mutex_unlock(&cb->requests_lock);
+
+    while (pending != NULL) {
+      wh_request_t *req = pending;
+      pending = req->next;
+      req->next = NULL;
+
+      memset(req->response_buffer, 0, sizeof(req->response_buffer));
+      req->response_buffer_pos = 0;
+      req->curl_errbuf[0] = 0;
+
+      void const *body = req->buffer;
+      size_t body_size = req->buffer_fill;
+      if ((req->compressor != NULL) &&
+          (compressor_compress(req->compressor, req->buffer, req->buffer_fill,
+                               &body, &body_size) != 0)) {
+        ERROR("write_http plugin: Compressing the request failed.");
+        wh_request_done(cb, req, CURLE_FAILED_INIT);
+        continue;
+      }
+
+      curl_easy_setopt(req->curl, CURLOPT_POSTFIELDSIZE, (long)body_size);
+      curl_easy_setopt(req->curl, CURLOPT_POSTFIELDS, body);
+      CURLMcode mstatus = curl_multi_add_handle(cb->multi, req->curl);
+      if (mstatus != CURLM_OK) {
+        ERROR("write_http plugin: curl_multi_add_handle failed: %s",
+              curl_multi_strerror(mstatus));
+        wh_request_done(cb, req, CURLE_FAILED_INIT);
+      }
+    }
+
+    curl_multi_perform(cb->multi, &running);
+
+    CURLMsg *msg;
+    int msgs_left;
+    while ((msg = curl_multi_info_read(cb->multi, &msgs_left)) != NULL) {
+      wh_request_t *req = NULL;
+
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      CURLcode status = msg->data.result;
+      CURL *curl = msg->easy_handle;
+      curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&req);
+      curl_multi_remove_handle(cb->multi, curl);
+      wh_request_done(cb, req, status);
+    }
+
+    if (running > 0) {
+#if LIBCURL_VERSION_NUM >= 0x074400
+      /* New submissions call curl_multi_wakeup(). */
+      curl_multi_poll(cb->multi, NULL, 0, 1000, NULL);
+#else
+      curl_multi_wait(cb->multi, NULL, 0, 10, NULL);
+#endif
+    }
+  }
+
+  return NULL;
+} /* }}} void *wh_sender_thread */
+
+/* wh_stream_read_callback feeds the body of the current POST from the ring
+ * buffer, blocking until data is available. Once the POST is due for
+ * rotation, it ends the body after the data that has been written to the
+ * ring so far, which always ends with a complete batch. JSON batches are
+ * stored with a leading comma, so the body is opened with a bracket, the
+ * first comma is skipped and the body is closed with a bracket. Called by
+ * the sender thread only. */
+static size_t wh_stream_read_callback(char *buffer, size_t size, /* {{{ */
+                                      size_t nitems, void *userdata) {
+  wh_callback_t *cb = userdata;
+  bool json =
+      (cb->format == WH_FORMAT_JSON) || (cb->format == WH_FORMAT_KAIROSDB);
+  size_t max = size * nitems;
+  size_t n = 0;
+
+  if (max == 0)
+    return 0;
+
+  pthread_mutex_lock(&cb->requests_lock);
+  if (json && !cb->stream_opened) {
+    cb->stream_opened = true;
+    buffer[0] = '[';
+    pthread_mutex_unlock(&cb->requests_lock);
+    return 1;
+  }
+
+  while (42) {
+    if (!cb->stream_ending &&
+        (cb->sender_shutdown || (cb->stream_sent >= cb->stream_max_size) ||
+         (cdtime() >= cb->stream_deadline))) {
+      cb->stream_ending = true;
+      cb->stream_end = cb->ring_in;
+    }
+
+    uint64_t limit = cb->stream_ending ? cb->stream_end : cb->ring_in;
+    if ((cb->ring_out < limit) && json && (cb->stream_sent == 0)) {
+      /* Skip the comma of the first JSON batch. */
+      cb->ring_out++;
+      cb->stream_sent++;
+    }
+
+    if (cb->ring_out < limit) {
+      size_t offset = (size_t)(cb->ring_out % cb->stream_buffer_size);
+      n = (size_t)(limit - cb->ring_out);
+      if (n > max)
+        n = max;
+      if (n > cb->stream_buffer_size - offset)
+        n = cb->stream_buffer_size - offset;
+
+      memcpy(buffer, cb->ring + offset, n);
+      cb->ring_out += n;
+      cb->stream_sent += n;
+      pthread_cond_broadcast(&cb->requests_cond);
+      break;
+    }
+
+    if (cb->stream_ending) {
+      if (json && !cb->stream_closed) {
+        cb->stream_closed = true;
+        buffer[0] = ']';
+        n = 1;
+      }
+      break;
+    }
+
+    struct timespec deadline = CDTIME_T_TO_TIMESPEC(cb->stream_deadline);
+    pthread_cond_timedwait(&cb->requests_cond, &cb->requests_lock, &deadline);
+  }
+  pthread_mutex_unlock(&cb->requests_lock);
+
+  return n;
+} /* }}} size_t wh_stream_read_callback */
+
+static void *wh_stream_thread(void *arg) /* {{{ */
+{
+  wh_callback_t *cb = arg;
+  wh_request_t *req = cb->stream;
+
+  while (42) {
+    pthread_mutex_lock(&cb->requests_lock);
+    /* Only start a POST when there is something to send. */
+    while ((cb->ring_in == cb->ring_out) && !cb->sender_shutdown)
+      pthread_cond_wait(&cb->requests_cond, &cb->requests_lock);
+
+    if (cb->ring_in == cb->ring_out) {
+      pthread_mutex_unlock(&cb->requests_lock);
+      break;
+    }
+
+    cb->stream_sent = 0;
+    cb->stream_deadline = cdtime() + cb->stream_max_age;
+    cb->stream_opened = false;
+    cb->stream_ending = false;
+    cb->stream_closed = false;
+    pthread_mutex_unlock(&cb->requests_lock);
+
+    memset(req->response_buffer, 0, sizeof(req->response_buffer));
+    req->response_buffer_pos = 0;
+    req->curl_errbuf[0] = 0;
+
+    CURLcode status = curl_easy_perform(req->curl);
+    wh_request_log(cb, req, status);
+    if (status == CURLE_OK)
+      continue;
+
+    /* Retry after a second, e.g. if the server is not reachable. Data that
+     * has already been sent is lost, like with a failed POST. */
+    cdtime_t retry = cdtime() + TIME_T_TO_CDTIME_T(1);
+    bool shutdown;
+
+    pthread_mutex_lock(&cb->requests_lock);
+    while (!cb->sender_shutdown && (cdtime() < retry)) {
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(retry);
+      pthread_cond_timedwait(&cb->requests_cond, &cb->requests_lock, &ts);
+    }
+    shutdown = cb->sender_shutdown;
+    pthread_mutex_unlock(&cb->requests_lock);
+
+    if (shutdown)
+      break;
+  }
+
+  return NULL;
+} /* }}} void *wh_stream_thread */
+
+/* wh_submit_nolock hands the send buffer over to the sender thread and
+ * replaces it with the payload buffer of a free request. When all requests
+ * are busy, it waits for one to finish or, with "DropWhenBusy", drops the
+ * batch.
+ * must hold cb->send_lock when calling */
+static int wh_submit_nolock(wh_callback_t *cb) /* {{{ */
+{
+  wh_request_t *req;
+
+  pthread_mutex_lock(&cb->requests_lock);
+  while ((cb->requests_free == NULL) && !cb->drop_when_busy &&
+         !cb->sender_shutdown)
+    pthread_cond_wait(&cb->requests_cond, &cb->requests_lock);
+
+  req = cb->requests_free;
+  if (req == NULL) {
+    cb->requests_dropped++;
+    pthread_mutex_unlock(&cb->requests_lock);
+    WARNING("write_http plugin: <%s>: All %d requests are busy, dropping %" PRIsz
+            " bytes.",
+            cb->name, cb->concurrent_requests, cb->send_buffer_fill);
+    return -1;
+  }
+  cb->requests_free = req->next;
+  cb->requests_busy++;
+
+  char *tmp = req->buffer;
+  req->buffer = cb->send_buffer;
+  req->buffer_fill = cb->send_buffer_fill;
+  req->next = NULL;
+  cb->send_buffer = tmp;
+
+  if (cb->requests_pending_tail == NULL)
+    cb->requests_pending_head = req;
+  else
+    cb->requests_pending_tail->next = req;
+  cb->requests_pending_tail = req;
+
+  pthread_cond_broadcast(&cb->requests_cond);
+  pthread_mutex_unlock(&cb->requests_lock);
+
+#if LIBCURL_VERSION_NUM >= 0x074400
+  curl_multi_wakeup(cb->multi);
+#endif
+  return 0;
+} /* }}} int wh_submit_nolock */
+
+/* wh_stream_push_nolock copies the send buffer into the stream's ring
+ * buffer. When the ring is full, it waits for the sender thread to make room
+ * or, with "DropWhenBusy", drops the batch.
+ * must hold cb->send_lock when calling */
+static int wh_stream_push_nolock(wh_callback_t *cb) /* {{{ */
+{
+  size_t size = cb->send_buffer_fill;
+
+  pthread_mutex_lock(&cb->requests_lock);
+  while ((cb->stream_buffer_size - (size_t)(cb->ring_in - cb->ring_out) <
+          size) &&
+         !cb->drop_when_busy && !cb->sender_shutdown)
+    pthread_cond_wait(&cb->requests_cond, &cb->requests_lock);
+
+  if (cb->stream_buffer_size - (size_t)(cb->ring_in - cb->ring_out) < size) {
+    cb->requests_dropped++;
+    pthread_mutex_unlock(&cb->requests_lock);
+    WARNING("write_http plugin: <%s>: The stream buffer is full, dropping "
+            "%" PRIsz " bytes.",
+            cb->name, size);
+    return -1;
+  }
+
+  size_t offset = (size_t)(cb->ring_in % cb->stream_buffer_size);
+  size_t first = cb->stream_buffer_size - offset;
+  if (first > size)
+    first = size;
+  memcpy(cb->ring + offset, cb->send_buffer, first);
+  memcpy(cb->ring, cb->send_buffer + first, size - first);
+  cb->ring_in += size;
+
+  pthread_cond_broadcast(&cb->requests_cond);
+  pthread_mutex_unlock(&cb->requests_lock);
+  return 0;
+} /* }}} int wh_stream_push_nolock */
+
+/* wh_send_nolock sends the contents of the send buffer, either synchronously,
+ * by submitting it to the sender thread or by adding it to the stream, and
+ * resets the buffer.
+ * must hold cb->send_lock when calling */
+static int wh_send_nolock(wh_callback_t *cb) /* {{{ */
+{
+  int status;
+
+  if (cb->multi != NULL)
+    status = wh_submit_nolock(cb);
+  else if (cb->ring != NULL)
+    status = wh_stream_push_nolock(cb);
+  else
+    status = wh_post_nolock(cb, cb->send_buffer, cb->send_buffer_fill);
+
+  wh_reset_buffer(cb);
+  return status;
+} /* }}} int wh_send_nolock */
+
 static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
 {
   int status;
@@ -315,33 +999,34 @@ static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
       return 0;
     }
 
-    status = wh_post_nolock(cb, cb->send_buffer, cb->send_buffer_fill);
-    wh_reset_buffer(cb);
+    status = wh_send_nolock(cb);
   } else if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB) {
     if (cb->send_buffer_fill <= 2) {
       cb->send_buffer_init_time = cdtime();
       return 0;
     }
 
-    status = format_json_finalize(cb->send_buffer, &cb->send_buffer_fill,
-                                  &cb->send_buffer_free);
-    if (status != 0) {
-      ERROR("write_http: wh_flush_nolock: "
-            "format_json_finalize failed.");
-      wh_reset_buffer(cb);
-      return status;
+    /* Streams add the brackets themselves, see
+     * wh_stream_read_callback(). */
+    if (cb->ring == NULL) {
+      status = format_json_finalize(cb->send_buffer, &cb->send_buffer_fill,
+                                    &cb->send_buffer_free);
+      if (status != 0) {
+        ERROR("write_http: wh_flush_nolock: "
+              "format_json_finalize failed.");
+        wh_reset_buffer(cb);
+        return status;
+      }
     }
 
-    status = wh_post_nolock(cb, cb->send_buffer, cb->send_buffer_fill);
-    wh_reset_buffer(cb);
+    status = wh_send_nolock(cb);
   } else if (cb->format == WH_FORMAT_INFLUXDB) {
     if (cb->send_buffer_fill == 0) {
       cb->send_buffer_init_time = cdtime();
       return 0;
     }
 
-    status = wh_post_nolock(cb, cb->send_buffer, cb->send_buffer_fill);
-    wh_reset_buffer(cb);
+    status = wh_send_nolock(cb);
   } else {
     ERROR("write_http: wh_flush_nolock: "
           "Unknown format: %i",
@@ -389,6 +1074,9 @@ static void wh_callback_free(void *data) /* {{{ */
   if (cb->send_buffer != NULL)
     wh_flush_nolock(/* timeout = */ 0, cb);
 
+  /* Waits for the requests in flight. */
+  wh_sender_destroy(cb);
+
   if (cb->curl != NULL) {
     curl_easy_cleanup(cb->curl);
     cb->curl = NULL;
@@ -397,6 +1085,9 @@ static void wh_callback_free(void *data) /* {{{ */
   curl_stats_destroy(cb->curl_stats);
   cb->curl_stats = NULL;
 
+  compressor_destroy(cb->compressor);
+  cb->compressor = NULL;
+
   if (cb->headers != NULL) {
     curl_slist_free_all(cb->headers);
     cb->headers = NULL;
@@ -414,6 +1105,12 @@ static void wh_callback_free(void *data) /* {{{ */
   sfree(cb->clientkeypass);
   sfree(cb->send_buffer);
   sfree(cb->metrics_prefix);
+  format_influxdb_cache_destroy(cb->influxdb_cache);
+  format_json_cache_destroy(cb->json_cache);
+
+  pthread_cond_destroy(&cb->requests_cond);
+  pthread_mutex_destroy(&cb->requests_lock);
+  pthread_mutex_destroy(&cb->send_lock);
 
   sfree(cb);
 } /* }}} void wh_callback_free */
@@ -512,9 +1209,9 @@ static int wh_write_json(const data_set_t *ds, const value_list_t *vl, /* {{{ */
     return -1;
   }
 
-  status =
-      format_json_value_list(cb->send_buffer, &cb->send_buffer_fill,
-                             &cb->send_buffer_free, ds, vl, cb->store_rates);
+  status = format_json_value_list_cached(
+      cb->json_cache, cb->send_buffer, &cb->send_buffer_fill,
+      &cb->send_buffer_free, ds, vl, cb->store_rates);
   if (status == -ENOMEM) {
     status = wh_flush_nolock(/* timeout = */ 0, cb);
     if (status != 0) {
@@ -523,9 +1220,9 @@ static int wh_write_json(const data_set_t *ds, const value_list_t *vl, /* {{{ */
       return status;
     }
 
-    status =
-        format_json_value_list(cb->send_buffer, &cb->send_buffer_fill,
-                               &cb->send_buffer_free, ds, vl, cb->store_rates);
+    status = format_json_value_list_cached(
+        cb->json_cache, cb->send_buffer, &cb->send_buffer_fill,
+        &cb->send_buffer_free, ds, vl, cb->store_rates);
   }
   if (status != 0) {
     pthread_mutex_unlock(&cb->send_lock);
@@ -604,9 +1301,9 @@ static int wh_write_influxdb(const data_set_t *ds,
     return -1;
   }
 
-  status = format_influxdb_value_list(cb->send_buffer + cb->send_buffer_fill,
-                                      cb->send_buffer_free, ds, vl, NS,
-                                      cb->store_rates, true);
+  status = format_influxdb_value_list_cached(
+      cb->influxdb_cache, cb->send_buffer + cb->send_buffer_fill,
+      cb->send_buffer_free, ds, vl, NS, cb->store_rates, true);
   if (status == -ENOMEM) {
     status = wh_flush_nolock(/* timeout = */ 0, cb);
     if (status != 0) {
@@ -615,9 +1312,9 @@ static int wh_write_influxdb(const data_set_t *ds,
       return status;
     }
 
-    status = format_influxdb_value_list(cb->send_buffer + cb->send_buffer_fill,
-                                        cb->send_buffer_free, ds, vl, NS,
-                                        cb->store_rates, true);
+    status = format_influxdb_value_list_cached(
+        cb->influxdb_cache, cb->send_buffer + cb->send_buffer_fill,
+        cb->send_buffer_free, ds, vl, NS, cb->store_rates, true);
   }
   if (status < 0) {
     pthread_mutex_unlock(&cb->send_lock);
@@ -764,6 +1461,9 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
   cb->metrics_prefix = strdup(WRITE_HTTP_DEFAULT_PREFIX);
   cb->curl_stats = NULL;
   cb->unix_socket_path = NULL;
+  cb->stream_buffer_size = WRITE_HTTP_DEFAULT_STREAM_BUFFER_SIZE;
+  cb->stream_max_size = WRITE_HTTP_DEFAULT_STREAM_MAX_SIZE;
+  cb->stream_max_age = WRITE_HTTP_DEFAULT_STREAM_MAX_AGE;
 
   if (cb->metrics_prefix == NULL) {
     ERROR("write_http plugin: strdup failed.");
@@ -772,6 +1472,8 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
   }
 
   pthread_mutex_init(&cb->send_lock, /* attr = */ NULL);
+  pthread_mutex_init(&cb->requests_lock, /* attr = */ NULL);
+  pthread_cond_init(&cb->requests_cond, /* attr = */ NULL);
 
   cf_util_get_string(ci, &cb->name);
 
@@ -887,6 +1589,56 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &cb->data_ttl);
     } else if (strcasecmp("Prefix", child->key) == 0) {
       status = cf_util_get_string(child, &cb->metrics_prefix);
+    } else if (strcasecmp("ConcurrentRequests", child->key) == 0) {
+      status = cf_util_get_int(child, &cb->concurrent_requests);
+      if ((status == 0) && (cb->concurrent_requests < 0)) {
+        ERROR("write_http plugin: `ConcurrentRequests' must not be "
+              "negative.");
+        status = EINVAL;
+      }
+    } else if (strcasecmp("Compression", child->key) == 0) {
+      char *value = NULL;
+
+      status = cf_util_get_string(child, &value);
+      if (status != 0)
+        break;
+
+      status = compress_algorithm_parse(value, &cb->compression);
+      if (status == ENOTSUP)
+        ERROR("write_http plugin: collectd was built without support for "
+              "\"Compression %s\".",
+              value);
+      else if (status != 0)
+        ERROR("write_http plugin: Invalid Compression option: %s.", value);
+      sfree(value);
+    } else if (strcasecmp("DropWhenBusy", child->key) == 0) {
+      status = cf_util_get_boolean(child, &cb->drop_when_busy);
+    } else if (strcasecmp("HTTP2", child->key) == 0) {
+      status = cf_util_get_boolean(child, &cb->http2);
+#ifndef CURL_HTTP_VERSION_2TLS
+      WARNING("write_http plugin: libcurl is too old for HTTP/2, "
+              "`HTTP2' is ignored.");
+#endif
+    } else if (strcasecmp("Streaming", child->key) == 0) {
+      status = cf_util_get_boolean(child, &cb->streaming);
+    } else if (strcasecmp("StreamBufferSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp <= 0)) {
+        ERROR("write_http plugin: `StreamBufferSize' must be positive.");
+        status = EINVAL;
+      }
+      cb->stream_buffer_size = (size_t)tmp;
+    } else if (strcasecmp("StreamMaxSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp <= 0)) {
+        ERROR("write_http plugin: `StreamMaxSize' must be positive.");
+        status = EINVAL;
+      }
+      cb->stream_max_size = (size_t)tmp;
+    } else if (strcasecmp("StreamMaxAge", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &cb->stream_max_age);
     } else if (strcasecmp("UnixSocket", child->key) == 0) {
 #ifdef CURL_VERSION_UNIX_SOCKETS
       status = cf_util_get_string(child, &cb->unix_socket_path);
@@ -937,6 +1689,24 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
     ERROR("write_http plugin: Ignoring invalid BufferSize setting (%d).",
           buffer_size);
 
+  if (cb->streaming) {
+    if (cb->concurrent_requests > 0) {
+      WARNING("write_http plugin: <%s>: `ConcurrentRequests' is ignored "
+              "when `Streaming' is enabled.",
+              cb->name);
+      cb->concurrent_requests = 0;
+    }
+    if (cb->compression != COMPRESS_NONE) {
+      WARNING("write_http plugin: <%s>: `Compression' is not supported "
+              "when `Streaming' is enabled and is ignored.",
+              cb->name);
+      cb->compression = COMPRESS_NONE;
+    }
+    /* The ring buffer must hold at least one batch. */
+    if (cb->stream_buffer_size < cb->send_buffer_size)
+      cb->stream_buffer_size = cb->send_buffer_size;
+  }
+
   /* Allocate the buffer. */
   cb->send_buffer = malloc(cb->send_buffer_size);
   if (cb->send_buffer == NULL) {
@@ -946,6 +1716,24 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  if (cb->send_metrics && (cb->format == WH_FORMAT_INFLUXDB)) {
+    cb->influxdb_cache = format_influxdb_cache_create();
+    if (cb->influxdb_cache == NULL) {
+      ERROR("write_http plugin: format_influxdb_cache_create failed.");
+      wh_callback_free(cb);
+      return -1;
+    }
+  }
+
+  if (cb->send_metrics && (cb->format == WH_FORMAT_JSON)) {
+    cb->json_cache = format_json_cache_create();
+    if (cb->json_cache == NULL) {
+      ERROR("write_http plugin: format_json_cache_create failed.");
+      wh_callback_free(cb);
+      return -1;
+    }
+  }
+
   /* Nulls the buffer and sets ..._free and ..._fill. */
   wh_reset_buffer(cb);
 
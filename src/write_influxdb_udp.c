@@ -25,6 +25,9 @@
  *   Paul (systemcrash) <newtwen thatfunny_at_symbol gmail.com>
  **/
 
+/* _GNU_SOURCE is needed in Linux to use sendmmsg */
+#define _GNU_SOURCE
+
 #include "collectd.h"
 
 #include "plugin.h"
@@ -72,6 +75,26 @@ typedef struct sockent {
 #define NET_DEFAULT_PACKET_SIZE 1452
 #define NET_DEFAULT_PORT "8089"
 
+/* Maximum number of finished packets sent with one sendmmsg(2) call. */
+#define SEND_BATCH_SIZE 16
+
+struct send_buffer_s;
+typedef struct send_buffer_s send_buffer_t;
+struct send_buffer_s {
+  /* Finished packets, followed by the packet currently being built. */
+  char *packets[SEND_BATCH_SIZE + 1];
+  size_t packets_len[SEND_BATCH_SIZE];
+  size_t packets_num; /* number of finished packets */
+
+  /* Fill level of the packet being built, i.e. packets[packets_num]. */
+  int buffer_fill;
+  cdtime_t first_update;
+  cdtime_t last_update;
+
+  pthread_mutex_t lock;
+  send_buffer_t *next;
+};
+
 /*
  * Private variables
  */
@@ -84,12 +107,16 @@ static format_influxdb_time_precision_t wifxudp_config_time_precision = MS;
 
 static sockent_t *sending_sockets;
 
-/* Buffer in which to-be-sent network packets are constructed. */
-static char *send_buffer;
-static char *send_buffer_ptr;
-static int send_buffer_fill;
-static cdtime_t send_buffer_last_update;
-static pthread_mutex_t send_buffer_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Buffers in which to-be-sent network packets are constructed. Each thread
+ * writing to this plugin has its own send buffer, so writers don't serialize
+ * on a single lock. All buffers are kept in the "send_buffers" list so they
+ * can be flushed and freed. */
+static send_buffer_t *send_buffers;
+static pthread_mutex_t send_buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t send_buffer_key;
+
+/* Measurement and tags of the lines, which never change for a series. */
+static format_influxdb_cache_t *prefix_cache;
 
 static int set_ttl(const sockent_t *se, const struct addrinfo *ai) {
 
@@ -303,25 +330,44 @@ static void sockent_destroy(sockent_t *se) {
   }
 } /* void sockent_destroy */
 
-static void write_influxdb_udp_init_buffer(void) {
-  memset(send_buffer, 0, wifxudp_config_packet_size);
-  send_buffer_ptr = send_buffer;
-  send_buffer_fill = 0;
-  send_buffer_last_update = 0;
-} /* write_influxdb_udp_init_buffer */
-
-static void write_influxdb_udp_send_buffer(sockent_t *sending_socket,
-                                           const char *buffer,
-                                           size_t buffer_size) {
-  while (42) {
-    int status = sockent_client_connect(sending_socket);
+/* Sends "buffers" to "se". The socket's lock must be held. */
+static void write_influxdb_udp_send_buffer(sockent_t *se,
+                                           char *const *buffers,
+                                           const size_t *buffers_size,
+                                           size_t buffers_num) {
+  size_t sent = 0;
+
+  while (sent < buffers_num) {
+    int status = sockent_client_connect(se);
     if (status != 0)
       return;
 
-    status =
-        sendto(sending_socket->client.fd, buffer, buffer_size,
-               /* flags = */ 0, (struct sockaddr *)sending_socket->client.addr,
-               sending_socket->client.addrlen);
+#if HAVE_SENDMMSG
+    struct mmsghdr msgs[SEND_BATCH_SIZE];
+    struct iovec iovs[SEND_BATCH_SIZE];
+    size_t num = buffers_num - sent;
+    if (num > SEND_BATCH_SIZE)
+      num = SEND_BATCH_SIZE;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < num; i++) {
+      iovs[i].iov_base = buffers[sent + i];
+      iovs[i].iov_len = buffers_size[sent + i];
+      msgs[i].msg_hdr.msg_iov = iovs + i;
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = se->client.addr;
+      msgs[i].msg_hdr.msg_namelen = se->client.addrlen;
+    }
+
+    status = sendmmsg(se->client.fd, msgs, (unsigned int)num,
+                      /* flags = */ 0);
+#else
+    status = sendto(se->client.fd, buffers[sent], buffers_size[sent],
+                    /* flags = */ 0, (struct sockaddr *)se->client.addr,
+                    se->client.addrlen);
+    if (status >= 0)
+      status = 1;
+#endif
     if (status < 0) {
       if ((errno == EINTR) || (errno == EAGAIN))
         continue;
@@ -329,61 +375,190 @@ static void write_influxdb_udp_send_buffer(sockent_t *sending_socket,
       ERROR("write_influxdb_udp plugin: "
             "sendto failed: %s. Closing sending socket.",
             STRERRNO);
-      sockent_client_disconnect(sending_socket);
+      sockent_client_disconnect(se);
       return;
     }
 
-    break;
-  } /* while (42) */
+    sent += (size_t)status;
+  } /* while (sent < buffers_num) */
 } /* void write_influxdb_udp_send_buffer */
 
-static void write_influxdb_send_buffers(char *buffer, size_t buffer_len) {
+static void write_influxdb_send_buffers(char *const *buffers,
+                                        const size_t *buffers_size,
+                                        size_t buffers_num) {
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
     pthread_mutex_lock(&se->lock);
-    write_influxdb_udp_send_buffer(se, buffer, buffer_len);
+    write_influxdb_udp_send_buffer(se, buffers, buffers_size, buffers_num);
     pthread_mutex_unlock(&se->lock);
   } /* for (sending_sockets) */
 }
 
-static void flush_buffer(void) {
-  write_influxdb_send_buffers(send_buffer, (size_t)send_buffer_fill);
-  write_influxdb_udp_init_buffer();
-}
+static void send_buffer_destroy(send_buffer_t *sb) {
+  if (sb == NULL)
+    return;
 
-static int
-write_influxdb_udp_write(const data_set_t *ds, const value_list_t *vl,
-                         user_data_t __attribute__((unused)) * user_data) {
-  char buffer[NET_DEFAULT_PACKET_SIZE];
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sb->packets); i++)
+    sfree(sb->packets[i]);
+  pthread_mutex_destroy(&sb->lock);
+  sfree(sb);
+} /* void send_buffer_destroy */
+
+static send_buffer_t *send_buffer_create(void) {
+  send_buffer_t *sb = calloc(1, sizeof(*sb));
+  if (sb == NULL)
+    return NULL;
+  pthread_mutex_init(&sb->lock, /* attr = */ NULL);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(sb->packets); i++) {
+    sb->packets[i] = malloc(wifxudp_config_packet_size);
+    if (sb->packets[i] == NULL) {
+      send_buffer_destroy(sb);
+      return NULL;
+    }
+  }
+
+  return sb;
+} /* send_buffer_t *send_buffer_create */
+
+/* Returns the calling thread's send buffer, creating it if necessary. */
+static send_buffer_t *send_buffer_get(void) {
+  send_buffer_t *sb = pthread_getspecific(send_buffer_key);
+  if (sb != NULL)
+    return sb;
+
+  sb = send_buffer_create();
+  if (sb == NULL) {
+    ERROR("write_influxdb_udp plugin: send_buffer_create failed.");
+    return NULL;
+  }
 
-  int status = format_influxdb_value_list(
-      buffer, NET_DEFAULT_PACKET_SIZE, ds, vl, wifxudp_config_time_precision,
-      wifxudp_config_store_rates, wifxudp_config_write_meta);
+  pthread_mutex_lock(&send_buffers_lock);
+  sb->next = send_buffers;
+  send_buffers = sb;
+  pthread_mutex_unlock(&send_buffers_lock);
+
+  pthread_setspecific(send_buffer_key, sb);
+  return sb;
+} /* send_buffer_t *send_buffer_get */
+
+/* Marks the packet being built as finished and starts a new one. The send
+ * buffer must be locked. */
+static void send_buffer_finish_packet(send_buffer_t *sb) {
+  if (sb->buffer_fill <= 0)
+    return;
+
+  sb->packets_len[sb->packets_num] = (size_t)sb->buffer_fill;
+  sb->packets_num++;
+  sb->buffer_fill = 0;
+} /* void send_buffer_finish_packet */
+
+/* Sends all finished packets. The send buffer must be locked. */
+static void send_buffer_send(send_buffer_t *sb) {
+  if (sb->packets_num == 0)
+    return;
+
+  write_influxdb_send_buffers(sb->packets, sb->packets_len, sb->packets_num);
+
+  /* Move the packet being built to the front. */
+  char *tmp = sb->packets[0];
+  sb->packets[0] = sb->packets[sb->packets_num];
+  sb->packets[sb->packets_num] = tmp;
+  sb->packets_num = 0;
+  if (sb->buffer_fill == 0)
+    sb->first_update = 0;
+} /* void send_buffer_send */
+
+/* Adds "vl" to the send buffer. The send buffer must be locked. */
+static int send_buffer_add(send_buffer_t *sb, const data_set_t *ds,
+                           const value_list_t *vl) {
+  int status = format_influxdb_value_list_cached(
+      prefix_cache, sb->packets[sb->packets_num] + sb->buffer_fill,
+      (int)wifxudp_config_packet_size - sb->buffer_fill, ds, vl,
+      wifxudp_config_time_precision, wifxudp_config_store_rates,
+      wifxudp_config_write_meta);
+  if ((status == -ENOMEM) && (sb->buffer_fill > 0)) {
+    send_buffer_finish_packet(sb);
+    if (sb->packets_num >= SEND_BATCH_SIZE)
+      send_buffer_send(sb);
+
+    status = format_influxdb_value_list_cached(
+        prefix_cache, sb->packets[sb->packets_num],
+        (int)wifxudp_config_packet_size, ds, vl, wifxudp_config_time_precision,
+        wifxudp_config_store_rates, wifxudp_config_write_meta);
+  }
 
   if (status < 0) {
-    ERROR("write_influxdb_udp plugin: write_influxdb_udp_write failed.");
+    ERROR("write_influxdb_udp plugin: format_influxdb_value_list failed.");
     return -1;
   }
   if (status == 0) /* no real values to send (nan) */
     return 0;
 
-  pthread_mutex_lock(&send_buffer_lock);
-  if (wifxudp_config_packet_size - send_buffer_fill < status)
-    flush_buffer();
-  memcpy(send_buffer_ptr, buffer, status);
-
-  send_buffer_fill += status;
-  send_buffer_ptr += status;
-  send_buffer_last_update = cdtime();
+  cdtime_t now = cdtime();
+  if (sb->first_update == 0)
+    sb->first_update = now;
+  sb->buffer_fill += status;
+  sb->last_update = now;
 
-  if (wifxudp_config_packet_size - send_buffer_fill < 120)
+  if (wifxudp_config_packet_size - sb->buffer_fill < 120) {
     /* No room for a new point of average size in buffer,
        the probability of fail for the new point is bigger than
        the probability of success */
-    flush_buffer();
+    send_buffer_finish_packet(sb);
+    if (sb->packets_num >= SEND_BATCH_SIZE)
+      send_buffer_send(sb);
+  }
 
-  pthread_mutex_unlock(&send_buffer_lock);
   return 0;
-} /* int write_influxdb_udp_write */
+} /* int send_buffer_add */
+
+/* Sends the data that has been waiting for more values for longer than one
+ * interval. Without this, a packet of a write thread that rarely gets values
+ * could be held back until shutdown. Buffers locked by another thread are
+ * skipped. */
+static void send_buffers_send_stale(cdtime_t now) {
+  cdtime_t interval = plugin_get_interval();
+
+  pthread_mutex_lock(&send_buffers_lock);
+  send_buffer_t *sb = send_buffers;
+  pthread_mutex_unlock(&send_buffers_lock);
+
+  for (; sb != NULL; sb = sb->next) {
+    if (pthread_mutex_trylock(&sb->lock) != 0)
+      continue;
+    if ((sb->first_update != 0) && ((sb->first_update + interval) <= now)) {
+      send_buffer_finish_packet(sb);
+      send_buffer_send(sb);
+    }
+    pthread_mutex_unlock(&sb->lock);
+  }
+} /* void send_buffers_send_stale */
+
+static int
+write_influxdb_udp_write_batch(const data_set_t *const *ds,
+                               const value_list_t *const *vl, size_t num,
+                               user_data_t __attribute__((unused)) *
+                                   user_data) {
+  int ret = 0;
+
+  send_buffer_t *sb = send_buffer_get();
+  if (sb == NULL)
+    return ENOMEM;
+
+  pthread_mutex_lock(&sb->lock);
+  for (size_t i = 0; i < num; i++) {
+    if (send_buffer_add(sb, ds[i], vl[i]) != 0)
+      ret = -1;
+  }
+
+  /* Packets are not kept around between calls, only the unfinished one. */
+  send_buffer_send(sb);
+  pthread_mutex_unlock(&sb->lock);
+
+  send_buffers_send_stale(cdtime());
+
+  return ret;
+} /* int write_influxdb_udp_write_batch */
 
 static int wifxudp_config_set_ttl(const oconfig_item_t *ci) {
   int tmp = 0;
@@ -523,10 +698,18 @@ static int write_influxdb_udp_config(oconfig_item_t *ci) {
 } /* int write_influxdb_udp_config */
 
 static int write_influxdb_udp_shutdown(void) {
-  if (send_buffer_fill > 0)
-    flush_buffer();
+  /* The write threads have been stopped, so the buffers are no longer used. */
+  while (send_buffers != NULL) {
+    send_buffer_t *sb = send_buffers;
+    send_buffers = sb->next;
+
+    send_buffer_finish_packet(sb);
+    send_buffer_send(sb);
+    send_buffer_destroy(sb);
+  }
 
-  sfree(send_buffer);
+  format_influxdb_cache_destroy(prefix_cache);
+  prefix_cache = NULL;
 
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
     sockent_client_disconnect(se);
@@ -551,17 +734,24 @@ static int write_influxdb_udp_init(void) {
 
   plugin_register_shutdown("write_influxdb_udp", write_influxdb_udp_shutdown);
 
-  send_buffer = malloc(wifxudp_config_packet_size);
-  if (send_buffer == NULL) {
-    ERROR("write_influxdb_udp plugin: malloc failed.");
-    return -1;
-  }
-  write_influxdb_udp_init_buffer();
-
   /* setup socket(s) and so on */
   if (sending_sockets != NULL) {
-    plugin_register_write("write_influxdb_udp", write_influxdb_udp_write,
-                          /* user_data = */ NULL);
+    int status = pthread_key_create(&send_buffer_key, /* destructor = */ NULL);
+    if (status != 0) {
+      ERROR("write_influxdb_udp plugin: pthread_key_create failed: %s",
+            STRERROR(status));
+      return -1;
+    }
+
+    /* Without the cache, every line is formatted from scratch. */
+    prefix_cache = format_influxdb_cache_create();
+    if (prefix_cache == NULL)
+      WARNING("write_influxdb_udp plugin: format_influxdb_cache_create "
+              "failed.");
+
+    plugin_register_write_batch("write_influxdb_udp",
+                                write_influxdb_udp_write_batch,
+                                /* user_data = */ NULL);
   }
 
   return 0;
@@ -572,19 +762,23 @@ static int write_influxdb_udp_flush(cdtime_t timeout,
                                     const char *identifier,
                                     __attribute__((unused))
                                     user_data_t *user_data) {
-  pthread_mutex_lock(&send_buffer_lock);
-
-  if (send_buffer_fill > 0) {
-    if (timeout > 0) {
-      cdtime_t now = cdtime();
-      if ((send_buffer_last_update + timeout) > now) {
-        pthread_mutex_unlock(&send_buffer_lock);
-        return 0;
-      }
+  cdtime_t now = cdtime();
+
+  pthread_mutex_lock(&send_buffers_lock);
+  send_buffer_t *sb = send_buffers;
+  pthread_mutex_unlock(&send_buffers_lock);
+
+  /* Buffers are only removed from the list at shutdown, so the list can be
+   * walked without holding send_buffers_lock. */
+  for (; sb != NULL; sb = sb->next) {
+    pthread_mutex_lock(&sb->lock);
+    if ((sb->buffer_fill > 0) &&
+        ((timeout == 0) || ((sb->last_update + timeout) <= now))) {
+      send_buffer_finish_packet(sb);
+      send_buffer_send(sb);
     }
-    flush_buffer();
+    pthread_mutex_unlock(&sb->lock);
   }
-  pthread_mutex_unlock(&send_buffer_lock);
 
   return 0;
 } /* int write_influxdb_udp_flush */
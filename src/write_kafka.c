@@ -44,6 +44,9 @@ struct kafka_topic_context {
   uint8_t format;
   unsigned int graphite_flags;
   bool store_rates;
+  bool key_host;
+  bool batch;
+  size_t batch_max_size;
   rd_kafka_topic_conf_t *conf;
   rd_kafka_topic_t *topic;
   rd_kafka_conf_t *kafka_conf;
@@ -53,11 +56,15 @@ struct kafka_topic_context {
   char *postfix;
   char escape_char;
   char *topic_name;
+  format_json_cache_t *json_cache;
   pthread_mutex_t lock;
 };
 
 static int kafka_handle(struct kafka_topic_context *);
 static int kafka_write(const data_set_t *, const value_list_t *, user_data_t *);
+static int kafka_write_batch(const data_set_t *const *,
+                             const value_list_t *const *, size_t,
+                             user_data_t *);
 static int32_t kafka_partition(const rd_kafka_topic_t *, const void *, size_t,
                                int32_t, void *, void *);
 
@@ -92,6 +99,10 @@ static uint32_t kafka_hash(const char *keydata, size_t keylen) {
   return hash;
 }
 
+/* Default upper bound of batched messages, well below the default of
+ * "message.max.bytes". */
+#define KAFKA_BATCH_MAX_SIZE 65536
+
 /* 31 bit -> 4 byte -> 8 byte hex string + null byte */
 #define KAFKA_RANDOM_KEY_SIZE 9
 #define KAFKA_RANDOM_KEY_BUFFER                                                \
@@ -101,6 +112,18 @@ static char *kafka_random_key(char buffer[static KAFKA_RANDOM_KEY_SIZE]) {
   return buffer;
 }
 
+/* Returns the message key for "vl": the host name if "Key Host" is
+ * configured, the configured key or a random key otherwise. */
+static char const *kafka_key(struct kafka_topic_context *ctx, /* {{{ */
+                             value_list_t const *vl,
+                             char buffer[static KAFKA_RANDOM_KEY_SIZE]) {
+  if (ctx->key_host)
+    return vl->host;
+  if (ctx->key != NULL)
+    return ctx->key;
+  return kafka_random_key(buffer);
+} /* }}} char const *kafka_key */
+
 static int32_t kafka_partition(const rd_kafka_topic_t *rkt, const void *keydata,
                                size_t keylen, int32_t partition_cnt, void *p,
                                void *m) {
@@ -173,7 +196,7 @@ static int kafka_handle(struct kafka_topic_context *ctx) /* {{{ */
 static int kafka_write(const data_set_t *ds, /* {{{ */
                        const value_list_t *vl, user_data_t *ud) {
   int status = 0;
-  void *key;
+  char const *key;
   size_t keylen = 0;
   char buffer[8192];
   size_t bfree = sizeof(buffer);
@@ -190,8 +213,6 @@ static int kafka_write(const data_set_t *ds, /* {{{ */
   if (status != 0)
     return status;
 
-  bzero(buffer, sizeof(buffer));
-
   switch (ctx->format) {
   case KAFKA_FORMAT_COMMAND:
     status = cmd_create_putval(buffer, sizeof(buffer), ds, vl);
@@ -204,7 +225,8 @@ static int kafka_write(const data_set_t *ds, /* {{{ */
     break;
   case KAFKA_FORMAT_JSON:
     format_json_initialize(buffer, &bfill, &bfree);
-    format_json_value_list(buffer, &bfill, &bfree, ds, vl, ctx->store_rates);
+    format_json_value_list_cached(ctx->json_cache, buffer, &bfill, &bfree, ds,
+                                  vl, ctx->store_rates);
     format_json_finalize(buffer, &bfill, &bfree);
     blen = strlen(buffer);
     break;
@@ -224,8 +246,7 @@ static int kafka_write(const data_set_t *ds, /* {{{ */
     return -1;
   }
 
-  key =
-      (ctx->key != NULL) ? ctx->key : kafka_random_key(KAFKA_RANDOM_KEY_BUFFER);
+  key = kafka_key(ctx, vl, KAFKA_RANDOM_KEY_BUFFER);
   keylen = strlen(key);
 
   rd_kafka_produce(ctx->topic, RD_KAFKA_PARTITION_UA, RD_KAFKA_MSG_F_COPY,
@@ -234,6 +255,248 @@ static int kafka_write(const data_set_t *ds, /* {{{ */
   return status;
 } /* }}} int kafka_write */
 
+/* A message being assembled by kafka_write_batch(). Value lists with the same
+ * key are packed into one message, either as a JSON array or as one line per
+ * value list. */
+typedef struct {
+  char key[DATA_MAX_NAME_LEN];
+  char *buffer;
+  size_t fill;
+  size_t free;
+} kafka_batch_msg_t;
+
+typedef struct {
+  struct kafka_topic_context *ctx;
+
+  kafka_batch_msg_t *open;
+  size_t open_num;
+
+  /* Finished messages. Ownership of the payloads is passed to librdkafka by
+   * rd_kafka_produce_batch(). */
+  rd_kafka_message_t *done;
+  char (*done_keys)[DATA_MAX_NAME_LEN];
+  size_t done_num;
+  size_t done_size;
+} kafka_batch_t;
+
+static int kafka_batch_msg_init(kafka_batch_t *b, /* {{{ */
+                                kafka_batch_msg_t *m) {
+  m->buffer = malloc(b->ctx->batch_max_size);
+  if (m->buffer == NULL)
+    return ENOMEM;
+  m->buffer[0] = 0;
+  m->fill = 0;
+  m->free = b->ctx->batch_max_size;
+  return 0;
+} /* }}} int kafka_batch_msg_init */
+
+/* Moves the payload of "m" to the list of finished messages. "m" has to be
+ * re-initialized before it is used again. */
+static int kafka_batch_msg_finish(kafka_batch_t *b, /* {{{ */
+                                  kafka_batch_msg_t *m) {
+  if (m->fill == 0) {
+    sfree(m->buffer);
+    return 0;
+  }
+
+  if (b->ctx->format == KAFKA_FORMAT_JSON)
+    format_json_finalize(m->buffer, &m->fill, &m->free);
+
+  if (b->done_num >= b->done_size) {
+    size_t size = (b->done_size == 0) ? 8 : 2 * b->done_size;
+    rd_kafka_message_t *done = realloc(b->done, size * sizeof(*done));
+    if (done == NULL)
+      return ENOMEM;
+    b->done = done;
+
+    char(*keys)[DATA_MAX_NAME_LEN] = realloc(b->done_keys, size * sizeof(*keys));
+    if (keys == NULL)
+      return ENOMEM;
+    b->done_keys = keys;
+    b->done_size = size;
+  }
+
+  /* The key pointers are set in kafka_batch_produce(), because "done_keys"
+   * may still move. */
+  b->done[b->done_num] = (rd_kafka_message_t){
+      .payload = m->buffer,
+      .len = m->fill,
+  };
+  sstrncpy(b->done_keys[b->done_num], m->key, sizeof(b->done_keys[0]));
+  b->done_num++;
+
+  m->buffer = NULL;
+  m->fill = 0;
+  m->free = 0;
+  return 0;
+} /* }}} int kafka_batch_msg_finish */
+
+static kafka_batch_msg_t *kafka_batch_msg_get(kafka_batch_t *b, /* {{{ */
+                                              char const *key) {
+  for (size_t i = 0; i < b->open_num; i++)
+    if (strcmp(b->open[i].key, key) == 0)
+      return b->open + i;
+
+  kafka_batch_msg_t *m = b->open + b->open_num;
+  sstrncpy(m->key, key, sizeof(m->key));
+  if (kafka_batch_msg_init(b, m) != 0)
+    return NULL;
+  b->open_num++;
+  return m;
+} /* }}} kafka_batch_msg_t *kafka_batch_msg_get */
+
+/* Appends "line" to the message, starting a new message if it doesn't fit. */
+static int kafka_batch_msg_append(kafka_batch_t *b, /* {{{ */
+                                  kafka_batch_msg_t *m, char const *line,
+                                  size_t len) {
+  if ((len >= m->free) && (m->fill > 0)) {
+    int status = kafka_batch_msg_finish(b, m);
+    if (status == 0)
+      status = kafka_batch_msg_init(b, m);
+    if (status != 0)
+      return status;
+  }
+
+  if (len >= m->free)
+    return ENOMEM;
+
+  memcpy(m->buffer + m->fill, line, len + 1);
+  m->fill += len;
+  m->free -= len;
+  return 0;
+} /* }}} int kafka_batch_msg_append */
+
+static int kafka_batch_add(kafka_batch_t *b, const data_set_t *ds, /* {{{ */
+                           const value_list_t *vl) {
+  struct kafka_topic_context *ctx = b->ctx;
+  char line[8192];
+  int status;
+
+  kafka_batch_msg_t *m =
+      kafka_batch_msg_get(b, ctx->key_host ? vl->host : "");
+  if (m == NULL)
+    return ENOMEM;
+
+  switch (ctx->format) {
+  case KAFKA_FORMAT_JSON:
+    status = format_json_value_list_cached(ctx->json_cache, m->buffer,
+                                           &m->fill, &m->free, ds, vl,
+                                           ctx->store_rates);
+    if ((status == -ENOMEM) && (m->fill > 0)) {
+      status = kafka_batch_msg_finish(b, m);
+      if (status == 0)
+        status = kafka_batch_msg_init(b, m);
+      if (status == 0)
+        status = format_json_value_list_cached(ctx->json_cache, m->buffer,
+                                               &m->fill, &m->free, ds, vl,
+                                               ctx->store_rates);
+    }
+    return status;
+  case KAFKA_FORMAT_COMMAND:
+    status = cmd_create_putval(line, sizeof(line) - 1, ds, vl);
+    if (status != 0)
+      return status;
+    strcat(line, "\n");
+    break;
+  case KAFKA_FORMAT_GRAPHITE:
+    status = format_graphite(line, sizeof(line), ds, vl, ctx->prefix,
+                             ctx->postfix, ctx->escape_char,
+                             ctx->graphite_flags);
+    if (status != 0)
+      return status;
+    break;
+  default:
+    return -1;
+  }
+
+  return kafka_batch_msg_append(b, m, line, strlen(line));
+} /* }}} int kafka_batch_add */
+
+static int kafka_batch_produce(kafka_batch_t *b) /* {{{ */
+{
+  struct kafka_topic_context *ctx = b->ctx;
+
+  if (b->done_num == 0)
+    return 0;
+
+  for (size_t i = 0; i < b->done_num; i++) {
+    char const *key = b->done_keys[i];
+    if (key[0] == 0)
+      key = (ctx->key != NULL) ? ctx->key
+                               : kafka_random_key(b->done_keys[i]);
+    b->done[i].key = (void *)key;
+    b->done[i].key_len = strlen(key);
+  }
+
+  rd_kafka_produce_batch(ctx->topic, RD_KAFKA_PARTITION_UA,
+                         RD_KAFKA_MSG_F_FREE, b->done, (int)b->done_num);
+
+  /* librdkafka only takes ownership of the payloads it enqueued. */
+  int status = 0;
+  for (size_t i = 0; i < b->done_num; i++) {
+    if (b->done[i].err == RD_KAFKA_RESP_ERR_NO_ERROR)
+      continue;
+    ERROR("write_kafka plugin: Producing a message to \"%s\" failed: %s",
+          ctx->topic_name, rd_kafka_err2str(b->done[i].err));
+    sfree(b->done[i].payload);
+    status = -1;
+  }
+
+  b->done_num = 0;
+  return status;
+} /* }}} int kafka_batch_produce */
+
+static int kafka_write_batch(const data_set_t *const *ds, /* {{{ */
+                             const value_list_t *const *vl, size_t num,
+                             user_data_t *ud) {
+  struct kafka_topic_context *ctx = ud->data;
+  int status;
+
+  if ((ds == NULL) || (vl == NULL) || (ctx == NULL))
+    return EINVAL;
+  if (num == 0)
+    return 0;
+
+  pthread_mutex_lock(&ctx->lock);
+  status = kafka_handle(ctx);
+  pthread_mutex_unlock(&ctx->lock);
+  if (status != 0)
+    return status;
+
+  kafka_batch_t b = {
+      .ctx = ctx,
+      .open = calloc(ctx->key_host ? num : 1, sizeof(*b.open)),
+  };
+  if (b.open == NULL)
+    return ENOMEM;
+
+  int ret = 0;
+  for (size_t i = 0; i < num; i++) {
+    status = kafka_batch_add(&b, ds[i], vl[i]);
+    if (status != 0) {
+      ERROR("write_kafka plugin: Formatting a value list failed with status "
+            "%i.",
+            status);
+      ret = status;
+    }
+  }
+
+  for (size_t i = 0; i < b.open_num; i++)
+    if (kafka_batch_msg_finish(&b, b.open + i) != 0) {
+      sfree(b.open[i].buffer);
+      ret = ENOMEM;
+    }
+
+  status = kafka_batch_produce(&b);
+  if (status != 0)
+    ret = status;
+
+  sfree(b.open);
+  sfree(b.done);
+  sfree(b.done_keys);
+  return ret;
+} /* }}} int kafka_write_batch */
+
 static void kafka_topic_context_free(void *p) /* {{{ */
 {
   struct kafka_topic_context *ctx = p;
@@ -243,6 +506,11 @@ static void kafka_topic_context_free(void *p) /* {{{ */
 
   if (ctx->topic_name != NULL)
     sfree(ctx->topic_name);
+#if RD_KAFKA_VERSION >= 0x000902ff
+  /* Deliver queued messages before the handle goes away. */
+  if (ctx->kafka != NULL)
+    rd_kafka_flush(ctx->kafka, /* timeout_ms = */ 10000);
+#endif
   if (ctx->topic != NULL)
     rd_kafka_topic_destroy(ctx->topic);
   if (ctx->conf != NULL)
@@ -251,6 +519,7 @@ static void kafka_topic_context_free(void *p) /* {{{ */
     rd_kafka_conf_destroy(ctx->kafka_conf);
   if (ctx->kafka != NULL)
     rd_kafka_destroy(ctx->kafka);
+  format_json_cache_destroy(ctx->json_cache);
 
   sfree(ctx);
 } /* }}} void kafka_topic_context_free */
@@ -276,6 +545,7 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
   tctx->store_rates = true;
   tctx->format = KAFKA_FORMAT_JSON;
   tctx->key = NULL;
+  tctx->batch_max_size = KAFKA_BATCH_MAX_SIZE;
 
   if ((tctx->kafka_conf = rd_kafka_conf_dup(conf)) == NULL) {
     sfree(tctx);
@@ -343,6 +613,9 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
       if (strcasecmp("Random", tctx->key) == 0) {
         sfree(tctx->key);
         tctx->key = strdup(kafka_random_key(KAFKA_RANDOM_KEY_BUFFER));
+      } else if (strcasecmp("Host", tctx->key) == 0) {
+        sfree(tctx->key);
+        tctx->key_host = true;
       }
     } else if (strcasecmp("Format", child->key) == 0) {
       status = cf_util_get_string(child, &key);
@@ -371,6 +644,19 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
       (void)cf_util_get_flag(child, &tctx->graphite_flags,
                              GRAPHITE_STORE_RATES);
 
+    } else if (strcasecmp("Batch", child->key) == 0) {
+      status = cf_util_get_boolean(child, &tctx->batch);
+
+    } else if (strcasecmp("BatchMaxSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1024)) {
+        WARNING("write_kafka plugin: BatchMaxSize must be at least 1024.");
+        status = -1;
+      }
+      if (status == 0)
+        tctx->batch_max_size = (size_t)tmp;
+
     } else if (strcasecmp("GraphiteSeparateInstances", child->key) == 0) {
       status = cf_util_get_flag(child, &tctx->graphite_flags,
                                 GRAPHITE_SEPARATE_INSTANCES);
@@ -407,17 +693,28 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
       break;
   }
 
+  if (tctx->format == KAFKA_FORMAT_JSON) {
+    tctx->json_cache = format_json_cache_create();
+    if (tctx->json_cache == NULL) {
+      ERROR("write_kafka plugin: format_json_cache_create failed.");
+      goto errout;
+    }
+  }
+
   rd_kafka_topic_conf_set_partitioner_cb(tctx->conf, kafka_partition);
   rd_kafka_topic_conf_set_opaque(tctx->conf, tctx);
 
   ssnprintf(callback_name, sizeof(callback_name), "write_kafka/%s",
             tctx->topic_name);
 
-  status = plugin_register_write(callback_name, kafka_write,
-                                 &(user_data_t){
-                                     .data = tctx,
-                                     .free_func = kafka_topic_context_free,
-                                 });
+  user_data_t ud = {
+      .data = tctx,
+      .free_func = kafka_topic_context_free,
+  };
+  if (tctx->batch)
+    status = plugin_register_write_batch(callback_name, kafka_write_batch, &ud);
+  else
+    status = plugin_register_write(callback_name, kafka_write, &ud);
   if (status != 0) {
     WARNING("write_kafka plugin: plugin_register_write (\"%s\") "
             "failed with status %i.",
@@ -431,6 +728,7 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
 errout:
   if (tctx->topic_name != NULL)
     free(tctx->topic_name);
+  format_json_cache_destroy(tctx->json_cache);
   if (tctx->conf != NULL)
     rd_kafka_topic_conf_destroy(tctx->conf);
   if (tctx->kafka_conf != NULL)
@@ -485,6 +783,22 @@ static int kafka_config(oconfig_item_t *ci) /* {{{ */
       }
       sfree(key);
       sfree(val);
+    } else if (strcasecmp("Compression", child->key) == 0) {
+      /* librdkafka compresses whole message batches, which compresses much
+       * better than compressing each small message on its own. */
+      char *codec = NULL;
+
+      if (cf_util_get_string(child, &codec) != 0)
+        goto errout;
+      ret = rd_kafka_conf_set(conf, "compression.codec", codec, errbuf,
+                              sizeof(errbuf));
+      if (ret != RD_KAFKA_CONF_OK) {
+        WARNING("write_kafka plugin: cannot set compression to %s: %s", codec,
+                errbuf);
+        sfree(codec);
+        goto errout;
+      }
+      sfree(codec);
     } else {
       WARNING("write_kafka plugin: Ignoring unknown "
               "configuration option \"%s\" at top level.",
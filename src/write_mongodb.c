@@ -33,6 +33,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils_cache.h"
 
@@ -53,37 +54,43 @@ struct wm_node_s {
   bool store_rates;
   bool connected;
 
+  /* Documents are inserted in bulk once "batch_size" documents have been
+   * queued for a collection or the oldest one is older than
+   * "flush_interval". */
+  int batch_size;
+  cdtime_t flush_interval;
+  cdtime_t last_sweep;
+
   mongoc_client_t *client;
   mongoc_database_t *database;
+  /* Maps collection (i.e. plugin) names to wm_collection_t. */
+  c_avl_tree_t *collections;
   pthread_mutex_t lock;
 };
 typedef struct wm_node_s wm_node_t;
 
+struct wm_collection_s {
+  mongoc_collection_t *collection;
+  mongoc_bulk_operation_t *bulk;
+  int pending;
+  cdtime_t pending_since;
+
+  /* Re-initialized for every document, so its buffer is reused. */
+  bson_t doc;
+};
+typedef struct wm_collection_s wm_collection_t;
+
 /*
  * Functions
  */
-static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
-                              const value_list_t *vl, bool store_rates) {
-  bson_t *ret;
+/* Fills "ret" with the document for "vl". If "rates" is not NULL, values are
+ * stored as rates. */
+static int wm_create_bson(bson_t *ret, const data_set_t *ds, /* {{{ */
+                          const value_list_t *vl, gauge_t const *rates) {
   bson_t subarray;
-  gauge_t *rates;
+  bool store_rates = (rates != NULL);
 
-  ret = bson_new();
-  if (!ret) {
-    ERROR("write_mongodb plugin: bson_new failed.");
-    return NULL;
-  }
-
-  if (store_rates) {
-    rates = uc_get_rate(ds, vl);
-    if (rates == NULL) {
-      ERROR("write_mongodb plugin: uc_get_rate() failed.");
-      bson_destroy(ret);
-      return NULL;
-    }
-  } else {
-    rates = NULL;
-  }
+  bson_reinit(ret);
 
   BSON_APPEND_DATE_TIME(ret, "timestamp", CDTIME_T_TO_MS(vl->time));
   BSON_APPEND_UTF8(ret, "host", vl->host);
@@ -111,8 +118,7 @@ static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
     else {
       ERROR("write_mongodb plugin: Unknown ds_type %d for index %" PRIsz,
             ds->ds[i].type, i);
-      bson_destroy(ret);
-      return NULL;
+      return -1;
     }
   }
   bson_append_array_end(ret, &subarray); /* }}} values */
@@ -139,19 +145,16 @@ static bson_t *wm_create_bson(const data_set_t *ds, /* {{{ */
   }
   bson_append_array_end(ret, &subarray); /* }}} dsnames */
 
-  sfree(rates);
-
   size_t error_location;
   if (!bson_validate(ret, BSON_VALIDATE_UTF8, &error_location)) {
     ERROR("write_mongodb plugin: Error in generated BSON document "
           "at byte %" PRIsz,
           error_location);
-    bson_destroy(ret);
-    return NULL;
+    return -1;
   }
 
-  return ret;
-} /* }}} bson *wm_create_bson */
+  return 0;
+} /* }}} int wm_create_bson */
 
 static int wm_initialize(wm_node_t *node) /* {{{ */
 {
@@ -218,68 +221,233 @@ static int wm_initialize(wm_node_t *node) /* {{{ */
   return 0;
 } /* }}} int wm_initialize */
 
+static void wm_collection_destroy(wm_collection_t *c) /* {{{ */
+{
+  if (c == NULL)
+    return;
+
+  if (c->pending > 0)
+    WARNING("write_mongodb plugin: Dropping %d queued documents.", c->pending);
+
+  mongoc_bulk_operation_destroy(c->bulk);
+  if (c->collection != NULL)
+    mongoc_collection_destroy(c->collection);
+  bson_destroy(&c->doc);
+  sfree(c);
+} /* }}} void wm_collection_destroy */
+
+static void wm_disconnect(wm_node_t *node) /* {{{ */
+{
+  void *key;
+  void *value;
+
+  /* Collection handles belong to the client, so they go first. */
+  if (node->collections != NULL) {
+    while (c_avl_pick(node->collections, &key, &value) == 0) {
+      sfree(key);
+      wm_collection_destroy(value);
+    }
+  }
+
+  mongoc_database_destroy(node->database);
+  mongoc_client_destroy(node->client);
+  node->database = NULL;
+  node->client = NULL;
+  node->connected = false;
+} /* }}} void wm_disconnect */
+
+static wm_collection_t *wm_collection_get(wm_node_t *node, /* {{{ */
+                                          char const *name) {
+  wm_collection_t *c = NULL;
+
+  if (c_avl_get(node->collections, name, (void *)&c) == 0)
+    return c;
+
+  c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return NULL;
+  bson_init(&c->doc);
+
+  c->collection = mongoc_client_get_collection(node->client, "collectd", name);
+  if (c->collection == NULL) {
+    ERROR("write_mongodb plugin: error creating/getting collection");
+    wm_collection_destroy(c);
+    return NULL;
+  }
+
+  char *key = strdup(name);
+  if ((key == NULL) || (c_avl_insert(node->collections, key, c) != 0)) {
+    sfree(key);
+    wm_collection_destroy(c);
+    return NULL;
+  }
+
+  return c;
+} /* }}} wm_collection_t *wm_collection_get */
+
+/* Queues the document in "c->doc" for insertion. */
+static int wm_collection_add(wm_collection_t *c) /* {{{ */
+{
+  if (c->bulk == NULL) {
+#if MONGOC_CHECK_VERSION(1, 9, 0)
+    bson_t opts = BSON_INITIALIZER;
+    BSON_APPEND_BOOL(&opts, "ordered", false);
+    c->bulk = mongoc_collection_create_bulk_operation_with_opts(c->collection,
+                                                                &opts);
+    bson_destroy(&opts);
+#else
+    c->bulk = mongoc_collection_create_bulk_operation(
+        c->collection, /* ordered = */ false, /* write_concern = */ NULL);
+#endif
+    if (c->bulk == NULL) {
+      ERROR("write_mongodb plugin: error creating bulk operation");
+      return -1;
+    }
+    c->pending = 0;
+    c->pending_since = cdtime();
+  }
+
+  mongoc_bulk_operation_insert(c->bulk, &c->doc);
+  c->pending++;
+  return 0;
+} /* }}} int wm_collection_add */
+
+/* Inserts the queued documents. A bulk operation can only be executed once, so
+ * the next document starts a new one. */
+static int wm_collection_flush(wm_collection_t *c) /* {{{ */
+{
+  bson_t reply;
+  bson_error_t error;
+
+  if (c->bulk == NULL)
+    return 0;
+
+  uint32_t status = mongoc_bulk_operation_execute(c->bulk, &reply, &error);
+  bson_destroy(&reply);
+  mongoc_bulk_operation_destroy(c->bulk);
+  c->bulk = NULL;
+  c->pending = 0;
+
+  if (status == 0) {
+    ERROR("write_mongodb plugin: error inserting records: %s", error.message);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int wm_collection_flush */
+
+/* Flushes all collections with documents older than "timeout". Drops the
+ * connection if an insert fails. Must be called with the node lock held. */
+static int wm_flush_all(wm_node_t *node, cdtime_t timeout) /* {{{ */
+{
+  cdtime_t now = cdtime();
+  int status = 0;
+
+  node->last_sweep = now;
+  if (!node->connected)
+    return 0;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(node->collections);
+  if (iter == NULL)
+    return ENOMEM;
+
+  void *key;
+  void *value;
+  while (c_avl_iterator_next(iter, &key, &value) == 0) {
+    wm_collection_t *c = value;
+
+    if ((c->pending == 0) ||
+        ((timeout != 0) && (now - c->pending_since < timeout)))
+      continue;
+
+    status = wm_collection_flush(c);
+    if (status != 0)
+      break;
+  }
+  c_avl_iterator_destroy(iter);
+
+  if (status != 0)
+    wm_disconnect(node);
+  return status;
+} /* }}} int wm_flush_all */
+
 static int wm_write(const data_set_t *ds, /* {{{ */
                     const value_list_t *vl, user_data_t *ud) {
   wm_node_t *node = ud->data;
-  mongoc_collection_t *collection = NULL;
-  bson_t *bson_record;
-  bson_error_t error;
+  gauge_t *rates = NULL;
   int status;
 
-  bson_record = wm_create_bson(ds, vl, node->store_rates);
-  if (!bson_record) {
-    ERROR("write_mongodb plugin: error making insert bson");
-    return -1;
+  if (node->store_rates) {
+    rates = uc_get_rate(ds, vl);
+    if (rates == NULL) {
+      ERROR("write_mongodb plugin: uc_get_rate() failed.");
+      return -1;
+    }
   }
 
   pthread_mutex_lock(&node->lock);
   if (wm_initialize(node) < 0) {
     ERROR("write_mongodb plugin: error making connection to server");
     pthread_mutex_unlock(&node->lock);
-    bson_destroy(bson_record);
+    sfree(rates);
     return -1;
   }
 
-  collection =
-      mongoc_client_get_collection(node->client, "collectd", vl->plugin);
-  if (!collection) {
-    ERROR("write_mongodb plugin: error creating/getting collection");
-    mongoc_database_destroy(node->database);
-    mongoc_client_destroy(node->client);
-    node->database = NULL;
-    node->client = NULL;
-    node->connected = false;
+  wm_collection_t *c = wm_collection_get(node, vl->plugin);
+  if (c == NULL) {
+    wm_disconnect(node);
     pthread_mutex_unlock(&node->lock);
-    bson_destroy(bson_record);
+    sfree(rates);
     return -1;
   }
 
-  status = mongoc_collection_insert(collection, MONGOC_INSERT_NONE, bson_record,
-                                    NULL, &error);
-
-  if (!status) {
-    ERROR("write_mongodb plugin: error inserting record: %s", error.message);
-    mongoc_database_destroy(node->database);
-    mongoc_client_destroy(node->client);
-    node->database = NULL;
-    node->client = NULL;
-    node->connected = false;
+  status = wm_create_bson(&c->doc, ds, vl, rates);
+  sfree(rates);
+  if (status != 0) {
+    ERROR("write_mongodb plugin: error making insert bson");
     pthread_mutex_unlock(&node->lock);
-    bson_destroy(bson_record);
-    mongoc_collection_destroy(collection);
     return -1;
   }
 
-  /* free our resource as not to leak memory */
-  mongoc_collection_destroy(collection);
+  status = wm_collection_add(c);
+  if (status != 0) {
+    pthread_mutex_unlock(&node->lock);
+    return status;
+  }
 
-  pthread_mutex_unlock(&node->lock);
+  cdtime_t now = cdtime();
+  if ((c->pending >= node->batch_size) ||
+      (now - c->pending_since >= node->flush_interval)) {
+    status = wm_collection_flush(c);
+    if (status != 0) {
+      wm_disconnect(node);
+      pthread_mutex_unlock(&node->lock);
+      return status;
+    }
+  }
 
-  bson_destroy(bson_record);
+  /* Documents of collections that are not written to any more are inserted
+   * here, too. */
+  if (now - node->last_sweep >= node->flush_interval)
+    status = wm_flush_all(node, node->flush_interval);
 
-  return 0;
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
 } /* }}} int wm_write */
 
+static int wm_flush(cdtime_t timeout, /* {{{ */
+                    __attribute__((unused)) const char *identifier,
+                    user_data_t *ud) {
+  wm_node_t *node = ud->data;
+
+  pthread_mutex_lock(&node->lock);
+  int status = wm_flush_all(node, timeout);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wm_flush */
+
 static void wm_config_free(void *ptr) /* {{{ */
 {
   wm_node_t *node = ptr;
@@ -287,11 +455,10 @@ static void wm_config_free(void *ptr) /* {{{ */
   if (node == NULL)
     return;
 
-  mongoc_database_destroy(node->database);
-  mongoc_client_destroy(node->client);
-  node->database = NULL;
-  node->client = NULL;
-  node->connected = false;
+  wm_flush_all(node, /* timeout = */ 0);
+  wm_disconnect(node);
+  if (node->collections != NULL)
+    c_avl_destroy(node->collections);
 
   sfree(node->host);
   sfree(node);
@@ -313,13 +480,21 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
   }
   node->port = MONGOC_DEFAULT_PORT;
   node->store_rates = true;
+  node->batch_size = 1;
+  node->flush_interval = TIME_T_TO_CDTIME_T(1);
+  node->collections =
+      c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (node->collections == NULL) {
+    sfree(node->host);
+    sfree(node);
+    return ENOMEM;
+  }
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
 
   if (status != 0) {
-    sfree(node->host);
-    sfree(node);
+    wm_config_free(node);
     return status;
   }
 
@@ -344,6 +519,14 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_string(child, &node->user);
     else if (strcasecmp("Password", child->key) == 0)
       status = cf_util_get_string(child, &node->passwd);
+    else if (strcasecmp("BatchSize", child->key) == 0) {
+      status = cf_util_get_int(child, &node->batch_size);
+      if ((status == 0) && (node->batch_size < 1)) {
+        ERROR("write_mongodb plugin: BatchSize must be positive.");
+        status = -1;
+      }
+    } else if (strcasecmp("FlushInterval", child->key) == 0)
+      status = cf_util_get_cdtime(child, &node->flush_interval);
     else
       WARNING("write_mongodb plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -375,6 +558,8 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
                                        .data = node,
                                        .free_func = wm_config_free,
                                    });
+    if (status == 0)
+      plugin_register_flush(cb_name, wm_flush, &(user_data_t){.data = node});
     INFO("write_mongodb plugin: registered write plugin %s %d", cb_name,
          status);
   }
@@ -0,0 +1,1255 @@
+/**
+ * collectd - src/write_parquet.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/avltree/avltree.h"
+#include "utils/common/common.h"
+#include "utils/compress/compress.h"
+#include "utils_cache.h"
+
+/*
+ * Writes values to Apache Parquet files, one file per plugin and type at a
+ * time. Values are buffered in columns and written as a row group when
+ * "RowGroupSize" rows have been buffered. Identifier columns are dictionary
+ * encoded, all pages are compressed. Files are written under a temporary,
+ * hidden name and renamed once the footer has been written, i.e. when the file
+ * is rolled because of "RollSize" or "RollInterval" or on shutdown.
+ *
+ * The file metadata is encoded with the Thrift compact protocol; only the
+ * parts of parquet.thrift used here are implemented.
+ */
+
+/* Constants from parquet.thrift. */
+#define PARQUET_MAGIC "PAR1"
+
+#define PQ_TYPE_INT64 2
+#define PQ_TYPE_DOUBLE 5
+#define PQ_TYPE_BYTE_ARRAY 6
+
+#define PQ_REPETITION_REQUIRED 0
+
+#define PQ_CONVERTED_NONE -1
+#define PQ_CONVERTED_UTF8 0
+#define PQ_CONVERTED_TIMESTAMP_MILLIS 9
+#define PQ_CONVERTED_UINT_64 14
+
+#define PQ_ENCODING_PLAIN 0
+#define PQ_ENCODING_PLAIN_DICTIONARY 2
+#define PQ_ENCODING_RLE 3
+
+#define PQ_CODEC_UNCOMPRESSED 0
+#define PQ_CODEC_SNAPPY 1
+#define PQ_CODEC_GZIP 2
+
+#define PQ_PAGE_DATA 0
+#define PQ_PAGE_DICTIONARY 2
+
+/* Types of the Thrift compact protocol. */
+#define TC_I32 5
+#define TC_I64 6
+#define TC_BINARY 8
+#define TC_LIST 9
+#define TC_STRUCT 12
+
+#define TC_MAX_DEPTH 8
+
+/* The identifier columns come first, followed by the time and one column per
+ * data source. */
+enum {
+  COL_HOST,
+  COL_PLUGIN,
+  COL_PLUGIN_INSTANCE,
+  COL_TYPE,
+  COL_TYPE_INSTANCE,
+  COL_IDS_NUM,
+};
+#define COL_TIME COL_IDS_NUM
+#define COL_VALUES (COL_IDS_NUM + 1)
+
+static char const *id_column_names[COL_IDS_NUM] = {
+    "host", "plugin", "plugin_instance", "type", "type_instance",
+};
+
+/*
+ * Private types
+ */
+/* pq_buffer_t is a growing byte buffer. Allocation failures are sticky, so
+ * that encoders only need to check "failed" once at the end. */
+typedef struct {
+  uint8_t *data;
+  size_t len;
+  size_t size;
+  bool failed;
+} pq_buffer_t;
+
+typedef struct {
+  pq_buffer_t *b;
+  int16_t last_id[TC_MAX_DEPTH];
+  int depth;
+} tc_writer_t;
+
+/* pq_dict_t is a dictionary encoded string column of the current row group. */
+typedef struct {
+  c_avl_tree_t *index; /* value -> position + 1; keys are owned by "values" */
+  char **values;
+  size_t values_num;
+  size_t values_size;
+  uint32_t *rows;
+} pq_dict_t;
+
+typedef struct {
+  int64_t dictionary_offset; /* -1 without dictionary page */
+  int64_t data_offset;
+  int64_t uncompressed_size;
+  int64_t compressed_size;
+} pq_chunk_t;
+
+typedef struct {
+  pq_chunk_t *chunks;
+  int64_t rows_num;
+  int64_t time_min;
+  int64_t time_max;
+} pq_row_group_t;
+
+typedef struct {
+  char *key; /* "plugin/type", key in "files" */
+  char *path;
+  char *tmp_path;
+  int fd;
+  uint64_t offset;
+  cdtime_t opened;
+
+  size_t ds_num;
+  int *ds_types;
+  char **ds_names;
+
+  /* Rows of the current row group. Values are stored as the bit patterns of
+   * doubles or as int64_t, depending on the column type. */
+  size_t rows_num;
+  size_t rows_size;
+  cdtime_t first_row;
+  pq_dict_t ids[COL_IDS_NUM];
+  int64_t *time;
+  uint64_t **values;
+
+  /* Written row groups, for the footer. */
+  pq_row_group_t *row_groups;
+  size_t row_groups_num;
+  int64_t rows_total;
+} pq_file_t;
+
+/*
+ * Private variables
+ */
+static char *datadir;
+static bool store_rates;
+static compress_algorithm_t compression = COMPRESS_SNAPPY;
+static size_t row_group_size = 65536;
+static uint64_t roll_size = 128 * 1024 * 1024;
+static cdtime_t roll_interval = TIME_T_TO_CDTIME_T_STATIC(3600);
+
+/* files_lock protects "files", all files and "compressor". */
+static c_avl_tree_t *files;
+static compressor_t *compressor;
+static cdtime_t files_last_sweep;
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Buffers and the Thrift compact protocol
+ * {{{ */
+static void buf_reserve(pq_buffer_t *b, size_t n) {
+  if (b->failed || (b->size - b->len >= n))
+    return;
+
+  size_t new_size = (b->size == 0) ? 4096 : 2 * b->size;
+  while (new_size - b->len < n)
+    new_size *= 2;
+
+  uint8_t *tmp = realloc(b->data, new_size);
+  if (tmp == NULL) {
+    b->failed = true;
+    return;
+  }
+  b->data = tmp;
+  b->size = new_size;
+}
+
+static void buf_append(pq_buffer_t *b, void const *data, size_t n) {
+  buf_reserve(b, n);
+  if (b->failed)
+    return;
+  memcpy(b->data + b->len, data, n);
+  b->len += n;
+}
+
+static void buf_byte(pq_buffer_t *b, uint8_t v) { buf_append(b, &v, 1); }
+
+static void buf_varint(pq_buffer_t *b, uint64_t v) {
+  uint8_t tmp[10];
+  size_t n = 0;
+  while (v >= 0x80) {
+    tmp[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  tmp[n++] = (uint8_t)v;
+  buf_append(b, tmp, n);
+}
+
+static void buf_le32(pq_buffer_t *b, uint32_t v) {
+  uint8_t tmp[4];
+  for (size_t i = 0; i < sizeof(tmp); i++)
+    tmp[i] = (uint8_t)(v >> (8 * i));
+  buf_append(b, tmp, sizeof(tmp));
+}
+
+static void buf_le64(pq_buffer_t *b, uint64_t v) {
+  uint8_t tmp[8];
+  for (size_t i = 0; i < sizeof(tmp); i++)
+    tmp[i] = (uint8_t)(v >> (8 * i));
+  buf_append(b, tmp, sizeof(tmp));
+}
+
+static void buf_reset(pq_buffer_t *b) {
+  b->len = 0;
+  b->failed = false;
+}
+
+static void buf_free(pq_buffer_t *b) {
+  sfree(b->data);
+  *b = (pq_buffer_t){0};
+}
+
+static uint64_t tc_zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static void tc_init(tc_writer_t *w, pq_buffer_t *b) {
+  *w = (tc_writer_t){.b = b};
+}
+
+/* tc_field writes a field header. Field IDs are encoded as the difference to
+ * the previous field of the same struct where possible. */
+static void tc_field(tc_writer_t *w, int16_t id, uint8_t type) {
+  int delta = id - w->last_id[w->depth];
+  if ((delta > 0) && (delta <= 15)) {
+    buf_byte(w->b, (uint8_t)((delta << 4) | type));
+  } else {
+    buf_byte(w->b, type);
+    buf_varint(w->b, tc_zigzag(id));
+  }
+  w->last_id[w->depth] = id;
+}
+
+/* tc_struct_begin starts a struct, either a list element or the value of a
+ * field written with tc_field(). */
+static void tc_struct_begin(tc_writer_t *w) {
+  assert(w->depth + 1 < TC_MAX_DEPTH);
+  w->depth++;
+  w->last_id[w->depth] = 0;
+}
+
+/* tc_struct_end ends a struct started with tc_struct_begin() or, at depth
+ * zero, the outermost struct. */
+static void tc_struct_end(tc_writer_t *w) {
+  buf_byte(w->b, 0);
+  if (w->depth > 0)
+    w->depth--;
+}
+
+static void tc_field_struct(tc_writer_t *w, int16_t id) {
+  tc_field(w, id, TC_STRUCT);
+  tc_struct_begin(w);
+}
+
+static void tc_i32(tc_writer_t *w, int16_t id, int32_t v) {
+  tc_field(w, id, TC_I32);
+  buf_varint(w->b, tc_zigzag(v));
+}
+
+static void tc_i64(tc_writer_t *w, int16_t id, int64_t v) {
+  tc_field(w, id, TC_I64);
+  buf_varint(w->b, tc_zigzag(v));
+}
+
+static void tc_binary(tc_writer_t *w, int16_t id, void const *data,
+                      size_t len) {
+  tc_field(w, id, TC_BINARY);
+  buf_varint(w->b, len);
+  buf_append(w->b, data, len);
+}
+
+static void tc_string(tc_writer_t *w, int16_t id, char const *s) {
+  tc_binary(w, id, s, strlen(s));
+}
+
+static void tc_list(tc_writer_t *w, int16_t id, uint8_t elem_type,
+                    size_t num) {
+  tc_field(w, id, TC_LIST);
+  if (num < 15) {
+    buf_byte(w->b, (uint8_t)((num << 4) | elem_type));
+  } else {
+    buf_byte(w->b, (uint8_t)(0xf0 | elem_type));
+    buf_varint(w->b, num);
+  }
+}
+
+/* Elements of lists of integers and strings. */
+static void tc_elem_i32(tc_writer_t *w, int32_t v) {
+  buf_varint(w->b, tc_zigzag(v));
+}
+
+static void tc_elem_string(tc_writer_t *w, char const *s) {
+  size_t len = strlen(s);
+  buf_varint(w->b, len);
+  buf_append(w->b, s, len);
+}
+/* }}} */
+
+/*
+ * Column encoding
+ * {{{ */
+/* pq_rle_hybrid encodes "values" with the RLE / bit-packing hybrid encoding
+ * used for dictionary indices. Runs of eight or more equal values are run
+ * length encoded, everything else is bit-packed in groups of eight values. */
+static void pq_rle_hybrid(pq_buffer_t *b, uint32_t const *values, size_t num,
+                          int bit_width) {
+  size_t value_bytes = ((size_t)bit_width + 7) / 8;
+  size_t i = 0;
+
+  while (i < num) {
+    size_t run = 1;
+    while ((i + run < num) && (values[i + run] == values[i]))
+      run++;
+
+    if (run >= 8) {
+      buf_varint(b, (uint64_t)run << 1);
+      for (size_t j = 0; j < value_bytes; j++)
+        buf_byte(b, (uint8_t)(values[i] >> (8 * j)));
+      i += run;
+      continue;
+    }
+
+    /* Bit-pack groups of eight until a long run starts at a group boundary.
+     * Only the last group may be padded. */
+    size_t start = i;
+    size_t groups = 0;
+    while (i < num) {
+      run = 1;
+      while ((i + run < num) && (run < 8) && (values[i + run] == values[i]))
+        run++;
+      if ((groups > 0) && (run >= 8))
+        break;
+      i += 8;
+      groups++;
+    }
+    if (i > num)
+      i = num;
+
+    buf_varint(b, ((uint64_t)groups << 1) | 1);
+    buf_reserve(b, groups * (size_t)bit_width);
+    if (b->failed)
+      return;
+
+    uint8_t *out = b->data + b->len;
+    memset(out, 0, groups * (size_t)bit_width);
+    size_t bit = 0;
+    for (size_t j = start; j < start + 8 * groups; j++) {
+      uint32_t v = (j < num) ? values[j] : 0;
+      for (int k = 0; k < bit_width; k++, bit++) {
+        if (v & (1u << k))
+          out[bit / 8] |= (uint8_t)(1u << (bit % 8));
+      }
+    }
+    b->len += groups * (size_t)bit_width;
+  }
+}
+
+static int pq_bit_width(size_t max_value) {
+  int width = 1;
+  while ((width < 32) && ((max_value >> width) != 0))
+    width++;
+  return width;
+}
+
+/* pq_write_page compresses "payload" and appends it, preceded by its page
+ * header, to "out". */
+static void pq_write_page(pq_buffer_t *out, pq_buffer_t const *payload,
+                          int page_type, size_t num_values, int encoding,
+                          pq_chunk_t *chunk) {
+  void const *data = NULL;
+  size_t size = 0;
+  if (payload->failed ||
+      (compressor_compress(compressor, payload->data, payload->len, &data,
+                           &size) != 0)) {
+    out->failed = true;
+    return;
+  }
+
+  size_t header_start = out->len;
+  tc_writer_t w;
+  tc_init(&w, out);
+  tc_i32(&w, 1, page_type);
+  tc_i32(&w, 2, (int32_t)payload->len);
+  tc_i32(&w, 3, (int32_t)size);
+  if (page_type == PQ_PAGE_DATA) {
+    tc_field_struct(&w, 5);
+    tc_i32(&w, 1, (int32_t)num_values);
+    tc_i32(&w, 2, encoding);
+    tc_i32(&w, 3, PQ_ENCODING_RLE); /* definition levels */
+    tc_i32(&w, 4, PQ_ENCODING_RLE); /* repetition levels */
+    tc_struct_end(&w);
+  } else {
+    tc_field_struct(&w, 7);
+    tc_i32(&w, 1, (int32_t)num_values);
+    tc_i32(&w, 2, encoding);
+    tc_struct_end(&w);
+  }
+  tc_struct_end(&w);
+  size_t header_len = out->len - header_start;
+
+  buf_append(out, data, size);
+
+  chunk->uncompressed_size += (int64_t)(header_len + payload->len);
+  chunk->compressed_size += (int64_t)(header_len + size);
+}
+
+/* pq_write_dict_chunk writes a dictionary page and a data page with the
+ * dictionary indices of all rows. All columns are required, so there are no
+ * definition or repetition levels. */
+static void pq_write_dict_chunk(pq_file_t *f, pq_buffer_t *out,
+                                pq_buffer_t *page, pq_dict_t const *d,
+                                pq_chunk_t *chunk) {
+  chunk->dictionary_offset = (int64_t)(f->offset + out->len);
+  buf_reset(page);
+  for (size_t i = 0; i < d->values_num; i++) {
+    size_t len = strlen(d->values[i]);
+    buf_le32(page, (uint32_t)len);
+    buf_append(page, d->values[i], len);
+  }
+  pq_write_page(out, page, PQ_PAGE_DICTIONARY, d->values_num,
+                PQ_ENCODING_PLAIN_DICTIONARY, chunk);
+
+  chunk->data_offset = (int64_t)(f->offset + out->len);
+  buf_reset(page);
+  int bit_width = pq_bit_width(d->values_num - 1);
+  buf_byte(page, (uint8_t)bit_width);
+  pq_rle_hybrid(page, d->rows, f->rows_num, bit_width);
+  pq_write_page(out, page, PQ_PAGE_DATA, f->rows_num,
+                PQ_ENCODING_PLAIN_DICTIONARY, chunk);
+}
+
+static void pq_write_plain_chunk(pq_file_t *f, pq_buffer_t *out,
+                                 pq_buffer_t *page, uint64_t const *values,
+                                 pq_chunk_t *chunk) {
+  chunk->dictionary_offset = -1;
+  chunk->data_offset = (int64_t)(f->offset + out->len);
+  buf_reset(page);
+  buf_reserve(page, 8 * f->rows_num);
+  for (size_t i = 0; i < f->rows_num; i++)
+    buf_le64(page, values[i]);
+  pq_write_page(out, page, PQ_PAGE_DATA, f->rows_num, PQ_ENCODING_PLAIN,
+                chunk);
+}
+/* }}} */
+
+/*
+ * Files
+ * {{{ */
+static size_t pq_columns_num(pq_file_t const *f) {
+  return COL_VALUES + f->ds_num;
+}
+
+static bool pq_ds_is_double(int ds_type) {
+  return store_rates || (ds_type == DS_TYPE_GAUGE);
+}
+
+static void pq_dict_reset(pq_dict_t *d) {
+  void *key;
+  void *value;
+  while (c_avl_pick(d->index, &key, &value) == 0)
+    ;
+  for (size_t i = 0; i < d->values_num; i++)
+    sfree(d->values[i]);
+  d->values_num = 0;
+}
+
+static int pq_dict_add(pq_dict_t *d, char const *value, size_t row) {
+  void *pos = NULL;
+  if (c_avl_get(d->index, value, &pos) == 0) {
+    d->rows[row] = (uint32_t)((uintptr_t)pos - 1);
+    return 0;
+  }
+
+  if (d->values_num == d->values_size) {
+    size_t new_size = (d->values_size == 0) ? 16 : 2 * d->values_size;
+    char **tmp = realloc(d->values, new_size * sizeof(*tmp));
+    if (tmp == NULL)
+      return ENOMEM;
+    d->values = tmp;
+    d->values_size = new_size;
+  }
+
+  char *copy = strdup(value);
+  if (copy == NULL)
+    return ENOMEM;
+  if (c_avl_insert(d->index, copy, (void *)(uintptr_t)(d->values_num + 1)) !=
+      0) {
+    sfree(copy);
+    return ENOMEM;
+  }
+  d->values[d->values_num] = copy;
+  d->rows[row] = (uint32_t)d->values_num;
+  d->values_num++;
+  return 0;
+}
+
+/* pq_write_row_group encodes the buffered rows and writes them to the file.
+ * The buffer is cleared even if writing fails. */
+static int pq_write_row_group(pq_file_t *f) {
+  if (f->rows_num == 0)
+    return 0;
+
+  pq_row_group_t *rgs = realloc(f->row_groups, (f->row_groups_num + 1) *
+                                                   sizeof(*f->row_groups));
+  if (rgs == NULL)
+    return ENOMEM;
+  f->row_groups = rgs;
+
+  pq_row_group_t *rg = f->row_groups + f->row_groups_num;
+  *rg = (pq_row_group_t){
+      .chunks = calloc(pq_columns_num(f), sizeof(*rg->chunks)),
+      .rows_num = (int64_t)f->rows_num,
+      .time_min = f->time[0],
+      .time_max = f->time[0],
+  };
+  if (rg->chunks == NULL)
+    return ENOMEM;
+
+  for (size_t i = 1; i < f->rows_num; i++) {
+    if (f->time[i] < rg->time_min)
+      rg->time_min = f->time[i];
+    if (f->time[i] > rg->time_max)
+      rg->time_max = f->time[i];
+  }
+
+  pq_buffer_t out = {0};
+  pq_buffer_t page = {0};
+
+  for (size_t i = 0; i < COL_IDS_NUM; i++)
+    pq_write_dict_chunk(f, &out, &page, f->ids + i, rg->chunks + i);
+  pq_write_plain_chunk(f, &out, &page, (uint64_t *)f->time,
+                       rg->chunks + COL_TIME);
+  for (size_t i = 0; i < f->ds_num; i++)
+    pq_write_plain_chunk(f, &out, &page, f->values[i],
+                         rg->chunks + COL_VALUES + i);
+
+  int status = 0;
+  size_t written = out.len;
+  if (out.failed) {
+    ERROR("write_parquet plugin: Encoding a row group of \"%s\" failed.",
+          f->tmp_path);
+    status = ENOMEM;
+  } else if (swrite(f->fd, out.data, out.len) != 0) {
+    ERROR("write_parquet plugin: Writing to \"%s\" failed: %s", f->tmp_path,
+          STRERRNO);
+    status = -1;
+  }
+  buf_free(&out);
+  buf_free(&page);
+
+  for (size_t i = 0; i < COL_IDS_NUM; i++)
+    pq_dict_reset(f->ids + i);
+  f->rows_num = 0;
+
+  if (status != 0) {
+    sfree(rg->chunks);
+    return status;
+  }
+
+  f->offset += written;
+  f->row_groups_num++;
+  f->rows_total += rg->rows_num;
+  return 0;
+}
+
+static void pq_write_schema_element(tc_writer_t *w, int type, char const *name,
+                                    int converted_type) {
+  tc_struct_begin(w);
+  tc_i32(w, 1, type);
+  tc_i32(w, 3, PQ_REPETITION_REQUIRED);
+  tc_string(w, 4, name);
+  if (converted_type != PQ_CONVERTED_NONE)
+    tc_i32(w, 6, converted_type);
+  tc_struct_end(w);
+}
+
+static int pq_codec(void) {
+  switch (compression) {
+  case COMPRESS_SNAPPY:
+    return PQ_CODEC_SNAPPY;
+  case COMPRESS_GZIP:
+    return PQ_CODEC_GZIP;
+  default:
+    return PQ_CODEC_UNCOMPRESSED;
+  }
+}
+
+/* pq_write_footer writes the FileMetaData, its length and the trailing magic
+ * number. */
+static int pq_write_footer(pq_file_t *f) {
+  size_t columns_num = pq_columns_num(f);
+  int types[columns_num];
+  char const *names[columns_num];
+  int converted[columns_num];
+
+  for (size_t i = 0; i < COL_IDS_NUM; i++) {
+    types[i] = PQ_TYPE_BYTE_ARRAY;
+    names[i] = id_column_names[i];
+    converted[i] = PQ_CONVERTED_UTF8;
+  }
+  types[COL_TIME] = PQ_TYPE_INT64;
+  names[COL_TIME] = "epoch";
+  converted[COL_TIME] = PQ_CONVERTED_TIMESTAMP_MILLIS;
+  for (size_t i = 0; i < f->ds_num; i++) {
+    bool is_double = pq_ds_is_double(f->ds_types[i]);
+    types[COL_VALUES + i] = is_double ? PQ_TYPE_DOUBLE : PQ_TYPE_INT64;
+    names[COL_VALUES + i] = f->ds_names[i];
+    converted[COL_VALUES + i] = PQ_CONVERTED_NONE;
+    if (!is_double && (f->ds_types[i] != DS_TYPE_DERIVE))
+      converted[COL_VALUES + i] = PQ_CONVERTED_UINT_64;
+  }
+
+  pq_buffer_t b = {0};
+  tc_writer_t w;
+  tc_init(&w, &b);
+
+  tc_i32(&w, 1, 1); /* version */
+
+  tc_list(&w, 2, TC_STRUCT, columns_num + 1);
+  tc_struct_begin(&w);
+  tc_string(&w, 4, "schema");
+  tc_i32(&w, 5, (int32_t)columns_num);
+  tc_struct_end(&w);
+  for (size_t i = 0; i < columns_num; i++)
+    pq_write_schema_element(&w, types[i], names[i], converted[i]);
+
+  tc_i64(&w, 3, f->rows_total);
+
+  tc_list(&w, 4, TC_STRUCT, f->row_groups_num);
+  for (size_t i = 0; i < f->row_groups_num; i++) {
+    pq_row_group_t const *rg = f->row_groups + i;
+    int64_t total_uncompressed = 0;
+    int64_t total_compressed = 0;
+
+    tc_struct_begin(&w);
+    tc_list(&w, 1, TC_STRUCT, columns_num);
+    for (size_t j = 0; j < columns_num; j++) {
+      pq_chunk_t const *c = rg->chunks + j;
+      bool dict = (c->dictionary_offset >= 0);
+      total_uncompressed += c->uncompressed_size;
+      total_compressed += c->compressed_size;
+
+      tc_struct_begin(&w); /* ColumnChunk */
+      tc_i64(&w, 2, dict ? c->dictionary_offset : c->data_offset);
+      tc_field_struct(&w, 3); /* ColumnMetaData */
+      tc_i32(&w, 1, types[j]);
+      tc_list(&w, 2, TC_I32, 2);
+      tc_elem_i32(&w, dict ? PQ_ENCODING_PLAIN_DICTIONARY : PQ_ENCODING_PLAIN);
+      tc_elem_i32(&w, PQ_ENCODING_RLE);
+      tc_list(&w, 3, TC_BINARY, 1);
+      tc_elem_string(&w, names[j]);
+      tc_i32(&w, 4, pq_codec());
+      tc_i64(&w, 5, rg->rows_num);
+      tc_i64(&w, 6, c->uncompressed_size);
+      tc_i64(&w, 7, c->compressed_size);
+      tc_i64(&w, 9, c->data_offset);
+      if (dict)
+        tc_i64(&w, 11, c->dictionary_offset);
+      if (j == COL_TIME) {
+        /* Statistics allow readers to skip row groups by time. */
+        pq_buffer_t stat = {0};
+        buf_le64(&stat, (uint64_t)rg->time_max);
+        buf_le64(&stat, (uint64_t)rg->time_min);
+        tc_field_struct(&w, 12);
+        tc_i64(&w, 3, 0); /* null_count */
+        tc_binary(&w, 5, stat.data, 8);
+        tc_binary(&w, 6, (stat.data != NULL) ? stat.data + 8 : NULL, 8);
+        tc_struct_end(&w);
+        if (stat.failed)
+          b.failed = true;
+        buf_free(&stat);
+      }
+      tc_struct_end(&w); /* ColumnMetaData */
+      tc_struct_end(&w); /* ColumnChunk */
+    }
+    tc_i64(&w, 2, total_uncompressed);
+    tc_i64(&w, 3, rg->rows_num);
+    tc_i64(&w, 5, rg->chunks[0].dictionary_offset);
+    tc_i64(&w, 6, total_compressed);
+    tc_struct_end(&w);
+  }
+
+  tc_string(&w, 6, "collectd version " PACKAGE_VERSION);
+  tc_struct_end(&w);
+
+  size_t metadata_len = b.len;
+  buf_le32(&b, (uint32_t)metadata_len);
+  buf_append(&b, PARQUET_MAGIC, strlen(PARQUET_MAGIC));
+
+  int status = 0;
+  if (b.failed) {
+    ERROR("write_parquet plugin: Encoding the footer of \"%s\" failed.",
+          f->tmp_path);
+    status = ENOMEM;
+  } else if (swrite(f->fd, b.data, b.len) != 0) {
+    ERROR("write_parquet plugin: Writing to \"%s\" failed: %s", f->tmp_path,
+          STRERRNO);
+    status = -1;
+  } else {
+    f->offset += b.len;
+  }
+
+  buf_free(&b);
+  return status;
+}
+
+static void pq_file_free(pq_file_t *f) {
+  if (f == NULL)
+    return;
+
+  for (size_t i = 0; i < COL_IDS_NUM; i++) {
+    if (f->ids[i].index != NULL) {
+      pq_dict_reset(f->ids + i);
+      c_avl_destroy(f->ids[i].index);
+    }
+    sfree(f->ids[i].values);
+    sfree(f->ids[i].rows);
+  }
+  if (f->values != NULL) {
+    for (size_t i = 0; i < f->ds_num; i++)
+      sfree(f->values[i]);
+  }
+  sfree(f->values);
+  sfree(f->time);
+
+  for (size_t i = 0; i < f->row_groups_num; i++)
+    sfree(f->row_groups[i].chunks);
+  sfree(f->row_groups);
+
+  if (f->ds_names != NULL) {
+    for (size_t i = 0; i < f->ds_num; i++)
+      sfree(f->ds_names[i]);
+  }
+  sfree(f->ds_names);
+  sfree(f->ds_types);
+
+  sfree(f->key);
+  sfree(f->path);
+  sfree(f->tmp_path);
+  sfree(f);
+}
+
+/* pq_file_close writes the remaining rows and the footer and renames the file
+ * to its final name. Files without rows are removed.
+ * XXX: You must hold "files_lock" when calling this function! */
+static int pq_file_close(pq_file_t *f) {
+  c_avl_remove(files, f->key, NULL, NULL);
+
+  int status = pq_write_row_group(f);
+  if ((status == 0) && (f->rows_total > 0))
+    status = pq_write_footer(f);
+  if ((status == 0) && (f->rows_total > 0) && (fdatasync(f->fd) != 0)) {
+    ERROR("write_parquet plugin: fdatasync (%s) failed: %s", f->tmp_path,
+          STRERRNO);
+    status = -1;
+  }
+  close(f->fd);
+
+  if ((status != 0) || (f->rows_total == 0)) {
+    unlink(f->tmp_path);
+  } else if (rename(f->tmp_path, f->path) != 0) {
+    ERROR("write_parquet plugin: rename (%s, %s) failed: %s", f->tmp_path,
+          f->path, STRERRNO);
+    unlink(f->tmp_path);
+    status = -1;
+  } else {
+    DEBUG("write_parquet plugin: Wrote %" PRIi64 " rows to \"%s\".",
+          f->rows_total, f->path);
+  }
+
+  pq_file_free(f);
+  return status;
+}
+
+/* pq_file_create opens a new file for the plugin and type of "vl", named after
+ * the current time in UTC. */
+static pq_file_t *pq_file_create(char const *key, data_set_t const *ds,
+                                 value_list_t const *vl, cdtime_t now) {
+  pq_file_t *f = calloc(1, sizeof(*f));
+  if (f == NULL)
+    return NULL;
+  f->fd = -1;
+  f->opened = now;
+
+  f->key = strdup(key);
+  f->ds_num = ds->ds_num;
+  f->ds_types = calloc(ds->ds_num, sizeof(*f->ds_types));
+  f->ds_names = calloc(ds->ds_num, sizeof(*f->ds_names));
+  f->values = calloc(ds->ds_num, sizeof(*f->values));
+  if ((f->key == NULL) || (f->ds_types == NULL) || (f->ds_names == NULL) ||
+      (f->values == NULL)) {
+    pq_file_free(f);
+    return NULL;
+  }
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    f->ds_types[i] = ds->ds[i].type;
+    f->ds_names[i] = strdup(ds->ds[i].name);
+    if (f->ds_names[i] == NULL) {
+      pq_file_free(f);
+      return NULL;
+    }
+  }
+  for (size_t i = 0; i < COL_IDS_NUM; i++) {
+    f->ids[i].index = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (f->ids[i].index == NULL) {
+      pq_file_free(f);
+      return NULL;
+    }
+  }
+
+  char date[32];
+  struct tm tm = {0};
+  time_t t = CDTIME_T_TO_TIME_T(now);
+  gmtime_r(&t, &tm);
+  strftime(date, sizeof(date), "%Y%m%dT%H%M%SZ", &tm);
+
+  char dir[PATH_MAX];
+  if (datadir != NULL)
+    ssnprintf(dir, sizeof(dir), "%s/%s", datadir, vl->plugin);
+  else
+    sstrncpy(dir, vl->plugin, sizeof(dir));
+
+  /* Files rolled within the same second get a sequence number. */
+  for (int seq = 0; (seq < 1000) && (f->fd < 0); seq++) {
+    char name[NAME_MAX];
+    if (seq == 0)
+      ssnprintf(name, sizeof(name), "%s-%s.parquet", vl->type, date);
+    else
+      ssnprintf(name, sizeof(name), "%s-%s-%d.parquet", vl->type, date, seq);
+
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    ssnprintf(path, sizeof(path), "%s/%s", dir, name);
+    ssnprintf(tmp_path, sizeof(tmp_path), "%s/.%s.tmp", dir, name);
+
+    if (access(path, F_OK) == 0)
+      continue;
+    if ((seq == 0) && (check_create_dir(path) != 0)) {
+      pq_file_free(f);
+      return NULL;
+    }
+
+    f->fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if ((f->fd < 0) && (errno == EEXIST))
+      continue;
+    if (f->fd < 0) {
+      ERROR("write_parquet plugin: open (%s) failed: %s", tmp_path, STRERRNO);
+      pq_file_free(f);
+      return NULL;
+    }
+
+    f->path = strdup(path);
+    f->tmp_path = strdup(tmp_path);
+  }
+
+  if (f->fd < 0) {
+    ERROR("write_parquet plugin: Unable to find an unused file name for "
+          "\"%s\" in \"%s\".",
+          key, dir);
+    pq_file_free(f);
+    return NULL;
+  }
+
+  if ((f->path == NULL) || (f->tmp_path == NULL) ||
+      (swrite(f->fd, PARQUET_MAGIC, strlen(PARQUET_MAGIC)) != 0)) {
+    ERROR("write_parquet plugin: Initializing \"%s\" failed.", key);
+    close(f->fd);
+    if (f->tmp_path != NULL)
+      unlink(f->tmp_path);
+    pq_file_free(f);
+    return NULL;
+  }
+  f->offset = strlen(PARQUET_MAGIC);
+
+  return f;
+}
+
+static bool pq_file_matches(pq_file_t const *f, data_set_t const *ds) {
+  if (f->ds_num != ds->ds_num)
+    return false;
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    if ((f->ds_types[i] != ds->ds[i].type) ||
+        (strcmp(f->ds_names[i], ds->ds[i].name) != 0))
+      return false;
+  }
+  return true;
+}
+
+/* pq_file_get returns the open file for the plugin and type of "vl", opening
+ * a new one if necessary.
+ * XXX: You must hold "files_lock" when calling this function! */
+static pq_file_t *pq_file_get(data_set_t const *ds, value_list_t const *vl,
+                              cdtime_t now) {
+  char key[2 * DATA_MAX_NAME_LEN];
+  ssnprintf(key, sizeof(key), "%s/%s", vl->plugin, vl->type);
+
+  pq_file_t *f = NULL;
+  if (c_avl_get(files, key, (void *)&f) == 0) {
+    if (pq_file_matches(f, ds))
+      return f;
+    /* The data set has changed, e.g. because types.db has been edited. */
+    pq_file_close(f);
+  }
+
+  f = pq_file_create(key, ds, vl, now);
+  if (f == NULL)
+    return NULL;
+
+  if (c_avl_insert(files, f->key, f) != 0) {
+    ERROR("write_parquet plugin: c_avl_insert (%s) failed.", key);
+    close(f->fd);
+    unlink(f->tmp_path);
+    pq_file_free(f);
+    return NULL;
+  }
+
+  return f;
+}
+
+static int pq_file_reserve(pq_file_t *f) {
+  if (f->rows_num < f->rows_size)
+    return 0;
+
+  size_t new_size = (f->rows_size == 0) ? 1024 : 2 * f->rows_size;
+  if (new_size > row_group_size)
+    new_size = row_group_size;
+
+  for (size_t i = 0; i < COL_IDS_NUM; i++) {
+    uint32_t *tmp = realloc(f->ids[i].rows, new_size * sizeof(*tmp));
+    if (tmp == NULL)
+      return ENOMEM;
+    f->ids[i].rows = tmp;
+  }
+  int64_t *time = realloc(f->time, new_size * sizeof(*time));
+  if (time == NULL)
+    return ENOMEM;
+  f->time = time;
+  for (size_t i = 0; i < f->ds_num; i++) {
+    uint64_t *tmp = realloc(f->values[i], new_size * sizeof(*tmp));
+    if (tmp == NULL)
+      return ENOMEM;
+    f->values[i] = tmp;
+  }
+
+  f->rows_size = new_size;
+  return 0;
+}
+
+/* pq_file_append adds one row.
+ * XXX: You must hold "files_lock" when calling this function! */
+static int pq_file_append(pq_file_t *f, data_set_t const *ds,
+                          value_list_t const *vl, gauge_t const *rates,
+                          cdtime_t now) {
+  int status = pq_file_reserve(f);
+  if (status != 0)
+    return status;
+
+  size_t row = f->rows_num;
+  char const *ids[COL_IDS_NUM] = {
+      [COL_HOST] = vl->host,
+      [COL_PLUGIN] = vl->plugin,
+      [COL_PLUGIN_INSTANCE] = vl->plugin_instance,
+      [COL_TYPE] = vl->type,
+      [COL_TYPE_INSTANCE] = vl->type_instance,
+  };
+  for (size_t i = 0; i < COL_IDS_NUM; i++) {
+    status = pq_dict_add(f->ids + i, ids[i], row);
+    if (status != 0)
+      return status;
+  }
+
+  f->time[row] = (int64_t)CDTIME_T_TO_MS(vl->time);
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    uint64_t v = 0;
+    if (ds->ds[i].type == DS_TYPE_GAUGE) {
+      memcpy(&v, &vl->values[i].gauge, sizeof(v));
+    } else if (store_rates) {
+      double rate = (double)rates[i];
+      memcpy(&v, &rate, sizeof(v));
+    } else if (ds->ds[i].type == DS_TYPE_COUNTER) {
+      v = (uint64_t)vl->values[i].counter;
+    } else if (ds->ds[i].type == DS_TYPE_DERIVE) {
+      v = (uint64_t)vl->values[i].derive;
+    } else {
+      v = (uint64_t)vl->values[i].absolute;
+    }
+    f->values[i][row] = v;
+  }
+
+  if (f->rows_num == 0)
+    f->first_row = now;
+  f->rows_num++;
+  return 0;
+}
+
+/* pq_files_roll closes all files that are due because of "RollInterval".
+ * XXX: You must hold "files_lock" when calling this function! */
+static void pq_files_roll(cdtime_t now) {
+  c_avl_iterator_t *iter = c_avl_get_iterator(files);
+  pq_file_t *due = NULL;
+  char *key;
+  pq_file_t *f;
+
+  /* Files can't be removed while iterating, so one due file is closed per
+   * iteration. */
+  do {
+    due = NULL;
+    c_avl_iterator_destroy(iter);
+    iter = c_avl_get_iterator(files);
+    while (c_avl_iterator_next(iter, (void *)&key, (void *)&f) == 0) {
+      if ((now - f->opened) >= roll_interval) {
+        due = f;
+        break;
+      }
+    }
+    if (due != NULL)
+      pq_file_close(due);
+  } while (due != NULL);
+
+  c_avl_iterator_destroy(iter);
+}
+/* }}} */
+
+/*
+ * collectd callbacks
+ */
+static int pq_config(oconfig_item_t *ci) {
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+    int status = 0;
+
+    if (strcasecmp("DataDir", child->key) == 0) {
+      status = cf_util_get_string(child, &datadir);
+      if (status == 0) {
+        size_t len = strlen(datadir);
+        while ((len > 0) && (datadir[len - 1] == '/'))
+          datadir[--len] = 0;
+        if (len == 0)
+          sfree(datadir);
+      }
+    } else if (strcasecmp("StoreRates", child->key) == 0) {
+      status = cf_util_get_boolean(child, &store_rates);
+    } else if (strcasecmp("Compression", child->key) == 0) {
+      char *name = NULL;
+      status = cf_util_get_string(child, &name);
+      if (status == 0) {
+        status = compress_algorithm_parse(name, &compression);
+        if (status == ENOTSUP)
+          ERROR("write_parquet plugin: collectd was built without support "
+                "for the \"%s\" compression.",
+                name);
+        else if (status != 0)
+          ERROR("write_parquet plugin: Unknown compression \"%s\".", name);
+      }
+      sfree(name);
+    } else if (strcasecmp("RowGroupSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        ERROR("write_parquet plugin: \"RowGroupSize\" must be positive.");
+        status = -1;
+      }
+      if (status == 0)
+        row_group_size = (size_t)tmp;
+    } else if (strcasecmp("RollSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        ERROR("write_parquet plugin: \"RollSize\" must be positive.");
+        status = -1;
+      }
+      if (status == 0)
+        roll_size = (uint64_t)tmp * 1024 * 1024;
+    } else if (strcasecmp("RollInterval", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &roll_interval);
+      if ((status == 0) && (roll_interval == 0)) {
+        ERROR("write_parquet plugin: \"RollInterval\" must be positive.");
+        status = -1;
+      }
+    } else {
+      WARNING("write_parquet plugin: Ignoring unknown config option \"%s\".",
+              child->key);
+    }
+
+    if (status != 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+static int pq_init(void) {
+  pthread_mutex_lock(&files_lock);
+  if (files == NULL)
+    files = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (compressor == NULL)
+    compressor = compressor_create(compression);
+  pthread_mutex_unlock(&files_lock);
+
+  if ((files == NULL) || (compressor == NULL)) {
+    ERROR("write_parquet plugin: Initialization failed.");
+    return -1;
+  }
+
+  return 0;
+}
+
+static int pq_write(data_set_t const *ds, value_list_t const *vl,
+                    __attribute__((unused)) user_data_t *ud) {
+  if (strcmp(ds->type, vl->type) != 0) {
+    ERROR("write_parquet plugin: DS type does not match value list type");
+    return -1;
+  }
+
+  gauge_t *rates = NULL;
+  if (store_rates) {
+    for (size_t i = 0; i < ds->ds_num; i++) {
+      if (ds->ds[i].type == DS_TYPE_GAUGE)
+        continue;
+      rates = uc_get_rate(ds, vl);
+      if (rates == NULL) {
+        WARNING("write_parquet plugin: uc_get_rate failed.");
+        return -1;
+      }
+      break;
+    }
+  }
+
+  cdtime_t now = cdtime();
+  int status = 0;
+
+  pthread_mutex_lock(&files_lock);
+
+  if (files == NULL) {
+    pthread_mutex_unlock(&files_lock);
+    sfree(rates);
+    ERROR("write_parquet plugin: The plugin has not been initialized.");
+    return -1;
+  }
+
+  pq_file_t *f = pq_file_get(ds, vl, now);
+  if (f == NULL) {
+    status = -1;
+  } else {
+    status = pq_file_append(f, ds, vl, rates, now);
+    if ((status == 0) && (f->rows_num >= row_group_size))
+      status = pq_write_row_group(f);
+
+    if (status != 0) {
+      ERROR("write_parquet plugin: Writing to \"%s\" failed with status %d, "
+            "closing the file.",
+            f->tmp_path, status);
+      pq_file_close(f);
+    } else if (f->offset >= roll_size) {
+      status = pq_file_close(f);
+    }
+  }
+
+  /* Files that are not written to anymore are rolled here. */
+  if ((now - files_last_sweep) >= TIME_T_TO_CDTIME_T(1)) {
+    pq_files_roll(now);
+    files_last_sweep = now;
+  }
+
+  pthread_mutex_unlock(&files_lock);
+  sfree(rates);
+  return status;
+}
+
+/* pq_flush writes the buffered rows of all files as row groups. The files
+ * only become readable when they are rolled, though. */
+static int pq_flush(cdtime_t timeout,
+                    __attribute__((unused)) char const *identifier,
+                    __attribute__((unused)) user_data_t *ud) {
+  cdtime_t now = cdtime();
+
+  pthread_mutex_lock(&files_lock);
+  if (files != NULL) {
+    c_avl_iterator_t *iter = c_avl_get_iterator(files);
+    char *key;
+    pq_file_t *f;
+    while (c_avl_iterator_next(iter, (void *)&key, (void *)&f) == 0) {
+      if ((f->rows_num == 0) ||
+          ((timeout != 0) && ((now - f->first_row) < timeout)))
+        continue;
+      pq_write_row_group(f);
+    }
+    c_avl_iterator_destroy(iter);
+
+    pq_files_roll(now);
+  }
+  pthread_mutex_unlock(&files_lock);
+
+  return 0;
+}
+
+static int pq_shutdown(void) {
+  pthread_mutex_lock(&files_lock);
+  if (files != NULL) {
+    char *key;
+    pq_file_t *f;
+    while (c_avl_pick(files, (void *)&key, (void *)&f) == 0)
+      pq_file_close(f);
+    c_avl_destroy(files);
+    files = NULL;
+  }
+  compressor_destroy(compressor);
+  compressor = NULL;
+  pthread_mutex_unlock(&files_lock);
+
+  sfree(datadir);
+  return 0;
+}
+
+void module_register(void) {
+  plugin_register_complex_config("write_parquet", pq_config);
+  plugin_register_init("write_parquet", pq_init);
+  plugin_register_write("write_parquet", pq_write, /* user_data = */ NULL);
+  plugin_register_flush("write_parquet", pq_flush, /* user_data = */ NULL);
+  plugin_register_shutdown("write_parquet", pq_shutdown);
+}
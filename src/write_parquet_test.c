@@ -0,0 +1,160 @@
+/**
+ * collectd - src/write_parquet_test.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Licensed under the same terms and conditions as src/write_parquet.c.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "write_parquet.c"
+
+#include "testing.h"
+
+static char test_dir[] = "/tmp/collectd-parquet-test-XXXXXX";
+
+static int expect_bytes(pq_buffer_t const *b, uint8_t const *want,
+                        size_t want_len) {
+  EXPECT_EQ_UINT64(want_len, b->len);
+  for (size_t i = 0; i < want_len; i++) {
+    if (b->data[i] != want[i]) {
+      printf("not ok - byte %" PRIsz ": got 0x%02x, want 0x%02x\n", i,
+             b->data[i], want[i]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+DEF_TEST(rle_hybrid) {
+  pq_buffer_t b = {0};
+
+  /* A run of ten zeros is run length encoded. */
+  uint32_t run[10] = {0};
+  pq_rle_hybrid(&b, run, STATIC_ARRAY_SIZE(run), 1);
+  EXPECT_EQ_INT(0, expect_bytes(&b, (uint8_t[]){0x14, 0x00}, 2));
+
+  /* Short runs are bit-packed in one group of eight, padded with zeros. */
+  buf_reset(&b);
+  uint32_t packed[] = {0, 1, 2, 3};
+  pq_rle_hybrid(&b, packed, STATIC_ARRAY_SIZE(packed), 2);
+  EXPECT_EQ_INT(0, expect_bytes(&b, (uint8_t[]){0x03, 0xe4, 0x00}, 3));
+
+  /* A bit-packed group followed by a run. */
+  buf_reset(&b);
+  uint32_t mixed[] = {1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1};
+  pq_rle_hybrid(&b, mixed, STATIC_ARRAY_SIZE(mixed), 1);
+  EXPECT_EQ_INT(0, expect_bytes(&b, (uint8_t[]){0x03, 0x55, 0x10, 0x01}, 4));
+
+  buf_free(&b);
+  return 0;
+}
+
+DEF_TEST(thrift_compact) {
+  pq_buffer_t b = {0};
+  tc_writer_t w;
+  tc_init(&w, &b);
+
+  tc_i32(&w, 1, 1);
+  tc_i64(&w, 20, -2);
+  tc_field_struct(&w, 21);
+  tc_i32(&w, 1, -1);
+  tc_struct_end(&w);
+  tc_list(&w, 22, TC_BINARY, 1);
+  tc_elem_string(&w, "a");
+  tc_struct_end(&w);
+
+  uint8_t want[] = {
+      0x15, 0x02,             /* field 1: i32 1 */
+      0x06, 0x28, 0x03,       /* field 20: i64 -2 */
+      0x1c,                   /* field 21: struct */
+      0x15, 0x01, 0x00,       /*   field 1: i32 -1, stop */
+      0x19, 0x18, 0x01, 'a',  /* field 22: list<binary> ["a"] */
+      0x00,                   /* stop */
+  };
+  EXPECT_EQ_INT(0, expect_bytes(&b, want, sizeof(want)));
+
+  buf_free(&b);
+  return 0;
+}
+
+static char found_path[PATH_MAX];
+
+static int find_cb(const char *dirname, const char *filename,
+                   void *user_data) {
+  snprintf(found_path, sizeof(found_path), "%s/%s", dirname, filename);
+  (*(int *)user_data)++;
+  return 0;
+}
+
+DEF_TEST(file) {
+  data_source_t dsrc[] = {
+      {"rx", DS_TYPE_DERIVE, 0, NAN},
+      {"tx", DS_TYPE_GAUGE, 0, NAN},
+  };
+  data_set_t ds = {"if_octets", STATIC_ARRAY_SIZE(dsrc), dsrc};
+
+  datadir = strdup(test_dir);
+  row_group_size = 64;
+  CHECK_ZERO(pq_init());
+
+  int status = 0;
+  for (int i = 0; (i < 1000) && (status == 0); i++) {
+    value_t values[] = {{.derive = i}, {.gauge = i / 2.0}};
+    value_list_t vl = {
+        .values = values,
+        .values_len = STATIC_ARRAY_SIZE(values),
+        .time = TIME_T_TO_CDTIME_T(1700000000 + i),
+    };
+    sstrncpy(vl.host, "example.com", sizeof(vl.host));
+    sstrncpy(vl.plugin, "interface", sizeof(vl.plugin));
+    snprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "eth%d", i % 3);
+    sstrncpy(vl.type, "if_octets", sizeof(vl.type));
+    status = pq_write(&ds, &vl, NULL);
+  }
+  EXPECT_EQ_INT(0, status);
+  CHECK_ZERO(pq_shutdown());
+
+  char dir[PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s/interface", test_dir);
+  int count = 0;
+  walk_directory(dir, find_cb, &count, /* hidden = */ 1);
+  EXPECT_EQ_INT(1, count);
+
+  FILE *fh = fopen(found_path, "r");
+  CHECK_NOT_NULL(fh);
+  uint8_t head[4];
+  uint8_t tail[8];
+  OK(fread(head, 1, sizeof(head), fh) == sizeof(head));
+  OK(fseek(fh, -(long)sizeof(tail), SEEK_END) == 0);
+  long footer_end = ftell(fh);
+  OK(fread(tail, 1, sizeof(tail), fh) == sizeof(tail));
+  fclose(fh);
+
+  OK(memcmp(head, PARQUET_MAGIC, 4) == 0);
+  OK(memcmp(tail + 4, PARQUET_MAGIC, 4) == 0);
+  uint32_t footer_len = (uint32_t)tail[0] | ((uint32_t)tail[1] << 8) |
+                        ((uint32_t)tail[2] << 16) | ((uint32_t)tail[3] << 24);
+  OK(footer_len > 0);
+  OK(footer_len < (uint32_t)footer_end);
+
+  unlink(found_path);
+  rmdir(dir);
+  return 0;
+}
+
+int main(void) {
+  if (mkdtemp(test_dir) == NULL) {
+    fprintf(stderr, "mkdtemp failed: %s\n", STRERRNO);
+    return 1;
+  }
+
+  RUN_TEST(rle_hybrid);
+  RUN_TEST(thrift_compact);
+  RUN_TEST(file);
+
+  rmdir(test_dir);
+
+  END_TEST;
+}
@@ -36,6 +36,17 @@
 
 #include <microhttpd.h>
 
+#if HAVE_LIBCURL
+#include "prometheus_remote.pb-c.h"
+#include "utils/compress/compress.h"
+
+#include <curl/curl.h>
+#endif
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include <netdb.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -57,14 +68,69 @@
 #define MHD_RESULT int
 #endif
 
+/* prom_metric_t extends the protobuf message with the metric's labels in text
+ * format. Labels identify a metric and never change, so they are formatted
+ * once when the metric is created, and scrapes only format the value. "pb" must
+ * be the first member so that pointers can be converted in both directions. */
+typedef struct prom_metric_s prom_metric_t;
+struct prom_metric_s {
+  Io__Prometheus__Client__Metric pb;
+  char *labels;
+  size_t labels_len;
+
+  /* Hash of the label values, position in the family's "metric" array and
+   * next metric in the same hash bucket. */
+  uint32_t hash;
+  size_t index;
+  prom_metric_t *next;
+};
+
+/* prom_family_t extends the protobuf message with the "# HELP" and "# TYPE"
+ * lines of the text format, a hash table indexing the metrics by their label
+ * values and a lock. The lock protects the metrics and is taken with
+ * metrics_lock held for reading, so that writes to different families don't
+ * block each other. The "metric" array is only sorted at scrape time. */
+typedef struct {
+  Io__Prometheus__Client__MetricFamily pb;
+  char *header;
+  size_t header_len;
+
+  pthread_mutex_t lock;
+  prom_metric_t **buckets;
+  size_t buckets_num;
+  size_t metric_size;
+  bool sorted;
+} prom_family_t;
+
+/* prom_response_t is a complete response body, which is reused for "CacheTTL"
+ * after it has been created, e.g. when a pair of Prometheus servers scrape
+ * this instance. */
+typedef struct {
+  uint8_t *data;
+  size_t len;
+  cdtime_t time;
+} prom_response_t;
+
+/* metrics_lock protects the "metrics" tree. Writers hold it for reading and
+ * lock the family they update, adding and removing families requires holding
+ * it for writing. */
 static c_avl_tree_t *metrics;
-static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t metrics_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* Indexed by [want_proto][want_gzip]. */
+static prom_response_t responses[2][2];
+static pthread_mutex_t responses_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static char *httpd_host = NULL;
 static unsigned short httpd_port = 9103;
 static struct MHD_Daemon *httpd;
+/* With "RemoteWrite", the HTTP server is only started if "Host" or "Port" is
+ * configured. Otherwise the "metrics" tree isn't needed either. */
+static bool httpd_configured;
+static bool httpd_enabled = true;
 
 static cdtime_t staleness_delta = PROMETHEUS_DEFAULT_STALENESS_DELTA;
+static cdtime_t cache_ttl;
 
 /* Unfortunately, protoc-c doesn't export its implementation of varint, so we
  * need to implement our own. */
@@ -83,16 +149,23 @@ static size_t varint(uint8_t buffer[static VARINT_UINT32_BYTES],
   return 0;
 }
 
+static void metric_family_sort(prom_family_t *pf);
+
 /* format_protobuf iterates over all metric families in "metrics" and adds them
  * to a buffer in ProtoBuf format. It prefixes each protobuf with its encoded
  * size, the so called "delimited" format. */
 static void format_protobuf(ProtobufCBuffer *buffer) {
-  pthread_mutex_lock(&metrics_lock);
+  pthread_rwlock_rdlock(&metrics_lock);
 
   char *unused_name;
   Io__Prometheus__Client__MetricFamily *fam;
   c_avl_iterator_t *iter = c_avl_get_iterator(metrics);
   while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&fam) == 0) {
+    prom_family_t *pf = (prom_family_t *)fam;
+
+    pthread_mutex_lock(&pf->lock);
+    metric_family_sort(pf);
+
     /* Prometheus uses a message length prefix to determine where one
      * MetricFamily ends and the next begins. This delimiter is encoded as a
      * "varint", which is common in Protobufs. */
@@ -103,10 +176,12 @@ static void format_protobuf(ProtobufCBuffer *buffer) {
     buffer->append(buffer, delim_len, delim);
 
     io__prometheus__client__metric_family__pack_to_buffer(fam, buffer);
+
+    pthread_mutex_unlock(&pf->lock);
   }
   c_avl_iterator_destroy(iter);
 
-  pthread_mutex_unlock(&metrics_lock);
+  pthread_rwlock_unlock(&metrics_lock);
 }
 
 static char const *escape_label_value(char *buffer, size_t buffer_size,
@@ -179,47 +254,55 @@ static char *format_labels(char *buffer, size_t buffer_size,
   return buffer;
 }
 
-/* format_protobuf iterates over all metric families in "metrics" and adds them
- * to a buffer in plain text format. */
+/* format_text iterates over all metric families in "metrics" and adds them to
+ * a buffer in plain text format. Only the values are formatted here, names and
+ * labels have been formatted when the metric was created. */
 static void format_text(ProtobufCBuffer *buffer) {
-  pthread_mutex_lock(&metrics_lock);
+  pthread_rwlock_rdlock(&metrics_lock);
 
   char *unused_name;
   Io__Prometheus__Client__MetricFamily *fam;
   c_avl_iterator_t *iter = c_avl_get_iterator(metrics);
   while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&fam) == 0) {
-    char line[1024]; /* 4x DATA_MAX_NAME_LEN? */
+    prom_family_t *pf = (prom_family_t *)fam;
+    size_t name_len = strlen(fam->name);
 
-    ssnprintf(line, sizeof(line), "# HELP %s %s\n", fam->name, fam->help);
-    buffer->append(buffer, strlen(line), (uint8_t *)line);
+    pthread_mutex_lock(&pf->lock);
+    metric_family_sort(pf);
 
-    ssnprintf(line, sizeof(line), "# TYPE %s %s\n", fam->name,
-              (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
-                  ? "gauge"
-                  : "counter");
-    buffer->append(buffer, strlen(line), (uint8_t *)line);
+    buffer->append(buffer, pf->header_len, (uint8_t *)pf->header);
 
     for (size_t i = 0; i < fam->n_metric; i++) {
       Io__Prometheus__Client__Metric *m = fam->metric[i];
+      prom_metric_t const *pm = (prom_metric_t const *)m;
 
-      char labels[1024];
-
-      char timestamp_ms[24] = "";
-      if (m->has_timestamp_ms)
-        ssnprintf(timestamp_ms, sizeof(timestamp_ms), " %" PRIi64,
-                  m->timestamp_ms);
-
+      /* "} " value [" " timestamp] "\n" */
+      char value[128];
+      int value_len;
       if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
-        ssnprintf(line, sizeof(line), "%s{%s} " GAUGE_FORMAT "%s\n", fam->name,
-                  format_labels(labels, sizeof(labels), m), m->gauge->value,
-                  timestamp_ms);
+        value_len =
+            ssnprintf(value, sizeof(value), "} " GAUGE_FORMAT, m->gauge->value);
       else /* if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__COUNTER) */
-        ssnprintf(line, sizeof(line), "%s{%s} %.0f%s\n", fam->name,
-                  format_labels(labels, sizeof(labels), m), m->counter->value,
-                  timestamp_ms);
+        value_len = ssnprintf(value, sizeof(value), "} %.0f", m->counter->value);
+      if ((value_len < 0) || ((size_t)value_len >= sizeof(value)))
+        continue;
 
-      buffer->append(buffer, strlen(line), (uint8_t *)line);
+      if (m->has_timestamp_ms)
+        value_len += ssnprintf(value + value_len, sizeof(value) - value_len,
+                               " %" PRIi64 "\n", m->timestamp_ms);
+      else
+        value_len += ssnprintf(value + value_len, sizeof(value) - value_len,
+                               "\n");
+      if ((size_t)value_len >= sizeof(value))
+        continue;
+
+      buffer->append(buffer, name_len, (uint8_t *)fam->name);
+      buffer->append(buffer, 1, (uint8_t *)"{");
+      buffer->append(buffer, pm->labels_len, (uint8_t *)pm->labels);
+      buffer->append(buffer, (size_t)value_len, (uint8_t *)value);
     }
+
+    pthread_mutex_unlock(&pf->lock);
   }
   c_avl_iterator_destroy(iter);
 
@@ -228,7 +311,103 @@ static void format_text(ProtobufCBuffer *buffer) {
             PACKAGE_VERSION, hostname_g);
   buffer->append(buffer, strlen(server), (uint8_t *)server);
 
-  pthread_mutex_unlock(&metrics_lock);
+  pthread_rwlock_unlock(&metrics_lock);
+}
+
+#if HAVE_ZLIB
+/* gzip_compress compresses "in" into a newly allocated buffer. Scrapes are
+ * frequent and the output compresses well, so speed is favored over size. */
+static int gzip_compress(uint8_t const *in, size_t in_len, uint8_t **ret_out,
+                         size_t *ret_out_len) {
+  z_stream stream = {0};
+
+  /* 16 + MAX_WBITS selects the gzip format instead of zlib's own. */
+  int status = deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 16 + MAX_WBITS,
+                            /* memLevel = */ 8, Z_DEFAULT_STRATEGY);
+  if (status != Z_OK) {
+    ERROR("write_prometheus plugin: deflateInit2 failed with status %d.",
+          status);
+    return -1;
+  }
+
+  size_t out_size = (size_t)deflateBound(&stream, (uLong)in_len);
+  uint8_t *out = malloc(out_size);
+  if (out == NULL) {
+    deflateEnd(&stream);
+    return ENOMEM;
+  }
+
+  stream.next_in = (Bytef *)in;
+  stream.avail_in = (uInt)in_len;
+  stream.next_out = out;
+  stream.avail_out = (uInt)out_size;
+
+  status = deflate(&stream, Z_FINISH);
+  if (status != Z_STREAM_END) {
+    ERROR("write_prometheus plugin: deflate failed with status %d.", status);
+    deflateEnd(&stream);
+    free(out);
+    return -1;
+  }
+
+  *ret_out = out;
+  *ret_out_len = out_size - stream.avail_out;
+  deflateEnd(&stream);
+  return 0;
+}
+#endif
+
+/* response_get returns the response body for the requested format, reusing a
+ * previous one if it is younger than "CacheTTL". The compressed body is created
+ * from the uncompressed one, so that the metrics are only formatted once for
+ * both. Must hold responses_lock when calling this function. */
+static prom_response_t *response_get(bool want_proto, bool want_gzip) {
+  prom_response_t *r = &responses[want_proto][want_gzip];
+  cdtime_t now = cdtime();
+
+  if ((r->data != NULL) && (cache_ttl > 0) && ((now - r->time) < cache_ttl))
+    return r;
+
+  uint8_t *data = NULL;
+  size_t len = 0;
+
+  if (want_gzip) {
+#if HAVE_ZLIB
+    prom_response_t *plain = response_get(want_proto, /* want_gzip = */ false);
+    if (plain == NULL)
+      return NULL;
+    if (gzip_compress(plain->data, plain->len, &data, &len) != 0)
+      return NULL;
+    now = plain->time;
+#else
+    return NULL;
+#endif
+  } else {
+    uint8_t scratch[4096] = {0};
+    ProtobufCBufferSimple simple = PROTOBUF_C_BUFFER_SIMPLE_INIT(scratch);
+    ProtobufCBuffer *buffer = (ProtobufCBuffer *)&simple;
+
+    if (want_proto)
+      format_protobuf(buffer);
+    else
+      format_text(buffer);
+
+    /* Allocate at least one byte so that empty responses can be cached, too. */
+    data = malloc(simple.len + 1);
+    if (data == NULL) {
+      PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
+      return NULL;
+    }
+    memcpy(data, simple.data, simple.len);
+    len = simple.len;
+    PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
+  }
+
+  sfree(r->data);
+  r->data = data;
+  r->len = len;
+  r->time = now;
+  return r;
 }
 
 /* http_handler is the callback called by the microhttpd library. It essentially
@@ -256,29 +435,43 @@ static MHD_RESULT http_handler(void *cls, struct MHD_Connection *connection,
   bool want_proto = (accept != NULL) &&
                     (strstr(accept, "application/vnd.google.protobuf") != NULL);
 
-  uint8_t scratch[4096] = {0};
-  ProtobufCBufferSimple simple = PROTOBUF_C_BUFFER_SIMPLE_INIT(scratch);
-  ProtobufCBuffer *buffer = (ProtobufCBuffer *)&simple;
+  bool want_gzip = false;
+#if HAVE_ZLIB
+  char const *encoding = MHD_lookup_connection_value(
+      connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+  want_gzip = (encoding != NULL) && (strstr(encoding, "gzip") != NULL);
+#endif
+
+  pthread_mutex_lock(&responses_lock);
 
-  if (want_proto)
-    format_protobuf(buffer);
-  else
-    format_text(buffer);
+  prom_response_t *r = response_get(want_proto, want_gzip);
+  if ((r == NULL) && want_gzip) {
+    want_gzip = false;
+    r = response_get(want_proto, want_gzip);
+  }
+  if (r == NULL) {
+    pthread_mutex_unlock(&responses_lock);
+    return MHD_NO;
+  }
 
 #if defined(MHD_VERSION) && MHD_VERSION >= 0x00090500
-  struct MHD_Response *res = MHD_create_response_from_buffer(
-      simple.len, simple.data, MHD_RESPMEM_MUST_COPY);
+  struct MHD_Response *res =
+      MHD_create_response_from_buffer(r->len, r->data, MHD_RESPMEM_MUST_COPY);
 #else
   struct MHD_Response *res = MHD_create_response_from_data(
-      simple.len, simple.data, /* must_free = */ 0, /* must_copy = */ 1);
+      r->len, r->data, /* must_free = */ 0, /* must_copy = */ 1);
 #endif
+
+  pthread_mutex_unlock(&responses_lock);
+
   MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_TYPE,
                           want_proto ? CONTENT_TYPE_PROTO : CONTENT_TYPE_TEXT);
+  if (want_gzip)
+    MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_ENCODING, "gzip");
 
   MHD_RESULT status = MHD_queue_response(connection, MHD_HTTP_OK, res);
 
   MHD_destroy_response(res);
-  PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
   return status;
 }
 
@@ -340,6 +533,9 @@ static void metric_destroy(Io__Prometheus__Client__Metric *msg) {
   sfree(msg->gauge);
   sfree(msg->counter);
 
+  prom_metric_t *pm = (prom_metric_t *)msg;
+  sfree(pm->labels);
+
   sfree(msg);
 }
 
@@ -434,9 +630,11 @@ static int metric_cmp(void const *a, void const *b) {
 /* metric_clone allocates and initializes a new metric based on orig. */
 static Io__Prometheus__Client__Metric *
 metric_clone(Io__Prometheus__Client__Metric const *orig) {
-  Io__Prometheus__Client__Metric *copy = calloc(1, sizeof(*copy));
-  if (copy == NULL)
+  prom_metric_t *pm = calloc(1, sizeof(*pm));
+  if (pm == NULL)
     return NULL;
+
+  Io__Prometheus__Client__Metric *copy = &pm->pb;
   io__prometheus__client__metric__init(copy);
 
   copy->n_label = orig->n_label;
@@ -454,6 +652,14 @@ metric_clone(Io__Prometheus__Client__Metric const *orig) {
     }
   }
 
+  char labels[1024];
+  pm->labels = strdup(format_labels(labels, sizeof(labels), copy));
+  if (pm->labels == NULL) {
+    metric_destroy(copy);
+    return NULL;
+  }
+  pm->labels_len = strlen(pm->labels);
+
   return copy;
 }
 
@@ -517,83 +723,174 @@ static int metric_update(Io__Prometheus__Client__Metric *m, value_t value,
   return 0;
 }
 
-/* metric_family_add_metric adds m to the metric list of fam. */
-static int metric_family_add_metric(Io__Prometheus__Client__MetricFamily *fam,
-                                    Io__Prometheus__Client__Metric *m) {
-  Io__Prometheus__Client__Metric **tmp =
-      realloc(fam->metric, (fam->n_metric + 1) * sizeof(*fam->metric));
-  if (tmp == NULL)
+/* metric_hash hashes the label values of m using FNV-1a. Label names are the
+ * same for all metrics in a family, see metric_cmp(). */
+static uint32_t metric_hash(Io__Prometheus__Client__Metric const *m) {
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < m->n_label; i++) {
+    /* Include the terminating null byte to separate the values. */
+    for (char const *c = m->label[i]->value;; c++) {
+      hash = (hash ^ (uint8_t)*c) * 16777619u;
+      if (*c == 0)
+        break;
+    }
+  }
+
+  return hash;
+}
+
+/* metric_family_sort sorts the metrics of a family, so that scrapes return
+ * them in a stable order. Must hold the family's lock. */
+static void metric_family_sort(prom_family_t *pf) {
+  Io__Prometheus__Client__MetricFamily *fam = &pf->pb;
+
+  if (pf->sorted)
+    return;
+
+  qsort(fam->metric, fam->n_metric, sizeof(*fam->metric), metric_cmp);
+  for (size_t i = 0; i < fam->n_metric; i++)
+    ((prom_metric_t *)fam->metric[i])->index = i;
+
+  pf->sorted = true;
+}
+
+/* metric_family_resize_buckets grows the hash table of a family so that there
+ * is about one metric per bucket. */
+static int metric_family_resize_buckets(prom_family_t *pf) {
+  size_t buckets_num = (pf->buckets_num == 0) ? 16 : 2 * pf->buckets_num;
+  prom_metric_t **buckets = calloc(buckets_num, sizeof(*buckets));
+  if (buckets == NULL)
     return ENOMEM;
-  fam->metric = tmp;
 
-  fam->metric[fam->n_metric] = m;
+  for (size_t i = 0; i < pf->buckets_num; i++) {
+    prom_metric_t *pm = pf->buckets[i];
+    while (pm != NULL) {
+      prom_metric_t *next = pm->next;
+      size_t bucket = pm->hash % buckets_num;
+
+      pm->next = buckets[bucket];
+      buckets[bucket] = pm;
+      pm = next;
+    }
+  }
+
+  sfree(pf->buckets);
+  pf->buckets = buckets;
+  pf->buckets_num = buckets_num;
+  return 0;
+}
+
+/* metric_family_find looks up the metric with the same labels as key. If
+ * ret_prev is not NULL, it is set to the link pointing to the metric. */
+static prom_metric_t *
+metric_family_find(prom_family_t *pf, Io__Prometheus__Client__Metric *key,
+                   uint32_t hash, prom_metric_t ***ret_prev) {
+  if (pf->buckets_num == 0)
+    return NULL;
+
+  prom_metric_t **prev = &pf->buckets[hash % pf->buckets_num];
+  for (prom_metric_t *pm = *prev; pm != NULL; prev = &pm->next, pm = *prev) {
+    Io__Prometheus__Client__Metric *m = &pm->pb;
+    if ((pm->hash == hash) && (metric_cmp(&key, &m) == 0)) {
+      if (ret_prev != NULL)
+        *ret_prev = prev;
+      return pm;
+    }
+  }
+
+  return NULL;
+}
+
+/* metric_family_add_metric adds m to the metric list and the hash table of
+ * fam. */
+static int metric_family_add_metric(prom_family_t *pf, prom_metric_t *pm) {
+  Io__Prometheus__Client__MetricFamily *fam = &pf->pb;
+
+  if (fam->n_metric >= pf->metric_size) {
+    size_t metric_size = (pf->metric_size == 0) ? 8 : 2 * pf->metric_size;
+    Io__Prometheus__Client__Metric **tmp =
+        realloc(fam->metric, metric_size * sizeof(*fam->metric));
+    if (tmp == NULL)
+      return ENOMEM;
+    fam->metric = tmp;
+    pf->metric_size = metric_size;
+  }
+
+  if (fam->n_metric >= pf->buckets_num) {
+    int status = metric_family_resize_buckets(pf);
+    if (status != 0)
+      return status;
+  }
+
+  pm->index = fam->n_metric;
+  fam->metric[fam->n_metric] = &pm->pb;
   fam->n_metric++;
 
-  /* Sort the metrics so that lookup is fast. */
-  qsort(fam->metric, fam->n_metric, sizeof(*fam->metric), metric_cmp);
+  size_t bucket = pm->hash % pf->buckets_num;
+  pm->next = pf->buckets[bucket];
+  pf->buckets[bucket] = pm;
 
+  pf->sorted = false;
   return 0;
 }
 
 /* metric_family_delete_metric looks up and deletes the metric corresponding to
  * vl. */
-static int
-metric_family_delete_metric(Io__Prometheus__Client__MetricFamily *fam,
-                            value_list_t const *vl) {
+static int metric_family_delete_metric(prom_family_t *pf,
+                                       value_list_t const *vl) {
+  Io__Prometheus__Client__MetricFamily *fam = &pf->pb;
   Io__Prometheus__Client__Metric *key = METRIC_INIT;
   METRIC_ADD_LABELS(key, vl);
 
-  size_t i;
-  for (i = 0; i < fam->n_metric; i++) {
-    if (metric_cmp(&key, &fam->metric[i]) == 0)
-      break;
-  }
-
-  if (i >= fam->n_metric)
+  prom_metric_t **prev = NULL;
+  prom_metric_t *pm = metric_family_find(pf, key, metric_hash(key), &prev);
+  if (pm == NULL)
     return ENOENT;
 
-  metric_destroy(fam->metric[i]);
-  if ((fam->n_metric - 1) > i)
-    memmove(&fam->metric[i], &fam->metric[i + 1],
-            ((fam->n_metric - 1) - i) * sizeof(fam->metric[i]));
+  *prev = pm->next;
+
+  /* Move the last metric into the gap. */
+  size_t i = pm->index;
   fam->n_metric--;
+  if (i < fam->n_metric) {
+    fam->metric[i] = fam->metric[fam->n_metric];
+    ((prom_metric_t *)fam->metric[i])->index = i;
+    pf->sorted = false;
+  }
+
+  metric_destroy(&pm->pb);
 
   if (fam->n_metric == 0) {
     sfree(fam->metric);
-    return 0;
+    pf->metric_size = 0;
+    sfree(pf->buckets);
+    pf->buckets_num = 0;
   }
 
-  Io__Prometheus__Client__Metric **tmp =
-      realloc(fam->metric, fam->n_metric * sizeof(*fam->metric));
-  if (tmp != NULL)
-    fam->metric = tmp;
-
   return 0;
 }
 
 /* metric_family_get_metric looks up the matching metric in a metric family,
  * allocating it if necessary. */
 static Io__Prometheus__Client__Metric *
-metric_family_get_metric(Io__Prometheus__Client__MetricFamily *fam,
-                         value_list_t const *vl) {
+metric_family_get_metric(prom_family_t *pf, value_list_t const *vl) {
   Io__Prometheus__Client__Metric *key = METRIC_INIT;
   METRIC_ADD_LABELS(key, vl);
 
-  /* Metrics are sorted in metric_family_add_metric() so that we can do a binary
-   * search here. */
-  Io__Prometheus__Client__Metric **m = bsearch(
-      &key, fam->metric, fam->n_metric, sizeof(*fam->metric), metric_cmp);
-
-  if (m != NULL) {
-    return *m;
-  }
+  uint32_t hash = metric_hash(key);
+  prom_metric_t *pm = metric_family_find(pf, key, hash, NULL);
+  if (pm != NULL)
+    return &pm->pb;
 
   Io__Prometheus__Client__Metric *new_metric = metric_clone(key);
   if (new_metric == NULL)
     return NULL;
+  pm = (prom_metric_t *)new_metric;
+  pm->hash = hash;
 
   DEBUG("write_prometheus plugin: created new metric in family");
-  int status = metric_family_add_metric(fam, new_metric);
+  int status = metric_family_add_metric(pf, pm);
   if (status != 0) {
     metric_destroy(new_metric);
     return NULL;
@@ -607,7 +904,8 @@ metric_family_get_metric(Io__Prometheus__Client__MetricFamily *fam,
 static int metric_family_update(Io__Prometheus__Client__MetricFamily *fam,
                                 data_set_t const *ds, value_list_t const *vl,
                                 size_t ds_index) {
-  Io__Prometheus__Client__Metric *m = metric_family_get_metric(fam, vl);
+  Io__Prometheus__Client__Metric *m =
+      metric_family_get_metric((prom_family_t *)fam, vl);
   if (m == NULL)
     return -1;
 
@@ -628,6 +926,11 @@ static void metric_family_destroy(Io__Prometheus__Client__MetricFamily *msg) {
   }
   sfree(msg->metric);
 
+  prom_family_t *pf = (prom_family_t *)msg;
+  sfree(pf->header);
+  sfree(pf->buckets);
+  pthread_mutex_destroy(&pf->lock);
+
   sfree(msg);
 }
 
@@ -635,10 +938,14 @@ static void metric_family_destroy(Io__Prometheus__Client__MetricFamily *msg) {
 static Io__Prometheus__Client__MetricFamily *
 metric_family_create(char *name, data_set_t const *ds, value_list_t const *vl,
                      size_t ds_index) {
-  Io__Prometheus__Client__MetricFamily *msg = calloc(1, sizeof(*msg));
-  if (msg == NULL)
+  prom_family_t *pf = calloc(1, sizeof(*pf));
+  if (pf == NULL)
     return NULL;
+
+  Io__Prometheus__Client__MetricFamily *msg = &pf->pb;
   io__prometheus__client__metric_family__init(msg);
+  pthread_mutex_init(&pf->lock, /* attr = */ NULL);
+  pf->sorted = true;
 
   msg->name = name;
 
@@ -655,6 +962,18 @@ metric_family_create(char *name, data_set_t const *ds, value_list_t const *vl,
                   : IO__PROMETHEUS__CLIENT__METRIC_TYPE__COUNTER;
   msg->has_type = 1;
 
+  pf->header = ssnprintf_alloc(
+      "# HELP %s %s\n# TYPE %s %s\n", msg->name, msg->help, msg->name,
+      (msg->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE) ? "gauge"
+                                                                : "counter");
+  if ((msg->help == NULL) || (pf->header == NULL)) {
+    /* "name" is owned by the caller until this function succeeds. */
+    msg->name = NULL;
+    metric_family_destroy(msg);
+    return NULL;
+  }
+  pf->header_len = strlen(pf->header);
+
   return msg;
 }
 
@@ -663,7 +982,8 @@ metric_family_create(char *name, data_set_t const *ds, value_list_t const *vl,
  * compatibility. In essence, the plugin, type and data source name go in the
  * metric family name, while hostname, plugin instance and type instance go into
  * the labels of a metric. */
-static char *metric_family_name(data_set_t const *ds, value_list_t const *vl,
+static char *metric_family_name(char *buffer, size_t buffer_size,
+                                data_set_t const *ds, value_list_t const *vl,
                                 size_t ds_index) {
   char const *fields[5] = {"collectd"};
   size_t fields_num = 1;
@@ -688,31 +1008,30 @@ static char *metric_family_name(data_set_t const *ds, value_list_t const *vl,
     fields_num++;
   }
 
-  char name[5 * DATA_MAX_NAME_LEN];
-  strjoin(name, sizeof(name), (char **)fields, fields_num, "_");
-  return strdup(name);
+  strjoin(buffer, buffer_size, (char **)fields, fields_num, "_");
+  return buffer;
 }
 
 /* metric_family_get looks up the matching metric family, allocating it if
- * necessary. */
+ * necessary. Must hold metrics_lock, for writing if "allocate" is true. */
 static Io__Prometheus__Client__MetricFamily *
 metric_family_get(data_set_t const *ds, value_list_t const *vl, size_t ds_index,
                   bool allocate) {
-  char *name = metric_family_name(ds, vl, ds_index);
-  if (name == NULL) {
-    ERROR("write_prometheus plugin: Allocating metric family name failed.");
-    return NULL;
-  }
+  char buffer[5 * DATA_MAX_NAME_LEN];
+  metric_family_name(buffer, sizeof(buffer), ds, vl, ds_index);
 
   Io__Prometheus__Client__MetricFamily *fam = NULL;
-  if (c_avl_get(metrics, name, (void *)&fam) == 0) {
-    sfree(name);
+  if (c_avl_get(metrics, buffer, (void *)&fam) == 0) {
     assert(fam != NULL);
     return fam;
   }
 
-  if (!allocate) {
-    sfree(name);
+  if (!allocate)
+    return NULL;
+
+  char *name = strdup(buffer);
+  if (name == NULL) {
+    ERROR("write_prometheus plugin: Allocating metric family name failed.");
     return NULL;
   }
 
@@ -739,6 +1058,554 @@ metric_family_get(data_set_t const *ds, value_list_t const *vl, size_t ds_index,
 }
 /* }}} */
 
+#if HAVE_LIBCURL
+/*
+ * Remote write
+ *
+ * Instead of (or in addition to) being scraped, the plugin can push samples
+ * to a Prometheus "remote_write" endpoint. Series are named and labeled like
+ * the metrics exposed for scraping. Each series is encoded into a TimeSeries
+ * message when it is written and appended to the queue of one shard as an
+ * entry of the WriteRequest's "timeseries" field, so that a queue is a
+ * complete WriteRequest and sending it only requires compressing the buffer.
+ * A series is always added to the same shard, which keeps its samples in
+ * order.
+ * {{{ */
+#define RW_TIMESERIES_TAG 0x0a /* field 1, length delimited */
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+  bool thread_running;
+
+  uint8_t *queue;
+  size_t queue_len;
+  size_t queue_size;
+  size_t queue_num;
+  cdtime_t queue_time;
+  c_complain_t queue_full;
+
+  /* The batch that is being sent. Only used by the shard's thread. */
+  uint8_t *batch;
+  size_t batch_len;
+  size_t batch_size;
+  size_t batch_num;
+
+  CURL *curl;
+  char curl_errbuf[CURL_ERROR_SIZE];
+  compressor_t *compressor;
+  c_complain_t send_failed;
+} rw_shard_t;
+
+static char *rw_url;
+static char *rw_user;
+static char *rw_password;
+static char *rw_cacert;
+static bool rw_verify_peer = true;
+static struct curl_slist *rw_headers;
+static size_t rw_shards_num = 1;
+static size_t rw_batch_size = 2000;
+static size_t rw_queue_limit = 10000;
+static cdtime_t rw_flush_interval = TIME_T_TO_CDTIME_T_STATIC(5);
+static cdtime_t rw_timeout = TIME_T_TO_CDTIME_T_STATIC(30);
+static cdtime_t rw_min_backoff = DOUBLE_TO_CDTIME_T_STATIC(0.03);
+static cdtime_t rw_max_backoff = TIME_T_TO_CDTIME_T_STATIC(5);
+
+static rw_shard_t *rw_shards;
+/* Set with all shard locks held, so that reading it with one held is safe. */
+static bool rw_shutdown;
+
+static size_t rw_curl_write_callback(__attribute__((unused)) char *ptr,
+                                     size_t size, size_t nmemb,
+                                     __attribute__((unused)) void *userdata) {
+  /* Discard the response body. */
+  return size * nmemb;
+}
+
+/* rw_label_cmp orders labels by name, as required by remote write. */
+static int rw_label_cmp(void const *a, void const *b) {
+  Prometheus__Label const *l_a = *((Prometheus__Label **)a);
+  Prometheus__Label const *l_b = *((Prometheus__Label **)b);
+  return strcmp(l_a->name, l_b->name);
+}
+
+/* rw_enqueue encodes a sample of the series identified by the family name and
+ * the labels of "m" and appends it to the queue of the series' shard. */
+static int rw_enqueue(char const *name, Io__Prometheus__Client__Metric const *m,
+                      double value, cdtime_t t) {
+  Prometheus__Label labels[4];
+  Prometheus__Label *labels_ptr[4];
+  size_t labels_num = 0;
+
+  prometheus__label__init(&labels[0]);
+  labels[0].name = "__name__";
+  labels[0].value = (char *)name;
+  labels_ptr[0] = &labels[0];
+  labels_num++;
+
+  for (size_t i = 0; (i < m->n_label) && (labels_num < 4); i++) {
+    Prometheus__Label *l = &labels[labels_num];
+    prometheus__label__init(l);
+    l->name = m->label[i]->name;
+    l->value = m->label[i]->value;
+    labels_ptr[labels_num] = l;
+    labels_num++;
+  }
+  qsort(labels_ptr, labels_num, sizeof(*labels_ptr), rw_label_cmp);
+
+  Prometheus__Sample sample = PROMETHEUS__SAMPLE__INIT;
+  sample.value = value;
+  sample.has_value = 1;
+  sample.timestamp = (int64_t)CDTIME_T_TO_MS(t);
+  sample.has_timestamp = 1;
+  Prometheus__Sample *sample_ptr = &sample;
+
+  Prometheus__TimeSeries ts = PROMETHEUS__TIME_SERIES__INIT;
+  ts.labels = labels_ptr;
+  ts.n_labels = labels_num;
+  ts.samples = &sample_ptr;
+  ts.n_samples = 1;
+
+  /* The shard is picked by the same hash as used for the family's hash table,
+   * extended with the family name. */
+  uint32_t hash = metric_hash(m);
+  for (char const *c = name; *c != 0; c++)
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+  rw_shard_t *s = rw_shards + (hash % rw_shards_num);
+
+  size_t ts_len = prometheus__time_series__get_packed_size(&ts);
+  size_t need = 1 + VARINT_UINT32_BYTES + ts_len;
+
+  pthread_mutex_lock(&s->lock);
+
+  if (s->queue_num >= rw_queue_limit) {
+    pthread_mutex_unlock(&s->lock);
+    c_complain(LOG_WARNING, &s->queue_full,
+               "write_prometheus plugin: The remote write queue is full, "
+               "dropping samples. Consider increasing \"QueueLimit\" or "
+               "\"Shards\".");
+    return ENOSPC;
+  }
+
+  if (s->queue_size - s->queue_len < need) {
+    size_t new_size = 2 * s->queue_size;
+    if (new_size < s->queue_len + need)
+      new_size = s->queue_len + need + 4096;
+    uint8_t *tmp = realloc(s->queue, new_size);
+    if (tmp == NULL) {
+      pthread_mutex_unlock(&s->lock);
+      return ENOMEM;
+    }
+    s->queue = tmp;
+    s->queue_size = new_size;
+  }
+
+  uint8_t *p = s->queue + s->queue_len;
+  *p++ = RW_TIMESERIES_TAG;
+  p += varint(p, (uint32_t)ts_len);
+  p += prometheus__time_series__pack(&ts, p);
+  s->queue_len = (size_t)(p - s->queue);
+
+  if (s->queue_num == 0)
+    s->queue_time = cdtime();
+  s->queue_num++;
+  /* The thread waits for the first series, which starts the flush timer, and
+   * for a complete batch. */
+  if ((s->queue_num == 1) || (s->queue_num == rw_batch_size))
+    pthread_cond_signal(&s->cond);
+
+  c_release(LOG_INFO, &s->queue_full,
+            "write_prometheus plugin: The remote write queue accepts samples "
+            "again.");
+  pthread_mutex_unlock(&s->lock);
+  return 0;
+}
+
+static double rw_value(value_t value, int ds_type) {
+  switch (ds_type) {
+  case DS_TYPE_GAUGE:
+    return (double)value.gauge;
+  case DS_TYPE_ABSOLUTE:
+    return (double)value.absolute;
+  case DS_TYPE_COUNTER:
+    return (double)value.counter;
+  default:
+    return (double)value.derive;
+  }
+}
+
+/* rw_write queues one sample per data source of "vl". */
+static void rw_write(data_set_t const *ds, value_list_t const *vl,
+                     bool stale) {
+  Io__Prometheus__Client__Metric *m = METRIC_INIT;
+  METRIC_ADD_LABELS(m, vl);
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    char name[5 * DATA_MAX_NAME_LEN];
+    metric_family_name(name, sizeof(name), ds, vl, i);
+
+    double value;
+    cdtime_t t = vl->time;
+    if (stale) {
+      /* Prometheus' staleness marker, a NaN with a special bit pattern, tells
+       * it that the series is gone. */
+      uint64_t stale_nan = 0x7ff0000000000002ULL;
+      memcpy(&value, &stale_nan, sizeof(value));
+      t = cdtime();
+    } else {
+      value = rw_value(vl->values[i], ds->ds[i].type);
+    }
+
+    int status = rw_enqueue(name, m, value, t);
+    if ((status != 0) && (status != ENOSPC))
+      ERROR("write_prometheus plugin: Queueing a sample of \"%s\" for remote "
+            "write failed with status %d",
+            name, status);
+  }
+}
+
+/* rw_post sends a compressed WriteRequest. Returns EAGAIN if the request
+ * should be retried. */
+static int rw_post(rw_shard_t *s, void const *data, size_t size) {
+  curl_easy_setopt(s->curl, CURLOPT_POSTFIELDSIZE, (long)size);
+  curl_easy_setopt(s->curl, CURLOPT_POSTFIELDS, data);
+
+  CURLcode status = curl_easy_perform(s->curl);
+  if (status != CURLE_OK) {
+    c_complain(LOG_ERR, &s->send_failed,
+               "write_prometheus plugin: Sending to \"%s\" failed: %s", rw_url,
+               s->curl_errbuf);
+    return EAGAIN;
+  }
+
+  long code = 0;
+  curl_easy_getinfo(s->curl, CURLINFO_RESPONSE_CODE, &code);
+  if ((code >= 200) && (code < 300)) {
+    c_release(LOG_INFO, &s->send_failed,
+              "write_prometheus plugin: Sending to \"%s\" succeeded again.",
+              rw_url);
+    return 0;
+  }
+
+  /* Server errors and rate limiting are temporary, other client errors mean
+   * that the request will never be accepted. */
+  if ((code >= 500) || (code == 429)) {
+    c_complain(LOG_ERR, &s->send_failed,
+               "write_prometheus plugin: \"%s\" returned HTTP status %ld.",
+               rw_url, code);
+    return EAGAIN;
+  }
+
+  ERROR("write_prometheus plugin: \"%s\" rejected %zu samples with HTTP "
+        "status %ld.",
+        rw_url, s->batch_num, code);
+  return -1;
+}
+
+/* rw_send_batch sends the shard's batch, retrying with exponential backoff
+ * until it succeeds or the plugin shuts down. */
+static void rw_send_batch(rw_shard_t *s) {
+  void const *data = NULL;
+  size_t size = 0;
+  int status =
+      compressor_compress(s->compressor, s->batch, s->batch_len, &data, &size);
+  if (status != 0) {
+    ERROR("write_prometheus plugin: Compressing %zu samples failed with "
+          "status %d.",
+          s->batch_num, status);
+    s->batch_len = s->batch_num = 0;
+    return;
+  }
+
+  cdtime_t backoff = rw_min_backoff;
+  while (rw_post(s, data, size) == EAGAIN) {
+    cdtime_t deadline = cdtime() + backoff;
+
+    pthread_mutex_lock(&s->lock);
+    /* Writers signal the condition, too, so wait until the deadline. */
+    while (!rw_shutdown && (cdtime() < deadline)) {
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(deadline);
+      pthread_cond_timedwait(&s->cond, &s->lock, &ts);
+    }
+    bool stop = rw_shutdown;
+    pthread_mutex_unlock(&s->lock);
+
+    if (stop) {
+      ERROR("write_prometheus plugin: Shutting down, dropping %zu samples "
+            "that could not be sent.",
+            s->batch_num);
+      break;
+    }
+
+    backoff *= 2;
+    if (backoff > rw_max_backoff)
+      backoff = rw_max_backoff;
+  }
+
+  s->batch_len = s->batch_num = 0;
+}
+
+static void *rw_shard_thread(void *arg) {
+  rw_shard_t *s = arg;
+
+  pthread_mutex_lock(&s->lock);
+  while (true) {
+    while (!rw_shutdown && (s->queue_num < rw_batch_size)) {
+      if (s->queue_num == 0) {
+        pthread_cond_wait(&s->cond, &s->lock);
+        continue;
+      }
+
+      cdtime_t deadline = s->queue_time + rw_flush_interval;
+      if (cdtime() >= deadline)
+        break;
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(deadline);
+      pthread_cond_timedwait(&s->cond, &s->lock, &ts);
+    }
+
+    if (s->queue_num == 0) {
+      if (rw_shutdown)
+        break;
+      continue;
+    }
+
+    /* Swap the buffers, so that writers can fill the queue while the batch is
+     * being sent. */
+    uint8_t *tmp = s->batch;
+    size_t tmp_size = s->batch_size;
+    s->batch = s->queue;
+    s->batch_size = s->queue_size;
+    s->batch_len = s->queue_len;
+    s->batch_num = s->queue_num;
+    s->queue = tmp;
+    s->queue_size = tmp_size;
+    s->queue_len = s->queue_num = 0;
+
+    pthread_mutex_unlock(&s->lock);
+    rw_send_batch(s);
+    pthread_mutex_lock(&s->lock);
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  return NULL;
+}
+
+static int rw_shard_init(rw_shard_t *s) {
+  s->compressor = compressor_create(COMPRESS_SNAPPY);
+  if (s->compressor == NULL) {
+    ERROR("write_prometheus plugin: compressor_create failed.");
+    return -1;
+  }
+
+  s->curl = curl_easy_init();
+  if (s->curl == NULL) {
+    ERROR("write_prometheus plugin: curl_easy_init failed.");
+    return -1;
+  }
+
+  curl_easy_setopt(s->curl, CURLOPT_URL, rw_url);
+  curl_easy_setopt(s->curl, CURLOPT_POST, 1L);
+  curl_easy_setopt(s->curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(s->curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+  curl_easy_setopt(s->curl, CURLOPT_HTTPHEADER, rw_headers);
+  curl_easy_setopt(s->curl, CURLOPT_ERRORBUFFER, s->curl_errbuf);
+  curl_easy_setopt(s->curl, CURLOPT_WRITEFUNCTION, rw_curl_write_callback);
+  curl_easy_setopt(s->curl, CURLOPT_SSL_VERIFYPEER, (long)rw_verify_peer);
+  curl_easy_setopt(s->curl, CURLOPT_SSL_VERIFYHOST, rw_verify_peer ? 2L : 0L);
+  if (rw_cacert != NULL)
+    curl_easy_setopt(s->curl, CURLOPT_CAINFO, rw_cacert);
+#ifdef HAVE_CURLOPT_TIMEOUT_MS
+  curl_easy_setopt(s->curl, CURLOPT_TIMEOUT_MS,
+                   (long)CDTIME_T_TO_MS(rw_timeout));
+#endif
+  if (rw_user != NULL) {
+#ifdef HAVE_CURLOPT_USERNAME
+    curl_easy_setopt(s->curl, CURLOPT_USERNAME, rw_user);
+    curl_easy_setopt(s->curl, CURLOPT_PASSWORD,
+                     (rw_password == NULL) ? "" : rw_password);
+#else
+    ERROR("write_prometheus plugin: \"User\" requires libcurl 7.19.1 or "
+          "later.");
+    return -1;
+#endif
+  }
+
+  int status = plugin_thread_create(&s->thread, rw_shard_thread, s,
+                                    "prom rw shard");
+  if (status != 0) {
+    ERROR("write_prometheus plugin: plugin_thread_create failed: %s",
+          STRERROR(status));
+    return -1;
+  }
+  s->thread_running = true;
+
+  return 0;
+}
+
+static void rw_shard_destroy(rw_shard_t *s) {
+  if (s->curl != NULL)
+    curl_easy_cleanup(s->curl);
+  compressor_destroy(s->compressor);
+  sfree(s->queue);
+  sfree(s->batch);
+  pthread_cond_destroy(&s->cond);
+  pthread_mutex_destroy(&s->lock);
+}
+
+static int rw_init(void) {
+  if (rw_shards != NULL)
+    return 0;
+
+  if (rw_headers == NULL) {
+    char const *headers[] = {
+        "Content-Encoding: snappy",
+        "Content-Type: application/x-protobuf",
+        "X-Prometheus-Remote-Write-Version: 0.1.0",
+        "Expect:",
+    };
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(headers); i++) {
+      struct curl_slist *tmp = curl_slist_append(rw_headers, headers[i]);
+      if (tmp == NULL)
+        return ENOMEM;
+      rw_headers = tmp;
+    }
+  }
+
+  curl_global_init(CURL_GLOBAL_SSL);
+
+  rw_shards = calloc(rw_shards_num, sizeof(*rw_shards));
+  if (rw_shards == NULL)
+    return ENOMEM;
+
+  for (size_t i = 0; i < rw_shards_num; i++) {
+    rw_shard_t *s = rw_shards + i;
+    pthread_mutex_init(&s->lock, /* attr = */ NULL);
+    pthread_cond_init(&s->cond, /* attr = */ NULL);
+    C_COMPLAIN_INIT(&s->queue_full);
+    C_COMPLAIN_INIT(&s->send_failed);
+  }
+
+  for (size_t i = 0; i < rw_shards_num; i++) {
+    int status = rw_shard_init(rw_shards + i);
+    if (status != 0)
+      return status;
+  }
+
+  INFO("write_prometheus plugin: Sending to \"%s\" with %zu shard(s).", rw_url,
+       rw_shards_num);
+  return 0;
+}
+
+/* rw_shutdown_shards sends what is queued, without retrying, and frees all
+ * shards. */
+static void rw_shutdown_shards(void) {
+  if (rw_shards == NULL)
+    return;
+
+  for (size_t i = 0; i < rw_shards_num; i++)
+    pthread_mutex_lock(&rw_shards[i].lock);
+  rw_shutdown = true;
+  for (size_t i = 0; i < rw_shards_num; i++) {
+    pthread_cond_signal(&rw_shards[i].cond);
+    pthread_mutex_unlock(&rw_shards[i].lock);
+  }
+
+  for (size_t i = 0; i < rw_shards_num; i++) {
+    if (rw_shards[i].thread_running)
+      pthread_join(rw_shards[i].thread, NULL);
+    rw_shard_destroy(rw_shards + i);
+  }
+  sfree(rw_shards);
+}
+
+static int rw_config_size(oconfig_item_t *ci, size_t *ret) {
+  int tmp = 0;
+  int status = cf_util_get_int(ci, &tmp);
+  if (status != 0)
+    return status;
+  if (tmp < 1) {
+    ERROR("write_prometheus plugin: \"%s\" must be at least 1.", ci->key);
+    return -1;
+  }
+  *ret = (size_t)tmp;
+  return 0;
+}
+
+static int rw_config(oconfig_item_t *ci) {
+  if (rw_url != NULL) {
+    ERROR("write_prometheus plugin: Only one \"RemoteWrite\" block is "
+          "supported.");
+    return -1;
+  }
+
+  int status = cf_util_get_string(ci, &rw_url);
+  if (status != 0)
+    return status;
+
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("User", child->key) == 0)
+      status = cf_util_get_string(child, &rw_user);
+    else if (strcasecmp("Password", child->key) == 0)
+      status = cf_util_get_string(child, &rw_password);
+    else if (strcasecmp("CACert", child->key) == 0)
+      status = cf_util_get_string(child, &rw_cacert);
+    else if (strcasecmp("VerifyPeer", child->key) == 0)
+      status = cf_util_get_boolean(child, &rw_verify_peer);
+    else if (strcasecmp("Header", child->key) == 0) {
+      char *header = NULL;
+      status = cf_util_get_string(child, &header);
+      if (status == 0) {
+        struct curl_slist *tmp = curl_slist_append(rw_headers, header);
+        if (tmp == NULL)
+          status = ENOMEM;
+        else
+          rw_headers = tmp;
+      }
+      sfree(header);
+    } else if (strcasecmp("Shards", child->key) == 0)
+      status = rw_config_size(child, &rw_shards_num);
+    else if (strcasecmp("BatchSize", child->key) == 0)
+      status = rw_config_size(child, &rw_batch_size);
+    else if (strcasecmp("QueueLimit", child->key) == 0)
+      status = rw_config_size(child, &rw_queue_limit);
+    else if (strcasecmp("FlushInterval", child->key) == 0)
+      status = cf_util_get_cdtime(child, &rw_flush_interval);
+    else if (strcasecmp("Timeout", child->key) == 0)
+      status = cf_util_get_cdtime(child, &rw_timeout);
+    else if (strcasecmp("RetryMinBackoff", child->key) == 0)
+      status = cf_util_get_cdtime(child, &rw_min_backoff);
+    else if (strcasecmp("RetryMaxBackoff", child->key) == 0)
+      status = cf_util_get_cdtime(child, &rw_max_backoff);
+    else {
+      WARNING("write_prometheus plugin: Ignoring unknown \"RemoteWrite\" "
+              "option \"%s\".",
+              child->key);
+      continue;
+    }
+
+    if (status != 0)
+      return status;
+  }
+
+  if (rw_queue_limit < rw_batch_size) {
+    WARNING("write_prometheus plugin: \"QueueLimit\" is smaller than "
+            "\"BatchSize\", raising it to %zu.",
+            rw_batch_size);
+    rw_queue_limit = rw_batch_size;
+  }
+  if (rw_min_backoff == 0)
+    rw_min_backoff = MS_TO_CDTIME_T(1);
+  if (rw_max_backoff < rw_min_backoff)
+    rw_max_backoff = rw_min_backoff;
+
+  return 0;
+}
+/* }}} */
+#endif /* HAVE_LIBCURL */
+
 static void prom_logger(__attribute__((unused)) void *arg, char const *fmt,
                         va_list ap) {
   /* {{{ */
@@ -872,6 +1739,7 @@ static int prom_config(oconfig_item_t *ci) {
     if (strcasecmp("Host", child->key) == 0) {
 #if MHD_VERSION >= 0x00090000
       cf_util_get_string(child, &httpd_host);
+      httpd_configured = true;
 #else
       ERROR("write_prometheus plugin: Option `Host' not supported. Please "
             "upgrade libmicrohttpd to at least 0.9.0");
@@ -881,8 +1749,21 @@ static int prom_config(oconfig_item_t *ci) {
       int status = cf_util_get_port_number(child);
       if (status > 0)
         httpd_port = (unsigned short)status;
+      httpd_configured = true;
     } else if (strcasecmp("StalenessDelta", child->key) == 0) {
       cf_util_get_cdtime(child, &staleness_delta);
+    } else if (strcasecmp("CacheTTL", child->key) == 0) {
+      cf_util_get_cdtime(child, &cache_ttl);
+    } else if (strcasecmp("RemoteWrite", child->key) == 0) {
+#if HAVE_LIBCURL
+      int status = rw_config(child);
+      if (status != 0)
+        return status;
+#else
+      ERROR("write_prometheus plugin: Option `RemoteWrite' requires "
+            "collectd to be built with libcurl.");
+      return -1;
+#endif
     } else {
       WARNING("write_prometheus plugin: Ignoring unknown configuration option "
               "\"%s\".",
@@ -890,6 +1771,11 @@ static int prom_config(oconfig_item_t *ci) {
     }
   }
 
+#if HAVE_LIBCURL
+  if ((rw_url != NULL) && !httpd_configured)
+    httpd_enabled = false;
+#endif
+
   return 0;
 }
 
@@ -902,7 +1788,19 @@ static int prom_init() {
     }
   }
 
-  if (httpd == NULL) {
+#if HAVE_LIBCURL
+  if (rw_url != NULL) {
+    int status = rw_init();
+    if (status != 0) {
+      ERROR("write_prometheus plugin: Initializing remote write failed with "
+            "status %d.",
+            status);
+      return -1;
+    }
+  }
+#endif
+
+  if (httpd_enabled && (httpd == NULL)) {
     httpd = prom_start_daemon();
     if (httpd == NULL) {
       return -1;
@@ -916,24 +1814,43 @@ static int prom_init() {
 
 static int prom_write(data_set_t const *ds, value_list_t const *vl,
                       __attribute__((unused)) user_data_t *ud) {
-  pthread_mutex_lock(&metrics_lock);
+#if HAVE_LIBCURL
+  if (rw_shards != NULL)
+    rw_write(ds, vl, /* stale = */ false);
+#endif
+
+  if (!httpd_enabled)
+    return 0;
 
   for (size_t i = 0; i < ds->ds_num; i++) {
+    pthread_rwlock_rdlock(&metrics_lock);
+
     Io__Prometheus__Client__MetricFamily *fam =
-        metric_family_get(ds, vl, i, /* allocate = */ true);
-    if (fam == NULL)
+        metric_family_get(ds, vl, i, /* allocate = */ false);
+    if (fam == NULL) {
+      /* Creating a family requires exclusive access to "metrics". */
+      pthread_rwlock_unlock(&metrics_lock);
+      pthread_rwlock_wrlock(&metrics_lock);
+      fam = metric_family_get(ds, vl, i, /* allocate = */ true);
+    }
+    if (fam == NULL) {
+      pthread_rwlock_unlock(&metrics_lock);
       continue;
+    }
 
+    prom_family_t *pf = (prom_family_t *)fam;
+    pthread_mutex_lock(&pf->lock);
     int status = metric_family_update(fam, ds, vl, i);
-    if (status != 0) {
+    pthread_mutex_unlock(&pf->lock);
+
+    if (status != 0)
       ERROR("write_prometheus plugin: Updating metric \"%s\" failed with "
             "status %d",
             fam->name, status);
-      continue;
-    }
+
+    pthread_rwlock_unlock(&metrics_lock);
   }
 
-  pthread_mutex_unlock(&metrics_lock);
   return 0;
 }
 
@@ -943,7 +1860,17 @@ static int prom_missing(value_list_t const *vl,
   if (ds == NULL)
     return ENOENT;
 
-  pthread_mutex_lock(&metrics_lock);
+#if HAVE_LIBCURL
+  if (rw_shards != NULL)
+    rw_write(ds, vl, /* stale = */ true);
+#endif
+
+  if (!httpd_enabled)
+    return 0;
+
+  /* Holding metrics_lock for writing excludes all other users of the
+   * families, so their locks aren't needed. */
+  pthread_rwlock_wrlock(&metrics_lock);
 
   for (size_t i = 0; i < ds->ds_num; i++) {
     Io__Prometheus__Client__MetricFamily *fam =
@@ -951,7 +1878,7 @@ static int prom_missing(value_list_t const *vl,
     if (fam == NULL)
       continue;
 
-    int status = metric_family_delete_metric(fam, vl);
+    int status = metric_family_delete_metric((prom_family_t *)fam, vl);
     if (status != 0) {
       ERROR("write_prometheus plugin: Deleting a metric in family \"%s\" "
             "failed with status %d",
@@ -972,7 +1899,7 @@ static int prom_missing(value_list_t const *vl,
     }
   }
 
-  pthread_mutex_unlock(&metrics_lock);
+  pthread_rwlock_unlock(&metrics_lock);
   return 0;
 }
 
@@ -982,7 +1909,7 @@ static int prom_shutdown() {
     httpd = NULL;
   }
 
-  pthread_mutex_lock(&metrics_lock);
+  pthread_rwlock_wrlock(&metrics_lock);
   if (metrics != NULL) {
     char *name;
     Io__Prometheus__Client__MetricFamily *fam;
@@ -995,10 +1922,31 @@ static int prom_shutdown() {
     c_avl_destroy(metrics);
     metrics = NULL;
   }
-  pthread_mutex_unlock(&metrics_lock);
+  pthread_rwlock_unlock(&metrics_lock);
+
+  pthread_mutex_lock(&responses_lock);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(responses); i++) {
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(responses[i]); j++) {
+      sfree(responses[i][j].data);
+      responses[i][j] = (prom_response_t){0};
+    }
+  }
+  pthread_mutex_unlock(&responses_lock);
 
   sfree(httpd_host);
 
+#if HAVE_LIBCURL
+  rw_shutdown_shards();
+  if (rw_headers != NULL) {
+    curl_slist_free_all(rw_headers);
+    rw_headers = NULL;
+  }
+  sfree(rw_url);
+  sfree(rw_user);
+  sfree(rw_password);
+  sfree(rw_cacert);
+#endif
+
   return 0;
 }
 
@@ -0,0 +1,250 @@
+/**
+ * collectd - src/write_record.c
+ * Copyright (C) 2026  collectd authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd authors
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/cmds/putbin.h"
+#include "utils/common/common.h"
+
+#if HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+/*
+ * Appends all value lists passed to the write callbacks to a file, so that
+ * they can be dispatched again by the replay plugin. The file starts with
+ * RECORD_MAGIC, followed by frames. Each frame is a 32 bit length in network
+ * byte order and that many bytes of value lists encoded in the binary network
+ * protocol by cmd_create_putbin(). Within a frame, parts that didn't change
+ * since the previous value list are omitted, like in network packets.
+ */
+#define RECORD_MAGIC "CDREC001"
+#define RECORD_MAGIC_SIZE 8
+#define RECORD_FRAME_SIZE_DEFAULT 65536
+
+static char *file_path;
+static size_t frame_size = RECORD_FRAME_SIZE_DEFAULT;
+
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *record_fh;
+static char *frame;
+static size_t frame_fill;
+/* Identifier, time and interval of the last value list in "frame". */
+static value_list_t frame_prev;
+static cdtime_t frame_first;
+
+/* Must be called with "record_lock" held. */
+static int record_write_frame(void) {
+  if (frame_fill == 0)
+    return 0;
+
+  uint32_t len = htonl((uint32_t)frame_fill);
+  size_t status = fwrite(&len, sizeof(len), 1, record_fh);
+  if (status == 1)
+    status = fwrite(frame, frame_fill, 1, record_fh);
+  frame_fill = 0;
+
+  if (status != 1) {
+    ERROR("write_record plugin: Writing to \"%s\" failed: %s", file_path,
+          STRERRNO);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int record_config(oconfig_item_t *ci) {
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+    int status = 0;
+
+    if (strcasecmp("File", child->key) == 0) {
+      status = cf_util_get_string(child, &file_path);
+    } else if (strcasecmp("FrameSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && ((tmp < 1024) || (tmp > CMD_PUTBIN_MAX_SIZE))) {
+        ERROR("write_record plugin: \"FrameSize\" must be between 1024 and "
+              "%d.",
+              CMD_PUTBIN_MAX_SIZE);
+        status = -1;
+      }
+      if (status == 0)
+        frame_size = (size_t)tmp;
+    } else {
+      WARNING("write_record plugin: Ignoring unknown config option \"%s\".",
+              child->key);
+    }
+
+    if (status != 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+static int record_init(void) {
+  if (file_path == NULL) {
+    ERROR("write_record plugin: The \"File\" option is required.");
+    return -1;
+  }
+
+  pthread_mutex_lock(&record_lock);
+  if (record_fh != NULL) {
+    pthread_mutex_unlock(&record_lock);
+    return 0;
+  }
+
+  frame = malloc(frame_size);
+  if (frame == NULL) {
+    pthread_mutex_unlock(&record_lock);
+    ERROR("write_record plugin: malloc failed.");
+    return -1;
+  }
+
+  /* Writes always go to the end of the file; reading is only used to check
+   * that an existing file is a recording. */
+  record_fh = fopen(file_path, "a+");
+  if (record_fh == NULL) {
+    ERROR("write_record plugin: Opening \"%s\" failed: %s", file_path,
+          STRERRNO);
+    sfree(frame);
+    pthread_mutex_unlock(&record_lock);
+    return -1;
+  }
+
+  char magic[RECORD_MAGIC_SIZE];
+  int status = 0;
+  if (fseek(record_fh, 0, SEEK_END) != 0) {
+    status = errno;
+  } else if (ftell(record_fh) == 0) {
+    if (fwrite(RECORD_MAGIC, RECORD_MAGIC_SIZE, 1, record_fh) != 1)
+      status = errno;
+  } else {
+    rewind(record_fh);
+    if ((fread(magic, sizeof(magic), 1, record_fh) != 1) ||
+        (memcmp(magic, RECORD_MAGIC, sizeof(magic)) != 0)) {
+      ERROR("write_record plugin: \"%s\" exists but is not a recording.",
+            file_path);
+      status = EINVAL;
+    }
+  }
+
+  if (status != 0) {
+    if (status != EINVAL)
+      ERROR("write_record plugin: Initializing \"%s\" failed: %s", file_path,
+            STRERROR(status));
+    fclose(record_fh);
+    record_fh = NULL;
+    sfree(frame);
+  }
+  pthread_mutex_unlock(&record_lock);
+
+  return (status == 0) ? 0 : -1;
+}
+
+static int record_write(data_set_t const *ds, value_list_t const *vl,
+                        __attribute__((unused)) user_data_t *ud) {
+  pthread_mutex_lock(&record_lock);
+
+  if (record_fh == NULL) {
+    pthread_mutex_unlock(&record_lock);
+    return -1;
+  }
+
+  ssize_t n = cmd_create_putbin(frame + frame_fill, frame_size - frame_fill, ds,
+                                vl, (frame_fill > 0) ? &frame_prev : NULL);
+  if ((n < 0) && (frame_fill > 0)) {
+    /* The frame is full: write it and start a new one. */
+    record_write_frame();
+    n = cmd_create_putbin(frame, frame_size, ds, vl, NULL);
+  }
+
+  if (n < 0) {
+    pthread_mutex_unlock(&record_lock);
+    ERROR("write_record plugin: Encoding a value list of type \"%s\" failed. "
+          "Is \"FrameSize\" too small?",
+          vl->type);
+    return -1;
+  }
+
+  if (frame_fill == 0)
+    frame_first = cdtime();
+  frame_fill += (size_t)n;
+
+  frame_prev = *vl;
+  frame_prev.values = NULL;
+  frame_prev.values_len = 0;
+  frame_prev.meta = NULL;
+
+  pthread_mutex_unlock(&record_lock);
+  return 0;
+}
+
+static int record_flush(cdtime_t timeout,
+                        __attribute__((unused)) char const *identifier,
+                        __attribute__((unused)) user_data_t *ud) {
+  int status = 0;
+
+  pthread_mutex_lock(&record_lock);
+  if ((record_fh != NULL) && (frame_fill > 0) &&
+      ((timeout == 0) || ((cdtime() - frame_first) >= timeout))) {
+    status = record_write_frame();
+    if ((status == 0) && (fflush(record_fh) != 0)) {
+      ERROR("write_record plugin: Flushing \"%s\" failed: %s", file_path,
+            STRERRNO);
+      status = -1;
+    }
+  }
+  pthread_mutex_unlock(&record_lock);
+
+  return status;
+}
+
+static int record_shutdown(void) {
+  pthread_mutex_lock(&record_lock);
+  if (record_fh != NULL) {
+    record_write_frame();
+    if (fclose(record_fh) != 0)
+      ERROR("write_record plugin: Closing \"%s\" failed: %s", file_path,
+            STRERRNO);
+    record_fh = NULL;
+  }
+  sfree(frame);
+  pthread_mutex_unlock(&record_lock);
+
+  sfree(file_path);
+  return 0;
+}
+
+void module_register(void) {
+  plugin_register_complex_config("write_record", record_config);
+  plugin_register_init("write_record", record_init);
+  plugin_register_write("write_record", record_write, /* user_data = */ NULL);
+  plugin_register_flush("write_record", record_flush, /* user_data = */ NULL);
+  plugin_register_shutdown("write_record", record_shutdown);
+}
@@ -27,6 +27,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 
 #include <hiredis/hiredis.h>
@@ -48,7 +49,20 @@ struct wr_node_s {
   int max_set_duration;
   bool store_rates;
 
+  /* Commands are pipelined: replies are read once "batch_size" values have
+   * been written or the oldest unread reply is older than "flush_interval". */
+  int batch_size;
+  cdtime_t flush_interval;
+  /* Sets are trimmed on every "trim_interval"th write to a key. */
+  int trim_interval;
+
   redisContext *conn;
+  int pending_values;
+  int pending_replies;
+  cdtime_t pending_since;
+  /* Keys written on this connection, mapped to the number of writes since the
+   * last trim. */
+  c_avl_tree_t *keys;
   pthread_mutex_t lock;
 };
 typedef struct wr_node_s wr_node_t;
@@ -56,6 +70,132 @@ typedef struct wr_node_s wr_node_t;
 /*
  * Functions
  */
+static void wr_disconnect(wr_node_t *node) /* {{{ */
+{
+  if (node->conn != NULL) {
+    redisFree(node->conn);
+    node->conn = NULL;
+  }
+  node->pending_values = 0;
+  node->pending_replies = 0;
+
+  /* Keys are added to the "values" set again after reconnecting. */
+  if (node->keys != NULL) {
+    void *key;
+    void *value;
+    while (c_avl_pick(node->keys, &key, &value) == 0) {
+      sfree(key);
+      sfree(value);
+    }
+  }
+} /* }}} void wr_disconnect */
+
+static int wr_connect(wr_node_t *node) /* {{{ */
+{
+  redisReply *rr;
+
+  if (node->conn != NULL)
+    return 0;
+
+  node->conn =
+      redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
+  if (node->conn == NULL) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
+          "Unknown reason",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379);
+    return -1;
+  } else if (node->conn->err) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379, node->conn->errstr);
+    wr_disconnect(node);
+    return -1;
+  }
+
+  rr = redisCommand(node->conn, "SELECT %d", node->database);
+  if (rr == NULL)
+    WARNING("SELECT command error. database:%d message:%s", node->database,
+            node->conn->errstr);
+  else
+    freeReplyObject(rr);
+
+  return 0;
+} /* }}} int wr_connect */
+
+/* Queues a command on the connection without waiting for its reply. */
+static int wr_append(wr_node_t *node, const char *format, ...) /* {{{ */
+{
+  va_list ap;
+  int status;
+
+  va_start(ap, format);
+  status = redisvAppendCommand(node->conn, format, ap);
+  va_end(ap);
+
+  if (status != REDIS_OK) {
+    WARNING("write_redis plugin: Queueing command \"%s\" failed: %s", format,
+            node->conn->errstr);
+    return -1;
+  }
+
+  if (node->pending_replies == 0)
+    node->pending_since = cdtime();
+  node->pending_replies++;
+  return 0;
+} /* }}} int wr_append */
+
+/* Sends all queued commands and reads their replies. */
+static int wr_drain(wr_node_t *node) /* {{{ */
+{
+  while (node->pending_replies > 0) {
+    redisReply *rr = NULL;
+
+    if (redisGetReply(node->conn, (void **)&rr) != REDIS_OK) {
+      ERROR("write_redis plugin: Reading replies from node \"%s\" failed: %s",
+            node->name, node->conn->errstr);
+      wr_disconnect(node);
+      return -1;
+    }
+    node->pending_replies--;
+
+    if (rr->type == REDIS_REPLY_ERROR)
+      WARNING("write_redis plugin: Command failed on node \"%s\": %s",
+              node->name, rr->str);
+    freeReplyObject(rr);
+  }
+
+  node->pending_values = 0;
+  return 0;
+} /* }}} int wr_drain */
+
+/* Counts a write to "key" and returns true if the key's set is due to be
+ * trimmed. "ret_new" is set if "key" has not been written on this connection
+ * before. */
+static bool wr_key_trim_due(wr_node_t *node, char const *key, /* {{{ */
+                            bool *ret_new) {
+  int *count = NULL;
+
+  *ret_new = false;
+  if (c_avl_get(node->keys, key, (void *)&count) == 0) {
+    (*count)++;
+    if (*count < node->trim_interval)
+      return false;
+    *count = 0;
+    return true;
+  }
+
+  *ret_new = true;
+  char *key_copy = strdup(key);
+  count = calloc(1, sizeof(*count));
+  if ((key_copy == NULL) || (count == NULL) ||
+      (c_avl_insert(node->keys, key_copy, count) != 0)) {
+    sfree(key_copy);
+    sfree(count);
+  }
+  return true;
+} /* }}} bool wr_key_trim_due */
+
 static int wr_write(const data_set_t *ds, /* {{{ */
                     const value_list_t *vl, user_data_t *ud) {
   wr_node_t *node = ud->data;
@@ -66,7 +206,6 @@ static int wr_write(const data_set_t *ds, /* {{{ */
   size_t value_size;
   char *value_ptr;
   int status;
-  redisReply *rr;
 
   status = FORMAT_VL(ident, sizeof(ident), vl);
   if (status != 0)
@@ -84,80 +223,63 @@ static int wr_write(const data_set_t *ds, /* {{{ */
 
   pthread_mutex_lock(&node->lock);
 
-  if (node->conn == NULL) {
-    node->conn =
-        redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
-    if (node->conn == NULL) {
-      ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
-            "Unknown reason",
-            (node->host != NULL) ? node->host : "localhost",
-            (node->port != 0) ? node->port : 6379);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    } else if (node->conn->err) {
-      ERROR(
-          "write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
-          (node->host != NULL) ? node->host : "localhost",
-          (node->port != 0) ? node->port : 6379, node->conn->errstr);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    }
-
-    rr = redisCommand(node->conn, "SELECT %d", node->database);
-    if (rr == NULL)
-      WARNING("SELECT command error. database:%d message:%s", node->database,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
+  if (wr_connect(node) != 0) {
+    pthread_mutex_unlock(&node->lock);
+    return -1;
   }
 
-  rr = redisCommand(node->conn, "ZADD %s %s %s", key, time, value);
-  if (rr == NULL)
-    WARNING("ZADD command error. key:%s message:%s", key, node->conn->errstr);
-  else
-    freeReplyObject(rr);
+  bool is_new;
+  bool trim = wr_key_trim_due(node, key, &is_new);
 
-  if (node->max_set_size >= 0) {
-    rr = redisCommand(node->conn, "ZREMRANGEBYRANK %s %d %d", key, 0,
-                      (-1 * node->max_set_size) - 1);
-    if (rr == NULL)
-      WARNING("ZREMRANGEBYRANK command error. key:%s message:%s", key,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
-  }
+  wr_append(node, "ZADD %s %s %s", key, time, value);
 
-  if (node->max_set_duration > 0) {
-    /*
-     * remove element, scored less than 'current-max_set_duration'
-     * '(...' indicates 'less than' in redis CLI.
-     */
-    rr = redisCommand(node->conn, "ZREMRANGEBYSCORE %s -1 (%.9f", key,
-                      (CDTIME_T_TO_DOUBLE(vl->time) - node->max_set_duration));
-    if (rr == NULL)
-      WARNING("ZREMRANGEBYSCORE command error. key:%s message:%s", key,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
+  if (trim) {
+    if (node->max_set_size >= 0)
+      wr_append(node, "ZREMRANGEBYRANK %s %d %d", key, 0,
+                (-1 * node->max_set_size) - 1);
+
+    if (node->max_set_duration > 0) {
+      /*
+       * remove element, scored less than 'current-max_set_duration'
+       * '(...' indicates 'less than' in redis CLI.
+       */
+      wr_append(node, "ZREMRANGEBYSCORE %s -1 (%.9f", key,
+                (CDTIME_T_TO_DOUBLE(vl->time) - node->max_set_duration));
+    }
   }
 
-  /* TODO(octo): This is more overhead than necessary. Use the cache and
-   * metadata to determine if it is a new metric and call SADD only once for
-   * each metric. */
-  rr = redisCommand(
-      node->conn, "SADD %svalues %s",
-      (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX, ident);
-  if (rr == NULL)
-    WARNING("SADD command error. ident:%s message:%s", ident,
-            node->conn->errstr);
-  else
-    freeReplyObject(rr);
+  /* The "values" set only needs to be updated for new metrics. */
+  if (is_new)
+    wr_append(node, "SADD %svalues %s",
+              (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX,
+              ident);
+
+  node->pending_values++;
+  status = 0;
+  if ((node->pending_values >= node->batch_size) ||
+      (cdtime() - node->pending_since >= node->flush_interval))
+    status = wr_drain(node);
 
   pthread_mutex_unlock(&node->lock);
 
-  return 0;
+  return status;
 } /* }}} int wr_write */
 
+static int wr_flush(cdtime_t timeout, /* {{{ */
+                    __attribute__((unused)) const char *identifier,
+                    user_data_t *ud) {
+  wr_node_t *node = ud->data;
+  int status = 0;
+
+  pthread_mutex_lock(&node->lock);
+  if ((node->conn != NULL) && (node->pending_replies > 0) &&
+      ((timeout == 0) || (cdtime() - node->pending_since >= timeout)))
+    status = wr_drain(node);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wr_flush */
+
 static void wr_config_free(void *ptr) /* {{{ */
 {
   wr_node_t *node = ptr;
@@ -165,12 +287,14 @@ static void wr_config_free(void *ptr) /* {{{ */
   if (node == NULL)
     return;
 
-  if (node->conn != NULL) {
-    redisFree(node->conn);
-    node->conn = NULL;
-  }
+  if (node->conn != NULL)
+    wr_drain(node);
+  wr_disconnect(node);
+  if (node->keys != NULL)
+    c_avl_destroy(node->keys);
 
   sfree(node->host);
+  sfree(node->prefix);
   sfree(node);
 } /* }}} void wr_config_free */
 
@@ -193,11 +317,19 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
   node->max_set_size = -1;
   node->max_set_duration = -1;
   node->store_rates = true;
+  node->batch_size = 1;
+  node->flush_interval = TIME_T_TO_CDTIME_T(1);
+  node->trim_interval = 1;
+  node->keys = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (node->keys == NULL) {
+    sfree(node);
+    return ENOMEM;
+  }
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
   if (status != 0) {
-    sfree(node);
+    wr_config_free(node);
     return status;
   }
 
@@ -229,6 +361,20 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &node->max_set_duration);
     } else if (strcasecmp("StoreRates", child->key) == 0) {
       status = cf_util_get_boolean(child, &node->store_rates);
+    } else if (strcasecmp("BatchSize", child->key) == 0) {
+      status = cf_util_get_int(child, &node->batch_size);
+      if ((status == 0) && (node->batch_size < 1)) {
+        ERROR("write_redis plugin: BatchSize must be positive.");
+        status = -1;
+      }
+    } else if (strcasecmp("FlushInterval", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &node->flush_interval);
+    } else if (strcasecmp("TrimInterval", child->key) == 0) {
+      status = cf_util_get_int(child, &node->trim_interval);
+      if ((status == 0) && (node->trim_interval < 1)) {
+        ERROR("write_redis plugin: TrimInterval must be positive.");
+        status = -1;
+      }
     } else
       WARNING("write_redis plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -247,6 +393,8 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
                                        .data = node,
                                        .free_func = wr_config_free,
                                    });
+    if (status == 0)
+      plugin_register_flush(cb_name, wr_flush, &(user_data_t){.data = node});
   }
 
   if (status != 0)
@@ -31,6 +31,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/avltree/avltree.h"
 #include "utils/common/common.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
@@ -42,6 +43,33 @@
 #define RIEMANN_PORT 5555
 #define RIEMANN_TTL_FACTOR 2.0
 #define RIEMANN_BATCH_MAX 8192
+#define RIEMANN_MAX_QUEUED_BATCHES 64
+
+/* A message whose events may borrow host, service, tags and attributes from
+ * a template, see wrr_template_get(). */
+struct wrr_message {
+  riemann_message_t *msg;
+  bool *borrowed;
+  size_t borrowed_size;
+  struct wrr_message *next;
+};
+typedef struct wrr_message wrr_message_t;
+
+/* Events with the fields that do not change between the values of one
+ * series, one per data source. */
+struct wrr_template {
+  size_t events_num;
+  riemann_event_t **events;
+};
+typedef struct wrr_template wrr_template_t;
+
+struct wrr_connection {
+  struct riemann_host *host;
+  riemann_client_t *client;
+  pthread_mutex_t lock;
+  pthread_t thread;
+};
+typedef struct wrr_connection wrr_connection_t;
 
 struct riemann_host {
   c_complain_t init_complaint;
@@ -56,17 +84,34 @@ struct riemann_host {
   char *node;
   int port;
   riemann_client_type_t client_type;
-  riemann_client_t *client;
   double ttl_factor;
   cdtime_t batch_init;
   int batch_max;
   int batch_timeout;
   int reference_count;
-  riemann_message_t *batch_msg;
+  wrr_message_t *batch_msg;
   char *tls_ca_file;
   char *tls_cert_file;
   char *tls_key_file;
   struct timeval timeout;
+
+  /* Each connection has its own lock. In batch mode, each connection also
+   * has a sender thread, which sends the batches queued by
+   * wrr_batch_flush_nolock(). The queue is protected by "lock". */
+  wrr_connection_t *connections;
+  size_t connections_num;
+  size_t senders_num;
+  bool senders_started;
+  bool senders_loop;
+  wrr_message_t *queue_head;
+  wrr_message_t *queue_tail;
+  size_t queue_len;
+  pthread_cond_t queue_cond;
+  c_complain_t queue_complaint;
+
+  /* Maps identifiers to wrr_template_t, protected by "templates_lock". */
+  c_avl_tree_t *templates;
+  pthread_mutex_t templates_lock;
 };
 
 static char **riemann_tags;
@@ -74,26 +119,26 @@ static size_t riemann_tags_num;
 static char **riemann_attrs;
 static size_t riemann_attrs_num;
 
-/* host->lock must be held when calling this function. */
-static int wrr_connect(struct riemann_host *host) /* {{{ */
-{
+/* conn->lock must be held when calling this function. */
+static int wrr_connect(struct riemann_host *host, /* {{{ */
+                       wrr_connection_t *conn) {
   char const *node;
   int port;
 
-  if (host->client)
+  if (conn->client)
     return 0;
 
   node = (host->node != NULL) ? host->node : RIEMANN_HOST;
   port = (host->port) ? host->port : RIEMANN_PORT;
 
-  host->client = NULL;
+  conn->client = NULL;
 
-  host->client = riemann_client_create(
+  conn->client = riemann_client_create(
       host->client_type, node, port, RIEMANN_CLIENT_OPTION_TLS_CA_FILE,
       host->tls_ca_file, RIEMANN_CLIENT_OPTION_TLS_CERT_FILE,
       host->tls_cert_file, RIEMANN_CLIENT_OPTION_TLS_KEY_FILE,
       host->tls_key_file, RIEMANN_CLIENT_OPTION_NONE);
-  if (host->client == NULL) {
+  if (conn->client == NULL) {
     c_complain(LOG_ERR, &host->init_complaint,
                "write_riemann plugin: Unable to connect to Riemann at %s:%d",
                node, port);
@@ -101,9 +146,9 @@ static int wrr_connect(struct riemann_host *host) /* {{{ */
   }
 #if RCC_VERSION_NUMBER >= 0x010800
   if (host->timeout.tv_sec != 0) {
-    if (riemann_client_set_timeout(host->client, &host->timeout) != 0) {
-      riemann_client_free(host->client);
-      host->client = NULL;
+    if (riemann_client_set_timeout(conn->client, &host->timeout) != 0) {
+      riemann_client_free(conn->client);
+      conn->client = NULL;
       c_complain(LOG_ERR, &host->init_complaint,
                  "write_riemann plugin: Unable to connect to Riemann at %s:%d",
                  node, port);
@@ -112,7 +157,7 @@ static int wrr_connect(struct riemann_host *host) /* {{{ */
   }
 #endif
 
-  set_sock_opts(riemann_client_get_fd(host->client));
+  set_sock_opts(riemann_client_get_fd(conn->client));
 
   c_release(LOG_INFO, &host->init_complaint,
             "write_riemann plugin: Successfully connected to %s:%d", node,
@@ -121,14 +166,14 @@ static int wrr_connect(struct riemann_host *host) /* {{{ */
   return 0;
 } /* }}} int wrr_connect */
 
-/* host->lock must be held when calling this function. */
-static int wrr_disconnect(struct riemann_host *host) /* {{{ */
+/* conn->lock must be held when calling this function. */
+static int wrr_disconnect(wrr_connection_t *conn) /* {{{ */
 {
-  if (!host->client)
+  if (!conn->client)
     return 0;
 
-  riemann_client_free(host->client);
-  host->client = NULL;
+  riemann_client_free(conn->client);
+  conn->client = NULL;
 
   return 0;
 } /* }}} int wrr_disconnect */
@@ -136,21 +181,20 @@ static int wrr_disconnect(struct riemann_host *host) /* {{{ */
 /**
  * Function to send messages to riemann.
  *
- * Acquires the host lock, disconnects on errors.
+ * conn->lock must be held, disconnects on errors.
  */
-static int wrr_send_nolock(struct riemann_host *host,
-                           riemann_message_t *msg) /* {{{ */
-{
+static int wrr_send_nolock(struct riemann_host *host, /* {{{ */
+                           wrr_connection_t *conn, riemann_message_t *msg) {
   int status = 0;
 
-  status = wrr_connect(host);
+  status = wrr_connect(host, conn);
   if (status != 0) {
     return status;
   }
 
-  status = riemann_client_send_message(host->client, msg);
+  status = riemann_client_send_message(conn->client, msg);
   if (status != 0) {
-    wrr_disconnect(host);
+    wrr_disconnect(conn);
     return status;
   }
 
@@ -160,10 +204,10 @@ static int wrr_send_nolock(struct riemann_host *host,
   if (host->client_type != RIEMANN_CLIENT_UDP) {
     riemann_message_t *response;
 
-    response = riemann_client_recv_message(host->client);
+    response = riemann_client_recv_message(conn->client);
 
     if (response == NULL) {
-      wrr_disconnect(host);
+      wrr_disconnect(conn);
       return errno;
     }
     riemann_message_free(response);
@@ -172,15 +216,86 @@ static int wrr_send_nolock(struct riemann_host *host,
   return 0;
 } /* }}} int wrr_send */
 
+/* Sends "msg" over an idle connection, or waits for the first one. */
 static int wrr_send(struct riemann_host *host, riemann_message_t *msg) {
+  wrr_connection_t *conn = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&host->lock);
-  status = wrr_send_nolock(host, msg);
-  pthread_mutex_unlock(&host->lock);
+  for (size_t i = 0; i < host->connections_num; i++) {
+    if (pthread_mutex_trylock(&host->connections[i].lock) == 0) {
+      conn = host->connections + i;
+      break;
+    }
+  }
+  if (conn == NULL) {
+    conn = host->connections;
+    pthread_mutex_lock(&conn->lock);
+  }
+
+  status = wrr_send_nolock(host, conn, msg);
+  pthread_mutex_unlock(&conn->lock);
   return status;
 }
 
+/* Frees "m", leaving the fields borrowed from templates alone. */
+static void wrr_message_free(wrr_message_t *m) /* {{{ */
+{
+  if (m == NULL)
+    return;
+
+  for (size_t i = 0; (m->msg != NULL) && (i < m->msg->n_events); i++) {
+    riemann_event_t *event = m->msg->events[i];
+
+    if ((i >= m->borrowed_size) || !m->borrowed[i])
+      continue;
+
+    event->host = NULL;
+    event->service = NULL;
+    event->n_tags = 0;
+    event->tags = NULL;
+    event->n_attributes = 0;
+    event->attributes = NULL;
+  }
+
+  if (m->msg != NULL)
+    riemann_message_free(m->msg);
+  sfree(m->borrowed);
+  sfree(m);
+} /* }}} void wrr_message_free */
+
+/* Moves the events of "src" to the end of "dst" and frees "src". */
+static int wrr_message_append(wrr_message_t *dst, /* {{{ */
+                              wrr_message_t *src) {
+  size_t dst_num = dst->msg->n_events;
+  size_t src_num = src->msg->n_events;
+  int status;
+
+  if (dst->borrowed_size < dst_num + src_num) {
+    size_t size = 2 * (dst_num + src_num);
+    bool *tmp = realloc(dst->borrowed, size * sizeof(*tmp));
+    if (tmp == NULL)
+      return ENOMEM;
+    memset(tmp + dst->borrowed_size, 0,
+           (size - dst->borrowed_size) * sizeof(*tmp));
+    dst->borrowed = tmp;
+    dst->borrowed_size = size;
+  }
+
+  status =
+      riemann_message_append_events_n(dst->msg, src_num, src->msg->events);
+  if (status != 0)
+    return status;
+
+  for (size_t i = 0; i < src_num; i++)
+    dst->borrowed[dst_num + i] = (i < src->borrowed_size) && src->borrowed[i];
+
+  /* The events are owned by "dst" now. */
+  src->msg->n_events = 0;
+  src->msg->events = NULL;
+  wrr_message_free(src);
+  return 0;
+} /* }}} int wrr_message_append */
+
 static riemann_message_t *wrr_notification_to_message(notification_t const *n) {
   riemann_message_t *msg;
   riemann_event_t *event;
@@ -271,10 +386,12 @@ static riemann_message_t *wrr_notification_to_message(notification_t const *n) {
   return msg;
 }
 
+/* Creates an event with the fields that are the same for all values of the
+ * data source "index" of a series. */
 static riemann_event_t *
-wrr_value_to_event(struct riemann_host const *host, /* {{{ */
-                   data_set_t const *ds, value_list_t const *vl, size_t index,
-                   gauge_t const *rates, int status) {
+wrr_event_create(struct riemann_host const *host, /* {{{ */
+                 data_set_t const *ds, value_list_t const *vl, size_t index,
+                 bool rates) {
   riemann_event_t *event;
   char name_buffer[5 * DATA_MAX_NAME_LEN];
   char service_buffer[6 * DATA_MAX_NAME_LEN];
@@ -305,40 +422,11 @@ wrr_value_to_event(struct riemann_host const *host, /* {{{ */
                 host->event_service_prefix, &name_buffer[1]);
   }
 
-  riemann_event_set(
-      event, RIEMANN_EVENT_FIELD_HOST, vl->host, RIEMANN_EVENT_FIELD_TIME,
-      (int64_t)CDTIME_T_TO_TIME_T(vl->time), RIEMANN_EVENT_FIELD_TTL,
-      (float)CDTIME_T_TO_DOUBLE(vl->interval) * host->ttl_factor,
-      RIEMANN_EVENT_FIELD_STRING_ATTRIBUTES, "plugin", vl->plugin, "type",
-      vl->type, "ds_name", ds->ds[index].name, NULL,
-      RIEMANN_EVENT_FIELD_SERVICE, service_buffer, RIEMANN_EVENT_FIELD_NONE);
-
-#if RCC_VERSION_NUMBER >= 0x010A00
-  riemann_event_set(event, RIEMANN_EVENT_FIELD_TIME_MICROS,
-                    (int64_t)CDTIME_T_TO_US(vl->time));
-#endif
-
-  if (host->check_thresholds) {
-    const char *state = NULL;
-
-    switch (status) {
-    case STATE_OKAY:
-      state = "ok";
-      break;
-    case STATE_ERROR:
-      state = "critical";
-      break;
-    case STATE_WARNING:
-      state = "warning";
-      break;
-    case STATE_MISSING:
-      state = "unknown";
-      break;
-    }
-    if (state)
-      riemann_event_set(event, RIEMANN_EVENT_FIELD_STATE, state,
-                        RIEMANN_EVENT_FIELD_NONE);
-  }
+  riemann_event_set(event, RIEMANN_EVENT_FIELD_HOST, vl->host,
+                    RIEMANN_EVENT_FIELD_STRING_ATTRIBUTES, "plugin",
+                    vl->plugin, "type", vl->type, "ds_name",
+                    ds->ds[index].name, NULL, RIEMANN_EVENT_FIELD_SERVICE,
+                    service_buffer, RIEMANN_EVENT_FIELD_NONE);
 
   if (vl->plugin_instance[0] != 0)
     riemann_event_string_attribute_add(event, "plugin_instance",
@@ -347,7 +435,7 @@ wrr_value_to_event(struct riemann_host const *host, /* {{{ */
     riemann_event_string_attribute_add(event, "type_instance",
                                        vl->type_instance);
 
-  if ((ds->ds[index].type != DS_TYPE_GAUGE) && (rates != NULL)) {
+  if ((ds->ds[index].type != DS_TYPE_GAUGE) && rates) {
     char ds_type[DATA_MAX_NAME_LEN];
 
     ssnprintf(ds_type, sizeof(ds_type), "%s:rate",
@@ -372,6 +460,47 @@ wrr_value_to_event(struct riemann_host const *host, /* {{{ */
   for (i = 0; i < riemann_tags_num; i++)
     riemann_event_tag_add(event, riemann_tags[i]);
 
+  return event;
+} /* }}} riemann_event_t *wrr_event_create */
+
+/* Sets the fields that change with every value. */
+static void wrr_event_set_value(struct riemann_host const *host, /* {{{ */
+                                riemann_event_t *event, data_set_t const *ds,
+                                value_list_t const *vl, size_t index,
+                                gauge_t const *rates, int status) {
+  riemann_event_set(
+      event, RIEMANN_EVENT_FIELD_TIME, (int64_t)CDTIME_T_TO_TIME_T(vl->time),
+      RIEMANN_EVENT_FIELD_TTL,
+      (float)CDTIME_T_TO_DOUBLE(vl->interval) * host->ttl_factor,
+      RIEMANN_EVENT_FIELD_NONE);
+
+#if RCC_VERSION_NUMBER >= 0x010A00
+  riemann_event_set(event, RIEMANN_EVENT_FIELD_TIME_MICROS,
+                    (int64_t)CDTIME_T_TO_US(vl->time));
+#endif
+
+  if (host->check_thresholds) {
+    const char *state = NULL;
+
+    switch (status) {
+    case STATE_OKAY:
+      state = "ok";
+      break;
+    case STATE_ERROR:
+      state = "critical";
+      break;
+    case STATE_WARNING:
+      state = "warning";
+      break;
+    case STATE_MISSING:
+      state = "unknown";
+      break;
+    }
+    if (state)
+      riemann_event_set(event, RIEMANN_EVENT_FIELD_STATE, state,
+                        RIEMANN_EVENT_FIELD_NONE);
+  }
+
   if (ds->ds[index].type == DS_TYPE_GAUGE) {
     riemann_event_set(event, RIEMANN_EVENT_FIELD_METRIC_D,
                       (double)vl->values[index].gauge,
@@ -392,6 +521,99 @@ wrr_value_to_event(struct riemann_host const *host, /* {{{ */
     riemann_event_set(event, RIEMANN_EVENT_FIELD_METRIC_S64, (int64_t)metric,
                       RIEMANN_EVENT_FIELD_NONE);
   }
+} /* }}} void wrr_event_set_value */
+
+static void wrr_template_free(wrr_template_t *t) /* {{{ */
+{
+  if (t == NULL)
+    return;
+
+  for (size_t i = 0; i < t->events_num; i++)
+    if (t->events[i] != NULL)
+      riemann_event_free(t->events[i]);
+  sfree(t->events);
+  sfree(t);
+} /* }}} void wrr_template_free */
+
+/* Returns the template of the series "vl", creating it the first time the
+ * series is written. Templates are never modified once created and live as
+ * long as "host", so that events can borrow their fields. */
+static wrr_template_t *wrr_template_get(struct riemann_host *host, /* {{{ */
+                                        data_set_t const *ds,
+                                        value_list_t const *vl) {
+  char identifier[6 * DATA_MAX_NAME_LEN];
+  wrr_template_t *t = NULL;
+
+  if (FORMAT_VL(identifier, sizeof(identifier), vl) != 0)
+    return NULL;
+
+  pthread_mutex_lock(&host->templates_lock);
+
+  if (c_avl_get(host->templates, identifier, (void *)&t) == 0) {
+    pthread_mutex_unlock(&host->templates_lock);
+    return (t->events_num == ds->ds_num) ? t : NULL;
+  }
+
+  char *key = strdup(identifier);
+  t = calloc(1, sizeof(*t));
+  if ((key == NULL) || (t == NULL) ||
+      ((t->events = calloc(ds->ds_num, sizeof(*t->events))) == NULL)) {
+    pthread_mutex_unlock(&host->templates_lock);
+    sfree(key);
+    sfree(t);
+    return NULL;
+  }
+  t->events_num = ds->ds_num;
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    t->events[i] = wrr_event_create(host, ds, vl, i, host->store_rates);
+    if (t->events[i] == NULL) {
+      pthread_mutex_unlock(&host->templates_lock);
+      sfree(key);
+      wrr_template_free(t);
+      return NULL;
+    }
+  }
+
+  if (c_avl_insert(host->templates, key, t) != 0) {
+    pthread_mutex_unlock(&host->templates_lock);
+    sfree(key);
+    wrr_template_free(t);
+    return NULL;
+  }
+
+  pthread_mutex_unlock(&host->templates_lock);
+  return t;
+} /* }}} wrr_template_t *wrr_template_get */
+
+static riemann_event_t *
+wrr_value_to_event(struct riemann_host const *host, /* {{{ */
+                   data_set_t const *ds, value_list_t const *vl, size_t index,
+                   gauge_t const *rates, int status,
+                   riemann_event_t const *template) {
+  riemann_event_t *event;
+
+  if (template != NULL) {
+    event = riemann_event_new();
+    if (event == NULL) {
+      ERROR("write_riemann plugin: riemann_event_new() failed.");
+      return NULL;
+    }
+
+    /* Borrowed, see wrr_message_free(). */
+    event->host = template->host;
+    event->service = template->service;
+    event->n_tags = template->n_tags;
+    event->tags = template->tags;
+    event->n_attributes = template->n_attributes;
+    event->attributes = template->attributes;
+  } else {
+    event = wrr_event_create(host, ds, vl, index, rates != NULL);
+    if (event == NULL)
+      return NULL;
+  }
+
+  wrr_event_set_value(host, event, ds, vl, index, rates, status);
 
   if (vl->meta) {
     char **toc;
@@ -417,45 +639,124 @@ wrr_value_to_event(struct riemann_host const *host, /* {{{ */
   return event;
 } /* }}} riemann_event_t *wrr_value_to_event */
 
-static riemann_message_t *
-wrr_value_list_to_message(struct riemann_host const *host, /* {{{ */
+static wrr_message_t *
+wrr_value_list_to_message(struct riemann_host *host, /* {{{ */
                           data_set_t const *ds, value_list_t const *vl,
                           int *statuses) {
-  riemann_message_t *msg;
+  wrr_message_t *m;
+  wrr_template_t *t = NULL;
   size_t i;
   gauge_t *rates = NULL;
 
   /* Initialize the Msg structure. */
-  msg = riemann_message_new();
-  if (msg == NULL) {
+  m = calloc(1, sizeof(*m));
+  if (m == NULL) {
+    ERROR("write_riemann plugin: calloc failed.");
+    return NULL;
+  }
+  m->msg = riemann_message_new();
+  m->borrowed = calloc(vl->values_len, sizeof(*m->borrowed));
+  if ((m->msg == NULL) || (m->borrowed == NULL)) {
     ERROR("write_riemann plugin: riemann_message_new failed.");
+    wrr_message_free(m);
     return NULL;
   }
+  m->borrowed_size = vl->values_len;
 
   if (host->store_rates) {
     rates = uc_get_rate(ds, vl);
     if (rates == NULL) {
       ERROR("write_riemann plugin: uc_get_rate failed.");
-      riemann_message_free(msg);
+      wrr_message_free(m);
       return NULL;
     }
   }
 
+  /* Meta data adds attributes to the event, which can therefore not be
+   * borrowed. */
+  if (vl->meta == NULL)
+    t = wrr_template_get(host, ds, vl);
+
   for (i = 0; i < vl->values_len; i++) {
     riemann_event_t *event;
 
-    event = wrr_value_to_event(host, ds, vl, (int)i, rates, statuses[i]);
+    event = wrr_value_to_event(host, ds, vl, i, rates, statuses[i],
+                               (t != NULL) ? t->events[i] : NULL);
     if (event == NULL) {
-      riemann_message_free(msg);
+      wrr_message_free(m);
       sfree(rates);
       return NULL;
     }
-    riemann_message_append_events(msg, event, NULL);
+    riemann_message_append_events(m->msg, event, NULL);
+    m->borrowed[i] = (t != NULL);
   }
 
   sfree(rates);
-  return msg;
-} /* }}} riemann_message_t *wrr_value_list_to_message */
+  return m;
+} /* }}} wrr_message_t *wrr_value_list_to_message */
+
+static void *wrr_sender_thread(void *arg) /* {{{ */
+{
+  wrr_connection_t *conn = arg;
+  struct riemann_host *host = conn->host;
+
+  pthread_mutex_lock(&host->lock);
+
+  while (host->senders_loop || (host->queue_head != NULL)) {
+    if (host->queue_head == NULL) {
+      pthread_cond_wait(&host->queue_cond, &host->lock);
+      continue;
+    }
+
+    wrr_message_t *m = host->queue_head;
+    host->queue_head = m->next;
+    if (host->queue_head == NULL)
+      host->queue_tail = NULL;
+    host->queue_len--;
+    pthread_mutex_unlock(&host->lock);
+
+    pthread_mutex_lock(&conn->lock);
+    int status = wrr_send_nolock(host, conn, m->msg);
+    pthread_mutex_unlock(&conn->lock);
+    wrr_message_free(m);
+
+    pthread_mutex_lock(&host->lock);
+    if (status != 0)
+      c_complain(
+          LOG_ERR, &host->init_complaint,
+          "write_riemann plugin: riemann_client_send failed with status %i",
+          status);
+    else
+      c_release(LOG_DEBUG, &host->init_complaint,
+                "write_riemann plugin: batch sent.");
+  }
+
+  pthread_mutex_unlock(&host->lock);
+  return NULL;
+} /* }}} void *wrr_sender_thread */
+
+/* Starts one sender thread per connection. Threads are started on the first
+ * flush rather than during configuration, i.e. after the daemon has forked.
+ * Always call while holding host->lock ! */
+static void wrr_senders_start(struct riemann_host *host) /* {{{ */
+{
+  if (host->senders_started)
+    return;
+  host->senders_started = true;
+  host->senders_loop = true;
+
+  for (size_t i = 0; i < host->connections_num; i++) {
+    wrr_connection_t *conn = host->connections + i;
+    int status = plugin_thread_create(&conn->thread, wrr_sender_thread, conn,
+                                      "write_riemann send");
+    if (status != 0) {
+      ERROR("write_riemann plugin: Starting sender thread failed: %s",
+            STRERROR(status));
+      break;
+    }
+    host->senders_num++;
+  }
+} /* }}} void wrr_senders_start */
 
 /*
  * Always call while holding host->lock !
@@ -470,11 +771,45 @@ static int wrr_batch_flush_nolock(cdtime_t timeout, struct riemann_host *host) {
       return status;
     }
   }
-  wrr_send_nolock(host, host->batch_msg);
-  riemann_message_free(host->batch_msg);
 
+  wrr_message_t *m = host->batch_msg;
   host->batch_init = now;
   host->batch_msg = NULL;
+  if (m == NULL)
+    return status;
+
+  wrr_senders_start(host);
+  if (host->senders_num == 0) {
+    pthread_mutex_lock(&host->connections[0].lock);
+    status = wrr_send_nolock(host, host->connections, m->msg);
+    pthread_mutex_unlock(&host->connections[0].lock);
+    wrr_message_free(m);
+    return status;
+  }
+
+  /* The batch is sent by a sender thread, so that writers do not wait for
+   * Riemann's acknowledgement. */
+  if (host->queue_len >= RIEMANN_MAX_QUEUED_BATCHES) {
+    c_complain(LOG_WARNING, &host->queue_complaint,
+               "write_riemann plugin: %" PRIsz " batches are waiting to be "
+               "sent to \"%s\", dropping values. Consider increasing "
+               "\"Connections\".",
+               host->queue_len, host->name);
+    wrr_message_free(m);
+    return -1;
+  }
+  c_release(LOG_INFO, &host->queue_complaint,
+            "write_riemann plugin: Batches are sent to \"%s\" again.",
+            host->name);
+
+  if (host->queue_tail == NULL)
+    host->queue_head = m;
+  else
+    host->queue_tail->next = m;
+  host->queue_tail = m;
+  host->queue_len++;
+  pthread_cond_signal(&host->queue_cond);
+
   return status;
 }
 
@@ -490,15 +825,6 @@ static int wrr_batch_flush(cdtime_t timeout,
   host = user_data->data;
   pthread_mutex_lock(&host->lock);
   status = wrr_batch_flush_nolock(timeout, host);
-  if (status != 0)
-    c_complain(
-        LOG_ERR, &host->init_complaint,
-        "write_riemann plugin: riemann_client_send failed with status %i",
-        status);
-  else
-    c_release(LOG_DEBUG, &host->init_complaint,
-              "write_riemann plugin: batch sent.");
-
   pthread_mutex_unlock(&host->lock);
   return status;
 }
@@ -506,37 +832,32 @@ static int wrr_batch_flush(cdtime_t timeout,
 static int wrr_batch_add_value_list(struct riemann_host *host, /* {{{ */
                                     data_set_t const *ds,
                                     value_list_t const *vl, int *statuses) {
-  riemann_message_t *msg;
+  wrr_message_t *m;
   size_t len;
   int ret;
   cdtime_t timeout;
 
-  msg = wrr_value_list_to_message(host, ds, vl, statuses);
-  if (msg == NULL)
+  m = wrr_value_list_to_message(host, ds, vl, statuses);
+  if (m == NULL)
     return -1;
 
   pthread_mutex_lock(&host->lock);
 
   if (host->batch_msg == NULL) {
-    host->batch_msg = msg;
+    host->batch_msg = m;
   } else {
     int status;
 
-    status = riemann_message_append_events_n(host->batch_msg, msg->n_events,
-                                             msg->events);
-    msg->n_events = 0;
-    msg->events = NULL;
-
-    riemann_message_free(msg);
-
+    status = wrr_message_append(host->batch_msg, m);
     if (status != 0) {
       pthread_mutex_unlock(&host->lock);
+      wrr_message_free(m);
       ERROR("write_riemann plugin: out of memory");
       return -1;
     }
   }
 
-  len = riemann_message_get_packed_size(host->batch_msg);
+  len = riemann_message_get_packed_size(host->batch_msg->msg);
   ret = 0;
   if ((host->batch_max < 0) || (((size_t)host->batch_max) <= len)) {
     ret = wrr_batch_flush_nolock(0, host);
@@ -586,7 +907,7 @@ static int wrr_write(const data_set_t *ds, /* {{{ */
   int status = 0;
   int statuses[vl->values_len];
   struct riemann_host *host = ud->data;
-  riemann_message_t *msg;
+  wrr_message_t *m;
 
   if (host->check_thresholds) {
     status = write_riemann_threshold_check(ds, vl, statuses);
@@ -599,13 +920,13 @@ static int wrr_write(const data_set_t *ds, /* {{{ */
   if (host->client_type != RIEMANN_CLIENT_UDP && host->batch_mode) {
     wrr_batch_add_value_list(host, ds, vl, statuses);
   } else {
-    msg = wrr_value_list_to_message(host, ds, vl, statuses);
-    if (msg == NULL)
+    m = wrr_value_list_to_message(host, ds, vl, statuses);
+    if (m == NULL)
       return -1;
 
-    status = wrr_send(host, msg);
+    status = wrr_send(host, m->msg);
 
-    riemann_message_free(msg);
+    wrr_message_free(m);
   }
   return status;
 } /* }}} int wrr_write */
@@ -625,9 +946,41 @@ static void wrr_free(void *p) /* {{{ */
     return;
   }
 
-  wrr_disconnect(host);
+  /* Sender threads send the queued batches before exiting. */
+  host->senders_loop = false;
+  pthread_cond_broadcast(&host->queue_cond);
+  pthread_mutex_unlock(&host->lock);
 
-  pthread_mutex_lock(&host->lock);
+  for (size_t i = 0; i < host->senders_num; i++)
+    pthread_join(host->connections[i].thread, NULL);
+
+  for (size_t i = 0; (host->connections != NULL) && (i < host->connections_num);
+       i++) {
+    wrr_disconnect(host->connections + i);
+    pthread_mutex_destroy(&host->connections[i].lock);
+  }
+  sfree(host->connections);
+
+  while (host->queue_head != NULL) {
+    wrr_message_t *m = host->queue_head;
+    host->queue_head = m->next;
+    wrr_message_free(m);
+  }
+  wrr_message_free(host->batch_msg);
+
+  /* Templates last, events of queued messages borrow from them. */
+  if (host->templates != NULL) {
+    void *key;
+    void *value;
+    while (c_avl_pick(host->templates, &key, &value) == 0) {
+      sfree(key);
+      wrr_template_free(value);
+    }
+    c_avl_destroy(host->templates);
+  }
+
+  pthread_cond_destroy(&host->queue_cond);
+  pthread_mutex_destroy(&host->templates_lock);
   pthread_mutex_destroy(&host->lock);
   sfree(host);
 } /* }}} void wrr_free */
@@ -645,7 +998,10 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
     return ENOMEM;
   }
   pthread_mutex_init(&host->lock, NULL);
+  pthread_mutex_init(&host->templates_lock, NULL);
+  pthread_cond_init(&host->queue_cond, NULL);
   C_COMPLAIN_INIT(&host->init_complaint);
+  C_COMPLAIN_INIT(&host->queue_complaint);
   host->reference_count = 1;
   host->node = NULL;
   host->port = 0;
@@ -658,7 +1014,7 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
   host->batch_init = cdtime();
   host->batch_timeout = 0;
   host->ttl_factor = RIEMANN_TTL_FACTOR;
-  host->client = NULL;
+  host->connections_num = 1;
   host->client_type = RIEMANN_CLIENT_TCP;
   host->timeout.tv_sec = 0;
   host->timeout.tv_usec = 0;
@@ -706,6 +1062,17 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &host->batch_timeout);
       if (status != 0)
         break;
+    } else if (strcasecmp("Connections", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if (status != 0)
+        break;
+      if (tmp < 1) {
+        ERROR("write_riemann plugin: Connections must be positive.");
+        status = -1;
+        break;
+      }
+      host->connections_num = (size_t)tmp;
     } else if (strcasecmp("Timeout", child->key) == 0) {
 #if RCC_VERSION_NUMBER >= 0x010800
       status = cf_util_get_int(child, (int *)&host->timeout.tv_sec);
@@ -796,6 +1163,18 @@ static int wrr_config_node(oconfig_item_t *ci) /* {{{ */
     return status;
   }
 
+  host->connections = calloc(host->connections_num, sizeof(*host->connections));
+  host->templates = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if ((host->connections == NULL) || (host->templates == NULL)) {
+    ERROR("write_riemann plugin: calloc failed.");
+    wrr_free(host);
+    return ENOMEM;
+  }
+  for (size_t j = 0; j < host->connections_num; j++) {
+    host->connections[j].host = host;
+    pthread_mutex_init(&host->connections[j].lock, NULL);
+  }
+
   ssnprintf(callback_name, sizeof(callback_name), "write_riemann/%s",
             host->name);
 
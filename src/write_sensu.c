@@ -29,6 +29,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/async_sender/async_sender.h"
 #include "utils/common/common.h"
 #include "utils_cache.h"
 #include <arpa/inet.h>
@@ -41,6 +42,10 @@
 #define SENSU_HOST "localhost"
 #define SENSU_PORT "3030"
 
+/* Events of one value list or notification are collected in a buffer of this
+ * size before they are handed to the sender thread. */
+#define SENSU_SEND_BUF_SIZE 8192
+
 #ifdef HAVE_ASPRINTF
 #define my_asprintf asprintf
 #define my_vasprintf vasprintf
@@ -118,11 +123,25 @@ struct sensu_host {
   int s;
   struct addrinfo *res;
   int reference_count;
+
+  /* Beginning of every metric event, including the handlers. */
+  char *metric_prefix;
+
+  /* With "SendQueueLength", events are collected in send_buf and handed to a
+   * sender thread which keeps the connection open. Otherwise every event is
+   * sent on a new connection. */
+  int send_queue_length;
+  bool report_stats;
+  async_sender_t *sender;
+  char send_buf[SENSU_SEND_BUF_SIZE];
+  size_t send_buf_fill;
 };
 
 static char *sensu_tags;
 static char **sensu_attrs;
 static size_t sensu_attrs_num;
+/* Attributes and tags, formatted as JSON members for all events. */
+static char *sensu_attrs_json;
 
 static int add_str_to_list(struct str_list *strs,
                            const char *str_to_add) /* {{{ */
@@ -336,154 +355,151 @@ static void in_place_replace_sensu_name_reserved(char *orig_name) /* {{{ */
   }
 } /* }}} char *replace_sensu_name_reserved */
 
-static char *sensu_value_to_json(struct sensu_host const *host, /* {{{ */
-                                 data_set_t const *ds, value_list_t const *vl,
-                                 size_t index, gauge_t const *rates) {
-  char name_buffer[5 * DATA_MAX_NAME_LEN];
-  char service_buffer[6 * DATA_MAX_NAME_LEN];
+/* Formats the members that are the same for all data sources of a value
+ * list: source, plugin, type and instances. */
+static char *sensu_value_list_to_json(struct sensu_host const *host, /* {{{ */
+                                      value_list_t const *vl) {
+  char source[DATA_MAX_NAME_LEN + 16] = "";
+  char plugin_instance[DATA_MAX_NAME_LEN + 32] = "";
+  char type_instance[DATA_MAX_NAME_LEN + 40] = "";
   char *ret_str;
-  char *temp_str;
-  char *value_str;
-  int res;
-  // First part of the JSON string
-  const char *part1 = "{\"name\": \"collectd\", \"type\": \"metric\"";
 
-  char *handlers_str =
-      build_json_str_list("handlers", &(host->metric_handlers));
-  if (handlers_str == NULL) {
+  if (host->include_source)
+    snprintf(source, sizeof(source), ", \"source\": \"%s\"", vl->host);
+  if (vl->plugin_instance[0] != 0)
+    snprintf(plugin_instance, sizeof(plugin_instance),
+             ", \"collectd_plugin_instance\": \"%s\"", vl->plugin_instance);
+  if (vl->type_instance[0] != 0)
+    snprintf(type_instance, sizeof(type_instance),
+             ", \"collectd_plugin_type_instance\": \"%s\"",
+             vl->type_instance);
+
+  if (my_asprintf(&ret_str,
+                  "%s, \"collectd_plugin\": \"%s\""
+                  ", \"collectd_plugin_type\": \"%s\"%s%s",
+                  source, vl->plugin, vl->type, plugin_instance,
+                  type_instance) == -1) {
     ERROR("write_sensu plugin: Unable to alloc memory");
     return NULL;
   }
+  return ret_str;
+} /* }}} char *sensu_value_list_to_json */
 
-  // incorporate the handlers
-  if (strlen(handlers_str) == 0) {
-    free(handlers_str);
-    ret_str = strdup(part1);
-    if (ret_str == NULL) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
+/* Formats the event of one data source. "vl_json" and "name" are the output
+ * of sensu_value_list_to_json() and sensu_format_name2(), which are shared by
+ * all data sources of "vl". */
+static char *sensu_value_to_json(struct sensu_host const *host, /* {{{ */
+                                 data_set_t const *ds, value_list_t const *vl,
+                                 size_t index, gauge_t const *rates,
+                                 char const *vl_json, char const *name) {
+  char service_buffer[6 * DATA_MAX_NAME_LEN];
+  char ds_type[DATA_MAX_NAME_LEN];
+  char value_str[DATA_MAX_NAME_LEN];
+  char *ret_str;
+
+  // incorporate the data source type
+  if ((ds->ds[index].type != DS_TYPE_GAUGE) && (rates != NULL))
+    snprintf(ds_type, sizeof(ds_type), "%s:rate",
+             DS_TYPE_TO_STRING(ds->ds[index].type));
+  else
+    sstrncpy(ds_type, DS_TYPE_TO_STRING(ds->ds[index].type), sizeof(ds_type));
+
+  // calculate the value and set to a string
+  if (ds->ds[index].type == DS_TYPE_GAUGE)
+    snprintf(value_str, sizeof(value_str), GAUGE_FORMAT,
+             vl->values[index].gauge);
+  else if (rates != NULL)
+    snprintf(value_str, sizeof(value_str), GAUGE_FORMAT, rates[index]);
+  else if (ds->ds[index].type == DS_TYPE_DERIVE)
+    snprintf(value_str, sizeof(value_str), "%" PRIi64,
+             vl->values[index].derive);
+  else if (ds->ds[index].type == DS_TYPE_ABSOLUTE)
+    snprintf(value_str, sizeof(value_str), "%" PRIu64,
+             vl->values[index].absolute);
+  else
+    snprintf(value_str, sizeof(value_str), "%" PRIu64,
+             (uint64_t)vl->values[index].counter);
+
+  // Generate the full service name
+  if (host->always_append_ds || (ds->ds_num > 1)) {
+    if (host->event_service_prefix == NULL)
+      snprintf(service_buffer, sizeof(service_buffer), "%s.%s", name,
+               ds->ds[index].name);
+    else
+      snprintf(service_buffer, sizeof(service_buffer), "%s%s.%s",
+               host->event_service_prefix, name, ds->ds[index].name);
   } else {
-    res = my_asprintf(&ret_str, "%s, %s", part1, handlers_str);
-    free(handlers_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
+    if (host->event_service_prefix == NULL)
+      sstrncpy(service_buffer, name, sizeof(service_buffer));
+    else
+      snprintf(service_buffer, sizeof(service_buffer), "%s%s",
+               host->event_service_prefix, name);
   }
 
-  if (host->include_source) {
-    res = my_asprintf(&temp_str, "%s, \"source\": \"%s\"", ret_str, vl->host);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  // Replace collectd sensor name reserved characters so that time series DB is
+  // happy
+  in_place_replace_sensu_name_reserved(service_buffer);
 
-  // incorporate the plugin name information
-  res = my_asprintf(&temp_str, "%s, \"collectd_plugin\": \"%s\"", ret_str,
-                    vl->plugin);
-  free(ret_str);
-  if (res == -1) {
+  if (my_asprintf(&ret_str,
+                  "%s%s, \"collectd_data_source_type\": \"%s\""
+                  ", \"collectd_data_source_name\": \"%s\""
+                  ", \"collectd_data_source_index\": %" PRIsz
+                  "%s, \"output\": \"%s %s %lld\"}\n",
+                  host->metric_prefix, vl_json, ds_type, ds->ds[index].name,
+                  index, (sensu_attrs_json != NULL) ? sensu_attrs_json : "",
+                  service_buffer, value_str,
+                  (long long)CDTIME_T_TO_TIME_T(vl->time)) == -1) {
     ERROR("write_sensu plugin: Unable to alloc memory");
     return NULL;
   }
-  ret_str = temp_str;
 
-  // incorporate the plugin type
-  res = my_asprintf(&temp_str, "%s, \"collectd_plugin_type\": \"%s\"", ret_str,
-                    vl->type);
-  free(ret_str);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    return NULL;
-  }
-  ret_str = temp_str;
+  DEBUG("write_sensu plugin: Successfully created json for metric: "
+        "host = \"%s\", service = \"%s\"",
+        vl->host, service_buffer);
+  return ret_str;
+} /* }}} char *sensu_value_to_json */
 
-  // incorporate the plugin instance if any
-  if (vl->plugin_instance[0] != 0) {
-    res = my_asprintf(&temp_str, "%s, \"collectd_plugin_instance\": \"%s\"",
-                      ret_str, vl->plugin_instance);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+/* Formats the beginning of all metric events of "host". */
+static char *sensu_metric_prefix(struct sensu_host const *host) /* {{{ */
+{
+  // First part of the JSON string
+  const char *part1 = "{\"name\": \"collectd\", \"type\": \"metric\"";
+  char *ret_str;
 
-  // incorporate the plugin type instance if any
-  if (vl->type_instance[0] != 0) {
-    res =
-        my_asprintf(&temp_str, "%s, \"collectd_plugin_type_instance\": \"%s\"",
-                    ret_str, vl->type_instance);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  if (host->metric_handlers.nb_strs == 0)
+    return strdup(part1);
 
-  // incorporate the data source type
-  if ((ds->ds[index].type != DS_TYPE_GAUGE) && (rates != NULL)) {
-    char ds_type[DATA_MAX_NAME_LEN];
-    snprintf(ds_type, sizeof(ds_type), "%s:rate",
-             DS_TYPE_TO_STRING(ds->ds[index].type));
-    res = my_asprintf(&temp_str, "%s, \"collectd_data_source_type\": \"%s\"",
-                      ret_str, ds_type);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  } else {
-    res = my_asprintf(&temp_str, "%s, \"collectd_data_source_type\": \"%s\"",
-                      ret_str, DS_TYPE_TO_STRING(ds->ds[index].type));
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+  char *handlers_str =
+      build_json_str_list("handlers", &(host->metric_handlers));
+  if (handlers_str == NULL)
+    return NULL;
 
-  // incorporate the data source name
-  res = my_asprintf(&temp_str, "%s, \"collectd_data_source_name\": \"%s\"",
-                    ret_str, ds->ds[index].name);
-  free(ret_str);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
+  // incorporate the handlers
+  int res = my_asprintf(&ret_str, "%s, %s", part1, handlers_str);
+  free(handlers_str);
+  if (res == -1)
     return NULL;
-  }
-  ret_str = temp_str;
+  return ret_str;
+} /* }}} char *sensu_metric_prefix */
 
-  // incorporate the data source index
-  {
-    char ds_index[DATA_MAX_NAME_LEN];
-    snprintf(ds_index, sizeof(ds_index), "%" PRIsz, index);
-    res = my_asprintf(&temp_str, "%s, \"collectd_data_source_index\": %s",
-                      ret_str, ds_index);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
+/* Formats the configured attributes and tags, which are appended to all
+ * events. */
+static char *sensu_attrs_to_json(void) /* {{{ */
+{
+  char *ret_str = strdup("");
+  char *temp_str;
+  int res;
+
+  if (ret_str == NULL)
+    return NULL;
 
   // add key value attributes from config if any
   for (size_t i = 0; i < sensu_attrs_num; i += 2) {
     res = my_asprintf(&temp_str, "%s, \"%s\": \"%s\"", ret_str, sensu_attrs[i],
                       sensu_attrs[i + 1]);
     free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
+    if (res == -1)
       return NULL;
-    }
     ret_str = temp_str;
   }
 
@@ -491,94 +507,13 @@ static char *sensu_value_to_json(struct sensu_host const *host, /* {{{ */
   if ((sensu_tags != NULL) && (strlen(sensu_tags) != 0)) {
     res = my_asprintf(&temp_str, "%s, %s", ret_str, sensu_tags);
     free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
+    if (res == -1)
       return NULL;
-    }
     ret_str = temp_str;
   }
 
-  // calculate the value and set to a string
-  if (ds->ds[index].type == DS_TYPE_GAUGE) {
-    res = my_asprintf(&value_str, GAUGE_FORMAT, vl->values[index].gauge);
-    if (res == -1) {
-      free(ret_str);
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-  } else if (rates != NULL) {
-    res = my_asprintf(&value_str, GAUGE_FORMAT, rates[index]);
-    if (res == -1) {
-      free(ret_str);
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-  } else {
-    if (ds->ds[index].type == DS_TYPE_DERIVE) {
-      res = my_asprintf(&value_str, "%" PRIi64, vl->values[index].derive);
-      if (res == -1) {
-        free(ret_str);
-        ERROR("write_sensu plugin: Unable to alloc memory");
-        return NULL;
-      }
-    } else if (ds->ds[index].type == DS_TYPE_ABSOLUTE) {
-      res = my_asprintf(&value_str, "%" PRIu64, vl->values[index].absolute);
-      if (res == -1) {
-        free(ret_str);
-        ERROR("write_sensu plugin: Unable to alloc memory");
-        return NULL;
-      }
-    } else {
-      res = my_asprintf(&value_str, "%" PRIu64,
-                        (uint64_t)vl->values[index].counter);
-      if (res == -1) {
-        free(ret_str);
-        ERROR("write_sensu plugin: Unable to alloc memory");
-        return NULL;
-      }
-    }
-  }
-
-  // Generate the full service name
-  sensu_format_name2(name_buffer, sizeof(name_buffer), vl->host, vl->plugin,
-                     vl->plugin_instance, vl->type, vl->type_instance,
-                     host->separator);
-  if (host->always_append_ds || (ds->ds_num > 1)) {
-    if (host->event_service_prefix == NULL)
-      snprintf(service_buffer, sizeof(service_buffer), "%s.%s", name_buffer,
-               ds->ds[index].name);
-    else
-      snprintf(service_buffer, sizeof(service_buffer), "%s%s.%s",
-               host->event_service_prefix, name_buffer, ds->ds[index].name);
-  } else {
-    if (host->event_service_prefix == NULL)
-      sstrncpy(service_buffer, name_buffer, sizeof(service_buffer));
-    else
-      snprintf(service_buffer, sizeof(service_buffer), "%s%s",
-               host->event_service_prefix, name_buffer);
-  }
-
-  // Replace collectd sensor name reserved characters so that time series DB is
-  // happy
-  in_place_replace_sensu_name_reserved(service_buffer);
-
-  // finalize the buffer by setting the output and closing curly bracket
-  res = my_asprintf(&temp_str, "%s, \"output\": \"%s %s %lld\"}\n", ret_str,
-                    service_buffer, value_str,
-                    (long long)CDTIME_T_TO_TIME_T(vl->time));
-  free(ret_str);
-  free(value_str);
-  if (res == -1) {
-    ERROR("write_sensu plugin: Unable to alloc memory");
-    return NULL;
-  }
-  ret_str = temp_str;
-
-  DEBUG("write_sensu plugin: Successfully created json for metric: "
-        "host = \"%s\", service = \"%s\"",
-        vl->host, service_buffer);
   return ret_str;
-} /* }}} char *sensu_value_to_json */
+} /* }}} char *sensu_attrs_to_json */
 
 /*
  * Uses replace_str2() implementation from
@@ -671,7 +606,6 @@ static char *sensu_notification_to_json(struct sensu_host *host, /* {{{ */
   char *ret_str;
   char *temp_str;
   int status;
-  size_t i;
   int res;
   // add the severity/status
   switch (n->severity) {
@@ -788,21 +722,9 @@ static char *sensu_notification_to_json(struct sensu_host *host, /* {{{ */
     ret_str = temp_str;
   }
 
-  // add key value attributes from config if any
-  for (i = 0; i < sensu_attrs_num; i += 2) {
-    res = my_asprintf(&temp_str, "%s, \"%s\": \"%s\"", ret_str, sensu_attrs[i],
-                      sensu_attrs[i + 1]);
-    free(ret_str);
-    if (res == -1) {
-      ERROR("write_sensu plugin: Unable to alloc memory");
-      return NULL;
-    }
-    ret_str = temp_str;
-  }
-
-  // incorporate sensu tags from config if any
-  if ((sensu_tags != NULL) && (strlen(sensu_tags) != 0)) {
-    res = my_asprintf(&temp_str, "%s, %s", ret_str, sensu_tags);
+  // add key value attributes and sensu tags from config if any
+  if ((sensu_attrs_json != NULL) && (sensu_attrs_json[0] != 0)) {
+    res = my_asprintf(&temp_str, "%s%s", ret_str, sensu_attrs_json);
     free(ret_str);
     if (res == -1) {
       ERROR("write_sensu plugin: Unable to alloc memory");
@@ -909,10 +831,44 @@ static int sensu_send_msg(struct sensu_host *host, const char *msg) /* {{{ */
   return 0;
 } /* }}} int sensu_send_msg */
 
+/* Hands the collected events to the sender thread.
+ * NOTE: You must hold host->lock when calling this function! */
+static int sensu_flush_buffer(struct sensu_host *host) /* {{{ */
+{
+  if (host->send_buf_fill == 0)
+    return 0;
+
+  int status =
+      async_sender_enqueue(host->sender, host->send_buf, host->send_buf_fill);
+  host->send_buf_fill = 0;
+
+  /* The sender complains about full queues itself. */
+  return (status == ENOBUFS) ? 0 : status;
+} /* }}} int sensu_flush_buffer */
+
+/* NOTE: You must hold host->lock when calling this function! */
 static int sensu_send(struct sensu_host *host, char const *msg) /* {{{ */
 {
   int status = 0;
 
+  if (host->sender != NULL) {
+    size_t msg_len = strlen(msg);
+    if (msg_len > sizeof(host->send_buf)) {
+      ERROR("write_sensu plugin: Event of %" PRIsz " bytes exceeds the "
+            "send buffer size of %" PRIsz " bytes.",
+            msg_len, sizeof(host->send_buf));
+      return -1;
+    }
+    if (msg_len > (sizeof(host->send_buf) - host->send_buf_fill)) {
+      status = sensu_flush_buffer(host);
+      if (status != 0)
+        return status;
+    }
+    memcpy(host->send_buf + host->send_buf_fill, msg, msg_len);
+    host->send_buf_fill += msg_len;
+    return 0;
+  }
+
   status = sensu_send_msg(host, msg);
   if (status != 0) {
     host->flags &= ~F_READY;
@@ -928,41 +884,51 @@ static int sensu_send(struct sensu_host *host, char const *msg) /* {{{ */
 
 static int sensu_write(const data_set_t *ds, /* {{{ */
                        const value_list_t *vl, user_data_t *ud) {
-  int status = 0;
-  int statuses[vl->values_len];
   struct sensu_host *host = ud->data;
+  char name[5 * DATA_MAX_NAME_LEN];
   gauge_t *rates = NULL;
-  char *msg;
-
-  pthread_mutex_lock(&host->lock);
-  memset(statuses, 0, vl->values_len * sizeof(*statuses));
+  char *msgs[vl->values_len];
 
   if (host->store_rates) {
     rates = uc_get_rate(ds, vl);
     if (rates == NULL) {
       ERROR("write_sensu plugin: uc_get_rate failed.");
-      pthread_mutex_unlock(&host->lock);
       return -1;
     }
   }
+
+  /* The events are formatted before taking the lock. Only the data source
+   * specific parts are formatted for every value. */
+  char *vl_json = sensu_value_list_to_json(host, vl);
+  if (vl_json == NULL) {
+    sfree(rates);
+    return -1;
+  }
+  sensu_format_name2(name, sizeof(name), vl->host, vl->plugin,
+                     vl->plugin_instance, vl->type, vl->type_instance,
+                     host->separator);
+
+  int status = 0;
   for (size_t i = 0; i < vl->values_len; i++) {
-    msg = sensu_value_to_json(host, ds, vl, (int)i, rates);
-    if (msg == NULL) {
-      sfree(rates);
-      pthread_mutex_unlock(&host->lock);
-      return -1;
-    }
-    status = sensu_send(host, msg);
-    free(msg);
-    if (status != 0) {
-      ERROR("write_sensu plugin: sensu_send failed with status %i", status);
-      pthread_mutex_unlock(&host->lock);
-      sfree(rates);
-      return status;
-    }
+    msgs[i] = sensu_value_to_json(host, ds, vl, i, rates, vl_json, name);
+    if (msgs[i] == NULL)
+      status = -1;
   }
+  sfree(vl_json);
   sfree(rates);
+
+  pthread_mutex_lock(&host->lock);
+  for (size_t i = 0; (i < vl->values_len) && (status == 0); i++) {
+    status = sensu_send(host, msgs[i]);
+    if (status != 0)
+      ERROR("write_sensu plugin: sensu_send failed with status %i", status);
+  }
+  if ((status == 0) && (host->sender != NULL))
+    status = sensu_flush_buffer(host);
   pthread_mutex_unlock(&host->lock);
+
+  for (size_t i = 0; i < vl->values_len; i++)
+    sfree(msgs[i]);
   return status;
 } /* }}} int sensu_write */
 
@@ -973,23 +939,30 @@ static int sensu_notification(const notification_t *n,
   struct sensu_host *host = ud->data;
   char *msg;
 
-  pthread_mutex_lock(&host->lock);
-
   msg = sensu_notification_to_json(host, n);
-  if (msg == NULL) {
-    pthread_mutex_unlock(&host->lock);
+  if (msg == NULL)
     return -1;
-  }
 
+  pthread_mutex_lock(&host->lock);
   status = sensu_send(host, msg);
-  free(msg);
   if (status != 0)
     ERROR("write_sensu plugin: sensu_send failed with status %i", status);
+  else if (host->sender != NULL)
+    status = sensu_flush_buffer(host);
   pthread_mutex_unlock(&host->lock);
+  free(msg);
 
   return status;
 } /* }}} int sensu_notification */
 
+static int sensu_stats_read(user_data_t *ud) /* {{{ */
+{
+  struct sensu_host *host = ud->data;
+
+  async_sender_dispatch_stats(host->sender, "write_sensu", host->name);
+  return 0;
+} /* }}} int sensu_stats_read */
+
 static void sensu_free(void *p) /* {{{ */
 {
   struct sensu_host *host = p;
@@ -1005,11 +978,13 @@ static void sensu_free(void *p) /* {{{ */
     return;
   }
 
+  async_sender_destroy(host->sender);
   sensu_close_socket(host);
   if (host->res != NULL) {
     freeaddrinfo(host->res);
     host->res = NULL;
   }
+  sfree(host->metric_prefix);
   sfree(host->service);
   sfree(host->event_service_prefix);
   sfree(host->name);
@@ -1120,6 +1095,14 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_boolean(child, &host->include_source);
       if (status != 0)
         break;
+    } else if (strcasecmp("SendQueueLength", child->key) == 0) {
+      status = cf_util_get_int(child, &host->send_queue_length);
+      if (status != 0)
+        break;
+    } else if (strcasecmp("ReportStats", child->key) == 0) {
+      status = cf_util_get_boolean(child, &host->report_stats);
+      if (status != 0)
+        break;
     } else {
       WARNING("write_sensu plugin: ignoring unknown config "
               "option: \"%s\"",
@@ -1165,6 +1148,42 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  if (host->metrics) {
+    host->metric_prefix = sensu_metric_prefix(host);
+    if (host->metric_prefix == NULL) {
+      ERROR("write_sensu plugin: Unable to alloc memory");
+      sensu_free(host);
+      return -1;
+    }
+  }
+
+  if (host->send_queue_length < 0) {
+    WARNING("write_sensu plugin: \"SendQueueLength\" must not be negative. "
+            "Sending synchronously.");
+    host->send_queue_length = 0;
+  }
+
+  if (host->send_queue_length > 0) {
+    host->sender = async_sender_create(&(async_sender_options_t){
+        .log_prefix = "write_sensu plugin",
+        .node = (host->node != NULL) ? host->node : SENSU_HOST,
+        .service = (host->service != NULL) ? host->service : SENSU_PORT,
+        .socktype = SOCK_STREAM,
+        .buffer_size = sizeof(host->send_buf),
+        .queue_length = (size_t)host->send_queue_length,
+        .log_send_errors = true,
+    });
+    if (host->sender == NULL) {
+      ERROR("write_sensu plugin: async_sender_create failed.");
+      sensu_free(host);
+      return -1;
+    }
+  } else if (host->report_stats) {
+    WARNING("write_sensu plugin: \"ReportStats\" requires "
+            "\"SendQueueLength\" and will be ignored.");
+    host->report_stats = false;
+  }
+
   snprintf(callback_name, sizeof(callback_name), "write_sensu/%s", host->name);
 
   user_data_t ud = {.data = host, .free_func = sensu_free};
@@ -1192,6 +1211,18 @@ static int sensu_config_node(oconfig_item_t *ci) /* {{{ */
       host->reference_count++;
   }
 
+  if ((host->reference_count > 1) && host->report_stats) {
+    int read_status = plugin_register_complex_read(
+        /* group = */ NULL, callback_name, sensu_stats_read,
+        /* interval = */ 0, &ud);
+    if (read_status != 0)
+      WARNING("write_sensu plugin: plugin_register_complex_read (\"%s\") "
+              "failed with status %i.",
+              callback_name, read_status);
+    else
+      host->reference_count++;
+  }
+
   if (host->reference_count <= 1) {
     /* Both callbacks failed => free memory.
      * We need to unlock here, because sensu_free() will lock.
@@ -1266,6 +1297,13 @@ static int sensu_config(oconfig_item_t *ci) /* {{{ */
       return -1;
     }
   }
+
+  sfree(sensu_attrs_json);
+  sensu_attrs_json = sensu_attrs_to_json();
+  if (sensu_attrs_json == NULL) {
+    ERROR("write_sensu plugin: Unable to alloc memory");
+    return -1;
+  }
   return 0;
 } /* }}} int sensu_config */
 
@@ -0,0 +1,249 @@
+/**
+ * collectd - src/write_shm.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils/avltree/avltree.h"
+#include "utils/common/common.h"
+#include "utils_cache.h"
+
+#include "collectd/shm_format.h"
+
+#include <sys/mman.h>
+
+#define WS_DEFAULT_MAX_RECORDS 16384
+
+static char *ws_name;
+static uint32_t ws_max_records = WS_DEFAULT_MAX_RECORDS;
+
+static void *ws_addr;
+static size_t ws_size;
+static lcc_shm_header_t *ws_header;
+static lcc_shm_record_t *ws_records;
+
+/* Maps identifiers to record numbers. Records are never removed, so the
+ * segment only grows up to "MaxRecords" metrics. */
+static c_avl_tree_t *ws_index;
+static bool ws_full_warned;
+static pthread_mutex_t ws_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int ws_config(oconfig_item_t *ci) /* {{{ */
+{
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+    int status = 0;
+
+    if (strcasecmp("Name", child->key) == 0) {
+      status = cf_util_get_string(child, &ws_name);
+      if ((status == 0) && (ws_name[0] != '/')) {
+        ERROR("write_shm plugin: The name must start with a slash.");
+        status = -1;
+      }
+    } else if (strcasecmp("MaxRecords", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1)) {
+        ERROR("write_shm plugin: MaxRecords must be positive.");
+        status = -1;
+      }
+      if (status == 0)
+        ws_max_records = (uint32_t)tmp;
+    } else {
+      WARNING("write_shm plugin: Ignoring unknown config option \"%s\".",
+              child->key);
+    }
+
+    if (status != 0)
+      return status;
+  }
+
+  return 0;
+} /* }}} int ws_config */
+
+static int ws_init(void) /* {{{ */
+{
+  if (ws_addr != NULL)
+    return 0;
+
+  if (ws_name == NULL) {
+    ws_name = strdup(LCC_SHM_DEFAULT_NAME);
+    if (ws_name == NULL)
+      return ENOMEM;
+  }
+
+  ws_index = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (ws_index == NULL)
+    return ENOMEM;
+
+  ws_size = sizeof(lcc_shm_header_t) +
+            (size_t)ws_max_records * sizeof(lcc_shm_record_t);
+
+  /* Start with an empty segment, so that readers of a previous instance see
+   * the new magic only after it has been initialized. */
+  shm_unlink(ws_name);
+  int fd = shm_open(ws_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    ERROR("write_shm plugin: shm_open(\"%s\") failed: %s", ws_name, STRERRNO);
+    return -1;
+  }
+
+  if (ftruncate(fd, (off_t)ws_size) != 0) {
+    ERROR("write_shm plugin: ftruncate(\"%s\") failed: %s", ws_name, STRERRNO);
+    close(fd);
+    shm_unlink(ws_name);
+    return -1;
+  }
+
+  void *addr = mmap(NULL, ws_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                    /* offset = */ 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    ERROR("write_shm plugin: mmap(\"%s\") failed: %s", ws_name, STRERRNO);
+    shm_unlink(ws_name);
+    return -1;
+  }
+
+  ws_addr = addr;
+  ws_header = addr;
+  ws_records = (lcc_shm_record_t *)((char *)addr + sizeof(*ws_header));
+
+  ws_header->version = LCC_SHM_VERSION;
+  ws_header->record_size = (uint32_t)sizeof(lcc_shm_record_t);
+  ws_header->records_max = ws_max_records;
+  ws_header->records_num = 0;
+  __atomic_store_n(&ws_header->magic, LCC_SHM_MAGIC, __ATOMIC_RELEASE);
+
+  return 0;
+} /* }}} int ws_init */
+
+/* Returns the record for "identifier", creating it if necessary. Must be
+ * called with ws_lock held. */
+static lcc_shm_record_t *ws_record_get(char const *identifier) /* {{{ */
+{
+  uintptr_t i;
+
+  if (c_avl_get(ws_index, identifier, (void *)&i) == 0)
+    return ws_records + i;
+
+  i = (uintptr_t)ws_header->records_num;
+  if (i >= ws_max_records) {
+    if (!ws_full_warned)
+      WARNING("write_shm plugin: All %" PRIu32 " records are in use. "
+              "Consider increasing \"MaxRecords\".",
+              ws_max_records);
+    ws_full_warned = true;
+    return NULL;
+  }
+
+  char *key = strdup(identifier);
+  if (key == NULL)
+    return NULL;
+  if (c_avl_insert(ws_index, key, (void *)i) != 0) {
+    sfree(key);
+    return NULL;
+  }
+
+  lcc_shm_record_t *r = ws_records + i;
+  sstrncpy(r->identifier, identifier, sizeof(r->identifier));
+
+  /* Publish the record after its identifier has been written. */
+  __atomic_store_n(&ws_header->records_num, (uint32_t)(i + 1),
+                   __ATOMIC_RELEASE);
+  return r;
+} /* }}} lcc_shm_record_t *ws_record_get */
+
+static int ws_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
+                    __attribute__((unused)) user_data_t *ud) {
+  char identifier[6 * DATA_MAX_NAME_LEN];
+
+  if (ws_addr == NULL)
+    return -1;
+
+  if (ds->ds_num > LCC_SHM_VALUES_MAX)
+    return 0;
+
+  int status = FORMAT_VL(identifier, sizeof(identifier), vl);
+  if (status != 0)
+    return status;
+
+  /* Such identifiers can not be expressed with libcollectdclient. */
+  if (strlen(identifier) >= LCC_SHM_IDENTIFIER_SIZE)
+    return 0;
+
+  gauge_t rates[ds->ds_num];
+  if (uc_get_rate_into(ds, vl, rates, STATIC_ARRAY_SIZE(rates)) != 0)
+    return -1;
+
+  pthread_mutex_lock(&ws_lock);
+
+  lcc_shm_record_t *r = ws_record_get(identifier);
+  if (r == NULL) {
+    pthread_mutex_unlock(&ws_lock);
+    return 0;
+  }
+
+  /* Seqlock: readers retry while "seq" is odd or has changed. */
+  uint32_t seq = r->seq;
+  __atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  r->values_num = (uint32_t)ds->ds_num;
+  r->time = (uint64_t)vl->time;
+  r->interval = (uint64_t)vl->interval;
+  for (size_t i = 0; i < ds->ds_num; i++)
+    r->values[i] = rates[i];
+
+  __atomic_store_n(&r->seq, seq + 2, __ATOMIC_RELEASE);
+
+  pthread_mutex_unlock(&ws_lock);
+
+  return 0;
+} /* }}} int ws_write */
+
+static int ws_shutdown(void) /* {{{ */
+{
+  if (ws_addr != NULL) {
+    munmap(ws_addr, ws_size);
+    shm_unlink(ws_name);
+    ws_addr = NULL;
+  }
+
+  if (ws_index != NULL) {
+    void *key;
+    void *value;
+    while (c_avl_pick(ws_index, &key, &value) == 0)
+      sfree(key);
+    c_avl_destroy(ws_index);
+    ws_index = NULL;
+  }
+
+  sfree(ws_name);
+  return 0;
+} /* }}} int ws_shutdown */
+
+void module_register(void) {
+  plugin_register_complex_config("write_shm", ws_config);
+  plugin_register_init("write_shm", ws_init);
+  plugin_register_write("write_shm", ws_write, /* user_data = */ NULL);
+  plugin_register_shutdown("write_shm", ws_shutdown);
+} /* void module_register */
@@ -25,6 +25,7 @@
 #include "configfile.h"
 #include "plugin.h"
 #include "utils/common/common.h"
+#include "utils/compress/compress.h"
 #include "utils/format_stackdriver/format_stackdriver.h"
 #include "utils/gce/gce.h"
 #include "utils/oauth/oauth.h"
@@ -44,31 +45,66 @@
 #define MONITORING_SCOPE "https://www.googleapis.com/auth/monitoring"
 #endif
 
+#define WG_DEFAULT_CONNECTIONS 4
+#define WG_MAX_QUEUED_REQUESTS 1024
+
+/* The access token is renewed 30 seconds before it expires, so a header that
+ * is at most 10 seconds old is always valid. */
+#define WG_AUTH_HEADER_MAX_AGE TIME_T_TO_CDTIME_T(10)
+
+struct wg_memory_s {
+  char *memory;
+  size_t size;
+};
+typedef struct wg_memory_s wg_memory_t;
+
+/* A projects.timeSeries.create() request waiting for or being processed by
+ * the upload thread. */
+struct wg_request_s {
+  char url[1024];
+  struct curl_slist *headers;
+  void *body;
+  size_t body_size;
+  wg_memory_t response;
+  char curl_errbuf[CURL_ERROR_SIZE];
+  struct wg_request_s *next;
+};
+typedef struct wg_request_s wg_request_t;
+
 struct wg_callback_s {
   /* config */
   char *email;
   char *project;
   char *url;
   sd_resource_t *resource;
+  compress_algorithm_t compression;
+  size_t connections;
 
   /* runtime */
   oauth_t *auth;
   sd_output_t *formatter;
   CURL *curl;
   char curl_errbuf[CURL_ERROR_SIZE];
+  compressor_t *compressor;
+  char *auth_header;
+  cdtime_t auth_header_time;
   /* used by flush */
   size_t timeseries_count;
   cdtime_t send_buffer_init_time;
 
   pthread_mutex_t lock;
-};
-typedef struct wg_callback_s wg_callback_t;
 
-struct wg_memory_s {
-  char *memory;
-  size_t size;
+  /* Requests for the upload thread, protected by queue_lock. */
+  wg_request_t *queue_head;
+  wg_request_t *queue_tail;
+  size_t queue_len;
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+  pthread_t upload_thread;
+  bool upload_thread_started;
+  bool upload_loop;
 };
-typedef struct wg_memory_s wg_memory_t;
+typedef struct wg_callback_s wg_callback_t;
 
 static size_t wg_write_memory_cb(void *contents, size_t size,
                                  size_t nmemb, /* {{{ */
@@ -94,11 +130,18 @@ static size_t wg_write_memory_cb(void *contents, size_t size,
   return realsize;
 } /* }}} size_t wg_write_memory_cb */
 
-static char *wg_get_authorization_header(wg_callback_t *cb) { /* {{{ */
+/* Returns the "Authorization" header, reusing it for up to
+ * WG_AUTH_HEADER_MAX_AGE. Must hold cb->lock when calling. */
+static char const *wg_get_authorization_header(wg_callback_t *cb) { /* {{{ */
   int status = 0;
   char access_token[GOOGLE_OAUTH_ACCESS_TOKEN_SIZE];
   char authorization_header[GOOGLE_OAUTH_ACCESS_TOKEN_SIZE + 32];
 
+  cdtime_t now = cdtime();
+  if ((cb->auth_header != NULL) &&
+      ((now - cb->auth_header_time) < WG_AUTH_HEADER_MAX_AGE))
+    return cb->auth_header;
+
   assert((cb->auth != NULL) || gce_check());
   if (cb->auth != NULL)
     status = oauth_access_token(cb->auth, access_token, sizeof(access_token));
@@ -114,8 +157,61 @@ static char *wg_get_authorization_header(wg_callback_t *cb) { /* {{{ */
   if ((status < 1) || ((size_t)status >= sizeof(authorization_header)))
     return NULL;
 
-  return strdup(authorization_header);
-} /* }}} char *wg_get_authorization_header */
+  char *tmp = strdup(authorization_header);
+  if (tmp == NULL)
+    return NULL;
+
+  sfree(cb->auth_header);
+  cb->auth_header = tmp;
+  cb->auth_header_time = now;
+  return cb->auth_header;
+} /* }}} char const *wg_get_authorization_header */
+
+/* Creates the headers for a POST request and compresses "payload" if
+ * configured. On success, "ret_body" points either to "payload" or to memory
+ * owned by cb->compressor. Must hold cb->lock when calling. */
+static struct curl_slist *wg_prepare_post(wg_callback_t *cb, /* {{{ */
+                                          char const *payload,
+                                          void const **ret_body,
+                                          size_t *ret_body_size) {
+  char const *auth_header = wg_get_authorization_header(cb);
+  if (auth_header == NULL) {
+    ERROR("write_stackdriver plugin: getting access token failed with");
+    return NULL;
+  }
+
+  struct curl_slist *headers =
+      curl_slist_append(NULL, "Content-Type: application/json");
+  headers = curl_slist_append(headers, auth_header);
+
+  void const *body = payload;
+  size_t body_size = strlen(payload);
+  if (cb->compressor != NULL) {
+    if (compressor_compress(cb->compressor, payload, body_size, &body,
+                            &body_size) != 0) {
+      ERROR("write_stackdriver plugin: Compressing the request failed.");
+      curl_slist_free_all(headers);
+      return NULL;
+    }
+    char encoding_header[64];
+    ssnprintf(encoding_header, sizeof(encoding_header),
+              "Content-Encoding: %s",
+              compress_content_encoding(cb->compression));
+    headers = curl_slist_append(headers, encoding_header);
+  }
+
+  *ret_body = body;
+  *ret_body_size = body_size;
+  return headers;
+} /* }}} struct curl_slist *wg_prepare_post */
+
+static long wg_request_timeout_ms(void) {
+  long timeout_ms = 2 * CDTIME_T_TO_MS(plugin_get_interval());
+  if (timeout_ms < 10000) {
+    timeout_ms = 10000;
+  }
+  return timeout_ms;
+}
 
 typedef struct {
   int code;
@@ -189,26 +285,18 @@ static int do_post(wg_callback_t *cb, char const *url, void const *payload,
 
   curl_easy_setopt(cb->curl, CURLOPT_POST, 1L);
   curl_easy_setopt(cb->curl, CURLOPT_URL, url);
-
-  long timeout_ms = 2 * CDTIME_T_TO_MS(plugin_get_interval());
-  if (timeout_ms < 10000) {
-    timeout_ms = 10000;
-  }
-  curl_easy_setopt(cb->curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+  curl_easy_setopt(cb->curl, CURLOPT_TIMEOUT_MS, wg_request_timeout_ms());
 
   /* header */
-  char *auth_header = wg_get_authorization_header(cb);
-  if (auth_header == NULL) {
-    ERROR("write_stackdriver plugin: getting access token failed with");
+  void const *body = NULL;
+  size_t body_size = 0;
+  struct curl_slist *headers = wg_prepare_post(cb, payload, &body, &body_size);
+  if (headers == NULL)
     return -1;
-  }
-
-  struct curl_slist *headers =
-      curl_slist_append(NULL, "Content-Type: application/json");
-  headers = curl_slist_append(headers, auth_header);
   curl_easy_setopt(cb->curl, CURLOPT_HTTPHEADER, headers);
 
-  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDS, payload);
+  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDSIZE, (long)body_size);
+  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDS, body);
 
   curl_easy_setopt(cb->curl, CURLOPT_WRITEFUNCTION,
                    ret_content ? wg_write_memory_cb : NULL);
@@ -218,7 +306,6 @@ static int do_post(wg_callback_t *cb, char const *url, void const *payload,
 
   /* clean up that has to happen in any case */
   curl_slist_free_all(headers);
-  sfree(auth_header);
   curl_easy_setopt(cb->curl, CURLOPT_HTTPHEADER, NULL);
   curl_easy_setopt(cb->curl, CURLOPT_WRITEFUNCTION, NULL);
   curl_easy_setopt(cb->curl, CURLOPT_WRITEDATA, NULL);
@@ -293,6 +380,209 @@ static int wg_call_timeseries_write(wg_callback_t *cb, char const *payload) {
   return 0;
 } /* int wg_call_timeseries_write */
 
+static void wg_request_free(wg_request_t *r) /* {{{ */
+{
+  if (r == NULL)
+    return;
+
+  curl_slist_free_all(r->headers);
+  sfree(r->body);
+  sfree(r->response.memory);
+  sfree(r);
+} /* }}} void wg_request_free */
+
+/* Logs the outcome of a finished request, like wg_call_timeseries_write()
+ * does for synchronous requests. */
+static void wg_request_done(CURL *curl, CURLcode result, /* {{{ */
+                            wg_request_t *r) {
+  if (result != CURLE_OK) {
+    ERROR("write_stackdriver plugin: POST %s failed: %s", r->url,
+          r->curl_errbuf);
+    return;
+  }
+
+  long http_code = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+  if (http_code == 200)
+    return;
+
+  if ((http_code >= 400) && (http_code < 500) && (r->response.memory != NULL))
+    ERROR("write_stackdriver plugin: POST %s: %s", r->url,
+          API_ERROR_STRING(parse_api_error(r->response.memory)));
+  else if ((http_code >= 500) && (r->response.memory != NULL))
+    WARNING("write_stackdriver plugin: POST %s: %s", r->url,
+            r->response.memory);
+  ERROR("write_stackdriver plugin: POST %s: unexpected response code: got "
+        "%ld, want 200",
+        r->url, http_code);
+} /* }}} void wg_request_done */
+
+/* wg_upload_thread sends the queued requests, with up to cb->connections
+ * requests in flight on one curl multi handle. */
+static void *wg_upload_thread(void *arg) /* {{{ */
+{
+  wg_callback_t *cb = arg;
+  size_t in_flight = 0;
+
+  CURLM *multi = curl_multi_init();
+  CURL **idle = calloc(cb->connections, sizeof(*idle));
+  size_t idle_num = 0;
+  if ((multi == NULL) || (idle == NULL)) {
+    ERROR("write_stackdriver plugin: curl_multi_init failed.");
+    if (multi != NULL)
+      curl_multi_cleanup(multi);
+    sfree(idle);
+    return NULL;
+  }
+
+  while (42) {
+    pthread_mutex_lock(&cb->queue_lock);
+    while ((in_flight == 0) && (cb->queue_head == NULL) && cb->upload_loop)
+      pthread_cond_wait(&cb->queue_cond, &cb->queue_lock);
+    if ((in_flight == 0) && (cb->queue_head == NULL)) {
+      pthread_mutex_unlock(&cb->queue_lock);
+      break;
+    }
+
+    while ((in_flight < cb->connections) && (cb->queue_head != NULL)) {
+      CURL *curl = (idle_num > 0) ? idle[--idle_num] : curl_easy_init();
+      if (curl == NULL)
+        break;
+
+      wg_request_t *r = cb->queue_head;
+      cb->queue_head = r->next;
+      if (cb->queue_head == NULL)
+        cb->queue_tail = NULL;
+      cb->queue_len--;
+
+      curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+      curl_easy_setopt(curl, CURLOPT_USERAGENT,
+                       PACKAGE_NAME "/" PACKAGE_VERSION);
+      curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, r->curl_errbuf);
+      curl_easy_setopt(curl, CURLOPT_POST, 1L);
+      curl_easy_setopt(curl, CURLOPT_URL, r->url);
+      curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, wg_request_timeout_ms());
+      curl_easy_setopt(curl, CURLOPT_HTTPHEADER, r->headers);
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)r->body_size);
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, r->body);
+      curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, wg_write_memory_cb);
+      curl_easy_setopt(curl, CURLOPT_WRITEDATA, &r->response);
+      curl_easy_setopt(curl, CURLOPT_PRIVATE, r);
+
+      curl_multi_add_handle(multi, curl);
+      in_flight++;
+    }
+    pthread_mutex_unlock(&cb->queue_lock);
+
+    int running = 0;
+    curl_multi_perform(multi, &running);
+
+    CURLMsg *msg;
+    int msgs_left = 0;
+    while ((msg = curl_multi_info_read(multi, &msgs_left)) != NULL) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      CURL *curl = msg->easy_handle;
+      CURLcode result = msg->data.result;
+      wg_request_t *r = NULL;
+      curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&r);
+
+      wg_request_done(curl, result, r);
+
+      curl_multi_remove_handle(multi, curl);
+      curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
+      curl_easy_setopt(curl, CURLOPT_WRITEDATA, NULL);
+      /* Keep the handle and its connection for the next request. */
+      if (idle_num < cb->connections)
+        idle[idle_num++] = curl;
+      else
+        curl_easy_cleanup(curl);
+      wg_request_free(r);
+      in_flight--;
+    }
+
+    /* Wake up regularly to pick up new requests. */
+    if (in_flight > 0)
+      curl_multi_wait(multi, NULL, 0, /* timeout_ms = */ 100, NULL);
+  }
+
+  for (size_t i = 0; i < idle_num; i++)
+    curl_easy_cleanup(idle[i]);
+  sfree(idle);
+  curl_multi_cleanup(multi);
+  return NULL;
+} /* }}} void *wg_upload_thread */
+
+/* Queues "payload" for the upload thread, which is started on first use.
+ * Takes ownership of "payload". Must hold cb->lock when calling. */
+static int wg_queue_timeseries_write(wg_callback_t *cb, /* {{{ */
+                                     char *payload) {
+  wg_request_t *r = calloc(1, sizeof(*r));
+  if (r == NULL) {
+    sfree(payload);
+    return ENOMEM;
+  }
+  ssnprintf(r->url, sizeof(r->url), "%s/projects/%s/timeSeries", cb->url,
+            cb->project);
+
+  void const *body = NULL;
+  r->headers = wg_prepare_post(cb, payload, &body, &r->body_size);
+  if (r->headers == NULL) {
+    sfree(payload);
+    wg_request_free(r);
+    return -1;
+  }
+
+  if (body == payload) {
+    r->body = payload;
+  } else {
+    /* The compressor's buffer is reused by the next request. */
+    sfree(payload);
+    r->body = malloc(r->body_size);
+    if (r->body == NULL) {
+      wg_request_free(r);
+      return ENOMEM;
+    }
+    memcpy(r->body, body, r->body_size);
+  }
+
+  pthread_mutex_lock(&cb->queue_lock);
+  if (!cb->upload_thread_started) {
+    cb->upload_loop = true;
+    int status = plugin_thread_create(&cb->upload_thread, wg_upload_thread, cb,
+                                      "stackdriver upload");
+    if (status != 0) {
+      pthread_mutex_unlock(&cb->queue_lock);
+      ERROR("write_stackdriver plugin: Starting the upload thread failed: %s",
+            STRERROR(status));
+      wg_request_free(r);
+      return status;
+    }
+    cb->upload_thread_started = true;
+  }
+
+  if (cb->queue_len >= WG_MAX_QUEUED_REQUESTS) {
+    pthread_mutex_unlock(&cb->queue_lock);
+    ERROR("write_stackdriver plugin: %d requests are waiting to be sent, "
+          "dropping time series.",
+          WG_MAX_QUEUED_REQUESTS);
+    wg_request_free(r);
+    return -1;
+  }
+
+  if (cb->queue_tail == NULL)
+    cb->queue_head = r;
+  else
+    cb->queue_tail->next = r;
+  cb->queue_tail = r;
+  cb->queue_len++;
+  pthread_cond_signal(&cb->queue_cond);
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  return 0;
+} /* }}} int wg_queue_timeseries_write */
+
 static void wg_reset_buffer(wg_callback_t *cb) /* {{{ */
 {
   cb->timeseries_count = 0;
@@ -341,10 +631,17 @@ static int wg_flush_nolock(cdtime_t timeout, wg_callback_t *cb) /* {{{ */
   }
 
   char *payload = sd_output_reset(cb->formatter);
-  int status = wg_call_timeseries_write(cb, payload);
   wg_reset_buffer(cb);
-  sfree(payload);
-  return status;
+  if (payload == NULL)
+    return ENOMEM;
+
+  if (cb->connections == 0) {
+    int status = wg_call_timeseries_write(cb, payload);
+    sfree(payload);
+    return status;
+  }
+
+  return wg_queue_timeseries_write(cb, payload);
 } /* }}} wg_flush_nolock */
 
 static int wg_flush(cdtime_t timeout, /* {{{ */
@@ -381,6 +678,20 @@ static void wg_callback_free(void *data) /* {{{ */
   if (cb == NULL)
     return;
 
+  /* The upload thread sends all queued requests before exiting. */
+  pthread_mutex_lock(&cb->queue_lock);
+  bool started = cb->upload_thread_started;
+  cb->upload_loop = false;
+  pthread_cond_broadcast(&cb->queue_cond);
+  pthread_mutex_unlock(&cb->queue_lock);
+  if (started)
+    pthread_join(cb->upload_thread, NULL);
+  while (cb->queue_head != NULL) {
+    wg_request_t *r = cb->queue_head;
+    cb->queue_head = r->next;
+    wg_request_free(r);
+  }
+
   sd_output_destroy(cb->formatter);
   cb->formatter = NULL;
 
@@ -392,6 +703,8 @@ static void wg_callback_free(void *data) /* {{{ */
   if (cb->curl) {
     curl_easy_cleanup(cb->curl);
   }
+  compressor_destroy(cb->compressor);
+  sfree(cb->auth_header);
 
   sfree(cb);
 } /* }}} void wg_callback_free */
@@ -450,8 +763,8 @@ static int wg_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
       wg_flush_nolock(0, cb);
       status = 0;
       break;
-    } else if (status == EEXIST) {
-      /* metric already in the buffer; flush and retry */
+    } else if ((status == EEXIST) || (status == ENOSPC)) {
+      /* metric already in the buffer or buffer full; flush and retry */
       wg_flush_nolock(0, cb);
       continue;
     } else if (status == ENOENT) {
@@ -545,6 +858,38 @@ static int wg_config_resource(oconfig_item_t *ci, wg_callback_t *cb) /* {{{ */
   return 0;
 } /* }}} int wg_config_resource */
 
+static int wg_config_compression(oconfig_item_t *ci,
+                                 wg_callback_t *cb) /* {{{ */
+{
+  char *name = NULL;
+  int status = cf_util_get_string(ci, &name);
+  if (status != 0)
+    return status;
+
+  status = compress_algorithm_parse(name, &cb->compression);
+  if (status == ENOTSUP)
+    ERROR("write_stackdriver plugin: collectd was built without support for "
+          "\"Compression %s\".",
+          name);
+  else if (status != 0)
+    ERROR("write_stackdriver plugin: Invalid compression: %s", name);
+  sfree(name);
+  if (status != 0)
+    return status;
+
+  compressor_destroy(cb->compressor);
+  cb->compressor = NULL;
+  if (cb->compression == COMPRESS_NONE)
+    return 0;
+
+  cb->compressor = compressor_create(cb->compression);
+  if (cb->compressor == NULL) {
+    ERROR("write_stackdriver plugin: compressor_create failed.");
+    return -1;
+  }
+  return 0;
+} /* }}} int wg_config_compression */
+
 static int wg_config(oconfig_item_t *ci) /* {{{ */
 {
   if (ci == NULL) {
@@ -557,7 +902,10 @@ static int wg_config(oconfig_item_t *ci) /* {{{ */
     return ENOMEM;
   }
   cb->url = strdup(GCM_API_URL);
+  cb->connections = WG_DEFAULT_CONNECTIONS;
   pthread_mutex_init(&cb->lock, /* attr = */ NULL);
+  pthread_mutex_init(&cb->queue_lock, /* attr = */ NULL);
+  pthread_cond_init(&cb->queue_cond, /* attr = */ NULL);
 
   char *credential_file = NULL;
 
@@ -573,7 +921,20 @@ static int wg_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_string(child, &credential_file);
     else if (strcasecmp("Resource", child->key) == 0)
       wg_config_resource(child, cb);
-    else {
+    else if (strcasecmp("Connections", child->key) == 0) {
+      int tmp = -1;
+      if ((cf_util_get_int(child, &tmp) != 0) || (tmp < 0)) {
+        ERROR("write_stackdriver plugin: Connections must not be negative.");
+        wg_callback_free(cb);
+        return EINVAL;
+      }
+      cb->connections = (size_t)tmp;
+    } else if (strcasecmp("Compression", child->key) == 0) {
+      if (wg_config_compression(child, cb) != 0) {
+        wg_callback_free(cb);
+        return EINVAL;
+      }
+    } else {
       ERROR("write_stackdriver plugin: Invalid configuration option: %s.",
             child->key);
       wg_callback_free(cb);
@@ -51,6 +51,7 @@
 #include "utils/common/common.h"
 
 #include "plugin.h"
+#include "utils/async_sender/async_sender.h"
 #include "utils_cache.h"
 #include "utils_random.h"
 
@@ -82,6 +83,7 @@ struct ws_callback {
   char *host_tags;
   char *msg_format;
   char *metrics_prefix;
+  bool format_json;
   bool store_rates;
   bool always_append_ds;
 
@@ -95,11 +97,22 @@ struct ws_callback {
   bool connect_failed_log_enabled;
   int connect_dns_failed_attempts_remaining;
   cdtime_t next_random_ttl;
+
+  /* With "SendQueueLength", full send buffers are handed to a sender thread
+   * which keeps the connection open and writes to the socket. Otherwise
+   * writes are synchronous. */
+  int send_queue_length;
+  bool report_stats;
+  async_sender_t *sender;
 };
 
 static cdtime_t resolve_interval;
 static cdtime_t resolve_jitter;
 
+/* The PID is part of every message header. It is set by the init callback,
+ * i.e. after the daemon has forked. */
+static pid_t ws_pid;
+
 /*
  * Functions
  */
@@ -113,6 +126,12 @@ static void ws_reset_buffer(struct ws_callback *cb) {
 static int ws_send_buffer(struct ws_callback *cb) {
   ssize_t status = 0;
 
+  if (cb->sender != NULL) {
+    /* The sender complains about full queues itself. */
+    status = async_sender_enqueue(cb->sender, cb->send_buf, cb->send_buf_fill);
+    return (status == ENOBUFS) ? 0 : (int)status;
+  }
+
   status = swrite(cb->sock_fd, cb->send_buf, strlen(cb->send_buf));
   if (status != 0) {
     ERROR("write_syslog plugin: send failed with status %zi (%s)", status,
@@ -274,6 +293,7 @@ static void ws_callback_free(void *data) {
   pthread_mutex_lock(&cb->send_lock);
 
   ws_flush_nolock(0, cb);
+  async_sender_destroy(cb->sender);
 
   close(cb->sock_fd);
   cb->sock_fd = -1;
@@ -303,7 +323,7 @@ static int ws_flush(cdtime_t timeout,
 
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->sock_fd < 0) {
+  if ((cb->sender == NULL) && (cb->sock_fd < 0)) {
     status = ws_callback_init(cb);
     if (status != 0) {
       ERROR("write_syslog plugin: ws_callback_init failed.");
@@ -385,6 +405,7 @@ static int ws_format_name(char *ret, int ret_len, const value_list_t *vl,
 }
 
 static int ws_send_message(const char *key, const char *value, cdtime_t time,
+                           const char *rfc3339_timestamp,
                            struct ws_callback *cb, const char *plugin,
                            const char *plugin_instance,
                            const char *type_instance, const char *type,
@@ -393,23 +414,17 @@ static int ws_send_message(const char *key, const char *value, cdtime_t time,
   int status;
   size_t message_len;
   char message[1024];
-  char rfc3339_timestamp[64];
   const char *host_tags = cb->host_tags ? cb->host_tags : "";
   const char *host_tags_json_prefix = "";
   const char *metrics_prefix =
       cb->metrics_prefix ? cb->metrics_prefix : WS_DEFAULT_PREFIX;
-  const char *msg_format = cb->msg_format ? cb->msg_format : WS_DEFAULT_FORMAT;
-  int pid;
-
-  pid = getpid();
-
-  rfc3339_local(rfc3339_timestamp, sizeof(rfc3339_timestamp), time);
+  int pid = (int)ws_pid;
 
   /* skip if value is NaN */
   if (value[0] == 'n')
     return 0;
 
-  if (strcasecmp("JSON", msg_format) == 0) {
+  if (cb->format_json) {
     if (cb->host_tags) {
       host_tags_json_prefix = ",";
     }
@@ -452,7 +467,8 @@ static int ws_send_message(const char *key, const char *value, cdtime_t time,
 
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->sock_fd < 0) {
+  /* With a sender thread, connecting is left to that thread. */
+  if ((cb->sender == NULL) && (cb->sock_fd < 0)) {
     status = ws_callback_init(cb);
     if (status != 0) {
       ERROR("write_syslog plugin: ws_callback_init failed.");
@@ -493,6 +509,7 @@ static int ws_write_messages(const data_set_t *ds, const value_list_t *vl,
                              struct ws_callback *cb) {
   char key[10 * DATA_MAX_NAME_LEN];
   char values[512];
+  char rfc3339_timestamp[64];
 
   int status;
 
@@ -502,6 +519,9 @@ static int ws_write_messages(const data_set_t *ds, const value_list_t *vl,
     return -1;
   }
 
+  /* All data sources of a value list share the timestamp. */
+  rfc3339_local(rfc3339_timestamp, sizeof(rfc3339_timestamp), vl->time);
+
   for (size_t i = 0; i < ds->ds_num; i++) {
     const char *ds_name = NULL;
 
@@ -527,7 +547,8 @@ static int ws_write_messages(const data_set_t *ds, const value_list_t *vl,
     }
 
     /* Send the message to tcp */
-    status = ws_send_message(key, values, vl->time, cb, vl->plugin,
+    status = ws_send_message(key, values, vl->time, rfc3339_timestamp, cb,
+                             vl->plugin,
                              vl->plugin_instance, vl->type_instance, vl->type,
                              ds_name, vl->interval, vl->host);
     if (status != 0) {
@@ -555,6 +576,17 @@ static int ws_write(const data_set_t *ds, const value_list_t *vl,
   return status;
 }
 
+static int ws_stats_read(user_data_t *user_data) {
+  struct ws_callback *cb = user_data->data;
+  char plugin_instance[DATA_MAX_NAME_LEN];
+
+  snprintf(plugin_instance, sizeof(plugin_instance), "%s-%s",
+           cb->node != NULL ? cb->node : WS_DEFAULT_NODE,
+           cb->service != NULL ? cb->service : WS_DEFAULT_SERVICE);
+  async_sender_dispatch_stats(cb->sender, "write_syslog", plugin_instance);
+  return 0;
+}
+
 static int ws_config_tsd(oconfig_item_t *ci) {
   struct ws_callback *cb;
   char callback_name[DATA_MAX_NAME_LEN];
@@ -587,6 +619,10 @@ static int ws_config_tsd(oconfig_item_t *ci) {
       cf_util_get_boolean(child, &cb->always_append_ds);
     else if (strcasecmp("Prefix", child->key) == 0)
       cf_util_get_string(child, &cb->metrics_prefix);
+    else if (strcasecmp("SendQueueLength", child->key) == 0)
+      cf_util_get_int(child, &cb->send_queue_length);
+    else if (strcasecmp("ReportStats", child->key) == 0)
+      cf_util_get_boolean(child, &cb->report_stats);
     else {
       ERROR("write_syslog plugin: Invalid configuration "
             "option: %s.",
@@ -595,6 +631,39 @@ static int ws_config_tsd(oconfig_item_t *ci) {
     }
   }
 
+  cb->format_json =
+      (cb->msg_format != NULL) && (strcasecmp("JSON", cb->msg_format) == 0);
+
+  if (cb->send_queue_length < 0) {
+    WARNING("write_syslog plugin: \"SendQueueLength\" must not be negative. "
+            "Sending synchronously.");
+    cb->send_queue_length = 0;
+  }
+
+  if (cb->send_queue_length > 0) {
+    cb->sender = async_sender_create(&(async_sender_options_t){
+        .log_prefix = "write_syslog plugin",
+        .node = cb->node != NULL ? cb->node : WS_DEFAULT_NODE,
+        .service = cb->service != NULL ? cb->service : WS_DEFAULT_SERVICE,
+        .socktype = SOCK_STREAM,
+        .buffer_size = sizeof(cb->send_buf),
+        .queue_length = (size_t)cb->send_queue_length,
+        .resolve_interval = resolve_interval,
+        .resolve_jitter = resolve_jitter,
+        .log_send_errors = true,
+    });
+    if (cb->sender == NULL) {
+      ERROR("write_syslog plugin: async_sender_create failed.");
+      ws_callback_free(cb);
+      return -1;
+    }
+    ws_reset_buffer(cb);
+  } else if (cb->report_stats) {
+    WARNING("write_syslog plugin: \"ReportStats\" requires "
+            "\"SendQueueLength\" and will be ignored.");
+    cb->report_stats = false;
+  }
+
   snprintf(callback_name, sizeof(callback_name), "write_syslog/%s/%s",
            cb->node != NULL ? cb->node : WS_DEFAULT_NODE,
            cb->service != NULL ? cb->service : WS_DEFAULT_SERVICE);
@@ -606,6 +675,11 @@ static int ws_config_tsd(oconfig_item_t *ci) {
   user_data.free_func = NULL;
   plugin_register_flush(callback_name, ws_flush, &user_data);
 
+  if (cb->report_stats)
+    plugin_register_complex_read(/* group = */ NULL, callback_name,
+                                 ws_stats_read, /* interval = */ 0,
+                                 &user_data);
+
   return 0;
 }
 
@@ -616,10 +690,9 @@ static int ws_config(oconfig_item_t *ci) {
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
 
-    if (strcasecmp("Node", child->key) == 0) {
-      if (ws_config_tsd(child) < 0)
-        return -1;
-    } else if (strcasecmp("ResolveInterval", child->key) == 0)
+    if (strcasecmp("Node", child->key) == 0)
+      continue; /* handled below */
+    else if (strcasecmp("ResolveInterval", child->key) == 0)
       cf_util_get_cdtime(child, &resolve_interval);
     else if (strcasecmp("ResolveJitter", child->key) == 0)
       cf_util_get_cdtime(child, &resolve_jitter);
@@ -631,9 +704,26 @@ static int ws_config(oconfig_item_t *ci) {
     }
   }
 
+  /* Nodes are configured last, because their senders copy the resolve
+   * settings. */
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("Node", child->key) == 0) {
+      if (ws_config_tsd(child) < 0)
+        return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int ws_init(void) {
+  ws_pid = getpid();
   return 0;
 }
 
 void module_register(void) {
   plugin_register_complex_config("write_syslog", ws_config);
+  plugin_register_init("write_syslog", ws_init);
 }
@@ -44,6 +44,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils/async_sender/async_sender.h"
 #include "utils/common/common.h"
 #include "utils_cache.h"
 #include "utils_random.h"
@@ -92,6 +93,13 @@ struct wt_callback {
   bool connect_failed_log_enabled;
   int connect_dns_failed_attempts_remaining;
   cdtime_t next_random_ttl;
+
+  /* With "SendQueueLength", full send buffers are handed to a sender thread
+   * which connects and writes to the socket. Otherwise writes are
+   * synchronous. */
+  int send_queue_length;
+  bool report_stats;
+  async_sender_t *sender;
 };
 
 static cdtime_t resolve_interval;
@@ -110,6 +118,12 @@ static void wt_reset_buffer(struct wt_callback *cb) {
 static int wt_send_buffer(struct wt_callback *cb) {
   ssize_t status = 0;
 
+  if (cb->sender != NULL) {
+    /* The sender complains about full queues itself. */
+    status = async_sender_enqueue(cb->sender, cb->send_buf, cb->send_buf_fill);
+    return (status == ENOBUFS) ? 0 : (int)status;
+  }
+
   status = swrite(cb->sock_fd, cb->send_buf, strlen(cb->send_buf));
   if (status != 0) {
     ERROR("write_tsdb plugin: send failed with status %zi (%s)", status,
@@ -269,6 +283,7 @@ static void wt_callback_free(void *data) {
   pthread_mutex_lock(&cb->send_lock);
 
   wt_flush_nolock(0, cb);
+  async_sender_destroy(cb->sender);
 
   close(cb->sock_fd);
   cb->sock_fd = -1;
@@ -296,7 +311,7 @@ static int wt_flush(cdtime_t timeout,
 
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->sock_fd < 0) {
+  if ((cb->sender == NULL) && (cb->sock_fd < 0)) {
     status = wt_callback_init(cb);
     if (status != 0) {
       ERROR("write_tsdb plugin: wt_callback_init failed.");
@@ -471,7 +486,8 @@ static int wt_send_message(const char *key, const char *value, cdtime_t time,
 
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->sock_fd < 0) {
+  /* With a sender thread, connecting is left to that thread. */
+  if ((cb->sender == NULL) && (cb->sock_fd < 0)) {
     status = wt_callback_init(cb);
     if (status != 0) {
       ERROR("write_tsdb plugin: wt_callback_init failed.");
@@ -571,6 +587,17 @@ static int wt_write(const data_set_t *ds, const value_list_t *vl,
   return status;
 }
 
+static int wt_stats_read(user_data_t *user_data) {
+  struct wt_callback *cb = user_data->data;
+  char plugin_instance[DATA_MAX_NAME_LEN];
+
+  snprintf(plugin_instance, sizeof(plugin_instance), "%s-%s",
+           cb->node != NULL ? cb->node : WT_DEFAULT_NODE,
+           cb->service != NULL ? cb->service : WT_DEFAULT_SERVICE);
+  async_sender_dispatch_stats(cb->sender, "write_tsdb", plugin_instance);
+  return 0;
+}
+
 static int wt_config_tsd(oconfig_item_t *ci) {
   struct wt_callback *cb;
   char callback_name[DATA_MAX_NAME_LEN];
@@ -599,6 +626,10 @@ static int wt_config_tsd(oconfig_item_t *ci) {
       cf_util_get_boolean(child, &cb->store_rates);
     else if (strcasecmp("AlwaysAppendDS", child->key) == 0)
       cf_util_get_boolean(child, &cb->always_append_ds);
+    else if (strcasecmp("SendQueueLength", child->key) == 0)
+      cf_util_get_int(child, &cb->send_queue_length);
+    else if (strcasecmp("ReportStats", child->key) == 0)
+      cf_util_get_boolean(child, &cb->report_stats);
     else {
       ERROR("write_tsdb plugin: Invalid configuration "
             "option: %s.",
@@ -606,6 +637,36 @@ static int wt_config_tsd(oconfig_item_t *ci) {
     }
   }
 
+  if (cb->send_queue_length < 0) {
+    WARNING("write_tsdb plugin: \"SendQueueLength\" must not be negative. "
+            "Sending synchronously.");
+    cb->send_queue_length = 0;
+  }
+
+  if (cb->send_queue_length > 0) {
+    cb->sender = async_sender_create(&(async_sender_options_t){
+        .log_prefix = "write_tsdb plugin",
+        .node = cb->node != NULL ? cb->node : WT_DEFAULT_NODE,
+        .service = cb->service != NULL ? cb->service : WT_DEFAULT_SERVICE,
+        .socktype = SOCK_STREAM,
+        .buffer_size = sizeof(cb->send_buf),
+        .queue_length = (size_t)cb->send_queue_length,
+        .resolve_interval = resolve_interval,
+        .resolve_jitter = resolve_jitter,
+        .log_send_errors = true,
+    });
+    if (cb->sender == NULL) {
+      ERROR("write_tsdb plugin: async_sender_create failed.");
+      wt_callback_free(cb);
+      return -1;
+    }
+    wt_reset_buffer(cb);
+  } else if (cb->report_stats) {
+    WARNING("write_tsdb plugin: \"ReportStats\" requires \"SendQueueLength\" "
+            "and will be ignored.");
+    cb->report_stats = false;
+  }
+
   snprintf(callback_name, sizeof(callback_name), "write_tsdb/%s/%s",
            cb->node != NULL ? cb->node : WT_DEFAULT_NODE,
            cb->service != NULL ? cb->service : WT_DEFAULT_SERVICE);
@@ -617,6 +678,11 @@ static int wt_config_tsd(oconfig_item_t *ci) {
   user_data.free_func = NULL;
   plugin_register_flush(callback_name, wt_flush, &user_data);
 
+  if (cb->report_stats)
+    plugin_register_complex_read(/* group = */ NULL, callback_name,
+                                 wt_stats_read, /* interval = */ 0,
+                                 &user_data);
+
   return 0;
 }
 
@@ -628,7 +694,7 @@ static int wt_config(oconfig_item_t *ci) {
     oconfig_item_t *child = ci->children + i;
 
     if (strcasecmp("Node", child->key) == 0)
-      wt_config_tsd(child);
+      continue; /* handled below */
     else if (strcasecmp("ResolveInterval", child->key) == 0)
       cf_util_get_cdtime(child, &resolve_interval);
     else if (strcasecmp("ResolveJitter", child->key) == 0)
@@ -640,6 +706,15 @@ static int wt_config(oconfig_item_t *ci) {
     }
   }
 
+  /* Nodes are configured last, because their senders copy the resolve
+   * settings. */
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("Node", child->key) == 0)
+      wt_config_tsd(child);
+  }
+
   return 0;
 }
 
@@ -170,6 +170,43 @@ static int zookeeper_query(char *buffer, size_t buffer_size) {
   return status;
 } /* int zookeeper_query */
 
+struct zookeeper_stat_s {
+  const char *name;
+  const char *type;
+  const char *type_instance;
+  int ds_type;
+};
+typedef struct zookeeper_stat_s zookeeper_stat_t;
+
+/* Sorted by zookeeper_init(), so that lines can be looked up with bsearch(). */
+static zookeeper_stat_t zookeeper_stats[] = {
+    {"zk_avg_latency", "latency", "avg", DS_TYPE_GAUGE},
+    {"zk_min_latency", "latency", "min", DS_TYPE_GAUGE},
+    {"zk_max_latency", "latency", "max", DS_TYPE_GAUGE},
+    {"zk_packets_received", "packets", "received", DS_TYPE_DERIVE},
+    {"zk_packets_sent", "packets", "sent", DS_TYPE_DERIVE},
+    {"zk_num_alive_connections", "current_connections", NULL, DS_TYPE_GAUGE},
+    {"zk_outstanding_requests", "requests", "outstanding", DS_TYPE_GAUGE},
+    {"zk_znode_count", "gauge", "znode", DS_TYPE_GAUGE},
+    {"zk_watch_count", "gauge", "watch", DS_TYPE_GAUGE},
+    {"zk_ephemerals_count", "gauge", "ephemerals", DS_TYPE_GAUGE},
+    {"zk_open_file_descriptor_count", "file_handles", "open", DS_TYPE_GAUGE},
+    {"zk_max_file_descriptor_count", "file_handles", "max", DS_TYPE_GAUGE},
+    {"zk_approximate_data_size", "bytes", "approximate_data_size",
+     DS_TYPE_GAUGE},
+    {"zk_followers", "count", "followers", DS_TYPE_GAUGE},
+    {"zk_synced_followers", "count", "synced_followers", DS_TYPE_GAUGE},
+    {"zk_pending_syncs", "count", "pending_syncs", DS_TYPE_GAUGE},
+    {"zk_last_proposal_size", "bytes", "last_proposal", DS_TYPE_GAUGE},
+    {"zk_min_proposal_size", "bytes", "min_proposal", DS_TYPE_GAUGE},
+    {"zk_max_proposal_size", "bytes", "max_proposal", DS_TYPE_GAUGE},
+};
+
+static int zookeeper_stat_compare(const void *a, const void *b) {
+  return strcmp(((const zookeeper_stat_t *)a)->name,
+                ((const zookeeper_stat_t *)b)->name);
+} /* int zookeeper_stat_compare */
+
 static int zookeeper_read(void) {
   char buf[4096];
   char *ptr;
@@ -190,51 +227,24 @@ static int zookeeper_read(void) {
     if (strsplit(line, fields, 2) != 2) {
       continue;
     }
-#define FIELD_CHECK(check, expected)                                           \
-  (strncmp(check, expected, strlen(expected)) == 0)
-
-    if (FIELD_CHECK(fields[0], "zk_avg_latency")) {
-      zookeeper_submit_gauge("latency", "avg", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_min_latency")) {
-      zookeeper_submit_gauge("latency", "min", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_max_latency")) {
-      zookeeper_submit_gauge("latency", "max", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_packets_received")) {
-      zookeeper_submit_derive("packets", "received", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_packets_sent")) {
-      zookeeper_submit_derive("packets", "sent", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_num_alive_connections")) {
-      zookeeper_submit_gauge("current_connections", NULL, atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_outstanding_requests")) {
-      zookeeper_submit_gauge("requests", "outstanding", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_znode_count")) {
-      zookeeper_submit_gauge("gauge", "znode", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_watch_count")) {
-      zookeeper_submit_gauge("gauge", "watch", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_ephemerals_count")) {
-      zookeeper_submit_gauge("gauge", "ephemerals", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_open_file_descriptor_count")) {
-      zookeeper_submit_gauge("file_handles", "open", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_max_file_descriptor_count")) {
-      zookeeper_submit_gauge("file_handles", "max", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_approximate_data_size")) {
-      zookeeper_submit_gauge("bytes", "approximate_data_size", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_followers")) {
-      followers = atol(fields[1]);
-      zookeeper_submit_gauge("count", "followers", followers);
-    } else if (FIELD_CHECK(fields[0], "zk_synced_followers")) {
-      zookeeper_submit_gauge("count", "synced_followers", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_pending_syncs")) {
-      zookeeper_submit_gauge("count", "pending_syncs", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_last_proposal_size")) {
-      zookeeper_submit_gauge("bytes", "last_proposal", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_min_proposal_size")) {
-      zookeeper_submit_gauge("bytes", "min_proposal", atol(fields[1]));
-    } else if (FIELD_CHECK(fields[0], "zk_max_proposal_size")) {
-      zookeeper_submit_gauge("bytes", "max_proposal", atol(fields[1]));
-    } else {
+
+    zookeeper_stat_t *m = bsearch(
+        &(zookeeper_stat_t){.name = fields[0]}, zookeeper_stats,
+        STATIC_ARRAY_SIZE(zookeeper_stats), sizeof(zookeeper_stats[0]),
+        zookeeper_stat_compare);
+    if (m == NULL) {
       DEBUG("Uncollected zookeeper MNTR field %s", fields[0]);
+      continue;
     }
+
+    long value = atol(fields[1]);
+    if (m->ds_type == DS_TYPE_DERIVE)
+      zookeeper_submit_derive(m->type, m->type_instance, value);
+    else
+      zookeeper_submit_gauge(m->type, m->type_instance, value);
+
+    if (strcmp("zk_followers", m->name) == 0)
+      followers = value;
   }
   /* Reports 0 for followers, # when zk_followers present. Intended to be used
    * for quorum detection by taking max for each time period. */
@@ -243,8 +253,15 @@ static int zookeeper_read(void) {
   return 0;
 } /* zookeeper_read */
 
+static int zookeeper_init(void) {
+  qsort(zookeeper_stats, STATIC_ARRAY_SIZE(zookeeper_stats),
+        sizeof(zookeeper_stats[0]), zookeeper_stat_compare);
+  return 0;
+} /* zookeeper_init */
+
 void module_register(void) {
   plugin_register_config("zookeeper", zookeeper_config, config_keys,
                          config_keys_num);
+  plugin_register_init("zookeeper", zookeeper_init);
   plugin_register_read("zookeeper", zookeeper_read);
 } /* void module_register */